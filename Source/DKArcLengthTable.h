@@ -0,0 +1,112 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/// opaque types used internally by the table
+
+typedef struct _DKArcLengthSegment DKArcLengthSegment;
+typedef struct _DKArcLengthSample DKArcLengthSample;
+
+/** @brief Maps distances along a path to points on it, and back.
+
+ Methods such as -pointOnPathAtLength:slope: measure the path from the start on every call. A placement loop that calls them for each
+ glyph, motif or link is therefore quadratic. An arc length table measures the path once. It records the cumulative length at each point
+ where a curve is flat enough to be treated as straight, along with that point's curve parameter. Later lookups binary search those samples
+ and evaluate the curve at the interpolated parameter, so each one is O(log n) and gives the exact position and tangent.
+
+ The table is a snapshot; it does not track later changes to the path. Use +arcLengthTableForPath:cache: to keep one in a rendering cache,
+ where it is rebuilt only when the path's checksum changes.
+*/
+@interface DKArcLengthTable : NSObject {
+@private
+	DKArcLengthSegment* mSegments;
+	NSUInteger mSegmentCount;
+	NSUInteger mSegmentCapacity;
+	DKArcLengthSample* mSamples;
+	NSUInteger mSampleCount;
+	NSUInteger mSampleCapacity;
+	NSUInteger mChecksum;
+}
+
+/** @brief Returns a table for the path, reusing one stored in the cache if the path hasn't changed
+
+ The table is stored in <cache> along with the path's checksum and returned again while the checksum stays the same.
+ @param path the path
+ @param cache a mutable dictionary such as a renderable object's rendering cache, or nil to not cache the table
+ @return an arc length table for the path
+ */
++ (DKArcLengthTable*)arcLengthTableForPath:(NSBezierPath*)path cache:(NSMutableDictionary*)cache;
+
+/** @brief Returns a new table for the path
+ @param path the path
+ @return an autoreleased arc length table
+ */
++ (DKArcLengthTable*)arcLengthTableWithPath:(NSBezierPath*)path;
+
+/** @brief Initializes the table by measuring the path
+
+ Curves are divided until the difference between their control polygon and chord is less than <maxError>, the same criterion that
+ -[NSBezierPath lengthWithMaximumError:] uses, so the table's length agrees with that method.
+ @param path the path to measure
+ @param maxError the maximum error allowed in the length of each curve section
+ @return the table
+ */
+- (id)initWithPath:(NSBezierPath*)path maximumError:(CGFloat)maxError;
+
+/** @brief The total length of the path
+ @return the length
+ */
+- (CGFloat)length;
+
+/** @brief The checksum of the path when the table was built
+ @return the path's checksum
+ */
+- (NSUInteger)checksum;
+
+/** @brief Returns the point and slope at a given distance along the path
+
+ Distances outside the path's length are clamped to its ends. This is equivalent to -[NSBezierPath pointOnPathAtLength:slope:].
+ @param length the distance from the start of the path
+ @param slope if not NULL, receives the angle of the path's tangent at that point, in radians
+ @return the point, or NSZeroPoint if the path has no length-bearing elements
+ */
+- (NSPoint)pointAtLength:(CGFloat)length slope:(CGFloat*)slope;
+
+/** @brief Returns the points and slopes at regular distances along the path
+
+ All the points are found in a single pass over the table, so this is much quicker than calling -pointAtLength:slope: for each distance
+ in turn. Points are placed at <start>, <start> + <interval> and so on, for as long as the distance is within the path's length. Long
+ runs can be fetched in batches by starting each batch where the last one stopped.
+ @param points receives up to <count> points
+ @param slopes if not NULL, receives up to <count> slopes in radians
+ @param start the distance along the path of the first point
+ @param interval the distance between points, which must be greater than zero
+ @param count the capacity of the arrays
+ @return the number of points returned
+ */
+- (NSUInteger)getPoints:(NSPoint*)points slopes:(CGFloat*)slopes fromLength:(CGFloat)start interval:(CGFloat)interval count:(NSUInteger)count;
+
+/** @brief Returns the distance along the path to a point given as an element and curve parameter
+
+ This is the inverse of -pointAtLength:slope:, for use with the results of -[NSBezierPath elementHitByPoint:tolerance:tValue:].
+ @param element the index of a line, curve or close element in the path
+ @param t the parameter within that element, from 0 to 1
+ @return the distance from the start of the path, or -1 if the element doesn't exist
+ */
+- (CGFloat)lengthAtElement:(NSInteger)element t:(CGFloat)t;
+
+/** @brief Appends the part of the path between two distances along it to another path
+
+ The section is appended as a new subpath, starting with a move. Curves are split at the exact parameters of its ends, so it follows
+ the original path precisely. A section of no length appends the move and a segment of no length, which draws as a dot with round caps.
+ @param start the distance from the start of the path to the section's start
+ @param end the distance from the start of the path to the section's end
+ @param path the path to append to
+ */
+- (void)appendSectionFromLength:(CGFloat)start toLength:(CGFloat)end toPath:(NSBezierPath*)path;
+
+@end
@@ -0,0 +1,435 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKArcLengthTable.h"
+#import "DKDrawKitMacros.h"
+#import "DKGeometryUtilities.h"
+#import "NSBezierPath+Editing.h"
+#import "NSBezierPath+Geometry.h"
+#include <tgmath.h>
+
+#define kDKArcLengthDefaultMaximumError 0.1 // matches the tolerance used by -[NSBezierPath length]
+#define kDKArcLengthMaximumDepth 16
+
+static NSString* kDKArcLengthTableCacheKey = @"DKArcLengthTable";
+
+// a line, curve or close element of the path. Lines are stored as curves with their control points on the ends.
+
+struct _DKArcLengthSegment {
+	NSPoint bez[4];
+	NSInteger element;
+	NSUInteger firstSample;
+	BOOL isCurve;
+};
+
+// the cumulative length at a parameter value within a segment
+
+struct _DKArcLengthSample {
+	CGFloat length;
+	CGFloat t;
+	NSUInteger segment;
+};
+
+// evaluates a segment and, if <slope> isn't NULL, its tangent angle at <t>
+
+static NSPoint PointOnSegment(const DKArcLengthSegment* segment, CGFloat t, CGFloat* slope)
+{
+	const NSPoint* b = segment->bez;
+	CGFloat mt = 1.0 - t;
+	NSPoint p;
+
+	p.x = (mt * mt * mt * b[0].x) + (3.0 * mt * mt * t * b[1].x) + (3.0 * mt * t * t * b[2].x) + (t * t * t * b[3].x);
+	p.y = (mt * mt * mt * b[0].y) + (3.0 * mt * mt * t * b[1].y) + (3.0 * mt * t * t * b[2].y) + (t * t * t * b[3].y);
+
+	if (slope) {
+		if (segment->isCurve) {
+			CGFloat dx = (3.0 * mt * mt * (b[1].x - b[0].x)) + (6.0 * mt * t * (b[2].x - b[1].x)) + (3.0 * t * t * (b[3].x - b[2].x));
+			CGFloat dy = (3.0 * mt * mt * (b[1].y - b[0].y)) + (6.0 * mt * t * (b[2].y - b[1].y)) + (3.0 * t * t * (b[3].y - b[2].y));
+
+			// where a control point coincides with its end point the derivative vanishes there, so use the direction to the other control point
+
+			if (dx == 0.0 && dy == 0.0)
+				*slope = (t < 0.5) ? Slope(b[0], b[2]) : Slope(b[1], b[3]);
+			else
+				*slope = atan2(dy, dx);
+		} else
+			*slope = Slope(b[0], b[3]);
+	}
+
+	return p;
+}
+
+@interface DKArcLengthTable (Private)
+
+- (void)addSegment:(const NSPoint*)bez element:(NSInteger)element isCurve:(BOOL)curve;
+- (void)addSampleAtLength:(CGFloat)length t:(CGFloat)t;
+- (void)sampleCurve:(const NSPoint*)bez from:(CGFloat)t0 to:(CGFloat)t1 maximumError:(CGFloat)maxError depth:(NSUInteger)depth;
+- (NSUInteger)segmentAtLength:(CGFloat)length t:(CGFloat*)t;
+
+@end
+
+#pragma mark -
+
+@implementation DKArcLengthTable
+
++ (DKArcLengthTable*)arcLengthTableForPath:(NSBezierPath*)path cache:(NSMutableDictionary*)cache
+{
+	DKArcLengthTable* table = [cache objectForKey:kDKArcLengthTableCacheKey];
+
+	if (table == nil || [table checksum] != [path checksum]) {
+		table = [self arcLengthTableWithPath:path];
+		[cache setObject:table
+				  forKey:kDKArcLengthTableCacheKey];
+	}
+
+	return table;
+}
+
++ (DKArcLengthTable*)arcLengthTableWithPath:(NSBezierPath*)path
+{
+	return [[[self alloc] initWithPath:path
+						  maximumError:kDKArcLengthDefaultMaximumError] autorelease];
+}
+
+- (id)initWithPath:(NSBezierPath*)path maximumError:(CGFloat)maxError
+{
+	self = [super init];
+	if (self) {
+		NSInteger i, ec = [path elementCount];
+		NSPoint ap[3], bez[4];
+		NSPoint lastPoint = NSZeroPoint, pointForClose = NSZeroPoint;
+		CGFloat length = 0.0;
+
+		mChecksum = [path checksum];
+
+		for (i = 0; i < ec; ++i) {
+			NSBezierPathElement element = [path elementAtIndex:i
+											  associatedPoints:ap];
+
+			switch (element) {
+			case NSMoveToBezierPathElement:
+				pointForClose = lastPoint = ap[0];
+				break;
+
+			case NSClosePathBezierPathElement:
+				ap[0] = pointForClose;
+			// fall through
+
+			case NSLineToBezierPathElement:
+				bez[0] = bez[1] = lastPoint;
+				bez[2] = bez[3] = ap[0];
+
+				[self addSegment:bez
+						 element:i
+						 isCurve:NO];
+				[self addSampleAtLength:length
+									  t:0.0];
+
+				length += hypot(ap[0].x - lastPoint.x, ap[0].y - lastPoint.y);
+
+				[self addSampleAtLength:length
+									  t:1.0];
+				lastPoint = ap[0];
+				break;
+
+			case NSCurveToBezierPathElement:
+				bez[0] = lastPoint;
+				bez[1] = ap[0];
+				bez[2] = ap[1];
+				bez[3] = ap[2];
+
+				[self addSegment:bez
+						 element:i
+						 isCurve:YES];
+				[self addSampleAtLength:length
+									  t:0.0];
+				[self sampleCurve:bez
+							 from:0.0
+							   to:1.0
+					 maximumError:maxError
+							depth:0];
+				length = mSamples[mSampleCount - 1].length;
+				lastPoint = ap[2];
+				break;
+
+			default:
+				break;
+			}
+		}
+	}
+
+	return self;
+}
+
+- (CGFloat)length
+{
+	return (mSampleCount > 0) ? mSamples[mSampleCount - 1].length : 0.0;
+}
+
+- (NSUInteger)checksum
+{
+	return mChecksum;
+}
+
+- (NSPoint)pointAtLength:(CGFloat)length slope:(CGFloat*)slope
+{
+	if (mSampleCount == 0)
+		return NSZeroPoint;
+
+	CGFloat t;
+	NSUInteger segment = [self segmentAtLength:length
+											 t:&t];
+
+	return PointOnSegment(&mSegments[segment], t, slope);
+}
+
+- (NSUInteger)getPoints:(NSPoint*)points slopes:(CGFloat*)slopes fromLength:(CGFloat)start interval:(CGFloat)interval count:(NSUInteger)count
+{
+	NSAssert(interval > 0.0, @"interval must be greater than zero");
+
+	if (mSampleCount == 0 || points == NULL)
+		return 0;
+
+	// find the first sample at or beyond <start>. The distances only increase from there, so the search for each later one carries on
+	// from where the last finished rather than starting again.
+
+	CGFloat total = [self length];
+	NSUInteger n, s = 0, hi = mSampleCount, mid;
+
+	start = MAX(start, 0.0);
+
+	while (s < hi) {
+		mid = (s + hi) / 2;
+
+		if (mSamples[mid].length < start)
+			s = mid + 1;
+		else
+			hi = mid;
+	}
+
+	s = MIN(s, mSampleCount - 1);
+
+	for (n = 0; n < count; ++n) {
+		CGFloat length = start + interval * n;
+
+		if (length > total)
+			break;
+
+		while (s < mSampleCount - 1 && mSamples[s].length < length)
+			++s;
+
+		const DKArcLengthSample* sample = &mSamples[s];
+		CGFloat t = sample->t;
+
+		if (s > 0 && mSamples[s - 1].segment == sample->segment) {
+			const DKArcLengthSample* prev = &mSamples[s - 1];
+			CGFloat span = sample->length - prev->length;
+
+			if (span > 0.0)
+				t = prev->t + (sample->t - prev->t) * ((length - prev->length) / span);
+		}
+
+		points[n] = PointOnSegment(&mSegments[sample->segment], t, slopes ? &slopes[n] : NULL);
+	}
+
+	return n;
+}
+
+- (CGFloat)lengthAtElement:(NSInteger)element t:(CGFloat)t
+{
+	// segments are in element order, with gaps for move elements
+
+	NSUInteger lo = 0, hi = mSegmentCount, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+
+		if (mSegments[mid].element < element)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo >= mSegmentCount || mSegments[lo].element != element)
+		return -1.0;
+
+	NSUInteger first = mSegments[lo].firstSample;
+	NSUInteger last = (lo + 1 < mSegmentCount) ? mSegments[lo + 1].firstSample : mSampleCount;
+	NSUInteger i;
+
+	t = LIMIT(t, 0.0, 1.0);
+
+	for (i = first + 1; i < last; ++i) {
+		if (mSamples[i].t >= t) {
+			const DKArcLengthSample* prev = &mSamples[i - 1];
+			CGFloat dt = mSamples[i].t - prev->t;
+
+			if (dt <= 0.0)
+				return mSamples[i].length;
+
+			return prev->length + (mSamples[i].length - prev->length) * ((t - prev->t) / dt);
+		}
+	}
+
+	return mSamples[last - 1].length;
+}
+
+- (void)appendSectionFromLength:(CGFloat)start toLength:(CGFloat)end toPath:(NSBezierPath*)path
+{
+	if (mSampleCount == 0)
+		return;
+
+	CGFloat t0, t1;
+	NSUInteger first = [self segmentAtLength:start
+										   t:&t0];
+	NSUInteger last = [self segmentAtLength:MAX(start, end)
+										  t:&t1];
+	NSUInteger i;
+
+	for (i = first; i <= last; ++i) {
+		const DKArcLengthSegment* seg = &mSegments[i];
+		CGFloat from = (i == first) ? t0 : 0.0;
+		CGFloat to = (i == last) ? t1 : 1.0;
+		NSPoint bez[4], left[4], right[4];
+
+		// cut the part from <from> to <to> out of the segment, first dropping what's before <from> and then what's after <to>,
+		// whose parameter in the remaining part is rescaled accordingly
+
+		memcpy(bez, seg->bez, sizeof(bez));
+
+		if (from > 0.0) {
+			subdivideBezierAtT(bez, left, right, from);
+			memcpy(bez, right, sizeof(bez));
+		}
+
+		if (to < 1.0) {
+			CGFloat tt = (from < 1.0) ? (to - from) / (1.0 - from) : 0.0;
+
+			subdivideBezierAtT(bez, left, right, tt);
+			memcpy(bez, left, sizeof(bez));
+		}
+
+		if (i == first)
+			[path moveToPoint:bez[0]];
+
+		if (seg->isCurve)
+			[path curveToPoint:bez[3]
+				 controlPoint1:bez[1]
+				 controlPoint2:bez[2]];
+		else
+			[path lineToPoint:bez[3]];
+	}
+}
+
+#pragma mark -
+
+- (NSUInteger)segmentAtLength:(CGFloat)length t:(CGFloat*)t
+{
+	length = LIMIT(length, 0.0, [self length]);
+
+	// find the first sample at or beyond <length>
+
+	NSUInteger lo = 0, hi = mSampleCount, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+
+		if (mSamples[mid].length < length)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	hi = MIN(lo, mSampleCount - 1);
+
+	const DKArcLengthSample* sample = &mSamples[hi];
+
+	*t = sample->t;
+
+	if (hi > 0 && mSamples[hi - 1].segment == sample->segment) {
+		const DKArcLengthSample* prev = &mSamples[hi - 1];
+		CGFloat span = sample->length - prev->length;
+
+		if (span > 0.0)
+			*t = prev->t + (sample->t - prev->t) * ((length - prev->length) / span);
+	}
+
+	return sample->segment;
+}
+
+- (void)addSegment:(const NSPoint*)bez element:(NSInteger)element isCurve:(BOOL)curve
+{
+	if (mSegmentCount >= mSegmentCapacity) {
+		mSegmentCapacity = MAX(mSegmentCapacity * 2, 16U);
+		mSegments = realloc(mSegments, mSegmentCapacity * sizeof(DKArcLengthSegment));
+	}
+
+	DKArcLengthSegment* seg = &mSegments[mSegmentCount++];
+
+	memcpy(seg->bez, bez, sizeof(seg->bez));
+	seg->element = element;
+	seg->firstSample = mSampleCount;
+	seg->isCurve = curve;
+}
+
+- (void)addSampleAtLength:(CGFloat)length t:(CGFloat)t
+{
+	if (mSampleCount >= mSampleCapacity) {
+		mSampleCapacity = MAX(mSampleCapacity * 2, 64U);
+		mSamples = realloc(mSamples, mSampleCapacity * sizeof(DKArcLengthSample));
+	}
+
+	DKArcLengthSample* sample = &mSamples[mSampleCount++];
+
+	sample->length = length;
+	sample->t = t;
+	sample->segment = mSegmentCount - 1;
+}
+
+- (void)sampleCurve:(const NSPoint*)bez from:(CGFloat)t0 to:(CGFloat)t1 maximumError:(CGFloat)maxError depth:(NSUInteger)depth
+{
+	// <bez> is the section of the segment from t0 to t1. As in lengthOfBezier(), it is split in half until the control polygon is close to the chord,
+	// and then its length is taken as the mean of the two.
+
+	CGFloat chordLen = hypot(bez[3].x - bez[0].x, bez[3].y - bez[0].y);
+	CGFloat polyLen = 0.0;
+	NSUInteger n;
+
+	for (n = 0; n < 3; ++n)
+		polyLen += hypot(bez[n + 1].x - bez[n].x, bez[n + 1].y - bez[n].y);
+
+	if ((polyLen - chordLen) > maxError && depth < kDKArcLengthMaximumDepth) {
+		NSPoint left[4], right[4];
+		CGFloat tm = (t0 + t1) * 0.5;
+
+		subdivideBezierAtT(bez, left, right, 0.5);
+
+		[self sampleCurve:left
+					 from:t0
+					   to:tm
+			 maximumError:maxError
+					depth:depth + 1];
+		[self sampleCurve:right
+					 from:tm
+					   to:t1
+			 maximumError:maxError
+					depth:depth + 1];
+	} else
+		[self addSampleAtLength:mSamples[mSampleCount - 1].length + 0.5 * (polyLen + chordLen)
+							  t:t1];
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	free(mSegments);
+	free(mSamples);
+	[super dealloc];
+}
+
+@end
@@ -23,6 +23,7 @@ typedef enum {
 	CGFloat mEndAngle;
 	NSPoint mCentre;
 	DKArcPathType mArcType;
+	BOOL mPathNeedsCalculating; // YES once the parameters have changed, until the path is next asked for
 }
 
 - (void)setRadius:(CGFloat)rad;
@@ -12,16 +12,23 @@
 #import "DKObjectDrawingLayer.h"
 #import "LogEvent.h"
 #import "DKDrawkitMacros.h"
+#import "DKObjectSnapshot.h"
 #include <tgmath.h>
 
 @interface DKArcPath (Private)
 
-/** @brief Sets the path based on the current arc parameters
+/** @brief Makes the path from the current arc parameters
 
- Calls setPath: which is recorded by undo
+ Not recorded by undo - the parameters' setters are. Called when the path is next asked for after the parameters have changed, so
+ however many times they change while a knob is dragged, the path is made once for each time the arc is drawn.
  */
 - (void)calculatePath;
 
+/** @brief Discards the path and notifies the change, once the arc parameters have been changed
+ @param oldBounds the bounds before the parameters changed
+ */
+- (void)arcParametersDidChangeFromBounds:(NSRect)oldBounds;
+
 /** @brief Adjusts the arc parameters based on the mouse location passed and the partcode, etc.
 
  Called from mouseDragged: to implement interactive editing
@@ -33,6 +40,53 @@
 
 @end
 
+static NSRect arcBounds(NSPoint centre, CGFloat radius, CGFloat startAngle, CGFloat endAngle, DKArcPathType arcType)
+{
+	// the bounds of the arc's path, found from the parameters: its end points, the centre of a wedge, and the
+	// points at each quarter turn that the arc passes through. Angles are in degrees, as the path is made with.
+
+	if (arcType == kDKArcPathCircle)
+		return NSMakeRect(centre.x - radius, centre.y - radius, radius * 2.0, radius * 2.0);
+
+	CGFloat sweep = fmod(endAngle - startAngle, 360.0);
+
+	if (sweep <= 0.0)
+		sweep += 360.0;
+
+	CGFloat minX, maxX, minY, maxY, a;
+	NSPoint p;
+
+	p.x = centre.x + cos(DEGREES_TO_RADIANS(startAngle)) * radius;
+	p.y = centre.y + sin(DEGREES_TO_RADIANS(startAngle)) * radius;
+	minX = maxX = p.x;
+	minY = maxY = p.y;
+
+	p.x = centre.x + cos(DEGREES_TO_RADIANS(startAngle + sweep)) * radius;
+	p.y = centre.y + sin(DEGREES_TO_RADIANS(startAngle + sweep)) * radius;
+	minX = MIN(minX, p.x);
+	maxX = MAX(maxX, p.x);
+	minY = MIN(minY, p.y);
+	maxY = MAX(maxY, p.y);
+
+	for (a = ceil(startAngle / 90.0) * 90.0; a < startAngle + sweep; a += 90.0) {
+		p.x = centre.x + cos(DEGREES_TO_RADIANS(a)) * radius;
+		p.y = centre.y + sin(DEGREES_TO_RADIANS(a)) * radius;
+		minX = MIN(minX, p.x);
+		maxX = MAX(maxX, p.x);
+		minY = MIN(minY, p.y);
+		maxY = MAX(maxY, p.y);
+	}
+
+	if (arcType == kDKArcPathWedge) {
+		minX = MIN(minX, centre.x);
+		maxX = MAX(maxX, centre.x);
+		minY = MIN(minY, centre.y);
+		maxY = MAX(maxY, centre.y);
+	}
+
+	return NSMakeRect(minX, minY, maxX - minX, maxY - minY);
+}
+
 #pragma mark -
 
 @implementation DKArcPath
@@ -46,9 +100,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (rad != [self radius]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setRadius:[self radius]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mRadius = rad;
-		[self calculatePath];
+		[self arcParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Arc Radius", @"undo string for change arc radius")];
 	}
 }
@@ -70,9 +125,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (sa != [self startAngle]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setStartAngle:[self startAngle]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mStartAngle = DEGREES_TO_RADIANS(sa);
-		[self calculatePath];
+		[self arcParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Arc Angle", @"undo string for change arc angle")];
 	}
 }
@@ -94,9 +150,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (ea != [self endAngle]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setEndAngle:[self endAngle]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mEndAngle = DEGREES_TO_RADIANS(ea);
-		[self calculatePath];
+		[self arcParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Arc Angle", @"undo string for change arc angle")];
 	}
 }
@@ -119,9 +176,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (arcType != [self arcType]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setArcType:[self arcType]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mArcType = arcType;
-		[self calculatePath];
+		[self arcParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Arc Type", @"undo string for change arc type")];
 	}
 }
@@ -164,7 +222,18 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 			[arcPath closePath];
 		}
 	}
-	[self setPath:arcPath];
+
+	mPathNeedsCalculating = NO;
+	[self setPathWithoutUndo:arcPath];
+}
+
+- (void)arcParametersDidChangeFromBounds:(NSRect)oldBounds
+{
+	mPathNeedsCalculating = YES;
+	[self setPathWithoutUndo:nil];
+
+	[self notifyVisualChange];
+	[self notifyGeometryChange:oldBounds];
 }
 
 - (void)movePart:(NSInteger)pc toPoint:(NSPoint)mp constrainAngle:(BOOL)constrain
@@ -235,6 +304,28 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 #pragma mark -
 #pragma mark - as a DKDrawablePath
 
+- (void)setPath:(NSBezierPath*)path
+{
+	mPathNeedsCalculating = NO;
+	[super setPath:path];
+}
+
+- (NSBezierPath*)path
+{
+	if (mPathNeedsCalculating)
+		[self calculatePath];
+
+	return [super path];
+}
+
+- (DKPathGeometry*)pathGeometry
+{
+	if (mPathNeedsCalculating)
+		[self calculatePath];
+
+	return [super pathGeometry];
+}
+
 /** @brief Draws the selection knobs as required
  @param path not used
  @param knobs the knobs object to use for drawing
@@ -300,6 +391,7 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 	BOOL loop = YES, constrain = NO;
 	NSInteger phase;
 	NSPoint p, lp, nsp;
+	NSRect oldBounds;
 	NSString* abbrUnits = [[self drawing] abbreviatedDrawingUnits];
 
 	p = mCentre = [self snappedMousePoint:initialPoint
@@ -353,13 +445,14 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 		} break;
 
 		case NSMouseMoved:
+			oldBounds = [self bounds];
 			[self notifyVisualChange];
 			[view autoscroll:theEvent];
 			if (phase == 0) {
 				mRadius = hypotf(p.x - mCentre.x, p.y - mCentre.y);
 
 				if ([self arcType] == kDKArcPathCircle)
-					[self calculatePath];
+					[self arcParametersDidChangeFromBounds:oldBounds];
 				else
 					[self setAngle:atan2f(p.y - mCentre.y, p.x - mCentre.x)];
 
@@ -375,7 +468,7 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 				}
 			} else if (phase == 1) {
 				mStartAngle = atan2f(p.y - mCentre.y, p.x - mCentre.x);
-				[self calculatePath];
+				[self arcParametersDidChangeFromBounds:oldBounds];
 
 				if ([[self class] displaysSizeInfoWhenDragging]) {
 					CGFloat rad = [[self drawing] convertLength:mRadius];
@@ -640,9 +733,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (!NSEqualPoints(p, mCentre) && ![self locked] && ![self locationLocked]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setLocation:[self location]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mCentre = p;
-		[self calculatePath];
+		[self arcParametersDidChangeFromBounds:oldBounds];
 	}
 }
 
@@ -653,7 +747,9 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
  */
 - (NSRect)bounds
 {
-	NSRect pb = [[self path] bounds];
+	// found from the parameters, so that the path needn't be made to find out where it is
+
+	NSRect pb = arcBounds(mCentre, mRadius, [self startAngle], [self endAngle], [self arcType]);
 	NSRect kr;
 
 	CGFloat tol = [[[self layer] knobs] controlKnobSize].width;
@@ -687,10 +783,11 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 
 	if (da != 0.0) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setAngle:[self angle]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mStartAngle += da;
 		mEndAngle += da;
-		[self calculatePath];
+		[self arcParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Rotate Arc", @"undo string for rotate arc")];
 	}
 }
@@ -781,6 +878,28 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 	mCentre = [transform transformPoint:mCentre];
 }
 
+- (DKGeometrySnapshot*)geometrySnapshot
+{
+	// the path is derived from the parameters, but its geometry is kept as well so that it needn't be recalculated on restoring
+
+	CGFloat values[5] = { mCentre.x, mCentre.y, mRadius, mStartAngle, mEndAngle };
+
+	return [DKGeometrySnapshot snapshotWithPath:nil
+										 object:[self pathGeometry]
+										 values:values
+										  count:5];
+}
+
+- (void)restoreGeometrySnapshot:(DKGeometrySnapshot*)snapshot
+{
+	mPathNeedsCalculating = NO;
+	mCentre = NSMakePoint([snapshot valueAtIndex:0], [snapshot valueAtIndex:1]);
+	mRadius = [snapshot valueAtIndex:2];
+	mStartAngle = [snapshot valueAtIndex:3];
+	mEndAngle = [snapshot valueAtIndex:4];
+	[super restoreGeometrySnapshot:snapshot];
+}
+
 #pragma mark -
 #pragma mark - as a NSObject
 
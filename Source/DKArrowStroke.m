@@ -12,6 +12,7 @@
 #import "NSBezierPath+Text.h"
 #import "NSBezierPath+Editing.h"
 #import "DKShapeFactory.h"
+#import "DKArcLengthTable.h"
 #import "NSShadow+Scaling.h"
 
 #pragma mark Static Vars
@@ -310,9 +311,10 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 	return [path bezierPathByReversingPath];
 }
 
-- (NSBezierPath*)arrowHeadForPath:(NSBezierPath*)path ofKind:(DKArrowHeadKind)kind orientation:(BOOL)flip multiple:(NSInteger)n
+- (NSBezierPath*)arrowHeadForPath:(NSBezierPath*)path lengths:(DKArcLengthTable*)lengths ofKind:(DKArrowHeadKind)kind orientation:(BOOL)flip multiple:(NSInteger)n
 {
-	// this method returns the arrow head element indicated by the parameters
+	// this method returns the arrow head element indicated by the parameters. <lengths> is the arc length table of <path>, used to place heads
+	// on it without measuring it again
 
 	NSAssert(path != nil, @"can't make arrow heads for a nil path");
 
@@ -343,11 +345,11 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 			NSPoint ep;
 
 			if (flip)
-				ep = [path pointOnPathAtLength:[path length]
-										 slope:&slope];
+				ep = [lengths pointAtLength:[lengths length]
+									  slope:&slope];
 			else
-				ep = [path pointOnPathAtLength:0.0
-										 slope:&slope];
+				ep = [lengths pointAtLength:0.0
+									  slope:&slope];
 
 			NSAffineTransform* tfm = [NSAffineTransform transform];
 			[tfm translateXBy:ep.x
@@ -396,7 +398,7 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 				CGFloat adjustment;
 				CGFloat slope;
 
-				pathLength = flip ? [path length] : 0.0;
+				pathLength = flip ? [lengths length] : 0.0;
 
 				// adjustment is the amount of offset applied from the end of the path according to the multiple factor n
 
@@ -409,8 +411,8 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 
 				// get the path point and slope at this position along the path
 
-				NSPoint sp = [path pointOnPathAtLength:pathLength
-												 slope:&slope];
+				NSPoint sp = [lengths pointAtLength:pathLength
+											  slope:&slope];
 
 				// flipped heads point the other way
 
@@ -459,21 +461,23 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 	}
 }
 
-- (NSBezierPath*)arrowHeadForPathStart:(NSBezierPath*)path
+- (NSBezierPath*)arrowHeadForPathStart:(NSBezierPath*)path lengths:(DKArcLengthTable*)lengths
 {
 	// returns the arrow head path for the start, translated, scaled etc to the right place
 
 	return [self arrowHeadForPath:path
+						  lengths:lengths
 						   ofKind:[self arrowHeadAtStart]
 					  orientation:NO
 						 multiple:0];
 }
 
-- (NSBezierPath*)arrowHeadForPathEnd:(NSBezierPath*)path
+- (NSBezierPath*)arrowHeadForPathEnd:(NSBezierPath*)path lengths:(DKArcLengthTable*)lengths
 {
 	// returns the arrow head path for the end, translated, scaled etc to the right place
 
 	return [self arrowHeadForPath:path
+						  lengths:lengths
 						   ofKind:[self arrowHeadAtEnd]
 					  orientation:YES
 						 multiple:0];
@@ -492,22 +496,33 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 	if ([inPath elementCount] < 2)
 		return nil;
 
+	DKArcLengthTable* lengths = [DKArcLengthTable arcLengthTableWithPath:inPath];
 	CGFloat trimStart, trimEnd;
 
 	trimStart = [self trimLengthForKind:[self arrowHeadAtStart]];
 	trimEnd = [self trimLengthForKind:[self arrowHeadAtEnd]];
 
+	// the path is measured once, and the shaft is cut from it and the heads placed on it using that. Cutting a section out of a path of
+	// several subpaths would join them, so those are trimmed by the path itself
+
 	NSBezierPath* shaft = inPath; // shaft of the arrow will become the new path
 
-	if (trimStart > 0.0)
-		shaft = [shaft bezierPathByTrimmingFromLength:trimStart];
+	if ((trimStart > 0.0 || trimEnd > 0.0) && [inPath countSubPaths] == 1 && [lengths length] - trimStart - trimEnd > 0.0) {
+		shaft = [NSBezierPath bezierPath];
+		[lengths appendSectionFromLength:trimStart
+								toLength:[lengths length] - trimEnd
+								  toPath:shaft];
+	} else {
+		if (trimStart > 0.0)
+			shaft = [shaft bezierPathByTrimmingFromLength:trimStart];
 
-	if (trimEnd > 0.0)
-		shaft = [shaft bezierPathByTrimmingToLength:[shaft length] - trimEnd];
+		if (trimEnd > 0.0)
+			shaft = [shaft bezierPathByTrimmingToLength:[shaft length] - trimEnd];
+	}
 
 	// check that the path hasn't been trimmed to nothing
 
-	if (shaft == nil || [shaft elementCount] < 2 || [shaft length] <= 0.0)
+	if (shaft == nil || [shaft elementCount] < 2 || [lengths length] - trimStart - trimEnd <= 0.0)
 		return nil;
 
 	// copy the path at this point for use with later dimensioning text calculation
@@ -541,10 +556,12 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 	[shaft setWindingRule:NSNonZeroWindingRule];
 
 	if ([self arrowHeadAtStart] != kDKArrowHeadNone)
-		[shaft appendBezierPath:[self arrowHeadForPathStart:inPath]];
+		[shaft appendBezierPath:[self arrowHeadForPathStart:inPath
+													 lengths:lengths]];
 
 	if ([self arrowHeadAtEnd] != kDKArrowHeadNone)
-		[shaft appendBezierPath:[self arrowHeadForPathEnd:inPath]];
+		[shaft appendBezierPath:[self arrowHeadForPathEnd:inPath
+												   lengths:lengths]];
 
 	// if it's a dimensioning line, append the dimension text
 
@@ -842,6 +859,18 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 	return self;
 }
 
+- (NSUInteger)renderingCacheParameters
+{
+	NSUInteger cs = [super renderingCacheParameters];
+
+	cs = DKRasterizerChecksumCombine(cs, [self arrowHeadAtStart]);
+	cs = DKRasterizerChecksumCombine(cs, [self arrowHeadAtEnd]);
+	cs = DKRasterizerChecksumCombine(cs, [self arrowHeadLength]);
+	cs = DKRasterizerChecksumCombine(cs, [self arrowHeadWidth]);
+
+	return cs;
+}
+
 #pragma mark -
 #pragma mark As part of DKRasterizerProtocol
 
@@ -880,8 +909,24 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 	if ([self shadow] != nil && [DKStyle willDrawShadows])
 		[[self shadow] setAbsolute];
 
-	NSBezierPath* ap = [self arrowPathFromOriginalPath:[obj renderingPath]
-											fromObject:obj];
+	// the arrow path only changes when the object's geometry or the stroke's settings do, so it's kept in the object's rendering cache.
+	// Dimension text also depends on the object's metadata and units, so dimensioning lines are always regenerated.
+
+	NSBezierPath* rp = [obj renderingPath];
+	BOOL cacheable = ([self dimensioningLineOptions] == kDKDimensionNone);
+	NSBezierPath* ap = cacheable ? [self cachedPathForObject:obj
+												   sourcePath:rp]
+								 : nil;
+
+	if (ap == nil) {
+		ap = [self arrowPathFromOriginalPath:rp
+								  fromObject:obj];
+
+		if (cacheable)
+			[self setCachedPath:ap
+					  forObject:obj
+					 sourcePath:rp];
+	}
 
 	if (ap != nil) {
 		[ap fill];
@@ -894,6 +939,25 @@ NSString* kDKDimensionUnitsKey = @"DKDimensionUnits";
 	}
 }
 
+- (CGFloat)minimumDetailSize
+{
+	// arrow heads and dimension text are lost on very short paths
+
+	return 12.0;
+}
+
+- (void)renderLowDetail:(id<DKRenderable>)obj
+{
+	// draws the plain line without heads or dimensions
+
+	NSBezierPath* path = [[obj renderingPath] copy];
+
+	[path setLineWidth:[self width]];
+	[[self colour] setStroke];
+	[path stroke];
+	[path release];
+}
+
 #pragma mark -
 #pragma mark As part of NSCoding Protocol
 
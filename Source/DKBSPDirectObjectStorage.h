@@ -13,8 +13,11 @@
  This uses a similar algorithm to DKBSPObjectStorage but instead of indexing the objects it stores them directly by retaining them in additional arrays
  within the BSP tree. This is likely to be faster than the indexing approach though profiling is needed to confirm this.
  
- To facilitate correct z-ordering, each object stores its own Z-position and the objects are sorted on this property when necessary. Objects need to be
- renumbered when indexes change.
+ To facilitate correct z-ordering, each object stores its own Z-position and the objects are sorted on this property when necessary. The Z-position is
+ a sparse key rather than the object's array index: keys increase strictly in array order but are spaced apart, so an object inserted, moved or deleted
+ normally only needs its own key assigning (the midpoint of its neighbours' keys) rather than renumbering every object above it. When two neighbours'
+ keys become adjacent, all keys are respaced, which is rare enough to be amortised away. Because keys are ordered, -indexOfObject: is a binary search,
+ and query results are sorted with a radix sort on the keys.
 
  The trade-off here is that drawing speed should be faster but object insertion, deletion and changing of Z-position may be slower.
 */
@@ -24,12 +27,31 @@
 	NSUInteger mTreeDepth;
 	NSUInteger mLastItemCount;
 	BOOL mAutoRebuild;
+	NSUInteger mBatchNesting;
+	NSMutableArray* mBatchObjects;
+	BOOL mDefersRebuild;
+	BOOL mRebuildPending;
+	DKBSPRebuildStatistics mRebuildStats;
 }
 
 - (void)setTreeDepth:(NSUInteger)aDepth;
 - (id)tree;
 - (NSBezierPath*)debugStorageDivisions;
 
+/** @brief Sets whether tree rebuilds caused by a change in object count are deferred to the end of the event loop
+
+ See DKBSPObjectStorage for details. Default is NO.
+ @param defer YES to defer rebuilds
+ */
+- (void)setDefersTreeRebuilds:(BOOL)defer;
+- (BOOL)defersTreeRebuilds;
+
+/** @brief Returns counters describing the tree rebuilds this storage has performed
+ @return the statistics
+ */
+- (DKBSPRebuildStatistics)rebuildStatistics;
+- (void)resetRebuildStatistics;
+
 @end
 
 #pragma mark -
@@ -43,10 +65,12 @@
 	NSUInteger mObjectCount;
 	NSView* mViewRef;
 	NSRect mRect;
+	NSUInteger mQueryStamp;
 }
 
 - (void)insertItem:(id<DKStorableObject>)obj withRect:(NSRect)rect;
 - (void)removeItem:(id<DKStorableObject>)obj withRect:(NSRect)rect;
+- (void)removeItems:(NSArray*)objects;
 - (void)removeAllObjects;
 - (NSUInteger)count;
 
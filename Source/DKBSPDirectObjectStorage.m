@@ -5,6 +5,7 @@
 */
 
 #import "DKBSPDirectObjectStorage.h"
+#import "DKTrace.h"
 
 // if this is set to 1, various iterations are done using the much faster CFArrayApplyFunction and CFArraySortValues methods
 
@@ -22,14 +23,28 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 //	return (nodeIndex << 1) + 1;
 //}
 
+// Z-keys are assigned this far apart when the keys are (re)spaced. With 64-bit keys this leaves room for around 2^44 objects
+
+#define kDKZKeySpacing ((NSUInteger)1 << (sizeof(NSUInteger) == 8 ? 20 : 8))
+
+// results smaller than this are sorted using a comparison sort
+
+#define kDKRadixSortThreshold 64
+
 @interface DKBSPDirectObjectStorage (Private)
 
 - (void)sortObjectsByZ:(NSMutableArray*)objects;
-- (void)renumberObjectsFromIndex:(NSUInteger)indx;
+- (void)assignZKeyToObjectAtIndex:(NSUInteger)indx;
+- (void)respaceZKeys;
 - (void)unmarkAll:(NSArray*)objects;
 - (BOOL)checkForTreeRebuild;
+- (BOOL)needsRebuildAtDepth:(NSUInteger*)newDepth;
+- (void)scheduleDeferredRebuild;
+- (void)performDeferredRebuild;
+- (void)recordRebuildTimeSince:(NSTimeInterval)start;
 - (void)loadBSPTree;
 - (void)setAutoRebuildEnable:(BOOL)enable;
+- (void)applyPendingBoundsUpdates;
 
 @end
 
@@ -58,12 +73,34 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 	return mTree;
 }
 
+- (void)setDefersTreeRebuilds:(BOOL)defer
+{
+	mDefersRebuild = defer;
+}
+
+- (BOOL)defersTreeRebuilds
+{
+	return mDefersRebuild;
+}
+
+- (DKBSPRebuildStatistics)rebuildStatistics
+{
+	return mRebuildStats;
+}
+
+- (void)resetRebuildStatistics
+{
+	memset(&mRebuildStats, 0, sizeof(DKBSPRebuildStatistics));
+}
+
 - (NSArray*)objectsIntersectingRect:(NSRect)aRect inView:(NSView*)aView options:(DKObjectStorageOptions)options
 {
 #pragma unused(options)
 
 	NSMutableArray* results;
 
+	[self applyPendingBoundsUpdates];
+
 	if (aView) {
 		const NSRect* rects;
 		NSInteger count;
@@ -81,8 +118,6 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 	if ((options & kDKZOrderMayBeRelaxed) == 0)
 		[self sortObjectsByZ:results];
 
-	[self unmarkAll:results];
-
 	//NSLog(@"returning %d object(s)", [results count]);
 
 	// warning, the results returned is the actual mutable array owned by the tree. This is for performance reasons. The client should not
@@ -93,15 +128,17 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 
 - (NSArray*)objectsContainingPoint:(NSPoint)aPoint
 {
+	[self applyPendingBoundsUpdates];
+
 	NSMutableArray* objects = [mTree objectsIntersectingPoint:aPoint];
 
 	[self sortObjectsByZ:objects];
-	[self unmarkAll:objects];
 	return objects;
 }
 
 - (void)setObjects:(NSArray*)objects
 {
+	[self applyPendingBoundsUpdates];
 	[[self objects] makeObjectsPerformSelector:@selector(setStorage:)
 									withObject:nil];
 	[super setObjects:objects];
@@ -110,12 +147,14 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 
 - (void)insertObject:(id<DKStorableObject>)obj inObjectsAtIndex:(NSUInteger)indx
 {
+	[self applyPendingBoundsUpdates];
+
 	NSAssert(obj != nil, @"can't insert a nil object");
 
 	if ([obj conformsToProtocol:@protocol(DKStorableObject)]) {
 		[super insertObject:obj
 			inObjectsAtIndex:indx];
-		[self renumberObjectsFromIndex:indx];
+		[self assignZKeyToObjectAtIndex:indx];
 		[obj setStorage:self];
 
 		if (![self checkForTreeRebuild])
@@ -128,17 +167,18 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 
 - (void)removeObjectFromObjectsAtIndex:(NSUInteger)indx
 {
+	[self applyPendingBoundsUpdates];
+
 	id<DKStorableObject> obj = [self objectInObjectsAtIndex:indx];
 
 	if (obj) {
 		//NSLog(@"will remove %@, index = %d", obj, indx );
 
-		NSAssert1([obj index] == indx, @"index mismatch when removing object from storage, obj = %@", obj);
-
 		[obj retain];
 
+		// removal leaves the keys of the remaining objects in order, so nothing needs renumbering
+
 		[super removeObjectFromObjectsAtIndex:indx];
-		[self renumberObjectsFromIndex:indx];
 		[obj setStorage:nil];
 
 		if (![self checkForTreeRebuild])
@@ -151,18 +191,18 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 
 - (void)replaceObjectInObjectsAtIndex:(NSUInteger)indx withObject:(id<DKStorableObject>)obj
 {
+	[self applyPendingBoundsUpdates];
+
 	NSAssert(obj != nil, @"cannot replace an object with nil");
 
 	id<DKStorableObject> old = [self objectInObjectsAtIndex:indx];
 
 	if ((old != obj) && [obj conformsToProtocol:@protocol(DKStorableObject)]) {
-		if (old) {
-			NSAssert1([old index] == indx, @"index mismatch when replacing object in storage, obj = %@", old);
+		if (old)
 			[mTree removeItem:old
 					 withRect:[old bounds]];
-		}
 
-		[obj setIndex:indx];
+		[obj setIndex:[old index]];
 		[super replaceObjectInObjectsAtIndex:indx
 								  withObject:obj];
 		[mTree insertItem:obj
@@ -204,6 +244,8 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 
 - (void)removeObjectsAtIndexes:(NSIndexSet*)set
 {
+	[self applyPendingBoundsUpdates];
+
 	NSAssert(set != nil, @"indexes were nil");
 
 	if ([set count] > 0) {
@@ -223,7 +265,6 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 		}
 
 		[super removeObjectsAtIndexes:set];
-		[self renumberObjectsFromIndex:[set firstIndex]];
 	}
 }
 
@@ -234,19 +275,60 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 	return [object storage] == self;
 }
 
+- (NSUInteger)indexOfObject:(id<DKStorableObject>)object
+{
+	// keys increase strictly in array order, so the object can be found by binary search on its key
+
+	if ([object storage] != self)
+		return NSNotFound;
+
+	NSArray* objects = [self objects];
+	NSUInteger key = [object index];
+	NSUInteger lo = 0, hi = [objects count];
+
+	while (lo < hi) {
+		NSUInteger mid = (lo + hi) >> 1;
+		id<DKStorableObject> probe = [objects objectAtIndex:mid];
+
+		if (probe == object)
+			return mid;
+		else if ([probe index] < key)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	// shouldn't happen if the keys are consistent, but fall back to a linear search to be safe. Not super's, which would renumber the keys
+
+	return [objects indexOfObjectIdenticalTo:object];
+}
+
 - (void)moveObject:(id<DKStorableObject>)obj toIndex:(NSUInteger)indx
 {
-	NSUInteger oldIndex = [obj index];
+	NSUInteger oldIndex = [self indexOfObject:obj];
+
+	indx = MIN(indx, [self countOfObjects] - 1);
 
 	if (oldIndex != indx) {
 		[super moveObject:obj
 				  toIndex:indx];
-		[self renumberObjectsFromIndex:MIN(oldIndex, indx)];
+		[self assignZKeyToObjectAtIndex:indx];
 	}
 }
 
 - (void)object:(id<DKStorableObject>)obj didChangeBoundsFrom:(NSRect)oldBounds
 {
+	if (mBatchNesting > 0) {
+		// queries de-duplicate using query stamps rather than the mark flag, so it can be used here to record which objects are already pending
+
+		if (![obj isMarked]) {
+			[obj setMarked:YES];
+			[mBatchObjects addObject:obj];
+		}
+
+		return;
+	}
+
 	[obj retain];
 	[mTree removeItem:obj
 			 withRect:oldBounds];
@@ -257,6 +339,8 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 
 - (void)setCanvasSize:(NSSize)size
 {
+	[self applyPendingBoundsUpdates];
+
 	// rebuilds the BSP tree entirely. Note that this is the only method that creates the tree - it must be called when the storage
 	// is first created, and whenever the canvas size changes. Because the tree is the sole storage for the objects, we retain them in a list
 	// then set them again to reload the tree.
@@ -274,6 +358,19 @@ static inline NSUInteger depthForObjectCount(NSUInteger n)
 	}
 }
 
+- (void)beginBoundsUpdateBatch
+{
+	++mBatchNesting;
+}
+
+- (void)endBoundsUpdateBatch
+{
+	NSAssert(mBatchNesting > 0, @"unbalanced call to endBoundsUpdateBatch");
+
+	if (mBatchNesting > 0 && --mBatchNesting == 0)
+		[self applyPendingBoundsUpdates];
+}
+
 #pragma mark -
 
 static NSComparisonResult zComparisonFunc(id<DKStorableObject> a, id<DKStorableObject> b, void* context)
@@ -291,22 +388,71 @@ static NSComparisonResult zComparisonFunc(id<DKStorableObject> a, id<DKStorableO
 		return NSOrderedSame;
 }
 
+typedef struct {
+	NSUInteger key;
+	const void* obj;
+} DKZSortItem;
+
 - (void)sortObjectsByZ:(NSMutableArray*)objects
 {
-#if USE_CF_APPLIER
-	if (objects)
-		CFArraySortValues((CFMutableArrayRef)objects, CFRangeMake(0, [objects count]), (CFComparatorFunction)zComparisonFunc, NULL);
-#else
-	[objects sortUsingFunction:zComparisonFunc
-					   context:NULL];
-#endif
-}
+	NSUInteger n = [objects count];
 
-static void renumberFunc(const void* value, void* context)
-{
-	id<DKStorableObject> obj = (id<DKStorableObject>)value;
-	[obj setIndex:*(NSUInteger*)context];
-	(*(NSUInteger*)context)++;
+	if (n < 2)
+		return;
+
+	if (n < kDKRadixSortThreshold) {
+		CFArraySortValues((CFMutableArrayRef)objects, CFRangeMake(0, n), (CFComparatorFunction)zComparisonFunc, NULL);
+		return;
+	}
+
+	// least-significant-digit radix sort on the keys, one byte per pass. Passes where every key has the same byte value are
+	// skipped, which for the typical key range eliminates most of them. Each key is fetched just once.
+
+	DKZSortItem* items = malloc(sizeof(DKZSortItem) * n * 2);
+	DKZSortItem* src = items;
+	DKZSortItem* dst = items + n;
+	const void** values = malloc(sizeof(void*) * n);
+	NSUInteger i, pass, counts[256];
+
+	CFArrayGetValues((CFArrayRef)objects, CFRangeMake(0, n), values);
+
+	for (i = 0; i < n; ++i) {
+		src[i].obj = values[i];
+		src[i].key = [(id<DKStorableObject>)values[i] index];
+	}
+
+	for (pass = 0; pass < sizeof(NSUInteger); ++pass) {
+		NSUInteger shift = pass * 8, total = 0;
+
+		memset(counts, 0, sizeof(counts));
+
+		for (i = 0; i < n; ++i)
+			counts[(src[i].key >> shift) & 0xFF]++;
+
+		if (counts[(src[0].key >> shift) & 0xFF] == n)
+			continue;
+
+		for (i = 0; i < 256; ++i) {
+			NSUInteger c = counts[i];
+			counts[i] = total;
+			total += c;
+		}
+
+		for (i = 0; i < n; ++i)
+			dst[counts[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+		DKZSortItem* temp = src;
+		src = dst;
+		dst = temp;
+	}
+
+	for (i = 0; i < n; ++i)
+		values[i] = src[i].obj;
+
+	CFArrayReplaceValues((CFMutableArrayRef)objects, CFRangeMake(0, n), values, n);
+
+	free(values);
+	free(items);
 }
 
 static void unmarkFunc(const void* value, void* context)
@@ -315,25 +461,61 @@ static void unmarkFunc(const void* value, void* context)
 	[(id<DKStorableObject>)value setMarked:NO];
 }
 
-- (void)renumberObjectsFromIndex:(NSUInteger)indx
+- (void)assignZKeyToObjectAtIndex:(NSUInteger)indx
 {
-	// renumbers the index value of objects starting from <indx>
+	// gives the object at <indx> a key that lies between those of its neighbours. If there's no room between them, all keys are respaced.
 
-	if (indx > [self countOfObjects])
-		return;
+	NSArray* objects = [self objects];
+	NSUInteger count = [objects count];
+	NSUInteger key;
+	BOOL hasPrev = (indx > 0);
+	BOOL hasNext = (indx + 1 < count);
+	NSUInteger prev = hasPrev ? [[objects objectAtIndex:indx - 1] index] : 0;
+	NSUInteger next = hasNext ? [[objects objectAtIndex:indx + 1] index] : 0;
 
-	NSUInteger i = indx;
+	if (!hasPrev && !hasNext)
+		key = kDKZKeySpacing;
+	else if (!hasNext) {
+		if (prev > NSUIntegerMax - kDKZKeySpacing) {
+			[self respaceZKeys];
+			return;
+		}
 
-#if USE_CF_APPLIER
-	CFArrayApplyFunction((CFArrayRef)[self objects], CFRangeMake(indx, [self countOfObjects] - indx), renumberFunc, &i);
-#else
-	id<DKStorableObject> obj;
+		key = prev + kDKZKeySpacing;
+	} else if (!hasPrev) {
+		if (next == 0) {
+			[self respaceZKeys];
+			return;
+		}
 
-	for (i = indx; i < [self countOfObjects]; ++i) {
-		obj = [[self objects] objectAtIndex:i];
-		[obj setIndex:i];
+		key = next / 2;
+	} else {
+		if (next <= prev + 1) {
+			[self respaceZKeys];
+			return;
+		}
+
+		key = prev + (next - prev) / 2;
 	}
-#endif
+
+	[[objects objectAtIndex:indx] setIndex:key];
+}
+
+- (void)respaceZKeys
+{
+	// renumbers every object with evenly spaced keys, starting at one spacing unit so that there's room below the first object
+
+	NSArray* objects = [self objects];
+	NSUInteger count = [objects count];
+	NSUInteger spacing = MIN((NSUInteger)kDKZKeySpacing, NSUIntegerMax / (count + 2));
+	NSUInteger i;
+
+	NSAssert(spacing > 1, @"too many objects for Z-key spacing");
+
+	for (i = 0; i < count; ++i)
+		[[objects objectAtIndex:i] setIndex:(i + 1) * spacing];
+
+	DKTrace_(kDKTraceInfo, @"%@ <%p> respaced Z-keys for %lu objects", NSStringFromClass([self class]), self, (unsigned long)count);
 }
 
 - (void)unmarkAll:(NSArray*)objects
@@ -357,31 +539,107 @@ static void unmarkFunc(const void* value, void* context)
 	return [mTree debugStorageDivisions];
 }
 
+- (BOOL)needsRebuildAtDepth:(NSUInteger*)newDepth
+{
+	// calculates an optimal tree depth given the current number of items stored. The tree is rebuilt deeper as soon as the item count has
+	// changed by more than the slack value, but only rebuilt shallower once the optimal depth has fallen more than kDKBSPShrinkHysteresis levels
+	// below the current one. This stops the tree being rebuilt over and over when objects are added and removed around a depth boundary.
+
+	NSUInteger count = [self countOfObjects];
+	NSUInteger curDepth = [mTree depth];
+	NSUInteger neuDepth = MAX(depthForObjectCount(count), kDKMinimumDepth);
+
+	if (kDKMaximumDepth != 0)
+		neuDepth = MIN(neuDepth, kDKMaximumDepth);
+
+	*newDepth = neuDepth;
+
+	if ([mTree countOfLeaves] == 0)
+		return YES;
+
+	if (neuDepth == curDepth || ABS((NSInteger)mLastItemCount - (NSInteger)count) <= kDKBSPSlack)
+		return NO;
+
+	return (neuDepth > curDepth || neuDepth + kDKBSPShrinkHysteresis < curDepth);
+}
+
 - (BOOL)checkForTreeRebuild
 {
-	// calculates an optimal tree depth given the current number of items stored. This is done if the depth is
-	// initialised to 0. If the depth is different and the item count exceeds the slack value, then the tree is
-	// rebuilt with the new depth. If the tree depth is preset to a fixed value, this dynamic resizing is never done.
+	// rebuilds the tree with a new depth if needed. This is done if the depth is initialised to 0. If the tree depth is preset to a fixed value,
+	// this dynamic resizing is never done. If rebuilds are deferred, the existing tree remains valid and is maintained as normal until a
+	// replacement is swapped in at the end of the event loop.
 	// return YES if the tree was rebuilt, NO otherwise
 
-	if (mTreeDepth == 0 && mAutoRebuild) {
-		NSUInteger oldDepth = MAX(depthForObjectCount(mLastItemCount), kDKMinimumDepth);
-		NSUInteger neuDepth = MAX(depthForObjectCount([self countOfObjects]), kDKMinimumDepth);
-
-		if ([mTree countOfLeaves] == 0 || (oldDepth != neuDepth && ABS((NSInteger)mLastItemCount - (NSInteger)[self countOfObjects]) > kDKBSPSlack)) {
-			// sufficient cause to rebuild the tree
+	NSUInteger neuDepth;
 
-			[mTree setDepth:neuDepth];
-			[self loadBSPTree];
-			return YES;
+	if (mTreeDepth == 0 && mAutoRebuild && [self needsRebuildAtDepth:&neuDepth]) {
+		if (mDefersRebuild && [mTree countOfLeaves] > 0) {
+			[self scheduleDeferredRebuild];
+			return NO;
 		}
+
+		// sufficient cause to rebuild the tree
+
+		[mTree setDepth:neuDepth];
+		[self loadBSPTree];
+		return YES;
 	}
 
 	return NO;
 }
 
+- (void)scheduleDeferredRebuild
+{
+	if (!mRebuildPending) {
+		mRebuildPending = YES;
+		[self performSelector:@selector(performDeferredRebuild)
+				   withObject:nil
+				   afterDelay:0.0];
+	}
+}
+
+- (void)performDeferredRebuild
+{
+	// builds a complete replacement tree and swaps it in. This runs on the main thread because building the tree reads the objects' bounds,
+	// but as it's coalesced to once per event loop cycle, a burst of edits costs a single rebuild.
+
+	mRebuildPending = NO;
+
+	NSUInteger neuDepth;
+
+	if (mTreeDepth != 0 || mTree == nil)
+		return;
+
+	[self applyPendingBoundsUpdates];
+
+	if ([self needsRebuildAtDepth:&neuDepth]) {
+		DKBSPDirectTree* oldTree = mTree;
+
+		mTree = [[DKBSPDirectTree alloc] initWithCanvasSize:[oldTree canvasSize]
+													  depth:neuDepth];
+		[self loadBSPTree];
+		[oldTree release];
+
+		mRebuildStats.deferredCount++;
+	}
+}
+
+- (void)recordRebuildTimeSince:(NSTimeInterval)start
+{
+	NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+	mRebuildStats.rebuildCount++;
+	mRebuildStats.totalTime += elapsed;
+	mRebuildStats.lastTime = elapsed;
+	mRebuildStats.maxTime = MAX(mRebuildStats.maxTime, elapsed);
+
+	DKTrace_(kDKTraceInfo, @"%@ <%p> rebuilt tree with %lu objects in %.2fms", NSStringFromClass([self class]), self, (unsigned long)[self countOfObjects], elapsed * 1000.0);
+}
+
 - (void)loadBSPTree
 {
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+
 	[mTree removeAllObjects];
 
 	// reload the tree
@@ -390,9 +648,11 @@ static void unmarkFunc(const void* value, void* context)
 	NSEnumerator* iter = [[self objects] objectEnumerator];
 	id<DKStorableObject> obj;
 
+	[self respaceZKeys];
+
 	while ((obj = [iter nextObject])) {
 		if ([obj conformsToProtocol:@protocol(DKStorableObject)]) {
-			[obj setIndex:z++];
+			z++;
 			[obj setStorage:self];
 			[mTree insertItem:obj
 					 withRect:[obj bounds]];
@@ -400,6 +660,7 @@ static void unmarkFunc(const void* value, void* context)
 	}
 
 	mLastItemCount = z;
+	[self recordRebuildTimeSince:start];
 
 	//NSLog(@"loaded BSP tree with %d indexes (tree = %@)", k, mTree );
 }
@@ -409,6 +670,35 @@ static void unmarkFunc(const void* value, void* context)
 	mAutoRebuild = enable;
 }
 
+- (void)applyPendingBoundsUpdates
+{
+	// re-files all objects whose bounds changed during a batch. The stale references are removed from the leaves in a single
+	// pass, then each object is reinserted at its new bounds. If most objects moved, the tree is simply reloaded.
+
+	NSUInteger count = [mBatchObjects count];
+
+	if (count == 0)
+		return;
+
+	if (count * 4 > [self countOfObjects]) {
+		[self unmarkAll:mBatchObjects];
+		[self loadBSPTree];
+	} else {
+		// n.b. -removeItems: clears the marks
+
+		[mTree removeItems:mBatchObjects];
+
+		NSEnumerator* iter = [mBatchObjects objectEnumerator];
+		id<DKStorableObject> obj;
+
+		while ((obj = [iter nextObject]))
+			[mTree insertItem:obj
+					 withRect:[obj bounds]];
+	}
+
+	[mBatchObjects removeAllObjects];
+}
+
 #pragma mark -
 #pragma mark - as a NSObject
 
@@ -417,6 +707,7 @@ static void unmarkFunc(const void* value, void* context)
 	self = [super init];
 	if (self) {
 		mAutoRebuild = YES;
+		mBatchObjects = [[NSMutableArray alloc] init];
 	}
 
 	return self;
@@ -425,6 +716,7 @@ static void unmarkFunc(const void* value, void* context)
 - (void)dealloc
 {
 	[mTree release];
+	[mBatchObjects release];
 	[super dealloc];
 }
 
@@ -435,6 +727,7 @@ static void unmarkFunc(const void* value, void* context)
 	mTreeDepth = [coder decodeIntegerForKey:@"DKBSPDirectStorage_treeDepth"];
 	[self setCanvasSize:[coder decodeSizeForKey:@"DKBSPDirectStorage_canvasSize"]];
 	mAutoRebuild = YES;
+	mBatchObjects = [[NSMutableArray alloc] init];
 	[super initWithCoder:coder];
 
 	return self;
@@ -449,8 +742,8 @@ static void unmarkFunc(const void* value, void* context)
 // these are implemented by DKBSPIndexTree as private methods, re-prototyped here so
 // we can make use of them in this subclass
 
-- (void)recursivelySearchWithRect:(NSRect)rect index:(NSUInteger)indx;
-- (void)recursivelySearchWithPoint:(NSPoint)pt index:(NSUInteger)indx;
+- (void)searchWithRect:(NSRect)rect;
+- (void)searchWithPoint:(NSPoint)pt;
 - (void)operateOnLeaf:(id)leaf;
 - (void)removeObject:(id<DKStorableObject>)obj;
 
@@ -462,14 +755,13 @@ static void unmarkFunc(const void* value, void* context)
 
 - (void)insertItem:(id<DKStorableObject>)obj withRect:(NSRect)rect
 {
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return;
 
 	if (obj && !NSIsEmptyRect(rect)) {
 		mOp = kDKOperationInsert;
 		mObj = obj;
-		[self recursivelySearchWithRect:rect
-								  index:0];
+		[self searchWithRect:rect];
 
 		++mObjectCount;
 	} else
@@ -482,7 +774,7 @@ static void unmarkFunc(const void* value, void* context)
 {
 #pragma unused(rect)
 	/*
- if ([mNodes count] == 0)
+ if (mNodeCount == 0)
         return;
 
 	if( obj && !NSIsEmptyRect( rect ))
@@ -490,7 +782,7 @@ static void unmarkFunc(const void* value, void* context)
 		[obj setMarked:NO];
 		mOp = kDKOperationDelete;
 		mObj = obj;
-		[self recursivelySearchWithRect:rect index:0];
+		[self searchWithRect:rect];
 		
 		if( mObjectCount > 0 )
 			--mObjectCount;
@@ -502,6 +794,35 @@ static void unmarkFunc(const void* value, void* context)
 	//NSLog(@"removed %@", obj );
 }
 
+- (void)removeItems:(NSArray*)objects
+{
+	// removes all references to the objects in a single pass over the leaves. The objects are expected to be marked on entry, and
+	// are unmarked on return.
+
+	NSEnumerator* iter = [mLeaves objectEnumerator];
+	NSMutableArray* leaf;
+	NSMutableIndexSet* removals = [[NSMutableIndexSet alloc] init];
+
+	while ((leaf = [iter nextObject])) {
+		NSUInteger i, count = [leaf count];
+
+		for (i = 0; i < count; ++i) {
+			if ([[leaf objectAtIndex:i] isMarked])
+				[removals addIndex:i];
+		}
+
+		if ([removals count] > 0) {
+			[leaf removeObjectsAtIndexes:removals];
+			[removals removeAllIndexes];
+		}
+	}
+
+	[removals release];
+	CFArrayApplyFunction((CFArrayRef)objects, CFRangeMake(0, [objects count]), unmarkFunc, NULL);
+
+	mObjectCount = (mObjectCount > [objects count]) ? mObjectCount - [objects count] : 0;
+}
+
 - (void)removeAllObjects
 {
 	NSEnumerator* iter = [mLeaves objectEnumerator];
@@ -517,48 +838,51 @@ static void unmarkFunc(const void* value, void* context)
 {
 	// this may be used in conjunction with NSView's -getRectsBeingDrawn:count: to find those objects that intersect the non-rectangular update region.
 
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return nil;
 
+	// all the rects are searched under a single query stamp, so an object that lies in several leaves or rects is only found once
+
 	mViewRef = aView;
 	mOp = kDKOperationAccumulate;
+	mQueryStamp = DKObjectStorageNextQueryStamp();
 	[mFoundObjects removeAllObjects];
 
 	NSUInteger i;
 
 	for (i = 0; i < count; ++i)
-		[self recursivelySearchWithRect:rects[i]
-								  index:0];
+		[self searchWithRect:rects[i]];
 
 	return mFoundObjects;
 }
 
 - (NSMutableArray*)objectsIntersectingRect:(NSRect)rect
 {
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return nil;
 
 	mRect = rect;
 	mViewRef = nil;
 	mOp = kDKOperationAccumulate;
+	mQueryStamp = DKObjectStorageNextQueryStamp();
 	[mFoundObjects removeAllObjects];
 
-	[self recursivelySearchWithRect:rect
-							  index:0];
+	[self searchWithRect:rect];
 	return mFoundObjects;
 }
 
 - (NSMutableArray*)objectsIntersectingPoint:(NSPoint)point
 {
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return nil;
 
 	mRect = NSMakeRect(point.x, point.y, 1e-3, 1e-3);
+	mViewRef = nil;
 	mOp = kDKOperationAccumulate;
+	mQueryStamp = DKObjectStorageNextQueryStamp();
 	[mFoundObjects removeAllObjects];
 
-	[self recursivelySearchWithPoint:point
-							   index:0];
+	[self searchWithPoint:point];
 
 	return mFoundObjects;
 }
@@ -592,15 +916,15 @@ static void unmarkFunc(const void* value, void* context)
 static void addValueToFoundObjects(const void* value, void* context)
 {
 	id<DKStorableObject> obj = (id<DKStorableObject>)value;
+	DKBSPDirectTree* tree = (DKBSPDirectTree*)context;
 
-	if (![obj isMarked] && [obj visible]) {
-		DKBSPDirectTree* tree = (DKBSPDirectTree*)context;
+	if ([obj queryStamp] != tree->mQueryStamp && [obj visible]) {
 		NSView* view = tree->mViewRef;
 
 		// double-check that the view really needs to draw this
 
 		if ((view == nil && NSIntersectsRect([obj bounds], tree->mRect)) || [view needsToDrawRect:[obj bounds]]) {
-			[obj setMarked:YES];
+			[obj setQueryStamp:tree->mQueryStamp];
 			CFArrayAppendValue((CFMutableArrayRef)tree->mFoundObjects, value);
 		}
 	}
@@ -627,9 +951,9 @@ static void addValueToFoundObjects(const void* value, void* context)
 		id<DKStorableObject> anObject;
 
 		while ((anObject = [iter nextObject])) {
-			if (![anObject isMarked] && [anObject visible]) {
+			if ([anObject queryStamp] != mQueryStamp && [anObject visible]) {
 				if ((mViewRef == nil && NSIntersectsRect([anObject bounds], mRect)) || [mViewRef needsToDrawRect:[anObject bounds]]) {
-					[anObject setMarked:YES];
+					[anObject setQueryStamp:mQueryStamp];
 					[mFoundObjects addObject:anObject];
 				}
 			}
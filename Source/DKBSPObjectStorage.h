@@ -25,6 +25,36 @@ typedef enum {
 	kDKOperationAccumulate
 } DKBSPOperation;
 
+/// a node in the BSP tree. Nodes are stored in a flat array rather than as objects
+
+typedef struct {
+	DKLeafType type;
+	union {
+		CGFloat offset;
+		NSUInteger leafIndex;
+	} u;
+} DKBSPNodeRec;
+
+/// a leaf in the packed tree - a sorted vector of object indexes
+
+typedef struct {
+	uint32_t* items;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKBSPPackedLeaf;
+
+/// counters describing how often a storage has rebuilt its tree, and how long it took. Times are in seconds.
+
+typedef struct {
+	NSUInteger rebuildCount; // number of full tree rebuilds, including deferred ones
+	NSUInteger deferredCount; // number of rebuilds that were deferred to the end of the event loop
+	NSUInteger suppressedCount; // number of depth changes ignored because they were within the hysteresis band
+	NSUInteger restoredCount; // number of trees restored from an archived index instead of being built
+	NSTimeInterval totalTime;
+	NSTimeInterval lastTime;
+	NSTimeInterval maxTime;
+} DKBSPRebuildStatistics;
+
 /** @brief The actual storage object.
 
  The actual storage object. This inherits the linear array which actually stores the objects, but maintains a BSP tree in parallel, which
@@ -36,11 +66,57 @@ typedef enum {
 	DKBSPIndexTree* mTree;
 	NSUInteger mTreeDepth;
 	NSUInteger mLastItemCount;
+	NSUInteger mBatchNesting;
+	NSMutableIndexSet* mBatchIndexes;
+	BOOL mDefersRebuild;
+	BOOL mRebuildPending;
+	DKBSPRebuildStatistics mRebuildStats;
+	NSData* mArchivedIndex;
 }
 
+/** @brief Sets the class of the index tree used by newly created BSP storage
+
+ The default is DKBSPIndexTree. DKBSPPackedIndexTree may be used instead for faster queries in dense layers.
+ @param aClass DKBSPIndexTree or a subclass of it
+ */
++ (void)setIndexTreeClass:(Class)aClass;
++ (Class)indexTreeClass;
+
 - (void)setTreeDepth:(NSUInteger)aDepth;
 - (id)tree;
 
+/** @brief Sets whether tree rebuilds caused by a change in object count are deferred
+
+ When the tree depth is dynamic (0), the tree is rebuilt at a new depth as the number of objects grows or shrinks. Normally this happens
+ immediately, in the middle of whatever insertion or deletion triggered it. If deferred, the existing tree continues to be maintained
+ incrementally (it remains correct, just less well balanced) and a replacement tree is built and swapped in at the end of the current
+ event loop cycle, so a burst of edits costs at most one rebuild. Default is NO.
+ @param defer YES to defer rebuilds
+ */
+- (void)setDefersTreeRebuilds:(BOOL)defer;
+- (BOOL)defersTreeRebuilds;
+
+/** @brief Returns counters describing the tree rebuilds this storage has performed
+ @return the statistics
+ */
+- (DKBSPRebuildStatistics)rebuildStatistics;
+- (void)resetRebuildStatistics;
+
+/** @brief Returns the tree's contents as data, to be archived with the objects
+
+ The data records the canvas size, depth and number of objects with a checksum of their bounds and visibility, so that when it's given
+ back to -setArchivedIndex: it's only used if it still describes the objects exactly. If it doesn't, the tree is built as usual.
+ @return the archived index, or nil if there is no tree
+ */
+- (NSData*)archivedIndex;
+
+/** @brief Sets an archived index to be used in place of building the tree the next time it's loaded
+
+ The index is used once - when the tree is next loaded, whether or not it matched, it's discarded.
+ @param data data returned by -archivedIndex
+ */
+- (void)setArchivedIndex:(NSData*)data;
+
 @end
 
 #pragma mark -
@@ -58,7 +134,9 @@ typedef enum {
 @interface DKBSPIndexTree : NSObject {
 @protected
 	NSMutableArray* mLeaves;
-	NSMutableArray* mNodes;
+	DKBSPNodeRec* mNodes;
+	NSUInteger mNodeCount;
+	NSUInteger mDepth;
 	NSMutableIndexSet* mResults;
 	NSSize mCanvasSize;
 	DKBSPOperation mOp;
@@ -72,10 +150,12 @@ typedef enum {
 - (NSSize)canvasSize;
 
 - (void)setDepth:(NSUInteger)depth;
+- (NSUInteger)depth;
 - (NSUInteger)countOfLeaves;
 
 - (void)insertItemIndex:(NSUInteger)idx withRect:(NSRect)rect;
 - (void)removeItemIndex:(NSUInteger)idx withRect:(NSRect)rect;
+- (void)removeItemIndexes:(NSIndexSet*)indexes;
 
 - (NSIndexSet*)itemsIntersectingRects:(const NSRect*)rects count:(NSUInteger)count;
 - (NSIndexSet*)itemsIntersectingRect:(NSRect)rect;
@@ -83,10 +163,44 @@ typedef enum {
 
 - (void)shiftIndexesStartingAtIndex:(NSUInteger)startIndex by:(NSInteger)delta;
 
+/** @brief Returns the indexes in each leaf as data, which -restoreLeafData:itemCount: can restore into a tree of the same size and depth
+ @return the leaf count, then for each leaf its count of indexes followed by the indexes in ascending order, all as 32-bit values
+ */
+- (NSData*)leafData;
+
+/** @brief Fills the leaves of an empty tree from data returned by -leafData
+ @param data the leaf data
+ @param count the number of items stored; all of the indexes must be less than this
+ @return YES if the data was restored, NO if it didn't fit the tree, in which case the tree is unchanged
+ */
+- (BOOL)restoreLeafData:(NSData*)data itemCount:(NSUInteger)count;
+
 - (NSBezierPath*)debugStorageDivisions;
 
 @end
 
+#pragma mark -
+
+/** @brief Index tree that stores leaf membership in packed, sorted 32-bit vectors instead of NSMutableIndexSets.
+
+ Index tree that stores leaf membership in packed, sorted 32-bit vectors instead of NSMutableIndexSets. Queries gather the raw indexes from the
+ leaves into a scratch buffer, then sort them and add them to the result set as ranges. This avoids all message dispatch while traversing and
+ is considerably more cache-friendly, so queries on dense layers are much cheaper. Results are identical to DKBSPIndexTree.
+
+ Because indexes are stored as 32-bit values, the storage using this tree is limited to 2^32 objects.
+*/
+@interface DKBSPPackedIndexTree : DKBSPIndexTree {
+@private
+	DKBSPPackedLeaf* mPackedLeaves;
+	NSUInteger mPackedLeafCount;
+	uint32_t* mScratch;
+	NSUInteger mScratchCount;
+	NSUInteger mScratchCapacity;
+}
+
+@end
+
 #define kDKBSPSlack 48
+#define kDKBSPShrinkHysteresis 1U // number of levels the ideal depth must fall below the current depth before the tree is rebuilt shallower
 #define kDKMinimumDepth 10U
 #define kDKMaximumDepth 0U // set 0 for no limit
@@ -5,7 +5,7 @@
 */
 
 #import "DKBSPObjectStorage.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 
 // utility functions:
 
@@ -19,18 +19,119 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	return (nodeIndex << 1) + 1;
 }
 
+/// the header of an archived index, followed by the tree's leaf data. Values are in host byte order - an index archived on a machine of
+/// the other byte order fails the magic number check and the tree is rebuilt.
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t objectCount;
+	uint64_t boundsChecksum;
+	double canvasWidth;
+	double canvasHeight;
+	uint32_t depth;
+	uint32_t reserved;
+} DKBSPArchivedIndexHeader;
+
+#define kDKBSPArchivedIndexMagic 0x444B4249 // 'DKBI'
+#define kDKBSPArchivedIndexVersion 1
+
+static uint64_t boundsChecksumOfObjects(NSArray* objects)
+{
+	// FNV-1a over each object's visibility and bounds - everything the contents of the tree depend on
+
+	NSEnumerator* iter = [objects objectEnumerator];
+	id<DKStorableObject> obj;
+	uint64_t hash = 14695981039346656037ULL;
+	double values[5];
+	NSUInteger i;
+
+	while ((obj = [iter nextObject])) {
+		NSRect br = [obj bounds];
+
+		values[0] = [obj visible] ? 1.0 : 0.0;
+		values[1] = br.origin.x;
+		values[2] = br.origin.y;
+		values[3] = br.size.width;
+		values[4] = br.size.height;
+
+		const unsigned char* bytes = (const unsigned char*)values;
+
+		for (i = 0; i < sizeof(values); ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+	}
+
+	return hash;
+}
+
+static BOOL validateLeafData(NSData* data, NSUInteger leafCount, NSUInteger itemCount)
+{
+	// checks that leaf data is well formed and fits a tree with <leafCount> leaves storing <itemCount> items, before any of it is used
+
+	NSUInteger words = [data length] / sizeof(uint32_t);
+	const uint32_t* p = (const uint32_t*)[data bytes];
+	NSUInteger pos = 1, leaf, i;
+
+	if ([data length] % sizeof(uint32_t) != 0 || words < 1 || p[0] != leafCount)
+		return NO;
+
+	for (leaf = 0; leaf < leafCount; ++leaf) {
+		if (pos >= words)
+			return NO;
+
+		NSUInteger n = p[pos++];
+
+		if (n > words - pos)
+			return NO;
+
+		for (i = 0; i < n; ++i) {
+			if (p[pos + i] >= itemCount || (i > 0 && p[pos + i] <= p[pos + i - 1]))
+				return NO;
+		}
+
+		pos += n;
+	}
+
+	return pos == words;
+}
+
 @interface DKBSPObjectStorage (Private)
 
 - (void)setDepthAndLoadTree:(NSUInteger)aDepth;
 - (void)loadBSPTree;
 - (BOOL)checkForTreeRebuild;
+- (BOOL)needsRebuildAtDepth:(NSUInteger*)newDepth;
+- (void)scheduleDeferredRebuild;
+- (void)performDeferredRebuild;
+- (void)recordRebuildTimeSince:(NSTimeInterval)start;
+- (void)applyPendingBoundsUpdates;
+- (BOOL)restoreArchivedIndex;
+- (NSArray*)treeObjectsNearPoint:(NSPoint)aPoint count:(NSUInteger)count withinDistance:(CGFloat)distance options:(DKObjectStorageOptions)options;
 
 @end
 
 #pragma mark -
 
+static Class sIndexTreeClass = nil;
+
 @implementation DKBSPObjectStorage
 
++ (void)setIndexTreeClass:(Class)aClass
+{
+	if ([aClass isSubclassOfClass:[DKBSPIndexTree class]])
+		sIndexTreeClass = aClass;
+}
+
++ (Class)indexTreeClass
+{
+	if (sIndexTreeClass == nil)
+		return [DKBSPIndexTree class];
+	else
+		return sIndexTreeClass;
+}
+
 - (void)setTreeDepth:(NSUInteger)aDepth
 {
 	// intended to be set when the storage is created. Defaults to 0, meaning that the tree is dynamically rebuilt when needed
@@ -50,12 +151,34 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	return mTree;
 }
 
+- (void)setDefersTreeRebuilds:(BOOL)defer
+{
+	mDefersRebuild = defer;
+}
+
+- (BOOL)defersTreeRebuilds
+{
+	return mDefersRebuild;
+}
+
+- (DKBSPRebuildStatistics)rebuildStatistics
+{
+	return mRebuildStats;
+}
+
+- (void)resetRebuildStatistics
+{
+	memset(&mRebuildStats, 0, sizeof(DKBSPRebuildStatistics));
+}
+
 - (NSArray*)objectsIntersectingRect:(NSRect)aRect inView:(NSView*)aView options:(DKObjectStorageOptions)options
 {
 #pragma unused(options)
 
 	NSIndexSet* indexes;
 
+	[self applyPendingBoundsUpdates];
+
 	if (aView) {
 		const NSRect* rects;
 		NSInteger count;
@@ -90,6 +213,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (NSArray*)objectsContainingPoint:(NSPoint)aPoint
 {
+	[self applyPendingBoundsUpdates];
+
 	NSIndexSet* indexes = [mTree itemsIntersectingPoint:aPoint];
 
 	//NSLog(@"indexes returned for hit: %@", indexes );
@@ -106,14 +231,74 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	return array;
 }
 
+- (NSArray*)objectsNearestPoint:(NSPoint)aPoint count:(NSUInteger)count options:(DKObjectStorageOptions)options
+{
+	// the tree only holds the visible objects
+
+	NSRect canvas = NSZeroRect;
+	canvas.size = [mTree canvasSize];
+
+	if ((options & kDKIncludeInvisible) || NSIsEmptyRect(canvas) || count == 0 || [self countOfObjects] == 0)
+		return [super objectsNearestPoint:aPoint
+									count:count
+								  options:options];
+
+	[self applyPendingBoundsUpdates];
+
+	// search a square big enough to hold <count> objects if they were spread evenly, doubling it until that many are found within it.
+	// Objects within the square's half-width of the point are all inside it, so once enough are found they are the nearest. When the
+	// square covers the canvas the tree can't narrow the search any more.
+
+	NSUInteger n = [self countOfObjects];
+	CGFloat half = MAX(_CGFloatSqrt(canvas.size.width * canvas.size.height * MIN(count, n) / n) * 0.5, 1.0);
+	NSArray* results;
+
+	while (!NSContainsRect(NSMakeRect(aPoint.x - half, aPoint.y - half, half * 2, half * 2), canvas)) {
+		results = [self treeObjectsNearPoint:aPoint
+									   count:count
+							  withinDistance:half
+									 options:options];
+
+		if ([results count] == count)
+			return results;
+
+		half *= 2;
+	}
+
+	return [super objectsNearestPoint:aPoint
+								count:count
+							  options:options];
+}
+
+- (NSArray*)objectsWithinDistance:(CGFloat)distance ofPoint:(NSPoint)aPoint options:(DKObjectStorageOptions)options
+{
+	NSRect canvas = NSZeroRect;
+	canvas.size = [mTree canvasSize];
+
+	if ((options & kDKIncludeInvisible) || NSIsEmptyRect(canvas) || NSContainsRect(NSMakeRect(aPoint.x - distance, aPoint.y - distance, distance * 2, distance * 2), canvas))
+		return [super objectsWithinDistance:distance
+									ofPoint:aPoint
+									options:options];
+
+	[self applyPendingBoundsUpdates];
+
+	return [self treeObjectsNearPoint:aPoint
+								count:NSUIntegerMax
+					   withinDistance:distance
+							  options:options];
+}
+
 - (void)setObjects:(NSArray*)objects
 {
+	[mBatchIndexes removeAllIndexes];
 	[super setObjects:objects];
 	[self setDepthAndLoadTree:mTreeDepth];
 }
 
 - (void)insertObject:(id<DKStorableObject>)obj inObjectsAtIndex:(NSUInteger)indx
 {
+	[self applyPendingBoundsUpdates];
+
 	[super insertObject:obj
 		inObjectsAtIndex:indx];
 
@@ -129,6 +314,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)removeObjectFromObjectsAtIndex:(NSUInteger)indx
 {
+	[self applyPendingBoundsUpdates];
+
 	id<DKStorableObject> obj = [self objectInObjectsAtIndex:indx];
 
 	if ([obj visible]) {
@@ -145,6 +332,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)replaceObjectInObjectsAtIndex:(NSUInteger)indx withObject:(id<DKStorableObject>)obj
 {
+	[self applyPendingBoundsUpdates];
+
 	id<DKStorableObject> old = [self objectInObjectsAtIndex:indx];
 	if ([old visible])
 		[mTree removeItemIndex:indx
@@ -160,6 +349,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)insertObjects:(NSArray*)objs atIndexes:(NSIndexSet*)set
 {
+	[self applyPendingBoundsUpdates];
+
 	// this may be expensive, as it rebuilds the entire tree due to the extensive renumbering of items
 
 	[super insertObjects:objs
@@ -171,6 +362,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)removeObjectsAtIndexes:(NSIndexSet*)set
 {
+	[self applyPendingBoundsUpdates];
+
 	// this may be expensive, as it rebuilds the entire tree due to the extensive renumbering of items
 
 	[super removeObjectsAtIndexes:set];
@@ -181,6 +374,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)moveObject:(id<DKStorableObject>)obj toIndex:(NSUInteger)indx
 {
+	[self applyPendingBoundsUpdates];
+
 	NSUInteger newIdx, oldIdx = [self indexOfObject:obj];
 	[super moveObject:obj
 			  toIndex:indx];
@@ -206,6 +401,14 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	// n.b. only called if the bounds has actually changed, so we don't need to test that again
 
 	NSUInteger indx = [self indexOfObject:obj];
+
+	if (mBatchNesting > 0) {
+		if ([obj visible])
+			[mBatchIndexes addIndex:indx];
+
+		return;
+	}
+
 	if ([obj visible]) {
 		[mTree removeItemIndex:indx
 					  withRect:oldBounds];
@@ -216,6 +419,8 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)objectDidChangeVisibility:(id<DKStorableObject>)obj
 {
+	[self applyPendingBoundsUpdates];
+
 	NSUInteger indx = [self indexOfObject:obj];
 
 	if ([obj visible])
@@ -226,16 +431,30 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 					  withRect:[obj bounds]];
 }
 
+- (void)beginBoundsUpdateBatch
+{
+	++mBatchNesting;
+}
+
+- (void)endBoundsUpdateBatch
+{
+	NSAssert(mBatchNesting > 0, @"unbalanced call to endBoundsUpdateBatch");
+
+	if (mBatchNesting > 0 && --mBatchNesting == 0)
+		[self applyPendingBoundsUpdates];
+}
+
 - (void)setCanvasSize:(NSSize)size
 {
 	// rebuilds the BSP tree entirely. Note that this is the only method that creates the tree - it must be called when the storage
 	// is first created, and whenever the canvas size changes.
 
 	if (!NSEqualSizes(size, [mTree canvasSize])) {
+		[mBatchIndexes removeAllIndexes];
 		[mTree release];
 
 		NSUInteger depth = (mTreeDepth == 0 ? depthForObjectCount([self countOfObjects]) : mTreeDepth);
-		mTree = [[DKBSPIndexTree alloc] initWithCanvasSize:size
+		mTree = [[[[self class] indexTreeClass] alloc] initWithCanvasSize:size
 													 depth:MAX(depth, kDKMinimumDepth)];
 		[self loadBSPTree];
 	}
@@ -251,6 +470,22 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 
 - (void)loadBSPTree
 {
+	// an archived index is used in place of building the tree if it still matches the objects. It's kept until there's a tree to load -
+	// when a document is opened, the objects are set before the canvas size is known
+
+	if (mArchivedIndex && mTree) {
+		NSTimeInterval restoreStart = [NSDate timeIntervalSinceReferenceDate];
+
+		if ([self restoreArchivedIndex]) {
+			mLastItemCount = [self countOfObjects];
+			mRebuildStats.restoredCount++;
+
+			DKTrace_(kDKTraceInfo, @"%@ <%p> restored tree with %lu objects in %.2fms", NSStringFromClass([self class]), self, (unsigned long)mLastItemCount, ([NSDate timeIntervalSinceReferenceDate] - restoreStart) * 1000.0);
+			return;
+		}
+	}
+
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
 	NSEnumerator* iter = [[self objects] objectEnumerator];
 	id<DKStorableObject> obj;
 	NSUInteger k = 0;
@@ -264,113 +499,302 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	}
 
 	mLastItemCount = k;
+	[self recordRebuildTimeSince:start];
 
 	//NSLog(@"loaded BSP tree with %d indexes (tree = %@)", k, mTree );
 }
 
+- (BOOL)needsRebuildAtDepth:(NSUInteger*)newDepth
+{
+	// calculates an optimal tree depth given the current number of items stored. The tree is rebuilt deeper as soon as the item count has
+	// changed by more than the slack value, but only rebuilt shallower once the optimal depth has fallen more than kDKBSPShrinkHysteresis levels
+	// below the current one. This stops the tree being rebuilt over and over when objects are added and removed around a depth boundary.
+
+	NSUInteger count = [self countOfObjects];
+	NSUInteger curDepth = [mTree depth];
+	NSUInteger neuDepth = MAX(depthForObjectCount(count), kDKMinimumDepth);
+
+	if (kDKMaximumDepth != 0)
+		neuDepth = MIN(neuDepth, kDKMaximumDepth);
+
+	*newDepth = neuDepth;
+
+	if ([mTree countOfLeaves] == 0)
+		return YES;
+
+	if (neuDepth == curDepth || ABS((NSInteger)mLastItemCount - (NSInteger)count) <= kDKBSPSlack)
+		return NO;
+
+	if (neuDepth > curDepth || neuDepth + kDKBSPShrinkHysteresis < curDepth)
+		return YES;
+
+	// a shallower tree would do, but not by enough to be worth rebuilding
+
+	mRebuildStats.suppressedCount++;
+	return NO;
+}
+
 - (BOOL)checkForTreeRebuild
 {
-	// calculates an optimal tree depth given the current number of items stored. This is done if the depth is
-	// initialised to 0. If the depth is different and the item count exceeds the slack value, then the tree is
-	// rebuilt with the new depth. If the tree depth is preset to a fixed value, this dynamic resizing is never done.
+	// rebuilds the tree with a new depth if needed. This is done if the depth is initialised to 0. If the tree depth is preset to a fixed value,
+	// this dynamic resizing is never done. If rebuilds are deferred, the existing tree remains valid and is maintained as normal until a
+	// replacement is swapped in at the end of the event loop.
 	// return YES if the tree was rebuilt, NO otherwise
 
-	if (mTreeDepth == 0) {
-		NSUInteger oldDepth = MAX(depthForObjectCount(mLastItemCount), kDKMinimumDepth);
-		NSUInteger neuDepth = MAX(depthForObjectCount([self countOfObjects]), kDKMinimumDepth);
-
-		if ([mTree countOfLeaves] == 0 || (oldDepth != neuDepth && ABS((NSInteger)mLastItemCount - (NSInteger)[self countOfObjects]) > kDKBSPSlack)) {
-			// sufficient cause to rebuild the tree
+	NSUInteger neuDepth;
 
-			[mTree setDepth:neuDepth];
-			[self loadBSPTree];
-			return YES;
+	if (mTreeDepth == 0 && [self needsRebuildAtDepth:&neuDepth]) {
+		if (mDefersRebuild && [mTree countOfLeaves] > 0) {
+			[self scheduleDeferredRebuild];
+			return NO;
 		}
+
+		// sufficient cause to rebuild the tree
+
+		[mTree setDepth:neuDepth];
+		[self loadBSPTree];
+		return YES;
 	}
 
 	return NO;
 }
 
-#pragma mark -
-#pragma mark - as implementor of the NSCoding protocol
+- (void)scheduleDeferredRebuild
+{
+	if (!mRebuildPending) {
+		mRebuildPending = YES;
+		[self performSelector:@selector(performDeferredRebuild)
+				   withObject:nil
+				   afterDelay:0.0];
+	}
+}
 
-- (id)initWithCoder:(NSCoder*)aCoder
+- (void)performDeferredRebuild
 {
-	// this method is here solely to support backward compatibility with b5; storage is no longer archived.
+	// builds a complete replacement tree and swaps it in. This runs on the main thread because building the tree reads the objects' bounds,
+	// but as it's coalesced to once per event loop cycle, a burst of edits costs a single rebuild.
 
-	[super initWithCoder:aCoder];
-	mTreeDepth = [aCoder decodeIntegerForKey:@"DKBSPObjectStorage_treeDepth"];
-	[self setCanvasSize:[aCoder decodeSizeForKey:@"DKBSPObjectStorage_canvasSize"]];
+	mRebuildPending = NO;
 
-	return self;
-}
+	NSUInteger neuDepth;
 
-#pragma mark -
-#pragma mark - as a NSObject
+	if (mTreeDepth != 0 || mTree == nil)
+		return;
 
-- (void)dealloc
+	[self applyPendingBoundsUpdates];
+
+	if ([self needsRebuildAtDepth:&neuDepth]) {
+		DKBSPIndexTree* oldTree = mTree;
+
+		mTree = [[[oldTree class] alloc] initWithCanvasSize:[oldTree canvasSize]
+													 depth:neuDepth];
+		[self loadBSPTree];
+		[oldTree release];
+
+		mRebuildStats.deferredCount++;
+	}
+}
+
+- (void)recordRebuildTimeSince:(NSTimeInterval)start
 {
-	[mTree release];
-	[super dealloc];
+	NSTimeInterval elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+	mRebuildStats.rebuildCount++;
+	mRebuildStats.totalTime += elapsed;
+	mRebuildStats.lastTime = elapsed;
+	mRebuildStats.maxTime = MAX(mRebuildStats.maxTime, elapsed);
+
+	DKTrace_(kDKTraceInfo, @"%@ <%p> rebuilt tree with %lu objects in %.2fms", NSStringFromClass([self class]), self, (unsigned long)[self countOfObjects], elapsed * 1000.0);
 }
 
-@end
+- (void)applyPendingBoundsUpdates
+{
+	// re-indexes all objects whose bounds changed during a batch. All of their stale indexes are removed from the leaves in one pass, rather
+	// than one pass per object. If a large proportion of the objects moved, it's cheaper just to reload the tree.
 
-#pragma mark -
+	NSUInteger count = [mBatchIndexes count];
+
+	if (count == 0)
+		return;
+
+	if (count * 4 > [self countOfObjects])
+		[self setDepthAndLoadTree:mTreeDepth];
+	else {
+		[mTree removeItemIndexes:mBatchIndexes];
+
+		NSUInteger indx = [mBatchIndexes firstIndex];
 
-@interface DKBSPNode : NSObject {
-@public
-	DKLeafType mType;
-	union {
-		CGFloat mOffset;
-		NSUInteger mIndex;
-	} u;
+		while (indx != NSNotFound) {
+			id<DKStorableObject> obj = [self objectInObjectsAtIndex:indx];
+
+			if ([obj visible])
+				[mTree insertItemIndex:indx
+							  withRect:[obj bounds]];
+
+			indx = [mBatchIndexes indexGreaterThanIndex:indx];
+		}
+	}
+
+	[mBatchIndexes removeAllIndexes];
 }
 
-/**  */
-- (void)setType:(DKLeafType)aType;
-- (DKLeafType)type;
+- (NSArray*)treeObjectsNearPoint:(NSPoint)aPoint count:(NSUInteger)count withinDistance:(CGFloat)distance options:(DKObjectStorageOptions)options
+{
+	// measures only the objects in the leaves the square around the point touches
 
-- (void)setLeafIndex:(NSUInteger)indx;
-- (NSUInteger)leafIndex;
+	NSIndexSet* indexes = [mTree itemsIntersectingRect:NSMakeRect(aPoint.x - distance, aPoint.y - distance, distance * 2, distance * 2)];
+	NSUInteger i, n = [indexes count], found = 0;
 
-- (void)setOffset:(CGFloat)offset;
-- (CGFloat)offset;
+	if (n == 0)
+		return [NSArray array];
 
-@end
+	NSUInteger* buffer = malloc(sizeof(NSUInteger) * n);
+	DKObjectDistance* candidates = malloc(sizeof(DKObjectDistance) * n);
+	id<DKStorableObject> obj;
+	CGFloat d;
 
-#pragma mark -
+	@try {
+		[indexes getIndexes:buffer
+				   maxCount:n
+			   inIndexRange:NULL];
+
+		for (i = 0; i < n; ++i) {
+			obj = [self objectInObjectsAtIndex:buffer[i]];
+			d = DKObjectStorageDistanceToRect(aPoint, [obj bounds]);
+
+			if (d <= distance && (options & kDKExactDistance))
+				d = DKObjectStorageDistanceToObject(obj, aPoint, options);
 
-@implementation DKBSPNode
+			if (d > distance)
+				continue;
 
-- (void)setType:(DKLeafType)aType
+			candidates[found].object = obj;
+			candidates[found].distance = d;
+			candidates[found].index = buffer[i];
+			++found;
+		}
+
+		return DKObjectStorageNearestObjects(candidates, found, count);
+	}
+	@finally {
+		free(buffer);
+		free(candidates);
+	}
+}
+
+- (BOOL)restoreArchivedIndex
 {
-	mType = aType;
+	// the index is used once, whether or not it matches
+
+	NSData* data = [mArchivedIndex autorelease];
+	DKBSPArchivedIndexHeader header;
+
+	mArchivedIndex = nil;
+
+	if ([data length] < sizeof(header))
+		return NO;
+
+	memcpy(&header, [data bytes], sizeof(header));
+
+	if (header.magic != kDKBSPArchivedIndexMagic || header.version != kDKBSPArchivedIndexVersion)
+		return NO;
+
+	if (header.objectCount != [self countOfObjects] || !NSEqualSizes(NSMakeSize(header.canvasWidth, header.canvasHeight), [mTree canvasSize]))
+		return NO;
+
+	// a tree of fixed depth can only take an index of that depth. A dynamic one takes the archived depth, which suited these objects when
+	// they were saved - it may differ from the ideal depth within the slack and hysteresis allowed for
+
+	if (header.depth != [mTree depth] && (mTreeDepth != 0 || header.depth < kDKMinimumDepth || (kDKMaximumDepth != 0 && header.depth > kDKMaximumDepth)))
+		return NO;
+
+	if (boundsChecksumOfObjects([self objects]) != header.boundsChecksum)
+		return NO;
+
+	if (header.depth != [mTree depth])
+		[mTree setDepth:header.depth];
+
+	return [mTree restoreLeafData:[data subdataWithRange:NSMakeRange(sizeof(header), [data length] - sizeof(header))]
+						itemCount:[self countOfObjects]];
 }
 
-- (DKLeafType)type
+#pragma mark -
+
+- (NSData*)archivedIndex
 {
-	return mType;
+	// an index that hasn't been used yet - there's been no tree to load - is passed on as it is. It's still checked when it's used
+
+	if (mTree == nil)
+		return mArchivedIndex;
+
+	[self applyPendingBoundsUpdates];
+
+	NSData* leaves = [mTree leafData];
+
+	if (leaves == nil)
+		return nil;
+
+	DKBSPArchivedIndexHeader header;
+
+	memset(&header, 0, sizeof(header));
+	header.magic = kDKBSPArchivedIndexMagic;
+	header.version = kDKBSPArchivedIndexVersion;
+	header.objectCount = [self countOfObjects];
+	header.boundsChecksum = boundsChecksumOfObjects([self objects]);
+	header.canvasWidth = [mTree canvasSize].width;
+	header.canvasHeight = [mTree canvasSize].height;
+	header.depth = (uint32_t)[mTree depth];
+
+	NSMutableData* data = [NSMutableData dataWithCapacity:sizeof(header) + [leaves length]];
+
+	[data appendBytes:&header
+			   length:sizeof(header)];
+	[data appendData:leaves];
+
+	return data;
 }
 
-- (void)setLeafIndex:(NSUInteger)indx
+- (void)setArchivedIndex:(NSData*)data
 {
-	u.mIndex = indx;
+	[data retain];
+	[mArchivedIndex release];
+	mArchivedIndex = data;
 }
 
-- (NSUInteger)leafIndex
+#pragma mark -
+#pragma mark - as implementor of the NSCoding protocol
+
+- (id)initWithCoder:(NSCoder*)aCoder
 {
-	return u.mIndex;
+	// this method is here solely to support backward compatibility with b5; storage is no longer archived.
+
+	mBatchIndexes = [[NSMutableIndexSet alloc] init];
+	[super initWithCoder:aCoder];
+	mTreeDepth = [aCoder decodeIntegerForKey:@"DKBSPObjectStorage_treeDepth"];
+	[self setCanvasSize:[aCoder decodeSizeForKey:@"DKBSPObjectStorage_canvasSize"]];
+
+	return self;
 }
 
-- (void)setOffset:(CGFloat)offset
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (id)init
 {
-	u.mOffset = offset;
+	self = [super init];
+	if (self) {
+		mBatchIndexes = [[NSMutableIndexSet alloc] init];
+	}
+
+	return self;
 }
 
-- (CGFloat)offset
+- (void)dealloc
 {
-	return u.mOffset;
+	[mTree release];
+	[mBatchIndexes release];
+	[mArchivedIndex release];
+	[super dealloc];
 }
 
 @end
@@ -380,8 +804,9 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 @interface DKBSPIndexTree (Private)
 
 - (void)partition:(NSRect)rect depth:(NSUInteger)depth index:(NSUInteger)indx;
-- (void)recursivelySearchWithRect:(NSRect)rect index:(NSUInteger)indx;
-- (void)recursivelySearchWithPoint:(NSPoint)pt index:(NSUInteger)indx;
+- (void)searchWithRect:(NSRect)rect;
+- (void)searchWithPoint:(NSPoint)pt;
+- (void)operateOnLeafAtIndex:(NSUInteger)leafIndex;
 - (void)operateOnLeaf:(id)leaf;
 - (void)removeNodesAndLeaves;
 - (void)allocateLeaves:(NSUInteger)howMany;
@@ -403,7 +828,6 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	self = [super init];
 	if (self) {
 		mCanvasSize = size;
-		mNodes = [[NSMutableArray alloc] init];
 		mLeaves = [[NSMutableArray alloc] init];
 		mResults = [[NSMutableIndexSet alloc] init];
 		mDebugPath = [[NSBezierPath alloc] init];
@@ -419,6 +843,11 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	return mCanvasSize;
 }
 
+- (NSUInteger)depth
+{
+	return mDepth;
+}
+
 // a.k.a "initialize"
 
 - (void)setDepth:(NSUInteger)depth
@@ -428,15 +857,11 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	if (kDKMaximumDepth != 0)
 		depth = MIN(depth, kDKMaximumDepth);
 
-	NSUInteger i, nodeCount = ((1 << (depth + 1)) - 1);
+	// the nodes are allocated as a single contiguous block, laid out as an implicit binary heap (children of node n are at 2n+1 and 2n+2)
 
-	// prefill the nodes array
-
-	for (i = 0; i < nodeCount; ++i) {
-		DKBSPNode* node = [[DKBSPNode alloc] init];
-		[mNodes addObject:node];
-		[node release];
-	}
+	mNodeCount = ((1 << (depth + 1)) - 1);
+	mNodes = calloc(mNodeCount, sizeof(DKBSPNodeRec));
+	mDepth = depth;
 
 	[self allocateLeaves:(1 << depth)];
 
@@ -447,18 +872,17 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 			  depth:depth
 			  index:0];
 
-	LogEvent_(kInfoEvent, @"%@ <%p> (re)inited BSP, size = %@, depth = %d, nodes = %d, leaves = %d", NSStringFromClass([self class]), self, NSStringFromSize(mCanvasSize), depth, [mNodes count], [mLeaves count]);
+	DKTrace_(kDKTraceInfo, @"%@ <%p> (re)inited BSP, size = %@, depth = %d, nodes = %d, leaves = %d", NSStringFromClass([self class]), self, NSStringFromSize(mCanvasSize), depth, mNodeCount, [self countOfLeaves]);
 }
 
 - (void)insertItemIndex:(NSUInteger)idx withRect:(NSRect)rect
 {
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return;
 
 	mOp = kDKOperationInsert;
 	mOpIndex = idx;
-	[self recursivelySearchWithRect:rect
-							  index:0];
+	[self searchWithRect:rect];
 
 	//NSLog(@"inserted index = %d, bounds = %@", idx, NSStringFromRect( rect ));
 }
@@ -466,22 +890,33 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 - (void)removeItemIndex:(NSUInteger)idx withRect:(NSRect)rect
 {
 #pragma unused(rect)
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return;
 	/*
 	mOp = kDKOperationDelete;
 	mOpIndex = idx;
-	[self recursivelySearchWithRect:rect index:0];
+	[self searchWithRect:rect];
 	 */
 
 	[self removeIndex:idx];
 }
 
+- (void)removeItemIndexes:(NSIndexSet*)indexes
+{
+	// removes all of the indexes from every leaf in a single pass over the leaves
+
+	NSEnumerator* iter = [mLeaves objectEnumerator];
+	NSMutableIndexSet* leafSet;
+
+	while ((leafSet = [iter nextObject]))
+		[leafSet removeIndexes:indexes];
+}
+
 - (NSIndexSet*)itemsIntersectingRects:(const NSRect*)rects count:(NSUInteger)count
 {
 	// this may be used in conjunction with NSView's -getRectsBeingDrawn:count: to find those objects that intersect the non-rectangular update region.
 
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return nil;
 
 	mOp = kDKOperationAccumulate;
@@ -490,35 +925,32 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 	NSUInteger i;
 
 	for (i = 0; i < count; ++i)
-		[self recursivelySearchWithRect:rects[i]
-								  index:0];
+		[self searchWithRect:rects[i]];
 
 	return mResults;
 }
 
 - (NSIndexSet*)itemsIntersectingRect:(NSRect)rect
 {
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return nil;
 
 	mOp = kDKOperationAccumulate;
 	[mResults removeAllIndexes];
 
-	[self recursivelySearchWithRect:rect
-							  index:0];
+	[self searchWithRect:rect];
 	return mResults;
 }
 
 - (NSIndexSet*)itemsIntersectingPoint:(NSPoint)point
 {
-	if ([mNodes count] == 0)
+	if (mNodeCount == 0)
 		return nil;
 
 	mOp = kDKOperationAccumulate;
 	[mResults removeAllIndexes];
 
-	[self recursivelySearchWithPoint:point
-							   index:0];
+	[self searchWithPoint:point];
 	return mResults;
 }
 
@@ -540,6 +972,84 @@ static inline NSUInteger childNodeAtIndex(NSUInteger nodeIndex)
 										  by:delta];
 }
 
+- (NSData*)leafData
+{
+	NSMutableData* data = [NSMutableData data];
+	NSEnumerator* iter = [mLeaves objectEnumerator];
+	NSIndexSet* leafSet;
+	NSUInteger* indexes = NULL;
+	NSUInteger capacity = 0, n, i;
+	uint32_t word = (uint32_t)[mLeaves count];
+
+	[data appendBytes:&word
+			   length:sizeof(word)];
+
+	@try {
+		while ((leafSet = [iter nextObject])) {
+			n = [leafSet count];
+
+			if (n > capacity) {
+				capacity = n;
+				indexes = realloc(indexes, sizeof(NSUInteger) * capacity);
+			}
+
+			[leafSet getIndexes:indexes
+					   maxCount:n
+				   inIndexRange:NULL];
+
+			word = (uint32_t)n;
+			[data appendBytes:&word
+					   length:sizeof(word)];
+
+			for (i = 0; i < n; ++i) {
+				// indexes too large to archive as 32 bits - not expected in practice - mean there's no archived index
+
+				if (indexes[i] > UINT32_MAX)
+					return nil;
+
+				word = (uint32_t)indexes[i];
+				[data appendBytes:&word
+						   length:sizeof(word)];
+			}
+		}
+	}
+	@finally {
+		free(indexes);
+	}
+
+	return data;
+}
+
+- (BOOL)restoreLeafData:(NSData*)data itemCount:(NSUInteger)count
+{
+	if (!validateLeafData(data, [self countOfLeaves], count))
+		return NO;
+
+	const uint32_t* p = (const uint32_t*)[data bytes] + 1;
+	NSEnumerator* iter = [mLeaves objectEnumerator];
+	NSMutableIndexSet* leafSet;
+	NSUInteger n, i, runStart;
+
+	while ((leafSet = [iter nextObject])) {
+		n = *p++;
+
+		// the indexes are ascending, so they're added as runs
+
+		for (i = 0; i < n;) {
+			runStart = i;
+
+			while (++i < n && p[i] == p[i - 1] + 1)
+				;
+
+			[leafSet addIndexesInRange:NSMakeRange(p[runStart], i - runStart)];
+		}
+
+		p += n;
+	}
+
+	return YES;
+}
+
 - (NSBezierPath*)debugStorageDivisions
 {
 	// returns a path consisting of all the BSP rect divisions
@@ -557,11 +1067,11 @@ static NSUInteger sLeafCount = 0;
 	// recursively subdivide the total canvas size into equal halves in alternating horizontal and vertical directions.
 	// This is done once when the tree is built or rebuilt.
 
-	DKBSPNode* node = [mNodes objectAtIndex:indx];
+	DKBSPNodeRec* node = &mNodes[indx];
 
 	if (indx == 0) {
-		[node setType:kNodeHorizontal];
-		[node setOffset:NSMidX(rect)];
+		node->type = kNodeHorizontal;
+		node->u.offset = NSMidX(rect);
 		sLeafCount = 0;
 
 		[mDebugPath removeAllPoints];
@@ -574,7 +1084,7 @@ static NSUInteger sLeafCount = 0;
 		NSRect ra, rb;
 		CGFloat oa, ob;
 
-		if ([node type] == kNodeHorizontal) {
+		if (node->type == kNodeHorizontal) {
 			type = kNodeVertical;
 			ra = NSMakeRect(NSMinX(rect), NSMinY(rect), NSWidth(rect), NSHeight(rect) * 0.5f);
 			rb = NSMakeRect(NSMinX(rect), NSMaxY(ra), NSWidth(rect), NSHeight(rect) - NSHeight(ra));
@@ -590,13 +1100,10 @@ static NSUInteger sLeafCount = 0;
 
 		NSUInteger chIdx = childNodeAtIndex(indx);
 
-		DKBSPNode* child = [mNodes objectAtIndex:chIdx];
-		[child setType:type];
-		[child setOffset:oa];
-
-		child = [mNodes objectAtIndex:chIdx + 1];
-		[child setType:type];
-		[child setOffset:ob];
+		mNodes[chIdx].type = type;
+		mNodes[chIdx].u.offset = oa;
+		mNodes[chIdx + 1].type = type;
+		mNodes[chIdx + 1].u.offset = ob;
 
 		[self partition:ra
 				  depth:depth - 1
@@ -605,116 +1112,88 @@ static NSUInteger sLeafCount = 0;
 				  depth:depth - 1
 				  index:chIdx + 1];
 	} else {
-		[node setType:kNodeLeaf];
-		[node setLeafIndex:sLeafCount++];
-	}
-}
-
-// if set to 1, recursive function avoids obj-C message dispatch for slightly more performance
-
-#define qUseImpCaching 1
-
-- (void)recursivelySearchWithRect:(NSRect)rect index:(NSUInteger)indx
-{
-#if qUseImpCaching
-	static void (*sfunc)(id, SEL, NSRect, NSUInteger) = nil;
-
-	if (sfunc == nil)
-		sfunc = (void (*)(id, SEL, NSRect, NSUInteger))[[self class] instanceMethodForSelector : _cmd];
-#endif
-
-	DKBSPNode* node = [mNodes objectAtIndex:indx];
-	NSUInteger subnode = childNodeAtIndex(indx);
-
-	switch (node->mType) {
-	case kNodeHorizontal:
-		if (NSMinY(rect) < node->u.mOffset) {
-#if qUseImpCaching
-			sfunc(self, _cmd, rect, subnode);
-#else
-			[self recursivelySearchWithRect:rect
-									  index:subnode];
-#endif
-			if (NSMaxY(rect) >= node->u.mOffset)
-#if qUseImpCaching
-				sfunc(self, _cmd, rect, subnode + 1);
-#else
-				[self recursivelySearchWithRect:rect
-										  index:subnode + 1];
-#endif
-		} else
-#if qUseImpCaching
-			sfunc(self, _cmd, rect, subnode + 1);
-#else
-			[self recursivelySearchWithRect:rect
-									  index:subnode + 1];
-#endif
-		break;
+		node->type = kNodeLeaf;
+		node->u.leafIndex = sLeafCount++;
+	}
+}
 
-	case kNodeVertical:
-		if (NSMinX(rect) < node->u.mOffset) {
-#if qUseImpCaching
-			sfunc(self, _cmd, rect, subnode);
-#else
-			[self recursivelySearchWithRect:rect
-									  index:subnode];
-#endif
-			if (NSMaxX(rect) >= node->u.mOffset)
-#if qUseImpCaching
-				sfunc(self, _cmd, rect, subnode + 1);
-#else
-				[self recursivelySearchWithRect:rect
-										  index:subnode + 1];
-#endif
-		} else
-#if qUseImpCaching
-			sfunc(self, _cmd, rect, subnode + 1);
-#else
-			[self recursivelySearchWithRect:rect
-									  index:subnode + 1];
-#endif
-		break;
+- (void)searchWithRect:(NSRect)rect
+{
+	// non-recursive traversal using an explicit stack. Because each node visited pushes at most two children and one of them is popped
+	// immediately, the stack never holds more than depth + 1 entries.
 
-	case kNodeLeaf:
-		[self operateOnLeaf:[mLeaves objectAtIndex:node->u.mIndex]];
-		break;
+	// the leaf operation is looked up once per search to avoid a dispatch for every leaf visited
 
-	default:
-		break;
+	SEL leafSel = @selector(operateOnLeafAtIndex:);
+	void (*leafFunc)(id, SEL, NSUInteger) = (void (*)(id, SEL, NSUInteger))[self methodForSelector:leafSel];
+
+	NSUInteger stack[mDepth + 2];
+	NSUInteger sp = 0;
+	CGFloat minX = NSMinX(rect), maxX = NSMaxX(rect);
+	CGFloat minY = NSMinY(rect), maxY = NSMaxY(rect);
+
+	stack[sp++] = 0;
+
+	while (sp > 0) {
+		NSUInteger indx = stack[--sp];
+		DKBSPNodeRec* node = &mNodes[indx];
+		NSUInteger subnode = childNodeAtIndex(indx);
+
+		switch (node->type) {
+		case kNodeHorizontal:
+			if (minY < node->u.offset) {
+				if (maxY >= node->u.offset)
+					stack[sp++] = subnode + 1;
+
+				stack[sp++] = subnode;
+			} else
+				stack[sp++] = subnode + 1;
+			break;
+
+		case kNodeVertical:
+			if (minX < node->u.offset) {
+				if (maxX >= node->u.offset)
+					stack[sp++] = subnode + 1;
+
+				stack[sp++] = subnode;
+			} else
+				stack[sp++] = subnode + 1;
+			break;
+
+		case kNodeLeaf:
+			leafFunc(self, leafSel, node->u.leafIndex);
+			break;
+
+		default:
+			break;
+		}
 	}
 }
 
-- (void)recursivelySearchWithPoint:(NSPoint)pt index:(NSUInteger)indx
+- (void)searchWithPoint:(NSPoint)pt
 {
-	DKBSPNode* node = [mNodes objectAtIndex:indx];
-	NSUInteger subnode = childNodeAtIndex(indx);
+	// a point can only ever fall in one leaf, so this just walks down the tree
 
-	switch ([node type]) {
-	case kNodeLeaf:
-		[self operateOnLeaf:[mLeaves objectAtIndex:[node leafIndex]]];
-		break;
+	NSUInteger indx = 0;
+	DKBSPNodeRec* node = &mNodes[0];
 
-	case kNodeVertical:
-		if (pt.x < [node offset])
-			[self recursivelySearchWithPoint:pt
-									   index:subnode];
-		else
-			[self recursivelySearchWithPoint:pt
-									   index:subnode + 1];
-		break;
+	while (node->type != kNodeLeaf) {
+		NSUInteger subnode = childNodeAtIndex(indx);
 
-	case kNodeHorizontal:
-		if (pt.y < [node offset])
-			[self recursivelySearchWithPoint:pt
-									   index:subnode];
+		if (node->type == kNodeVertical)
+			indx = (pt.x < node->u.offset) ? subnode : subnode + 1;
 		else
-			[self recursivelySearchWithPoint:pt
-									   index:subnode + 1];
-		break;
+			indx = (pt.y < node->u.offset) ? subnode : subnode + 1;
 
-	default:
-		break;
+		node = &mNodes[indx];
 	}
+
+	[self operateOnLeafAtIndex:node->u.leafIndex];
+}
+
+- (void)operateOnLeafAtIndex:(NSUInteger)leafIndex
+{
+	[self operateOnLeaf:[mLeaves objectAtIndex:leafIndex]];
 }
 
 - (void)operateOnLeaf:(id)leaf
@@ -741,7 +1220,9 @@ static NSUInteger sLeafCount = 0;
 
 - (void)removeNodesAndLeaves
 {
-	[mNodes removeAllObjects];
+	free(mNodes);
+	mNodes = NULL;
+	mNodeCount = 0;
 	[mLeaves removeAllObjects];
 }
 
@@ -772,7 +1253,7 @@ static NSUInteger sLeafCount = 0;
 
 - (void)dealloc
 {
-	[mNodes release];
+	free(mNodes);
 	[mLeaves release];
 	[mResults release];
 	[mDebugPath release];
@@ -787,3 +1268,328 @@ static NSUInteger sLeafCount = 0;
 }
 
 @end
+
+#pragma mark -
+
+// utility functions for the packed leaves. Each leaf is a sorted vector of unique 32-bit indexes.
+
+static NSUInteger packedLeafLowerBound(const DKBSPPackedLeaf* leaf, uint32_t value)
+{
+	// returns the position of the first item >= <value>
+
+	NSUInteger lo = 0, hi = leaf->count;
+
+	while (lo < hi) {
+		NSUInteger mid = (lo + hi) >> 1;
+
+		if (leaf->items[mid] < value)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void packedLeafInsert(DKBSPPackedLeaf* leaf, uint32_t value)
+{
+	NSUInteger pos = packedLeafLowerBound(leaf, value);
+
+	if (pos < leaf->count && leaf->items[pos] == value)
+		return;
+
+	if (leaf->count == leaf->capacity) {
+		leaf->capacity = MAX(leaf->capacity * 2, (NSUInteger)8);
+		leaf->items = realloc(leaf->items, sizeof(uint32_t) * leaf->capacity);
+	}
+
+	memmove(&leaf->items[pos + 1], &leaf->items[pos], sizeof(uint32_t) * (leaf->count - pos));
+	leaf->items[pos] = value;
+	leaf->count++;
+}
+
+static void packedLeafRemove(DKBSPPackedLeaf* leaf, uint32_t value)
+{
+	NSUInteger pos = packedLeafLowerBound(leaf, value);
+
+	if (pos < leaf->count && leaf->items[pos] == value) {
+		memmove(&leaf->items[pos], &leaf->items[pos + 1], sizeof(uint32_t) * (leaf->count - pos - 1));
+		leaf->count--;
+	}
+}
+
+static int compareUInt32(const void* a, const void* b)
+{
+	uint32_t ua = *(const uint32_t*)a;
+	uint32_t ub = *(const uint32_t*)b;
+
+	return (ua < ub) ? -1 : ((ua > ub) ? 1 : 0);
+}
+
+@interface DKBSPPackedIndexTree (Private)
+
+- (void)gatherResults;
+
+@end
+
+#pragma mark -
+
+@implementation DKBSPPackedIndexTree
+
+- (NSIndexSet*)itemsIntersectingRects:(const NSRect*)rects count:(NSUInteger)count
+{
+	mScratchCount = 0;
+
+	if ([super itemsIntersectingRects:rects
+								count:count] == nil)
+		return nil;
+
+	[self gatherResults];
+	return mResults;
+}
+
+- (NSIndexSet*)itemsIntersectingRect:(NSRect)rect
+{
+	mScratchCount = 0;
+
+	if ([super itemsIntersectingRect:rect] == nil)
+		return nil;
+
+	[self gatherResults];
+	return mResults;
+}
+
+- (NSIndexSet*)itemsIntersectingPoint:(NSPoint)point
+{
+	mScratchCount = 0;
+
+	if ([super itemsIntersectingPoint:point] == nil)
+		return nil;
+
+	[self gatherResults];
+	return mResults;
+}
+
+- (NSUInteger)countOfLeaves
+{
+	return mPackedLeafCount;
+}
+
+- (void)removeItemIndexes:(NSIndexSet*)indexes
+{
+	NSUInteger n = [indexes count];
+
+	if (n == 0)
+		return;
+
+	// flatten the set to a sorted vector, then merge it against each leaf
+
+	NSUInteger* removals = malloc(sizeof(NSUInteger) * n);
+	NSUInteger i, j, k, r;
+
+	[indexes getIndexes:removals
+			   maxCount:n
+		   inIndexRange:NULL];
+
+	for (i = 0; i < mPackedLeafCount; ++i) {
+		DKBSPPackedLeaf* leaf = &mPackedLeaves[i];
+
+		for (j = k = r = 0; j < leaf->count; ++j) {
+			while (r < n && removals[r] < leaf->items[j])
+				++r;
+
+			if (r == n || removals[r] != leaf->items[j])
+				leaf->items[k++] = leaf->items[j];
+		}
+
+		leaf->count = k;
+	}
+
+	free(removals);
+}
+
+- (void)shiftIndexesStartingAtIndex:(NSUInteger)startIndex by:(NSInteger)delta
+{
+	// same semantics as -[NSMutableIndexSet shiftIndexesStartingAtIndex:by:]: when shifting down, any indexes in the range
+	// vacated by the shift are discarded.
+
+	NSUInteger i, j;
+
+	for (i = 0; i < mPackedLeafCount; ++i) {
+		DKBSPPackedLeaf* leaf = &mPackedLeaves[i];
+		NSUInteger pos = packedLeafLowerBound(leaf, (uint32_t)startIndex);
+
+		if (pos == leaf->count)
+			continue;
+
+		if (delta < 0) {
+			uint32_t floor = (uint32_t)MAX((NSInteger)startIndex + delta, 0);
+			NSUInteger first = packedLeafLowerBound(leaf, floor);
+
+			if (first < pos) {
+				memmove(&leaf->items[first], &leaf->items[pos], sizeof(uint32_t) * (leaf->count - pos));
+				leaf->count -= (pos - first);
+				pos = first;
+			}
+		}
+
+		for (j = pos; j < leaf->count; ++j)
+			leaf->items[j] = (uint32_t)((NSInteger)leaf->items[j] + delta);
+	}
+}
+
+- (NSData*)leafData
+{
+	// the leaves are already sorted 32-bit vectors, so they're copied as they are
+
+	NSUInteger i, words = 1 + mPackedLeafCount;
+
+	for (i = 0; i < mPackedLeafCount; ++i)
+		words += mPackedLeaves[i].count;
+
+	NSMutableData* data = [NSMutableData dataWithLength:sizeof(uint32_t) * words];
+	uint32_t* p = (uint32_t*)[data mutableBytes];
+
+	*p++ = (uint32_t)mPackedLeafCount;
+
+	for (i = 0; i < mPackedLeafCount; ++i) {
+		*p++ = (uint32_t)mPackedLeaves[i].count;
+		memcpy(p, mPackedLeaves[i].items, sizeof(uint32_t) * mPackedLeaves[i].count);
+		p += mPackedLeaves[i].count;
+	}
+
+	return data;
+}
+
+- (BOOL)restoreLeafData:(NSData*)data itemCount:(NSUInteger)count
+{
+	if (!validateLeafData(data, mPackedLeafCount, count))
+		return NO;
+
+	const uint32_t* p = (const uint32_t*)[data bytes] + 1;
+	NSUInteger i, n;
+
+	for (i = 0; i < mPackedLeafCount; ++i) {
+		DKBSPPackedLeaf* leaf = &mPackedLeaves[i];
+
+		n = *p++;
+
+		if (n > leaf->capacity) {
+			leaf->capacity = n;
+			leaf->items = realloc(leaf->items, sizeof(uint32_t) * n);
+		}
+
+		memcpy(leaf->items, p, sizeof(uint32_t) * n);
+		leaf->count = n;
+		p += n;
+	}
+
+	return YES;
+}
+
+- (NSString*)description
+{
+	NSUInteger i, total = 0;
+
+	for (i = 0; i < mPackedLeafCount; ++i)
+		total += mPackedLeaves[i].count;
+
+	return [NSString stringWithFormat:@"<%@ %p>, %ld leaves, %ld leaf entries", NSStringFromClass([self class]), self, (long)mPackedLeafCount, (long)total];
+}
+
+#pragma mark -
+#pragma mark - private
+
+- (void)operateOnLeafAtIndex:(NSUInteger)leafIndex
+{
+	DKBSPPackedLeaf* leaf = &mPackedLeaves[leafIndex];
+
+	switch (mOp) {
+	case kDKOperationInsert:
+		NSAssert(mOpIndex <= UINT32_MAX, @"index too large for packed BSP tree");
+		packedLeafInsert(leaf, (uint32_t)mOpIndex);
+		break;
+
+	case kDKOperationDelete:
+		packedLeafRemove(leaf, (uint32_t)mOpIndex);
+		break;
+
+	case kDKOperationAccumulate:
+		if (leaf->count > 0) {
+			if (mScratchCount + leaf->count > mScratchCapacity) {
+				mScratchCapacity = MAX(mScratchCapacity * 2, mScratchCount + leaf->count);
+				mScratch = realloc(mScratch, sizeof(uint32_t) * mScratchCapacity);
+			}
+
+			memcpy(&mScratch[mScratchCount], leaf->items, sizeof(uint32_t) * leaf->count);
+			mScratchCount += leaf->count;
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+- (void)gatherResults
+{
+	// the indexes accumulated from the leaves are sorted, then added to the result set as runs, so that the index set is built with the
+	// minimum number of range insertions.
+
+	if (mScratchCount == 0)
+		return;
+
+	qsort(mScratch, mScratchCount, sizeof(uint32_t), compareUInt32);
+
+	NSUInteger i = 0;
+
+	while (i < mScratchCount) {
+		NSUInteger runStart = mScratch[i];
+		NSUInteger runEnd = runStart;
+
+		while (++i < mScratchCount && mScratch[i] <= runEnd + 1)
+			runEnd = mScratch[i];
+
+		[mResults addIndexesInRange:NSMakeRange(runStart, runEnd - runStart + 1)];
+	}
+}
+
+- (void)removeNodesAndLeaves
+{
+	[super removeNodesAndLeaves];
+
+	NSUInteger i;
+
+	for (i = 0; i < mPackedLeafCount; ++i)
+		free(mPackedLeaves[i].items);
+
+	free(mPackedLeaves);
+	mPackedLeaves = NULL;
+	mPackedLeafCount = 0;
+}
+
+- (void)allocateLeaves:(NSUInteger)howMany
+{
+	mPackedLeaves = calloc(howMany, sizeof(DKBSPPackedLeaf));
+	mPackedLeafCount = howMany;
+}
+
+- (void)removeIndex:(NSUInteger)indx
+{
+	NSUInteger i;
+
+	for (i = 0; i < mPackedLeafCount; ++i)
+		packedLeafRemove(&mPackedLeaves[i], (uint32_t)indx);
+}
+
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (void)dealloc
+{
+	[self removeNodesAndLeaves];
+	free(mScratch);
+	[super dealloc];
+}
+
+@end
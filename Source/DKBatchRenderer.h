@@ -0,0 +1,166 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+// the kinds of file a batch job can write:
+
+typedef enum {
+	kDKBatchRenderPNG = 0,
+	kDKBatchRenderJPEG = 1,
+	kDKBatchRenderTIFF = 2,
+	kDKBatchRenderPDF = 3,
+	kDKBatchRenderSVG = 4
+} DKBatchRenderFormat;
+
+/** @brief One document to be converted by a DKBatchRenderer, and afterwards, how long each part of converting it took.
+
+ A job names a saved drawing and the file to write it to. Once the renderer has run it, the job also holds whether it succeeded and the
+ times taken to read the document, render it and finish writing the file. Bitmap formats are rendered a band at a time as the file is
+ written, and their render time is the time spent on the bands. SVG is written as it's made, so its time is all render time.
+*/
+@interface DKBatchRenderJob : NSObject {
+@private
+	NSURL* mDocumentURL;
+	NSURL* mOutputURL;
+	DKBatchRenderFormat mFormat;
+	CGFloat mScale;
+	BOOL mDrawsPaper;
+	BOOL mSucceeded;
+	NSString* mFailureReason;
+	NSTimeInterval mLoadTime;
+	NSTimeInterval mRenderTime;
+	NSTimeInterval mWriteTime;
+}
+
+/** @brief Returns the format for a file name extension
+ @param extension an extension such as "png" or "svg", in either case
+ @param format receives the format
+ @return YES if the extension is one a job can write
+ */
++ (BOOL)getFormat:(DKBatchRenderFormat*)format forPathExtension:(NSString*)extension;
+
+/** @brief Makes a job to convert a document
+ @param documentURL a file URL for a saved drawing
+ @param outputURL a file URL for the file to write, which is replaced if it exists
+ @param format the kind of file to write
+ @return the job
+ */
+- (id)initWithDocumentURL:(NSURL*)documentURL outputURL:(NSURL*)outputURL format:(DKBatchRenderFormat)format;
+
+- (NSURL*)documentURL;
+- (NSURL*)outputURL;
+- (DKBatchRenderFormat)format;
+
+/** @brief Sets the number of pixels per drawing unit for bitmap formats
+
+ The default is 1.0, for an image at 72 dpi. PDF and SVG are written at the drawing's own size.
+ @param scale the scale, greater than zero
+ */
+- (void)setScale:(CGFloat)scale;
+- (CGFloat)scale;
+
+/** @brief Sets whether the paper colour is painted behind the drawing
+
+ The default is YES. JPEG has no alpha channel, so without the paper what's behind the drawing is black.
+ @param paper YES to paint the paper colour
+ */
+- (void)setDrawsPaper:(BOOL)paper;
+- (BOOL)drawsPaper;
+
+/** @brief Whether the job ran and wrote its file
+ @return YES once the file has been written
+ */
+- (BOOL)succeeded;
+
+/** @brief Why the job failed
+ @return a description of the failure, or nil if it hasn't failed
+ */
+- (NSString*)failureReason;
+
+/** @brief The time taken to read the document
+ @return the time in seconds
+ */
+- (NSTimeInterval)loadTime;
+
+/** @brief The time taken to render the drawing
+ @return the time in seconds
+ */
+- (NSTimeInterval)renderTime;
+
+/** @brief The time taken to finish writing the file after rendering
+ @return the time in seconds
+ */
+- (NSTimeInterval)writeTime;
+
+@end
+
+#pragma mark -
+
+/** @brief Converts many saved drawings to image, PDF or SVG files at once, without a window or the main thread.
+
+ Converts many saved drawings to image, PDF or SVG files at once, without a window or the main thread. Each job is run on a worker thread,
+ with at most -maximumConcurrentJobs of them running at a time: the worker reads the document with a DKUnarchivingHelper of its own (see
+ +[DKDrawing drawingWithData:dearchivingHelper:]), renders it with its own DKDrawingRenderer and writes the file, all inside an autorelease
+ pool of its own, so nothing of a job outlives it. Since each drawing is only ever seen by the worker that read it, and drawings read from
+ files have styles of their own, the jobs don't need to share anything. Styles must not be interned while jobs run (see
+ +[DKDrawing setInternsStylesWhenReading:]), as that would share them.
+
+ Bitmaps are rendered a band of kDKBatchRenderBandHeight rows at a time as the image's data is read by ImageIO, so a job holds one band
+ rather than the whole image, however large it is. PDFs are rendered straight into a PDF context writing to the file, and SVG is streamed
+ to the file by a DKSVGExporter.
+
+ The memory a job holds beyond that is mostly its drawing, so the number of concurrent jobs bounds the memory of the whole batch.
+*/
+@interface DKBatchRenderer : NSObject {
+@private
+	NSArray* mJobs;
+	NSUInteger mMaxConcurrentJobs;
+	id mDelegate;
+	NSLock* mDelegateLock;
+}
+
+/** @brief Makes a renderer for some jobs
+ @param jobs DKBatchRenderJobs, which are run in roughly the order given
+ @return the renderer
+ */
+- (id)initWithJobs:(NSArray*)jobs;
+
+- (NSArray*)jobs;
+
+/** @brief Sets how many jobs may run at the same time
+
+ The default is the number of active processors.
+ @param maxJobs the number of jobs, at least 1
+ */
+- (void)setMaximumConcurrentJobs:(NSUInteger)maxJobs;
+- (NSUInteger)maximumConcurrentJobs;
+
+/** @brief Sets the object told as each job finishes
+
+ The delegate is not retained. It's called on the thread that ran the job, but never for two jobs at once.
+ @param aDelegate an object implementing the DKBatchRendererDelegate informal protocol, or nil
+ */
+- (void)setDelegate:(id)aDelegate;
+- (id)delegate;
+
+/** @brief Runs all the jobs, returning when they have finished
+ @return the number of jobs that failed
+ */
+- (NSUInteger)run;
+
+@end
+
+// informal protocol that an object can implement to be told as each job of a batch finishes, whether or not it succeeded
+
+@interface NSObject (DKBatchRendererDelegate)
+
+- (void)batchRenderer:(DKBatchRenderer*)renderer didFinishJob:(DKBatchRenderJob*)job;
+
+@end
+
+#define kDKBatchRenderBandHeight 256 // rows of pixels rendered at a time for bitmap formats
+#define kDKBatchRenderJPEGQuality 0.9 // the compression quality of JPEG output, from 0 to 1
@@ -0,0 +1,527 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKBatchRenderer.h"
+#import "DKDrawing.h"
+#import "DKDrawing+Export.h"
+#import "DKDrawingRenderer.h"
+#import "DKUnarchivingHelper.h"
+#import "LogEvent.h"
+#include <dispatch/dispatch.h>
+
+@interface DKBatchRenderJob (Private)
+
+- (void)run;
+- (BOOL)writeBitmapOfDrawing:(DKDrawing*)drawing;
+- (BOOL)writePDFOfDrawing:(DKDrawing*)drawing;
+- (void)setFailureReason:(NSString*)reason;
+
+@end
+
+@interface DKBatchRenderer (Private)
+
+- (void)jobDidFinish:(DKBatchRenderJob*)job;
+
+@end
+
+#pragma mark Banded bitmaps
+
+// a bitmap job's image is rendered into one band's worth of pixels at a time, as ImageIO reads its data from the top down
+
+typedef struct {
+	DKDrawingRenderer* renderer; // not retained
+	CGContextRef band;
+	uint8_t* pixels;
+	size_t width;
+	size_t height;
+	size_t bytesPerRow;
+	CGFloat scale;
+	size_t bandFirstRow; // the rows the band holds, or none if bandRows is 0
+	size_t bandRows;
+	size_t position; // in bytes from the start of the image
+	NSTimeInterval renderTime;
+} DKBatchBandState;
+
+static void renderBandFromRow(DKBatchBandState* s, size_t firstRow)
+{
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+	size_t rows = MIN((size_t)kDKBatchRenderBandHeight, s->height - firstRow);
+
+	memset(s->pixels, 0, s->bytesPerRow * kDKBatchRenderBandHeight);
+
+	// the band's top row is the first in memory, so the area of the drawing it shows fills it from the top, leaving the unused rows of a
+	// short last band at the bottom
+
+	[s->renderer renderRect:NSMakeRect(0, firstRow / s->scale, s->width / s->scale, rows / s->scale)
+				intoContext:s->band
+			destinationRect:CGRectMake(0, kDKBatchRenderBandHeight - rows, s->width, rows)];
+
+	s->bandFirstRow = firstRow;
+	s->bandRows = rows;
+	s->renderTime += [NSDate timeIntervalSinceReferenceDate] - start;
+}
+
+static size_t bandGetBytes(void* info, void* buffer, size_t count)
+{
+	DKBatchBandState* s = (DKBatchBandState*)info;
+	size_t total = s->height * s->bytesPerRow;
+	size_t copied = 0;
+
+	while (copied < count && s->position < total) {
+		size_t row = s->position / s->bytesPerRow;
+
+		if (s->bandRows == 0 || row < s->bandFirstRow || row >= s->bandFirstRow + s->bandRows)
+			renderBandFromRow(s, row - (row % kDKBatchRenderBandHeight));
+
+		size_t offset = s->position - (s->bandFirstRow * s->bytesPerRow);
+		size_t n = MIN(s->bandRows * s->bytesPerRow - offset, count - copied);
+
+		memcpy((uint8_t*)buffer + copied, s->pixels + offset, n);
+		s->position += n;
+		copied += n;
+	}
+
+	return copied;
+}
+
+static off_t bandSkipForward(void* info, off_t count)
+{
+	DKBatchBandState* s = (DKBatchBandState*)info;
+	size_t n = MIN((size_t)count, s->height * s->bytesPerRow - s->position);
+
+	s->position += n;
+	return (off_t)n;
+}
+
+static void bandRewind(void* info)
+{
+	((DKBatchBandState*)info)->position = 0;
+}
+
+#pragma mark Workers
+
+// context is an array of { the renderer, the job, the semaphore limiting the jobs running }
+
+static void runBatchJob(void* context)
+{
+	void** job = (void**)context;
+
+	@autoreleasepool
+	{
+		[(DKBatchRenderJob*)job[1] run];
+		[(DKBatchRenderer*)job[0] jobDidFinish:(DKBatchRenderJob*)job[1]];
+	}
+
+	dispatch_semaphore_signal((dispatch_semaphore_t)job[2]);
+	free(job);
+}
+
+#pragma mark -
+
+@implementation DKBatchRenderJob
+
++ (BOOL)getFormat:(DKBatchRenderFormat*)format forPathExtension:(NSString*)extension
+{
+	static NSDictionary* sFormats = nil;
+
+	if (sFormats == nil)
+		sFormats = [[NSDictionary alloc] initWithObjectsAndKeys:[NSNumber numberWithInt:kDKBatchRenderPNG], @"png",
+																[NSNumber numberWithInt:kDKBatchRenderJPEG], @"jpg",
+																[NSNumber numberWithInt:kDKBatchRenderJPEG], @"jpeg",
+																[NSNumber numberWithInt:kDKBatchRenderTIFF], @"tif",
+																[NSNumber numberWithInt:kDKBatchRenderTIFF], @"tiff",
+																[NSNumber numberWithInt:kDKBatchRenderPDF], @"pdf",
+																[NSNumber numberWithInt:kDKBatchRenderSVG], @"svg", nil];
+
+	NSNumber* value = [sFormats objectForKey:[extension lowercaseString]];
+
+	if (value == nil)
+		return NO;
+
+	if (format)
+		*format = (DKBatchRenderFormat)[value intValue];
+
+	return YES;
+}
+
+- (id)initWithDocumentURL:(NSURL*)documentURL outputURL:(NSURL*)outputURL format:(DKBatchRenderFormat)format
+{
+	NSAssert(documentURL != nil, @"cannot render a nil document URL");
+	NSAssert(outputURL != nil, @"cannot render to a nil output URL");
+
+	self = [super init];
+	if (self) {
+		mDocumentURL = [documentURL copy];
+		mOutputURL = [outputURL copy];
+		mFormat = format;
+		mScale = 1.0;
+		mDrawsPaper = YES;
+	}
+
+	return self;
+}
+
+- (NSURL*)documentURL
+{
+	return mDocumentURL;
+}
+
+- (NSURL*)outputURL
+{
+	return mOutputURL;
+}
+
+- (DKBatchRenderFormat)format
+{
+	return mFormat;
+}
+
+- (void)setScale:(CGFloat)scale
+{
+	NSAssert(scale > 0, @"scale must be greater than zero");
+	mScale = scale;
+}
+
+- (CGFloat)scale
+{
+	return mScale;
+}
+
+- (void)setDrawsPaper:(BOOL)paper
+{
+	mDrawsPaper = paper;
+}
+
+- (BOOL)drawsPaper
+{
+	return mDrawsPaper;
+}
+
+- (BOOL)succeeded
+{
+	return mSucceeded;
+}
+
+- (NSString*)failureReason
+{
+	return mFailureReason;
+}
+
+- (NSTimeInterval)loadTime
+{
+	return mLoadTime;
+}
+
+- (NSTimeInterval)renderTime
+{
+	return mRenderTime;
+}
+
+- (NSTimeInterval)writeTime
+{
+	return mWriteTime;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mDocumentURL release];
+	[mOutputURL release];
+	[mFailureReason release];
+	[super dealloc];
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"%@ %@ -> %@", [super description], [mDocumentURL path], [mOutputURL path]];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKBatchRenderJob (Private)
+
+- (void)run
+{
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+	NSError* error = nil;
+	DKDrawing* drawing = nil;
+
+	mSucceeded = NO;
+	mLoadTime = mRenderTime = mWriteTime = 0;
+
+	@try
+	{
+		NSData* data = [NSData dataWithContentsOfURL:mDocumentURL
+											 options:NSDataReadingMappedIfSafe
+											   error:&error];
+
+		if (data == nil) {
+			[self setFailureReason:[error localizedDescription]];
+			return;
+		}
+
+		// the default dearchiving helper is shared by the whole process and changes as it decodes, so each job reads with its own
+
+		DKUnarchivingHelper* helper = [[[DKUnarchivingHelper alloc] init] autorelease];
+
+		drawing = [DKDrawing drawingWithData:data
+						   dearchivingHelper:helper];
+		mLoadTime = [NSDate timeIntervalSinceReferenceDate] - start;
+
+		if (drawing == nil) {
+			[self setFailureReason:@"the document is not a drawing"];
+			return;
+		}
+
+		switch (mFormat) {
+		case kDKBatchRenderPNG:
+		case kDKBatchRenderJPEG:
+		case kDKBatchRenderTIFF:
+			mSucceeded = [self writeBitmapOfDrawing:drawing];
+			break;
+
+		case kDKBatchRenderPDF:
+			mSucceeded = [self writePDFOfDrawing:drawing];
+			break;
+
+		case kDKBatchRenderSVG:
+			// the drawing was read by this thread and is seen by no other, so it can be exported here instead of on the main thread. The
+			// document is written as it's made, so the time is all rendering
+
+			start = [NSDate timeIntervalSinceReferenceDate];
+			mSucceeded = [drawing writeSVGToURL:mOutputURL];
+			mRenderTime = [NSDate timeIntervalSinceReferenceDate] - start;
+			break;
+		}
+
+		if (!mSucceeded && mFailureReason == nil)
+			[self setFailureReason:@"the file could not be written"];
+	}
+	@catch (id exc)
+	{
+		LogEvent_(kWheneverEvent, @"exception while batch rendering %@ (%@)", [mDocumentURL path], exc);
+		[self setFailureReason:[exc description]];
+		mSucceeded = NO;
+	}
+}
+
+- (BOOL)writeBitmapOfDrawing:(DKDrawing*)drawing
+{
+	NSSize size = [drawing drawingSize];
+	DKBatchBandState s;
+
+	memset(&s, 0, sizeof(s));
+	s.width = (size_t)ceil(size.width * mScale);
+	s.height = (size_t)ceil(size.height * mScale);
+	s.bytesPerRow = s.width * 4;
+	s.scale = mScale;
+
+	if (s.width == 0 || s.height == 0) {
+		[self setFailureReason:@"the drawing is empty"];
+		return NO;
+	}
+
+	CFStringRef type = (mFormat == kDKBatchRenderJPEG) ? kUTTypeJPEG : ((mFormat == kDKBatchRenderTIFF) ? kUTTypeTIFF : kUTTypePNG);
+	CGImageDestinationRef destRef = CGImageDestinationCreateWithURL((CFURLRef)mOutputURL, type, 1, NULL);
+
+	if (destRef == NULL)
+		return NO;
+
+	DKDrawingRenderer* renderer = [[DKDrawingRenderer alloc] initWithDrawing:drawing];
+	CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+
+	[renderer setDrawsPaper:mDrawsPaper];
+
+	s.renderer = renderer;
+	s.pixels = malloc(s.bytesPerRow * kDKBatchRenderBandHeight);
+	s.band = s.pixels ? CGBitmapContextCreate(s.pixels, s.width, kDKBatchRenderBandHeight, 8, s.bytesPerRow, space, kCGImageAlphaPremultipliedLast) : NULL;
+
+	BOOL result = NO;
+
+	if (s.band) {
+		CGDataProviderSequentialCallbacks callbacks = { 0, bandGetBytes, bandSkipForward, bandRewind, NULL };
+		CGDataProviderRef provider = CGDataProviderCreateSequential(&s, &callbacks);
+		CGImageRef image = CGImageCreate(s.width, s.height, 8, 32, s.bytesPerRow, space, kCGImageAlphaPremultipliedLast, provider, NULL, NO, kCGRenderingIntentDefault);
+		CGFloat dpi = 72.0 * mScale;
+		NSMutableDictionary* props = [NSMutableDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithDouble:dpi], (NSString*)kCGImagePropertyDPIWidth,
+																					   [NSNumber numberWithDouble:dpi], (NSString*)kCGImagePropertyDPIHeight, nil];
+
+		if (mFormat == kDKBatchRenderJPEG)
+			[props setObject:[NSNumber numberWithDouble:kDKBatchRenderJPEGQuality]
+					  forKey:(NSString*)kCGImageDestinationLossyCompressionQuality];
+
+		// the image's data, and so the rendering, is read as the destination encodes it - the time that isn't rendering is writing
+
+		NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+
+		CGImageDestinationAddImage(destRef, image, (CFDictionaryRef)props);
+		result = CGImageDestinationFinalize(destRef);
+
+		mRenderTime = s.renderTime;
+		mWriteTime = MAX(0, [NSDate timeIntervalSinceReferenceDate] - start - s.renderTime);
+
+		CGImageRelease(image);
+		CGDataProviderRelease(provider);
+		CGContextRelease(s.band);
+	}
+
+	free(s.pixels);
+	CGColorSpaceRelease(space);
+	CFRelease(destRef);
+	[renderer release];
+
+	return result;
+}
+
+- (BOOL)writePDFOfDrawing:(DKDrawing*)drawing
+{
+	NSSize size = [drawing drawingSize];
+	CGRect mediaBox = CGRectMake(0, 0, size.width, size.height);
+	CGContextRef pdf = CGPDFContextCreateWithURL((CFURLRef)mOutputURL, &mediaBox, NULL);
+
+	if (pdf == NULL)
+		return NO;
+
+	DKDrawingRenderer* renderer = [[DKDrawingRenderer alloc] initWithDrawing:drawing];
+	NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+
+	[renderer setDrawsPaper:mDrawsPaper];
+
+	CGPDFContextBeginPage(pdf, NULL);
+	[renderer renderRect:NSMakeRect(0, 0, size.width, size.height)
+			 intoContext:pdf
+		 destinationRect:mediaBox];
+	CGPDFContextEndPage(pdf);
+
+	mRenderTime = [NSDate timeIntervalSinceReferenceDate] - start;
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	CGPDFContextClose(pdf);
+	CGContextRelease(pdf);
+
+	mWriteTime = [NSDate timeIntervalSinceReferenceDate] - start;
+	[renderer release];
+
+	return YES;
+}
+
+- (void)setFailureReason:(NSString*)reason
+{
+	[reason retain];
+	[mFailureReason release];
+	mFailureReason = reason;
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKBatchRenderer
+
+- (id)initWithJobs:(NSArray*)jobs
+{
+	self = [super init];
+	if (self) {
+		mJobs = [jobs copy];
+		mMaxConcurrentJobs = MAX(1U, [[NSProcessInfo processInfo] activeProcessorCount]);
+		mDelegateLock = [[NSLock alloc] init];
+	}
+
+	return self;
+}
+
+- (NSArray*)jobs
+{
+	return mJobs;
+}
+
+- (void)setMaximumConcurrentJobs:(NSUInteger)maxJobs
+{
+	mMaxConcurrentJobs = MAX(1U, maxJobs);
+}
+
+- (NSUInteger)maximumConcurrentJobs
+{
+	return mMaxConcurrentJobs;
+}
+
+- (void)setDelegate:(id)aDelegate
+{
+	mDelegate = aDelegate;
+}
+
+- (id)delegate
+{
+	return mDelegate;
+}
+
+- (NSUInteger)run
+{
+	// a job is only started once there's a slot for it, so no more than mMaxConcurrentJobs drawings are ever in memory at once
+
+	dispatch_semaphore_t slots = dispatch_semaphore_create(mMaxConcurrentJobs);
+	dispatch_group_t group = dispatch_group_create();
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	NSEnumerator* iter = [mJobs objectEnumerator];
+	DKBatchRenderJob* job;
+	NSUInteger failed = 0;
+
+	while ((job = [iter nextObject])) {
+		void** context = malloc(3 * sizeof(void*));
+
+		context[0] = self;
+		context[1] = job;
+		context[2] = slots;
+
+		dispatch_semaphore_wait(slots, DISPATCH_TIME_FOREVER);
+		dispatch_group_async_f(group, queue, context, runBatchJob);
+	}
+
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	dispatch_release(group);
+	dispatch_release(slots);
+
+	iter = [mJobs objectEnumerator];
+
+	while ((job = [iter nextObject])) {
+		if (![job succeeded])
+			++failed;
+	}
+
+	return failed;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mJobs release];
+	[mDelegateLock release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKBatchRenderer (Private)
+
+- (void)jobDidFinish:(DKBatchRenderJob*)job
+{
+	if ([mDelegate respondsToSelector:@selector(batchRenderer:didFinishJob:)]) {
+		[mDelegateLock lock];
+		[mDelegate batchRenderer:self
+					didFinishJob:job];
+		[mDelegateLock unlock];
+	}
+}
+
+@end
@@ -5,6 +5,7 @@
  */
 
 #import "DKBezierLayoutManager.h"
+#import "DKGlyphOutlineCache.h"
 
 @implementation DKBezierLayoutManager
 
@@ -58,21 +59,20 @@
 					font = [[[self textStorage] attributesAtIndex:g
 												   effectiveRange:NULL] objectForKey:NSFontAttributeName];
 
-					[temp moveToPoint:ploc];
-					[temp appendBezierPathWithGlyph:[self glyphAtIndex:g]
-											 inFont:font];
-
 					// need to vertically flip and offset each glyph as it is created. The glyph is flipped around its given location to
-					// ensure that any unusual baseline requirements are taken into consideration.
+					// ensure that any unusual baseline requirements are taken into consideration. The outline comes from the shared cache
+					// with its origin at 0,0, so it's placed at its location by the same transform.
 
 					NSAffineTransform* xform = [NSAffineTransform transform];
 					[xform translateXBy:ploc.x
 									yBy:ploc.y];
 					[xform scaleXBy:1.0
 								yBy:-1.0];
-					[xform translateXBy:-ploc.x
-									yBy:-ploc.y];
-					[temp transformUsingAffineTransform:xform];
+
+					[[DKGlyphOutlineCache sharedGlyphOutlineCache] appendOutlineOfGlyph:[self glyphAtIndex:g]
+																				 inFont:font
+																			  transform:xform
+																				 toPath:temp];
 
 					[array addObject:temp];
 				}
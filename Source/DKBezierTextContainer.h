@@ -6,13 +6,19 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class DKScanlineEdgeTable;
+
 /** @brief This class is used by DKTextAdornment to lay out text flowed into an arbitrary shape.
 
  This class is used by DKTextAdornment to lay out text flowed into an arbitrary shape. Given the bezier path representing
  the text container, this caches the text layout rects and uses that info to return rects on demand to the layout manager.
+
+ The path's edges are kept in a DKScanlineEdgeTable, so that each line fragment is found from the edges its line crosses. The table is
+ kept while the path set is the same, so laying out again without changing the shape doesn't build it again.
 */
 @interface DKBezierTextContainer : NSTextContainer {
 	NSBezierPath* mPath;
+	DKScanlineEdgeTable* mEdgeTable;
 }
 
 - (void)setBezierPath:(NSBezierPath*)aPath;
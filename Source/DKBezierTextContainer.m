@@ -6,6 +6,8 @@
 
 #import "DKBezierTextContainer.h"
 #import "NSBezierPath+Text.h"
+#import "NSBezierPath+Editing.h"
+#import "DKScanlineEdgeTable.h"
 
 @implementation DKBezierTextContainer
 
@@ -24,6 +26,17 @@
 	[aPath retain];
 	[mPath release];
 	mPath = aPath;
+
+	// the edges are only found again when the shape has changed
+
+	if (mPath == nil || [mPath isEmpty]) {
+		[mEdgeTable release];
+		mEdgeTable = nil;
+	} else if (mEdgeTable == nil || [mEdgeTable checksum] != [mPath checksum]) {
+		[mEdgeTable release];
+		mEdgeTable = [[DKScanlineEdgeTable alloc] initWithPath:mPath
+													  flatness:kDKScanlineEdgeTableFlatness];
+	}
 }
 
 - (BOOL)isSimpleRegularTextContainer
@@ -41,13 +54,20 @@
 									   sweepDirection:sweepDirection
 									movementDirection:movementDirection
 										remainingRect:remainingRect];
-	else
-		return [mPath lineFragmentRectForProposedRect:proposedRect
-										remainingRect:remainingRect];
+	else if (mEdgeTable == nil) {
+		if (remainingRect)
+			*remainingRect = NSZeroRect;
+
+		return NSZeroRect;
+	} else
+		return [mEdgeTable lineFragmentRectForProposedRect:proposedRect
+											 remainingRect:remainingRect
+											   datumOffset:0];
 }
 
 - (void)dealloc
 {
+	[mEdgeTable release];
 	[mPath release];
 	[super dealloc];
 }
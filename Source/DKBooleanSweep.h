@@ -0,0 +1,138 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+/** @brief The sweep-line engine behind the boolean operations in NSBezierPath+Combinatorial.
+
+ Paths are reduced to straight edges. Curves are first split where they turn back on themselves in x or y, so that each piece is
+ monotonic, and the pieces are then flattened. Every edge remembers which curve it came from and the range of that curve's parameter it
+ covers, so that after the operation runs of untouched edges can be turned back into the original curves.
+
+ The edges are swept left to right in the manner of Bentley and Ottmann. Events are kept in a heap and the edges crossing the sweep line in
+ a sorted array. Each edge is tested only against its neighbours on the sweep line. Where two edges cross they are split, and where they
+ overlap they are merged into one. When an edge joins the sweep line, the winding number of the region below it is taken from its lower
+ neighbour. The winding number above it is that plus the edge's own contribution. Edges are kept when the fill rule gives different results
+ on their two sides.
+
+ Any number of operands can be combined in one sweep. Each operand is first swept on its own, using its own fill rule, which gives
+ non-overlapping contours with the inside on their left. Once that's done, the winding number of a point is simply the number of operands
+ that contain it, so union, intersection, difference and exclusive-or are just rules on that count.
+*/
+
+typedef enum {
+	kDKBooleanFillNonZero = 0, // inside where the winding number is not zero
+	kDKBooleanFillEvenOdd = 1, // inside where the winding number is odd
+	kDKBooleanFillAll = 2, // inside where every operand is (intersection)
+	kDKBooleanFillSubjectOnly = 3 // inside where the first operand is and no other is (difference)
+} DKBooleanFillRule;
+
+// a directed straight edge. <curve> is the index of the curve it was flattened from in a DKBooleanCurveTable, or -1 for a line,
+// and <t0> and <t1> are that curve's parameter values at <p0> and <p1>.
+
+typedef struct {
+	NSPoint p0;
+	NSPoint p1;
+	NSInteger curve;
+	CGFloat t0;
+	CGFloat t1;
+} DKBooleanEdge;
+
+typedef struct {
+	DKBooleanEdge* edges;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKBooleanEdgeList;
+
+typedef struct {
+	NSPoint bez[4];
+} DKBooleanCurve;
+
+typedef struct {
+	DKBooleanCurve* curves;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKBooleanCurveTable;
+
+// a closed loop of edges belonging to one operand. <isolated> is set by DKBooleanMarkIsolatedContours().
+
+typedef struct {
+	DKBooleanEdgeList edges;
+	NSRect bounds;
+	NSInteger operand;
+	BOOL isolated;
+} DKBooleanContour;
+
+typedef struct {
+	DKBooleanContour* contours;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKBooleanContourList;
+
+void DKBooleanEdgeListAppend(DKBooleanEdgeList* list, NSPoint p0, NSPoint p1, NSInteger curve, CGFloat t0, CGFloat t1);
+void DKBooleanEdgeListFree(DKBooleanEdgeList* list);
+
+NSInteger DKBooleanCurveTableAppend(DKBooleanCurveTable* table, const NSPoint bez[4]);
+void DKBooleanCurveTableFree(DKBooleanCurveTable* table);
+
+void DKBooleanContourListFree(DKBooleanContourList* list);
+
+/** @brief Flattens a curve into edges, splitting it first into pieces that are monotonic in x and y
+ @param table the curve table to record the curve in
+ @param bez the curve's four control points
+ @param flatness the most that the edges may deviate from the curve
+ @param edges receives the edges, in the curve's direction
+ */
+void DKBooleanFlattenCurve(DKBooleanCurveTable* table, const NSPoint bez[4], CGFloat flatness, DKBooleanEdgeList* edges);
+
+/** @brief Returns the part of a curve between two parameter values
+ @param bez the curve
+ @param ta the parameter value of the start of the part
+ @param tb the parameter value of the end of the part, which may be less than <ta> to get the part in reverse
+ @param part receives the control points of the part
+ */
+void DKBooleanSubcurve(const NSPoint bez[4], CGFloat ta, CGFloat tb, NSPoint part[4]);
+
+/** @brief Sweeps a single operand's edges, returning the boundary of the area inside it under the fill rule
+ @param edges the edges, which should form closed loops
+ @param rule kDKBooleanFillNonZero or kDKBooleanFillEvenOdd
+ @param result receives the boundary edges, directed so that the inside is on their left
+ */
+void DKBooleanSweepEdges(const DKBooleanEdgeList* edges, DKBooleanFillRule rule, DKBooleanEdgeList* result);
+
+/** @brief Sweeps the contours of many operands together, returning the boundary of the area inside under the fill rule
+
+ The contours must already be simplified, so that each operand's winding number is 0 or 1 everywhere. Contours marked as isolated are left out.
+ Operand 0 is the subject for kDKBooleanFillSubjectOnly.
+ @param contours the operands' contours
+ @param rule the fill rule
+ @param operandCount the number of operands, for kDKBooleanFillAll
+ @param result receives the boundary edges, directed so that the inside is on their left
+ */
+void DKBooleanSweepContours(const DKBooleanContourList* contours, DKBooleanFillRule rule, NSInteger operandCount, DKBooleanEdgeList* result);
+
+/** @brief Joins boundary edges end to end into closed contours
+ @param edges the edges returned by one of the sweep functions
+ @param operand the operand number to give the contours
+ @param contours receives the contours
+ */
+void DKBooleanChainEdges(const DKBooleanEdgeList* edges, NSInteger operand, DKBooleanContourList* contours);
+
+/** @brief Marks the contours whose bounds don't touch those of any other contour
+
+ An isolated contour can't interact with anything else, so it can be kept or dropped as a whole without being swept.
+ @param contours the contours
+ */
+void DKBooleanMarkIsolatedContours(DKBooleanContourList* contours);
+
+/** @brief Whether a point is inside under a fill rule
+ @param rule the fill rule
+ @param winding the number of operands containing the point, or its winding number for a single operand
+ @param subjectWinding the part of <winding> contributed by operand 0
+ @param operandCount the number of operands
+ @return YES if the point is inside
+ */
+BOOL DKBooleanIsInside(DKBooleanFillRule rule, NSInteger winding, NSInteger subjectWinding, NSInteger operandCount);
@@ -0,0 +1,984 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKBooleanSweep.h"
+#import "NSBezierPath+Geometry.h"
+#include <tgmath.h>
+
+#define kDKBooleanEpsilon 1e-6 // points closer than this in x and y are the same point
+#define kDKBooleanParallelEpsilon 1e-10 // sine of the angle below which two edges are treated as parallel
+#define kDKBooleanMaximumFlatteningDepth 12
+
+typedef struct _DKBooleanSegment DKBooleanSegment;
+typedef struct _DKBooleanEvent DKBooleanEvent;
+
+// an edge taking part in the sweep, stored with its left (or lower) end first. <winding> is the change in winding number crossing the
+// segment from below to above - +1 or -1 for a single edge, or the sum for edges that have been merged because they overlap.
+
+struct _DKBooleanSegment {
+	NSPoint start;
+	NSPoint end;
+	NSInteger curve;
+	CGFloat tStart;
+	CGFloat tEnd;
+	NSInteger winding;
+	NSInteger subjectWinding;
+	NSInteger windingBelow;
+	NSInteger subjectBelow;
+	DKBooleanEvent* startEvent;
+	DKBooleanEvent* endEvent;
+	BOOL inStatus;
+};
+
+// an event is where a segment joins or leaves the sweep line. Its points are copied from the segment when queued, so that its
+// position in the heap doesn't change if the segment is later divided - instead the event is marked dead and a new one queued.
+
+struct _DKBooleanEvent {
+	DKBooleanSegment* seg;
+	NSPoint point;
+	NSPoint otherPoint;
+	NSUInteger order;
+	BOOL isStart;
+	BOOL isDead;
+};
+
+typedef struct {
+	DKBooleanEvent** heap;
+	NSUInteger heapCount;
+	NSUInteger heapCapacity;
+	DKBooleanSegment** status; // segments crossing the sweep line, from bottom to top
+	NSUInteger statusCount;
+	NSUInteger statusCapacity;
+	void** allocations;
+	NSUInteger allocationCount;
+	NSUInteger allocationCapacity;
+	NSUInteger nextOrder;
+} DKBooleanSweep;
+
+typedef struct {
+	NSPoint p;
+	NSUInteger index;
+} DKBooleanEdgeStart;
+
+typedef struct {
+	CGFloat minX;
+	NSUInteger index;
+} DKBooleanContourStart;
+
+#pragma mark Geometric predicates
+
+static inline BOOL pointsSame(NSPoint a, NSPoint b)
+{
+	return fabs(a.x - b.x) < kDKBooleanEpsilon && fabs(a.y - b.y) < kDKBooleanEpsilon;
+}
+
+static inline NSInteger pointsCompare(NSPoint a, NSPoint b)
+{
+	// orders points left to right, then bottom to top
+
+	if (fabs(a.x - b.x) < kDKBooleanEpsilon) {
+		if (fabs(a.y - b.y) < kDKBooleanEpsilon)
+			return 0;
+
+		return (a.y < b.y) ? -1 : 1;
+	}
+
+	return (a.x < b.x) ? -1 : 1;
+}
+
+static inline CGFloat crossFromLine(NSPoint p, NSPoint l0, NSPoint l1)
+{
+	return (l1.x - l0.x) * (p.y - l0.y) - (l1.y - l0.y) * (p.x - l0.x);
+}
+
+static inline BOOL pointOnLine(NSPoint p, NSPoint l0, NSPoint l1)
+{
+	// YES if <p> is on the infinite line through <l0> and <l1>
+
+	return fabs(crossFromLine(p, l0, l1)) <= kDKBooleanEpsilon * hypot(l1.x - l0.x, l1.y - l0.y);
+}
+
+static inline BOOL pointAboveOrOnLine(NSPoint p, NSPoint left, NSPoint right)
+{
+	return crossFromLine(p, left, right) >= -kDKBooleanEpsilon * hypot(right.x - left.x, right.y - left.y);
+}
+
+static inline BOOL pointBetween(NSPoint p, NSPoint left, NSPoint right)
+{
+	// YES if <p>, which is assumed to be on the line, lies strictly between its ends
+
+	CGFloat dx = right.x - left.x;
+	CGFloat dy = right.y - left.y;
+	CGFloat len = hypot(dx, dy);
+	CGFloat dot = (p.x - left.x) * dx + (p.y - left.y) * dy;
+
+	return (dot >= kDKBooleanEpsilon * len) && (dot - len * len <= -kDKBooleanEpsilon * len);
+}
+
+static inline NSInteger classifyParameter(CGFloat t, CGFloat eps)
+{
+	// -2 before the start, -1 at the start, 0 between the ends, 1 at the end, 2 beyond the end
+
+	if (t <= -eps)
+		return -2;
+	else if (t < eps)
+		return -1;
+	else if (t - 1.0 <= -eps)
+		return 0;
+	else if (t - 1.0 < eps)
+		return 1;
+	else
+		return 2;
+}
+
+static BOOL linesIntersect(NSPoint a0, NSPoint a1, NSPoint b0, NSPoint b1, NSPoint* pt, NSInteger* alongA, NSInteger* alongB)
+{
+	// finds where the lines through two segments cross, and where that is relative to each segment. Returns NO if they are parallel.
+
+	CGFloat adx = a1.x - a0.x;
+	CGFloat ady = a1.y - a0.y;
+	CGFloat bdx = b1.x - b0.x;
+	CGFloat bdy = b1.y - b0.y;
+	CGFloat lenA = hypot(adx, ady);
+	CGFloat lenB = hypot(bdx, bdy);
+	CGFloat axb = adx * bdy - ady * bdx;
+
+	if (fabs(axb) <= kDKBooleanParallelEpsilon * lenA * lenB)
+		return NO;
+
+	CGFloat dx = a0.x - b0.x;
+	CGFloat dy = a0.y - b0.y;
+	CGFloat A = (bdx * dy - bdy * dx) / axb;
+	CGFloat B = (adx * dy - ady * dx) / axb;
+
+	pt->x = a0.x + A * adx;
+	pt->y = a0.y + A * ady;
+
+	*alongA = classifyParameter(A, kDKBooleanEpsilon / lenA);
+	*alongB = classifyParameter(B, kDKBooleanEpsilon / lenB);
+
+	return YES;
+}
+
+#pragma mark -
+#pragma mark Curves
+
+static inline NSPoint bezierPoint(const NSPoint b[4], CGFloat t)
+{
+	CGFloat mt = 1.0 - t;
+	NSPoint p;
+
+	p.x = (mt * mt * mt * b[0].x) + (3.0 * mt * mt * t * b[1].x) + (3.0 * mt * t * t * b[2].x) + (t * t * t * b[3].x);
+	p.y = (mt * mt * mt * b[0].y) + (3.0 * mt * mt * t * b[1].y) + (3.0 * mt * t * t * b[2].y) + (t * t * t * b[3].y);
+
+	return p;
+}
+
+static inline CGFloat distanceFromChord(NSPoint p, NSPoint c0, NSPoint c1)
+{
+	CGFloat len = hypot(c1.x - c0.x, c1.y - c0.y);
+
+	if (len < kDKBooleanEpsilon)
+		return hypot(p.x - c0.x, p.y - c0.y);
+
+	return fabs(crossFromLine(p, c0, c1)) / len;
+}
+
+static NSUInteger addExtremaForAxis(CGFloat p0, CGFloat p1, CGFloat p2, CGFloat p3, CGFloat* roots, NSUInteger count)
+{
+	// the derivative of the curve along one axis is a quadratic. Its roots within (0, 1) are where the curve turns back on that axis.
+
+	CGFloat d0 = p1 - p0;
+	CGFloat d1 = p2 - p1;
+	CGFloat d2 = p3 - p2;
+	CGFloat a = d0 - 2.0 * d1 + d2;
+	CGFloat b = 2.0 * (d1 - d0);
+	CGFloat c = d0;
+	CGFloat t[2];
+	NSUInteger i, n = 0;
+
+	if (fabs(a) < 1e-12) {
+		if (fabs(b) > 1e-12)
+			t[n++] = -c / b;
+	} else {
+		CGFloat disc = b * b - 4.0 * a * c;
+
+		if (disc >= 0.0) {
+			CGFloat sq = sqrt(disc);
+
+			t[n++] = (-b + sq) / (2.0 * a);
+			t[n++] = (-b - sq) / (2.0 * a);
+		}
+	}
+
+	for (i = 0; i < n; ++i) {
+		if (t[i] > 1e-6 && t[i] < 1.0 - 1e-6)
+			roots[count++] = t[i];
+	}
+
+	return count;
+}
+
+static void flattenCurveRange(DKBooleanEdgeList* edges, NSInteger curve, const NSPoint bez[4], CGFloat u0, CGFloat u1, NSPoint p0, NSPoint p1, CGFloat flatness, NSUInteger depth)
+{
+	NSPoint part[4];
+
+	DKBooleanSubcurve(bez, u0, u1, part);
+
+	if (depth < kDKBooleanMaximumFlatteningDepth && (distanceFromChord(part[1], p0, p1) > flatness || distanceFromChord(part[2], p0, p1) > flatness)) {
+		CGFloat um = 0.5 * (u0 + u1);
+		NSPoint pm = bezierPoint(bez, um);
+
+		flattenCurveRange(edges, curve, bez, u0, um, p0, pm, flatness, depth + 1);
+		flattenCurveRange(edges, curve, bez, um, u1, pm, p1, flatness, depth + 1);
+	} else
+		DKBooleanEdgeListAppend(edges, p0, p1, curve, u0, u1);
+}
+
+void DKBooleanFlattenCurve(DKBooleanCurveTable* table, const NSPoint bez[4], CGFloat flatness, DKBooleanEdgeList* edges)
+{
+	NSInteger curve = DKBooleanCurveTableAppend(table, bez);
+	CGFloat splits[6];
+	NSUInteger i, j, n = 0;
+
+	// split the curve into pieces that are monotonic in both x and y. Each piece then lies within the box of its end points, and two
+	// pieces can't cross each other more than once for every time their flattened edges do.
+
+	splits[n++] = 0.0;
+	n = addExtremaForAxis(bez[0].x, bez[1].x, bez[2].x, bez[3].x, splits, n);
+	n = addExtremaForAxis(bez[0].y, bez[1].y, bez[2].y, bez[3].y, splits, n);
+	splits[n++] = 1.0;
+
+	for (i = 1; i < n; ++i) {
+		for (j = i; j > 0 && splits[j] < splits[j - 1]; --j) {
+			CGFloat temp = splits[j];
+			splits[j] = splits[j - 1];
+			splits[j - 1] = temp;
+		}
+	}
+
+	NSPoint p0 = bez[0];
+
+	for (i = 1; i < n; ++i) {
+		if (splits[i] - splits[i - 1] < 1e-6)
+			continue;
+
+		NSPoint p1 = (i == n - 1) ? bez[3] : bezierPoint(bez, splits[i]);
+
+		flattenCurveRange(edges, curve, bez, splits[i - 1], splits[i], p0, p1, flatness, 0);
+		p0 = p1;
+	}
+}
+
+void DKBooleanSubcurve(const NSPoint bez[4], CGFloat ta, CGFloat tb, NSPoint part[4])
+{
+	NSPoint work[4], left[4], right[4];
+	BOOL reversed = (ta > tb);
+	NSUInteger i;
+
+	if (reversed) {
+		CGFloat temp = ta;
+		ta = tb;
+		tb = temp;
+	}
+
+	memcpy(work, bez, sizeof(work));
+
+	if (ta > 0.0) {
+		subdivideBezierAtT(work, left, right, ta);
+		memcpy(work, right, sizeof(work));
+	}
+
+	if (tb < 1.0 && ta < 1.0) {
+		subdivideBezierAtT(work, left, right, (tb - ta) / (1.0 - ta));
+		memcpy(work, left, sizeof(work));
+	}
+
+	for (i = 0; i < 4; ++i)
+		part[i] = reversed ? work[3 - i] : work[i];
+}
+
+#pragma mark -
+#pragma mark Lists
+
+void DKBooleanEdgeListAppend(DKBooleanEdgeList* list, NSPoint p0, NSPoint p1, NSInteger curve, CGFloat t0, CGFloat t1)
+{
+	if (list->count >= list->capacity) {
+		list->capacity = MAX(list->capacity * 2, 64U);
+		list->edges = realloc(list->edges, list->capacity * sizeof(DKBooleanEdge));
+	}
+
+	DKBooleanEdge* edge = &list->edges[list->count++];
+
+	edge->p0 = p0;
+	edge->p1 = p1;
+	edge->curve = curve;
+	edge->t0 = t0;
+	edge->t1 = t1;
+}
+
+void DKBooleanEdgeListFree(DKBooleanEdgeList* list)
+{
+	free(list->edges);
+	list->edges = NULL;
+	list->count = list->capacity = 0;
+}
+
+NSInteger DKBooleanCurveTableAppend(DKBooleanCurveTable* table, const NSPoint bez[4])
+{
+	if (table->count >= table->capacity) {
+		table->capacity = MAX(table->capacity * 2, 16U);
+		table->curves = realloc(table->curves, table->capacity * sizeof(DKBooleanCurve));
+	}
+
+	memcpy(table->curves[table->count].bez, bez, sizeof(NSPoint) * 4);
+
+	return table->count++;
+}
+
+void DKBooleanCurveTableFree(DKBooleanCurveTable* table)
+{
+	free(table->curves);
+	table->curves = NULL;
+	table->count = table->capacity = 0;
+}
+
+static void contourListAppend(DKBooleanContourList* list, const DKBooleanContour* contour)
+{
+	if (list->count >= list->capacity) {
+		list->capacity = MAX(list->capacity * 2, 16U);
+		list->contours = realloc(list->contours, list->capacity * sizeof(DKBooleanContour));
+	}
+
+	list->contours[list->count++] = *contour;
+}
+
+void DKBooleanContourListFree(DKBooleanContourList* list)
+{
+	NSUInteger i;
+
+	for (i = 0; i < list->count; ++i)
+		DKBooleanEdgeListFree(&list->contours[i].edges);
+
+	free(list->contours);
+	list->contours = NULL;
+	list->count = list->capacity = 0;
+}
+
+#pragma mark -
+#pragma mark The sweep
+
+static void* sweepAllocate(DKBooleanSweep* sw, size_t size)
+{
+	void* p = calloc(1, size);
+
+	if (sw->allocationCount >= sw->allocationCapacity) {
+		sw->allocationCapacity = MAX(sw->allocationCapacity * 2, 256U);
+		sw->allocations = realloc(sw->allocations, sw->allocationCapacity * sizeof(void*));
+	}
+
+	sw->allocations[sw->allocationCount++] = p;
+	return p;
+}
+
+static void sweepFree(DKBooleanSweep* sw)
+{
+	NSUInteger i;
+
+	for (i = 0; i < sw->allocationCount; ++i)
+		free(sw->allocations[i]);
+
+	free(sw->allocations);
+	free(sw->heap);
+	free(sw->status);
+}
+
+static NSInteger eventCompare(const DKBooleanEvent* a, const DKBooleanEvent* b)
+{
+	NSInteger comp = pointsCompare(a->point, b->point);
+
+	if (comp != 0)
+		return comp;
+
+	if (!pointsSame(a->otherPoint, b->otherPoint)) {
+		// at the same point, segments leave the sweep line before new ones join it
+
+		if (a->isStart != b->isStart)
+			return a->isStart ? 1 : -1;
+
+		// otherwise the one whose other end is lower goes first
+
+		if (b->isStart)
+			return pointAboveOrOnLine(a->otherPoint, b->point, b->otherPoint) ? 1 : -1;
+		else
+			return pointAboveOrOnLine(a->otherPoint, b->otherPoint, b->point) ? 1 : -1;
+	}
+
+	if (a->order == b->order)
+		return 0;
+
+	return (a->order < b->order) ? -1 : 1;
+}
+
+static void heapPush(DKBooleanSweep* sw, DKBooleanEvent* ev)
+{
+	if (sw->heapCount >= sw->heapCapacity) {
+		sw->heapCapacity = MAX(sw->heapCapacity * 2, 256U);
+		sw->heap = realloc(sw->heap, sw->heapCapacity * sizeof(DKBooleanEvent*));
+	}
+
+	NSUInteger i = sw->heapCount++;
+
+	while (i > 0) {
+		NSUInteger parent = (i - 1) / 2;
+
+		if (eventCompare(sw->heap[parent], ev) <= 0)
+			break;
+
+		sw->heap[i] = sw->heap[parent];
+		i = parent;
+	}
+
+	sw->heap[i] = ev;
+}
+
+static DKBooleanEvent* heapPop(DKBooleanSweep* sw)
+{
+	if (sw->heapCount == 0)
+		return NULL;
+
+	DKBooleanEvent* top = sw->heap[0];
+	DKBooleanEvent* last = sw->heap[--sw->heapCount];
+	NSUInteger i = 0, n = sw->heapCount;
+
+	if (n > 0) {
+		while (YES) {
+			NSUInteger child = 2 * i + 1;
+
+			if (child >= n)
+				break;
+
+			if (child + 1 < n && eventCompare(sw->heap[child + 1], sw->heap[child]) < 0)
+				++child;
+
+			if (eventCompare(last, sw->heap[child]) <= 0)
+				break;
+
+			sw->heap[i] = sw->heap[child];
+			i = child;
+		}
+
+		sw->heap[i] = last;
+	}
+
+	return top;
+}
+
+static DKBooleanEvent* heapPeek(DKBooleanSweep* sw)
+{
+	while (sw->heapCount > 0 && sw->heap[0]->isDead)
+		heapPop(sw);
+
+	return (sw->heapCount > 0) ? sw->heap[0] : NULL;
+}
+
+static void queueEvent(DKBooleanSweep* sw, DKBooleanSegment* seg, BOOL isStart)
+{
+	DKBooleanEvent* ev = sweepAllocate(sw, sizeof(DKBooleanEvent));
+
+	ev->seg = seg;
+	ev->isStart = isStart;
+	ev->order = sw->nextOrder++;
+	ev->point = isStart ? seg->start : seg->end;
+	ev->otherPoint = isStart ? seg->end : seg->start;
+
+	if (isStart)
+		seg->startEvent = ev;
+	else
+		seg->endEvent = ev;
+
+	heapPush(sw, ev);
+}
+
+static void addSegment(DKBooleanSweep* sw, const DKBooleanEdge* edge, NSInteger winding, NSInteger subjectWinding)
+{
+	NSInteger comp = pointsCompare(edge->p0, edge->p1);
+
+	if (comp == 0)
+		return;
+
+	DKBooleanSegment* seg = sweepAllocate(sw, sizeof(DKBooleanSegment));
+
+	seg->curve = edge->curve;
+
+	if (comp < 0) {
+		seg->start = edge->p0;
+		seg->end = edge->p1;
+		seg->tStart = edge->t0;
+		seg->tEnd = edge->t1;
+		seg->winding = winding;
+		seg->subjectWinding = subjectWinding;
+	} else {
+		seg->start = edge->p1;
+		seg->end = edge->p0;
+		seg->tStart = edge->t1;
+		seg->tEnd = edge->t0;
+		seg->winding = -winding;
+		seg->subjectWinding = -subjectWinding;
+	}
+
+	queueEvent(sw, seg, YES);
+	queueEvent(sw, seg, NO);
+}
+
+static void divideSegment(DKBooleanSweep* sw, DKBooleanSegment* seg, NSPoint pt)
+{
+	// splits <seg> at <pt>, so that it ends there and a new segment carries on to its old end
+
+	if (pointsCompare(seg->start, pt) >= 0 || pointsCompare(pt, seg->end) >= 0)
+		return;
+
+	CGFloat dx = seg->end.x - seg->start.x;
+	CGFloat dy = seg->end.y - seg->start.y;
+	CGFloat frac = ((pt.x - seg->start.x) * dx + (pt.y - seg->start.y) * dy) / (dx * dx + dy * dy);
+	CGFloat t = seg->tStart + (seg->tEnd - seg->tStart) * frac;
+
+	DKBooleanSegment* ns = sweepAllocate(sw, sizeof(DKBooleanSegment));
+
+	ns->start = pt;
+	ns->end = seg->end;
+	ns->curve = seg->curve;
+	ns->tStart = t;
+	ns->tEnd = seg->tEnd;
+	ns->winding = seg->winding;
+	ns->subjectWinding = seg->subjectWinding;
+
+	seg->end = pt;
+	seg->tEnd = t;
+
+	seg->endEvent->isDead = YES;
+	queueEvent(sw, seg, NO);
+
+	if (!seg->inStatus) {
+		seg->startEvent->isDead = YES;
+		queueEvent(sw, seg, YES);
+	}
+
+	queueEvent(sw, ns, YES);
+	queueEvent(sw, ns, NO);
+}
+
+static DKBooleanSegment* checkIntersection(DKBooleanSweep* sw, DKBooleanSegment* a, DKBooleanSegment* b)
+{
+	// divides <a> and <b> where they cross or overlap. If once divided <a> is the same as <b>, returns <b> so that the caller can
+	// merge them. <b> is on the sweep line and <a> either is too or is about to join it.
+
+	NSPoint a1 = a->start, a2 = a->end, b1 = b->start, b2 = b->end;
+	NSPoint pt;
+	NSInteger alongA, alongB;
+
+	if (!linesIntersect(a1, a2, b1, b2, &pt, &alongA, &alongB)) {
+		// parallel - nothing to do unless they're on the same line and overlap
+
+		if (!pointOnLine(a1, b1, b2))
+			return NULL;
+
+		if (pointsSame(a1, b2) || pointsSame(a2, b1))
+			return NULL;
+
+		BOOL a1SameB1 = pointsSame(a1, b1);
+		BOOL a2SameB2 = pointsSame(a2, b2);
+
+		if (a1SameB1 && a2SameB2)
+			return b;
+
+		BOOL a1Between = !a1SameB1 && pointBetween(a1, b1, b2);
+		BOOL a2Between = !a2SameB2 && pointBetween(a2, b1, b2);
+
+		if (a1SameB1) {
+			if (a2Between)
+				divideSegment(sw, b, a2);
+			else
+				divideSegment(sw, a, b2);
+
+			return b;
+		} else if (a1Between) {
+			if (!a2SameB2) {
+				if (a2Between)
+					divideSegment(sw, b, a2);
+				else
+					divideSegment(sw, a, b2);
+			}
+
+			divideSegment(sw, b, a1);
+		}
+	} else {
+		if (alongA == 0) {
+			if (alongB == -1)
+				divideSegment(sw, a, b1);
+			else if (alongB == 0)
+				divideSegment(sw, a, pt);
+			else if (alongB == 1)
+				divideSegment(sw, a, b2);
+		}
+
+		if (alongB == 0) {
+			if (alongA == -1)
+				divideSegment(sw, b, a1);
+			else if (alongA == 0)
+				divideSegment(sw, b, pt);
+			else if (alongA == 1)
+				divideSegment(sw, b, a2);
+		}
+	}
+
+	return NULL;
+}
+
+static BOOL segmentIsAbove(const DKBooleanSegment* a, const DKBooleanSegment* b)
+{
+	if (pointOnLine(a->start, b->start, b->end)) {
+		if (pointOnLine(a->end, b->start, b->end))
+			return YES;
+
+		return pointAboveOrOnLine(a->end, b->start, b->end);
+	}
+
+	return pointAboveOrOnLine(a->start, b->start, b->end);
+}
+
+static NSUInteger statusInsertionIndex(const DKBooleanSweep* sw, const DKBooleanSegment* seg)
+{
+	NSUInteger lo = 0, hi = sw->statusCount;
+
+	while (lo < hi) {
+		NSUInteger mid = (lo + hi) / 2;
+
+		if (segmentIsAbove(seg, sw->status[mid]))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static void statusInsert(DKBooleanSweep* sw, NSUInteger indx, DKBooleanSegment* seg)
+{
+	if (sw->statusCount >= sw->statusCapacity) {
+		sw->statusCapacity = MAX(sw->statusCapacity * 2, 64U);
+		sw->status = realloc(sw->status, sw->statusCapacity * sizeof(DKBooleanSegment*));
+	}
+
+	memmove(&sw->status[indx + 1], &sw->status[indx], (sw->statusCount - indx) * sizeof(DKBooleanSegment*));
+	sw->status[indx] = seg;
+	sw->statusCount++;
+	seg->inStatus = YES;
+}
+
+static void statusRemoveAtIndex(DKBooleanSweep* sw, NSUInteger indx)
+{
+	sw->status[indx]->inStatus = NO;
+	sw->statusCount--;
+	memmove(&sw->status[indx], &sw->status[indx + 1], (sw->statusCount - indx) * sizeof(DKBooleanSegment*));
+}
+
+static BOOL statusFind(const DKBooleanSweep* sw, const DKBooleanSegment* seg, NSUInteger* indx)
+{
+	NSUInteger i;
+
+	for (i = 0; i < sw->statusCount; ++i) {
+		if (sw->status[i] == seg) {
+			*indx = i;
+			return YES;
+		}
+	}
+
+	return NO;
+}
+
+static void sweepRun(DKBooleanSweep* sw, DKBooleanFillRule rule, NSInteger operandCount, DKBooleanEdgeList* result)
+{
+	DKBooleanEvent* ev;
+
+	while ((ev = heapPop(sw))) {
+		if (ev->isDead)
+			continue;
+
+		DKBooleanSegment* seg = ev->seg;
+
+		if (ev->isStart) {
+			NSUInteger indx = statusInsertionIndex(sw, seg);
+			DKBooleanSegment* below = (indx > 0) ? sw->status[indx - 1] : NULL;
+			DKBooleanSegment* above = (indx < sw->statusCount) ? sw->status[indx] : NULL;
+			DKBooleanSegment* same = NULL;
+
+			if (above)
+				same = checkIntersection(sw, seg, above);
+
+			if (same == NULL && below)
+				same = checkIntersection(sw, seg, below);
+
+			if (same) {
+				// the segment coincides with one already on the sweep line, so it's merged into it
+
+				same->winding += seg->winding;
+				same->subjectWinding += seg->subjectWinding;
+				seg->startEvent->isDead = YES;
+				seg->endEvent->isDead = YES;
+				continue;
+			}
+
+			// if the segment was divided, a new start event has replaced this one. If dividing its neighbours queued events that
+			// come before this one, they must be handled first.
+
+			if (ev->isDead)
+				continue;
+
+			DKBooleanEvent* next = heapPeek(sw);
+
+			if (next && eventCompare(next, ev) < 0) {
+				heapPush(sw, ev);
+				continue;
+			}
+
+			seg->windingBelow = below ? below->windingBelow + below->winding : 0;
+			seg->subjectBelow = below ? below->subjectBelow + below->subjectWinding : 0;
+
+			statusInsert(sw, indx, seg);
+		} else {
+			NSUInteger indx;
+
+			if (!statusFind(sw, seg, &indx))
+				continue;
+
+			// the segments either side of this one become neighbours
+
+			if (indx > 0 && indx + 1 < sw->statusCount)
+				checkIntersection(sw, sw->status[indx + 1], sw->status[indx - 1]);
+
+			statusRemoveAtIndex(sw, indx);
+
+			// the segment is finished with, so keep it if it's on the boundary of the result, directed so that the inside is on its left
+
+			BOOL insideAbove = DKBooleanIsInside(rule, seg->windingBelow + seg->winding, seg->subjectBelow + seg->subjectWinding, operandCount);
+			BOOL insideBelow = DKBooleanIsInside(rule, seg->windingBelow, seg->subjectBelow, operandCount);
+
+			if (insideAbove && !insideBelow)
+				DKBooleanEdgeListAppend(result, seg->start, seg->end, seg->curve, seg->tStart, seg->tEnd);
+			else if (insideBelow && !insideAbove)
+				DKBooleanEdgeListAppend(result, seg->end, seg->start, seg->curve, seg->tEnd, seg->tStart);
+		}
+	}
+}
+
+BOOL DKBooleanIsInside(DKBooleanFillRule rule, NSInteger winding, NSInteger subjectWinding, NSInteger operandCount)
+{
+	switch (rule) {
+	default:
+	case kDKBooleanFillNonZero:
+		return winding != 0;
+
+	case kDKBooleanFillEvenOdd:
+		return (winding & 1) != 0;
+
+	case kDKBooleanFillAll:
+		return winding >= operandCount;
+
+	case kDKBooleanFillSubjectOnly:
+		return subjectWinding > 0 && winding == subjectWinding;
+	}
+}
+
+void DKBooleanSweepEdges(const DKBooleanEdgeList* edges, DKBooleanFillRule rule, DKBooleanEdgeList* result)
+{
+	DKBooleanSweep sw;
+	NSUInteger i;
+
+	memset(&sw, 0, sizeof(sw));
+
+	for (i = 0; i < edges->count; ++i)
+		addSegment(&sw, &edges->edges[i], 1, 1);
+
+	sweepRun(&sw, rule, 1, result);
+	sweepFree(&sw);
+}
+
+void DKBooleanSweepContours(const DKBooleanContourList* contours, DKBooleanFillRule rule, NSInteger operandCount, DKBooleanEdgeList* result)
+{
+	DKBooleanSweep sw;
+	NSUInteger i, j;
+
+	memset(&sw, 0, sizeof(sw));
+
+	for (i = 0; i < contours->count; ++i) {
+		const DKBooleanContour* contour = &contours->contours[i];
+
+		if (contour->isolated)
+			continue;
+
+		for (j = 0; j < contour->edges.count; ++j)
+			addSegment(&sw, &contour->edges.edges[j], 1, (contour->operand == 0) ? 1 : 0);
+	}
+
+	sweepRun(&sw, rule, operandCount, result);
+	sweepFree(&sw);
+}
+
+#pragma mark -
+#pragma mark Building contours
+
+static int compareEdgeStarts(const void* a, const void* b)
+{
+	NSPoint pa = ((const DKBooleanEdgeStart*)a)->p;
+	NSPoint pb = ((const DKBooleanEdgeStart*)b)->p;
+
+	if (pa.x != pb.x)
+		return (pa.x < pb.x) ? -1 : 1;
+
+	if (pa.y != pb.y)
+		return (pa.y < pb.y) ? -1 : 1;
+
+	return 0;
+}
+
+static NSInteger unusedEdgeStartingAt(const DKBooleanEdgeStart* starts, NSUInteger count, const BOOL* used, NSPoint p)
+{
+	// the starts are sorted by x, so find the first within tolerance of <p> and look at those from there that are close enough
+
+	NSUInteger lo = 0, hi = count;
+
+	while (lo < hi) {
+		NSUInteger mid = (lo + hi) / 2;
+
+		if (starts[mid].p.x < p.x - kDKBooleanEpsilon)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	for (; lo < count && starts[lo].p.x <= p.x + kDKBooleanEpsilon; ++lo) {
+		if (!used[starts[lo].index] && pointsSame(starts[lo].p, p))
+			return starts[lo].index;
+	}
+
+	return -1;
+}
+
+void DKBooleanChainEdges(const DKBooleanEdgeList* edges, NSInteger operand, DKBooleanContourList* contours)
+{
+	NSUInteger i, j, n = edges->count;
+
+	if (n == 0)
+		return;
+
+	DKBooleanEdgeStart* starts = malloc(n * sizeof(DKBooleanEdgeStart));
+	BOOL* used = calloc(n, sizeof(BOOL));
+
+	for (i = 0; i < n; ++i) {
+		starts[i].p = edges->edges[i].p0;
+		starts[i].index = i;
+	}
+
+	qsort(starts, n, sizeof(DKBooleanEdgeStart), compareEdgeStarts);
+
+	// the boundary edges have the inside on their left, so following each edge with one that starts where it ends goes around a contour
+
+	for (i = 0; i < n; ++i) {
+		if (used[i])
+			continue;
+
+		DKBooleanContour contour;
+		NSInteger e = i;
+		NSPoint first = edges->edges[i].p0;
+		BOOL hasCurve = NO;
+
+		memset(&contour, 0, sizeof(contour));
+		contour.operand = operand;
+
+		while (e >= 0) {
+			const DKBooleanEdge* edge = &edges->edges[e];
+
+			used[e] = YES;
+			DKBooleanEdgeListAppend(&contour.edges, edge->p0, edge->p1, edge->curve, edge->t0, edge->t1);
+			hasCurve |= (edge->curve >= 0);
+
+			if (pointsSame(edge->p1, first))
+				break;
+
+			e = unusedEdgeStartingAt(starts, n, used, edge->p1);
+		}
+
+		// a contour needs at least three edges to enclose anything, or two if one of them stands for a curve
+
+		if (contour.edges.count >= 3 || (contour.edges.count == 2 && hasCurve)) {
+			NSPoint minp = first, maxp = first;
+
+			for (j = 0; j < contour.edges.count; ++j) {
+				NSPoint p = contour.edges.edges[j].p1;
+
+				minp.x = MIN(minp.x, p.x);
+				minp.y = MIN(minp.y, p.y);
+				maxp.x = MAX(maxp.x, p.x);
+				maxp.y = MAX(maxp.y, p.y);
+			}
+
+			contour.bounds = NSMakeRect(minp.x, minp.y, maxp.x - minp.x, maxp.y - minp.y);
+			contourListAppend(contours, &contour);
+		} else
+			DKBooleanEdgeListFree(&contour.edges);
+	}
+
+	free(starts);
+	free(used);
+}
+
+static int compareContourStarts(const void* a, const void* b)
+{
+	CGFloat xa = ((const DKBooleanContourStart*)a)->minX;
+	CGFloat xb = ((const DKBooleanContourStart*)b)->minX;
+
+	if (xa == xb)
+		return 0;
+
+	return (xa < xb) ? -1 : 1;
+}
+
+void DKBooleanMarkIsolatedContours(DKBooleanContourList* contours)
+{
+	NSUInteger i, j, n = contours->count;
+
+	if (n == 0)
+		return;
+
+	DKBooleanContourStart* order = malloc(n * sizeof(DKBooleanContourStart));
+
+	for (i = 0; i < n; ++i) {
+		contours->contours[i].isolated = YES;
+		order[i].minX = NSMinX(contours->contours[i].bounds);
+		order[i].index = i;
+	}
+
+	qsort(order, n, sizeof(DKBooleanContourStart), compareContourStarts);
+
+	// sort and sweep - once a contour starts to the right of this one's bounds, so do all the rest
+
+	for (i = 0; i < n; ++i) {
+		DKBooleanContour* ci = &contours->contours[order[i].index];
+
+		for (j = i + 1; j < n; ++j) {
+			DKBooleanContour* cj = &contours->contours[order[j].index];
+
+			if (NSMinX(cj->bounds) > NSMaxX(ci->bounds) + kDKBooleanEpsilon)
+				break;
+
+			if (NSMinY(cj->bounds) <= NSMaxY(ci->bounds) + kDKBooleanEpsilon && NSMinY(ci->bounds) <= NSMaxY(cj->bounds) + kDKBooleanEpsilon)
+				ci->isolated = cj->isolated = NO;
+		}
+	}
+
+	free(order);
+}
@@ -11,6 +11,9 @@
  This class implements a special rendergroup that captures the output of its contained renderers in an image, then
  allows that image to be manipulated or processed (e.g. by core image) before rendering it back to the drawing. This
  allows us to leverage all sorts of imaging code to extend the range of available styles and effects.
+
+ The filtered image is kept in the object's rendering cache, at the device resolution rounded up to a power of two, so it is only
+ made again when the object, the filter settings or the scale change.
 */
 @interface DKCIFilterRastGroup : DKRastGroup <NSCoding, NSCopying> {
 	NSString* m_filter;
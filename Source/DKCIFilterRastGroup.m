@@ -10,8 +10,132 @@
 #import "NSDictionary+DeepCopy.h"
 #import "DKDrawableObject.h"
 #import "NSBezierPath+Geometry.h"
+#import "NSBezierPath+Editing.h"
 #import <QuartzCore/QuartzCore.h>
 
+#define kDKCIFilterMaximumImageSize 4096 // filtered images are never made with more pixels than this along either side
+
+static CIContext* sSharedCIContext = nil;
+
+@interface DKCIFilterRastGroup (Private)
+
+/** @brief The Core Image context used to filter every group's output
+
+ The context renders on the GPU where there is one, otherwise in software. It is made once and reused, since making a Core Image
+ context is much more expensive than drawing with one.
+ @return the context
+ */
++ (CIContext*)sharedCIContext;
+
+/** @brief A checksum of everything that determines the filtered image of an object
+ */
+- (NSUInteger)outputChecksumForObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale;
+- (CGImageRef)cachedOutputForObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale;
+- (void)setCachedOutput:(CGImageRef)image forObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale;
+
+/** @brief Renders the contained renderers into a bitmap and runs the filter over it
+
+ The filter is applied in the drawing's coordinates, so its arguments mean the same at any scale, and its output is rendered at
+ <scale> pixels per point.
+ @return the filtered image, which the caller must release, or NULL
+ */
+- (CGImageRef)newFilteredImageOfObject:(DKDrawableObject*)object path:(NSBezierPath*)path inRect:(NSRect)imgRect scale:(CGFloat)scale padding:(CGFloat)padding;
+
+@end
+
+#pragma mark -
+
+@implementation DKCIFilterRastGroup
+#pragma mark As a DKCIFilterRastGroup
+
++ (DKCIFilterRastGroup*)effectGroupWithFilter:(NSString*)filter
+{
+	DKCIFilterRastGroup* fg = [[DKCIFilterRastGroup alloc] init];
+
+	[fg setFilter:filter];
+
+	return [fg autorelease];
+}
+
+#pragma mark -
+- (void)setFilter:(NSString*)filter
+{
+	LogEvent_(kStateEvent, @"setting fx filter: %@", filter);
+
+	if (filter != [self filter]) {
+		[filter retain];
+		[m_filter release];
+		m_filter = filter;
+
+		[self invalidateCache];
+	}
+}
+
+- (NSString*)filter
+{
+	return m_filter;
+}
+
+#pragma mark -
+- (void)setArguments:(NSDictionary*)dict
+{
+	[dict retain];
+	[m_arguments release];
+	m_arguments = dict;
+}
+
+- (NSDictionary*)arguments
+{
+	return m_arguments;
+}
+
+#pragma mark -
+- (void)invalidateCache
+{
+	[m_cache release];
+	m_cache = nil;
+}
+
+#pragma mark -
++ (CIContext*)sharedCIContext
+{
+	// a CIContext can be used from any thread, but it must only be made once
+
+	@synchronized([DKCIFilterRastGroup class])
+	{
+		if (sSharedCIContext == nil) {
+			// Core Image renders on the GPU unless asked to use software, so the bitmap context is only where it would draw, which it
+			// never does here since images are made with -createCGImage:fromRect:
+
+			CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+			CGContextRef bm = CGBitmapContextCreate(NULL, 1, 1, 8, 0, space, kCGImageAlphaPremultipliedLast);
+
+			sSharedCIContext = [[CIContext contextWithCGContext:bm
+														options:nil] retain];
+			CGContextRelease(bm);
+			CGColorSpaceRelease(space);
+		}
+	}
+
+	return sSharedCIContext;
+}
+
+- (NSUInteger)outputChecksumForObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale;
+- (CGImageRef)cachedOutputForObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale;
+- (void)setCachedOutput:(CGImageRef)image forObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale;
+
+/** @brief Renders the contained renderers into a bitmap and runs the filter over it
+
+ The filter is applied in the drawing's coordinates, so its arguments mean the same at any scale, and its output is rendered at
+ <scale> pixels per point.
+ @return the filtered image, which the caller must release, or NULL
+ */
+- (CGImageRef)newFilteredImageOfObject:(DKDrawableObject*)object path:(NSBezierPath*)path inRect:(NSRect)imgRect scale:(CGFloat)scale padding:(CGFloat)padding;
+
+@end
+
+#pragma mark -
+
 @implementation DKCIFilterRastGroup
 #pragma mark As a DKCIFilterRastGroup
 
@@ -63,6 +187,185 @@
 	m_cache = nil;
 }
 
+#pragma mark -
++ (CIContext*)sharedCIContext
+{
+	if (sSharedCIContext == nil) {
+		CGLPixelFormatAttribute attributes[] = { kCGLPFAAccelerated, kCGLPFANoRecovery, kCGLPFAAllowOfflineRenderers, (CGLPixelFormatAttribute)0 };
+		CGLPixelFormatObj pixelFormat = NULL;
+		CGLContextObj cglContext = NULL;
+		GLint count = 0;
+
+		if (CGLChoosePixelFormat(attributes, &pixelFormat, &count) == kCGLNoError && pixelFormat != NULL) {
+			if (CGLCreateContext(pixelFormat, NULL, &cglContext) == kCGLNoError) {
+				CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+
+				sSharedCIContext = [[CIContext contextWithCGLContext:cglContext
+														 pixelFormat:pixelFormat
+														  colorSpace:space
+															 options:nil] retain];
+				CGColorSpaceRelease(space);
+				CGLReleaseContext(cglContext);
+			}
+
+			CGLReleasePixelFormat(pixelFormat);
+		}
+
+		if (sSharedCIContext == nil) {
+			LogEvent_(kInfoEvent, @"no accelerated renderer for Core Image filters, using software");
+
+			CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+			CGContextRef bm = CGBitmapContextCreate(NULL, 1, 1, 8, 0, space, kCGImageAlphaPremultipliedLast);
+
+			sSharedCIContext = [[CIContext contextWithCGContext:bm
+														options:[NSDictionary dictionaryWithObject:[NSNumber numberWithBool:YES]
+																							forKey:kCIContextUseSoftwareRenderer]] retain];
+			CGContextRelease(bm);
+			CGColorSpaceRelease(space);
+		}
+	}
+
+	return sSharedCIContext;
+}
+
+- (NSUInteger)outputChecksumForObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale
+{
+	// the rendering cache is emptied when the style changes, but the filter's settings are included for when the group is shared by
+	// styles that don't notify each other
+
+	NSUInteger checksum = ([object geometryChecksum] * 31 + [path checksum]) * 31 + [self renderingCacheParameters];
+
+	checksum = checksum * 31 + [[self filter] hash];
+	checksum = checksum * 31 + [[[self arguments] description] hash];
+	checksum = DKRasterizerChecksumCombine(checksum, scale);
+	checksum = DKRasterizerChecksumCombine(checksum, [object offset].width);
+	checksum = DKRasterizerChecksumCombine(checksum, [object offset].height);
+
+	return checksum;
+}
+
+- (CGImageRef)cachedOutputForObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale
+{
+	if (![object respondsToSelector:@selector(renderingCache)])
+		return NULL;
+
+	NSArray* entry = [[object renderingCache] objectForKey:[NSString stringWithFormat:@"DKCIFilterRastGroup_%p", self]];
+
+	if (entry != nil && [[entry objectAtIndex:0] unsignedIntegerValue] == [self outputChecksumForObject:object
+																								sourcePath:path
+																									 scale:scale])
+		return (CGImageRef)[entry objectAtIndex:1];
+
+	return NULL;
+}
+
+- (void)setCachedOutput:(CGImageRef)image forObject:(DKDrawableObject*)object sourcePath:(NSBezierPath*)path scale:(CGFloat)scale
+{
+	if (image == NULL || ![object respondsToSelector:@selector(renderingCache)])
+		return;
+
+	NSNumber* checksum = [NSNumber numberWithUnsignedInteger:[self outputChecksumForObject:object
+																				sourcePath:path
+																					 scale:scale]];
+
+	[[object renderingCache] setObject:[NSArray arrayWithObjects:checksum, (id)image, nil]
+								forKey:[NSString stringWithFormat:@"DKCIFilterRastGroup_%p", self]];
+}
+
+- (CGImageRef)newFilteredImageOfObject:(DKDrawableObject*)object path:(NSBezierPath*)path inRect:(NSRect)imgRect scale:(CGFloat)scale padding:(CGFloat)padding
+{
+	size_t pw = (size_t)ceil(NSWidth(imgRect) * scale);
+	size_t ph = (size_t)ceil(NSHeight(imgRect) * scale);
+
+	if (pw == 0 || ph == 0)
+		return NULL;
+
+	CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+	CGContextRef bm = CGBitmapContextCreate(NULL, pw, ph, 8, 0, space, kCGImageAlphaPremultipliedLast);
+	CGColorSpaceRelease(space);
+
+	if (bm == NULL)
+		return NULL;
+
+	// capture the contained renderers, with the top of the image at the top of the bitmap as the drawing is flipped
+
+	CGContextScaleCTM(bm, scale, scale);
+	CGContextTranslateCTM(bm, 0, NSHeight(imgRect));
+	CGContextScaleCTM(bm, 1.0, -1.0);
+	CGContextTranslateCTM(bm, -NSMinX(imgRect), -NSMinY(imgRect));
+
+	[NSGraphicsContext saveGraphicsState];
+	[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:bm
+																					flipped:YES]];
+
+	DKClippingOption saveClipping = [self clipping];
+	[self setClippingWithoutNotifying:kDKClippingNone];
+
+	[super render:object];
+	[self setClippingWithoutNotifying:saveClipping];
+
+	[NSGraphicsContext restoreGraphicsState];
+
+	CGImageRef captured = CGBitmapContextCreateImage(bm);
+	CGContextRelease(bm);
+
+	if (captured == NULL)
+		return NULL;
+
+	// the filter works in points, so the captured pixels are scaled down for it and its output scaled back up
+
+	CGImageRef output = NULL;
+	CIImage* before = [CIImage imageWithCGImage:captured];
+	CGImageRelease(captured);
+
+	@try
+	{
+		CIFilter* filter = [CIFilter filterWithName:[self filter]];
+		NSMutableDictionary* args = [[[self arguments] mutableCopy] autorelease];
+
+		[filter setDefaults];
+
+		if ([[filter inputKeys] containsObject:@"inputCenter"]) {
+			// if the arguments don't contain a centre value, set it from the object's offset
+
+			if (args == nil)
+				args = [NSMutableDictionary dictionary];
+
+			NSPoint pp;
+
+			pp.x = imgRect.size.width * 0.5f + ([object offset].width * [object size].width);
+			pp.y = imgRect.size.height * 0.5f + ([object offset].height * [object size].height);
+
+			[args setObject:[CIVector vectorWithX:pp.x
+												Y:pp.y]
+					 forKey:@"inputCenter"];
+		}
+
+		[args removeObjectForKey:@"gt_noRenderPadding"];
+
+		if (args)
+			[filter setValuesForKeysWithDictionary:args];
+
+		[filter setValue:[before imageByApplyingTransform:CGAffineTransformMakeScale(1.0 / scale, 1.0 / scale)]
+				  forKey:@"inputImage"];
+
+		CIImage* after = [[filter valueForKey:@"outputImage"] imageByApplyingTransform:CGAffineTransformMakeScale(scale, scale)];
+
+		if (after) {
+			CGRect fr = CGRectMake(-padding * scale, -padding * scale, pw + padding * scale * 2.0, ph + padding * scale * 2.0);
+
+			output = [[[self class] sharedCIContext] createCGImage:after
+														  fromRect:fr];
+		}
+	}
+	@catch (NSException* e)
+	{
+		LogEvent_(kWheneverEvent, @"exception encountered during core image filtering: %@", e);
+	}
+
+	return output;
+}
+
 #pragma mark -
 #pragma mark As a GCObservableObject
 + (NSArray*)observableKeyPaths
@@ -124,86 +427,82 @@
 	if (![self enabled])
 		return;
 
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+	CGContextRef ctx = [context graphicsPort];
+
+	if (ctx == NULL)
+		return;
+
 	NSBezierPath* path = [self renderingPathForObject:object];
 	NSRect br = [path bounds];
 	NSSize extra = [self extraSpaceNeeded];
-
 	NSRect imgRect = NSInsetRect(br, -extra.width, -extra.height);
 
-	if (m_cache) {
-
-	} else {
-		NSImage* image = [[NSImage alloc] initWithSize:imgRect.size];
-		[image setFlipped:YES];
-
-		NSAffineTransform* tfm = [NSAffineTransform transform];
-		[tfm translateXBy:extra.width - br.origin.x
-					  yBy:extra.height - br.origin.y];
-		//[tfm scaleXBy:1.0 yBy:-1.0];
-
-		[image lockFocus];
-		[tfm set];
+	if (NSIsEmptyRect(imgRect))
+		return;
 
-		DKClippingOption saveClipping = [self clipping];
-		[self setClippingWithoutNotifying:kDKClippingNone];
+	// the output is made at the device resolution rounded up to a power of two, so small changes of scale reuse it
 
-		[super render:object];
-		[self setClippingWithoutNotifying:saveClipping];
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform(ctx);
+	CGFloat deviceScale = exp2(ceil(log2(MAX(sqrt(fabs(dt.a * dt.d - dt.b * dt.c)), 0.125))));
 
-		[image unlockFocus];
+	while (deviceScale > 0.125 && MAX(NSWidth(imgRect), NSHeight(imgRect)) * deviceScale > kDKCIFilterMaximumImageSize)
+		deviceScale *= 0.5;
 
-		// captured, now render it back to the drawing, applying the filter
+	CGFloat padding = [[[self arguments] objectForKey:@"gt_noRenderPadding"] boolValue] ? 0.0 : CIIMAGE_PADDING;
+	CGImageRef output = [self cachedOutputForObject:object
+										 sourcePath:path
+											  scale:deviceScale];
 
-		NSRect fr = NSZeroRect;
-		fr.size = imgRect.size;
+	if (output == NULL) {
+		output = [self newFilteredImageOfObject:object
+										   path:path
+										 inRect:imgRect
+										  scale:deviceScale
+										padding:padding];
 
-		SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
-			switch ([self clipping])
-		{
-		default:
-		case kDKClippingNone:
-			break;
+		if (output == NULL)
+			return;
 
-		case kDKClipInsidePath:
-			[path addClip];
-			break;
-
-		case kDKClipOutsidePath:
-			[path addInverseClip];
-			break;
-		}
-
-		NSArray* inputKeys = [[CIFilter filterWithName:[self filter]] inputKeys];
+		[self setCachedOutput:output
+					forObject:object
+				   sourcePath:path
+						scale:deviceScale];
+		CGImageRelease(output);
+	}
 
-		//NSLog(@"input keys = %@", inputKeys);
+	// render it back to the drawing, clipped as set
 
-		NSMutableDictionary* args = [[self arguments] mutableCopy];
+	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
+		switch ([self clipping])
+	{
+	default:
+	case kDKClippingNone:
+		break;
 
-		if ([inputKeys containsObject:@"inputCenter"]) {
-			// if the arguments don't contain a centre value, set it from the object's offset
+	case kDKClipInsidePath:
+		[path addClip];
+		break;
 
-			if (args == nil)
-				args = [[NSMutableDictionary alloc] init];
+	case kDKClipOutsidePath:
+		[path addInverseClip];
+		break;
+	}
 
-			NSPoint pp;
+	NSRect dr = NSInsetRect(imgRect, -padding, -padding);
 
-			pp.x = imgRect.size.width * 0.5f + ([object offset].width * [object size].width);
-			pp.y = imgRect.size.height * 0.5f + ([object offset].height * [object size].height);
+	CGContextSaveGState(ctx);
 
-			[args setObject:[CIVector vectorWithX:pp.x
-												Y:pp.y]
-					 forKey:@"inputCenter"];
-		}
+	if ([context isFlipped]) {
+		CGContextTranslateCTM(ctx, NSMinX(dr), NSMaxY(dr));
+		CGContextScaleCTM(ctx, 1.0, -1.0);
+	} else
+		CGContextTranslateCTM(ctx, NSMinX(dr), NSMinY(dr));
 
-		[image drawAtPoint:imgRect.origin
-				   fromRect:fr
-			coreImageFilter:[self filter]
-				  arguments:args];
-		[args release];
-		[image release];
+	CGContextDrawImage(ctx, CGRectMake(0, 0, NSWidth(dr), NSHeight(dr)), output);
+	CGContextRestoreGState(ctx);
 
-		RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
-	}
+	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 }
 
 #pragma mark -
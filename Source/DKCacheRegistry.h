@@ -0,0 +1,84 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/// the order in which caches are purged - cheapest to rebuild first
+
+typedef enum {
+	kDKCachePurgeRenderedImages = 0, // bitmaps that can be rendered again, such as swatches, shadows and object images
+	kDKCachePurgeLayout = 1, // laid out text, glyph outlines, hatching and other computed geometry
+	kDKCachePurgeDecodedImages = 2, // images decoded from their data, which take the longest to make again
+	kDKCachePurgePriorityCount = 3
+} DKCachePurgePriority;
+
+/** @brief Implemented by caches that can give up their contents when memory is short */
+@protocol DKPurgeableCache <NSObject>
+
+/** @brief Discards everything the cache can make again
+ @return roughly the number of bytes released, or 0 if the cache doesn't know
+ */
+- (NSUInteger)purgeForMemoryPressure;
+
+@end
+
+/** @brief A registry of DrawKit's caches, which purges them when the system is short of memory.
+
+ A registry of DrawKit's caches, which purges them when the system is short of memory. Caches register with the priority of what they
+ hold, and are purged in priority order: rendered images first, as they are the quickest to make again, then layout, then decoded images.
+ When the system warns of memory pressure the rendered images are purged; when it's critical, everything is. The caches are not
+ retained - each unregisters itself before it's deallocated.
+
+ Purges are made on the main thread. The registry keeps statistics of them, logs each one and posts kDKCacheRegistryDidPurgeNotification.
+*/
+@interface DKCacheRegistry : NSObject {
+@private
+	CFMutableSetRef mCaches[kDKCachePurgePriorityCount]; // caches registered at each priority, not retained
+	dispatch_source_t mPressureSource;
+	NSUInteger mPurgeCount;
+	NSUInteger mCachesPurged;
+	NSUInteger mBytesPurged[kDKCachePurgePriorityCount];
+}
+
+/** @brief The registry the caches of DrawKit register with, listening for memory pressure
+ @return the shared registry
+ */
++ (DKCacheRegistry*)sharedCacheRegistry;
+
+- (void)registerCache:(id<DKPurgeableCache>)cache priority:(DKCachePurgePriority)priority;
+- (void)unregisterCache:(id<DKPurgeableCache>)cache;
+- (NSUInteger)countOfCaches;
+
+/** @brief Purges the caches of every priority up to and including <priority>, in priority order
+ @param priority the last priority to purge
+ @return roughly the number of bytes released
+ */
+- (NSUInteger)purgeCachesUpToPriority:(DKCachePurgePriority)priority;
+
+/** @brief Whether the registry purges the caches when the system signals memory pressure
+
+ Default is YES. Turn this off to manage memory some other way, calling -purgeCachesUpToPriority: as needed. Before 10.9 the system
+ doesn't signal memory pressure, so this stays NO whatever it's set to.
+ */
+- (void)setRespondsToMemoryPressure:(BOOL)responds;
+- (BOOL)respondsToMemoryPressure;
+
+// statistics:
+
+- (NSUInteger)purgeCount;
+- (NSUInteger)cachesPurged;
+- (NSUInteger)bytesPurgedAtPriority:(DKCachePurgePriority)priority;
+- (NSUInteger)bytesPurged;
+- (void)resetStatistics;
+
+@end
+
+extern NSString* kDKCacheRegistryDidPurgeNotification;
+
+// keys in the notification's user info
+
+extern NSString* kDKCacheRegistryPurgePriorityKey; // NSNumber, the last priority purged
+extern NSString* kDKCacheRegistryBytesPurgedKey; // NSNumber, the bytes released by the purge
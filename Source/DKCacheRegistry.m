@@ -0,0 +1,226 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKCacheRegistry.h"
+#import "LogEvent.h"
+
+NSString* kDKCacheRegistryDidPurgeNotification = @"kDKCacheRegistryDidPurgeNotification";
+NSString* kDKCacheRegistryPurgePriorityKey = @"priority";
+NSString* kDKCacheRegistryBytesPurgedKey = @"bytes_purged";
+
+static DKCacheRegistry* sSharedCacheRegistry = nil;
+
+@interface DKCacheRegistry (Private)
+
+- (void)memoryPressureChanged;
+
+@end
+
+static void memoryPressureHandler(void* context)
+{
+	[(DKCacheRegistry*)context memoryPressureChanged];
+}
+
+@implementation DKCacheRegistry
+
++ (DKCacheRegistry*)sharedCacheRegistry
+{
+	@synchronized(self)
+	{
+		if (sSharedCacheRegistry == nil) {
+			sSharedCacheRegistry = [[self alloc] init];
+			[sSharedCacheRegistry setRespondsToMemoryPressure:YES];
+		}
+	}
+
+	return sSharedCacheRegistry;
+}
+
+- (void)registerCache:(id<DKPurgeableCache>)cache priority:(DKCachePurgePriority)priority
+{
+	NSAssert(priority < kDKCachePurgePriorityCount, @"invalid cache purge priority");
+
+	if (cache == nil)
+		return;
+
+	@synchronized(self)
+	{
+		CFSetAddValue(mCaches[priority], cache);
+	}
+}
+
+- (void)unregisterCache:(id<DKPurgeableCache>)cache
+{
+	NSUInteger priority;
+
+	@synchronized(self)
+	{
+		for (priority = 0; priority < kDKCachePurgePriorityCount; ++priority)
+			CFSetRemoveValue(mCaches[priority], cache);
+	}
+}
+
+- (NSUInteger)countOfCaches
+{
+	NSUInteger priority, count = 0;
+
+	@synchronized(self)
+	{
+		for (priority = 0; priority < kDKCachePurgePriorityCount; ++priority)
+			count += CFSetGetCount(mCaches[priority]);
+	}
+
+	return count;
+}
+
+- (NSUInteger)purgeCachesUpToPriority:(DKCachePurgePriority)priority
+{
+	NSUInteger level, bytes, total = 0;
+	id<DKPurgeableCache> cache;
+
+	// the caches are purged with the registry locked, so none can be deallocated - which unregisters it - while it's being purged
+
+	@synchronized(self)
+	{
+		for (level = 0; level <= (NSUInteger)priority && level < kDKCachePurgePriorityCount; ++level) {
+			NSEnumerator* iter = [[(NSSet*)mCaches[level] allObjects] objectEnumerator];
+
+			bytes = 0;
+
+			while ((cache = [iter nextObject])) {
+				bytes += [cache purgeForMemoryPressure];
+				++mCachesPurged;
+			}
+
+			mBytesPurged[level] += bytes;
+			total += bytes;
+		}
+
+		++mPurgeCount;
+	}
+
+	LogEvent_(kInfoEvent, @"purged caches up to priority %d, releasing about %lu bytes", priority, (unsigned long)total);
+
+	NSDictionary* info = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInteger:priority], kDKCacheRegistryPurgePriorityKey,
+														 [NSNumber numberWithUnsignedInteger:total], kDKCacheRegistryBytesPurgedKey, nil];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKCacheRegistryDidPurgeNotification
+														object:self
+													  userInfo:info];
+	return total;
+}
+
+- (void)setRespondsToMemoryPressure:(BOOL)responds
+{
+	if (responds == [self respondsToMemoryPressure])
+		return;
+
+	if (responds) {
+		// memory pressure sources are only available from 10.9, and the source may not be made even then. Without one the registry
+		// doesn't respond, and caches are purged only when asked
+
+		if (@available(macOS 10.9, *))
+			mPressureSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_MEMORYPRESSURE, 0, DISPATCH_MEMORYPRESSURE_WARN | DISPATCH_MEMORYPRESSURE_CRITICAL, dispatch_get_main_queue());
+
+		if (mPressureSource == NULL) {
+			LogEvent_(kInfoEvent, @"memory pressure isn't available, caches will only be purged when asked");
+			return;
+		}
+
+		dispatch_set_context(mPressureSource, self);
+		dispatch_source_set_event_handler_f(mPressureSource, memoryPressureHandler);
+		dispatch_resume(mPressureSource);
+	} else {
+		dispatch_source_cancel(mPressureSource);
+		dispatch_release(mPressureSource);
+		mPressureSource = NULL;
+	}
+}
+
+- (BOOL)respondsToMemoryPressure
+{
+	return mPressureSource != NULL;
+}
+
+#pragma mark -
+
+- (NSUInteger)purgeCount
+{
+	return mPurgeCount;
+}
+
+- (NSUInteger)cachesPurged
+{
+	return mCachesPurged;
+}
+
+- (NSUInteger)bytesPurgedAtPriority:(DKCachePurgePriority)priority
+{
+	return (priority < kDKCachePurgePriorityCount) ? mBytesPurged[priority] : 0;
+}
+
+- (NSUInteger)bytesPurged
+{
+	NSUInteger priority, bytes = 0;
+
+	for (priority = 0; priority < kDKCachePurgePriorityCount; ++priority)
+		bytes += mBytesPurged[priority];
+
+	return bytes;
+}
+
+- (void)resetStatistics
+{
+	@synchronized(self)
+	{
+		mPurgeCount = mCachesPurged = 0;
+		memset(mBytesPurged, 0, sizeof(mBytesPurged));
+	}
+}
+
+#pragma mark -
+
+- (void)memoryPressureChanged
+{
+	unsigned long pressure = dispatch_source_get_data(mPressureSource);
+
+	// a warning costs only what can be redrawn; when memory is critical, everything rebuildable goes
+
+	if (pressure & DISPATCH_MEMORYPRESSURE_CRITICAL)
+		[self purgeCachesUpToPriority:kDKCachePurgeDecodedImages];
+	else if (pressure & DISPATCH_MEMORYPRESSURE_WARN)
+		[self purgeCachesUpToPriority:kDKCachePurgeRenderedImages];
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		NSUInteger priority;
+
+		for (priority = 0; priority < kDKCachePurgePriorityCount; ++priority)
+			mCaches[priority] = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	NSUInteger priority;
+
+	[self setRespondsToMemoryPressure:NO];
+
+	for (priority = 0; priority < kDKCachePurgePriorityCount; ++priority)
+		CFRelease(mCaches[priority]);
+
+	[super dealloc];
+}
+
+@end
@@ -13,7 +13,8 @@ typedef enum {
 	kDKIncludeRecentlyUsedItems = (1 << 1),
 	kDKIncludeAllItems = (1 << 2),
 	kDKDontAddDividingLine = (1 << 3),
-	kDKMenuIsPopUpMenu = (1 << 4)
+	kDKMenuIsPopUpMenu = (1 << 4),
+	kDKLazilyPopulateMenus = (1 << 5) // category submenus are filled in when first opened, and images are set after the menu appears
 } DKCategoryMenuOptions;
 
 typedef enum {
@@ -31,6 +32,11 @@ typedef enum {
  When the CM is asked for a menu, this helper object is used to create and manage it. As the CM is used (items and categories added/removed) the menu helpers are
  informed of the changes and in turn update the menus to match by adding or deleting menu items. This is necessary because when the CM grows to a significant number
  of items, rebuilding the menus is very time-consuming. This way performance is much better.
+
+ Alongside the master list and the categories, the CM keeps indexes of the keys of each object, the keys in each category and the categories
+ containing each key, so finding any of these doesn't have to search every key. They are kept up to date as objects and keys are added, removed
+ and renamed, and rebuilt when the contents are replaced wholesale, as when the CM is dearchived. Objects are found in the index by -isEqual:,
+ so their -hash must not change while they are in the CM.
 */
 @interface DKCategoryManager : NSObject <NSCoding, NSCopying> {
 @private
@@ -41,6 +47,10 @@ typedef enum {
 	NSUInteger m_maxRecentlyAddedItems;
 	NSUInteger m_maxRecentlyUsedItems;
 	NSMutableArray* mMenusList;
+	CFMutableDictionaryRef mObjectKeys; // object -> array of its keys
+	NSMutableDictionary* mCategoryKeys; // category name -> set of its keys
+	NSMutableDictionary* mKeyCategories; // key -> set of the names of the categories containing it
+	NSMutableDictionary* mArchivedObjects; // lowercase key -> the archive of an object not yet unarchived
 	BOOL mRecentlyAddedEnabled;
 }
 
@@ -491,6 +501,34 @@ typedef enum {
  */
 - (void)copyItemsFromCategoryManager:(DKCategoryManager*)cm;
 
+// objects unarchived when first used:
+
+/** @brief Add an object in its archived form, to be unarchived the first time it is asked for
+
+ The key is listed in the categories straight away, but the object isn't made until -objectForKey: or
+ a method listing objects needs it, so a large collection can be loaded without unarchiving objects
+ that are never used. Methods that list all of the objects unarchive all of them.
+ @param data a keyed archive of the object, its root object stored under "root"
+ @param key the object's key
+ @param catNames the names of the categories to add it to, or nil for defaults
+ @param cg YES to create the categories if they don't exist. NO not to do so
+ */
+- (void)addArchivedObject:(NSData*)data forKey:(NSString*)key toCategories:(NSArray*)catNames createCategories:(BOOL)cg;
+
+/** @brief The archive of an object that hasn't yet been unarchived
+ @param key the object's key
+ @return the archive, or nil if the object has been unarchived or the key is unknown
+ */
+- (NSData*)archivedObjectForKey:(NSString*)key;
+
+/** @brief Unarchives an object added by -addArchivedObject:forKey:toCategories:createCategories:
+
+ Subclasses can override this to unarchive their objects some other way.
+ @param data the archive
+ @return the object, or nil if the archive couldn't be read
+ */
+- (id)unarchiveObjectWithData:(NSData*)data;
+
 // supporting UI:
 // menus of just the categories:
 
@@ -534,6 +572,9 @@ typedef enum {
  Note that the returned menu is fully managed - as objects are added and removed the menu will be
  directly managed to keep in synch. Thus the client code does not need to bother doing this just
  to keep the menus up to date. The menu updating is done very efficiently for performance.
+ With the kDKLazilyPopulateMenus option, only the category items are made here and each submenu is
+ filled in when it is first opened, so a large manager's menu costs almost nothing until it is used.
+ Changes to the contents then just mark the affected submenus as needing to be filled in again.
  If the content of a menu item needs to change, call -updateMenusForKey: for the object key in
  question. When the client is dealloc'd, it should call -removeMenu: for any menus it obtained
  using this, so that stale references to the callback object are cleared out.
@@ -611,6 +652,16 @@ that the object is a member of. This facilitates category-oriented lookups of ob
 
 - (void)menuItem:(NSMenuItem*)item wasAddedForObject:(id)object inCategory:(NSString*)category;
 
+/** @brief Return the image for menu items representing the object
+
+ Optional. If implemented, the returned image is set as the item's image after -menuItem:wasAddedForObject:inCategory:.
+ For menus created with kDKLazilyPopulateMenus, this is called once per object on later passes of the run loop
+ while the menu is open, and the image is cached until -updateMenusForKey: is called for the object's key.
+ @param object the object represented by the menu item
+ @return an image, or nil
+ */
+- (NSImage*)menuItemImageForObject:(id)object;
+
 @end
 
 // delegate informal protocol allows the delegate to decide which of a pair of objects should be used when merging
@@ -625,7 +676,7 @@ that the object is a member of. This facilitates category-oriented lookups of ob
 
  Menu creation and management is moved to this class, but API in Cat Manager functions as previously.
  */
-@interface DKCategoryManagerMenuInfo : NSObject {
+@interface DKCategoryManagerMenuInfo : NSObject <NSMenuDelegate> {
 @private
 	DKCategoryManager* mCatManagerRef; // the category manager that owns this
 	NSMenu* mTheMenu; // the menu being managed
@@ -636,6 +687,10 @@ that the object is a member of. This facilitates category-oriented lookups of ob
 	BOOL mCategoriesOnly; // YES if the menu just lists the categories and not the category contents
 	NSMenuItem* mRecentlyUsedMenuItemRef; // the menu item for "recently used"
 	NSMenuItem* mRecentlyAddedMenuItemRef; // the menu item for "recently added"
+	NSMutableSet* mPopulatedMenus; // lazy submenus whose items are up to date
+	NSMutableDictionary* mImageCache; // key -> image (or NSNull) for lazy menus
+	NSMutableArray* mPendingImageItems; // items waiting for their image
+	BOOL mImagesScheduled; // YES if -renderPendingImages is due to be performed
 }
 
 - (id)initWithCategoryManager:(DKCategoryManager*)mgr itemTarget:(id)target itemAction:(SEL)selector options:(DKCategoryMenuOptions)options;
@@ -654,6 +709,7 @@ that the object is a member of. This facilitates category-oriented lookups of ob
 - (void)checkItemsForKey:(NSString*)key;
 - (void)updateForKey:(NSString*)key;
 - (void)removeAll;
+- (void)cancelPendingImages;
 
 @end
 
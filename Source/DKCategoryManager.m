@@ -10,6 +10,7 @@
 #import "NSMutableArray+DKAdditions.h"
 #import "NSString+DKAdditions.h"
 #import "DKUnarchivingHelper.h"
+#import "DKUniqueID.h"
 
 #pragma mark Contants(Non - localized)
 NSString* kDKDefaultCategoryName = @"All Items";
@@ -34,6 +35,20 @@ NSString* kDKCategoryManagerDidDeleteCategory = @"kDKCategoryManagerDidDeleteCat
 
 - (DKCategoryManagerMenuInfo*)findInfoForMenu:(NSMenu*)aMenu;
 
+// the indexes are derived from the master list and categories, and must be kept in step with them
+
+- (void)rebuildIndexes;
+- (void)indexKey:(NSString*)key forObject:(id)obj;
+- (void)unindexKey:(NSString*)key;
+- (void)indexKey:(NSString*)key inCategory:(NSString*)catName;
+- (void)unindexKey:(NSString*)key fromCategory:(NSString*)catName;
+
+// objects added in archived form are unarchived into the master list the first time they're needed
+
+- (id)unarchiveObjectForKey:(NSString*)key;
+- (void)unarchiveObjectsForKeys:(NSArray*)keys;
+- (void)unarchiveAllObjects;
+
 @end
 
 #pragma mark -
@@ -139,6 +154,7 @@ static id sDearchivingHelper = nil;
 			[m_categories setDictionary:cm->m_categories];
 			[m_recentlyAdded setArray:cm->m_recentlyAdded];
 			[m_recentlyUsed setArray:cm->m_recentlyUsed];
+			[self rebuildIndexes];
 
 			m_maxRecentlyUsedItems = cm->m_maxRecentlyUsedItems;
 			m_maxRecentlyAddedItems = cm->m_maxRecentlyAddedItems;
@@ -181,6 +197,8 @@ static id sDearchivingHelper = nil;
 		if (aicat) {
 			[aicat addObjectsFromArray:[dict allKeys]];
 		}
+
+		[self rebuildIndexes];
 	}
 
 	return self;
@@ -210,8 +228,12 @@ static id sDearchivingHelper = nil;
 
 	// add the object to the master list
 
+	[self unindexKey:name];
+	[mArchivedObjects removeObjectForKey:[name lowercaseString]];
 	[m_masterList setObject:obj
 					 forKey:[name lowercaseString]];
+	[self indexKey:name
+		 forObject:obj];
 	[self addKey:name
 		toRecentList:kDKListRecentlyAdded];
 
@@ -251,8 +273,12 @@ static id sDearchivingHelper = nil;
 
 	// add the object to the master list
 
+	[self unindexKey:name];
+	[mArchivedObjects removeObjectForKey:[name lowercaseString]];
 	[m_masterList setObject:obj
 					 forKey:[name lowercaseString]];
+	[self indexKey:name
+		 forObject:obj];
 	[self addKey:name
 		toRecentList:kDKListRecentlyAdded];
 
@@ -293,7 +319,9 @@ static id sDearchivingHelper = nil;
 
 	// remove from master dictionary
 
+	[self unindexKey:key];
 	[m_masterList removeObjectForKey:[key lowercaseString]];
+	[mArchivedObjects removeObjectForKey:[key lowercaseString]];
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKCategoryManagerDidRemoveObject
 														object:self];
 }
@@ -330,7 +358,9 @@ static id sDearchivingHelper = nil;
  */
 - (BOOL)containsKey:(NSString*)key
 {
-	return [[m_masterList allKeys] containsObject:[key lowercaseString]];
+	NSString* lowerKey = [key lowercaseString];
+
+	return [m_masterList objectForKey:lowerKey] != nil || [mArchivedObjects objectForKey:lowerKey] != nil;
 }
 
 /** @brief Return total number of stored objects in container
@@ -338,7 +368,7 @@ static id sDearchivingHelper = nil;
  */
 - (NSUInteger)count
 {
-	return [m_masterList count];
+	return [m_masterList count] + [mArchivedObjects count];
 }
 
 #pragma mark -
@@ -349,7 +379,12 @@ static id sDearchivingHelper = nil;
  */
 - (id)objectForKey:(NSString*)key
 {
-	return [m_masterList objectForKey:[key lowercaseString]];
+	id obj = [m_masterList objectForKey:[key lowercaseString]];
+
+	if (obj == nil && [mArchivedObjects count] > 0)
+		obj = [self unarchiveObjectForKey:key];
+
+	return obj;
 }
 
 /** @brief Return the object for the given key, optionally remembering it in the "recently used" list
@@ -384,16 +419,12 @@ static id sDearchivingHelper = nil;
 {
 	//return [[self dictionary] allKeysForObject:obj];  // doesn't work because master dict uses lowercase keys
 
-	NSMutableArray* keys = [[NSMutableArray alloc] init];
-	NSEnumerator* iter = [[self allKeys] objectEnumerator];
-	NSString* key;
+	NSArray* keys = nil;
 
-	while ((key = [iter nextObject])) {
-		if ([[self objectForKey:key] isEqual:obj])
-			[keys addObject:key];
-	}
+	if (obj)
+		keys = (NSArray*)CFDictionaryGetValue(mObjectKeys, obj);
 
-	return [keys autorelease];
+	return keys ? [[keys copy] autorelease] : [NSArray array];
 }
 
 /** @brief Return a copy of the master dictionary
@@ -401,6 +432,7 @@ static id sDearchivingHelper = nil;
  */
 - (NSDictionary*)dictionary
 {
+	[self unarchiveAllObjects];
 	return [[m_masterList copy] autorelease];
 }
 
@@ -526,9 +558,12 @@ static id sDearchivingHelper = nil;
 - (NSArray*)objectsInCategory:(NSString*)catName
 {
 	NSMutableArray* keys = [[[NSMutableArray alloc] init] autorelease];
-	NSEnumerator* iter = [[self allKeysInCategory:catName] objectEnumerator];
+	NSArray* catKeys = [self allKeysInCategory:catName];
+	NSEnumerator* iter = [catKeys objectEnumerator];
 	NSString* s;
 
+	[self unarchiveObjectsForKeys:catKeys];
+
 	while ((s = [iter nextObject]))
 		[keys addObject:[s lowercaseString]];
 
@@ -547,9 +582,12 @@ static id sDearchivingHelper = nil;
 - (NSArray*)objectsInCategories:(NSArray*)catNames
 {
 	NSMutableArray* keys = [[[NSMutableArray alloc] init] autorelease];
-	NSEnumerator* iter = [[self allKeysInCategories:catNames] objectEnumerator];
+	NSArray* catKeys = [self allKeysInCategories:catNames];
+	NSEnumerator* iter = [catKeys objectEnumerator];
 	NSString* s;
 
+	[self unarchiveObjectsForKeys:catKeys];
+
 	while ((s = [iter nextObject]))
 		[keys addObject:[s lowercaseString]];
 
@@ -621,6 +659,7 @@ static id sDearchivingHelper = nil;
  */
 - (NSArray*)allObjects
 {
+	[self unarchiveAllObjects];
 	return [m_masterList allValues];
 }
 
@@ -721,6 +760,8 @@ static id sDearchivingHelper = nil;
 														  userInfo:info];
 		[m_categories setObject:cat
 						 forKey:catName];
+		[mCategoryKeys setObject:[NSMutableSet set]
+						  forKey:catName];
 		[cat release];
 
 		// inform any menus of the new category
@@ -761,6 +802,15 @@ static id sDearchivingHelper = nil;
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKCategoryManagerWillDeleteCategory
 															object:self
 														  userInfo:info];
+
+		NSEnumerator* iter = [[[[mCategoryKeys objectForKey:catName] copy] autorelease] objectEnumerator];
+		NSString* key;
+
+		while ((key = [iter nextObject]))
+			[self unindexKey:key
+				fromCategory:catName];
+
+		[mCategoryKeys removeObjectForKey:catName];
 		[m_categories removeObjectForKey:catName];
 
 		// inform menus that category has gone
@@ -785,7 +835,29 @@ static id sDearchivingHelper = nil;
 
 	NSMutableArray* gs = [m_categories objectForKey:catName];
 
-	if (gs) {
+	if (gs && ![catName isEqualToString:newname]) {
+		// the keys of a category that is replaced are no longer in it, and those of the renamed one are now in it under the new name
+
+		NSMutableSet* keySet = [[mCategoryKeys objectForKey:catName] retain];
+		NSEnumerator* iter = [[[[mCategoryKeys objectForKey:newname] copy] autorelease] objectEnumerator];
+		NSString* key;
+
+		while ((key = [iter nextObject]))
+			[self unindexKey:key
+				fromCategory:newname];
+
+		iter = [keySet objectEnumerator];
+
+		while ((key = [iter nextObject])) {
+			[[mKeyCategories objectForKey:key] removeObject:catName];
+			[[mKeyCategories objectForKey:key] addObject:newname];
+		}
+
+		[mCategoryKeys removeObjectForKey:catName];
+		[mCategoryKeys setObject:keySet
+						  forKey:newname];
+		[keySet release];
+
 		[gs retain];
 		[m_categories removeObjectForKey:catName];
 
@@ -811,9 +883,11 @@ static id sDearchivingHelper = nil;
 - (void)removeAllCategories
 {
 	[m_masterList removeAllObjects];
+	[mArchivedObjects removeAllObjects];
 	[m_categories removeAllObjects];
 	[m_recentlyUsed removeAllObjects];
 	[m_recentlyAdded removeAllObjects];
+	[self rebuildIndexes];
 
 	[mMenusList makeObjectsPerformSelector:@selector(removeAll)];
 }
@@ -849,8 +923,10 @@ static id sDearchivingHelper = nil;
 
 	// add the key to this group's list if not already known
 
-	if (![ga containsObject:key]) {
+	if (![[mCategoryKeys objectForKey:catName] containsObject:key]) {
 		[ga addObject:key];
+		[self indexKey:key
+			inCategory:catName];
 
 		// update menus
 
@@ -898,7 +974,13 @@ static id sDearchivingHelper = nil;
 
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKCategoryManagerWillRemoveKeyFromCategory
 															object:self];
-		[ga removeObject:key];
+
+		if ([[mCategoryKeys objectForKey:catName] containsObject:key]) {
+			[ga removeObject:key];
+			[self unindexKey:key
+				fromCategory:catName];
+		}
+
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKCategoryManagerDidRemoveKeyFromCategory
 															object:self];
 	}
@@ -925,7 +1007,7 @@ static id sDearchivingHelper = nil;
 - (void)removeKeyFromAllCategories:(NSString*)key
 {
 	[self removeKey:key
-		fromCategories:[self allCategories]];
+		fromCategories:[[mKeyCategories objectForKey:key] allObjects]];
 }
 
 /** @brief Checks that all keys refer to real objects, removing any that do not
@@ -938,7 +1020,7 @@ static id sDearchivingHelper = nil;
 	NSString* key;
 
 	while ((key = [iter nextObject])) {
-		if ([self objectForKey:key] == nil)
+		if (![self containsKey:key])
 			[self removeKeyFromAllCategories:key];
 	}
 }
@@ -1025,19 +1107,11 @@ static id sDearchivingHelper = nil;
 
 - (NSArray*)categoriesContainingKey:(NSString*)key withSorting:(BOOL)sortIt
 {
-	NSEnumerator* iter = [[m_categories allKeys] objectEnumerator];
-	NSString* catName;
-	NSArray* cat;
-	NSMutableArray* catList;
-
-	catList = [[NSMutableArray alloc] init];
-
-	while ((catName = [iter nextObject])) {
-		cat = [self allKeysInCategory:catName];
+	NSMutableArray* catList = [[NSMutableArray alloc] init];
+	NSSet* cats = [mKeyCategories objectForKey:key];
 
-		if ([cat containsObject:key])
-			[catList addObject:catName];
-	}
+	if (cats)
+		[catList addObjectsFromArray:[cats allObjects]];
 
 	if (sortIt)
 		[catList sortUsingSelector:@selector(caseInsensitiveCompare:)];
@@ -1084,7 +1158,7 @@ static id sDearchivingHelper = nil;
  */
 - (BOOL)key:(NSString*)key existsInCategory:(NSString*)catName
 {
-	return [[m_categories objectForKey:catName] containsObject:key];
+	return [[mCategoryKeys objectForKey:catName] containsObject:key];
 }
 
 #pragma mark -
@@ -1264,6 +1338,7 @@ static id sDearchivingHelper = nil;
 		[m_categories setDictionary:newCM->m_categories];
 		[m_recentlyUsed setArray:newCM->m_recentlyUsed];
 		[m_recentlyAdded setArray:newCM->m_recentlyAdded];
+		[self rebuildIndexes];
 
 		// TODO: deal with menus
 
@@ -1318,24 +1393,263 @@ static id sDearchivingHelper = nil;
 
 	NSEnumerator* iter = [newObjects objectEnumerator];
 	NSString* key;
+	NSData* archive;
 	id obj;
 
 	[self setRecentlyAddedListEnabled:NO];
 
 	while ((key = [iter nextObject])) {
-		obj = [cm objectForKey:key];
 		newCategories = [cm categoriesContainingKey:key
 										withSorting:NO];
-		[self addObject:obj
-					  forKey:key
-				toCategories:newCategories
-			createCategories:YES];
+
+		// objects <cm> hasn't unarchived yet are copied in their archived form
+
+		archive = [cm archivedObjectForKey:key];
+
+		if (archive)
+			[self addArchivedObject:archive
+							   forKey:key
+						 toCategories:newCategories
+					 createCategories:YES];
+		else {
+			obj = [cm objectForKey:key];
+			[self addObject:obj
+						  forKey:key
+					toCategories:newCategories
+				createCategories:YES];
+		}
 	}
 
 	[self setRecentlyAddedListEnabled:YES];
 	[self setRecentlyAddedItems:[cm recentlyAddedItems]];
 }
 
+#pragma mark -
+#pragma mark - objects unarchived when first used
+
+- (void)addArchivedObject:(NSData*)data forKey:(NSString*)key toCategories:(NSArray*)catNames createCategories:(BOOL)cg
+{
+	NSAssert(data != nil, @"archive cannot be nil");
+	NSAssert(key != nil, @"key cannot be nil");
+	NSAssert([key length] > 0, @"key cannot be empty");
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKCategoryManagerWillAddObject
+														object:self];
+
+	// any object already unarchived under this key is replaced
+
+	[self unindexKey:key];
+	[m_masterList removeObjectForKey:[key lowercaseString]];
+	[mArchivedObjects setObject:data
+						 forKey:[key lowercaseString]];
+	[self addKey:key
+		toRecentList:kDKListRecentlyAdded];
+
+	if (catNames != nil && [catNames count] > 0)
+		[self addKey:key
+				toCategories:catNames
+			createCategories:cg];
+
+	[self addKey:key
+			toCategory:kDKDefaultCategoryName
+		createCategory:NO];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKCategoryManagerDidAddObject
+														object:self];
+}
+
+- (NSData*)archivedObjectForKey:(NSString*)key
+{
+	return [mArchivedObjects objectForKey:[key lowercaseString]];
+}
+
+- (id)unarchiveObjectWithData:(NSData*)data
+{
+	NSKeyedUnarchiver* unarch = nil;
+	id obj = nil;
+
+	@try
+	{
+		unarch = [[NSKeyedUnarchiver alloc] initForReadingWithData:data];
+		[unarch setDelegate:[[self class] dearchivingHelper]];
+		obj = [unarch decodeObjectForKey:@"root"];
+		[unarch finishDecoding];
+	}
+	@catch (NSException* e)
+	{
+		LogEvent_(kWheneverEvent, @"exception encountered unarchiving an object: %@", e);
+		obj = nil;
+	}
+	@finally
+	{
+		[unarch release];
+	}
+
+	return obj;
+}
+
+- (id)unarchiveObjectForKey:(NSString*)key
+{
+	NSString* lowerKey = [key lowercaseString];
+	NSData* data = [mArchivedObjects objectForKey:lowerKey];
+
+	if (data == nil)
+		return nil;
+
+	id obj = [self unarchiveObjectWithData:data];
+
+	// the archive is dropped even if it couldn't be read, so a bad one is only tried once
+
+	[mArchivedObjects removeObjectForKey:lowerKey];
+
+	if (obj) {
+		[m_masterList setObject:obj
+						 forKey:lowerKey];
+		[self indexKey:key
+			 forObject:obj];
+	} else
+		NSLog(@"%@ ! the archived object for key '%@' could not be unarchived", self, key);
+
+	return obj;
+}
+
+- (void)unarchiveObjectsForKeys:(NSArray*)keys
+{
+	NSEnumerator* iter = [keys objectEnumerator];
+	NSString* key;
+
+	while ([mArchivedObjects count] > 0 && (key = [iter nextObject]))
+		[self unarchiveObjectForKey:key];
+}
+
+- (void)unarchiveAllObjects
+{
+	// keys are taken from the categories first so that the objects are indexed under the keys as the categories have them
+
+	if ([mArchivedObjects count] > 0) {
+		[self unarchiveObjectsForKeys:[self allKeys]];
+		[self unarchiveObjectsForKeys:[mArchivedObjects allKeys]];
+	}
+}
+
+#pragma mark -
+#pragma mark - indexes
+
+- (void)rebuildIndexes
+{
+	CFDictionaryRemoveAllValues(mObjectKeys);
+	[mCategoryKeys removeAllObjects];
+	[mKeyCategories removeAllObjects];
+
+	NSEnumerator* iter = [m_categories keyEnumerator];
+	NSString* catName;
+	NSString* key;
+
+	while ((catName = [iter nextObject])) {
+		[mCategoryKeys setObject:[NSMutableSet set]
+						  forKey:catName];
+
+		NSEnumerator* keyIter = [[m_categories objectForKey:catName] objectEnumerator];
+
+		while ((key = [keyIter nextObject]))
+			[self indexKey:key
+				inCategory:catName];
+	}
+
+	// keys are indexed as the categories have them, since the master list's are lowercase. Any object not listed by a category is
+	// indexed under its lowercase key
+
+	NSMutableSet* indexed = [NSMutableSet set];
+
+	iter = [mKeyCategories keyEnumerator];
+
+	while ((key = [iter nextObject])) {
+		NSString* lowerKey = [key lowercaseString];
+		id obj = [m_masterList objectForKey:lowerKey];
+
+		if (obj && ![indexed containsObject:lowerKey]) {
+			[self indexKey:key
+				 forObject:obj];
+			[indexed addObject:lowerKey];
+		}
+	}
+
+	iter = [m_masterList keyEnumerator];
+
+	while ((key = [iter nextObject])) {
+		if (![indexed containsObject:key])
+			[self indexKey:key
+				 forObject:[m_masterList objectForKey:key]];
+	}
+}
+
+- (void)indexKey:(NSString*)key forObject:(id)obj
+{
+	NSMutableArray* keys = (NSMutableArray*)CFDictionaryGetValue(mObjectKeys, obj);
+
+	if (keys == nil) {
+		keys = [[NSMutableArray alloc] init];
+		CFDictionarySetValue(mObjectKeys, obj, keys);
+		[keys release];
+	}
+
+	[keys addObject:key];
+}
+
+- (void)unindexKey:(NSString*)key
+{
+	// removes the key, in any case, from the keys of the object it refers to
+
+	NSString* lowerKey = [key lowercaseString];
+	id obj = [m_masterList objectForKey:lowerKey];
+
+	if (obj == nil)
+		return;
+
+	NSMutableArray* keys = (NSMutableArray*)CFDictionaryGetValue(mObjectKeys, obj);
+	NSInteger i;
+
+	for (i = (NSInteger)[keys count] - 1; i >= 0; --i) {
+		if ([[[keys objectAtIndex:i] lowercaseString] isEqualToString:lowerKey])
+			[keys removeObjectAtIndex:i];
+	}
+
+	if (keys && [keys count] == 0)
+		CFDictionaryRemoveValue(mObjectKeys, obj);
+}
+
+- (void)indexKey:(NSString*)key inCategory:(NSString*)catName
+{
+	NSMutableSet* keySet = [mCategoryKeys objectForKey:catName];
+
+	if (keySet == nil)
+		return;
+
+	[keySet addObject:key];
+
+	NSMutableSet* cats = [mKeyCategories objectForKey:key];
+
+	if (cats == nil) {
+		cats = [NSMutableSet set];
+		[mKeyCategories setObject:cats
+						   forKey:key];
+	}
+
+	[cats addObject:catName];
+}
+
+- (void)unindexKey:(NSString*)key fromCategory:(NSString*)catName
+{
+	[[mCategoryKeys objectForKey:catName] removeObject:key];
+
+	NSMutableSet* cats = [mKeyCategories objectForKey:key];
+
+	[cats removeObject:catName];
+
+	if (cats && [cats count] == 0)
+		[mKeyCategories removeObjectForKey:key];
+}
+
 #pragma mark -
 #pragma mark - supporting UI
 
@@ -1362,7 +1676,12 @@ static id sDearchivingHelper = nil;
  */
 - (void)removeMenu:(NSMenu*)menu
 {
-	[mMenusList removeObject:[self findInfoForMenu:menu]];
+	DKCategoryManagerMenuInfo* menuInfo = [self findInfoForMenu:menu];
+
+	// a pending image would otherwise keep the info, and call its delegate, after the client has gone
+
+	[menuInfo cancelPendingImages];
+	[mMenusList removeObject:menuInfo];
 }
 
 /** @brief Synchronises the menus to reflect any change of the object referenced by <key>
@@ -1390,6 +1709,9 @@ static id sDearchivingHelper = nil;
  Note that the returned menu is fully managed - as objects are added and removed the menu will be
  directly managed to keep in synch. Thus the client code does not need to bother doing this just
  to keep the menus up to date. The menu updating is done very efficiently for performance.
+ With the kDKLazilyPopulateMenus option, only the category items are made here and each submenu is
+ filled in when it is first opened, so a large manager's menu costs almost nothing until it is used.
+ Changes to the contents then just mark the affected submenus as needing to be filled in again.
  If the content of a menu item needs to change, call -updateMenusForKey: for the object key in
  question. When the client is dealloc'd, it should call -removeMenu: for any menus it obtained
  using this, so that stale references to the callback object are cleared out.
@@ -1495,6 +1817,12 @@ static id sDearchivingHelper = nil;
 	[m_categories release];
 	[m_masterList release];
 	[mMenusList release];
+	[mCategoryKeys release];
+	[mKeyCategories release];
+	[mArchivedObjects release];
+
+	if (mObjectKeys)
+		CFRelease(mObjectKeys);
 
 	[super dealloc];
 }
@@ -1508,6 +1836,10 @@ static id sDearchivingHelper = nil;
 		m_recentlyAdded = [[NSMutableArray alloc] init];
 		m_recentlyUsed = [[NSMutableArray alloc] init];
 		mMenusList = [[NSMutableArray alloc] init];
+		mObjectKeys = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+		mCategoryKeys = [[NSMutableDictionary alloc] init];
+		mKeyCategories = [[NSMutableDictionary alloc] init];
+		mArchivedObjects = [[NSMutableDictionary alloc] init];
 		mRecentlyAddedEnabled = YES;
 		m_maxRecentlyAddedItems = kDKDefaultMaxRecentArraySize;
 		m_maxRecentlyUsedItems = kDKDefaultMaxRecentArraySize;
@@ -1532,6 +1864,10 @@ static id sDearchivingHelper = nil;
 #pragma mark As part of NSCoding Protocol
 - (void)encodeWithCoder:(NSCoder*)coder
 {
+	// the archive holds the objects themselves, so any still archived are unarchived first
+
+	[self unarchiveAllObjects];
+
 	[coder encodeObject:m_masterList
 				 forKey:@"master"];
 	[coder encodeObject:m_categories
@@ -1549,7 +1885,18 @@ static id sDearchivingHelper = nil;
 
 - (id)initWithCoder:(NSCoder*)coder
 {
-	m_masterList = [[coder decodeObjectForKey:@"master"] retain];
+	NSDictionary* master = [coder decodeObjectForKey:@"master"];
+	NSEnumerator* iter = [master keyEnumerator];
+	NSString* key;
+
+	// keys that are unique IDs are kept in their compact form, which compares faster
+
+	m_masterList = [[NSMutableDictionary alloc] initWithCapacity:[master count]];
+
+	while ((key = [iter nextObject]))
+		[m_masterList setObject:[master objectForKey:key]
+						 forKey:[DKUniqueID uniqueKeyWithString:key]];
+
 	m_categories = [[coder decodeObjectForKey:@"categories"] retain];
 	m_recentlyAdded = [[coder decodeObjectForKey:@"recent_add"] retain];
 	m_recentlyUsed = [[coder decodeObjectForKey:@"recent_use"] retain];
@@ -1560,13 +1907,21 @@ static id sDearchivingHelper = nil;
 
 	mMenusList = [[NSMutableArray alloc] init];
 
+	// the indexes aren't archived, since they can always be derived from the master list and categories
+
+	mObjectKeys = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+	mCategoryKeys = [[NSMutableDictionary alloc] init];
+	mKeyCategories = [[NSMutableDictionary alloc] init];
+	mArchivedObjects = [[NSMutableDictionary alloc] init];
+
 	if (m_masterList == nil
 		|| m_categories == nil
 		|| m_recentlyAdded == nil
 		|| m_recentlyUsed == nil) {
 		[self autorelease];
 		self = nil;
-	}
+	} else
+		[self rebuildIndexes];
 
 	return self;
 }
@@ -1583,10 +1938,12 @@ static id sDearchivingHelper = nil;
 	DKCategoryManager* copy = [[[self class] allocWithZone:zone] init];
 
 	[copy->m_masterList setDictionary:m_masterList];
+	[copy->mArchivedObjects setDictionary:mArchivedObjects];
 
 	NSDictionary* cats = [m_categories deepCopy];
 	[copy->m_categories setDictionary:cats];
 	[cats release];
+	[copy rebuildIndexes];
 
 	return copy;
 }
@@ -1601,10 +1958,24 @@ static id sDearchivingHelper = nil;
 - (void)createMenu;
 - (void)createCategoriesMenu;
 - (NSMenu*)createSubmenuWithTitle:(NSString*)title forArray:(NSArray*)items;
+- (void)setUpItem:(NSMenuItem*)item forObject:(id)object key:(NSString*)key inCategory:(NSString*)cat;
 - (void)removeItemsInMenu:(NSMenu*)aMenu withTag:(NSInteger)tag excludingItem0:(BOOL)title;
 
+// lazily populated menus
+
+- (NSMenu*)createLazySubmenuWithTitle:(NSString*)title;
+- (void)populateLazySubmenu:(NSMenu*)menu;
+- (void)invalidateSubmenu:(NSMenu*)menu;
+- (void)invalidateSubmenusForKey:(NSString*)key;
+- (void)queueImageForItem:(NSMenuItem*)item key:(NSString*)key;
+- (void)renderPendingImages;
+
 @end
 
+// the number of images rendered for lazily populated menus on each pass of the run loop
+
+#define kDKCategoryMenuImagesPerPass 8
+
 @implementation DKCategoryManagerMenuInfo
 
 - (id)initWithCategoryManager:(DKCategoryManager*)mgr itemTarget:(id)target itemAction:(SEL)selector options:(DKCategoryMenuOptions)options
@@ -1632,6 +2003,9 @@ static id sDearchivingHelper = nil;
 		mCallbackTargetRef = delegate;
 		mOptions = options;
 		mCategoriesOnly = NO;
+		mPopulatedMenus = [[NSMutableSet alloc] init];
+		mImageCache = [[NSMutableDictionary alloc] init];
+		mPendingImageItems = [[NSMutableArray alloc] init];
 		[self createMenu];
 	}
 
@@ -1650,6 +2024,9 @@ static id sDearchivingHelper = nil;
 		mSelector = selector;
 		mOptions = options;
 		mCategoriesOnly = NO;
+		mPopulatedMenus = [[NSMutableSet alloc] init];
+		mImageCache = [[NSMutableDictionary alloc] init];
+		mPendingImageItems = [[NSMutableArray alloc] init];
 		[self createMenu];
 	}
 
@@ -1686,6 +2063,11 @@ static id sDearchivingHelper = nil;
 		[newItem setAction:mSelector];
 		[newItem setTag:kDKCategoryManagerManagedMenuItemTag];
 
+		// a lazy submenu finds its category through its parent item
+
+		if (!mCategoriesOnly && (mOptions & kDKLazilyPopulateMenus) != 0)
+			[newItem setRepresentedObject:newCategory];
+
 		// find where to insert it and do so. The categories already contains this item, so we can just sort then find it.
 
 		NSArray* temp = [mCatManagerRef allCategories];
@@ -1724,8 +2106,10 @@ static id sDearchivingHelper = nil;
 
 	NSMenuItem* item = [mTheMenu itemWithTitle:[oldCategory capitalizedString]];
 
-	if (item != nil)
+	if (item != nil) {
+		[self invalidateSubmenu:[item submenu]];
 		[mTheMenu removeItem:item];
+	}
 }
 
 - (void)renameCategoryWithInfo:(NSDictionary*)info
@@ -1740,6 +2124,9 @@ static id sDearchivingHelper = nil;
 		[mTheMenu removeItem:item];
 		[item setTitle:[newName capitalizedString]];
 
+		if (!mCategoriesOnly && (mOptions & kDKLazilyPopulateMenus) != 0)
+			[item setRepresentedObject:newName];
+
 		// where should it be reinserted to maintain sorting?
 
 		NSArray* temp = [mCatManagerRef allCategories];
@@ -1776,6 +2163,27 @@ static id sDearchivingHelper = nil;
 
 	LogEvent_(kInfoEvent, @"adding item key '%@' to menu %@", aKey, self);
 
+	if ((mOptions & kDKLazilyPopulateMenus) != 0) {
+		// make sure each category the key is in has a submenu, and leave filling it in until it's next opened
+
+		NSEnumerator* catIter = [[mCatManagerRef categoriesContainingKey:aKey] objectEnumerator];
+		NSString* catName;
+
+		while ((catName = [catIter nextObject])) {
+			NSMenuItem* catItem = [mTheMenu itemWithTitle:[catName capitalizedString]];
+
+			if (catItem != nil) {
+				if ([catItem submenu] == nil)
+					[catItem setSubmenu:[self createLazySubmenuWithTitle:[catName capitalizedString]]];
+
+				[catItem setEnabled:YES];
+				[self invalidateSubmenu:[catItem submenu]];
+			}
+		}
+
+		return;
+	}
+
 	// the key may be being added to several categories, so first get a list of the categories that it belongs to
 
 	NSArray* cats = [mCatManagerRef categoriesContainingKey:aKey];
@@ -1816,12 +2224,10 @@ static id sDearchivingHelper = nil;
 					[childItem setTarget:mTargetRef];
 					[childItem setRepresentedObject:repObject];
 
-					if (mCallbackTargetRef && [mCallbackTargetRef respondsToSelector:@selector(menuItem:
-																						 wasAddedForObject:
-																								inCategory:)])
-						[mCallbackTargetRef menuItem:childItem
-								   wasAddedForObject:repObject
-										  inCategory:cat];
+					[self setUpItem:childItem
+						  forObject:repObject
+								key:aKey
+						 inCategory:cat];
 
 					[childItem setTag:kDKCategoryManagerManagedMenuItemTag];
 
@@ -1873,6 +2279,11 @@ static id sDearchivingHelper = nil;
 			[mRecentlyUsedMenuItemRef setEnabled:[array count] > 0];
 		}
 
+		if ((mOptions & kDKLazilyPopulateMenus) != 0) {
+			[self invalidateSubmenu:raSub];
+			continue;
+		}
+
 		if (!mCategoriesOnly && raSub != nil) {
 			// remove any menu items that are not present in the array
 
@@ -1914,12 +2325,10 @@ static id sDearchivingHelper = nil;
 					[childItem setRepresentedObject:repObject];
 					[childItem setTarget:mTargetRef];
 
-					if (mCallbackTargetRef && [mCallbackTargetRef respondsToSelector:@selector(menuItem:
-																						 wasAddedForObject:
-																								inCategory:)])
-						[mCallbackTargetRef menuItem:childItem
-								   wasAddedForObject:repObject
-										  inCategory:nil];
+					[self setUpItem:childItem
+						  forObject:repObject
+								key:aKey
+						 inCategory:nil];
 
 					// just added, so will always be first item in the list
 
@@ -1943,6 +2352,11 @@ static id sDearchivingHelper = nil;
 
 	NSMenu* recentItemsMenu = [mRecentlyUsedMenuItemRef submenu];
 
+	if ((mOptions & kDKLazilyPopulateMenus) != 0) {
+		[self invalidateSubmenu:recentItemsMenu];
+		return;
+	}
+
 	if (recentItemsMenu != nil) {
 		id repObject = [mCatManagerRef objectForKey:aKey];
 		NSInteger indx = [recentItemsMenu indexOfItemWithRepresentedObject:repObject];
@@ -1964,6 +2378,12 @@ static id sDearchivingHelper = nil;
 	if (mCategoriesOnly)
 		return;
 
+	if ((mOptions & kDKLazilyPopulateMenus) != 0) {
+		[mImageCache removeObjectForKey:aKey];
+		[self invalidateSubmenusForKey:aKey];
+		return;
+	}
+
 	NSArray* cats = [mCatManagerRef categoriesContainingKey:aKey];
 	NSEnumerator* iter = [cats objectEnumerator];
 	NSString* cat;
@@ -2037,6 +2457,16 @@ static id sDearchivingHelper = nil;
 	NSAssert(key != nil, @"can't update - key was nil");
 	LogEvent_(kInfoEvent, @"updating menu %@ for key '%@'", self, key);
 
+	if ((mOptions & kDKLazilyPopulateMenus) != 0) {
+		// the items are remade when their menus are next opened, so there's nothing to update until then
+
+		[mImageCache removeObjectForKey:key];
+		[self invalidateSubmenusForKey:key];
+		[self invalidateSubmenu:[mRecentlyUsedMenuItemRef submenu]];
+		[self invalidateSubmenu:[mRecentlyAddedMenuItemRef submenu]];
+		return;
+	}
+
 	NSMutableArray* categories = [[mCatManagerRef categoriesContainingKey:key] mutableCopy];
 
 	// add the recent items/added menus as if they were categories
@@ -2063,12 +2493,10 @@ static id sDearchivingHelper = nil;
 
 				NSString* oldTitle = [[item title] retain];
 
-				if (mCallbackTargetRef && [mCallbackTargetRef respondsToSelector:@selector(menuItem:
-																					 wasAddedForObject:
-																							inCategory:)])
-					[mCallbackTargetRef menuItem:item
-							   wasAddedForObject:repObject
-									  inCategory:catName];
+				[self setUpItem:item
+					  forObject:repObject
+							key:key
+					 inCategory:catName];
 
 				// if title changed, reposition the item
 
@@ -2098,6 +2526,10 @@ static id sDearchivingHelper = nil;
 {
 	// removes all managed items and submenus from the menu excluding the recent items
 
+	[self cancelPendingImages];
+	[mPopulatedMenus removeAllObjects];
+	[mImageCache removeAllObjects];
+
 	[self removeItemsInMenu:mTheMenu
 					withTag:kDKCategoryManagerManagedMenuItemTag
 			 excludingItem0:(mOptions & kDKMenuIsPopUpMenu) != 0];
@@ -2161,6 +2593,13 @@ static id sDearchivingHelper = nil;
 								  keyEquivalent:@""];
 		[parentItem setTag:kDKCategoryManagerManagedMenuItemTag];
 
+		if ((mOptions & kDKLazilyPopulateMenus) != 0) {
+			[parentItem setRepresentedObject:cat];
+			[parentItem setSubmenu:[self createLazySubmenuWithTitle:[cat capitalizedString]]];
+			[parentItem setEnabled:[mCatManagerRef countOfObjectsInCategory:cat] > 0];
+			continue;
+		}
+
 		// get the sorted list of items in the category
 
 		catObjects = [mCatManagerRef allSortedKeysInCategory:cat];
@@ -2189,8 +2628,11 @@ static id sDearchivingHelper = nil;
 		parentItem = [mTheMenu addItemWithTitle:title
 										 action:0
 								  keyEquivalent:@""];
-		subMenu = [self createSubmenuWithTitle:title
-									  forArray:[mCatManagerRef recentlyUsedItems]];
+		if ((mOptions & kDKLazilyPopulateMenus) != 0)
+			subMenu = [self createLazySubmenuWithTitle:title];
+		else
+			subMenu = [self createSubmenuWithTitle:title
+										  forArray:[mCatManagerRef recentlyUsedItems]];
 
 		[parentItem setTag:kDKCategoryManagerRecentMenuItemTag];
 		[parentItem setSubmenu:subMenu];
@@ -2204,8 +2646,11 @@ static id sDearchivingHelper = nil;
 		parentItem = [mTheMenu addItemWithTitle:title
 										 action:0
 								  keyEquivalent:@""];
-		subMenu = [self createSubmenuWithTitle:title
-									  forArray:[mCatManagerRef recentlyAddedItems]];
+		if ((mOptions & kDKLazilyPopulateMenus) != 0)
+			subMenu = [self createLazySubmenuWithTitle:title];
+		else
+			subMenu = [self createSubmenuWithTitle:title
+										  forArray:[mCatManagerRef recentlyAddedItems]];
 
 		[parentItem setTag:kDKCategoryManagerRecentMenuItemTag];
 		[parentItem setSubmenu:subMenu];
@@ -2291,12 +2736,10 @@ static id sDearchivingHelper = nil;
 		repObject = [mCatManagerRef objectForKey:key];
 		[childItem setRepresentedObject:repObject];
 
-		if (mCallbackTargetRef && [mCallbackTargetRef respondsToSelector:@selector(menuItem:
-																			 wasAddedForObject:
-																					inCategory:)])
-			[mCallbackTargetRef menuItem:childItem
-					   wasAddedForObject:repObject
-							  inCategory:nil];
+		[self setUpItem:childItem
+			  forObject:repObject
+					key:key
+			 inCategory:nil];
 
 		[childItem setTag:kDKCategoryManagerManagedMenuItemTag];
 	}
@@ -2304,12 +2747,250 @@ static id sDearchivingHelper = nil;
 	return [theMenu autorelease];
 }
 
+- (void)setUpItem:(NSMenuItem*)item forObject:(id)object key:(NSString*)key inCategory:(NSString*)cat
+{
+	// passes a new or changed item to the delegate, then sets its image if the delegate supplies one. Lazy menus set
+	// the image on a later pass of the run loop unless it's already cached.
+
+	if (mCallbackTargetRef == nil)
+		return;
+
+	if ([mCallbackTargetRef respondsToSelector:@selector(menuItem:
+														   wasAddedForObject:
+																  inCategory:)])
+		[mCallbackTargetRef menuItem:item
+				   wasAddedForObject:object
+						  inCategory:cat];
+
+	if ([mCallbackTargetRef respondsToSelector:@selector(menuItemImageForObject:)]) {
+		if ((mOptions & kDKLazilyPopulateMenus) == 0)
+			[item setImage:[mCallbackTargetRef menuItemImageForObject:object]];
+		else {
+			id image = [mImageCache objectForKey:key];
+
+			if (image == nil)
+				[self queueImageForItem:item
+									key:key];
+			else if (image != [NSNull null])
+				[item setImage:image];
+		}
+	}
+}
+
+- (void)cancelPendingImages
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self
+											 selector:@selector(renderPendingImages)
+											   object:nil];
+	[mPendingImageItems removeAllObjects];
+	mImagesScheduled = NO;
+}
+
 - (void)dealloc
 {
+	[self cancelPendingImages];
+
+	// the lazy submenus may outlive us if the client kept the menu
+
+	NSEnumerator* iter = [[mTheMenu itemArray] objectEnumerator];
+	NSMenuItem* item;
+
+	while ((item = [iter nextObject])) {
+		if ([[item submenu] delegate] == self)
+			[[item submenu] setDelegate:nil];
+	}
+
 	[mTheMenu release];
+	[mPopulatedMenus release];
+	[mImageCache release];
+	[mPendingImageItems release];
 	[super dealloc];
 }
 
+#pragma mark -
+#pragma mark - lazily populated menus
+
+- (NSMenu*)createLazySubmenuWithTitle:(NSString*)title
+{
+	// an empty menu which is filled in by -menuNeedsUpdate: when it's about to be shown
+
+	NSMenu* theMenu = [[NSMenu alloc] initWithTitle:title];
+	[theMenu setDelegate:self];
+
+	return [theMenu autorelease];
+}
+
+- (void)populateLazySubmenu:(NSMenu*)menu
+{
+	NSArray* keys = nil;
+	NSString* cat = nil;
+
+	if (menu == [mRecentlyUsedMenuItemRef submenu])
+		keys = [mCatManagerRef recentlyUsedItems];
+	else if (menu == [mRecentlyAddedMenuItemRef submenu])
+		keys = [mCatManagerRef recentlyAddedItems];
+	else {
+		NSMenu* supermenu = [menu supermenu];
+		NSInteger indx = [supermenu indexOfItemWithSubmenu:menu];
+
+		if (indx == -1)
+			return;
+
+		cat = [[supermenu itemAtIndex:indx] representedObject];
+
+		if (cat != nil)
+			keys = [mCatManagerRef allSortedKeysInCategory:cat];
+	}
+
+	LogEvent_(kInfoEvent, @"populating lazy menu '%@' with %lu items", [menu title], (unsigned long)[keys count]);
+
+	[self removeItemsInMenu:menu
+					withTag:kDKCategoryManagerManagedMenuItemTag
+			 excludingItem0:NO];
+
+	NSEnumerator* iter = [keys objectEnumerator];
+	NSString* key;
+	id repObject;
+
+	while ((key = [iter nextObject])) {
+		NSMenuItem* childItem = [[NSMenuItem alloc] initWithTitle:[key capitalizedString]
+														   action:mSelector
+													keyEquivalent:@""];
+		[childItem setTarget:mTargetRef];
+		repObject = [mCatManagerRef objectForKey:key];
+		[childItem setRepresentedObject:repObject];
+
+		[self setUpItem:childItem
+			  forObject:repObject
+					key:key
+			 inCategory:cat];
+
+		[childItem setTag:kDKCategoryManagerManagedMenuItemTag];
+		[menu addItem:childItem];
+		[childItem release];
+	}
+
+	[mPopulatedMenus addObject:menu];
+}
+
+- (void)invalidateSubmenu:(NSMenu*)menu
+{
+	if (menu != nil)
+		[mPopulatedMenus removeObject:menu];
+}
+
+- (void)invalidateSubmenusForKey:(NSString*)key
+{
+	NSEnumerator* iter = [[mCatManagerRef categoriesContainingKey:key] objectEnumerator];
+	NSString* cat;
+
+	while ((cat = [iter nextObject]))
+		[self invalidateSubmenu:[[mTheMenu itemWithTitle:[cat capitalizedString]] submenu]];
+}
+
+- (void)queueImageForItem:(NSMenuItem*)item key:(NSString*)key
+{
+	NSAssert(key != nil, @"can't queue an image for a nil key");
+
+	[mPendingImageItems addObject:[NSArray arrayWithObjects:item, key, nil]];
+
+	// the event tracking mode lets the images be rendered while the menu is open
+
+	if (!mImagesScheduled) {
+		mImagesScheduled = YES;
+		[self performSelector:@selector(renderPendingImages)
+				   withObject:nil
+				   afterDelay:0
+					  inModes:[NSArray arrayWithObjects:NSDefaultRunLoopMode, NSEventTrackingRunLoopMode, nil]];
+	}
+}
+
+- (void)renderPendingImages
+{
+	// renders a few images at a time, so that the menu stays responsive however many items it has. Each object's
+	// image is cached, so it's rendered once however many menus it appears in.
+
+	NSUInteger rendered = 0;
+
+	mImagesScheduled = NO;
+
+	while ([mPendingImageItems count] > 0 && rendered < kDKCategoryMenuImagesPerPass) {
+		NSArray* pending = [[mPendingImageItems objectAtIndex:0] retain];
+		[mPendingImageItems removeObjectAtIndex:0];
+
+		NSMenuItem* item = [pending objectAtIndex:0];
+		NSString* key = [pending objectAtIndex:1];
+		id image = [mImageCache objectForKey:key];
+
+		// an item no longer in a menu has been replaced, so doesn't need its image
+
+		if (image == nil && [item menu] != nil) {
+			image = [mCallbackTargetRef menuItemImageForObject:[item representedObject]];
+
+			if (image == nil)
+				image = [NSNull null];
+
+			[mImageCache setObject:image
+							forKey:key];
+			++rendered;
+		}
+
+		if (image != nil && image != [NSNull null])
+			[item setImage:image];
+
+		[pending release];
+	}
+
+	if ([mPendingImageItems count] > 0 && !mImagesScheduled) {
+		mImagesScheduled = YES;
+		[self performSelector:@selector(renderPendingImages)
+				   withObject:nil
+				   afterDelay:0
+					  inModes:[NSArray arrayWithObjects:NSDefaultRunLoopMode, NSEventTrackingRunLoopMode, nil]];
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSMenuDelegate
+
+- (void)menuNeedsUpdate:(NSMenu*)menu
+{
+	if (![mPopulatedMenus containsObject:menu]) {
+		[self populateLazySubmenu:menu];
+		return;
+	}
+
+	// up to date, but images not rendered before the menu was last closed are still wanted
+
+	if ([mCallbackTargetRef respondsToSelector:@selector(menuItemImageForObject:)]) {
+		NSEnumerator* iter = [[menu itemArray] objectEnumerator];
+		NSMenuItem* item;
+		NSString* key;
+
+		while ((item = [iter nextObject])) {
+			if ([item tag] == kDKCategoryManagerManagedMenuItemTag && [item image] == nil) {
+				key = [[mCatManagerRef keysForObject:[item representedObject]] lastObject];
+
+				if (key != nil && [mImageCache objectForKey:key] == nil)
+					[self queueImageForItem:item
+										key:key];
+			}
+		}
+	}
+}
+
+- (void)menuDidClose:(NSMenu*)menu
+{
+	// stop rendering images for a menu that can't be seen
+
+	NSUInteger i = [mPendingImageItems count];
+
+	while (i-- > 0) {
+		if ([[[mPendingImageItems objectAtIndex:i] objectAtIndex:0] menu] == menu)
+			[mPendingImageItems removeObjectAtIndex:i];
+	}
+}
+
 #pragma mark -
 
 - (void)removeItemsInMenu:(NSMenu*)aMenu withTag:(NSInteger)tag excludingItem0:(BOOL)title
@@ -2317,8 +2998,6 @@ static id sDearchivingHelper = nil;
 	NSMutableArray* items = [[aMenu itemArray] mutableCopy];
 	NSMenuItem* item;
 
-	NSLog(@"menu items = %@", items);
-
 	// if a pop-up menu, don't remove the title item
 
 	if (title)
@@ -0,0 +1,250 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawing, DKStyleInternTable;
+
+// the current version of the chunked format. Readers refuse files with a later version. Version 2 added compressed chunks and checksums
+
+#define kDKChunkedDrawingFormatVersion 2
+
+// the number of objects archived together in each object chunk
+
+#define kDKChunkedDrawingObjectsPerChunk 1000
+
+/** @brief A keyed archiver that can leave the objects out of the layers it encodes.
+
+ A keyed archiver that can leave the objects out of the layers it encodes. DKObjectOwnerLayer asks the coder for
+ -encodesLayerObjectsSeparately, in the same way that objects ask DKKeyedUnarchiver for the image manager when decoding.
+*/
+@interface DKKeyedArchiver : NSKeyedArchiver {
+@private
+	BOOL mEncodesLayerObjectsSeparately;
+}
+
+- (void)setEncodesLayerObjectsSeparately:(BOOL)separately;
+- (BOOL)encodesLayerObjectsSeparately;
+
+@end
+
+#pragma mark -
+
+/** @brief Writes a drawing as a series of independent chunks, in a versioned binary container.
+
+ Writes a drawing as a series of independent chunks, in a versioned binary container. The drawing and its layers are archived in one chunk
+ without their objects, and the objects of each layer follow in chunks of kDKChunkedDrawingObjectsPerChunk. Each chunk is a keyed archive of
+ its own, so only one chunk's archive is in memory at a time, and each is written to the stream as soon as it's done.
+
+ Styles are stored once, in a chunk of shared objects written after the others, and each image's data as it is in a chunk of its own. Where
+ they are used, the archives hold a reference to them instead. The drawing's thumbnail is stored last, as JPEG data, so it can be read without
+ decoding anything. A table of contents gives the type, position and length of every chunk, and a trailer at the
+ end of the file gives the position of the table, so the reader can go straight to any chunk.
+
+ The layout is a 16 byte header ("DKCF", the version and 8 reserved bytes), then the chunks, each of which is a four character type and an
+ 8 byte length followed by that many bytes, then the table of contents as a chunk of type "TOC ", and finally the 16 byte trailer (the
+ position of the table, "DKCF" and the version). Numbers are big-endian.
+
+ Because only the last table of contents counts, a file can be brought up to date by appending the chunks that have changed followed by a
+ new table and trailer. A writer that tracks changes remembers what it wrote, and -appendChangesToDrawing:toStream: then writes only the
+ drawing chunk, the styles, any new image data and the object chunks containing objects that have changed since. The chunks that are no
+ longer listed are dead space until the file is compacted, which copies the live chunks to a new file.
+
+ The drawing, object and style chunks are compressed - with LZFSE where the system has it, otherwise zlib - and every chunk has a CRC-32 of
+ its bytes as stored, which the table of contents records with the method and the length before compression. The chunks are archived one
+ at a time on the calling thread, but compressed and checksummed on all the cores while the next ones are archived, and written in order
+ as they are finished, so writing a large drawing is limited by the archiving or the disk rather than by compression. Image data and the
+ thumbnail are already compressed, so they are stored as they are.
+*/
+@interface DKChunkedDrawingWriter : NSObject {
+@private
+	NSOutputStream* mStream;
+	unsigned long long mOffset; // bytes written so far, or the position in the file when appending
+	NSMutableArray* mContents; // table of contents entries
+	NSMutableArray* mSharedObjects; // styles, in the order they were first used
+	CFMutableDictionaryRef mSharedIndex; // style -> index in mSharedObjects
+	CFMutableSetRef mImageData; // the image manager's data objects
+	CFMutableDictionaryRef mImageIndex; // image data -> its index
+	NSMutableArray* mNewImages; // image data not yet written
+	NSMutableArray* mImageChunks; // table of contents entries of the image data chunks already written
+	NSMutableArray* mLayerRecords; // for each layer written, the layer, its objects and its chunks
+	NSMutableArray* mPendingChunks; // chunks being compressed, in the order they are to be written
+	BOOL mTracksChanges;
+	BOOL mCompressesChunks;
+	BOOL mEncodingSharedObjects;
+	BOOL mHasWritten;
+	BOOL mFailed;
+}
+
+/** @brief Writes a drawing to a stream in the chunked format
+ @param drawing the drawing
+ @param stream an output stream, which is opened if necessary, but not closed
+ @return YES if the drawing was written, NO if there was an error
+ */
++ (BOOL)writeDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream;
+
+/** @brief Copies only the chunks listed by the latest table of contents to a new file
+
+ Only the file is read, not the drawing, so this is safe to do on any thread.
+ @param path the path of a chunked drawing file
+ @param newPath the path to write the compacted file to
+ @param offsets if not NULL, receives a dictionary mapping each chunk's old position to its new one
+ @return YES if the file was compacted
+ */
++ (BOOL)compactFileAtPath:(NSString*)path toPath:(NSString*)newPath chunkOffsets:(NSDictionary**)offsets;
+
+/** @brief Sets whether the writer tracks changes to the drawing between writes
+
+ When YES, writing resets the change tracking of each layer that is written, so the writer should be the only one doing so for a given
+ drawing. This is required for appending changes. The default is NO.
+ @param tracks YES to track changes
+ */
+- (void)setTracksChanges:(BOOL)tracks;
+- (BOOL)tracksChanges;
+
+/** @brief Sets whether the drawing, object and style chunks are compressed
+
+ The default is YES. Chunks are checksummed either way.
+ @param compresses YES to compress chunks
+ */
+- (void)setCompressesChunks:(BOOL)compresses;
+- (BOOL)compressesChunks;
+
+/** @brief Writes the whole drawing
+ @param drawing the drawing
+ @param stream an output stream, which is opened if necessary, but not closed
+ @return YES if the drawing was written, NO if there was an error
+ */
+- (BOOL)writeDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream;
+
+/** @brief Appends the changes to the drawing since it was last written by this writer
+
+ The stream must append to the file last written, which must not have been changed since. If the writer can't append, for example because
+ it doesn't track changes or hasn't written the drawing yet, this returns NO without writing anything.
+ @param drawing the drawing, which must be the one last written
+ @param stream an output stream that appends to the file
+ @return YES if the changes were written, NO if there was an error
+ */
+- (BOOL)appendChangesToDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream;
+- (BOOL)canAppendChanges;
+
+/** @brief The length of the file as last written
+ */
+- (unsigned long long)fileLength;
+
+/** @brief The number of bytes in the file taken by the chunks listed in the latest table of contents, plus the header and trailer
+ */
+- (unsigned long long)liveLength;
+
+/** @brief Updates the positions of the chunks written after the file was compacted
+ @param offsets the dictionary returned by +compactFileAtPath:toPath:chunkOffsets:
+ @param length the length of the compacted file
+ */
+- (void)fileWasCompactedWithChunkOffsets:(NSDictionary*)offsets length:(unsigned long long)length;
+
+@end
+
+#pragma mark -
+
+/** @brief Reads a drawing written by DKChunkedDrawingWriter.
+
+ Reads a drawing written by DKChunkedDrawingWriter. The image data and styles are decoded first, then the drawing and its layers, and then the
+ object chunks one at a time, each in its own autorelease pool, so memory use stays close to that of the finished drawing. The data is best
+ memory-mapped from the file, since chunks are decoded in place without being copied. Images at least as large as the image manager's mapping
+ threshold are given mapped storage of their own rather than being read into memory.
+
+ Each chunk's checksum is checked before it's used, and a damaged chunk is left out - its objects are lost, but the rest of the drawing
+ can still be read. Compressed chunks are checked and decompressed on all the cores, a few chunks ahead of the one being decoded. Mapped
+ images aren't checked, since that would mean reading them.
+
+ The dearchiving helper (by default the drawing's) is used for every chunk, so class translation, progress notifications and cancellation
+ work as they do for keyed archives.
+
+ By default the objects of hidden layers aren't decoded when the drawing is read. Instead each such layer is given a loader which decodes
+ its chunks the first time the layer's objects are needed, so a drawing opens as quickly as its visible layers can be read. The loaders
+ keep the reader, and so the data, until every hidden layer has been loaded or released.
+*/
+@interface DKChunkedDrawingReader : NSObject {
+@private
+	NSData* mData;
+	NSArray* mContents;
+	NSArray* mSharedObjects;
+	NSArray* mSharedImageData;
+	id mHelper; // the helper while a chunk is being decoded
+	id mDearchivingHelper;
+	DKStyleInternTable* mStyleInternTable;
+	NSUInteger mVersion;
+	BOOL mLoadsHiddenLayersLazily;
+}
+
+/** @brief Whether some data is a drawing in the chunked format
+ @param data the data
+ @return YES if it begins with the chunked format's header
+ */
++ (BOOL)canReadData:(NSData*)data;
++ (DKDrawing*)drawingWithData:(NSData*)data;
+
+/** @brief Returns the thumbnail stored in a chunked drawing, without reading the drawing
+
+ Only the table of contents and the thumbnail are read, so this is quick enough for QuickLook.
+ @param data the data
+ @return JPEG data, or nil if there is no thumbnail
+ */
++ (NSData*)thumbnailDataWithData:(NSData*)data;
+
+/** @brief Initializes the reader, checking the header, trailer and table of contents
+
+ If the trailer is damaged, which happens if appending changes to the file was interrupted, the last complete table of contents before
+ it is used instead.
+
+ @param data the data
+ @return the reader, or nil if the data isn't a valid chunked drawing of a version that can be read
+ */
+- (id)initWithData:(NSData*)data;
+
+- (NSUInteger)formatVersion;
+- (NSArray*)tableOfContents;
+
+/** @brief Sets whether the objects of hidden layers are loaded when first needed rather than when the drawing is read
+
+ The default is YES.
+ @param lazy YES to load hidden layers lazily, NO to load everything in -readDrawing
+ */
+- (void)setLoadsHiddenLayersLazily:(BOOL)lazy;
+- (BOOL)loadsHiddenLayersLazily;
+
+/** @brief Sets the delegate of the unarchiver used for each chunk
+ @param helper the helper, or nil to use the drawing's default dearchiving helper
+ */
+- (void)setDearchivingHelper:(id)helper;
+- (id)dearchivingHelper;
+
+/** @brief Sets the table that identical unshared styles are interned in as they are decoded
+ @param table the table, or nil not to intern styles
+ */
+- (void)setStyleInternTable:(DKStyleInternTable*)table;
+- (DKStyleInternTable*)styleInternTable;
+
+- (DKDrawing*)readDrawing;
+
+/** @brief The thumbnail stored with the drawing
+ @return JPEG data, or nil if there is no thumbnail
+ */
+- (NSData*)thumbnailData;
+
+@end
+
+// keys in the table of contents entries
+
+extern NSString* kDKChunkedDrawingChunkTypeKey; /**< data type NSString */
+extern NSString* kDKChunkedDrawingChunkOffsetKey; /**< data type NSNumber */
+extern NSString* kDKChunkedDrawingChunkLengthKey; /**< data type NSNumber */
+extern NSString* kDKChunkedDrawingChunkLayerKey; /**< data type NSNumber, object chunks only */
+extern NSString* kDKChunkedDrawingChunkObjectCountKey; /**< data type NSNumber, object chunks only */
+extern NSString* kDKChunkedDrawingChunkBaseIndexKey; /**< data type NSNumber, image data chunks only */
+extern NSString* kDKChunkedDrawingChunkCompressionKey; /**< data type NSString, "lzfse" or "zlib", compressed chunks only */
+extern NSString* kDKChunkedDrawingChunkRawLengthKey; /**< data type NSNumber, the length before compression, compressed chunks only */
+extern NSString* kDKChunkedDrawingChunkChecksumKey; /**< data type NSNumber, the CRC-32 of the chunk as stored, version 2 and later */
@@ -0,0 +1,1503 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKChunkedDrawingArchive.h"
+#import "DKDrawing.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKStyle.h"
+#import "DKImageDataManager.h"
+#import "DKKeyedUnarchiver.h"
+#import "DKDrawing+Export.h"
+#import "DKDrawingThumbnail.h"
+#import "LogEvent.h"
+#include <compression.h>
+#include <zlib.h>
+
+NSString* kDKChunkedDrawingChunkTypeKey = @"type";
+NSString* kDKChunkedDrawingChunkOffsetKey = @"offset";
+NSString* kDKChunkedDrawingChunkLengthKey = @"length";
+NSString* kDKChunkedDrawingChunkLayerKey = @"layer";
+NSString* kDKChunkedDrawingChunkObjectCountKey = @"count";
+NSString* kDKChunkedDrawingChunkBaseIndexKey = @"base";
+NSString* kDKChunkedDrawingChunkCompressionKey = @"compression";
+NSString* kDKChunkedDrawingChunkRawLengthKey = @"rawLength";
+NSString* kDKChunkedDrawingChunkChecksumKey = @"crc32";
+
+// chunk types
+
+static NSString* kDKChunkTypeDrawing = @"DRWG";
+static NSString* kDKChunkTypeObjects = @"OBJS";
+static NSString* kDKChunkTypeShared = @"SHRD";
+static NSString* kDKChunkTypeImageData = @"IMGD";
+static NSString* kDKChunkTypeThumbnail = @"THMB";
+static NSString* kDKChunkTypeContents = @"TOC ";
+
+// compression methods
+
+static NSString* kDKChunkCompressionLZFSE = @"lzfse";
+static NSString* kDKChunkCompressionZlib = @"zlib";
+
+static const char kDKChunkedDrawingMagic[4] = { 'D', 'K', 'C', 'F' };
+
+#define kDKChunkedDrawingHeaderLength 16
+#define kDKChunkedDrawingTrailerLength 16
+#define kDKChunkHeaderLength 12
+#define kDKChunkMinimumCompressedLength 256 // shorter chunks are stored as they are
+#define kDKChunkChecksumBlockLength 0x40000000 // zlib's crc32 takes a 32 bit length, so longer data is summed in blocks of this
+
+static uint32_t readUInt32(const uint8_t* bytes)
+{
+	uint32_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return NSSwapBigIntToHost(value);
+}
+
+static uint64_t readUInt64(const uint8_t* bytes)
+{
+	uint64_t value;
+	memcpy(&value, bytes, sizeof(value));
+	return NSSwapBigLongLongToHost(value);
+}
+
+// returns the table of contents located by a trailer ending at <end>, or nil if there isn't a valid one there
+
+static NSArray* contentsForTrailer(const uint8_t* bytes, NSUInteger end)
+{
+	if (end < kDKChunkedDrawingHeaderLength + kDKChunkHeaderLength + kDKChunkedDrawingTrailerLength)
+		return nil;
+
+	const uint8_t* trailer = bytes + end - kDKChunkedDrawingTrailerLength;
+
+	if (memcmp(trailer + 8, kDKChunkedDrawingMagic, 4) != 0)
+		return nil;
+
+	uint64_t contentsOffset = readUInt64(trailer);
+
+	if (contentsOffset < kDKChunkedDrawingHeaderLength || contentsOffset + kDKChunkHeaderLength > end - kDKChunkedDrawingTrailerLength || memcmp(bytes + contentsOffset, "TOC ", 4) != 0)
+		return nil;
+
+	uint64_t contentsLength = readUInt64(bytes + contentsOffset + 4);
+
+	if (contentsLength != end - kDKChunkedDrawingTrailerLength - kDKChunkHeaderLength - contentsOffset)
+		return nil;
+
+	NSData* data = [NSData dataWithBytesNoCopy:(void*)(bytes + contentsOffset + kDKChunkHeaderLength)
+										length:(NSUInteger)contentsLength
+								  freeWhenDone:NO];
+	NSArray* contents = [NSPropertyListSerialization propertyListWithData:data
+																  options:NSPropertyListImmutable
+																   format:NULL
+																	error:NULL];
+	if (![contents isKindOfClass:[NSArray class]])
+		return nil;
+
+	// every chunk must lie within the data before the table
+
+	NSEnumerator* iter = [contents objectEnumerator];
+	NSDictionary* entry;
+
+	while ((entry = [iter nextObject])) {
+		if (![entry isKindOfClass:[NSDictionary class]])
+			return nil;
+
+		unsigned long long offset = [[entry objectForKey:kDKChunkedDrawingChunkOffsetKey] unsignedLongLongValue];
+		unsigned long long chunkLength = [[entry objectForKey:kDKChunkedDrawingChunkLengthKey] unsignedLongLongValue];
+
+		if (offset < kDKChunkedDrawingHeaderLength + kDKChunkHeaderLength || offset > contentsOffset || chunkLength > contentsOffset - offset)
+			return nil;
+	}
+
+	return contents;
+}
+
+static uint32_t chunkChecksum(const uint8_t* bytes, NSUInteger length)
+{
+	uLong crc = crc32(0L, Z_NULL, 0);
+
+	while (length > 0) {
+		NSUInteger block = MIN(length, (NSUInteger)kDKChunkChecksumBlockLength);
+
+		crc = crc32(crc, bytes, (uInt)block);
+		bytes += block;
+		length -= block;
+	}
+
+	return (uint32_t)crc;
+}
+
+// returns the data compressed, or nil if it doesn't get at least a little smaller, in which case it is stored as it is. libcompression is
+// weakly linked, since it's only in OS X 10.11 and later - until then zlib is used
+
+static NSData* createCompressedData(NSData* data, NSString** method)
+{
+	size_t length = [data length];
+
+	if (length < kDKChunkMinimumCompressedLength)
+		return nil;
+
+	uint8_t* buffer = malloc(length);
+	size_t compressedLength = 0;
+
+	if (compression_encode_buffer != NULL) {
+		compressedLength = compression_encode_buffer(buffer, length, [data bytes], length, NULL, COMPRESSION_LZFSE);
+		*method = kDKChunkCompressionLZFSE;
+	} else {
+		uLongf destLength = length;
+
+		if (compress2(buffer, &destLength, [data bytes], length, Z_BEST_SPEED) == Z_OK)
+			compressedLength = destLength;
+
+		*method = kDKChunkCompressionZlib;
+	}
+
+	if (compressedLength == 0 || compressedLength > length - length / 16) {
+		free(buffer);
+		return nil;
+	}
+
+	return [[NSData alloc] initWithBytesNoCopy:realloc(buffer, compressedLength)
+										length:compressedLength
+								  freeWhenDone:YES];
+}
+
+static NSData* createDecompressedData(const uint8_t* bytes, NSUInteger length, NSString* method, NSUInteger rawLength)
+{
+	uint8_t* buffer = malloc(MAX(rawLength, (NSUInteger)1));
+	size_t decodedLength = 0;
+
+	if ([method isEqualToString:kDKChunkCompressionLZFSE]) {
+		if (compression_decode_buffer != NULL)
+			decodedLength = compression_decode_buffer(buffer, rawLength, bytes, length, NULL, COMPRESSION_LZFSE);
+		else
+			NSLog(@"chunked drawing was compressed with LZFSE, which needs OS X 10.11 or later");
+	} else if ([method isEqualToString:kDKChunkCompressionZlib]) {
+		uLongf destLength = rawLength;
+
+		if (uncompress(buffer, &destLength, bytes, length) == Z_OK)
+			decodedLength = destLength;
+	} else
+		NSLog(@"chunked drawing uses unknown compression '%@'", method);
+
+	if (decodedLength != rawLength) {
+		free(buffer);
+		return nil;
+	}
+
+	return [[NSData alloc] initWithBytesNoCopy:buffer
+										length:rawLength
+								  freeWhenDone:YES];
+}
+
+// returns a chunk's data from the file, checked against its checksum and decompressed, or nil if it's damaged. The data of an uncompressed
+// chunk refers to the file's bytes without copying them. Safe to call on any thread.
+
+static NSData* createChunkData(NSData* fileData, NSDictionary* entry)
+{
+	NSUInteger offset = (NSUInteger)[[entry objectForKey:kDKChunkedDrawingChunkOffsetKey] unsignedLongLongValue];
+	NSUInteger length = (NSUInteger)[[entry objectForKey:kDKChunkedDrawingChunkLengthKey] unsignedLongLongValue];
+	const uint8_t* bytes = (const uint8_t*)[fileData bytes] + offset;
+	NSNumber* checksum = [entry objectForKey:kDKChunkedDrawingChunkChecksumKey];
+	NSString* method = [entry objectForKey:kDKChunkedDrawingChunkCompressionKey];
+
+	if (checksum && chunkChecksum(bytes, length) != [checksum unsignedIntValue]) {
+		NSLog(@"chunked drawing's %@ chunk at %lu is damaged - ignored", [entry objectForKey:kDKChunkedDrawingChunkTypeKey], (unsigned long)offset);
+		return nil;
+	}
+
+	if (method == nil)
+		return [[NSData alloc] initWithBytesNoCopy:(void*)bytes
+											length:length
+									  freeWhenDone:NO];
+
+	NSData* data = createDecompressedData(bytes, length, method, (NSUInteger)[[entry objectForKey:kDKChunkedDrawingChunkRawLengthKey] unsignedLongLongValue]);
+
+	if (data == nil)
+		NSLog(@"chunked drawing's %@ chunk at %lu can't be decompressed - ignored", [entry objectForKey:kDKChunkedDrawingChunkTypeKey], (unsigned long)offset);
+
+	return data;
+}
+
+#pragma mark -
+
+// a chunk waiting to be written. It is compressed and checksummed on another thread while the writer archives the next ones
+
+@interface DKChunkedPendingChunk : NSObject {
+@public
+	NSString* mType;
+	NSData* mData; // the chunk as archived
+	NSData* mStoredData; // the chunk as it is to be written, set when finished
+	NSMutableDictionary* mEntry; // the table of contents entry, which is given its position when the chunk is written
+	BOOL mCompresses;
+	dispatch_semaphore_t mFinished;
+}
+
+@end
+
+@implementation DKChunkedPendingChunk
+
+- (void)dealloc
+{
+	[mType release];
+	[mData release];
+	[mStoredData release];
+	[mEntry release];
+
+	if (mFinished)
+		dispatch_release(mFinished);
+
+	[super dealloc];
+}
+
+@end
+
+static void prepareChunkJob(void* context)
+{
+	DKChunkedPendingChunk* chunk = (DKChunkedPendingChunk*)context;
+
+	@autoreleasepool {
+		NSString* method = nil;
+		NSData* compressed = chunk->mCompresses ? createCompressedData(chunk->mData, &method) : nil;
+
+		if (compressed) {
+			[chunk->mEntry setObject:method
+							  forKey:kDKChunkedDrawingChunkCompressionKey];
+			[chunk->mEntry setObject:[NSNumber numberWithUnsignedLongLong:[chunk->mData length]]
+							  forKey:kDKChunkedDrawingChunkRawLengthKey];
+			chunk->mStoredData = compressed;
+		} else
+			chunk->mStoredData = [chunk->mData retain];
+
+		[chunk->mEntry setObject:[NSNumber numberWithUnsignedInt:chunkChecksum([chunk->mStoredData bytes], [chunk->mStoredData length])]
+						  forKey:kDKChunkedDrawingChunkChecksumKey];
+	}
+
+	dispatch_semaphore_signal(chunk->mFinished);
+	[chunk release];
+}
+
+#pragma mark -
+
+// stands in for a style or image data in a chunk's archive. When decoded by a DKKeyedUnarchiver that has the shared objects, it's replaced by
+// the object it refers to
+
+@interface DKChunkedArchiveReference : NSObject <NSCoding> {
+@private
+	NSUInteger mIndex;
+	BOOL mIsImageData;
+}
+
+- (id)initWithIndex:(NSUInteger)indx imageData:(BOOL)isImageData;
+
+@end
+
+@implementation DKChunkedArchiveReference
+
+- (id)initWithIndex:(NSUInteger)indx imageData:(BOOL)isImageData
+{
+	self = [super init];
+	if (self) {
+		mIndex = indx;
+		mIsImageData = isImageData;
+	}
+
+	return self;
+}
+
+- (void)encodeWithCoder:(NSCoder*)coder
+{
+	[coder encodeInteger:mIndex
+				  forKey:@"index"];
+	[coder encodeBool:mIsImageData
+			   forKey:@"image"];
+}
+
+- (id)initWithCoder:(NSCoder*)coder
+{
+	NSUInteger indx = [coder decodeIntegerForKey:@"index"];
+	BOOL isImageData = [coder decodeBoolForKey:@"image"];
+	NSArray* shared = nil;
+
+	if ([coder respondsToSelector:@selector(sharedObjects)])
+		shared = isImageData ? [(DKKeyedUnarchiver*)coder sharedImageData] : [(DKKeyedUnarchiver*)coder sharedObjects];
+
+	id object = nil;
+
+	if (indx < [shared count])
+		object = [[shared objectAtIndex:indx] retain];
+	else
+		NSLog(@"chunked drawing refers to missing shared object %lu", (unsigned long)indx);
+
+	[self release];
+	return object;
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKKeyedArchiver
+
+- (void)setEncodesLayerObjectsSeparately:(BOOL)separately
+{
+	mEncodesLayerObjectsSeparately = separately;
+}
+
+- (BOOL)encodesLayerObjectsSeparately
+{
+	return mEncodesLayerObjectsSeparately;
+}
+
+@end
+
+#pragma mark -
+
+@interface DKChunkedDrawingWriter (Private)
+
+- (BOOL)writeDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream appending:(BOOL)append;
+- (NSArray*)chunksForLayer:(DKObjectOwnerLayer*)layer index:(NSUInteger)layerIndex reusing:(NSDictionary*)record;
+- (void)writeBytes:(const void*)bytes length:(NSUInteger)length;
+- (void)writeUInt32:(uint32_t)value;
+- (void)writeUInt64:(uint64_t)value;
+- (NSMutableDictionary*)writeChunkOfType:(NSString*)type data:(NSData*)data info:(NSDictionary*)info;
+- (void)writeChunkOfType:(NSString*)type data:(NSData*)data entry:(NSMutableDictionary*)entry;
+- (NSMutableDictionary*)queueChunkOfType:(NSString*)type data:(NSData*)data info:(NSDictionary*)info compressible:(BOOL)compressible;
+- (void)writePendingChunksLeaving:(NSUInteger)count;
+- (NSData*)archiveRootObject:(id)object separatingLayerObjects:(BOOL)separate sharingObjects:(BOOL)share;
+
+@end
+
+@implementation DKChunkedDrawingWriter
+
++ (BOOL)writeDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream
+{
+	DKChunkedDrawingWriter* writer = [[self alloc] init];
+	BOOL result = [writer writeDrawing:drawing
+							  toStream:stream];
+
+	[writer release];
+	return result;
+}
+
++ (BOOL)compactFileAtPath:(NSString*)path toPath:(NSString*)newPath chunkOffsets:(NSDictionary**)offsets
+{
+	NSAssert(path != nil && newPath != nil, @"can't compact without both paths");
+
+	NSData* data = [NSData dataWithContentsOfFile:path
+										  options:NSDataReadingMappedIfSafe
+											error:NULL];
+	DKChunkedDrawingReader* reader = [[DKChunkedDrawingReader alloc] initWithData:data];
+
+	if (reader == nil)
+		return NO;
+
+	// each live chunk is copied whole, header included, in the order it appears in the file
+
+	NSSortDescriptor* byOffset = [NSSortDescriptor sortDescriptorWithKey:kDKChunkedDrawingChunkOffsetKey
+															   ascending:YES];
+	NSArray* chunks = [[reader tableOfContents] sortedArrayUsingDescriptors:[NSArray arrayWithObject:byOffset]];
+	NSMutableArray* contents = [NSMutableArray arrayWithCapacity:[chunks count]];
+	NSMutableDictionary* newOffsets = [NSMutableDictionary dictionaryWithCapacity:[chunks count]];
+	NSOutputStream* stream = [NSOutputStream outputStreamToFileAtPath:newPath
+															   append:NO];
+	const uint8_t* bytes = [data bytes];
+
+	DKChunkedDrawingWriter* writer = [[self alloc] init];
+	writer->mStream = [stream retain];
+	[stream open];
+
+	[writer writeBytes:bytes
+				length:kDKChunkedDrawingHeaderLength];
+
+	NSEnumerator* iter = [chunks objectEnumerator];
+	NSDictionary* entry;
+
+	while ((entry = [iter nextObject])) {
+		NSNumber* oldOffset = [entry objectForKey:kDKChunkedDrawingChunkOffsetKey];
+		NSUInteger chunkLength = (NSUInteger)[[entry objectForKey:kDKChunkedDrawingChunkLengthKey] unsignedLongLongValue];
+		NSNumber* newOffset = [NSNumber numberWithUnsignedLongLong:writer->mOffset + kDKChunkHeaderLength];
+
+		[writer writeBytes:bytes + [oldOffset unsignedLongLongValue] - kDKChunkHeaderLength
+					length:chunkLength + kDKChunkHeaderLength];
+
+		NSMutableDictionary* newEntry = [[entry mutableCopy] autorelease];
+		[newEntry setObject:newOffset
+					 forKey:kDKChunkedDrawingChunkOffsetKey];
+		[contents addObject:newEntry];
+		[newOffsets setObject:newOffset
+					   forKey:oldOffset];
+	}
+
+	unsigned long long contentsOffset = writer->mOffset;
+	NSData* toc = [NSPropertyListSerialization dataWithPropertyList:contents
+															 format:NSPropertyListBinaryFormat_v1_0
+															options:0
+															  error:NULL];
+	[writer writeChunkOfType:kDKChunkTypeContents
+						data:toc
+						info:nil];
+	[writer writeUInt64:contentsOffset];
+	[writer writeBytes:kDKChunkedDrawingMagic
+				length:4];
+	[writer writeUInt32:(uint32_t)[reader formatVersion]];
+
+	BOOL result = !writer->mFailed && toc != nil;
+
+	LogEvent_(kFileEvent, @"compacted chunked drawing from %lu to %llu bytes", (unsigned long)[data length], writer->mOffset);
+
+	[stream close];
+	[writer release];
+	[reader release];
+
+	if (result && offsets)
+		*offsets = newOffsets;
+
+	return result;
+}
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		mContents = [[NSMutableArray alloc] init];
+		mSharedObjects = [[NSMutableArray alloc] init];
+		mSharedIndex = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+		mImageData = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+		mImageIndex = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, NULL);
+		mNewImages = [[NSMutableArray alloc] init];
+		mImageChunks = [[NSMutableArray alloc] init];
+		mLayerRecords = [[NSMutableArray alloc] init];
+		mPendingChunks = [[NSMutableArray alloc] init];
+		mCompressesChunks = YES;
+	}
+
+	return self;
+}
+
+- (void)setTracksChanges:(BOOL)tracks
+{
+	mTracksChanges = tracks;
+}
+
+- (BOOL)tracksChanges
+{
+	return mTracksChanges;
+}
+
+- (void)setCompressesChunks:(BOOL)compresses
+{
+	mCompressesChunks = compresses;
+}
+
+- (BOOL)compressesChunks
+{
+	return mCompressesChunks;
+}
+
+- (BOOL)writeDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream
+{
+	// a full write starts afresh
+
+	mOffset = 0;
+	[mSharedObjects removeAllObjects];
+	CFDictionaryRemoveAllValues(mSharedIndex);
+	CFDictionaryRemoveAllValues(mImageIndex);
+	[mImageChunks removeAllObjects];
+	[mLayerRecords removeAllObjects];
+
+	mHasWritten = [self writeDrawing:drawing
+							toStream:stream
+						   appending:NO];
+	return mHasWritten;
+}
+
+- (BOOL)appendChangesToDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream
+{
+	if (![self canAppendChanges])
+		return NO;
+
+	unsigned long long length = mOffset;
+	BOOL result = [self writeDrawing:drawing
+							toStream:stream
+						   appending:YES];
+
+	// if the append failed the file's state isn't known, so the next write has to be a full one
+
+	if (!result) {
+		mOffset = length;
+		mHasWritten = NO;
+	}
+
+	return result;
+}
+
+- (BOOL)canAppendChanges
+{
+	return mTracksChanges && mHasWritten;
+}
+
+- (unsigned long long)fileLength
+{
+	return mOffset;
+}
+
+- (unsigned long long)liveLength
+{
+	unsigned long long live = kDKChunkedDrawingHeaderLength + kDKChunkedDrawingTrailerLength;
+	NSEnumerator* iter = [mContents objectEnumerator];
+	NSDictionary* entry;
+
+	while ((entry = [iter nextObject]))
+		live += [[entry objectForKey:kDKChunkedDrawingChunkLengthKey] unsignedLongLongValue] + kDKChunkHeaderLength;
+
+	return live;
+}
+
+- (void)fileWasCompactedWithChunkOffsets:(NSDictionary*)offsets length:(unsigned long long)length
+{
+	// every entry the writer may reuse is one of those in the last table of contents, so all of them are moved
+
+	NSEnumerator* iter = [mContents objectEnumerator];
+	NSMutableDictionary* entry;
+
+	while ((entry = [iter nextObject])) {
+		NSNumber* newOffset = [offsets objectForKey:[entry objectForKey:kDKChunkedDrawingChunkOffsetKey]];
+
+		if (newOffset)
+			[entry setObject:newOffset
+					  forKey:kDKChunkedDrawingChunkOffsetKey];
+		else
+			mHasWritten = NO;
+	}
+
+	mOffset = length;
+}
+
+#pragma mark -
+
+- (BOOL)writeDrawing:(DKDrawing*)drawing toStream:(NSOutputStream*)stream appending:(BOOL)append
+{
+	NSAssert(drawing != nil, @"can't write a nil drawing");
+	NSAssert(stream != nil, @"can't write a chunked drawing to a nil stream");
+
+	[stream retain];
+	[mStream release];
+	mStream = stream;
+	mFailed = NO;
+
+	if ([mStream streamStatus] == NSStreamStatusNotOpen)
+		[mStream open];
+
+	[drawing finalizePriorToSaving];
+
+	// image data is found by identity, since the image shapes archive the same data objects that the image manager holds
+
+	DKImageDataManager* imageManager = [drawing imageManager];
+	NSEnumerator* iter = [[imageManager allKeys] objectEnumerator];
+	NSString* key;
+
+	CFSetRemoveAllValues(mImageData);
+	[mNewImages removeAllObjects];
+
+	while ((key = [iter nextObject])) {
+		NSData* data = [imageManager imageDataForKey:key];
+
+		if (data)
+			CFSetAddValue(mImageData, data);
+	}
+
+	if (!append) {
+		[self writeBytes:kDKChunkedDrawingMagic
+				  length:4];
+		[self writeUInt32:kDKChunkedDrawingFormatVersion];
+		[self writeUInt64:0];
+	}
+
+	NSMutableArray* contents = [NSMutableArray array];
+
+	// the drawing and its layers, without their objects
+
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+	[contents addObject:[self queueChunkOfType:kDKChunkTypeDrawing
+										  data:[self archiveRootObject:drawing
+												separatingLayerObjects:YES
+														sharingObjects:YES]
+										  info:nil
+								  compressible:YES]];
+	[pool drain];
+
+	// the objects of each layer. When appending, layers whose objects haven't changed keep the chunks already in the file
+
+	NSArray* layers = [drawing flattenedLayersOfClass:[DKObjectOwnerLayer class]];
+	NSMutableArray* records = [NSMutableArray arrayWithCapacity:[layers count]];
+	NSUInteger layerIndex;
+
+	for (layerIndex = 0; layerIndex < [layers count] && !mFailed; ++layerIndex) {
+		DKObjectOwnerLayer* layer = [layers objectAtIndex:layerIndex];
+		NSDictionary* oldRecord = nil;
+
+		if (append) {
+			NSEnumerator* recordIter = [mLayerRecords objectEnumerator];
+			NSDictionary* record;
+
+			while ((record = [recordIter nextObject])) {
+				if ([record objectForKey:@"layer"] == layer) {
+					oldRecord = record;
+					break;
+				}
+			}
+		}
+
+		NSArray* chunks = [self chunksForLayer:layer
+										 index:layerIndex
+									   reusing:oldRecord];
+		[contents addObjectsFromArray:chunks];
+
+		if (mTracksChanges) {
+			[records addObject:[NSDictionary dictionaryWithObjectsAndKeys:layer, @"layer", [layer objects], @"objects", chunks, @"chunks", nil]];
+			[layer resetObjectChanges];
+		}
+	}
+
+	// the styles used by all of the above, then any image data that hasn't been written before
+
+	pool = [[NSAutoreleasePool alloc] init];
+
+	mEncodingSharedObjects = YES;
+	[contents addObject:[self queueChunkOfType:kDKChunkTypeShared
+										  data:[self archiveRootObject:[[mSharedObjects copy] autorelease]
+												separatingLayerObjects:NO
+														sharingObjects:YES]
+										  info:nil
+								  compressible:YES]];
+	mEncodingSharedObjects = NO;
+
+	// each image is written as it is, in a chunk of its own, so the reader can map it straight from the file
+
+	NSUInteger imageIndex = CFDictionaryGetCount(mImageIndex) - [mNewImages count];
+	NSEnumerator* imageIter = [mNewImages objectEnumerator];
+	NSData* image;
+
+	while ((image = [imageIter nextObject])) {
+		NSDictionary* info = [NSDictionary dictionaryWithObject:[NSNumber numberWithUnsignedInteger:imageIndex++]
+														 forKey:kDKChunkedDrawingChunkBaseIndexKey];
+
+		[mImageChunks addObject:[self queueChunkOfType:kDKChunkTypeImageData
+												  data:image
+												  info:info
+										  compressible:NO]];
+	}
+
+	[mNewImages removeAllObjects];
+
+	[contents addObjectsFromArray:mImageChunks];
+	[pool drain];
+
+	// the thumbnail, which only renders what has changed since it was last written
+
+	NSData* thumbnail = [drawing thumbnailData];
+
+	if (thumbnail)
+		[contents addObject:[self queueChunkOfType:kDKChunkTypeThumbnail
+											  data:thumbnail
+											  info:nil
+									  compressible:NO]];
+
+	// every chunk must be in the file, and its entry complete, before the table of contents is made
+
+	[self writePendingChunksLeaving:0];
+
+	// the table of contents and the trailer that locates it
+
+	unsigned long long contentsOffset = mOffset;
+	NSError* error = nil;
+	NSData* toc = [NSPropertyListSerialization dataWithPropertyList:contents
+															 format:NSPropertyListBinaryFormat_v1_0
+															options:0
+															  error:&error];
+	if (toc == nil) {
+		NSLog(@"unable to write chunked drawing contents: %@", error);
+		return NO;
+	}
+
+	[self writeChunkOfType:kDKChunkTypeContents
+					  data:toc
+					  info:nil];
+	[self writeUInt64:contentsOffset];
+	[self writeBytes:kDKChunkedDrawingMagic
+			  length:4];
+	[self writeUInt32:kDKChunkedDrawingFormatVersion];
+
+	[mContents setArray:contents];
+	[mLayerRecords setArray:records];
+
+	LogEvent_(kFileEvent, @"%@ chunked drawing, %lu chunks, %lu styles, %llu bytes", append ? @"appended to" : @"wrote", (unsigned long)[contents count], (unsigned long)[mSharedObjects count], mOffset);
+
+	return !mFailed;
+}
+
+- (NSArray*)chunksForLayer:(DKObjectOwnerLayer*)layer index:(NSUInteger)layerIndex reusing:(NSDictionary*)record
+{
+	NSArray* objects = [layer objects];
+	NSArray* oldObjects = [record objectForKey:@"objects"];
+	NSArray* oldChunks = [record objectForKey:@"chunks"];
+	NSMutableArray* chunks = [NSMutableArray array];
+	NSNumber* layerNumber = [NSNumber numberWithUnsignedInteger:layerIndex];
+	NSUInteger start, chunkIndex = 0;
+
+	for (start = 0; start < [objects count] && !mFailed; start += kDKChunkedDrawingObjectsPerChunk, ++chunkIndex) {
+		NSRange range = NSMakeRange(start, MIN((NSUInteger)kDKChunkedDrawingObjectsPerChunk, [objects count] - start));
+
+		// a chunk written before can be kept if it holds the same objects, none of which have changed since
+
+		if (chunkIndex < [oldChunks count] && NSMaxRange(range) <= [oldObjects count]) {
+			NSMutableDictionary* oldChunk = [oldChunks objectAtIndex:chunkIndex];
+			BOOL same = [[oldChunk objectForKey:kDKChunkedDrawingChunkObjectCountKey] unsignedIntegerValue] == range.length;
+			NSUInteger i;
+
+			for (i = range.location; i < NSMaxRange(range) && same; ++i) {
+				id obj = [objects objectAtIndex:i];
+				same = (obj == [oldObjects objectAtIndex:i]) && ![layer objectHasChanged:obj];
+			}
+
+			if (same) {
+				// the layer may have moved in the drawing
+
+				[oldChunk setObject:layerNumber
+							 forKey:kDKChunkedDrawingChunkLayerKey];
+				[chunks addObject:oldChunk];
+				continue;
+			}
+		}
+
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		NSDictionary* info = [NSDictionary dictionaryWithObjectsAndKeys:layerNumber, kDKChunkedDrawingChunkLayerKey,
+																		[NSNumber numberWithUnsignedInteger:range.length], kDKChunkedDrawingChunkObjectCountKey, nil];
+
+		[chunks addObject:[self queueChunkOfType:kDKChunkTypeObjects
+											data:[self archiveRootObject:[objects subarrayWithRange:range]
+												  separatingLayerObjects:NO
+														  sharingObjects:YES]
+											info:info
+									compressible:YES]];
+		[pool drain];
+	}
+
+	return chunks;
+}
+
+- (void)writeBytes:(const void*)bytes length:(NSUInteger)length
+{
+	const uint8_t* p = bytes;
+
+	while (length > 0 && !mFailed) {
+		NSInteger written = [mStream write:p
+								 maxLength:length];
+
+		if (written <= 0) {
+			NSLog(@"unable to write chunked drawing: %@", [mStream streamError]);
+			mFailed = YES;
+		} else {
+			p += written;
+			length -= written;
+			mOffset += written;
+		}
+	}
+}
+
+- (void)writeUInt32:(uint32_t)value
+{
+	value = NSSwapHostIntToBig(value);
+	[self writeBytes:&value
+			  length:sizeof(value)];
+}
+
+- (void)writeUInt64:(uint64_t)value
+{
+	value = NSSwapHostLongLongToBig(value);
+	[self writeBytes:&value
+			  length:sizeof(value)];
+}
+
+- (NSMutableDictionary*)writeChunkOfType:(NSString*)type data:(NSData*)data info:(NSDictionary*)info
+{
+	// the entry for the table of contents, which the caller adds to it
+
+	NSMutableDictionary* entry = [NSMutableDictionary dictionaryWithDictionary:info];
+
+	[entry setObject:type
+			  forKey:kDKChunkedDrawingChunkTypeKey];
+	[self writeChunkOfType:type
+					  data:data
+					 entry:entry];
+
+	return entry;
+}
+
+- (void)writeChunkOfType:(NSString*)type data:(NSData*)data entry:(NSMutableDictionary*)entry
+{
+	NSAssert([type length] == 4, @"chunk type must be four characters");
+
+	char typeCode[5];
+	[type getCString:typeCode
+		   maxLength:5
+			encoding:NSASCIIStringEncoding];
+
+	[self writeBytes:typeCode
+			  length:4];
+	[self writeUInt64:[data length]];
+
+	[entry setObject:[NSNumber numberWithUnsignedLongLong:mOffset]
+			  forKey:kDKChunkedDrawingChunkOffsetKey];
+	[entry setObject:[NSNumber numberWithUnsignedLongLong:[data length]]
+			  forKey:kDKChunkedDrawingChunkLengthKey];
+
+	[self writeBytes:[data bytes]
+			  length:[data length]];
+}
+
+- (NSMutableDictionary*)queueChunkOfType:(NSString*)type data:(NSData*)data info:(NSDictionary*)info compressible:(BOOL)compressible
+{
+	// the chunk is compressed and checksummed in the background, and written when it's done and those before it have been. Its entry is
+	// returned straight away for the caller to list, but isn't complete until then
+
+	DKChunkedPendingChunk* chunk = [[DKChunkedPendingChunk alloc] init];
+
+	chunk->mType = [type copy];
+	chunk->mData = [data retain];
+	chunk->mEntry = [[NSMutableDictionary alloc] initWithDictionary:info];
+	chunk->mCompresses = compressible && mCompressesChunks;
+	chunk->mFinished = dispatch_semaphore_create(0);
+
+	[chunk->mEntry setObject:type
+					  forKey:kDKChunkedDrawingChunkTypeKey];
+	[mPendingChunks addObject:chunk];
+
+	// the job has its own reference, released when it's done
+
+	dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), [chunk retain], prepareChunkJob);
+
+	NSMutableDictionary* entry = [[chunk->mEntry retain] autorelease];
+	[chunk release];
+
+	// enough chunks are kept in hand to keep every core busy, without holding the whole drawing's archives in memory
+
+	[self writePendingChunksLeaving:[[NSProcessInfo processInfo] activeProcessorCount] * 2];
+
+	return entry;
+}
+
+- (void)writePendingChunksLeaving:(NSUInteger)count
+{
+	while ([mPendingChunks count] > count) {
+		DKChunkedPendingChunk* chunk = [mPendingChunks objectAtIndex:0];
+
+		dispatch_semaphore_wait(chunk->mFinished, DISPATCH_TIME_FOREVER);
+
+		[self writeChunkOfType:chunk->mType
+						  data:chunk->mStoredData
+						 entry:chunk->mEntry];
+		[mPendingChunks removeObjectAtIndex:0];
+	}
+}
+
+- (NSData*)archiveRootObject:(id)object separatingLayerObjects:(BOOL)separate sharingObjects:(BOOL)share
+{
+	NSMutableData* data = [NSMutableData data];
+	DKKeyedArchiver* karch = [[DKKeyedArchiver alloc] initForWritingWithMutableData:data];
+
+	[karch setEncodesLayerObjectsSeparately:separate];
+
+	if (share)
+		[karch setDelegate:self];
+
+	[karch encodeObject:object
+				 forKey:@"root"];
+	[karch finishEncoding];
+	[karch release];
+
+	return data;
+}
+
+#pragma mark -
+#pragma mark As an NSKeyedArchiver delegate
+
+- (id)archiver:(NSKeyedArchiver*)archiver willEncodeObject:(id)object
+{
+#pragma unused(archiver)
+
+	// styles and image data are replaced by a reference to them, except in the styles chunk itself. Styles are listed in the order first
+	// used, and the list only grows, so that object chunks kept from earlier writes still refer to the right ones
+
+	if ([object isKindOfClass:[DKStyle class]] && !mEncodingSharedObjects) {
+		NSUInteger indx;
+
+		if (CFDictionaryContainsKey(mSharedIndex, object))
+			indx = (NSUInteger)CFDictionaryGetValue(mSharedIndex, object);
+		else {
+			indx = [mSharedObjects count];
+			[mSharedObjects addObject:object];
+			CFDictionarySetValue(mSharedIndex, object, (const void*)indx);
+		}
+
+		return [[[DKChunkedArchiveReference alloc] initWithIndex:indx
+													   imageData:NO] autorelease];
+	}
+
+	if ([object isKindOfClass:[NSData class]] && CFSetContainsValue(mImageData, object)) {
+		NSUInteger indx;
+
+		// image data that was written before is found by equality, since the data object may have been replaced by an equal one
+
+		if (CFDictionaryContainsKey(mImageIndex, object))
+			indx = (NSUInteger)CFDictionaryGetValue(mImageIndex, object);
+		else {
+			indx = CFDictionaryGetCount(mImageIndex);
+			[mNewImages addObject:object];
+			CFDictionarySetValue(mImageIndex, object, (const void*)indx);
+		}
+
+		return [[[DKChunkedArchiveReference alloc] initWithIndex:indx
+													   imageData:YES] autorelease];
+	}
+
+	return object;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mStream release];
+	[mContents release];
+	[mSharedObjects release];
+	CFRelease(mSharedIndex);
+	CFRelease(mImageData);
+	CFRelease(mImageIndex);
+	[mNewImages release];
+	[mImageChunks release];
+	[mLayerRecords release];
+	[mPendingChunks release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKChunkedDrawingReader (Private)
+
+- (NSArray*)chunksOfType:(NSString*)type;
+- (id)decodeChunk:(NSDictionary*)entry imageManager:(DKImageDataManager*)imageManager;
+- (id)decodeChunkData:(NSData*)chunk imageManager:(DKImageDataManager*)imageManager;
+- (NSArray*)objectsFromChunks:(NSArray*)chunks imageManager:(DKImageDataManager*)imageManager;
+
+@end
+
+// a run of the object chunks a reader is about to decode, which are checked and decompressed together on all the cores while the run before
+// them is decoded
+
+typedef struct {
+	NSData* fileData;
+	NSArray* entries;
+	NSUInteger first;
+	NSUInteger count;
+	NSData** chunkData; // one for each entry of the run, or nil if it's damaged
+} DKChunkedReadBatch;
+
+static void readChunkJob(void* context, size_t i)
+{
+	DKChunkedReadBatch* batch = (DKChunkedReadBatch*)context;
+
+	@autoreleasepool {
+		batch->chunkData[i] = createChunkData(batch->fileData, [batch->entries objectAtIndex:batch->first + i]);
+	}
+}
+
+static void readBatchJob(void* context)
+{
+	DKChunkedReadBatch* batch = (DKChunkedReadBatch*)context;
+
+	dispatch_apply_f(batch->count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), batch, readChunkJob);
+}
+
+#pragma mark -
+
+// decodes the object chunks of one layer when the layer first needs them
+
+@interface DKChunkedLayerLoader : NSObject <DKLayerObjectLoader> {
+@private
+	DKChunkedDrawingReader* mReader;
+	NSArray* mChunks;
+	DKImageDataManager* mImageManager;
+}
+
+- (id)initWithReader:(DKChunkedDrawingReader*)reader chunks:(NSArray*)chunks imageManager:(DKImageDataManager*)imageManager;
+
+@end
+
+@implementation DKChunkedLayerLoader
+
+- (id)initWithReader:(DKChunkedDrawingReader*)reader chunks:(NSArray*)chunks imageManager:(DKImageDataManager*)imageManager
+{
+	self = [super init];
+	if (self) {
+		mReader = [reader retain];
+		mChunks = [chunks copy];
+		mImageManager = [imageManager retain];
+	}
+
+	return self;
+}
+
+- (NSArray*)objectsForLayer:(DKObjectOwnerLayer*)layer
+{
+#pragma unused(layer)
+
+	return [mReader objectsFromChunks:mChunks
+						 imageManager:mImageManager];
+}
+
+- (void)dealloc
+{
+	[mReader release];
+	[mChunks release];
+	[mImageManager release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKChunkedDrawingReader
+
++ (BOOL)canReadData:(NSData*)data
+{
+	return [data length] >= kDKChunkedDrawingHeaderLength + kDKChunkedDrawingTrailerLength && memcmp([data bytes], kDKChunkedDrawingMagic, 4) == 0;
+}
+
++ (NSData*)thumbnailDataWithData:(NSData*)data
+{
+	DKChunkedDrawingReader* reader = [[self alloc] initWithData:data];
+	NSData* thumbnail = [[reader thumbnailData] retain];
+
+	[reader release];
+
+	return [thumbnail autorelease];
+}
+
++ (DKDrawing*)drawingWithData:(NSData*)data
+{
+	DKChunkedDrawingReader* reader = [[self alloc] initWithData:data];
+	DKDrawing* drawing = [reader readDrawing];
+
+	[reader release];
+	return drawing;
+}
+
+- (id)initWithData:(NSData*)data
+{
+	self = [super init];
+	if (self) {
+		if (![[self class] canReadData:data]) {
+			[self autorelease];
+			return nil;
+		}
+
+		const uint8_t* bytes = [data bytes];
+		NSUInteger length = [data length];
+
+		mVersion = readUInt32(bytes + 4);
+
+		if (mVersion == 0 || mVersion > kDKChunkedDrawingFormatVersion) {
+			NSLog(@"chunked drawing version %lu can't be read", (unsigned long)mVersion);
+			[self autorelease];
+			return nil;
+		}
+
+		// the trailer at the end gives the position of the table of contents. If it's damaged, changes were being appended when something
+		// went wrong, so the file is searched backwards for the trailer of the last complete write
+
+		NSUInteger end = length;
+
+		mContents = [contentsForTrailer(bytes, end) retain];
+
+		while (mContents == nil && --end >= kDKChunkedDrawingHeaderLength + kDKChunkHeaderLength + kDKChunkedDrawingTrailerLength) {
+			if (memcmp(bytes + end - 8, kDKChunkedDrawingMagic, 4) == 0)
+				mContents = [contentsForTrailer(bytes, end) retain];
+		}
+
+		if (mContents == nil) {
+			NSLog(@"chunked drawing has no valid table of contents");
+			[self autorelease];
+			return nil;
+		}
+
+		if (end < length)
+			NSLog(@"chunked drawing has %lu bytes of incomplete changes at the end - ignored", (unsigned long)(length - end));
+
+		mData = [data retain];
+		mLoadsHiddenLayersLazily = YES;
+	}
+
+	return self;
+}
+
+- (NSUInteger)formatVersion
+{
+	return mVersion;
+}
+
+- (NSArray*)tableOfContents
+{
+	return mContents;
+}
+
+- (void)setLoadsHiddenLayersLazily:(BOOL)lazy
+{
+	mLoadsHiddenLayersLazily = lazy;
+}
+
+- (BOOL)loadsHiddenLayersLazily
+{
+	return mLoadsHiddenLayersLazily;
+}
+
+- (void)setDearchivingHelper:(id)helper
+{
+	[helper retain];
+	[mDearchivingHelper release];
+	mDearchivingHelper = helper;
+}
+
+- (id)dearchivingHelper
+{
+	if (mDearchivingHelper == nil)
+		return [DKDrawing dearchivingHelper];
+
+	return mDearchivingHelper;
+}
+
+- (void)setStyleInternTable:(DKStyleInternTable*)table
+{
+	[table retain];
+	[mStyleInternTable release];
+	mStyleInternTable = table;
+}
+
+- (DKStyleInternTable*)styleInternTable
+{
+	return mStyleInternTable;
+}
+
+- (DKDrawing*)readDrawing
+{
+	NSArray* drawingChunks = [self chunksOfType:kDKChunkTypeDrawing];
+	NSArray* sharedChunks = [self chunksOfType:kDKChunkTypeShared];
+
+	if ([drawingChunks count] != 1 || [sharedChunks count] != 1) {
+		NSLog(@"chunked drawing must have exactly one drawing and one shared objects chunk");
+		return nil;
+	}
+
+	mHelper = [self dearchivingHelper];
+
+	if ([mHelper respondsToSelector:@selector(reset)])
+		[mHelper reset];
+
+	LogEvent_(kReactiveEvent, @"decoding chunked drawing......");
+
+	// image data is listed in the order the chunks were appended, which their base indexes give
+
+	NSSortDescriptor* byBase = [NSSortDescriptor sortDescriptorWithKey:kDKChunkedDrawingChunkBaseIndexKey
+															 ascending:YES];
+	NSArray* imageChunks = [[self chunksOfType:kDKChunkTypeImageData] sortedArrayUsingDescriptors:[NSArray arrayWithObject:byBase]];
+	NSMutableArray* imageData = [NSMutableArray array];
+	NSEnumerator* imageIter = [imageChunks objectEnumerator];
+	NSDictionary* imageEntry;
+
+	NSUInteger threshold = [DKImageDataManager mappingThreshold];
+
+	while ((imageEntry = [imageIter nextObject])) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		NSUInteger offset = (NSUInteger)[[imageEntry objectForKey:kDKChunkedDrawingChunkOffsetKey] unsignedLongLongValue];
+		NSUInteger length = (NSUInteger)[[imageEntry objectForKey:kDKChunkedDrawingChunkLengthKey] unsignedLongLongValue];
+		const uint8_t* bytes = (const uint8_t*)[mData bytes] + offset;
+		NSData* image = nil;
+
+		if ([[imageEntry objectForKey:kDKChunkedDrawingChunkBaseIndexKey] unsignedIntegerValue] != [imageData count])
+			NSLog(@"chunked drawing's image data is out of sequence");
+
+		// large images are mapped, so a drawing full of photos opens without any of them being read into memory
+
+		if (threshold > 0 && length >= threshold)
+			image = [DKImageDataManager mappedDataWithBytes:bytes
+													 length:length];
+
+		// the rest are copied, and so can be checked. A damaged one is left empty, so that the references to those after it still match
+
+		if (image == nil) {
+			NSNumber* checksum = [imageEntry objectForKey:kDKChunkedDrawingChunkChecksumKey];
+
+			if (checksum && chunkChecksum(bytes, length) != [checksum unsignedIntValue]) {
+				NSLog(@"chunked drawing's image data at %lu is damaged - ignored", (unsigned long)offset);
+				image = [NSData data];
+			} else
+				image = [NSData dataWithBytes:bytes
+									   length:length];
+		}
+
+		[imageData addObject:image];
+		[pool drain];
+	}
+
+	[mSharedImageData release];
+	mSharedImageData = [imageData copy];
+
+	[mSharedObjects release];
+	mSharedObjects = [[self decodeChunk:[sharedChunks lastObject]
+						   imageManager:nil] retain];
+
+	DKDrawing* drawing = [self decodeChunk:[drawingChunks lastObject]
+							  imageManager:nil];
+
+	// the object chunks are grouped by layer, so that each layer's objects can be set all at once, which is much faster than adding them
+	// a chunk at a time
+
+	NSArray* layers = [drawing flattenedLayersOfClass:[DKObjectOwnerLayer class]];
+	NSMutableArray* layerChunks = [NSMutableArray arrayWithCapacity:[layers count]];
+	NSUInteger i;
+
+	for (i = 0; i < [layers count]; ++i)
+		[layerChunks addObject:[NSMutableArray array]];
+
+	NSEnumerator* iter = [[self chunksOfType:kDKChunkTypeObjects] objectEnumerator];
+	NSDictionary* entry;
+
+	while ((entry = [iter nextObject])) {
+		NSUInteger layerIndex = [[entry objectForKey:kDKChunkedDrawingChunkLayerKey] unsignedIntegerValue];
+
+		if (layerIndex < [layers count])
+			[[layerChunks objectAtIndex:layerIndex] addObject:entry];
+		else
+			NSLog(@"chunked drawing has objects for missing layer %lu - ignored", (unsigned long)layerIndex);
+	}
+
+	// visible layers are loaded now, hidden ones when they are first used
+
+	for (i = 0; i < [layers count]; ++i) {
+		DKObjectOwnerLayer* layer = [layers objectAtIndex:i];
+		NSArray* chunks = [layerChunks objectAtIndex:i];
+
+		if ([chunks count] == 0)
+			continue;
+
+		if (mLoadsHiddenLayersLazily && ![layer visible]) {
+			DKChunkedLayerLoader* loader = [[DKChunkedLayerLoader alloc] initWithReader:self
+																				chunks:chunks
+																		  imageManager:[drawing imageManager]];
+			[layer setPendingObjectLoader:loader];
+			[loader release];
+		} else {
+			NSArray* objects = [self objectsFromChunks:chunks
+										  imageManager:[drawing imageManager]];
+
+			if ([objects count] > 0)
+				[layer setObjects:objects];
+		}
+	}
+
+	if ([mHelper respondsToSelector:@selector(unarchiverDidFinish:)])
+		[mHelper unarchiverDidFinish:nil];
+
+	mHelper = nil;
+
+	// starting from the stored thumbnail means saving again only renders what has changed
+
+	NSData* thumbnail = [self thumbnailData];
+
+	if (thumbnail)
+		[[drawing thumbnail] setData:thumbnail];
+
+	return drawing;
+}
+
+- (NSData*)thumbnailData
+{
+	NSDictionary* entry = [[self chunksOfType:kDKChunkTypeThumbnail] lastObject];
+
+	if (entry == nil)
+		return nil;
+
+	// copied, since the reader may not outlive it
+
+	NSData* chunk = createChunkData(mData, entry);
+	NSData* thumbnail = chunk ? [NSData dataWithBytes:[chunk bytes]
+											   length:[chunk length]]
+							  : nil;
+	[chunk release];
+
+	return thumbnail;
+}
+
+#pragma mark -
+
+- (NSArray*)chunksOfType:(NSString*)type
+{
+	NSMutableArray* chunks = [NSMutableArray array];
+	NSEnumerator* iter = [mContents objectEnumerator];
+	NSDictionary* entry;
+
+	while ((entry = [iter nextObject])) {
+		if ([[entry objectForKey:kDKChunkedDrawingChunkTypeKey] isEqualToString:type])
+			[chunks addObject:entry];
+	}
+
+	return chunks;
+}
+
+- (id)decodeChunk:(NSDictionary*)entry imageManager:(DKImageDataManager*)imageManager
+{
+	// an uncompressed chunk is decoded where it lies in the data, which is usually mapped from the file
+
+	NSData* chunk = createChunkData(mData, entry);
+	id root = chunk ? [self decodeChunkData:chunk
+							   imageManager:imageManager]
+					: nil;
+
+	[chunk release];
+
+	return root;
+}
+
+- (id)decodeChunkData:(NSData*)chunk imageManager:(DKImageDataManager*)imageManager
+{
+	DKKeyedUnarchiver* unarch = [[DKKeyedUnarchiver alloc] initForReadingWithData:chunk];
+
+	[unarch setDelegate:self];
+	[unarch setImageManager:imageManager];
+	[unarch setSharedObjects:mSharedObjects];
+	[unarch setSharedImageData:mSharedImageData];
+	[unarch setStyleInternTable:mStyleInternTable];
+
+	id root = [[unarch decodeObjectForKey:@"root"] retain];
+
+	[unarch finishDecoding];
+	[unarch release];
+
+	return [root autorelease];
+}
+
+- (NSArray*)objectsFromChunks:(NSArray*)chunks imageManager:(DKImageDataManager*)imageManager
+{
+	// when loading a hidden layer later, the helper is only used for class translation, so it isn't reset
+
+	id savedHelper = mHelper;
+
+	if (mHelper == nil)
+		mHelper = [self dearchivingHelper];
+
+	// the chunks can only be decoded one at a time, on this thread, but the next run of them is checked and decompressed on the other
+	// cores meanwhile
+
+	NSMutableArray* objects = [NSMutableArray array];
+	NSUInteger runLength = MAX(2U, [[NSProcessInfo processInfo] activeProcessorCount] * 2);
+	NSUInteger i, count = [chunks count];
+	DKChunkedReadBatch batches[2];
+	dispatch_group_t group = dispatch_group_create();
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	NSUInteger run = 0;
+
+	for (i = 0; i < 2; ++i) {
+		batches[i].fileData = mData;
+		batches[i].entries = chunks;
+		batches[i].chunkData = calloc(runLength, sizeof(NSData*));
+	}
+
+	batches[0].first = 0;
+	batches[0].count = MIN(runLength, count);
+	dispatch_group_async_f(group, queue, &batches[0], readBatchJob);
+
+	while (batches[run & 1].count > 0) {
+		DKChunkedReadBatch* batch = &batches[run & 1];
+		DKChunkedReadBatch* next = &batches[(run + 1) & 1];
+
+		dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+
+		next->first = batch->first + batch->count;
+		next->count = MIN(runLength, count - next->first);
+
+		if (next->count > 0)
+			dispatch_group_async_f(group, queue, next, readBatchJob);
+
+		for (i = 0; i < batch->count; ++i) {
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+			NSArray* chunkObjects = batch->chunkData[i] ? [self decodeChunkData:batch->chunkData[i]
+																	imageManager:imageManager]
+														: nil;
+
+			if (chunkObjects)
+				[objects addObjectsFromArray:chunkObjects];
+
+			[batch->chunkData[i] release];
+			batch->chunkData[i] = nil;
+			[pool drain];
+		}
+
+		++run;
+	}
+
+	dispatch_group_wait(group, DISPATCH_TIME_FOREVER);
+	dispatch_release(group);
+	free(batches[0].chunkData);
+	free(batches[1].chunkData);
+
+	mHelper = savedHelper;
+
+	return objects;
+}
+
+#pragma mark -
+#pragma mark As an NSKeyedUnarchiver delegate
+
+// these pass on to the drawing's dearchiving helper, except that it's only told that decoding has finished once, at the end
+
+- (id)unarchiver:(NSKeyedUnarchiver*)unarchiver didDecodeObject:(id)object
+{
+	if ([mHelper respondsToSelector:_cmd])
+		return [mHelper unarchiver:unarchiver
+				   didDecodeObject:object];
+
+	return object;
+}
+
+- (Class)unarchiver:(NSKeyedUnarchiver*)unarchiver cannotDecodeObjectOfClassName:(NSString*)name originalClasses:(NSArray*)classNames
+{
+	if ([mHelper respondsToSelector:_cmd])
+		return [mHelper unarchiver:unarchiver
+			cannotDecodeObjectOfClassName:name
+						  originalClasses:classNames];
+
+	return nil;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mData release];
+	[mContents release];
+	[mSharedObjects release];
+	[mSharedImageData release];
+	[mDearchivingHelper release];
+	[mStyleInternTable release];
+	[super dealloc];
+}
+
+@end
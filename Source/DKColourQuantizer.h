@@ -54,12 +54,30 @@ typedef struct _rgb_triple {
 	CGFloat b;
 } rgb_triple;
 
-/** @brief octree quantizer which does a much better job than DKColourQuantizer */
+// a lookup of recently mapped colours, so that indexForRGB: rarely has to walk the tree
+
+#define kDKOctreeIndexCacheSize 4096
+
+typedef struct _index_cache_entry {
+	NSUInteger key; // the masked rgb value plus one, or 0 if the entry is empty
+	NSInteger indexValue;
+} index_cache_entry;
+
+/** @brief octree quantizer which does a much better job than DKColourQuantizer
+
+ Nodes are allocated from blocks owned by the quantizer and recycled as the tree is reduced, so building the tree doesn't call malloc
+ for each node. Bitmaps with 8 bits per sample are read a row at a time directly from their data rather than a pixel at a time with
+ -getPixel:atX:y:.
+ */
 @interface DKOctreeQuantizer : DKColourQuantizer {
 	NODE* m_pTree;
 	NSUInteger m_nLeafCount;
 	NODE* m_pReducibleNodes[9];
 	NSUInteger m_nOutputMaxColors;
+	NODE* m_pNodeBlocks; // blocks of preallocated nodes, linked through the first node of each
+	NSUInteger m_nBlockNodesUsed; // nodes handed out from the newest block
+	NODE* m_pFreeNodes; // nodes returned by reductions, linked through pNext
+	index_cache_entry* m_indexCache;
 }
 
 - (void)addNode:(NODE**)ppNode colour:(NSUInteger[])rgb level:(NSUInteger)level leafCount:(NSUInteger*)leafCount reducibleNodes:(NODE**)redNodes;
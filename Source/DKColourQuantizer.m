@@ -186,50 +186,53 @@ static inline void indexToRGB_332(NSUInteger i, NSUInteger rgb[3])
 
 #pragma mark -
 
+#define kDKOctreeNodeBlockSize 1024 // nodes per block, including the one that links the blocks
+
 @implementation DKOctreeQuantizer
 
 static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 
-- (void)addNode:(NODE**)ppNode colour:(NSUInteger[])rgb level:(NSUInteger)level leafCount:(NSUInteger*)leafCount reducibleNodes:(NODE**)redNodes
+// the tree is built by these functions rather than the methods below, which call them, so that the per-pixel work involves no message
+// sends. Nodes come from blocks of kDKOctreeNodeBlockSize, and nodes freed by reductions are reused before any more are handed out.
+
+static NODE* octreeAllocNode(DKOctreeQuantizer* q)
 {
+	NODE* pnode = q->m_pFreeNodes;
 
-	// If the node doesn't exist, create it.
+	if (pnode) {
+		q->m_pFreeNodes = pnode->pNext;
+		memset(pnode, 0, sizeof(NODE));
+		return pnode;
+	}
 
-	if (*ppNode == NULL)
-		*ppNode = [self createNodeAtLevel:level
-								leafCount:leafCount
-						   reducibleNodes:redNodes];
+	if (q->m_pNodeBlocks == NULL || q->m_nBlockNodesUsed == kDKOctreeNodeBlockSize) {
+		NODE* block = (NODE*)calloc(kDKOctreeNodeBlockSize, sizeof(NODE));
 
-	// Update color	information	if it's	a leaf node.
+		if (block == NULL)
+			return NULL;
 
-	if ((*ppNode)->bIsLeaf) {
-		(*ppNode)->nPixelCount++;
-		(*ppNode)->nRedSum += rgb[0];
-		(*ppNode)->nGreenSum += rgb[1];
-		(*ppNode)->nBlueSum += rgb[2];
-		(*ppNode)->nAlphaSum += rgb[3];
-	} else {
-		// Recurse a level deeper if the node is not a leaf.
+		block->pNext = q->m_pNodeBlocks;
+		q->m_pNodeBlocks = block;
+		q->m_nBlockNodesUsed = 1;
+	}
 
-		NSInteger shift = 7 - level;
-		NSInteger nIndex = (((rgb[0] & mask[level]) >> shift) << 2) | (((rgb[1] & mask[level]) >> shift) << 1) | ((rgb[2] & mask[level]) >> shift);
+	return &q->m_pNodeBlocks[q->m_nBlockNodesUsed++];
+}
 
-		[self addNode:&((*ppNode)->pChild[nIndex])
-					colour:rgb
-					 level:level + 1
-				 leafCount:leafCount
-			reducibleNodes:redNodes];
-	}
+static void octreeFreeNode(DKOctreeQuantizer* q, NODE* pnode)
+{
+	pnode->pNext = q->m_pFreeNodes;
+	q->m_pFreeNodes = pnode;
 }
 
-- (NODE*)createNodeAtLevel:(NSUInteger)level leafCount:(NSUInteger*)leafCount reducibleNodes:(NODE**)redNodes
+static NODE* octreeCreateNode(DKOctreeQuantizer* q, NSUInteger level, NSUInteger* leafCount, NODE** redNodes)
 {
-	NODE* pnode = (NODE*)calloc(1, sizeof(NODE));
+	NODE* pnode = octreeAllocNode(q);
 
 	if (pnode == NULL)
 		return NULL;
 
-	pnode->bIsLeaf = (level == m_nBits);
+	pnode->bIsLeaf = (level == q->m_nBits);
 	pnode->indexValue = -1; // means not set
 
 	if (pnode->bIsLeaf)
@@ -242,13 +245,47 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 	return pnode;
 }
 
-- (void)reduceTreeLeafCount:(NSUInteger*)leafCount reducibleNodes:(NODE**)redNodes
+// adds a colour to the tree, returning the leaf it was added to, or NULL if a node couldn't be allocated
+
+static NODE* octreeAddColour(DKOctreeQuantizer* q, NODE** ppNode, NSUInteger r, NSUInteger g, NSUInteger b, NSUInteger a, NSUInteger* leafCount, NODE** redNodes)
+{
+	NSUInteger level = 0;
+
+	for (;;) {
+		if (*ppNode == NULL) {
+			*ppNode = octreeCreateNode(q, level, leafCount, redNodes);
+
+			if (*ppNode == NULL)
+				return NULL;
+		}
+
+		NODE* pnode = *ppNode;
+
+		if (pnode->bIsLeaf) {
+			pnode->nPixelCount++;
+			pnode->nRedSum += r;
+			pnode->nGreenSum += g;
+			pnode->nBlueSum += b;
+			pnode->nAlphaSum += a;
+
+			return pnode;
+		}
+
+		NSUInteger shift = 7 - level;
+		NSUInteger nIndex = (((r >> shift) & 1) << 2) | (((g >> shift) & 1) << 1) | ((b >> shift) & 1);
+
+		ppNode = &pnode->pChild[nIndex];
+		++level;
+	}
+}
+
+static void octreeReduce(DKOctreeQuantizer* q, NSUInteger* leafCount, NODE** redNodes)
 {
 	// Find	the	deepest	level containing at	least one reducible	node.
 
 	NSInteger i;
 
-	for (i = m_nBits - 1; (i > 0) && (redNodes[i] == NULL); i--)
+	for (i = q->m_nBits - 1; (i > 0) && (redNodes[i] == NULL); i--)
 		;
 
 	// Reduce the node most	recently added to the list at level	i.
@@ -270,7 +307,7 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 			nAlphaSum += pnode->pChild[i]->nAlphaSum;
 			pnode->nPixelCount += pnode->pChild[i]->nPixelCount;
 
-			free(pnode->pChild[i]);
+			octreeFreeNode(q, pnode->pChild[i]);
 			pnode->pChild[i] = NULL;
 
 			nChildren++;
@@ -286,8 +323,54 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 	*leafCount -= (nChildren - 1);
 }
 
+- (void)addNode:(NODE**)ppNode colour:(NSUInteger[])rgb level:(NSUInteger)level leafCount:(NSUInteger*)leafCount reducibleNodes:(NODE**)redNodes
+{
+	// If the node doesn't exist, create it.
+
+	if (*ppNode == NULL)
+		*ppNode = [self createNodeAtLevel:level
+								leafCount:leafCount
+						   reducibleNodes:redNodes];
+
+	if (*ppNode == NULL)
+		return;
+
+	// Update color	information	if it's	a leaf node.
+
+	if ((*ppNode)->bIsLeaf) {
+		(*ppNode)->nPixelCount++;
+		(*ppNode)->nRedSum += rgb[0];
+		(*ppNode)->nGreenSum += rgb[1];
+		(*ppNode)->nBlueSum += rgb[2];
+		(*ppNode)->nAlphaSum += rgb[3];
+	} else {
+		// Recurse a level deeper if the node is not a leaf.
+
+		NSInteger shift = 7 - level;
+		NSInteger nIndex = (((rgb[0] & mask[level]) >> shift) << 2) | (((rgb[1] & mask[level]) >> shift) << 1) | ((rgb[2] & mask[level]) >> shift);
+
+		[self addNode:&((*ppNode)->pChild[nIndex])
+					colour:rgb
+					 level:level + 1
+				 leafCount:leafCount
+			reducibleNodes:redNodes];
+	}
+}
+
+- (NODE*)createNodeAtLevel:(NSUInteger)level leafCount:(NSUInteger*)leafCount reducibleNodes:(NODE**)redNodes
+{
+	return octreeCreateNode(self, level, leafCount, redNodes);
+}
+
+- (void)reduceTreeLeafCount:(NSUInteger*)leafCount reducibleNodes:(NODE**)redNodes
+{
+	octreeReduce(self, leafCount, redNodes);
+}
+
 - (void)deleteTree:(NODE**)ppNode
 {
+	// the nodes go back to the arena, which is only freed when the quantizer is
+
 	NSInteger i;
 
 	for (i = 0; i < 8; i++) {
@@ -295,7 +378,7 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 			[self deleteTree:&((*ppNode)->pChild[i])];
 	}
 
-	free(*ppNode);
+	octreeFreeNode(self, *ppNode);
 	*ppNode = NULL;
 }
 
@@ -327,45 +410,107 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 
 - (void)lookUpNode:(NODE*)pTree level:(NSUInteger)level colour:(NSUInteger[])rgb index:(NSInteger*)indx
 {
-	if (pTree->bIsLeaf) {
-		*indx = pTree->indexValue;
-	} else {
-		// Recurse a level deeper if the node is not a leaf.
+	// colours that weren't in the image may lead to a missing child, which has no index
 
+	while (pTree && !pTree->bIsLeaf) {
 		NSInteger shift = 7 - level;
 		NSInteger nIndex = (((rgb[0] & mask[level]) >> shift) << 2) | (((rgb[1] & mask[level]) >> shift) << 1) | ((rgb[2] & mask[level]) >> shift);
 
-		[self lookUpNode:pTree->pChild[nIndex]
-				   level:level + 1
-				  colour:rgb
-				   index:indx];
+		pTree = pTree->pChild[nIndex];
+		++level;
 	}
+
+	*indx = pTree ? pTree->indexValue : -1;
 }
 
 #pragma mark -
 #pragma mark As a DKColourQuantizer
 - (void)analyse:(NSBitmapImageRep*)rep
 {
-	NSInteger i, j;
-	NSUInteger rgb[4];
-
 	[m_cTable removeAllObjects];
 
-	for (i = 0; i < m_imageSize.height; ++i) {
-		for (j = 0; j < m_imageSize.width; ++j) {
-			[rep getPixel:rgb
-					  atX:j
-						y:i];
-
-			[self addNode:&m_pTree
-						colour:rgb
-						 level:0
-					 leafCount:&m_nLeafCount
-				reducibleNodes:m_pReducibleNodes];
-
-			while (m_nLeafCount > m_maxColours)
-				[self reduceTreeLeafCount:&m_nLeafCount
-						   reducibleNodes:m_pReducibleNodes];
+	if (m_indexCache)
+		memset(m_indexCache, 0, kDKOctreeIndexCacheSize * sizeof(index_cache_entry));
+
+	// the usual 8 bit RGB and RGBA bitmaps are read straight from their rows. Anything else goes through -getPixel:atX:y:
+
+	NSInteger spp = [rep samplesPerPixel];
+	NSBitmapFormat format = [rep bitmapFormat];
+
+	if ([rep bitsPerSample] == 8 && ![rep isPlanar] && (spp == 3 || spp == 4) && (format & NSFloatingPointSamplesBitmapFormat) == 0 && [rep bitmapData] != NULL) {
+		const unsigned char* data = [rep bitmapData];
+		NSInteger bpr = [rep bytesPerRow];
+		NSInteger bpp = [rep bitsPerPixel] / 8;
+		NSInteger width = [rep pixelsWide];
+		NSInteger height = [rep pixelsHigh];
+		NSInteger colourOffset = 0;
+		NSInteger alphaOffset = -1;
+		NSInteger i, j;
+
+		if ([rep hasAlpha]) {
+			if (format & NSAlphaFirstBitmapFormat) {
+				alphaOffset = 0;
+				colourOffset = 1;
+			} else
+				alphaOffset = 3;
+		}
+
+		// runs of the same colour are common in drawings, and add to the same leaf as long as the tree hasn't been reduced
+
+		NODE* lastLeaf = NULL;
+		NSUInteger lastColour = 0;
+
+		for (i = 0; i < height; ++i) {
+			const unsigned char* p = data + i * bpr;
+
+			for (j = 0; j < width; ++j, p += bpp) {
+				NSUInteger r = p[colourOffset];
+				NSUInteger g = p[colourOffset + 1];
+				NSUInteger b = p[colourOffset + 2];
+				NSUInteger a = (alphaOffset >= 0) ? p[alphaOffset] : 0xFF;
+				NSUInteger colour = (r << 24) | (g << 16) | (b << 8) | a;
+
+				if (lastLeaf && colour == lastColour) {
+					lastLeaf->nPixelCount++;
+					lastLeaf->nRedSum += r;
+					lastLeaf->nGreenSum += g;
+					lastLeaf->nBlueSum += b;
+					lastLeaf->nAlphaSum += a;
+					continue;
+				}
+
+				lastLeaf = octreeAddColour(self, &m_pTree, r, g, b, a, &m_nLeafCount, m_pReducibleNodes);
+				lastColour = colour;
+
+				if (lastLeaf == NULL)
+					return;
+
+				if (m_nLeafCount > m_maxColours) {
+					while (m_nLeafCount > m_maxColours)
+						octreeReduce(self, &m_nLeafCount, m_pReducibleNodes);
+
+					lastLeaf = NULL;
+				}
+			}
+		}
+	} else {
+		NSInteger i, j;
+		NSUInteger rgb[4];
+
+		for (i = 0; i < m_imageSize.height; ++i) {
+			for (j = 0; j < m_imageSize.width; ++j) {
+				rgb[3] = 0xFF;
+
+				[rep getPixel:rgb
+						  atX:j
+							y:i];
+
+				if (octreeAddColour(self, &m_pTree, rgb[0], rgb[1], rgb[2], rgb[3], &m_nLeafCount, m_pReducibleNodes) == NULL)
+					return;
+
+				while (m_nLeafCount > m_maxColours)
+					octreeReduce(self, &m_nLeafCount, m_pReducibleNodes);
+			}
 		}
 	}
 }
@@ -379,7 +524,7 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 		NSUInteger i, indx = 0;
 		NSColor* colour;
 
-		rgb = (rgb_triple*)malloc(m_nLeafCount * sizeof(rgb_triple));
+		rgb = (rgb_triple*)malloc(MAX(1U, m_nLeafCount) * sizeof(rgb_triple));
 		[self paletteColour:m_pTree
 					  index:&indx
 					 colour:rgb];
@@ -395,6 +540,9 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 		}
 
 		free(rgb);
+
+		if (m_indexCache)
+			memset(m_indexCache, 0, kDKOctreeIndexCacheSize * sizeof(index_cache_entry));
 	}
 
 	return m_cTable;
@@ -407,11 +555,28 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 	// force computation of the indexes if not done already:
 	[self colourTable];
 
-	// recursive lookup:
-	[self lookUpNode:m_pTree
-			   level:0
-			  colour:rgb
-			   index:&indx];
+	// only the bits the tree uses matter, so colours that differ below those share a cache entry
+
+	NSUInteger bitMask = (0xFF << (8 - m_nBits)) & 0xFF;
+	NSUInteger key = (((rgb[0] & bitMask) << 16) | ((rgb[1] & bitMask) << 8) | (rgb[2] & bitMask)) + 1;
+	NSUInteger slot = ((key * 2654435761U) >> 8) % kDKOctreeIndexCacheSize;
+
+	if (m_indexCache == NULL)
+		m_indexCache = (index_cache_entry*)calloc(kDKOctreeIndexCacheSize, sizeof(index_cache_entry));
+
+	if (m_indexCache && m_indexCache[slot].key == key)
+		indx = m_indexCache[slot].indexValue;
+	else {
+		[self lookUpNode:m_pTree
+				   level:0
+				  colour:rgb
+				   index:&indx];
+
+		if (m_indexCache) {
+			m_indexCache[slot].key = key;
+			m_indexCache[slot].indexValue = indx;
+		}
+	}
 
 	if (indx != -1)
 		return indx;
@@ -449,10 +614,16 @@ static NSUInteger mask[8] = { 0x80, 0x40, 0x20, 0x10, 0x08, 0x04, 0x02, 0x01 };
 #pragma mark As an NSObject
 - (void)dealloc
 {
-	if (m_pTree != NULL) {
-		[self deleteTree:&m_pTree];
+	// every node belongs to one of the blocks, so freeing them frees the tree
+
+	while (m_pNodeBlocks) {
+		NODE* next = m_pNodeBlocks->pNext;
+		free(m_pNodeBlocks);
+		m_pNodeBlocks = next;
 	}
 
+	free(m_indexCache);
+
 	[super dealloc];
 }
 
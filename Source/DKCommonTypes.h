@@ -87,3 +87,19 @@ typedef enum {
 	kDKGreekingByLineRectangle = 1, // greek by filling line rects
 	kDKGreekingByGlyphRectangle = 2 // greek by filling glyph rects
 } DKGreeking;
+
+// drawing quality tiers, used by DKDrawingView to keep interactive updates within a frame time budget
+
+typedef enum {
+	kDKDrawingQualityFull = 0, // everything is drawn at best quality
+	kDKDrawingQualityReduced = 1, // shadows are dropped and intricate rasterizers (hatching, patterns, text) draw their low detail fallbacks
+	kDKDrawingQualityDraft = 2 // as reduced, and anti-aliasing is also turned off
+} DKDrawingQualityTier;
+
+// results of a geometric hit-test, used by DKDrawableObject to avoid rendering objects to test them
+
+typedef enum {
+	kDKHitTestMiss = 0, // the rect definitely misses the object
+	kDKHitTestHit = 1, // the rect definitely hits the object
+	kDKHitTestUndetermined = 2 // the object can't be tested geometrically, so it must be rendered to find out
+} DKHitTestResult;
@@ -0,0 +1,60 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+#define kDKDashedPathElementsPerRun 64 // dashes are grouped into runs of about this many elements, each culled as a whole
+#define kDKDashedPathMaximumDashes 250000 // paths that would have more dashes than this are left for Quartz to dash
+
+/** @brief The dashes of a dashed path, worked out once so that only those in the area being drawn need stroking.
+
+ The dashes of a dashed path, worked out once so that only those in the area being drawn need stroking. Quartz dashes a path afresh each
+ time it's stroked, measuring all of it however little is visible, which is slow for long, detailed paths with short dashes. A dashed path
+ measures each subpath once with a DKArcLengthTable and cuts the dashes out of it, following the path's dash pattern, phase and line
+ width as Quartz does: the pattern restarts with each subpath, and an odd-length pattern repeats with its marks and gaps swapped.
+
+ Consecutive dashes are grouped into runs, each an undashed path with the source path's stroke attributes and the bounds of its stroke.
+ -strokeInRect: strokes only the runs that reach into the rect, so the time taken is proportional to what's drawn.
+
+ A dashed path is immutable; it does not follow later changes to the source path.
+*/
+@interface DKDashedPath : NSObject {
+@private
+	NSMutableArray* mRuns;
+	NSRect* mRunBounds;
+	NSUInteger mDashCount;
+	NSRect mBounds;
+}
+
+/** @brief Returns the dashes of a path
+ @param path a path whose line width, cap and join styles, mitre limit and dash are those to be stroked
+ @return the dashed path, or nil if the path isn't dashed or would have too many dashes
+ */
++ (DKDashedPath*)dashedPathWithPath:(NSBezierPath*)path;
+
+- (id)initWithPath:(NSBezierPath*)path;
+
+/** @brief Strokes the runs of dashes whose strokes reach into a rect, in the current colour
+ @param rect the area being drawn, such as the bounds of the current clip
+ @return the number of runs stroked
+ */
+- (NSUInteger)strokeInRect:(NSRect)rect;
+
+/** @brief Strokes the runs of dashes that reach into the current context's clip, in the current colour
+ @return the number of runs stroked
+ */
+- (NSUInteger)strokeInClip;
+
+/** @brief The number of dashes and runs
+ */
+- (NSUInteger)dashCount;
+- (NSUInteger)runCount;
+
+/** @brief The bounds of all the dashes' strokes
+ */
+- (NSRect)bounds;
+
+@end
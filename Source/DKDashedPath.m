@@ -0,0 +1,232 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDashedPath.h"
+#import "DKArcLengthTable.h"
+#import "NSBezierPath+Geometry.h"
+#include <tgmath.h>
+
+@interface DKDashedPath (Private)
+
+- (NSBezierPath*)newRunLikePath:(NSBezierPath*)path;
+- (void)addRun:(NSBezierPath*)run outset:(CGFloat)outset;
+
+@end
+
+#pragma mark -
+
+@implementation DKDashedPath
+
++ (DKDashedPath*)dashedPathWithPath:(NSBezierPath*)path
+{
+	return [[[self alloc] initWithPath:path] autorelease];
+}
+
+- (id)initWithPath:(NSBezierPath*)path
+{
+	self = [super init];
+	if (self) {
+		NSInteger i, count = 0;
+		CGFloat phase = 0.0, patternLength = 0.0;
+
+		[path getLineDash:NULL
+					count:&count
+					phase:NULL];
+
+		if (count <= 0) {
+			[self release];
+			return nil;
+		}
+
+		// an odd-length pattern is repeated to make an even one, so that marks and gaps alternate
+
+		NSInteger patternCount = (count & 1) ? count * 2 : count;
+		CGFloat* pattern = malloc(patternCount * sizeof(CGFloat));
+
+		[path getLineDash:pattern
+					count:&count
+					phase:&phase];
+
+		for (i = 0; i < count; ++i) {
+			pattern[i] = MAX(pattern[i], 0.0);
+			patternLength += pattern[i];
+		}
+
+		for (i = count; i < patternCount; ++i)
+			pattern[i] = pattern[i - count];
+
+		patternLength *= (CGFloat)(patternCount / count);
+
+		NSArray* subpaths = [path subPaths];
+		NSMutableArray* tables = [NSMutableArray arrayWithCapacity:[subpaths count]];
+		NSEnumerator* iter = [subpaths objectEnumerator];
+		NSBezierPath* subpath;
+		CGFloat totalLength = 0.0;
+
+		while ((subpath = [iter nextObject])) {
+			DKArcLengthTable* table = [DKArcLengthTable arcLengthTableWithPath:subpath];
+
+			totalLength += [table length];
+			[tables addObject:table];
+		}
+
+		// give up on patterns that would make more dashes than are worth keeping, leaving them to Quartz
+
+		if (patternLength <= 0.0 || (totalLength / patternLength) * (patternCount / 2) > kDKDashedPathMaximumDashes) {
+			free(pattern);
+			[self release];
+			return nil;
+		}
+
+		// where the pattern starts, as an index into it and the length of that entry that's already used up
+
+		CGFloat startOffset = fmod(phase, patternLength);
+		NSInteger startIndex = 0;
+
+		if (startOffset < 0.0)
+			startOffset += patternLength;
+
+		while (startOffset >= pattern[startIndex] && startOffset > 0.0) {
+			startOffset -= pattern[startIndex];
+			startIndex = (startIndex + 1) % patternCount;
+		}
+
+		// the bounds of a run are its control points' bounds outset by as far as a join or cap can reach
+
+		CGFloat halfWidth = [path lineWidth] * 0.5;
+		CGFloat reach = ([path lineJoinStyle] == NSMiterLineJoinStyle) ? MAX([path miterLimit], (CGFloat)M_SQRT2) : M_SQRT2;
+		CGFloat outset = halfWidth * reach + 1.0;
+		BOOL butt = ([path lineCapStyle] == NSButtLineCapStyle);
+
+		mRuns = [[NSMutableArray alloc] init];
+		mBounds = NSZeroRect;
+
+		NSBezierPath* run = [self newRunLikePath:path];
+		DKArcLengthTable* table;
+
+		iter = [tables objectEnumerator];
+
+		while ((table = [iter nextObject])) {
+			CGFloat length = [table length];
+			CGFloat position = 0.0;
+			CGFloat used = startOffset;
+			NSInteger index = startIndex;
+
+			while (position < length) {
+				CGFloat end = MIN(position + pattern[index] - used, length);
+
+				// marks are at even indexes. A mark of no length only shows if it has caps.
+
+				if ((index & 1) == 0 && (end > position || !butt)) {
+					[table appendSectionFromLength:position
+										  toLength:end
+											toPath:run];
+					++mDashCount;
+
+					if ([run elementCount] >= kDKDashedPathElementsPerRun) {
+						[self addRun:run
+							  outset:outset];
+						[run release];
+						run = [self newRunLikePath:path];
+					}
+				}
+
+				position = end;
+				used = 0.0;
+				index = (index + 1) % patternCount;
+			}
+		}
+
+		if (![run isEmpty])
+			[self addRun:run
+				  outset:outset];
+
+		[run release];
+		free(pattern);
+	}
+
+	return self;
+}
+
+- (NSUInteger)strokeInRect:(NSRect)rect
+{
+	NSUInteger i, count = [mRuns count], stroked = 0;
+
+	if (!NSIntersectsRect(rect, mBounds))
+		return 0;
+
+	for (i = 0; i < count; ++i) {
+		if (NSIntersectsRect(rect, mRunBounds[i])) {
+			[(NSBezierPath*)[mRuns objectAtIndex:i] stroke];
+			++stroked;
+		}
+	}
+
+	return stroked;
+}
+
+- (NSUInteger)strokeInClip
+{
+	CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+
+	if (context == NULL)
+		return 0;
+
+	return [self strokeInRect:NSRectFromCGRect(CGContextGetClipBoundingBox(context))];
+}
+
+- (NSUInteger)dashCount
+{
+	return mDashCount;
+}
+
+- (NSUInteger)runCount
+{
+	return [mRuns count];
+}
+
+- (NSRect)bounds
+{
+	return mBounds;
+}
+
+#pragma mark -
+
+- (NSBezierPath*)newRunLikePath:(NSBezierPath*)path
+{
+	NSBezierPath* run = [[NSBezierPath alloc] init];
+
+	[run setLineWidth:[path lineWidth]];
+	[run setLineCapStyle:[path lineCapStyle]];
+	[run setLineJoinStyle:[path lineJoinStyle]];
+	[run setMiterLimit:[path miterLimit]];
+
+	return run;
+}
+
+- (void)addRun:(NSBezierPath*)run outset:(CGFloat)outset
+{
+	NSUInteger count = [mRuns count];
+	NSRect bounds = NSInsetRect([run controlPointBounds], -outset, -outset);
+
+	mRunBounds = realloc(mRunBounds, (count + 1) * sizeof(NSRect));
+	mRunBounds[count] = bounds;
+	[mRuns addObject:run];
+
+	mBounds = (count == 0) ? bounds : NSUnionRect(mBounds, bounds);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mRuns release];
+	free(mRunBounds);
+	[super dealloc];
+}
+
+@end
@@ -6,6 +6,26 @@
 
 #import <Cocoa/Cocoa.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Maps an array of points from a rectangle to a quadrilateral
+
+ This is the same mapping as -[DKDistortionTransform transformPoint:fromRect:], but done for many points in one pass of straight-line
+ arithmetic that the compiler can vectorize. The input and output arrays may be the same.
+ @param quad the four envelope points, clockwise from top, left
+ @param rect the rectangle the points are relative to
+ @param inPoints the points to map
+ @param outPoints receives the mapped points
+ @param count the number of points
+ */
+void DKDistortionMapPoints(const NSPoint quad[4], NSRect rect, const NSPoint* inPoints, NSPoint* outPoints, NSUInteger count);
+
+#ifdef __cplusplus
+}
+#endif
+
 /** @brief This objects performs distortion transformations on points and paths.
 
 This objects performs distortion transformations on points and paths. The four envelope points define a
@@ -18,6 +38,8 @@ can be used in a similar way.
 @interface DKDistortionTransform : NSObject <NSCoding, NSCopying> {
 	NSPoint m_q[4];
 	BOOL m_inverted;
+	NSPoint* m_buffer; // reusable point buffer for path transforms
+	NSUInteger m_bufferCapacity;
 }
 
 + (DKDistortionTransform*)transformWithInitialRect:(NSRect)rect;
@@ -37,6 +59,8 @@ can be used in a similar way.
 - (void)invert;
 
 - (NSPoint)transformPoint:(NSPoint)p fromRect:(NSRect)rect;
+- (void)transformPoints:(NSPoint*)points count:(NSUInteger)count fromRect:(NSRect)rect;
 - (NSBezierPath*)transformBezierPath:(NSBezierPath*)path;
+- (void)transformBezierPathInPlace:(NSBezierPath*)path;
 
 @end
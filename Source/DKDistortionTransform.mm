@@ -48,6 +48,53 @@ static NSPoint Map(NSPoint inPoint, NSSize sourceSize, NSPoint quad[4])
 	return p;
 }
 
+void DKDistortionMapPoints(const NSPoint quad[4], NSRect rect, const NSPoint* inPoints, NSPoint* outPoints, NSUInteger count)
+{
+	// this is Map() and VP() unrolled for a whole array. Each point's position in the rect is used to interpolate along the left and right
+	// edges of the quad (giving line 1-2) and along the top and bottom edges (giving line 3-4), and the result is where those lines cross.
+	// Everything that depends only on the quad and the rect is worked out once, leaving a loop without calls or branches.
+
+	const CGFloat sx = 1.0 / rect.size.width;
+	const CGFloat sy = 1.0 / rect.size.height;
+	const CGFloat ox = rect.origin.x;
+	const CGFloat oy = rect.origin.y;
+
+	const CGFloat q0x = quad[0].x, q0y = quad[0].y;
+	const CGFloat q1x = quad[1].x, q1y = quad[1].y;
+	const CGFloat q2x = quad[2].x, q2y = quad[2].y;
+	const CGFloat q3x = quad[3].x, q3y = quad[3].y;
+
+	// edge vectors for the interpolation
+
+	const CGFloat e03x = q3x - q0x, e03y = q3y - q0y;
+	const CGFloat e12x = q2x - q1x, e12y = q2y - q1y;
+	const CGFloat e01x = q1x - q0x, e01y = q1y - q0y;
+	const CGFloat e32x = q2x - q3x, e32y = q2y - q3y;
+
+	for (NSUInteger i = 0; i < count; ++i) {
+		const CGFloat t = (inPoints[i].x - ox) * sx;
+		const CGFloat s = (inPoints[i].y - oy) * sy;
+
+		const CGFloat x1 = q0x + s * e03x, y1 = q0y + s * e03y;
+		const CGFloat x2 = q1x + s * e12x, y2 = q1y + s * e12y;
+		const CGFloat x3 = q0x + t * e01x, y3 = q0y + t * e01y;
+		const CGFloat x4 = q3x + t * e32x, y4 = q3y + t * e32y;
+
+		const CGFloat dx12 = x1 - x2, dy12 = y1 - y2;
+		const CGFloat dx34 = x3 - x4, dy34 = y3 - y4;
+
+		CGFloat d = dx12 * dy34 - dy12 * dx34;
+		d = (d == 0.0) ? 1.0 : d;
+
+		const CGFloat c12 = x1 * y2 - y1 * x2;
+		const CGFloat c34 = x3 * y4 - y3 * x4;
+		const CGFloat rd = 1.0 / d;
+
+		outPoints[i].x = (c12 * dx34 - dx12 * c34) * rd;
+		outPoints[i].y = (c12 * dy34 - dy12 * c34) * rd;
+	}
+}
+
 #pragma mark -
 @implementation DKDistortionTransform
 #pragma mark As a DKDistortionTransform
@@ -216,58 +263,102 @@ static NSPoint Map(NSPoint inPoint, NSSize sourceSize, NSPoint quad[4])
 #endif
 }
 
+- (void)transformPoints:(NSPoint*)points count:(NSUInteger)count fromRect:(NSRect)rect
+{
+	// transforms the points in place
+
+#if qUseAgg
+	for (NSUInteger i = 0; i < count; ++i)
+		points[i] = [self transformPoint:points[i]
+								fromRect:rect];
+#else
+	DKDistortionMapPoints(m_q, rect, points, points, count);
+#endif
+}
+
 - (NSBezierPath*)transformBezierPath:(NSBezierPath*)path
 {
 	// transforms every point in the path, making a new path
 
 	NSBezierPath* newPath = [path copy];
-	NSPoint ap[3];
-	NSBezierPathElement elem;
-	NSInteger i, ec;
+
+	[self transformBezierPathInPlace:newPath];
+
+	return [newPath autorelease];
+}
+
+- (void)transformBezierPathInPlace:(NSBezierPath*)path
+{
+	// transforms every point in the path, relative to its control point bounds. The points are gathered into a buffer that is kept between
+	// calls, transformed in one batch, then set back into the path.
+
+	NSInteger i, ec = [path elementCount];
+	NSUInteger n = 0;
 	NSRect bounds = [path controlPointBounds];
 
-	[newPath removeAllPoints];
-	ec = [path elementCount];
+	if (ec == 0)
+		return;
+
+	// allow an extra element's worth so that a close path element can't write past the end, whatever it returns
+
+	NSUInteger needed = (ec + 1) * 3;
+
+	if (needed > m_bufferCapacity) {
+		m_buffer = (NSPoint*)realloc(m_buffer, needed * sizeof(NSPoint));
+		m_bufferCapacity = needed;
+	}
 
 	for (i = 0; i < ec; ++i) {
-		elem = [path elementAtIndex:i
-				   associatedPoints:ap];
-
-		if (elem == NSCurveToBezierPathElement) {
-			ap[0] = [self transformPoint:ap[0]
-								fromRect:bounds];
-			ap[1] = [self transformPoint:ap[1]
-								fromRect:bounds];
-			ap[2] = [self transformPoint:ap[2]
-								fromRect:bounds];
-
-			[newPath curveToPoint:ap[2]
-					controlPoint1:ap[0]
-					controlPoint2:ap[1]];
-		} else {
-			ap[0] = [self transformPoint:ap[0]
-								fromRect:bounds];
-
-			switch (elem) {
-			case NSMoveToBezierPathElement:
-				[newPath moveToPoint:ap[0]];
-				break;
-
-			case NSLineToBezierPathElement:
-				[newPath lineToPoint:ap[0]];
-				break;
-
-			case NSClosePathBezierPathElement:
-				[newPath closePath];
-				break;
-
-			default:
-				break;
-			}
+		switch ([path elementAtIndex:i
+					associatedPoints:m_buffer + n]) {
+		case NSCurveToBezierPathElement:
+			n += 3;
+			break;
+
+		case NSMoveToBezierPathElement:
+		case NSLineToBezierPathElement:
+			n += 1;
+			break;
+
+		default:
+			break;
 		}
 	}
 
-	return [newPath autorelease];
+	[self transformPoints:m_buffer
+					count:n
+				 fromRect:bounds];
+
+	n = 0;
+
+	for (i = 0; i < ec; ++i) {
+		switch ([path elementAtIndex:i]) {
+		case NSCurveToBezierPathElement:
+			[path setAssociatedPoints:m_buffer + n
+							  atIndex:i];
+			n += 3;
+			break;
+
+		case NSMoveToBezierPathElement:
+		case NSLineToBezierPathElement:
+			[path setAssociatedPoints:m_buffer + n
+							  atIndex:i];
+			n += 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	free(m_buffer);
+	[super dealloc];
 }
 
 #pragma mark -
@@ -7,12 +7,14 @@
 #import "DKDrawingView.h"
 #import "DKSelectionPDFView.h"
 #import "DKToolController.h"
+#import "DKEventRecording.h"
 #import "DKDrawKitMacros.h"
 
 #import "DKObjectStorageProtocol.h"
 #import "DKLinearObjectStorage.h"
 #import "DKBSPObjectStorage.h"
 #import "DKBSPDirectObjectStorage.h"
+#import "DKRTreeObjectStorage.h"
 
 #import "DKDrawing.h"
 #import "DKDrawing+Paper.h"
@@ -21,18 +23,24 @@
 #import "DKLayer.h"
 #import "DKLayer+Metadata.h"
 #import "DKLayerGroup.h"
+#import "DKLayerHitIndex.h"
+#import "DKLayerObjectIndex.h"
+#import "DKLayerVisibleSet.h"
 #import "DKObjectOwnerLayer.h"
 #import "DKObjectDrawingLayer.h"
 #import "DKObjectDrawingLayer+Alignment.h"
+#import "DKObjectDrawingLayer+BooleanOps.h"
 #import "DKObjectDrawingLayer+Duplication.h"
 
 #import "DKGridLayer.h"
 #import "DKGuideLayer.h"
 #import "DKDrawingInfoLayer.h"
 #import "DKImageOverlayLayer.h"
+#import "DKImageTilePyramid.h"
 
 #import "DKDrawableObject.h"
 #import "DKDrawableObject+Metadata.h"
+#import "DKDrawableObject+Dependencies.h"
 #import "DKDrawableShape.h"
 #import "DKReshapableShape.h"
 #import "DKDrawableShape+Hotspots.h"
@@ -99,7 +107,13 @@
 #import "GCZoomView.h"
 #import "DKUndoManager.h"
 #import "NSBezierPath+Editing.h"
+#import "DKPathElementIndex.h"
 #import "NSBezierPath+Geometry.h"
+#import "NSBezierPath+Packing.h"
+#import "NSBezierPath+Offset.h"
+#import "DKArcLengthTable.h"
+#import "DKDashedPath.h"
+#import "NSBezierPath+Combinatorial.h"
 #import "NSBezierPath+Text.h"
 #import "NSDictionary+DeepCopy.h"
 #import "NSShadow+Scaling.h"
@@ -108,6 +122,39 @@
 #import "NSMutableArray+DKAdditions.h"
 #import "NSImage+DKAdditions.h"
 #import "DKQuartzCache.h"
+#import "DKDrawingTileCache.h"
+#import "DKRenderedImageCache.h"
+#import "DKGlyphOutlineCache.h"
+#import "DKObjectSnapshot.h"
+#import "DKPathGeometry.h"
+#import "DKChunkedDrawingArchive.h"
+#import "DKDrawingRenderer.h"
+#import "DKDrawingSnapshot.h"
+#import "DKDrawingChangeFeed.h"
+#import "DKLayerCompositor.h"
+#import "DKDrawingThumbnail.h"
+#import "DKStyleInternTable.h"
+#import "DKStyleSwatchCache.h"
+#import "DKShadowCache.h"
+#import "DKCacheRegistry.h"
+#import "DKMetadataStore.h"
+#import "DKMetadataIndex.h"
+#import "DKSymbol.h"
+#import "DKSymbolInstance.h"
+#import "DKRenderStatistics.h"
+#import "DKMemoryFootprint.h"
+#import "DKPathIntersection.h"
+#import "DKPathAnimator.h"
+#import "DKFeedbackScheduler.h"
+#import "DKPDFResources.h"
+#import "DKLayerObjectBuilder.h"
+#import "DKTextIndex.h"
+#import "DKSVGExporter.h"
+#import "DKStorageTuner.h"
+#import "DKHitTestBatch.h"
+#import "DKScanlineEdgeTable.h"
+#import "DKBatchRenderer.h"
+#import "DKTrace.h"
 
 #ifdef qUseLogEvent
 #import "LogEvent.h"
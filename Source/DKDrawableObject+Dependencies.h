@@ -0,0 +1,61 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawableObject.h"
+
+/** @brief Links between objects whose geometry depends on other objects, such as a connector attached to the shapes at its ends.
+
+ Links between objects whose geometry depends on other objects, such as a connector attached to the shapes at its ends. An object added as a
+ dependent of another is sent -dependenciesDidChange: when the other object's bounds change, so it can reroute or refit itself. Only the
+ dependents of objects that actually changed are updated, not every linked object in the drawing.
+
+ Changes made on the main thread are collected and the dependents are updated once, before the run loop waits or a drawing is next drawn,
+ however many times their dependencies moved in between - dragging a selection of shapes updates each connector between them once per
+ mouse event, with all of the dependencies that moved. The updates are made in one pass, with the layers' display updates coalesced, so the
+ areas they dirty are redrawn together. If an update moves a dependent that itself has dependents, those are updated in a further pass.
+
+ Links are not retained in either direction and are not archived - the objects that make them, typically from hotspot delegates or
+ metadata, are expected to make them again when a drawing is opened. They are kept while an object is out of a layer, so that undoing its
+ deletion restores them, and are removed when either object is deallocated.
+*/
+@interface DKDrawableObject (Dependencies)
+
+/** @brief Updates the dependents of all objects that have changed since they were last updated
+
+ Called automatically before the main run loop waits, and by the drawing before it draws. Call this if
+ dependents must be up to date sooner.
+ */
++ (void)updatePendingDependents;
+
+/** @brief Makes <obj> a dependent of the receiver, so that it is updated when the receiver's geometry changes
+ @param obj another drawable
+ */
+- (void)addDependent:(DKDrawableObject*)obj;
+- (void)removeDependent:(DKDrawableObject*)obj;
+
+/** @brief Removes every link to and from the receiver */
+- (void)removeAllDependencies;
+
+- (NSSet*)dependents;
+- (NSSet*)dependencies;
+- (BOOL)hasDependents;
+
+/** @brief Notes that the receiver's geometry has changed, so that its dependents are updated
+
+ Called by -notifyGeometryChange:. Off the main thread the dependents are updated immediately.
+ */
+- (void)dependentsNeedUpdate;
+
+/** @brief Override to update the receiver when objects it depends on have changed
+
+ The default does nothing. Changes made here are redrawn with those of the other dependents being updated.
+ @param objects the dependencies whose geometry changed
+ */
+- (void)dependenciesDidChange:(NSSet*)objects;
+
+@end
+
+#define kDKDependencyMaximumPasses 8 // further passes for dependents of dependents; guards against cycles
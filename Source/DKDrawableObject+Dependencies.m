@@ -0,0 +1,207 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawableObject+Dependencies.h"
+#import "DKLayer.h"
+#import "LogEvent.h"
+
+static CFMutableSetRef sObjectsWithChangedGeometry = NULL; // retained, main thread only
+static CFRunLoopObserverRef sPendingDependentsObserver = NULL;
+
+static void pendingDependentsObserverCallback(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void* info)
+{
+#pragma unused(observer)
+#pragma unused(activity)
+#pragma unused(info)
+
+	[DKDrawableObject updatePendingDependents];
+}
+
+static void updateDependentsOfObjects(NSArray* changed)
+{
+	// gather every changed dependency of each dependent first, so each dependent is updated once per pass
+
+	CFDictionaryKeyCallBacks keyCallbacks = kCFTypeDictionaryKeyCallBacks;
+	keyCallbacks.equal = NULL;
+	keyCallbacks.hash = NULL;
+	CFMutableDictionaryRef updates = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &keyCallbacks, &kCFTypeDictionaryValueCallBacks);
+
+	NSEnumerator* iter = [changed objectEnumerator];
+	DKDrawableObject* obj;
+	DKDrawableObject* dependent;
+
+	while ((obj = [iter nextObject])) {
+		NSEnumerator* depIter = [[obj dependents] objectEnumerator];
+
+		while ((dependent = [depIter nextObject])) {
+			// an object out of its layer, such as one that has been deleted, need not follow until it is put back
+
+			if ([dependent layer] == nil)
+				continue;
+
+			NSMutableSet* objects = (NSMutableSet*)CFDictionaryGetValue(updates, dependent);
+
+			if (objects == nil) {
+				objects = [[NSMutableSet alloc] init];
+				CFDictionarySetValue(updates, dependent, objects);
+				[objects release];
+			}
+
+			[objects addObject:obj];
+		}
+	}
+
+	@try {
+		iter = [[(NSDictionary*)updates allKeys] objectEnumerator];
+
+		while ((dependent = [iter nextObject]))
+			[dependent dependenciesDidChange:(NSSet*)CFDictionaryGetValue(updates, dependent)];
+	}
+	@finally {
+		CFRelease(updates);
+	}
+}
+
+@implementation DKDrawableObject (Dependencies)
+
++ (void)updatePendingDependents
+{
+	if (sObjectsWithChangedGeometry == NULL || CFSetGetCount(sObjectsWithChangedGeometry) == 0 || ![NSThread isMainThread])
+		return;
+
+	NSUInteger pass = 0;
+
+	[DKLayer beginCoalescingDisplayUpdates];
+
+	@try {
+		while (CFSetGetCount(sObjectsWithChangedGeometry) > 0 && pass++ < kDKDependencyMaximumPasses) {
+			// take the objects out of the set first - dependents that move while being updated are added back for the next pass
+
+			NSArray* changed = [(NSSet*)sObjectsWithChangedGeometry allObjects];
+			CFSetRemoveAllValues(sObjectsWithChangedGeometry);
+
+			updateDependentsOfObjects(changed);
+		}
+
+		if (CFSetGetCount(sObjectsWithChangedGeometry) > 0) {
+			LogEvent_(kReactiveEvent, @"dependents still changing after %d passes - links may be cyclic", kDKDependencyMaximumPasses);
+			CFSetRemoveAllValues(sObjectsWithChangedGeometry);
+		}
+	}
+	@finally {
+		[DKLayer endCoalescingDisplayUpdates];
+	}
+}
+
+- (void)addDependent:(DKDrawableObject*)obj
+{
+	if (obj == nil || obj == self)
+		return;
+
+	// neither set retains - dealloc removes the links from both ends
+
+	if (mDependents == NULL)
+		mDependents = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+
+	if (obj->mDependencies == NULL)
+		obj->mDependencies = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+
+	CFSetAddValue(mDependents, obj);
+	CFSetAddValue(obj->mDependencies, self);
+}
+
+- (void)removeDependent:(DKDrawableObject*)obj
+{
+	if (obj == nil)
+		return;
+
+	if (mDependents != NULL)
+		CFSetRemoveValue(mDependents, obj);
+
+	if (obj->mDependencies != NULL)
+		CFSetRemoveValue(obj->mDependencies, self);
+}
+
+- (void)removeAllDependencies
+{
+	NSEnumerator* iter;
+	DKDrawableObject* obj;
+
+	if (mDependents != NULL) {
+		iter = [[(NSSet*)mDependents allObjects] objectEnumerator];
+
+		while ((obj = [iter nextObject]))
+			[self removeDependent:obj];
+
+		CFRelease(mDependents);
+		mDependents = NULL;
+	}
+
+	if (mDependencies != NULL) {
+		iter = [[(NSSet*)mDependencies allObjects] objectEnumerator];
+
+		while ((obj = [iter nextObject]))
+			[obj removeDependent:self];
+
+		CFRelease(mDependencies);
+		mDependencies = NULL;
+	}
+}
+
+- (NSSet*)dependents
+{
+	if (mDependents == NULL)
+		return [NSSet set];
+
+	return [NSSet setWithArray:[(NSSet*)mDependents allObjects]];
+}
+
+- (NSSet*)dependencies
+{
+	if (mDependencies == NULL)
+		return [NSSet set];
+
+	return [NSSet setWithArray:[(NSSet*)mDependencies allObjects]];
+}
+
+- (BOOL)hasDependents
+{
+	return mDependents != NULL && CFSetGetCount(mDependents) > 0;
+}
+
+- (void)dependentsNeedUpdate
+{
+	if (![self hasDependents])
+		return;
+
+	if (![NSThread isMainThread]) {
+		updateDependentsOfObjects([NSArray arrayWithObject:self]);
+		return;
+	}
+
+	// update the dependents once, before the run loop waits. The observer runs in the common modes so that dependents
+	// follow while an object is being dragged
+
+	if (sPendingDependentsObserver == NULL) {
+		// retained, but compared by identity
+
+		CFSetCallBacks callbacks = kCFTypeSetCallBacks;
+		callbacks.equal = NULL;
+		callbacks.hash = NULL;
+		sObjectsWithChangedGeometry = CFSetCreateMutable(kCFAllocatorDefault, 0, &callbacks);
+		sPendingDependentsObserver = CFRunLoopObserverCreate(kCFAllocatorDefault, kCFRunLoopBeforeWaiting, true, 0, pendingDependentsObserverCallback, NULL);
+		CFRunLoopAddObserver(CFRunLoopGetMain(), sPendingDependentsObserver, kCFRunLoopCommonModes);
+	}
+
+	CFSetAddValue(sObjectsWithChangedGeometry, self);
+}
+
+- (void)dependenciesDidChange:(NSSet*)objects
+{
+#pragma unused(objects)
+}
+
+@end
@@ -67,6 +67,12 @@ Note that the details of how metadata is stored changed in 1.0b6. Now, the metad
 - (NSSize)sizeForKey:(NSString*)key;
 
 - (void)updateMetadataKeys;
+
+/** @brief Replaces the metadata dictionary with a DKMetadataStore holding the same items, if it isn't one already
+
+ Called after the metadata is read from a file. Objects with many scalar metadata values use much less memory this way.
+ */
+- (void)compactMetadata;
 - (NSUInteger)metadataChecksum;
 
 - (void)metadataWillChangeKey:(NSString*)key;
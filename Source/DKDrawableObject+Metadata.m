@@ -6,6 +6,12 @@
 
 #import "DKDrawableObject+Metadata.h"
 #import "DKUndoManager.h"
+#import "DKMetadataStore.h"
+#import "DKMetadataIndex.h"
+#import "DKTextIndex.h"
+#import "DKDrawing.h"
+#import "DKDrawingChangeFeed.h"
+#import "DKObjectOwnerLayer.h"
 #import "LogEvent.h"
 
 NSString* kDKMetaDataUserInfoKey = @"kDKMetaDataUserInfoKey";
@@ -16,6 +22,16 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 
 #define USE_107_OR_LATER_SCHEMA 1
 
+static NSNumber* inlineMetadataNumber(NSDictionary* metadata, NSString* key)
+{
+	// scalar values held inline by the store can be read without making an item for them
+
+	if ([metadata isKindOfClass:[DKMetadataStore class]])
+		return [(DKMetadataStore*)metadata inlineNumberForKey:[key lowercaseString]];
+
+	return nil;
+}
+
 @implementation DKDrawableObject (Metadata)
 #pragma mark As a DKDrawableObject
 
@@ -48,8 +64,10 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 {
 	if ([self metadata] == nil && ![self locked]) {
 #if USE_107_OR_LATER_SCHEMA
-		[self setUserInfoObject:[NSMutableDictionary dictionary]
+		DKMetadataStore* store = [[DKMetadataStore alloc] init];
+		[self setUserInfoObject:store
 						 forKey:kDKMetaDataUserInfo107OrLaterKey];
+		[store release];
 #else
 		[self setUserInfoObject:[NSMutableDictionary dictionary]
 						 forKey:kDKMetaDataUserInfoKey];
@@ -286,6 +304,11 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 
 	// if using items, just return the item's data. This also searches the hierarchy but does not recognise keypaths
 
+	DKMetadataStore* store = (DKMetadataStore*)[self metadata];
+
+	if ([store isKindOfClass:[DKMetadataStore class]] && [store containsKey:[key lowercaseString]])
+		return [store metadataValueForKey:[key lowercaseString]];
+
 	return [[self metadataItemForKey:key] value];
 
 #else
@@ -305,6 +328,11 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 - (BOOL)hasMetadataForKey:(NSString*)key
 {
 #if USE_107_OR_LATER_SCHEMA
+	DKMetadataStore* store = (DKMetadataStore*)[self metadata];
+
+	if ([store isKindOfClass:[DKMetadataStore class]] && [store containsKey:[key lowercaseString]])
+		return YES;
+
 	return ([self metadataItemForKey:key] != nil);
 #else
 	return ([self metadataObjectForKey:key] != nil);
@@ -367,11 +395,12 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 		[[[self undoManager] prepareWithInvocationTarget:self] setMetadata:[self metadata]];
 
 	[self metadataWillChangeKey:nil];
-	NSMutableDictionary* md = [dict mutableCopy];
 #if USE_107_OR_LATER_SCHEMA
+	NSMutableDictionary* md = [[DKMetadataStore alloc] initWithDictionary:dict];
 	[self setUserInfoObject:md
 					 forKey:kDKMetaDataUserInfo107OrLaterKey];
 #else
+	NSMutableDictionary* md = [dict mutableCopy];
 	[self setUserInfoObject:md
 					 forKey:kDKMetaDataUserInfoKey];
 #endif
@@ -394,6 +423,11 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 - (CGFloat)floatValueForKey:(NSString*)key
 {
 #if USE_107_OR_LATER_SCHEMA
+	NSNumber* number = inlineMetadataNumber([self metadata], key);
+
+	if (number)
+		return [number doubleValue];
+
 	return [[self metadataItemForKey:key] doubleValue];
 #else
 	return [[self metadataObjectForKey:key] doubleValue];
@@ -414,6 +448,11 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 - (NSInteger)intValueForKey:(NSString*)key
 {
 #if USE_107_OR_LATER_SCHEMA
+	NSNumber* number = inlineMetadataNumber([self metadata], key);
+
+	if (number)
+		return [number integerValue];
+
 	return [[self metadataItemForKey:key] integerValue];
 #else
 	return [[self metadataObjectForKey:key] integerValue];
@@ -507,8 +546,13 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 	DKMetadataSchema schema = [self schema];
 	NSMutableDictionary* metaDict = nil;
 
-	if (schema == kDKMetadata107Schema)
-		return; // latest - nothing to do
+	if (schema == kDKMetadata107Schema) {
+		// latest - the metadata only needs to be moved into a compact store
+#if USE_107_OR_LATER_SCHEMA
+		[self compactMetadata];
+#endif
+		return;
+	}
 
 	if (schema == kDKMetadataOriginalSchema) {
 		// the original schema stored objects directly using case-sensitive keys. Migrate these to either the Mk2 or the 107 schema.
@@ -523,6 +567,7 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 		[self setUserInfoObject:metaDict
 						 forKey:kDKMetaDataUserInfo107OrLaterKey];
 		[metaDict release];
+		[self compactMetadata];
 #else
 		[self setUserInfoObject:metaDict
 						 forKey:kDKMetaDataUserInfoKey];
@@ -554,10 +599,25 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 		[self setUserInfoObject:metaDict
 						 forKey:kDKMetaDataUserInfo107OrLaterKey];
 		[metaDict release];
+		[self compactMetadata];
 	}
 #endif
 }
 
+- (void)compactMetadata
+{
+	// metadata read from a file is an ordinary dictionary of items, which is replaced by a store holding the same items
+
+	NSMutableDictionary* metaDict = [self userInfoObjectForKey:kDKMetaDataUserInfo107OrLaterKey];
+
+	if (metaDict != nil && ![metaDict isKindOfClass:[DKMetadataStore class]]) {
+		DKMetadataStore* store = [[DKMetadataStore alloc] initWithDictionary:metaDict];
+		[self setUserInfoObject:store
+						 forKey:kDKMetaDataUserInfo107OrLaterKey];
+		[store release];
+	}
+}
+
 - (NSUInteger)metadataChecksum
 {
 	// returns a number that is derived from the content of the metadata. If it changes, it means the metadata changed in some way. Don't interpret or store
@@ -573,11 +633,7 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 	id value;
 
 	while ((key = [iter nextObject])) {
-#if USE_107_OR_LATER_SCHEMA
-		value = [[self metadataItemForKey:key] value];
-#else
 		value = [self metadataObjectForKey:key];
-#endif
 		cs ^= [key hash] ^ [value hash];
 	}
 
@@ -602,6 +658,17 @@ NSString* kDKUndoableChangesUserDefaultsKey = @"DKMetadataChangesAreNotUndoable"
 
 - (void)metadataDidChangeKey:(NSString*)key
 {
+	// metadata is saved with the object but doesn't redraw it, so the layer has to be told here that the object needs writing again
+
+	[[self layer] noteChangeToObject:self];
+	[[[self drawing] metadataIndex] objectDidChangeMetadata:self
+													 forKey:key];
+	[[[self drawing] textIndex] objectDidChangeText:self];
+
+	if ([[self container] isKindOfClass:[DKObjectOwnerLayer class]])
+		[[[self drawing] changeFeed] object:self
+					   didChangeMetadataKey:key];
+
 	NSDictionary* userInfo = nil;
 	if (key)
 		userInfo = [NSDictionary dictionaryWithObject:[key lowercaseString]
@@ -10,7 +10,7 @@
 #import "DKRasterizerProtocol.h"
 #import "DKDrawableContainerProtocol.h"
 
-@class DKObjectOwnerLayer, DKStyle, DKDrawing, DKDrawingTool, DKShapeGroup;
+@class DKObjectOwnerLayer, DKStyle, DKDrawing, DKDrawingTool, DKShapeGroup, DKGeometrySnapshot, DKMemoryFootprint;
 
 /** @brief This object is responsible for the visual representation of the selection as well as any content.
 
@@ -35,19 +35,22 @@ to attach arbitrary data to any drawable object.
 	id<DKDrawableContainer> mContainerRef; // the immediate container of this object (layer, group or another drawable)
 	DKStyle* m_style; // the drawing style attached
 	id<DKObjectStorage> mStorageRef; // ref to the object's storage (DKStorableObject protocol)
-	NSMutableDictionary* mUserInfo; // user info including metadata is stored in this dictionary
-	NSSize m_mouseOffset; // used to track where mouse was relative to bounds
+	NSMutableDictionary* mUserInfo; // user info including metadata is stored in this dictionary, made when first set
 	NSUInteger mZIndex; // used by the DKStorableObject protocol
-	BOOL m_visible; // YES if visible
-	BOOL m_locked; // YES if locked
-	BOOL mLocationLocked; // YES if location is locked (independently of general lock)
-	BOOL m_snapEnable; // YES if mouse actions snap to grid/guides
-	BOOL m_inMouseOp; // YES while a mouse operation (drag) is in progress
-	BOOL m_mouseEverMoved; // used to set up undo for mouse operations
-	BOOL mMarked; // used by DKStorableObject protocol implementation
-	BOOL mGhosted; // YES if object is drawn ghosted
-	BOOL mIsHitTesting; // YES when drawContent is called for the purposes of hit-testing
-	NSMutableDictionary* mRenderingCache; // a dictionary to support general caching by renderers
+	NSUInteger mQueryStamp; // used by the DKStorableObject protocol
+	unsigned int m_visible : 1; // YES if visible
+	unsigned int m_locked : 1; // YES if locked
+	unsigned int mLocationLocked : 1; // YES if location is locked (independently of general lock)
+	unsigned int m_snapEnable : 1; // YES if mouse actions snap to grid/guides
+	unsigned int m_inMouseOp : 1; // YES while a mouse operation (drag) is in progress
+	unsigned int m_mouseEverMoved : 1; // used to set up undo for mouse operations
+	unsigned int mMarked : 1; // used by DKStorableObject protocol implementation
+	unsigned int mGhosted : 1; // YES if object is drawn ghosted
+	unsigned int mIsHitTesting : 1; // YES when drawContent is called for the purposes of hit-testing
+	unsigned int mHasRareState : 1; // YES if the object has an entry in the table of state few objects need, e.g. the mouse drag offset
+	NSMutableDictionary* mRenderingCache; // a dictionary to support general caching by renderers, made when first asked for
+	CFMutableSetRef mDependents; // objects updated when this one's geometry changes, not retained
+	CFMutableSetRef mDependencies; // objects this one is a dependent of, not retained
 @protected
 	BOOL m_showBBox : 1; // debugging - display the object's bounding box
 	BOOL m_clipToBBox : 1; // debugging - force clip region to the bbox
@@ -314,6 +317,31 @@ to attach arbitrary data to any drawable object.
 // drawing factors:
 
 - (void)drawContent;
+
+/** @brief Whether the object should be drawn from the drawing's rendered image cache, if it has one
+
+ The default returns YES for objects drawn to the screen whose style is expensive to render. Ghosted objects, objects being drawn
+ at low quality (e.g. while being dragged) or at a reduced quality tier, printing, and objects drawn off the main thread - the cache
+ isn't thread safe - are always rendered directly. Subclasses whose drawing depends on state other
+ than their geometry and style should override this to return NO.
+ @return YES to use cached images, NO to always render directly
+ */
+- (BOOL)wantsRenderedImageCaching;
+
+/** @brief The scale of the view the object is currently being drawn into
+ @return the view's scale, or 1.0 if not drawing into a DKDrawingView
+ */
+- (CGFloat)renderingScale;
+
+/** @brief Whether the object can be drawn together with others sharing its style
+
+ Batched drawing bypasses -drawContentWithSelectedState: and friends, so it's only possible for objects whose appearance comes entirely from
+ a batchable style (see -[DKStyle isSuitableForBatchedDrawing]). The default returns NO for ghosted objects and for any subclass that
+ reimplements one of the content drawing methods. Subclasses that override those methods without adding any drawing of their own can
+ override this to return YES again under the same conditions (see DKDrawableShape).
+ @return YES if the object may be drawn in a batch
+ */
+- (BOOL)isSuitableForBatchedDrawing;
 - (void)drawContentWithStyle:(DKStyle*)aStyle;
 - (void)drawGhostedContent;
 - (void)drawSelectedState;
@@ -333,6 +361,15 @@ to attach arbitrary data to any drawable object.
 - (NSBezierPath*)renderingPath;
 - (BOOL)useLowQualityDrawing;
 
+/** @brief Adds the object's outline, as shown by a view that draws outlines only, to a path
+
+ Called by the layer for each object it draws while the view draws outlines only (see -[DKDrawingView setDrawsOutlinesOnly:]), where all
+ of a layer's outlines are stroked at once. The default adds the rendering path, or the logical bounds if there isn't one. No style is
+ consulted. Subclasses override this to show something simpler or quicker to make.
+ @param path the path to add to, in drawing coordinates
+ */
+- (void)addOutlineToPath:(CGMutablePathRef)path;
+
 - (NSUInteger)geometryChecksum;
 
 // specialised drawing:
@@ -421,6 +458,15 @@ to attach arbitrary data to any drawable object.
  @return a transform */
 - (NSAffineTransform*)containerTransform;
 
+/** @brief Gets the container's transform into one the caller provides
+
+ The same transform as -containerTransform, but for an object directly in a layer, as nearly all are, it's known to be the
+ identity without making an NSAffineTransform. Use this in code that runs for every object drawn or hit-tested.
+ @param transform receives the container's transform
+ @return YES if the transform is other than the identity
+ */
+- (BOOL)getContainerTransform:(CGAffineTransform*)transform;
+
 /** @brief Apply the transform to the object
 
  The object's position, size and path are modified by the transform. This is called by the owning
@@ -429,6 +475,23 @@ to attach arbitrary data to any drawable object.
  */
 - (void)applyTransform:(NSAffineTransform*)transform;
 
+// geometry snapshots
+
+/** @brief Returns the state of the object's geometry, which can be put back later with -restoreGeometrySnapshot:
+
+ This is how DKObjectOwnerLayer undoes a bulk change in one step. The default returns nil, meaning that the object's geometry can't be
+ captured this way. Subclasses that store geometry must override both methods, and call super if they add to a superclass's geometry.
+ @return a snapshot, or nil
+ */
+- (DKGeometrySnapshot*)geometrySnapshot;
+
+/** @brief Puts the object's geometry back into the state recorded by -geometrySnapshot
+
+ Nothing is registered with the undo manager.
+ @param snapshot a snapshot made earlier by this object
+ */
+- (void)restoreGeometrySnapshot:(DKGeometrySnapshot*)snapshot;
+
 // bounding rects:
 
 - (NSRect)bounds;
@@ -511,13 +574,35 @@ to attach arbitrary data to any drawable object.
 
 /** @brief Test if a rect encloses any of the shape's actual pixels
 
- Note this can be an expensive way to test this - eliminate all obvious trivial cases first.
+ The object is first asked to test the rect geometrically (see -geometricHitTestRect:). Only if it can't is it rendered into a 1x1
+ bitmap to find out, which is much slower - eliminate all obvious trivial cases first.
  @param r the rect to test
  @return YES if at least one pixel enclosed by the rect, NO otherwise
  */
 - (BOOL)rectHitsPath:(NSRect)r;
 
-/** @brief Test a point against the offscreen bitmap representation of the shape
+/** @brief Test a rect against the object's geometry without rendering it
+
+ Called by -rectHitsPath: with the part of the rect that lies within the object's bounds. The default tests the rect against
+ the path returned by -hitTestPathWithOutlineDistance:filled:, or returns kDKHitTestUndetermined if there is none, so the
+ object is rendered to test it.
+ @param r the rect to test, in drawing coordinates
+ @return kDKHitTestHit or kDKHitTestMiss if known, otherwise kDKHitTestUndetermined
+ */
+- (DKHitTestResult)geometricHitTestRect:(NSRect)r;
+
+/** @brief The path whose outline and fill stand in for the object's hit-test rendering
+
+ Subclasses that know what their hit-test rendering paints return the path it paints, with how far either side of its outline
+ the stroke reaches and whether its area is filled. The default returns nil. Because the path is only read, it may be tested
+ on other threads (see DKHitTestBatch).
+ @param distance receives half the width of the stroke that is hit-tested, or 0 if the outline isn't stroked
+ @param filled receives whether the area the path encloses is hit-tested
+ @return the path, or nil if the object must be rendered to hit-test it
+ */
+- (NSBezierPath*)hitTestPathWithOutlineDistance:(CGFloat*)distance filled:(BOOL*)filled;
+
+/** @brief Test a point against the object's geometry, or failing that its offscreen bitmap representation
 
  Special case of the rectHitsPath call, which is now the fastest way to perform this test
  @param p the point to test
@@ -525,6 +610,15 @@ to attach arbitrary data to any drawable object.
  */
 - (BOOL)pointHitsPath:(NSPoint)p;
 
+/** @brief The distance from a point to the object's geometry, used by nearest-object queries that ask for exact distances
+
+ A point that hits the object is at 0. Otherwise this is the distance to the nearest point on the rendering path, or to the bounds if
+ the object has no path. It's never less than the distance to the bounds.
+ @param p the point to measure from
+ @return the distance
+ */
+- (CGFloat)distanceFromPoint:(NSPoint)p;
+
 /** @brief Is a hit-test in progress
 
  Drawing methods can check this to see if they can take shortcuts to save time when hit-testing.
@@ -601,7 +695,8 @@ to attach arbitrary data to any drawable object.
 
  The rendering cache is simply emptied. The contents of the cache are generally set by individual
  renderers to speed up drawing, and are not known to this object. The cache is invalidated by any
- change that alters the object's appearance - size, position, angle, style, etc.
+ change that alters the object's appearance - size, position, angle, style, etc. Any image of the object held by
+ the drawing's rendered image cache is also discarded.
  */
 - (void)invalidateRenderingCache;
 
@@ -613,6 +708,14 @@ to attach arbitrary data to any drawable object.
  */
 - (NSImage*)cachedImage;
 
+/** @brief Adds the memory used by the object to a footprint report
+
+ Counts the object, and adds the size of its instance variables, its user info and its rendering cache. Subclasses holding paths, text or
+ anything else of size override this to add it, calling super.
+ @param footprint the report
+ */
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint;
+
 // pasteboard:
 
 /** @brief Write additional data to the pasteboard specific to the object
@@ -645,6 +748,36 @@ to attach arbitrary data to any drawable object.
 - (IBAction)lockLocation:(id)sender;
 - (IBAction)unlockLocation:(id)sender;
 
+// splitting commands so that their geometry can be worked out concurrently when many objects are selected:
+
+/** @brief Captures what the geometric part of an action needs, so that it can be worked out on another thread
+
+ Called on the main thread by DKObjectDrawingLayer when an action is forwarded to many selected objects at once. The input is passed
+ to +resultOfConcurrentAction:withInput: on a worker thread while the main thread waits, so it must be immutable and independent of the
+ object, e.g. a copy of its path and the numbers the operation needs. The default returns nil, which means the action is invoked in
+ the ordinary way.
+ @param action the action's selector
+ @return the input, or nil if the action can't be split
+ */
+- (id)inputForConcurrentAction:(SEL)action;
+
+/** @brief Works out the geometric result of an action
+
+ May be called on any thread, and for several inputs at once, so it must use nothing but <input>.
+ @param action the action's selector
+ @param input what -inputForConcurrentAction: returned
+ @return the result, typically a new path, or nil if there's nothing to apply
+ */
++ (id)resultOfConcurrentAction:(SEL)action withInput:(id)input;
+
+/** @brief Completes an action using the result worked out on another thread
+
+ Called on the main thread, in place of invoking the action. The default invokes the action in the ordinary way.
+ @param result what +resultOfConcurrentAction:withInput: returned
+ @param action the action's selector
+ */
+- (void)applyResult:(id)result ofConcurrentAction:(SEL)action;
+
 #ifdef qIncludeGraphicDebugging
 // debugging:
 
@@ -671,6 +804,18 @@ enum {
 	kDKConvertToSubmenuTag = -55
 };
 
+/** @brief Whether <obj> is drawn purely by its style, with none of <baseClass>'s content drawing methods reimplemented by its own class
+
+ Used by implementations of -isSuitableForBatchedDrawing.
+ */
+BOOL DKDrawableUsesOnlyStyleDrawingOf(DKDrawableObject* obj, Class baseClass);
+
+/** @brief Whether <obj>'s class draws its content with <baseClass>'s methods, having reimplemented none of them
+
+ Used by implementations of -geometricHitTestRect:, which can only stand in for drawing they know about.
+ */
+BOOL DKDrawableDrawsContentAs(DKDrawableObject* obj, Class baseClass);
+
 // constant strings:
 
 extern NSString* kDKDrawableObjectPasteboardType;
@@ -11,20 +11,33 @@
 #import "DKObjectDrawingLayer.h"
 #import "NSDictionary+DeepCopy.h"
 #import "DKGeometryUtilities.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 #import "NSAffineTransform+DKAdditions.h"
 #import "DKDrawKitMacros.h"
 #import "NSColor+DKAdditions.h"
 #import "NSBezierPath+Combinatorial.h"
+#import "NSBezierPath+Editing.h"
+#import "NSBezierPath+Geometry.h"
+#import "DKLinearObjectStorage.h"
 #import "DKDrawableObject+Metadata.h"
+#import "DKDrawableObject+Dependencies.h"
 #import "DKDrawableContainerProtocol.h"
 #import "DKObjectDrawingLayer+Alignment.h"
 #import "DKAuxiliaryMenus.h"
 #import "DKSelectionPDFView.h"
 #import "DKPasteboardInfo.h"
+#import "DKKeyedUnarchiver.h"
+#import "DKStyleInternTable.h"
+#import "DKMetadataIndex.h"
+#import "DKTextIndex.h"
+#import "DKShapeGroup.h"
+#import "GCUndoManager.h"
+#import "DKMemoryFootprint.h"
+#import "DKDrawingView.h"
+#import "DKRenderedImageCache.h"
+#import <objc/runtime.h>
 
 #ifdef qIncludeGraphicDebugging
-#import "DKDrawingView.h"
 #include <tgmath.h>
 #endif
 
@@ -49,6 +62,40 @@ NSString* kDKDrawableCachedImageKey = @"DKD_Cached_Img";
 static NSColor* s_ghostColour = nil;
 static NSDictionary* s_interconversionTable = nil;
 
+// state that only objects being dragged or restyled need, kept out of the objects themselves so that the many that never need it don't pay
+// for it. Objects with an entry have mHasRareState set, so the table is only looked at for those.
+
+typedef struct {
+	NSSize mouseOffset; // where the mouse was relative to the location when a drag started
+	NSRect boundsBeforeStyleChange; // the bounds when the style said it was about to change
+} DKDrawableRareState;
+
+static CFMutableDictionaryRef sRareStates = NULL; // object -> malloc'd DKDrawableRareState, not retained
+
+@interface DKDrawableObject (Private)
+
+- (DKDrawableRareState*)rareStateCreatingIfNeeded:(BOOL)create;
+- (void)discardRareState;
+
+@end
+
+BOOL DKDrawableUsesOnlyStyleDrawingOf(DKDrawableObject* obj, Class baseClass)
+{
+	if ([obj isGhosted] || [obj isBeingHitTested] || ![[obj style] isSuitableForBatchedDrawing])
+		return NO;
+
+	return DKDrawableDrawsContentAs(obj, baseClass);
+}
+
+BOOL DKDrawableDrawsContentAs(DKDrawableObject* obj, Class baseClass)
+{
+	Class cl = [obj class];
+
+	return [cl instanceMethodForSelector:@selector(drawContentWithSelectedState:)] == [baseClass instanceMethodForSelector:@selector(drawContentWithSelectedState:)]
+		&& [cl instanceMethodForSelector:@selector(drawContent)] == [baseClass instanceMethodForSelector:@selector(drawContent)]
+		&& [cl instanceMethodForSelector:@selector(drawContentWithStyle:)] == [baseClass instanceMethodForSelector:@selector(drawContentWithStyle:)];
+}
+
 #pragma mark -
 @implementation DKDrawableObject
 #pragma mark As a DKDrawableObject
@@ -142,8 +189,26 @@ static NSDictionary* s_interconversionTable = nil;
 	NSData* pbdata = [pb dataForType:kDKDrawableObjectPasteboardType];
 	NSArray* objects = nil;
 
-	if (pbdata != nil)
-		objects = [NSKeyedUnarchiver unarchiveObjectWithData:pbdata];
+	if (pbdata != nil) {
+		if ([DKDrawing internsStylesWhenReading]) {
+			// collapse identical unshared styles among the pasted objects, as when reading a drawing
+
+			DKKeyedUnarchiver* unarch = [[DKKeyedUnarchiver alloc] initForReadingWithData:pbdata];
+			DKStyleInternTable* table = [[DKStyleInternTable alloc] init];
+
+			[unarch setStyleInternTable:table];
+
+			@try {
+				objects = [unarch decodeObjectForKey:NSKeyedArchiveRootObjectKey];
+				[unarch finishDecoding];
+			}
+			@finally {
+				[unarch release];
+				[table release];
+			}
+		} else
+			objects = [NSKeyedUnarchiver unarchiveObjectWithData:pbdata];
+	}
 
 	return objects;
 }
@@ -288,6 +353,8 @@ static NSDictionary* s_interconversionTable = nil;
 		m_visible = YES;
 		m_snapEnable = YES;
 
+		// the rendering cache and user info are only made when something is put in them
+
 		[self setStyle:aStyle];
 	}
 
@@ -350,6 +417,10 @@ static NSDictionary* s_interconversionTable = nil;
 			NSAssert1([aContainer conformsToProtocol:@protocol(DKDrawableContainer)], @"object passed (%@) does not conform to the DKDrawableContainer protocol", aContainer);
 		}
 
+		// any cached image belongs to the drawing the object is leaving
+
+		[[[self drawing] renderedImageCache] removeImageForObject:self];
+
 		mContainerRef = aContainer;
 
 		// make sure any attached style is aware of the undo manager used by the drawing/layers
@@ -426,7 +497,7 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)setMarked:(BOOL)markIt
 {
-	mMarked = markIt;
+	mMarked = (markIt != NO);
 }
 
 /** @brief Marks the object
@@ -439,6 +510,26 @@ static NSDictionary* s_interconversionTable = nil;
 	return mMarked;
 }
 
+/** @brief Sets the stamp of the last storage query that found this object
+
+ See DKObjectStorageProtocol.h. Not for client code.
+ @param stamp the query stamp
+ */
+- (void)setQueryStamp:(NSUInteger)stamp
+{
+	mQueryStamp = stamp;
+}
+
+/** @brief Returns the stamp of the last storage query that found this object
+
+ See DKObjectStorageProtocol.h. Not for client code.
+ @return the query stamp
+ */
+- (NSUInteger)queryStamp
+{
+	return mQueryStamp;
+}
+
 #pragma mark -
 #pragma mark - state
 
@@ -449,6 +540,8 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)setVisible:(BOOL)vis
 {
+	vis = (vis != NO);
+
 	if (m_visible != vis) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setVisible:m_visible];
 		m_visible = vis;
@@ -457,6 +550,9 @@ static NSDictionary* s_interconversionTable = nil;
 
 		[[self storage] objectDidChangeVisibility:self];
 
+		if ([[self container] isKindOfClass:[DKObjectOwnerLayer class]])
+			[(DKObjectOwnerLayer*)[self container] objectDidChangeVisibility:self];
+
 		[[self undoManager] setActionName:vis ? NSLocalizedString(@"Show", @"undo action for single object show") : NSLocalizedString(@"Hide", @"undo action for single object hide")];
 	}
 }
@@ -476,6 +572,8 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)setLocked:(BOOL)locked
 {
+	locked = (locked != NO);
+
 	if (m_locked != locked) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setLocked:m_locked];
 		m_locked = locked;
@@ -500,6 +598,8 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)setLocationLocked:(BOOL)lockLocation
 {
+	lockLocation = (lockLocation != NO);
+
 	if (mLocationLocked != lockLocation) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setLocationLocked:mLocationLocked];
 		mLocationLocked = lockLocation;
@@ -523,7 +623,7 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)setMouseSnappingEnabled:(BOOL)ems
 {
-	m_snapEnable = ems;
+	m_snapEnable = (ems != NO);
 }
 
 /** @brief Is mouse snapping enabled?
@@ -542,6 +642,8 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)setGhosted:(BOOL)ghosted
 {
+	ghosted = (ghosted != NO);
+
 	if (mGhosted != ghosted && ![self locked]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setGhosted:mGhosted];
 		mGhosted = ghosted;
@@ -570,17 +672,19 @@ static NSDictionary* s_interconversionTable = nil;
 
 - (void)setTrackingMouse:(BOOL)tracking
 {
-	m_inMouseOp = tracking;
+	m_inMouseOp = (tracking != NO);
 }
 
 - (NSSize)mouseDragOffset
 {
-	return m_mouseOffset;
+	DKDrawableRareState* rs = [self rareStateCreatingIfNeeded:NO];
+
+	return rs ? rs->mouseOffset : NSZeroSize;
 }
 
 - (void)setMouseDragOffset:(NSSize)offset
 {
-	m_mouseOffset = offset;
+	[self rareStateCreatingIfNeeded:YES]->mouseOffset = offset;
 }
 
 - (BOOL)mouseHasMovedSinceStartOfTracking
@@ -590,7 +694,7 @@ static NSDictionary* s_interconversionTable = nil;
 
 - (void)setMouseHasMovedSinceStartOfTracking:(BOOL)moved
 {
-	m_mouseEverMoved = moved;
+	m_mouseEverMoved = (moved != NO);
 }
 
 #pragma mark -
@@ -684,8 +788,6 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)objectWasAddedToLayer:(DKObjectOwnerLayer*)aLayer
 {
-#pragma unused(aLayer)
-
 	// begin observing style changes
 
 	[[NSNotificationCenter defaultCenter] addObserver:self
@@ -696,6 +798,13 @@ static NSDictionary* s_interconversionTable = nil;
 											 selector:@selector(styleDidChange:)
 												 name:kDKStyleDidChangeNotification
 											   object:[self style]];
+
+	// groups pass this on to the objects they contain, which aren't indexed
+
+	if ([self container] == aLayer) {
+		[[[aLayer drawing] metadataIndex] addObject:self];
+		[[[aLayer drawing] textIndex] addObject:self];
+	}
 }
 
 /** @brief The object was removed from the layer
@@ -706,11 +815,12 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)objectWasRemovedFromLayer:(DKObjectOwnerLayer*)aLayer
 {
-#pragma unused(aLayer)
-
 	[[NSNotificationCenter defaultCenter] removeObserver:self
 													name:nil
 												  object:[self style]];
+
+	[[[aLayer drawing] metadataIndex] removeObject:self];
+	[[[aLayer drawing] textIndex] removeObject:self];
 }
 
 #pragma mark -
@@ -742,7 +852,12 @@ static NSDictionary* s_interconversionTable = nil;
 		// draw the object's actual content
 
 		mIsHitTesting = NO;
-		[self drawContent];
+
+		DKRenderedImageCache* imageCache = [[self drawing] renderedImageCache];
+
+		if (imageCache == nil || ![self wantsRenderedImageCaching] || ![imageCache drawObject:self
+																			  atScale:[self renderingScale]])
+			[self drawContent];
 
 		// draw the selection highlight - other code should have already checked -objectMayBecomeSelected and refused to
 		// select the object but if for some reason this wasn't done, this at least supresses the highlight
@@ -782,6 +897,45 @@ static NSDictionary* s_interconversionTable = nil;
 	[self drawContentWithStyle:[self style]];
 }
 
+/** @brief Whether the object should be drawn from the drawing's rendered image cache, if it has one
+
+ The default returns YES for objects drawn to the screen whose style is expensive to render. Ghosted objects, objects being drawn
+ at low quality (e.g. while being dragged) or at a reduced quality tier, printing, and objects drawn off the main thread - the cache
+ isn't thread safe - are always rendered directly. Subclasses whose drawing depends on state other
+ than their geometry and style should override this to return NO.
+ @return YES to use cached images, NO to always render directly
+ */
+- (BOOL)wantsRenderedImageCaching
+{
+	return [NSThread isMainThread] && [NSGraphicsContext currentContextDrawingToScreen] && ![self isGhosted] && ![self useLowQualityDrawing] && [DKStyle drawingQualityTier] == kDKDrawingQualityFull && [[self style] isExpensiveToRender];
+}
+
+/** @brief Whether the object can be drawn together with others sharing its style
+
+ Batched drawing bypasses -drawContentWithSelectedState: and friends, so it's only possible for objects whose appearance comes entirely from
+ a batchable style (see -[DKStyle isSuitableForBatchedDrawing]). The default returns NO for ghosted objects and for any subclass that
+ reimplements one of the content drawing methods. Subclasses that override those methods without adding any drawing of their own can
+ override this to return YES again under the same conditions (see DKDrawableShape).
+ @return YES if the object may be drawn in a batch
+ */
+- (BOOL)isSuitableForBatchedDrawing
+{
+	return DKDrawableUsesOnlyStyleDrawingOf(self, [DKDrawableObject class]);
+}
+
+/** @brief The scale of the view the object is currently being drawn into
+ @return the view's scale, or 1.0 if not drawing into a DKDrawingView
+ */
+- (CGFloat)renderingScale
+{
+	NSView* view = [self currentView];
+
+	if ([view isKindOfClass:[DKDrawingView class]])
+		return [(DKDrawingView*)view scale];
+	else
+		return 1.0;
+}
+
 /** @brief Draw the content of the object but using a specific style, which might not be the one attached
  @param aStyle a valid style object, or nil to use the object's current style
  */
@@ -872,6 +1026,15 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)notifyVisualChange
 {
+	// the object's appearance may have changed in ways its geometry checksum doesn't capture (e.g. text), so its cached image can't be reused
+
+	[[[self drawing] renderedImageCache] removeImageForObject:self];
+
+	// groups cache their content, of which this is part
+
+	if ([(id)[self container] respondsToSelector:@selector(groupedObjectDidChange:)])
+		[(id)[self container] groupedObjectDidChange:self];
+
 	if ([self layer])
 		[[self layer] drawable:self
 			needsDisplayInRect:[self bounds]];
@@ -883,6 +1046,7 @@ static NSDictionary* s_interconversionTable = nil;
  */
 - (void)notifyStatusChange
 {
+	[[self layer] noteChangeToObject:self];
 	[[self drawing] objectDidNotifyStatusChange:self];
 }
 
@@ -901,7 +1065,19 @@ static NSDictionary* s_interconversionTable = nil;
 		[self invalidateRenderingCache];
 		[[self storage] object:self
 			didChangeBoundsFrom:oldBounds];
+
+		if ([[self container] isKindOfClass:[DKObjectOwnerLayer class]])
+			[(DKObjectOwnerLayer*)[self container] object:self
+									  didChangeBoundsFrom:oldBounds];
+
+		DKObjectDrawingLayer* odl = (DKObjectDrawingLayer*)[self container];
+
+		if ([odl isKindOfClass:[DKObjectDrawingLayer class]] && [odl isSelectedObject:self])
+			[odl selectedObject:self
+				didChangeBoundsFrom:oldBounds];
+
 		[self updateRulerMarkers];
+		[self dependentsNeedUpdate];
 	}
 }
 
@@ -1068,6 +1244,12 @@ static NSDictionary* s_interconversionTable = nil;
 																object:self
 															  userInfo:userInfo];
 
+		// only the layer's own objects are indexed by style, not those inside groups
+
+		if ([[self container] isKindOfClass:[DKObjectOwnerLayer class]])
+			[(DKObjectOwnerLayer*)[self container] object:self
+										willChangeStyleTo:newStyle];
+
 		[m_style styleWillBeRemoved:self];
 		[m_style release];
 		m_style = [newStyle retain];
@@ -1078,6 +1260,7 @@ static NSDictionary* s_interconversionTable = nil;
 			[m_style setUndoManager:[self undoManager]];
 
 		[m_style styleWasAttached:self];
+		[self invalidateRenderingCache];
 		[self notifyStatusChange];
 		[self notifyVisualChange];
 		[self notifyGeometryChange:oldBounds]; // in case the style change affects the bounds
@@ -1101,14 +1284,12 @@ static NSDictionary* s_interconversionTable = nil;
 	return m_style;
 }
 
-static NSRect s_oldBounds;
-
 /** @brief Called when the attached style is about to change
  */
 - (void)styleWillChange:(NSNotification*)note
 {
 	if ([note object] == [self style]) {
-		s_oldBounds = [self bounds];
+		[self rareStateCreatingIfNeeded:YES]->boundsBeforeStyleChange = [self bounds];
 		[self notifyVisualChange];
 	}
 }
@@ -1118,8 +1299,26 @@ static NSRect s_oldBounds;
 - (void)styleDidChange:(NSNotification*)note
 {
 	if ([note object] == [self style]) {
+		// rasterizers cache what they derive from the object's path, which may depend on the settings that changed
+
+		// the style's changes are posted once per turn of the run loop, so this may not have been told before the first of them if it
+		// took on the style in between - in that case its bounds were already up to date when it did
+
+		DKDrawableRareState* rs = [self rareStateCreatingIfNeeded:NO];
+		NSRect oldBounds = (rs == NULL || NSIsEmptyRect(rs->boundsBeforeStyleChange)) ? [self bounds] : rs->boundsBeforeStyleChange;
+
+		// the entry isn't needed any more unless a drag is under way
+
+		if (rs != NULL) {
+			if ([self isTrackingMouse])
+				rs->boundsBeforeStyleChange = NSZeroRect;
+			else
+				[self discardRareState];
+		}
+
+		[self invalidateRenderingCache];
 		[self notifyVisualChange];
-		[self notifyGeometryChange:s_oldBounds];
+		[self notifyGeometryChange:oldBounds];
 	}
 }
 
@@ -1180,7 +1379,7 @@ static NSRect s_oldBounds;
 
 		while ((st = [iter nextObject])) {
 			if ([[st uniqueKey] isEqualToString:[[self style] uniqueKey]]) {
-				LogEvent_(kStateEvent, @"replacing style with %@ '%@'", st, [st name]);
+				DKTrace_(kDKTraceState, @"replacing style with %@ '%@'", st, [st name]);
 
 				[self setStyle:st];
 				break;
@@ -1386,11 +1585,13 @@ static NSRect s_oldBounds;
 
  The rendering cache is simply emptied. The contents of the cache are generally set by individual
  renderers to speed up drawing, and are not known to this object. The cache is invalidated by any
- change that alters the object's appearance - size, position, angle, style, etc.
+ change that alters the object's appearance - size, position, angle, style, etc. Any image of the object held by
+ the drawing's rendered image cache is also discarded.
  */
 - (void)invalidateRenderingCache
 {
 	[mRenderingCache removeAllObjects];
+	[[[self drawing] renderedImageCache] removeImageForObject:self];
 }
 
 /** @brief Returns an image of the object representing its current appearance at 100% scale.
@@ -1401,17 +1602,28 @@ static NSRect s_oldBounds;
  */
 - (NSImage*)cachedImage
 {
-	NSImage* img = [mRenderingCache objectForKey:kDKDrawableCachedImageKey];
+	NSImage* img = [[self renderingCache] objectForKey:kDKDrawableCachedImageKey];
 
 	if (img == nil) {
 		img = [self swatchImageWithSize:NSZeroSize];
-		[mRenderingCache setObject:img
-							forKey:kDKDrawableCachedImageKey];
+		[[self renderingCache] setObject:img
+								  forKey:kDKDrawableCachedImageKey];
 	}
 
 	return img;
 }
 
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	[footprint addObject];
+	[footprint addBytes:class_getInstanceSize([self class])
+			 toCategory:kDKFootprintObjects];
+	[footprint addBytes:[mUserInfo undoCost]
+			 toCategory:kDKFootprintMetadata];
+	[footprint addBytes:[mRenderingCache undoCost]
+			 toCategory:kDKFootprintRenderCaches];
+}
+
 #pragma mark -
 
 /** @brief Set the relative offset of the object's anchor point
@@ -1470,6 +1682,16 @@ static NSRect s_oldBounds;
 	[self setSize:size];
 }
 
+- (DKGeometrySnapshot*)geometrySnapshot
+{
+	return nil;
+}
+
+- (void)restoreGeometrySnapshot:(DKGeometrySnapshot*)snapshot
+{
+#pragma unused(snapshot)
+}
+
 #pragma mark -
 #pragma mark - drawing tool information
 
@@ -1645,7 +1867,7 @@ static NSRect s_oldBounds;
  */
 - (NSSize)mouseOffset
 {
-	return m_mouseOffset;
+	return [self mouseDragOffset];
 }
 
 #pragma mark -
@@ -1751,7 +1973,8 @@ static NSRect s_oldBounds;
 
 /** @brief Test if a rect encloses any of the shape's actual pixels
 
- Note this can be an expensive way to test this - eliminate all obvious trivial cases first.
+ The object is first asked to test the rect geometrically (see -geometricHitTestRect:). Only if it can't is it rendered into a 1x1
+ bitmap to find out, which is much slower - eliminate all obvious trivial cases first.
  @param r the rect to test
  @return YES if at least one pixel enclosed by the rect, NO otherwise
  */
@@ -1767,6 +1990,13 @@ static NSRect s_oldBounds;
 
 		if (NSEqualRects(ir, [self bounds]))
 			return YES;
+
+		// most objects can work out the answer from their paths far more cheaply than rendering them
+
+		DKHitTestResult geometric = [self geometricHitTestRect:ir];
+
+		if (geometric != kDKHitTestUndetermined)
+			return (geometric == kDKHitTestHit);
 		else {
 			// this method scales the whole hit rect directly down into a 1x1 bitmap context - if it ends up opaque, it's hit. If transparent, it's not.
 			// this method suggested by Ken Ferry (Apple), as it avoids the need for writable access to NSBimapImageRep and so should
@@ -1812,14 +2042,20 @@ static NSRect s_oldBounds;
 			else
 			 */
 			{
-				// draw the object but without any shadows - this both speeds up the hit testing which doesn't care about shadows
-				// and avoids a nasty crashing bug in Quartz.
-
-				BOOL drawShadows = [DKStyle setWillDrawShadows:NO];
-				[self drawContentInRect:srcRect
-							   fromRect:ir
-							  withStyle:nil];
-				[DKStyle setWillDrawShadows:drawShadows];
+				// draw the object but without any shadows - the hit-test pass doesn't draw them. This both speeds up the hit testing
+				// which doesn't care about shadows and avoids a nasty crashing bug in Quartz.
+
+				[DKStyle beginRenderPass:kDKRenderPassHitTest
+							  lowQuality:[self useLowQualityDrawing]];
+
+				@try {
+					[self drawContentInRect:srcRect
+								   fromRect:ir
+								  withStyle:nil];
+				}
+				@finally {
+					[DKStyle endRenderPass];
+				}
 			}
 			mIsHitTesting = NO;
 
@@ -1831,7 +2067,48 @@ static NSRect s_oldBounds;
 	return hit;
 }
 
-/** @brief Test a point against the offscreen bitmap representation of the shape
+/** @brief Test a rect against the object's geometry without rendering it
+
+ Tests the rect against the path returned by -hitTestPathWithOutlineDistance:filled:. Without one it can't tell, so the object
+ is rendered to find out.
+ @param r the rect to test, in drawing coordinates
+ @return kDKHitTestHit or kDKHitTestMiss, or kDKHitTestUndetermined if there's no hit-test path
+ */
+- (DKHitTestResult)geometricHitTestRect:(NSRect)r
+{
+	CGFloat distance = 0;
+	BOOL filled = NO;
+	NSBezierPath* path = [self hitTestPathWithOutlineDistance:&distance
+													   filled:&filled];
+
+	if (path == nil)
+		return kDKHitTestUndetermined;
+
+	if (filled && [path filledAreaIntersectsRect:r])
+		return kDKHitTestHit;
+
+	if (distance > 0 && [path outlineIntersectsRect:r
+									 withinDistance:distance])
+		return kDKHitTestHit;
+
+	return kDKHitTestMiss;
+}
+
+/** @brief The path whose outline and fill stand in for the object's hit-test rendering
+
+ The default has none.
+ @param distance receives half the width of the stroke that is hit-tested, or 0 if the outline isn't stroked
+ @param filled receives whether the area the path encloses is hit-tested
+ @return nil
+ */
+- (NSBezierPath*)hitTestPathWithOutlineDistance:(CGFloat*)distance filled:(BOOL*)filled
+{
+#pragma unused(distance, filled)
+
+	return nil;
+}
+
+/** @brief Test a point against the object's geometry, or failing that its offscreen bitmap representation
 
  Special case of the rectHitsPath call, which is now the fastest way to perform this test
  @param p the point to test
@@ -1846,6 +2123,33 @@ static NSRect s_oldBounds;
 		return NO;
 }
 
+- (CGFloat)distanceFromPoint:(NSPoint)p
+{
+	NSRect br = [self bounds];
+	CGFloat boundsDistance = DKObjectStorageDistanceToRect(p, br);
+
+	if ([self pointHitsPath:p])
+		return 0;
+
+	NSBezierPath* path = [self renderingPath];
+
+	if (path == nil || [path isEmpty])
+		return boundsDistance;
+
+	// the tolerance reaches across the whole of the bounds, so the nearest point on the path is always found
+
+	NSPoint np;
+	CGFloat t;
+
+	if ([path elementHitByPoint:p
+					  tolerance:boundsDistance + hypot(NSWidth(br), NSHeight(br)) + 1.0
+						 tValue:&t
+				   nearestPoint:&np] < 1)
+		return boundsDistance;
+
+	return MAX(hypot(np.x - p.x, np.y - p.y), boundsDistance);
+}
+
 /** @brief Is a hit-test in progress
 
  Drawing methods can check this to see if they can take shortcuts to save time when hit-testing.
@@ -1865,7 +2169,7 @@ static NSRect s_oldBounds;
  */
 - (void)setBeingHitTested:(BOOL)hitTesting
 {
-	mIsHitTesting = hitTesting;
+	mIsHitTesting = (hitTesting != NO);
 }
 
 #pragma mark -
@@ -1882,8 +2186,7 @@ static NSRect s_oldBounds;
 {
 #pragma unused(evt, partcode)
 
-	m_mouseOffset.width = mp.x - [self location].x;
-	m_mouseOffset.height = mp.y - [self location].y;
+	[self setMouseDragOffset:NSMakeSize(mp.x - [self location].x, mp.y - [self location].y)];
 	[self setMouseHasMovedSinceStartOfTracking:NO];
 	[self setTrackingMouse:YES];
 }
@@ -2254,6 +2557,49 @@ static NSRect s_oldBounds;
 	}
 }
 
+#pragma mark -
+#pragma mark - splitting commands to work out their geometry concurrently
+
+/** @brief Captures what the geometric part of an action needs, so that it can be worked out on another thread
+
+ The default can't split any action.
+ @param action the action's selector
+ @return nil
+ */
+- (id)inputForConcurrentAction:(SEL)action
+{
+#pragma unused(action)
+
+	return nil;
+}
+
+/** @brief Works out the geometric result of an action
+ @param action the action's selector
+ @param input what -inputForConcurrentAction: returned
+ @return nil
+ */
++ (id)resultOfConcurrentAction:(SEL)action withInput:(id)input
+{
+#pragma unused(action)
+#pragma unused(input)
+
+	return nil;
+}
+
+/** @brief Completes an action using the result worked out on another thread
+
+ The default invokes the action in the ordinary way.
+ @param result what +resultOfConcurrentAction:withInput: returned
+ @param action the action's selector
+ */
+- (void)applyResult:(id)result ofConcurrentAction:(SEL)action
+{
+#pragma unused(result)
+
+	[self performSelector:action
+			   withObject:nil];
+}
+
 #ifdef qIncludeGraphicDebugging
 #pragma mark -
 #pragma mark - debugging
@@ -2303,6 +2649,7 @@ static NSRect s_oldBounds;
 - (void)dealloc
 {
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[self removeAllDependencies];
 
 	if (m_style != nil) {
 		[m_style styleWillBeRemoved:self];
@@ -2310,9 +2657,17 @@ static NSRect s_oldBounds;
 	}
 	[mUserInfo release];
 	[mRenderingCache release];
+	[self discardRareState];
 	[super dealloc];
 }
 
+- (NSUInteger)undoCost
+{
+	// the style is shared and the rendering cache can be rebuilt, so only the user info counts
+
+	return [super undoCost] + [mUserInfo undoCost];
+}
+
 - (id)init
 {
 	return [self initWithStyle:[DKStyle defaultStyle]];
@@ -2361,7 +2716,7 @@ static NSRect s_oldBounds;
 - (id)initWithCoder:(NSCoder*)coder
 {
 	NSAssert(coder != nil, @"Expected valid coder");
-	//	LogEvent_(kFileEvent, @"decoding drawable object %@", self);
+	//	DKTrace_(kDKTraceFile, @"decoding drawable object %@", self);
 
 	self = [self initWithStyle:nil];
 	if (self != nil) {
@@ -2550,6 +2905,30 @@ static NSRect s_oldBounds;
 		return ct;
 }
 
+- (BOOL)getContainerTransform:(CGAffineTransform*)transform
+{
+	static IMP sContainerTransformIMP = NULL;
+	static IMP sLayerRenderingTransformIMP = NULL;
+
+	if (sContainerTransformIMP == NULL) {
+		sContainerTransformIMP = [DKDrawableObject instanceMethodForSelector:@selector(containerTransform)];
+		sLayerRenderingTransformIMP = [DKObjectOwnerLayer instanceMethodForSelector:@selector(renderingTransform)];
+	}
+
+	// a layer's rendering transform is always the identity, so unless something has been overridden, there's nothing to make
+
+	id container = [self container];
+
+	if ([self methodForSelector:@selector(containerTransform)] == sContainerTransformIMP
+		&& (container == nil || [container methodForSelector:@selector(renderingTransform)] == sLayerRenderingTransformIMP)) {
+		*transform = CGAffineTransformIdentity;
+		return NO;
+	}
+
+	*transform = [[self containerTransform] CGAffineTransform];
+	return !CGAffineTransformIsIdentity(*transform);
+}
+
 /** @brief Return the path that represents the final user-visible path of the drawn object
 
  The default method does nothing. Subclasses should override this and supply the appropriate path,
@@ -2562,6 +2941,22 @@ static NSRect s_oldBounds;
 	return nil;
 }
 
+/** @brief Adds the object's outline, as shown by a view that draws outlines only, to a path
+ @param path the path to add to, in drawing coordinates
+ */
+- (void)addOutlineToPath:(CGMutablePathRef)path
+{
+	NSBezierPath* rp = [self renderingPath];
+
+	if ([rp elementCount] > 0) {
+		CGPathRef qp = [rp newQuartzPath];
+
+		CGPathAddPath(path, NULL, qp);
+		CGPathRelease(qp);
+	} else
+		CGPathAddRect(path, NULL, NSRectToCGRect([self logicalBounds]));
+}
+
 /** @brief Return hint to rasterizers that low quality drawing should be used
 
  Part of the informal rendering protocol used by rasterizers
@@ -2598,7 +2993,56 @@ static NSRect s_oldBounds;
 
 - (NSMutableDictionary*)renderingCache
 {
+	// renderers only ask for the cache to look in or store what they've worked out, so it's made the first time one does
+
+	if (mRenderingCache == nil)
+		mRenderingCache = [[NSMutableDictionary alloc] init];
+
 	return mRenderingCache;
 }
 
+#pragma mark -
+#pragma mark - rarely used state
+
+- (DKDrawableRareState*)rareStateCreatingIfNeeded:(BOOL)create
+{
+	// returns the object's entry in the side table, making a zeroed one if asked to. Returns NULL if there is none and none was asked for
+
+	if (!mHasRareState && !create)
+		return NULL;
+
+	DKDrawableRareState* rs;
+
+	@synchronized([DKDrawableObject class])
+	{
+		if (sRareStates == NULL)
+			sRareStates = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+
+		rs = (DKDrawableRareState*)CFDictionaryGetValue(sRareStates, self);
+
+		if (rs == NULL && create) {
+			rs = calloc(1, sizeof(DKDrawableRareState));
+			CFDictionarySetValue(sRareStates, self, rs);
+			mHasRareState = YES;
+		}
+	}
+
+	return rs;
+}
+
+- (void)discardRareState
+{
+	if (!mHasRareState)
+		return;
+
+	@synchronized([DKDrawableObject class])
+	{
+		DKDrawableRareState* rs = (DKDrawableRareState*)CFDictionaryGetValue(sRareStates, self);
+
+		CFDictionaryRemoveValue(sRareStates, self);
+		free(rs);
+		mHasRareState = NO;
+	}
+}
+
 @end
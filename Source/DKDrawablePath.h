@@ -8,6 +8,8 @@
 
 @class DKDrawableShape;
 @class DKKnob;
+@class DKPathElementIndex;
+@class DKPathGeometry;
 
 // editing modes:
 
@@ -53,6 +55,8 @@ maintain the concept of rotation or scale - it just is what it is.
 	NSInteger m_editPathMode;
 	CGFloat m_freehandEpsilon;
 	BOOL m_extending;
+	DKPathElementIndex* m_elementIndex;
+	DKPathGeometry* mPathGeometry; // immutable form of the path, shared with copies and snapshots
 }
 
 // convenience constructors:
@@ -137,6 +141,31 @@ maintain the concept of rotation or scale - it just is what it is.
 
 - (void)setPath:(NSBezierPath*)path;
 - (NSBezierPath*)path;
+
+/** @brief Replaces the path without recording undo or notifying the change
+
+ For subclasses whose path is derived from parameters of their own, whose setters record undo and notify the change themselves. Passing
+ nil discards the path until the subclass next makes it.
+ @param path a path, or nil
+ */
+- (void)setPathWithoutUndo:(NSBezierPath*)path;
+
+/** @brief Returns an immutable form of the path
+
+ Made when first asked for and kept until the path next changes. Copies of the object and its geometry snapshots share it rather
+ than copying the path, and only make an editable path from it if they need one.
+ @return the path's geometry
+ */
+- (DKPathGeometry*)pathGeometry;
+
+/** @brief Returns the path to draw, simplified to within a given error
+
+ Dense polylines are drawn from one of the simplified forms kept by the path's geometry while they're zoomed out far enough for the
+ difference not to show. Rasterizers ask for this rather than -renderingPath when drawing to the screen.
+ @param maxError the furthest the path drawn may stray from the path, in drawing coordinates
+ @return the path to draw, in drawing coordinates
+ */
+- (NSBezierPath*)renderingPathWithMaximumError:(CGFloat)maxError;
 - (void)drawControlPointsOfPath:(NSBezierPath*)path usingKnobs:(DKKnob*)knobs;
 
 /** @brief Return the length of the path
@@ -231,6 +260,20 @@ maintain the concept of rotation or scale - it just is what it is.
 - (DKDrawablePathJoinResult)wouldJoin:(DKDrawablePath*)anotherPath tolerance:(CGFloat)tol;
 - (DKDrawablePathJoinResult)join:(DKDrawablePath*)anotherPath tolerance:(CGFloat)tol makeColinear:(BOOL)colin;
 
+/** @brief Joins as many of a set of open paths together at their ends as possible
+
+ Ends are found using a grid as big as the tolerance, so the cost grows with the number of paths rather than the number of pairs of them.
+ Each maximal chain of paths meeting end to end is made into one path, given to the earliest path of the chain in the array; a chain that
+ comes back to its start is closed. The paths absorbed are not removed from their layer - see -[DKObjectDrawingLayer joinPathsInArray:
+ tolerance:makeColinear:].
+ @param paths the paths to join
+ @param tol a value used to determine if end points are placed sufficiently close to be joinable
+ @param colin if YES, and the joined segments are curves, this adjusts the control points of the curve
+ @param absorbed if not NULL, receives the paths that were joined onto others
+ @return the paths that have others joined to them
+ */
++ (NSArray*)joinPaths:(NSArray*)paths tolerance:(CGFloat)tol makeColinear:(BOOL)colin absorbedPaths:(NSArray**)absorbed;
+
 /** @brief Splits a path into two paths at a specific point
 
  The new path has the same style and user info as the original, but is not added to the layer
@@ -5,6 +5,8 @@
 */
 
 #import "DKDrawablePath.h"
+#import "DKArcLengthTable.h"
+#import "DKPathElementIndex.h"
 #import "DKShapeGroup.h"
 #import "DKDrawing.h"
 #import "DKStyle.h"
@@ -15,7 +17,14 @@
 #import "NSBezierPath+Geometry.h"
 #import "GCInfoFloater.h"
 #import "CurveFit.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
+#import "NSAffineTransform+DKAdditions.h"
+#import "GCUndoManager.h"
+#import "DKObjectSnapshot.h"
+#import "DKPathGeometry.h"
+#import "NSBezierPath+Offset.h"
+#import "NSBezierPath+Packing.h"
+#import "DKMemoryFootprint.h"
 #include <tgmath.h>
 
 #pragma mark Global Vars
@@ -26,12 +35,110 @@ NSString* kDKPathOnPathHitDetectionPriorityDefaultsKey = @"kDKPathOnPathHitDetec
 #pragma mark Static Vars
 static CGFloat sAngleConstraint = 0.261799387799; // 15 degrees
 static NSColor* sInfoWindowColour = nil;
+static NSString* kDKConcurrentActionPathKey = @"path";
+static NSString* kDKConcurrentActionAmountKey = @"amount";
+
+// the outline of the stroke of <path>, worked out analytically unless it's dashed, which only Quartz can stroke
+
+static NSBezierPath* strokeOutlineOfPath(NSBezierPath* path)
+{
+	NSInteger dashCount = 0;
+
+	[path getLineDash:NULL
+				count:&dashCount
+				phase:NULL];
+
+	return (dashCount > 0) ? [path strokedPath] : [path strokeOutlinePath];
+}
+
+// makes the curves meeting at a join - element <indx> ending at the join and <next> leaving it - smooth, if they are both curves
+
+static void colineariseJoin(NSBezierPath* path, NSInteger indx, NSInteger next)
+{
+	NSPoint elp[6];
+	NSBezierPathElement el = [path elementAtIndex:indx
+								 associatedPoints:elp];
+	NSBezierPathElement fl = [path elementAtIndex:next
+								 associatedPoints:&elp[3]];
+
+	if ((el == fl) && (el == NSCurveToBezierPathElement)) {
+		[NSBezierPath colineariseVertex:&elp[1]
+									cpA:&elp[1]
+									cpB:&elp[3]];
+
+		[path setAssociatedPoints:elp
+						  atIndex:indx];
+		[path setAssociatedPoints:&elp[3]
+						  atIndex:next];
+	}
+}
+
+// one end of an open path in a batch join, bucketed by the cell of a grid as big as the join tolerance that it lies in
+
+typedef struct {
+	int64_t cell;
+	NSPoint p;
+	NSUInteger end; // the path's index * 2, plus 1 for its last point
+} DKPathEnd;
+
+static int64_t cellKey(int32_t cx, int32_t cy)
+{
+	return ((int64_t)cx << 32) | (uint32_t)cy;
+}
+
+static int32_t cellCoordinate(CGFloat v, CGFloat cellSize)
+{
+	CGFloat c = floor(v / cellSize);
+
+	return (int32_t)MAX(MIN(c, (CGFloat)(INT32_MAX - 1)), (CGFloat)(INT32_MIN + 1));
+}
+
+static int comparePathEnds(const void* a, const void* b)
+{
+	const DKPathEnd* ea = a;
+	const DKPathEnd* eb = b;
+
+	if (ea->cell != eb->cell)
+		return (ea->cell < eb->cell) ? -1 : 1;
+
+	return (ea->end < eb->end) ? -1 : (ea->end > eb->end);
+}
+
+// the index of the first end in the sorted ends in <cell> or a later one
+
+static NSUInteger firstEndInCell(const DKPathEnd* ends, NSUInteger count, int64_t cell)
+{
+	NSUInteger lo = 0, hi = count;
+
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+
+		if (ends[mid].cell < cell)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
 
 @interface DKDrawablePath (Private)
 
 /**  */
 - (void)showLengthInfo:(CGFloat)dist atPoint:(NSPoint)p;
 
+/** @brief Returns an index of the path's elements for hit-testing, building it if necessary */
+- (DKPathElementIndex*)elementIndex;
+
+/** @brief Makes the geometry the object's path, without undo - the editable path is made from it when next needed */
+- (void)setPathGeometryWithoutUndo:(DKPathGeometry*)geometry;
+
+/** @brief A copy of the path with the style's stroke attributes, less the difference between its strokes, ready to be outlined */
+- (NSBezierPath*)pathForOutlining;
+
+/** @brief Sets the outline of the stroke as the path, replacing the style with a fill of the stroke's colour */
+- (void)setOutlinePath:(NSBezierPath*)path actionName:(NSString*)actionName;
+
 @end
 
 #pragma mark -
@@ -182,13 +289,15 @@ static NSColor* sInfoWindowColour = nil;
 - (void)setPath:(NSBezierPath*)path
 {
 	if (path != m_path) {
-		//	LogEvent_(kStateEvent, @"setting path: %@", path );
+		//	DKTrace_(kDKTraceState, @"setting path: %@", path );
 
 		NSRect oldBounds = [self bounds];
 
 		[self notifyVisualChange];
 
-		NSBezierPath* oldPath = [m_path copy];
+		// a path that is still only shared geometry needn't be copied for undo, just made editable
+
+		NSBezierPath* oldPath = (m_path != nil) ? [m_path copy] : [[mPathGeometry bezierPath] retain];
 		[[self undoManager] registerUndoWithTarget:self
 										  selector:@selector(setPath:)
 											object:oldPath];
@@ -207,9 +316,47 @@ static NSColor* sInfoWindowColour = nil;
  */
 - (NSBezierPath*)path
 {
+	// a copy or restored snapshot shares its geometry until the path is actually asked for
+
+	if (m_path == nil && mPathGeometry != nil)
+		m_path = [[mPathGeometry bezierPath] retain];
+
 	return m_path;
 }
 
+/** @brief Returns an immutable form of the path
+
+ Made when first asked for and kept until the path next changes. Copies of the object and its geometry snapshots share it rather
+ than copying the path, and only make an editable path from it if they need one.
+ @return the path's geometry
+ */
+- (DKPathGeometry*)pathGeometry
+{
+	if (mPathGeometry == nil)
+		mPathGeometry = [[DKPathGeometry alloc] initWithBezierPath:m_path];
+
+	return mPathGeometry;
+}
+
+- (void)setPathGeometryWithoutUndo:(DKPathGeometry*)geometry
+{
+	[geometry retain];
+	[mPathGeometry release];
+	mPathGeometry = geometry;
+
+	[m_path release];
+	m_path = nil;
+}
+
+- (void)setPathWithoutUndo:(NSBezierPath*)path
+{
+	[m_elementIndex release];
+	m_elementIndex = nil;
+
+	[self setPathGeometryWithoutUndo:nil];
+	m_path = [path retain];
+}
+
 /** @brief Returns the actual path drawn when the object is rendered
 
  Called by -drawSelectedState
@@ -378,12 +525,14 @@ static NSColor* sInfoWindowColour = nil;
 
 /** @brief Return the length of the path
 
- Length is accurately computed by summing the segment distances.
+ Length is accurately computed by summing the segment distances. The measurement is kept in the rendering cache
+ until the path changes.
  @return the path's length
  */
 - (CGFloat)length
 {
-	return [[self path] length];
+	return [[DKArcLengthTable arcLengthTableForPath:[self path]
+											  cache:[self renderingCache]] length];
 }
 
 /** @brief Return the length along the path for a given point
@@ -523,7 +672,7 @@ static NSColor* sInfoWindowColour = nil;
  */
 - (DKDrawablePathJoinResult)join:(DKDrawablePath*)anotherPath tolerance:(CGFloat)tol makeColinear:(BOOL)colin
 {
-	//	LogEvent_(kReactiveEvent, @"joining path, tolerance = %f", tol );
+	//	DKTrace_(kDKTraceReactive, @"joining path, tolerance = %f", tol );
 
 	NSBezierPath* ap = [anotherPath path];
 	DKDrawablePathJoinResult result = kDKPathNoJoin;
@@ -577,26 +726,10 @@ static NSColor* sInfoWindowColour = nil;
 					result = kDKPathOtherPathWasAppended;
 				}
 
-				if (colin) {
-					// colinearise the join if the segments joined are both curvetos
+				// colinearise the join if the segments joined are both curvetos
 
-					NSPoint elp[6];
-					NSBezierPathElement el = [newPath elementAtIndex:ec
-													associatedPoints:elp];
-					NSBezierPathElement fl = [newPath elementAtIndex:ec + 1
-													associatedPoints:&elp[3]];
-
-					if ((el == fl) && (el == NSCurveToBezierPathElement)) {
-						[NSBezierPath colineariseVertex:&elp[1]
-													cpA:&elp[1]
-													cpB:&elp[3]];
-
-						[newPath setAssociatedPoints:elp
-											 atIndex:ec];
-						[newPath setAssociatedPoints:&elp[3]
-											 atIndex:ec + 1];
-					}
-				}
+				if (colin)
+					colineariseJoin(newPath, ec, ec + 1);
 
 				// if the other ends are also aligned, close the path
 
@@ -610,39 +743,211 @@ static NSColor* sInfoWindowColour = nil;
 
 					result = kDKPathBothEndsJoined;
 
-					if (colin) {
-						// colinearise the join if the segments joined are both curvetos
+					if (colin)
+						colineariseJoin(newPath, [newPath elementCount] - 3, 1);
+				}
+
+				[self setPath:newPath];
+				[newPath release];
+
+				return result;
+			}
+		}
+	}
+
+	return kDKPathNoJoin;
+}
+
+/** @brief Joins as many of a set of open paths together at their ends as possible
+
+ The ends are bucketed in a grid of cells as big as the tolerance, so each end is compared only with those in the cells around it, and
+ each end is joined to the nearest free end of another path within the tolerance, those of earlier paths first. The paths are then
+ followed from end to end into chains, each made into one path in a single pass, which is given to the earliest path of the chain. A
+ chain that comes back to where it started is closed. Closed paths are left as they are.
+ @param paths the paths to join
+ @param tol the furthest apart two ends may be and still be joined
+ @param colin if YES, the curves meeting at each join are made smooth
+ @param absorbed if not NULL, receives the paths that were joined onto others, and so can be discarded
+ @return the paths that now have the chains of paths joined to them
+ */
++ (NSArray*)joinPaths:(NSArray*)paths tolerance:(CGFloat)tol makeColinear:(BOOL)colin absorbedPaths:(NSArray**)absorbed
+{
+	NSMutableArray* joined = [NSMutableArray array];
+	NSMutableArray* absorbedPaths = [NSMutableArray array];
+	NSUInteger i, n = [paths count];
+
+	if (absorbed)
+		*absorbed = absorbedPaths;
+
+	if (n < 2)
+		return joined;
+
+	CGFloat cellSize = MAX(tol, (CGFloat)0.001);
+	DKPathEnd* ends = malloc(2 * n * sizeof(DKPathEnd));
+	NSPoint* points = malloc(2 * n * sizeof(NSPoint));
+	NSUInteger* links = malloc(2 * n * sizeof(NSUInteger)); // the end each end is joined to, or NSNotFound
+	NSUInteger* chain = malloc(n * sizeof(NSUInteger)); // the end each path of a chain is entered by
+	BOOL* isOpen = calloc(n, sizeof(BOOL));
+	BOOL* visited = calloc(n, sizeof(BOOL));
+	NSUInteger e, endCount = 0;
+
+	for (i = 0; i < n; ++i) {
+		NSBezierPath* bp = [[paths objectAtIndex:i] path];
+
+		links[2 * i] = links[2 * i + 1] = NSNotFound;
+
+		if ([bp elementCount] < 2 || [bp isPathClosed])
+			continue;
+
+		isOpen[i] = YES;
+		points[2 * i] = [bp firstPoint];
+		points[2 * i + 1] = [bp lastPoint];
+
+		for (e = 2 * i; e < 2 * i + 2; ++e) {
+			ends[endCount].cell = cellKey(cellCoordinate(points[e].x, cellSize), cellCoordinate(points[e].y, cellSize));
+			ends[endCount].p = points[e];
+			ends[endCount].end = e;
+			++endCount;
+		}
+	}
+
+	qsort(ends, endCount, sizeof(DKPathEnd), comparePathEnds);
+
+	for (e = 0; e < 2 * n; ++e) {
+		if (!isOpen[e / 2] || links[e] != NSNotFound)
+			continue;
+
+		NSPoint p = points[e];
+		int32_t cx = cellCoordinate(p.x, cellSize);
+		int32_t cy = cellCoordinate(p.y, cellSize);
+		NSUInteger best = NSNotFound;
+		CGFloat bestDist = tol;
+		int32_t dx, dy;
+
+		for (dx = -1; dx <= 1; ++dx) {
+			for (dy = -1; dy <= 1; ++dy) {
+				int64_t cell = cellKey(cx + dx, cy + dy);
+				NSUInteger j;
 
-						ec = [newPath elementCount] - 3;
+				for (j = firstEndInCell(ends, endCount, cell); j < endCount && ends[j].cell == cell; ++j) {
+					NSUInteger f = ends[j].end;
 
-						NSPoint elp[6];
-						NSBezierPathElement el = [newPath elementAtIndex:ec
-														associatedPoints:elp];
-						NSBezierPathElement fl = [newPath elementAtIndex:1
-														associatedPoints:&elp[3]];
+					if (f / 2 == e / 2 || links[f] != NSNotFound)
+						continue;
 
-						if ((el == fl) && (el == NSCurveToBezierPathElement)) {
-							[NSBezierPath colineariseVertex:&elp[1]
-														cpA:&elp[1]
-														cpB:&elp[3]];
+					CGFloat dist = hypot(ends[j].p.x - p.x, ends[j].p.y - p.y);
 
-							[newPath setAssociatedPoints:elp
-												 atIndex:ec];
-							[newPath setAssociatedPoints:&elp[3]
-												 atIndex:1];
-						}
+					if (dist < bestDist || (dist == bestDist && f < best)) {
+						best = f;
+						bestDist = dist;
 					}
 				}
+			}
+		}
 
-				[self setPath:newPath];
-				[newPath release];
+		if (best != NSNotFound) {
+			links[e] = best;
+			links[best] = e;
+		}
+	}
 
-				return result;
+	// each path is joined at most once at each end, so the joins form simple chains. Those with a free end are followed from it first,
+	// leaving only the ones that come back round to where they started
+
+	NSUInteger pass;
+
+	for (pass = 0; pass < 2; ++pass) {
+		for (i = 0; i < n; ++i) {
+			if (!isOpen[i] || visited[i])
+				continue;
+
+			NSUInteger start;
+
+			if (pass == 1)
+				start = 2 * i;
+			else if (links[2 * i] == NSNotFound)
+				start = 2 * i;
+			else if (links[2 * i + 1] == NSNotFound)
+				start = 2 * i + 1;
+			else
+				continue;
+
+			NSUInteger count = 0, first = i;
+			BOOL closed = NO;
+
+			e = start;
+
+			while (YES) {
+				visited[e / 2] = YES;
+				chain[count++] = e;
+				first = MIN(first, e / 2);
+
+				// leave by the other end of the path, into the next one
+
+				NSUInteger next = links[e ^ 1];
+
+				if (next == NSNotFound)
+					break;
+
+				if (visited[next / 2]) {
+					closed = YES;
+					break;
+				}
+
+				e = next;
 			}
+
+			if (count < 2)
+				continue;
+
+			// the whole chain is made in one path, each piece running in the direction the chain enters it
+
+			DKDrawablePath* master = [paths objectAtIndex:first];
+			NSBezierPath* newPath = nil;
+			NSUInteger k;
+
+			for (k = 0; k < count; ++k) {
+				DKDrawablePath* piece = [paths objectAtIndex:chain[k] / 2];
+				NSBezierPath* bp = [piece path];
+
+				if (chain[k] & 1)
+					bp = [bp bezierPathByReversingPath];
+
+				if (newPath == nil)
+					newPath = [[bp copy] autorelease];
+				else {
+					NSInteger ec = [newPath elementCount] - 1;
+
+					[newPath appendBezierPathRemovingInitialMoveToPoint:bp];
+
+					if (colin)
+						colineariseJoin(newPath, ec, ec + 1);
+				}
+
+				if (piece != master)
+					[absorbedPaths addObject:piece];
+			}
+
+			if (closed) {
+				[newPath closePath];
+
+				if (colin)
+					colineariseJoin(newPath, [newPath elementCount] - 3, 1);
+			}
+
+			[master setPath:newPath];
+			[joined addObject:master];
 		}
 	}
 
-	return kDKPathNoJoin;
+	free(ends);
+	free(points);
+	free(links);
+	free(chain);
+	free(isOpen);
+	free(visited);
+
+	return joined;
 }
 
 /** @brief Converts each subpath in the current path to a separate object
@@ -757,7 +1062,7 @@ static NSColor* sInfoWindowColour = nil;
 	p = ip = [self snappedMousePoint:initialPoint
 					 withControlFlag:NO];
 
-	LogEvent_(kReactiveEvent, @"entering path create loop");
+	DKTrace_(kDKTraceReactive, @"entering path create loop");
 
 	NSBezierPath* path = [NSBezierPath bezierPath];
 
@@ -911,7 +1216,7 @@ static NSColor* sInfoWindowColour = nil;
 	}
 
 finish:
-	LogEvent_(kReactiveEvent, @"ending path create loop");
+	DKTrace_(kDKTraceReactive, @"ending path create loop");
 
 	[NSApp discardEventsMatchingMask:NSAnyEventMask
 						 beforeEvent:theEvent];
@@ -941,7 +1246,7 @@ finish:
 	p = ip = [self snappedMousePoint:initialPoint
 					 withControlFlag:NO];
 
-	LogEvent_(kReactiveEvent, @"entering line create loop");
+	DKTrace_(kDKTraceReactive, @"entering line create loop");
 
 	NSBezierPath* path = [NSBezierPath bezierPath];
 
@@ -1024,7 +1329,7 @@ finish:
 		[self notifyVisualChange];
 	}
 
-	LogEvent_(kReactiveEvent, @"ending line create loop");
+	DKTrace_(kDKTraceReactive, @"ending line create loop");
 
 	[NSApp discardEventsMatchingMask:NSAnyEventMask
 						 beforeEvent:theEvent];
@@ -1053,7 +1358,7 @@ finish:
 	p = ip = [self snappedMousePoint:initialPoint
 					 withControlFlag:NO];
 
-	LogEvent_(kReactiveEvent, @"entering poly create loop");
+	DKTrace_(kDKTraceReactive, @"entering poly create loop");
 
 	// if we are extending an existing path, start with that path and its open endpoint. Otherwise start from scratch
 
@@ -1179,7 +1484,7 @@ finish:
 	}
 
 finish:
-	LogEvent_(kReactiveEvent, @"ending poly create loop");
+	DKTrace_(kDKTraceReactive, @"ending poly create loop");
 
 	//[NSEvent stopPeriodicEvents];
 
@@ -1199,7 +1504,8 @@ finish:
  */
 - (void)freehandCreateLoop:(NSPoint)initialPoint
 {
-	// this works by building a freehand vector path (line segments) then smoothing it using curve fitting at the end.
+	// this works by curve fitting the sampled points as they arrive. Finished segments are kept and only the last few are refitted each time,
+	// so the path is already smooth when the mouse goes up. Without curve fitting, the path is simply made of the line segments between the points.
 
 	NSEvent* theEvent;
 	NSInteger mask = NSLeftMouseDownMask | NSLeftMouseUpMask | NSLeftMouseDraggedMask | NSPeriodicMask | NSScrollWheelMask;
@@ -1209,13 +1515,17 @@ finish:
 
 	p = lastPoint = initialPoint;
 
-	LogEvent_(kReactiveEvent, @"entering freehand create loop");
+	DKTrace_(kDKTraceReactive, @"entering freehand create loop");
 
 	NSBezierPath* path = [NSBezierPath bezierPath];
 
 	[path moveToPoint:p];
 	[self setPath:path];
 
+#ifdef qUseCurveFit
+	CurveFitStream* fit = curveFitStreamCreate(p, m_freehandEpsilon);
+#endif
+
 	while (loop) {
 		theEvent = [NSApp nextEventMatchingMask:mask
 									  untilDate:[NSDate distantFuture]
@@ -1237,10 +1547,11 @@ finish:
 
 		case NSLeftMouseDragged:
 			if (!NSEqualPoints(p, lastPoint)) {
-				[path lineToPoint:p];
 #ifdef qUseCurveFit
-				[self setPath:curveFitPath(path, m_freehandEpsilon)];
+				curveFitStreamAddPoint(fit, p);
+				[self setPath:curveFitStreamPath(fit)];
 #else
+				[path lineToPoint:p];
 				[self invalidateCache];
 				[self notifyVisualChange];
 #endif
@@ -1264,7 +1575,11 @@ finish:
 		[self notifyVisualChange];
 	}
 
-	LogEvent_(kReactiveEvent, @"ending freehand create loop");
+#ifdef qUseCurveFit
+	curveFitStreamFree(fit);
+#endif
+
+	DKTrace_(kDKTraceReactive, @"ending freehand create loop");
 
 	[NSApp discardEventsMatchingMask:NSAnyEventMask
 						 beforeEvent:theEvent];
@@ -1305,7 +1620,7 @@ finish:
 						 withControlFlag:NO];
 	phase = 0; // set radius
 
-	LogEvent_(kReactiveEvent, @"entering arc create loop");
+	DKTrace_(kDKTraceReactive, @"entering arc create loop");
 
 	NSBezierPath* path = [NSBezierPath bezierPath];
 
@@ -1419,7 +1734,7 @@ finish:
 		[self notifyVisualChange];
 	}
 
-	LogEvent_(kReactiveEvent, @"ending arc create loop");
+	DKTrace_(kDKTraceReactive, @"ending arc create loop");
 
 	[NSApp discardEventsMatchingMask:NSAnyEventMask
 						 beforeEvent:theEvent];
@@ -1538,6 +1853,21 @@ finish:
 	}
 }
 
+/** @brief Returns an index of the path's elements for hit-testing
+
+ The index is built the first time it's needed after the path changes, and is discarded by -notifyVisualChange.
+ @return the element index
+ */
+- (DKPathElementIndex*)elementIndex
+{
+	if (m_elementIndex == nil || [m_elementIndex elementCount] != [[self path] elementCount]) {
+		[m_elementIndex release];
+		m_elementIndex = [[DKPathElementIndex alloc] initWithPath:[self path]];
+	}
+
+	return m_elementIndex;
+}
+
 #pragma mark -
 
 /** @brief Delete the point from the path with the given part code
@@ -1592,7 +1922,9 @@ finish:
 	CGFloat tol = MAX(4.0, [[self style] maxStrokeWidth]);
 	NSInteger indx = [[self path] elementHitByPoint:loc
 										  tolerance:tol
-											 tValue:NULL];
+											 tValue:NULL
+									   nearestPoint:NULL
+									   elementIndex:[self elementIndex]];
 
 	if (indx != -1)
 		return [self pathDeleteElementAtIndex:indx];
@@ -1723,7 +2055,7 @@ finish:
 	DKDrawablePath* newPath = [self copy];
 
 	if (distance != 0.0) {
-		NSBezierPath* np = [[self path] paralleloidPathWithOffset2:distance];
+		NSBezierPath* np = [[self path] offsetPathWithDistance:distance];
 
 		if (smooth)
 			np = [np bezierPathByInterpolatingPath:1.0];
@@ -1795,7 +2127,13 @@ finish:
 {
 #pragma unused(sender)
 
-	NSBezierPath* path = [self path];
+	[self setOutlinePath:strokeOutlineOfPath([self pathForOutlining])
+			  actionName:NSLocalizedString(@"Convert To Outline", @"undo string for convert to outline")];
+}
+
+- (NSBezierPath*)pathForOutlining
+{
+	NSBezierPath* path = [[[self path] copy] autorelease];
 
 	CGFloat sw = [[self style] maxStrokeWidthDifference] / 2.0;
 	[[self style] applyStrokeAttributesToPath:path];
@@ -1803,7 +2141,16 @@ finish:
 	if (sw > 0.0)
 		[path setLineWidth:[path lineWidth] - sw];
 
-	path = [path strokedPath];
+	return path;
+}
+
+- (void)setOutlinePath:(NSBezierPath*)path actionName:(NSString*)actionName
+{
+	if (path == nil || [path isEmpty])
+		return;
+
+	CGFloat sw = [[self style] maxStrokeWidthDifference] / 2.0;
+
 	[self setPath:path];
 
 	// try to keep the appearance similar by creating a fill style with the same colour as the original's stroke
@@ -1828,7 +2175,7 @@ finish:
 		[self setStyle:newStyle];
 	}
 
-	[[self undoManager] setActionName:NSLocalizedString(@"Convert To Outline", @"undo string for convert to outline")];
+	[[self undoManager] setActionName:actionName];
 }
 
 /** @brief Replaces the object with new objects, one for each subpath in the original
@@ -1862,42 +2209,10 @@ finish:
 {
 #pragma unused(sender)
 
-	NSBezierPath* path = [self path];
-
-	CGFloat sw = [[self style] maxStrokeWidthDifference] / 2.0;
-	[[self style] applyStrokeAttributesToPath:path];
-
-	if (sw > 0.0)
-		[path setLineWidth:[path lineWidth] - sw];
-
 	CGFloat roughness = [[self style] maxStrokeWidth] / 4.0;
 
-	path = [path bezierPathWithRoughenedStrokeOutline:roughness];
-	[self setPath:path];
-
-	// try to keep the appearance similar by creating a fill style with the same colour as the original's stroke
-
-	NSArray* rs = [[self style] renderersOfClass:[DKStroke class]];
-	if ([rs count] > 0) {
-		DKStroke* stroke = [rs lastObject];
-		DKStroke* firstStroke = [rs objectAtIndex:0];
-		NSColor* strokeColour = nil;
-
-		if (firstStroke != stroke)
-			strokeColour = [firstStroke colour];
-
-		DKStyle* newStyle = [DKStyle styleWithFillColour:[stroke colour]
-											strokeColour:strokeColour];
-
-		stroke = [[newStyle renderersOfClass:[DKStroke class]] lastObject];
-
-		if (stroke)
-			[stroke setWidth:sw];
-
-		[self setStyle:newStyle];
-	}
-
-	[[self undoManager] setActionName:NSLocalizedString(@"Roughen Path", @"undo string for roughen path")];
+	[self setOutlinePath:[[self pathForOutlining] bezierPathWithRoughenedStrokeOutline:roughness]
+			  actionName:NSLocalizedString(@"Roughen Path", @"undo string for roughen path")];
 }
 
 #ifdef qUseCurveFit
@@ -1976,6 +2291,103 @@ finish:
 	}
 }
 
+/** @brief Captures what the geometric part of an action needs, so that it can be worked out on another thread
+
+ Outlining, roughening, smoothing and curve fitting are split, unless a subclass implements the action itself.
+ @param action the action's selector
+ @return a dictionary holding a copy of the path and the amount the operation uses, or nil
+ */
+- (id)inputForConcurrentAction:(SEL)action
+{
+	if ([self locked] || [[self class] instanceMethodForSelector:action] != [DKDrawablePath instanceMethodForSelector:action])
+		return nil;
+
+	NSBezierPath* path = nil;
+	CGFloat amount = 0;
+
+	if (action == @selector(convertToOutline:))
+		path = [self pathForOutlining];
+	else if (action == @selector(roughenPath:)) {
+		path = [self pathForOutlining];
+		amount = [[self style] maxStrokeWidth] / 4.0;
+	} else if (action == @selector(curveFit:)) {
+		path = [[[self path] copy] autorelease];
+		amount = MIN([path bounds].size.width, [path bounds].size.height) / 1000.0;
+	}
+#ifdef qUseCurveFit
+	else if (action == @selector(smoothPath:))
+		path = [[[self path] copy] autorelease];
+	else if (action == @selector(smoothPathMore:)) {
+		path = [[[self path] copy] autorelease];
+		amount = [self freehandSmoothing] * 4.0;
+	}
+#endif
+
+	if (path == nil || [path isEmpty])
+		return nil;
+
+	return [NSDictionary dictionaryWithObjectsAndKeys:path, kDKConcurrentActionPathKey, [NSNumber numberWithDouble:amount], kDKConcurrentActionAmountKey, nil];
+}
+
+/** @brief Works out the new path for an outlining, roughening, smoothing or curve fitting action
+ @param action the action's selector
+ @param input what -inputForConcurrentAction: returned
+ @return the new path, or nil
+ */
++ (id)resultOfConcurrentAction:(SEL)action withInput:(id)input
+{
+	NSBezierPath* path = [input objectForKey:kDKConcurrentActionPathKey];
+	CGFloat amount = [[input objectForKey:kDKConcurrentActionAmountKey] doubleValue];
+
+	if (action == @selector(convertToOutline:))
+		return strokeOutlineOfPath(path);
+	else if (action == @selector(roughenPath:))
+		return [path bezierPathWithRoughenedStrokeOutline:amount];
+	else if (action == @selector(curveFit:))
+		return smartCurveFitPath(path, amount, kDKDefaultCornerThreshold);
+#ifdef qUseCurveFit
+	else if (action == @selector(smoothPath:))
+		return [path bezierPathByInterpolatingPath:1.0];
+	else if (action == @selector(smoothPathMore:))
+		return smartCurveFitPath(path, amount, 1.2);
+#endif
+
+	return nil;
+}
+
+/** @brief Sets the path worked out on another thread, as the action would have
+ @param result the new path
+ @param action the action's selector
+ */
+- (void)applyResult:(id)result ofConcurrentAction:(SEL)action
+{
+	if (result == nil)
+		return;
+
+	if (action == @selector(convertToOutline:))
+		[self setOutlinePath:result
+				  actionName:NSLocalizedString(@"Convert To Outline", @"undo string for convert to outline")];
+	else if (action == @selector(roughenPath:))
+		[self setOutlinePath:result
+				  actionName:NSLocalizedString(@"Roughen Path", @"undo string for roughen path")];
+	else if (action == @selector(curveFit:)) {
+		[self setPath:result];
+		[[self undoManager] setActionName:NSLocalizedString(@"Curve Fit", @"undo action for Curve Fit")];
+	}
+#ifdef qUseCurveFit
+	else if (action == @selector(smoothPath:)) {
+		[self setPath:result];
+		[[self undoManager] setActionName:NSLocalizedString(@"Smooth Path", @"smooth path action name")];
+	} else if (action == @selector(smoothPathMore:)) {
+		[self setPath:result];
+		[[self undoManager] setActionName:NSLocalizedString(@"Smooth More", @"smooth more action name")];
+	}
+#endif
+	else
+		[super applyResult:result
+			ofConcurrentAction:action];
+}
+
 /** @brief Reverses the direction of the object's path
 
  Does not change the path's appearance directly, but may depending on the current style, e.g. arrows
@@ -2166,6 +2578,38 @@ finish:
 		[super drawContent];
 }
 
+/** @brief Whether the object can be drawn together with others sharing its style
+
+ -drawContent is overridden only to substitute a style while hit-testing, which batched drawing never is, so the path
+ can still be batched provided subclasses don't add drawing of their own.
+ @return YES if the object may be drawn in a batch
+ */
+- (BOOL)isSuitableForBatchedDrawing
+{
+	return DKDrawableUsesOnlyStyleDrawingOf(self, [DKDrawablePath class]);
+}
+
+/** @brief The path whose outline and fill stand in for the path's hit-test rendering
+
+ Hit-testing renders the path with the substitute style set up by -drawContent, so this is the rendering path with the same
+ stroke and fill. Subclasses that draw something else, and ghosted paths, are left to be rendered.
+ @param distance receives half the width of the substitute stroke
+ @param filled receives whether the substitute style fills the path
+ @return the rendering path, or nil if the path must be rendered to test it
+ */
+- (NSBezierPath*)hitTestPathWithOutlineDistance:(CGFloat*)distance filled:(BOOL*)filled
+{
+	if ([self isGhosted] || !DKDrawableDrawsContentAs(self, [DKDrawablePath class]))
+		return nil;
+
+	DKStyle* style = [self style];
+
+	*distance = MAX(4, [style maxStrokeWidth]) * 0.5;
+	*filled = [style hasFill] || [style hasHatch];
+
+	return [self renderingPath];
+}
+
 /** @brief Draws the seleciton highlight on the object when requested
  */
 - (void)drawSelectedState
@@ -2209,6 +2653,26 @@ finish:
 	[rp stroke];
 }
 
+/** @brief Request a redraw of this object
+
+ Every change to the path, including edits made to it in place, is bracketed by this, so the index of the path's
+ elements used for hit-testing and the path's immutable geometry are discarded here.
+ */
+- (void)notifyVisualChange
+{
+	[m_elementIndex release];
+	m_elementIndex = nil;
+
+	// the geometry is only out of date once there's an editable path that may have been changed
+
+	if (m_path != nil) {
+		[mPathGeometry release];
+		mPathGeometry = nil;
+	}
+
+	[super notifyVisualChange];
+}
+
 /** @brief Determines the partcode hit by a given point
 
  Partcodes apart from 0 and -1 are private to this object
@@ -2258,7 +2722,8 @@ finish:
 
 	pc = [[self path] partcodeHitByPoint:pt
 							   tolerance:tol
-				  prioritiseOnPathPoints:commandKey];
+				  prioritiseOnPathPoints:commandKey
+							elementIndex:[self elementIndex]];
 
 	// if snapping, ignore off-path points
 
@@ -2431,7 +2896,14 @@ finish:
 			NSRect oldBounds = [self bounds];
 
 			[self notifyVisualChange];
-			[[[self undoManager] prepareWithInvocationTarget:self] setLocation:[self location]];
+
+			// while dragging this is called for every event. Asking first whether the task would be coalesced away saves forwarding an invocation for it
+
+			id um = [self undoManager];
+
+			if (![um respondsToSelector:@selector(shouldCoalesceTaskWithTarget:selector:)] || ![um shouldCoalesceTaskWithTarget:self
+																														selector:_cmd])
+				[[um prepareWithInvocationTarget:self] setLocation:[self location]];
 
 			NSAffineTransform* tfm = [NSAffineTransform transform];
 			[tfm translateXBy:dx
@@ -2456,7 +2928,8 @@ finish:
 			// snapping to the nearest path point
 
 			return [[self path] nearestPointToPoint:gMouseForPathSnap
-										  tolerance:4];
+										  tolerance:4
+									   elementIndex:[self elementIndex]];
 		} else
 			return [[self path] controlPointForPartcode:pc];
 	} else
@@ -2497,11 +2970,18 @@ finish:
  */
 - (NSBezierPath*)renderingPath
 {
-	NSBezierPath* rPath = [[[self path] copy] autorelease];
-	NSAffineTransform* parentTransform = [self containerTransform];
+	// the path is copied once - transforming makes the copy when there's a transform, and a path that is still shared geometry is
+	// made from that rather than being made editable
+
+	NSBezierPath* rPath;
+	CGAffineTransform ct;
 
-	if (parentTransform)
-		rPath = [parentTransform transformBezierPath:rPath];
+	if ([self getContainerTransform:&ct])
+		rPath = [[NSAffineTransform transformWithCGAffineTransform:ct] transformBezierPath:[self path]];
+	else if (m_path == nil && mPathGeometry != nil)
+		rPath = [mPathGeometry bezierPath];
+	else
+		rPath = [[[self path] copy] autorelease];
 
 	// if drawing is in low quality mode, set a coarse flatness value:
 
@@ -2513,6 +2993,87 @@ finish:
 	return rPath;
 }
 
+/** @brief Returns the path to draw, simplified to within a given error
+
+ While the path is being edited or hit-tested, or until the simplified forms have been made, this is the same as -renderingPath.
+ @param maxError the furthest the path drawn may stray from the path, in drawing coordinates
+ @return a NSBezierPath object, transformed according to its parents
+ */
+- (NSBezierPath*)renderingPathWithMaximumError:(CGFloat)maxError
+{
+	NSInteger count = (m_path != nil) ? [m_path elementCount] : [mPathGeometry elementCount];
+
+	if (count < kDKPathGeometryMinimumElementsToSimplify || [self isTrackingMouse] || [self isBeingHitTested])
+		return [self renderingPath];
+
+	// the error allowed is in drawing coordinates, so it's scaled into the path's own by the container's transform
+
+	CGAffineTransform ct;
+	BOOL transformed = [self getContainerTransform:&ct];
+	CGFloat scale = transformed ? sqrt(fabs(ct.a * ct.d - ct.b * ct.c)) : 1.0;
+
+	if (scale <= 0.0)
+		return [self renderingPath];
+
+	NSBezierPath* simplified = [[self pathGeometry] simplifiedPathWithMaximumError:maxError / scale];
+
+	if (simplified == nil)
+		return [self renderingPath];
+
+	NSBezierPath* rPath = transformed ? [[NSAffineTransform transformWithCGAffineTransform:ct] transformBezierPath:simplified] : [[simplified copy] autorelease];
+
+	if ([[self drawing] lowRenderingQuality])
+		[rPath setFlatness:2.0];
+	else
+		[rPath setFlatness:0.5];
+
+	return rPath;
+}
+
+/** @brief Returns the rendering path as a Quartz path, for batched drawing
+
+ Only a path still held as shared geometry, in no container with a transform, has one kept - the geometry's.
+ @param windingRule receives the path's winding rule
+ @return the geometry's Quartz path, or NULL
+ */
+- (CGPathRef)cachedRenderingQuartzPath:(NSWindingRule*)windingRule
+{
+	CGAffineTransform ct;
+
+	if (m_path != nil || mPathGeometry == nil || [self getContainerTransform:&ct])
+		return NULL;
+
+	*windingRule = [mPathGeometry windingRule];
+	return [mPathGeometry quartzPath];
+}
+
+/** @brief Adds the path to a path of outlines
+
+ A path still held as shared geometry adds the geometry's Quartz path, so that nothing is made for the object.
+ @param path the path to add to, in drawing coordinates
+ */
+- (void)addOutlineToPath:(CGMutablePathRef)path
+{
+	if (m_path == nil && mPathGeometry != nil) {
+		CGAffineTransform ct;
+
+		if ([self getContainerTransform:&ct])
+			CGPathAddPath(path, &ct, [mPathGeometry quartzPath]);
+		else
+			CGPathAddPath(path, NULL, [mPathGeometry quartzPath]);
+	} else
+		[super addOutlineToPath:path];
+}
+
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	// geometry shared with copies and snapshots is counted for each of them
+
+	[super addFootprintToReport:footprint];
+	[footprint addBytes:[m_path undoCost] + [m_undoPath undoCost] + [mPathGeometry bytesUsed]
+			 toCategory:kDKFootprintPaths];
+}
+
 /** @brief Rotates the path to the given angle
 
  Paths are not rotatable like shapes, but in special circumstances you may want to rotate the path
@@ -2631,15 +3192,50 @@ finish:
 	[self notifyVisualChange];
 }
 
+- (DKGeometrySnapshot*)geometrySnapshot
+{
+	// the path is changed in place when the object moves, so the snapshot holds its immutable geometry, which is shared
+	// until the path next changes rather than copied
+
+	return [DKGeometrySnapshot snapshotWithPath:nil
+										 object:[self pathGeometry]
+										 values:NULL
+										  count:0];
+}
+
+- (void)restoreGeometrySnapshot:(DKGeometrySnapshot*)snapshot
+{
+	NSRect oldBounds = [self bounds];
+
+	[self notifyVisualChange];
+
+	if ([[snapshot object] isKindOfClass:[DKPathGeometry class]])
+		[self setPathGeometryWithoutUndo:[snapshot object]];
+	else {
+		[m_path release];
+		m_path = [[snapshot path] copy];
+	}
+
+	[self notifyVisualChange];
+	[self notifyGeometryChange:oldBounds];
+}
+
 #pragma mark -
 #pragma mark As an NSObject
 - (void)dealloc
 {
 	[m_path release];
 	[m_undoPath release];
+	[m_elementIndex release];
+	[mPathGeometry release];
 	[super dealloc];
 }
 
+- (NSUInteger)undoCost
+{
+	return [super undoCost] + (m_path != nil ? [m_path undoCost] : [mPathGeometry undoCost]);
+}
+
 - (id)init
 {
 	return [self initWithStyle:[DKStyle styleWithFillColour:nil
@@ -2653,8 +3249,8 @@ finish:
 {
 	[super encodeWithCoder:coder];
 
-	[coder encodeObject:[self path]
-				 forKey:@"path"];
+	[coder encodePath:[self path]
+			   forKey:@"path"];
 	[coder encodeDouble:m_freehandEpsilon
 				 forKey:@"freehand_smoothing"];
 }
@@ -2663,7 +3259,7 @@ finish:
 {
 	self = [super initWithCoder:coder];
 	if (self != nil) {
-		[self setPath:[coder decodeObjectForKey:@"path"]];
+		[self setPath:[coder decodePathForKey:@"path"]];
 		m_freehandEpsilon = [coder decodeDoubleForKey:@"freehand_smoothing"];
 	}
 	return self;
@@ -2674,10 +3270,10 @@ finish:
 - (id)copyWithZone:(NSZone*)zone
 {
 	DKDrawablePath* copy = [super copyWithZone:zone];
-	NSBezierPath* pc = [[self path] copyWithZone:zone];
 
-	[copy setPath:pc];
-	[pc release];
+	// the copy shares the path's immutable geometry, and only makes its own editable path if it's edited
+
+	[copy setPathGeometryWithoutUndo:[self pathGeometry]];
 
 	[copy setPathCreationMode:[self pathCreationMode]];
 
@@ -38,6 +38,14 @@ The appearance of a hotspot is drawn by default by a method of DKKnob.
 - (NSPoint)hotspotPointForPartcode:(NSInteger)pc;
 
 - (NSRect)hotspotRect:(DKHotspot*)hs;
+
+/** @brief Discards the cached locations of the hotspots
+
+ The hotspots' locations in the drawing are worked out once and kept along with the shape's transformed path, so that hit-testing
+ and drawing them doesn't transform each one every time. This is called whenever the path is discarded, the hotspots change, or a
+ hotspot moves.
+ */
+- (void)invalidateHotspotLocations;
 - (void)drawHotspotAtPoint:(NSPoint)hp inState:(DKHotspotState)state;
 - (void)drawHotspotsInState:(DKHotspotState)state;
 
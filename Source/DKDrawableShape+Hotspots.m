@@ -10,6 +10,23 @@
 #import "DKKnob.h"
 #import "LogEvent.h"
 
+@interface DKDrawableShape (HotspotsPrivate)
+
+- (const NSPoint*)hotspotLocations;
+
+@end
+
+static inline NSRect hotspotRectAtPoint(NSPoint p)
+{
+	NSRect hsr;
+
+	hsr.size = kDKDefaultHotspotSize;
+	hsr.origin.x = p.x - (hsr.size.width / 2);
+	hsr.origin.y = p.y - (hsr.size.height / 2);
+
+	return hsr;
+}
+
 @implementation DKDrawableShape (Hotspots)
 #pragma mark As a DKDrawableShape
 - (NSInteger)addHotspot:(DKHotspot*)hspot
@@ -20,6 +37,7 @@
 	[m_customHotSpots addObject:hspot];
 	[hspot setOwner:self];
 	[hspot setPartcode:[m_customHotSpots count] - 1 + kDKHotspotBasePartcode];
+	[self invalidateHotspotLocations];
 
 	return [hspot partcode];
 }
@@ -27,6 +45,7 @@
 - (void)removeHotspot:(DKHotspot*)hspot
 {
 	[m_customHotSpots removeObject:hspot];
+	[self invalidateHotspotLocations];
 }
 
 - (void)setHotspots:(NSArray*)spots
@@ -36,6 +55,7 @@
 
 	[m_customHotSpots makeObjectsPerformSelector:@selector(setOwner:)
 									  withObject:self];
+	[self invalidateHotspotLocations];
 }
 
 - (NSArray*)hotspots
@@ -46,6 +66,13 @@
 #pragma mark -
 - (DKHotspot*)hotspotForPartCode:(NSInteger)pc
 {
+	// hotspots added with -addHotspot: have partcodes that follow their order, so that's looked at first
+
+	NSInteger indx = pc - kDKHotspotBasePartcode;
+
+	if (indx >= 0 && indx < (NSInteger)[m_customHotSpots count] && [[m_customHotSpots objectAtIndex:indx] partcode] == pc)
+		return [m_customHotSpots objectAtIndex:indx];
+
 	NSEnumerator* iter = [[self hotspots] objectEnumerator];
 	DKHotspot* hs;
 
@@ -59,12 +86,17 @@
 
 - (DKHotspot*)hotspotUnderMouse:(NSPoint)mp
 {
-	NSEnumerator* iter = [[self hotspots] objectEnumerator];
-	DKHotspot* hs;
+	NSArray* spots = [self hotspots];
+	NSUInteger i, count = [spots count];
 
-	while ((hs = [iter nextObject])) {
-		if (NSPointInRect(mp, [self hotspotRect:hs]))
-			return hs;
+	if (count == 0)
+		return nil;
+
+	const NSPoint* locations = [self hotspotLocations];
+
+	for (i = 0; i < count; ++i) {
+		if (NSPointInRect(mp, hotspotRectAtPoint(locations[i])))
+			return [spots objectAtIndex:i];
 	}
 
 	return nil; // not found
@@ -80,14 +112,22 @@
 #pragma mark -
 - (NSRect)hotspotRect:(DKHotspot*)hs
 {
-	NSRect hsr;
-	NSPoint p = [self convertPointFromRelativeLocation:[hs relativeLocation]];
+	NSUInteger indx = [[self hotspots] indexOfObjectIdenticalTo:hs];
+	NSPoint p;
 
-	hsr.size = kDKDefaultHotspotSize;
-	hsr.origin.x = p.x - (hsr.size.width / 2);
-	hsr.origin.y = p.y - (hsr.size.height / 2);
+	if (indx != NSNotFound)
+		p = [self hotspotLocations][indx];
+	else
+		p = [self convertPointFromRelativeLocation:[hs relativeLocation]];
 
-	return hsr;
+	return hotspotRectAtPoint(p);
+}
+
+- (void)invalidateHotspotLocations
+{
+	free(mHotspotPointsCache);
+	mHotspotPointsCache = NULL;
+	mHotspotPointsCount = 0;
 }
 
 - (void)drawHotspotAtPoint:(NSPoint)hp inState:(DKHotspotState)state
@@ -106,15 +146,44 @@
 
 - (void)drawHotspotsInState:(DKHotspotState)state
 {
-	NSEnumerator* iter = [[self hotspots] objectEnumerator];
-	DKHotspot* hs;
-	NSPoint p;
+	NSArray* spots = [self hotspots];
+	NSUInteger i, count = [spots count];
 
-	while ((hs = [iter nextObject])) {
-		p = [self convertPointFromRelativeLocation:[hs relativeLocation]];
-		[hs drawHotspotAtPoint:p
-					   inState:state];
-	}
+	if (count == 0)
+		return;
+
+	const NSPoint* locations = [self hotspotLocations];
+
+	for (i = 0; i < count; ++i)
+		[[spots objectAtIndex:i] drawHotspotAtPoint:locations[i]
+											inState:state];
+}
+
+#pragma mark -
+
+/** @brief Returns the locations of the hotspots in the drawing, in the same order as -hotspots
+
+ The locations are kept until the transformed path is discarded, which happens whenever the shape's geometry or its container's
+ transform changes. Asking for the transformed path first is what notices a change to the container's transform.
+ */
+- (const NSPoint*)hotspotLocations
+{
+	NSArray* spots = [self hotspots];
+	NSUInteger i, count = [spots count];
+
+	if ([self transformedPath] == nil)
+		[self invalidateHotspotLocations];
+	else if (mHotspotPointsCache != NULL && mHotspotPointsCount == count)
+		return mHotspotPointsCache;
+
+	free(mHotspotPointsCache);
+	mHotspotPointsCache = malloc(MAX(count, 1U) * sizeof(NSPoint));
+	mHotspotPointsCount = count;
+
+	for (i = 0; i < count; ++i)
+		mHotspotPointsCache[i] = [self convertPointFromRelativeLocation:[[spots objectAtIndex:i] relativeLocation]];
+
+	return mHotspotPointsCache;
 }
 
 @end
@@ -173,6 +242,7 @@
 - (void)setRelativeLocation:(NSPoint)rloc
 {
 	m_relLoc = rloc;
+	[m_owner invalidateHotspotLocations];
 }
 
 - (NSPoint)relativeLocation
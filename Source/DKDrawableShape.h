@@ -46,6 +46,11 @@ can be generated by a factory class.
 	NSSize m_offset; // offset from origin of logical centre relative to canonical path
 	BOOL m_hideOriginTarget; // YES to hide temporarily the origin target - done for some mouse operations
 	NSInteger m_opMode; // drag operation mode - normal versus distortion modes
+	NSBezierPath* mTransformedPathCache; // cached result of -transformedPath
+	CGPathRef mTransformedQuartzPathCache; // cached result of -transformedQuartzPath
+	CGAffineTransform mCachedContainerTransform; // the container's transform when the cached path was made
+	NSPoint* mHotspotPointsCache; // the hotspots' locations in the drawing, cached along with the transformed path
+	NSUInteger mHotspotPointsCount;
 @protected
 	NSRect mBoundsCache; // cached value of the bounds
 	BOOL m_inRotateOp; // YES while a rotation drag is in progress
@@ -95,7 +100,29 @@ can be generated by a factory class.
 - (NSBezierPath*)path;
 - (void)reshapePath;
 - (void)adoptPath:(NSBezierPath*)path;
+
+/** @brief Returns the shape's path after transforming using the shape's location, size and rotation angle
+
+ The path is cached until the shape's geometry, path, distortion or container's transform changes, so repeated calls while
+ drawing cost nothing. The path returned is shared - copy it before modifying it.
+ @return the path transformed to its final form
+ */
 - (NSBezierPath*)transformedPath;
+
+/** @brief Returns the transformed path as a Quartz path
+
+ Cached along with -transformedPath. The path belongs to the shape and is only valid until the shape next changes.
+ @return a CGPath, or NULL if the shape has no path
+ */
+- (CGPathRef)transformedQuartzPath;
+
+/** @brief Whether the shape's transformed path contains a point
+
+ Used when hit-testing a filled shape. Subclasses that can answer this without transforming the path may override it.
+ @param pt the point to test
+ @return YES if the path contains the point
+ */
+- (BOOL)pathContainsPoint:(NSPoint)pt;
 - (BOOL)canPastePathWithPasteboard:(NSPasteboard*)pb;
 
 // geometry:
@@ -103,6 +130,15 @@ can be generated by a factory class.
 - (NSAffineTransform*)transform;
 - (NSAffineTransform*)transformIncludingParent;
 - (NSAffineTransform*)inverseTransform;
+
+/** @brief Get the shape's transforms into ones the caller provides
+
+ The same transforms as -transform and -transformIncludingParent, without making an NSAffineTransform. Code that runs for every
+ object drawn, hit-tested or stored, or for every point, uses these.
+ @param transform receives the transform
+ */
+- (void)getTransform:(CGAffineTransform*)transform;
+- (void)getTransformIncludingParent:(CGAffineTransform*)transform;
 - (NSPoint)locationIgnoringOffset;
 
 - (void)rotateUsingReferencePoint:(NSPoint)rp constrain:(BOOL)constrain;
@@ -15,7 +15,8 @@
 #import "DKObjectDrawingLayer.h"
 #import "GCInfoFloater.h"
 #import "DKGeometryUtilities.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
+#import "GCUndoManager.h"
 #import "NSBezierPath+Geometry.h"
 #import "NSBezierPath+Editing.h"
 #import "NSDictionary+DeepCopy.h"
@@ -23,6 +24,10 @@
 #import "DKShapeGroup.h"
 #import "DKDrawKitMacros.h"
 #import "DKPasteboardInfo.h"
+#import "DKObjectSnapshot.h"
+#import "NSAffineTransform+DKAdditions.h"
+#import "NSBezierPath+Packing.h"
+#import "DKMemoryFootprint.h"
 #include <tgmath.h>
 
 #pragma mark Static Vars
@@ -47,6 +52,7 @@ static NSSize sTempSavedOffset;
 - (void)prepareRotation;
 - (NSRect)knobRect:(NSInteger)knobPartCode;
 - (void)updateInfoForOperation:(DKShapeEditOperation)op atPoint:(NSPoint)mp;
+- (void)invalidateTransformedPath;
 
 @end
 
@@ -155,7 +161,7 @@ static NSSize sTempSavedOffset;
 		// not yet cached, so create the cursor from the image resource.
 		// All shape cursors are 16x16 images with the hotspot at the centre
 
-		LogEvent_(kInfoEvent, @"creating shape cursor: '%@'", key);
+		DKTrace_(kDKTraceInfo, @"creating shape cursor: '%@'", key);
 
 		NSImage* cursImage = [NSImage imageNamed:key];
 
@@ -555,16 +561,77 @@ static NSSize sTempSavedOffset;
 }
 
 /** @brief Returns the shape's path after transforming using the shape's location, size and rotation angle
+
+ The path is cached until the shape's geometry, path, distortion or container's transform changes, so repeated calls while
+ drawing cost nothing. The path returned is shared - copy it before modifying it.
  @return the path transformed to its final form
  */
 - (NSBezierPath*)transformedPath
 {
+	// the shape's own changes all pass through -notifyVisualChange, which discards the cache, but a group's transform can change
+	// without its members being told, so the container's transform is compared each time.
+
+	CGAffineTransform ct;
+
+	[self getContainerTransform:&ct];
+
+	if (mTransformedPathCache != nil && CGAffineTransformEqualToTransform(ct, mCachedContainerTransform))
+		return mTransformedPathCache;
+
+	[self invalidateTransformedPath];
+
 	NSBezierPath* path = [self path];
 
-	if (path != nil && ![path isEmpty])
-		return [[self transformIncludingParent] transformBezierPath:path];
-	else
+	if (path == nil || [path isEmpty])
 		return nil;
+
+	// a distorted path is already a new copy, so it can be transformed in place rather than copied a second time
+
+	if (path != m_path) {
+		[path transformUsingAffineTransform:[self transformIncludingParent]];
+		mTransformedPathCache = [path retain];
+	} else
+		mTransformedPathCache = [[[self transformIncludingParent] transformBezierPath:path] retain];
+
+	mCachedContainerTransform = ct;
+
+	return mTransformedPathCache;
+}
+
+/** @brief Returns the transformed path as a Quartz path
+
+ Cached along with -transformedPath. The path belongs to the shape and is only valid until the shape next changes.
+ @return a CGPath, or NULL if the shape has no path
+ */
+- (CGPathRef)transformedQuartzPath
+{
+	NSBezierPath* path = [self transformedPath];
+
+	if (path != nil && mTransformedQuartzPathCache == NULL)
+		mTransformedQuartzPathCache = [path newQuartzPath];
+
+	return mTransformedQuartzPathCache;
+}
+
+/** @brief Returns the rendering path as a Quartz path, for batched drawing
+ @param windingRule receives the path's winding rule
+ @return the transformed Quartz path, owned by the shape
+ */
+- (CGPathRef)cachedRenderingQuartzPath:(NSWindingRule*)windingRule
+{
+	*windingRule = [[self transformedPath] windingRule];
+	return [self transformedQuartzPath];
+}
+
+/** @brief Whether the shape's transformed path contains a point
+
+ Used when hit-testing a filled shape. Subclasses that can answer this without transforming the path may override it.
+ @param pt the point to test
+ @return YES if the path contains the point
+ */
+- (BOOL)pathContainsPoint:(NSPoint)pt
+{
+	return [[self transformedPath] containsPoint:pt];
 }
 
 #pragma mark -
@@ -583,13 +650,20 @@ static NSSize sTempSavedOffset;
  */
 - (NSAffineTransform*)transformIncludingParent
 {
-	NSAffineTransform* xform = [self transform];
-	NSAffineTransform* parentTransform = [self containerTransform];
+	CGAffineTransform t;
+
+	[self getTransformIncludingParent:&t];
+	return [NSAffineTransform transformWithCGAffineTransform:t];
+}
+
+- (void)getTransformIncludingParent:(CGAffineTransform*)transform
+{
+	CGAffineTransform ct;
 
-	if (parentTransform)
-		[xform appendTransform:parentTransform];
+	[self getTransform:transform];
 
-	return xform;
+	if ([self getContainerTransform:&ct])
+		*transform = CGAffineTransformConcat(*transform, ct);
 }
 
 /** @brief Returns the inverse transform representing the shape's parameters
@@ -614,7 +688,10 @@ static NSSize sTempSavedOffset;
  */
 - (NSPoint)locationIgnoringOffset
 {
-	return [[self transform] transformPoint:NSZeroPoint];
+	CGAffineTransform t;
+
+	[self getTransform:&t];
+	return NSMakePoint(t.tx, t.ty);
 }
 
 #pragma mark -
@@ -931,13 +1008,29 @@ static NSSize sTempSavedOffset;
 		rloc = [[self distortionTransform] transformPoint:rloc
 												 fromRect:[[self class] unitRectAtOrigin]];
 
-	NSAffineTransform* tx = [self transformIncludingParent];
-	return [tx transformPoint:rloc];
+	CGAffineTransform t;
+
+	[self getTransformIncludingParent:&t];
+	return NSPointFromCGPoint(CGPointApplyAffineTransform(NSPointToCGPoint(rloc), t));
 }
 
 #pragma mark -
 #pragma mark - private
 
+/** @brief Discards the cached transformed path, so that it's rebuilt when next needed
+ */
+- (void)invalidateTransformedPath
+{
+	[mTransformedPathCache release];
+	mTransformedPathCache = nil;
+	[self invalidateHotspotLocations];
+
+	if (mTransformedQuartzPathCache != NULL) {
+		CGPathRelease(mTransformedQuartzPathCache);
+		mTransformedQuartzPathCache = NULL;
+	}
+}
+
 /** @brief Return the rectangle that bounds the current control knobs
  @return a rect, the union of all active knob rectangles
  */
@@ -1197,8 +1290,10 @@ static NSSize sTempSavedOffset;
 		kp = [[self distortionTransform] transformPoint:kp
 											   fromRect:r];
 
-	NSAffineTransform* tx = [self transformIncludingParent];
-	return [tx transformPoint:kp];
+	CGAffineTransform t;
+
+	[self getTransformIncludingParent:&t];
+	return NSPointFromCGPoint(CGPointApplyAffineTransform(NSPointToCGPoint(kp), t));
 }
 
 /** @brief Given a partcode, this returns the knob type for it
@@ -1317,7 +1412,7 @@ static NSSize sTempSavedOffset;
 		return; // ignore all others
 	}
 
-	//	LogEvent_(kStateEvent, @"adjusting transform part %d", qi );
+	//	DKTrace_(kDKTraceState, @"adjusting transform part %d", qi );
 
 	NSPoint old = [self knobPoint:partCode];
 
@@ -1906,6 +2001,50 @@ static NSSize sTempSavedOffset;
 		[super drawContent];
 }
 
+/** @brief Whether the object can be drawn together with others sharing its style
+
+ -drawContent is overridden only to substitute a style while hit-testing, which batched drawing never is, so the shape
+ can still be batched provided subclasses don't add drawing of their own.
+ @return YES if the object may be drawn in a batch
+ */
+- (BOOL)isSuitableForBatchedDrawing
+{
+	return DKDrawableUsesOnlyStyleDrawingOf(self, [DKDrawableShape class]);
+}
+
+/** @brief The path whose outline and fill stand in for the shape's hit-test rendering
+
+ Hit-testing renders the shape with the substitute style set up by -drawContent, so this is the rendering path with the same
+ fill and stroke. Subclasses that draw something else, and ghosted shapes, are left to be rendered.
+ @param distance receives half the width of the substitute stroke, or 0 if it has none
+ @param filled receives whether the substitute style fills the shape
+ @return the rendering path, or nil if the shape must be rendered to test it
+ */
+- (NSBezierPath*)hitTestPathWithOutlineDistance:(CGFloat*)distance filled:(BOOL*)filled
+{
+	if ([self isGhosted] || !DKDrawableDrawsContentAs(self, [DKDrawableShape class]))
+		return nil;
+
+	DKStyle* style = [self style];
+	BOOL hasStroke = [style hasStroke];
+
+	*distance = hasStroke ? MAX(2, [style maxStrokeWidth]) * 0.5 : 0;
+	*filled = !hasStroke || [style hasFill] || [style hasHatch];
+
+	return [self renderingPath];
+}
+
+/** @brief Request a redraw of this object
+
+ Every change to the shape's location, size, angle, offset, path or distortion is bracketed by this, so the cached
+ transformed path is discarded here.
+ */
+- (void)notifyVisualChange
+{
+	[self invalidateTransformedPath];
+	[super notifyVisualChange];
+}
+
 /**
  Takes account of its internal state to draw the appropriate control knobs, etc
  */
@@ -1976,7 +2115,7 @@ static NSSize sTempSavedOffset;
 		// the path might not contain it. However, the hit could be on the stroke or shadow so we need to test against
 		// the cached bitmap copy of the shape.
 
-		if (([[self style] hasFill] || [[self style] hasHatch]) && [[self transformedPath] containsPoint:pt])
+		if (([[self style] hasFill] || [[self style] hasHatch]) && [self pathContainsPoint:pt])
 			return kDKDrawingEntireObjectPart;
 
 		if ([self pointHitsPath:pt])
@@ -2098,7 +2237,13 @@ static NSSize sTempSavedOffset;
 {
 	if (!NSEqualPoints(location, [self location]) && ![self locationLocked]) {
 		NSRect oldBounds = [self bounds];
-		[[[self undoManager] prepareWithInvocationTarget:self] setLocation:[self location]];
+		id um = [self undoManager];
+
+		// while dragging this is called for every event. Asking first whether the task would be coalesced away saves forwarding an invocation for it
+
+		if (![um respondsToSelector:@selector(shouldCoalesceTaskWithTarget:selector:)] || ![um shouldCoalesceTaskWithTarget:self
+																													selector:_cmd])
+			[[um prepareWithInvocationTarget:self] setLocation:[self location]];
 
 		[self notifyVisualChange];
 		m_location = location;
@@ -2397,21 +2542,22 @@ static NSSize sTempSavedOffset;
 {
 	// returns a transform which will transform a path at the origin to the correct location, scale and angle of this object.
 
-	NSAffineTransform* xform = [NSAffineTransform transform];
+	CGAffineTransform t;
 
-	[xform translateXBy:[self location].x
-					yBy:[self location].y];
-	[xform rotateByRadians:[self angle]];
-
-	CGFloat sx = [self size].width;
-	CGFloat sy = [self size].height;
+	[self getTransform:&t];
+	return [NSAffineTransform transformWithCGAffineTransform:t];
+}
 
-	[xform scaleXBy:sx
-				yBy:sy];
-	[xform translateXBy:-[self offset].width
-					yBy:-[self offset].height];
+- (void)getTransform:(CGAffineTransform*)transform
+{
+	NSPoint loc = [self location];
+	NSSize size = [self size];
+	NSSize offset = [self offset];
+	CGAffineTransform t = CGAffineTransformMakeTranslation(loc.x, loc.y);
 
-	return xform;
+	t = CGAffineTransformRotate(t, [self angle]);
+	t = CGAffineTransformScale(t, size.width, size.height);
+	*transform = CGAffineTransformTranslate(t, -offset.width, -offset.height);
 }
 
 /** @brief Return the cursor displayed when a given partcode is hit or entered
@@ -2513,7 +2659,7 @@ static NSSize sTempSavedOffset;
 		mBoundsCache = NSZeroRect;
 		[self notifyVisualChange];
 
-		LogEvent_(kReactiveEvent, @"set offset = %@; location = %@", NSStringFromSize(m_offset), NSStringFromPoint(p));
+		DKTrace_(kDKTraceReactive, @"set offset = %@; location = %@", NSStringFromSize(m_offset), NSStringFromPoint(p));
 	}
 }
 
@@ -2579,10 +2725,59 @@ static NSSize sTempSavedOffset;
 	return valid;
 }
 
+- (DKGeometrySnapshot*)geometrySnapshot
+{
+	// the canonical path is replaced rather than changed when the shape is reshaped, so it needn't be copied
+
+	CGFloat values[7] = { m_location.x, m_location.y, m_scale.width, m_scale.height, m_rotationAngle, m_offset.width, m_offset.height };
+
+	return [DKGeometrySnapshot snapshotWithPath:m_path
+										 object:m_distortTransform
+										 values:values
+										  count:7];
+}
+
+- (void)restoreGeometrySnapshot:(DKGeometrySnapshot*)snapshot
+{
+	NSRect oldBounds = [self bounds];
+
+	[self notifyVisualChange];
+
+	[[snapshot path] retain];
+	[m_path release];
+	m_path = [snapshot path];
+
+	m_location = NSMakePoint([snapshot valueAtIndex:0], [snapshot valueAtIndex:1]);
+	m_scale = NSMakeSize([snapshot valueAtIndex:2], [snapshot valueAtIndex:3]);
+	m_rotationAngle = [snapshot valueAtIndex:4];
+	m_offset = NSMakeSize([snapshot valueAtIndex:5], [snapshot valueAtIndex:6]);
+	mBoundsCache = NSZeroRect;
+
+	[self setDistortionTransform:[snapshot object]];
+	[self notifyVisualChange];
+	[self notifyGeometryChange:oldBounds];
+}
+
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	[super addFootprintToReport:footprint];
+
+	// the cached transformed path and its Quartz form have as many elements as the path
+
+	NSUInteger bytes = [m_path undoCost] + [mTransformedPathCache undoCost];
+
+	if (mTransformedQuartzPathCache != NULL)
+		bytes += [m_path undoCost];
+
+	[footprint addBytes:bytes
+			 toCategory:kDKFootprintPaths];
+}
+
 #pragma mark -
 #pragma mark As an NSObject
 - (void)dealloc
 {
+	[self invalidateTransformedPath];
 	[m_distortTransform release];
 	[m_customHotSpots release];
 	[m_path release];
@@ -2590,6 +2785,11 @@ static NSSize sTempSavedOffset;
 	[super dealloc];
 }
 
+- (NSUInteger)undoCost
+{
+	return [super undoCost] + [m_path undoCost];
+}
+
 #pragma mark -
 #pragma mark As part of NSCoding Protocol
 - (void)encodeWithCoder:(NSCoder*)coder
@@ -2597,8 +2797,8 @@ static NSSize sTempSavedOffset;
 	NSAssert(coder != nil, @"Expected valid coder");
 	[super encodeWithCoder:coder];
 
-	[coder encodeObject:m_path
-				 forKey:@"path"];
+	[coder encodePath:m_path
+			   forKey:@"path"];
 	[coder encodeObject:[self hotspots]
 				 forKey:@"hot_spots"];
 	[coder encodeDouble:[self angle]
@@ -2617,11 +2817,11 @@ static NSSize sTempSavedOffset;
 - (id)initWithCoder:(NSCoder*)coder
 {
 	NSAssert(coder != nil, @"Expected valid coder");
-	//	LogEvent_(kFileEvent, @"decoding drawable shape %@", self);
+	//	DKTrace_(kDKTraceFile, @"decoding drawable shape %@", self);
 
 	self = [super initWithCoder:coder];
 	if (self != nil) {
-		[self setPath:[coder decodeObjectForKey:@"path"]];
+		[self setPath:[coder decodePathForKey:@"path"]];
 		[self setHotspots:[coder decodeObjectForKey:@"hot_spots"]];
 		[self setAngle:[coder decodeDoubleForKey:@"angle"]];
 
@@ -23,6 +23,17 @@ will be twice as wide and twice as high as the drawing. If the dpi passed does n
 to the nearest whole value that is.
 
 This uses Image I/O to perform the data encoding.
+
+The drawing can also be written as SVG, for viewing in a web browser; see DKSVGExporter.
+
+Large images (over kDKExportBandedPixelThreshold pixels) are rendered as horizontal bands concurrently on several threads. When encoding, the bands are
+streamed to Image I/O as they are rendered, so the full bitmap is never held in memory; this can be forced on or off by passing kDKExportedImageIsBanded
+in the properties.
+
+Exports can also be written straight to a file URL, in which case the image is always streamed in bands and the encoded data goes to the file
+rather than to memory. Layer images are rendered from each layer's pdf concurrently. Making the pdfs draws with AppKit so happens on the calling
+thread, which should be the main thread; only the rasterization is done on other threads. Progress is reported by posting
+kDKDrawingExportProgressNotification on the calling thread.
 */
 @interface DKDrawing (Export)
 
@@ -40,6 +51,17 @@ This uses Image I/O to perform the data encoding.
 - (CGImageRef)CGImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha;
 - (CGImageRef)CGImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha relativeScale:(CGFloat)relScale;
 
+/** @brief Creates an image of the drawing whose pixels are rendered on demand, a band at a time, as the image data is read
+
+ Bands are rendered concurrently, a few at a time, just ahead of the reader, so only a small part of the image is ever held in memory.
+ The image's data can only be read sequentially, so it is only suitable for passing directly to an Image I/O destination for encoding.
+ @param dpi the resolution of the image in dots per inch.
+ @param hasAlpha specifies whether the image is painted in the background paper colour or not.
+ @param relScale scaling factor, 1.0 = actual size, 0.5 = half size, etc.
+ @return a CG image
+ */
+- (CGImageRef)bandedCGImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha relativeScale:(CGFloat)relScale;
+
 // convert to various formats:
 
 /** @brief Returns JPEG data for the drawing.
@@ -66,6 +88,47 @@ This uses Image I/O to perform the data encoding.
  */
 - (NSData*)PNGDataWithProperties:(NSDictionary*)props;
 
+// write to files:
+
+/** @brief Writes an image of the drawing to a file
+
+ The image is always rendered in bands and streamed to the encoder, so neither the bitmap nor the encoded data is ever held in memory
+ as a whole. kDKDrawingExportProgressNotification is posted as the bands are rendered.
+ @param url a file URL
+ @param type the UTI of the format, one of kUTTypeJPEG, kUTTypeTIFF or kUTTypePNG
+ @param props the same properties as for the data methods
+ @return YES if the file was written
+ */
+- (BOOL)writeImageToURL:(NSURL*)url type:(NSString*)type properties:(NSDictionary*)props;
+
+/** @brief Writes the drawing as a pdf file
+
+ The pdf is printed straight to the file rather than being built in memory first. This must be called on the main thread.
+ @param url a file URL
+ @return YES if the file was written
+ */
+- (BOOL)writePDFToURL:(NSURL*)url;
+
+/** @brief Writes the drawing as an SVG file
+
+ The document is streamed to the file as it's written, by a DKSVGExporter. The images of image shapes are written to a directory beside the
+ file, named after it with "_images" at the end, which is only made if there are any. This must be called on the main thread, unless the
+ drawing is used by no other thread.
+ @param url a file URL
+ @return YES if the file was written
+ */
+- (BOOL)writeSVGToURL:(NSURL*)url;
+
+/** @brief Writes the drawing as SVG to a stream
+
+ Images are referred to but not written; their file names, after the prefix, are their keys in the image manager with an extension for
+ their format. This must be called on the main thread.
+ @param stream an output stream, opened if it isn't already, and left open
+ @param prefix what comes before each image's file name in the references to it, or nil
+ @return YES if the document was written
+ */
+- (BOOL)writeSVGToStream:(NSOutputStream*)stream imageReferencePrefix:(NSString*)prefix;
+
 // convenience methods that set up the property dictionaries for you:
 
 /** @brief Returns JPEG data for the drawing or nil if there was a problem
@@ -90,7 +153,8 @@ This uses Image I/O to perform the data encoding.
 
 /** @brief Returns JPEG data for the drawing at 50% actual size, with 50% quality
 
- Useful for e.g. generating QuickLook thumbnails
+ Useful for e.g. generating QuickLook thumbnails. The data comes from the drawing's thumbnail, which only renders the areas that have
+ changed since it was last asked for. Chunked drawing files include it so it can be read without reading the drawing.
  @return JPEG data
  */
 - (NSData*)thumbnailData;
@@ -99,7 +163,8 @@ This uses Image I/O to perform the data encoding.
 
 /** @brief Returns an array of bitmaps (NSBitmapImageReps) one per layer
 
- The lowest index is the bottom layer. Hidden layers and non-printing layers are excluded.
+ The lowest index is the bottom layer. Hidden layers and non-printing layers are excluded. The layers are drawn as pdf
+ on the calling thread, then rendered into their bitmaps concurrently.
  @param dpi the desired resolution in dots per inch.
  @return an array of bitmaps
  */
@@ -113,8 +178,25 @@ This uses Image I/O to perform the data encoding.
  */
 - (NSData*)multipartTIFFDataWithResolution:(NSUInteger)dpi;
 
+/** @brief Writes a TIFF file with one image per layer
+
+ Each layer's image is rendered in bands, concurrently, as the encoder reads it, and written straight to the file, so only a few bands
+ of one layer are in memory at any time. kDKDrawingExportProgressNotification is posted as the layers are rendered. This must be
+ called on the main thread, since the layers are first drawn as pdf.
+ @param url a file URL
+ @param dpi the desired resolution in dots per inch.
+ @return YES if the file was written
+ */
+- (BOOL)writeMultipartTIFFToURL:(NSURL*)url resolution:(NSUInteger)dpi;
+
 @end
 
 extern NSString* kDKExportPropertiesResolution;
 extern NSString* kDKExportedImageHasAlpha;
 extern NSString* kDKExportedImageRelativeScale;
+extern NSString* kDKExportedImageIsBanded; // NSNumber bool; YES to stream the image to the encoder in bands, NO to render it in one piece
+
+extern NSString* kDKDrawingExportProgressNotification; // object is the drawing
+extern NSString* kDKDrawingExportProgressKey; // NSNumber double, 0..1, in the notification's userInfo
+
+#define kDKExportBandedPixelThreshold (4096.0 * 4096.0)
@@ -6,11 +6,270 @@
 
 #import "DKDrawing+Export.h"
 #import "DKLayer+Metadata.h"
+#import "DKSelectionPDFView.h"
+#import "DKViewController.h"
+#import "DKDrawingThumbnail.h"
+#import "DKSVGExporter.h"
 #import "LogEvent.h"
+#include <dispatch/dispatch.h>
 
 NSString* kDKExportPropertiesResolution = @"kDKExportPropertiesResolution";
 NSString* kDKExportedImageHasAlpha = @"kDKExportedImageHasAlpha";
 NSString* kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale";
+NSString* kDKExportedImageIsBanded = @"kDKExportedImageIsBanded";
+NSString* kDKDrawingExportProgressNotification = @"kDKDrawingExportProgressNotification";
+NSString* kDKDrawingExportProgressKey = @"progress";
+
+#pragma mark Banded rendering
+
+// large images are rendered as horizontal bands, each into its own bitmap context, concurrently. The pdf is drawn using Core Graphics directly so
+// that no AppKit state is touched from the worker threads - each band opens its own copy of the pdf document.
+
+#define kDKExportBandHeight 64
+
+typedef struct {
+	CFDataRef pdfData;
+	CGColorSpaceRef colorSpace;
+	size_t width;
+	size_t height;
+	size_t bytesPerRow;
+	size_t bandCount;
+	CGFloat paper[4];
+	BOOL hasAlpha;
+
+	// destination of the current batch of bands
+
+	uint8_t* target;
+	size_t targetFirstBand;
+
+	// streaming state - a window of bands is rendered ahead of the consumer
+
+	uint8_t* window;
+	size_t windowCapacity; // in bands
+	size_t windowFirstBand;
+	size_t windowBandCount;
+	size_t position; // in bytes from the start of the image
+
+	// progress is reported as the consumer moves through the image, scaled to this image's part of the whole export
+
+	DKDrawing* progressObject; // not retained
+	double progressBase;
+	double progressSpan;
+} DKBandRenderer;
+
+static void postExportProgress(DKDrawing* drawing, double progress)
+{
+	if (drawing == nil)
+		return;
+
+	NSDictionary* info = [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:MIN(progress, 1.0)]
+													 forKey:kDKDrawingExportProgressKey];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKDrawingExportProgressNotification
+														object:drawing
+													  userInfo:info];
+}
+
+// draws the first page of some pdf data into a bitmap context of <width> x <height> pixels, or the part of it from <firstRow>, counting down
+// from the top, that fits in a context <rows> high
+
+static void drawPDFDataInContext(CFDataRef pdfData, CGContextRef ctx, size_t width, size_t height, size_t firstRow, size_t rows)
+{
+	CGDataProviderRef provider = CGDataProviderCreateWithCFData(pdfData);
+	CGPDFDocumentRef doc = CGPDFDocumentCreateWithProvider(provider);
+	CGPDFPageRef page = CGPDFDocumentGetPage(doc, 1);
+
+	if (ctx && page) {
+		CGContextSetShouldAntialias(ctx, YES);
+		CGContextSetInterpolationQuality(ctx, kCGInterpolationHigh);
+
+		// shift the whole image down so that the wanted part of it lands in the context
+
+		CGRect mediaBox = CGPDFPageGetBoxRect(page, kCGPDFMediaBox);
+
+		CGContextSaveGState(ctx);
+		CGContextTranslateCTM(ctx, 0, -(CGFloat)(height - firstRow - rows));
+		CGContextScaleCTM(ctx, width / mediaBox.size.width, height / mediaBox.size.height);
+		CGContextTranslateCTM(ctx, -mediaBox.origin.x, -mediaBox.origin.y);
+		CGContextDrawPDFPage(ctx, page);
+		CGContextRestoreGState(ctx);
+	}
+
+	CGPDFDocumentRelease(doc);
+	CGDataProviderRelease(provider);
+}
+
+static DKBandRenderer* createBandRenderer(NSData* pdfData, NSSize size, BOOL hasAlpha, NSColor* paper)
+{
+	DKBandRenderer* r = calloc(1, sizeof(DKBandRenderer));
+
+	r->pdfData = (CFDataRef)[pdfData retain];
+	r->colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	r->width = (size_t)size.width;
+	r->height = (size_t)size.height;
+	r->bytesPerRow = r->width * 4;
+	r->bandCount = (r->height + kDKExportBandHeight - 1) / kDKExportBandHeight;
+	r->hasAlpha = hasAlpha;
+
+	[[paper colorUsingColorSpaceName:NSCalibratedRGBColorSpace] getRed:&r->paper[0]
+																 green:&r->paper[1]
+																  blue:&r->paper[2]
+																 alpha:&r->paper[3]];
+	return r;
+}
+
+static void disposeBandRenderer(void* info)
+{
+	DKBandRenderer* r = (DKBandRenderer*)info;
+
+	CFRelease(r->pdfData);
+	CGColorSpaceRelease(r->colorSpace);
+	free(r->window);
+	free(r);
+}
+
+static void renderBand(void* context, size_t i)
+{
+	DKBandRenderer* r = (DKBandRenderer*)context;
+	size_t band = r->targetFirstBand + i;
+	size_t firstRow = band * kDKExportBandHeight;
+	size_t rows = MIN((size_t)kDKExportBandHeight, r->height - firstRow);
+	uint8_t* buffer = r->target + (i * kDKExportBandHeight * r->bytesPerRow);
+
+	memset(buffer, 0, rows * r->bytesPerRow);
+
+	CGContextRef ctx = CGBitmapContextCreate(buffer, r->width, rows, 8, r->bytesPerRow, r->colorSpace, kCGImageAlphaPremultipliedLast);
+
+	if (ctx && !r->hasAlpha) {
+		CGContextSetRGBFillColor(ctx, r->paper[0], r->paper[1], r->paper[2], r->paper[3]);
+		CGContextFillRect(ctx, CGRectMake(0, 0, r->width, rows));
+	}
+
+	// the band's context covers image rows <firstRow> to <firstRow + rows> counting down from the top
+
+	drawPDFDataInContext(r->pdfData, ctx, r->width, r->height, firstRow, rows);
+	CGContextRelease(ctx);
+}
+
+static void renderBands(DKBandRenderer* r, size_t firstBand, size_t count, uint8_t* target)
+{
+	r->target = target;
+	r->targetFirstBand = firstBand;
+
+	dispatch_apply_f(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), r, renderBand);
+}
+
+static size_t bandedGetBytes(void* info, void* buffer, size_t count)
+{
+	DKBandRenderer* r = (DKBandRenderer*)info;
+	size_t bandBytes = kDKExportBandHeight * r->bytesPerRow;
+	size_t total = r->height * r->bytesPerRow;
+	size_t copied = 0;
+
+	while (copied < count && r->position < total) {
+		size_t band = r->position / bandBytes;
+
+		if (band < r->windowFirstBand || band >= r->windowFirstBand + r->windowBandCount) {
+			r->windowBandCount = MIN(r->windowCapacity, r->bandCount - band);
+			r->windowFirstBand = band;
+			renderBands(r, band, r->windowBandCount, r->window);
+
+			postExportProgress(r->progressObject, r->progressBase + r->progressSpan * (double)(band + r->windowBandCount) / (double)r->bandCount);
+		}
+
+		size_t offset = r->position - (r->windowFirstBand * bandBytes);
+		size_t available = MIN(r->windowBandCount * bandBytes - offset, total - r->position);
+		size_t n = MIN(available, count - copied);
+
+		memcpy((uint8_t*)buffer + copied, r->window + offset, n);
+		r->position += n;
+		copied += n;
+	}
+
+	return copied;
+}
+
+static off_t bandedSkipForward(void* info, off_t count)
+{
+	DKBandRenderer* r = (DKBandRenderer*)info;
+	size_t total = r->height * r->bytesPerRow;
+	size_t n = MIN((size_t)count, total - r->position);
+
+	r->position += n;
+	return (off_t)n;
+}
+
+static void bandedRewind(void* info)
+{
+	((DKBandRenderer*)info)->position = 0;
+}
+
+// creates an image whose pixels are rendered from the pdf a window of bands at a time as its data is read
+
+static CGImageRef createBandedImage(NSData* pdfData, NSSize size, BOOL hasAlpha, NSColor* paper, DKDrawing* progressObject, double progressBase, double progressSpan)
+{
+	DKBandRenderer* r = createBandRenderer(pdfData, size, hasAlpha, paper);
+
+	r->windowCapacity = MAX(2U, [[NSProcessInfo processInfo] activeProcessorCount] * 2);
+	r->window = malloc(r->windowCapacity * kDKExportBandHeight * r->bytesPerRow);
+	r->progressObject = progressObject;
+	r->progressBase = progressBase;
+	r->progressSpan = progressSpan;
+
+	if (r->window == NULL) {
+		disposeBandRenderer(r);
+		return NULL;
+	}
+
+	CGDataProviderSequentialCallbacks callbacks = { 0, bandedGetBytes, bandedSkipForward, bandedRewind, disposeBandRenderer };
+	CGDataProviderRef provider = CGDataProviderCreateSequential(r, &callbacks);
+	CGImageRef image = CGImageCreate(r->width, r->height, 8, 32, r->bytesPerRow, r->colorSpace, kCGImageAlphaPremultipliedLast, provider, NULL, NO, kCGRenderingIntentDefault);
+
+	CGDataProviderRelease(provider);
+
+	return image;
+}
+
+#pragma mark Layer rendering
+
+// the layers' pdfs are made on the main thread, since that draws with AppKit, then rasterized concurrently, each into its own bitmap
+
+typedef struct {
+	CFDataRef pdfData;
+	CGImageRef image;
+} DKLayerRender;
+
+typedef struct {
+	DKLayerRender* layers;
+	CGColorSpaceRef colorSpace;
+	size_t width;
+	size_t height;
+} DKLayerRenderBatch;
+
+static void renderLayer(void* context, size_t i)
+{
+	DKLayerRenderBatch* batch = (DKLayerRenderBatch*)context;
+	CGContextRef ctx = CGBitmapContextCreate(NULL, batch->width, batch->height, 8, 0, batch->colorSpace, kCGImageAlphaPremultipliedLast);
+
+	if (ctx) {
+		drawPDFDataInContext(batch->layers[i].pdfData, ctx, batch->width, batch->height, 0, batch->height);
+		batch->layers[i].image = CGBitmapContextCreateImage(ctx);
+		CGContextRelease(ctx);
+	}
+}
+
+@interface DKDrawing (ExportPrivate)
+
+- (BOOL)shouldUseBandedExportForSize:(NSSize)size properties:(NSDictionary*)props;
+- (NSSize)exportedImageSizeWithResolution:(NSInteger)dpi relativeScale:(CGFloat)relScale;
+- (CGImageRef)exportImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha relativeScale:(CGFloat)relScale properties:(NSDictionary*)props;
+- (NSArray*)exportedLayers;
+- (NSData*)imageDataOfType:(CFStringRef)type properties:(NSDictionary*)props;
+- (BOOL)addImageOfType:(CFStringRef)type properties:(NSDictionary*)props toDestination:(CGImageDestinationRef)destRef reportProgress:(BOOL)report;
+
+@end
+
+#pragma mark -
 
 @implementation DKDrawing (Export)
 
@@ -33,21 +292,52 @@ NSString* kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale";
 - (CGImageRef)CGImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha relativeScale:(CGFloat)relScale
 
 {
+	NSAssert(relScale > 0, @"scale factor must be greater than zero");
+
+	NSSize bmSize = [self exportedImageSizeWithResolution:dpi
+											relativeScale:relScale];
+
+	// large images are rendered in bands concurrently and stitched together
+
+	if (bmSize.width * bmSize.height >= kDKExportBandedPixelThreshold) {
+		NSData* pdfData = [self pdf];
+
+		if (pdfData == nil)
+			return nil;
+
+		DKBandRenderer* r = createBandRenderer(pdfData, bmSize, hasAlpha, [self paperColour]);
+		size_t length = r->height * r->bytesPerRow;
+		uint8_t* pixels = malloc(length);
+
+		if (pixels == NULL) {
+			disposeBandRenderer(r);
+			return nil;
+		}
+
+		LogEvent_(kInfoEvent, @"rendering %lu bands concurrently, size = %@, dpi = %d", (unsigned long)r->bandCount, NSStringFromSize(bmSize), dpi);
+
+		renderBands(r, 0, r->bandCount, pixels);
+
+		CFDataRef data = CFDataCreateWithBytesNoCopy(kCFAllocatorDefault, pixels, length, kCFAllocatorMalloc);
+		CGDataProviderRef provider = CGDataProviderCreateWithCFData(data);
+		CGImageRef image = CGImageCreate(r->width, r->height, 8, 32, r->bytesPerRow, r->colorSpace, kCGImageAlphaPremultipliedLast, provider, NULL, NO, kCGRenderingIntentDefault);
+
+		CGDataProviderRelease(provider);
+		CFRelease(data);
+		disposeBandRenderer(r);
+
+		return (CGImageRef)[(NSObject*)image autorelease];
+	}
+
 	NSPDFImageRep* pdfRep = [NSPDFImageRep imageRepWithData:[self pdf]];
 
 	NSAssert(pdfRep != nil, @"couldn't create pdf image rep");
-	NSAssert(relScale > 0, @"scale factor must be greater than zero");
 
 	if (pdfRep == nil)
 		return nil;
 
 	// create a bitmap rep of the requisite size.
 
-	NSSize bmSize = [self drawingSize];
-
-	bmSize.width = ceil((bmSize.width * (CGFloat)dpi * relScale) / 72.0f);
-	bmSize.height = ceil((bmSize.height * (CGFloat)dpi * relScale) / 72.0f);
-
 	NSBitmapImageRep* bmRep;
 
 	bmRep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
@@ -97,76 +387,46 @@ NSString* kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale";
 	return (CGImageRef)[(NSObject*)image autorelease];
 }
 
-/** @brief Returns JPEG data for the drawing.
- @param props various parameters and properties
- @return JPEG data or nil if there was a problem
- DrawKit properties that control the data generation. Users may find the convenience methods
- below easier to use for many typical situations.
+/** @brief Creates an image of the drawing whose pixels are rendered on demand, a band at a time, as the image data is read
+
+ Bands are rendered concurrently, a few at a time, just ahead of the reader, so only a small part of the image is ever held in memory.
+ The image's data can only be read sequentially, so it is only suitable for passing directly to an Image I/O destination for encoding.
+ @param dpi the resolution of the image in dots per inch.
+ @param hasAlpha specifies whether the image is painted in the background paper colour or not.
+ @param relScale scaling factor, 1.0 = actual size, 0.5 = half size, etc.
+ @return a CG image
  */
-- (NSData*)JPEGDataWithProperties:(NSDictionary*)props
+- (CGImageRef)bandedCGImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha relativeScale:(CGFloat)relScale
 {
-	NSAssert(props != nil, @"cannot create JPEG data - properties were nil");
-
-	// convert properties into a form useful to Image I/O
-
-	NSInteger dpi = [[props objectForKey:kDKExportPropertiesResolution] integerValue];
-
-	if (dpi == 0)
-		dpi = 72;
-
-	CGFloat scale = [[props objectForKey:kDKExportedImageRelativeScale] doubleValue];
-
-	if (scale == 0)
-		scale = 1.0;
-
-	NSMutableDictionary* options = [[props mutableCopy] autorelease];
-
-	[options setObject:[NSNumber numberWithInteger:dpi]
-				forKey:(NSString*)kCGImagePropertyDPIWidth];
-	[options setObject:[NSNumber numberWithInteger:dpi]
-				forKey:(NSString*)kCGImagePropertyDPIHeight];
-
-	NSNumber* value = [props objectForKey:NSImageCompressionFactor];
-	if (value == nil)
-		value = [NSNumber numberWithDouble:0.67];
-
-	[options setObject:value
-				forKey:(NSString*)kCGImageDestinationLossyCompressionQuality];
-
-	value = [props objectForKey:NSImageProgressive];
-	if (value != nil)
-		[options setObject:[NSDictionary dictionaryWithObject:value
-													   forKey:(NSString*)kCGImagePropertyJFIFIsProgressive]
-					forKey:(NSString*)kCGImagePropertyJFIFDictionary];
-
-	// generate the bitmap image at the required size
-
-	CGImageRef image = [self CGImageWithResolution:dpi
-										  hasAlpha:NO
-									 relativeScale:scale];
+	NSAssert(relScale > 0, @"scale factor must be greater than zero");
 
-	NSAssert(image != nil, @"could not create image for JPEG export");
+	NSData* pdfData = [self pdf];
 
-	if (image == nil)
+	if (pdfData == nil)
 		return nil;
 
-	// encode it to data using Image I/O
+	NSSize bmSize = [self exportedImageSizeWithResolution:dpi
+											relativeScale:relScale];
 
-	CFMutableDataRef data = CFDataCreateMutable(kCFAllocatorDefault, 0);
-	CGImageDestinationRef destRef = CGImageDestinationCreateWithData(data, kUTTypeJPEG, 1, NULL);
+	LogEvent_(kInfoEvent, @"streaming image in bands, size = %@, dpi = %d", NSStringFromSize(bmSize), dpi);
 
-	CGImageDestinationAddImage(destRef, image, (CFDictionaryRef)options);
+	CGImageRef image = createBandedImage(pdfData, bmSize, hasAlpha, [self paperColour], nil, 0, 0);
 
-	BOOL result = CGImageDestinationFinalize(destRef);
+	return (CGImageRef)[(NSObject*)image autorelease];
+}
 
-	CFRelease(destRef);
+/** @brief Returns JPEG data for the drawing.
+ @param props various parameters and properties
+ @return JPEG data or nil if there was a problem
+ DrawKit properties that control the data generation. Users may find the convenience methods
+ below easier to use for many typical situations.
+ */
+- (NSData*)JPEGDataWithProperties:(NSDictionary*)props
+{
+	NSAssert(props != nil, @"cannot create JPEG data - properties were nil");
 
-	if (result)
-		return [(NSData*)data autorelease];
-	else {
-		CFRelease(data);
-		return nil;
-	}
+	return [self imageDataOfType:kUTTypeJPEG
+					  properties:props];
 }
 
 /** @brief Returns TIFF data for the drawing.
@@ -179,157 +439,150 @@ NSString* kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale";
 {
 	NSAssert(props != nil, @"cannot create TIFF data - properties were nil");
 
-	NSInteger dpi = [[props objectForKey:kDKExportPropertiesResolution] integerValue];
-
-	if (dpi == 0)
-		dpi = 72;
-
-	CGFloat scale = [[props objectForKey:kDKExportedImageRelativeScale] doubleValue];
-
-	if (scale == 0)
-		scale = 1.0;
-
-	NSMutableDictionary* options = [[props mutableCopy] autorelease];
-
-	[options setObject:[NSNumber numberWithInteger:dpi]
-				forKey:(NSString*)kCGImagePropertyDPIWidth];
-	[options setObject:[NSNumber numberWithInteger:dpi]
-				forKey:(NSString*)kCGImagePropertyDPIHeight];
-
-	// set up a TIFF-specific dictionary
-
-	NSNumber* value;
+	return [self imageDataOfType:kUTTypeTIFF
+					  properties:props];
+}
 
-	NSMutableDictionary* tiffInfo = [NSMutableDictionary dictionary];
+/** @brief Returns PNG data for the drawing.
+ @param props various parameters and properties
+ @return PNG data or nil if there was a problem
+ DrawKit properties that control the data generation. Users may find the convenience methods
+ below easier to use for many typical situations.
+ */
+- (NSData*)PNGDataWithProperties:(NSDictionary*)props
+{
+	NSAssert(props != nil, @"cannot create PNG data - properties were nil");
 
-	value = [props objectForKey:NSImageCompressionMethod];
-	if (value != nil)
-		[tiffInfo setObject:value
-					 forKey:(NSString*)kCGImagePropertyTIFFCompression];
+	return [self imageDataOfType:kUTTypePNG
+					  properties:props];
+}
 
-	[tiffInfo setObject:[NSString stringWithFormat:@"DrawKit %@ (c)2008 apptree.net", [[self class] drawkitVersionString]]
-				 forKey:(NSString*)kCGImagePropertyTIFFSoftware];
+/** @brief Writes an image of the drawing to a file
 
-	NSString* metaStr;
+ The image is always rendered in bands and streamed to the encoder, so neither the bitmap nor the encoded data is ever held in memory
+ as a whole. kDKDrawingExportProgressNotification is posted as the bands are rendered.
+ @param url a file URL
+ @param type the UTI of the format, one of kUTTypeJPEG, kUTTypeTIFF or kUTTypePNG
+ @param props the same properties as for the data methods
+ @return YES if the file was written
+ */
+- (BOOL)writeImageToURL:(NSURL*)url type:(NSString*)type properties:(NSDictionary*)props
+{
+	NSAssert(url != nil, @"cannot export to a nil URL");
 
-	metaStr = [[self drawingInfo] objectForKey:[kDKDrawingInfoDraughter lowercaseString]];
+	CGImageDestinationRef destRef = CGImageDestinationCreateWithURL((CFURLRef)url, (CFStringRef)type, 1, NULL);
 
-	if (metaStr)
-		[tiffInfo setObject:metaStr
-					 forKey:(NSString*)kCGImagePropertyTIFFArtist];
+	if (destRef == NULL)
+		return NO;
 
-	metaStr = [[self drawingInfo] objectForKey:[kDKDrawingInfoDrawingNumber lowercaseString]];
+	NSMutableDictionary* streamed = [[props mutableCopy] autorelease];
 
-	if (metaStr)
-		[tiffInfo setObject:metaStr
-					 forKey:(NSString*)kCGImagePropertyTIFFDocumentName];
+	if (streamed == nil)
+		streamed = [NSMutableDictionary dictionary];
 
-	[tiffInfo setObject:[[NSDate date] description]
-				 forKey:(NSString*)kCGImagePropertyTIFFDateTime];
+	[streamed setObject:[NSNumber numberWithBool:YES]
+				 forKey:kDKExportedImageIsBanded];
 
-	[options setObject:tiffInfo
-				forKey:(NSString*)kCGImagePropertyTIFFDictionary];
+	BOOL result = [self addImageOfType:(CFStringRef)type
+							properties:streamed
+						 toDestination:destRef
+						reportProgress:YES];
 
-	value = [props objectForKey:kDKExportedImageHasAlpha];
+	result = result && CGImageDestinationFinalize(destRef);
+	CFRelease(destRef);
 
-	BOOL hasAlpha = NO;
+	postExportProgress(self, 1.0);
 
-	if (value != nil)
-		hasAlpha = [value boolValue];
+	return result;
+}
 
-	// generate the bitmap image at the required size
+/** @brief Writes the drawing as a pdf file
 
-	CGImageRef image = [self CGImageWithResolution:dpi
-										  hasAlpha:hasAlpha
-									 relativeScale:scale];
+ The pdf is printed straight to the file rather than being built in memory first. This must be called on the main thread.
+ @param url a file URL
+ @return YES if the file was written
+ */
+- (BOOL)writePDFToURL:(NSURL*)url
+{
+	NSAssert(url != nil, @"cannot export to a nil URL");
+	NSAssert([NSThread isMainThread], @"pdf export draws with AppKit so must be done on the main thread");
 
-	NSAssert(image != nil, @"could not create image for TIFF export");
+	[self finalizePriorToSaving];
 
-	if (image == nil)
-		return nil;
+	NSRect frame = NSZeroRect;
+	frame.size = [self drawingSize];
 
-	// encode it to data using Image I/O
+	DKLayerPDFView* pdfView = [[DKLayerPDFView alloc] initWithFrame:frame
+														  withLayer:self];
+	DKViewController* vc = [pdfView makeViewController];
 
-	CFMutableDataRef data = CFDataCreateMutable(kCFAllocatorDefault, 0);
-	CGImageDestinationRef destRef = CGImageDestinationCreateWithData(data, kUTTypeTIFF, 1, NULL);
+	[self addController:vc];
 
-	CGImageDestinationAddImage(destRef, image, (CFDictionaryRef)options);
+	NSPrintOperation* op = [NSPrintOperation PDFOperationWithView:pdfView
+													   insideRect:frame
+														   toPath:[url path]
+														printInfo:[NSPrintInfo sharedPrintInfo]];
+	[op setShowsPrintPanel:NO];
+	[op setShowsProgressPanel:NO];
 
-	BOOL result = CGImageDestinationFinalize(destRef);
+	BOOL result = [op runOperation];
 
-	CFRelease(destRef);
+	[pdfView release]; // removes the controller
 
-	if (result)
-		return [(NSData*)data autorelease];
-	else {
-		CFRelease(data);
-		return nil;
-	}
+	return result;
 }
 
-/** @brief Returns PNG data for the drawing.
- @param props various parameters and properties
- @return PNG data or nil if there was a problem
- DrawKit properties that control the data generation. Users may find the convenience methods
- below easier to use for many typical situations.
+/** @brief Writes the drawing as an SVG file
+
+ The document is streamed to the file as it's written, by a DKSVGExporter. The images of image shapes are written to a directory beside the
+ file, named after it with "_images" at the end, which is only made if there are any. This must be called on the main thread, unless the
+ drawing is used by no other thread.
+ @param url a file URL
+ @return YES if the file was written
  */
-- (NSData*)PNGDataWithProperties:(NSDictionary*)props
+- (BOOL)writeSVGToURL:(NSURL*)url
 {
-	NSAssert(props != nil, @"cannot create PNG data - properties were nil");
+	NSAssert(url != nil, @"cannot export to a nil URL");
 
-	NSInteger dpi = [[props objectForKey:kDKExportPropertiesResolution] integerValue];
+	[self finalizePriorToSaving];
 
-	if (dpi == 0)
-		dpi = 72;
+	NSString* imageDirectory = [[[url lastPathComponent] stringByDeletingPathExtension] stringByAppendingString:@"_images"];
+	DKSVGExporter* exporter = [[DKSVGExporter alloc] initWithDrawing:self
+															  layers:[self exportedLayers]];
+	NSOutputStream* stream = [NSOutputStream outputStreamWithURL:url
+														  append:NO];
 
-	CGFloat scale = [[props objectForKey:kDKExportedImageRelativeScale] doubleValue];
+	[exporter setImageDirectoryURL:[[url URLByDeletingLastPathComponent] URLByAppendingPathComponent:imageDirectory]];
+	[exporter setImageReferencePrefix:[[imageDirectory stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding] stringByAppendingString:@"/"]];
 
-	if (scale == 0)
-		scale = 1.0;
-
-	NSMutableDictionary* options = [[props mutableCopy] autorelease];
+	[stream open];
+	BOOL result = [exporter writeToStream:stream];
+	[stream close];
+	[exporter release];
 
-	[options setObject:[NSNumber numberWithInteger:dpi]
-				forKey:(NSString*)kCGImagePropertyDPIWidth];
-	[options setObject:[NSNumber numberWithInteger:dpi]
-				forKey:(NSString*)kCGImagePropertyDPIHeight];
-
-	NSNumber* value;
-
-	value = [props objectForKey:NSImageInterlaced];
-	if (value != nil)
-		[options setObject:[NSDictionary dictionaryWithObject:value
-													   forKey:(NSString*)kCGImagePropertyPNGInterlaceType]
-					forKey:(NSString*)kCGImagePropertyPNGDictionary];
-
-	// generate the bitmap image at the required size
-
-	CGImageRef image = [self CGImageWithResolution:dpi
-										  hasAlpha:NO
-									 relativeScale:scale];
-
-	NSAssert(image != nil, @"could not create image for PNG export");
-
-	if (image == nil)
-		return nil;
-
-	// encode it to data using Image I/O
+	return result;
+}
 
-	CFMutableDataRef data = CFDataCreateMutable(kCFAllocatorDefault, 0);
-	CGImageDestinationRef destRef = CGImageDestinationCreateWithData(data, kUTTypePNG, 1, NULL);
+/** @brief Writes the drawing as SVG to a stream
 
-	CGImageDestinationAddImage(destRef, image, (CFDictionaryRef)options);
+ Images are referred to but not written; their file names, after the prefix, are their keys in the image manager with an extension for
+ their format. This must be called on the main thread.
+ @param stream an output stream, opened if it isn't already, and left open
+ @param prefix what comes before each image's file name in the references to it, or nil
+ @return YES if the document was written
+ */
+- (BOOL)writeSVGToStream:(NSOutputStream*)stream imageReferencePrefix:(NSString*)prefix
+{
+	[self finalizePriorToSaving];
 
-	BOOL result = CGImageDestinationFinalize(destRef);
+	DKSVGExporter* exporter = [[DKSVGExporter alloc] initWithDrawing:self
+															  layers:[self exportedLayers]];
+	[exporter setImageReferencePrefix:prefix];
 
-	CFRelease(destRef);
+	BOOL result = [exporter writeToStream:stream];
+	[exporter release];
 
-	if (result)
-		return [(NSData*)data autorelease];
-	else {
-		CFRelease(data);
-		return nil;
-	}
+	return result;
 }
 
 #pragma mark -
@@ -389,40 +642,69 @@ NSString* kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale";
 
 /** @brief Returns JPEG data for the drawing at 50% actual size, with 50% quality
 
- Useful for e.g. generating QuickLook thumbnails
+ Useful for e.g. generating QuickLook thumbnails. The data comes from the drawing's thumbnail, which only renders the areas that have
+ changed since it was last asked for. Chunked drawing files include it so it can be read without reading the drawing.
  @return JPEG data
  */
 - (NSData*)thumbnailData
 {
-	NSDictionary* props = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInteger:72], kDKExportPropertiesResolution,
-																	 [NSNumber numberWithDouble:0.5], NSImageCompressionFactor,
-																	 [NSNumber numberWithBool:YES], NSImageProgressive,
-																	 [NSNumber numberWithDouble:0.5], kDKExportedImageRelativeScale,
-																	 nil];
-
-	return [self JPEGDataWithProperties:props];
+	return [[self thumbnail] data];
 }
 
 /** @brief Returns an array of bitmaps (NSBitmapImageReps) one per layer
 
- The lowest index is the bottom layer. Hidden layers and non-printing layers are excluded.
+ The lowest index is the bottom layer. Hidden layers and non-printing layers are excluded. The layers are drawn as pdf
+ on the calling thread, then rendered into their bitmaps concurrently.
  @param dpi the desired resolution in dots per inch.
  @return an array of bitmaps
  */
 - (NSArray*)layerBitmapsWithDPI:(NSUInteger)dpi
 {
-	NSMutableArray* layerBitmaps = [NSMutableArray array];
-	NSEnumerator* iter = [[self flattenedLayers] reverseObjectEnumerator];
-	DKLayer* layer;
+	NSArray* layers = [self exportedLayers];
+	NSUInteger i, count = [layers count];
 
-	while ((layer = [iter nextObject])) {
-		if ([layer visible] && [layer shouldDrawToPrinter]) {
-			NSBitmapImageRep* rep = [layer bitmapRepresentationWithDPI:dpi];
-			if (rep)
-				[layerBitmaps addObject:rep];
+	if (count == 0)
+		return [NSArray array];
+
+	if (dpi == 0)
+		dpi = 72;
+
+	// the pdfs are made here, then the layers rendered from them concurrently
+
+	DKLayerRenderBatch batch;
+	NSSize bmSize = [self exportedImageSizeWithResolution:dpi
+											relativeScale:1.0];
+
+	batch.layers = calloc(count, sizeof(DKLayerRender));
+	batch.colorSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	batch.width = (size_t)bmSize.width;
+	batch.height = (size_t)bmSize.height;
+
+	for (i = 0; i < count; ++i)
+		batch.layers[i].pdfData = (CFDataRef)[[[layers objectAtIndex:i] pdf] retain];
+
+	LogEvent_(kInfoEvent, @"rendering %lu layers concurrently, size = %@, dpi = %lu", (unsigned long)count, NSStringFromSize(bmSize), (unsigned long)dpi);
+
+	dispatch_apply_f(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &batch, renderLayer);
+
+	NSMutableArray* layerBitmaps = [NSMutableArray arrayWithCapacity:count];
+
+	for (i = 0; i < count; ++i) {
+		if (batch.layers[i].image) {
+			NSBitmapImageRep* rep = [[NSBitmapImageRep alloc] initWithCGImage:batch.layers[i].image];
+
+			[layerBitmaps addObject:rep];
+			[rep release];
+			CGImageRelease(batch.layers[i].image);
 		}
+
+		if (batch.layers[i].pdfData)
+			CFRelease(batch.layers[i].pdfData);
 	}
 
+	CGColorSpaceRelease(batch.colorSpace);
+	free(batch.layers);
+
 	return layerBitmaps;
 }
 
@@ -437,4 +719,250 @@ NSString* kDKExportedImageRelativeScale = @"kDKExportedImageRelativeScale";
 	return [NSBitmapImageRep TIFFRepresentationOfImageRepsInArray:[self layerBitmapsWithDPI:dpi]];
 }
 
+/** @brief Writes a TIFF file with one image per layer
+
+ Each layer's image is rendered in bands, concurrently, as the encoder reads it, and written straight to the file, so only a few bands
+ of one layer are in memory at any time. kDKDrawingExportProgressNotification is posted as the layers are rendered. This must be
+ called on the main thread, since the layers are first drawn as pdf.
+ @param url a file URL
+ @param dpi the desired resolution in dots per inch.
+ @return YES if the file was written
+ */
+- (BOOL)writeMultipartTIFFToURL:(NSURL*)url resolution:(NSUInteger)dpi
+{
+	NSAssert(url != nil, @"cannot export to a nil URL");
+
+	NSArray* layers = [self exportedLayers];
+	NSUInteger i, count = [layers count];
+
+	if (count == 0)
+		return NO;
+
+	if (dpi == 0)
+		dpi = 72;
+
+	CGImageDestinationRef destRef = CGImageDestinationCreateWithURL((CFURLRef)url, kUTTypeTIFF, count, NULL);
+
+	if (destRef == NULL)
+		return NO;
+
+	NSSize bmSize = [self exportedImageSizeWithResolution:dpi
+											relativeScale:1.0];
+	NSDictionary* options = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithUnsignedInteger:dpi], (NSString*)kCGImagePropertyDPIWidth,
+																	   [NSNumber numberWithUnsignedInteger:dpi], (NSString*)kCGImagePropertyDPIHeight, nil];
+
+	for (i = 0; i < count; ++i) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		CGImageRef image = createBandedImage([[layers objectAtIndex:i] pdf], bmSize, YES, nil, self, (double)i / count, 1.0 / count);
+
+		if (image) {
+			CGImageDestinationAddImage(destRef, image, (CFDictionaryRef)options);
+			CGImageRelease(image);
+		}
+
+		[pool drain];
+	}
+
+	BOOL result = CGImageDestinationFinalize(destRef);
+	CFRelease(destRef);
+
+	postExportProgress(self, 1.0);
+
+	return result;
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKDrawing (ExportPrivate)
+
+- (NSSize)exportedImageSizeWithResolution:(NSInteger)dpi relativeScale:(CGFloat)relScale
+{
+	NSSize bmSize = [self drawingSize];
+
+	bmSize.width = ceil((bmSize.width * (CGFloat)dpi * relScale) / 72.0f);
+	bmSize.height = ceil((bmSize.height * (CGFloat)dpi * relScale) / 72.0f);
+
+	return bmSize;
+}
+
+- (BOOL)shouldUseBandedExportForSize:(NSSize)size properties:(NSDictionary*)props
+{
+	NSNumber* banded = [props objectForKey:kDKExportedImageIsBanded];
+
+	if (banded)
+		return [banded boolValue];
+
+	return (size.width * size.height >= kDKExportBandedPixelThreshold);
+}
+
+- (NSArray*)exportedLayers
+{
+	// the lowest index is the bottom layer. Hidden layers and non-printing layers are excluded.
+
+	NSMutableArray* layers = [NSMutableArray array];
+	NSEnumerator* iter = [[self flattenedLayers] reverseObjectEnumerator];
+	DKLayer* layer;
+
+	while ((layer = [iter nextObject])) {
+		if ([layer visible] && [layer shouldDrawToPrinter])
+			[layers addObject:layer];
+	}
+
+	return layers;
+}
+
+- (NSData*)imageDataOfType:(CFStringRef)type properties:(NSDictionary*)props
+{
+	CFMutableDataRef data = CFDataCreateMutable(kCFAllocatorDefault, 0);
+	CGImageDestinationRef destRef = CGImageDestinationCreateWithData(data, type, 1, NULL);
+	BOOL result = [self addImageOfType:type
+							properties:props
+						 toDestination:destRef
+						reportProgress:NO];
+
+	result = result && CGImageDestinationFinalize(destRef);
+	CFRelease(destRef);
+
+	if (result)
+		return [(NSData*)data autorelease];
+	else {
+		CFRelease(data);
+		return nil;
+	}
+}
+
+- (BOOL)addImageOfType:(CFStringRef)type properties:(NSDictionary*)props toDestination:(CGImageDestinationRef)destRef reportProgress:(BOOL)report
+{
+	if (destRef == NULL)
+		return NO;
+
+	// convert properties into a form useful to Image I/O
+
+	NSInteger dpi = [[props objectForKey:kDKExportPropertiesResolution] integerValue];
+
+	if (dpi == 0)
+		dpi = 72;
+
+	CGFloat scale = [[props objectForKey:kDKExportedImageRelativeScale] doubleValue];
+
+	if (scale == 0)
+		scale = 1.0;
+
+	NSMutableDictionary* options = [[props mutableCopy] autorelease];
+	[options removeObjectForKey:kDKExportedImageIsBanded];
+
+	[options setObject:[NSNumber numberWithInteger:dpi]
+				forKey:(NSString*)kCGImagePropertyDPIWidth];
+	[options setObject:[NSNumber numberWithInteger:dpi]
+				forKey:(NSString*)kCGImagePropertyDPIHeight];
+
+	NSNumber* value;
+	BOOL hasAlpha = NO;
+
+	if (UTTypeEqual(type, kUTTypeJPEG)) {
+		value = [props objectForKey:NSImageCompressionFactor];
+		if (value == nil)
+			value = [NSNumber numberWithDouble:0.67];
+
+		[options setObject:value
+					forKey:(NSString*)kCGImageDestinationLossyCompressionQuality];
+
+		value = [props objectForKey:NSImageProgressive];
+		if (value != nil)
+			[options setObject:[NSDictionary dictionaryWithObject:value
+														   forKey:(NSString*)kCGImagePropertyJFIFIsProgressive]
+						forKey:(NSString*)kCGImagePropertyJFIFDictionary];
+	} else if (UTTypeEqual(type, kUTTypeTIFF)) {
+		// set up a TIFF-specific dictionary
+
+		NSMutableDictionary* tiffInfo = [NSMutableDictionary dictionary];
+
+		value = [props objectForKey:NSImageCompressionMethod];
+		if (value != nil)
+			[tiffInfo setObject:value
+						 forKey:(NSString*)kCGImagePropertyTIFFCompression];
+
+		[tiffInfo setObject:[NSString stringWithFormat:@"DrawKit %@ (c)2008 apptree.net", [[self class] drawkitVersionString]]
+					 forKey:(NSString*)kCGImagePropertyTIFFSoftware];
+
+		NSString* metaStr;
+
+		metaStr = [[self drawingInfo] objectForKey:[kDKDrawingInfoDraughter lowercaseString]];
+
+		if (metaStr)
+			[tiffInfo setObject:metaStr
+						 forKey:(NSString*)kCGImagePropertyTIFFArtist];
+
+		metaStr = [[self drawingInfo] objectForKey:[kDKDrawingInfoDrawingNumber lowercaseString]];
+
+		if (metaStr)
+			[tiffInfo setObject:metaStr
+						 forKey:(NSString*)kCGImagePropertyTIFFDocumentName];
+
+		[tiffInfo setObject:[[NSDate date] description]
+					 forKey:(NSString*)kCGImagePropertyTIFFDateTime];
+
+		[options setObject:tiffInfo
+					forKey:(NSString*)kCGImagePropertyTIFFDictionary];
+
+		value = [props objectForKey:kDKExportedImageHasAlpha];
+
+		if (value != nil)
+			hasAlpha = [value boolValue];
+	} else if (UTTypeEqual(type, kUTTypePNG)) {
+		value = [props objectForKey:NSImageInterlaced];
+		if (value != nil)
+			[options setObject:[NSDictionary dictionaryWithObject:value
+														   forKey:(NSString*)kCGImagePropertyPNGInterlaceType]
+						forKey:(NSString*)kCGImagePropertyPNGDictionary];
+	}
+
+	// generate the bitmap image at the required size
+
+	CGImageRef image;
+
+	if (report) {
+		NSSize bmSize = [self exportedImageSizeWithResolution:dpi
+												relativeScale:scale];
+		NSData* pdfData = [self pdf];
+
+		image = pdfData ? (CGImageRef)[(NSObject*)createBandedImage(pdfData, bmSize, hasAlpha, [self paperColour], self, 0, 1.0) autorelease] : NULL;
+	} else
+		image = [self exportImageWithResolution:dpi
+									   hasAlpha:hasAlpha
+								  relativeScale:scale
+									 properties:props];
+
+	NSAssert(image != nil, @"could not create image for export");
+
+	if (image == nil)
+		return NO;
+
+	// encode it using Image I/O
+
+	CGImageDestinationAddImage(destRef, image, (CFDictionaryRef)options);
+
+	return YES;
+}
+
+- (CGImageRef)exportImageWithResolution:(NSInteger)dpi hasAlpha:(BOOL)hasAlpha relativeScale:(CGFloat)relScale properties:(NSDictionary*)props
+{
+	// large images are streamed to the encoder so the whole bitmap never needs to exist at once
+
+	NSSize bmSize = [self exportedImageSizeWithResolution:dpi
+											relativeScale:relScale];
+
+	if ([self shouldUseBandedExportForSize:bmSize
+								properties:props])
+		return [self bandedCGImageWithResolution:dpi
+										hasAlpha:hasAlpha
+								   relativeScale:relScale];
+	else
+		return [self CGImageWithResolution:dpi
+								  hasAlpha:hasAlpha
+							 relativeScale:relScale];
+}
+
 @end
@@ -5,8 +5,10 @@
 */
 
 #import "DKLayerGroup.h"
+#import "DKCacheRegistry.h"
+#import "DKTextIndex.h"
 
-@class DKGridLayer, DKGuideLayer, DKKnob, DKViewController, DKImageDataManager, DKUndoManager;
+@class DKGridLayer, DKGuideLayer, DKKnob, DKViewController, DKImageDataManager, DKRenderedImageCache, DKLayerCompositor, DKDrawingThumbnail, DKDrawingTileCache, DKMetadataIndex, DKTextIndex, DKDrawingChangeFeed, DKUndoManager;
 
 /** @brief A DKDrawing is the model data for the drawing system.
 
@@ -26,7 +28,7 @@ at a time, there is no contention here.) The commands will go to whichever view
 
 Drawings can be saved simply by archiving them, thus all parts of the drawing need to adopt the NSCoding protocol.
 */
-@interface DKDrawing : DKLayerGroup <NSCoding, NSCopying> {
+@interface DKDrawing : DKLayerGroup <NSCoding, NSCopying, DKPurgeableCache> {
 @private
 	NSString* m_units; /**< user readable drawing units string, e.g. "millimetres" */
 	DKLayer* m_activeLayerRef; /**< which one is active for editing, etc */
@@ -52,6 +54,15 @@ Drawings can be saved simply by archiving them, thus all parts of the drawing ne
 	NSRect m_lastRectUpdated; /**< for refresh in HQ mode */
 	NSMutableSet* mControllers; /**< the set of current controllers */
 	DKImageDataManager* mImageManager; /**< internal object used to substantially improve efficiency of image archiving */
+	DKRenderedImageCache* mRenderedImageCache; /**< cached images of objects with expensive styles, if enabled */
+	DKLayerCompositor* mLayerCompositor; /**< renders suitable layers concurrently and composites them, if enabled */
+	DKDrawingThumbnail* mThumbnail; /**< thumbnail kept up to date as the drawing changes, once asked for */
+	DKDrawingTileCache* mTileCache; /**< rendered tiles shared by the views that use tiled rendering, once asked for */
+	DKMetadataIndex* mMetadataIndex; /**< index of the objects by the values of chosen metadata keys, if any */
+	DKTextIndex* mTextIndex; /**< index of the objects by the words of their text, if enabled */
+	DKDrawingChangeFeed* mChangeFeed; /**< the edits made to the drawing, while they're being recorded */
+	NSRect* mPendingUpdateRects; /**< areas flagged for update since the views were last told, merged as they're added */
+	NSUInteger mPendingUpdateCount; /**< the number of rects in <mPendingUpdateRects> */
 	id mDelegateRef; /**< delegate, if any */
 	id mOwnerRef; /**< back pointer to document or view that owns this */
 }
@@ -91,6 +102,16 @@ Drawings can be saved simply by archiving them, thus all parts of the drawing ne
  */
 + (DKDrawing*)drawingWithData:(NSData*)drawingData;
 
+/** @brief Creates a drawing from a lump of data, using a particular dearchiving helper
+
+ Giving each dearchiving its own helper allows drawings to be dearchived on several threads at once, and a particular one to be
+ cancelled. Exceptions raised during dearchiving, such as kDKUnarchiverCancelledException, are passed on to the caller.
+ @param drawingData data representing an archived drawing
+ @param helper the delegate of the unarchiver, or nil for the default helper
+ @return the unarchived drawing
+ */
++ (DKDrawing*)drawingWithData:(NSData*)drawingData dearchivingHelper:(id)helper;
+
 /** @brief Return the default derachiving helper for deaerchiving a drawing
 
  This helper is a delegate of the dearchiver during dearchiving and translates older or obsolete
@@ -109,6 +130,17 @@ Drawings can be saved simply by archiving them, thus all parts of the drawing ne
  */
 + (void)setDearchivingHelper:(id)helper;
 
+/** @brief Sets whether identical unshared styles are collapsed into one shared style when reading
+
+ When YES, each drawing read, and each set of objects pasted, is decoded with a DKStyleInternTable, so
+ the unshared styles that have the same content become one shared style. This saves a lot of memory
+ for drawings imported from elsewhere, which often carry thousands of copies of a few styles, but
+ means that editing the style of one of those objects changes them all. The default is NO.
+ @param intern YES to intern styles
+ */
++ (void)setInternsStylesWhenReading:(BOOL)intern;
++ (BOOL)internsStylesWhenReading;
+
 /** @brief Returns a new drawing number by incrementing the current default seed value
  @return a new drawing number
  */
@@ -234,6 +266,24 @@ Drawings can be saved simply by archiving them, thus all parts of the drawing ne
 
 - (void)objectDidNotifyStatusChange:(id)object;
 
+/** @brief Passes the areas flagged for update to the views now
+
+ On the main thread, -setNeedsDisplayInRect: collects the areas flagged during a turn of the run loop rather than passing each to
+ the views as it's made. As each is added it is merged with any other where redrawing the union costs less than redrawing both - so
+ nearby rects combine but distant ones stay apart - and there are never more than a few. Before the run loop waits, and so before the
+ views draw, the merged areas are passed to each controller in one call. Call this to pass them on sooner, such as before displaying a
+ view directly.
+ */
+- (void)flushPendingDisplayUpdates;
+
+/** @brief Marks an area of the views for update without discarding anything cached of the drawing's content there
+
+ For changes to what the layers draw over their content (see -[DKLayer drawOverlayRect:inView:]), such as the selection. A view that
+ caches the content as tiles redraws the area from the tiles and draws the overlay over them. The views are told at once.
+ @param rect the area within the drawing to update
+ */
+- (void)setNeedsOverlayDisplayInRect:(NSRect)rect;
+
 /** @} */
 /** @name dynamically adjusting the rendering quality:
  @{ */
@@ -275,6 +325,15 @@ Drawings can be saved simply by archiving them, thus all parts of the drawing ne
 - (void)setPaperColourIsPrinted:(BOOL)printIt;
 - (BOOL)paperColourIsPrinted;
 
+/** @brief Renders the drawing into the current graphics context without a view
+
+ Unlike -drawRect:inView:, this doesn't tell the delegate, adjust the knobs or start the low quality timer, so it can be called on
+ any thread. It is used by DKDrawingRenderer, which sets up the context.
+ @param rect the area to draw
+ @param paper YES to paint the paper colour behind the drawing
+ */
+- (void)drawContentInRect:(NSRect)rect drawsPaper:(BOOL)paper;
+
 /** @} */
 /** @name active layer
  @{ */
@@ -343,6 +402,7 @@ Drawings can be saved simply by archiving them, thus all parts of the drawing ne
 - (NSData*)drawingAsXMLDataAtRoot;
 - (NSData*)drawingAsXMLDataForKey:(NSString*)key;
 - (NSData*)drawingData;
+- (NSData*)chunkedDrawingData;
 - (NSData*)pdf;
 
 /** @} */
@@ -357,6 +417,158 @@ Drawings can be saved simply by archiving them, thus all parts of the drawing ne
  */
 - (DKImageDataManager*)imageManager;
 
+/** @} */
+/** @name rendered image cache
+ @{ */
+
+/** @brief Sets whether objects with expensive styles are drawn from cached images
+
+ When enabled, objects whose styles are slow to render (see -[DKStyle isExpensiveToRender]) are rasterized once at the current view scale
+ and blitted on subsequent redraws, until they or their style change. The images share a single memory budget for the whole drawing.
+ Disabling the cache discards all of the images. The default is NO.
+ @param caches YES to cache object images, NO to always render objects directly
+ */
+- (void)setCachesRenderedObjectImages:(BOOL)caches;
+- (BOOL)cachesRenderedObjectImages;
+
+/** @brief Returns the drawing's rendered image cache
+ @return the cache, or nil if rendered image caching is not enabled
+ */
+- (DKRenderedImageCache*)renderedImageCache;
+
+/** @} */
+/** @name layer compositing
+ @{ */
+
+/** @brief Sets whether suitable layers are rendered concurrently into bitmaps and composited
+
+ When enabled, each of the drawing's own layers that is suitable (see -[DKObjectOwnerLayer isSuitableForConcurrentCompositing]) - by
+ default, inactive object layers with the kDKLayerCacheUsingCGLayer cache option - is kept as a bitmap of the view's visible area.
+ As the view draws, only the layers that have changed are re-rendered, several at once on worker threads, and the bitmaps are drawn in
+ order between the layers drawn directly, so editing one layer costs that layer's render plus a composite. Disabling it discards
+ the bitmaps. The default is NO.
+ @param composite YES to composite suitable layers, NO to draw every layer directly
+ */
+- (void)setCompositesLayersConcurrently:(BOOL)composite;
+- (BOOL)compositesLayersConcurrently;
+
+/** @brief Returns the drawing's layer compositor
+ @return the compositor, or nil if layer compositing is not enabled
+ */
+- (DKLayerCompositor*)layerCompositor;
+
+/** @brief Returns the drawing's thumbnail, making it if necessary
+
+ The thumbnail is kept up to date as the drawing changes, so asking for its data only renders what has changed since it was last asked
+ for. Making it renders the whole drawing the first time its data is asked for.
+ @return the thumbnail
+ */
+- (DKDrawingThumbnail*)thumbnail;
+
+/** @brief Returns the cache of rendered tiles shared by the drawing's views, making it if necessary
+
+ Views that use tiled rendering (see -[DKDrawingView setUsesTiledRendering:]) all draw from this cache, which keeps the tiles for each
+ scale and backing scale factor apart, so views showing the drawing at the same scale and on the same kind of screen share the tiles
+ rendered by any of them. As the thumbnail, the cache is invalidated by the drawing once for each area updated, rather than by each view.
+ @return the tile cache
+ */
+- (DKDrawingTileCache*)tileCache;
+
+/** @brief Sets whether the edits made to the drawing's objects are recorded in a change feed
+
+ The feed starts empty, so a consumer should first take a copy of the whole drawing, and then keep it up to date by applying the records
+ taken from the feed. Turning recording off discards the feed. The default is NO.
+ @param record YES to record changes
+ */
+- (void)setRecordsChanges:(BOOL)record;
+- (BOOL)recordsChanges;
+
+/** @brief Returns the drawing's change feed
+ @return the feed, or nil if changes aren't being recorded
+ */
+- (DKDrawingChangeFeed*)changeFeed;
+
+/** @} */
+/** @name metadata queries
+ @{ */
+
+/** @brief Sets the metadata keys whose values the drawing's objects are indexed by
+
+ Finding objects by the value of an indexed key uses the index rather than reading the metadata of every object. Only the objects owned
+ directly by the drawing's layers are found, by the metadata they have themselves. Keys are not case sensitive, as for metadata.
+ @param keys an array of metadata keys, or nil or an empty array to stop indexing
+ */
+- (void)setIndexedMetadataKeys:(NSArray*)keys;
+- (NSArray*)indexedMetadataKeys;
+
+/** @brief Returns the drawing's metadata index
+ @return the index, or nil if no keys are indexed
+ */
+- (DKMetadataIndex*)metadataIndex;
+
+/** @brief Returns the objects whose metadata has a given value for a key
+
+ The key needn't be indexed, but if it isn't every object is looked at.
+ @param value the value
+ @param key the metadata key
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsWithMetadataValue:(id)value forKey:(NSString*)key;
+
+/** @brief Returns the objects whose metadata for a key lies in an inclusive range
+
+ Numbers and strings can be found by range; the bounds give which of them are found.
+ @param low the lowest value, or nil for no lower limit
+ @param high the highest value, or nil for no upper limit
+ @param key the metadata key
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsWithMetadataValuesFrom:(id)low to:(id)high forKey:(NSString*)key;
+
+/** @brief Returns the objects touching a rect whose metadata has a given value for a key
+ @param value the value
+ @param key the metadata key
+ @param rect the rect, tested using the objects' intersectsRect: method
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsWithMetadataValue:(id)value forKey:(NSString*)key inRect:(NSRect)rect;
+- (NSArray*)objectsWithMetadataValuesFrom:(id)low to:(id)high forKey:(NSString*)key inRect:(NSRect)rect;
+
+/** @} */
+/** @name text queries
+ @{ */
+
+/** @brief Sets whether the drawing's objects are indexed by the words of their text
+
+ Finding objects by their text uses the index rather than getting the text of every object. See DKTextIndex for the text that is indexed.
+ @param indexes YES to index text, NO to stop
+ */
+- (void)setIndexesText:(BOOL)indexes;
+- (BOOL)indexesText;
+
+/** @brief Returns the drawing's text index
+ @return the index, or nil if text isn't indexed
+ */
+- (DKTextIndex*)textIndex;
+
+/** @brief Returns the objects having some text
+
+ Every word of the text must be found in an object's text, in any order, ignoring case and diacritics. Text needn't be indexed, but if it
+ isn't every object's text is looked at.
+ @param text the text to find
+ @param options kDKTextSearchPrefix to find words beginning with those given
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsMatchingText:(NSString*)text options:(DKTextSearchOptions)options;
+
+/** @brief Returns the objects touching a rect having some text
+ @param text the text to find
+ @param options the search options
+ @param rect the rect, tested using the objects' intersectsRect: method
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsMatchingText:(NSString*)text options:(DKTextSearchOptions)options inRect:(NSRect)rect;
+
 /** @} */
 @end
 
@@ -15,15 +15,29 @@
 #import "DKGridLayer.h"
 #import "DKGuideLayer.h"
 #import "DKKnob.h"
+#import "NSColor+DKAdditions.h"
 #import "DKObjectDrawingLayer.h"
 #import "DKViewController.h"
 #import "DKUniqueID.h"
 #import "LogEvent.h"
 #import "DKLayer+Metadata.h"
 #import "DKImageDataManager.h"
+#import "DKRenderedImageCache.h"
+#import "DKLayerCompositor.h"
+#import "DKDrawingThumbnail.h"
+#import "DKDrawingTileCache.h"
 #import "DKKeyedUnarchiver.h"
 #import "DKUnarchivingHelper.h"
 #import "DKUndoManager.h"
+#import "DKChunkedDrawingArchive.h"
+#import "DKStyleInternTable.h"
+#import "DKMetadataIndex.h"
+#import "DKDrawingChangeFeed.h"
+#import "DKDrawableObject+Dependencies.h"
+#import "DKMemoryFootprint.h"
+#import "DKShadowCache.h"
+#import "DKStyleSwatchCache.h"
+#import "DKGlyphOutlineCache.h"
 
 #pragma mark Contants(Non - localized)
 
@@ -67,6 +81,20 @@ NSString* kDKDrawingUnitAbbreviationsUserDefault = @"kDKDrawingUnitAbbreviations
 #pragma mark Static vars
 
 static id sDearchivingHelper = nil;
+static BOOL sInternsStylesWhenReading = NO;
+
+// display updates collected on the main thread, passed on before the run loop waits. The observer runs after the one that posts
+// coalesced style changes (order 0), so that the updates those cause go out in the same turn
+
+#define kDKMaximumPendingUpdateRects 16
+#define kDKUpdateRectOverheadArea 4096.0 // the area it's worth redrawing to save passing one more rect, in drawing units
+#define kDKPendingUpdatesObserverOrder 1
+
+static CFMutableSetRef sDrawingsWithPendingUpdates = NULL;
+static CFRunLoopObserverRef sPendingUpdatesObserver = NULL;
+
+static NSUInteger addUpdateRect(NSRect* rects, NSUInteger count, NSRect rect);
+static void pendingUpdatesObserverCallback(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void* info);
 
 #pragma mark -
 @implementation DKDrawing
@@ -176,29 +204,76 @@ static id sDearchivingHelper = nil;
  @return the unarchived drawing
  */
 + (DKDrawing*)drawingWithData:(NSData*)drawingData
+{
+	return [self drawingWithData:drawingData
+			   dearchivingHelper:nil];
+}
+
+/** @brief Creates a drawing from a lump of data, using a particular dearchiving helper
+
+ Giving each dearchiving its own helper allows drawings to be dearchived on several threads at once, and a particular one to be
+ cancelled. Exceptions raised during dearchiving, such as kDKUnarchiverCancelledException, are passed on to the caller.
+ @param drawingData data representing an archived drawing
+ @param helper the delegate of the unarchiver, or nil for the default helper
+ @return the unarchived drawing
+ */
++ (DKDrawing*)drawingWithData:(NSData*)drawingData dearchivingHelper:(id)helper
 {
 	NSAssert(drawingData != nil, @"drawing data was nil - unable to proceed");
 	NSAssert([drawingData length] > 0, @"drawing data was empty - unable to proceed");
 
+	// in order to translate older files with classes named 'GC' instead of 'DK', need a delegate that can handle the
+	// translation. DKUnarchivingHelper can also be used to report loading progress.
+
+	if (helper == nil)
+		helper = [self dearchivingHelper];
+
+	// files in the chunked format are recognised by their header and read a chunk at a time
+
+	if ([DKChunkedDrawingReader canReadData:drawingData]) {
+		DKChunkedDrawingReader* reader = [[DKChunkedDrawingReader alloc] initWithData:drawingData];
+		DKDrawing* dwg = nil;
+
+		@try {
+			[reader setDearchivingHelper:helper];
+
+			if (sInternsStylesWhenReading) {
+				DKStyleInternTable* table = [[DKStyleInternTable alloc] init];
+				[reader setStyleInternTable:table];
+				[table release];
+			}
+
+			dwg = [reader readDrawing];
+		}
+		@finally {
+			[reader release];
+		}
+
+		return dwg;
+	}
+
 	// using DKKeyedUnarchiver allows passing of image data manager to dearchiving methods for certain objects
 
 	DKKeyedUnarchiver* unarch = [[DKKeyedUnarchiver alloc] initForReadingWithData:drawingData];
+	DKStyleInternTable* internTable = sInternsStylesWhenReading ? [[DKStyleInternTable alloc] init] : nil;
+	DKDrawing* dwg = nil;
 
-	// in order to translate older files with classes named 'GC' instead of 'DK', need a delegate that can handle the
-	// translation. DKUnarchivingHelper can also be used to report loading progress.
-
-	id dearchivingHelper = [self dearchivingHelper];
-	if ([dearchivingHelper respondsToSelector:@selector(reset)])
-		[dearchivingHelper reset];
+	if ([helper respondsToSelector:@selector(reset)])
+		[helper reset];
 
-	[unarch setDelegate:dearchivingHelper];
+	[unarch setDelegate:helper];
+	[unarch setStyleInternTable:internTable];
 
 	LogEvent_(kReactiveEvent, @"decoding drawing root object......");
 
-	DKDrawing* dwg = [unarch decodeObjectForKey:@"root"];
-
-	[unarch finishDecoding];
-	[unarch release];
+	@try {
+		dwg = [unarch decodeObjectForKey:@"root"];
+		[unarch finishDecoding];
+	}
+	@finally {
+		[unarch release];
+		[internTable release];
+	}
 
 	return dwg;
 }
@@ -232,6 +307,24 @@ static id sDearchivingHelper = nil;
 	sDearchivingHelper = helper;
 }
 
+/** @brief Sets whether identical unshared styles are collapsed into one shared style when reading
+
+ When YES, each drawing read, and each set of objects pasted, is decoded with a DKStyleInternTable, so
+ the unshared styles that have the same content become one shared style. This saves a lot of memory
+ for drawings imported from elsewhere, which often carry thousands of copies of a few styles, but
+ means that editing the style of one of those objects changes them all. The default is NO.
+ @param intern YES to intern styles
+ */
++ (void)setInternsStylesWhenReading:(BOOL)intern
+{
+	sInternsStylesWhenReading = intern;
+}
+
++ (BOOL)internsStylesWhenReading
+{
+	return sInternsStylesWhenReading;
+}
+
 #pragma mark -
 
 /** @brief Returns a new drawing number by incrementing the current default seed value
@@ -439,7 +532,9 @@ static id sDearchivingHelper = nil;
 			|| mControllers == nil) {
 			[self autorelease];
 			self = nil;
-		}
+		} else
+			[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+														priority:kDKCachePurgeLayout];
 	}
 	return self;
 }
@@ -1675,7 +1770,7 @@ static id sDearchivingHelper = nil;
 
 /** @brief Saves the entire drawing to a file
 
- Implies the binary format
+ Implies the chunked binary format, which is streamed to the file a chunk at a time rather than being built in memory first.
  @param filename the full path of the file 
  @param atom YES to save to a temporary file and swap (safest), NO to overwrite file
  @return YES if succesfully written, NO otherwise
@@ -1687,8 +1782,39 @@ static id sDearchivingHelper = nil;
 
 	[[self drawingInfo] setObject:filename
 						   forKey:kDKDrawingInfoOriginalFilename];
-	return [[self drawingData] writeToFile:filename
-								atomically:atom];
+
+	NSString* path = atom ? [filename stringByAppendingFormat:@".%@", [DKUniqueID uniqueKey]] : filename;
+	NSOutputStream* stream = [NSOutputStream outputStreamToFileAtPath:path
+															   append:NO];
+	[stream open];
+
+	BOOL result = [DKChunkedDrawingWriter writeDrawing:self
+											  toStream:stream];
+	[stream close];
+
+	if (atom) {
+		NSFileManager* fm = [NSFileManager defaultManager];
+
+		if (result) {
+			if ([fm fileExistsAtPath:filename])
+				result = [fm replaceItemAtURL:[NSURL fileURLWithPath:filename]
+								withItemAtURL:[NSURL fileURLWithPath:path]
+							   backupItemName:nil
+									  options:0
+							 resultingItemURL:NULL
+										error:NULL];
+			else
+				result = [fm moveItemAtPath:path
+									 toPath:filename
+									  error:NULL];
+		}
+
+		if (!result)
+			[fm removeItemAtPath:path
+						   error:NULL];
+	}
+
+	return result;
 }
 
 /** @brief Returns the entire drawing's data in XML format, having the key "root"
@@ -1741,6 +1867,24 @@ static id sDearchivingHelper = nil;
 	return [NSKeyedArchiver archivedDataWithRootObject:self];
 }
 
+/** @brief Returns the entire drawing's data in the chunked binary format
+
+ See DKChunkedDrawingWriter for details of the format. -drawingWithData: reads either this or -drawingData.
+ @return an NSData object which is the entire drawing and all its contents
+ */
+- (NSData*)chunkedDrawingData
+{
+	NSOutputStream* stream = [NSOutputStream outputStreamToMemory];
+	[stream open];
+
+	BOOL result = [DKChunkedDrawingWriter writeDrawing:self
+											  toStream:stream];
+	NSData* data = [stream propertyForKey:NSStreamDataWrittenToMemoryStreamKey];
+	[stream close];
+
+	return result ? data : nil;
+}
+
 /** @brief The entire drawing in PDF format
 
  When rendering a drawing for PDF, the drawing acts as if it were printing, therefore layers that
@@ -1764,6 +1908,350 @@ static id sDearchivingHelper = nil;
 	return mImageManager;
 }
 
+#pragma mark -
+
+/** @brief Sets whether objects with expensive styles are drawn from cached images
+
+ When enabled, objects whose styles are slow to render (see -[DKStyle isExpensiveToRender]) are rasterized once at the current view scale
+ and blitted on subsequent redraws, until they or their style change. The images share a single memory budget for the whole drawing.
+ Disabling the cache discards all of the images. The default is NO.
+ @param caches YES to cache object images, NO to always render objects directly
+ */
+- (void)setCachesRenderedObjectImages:(BOOL)caches
+{
+	if (caches != [self cachesRenderedObjectImages]) {
+		if (caches)
+			mRenderedImageCache = [[DKRenderedImageCache alloc] init];
+		else {
+			[mRenderedImageCache release];
+			mRenderedImageCache = nil;
+		}
+
+		[self setNeedsDisplay:YES];
+	}
+}
+
+- (BOOL)cachesRenderedObjectImages
+{
+	return mRenderedImageCache != nil;
+}
+
+/** @brief Returns the drawing's rendered image cache
+ @return the cache, or nil if rendered image caching is not enabled
+ */
+- (DKRenderedImageCache*)renderedImageCache
+{
+	return mRenderedImageCache;
+}
+
+#pragma mark -
+
+/** @brief Sets whether suitable layers are rendered concurrently into bitmaps and composited
+
+ When enabled, each of the drawing's own layers that is suitable (see -[DKObjectOwnerLayer isSuitableForConcurrentCompositing]) - by
+ default, inactive object layers with the kDKLayerCacheUsingCGLayer cache option - is kept as a bitmap of the view's visible area.
+ As the view draws, only the layers that have changed are re-rendered, several at once on worker threads, and the bitmaps are drawn in
+ order between the layers drawn directly, so editing one layer costs that layer's render plus a composite. Disabling it discards
+ the bitmaps. The default is NO.
+ @param composite YES to composite suitable layers, NO to draw every layer directly
+ */
+- (void)setCompositesLayersConcurrently:(BOOL)composite
+{
+	if (composite != [self compositesLayersConcurrently]) {
+		if (composite)
+			mLayerCompositor = [[DKLayerCompositor alloc] initWithDrawing:self];
+		else {
+			[mLayerCompositor release];
+			mLayerCompositor = nil;
+		}
+
+		[self setNeedsDisplay:YES];
+	}
+}
+
+- (BOOL)compositesLayersConcurrently
+{
+	return mLayerCompositor != nil;
+}
+
+/** @brief Returns the drawing's layer compositor
+ @return the compositor, or nil if layer compositing is not enabled
+ */
+- (DKLayerCompositor*)layerCompositor
+{
+	return mLayerCompositor;
+}
+
+/** @brief Returns the drawing's thumbnail, making it if necessary
+
+ The thumbnail is kept up to date as the drawing changes, so asking for its data only renders what has changed since it was last asked
+ for. Making it renders the whole drawing the first time its data is asked for.
+ @return the thumbnail
+ */
+- (DKDrawingThumbnail*)thumbnail
+{
+	if (mThumbnail == nil)
+		mThumbnail = [[DKDrawingThumbnail alloc] initWithDrawing:self];
+
+	return mThumbnail;
+}
+
+- (DKDrawingTileCache*)tileCache
+{
+	if (mTileCache == nil)
+		mTileCache = [[DKDrawingTileCache alloc] init];
+
+	return mTileCache;
+}
+
+- (void)setRecordsChanges:(BOOL)record
+{
+	if (record == [self recordsChanges])
+		return;
+
+	if (record)
+		mChangeFeed = [[DKDrawingChangeFeed alloc] initWithDrawing:self];
+	else {
+		[mChangeFeed setDrawing:nil];
+		[mChangeFeed release];
+		mChangeFeed = nil;
+	}
+}
+
+- (BOOL)recordsChanges
+{
+	return mChangeFeed != nil;
+}
+
+- (DKDrawingChangeFeed*)changeFeed
+{
+	return mChangeFeed;
+}
+
+#pragma mark -
+
+// adds <rect> to the list, merging it with the rect where redrawing their union costs least over redrawing both, if that's less than
+// the overhead of another rect or the list is full. A merged rect may now be worth merging with another, so it's added again
+
+static NSUInteger addUpdateRect(NSRect* rects, NSUInteger count, NSRect rect)
+{
+	NSUInteger i, best;
+	CGFloat added, leastAdded;
+	NSRect u;
+
+	while (YES) {
+		best = NSNotFound;
+		leastAdded = 0;
+
+		for (i = 0; i < count; ++i) {
+			if (NSContainsRect(rects[i], rect))
+				return count;
+
+			u = NSUnionRect(rects[i], rect);
+			added = (NSWidth(u) * NSHeight(u)) - (NSWidth(rects[i]) * NSHeight(rects[i])) - (NSWidth(rect) * NSHeight(rect));
+
+			if (best == NSNotFound || added < leastAdded) {
+				best = i;
+				leastAdded = added;
+			}
+		}
+
+		if (best == NSNotFound || (leastAdded > kDKUpdateRectOverheadArea && count < kDKMaximumPendingUpdateRects)) {
+			rects[count] = rect;
+			return count + 1;
+		}
+
+		rect = NSUnionRect(rects[best], rect);
+		rects[best] = rects[--count];
+	}
+}
+
+static void pendingUpdatesObserverCallback(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void* info)
+{
+#pragma unused(observer, activity, info)
+
+	if (CFSetGetCount(sDrawingsWithPendingUpdates) == 0)
+		return;
+
+	// the set is emptied first, as a drawing may flag further updates while its views are told
+
+	NSArray* drawings = [(NSSet*)sDrawingsWithPendingUpdates allObjects];
+	CFSetRemoveAllValues(sDrawingsWithPendingUpdates);
+
+	[drawings makeObjectsPerformSelector:@selector(flushPendingDisplayUpdates)];
+}
+
+#pragma mark -
+
+// the objects found by metadata are usually far fewer than those in the rect, so they are tested rather than the layers being searched
+
+static NSArray* objectsTouchingRect(NSArray* objects, NSRect rect)
+{
+	NSMutableArray* found = [NSMutableArray array];
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject])) {
+		if ([obj intersectsRect:rect])
+			[found addObject:obj];
+	}
+
+	return found;
+}
+
+/** @brief Sets the metadata keys whose values the drawing's objects are indexed by
+
+ Finding objects by the value of an indexed key uses the index rather than reading the metadata of every object. Only the objects owned
+ directly by the drawing's layers are found, by the metadata they have themselves. Keys are not case sensitive, as for metadata.
+ @param keys an array of metadata keys, or nil or an empty array to stop indexing
+ */
+- (void)setIndexedMetadataKeys:(NSArray*)keys
+{
+	[mMetadataIndex setDrawing:nil];
+	[mMetadataIndex release];
+	mMetadataIndex = nil;
+
+	if ([keys count] > 0)
+		mMetadataIndex = [[DKMetadataIndex alloc] initWithDrawing:self
+															 keys:keys];
+}
+
+- (NSArray*)indexedMetadataKeys
+{
+	return [mMetadataIndex indexedKeys];
+}
+
+/** @brief Returns the drawing's metadata index
+ @return the index, or nil if no keys are indexed
+ */
+- (DKMetadataIndex*)metadataIndex
+{
+	return mMetadataIndex;
+}
+
+/** @brief Returns the objects whose metadata has a given value for a key
+
+ The key needn't be indexed, but if it isn't every object is looked at.
+ @param value the value
+ @param key the metadata key
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsWithMetadataValue:(id)value forKey:(NSString*)key
+{
+	if (value == nil)
+		return [NSArray array];
+
+	if ([mMetadataIndex indexesKey:key])
+		return [[mMetadataIndex objectsWithValue:value
+										  forKey:key] allObjects];
+
+	return [DKMetadataIndex objectsInLayers:[self flattenedLayersOfClass:[DKObjectOwnerLayer class]]
+								  withValue:value
+							   orValuesFrom:nil
+										 to:nil
+									 forKey:key];
+}
+
+/** @brief Returns the objects whose metadata for a key lies in an inclusive range
+
+ Numbers and strings can be found by range; the bounds give which of them are found.
+ @param low the lowest value, or nil for no lower limit
+ @param high the highest value, or nil for no upper limit
+ @param key the metadata key
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsWithMetadataValuesFrom:(id)low to:(id)high forKey:(NSString*)key
+{
+	if ([mMetadataIndex indexesKey:key])
+		return [[mMetadataIndex objectsWithValuesFrom:low
+												   to:high
+											   forKey:key] allObjects];
+
+	return [DKMetadataIndex objectsInLayers:[self flattenedLayersOfClass:[DKObjectOwnerLayer class]]
+								  withValue:nil
+							   orValuesFrom:low
+										 to:high
+									 forKey:key];
+}
+
+/** @brief Returns the objects touching a rect whose metadata has a given value for a key
+ @param value the value
+ @param key the metadata key
+ @param rect the rect, tested using the objects' intersectsRect: method
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsWithMetadataValue:(id)value forKey:(NSString*)key inRect:(NSRect)rect
+{
+	return objectsTouchingRect([self objectsWithMetadataValue:value
+													   forKey:key],
+							   rect);
+}
+
+- (NSArray*)objectsWithMetadataValuesFrom:(id)low to:(id)high forKey:(NSString*)key inRect:(NSRect)rect
+{
+	return objectsTouchingRect([self objectsWithMetadataValuesFrom:low
+																to:high
+															forKey:key],
+							   rect);
+}
+
+#pragma mark -
+
+/** @brief Sets whether the drawing's objects are indexed by the words of their text
+ @param indexes YES to index text, NO to stop
+ */
+- (void)setIndexesText:(BOOL)indexes
+{
+	if (indexes && mTextIndex == nil)
+		mTextIndex = [[DKTextIndex alloc] initWithDrawing:self];
+	else if (!indexes && mTextIndex) {
+		[mTextIndex setDrawing:nil];
+		[mTextIndex release];
+		mTextIndex = nil;
+	}
+}
+
+- (BOOL)indexesText
+{
+	return mTextIndex != nil;
+}
+
+/** @brief Returns the drawing's text index
+ @return the index, or nil if text isn't indexed
+ */
+- (DKTextIndex*)textIndex
+{
+	return mTextIndex;
+}
+
+/** @brief Returns the objects having some text
+
+ Text needn't be indexed, but if it isn't every object's text is looked at.
+ @param text the text to find
+ @param options the search options
+ @return an array of the objects found, in no particular order
+ */
+- (NSArray*)objectsMatchingText:(NSString*)text options:(DKTextSearchOptions)options
+{
+	if (text == nil)
+		return [NSArray array];
+
+	if (mTextIndex)
+		return [[mTextIndex objectsMatchingText:text
+										options:options] allObjects];
+
+	return [DKTextIndex objectsInLayers:[self flattenedLayersOfClass:[DKObjectOwnerLayer class]]
+						   matchingText:text
+								options:options];
+}
+
+- (NSArray*)objectsMatchingText:(NSString*)text options:(DKTextSearchOptions)options inRect:(NSRect)rect
+{
+	return objectsTouchingRect([self objectsMatchingText:text
+												 options:options],
+							   rect);
+}
+
 #pragma mark -
 #pragma mark As a DKLayerGroup
 
@@ -1848,6 +2336,11 @@ static id sDearchivingHelper = nil;
  */
 - (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView
 {
+	// clients of styles changed, and dependents of objects moved, since the run loop last waited must be up to date before anything is drawn
+
+	[DKStyle postPendingChangeNotifications];
+	[DKDrawableObject updatePendingDependents];
+
 	// save the graphics context on entry so that we can restore it when we return. This allows recovery from an exception
 	// that could leave the context stack unbalanced.
 
@@ -1885,8 +2378,25 @@ static id sDearchivingHelper = nil;
 								  inView:aView];
 
 			[self beginDrawing];
-			[super drawRect:rect
-					 inView:aView];
+			[mLayerCompositor beginCompositingRect:rect
+											inView:aView];
+
+			// renderers convert their colours to the drawing's colour space, once for each colour rather than on every draw
+
+			NSColorSpace* savedColourSpace = [NSColor renderingColourSpace];
+			[NSColor setRenderingColourSpace:[self colourSpace]];
+
+			@try
+			{
+				[super drawRect:rect
+						 inView:aView];
+			}
+			@finally
+			{
+				[NSColor setRenderingColourSpace:savedColourSpace];
+				[mLayerCompositor endCompositing];
+			}
+
 			[self endDrawing];
 
 			if ([[self delegate] respondsToSelector:@selector(drawing:
@@ -1910,6 +2420,60 @@ static id sDearchivingHelper = nil;
 	[topContext release];
 }
 
+/** @brief Draws the overlays of the drawing's layers over content drawn from a view's tile cache
+ @param rect the update rect being drawn
+ @param aView the view that is rendering the drawing
+ */
+- (void)drawOverlayRect:(NSRect)rect inView:(DKDrawingView*)aView
+{
+	if (![self visible] || [self countOfLayers] == 0)
+		return;
+
+	// the knobs are usually sized as the content is drawn, which the tiles may have made unnecessary
+
+	if ([self knobsShouldAdjustToViewScale] && aView != nil)
+		[[self knobs] setControlKnobSizeForViewScale:[aView scale]];
+
+	NSColorSpace* savedColourSpace = [NSColor renderingColourSpace];
+	[NSColor setRenderingColourSpace:[self colourSpace]];
+
+	@try
+	{
+		[super drawOverlayRect:rect
+						inView:aView];
+	}
+	@catch (id exc)
+	{
+		NSLog(@"### DK: An exception occurred while drawing the overlay - (%@) - will be ignored ###", exc);
+	}
+	@finally
+	{
+		[NSColor setRenderingColourSpace:savedColourSpace];
+	}
+}
+
+/** @brief Renders the drawing into the current graphics context without a view
+
+ Unlike -drawRect:inView:, this doesn't tell the delegate, adjust the knobs or start the low quality timer, so it can be called on
+ any thread. It is used by DKDrawingRenderer, which sets up the context.
+ @param rect the area to draw
+ @param paper YES to paint the paper colour behind the drawing
+ */
+- (void)drawContentInRect:(NSRect)rect drawsPaper:(BOOL)paper
+{
+	if (paper) {
+		[[self paperColour] set];
+		NSRectFillUsingOperation(rect, NSCompositeSourceOver);
+	}
+
+	if ([self visible] && [self countOfLayers] > 0) {
+		[self beginDrawing];
+		[super drawRect:rect
+				 inView:nil];
+		[self endDrawing];
+	}
+}
+
 /** @brief Marks the entire drawing as needing updating (or not) for all attached views
 
  YES causes all attached views to re-render the drawing parts visible in each view
@@ -1917,6 +2481,16 @@ static id sDearchivingHelper = nil;
  */
 - (void)setNeedsDisplay:(BOOL)refresh
 {
+	// either way, the collected areas no longer matter
+
+	mPendingUpdateCount = 0;
+
+	if (refresh) {
+		[mThumbnail invalidate];
+		[mTileCache invalidateAll];
+		[mLayerCompositor invalidateAll];
+	}
+
 	[[self controllers] makeObjectsPerformSelector:@selector(setViewNeedsDisplay:)
 										withObject:[NSNumber numberWithBool:refresh]];
 }
@@ -1929,8 +2503,82 @@ static id sDearchivingHelper = nil;
  */
 - (void)setNeedsDisplayInRect:(NSRect)rect
 {
-	[[self controllers] makeObjectsPerformSelector:@selector(setViewNeedsDisplayInRect:)
-										withObject:[NSValue valueWithRect:rect]];
+	if (![NSThread isMainThread]) {
+		[mThumbnail invalidateRect:rect];
+		[mTileCache invalidateRect:rect];
+
+		[[self controllers] makeObjectsPerformSelector:@selector(setViewNeedsDisplayInRect:)
+											withObject:[NSValue valueWithRect:rect]];
+		return;
+	}
+
+	if (NSIsEmptyRect(rect))
+		return;
+
+	if (mPendingUpdateRects == NULL)
+		mPendingUpdateRects = malloc(sizeof(NSRect) * kDKMaximumPendingUpdateRects);
+
+	if (mPendingUpdateCount == 0) {
+		if (sPendingUpdatesObserver == NULL) {
+			// retained, and compared by identity
+
+			CFSetCallBacks callbacks = kCFTypeSetCallBacks;
+			callbacks.equal = NULL;
+			callbacks.hash = NULL;
+			sDrawingsWithPendingUpdates = CFSetCreateMutable(kCFAllocatorDefault, 0, &callbacks);
+			sPendingUpdatesObserver = CFRunLoopObserverCreate(kCFAllocatorDefault, kCFRunLoopBeforeWaiting, true, kDKPendingUpdatesObserverOrder, pendingUpdatesObserverCallback, NULL);
+			CFRunLoopAddObserver(CFRunLoopGetMain(), sPendingUpdatesObserver, kCFRunLoopCommonModes);
+		}
+
+		CFSetAddValue(sDrawingsWithPendingUpdates, self);
+	}
+
+	mPendingUpdateCount = addUpdateRect(mPendingUpdateRects, mPendingUpdateCount, rect);
+}
+
+- (void)flushPendingDisplayUpdates
+{
+	NSUInteger i, count = mPendingUpdateCount;
+	NSRect rects[kDKMaximumPendingUpdateRects];
+
+	if (count == 0)
+		return;
+
+	// copied and cleared first, since telling the views could flag more updates
+
+	memcpy(rects, mPendingUpdateRects, sizeof(NSRect) * count);
+	mPendingUpdateCount = 0;
+
+	for (i = 0; i < count; ++i) {
+		[mThumbnail invalidateRect:rects[i]];
+		[mTileCache invalidateRect:rects[i]];
+	}
+
+	NSEnumerator* iter = [[self controllers] objectEnumerator];
+	DKViewController* controller;
+
+	while ((controller = [iter nextObject]))
+		[controller setViewNeedsDisplayInRects:rects
+										 count:count];
+}
+
+- (void)setNeedsOverlayDisplayInRect:(NSRect)rect
+{
+	if (NSIsEmptyRect(rect))
+		return;
+
+	// off the main thread the views can't be told directly, so it's treated as any other update
+
+	if (![NSThread isMainThread]) {
+		[self setNeedsDisplayInRect:rect];
+		return;
+	}
+
+	NSEnumerator* iter = [[self controllers] objectEnumerator];
+	DKViewController* controller;
+
+	while ((controller = [iter nextObject]))
+		[controller setViewNeedsOverlayDisplayInRect:rect];
 }
 
 /** @brief Marks several areas for update at once
@@ -1946,8 +2594,7 @@ static id sDearchivingHelper = nil;
 	NSValue* val;
 
 	while ((val = [iter nextObject]))
-		[[self controllers] makeObjectsPerformSelector:@selector(setViewNeedsDisplayInRect:)
-											withObject:val];
+		[self setNeedsDisplayInRect:[val rectValue]];
 }
 
 /** @brief Marks several areas for update at once
@@ -2018,6 +2665,65 @@ static id sDearchivingHelper = nil;
 	[[self controllers] makeObjectsPerformSelector:@selector(hideViewRulerMarkers)];
 }
 
+/** @brief Adds the memory used by the drawing's layers, caches, images and undo stacks to a footprint report
+
+ The swatch, shadow and glyph outline caches are shared by every drawing in the process, and are included in full.
+ @param footprint the report
+ */
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	[super addFootprintToReport:footprint];
+
+	[footprint addBytes:[mRenderedImageCache bytesUsed] + [mLayerCompositor bytesUsed] + [mTileCache bytesUsed] + [mThumbnail bytesUsed] + [[DKShadowCache sharedShadowCache] bytesUsed]
+			 toCategory:kDKFootprintRenderCaches];
+	[footprint addBytes:[[DKStyleSwatchCache sharedSwatchCache] bytesUsed]
+			 toCategory:kDKFootprintSwatchCaches];
+	[footprint addBytes:[[DKGlyphOutlineCache sharedGlyphOutlineCache] bytesUsed]
+			 toCategory:kDKFootprintTextCaches];
+
+	// the metadata index keeps each indexed object in a bucket and an entry for each of its keys
+
+	[footprint addBytes:[mMetadataIndex objectCount] * [[mMetadataIndex indexedKeys] count] * 4 * sizeof(id)
+			 toCategory:kDKFootprintMetadata];
+
+	// and the text index keeps each object in the set for each of its words
+
+	[footprint addBytes:[mTextIndex postingCount] * 3 * sizeof(id)
+			 toCategory:kDKFootprintMetadata];
+
+	NSUInteger resident = 0, mapped = 0;
+
+	[mImageManager getResidentDataBytes:&resident
+						mappedDataBytes:&mapped];
+	[footprint addBytes:resident + [mImageManager proxyBytes]
+			 toCategory:kDKFootprintResidentImages];
+	[footprint addBytes:mapped
+			 toCategory:kDKFootprintMappedImages];
+
+	id um = [self undoManager];
+
+	if ([um isKindOfClass:[GCUndoManager class]])
+		[footprint addBytes:[(GCUndoManager*)um undoStackCost] + [(GCUndoManager*)um redoStackCost]
+				 toCategory:kDKFootprintUndo];
+}
+
+#pragma mark -
+#pragma mark As a DKPurgeableCache
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	// the drawing stands in for its objects, which are too many to register one by one. Their rendering caches hold the paths
+	// and layout their rasterizers made, so are made again as each object is next drawn
+
+	NSEnumerator* iter = [[self flattenedLayersOfClass:[DKObjectOwnerLayer class]] objectEnumerator];
+	DKObjectOwnerLayer* layer;
+
+	while ((layer = [iter nextObject]))
+		[[layer objects] makeObjectsPerformSelector:@selector(invalidateRenderingCache)];
+
+	return 0;
+}
+
 #pragma mark -
 #pragma mark As an NSObject
 
@@ -2025,6 +2731,8 @@ static id sDearchivingHelper = nil;
 {
 	LogEvent_(kLifeEvent, @"deallocating DKDrawing %@", self);
 
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
+
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 
 	[self setUndoManager:nil];
@@ -2035,6 +2743,8 @@ static id sDearchivingHelper = nil;
 	m_activeLayerRef = nil;
 	mDelegateRef = nil;
 
+	free(mPendingUpdateRects);
+
 	if (m_renderQualityTimer != nil) {
 		[m_renderQualityTimer invalidate];
 		[m_renderQualityTimer release];
@@ -2045,6 +2755,23 @@ static id sDearchivingHelper = nil;
 	[mColourSpace release];
 	[m_units release];
 	[mImageManager release];
+	[mRenderedImageCache release];
+	[mLayerCompositor release];
+
+	[mMetadataIndex setDrawing:nil];
+	[mMetadataIndex release];
+
+	[mTextIndex setDrawing:nil];
+	[mTextIndex release];
+
+	[mChangeFeed setDrawing:nil];
+	[mChangeFeed release];
+
+	// pending updates may keep the thumbnail for a while after the drawing has gone
+
+	[mThumbnail setDrawing:nil];
+	[mThumbnail release];
+	[mTileCache release];
 
 	[super dealloc];
 }
@@ -2199,6 +2926,9 @@ static id sDearchivingHelper = nil;
 		// file - would that be better? I'm unsure whether the active layer is legitimately part of a saved file's state.
 
 		[self setActiveLayer:[self firstLayerOfClass:[DKObjectDrawingLayer class]]];
+
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeLayout];
 	}
 
 	return self;
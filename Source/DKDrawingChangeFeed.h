@@ -0,0 +1,142 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawing, DKObjectOwnerLayer, DKDrawableObject, DKStyle;
+
+// the kinds of change recorded
+
+typedef enum {
+	kDKChangeObjectInserted = 1, // an object was inserted at <index>; the data is its archive
+	kDKChangeObjectRemoved = 2, // the object at <index> was removed
+	kDKChangeObjectReplaced = 3, // the object at <index> was replaced; the data is the archive of the new one
+	kDKChangeObjectMoved = 4, // the object at <index> was moved to <toIndex>
+	kDKChangeObjectRestyled = 5, // the object at <index> was given the style whose unique key is <key>; the data is its archive if not sent before
+	kDKChangeObjectGeometry = 6, // the geometry of the object at <index> changed; the data holds its new geometry
+	kDKChangeObjectMetadata = 7, // the metadata item <key> of the object at <index> changed; the data is its archive, or nil if it was removed.
+								 // If <key> is nil, any of its metadata may have changed, and the data is the archive of all of it
+	kDKChangeStyleEdited = 8, // the style whose unique key is <key> was changed; the data is its archive
+	kDKChangeLayerReplaced = 9 // all of the layer's objects were replaced; the data is the archive of the array of objects
+} DKDrawingChangeType;
+
+/** @brief One change to a drawing, as recorded by a DKDrawingChangeFeed. */
+@interface DKDrawingChangeRecord : NSObject {
+@private
+	DKDrawingChangeType mType;
+	unsigned long long mSequence;
+	NSString* mLayerKey;
+	NSUInteger mIndex;
+	NSUInteger mToIndex;
+	NSString* mKey;
+	NSData* mData;
+}
+
+- (id)initWithType:(DKDrawingChangeType)type sequence:(unsigned long long)sequence layerKey:(NSString*)layerKey index:(NSUInteger)indx toIndex:(NSUInteger)toIndex key:(NSString*)key data:(NSData*)data;
+
+- (DKDrawingChangeType)type;
+
+/** @brief The position of the change in the feed, counting from 1 */
+- (unsigned long long)sequence;
+
+/** @brief The unique key of the layer the change was made to, or nil for a change of style */
+- (NSString*)layerKey;
+- (NSUInteger)index;
+- (NSUInteger)toIndex;
+- (NSString*)key;
+- (NSData*)data;
+
+/** @brief The values of the geometry snapshot recorded by a geometry change, as NSNumbers
+ @return the values, or nil if this isn't a geometry change
+ */
+- (NSArray*)geometryValues;
+
+/** @brief The path of the geometry snapshot recorded by a geometry change
+ @return the path, or nil if there isn't one
+ */
+- (NSBezierPath*)geometryPath;
+
+@end
+
+#pragma mark -
+
+/** @brief An ordered feed of the edits made to a drawing, so that a copy of it elsewhere can be kept up to date from the changes alone.
+
+ An ordered feed of the edits made to a drawing, so that a copy of it elsewhere can be kept up to date from the changes alone. Once
+ -[DKDrawing setRecordsChanges:] has been turned on, the drawing's object layers report each object inserted, removed, replaced or moved in
+ the stacking order, each change of style or geometry, each change to an object's metadata and each edit of a style in use, from the same
+ methods that maintain the storage and register undo - so undo and redo are recorded like any other change. A consumer takes the records
+ with -takeRecords or -takeEncodedRecords, sends them on, and applies each in turn to its copy of the drawing as it was when recording
+ started.
+
+ Objects are identified by the unique key of their layer and their index in it, as they were when the change was made, so applying a change
+ means an array operation rather than a search. Inserted and replaced objects, and styles - once each, unless edited - are sent as keyed
+ archives. Geometry is sent as the object's geometry snapshot (see -[DKDrawableObject geometrySnapshot]), without its extra object, and
+ repeated changes to the geometry of an object are recorded once, with its latest geometry, so dragging an object doesn't flood the feed.
+ Objects whose geometry can't be captured that way are sent again whole.
+
+ Only the objects owned directly by object layers are tracked, not those inside groups, nor the drawing's layers themselves: adding,
+ removing or reordering layers, or changing their properties, needs the whole drawing to be sent again.
+
+ Records can be encoded in a compact binary form by +encodedDataWithRecords:: a four byte magic ("DKCR") and a version byte, then the number
+ of records and each record's type, sequence, layer key, indexes, key and data, with integers as variable length unsigned numbers, strings as
+ UTF-8 and geometry as big-endian doubles. +recordsWithEncodedData: reads it back. The feed is used on the main thread.
+*/
+@interface DKDrawingChangeFeed : NSObject {
+@private
+	DKDrawing* mDrawingRef; // the drawing, not retained
+	NSMutableArray* mRecords; // records not yet taken
+	unsigned long long mSequence; // the sequence of the last record made
+	CFMutableSetRef mPendingGeometry; // objects whose geometry has changed since it was last recorded
+	NSMutableSet* mSentStyleKeys; // keys of the styles whose archives have been sent
+}
+
+/** @brief Encodes records in the feed's binary form
+ @param records an array of DKDrawingChangeRecord
+ @return the encoded records
+ */
++ (NSData*)encodedDataWithRecords:(NSArray*)records;
+
+/** @brief Decodes records encoded by +encodedDataWithRecords:
+ @param data the encoded records
+ @return an array of DKDrawingChangeRecord, or nil if the data isn't valid
+ */
++ (NSArray*)recordsWithEncodedData:(NSData*)data;
+
+- (id)initWithDrawing:(DKDrawing*)drawing;
+- (DKDrawing*)drawing;
+- (void)setDrawing:(DKDrawing*)drawing;
+
+/** @brief Returns the changes recorded since the records were last taken, and forgets them
+ @return an array of DKDrawingChangeRecord, in order
+ */
+- (NSArray*)takeRecords;
+
+/** @brief As -takeRecords, encoded by +encodedDataWithRecords:
+ @return the encoded records
+ */
+- (NSData*)takeEncodedRecords;
+
+/** @brief The sequence of the most recent record
+ @return the sequence, or 0 if nothing has been recorded
+ */
+- (unsigned long long)lastSequence;
+
+// called by the drawing's object layers, before they change the stacking order so that the indexes recorded are those of the change:
+
+- (void)layer:(DKObjectOwnerLayer*)layer willInsertObjects:(NSArray*)objs atIndexes:(NSIndexSet*)set;
+- (void)layer:(DKObjectOwnerLayer*)layer willRemoveObjectsAtIndexes:(NSIndexSet*)set;
+- (void)layer:(DKObjectOwnerLayer*)layer willReplaceObjectAtIndex:(NSUInteger)indx withObject:(DKDrawableObject*)obj;
+- (void)layer:(DKObjectOwnerLayer*)layer willMoveObjectAtIndex:(NSUInteger)indx toIndex:(NSUInteger)toIndex;
+- (void)layer:(DKObjectOwnerLayer*)layer willReplaceObjectsWith:(NSArray*)objs;
+
+// and as objects change:
+
+- (void)object:(DKDrawableObject*)obj willChangeStyleTo:(DKStyle*)style;
+- (void)objectDidChangeGeometry:(DKDrawableObject*)obj;
+- (void)object:(DKDrawableObject*)obj didChangeMetadataKey:(NSString*)key;
+
+@end
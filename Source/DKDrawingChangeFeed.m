@@ -0,0 +1,699 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawingChangeFeed.h"
+#import "DKDrawing.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawableObject.h"
+#import "DKDrawableObject+Metadata.h"
+#import "DKObjectSnapshot.h"
+#import "DKStyle.h"
+
+#define kDKChangeFeedMagic "DKCR"
+#define kDKChangeFeedVersion 1
+
+@interface DKDrawingChangeFeed (Private)
+
+- (void)addRecordOfType:(DKDrawingChangeType)type layer:(DKObjectOwnerLayer*)layer index:(NSUInteger)indx toIndex:(NSUInteger)toIndex key:(NSString*)key data:(NSData*)data;
+- (void)recordPendingGeometry;
+- (NSData*)archiveOfStyleIfUnsent:(DKStyle*)style;
+- (BOOL)drawingUsesStyle:(DKStyle*)style;
+- (void)styleDidChange:(NSNotification*)note;
+
+@end
+
+#pragma mark -
+
+// integers are written 7 bits at a time, least significant first, with the top bit set on all but the last byte
+
+static void appendNumber(NSMutableData* data, unsigned long long n)
+{
+	uint8_t bytes[10];
+	NSUInteger count = 0;
+
+	do {
+		bytes[count] = n & 0x7F;
+		n >>= 7;
+
+		if (n)
+			bytes[count] |= 0x80;
+
+		++count;
+	} while (n);
+
+	[data appendBytes:bytes
+			   length:count];
+}
+
+// strings and data are written as their length plus one, or 0 for nil, followed by their bytes
+
+static void appendBytes(NSMutableData* data, NSData* bytes)
+{
+	if (bytes == nil)
+		appendNumber(data, 0);
+	else {
+		appendNumber(data, [bytes length] + 1);
+		[data appendData:bytes];
+	}
+}
+
+static void appendString(NSMutableData* data, NSString* str)
+{
+	appendBytes(data, [str dataUsingEncoding:NSUTF8StringEncoding]);
+}
+
+static void appendDouble(NSMutableData* data, double value)
+{
+	NSSwappedDouble swapped = NSSwapHostDoubleToBig(value);
+
+	[data appendBytes:&swapped
+			   length:sizeof(swapped)];
+}
+
+// reading stops at the first error, after which every read returns nothing
+
+typedef struct {
+	const uint8_t* bytes;
+	NSUInteger length;
+	NSUInteger position;
+	BOOL failed;
+} DKChangeReader;
+
+static unsigned long long readNumber(DKChangeReader* reader)
+{
+	unsigned long long n = 0;
+	NSUInteger shift = 0;
+	uint8_t byte;
+
+	do {
+		if (reader->failed || reader->position >= reader->length || shift > 63) {
+			reader->failed = YES;
+			return 0;
+		}
+
+		byte = reader->bytes[reader->position++];
+		n |= (unsigned long long)(byte & 0x7F) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	return n;
+}
+
+static NSData* readBytes(DKChangeReader* reader)
+{
+	unsigned long long length = readNumber(reader);
+
+	if (reader->failed || length == 0)
+		return nil;
+
+	if (--length > reader->length - reader->position) {
+		reader->failed = YES;
+		return nil;
+	}
+
+	NSData* bytes = [NSData dataWithBytes:reader->bytes + reader->position
+								   length:(NSUInteger)length];
+	reader->position += (NSUInteger)length;
+
+	return bytes;
+}
+
+static NSString* readString(DKChangeReader* reader)
+{
+	NSData* bytes = readBytes(reader);
+
+	if (bytes == nil)
+		return nil;
+
+	NSString* str = [[[NSString alloc] initWithData:bytes
+										   encoding:NSUTF8StringEncoding] autorelease];
+	if (str == nil)
+		reader->failed = YES;
+
+	return str;
+}
+
+static double readDouble(DKChangeReader* reader)
+{
+	NSSwappedDouble swapped;
+
+	if (reader->failed || reader->length - reader->position < sizeof(swapped)) {
+		reader->failed = YES;
+		return 0;
+	}
+
+	memcpy(&swapped, reader->bytes + reader->position, sizeof(swapped));
+	reader->position += sizeof(swapped);
+
+	return NSSwapBigDoubleToHost(swapped);
+}
+
+static inline NSUInteger pointsForElement(NSBezierPathElement element)
+{
+	if (element == NSCurveToBezierPathElement)
+		return 3;
+	else if (element == NSClosePathBezierPathElement)
+		return 0;
+	else
+		return 1;
+}
+
+// a geometry snapshot is written as its values, then its path's elements, each being its type and points
+
+static NSData* encodedGeometry(DKGeometrySnapshot* snapshot)
+{
+	NSMutableData* data = [NSMutableData data];
+	NSBezierPath* path = [snapshot path];
+	NSUInteger i, j, count = [snapshot valueCount];
+	NSPoint points[3];
+	NSBezierPathElement element;
+
+	appendNumber(data, count);
+
+	for (i = 0; i < count; ++i)
+		appendDouble(data, [snapshot valueAtIndex:i]);
+
+	count = [path elementCount];
+	appendNumber(data, count);
+
+	for (i = 0; i < count; ++i) {
+		element = [path elementAtIndex:i
+					  associatedPoints:points];
+		appendNumber(data, element);
+
+		for (j = 0; j < pointsForElement(element); ++j) {
+			appendDouble(data, points[j].x);
+			appendDouble(data, points[j].y);
+		}
+	}
+
+	return data;
+}
+
+#pragma mark -
+
+@implementation DKDrawingChangeRecord
+
+- (id)initWithType:(DKDrawingChangeType)type sequence:(unsigned long long)sequence layerKey:(NSString*)layerKey index:(NSUInteger)indx toIndex:(NSUInteger)toIndex key:(NSString*)key data:(NSData*)data
+{
+	self = [super init];
+	if (self) {
+		mType = type;
+		mSequence = sequence;
+		mLayerKey = [layerKey copy];
+		mIndex = indx;
+		mToIndex = toIndex;
+		mKey = [key copy];
+		mData = [data copy];
+	}
+
+	return self;
+}
+
+- (DKDrawingChangeType)type
+{
+	return mType;
+}
+
+- (unsigned long long)sequence
+{
+	return mSequence;
+}
+
+- (NSString*)layerKey
+{
+	return mLayerKey;
+}
+
+- (NSUInteger)index
+{
+	return mIndex;
+}
+
+- (NSUInteger)toIndex
+{
+	return mToIndex;
+}
+
+- (NSString*)key
+{
+	return mKey;
+}
+
+- (NSData*)data
+{
+	return mData;
+}
+
+- (NSArray*)geometryValues
+{
+	if (mType != kDKChangeObjectGeometry)
+		return nil;
+
+	DKChangeReader reader = { [mData bytes], [mData length], 0, NO };
+	unsigned long long i, count = readNumber(&reader);
+	NSMutableArray* values = [NSMutableArray array];
+
+	for (i = 0; i < count && !reader.failed; ++i)
+		[values addObject:[NSNumber numberWithDouble:readDouble(&reader)]];
+
+	return reader.failed ? nil : values;
+}
+
+- (NSBezierPath*)geometryPath
+{
+	if (mType != kDKChangeObjectGeometry)
+		return nil;
+
+	DKChangeReader reader = { [mData bytes], [mData length], 0, NO };
+	unsigned long long i, count = readNumber(&reader);
+	NSUInteger j;
+
+	for (i = 0; i < count && !reader.failed; ++i)
+		readDouble(&reader);
+
+	count = readNumber(&reader);
+
+	if (reader.failed || count == 0)
+		return nil;
+
+	NSBezierPath* path = [NSBezierPath bezierPath];
+	NSBezierPathElement element;
+	NSPoint points[3];
+
+	for (i = 0; i < count && !reader.failed; ++i) {
+		element = (NSBezierPathElement)readNumber(&reader);
+
+		for (j = 0; j < pointsForElement(element); ++j) {
+			points[j].x = readDouble(&reader);
+			points[j].y = readDouble(&reader);
+		}
+
+		switch (element) {
+		case NSMoveToBezierPathElement:
+			[path moveToPoint:points[0]];
+			break;
+
+		case NSLineToBezierPathElement:
+			[path lineToPoint:points[0]];
+			break;
+
+		case NSCurveToBezierPathElement:
+			[path curveToPoint:points[2]
+				 controlPoint1:points[0]
+				 controlPoint2:points[1]];
+			break;
+
+		case NSClosePathBezierPathElement:
+			[path closePath];
+			break;
+
+		default:
+			reader.failed = YES;
+			break;
+		}
+	}
+
+	return reader.failed ? nil : path;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mLayerKey release];
+	[mKey release];
+	[mData release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKDrawingChangeFeed
+
++ (NSData*)encodedDataWithRecords:(NSArray*)records
+{
+	NSMutableData* data = [NSMutableData data];
+	NSEnumerator* iter = [records objectEnumerator];
+	DKDrawingChangeRecord* record;
+	uint8_t version = kDKChangeFeedVersion;
+
+	[data appendBytes:kDKChangeFeedMagic
+			   length:4];
+	[data appendBytes:&version
+			   length:1];
+	appendNumber(data, [records count]);
+
+	while ((record = [iter nextObject])) {
+		appendNumber(data, [record type]);
+		appendNumber(data, [record sequence]);
+		appendString(data, [record layerKey]);
+		appendNumber(data, [record index]);
+		appendNumber(data, [record toIndex]);
+		appendString(data, [record key]);
+		appendBytes(data, [record data]);
+	}
+
+	return data;
+}
+
++ (NSArray*)recordsWithEncodedData:(NSData*)data
+{
+	if ([data length] < 5 || memcmp([data bytes], kDKChangeFeedMagic, 4) != 0 || ((const uint8_t*)[data bytes])[4] > kDKChangeFeedVersion)
+		return nil;
+
+	DKChangeReader reader = { [data bytes], [data length], 5, NO };
+	unsigned long long i, count = readNumber(&reader);
+	NSMutableArray* records = [NSMutableArray array];
+	DKDrawingChangeRecord* record;
+	DKDrawingChangeType type;
+	unsigned long long sequence, indx, toIndex;
+	NSString* layerKey;
+	NSString* key;
+	NSData* bytes;
+
+	for (i = 0; i < count && !reader.failed; ++i) {
+		type = (DKDrawingChangeType)readNumber(&reader);
+		sequence = readNumber(&reader);
+		layerKey = readString(&reader);
+		indx = readNumber(&reader);
+		toIndex = readNumber(&reader);
+		key = readString(&reader);
+		bytes = readBytes(&reader);
+
+		if (reader.failed)
+			break;
+
+		record = [[DKDrawingChangeRecord alloc] initWithType:type
+													sequence:sequence
+													layerKey:layerKey
+													   index:(NSUInteger)indx
+													 toIndex:(NSUInteger)toIndex
+														 key:key
+														data:bytes];
+		[records addObject:record];
+		[record release];
+	}
+
+	return reader.failed ? nil : records;
+}
+
+- (id)initWithDrawing:(DKDrawing*)drawing
+{
+	self = [super init];
+	if (self) {
+		mDrawingRef = drawing;
+		mRecords = [[NSMutableArray alloc] init];
+		mPendingGeometry = CFSetCreateMutable(kCFAllocatorDefault, 0, &kCFTypeSetCallBacks);
+		mSentStyleKeys = [[NSMutableSet alloc] init];
+
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(styleDidChange:)
+													 name:kDKStyleDidChangeNotification
+												   object:nil];
+	}
+
+	return self;
+}
+
+- (DKDrawing*)drawing
+{
+	return mDrawingRef;
+}
+
+- (void)setDrawing:(DKDrawing*)drawing
+{
+	mDrawingRef = drawing;
+}
+
+- (NSArray*)takeRecords
+{
+	[self recordPendingGeometry];
+
+	NSArray* records = [[mRecords copy] autorelease];
+	[mRecords removeAllObjects];
+
+	return records;
+}
+
+- (NSData*)takeEncodedRecords
+{
+	return [[self class] encodedDataWithRecords:[self takeRecords]];
+}
+
+- (unsigned long long)lastSequence
+{
+	return mSequence;
+}
+
+#pragma mark -
+
+- (void)layer:(DKObjectOwnerLayer*)layer willInsertObjects:(NSArray*)objs atIndexes:(NSIndexSet*)set
+{
+	NSUInteger indx = [set firstIndex];
+	NSEnumerator* iter = [objs objectEnumerator];
+	DKDrawableObject* obj;
+
+	[self recordPendingGeometry];
+
+	// inserting in ascending order of index puts each object where it ends up. The archives have the objects' styles
+
+	while ((obj = [iter nextObject]) && indx != NSNotFound) {
+		if ([obj style])
+			[mSentStyleKeys addObject:[[obj style] uniqueKey]];
+
+		[self addRecordOfType:kDKChangeObjectInserted
+						layer:layer
+						index:indx
+					  toIndex:0
+						  key:nil
+						 data:[NSKeyedArchiver archivedDataWithRootObject:obj]];
+
+		indx = [set indexGreaterThanIndex:indx];
+	}
+}
+
+- (void)layer:(DKObjectOwnerLayer*)layer willRemoveObjectsAtIndexes:(NSIndexSet*)set
+{
+	NSUInteger indx = [set lastIndex];
+
+	[self recordPendingGeometry];
+
+	// removing in descending order of index leaves the indexes still to be removed where they were
+
+	while (indx != NSNotFound) {
+		[self addRecordOfType:kDKChangeObjectRemoved
+						layer:layer
+						index:indx
+					  toIndex:0
+						  key:nil
+						 data:nil];
+
+		indx = [set indexLessThanIndex:indx];
+	}
+}
+
+- (void)layer:(DKObjectOwnerLayer*)layer willReplaceObjectAtIndex:(NSUInteger)indx withObject:(DKDrawableObject*)obj
+{
+	CFSetRemoveValue(mPendingGeometry, [layer objectInObjectsAtIndex:indx]);
+	[self recordPendingGeometry];
+
+	if ([obj style])
+		[mSentStyleKeys addObject:[[obj style] uniqueKey]];
+
+	[self addRecordOfType:kDKChangeObjectReplaced
+					layer:layer
+					index:indx
+				  toIndex:0
+					  key:nil
+					 data:[NSKeyedArchiver archivedDataWithRootObject:obj]];
+}
+
+- (void)layer:(DKObjectOwnerLayer*)layer willMoveObjectAtIndex:(NSUInteger)indx toIndex:(NSUInteger)toIndex
+{
+	[self recordPendingGeometry];
+	[self addRecordOfType:kDKChangeObjectMoved
+					layer:layer
+					index:indx
+				  toIndex:toIndex
+					  key:nil
+					 data:nil];
+}
+
+- (void)layer:(DKObjectOwnerLayer*)layer willReplaceObjectsWith:(NSArray*)objs
+{
+	NSEnumerator* iter = [objs objectEnumerator];
+	DKDrawableObject* obj;
+
+	[self recordPendingGeometry];
+
+	while ((obj = [iter nextObject])) {
+		if ([obj style])
+			[mSentStyleKeys addObject:[[obj style] uniqueKey]];
+	}
+
+	[self addRecordOfType:kDKChangeLayerReplaced
+					layer:layer
+					index:0
+				  toIndex:0
+					  key:nil
+					 data:[NSKeyedArchiver archivedDataWithRootObject:objs]];
+}
+
+- (void)object:(DKDrawableObject*)obj willChangeStyleTo:(DKStyle*)style
+{
+	DKObjectOwnerLayer* layer = (DKObjectOwnerLayer*)[obj container];
+
+	[self addRecordOfType:kDKChangeObjectRestyled
+					layer:layer
+					index:[layer indexOfObject:obj]
+				  toIndex:0
+					  key:[style uniqueKey]
+					 data:[self archiveOfStyleIfUnsent:style]];
+}
+
+- (void)objectDidChangeGeometry:(DKDrawableObject*)obj
+{
+	CFSetAddValue(mPendingGeometry, obj);
+}
+
+- (void)object:(DKDrawableObject*)obj didChangeMetadataKey:(NSString*)key
+{
+	DKObjectOwnerLayer* layer = (DKObjectOwnerLayer*)[obj container];
+	id value;
+
+	if (key) {
+		key = [key lowercaseString];
+		value = [obj metadataItemForKey:key
+					 limitToLocalSearch:YES];
+	} else
+		value = [obj metadata];
+
+	[self addRecordOfType:kDKChangeObjectMetadata
+					layer:layer
+					index:[layer indexOfObject:obj]
+				  toIndex:0
+					  key:key
+					 data:value ? [NSKeyedArchiver archivedDataWithRootObject:value] : nil];
+}
+
+#pragma mark -
+
+- (void)addRecordOfType:(DKDrawingChangeType)type layer:(DKObjectOwnerLayer*)layer index:(NSUInteger)indx toIndex:(NSUInteger)toIndex key:(NSString*)key data:(NSData*)data
+{
+	DKDrawingChangeRecord* record = [[DKDrawingChangeRecord alloc] initWithType:type
+																	   sequence:++mSequence
+																	   layerKey:[layer uniqueKey]
+																		  index:indx
+																		toIndex:toIndex
+																			key:key
+																		   data:data];
+	[mRecords addObject:record];
+	[record release];
+}
+
+- (void)recordPendingGeometry
+{
+	// only index changes need the geometry recorded first, and the objects waiting all have different ones, so the order doesn't matter
+
+	if (CFSetGetCount(mPendingGeometry) == 0)
+		return;
+
+	NSEnumerator* iter = [[(NSSet*)mPendingGeometry allObjects] objectEnumerator];
+	DKDrawableObject* obj;
+	DKObjectOwnerLayer* layer;
+	DKGeometrySnapshot* snapshot;
+	NSUInteger indx;
+
+	CFSetRemoveAllValues(mPendingGeometry);
+
+	while ((obj = [iter nextObject])) {
+		layer = (DKObjectOwnerLayer*)[obj container];
+
+		if (![layer isKindOfClass:[DKObjectOwnerLayer class]] || [layer drawing] != mDrawingRef)
+			continue;
+
+		indx = [layer indexOfObject:obj];
+
+		if (indx == NSNotFound)
+			continue;
+
+		snapshot = [obj geometrySnapshot];
+
+		if (snapshot)
+			[self addRecordOfType:kDKChangeObjectGeometry
+							layer:layer
+							index:indx
+						  toIndex:0
+							  key:nil
+							 data:encodedGeometry(snapshot)];
+		else
+			[self addRecordOfType:kDKChangeObjectReplaced
+							layer:layer
+							index:indx
+						  toIndex:0
+							  key:nil
+							 data:[NSKeyedArchiver archivedDataWithRootObject:obj]];
+	}
+}
+
+- (NSData*)archiveOfStyleIfUnsent:(DKStyle*)style
+{
+	if (style == nil || [mSentStyleKeys containsObject:[style uniqueKey]])
+		return nil;
+
+	[mSentStyleKeys addObject:[style uniqueKey]];
+	return [NSKeyedArchiver archivedDataWithRootObject:style];
+}
+
+- (BOOL)drawingUsesStyle:(DKStyle*)style
+{
+	NSEnumerator* iter = [[mDrawingRef flattenedLayersOfClass:[DKObjectOwnerLayer class]] objectEnumerator];
+	DKObjectOwnerLayer* layer;
+
+	while ((layer = [iter nextObject])) {
+		if ([[layer objectsWithStyle:style] count] > 0)
+			return YES;
+	}
+
+	return NO;
+}
+
+- (void)styleDidChange:(NSNotification*)note
+{
+	DKStyle* style = [note object];
+
+	// styles are used by many drawings, so only the changes to those in this one are recorded
+
+	if (![style isKindOfClass:[DKStyle class]] || ![self drawingUsesStyle:style])
+		return;
+
+	[mSentStyleKeys addObject:[style uniqueKey]];
+	[self addRecordOfType:kDKChangeStyleEdited
+					layer:nil
+					index:0
+				  toIndex:0
+					  key:[style uniqueKey]
+					 data:[NSKeyedArchiver archivedDataWithRootObject:style]];
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+
+	[mRecords release];
+	CFRelease(mPendingGeometry);
+	[mSentStyleKeys release];
+	[super dealloc];
+}
+
+@end
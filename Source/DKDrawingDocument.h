@@ -6,7 +6,7 @@
 
 #import <Cocoa/Cocoa.h>
 
-@class DKDrawing, DKDrawingView, DKViewController, DKDrawingTool, DKPrintDrawingView;
+@class DKDrawing, DKDrawingView, DKViewController, DKDrawingTool, DKPrintDrawingView, DKChunkedDrawingWriter;
 
 /** @brief This class is a simple document type that owns a drawing instance.
 
@@ -26,11 +26,27 @@ its drawing.
 
 If you subclass this to have more views, etc, bear this in mind - you have to consider how the document's drawing gets hooked up to the views you want. Outlets
 like this are one easy way to do it, but not the only way.
+
+Drawings of the standard types are read on a background thread (see +canConcurrentlyReadDocumentsOfType:). The drawing is built while
+detached from the document, and is only given to it, and so to its views, on the main thread once it's complete. Reading can be
+cancelled with -cancelReading:.
+
+Autosaving the standard drawing type is incremental. The first autosave to a file writes the whole drawing in the chunked format; later
+ones append only the chunks that have changed, and nothing at all if the undo manager's change count is the same. When dead chunks
+take up more than half of the file, it is compacted on a background thread. Any other save, or any change to the file by something else,
+makes the next autosave a full one again.
 */
 @interface DKDrawingDocument : NSDocument {
 @private
 	IBOutlet DKDrawingView* mMainDrawingView;
 	DKDrawing* m_drawing;
+	id mReadingHelper; // dearchiving helper of the read in progress, if any
+	DKChunkedDrawingWriter* mAutosaveWriter; // writer of the last autosave, which knows what it wrote
+	NSString* mAutosavePath; // file written by the last autosave
+	NSDate* mAutosaveFileDate; // modification date of that file after it was written
+	NSUInteger mAutosaveChangeCount; // undo manager's change count at the last autosave
+	BOOL mWritesIncrementalAutosaves; // YES to append changes to the autosaved file rather than rewriting it
+	BOOL mAutosaveCompacting; // YES while the autosaved file is compacted in the background
 }
 
 /** @brief Returns an undo manager that can be shared by multiple documents
@@ -74,6 +90,15 @@ like this are one easy way to do it, but not the only way.
  */
 + (NSUInteger)defaultLevelsOfUndo;
 
+/** @brief Whether documents of a type can be read on a background thread
+
+ Returns YES for the standard drawing types. Other types are imported by methods bound with +bindFileImportType:toSelector:, which
+ aren't known to be safe to call on a background thread, so return NO unless a subclass knows otherwise.
+ @param typeName the document type
+ @return YES if the type can be read on a background thread
+ */
++ (BOOL)canConcurrentlyReadDocumentsOfType:(NSString*)typeName;
+
 /** @brief Set the document's drawing object
 
  The document owns the drawing
@@ -187,6 +212,22 @@ like this are one easy way to do it, but not the only way.
  */
 - (DKDrawingTool*)drawingTool;
 
+/** @brief Sets whether autosaves of the standard drawing type append changes to the file rather than rewriting it
+
+ The default is YES.
+ @param incremental YES for incremental autosaves
+ */
+- (void)setWritesIncrementalAutosaves:(BOOL)incremental;
+- (BOOL)writesIncrementalAutosaves;
+
+/** @brief Stops reading the document, if it's being read
+
+ May be called from any thread, typically from a progress panel while the document is read in the background. The read then fails
+ with NSUserCancelledError, which NSDocumentController doesn't report.
+ @param sender the sender of the message
+ */
+- (IBAction)cancelReading:(id)sender;
+
 /** @brief High-level method to add a new drawing layer to the document
 
  The added layer is made the active layer
@@ -15,6 +15,9 @@
 #import "DKPrintDrawingView.h"
 #import "DKStyleRegistry.h"
 #import "DKDrawingInfoLayer.h"
+#import "DKUniqueID.h"
+#import "DKUnarchivingHelper.h"
+#import "DKChunkedDrawingArchive.h"
 #import "LogEvent.h"
 
 @interface DKSelectorWrapper : NSObject {
@@ -26,6 +29,33 @@
 
 @end
 
+// autosaved files are compacted when they are larger than this, and dead chunks take up more than half of them
+
+#define kDKAutosaveCompactionMinimumLength (1024 * 1024)
+
+// a compaction being done in the background
+
+typedef struct {
+	DKDrawingDocument* document;
+	NSString* path;
+	NSString* compactedPath;
+	NSDictionary* offsets;
+	unsigned long long length;
+	unsigned long long compactedLength;
+	BOOL succeeded;
+} DKAutosaveCompaction;
+
+@interface DKDrawingDocument (Private)
+
+- (void)attachReadDrawing:(DKDrawing*)drawing;
+- (BOOL)writeIncrementalAutosaveToPath:(NSString*)path error:(NSError**)outError;
+- (BOOL)autosavedFileIsUnchangedAtPath:(NSString*)path;
+- (void)recordAutosavedFileAtPath:(NSString*)path;
+- (void)compactAutosavedFileIfNeeded;
+- (void)autosaveCompactionDidFinish:(DKAutosaveCompaction*)compaction;
+
+@end
+
 #pragma mark Constants(Non - localized)
 
 NSString* kDKDrawingDocumentType = @"Drawing";
@@ -37,6 +67,37 @@ NSString* kDKDocumentLevelsOfUndoDefaultsKey = @"kDKDocumentLevelsOfUndo";
 
 #define qGlobalUndoManager 0
 
+static void finishCompaction(void* context)
+{
+	DKAutosaveCompaction* compaction = (DKAutosaveCompaction*)context;
+
+	[compaction->document autosaveCompactionDidFinish:compaction];
+
+	[compaction->offsets release];
+	[compaction->compactedPath release];
+	[compaction->path release];
+	[compaction->document release];
+	free(compaction);
+}
+
+static void compactInBackground(void* context)
+{
+	DKAutosaveCompaction* compaction = (DKAutosaveCompaction*)context;
+
+	@autoreleasepool {
+		NSDictionary* offsets = nil;
+
+		compaction->succeeded = [DKChunkedDrawingWriter compactFileAtPath:compaction->path
+																  toPath:compaction->compactedPath
+															chunkOffsets:&offsets];
+		compaction->offsets = [offsets retain];
+		compaction->compactedLength = [[[NSFileManager defaultManager] attributesOfItemAtPath:compaction->compactedPath
+																						error:NULL] fileSize];
+	}
+
+	dispatch_async_f(dispatch_get_main_queue(), compaction, finishCompaction);
+}
+
 #pragma mark -
 @implementation DKDrawingDocument
 #pragma mark As a DKDrawDocument
@@ -133,6 +194,18 @@ static NSMutableDictionary* sFileExportBindings = nil;
 	return levels;
 }
 
+/** @brief Whether documents of a type can be read on a background thread
+
+ Returns YES for the standard drawing types. Other types are imported by methods bound with +bindFileImportType:toSelector:, which
+ aren't known to be safe to call on a background thread, so return NO unless a subclass knows otherwise.
+ @param typeName the document type
+ @return YES if the type can be read on a background thread
+ */
++ (BOOL)canConcurrentlyReadDocumentsOfType:(NSString*)typeName
+{
+	return [typeName isEqualToString:kDKDrawingDocumentType] || [typeName isEqualToString:kDKDrawingDocumentUTI];
+}
+
 /** @brief Set the document's drawing object
 
  The document owns the drawing
@@ -406,18 +479,18 @@ static NSMutableDictionary* sFileExportBindings = nil;
 	// this default method takes option 2 as it's the simplest. It also creates a category using the document's name which will list
 	// all of these styles.
 
-	// perform a preflight at this point if you wish - info returned can be used to help th euser make an informed choice, etc.
-	// By default this info isn't used, just logged
-
-	NSDictionary* preflightInfo = [DKStyleRegistry compareStylesInSet:stylesToMerge];
-
-	LogEvent_(kInfoEvent, @"preflight info = %@", preflightInfo);
+	// perform a preflight at this point if you wish (+compareStylesInSet:) - info returned can be used to help th euser make an informed choice, etc.
+	// By default the comparison is made as part of the merge, in the same pass, and isn't used, just logged
 
+	NSDictionary* preflightInfo = nil;
 	NSArray* docNameCat = [NSArray arrayWithObject:[self documentStyleCategoryName]];
 	NSSet* changedStyles = [DKStyleRegistry mergeStyles:stylesToMerge
 										   inCategories:docNameCat
 												options:kDKReturnExistingStyles
-										  mergeDelegate:self];
+										  mergeDelegate:self
+											 comparison:&preflightInfo];
+
+	LogEvent_(kInfoEvent, @"preflight info = %@", preflightInfo);
 
 	// the returned set contains the objects from the registry that match those in the document. The document must now adopt these objects in
 	// place of the temporary ones that it created on being unarchived. If the set is empty or nil, we're done.
@@ -517,7 +590,7 @@ static NSMutableDictionary* sFileExportBindings = nil;
 	NSRect fr = NSZeroRect;
 	fr.size = [[self drawing] drawingSize];
 
-	DKDrawingView* pdv = [[DKDrawingView alloc] initWithFrame:fr];
+	DKDrawingView* pdv = [[DKPrintDrawingView alloc] initWithFrame:fr];
 
 	return [pdv autorelease];
 }
@@ -628,6 +701,7 @@ static NSMutableDictionary* sFileExportBindings = nil;
 - (BOOL)readFromData:(NSData*)data ofType:(NSString*)typeName error:(NSError**)outError
 {
 	DKDrawing* theDrawing = nil;
+	BOOL cancelled = NO;
 
 	if (sFileImportBindings != nil) {
 		DKSelectorWrapper* wrapper = [sFileImportBindings objectForKey:typeName];
@@ -635,35 +709,300 @@ static NSMutableDictionary* sFileExportBindings = nil;
 		if (wrapper) {
 			SEL selector = [wrapper selector];
 
-			if ([DKDrawing respondsToSelector:selector])
+			if (selector == @selector(drawingWithData:)) {
+				// the standard types are decoded with a helper of their own, so that this read can be cancelled without affecting any other
+
+				id helper = [[[[DKDrawing dearchivingHelper] class] alloc] init];
+
+				@synchronized(self)
+				{
+					mReadingHelper = helper;
+				}
+
+				@try {
+					theDrawing = [DKDrawing drawingWithData:data
+										  dearchivingHelper:helper];
+				}
+				@catch (NSException* excp) {
+					if (![[excp name] isEqualToString:kDKUnarchiverCancelledException])
+						@throw;
+
+					LogEvent_(kFileEvent, @"reading document was cancelled");
+					cancelled = YES;
+				}
+				@finally {
+					@synchronized(self)
+					{
+						mReadingHelper = nil;
+					}
+					[helper release];
+				}
+			} else if ([DKDrawing respondsToSelector:selector])
 				theDrawing = [DKDrawing performSelector:selector
 											 withObject:data];
 		}
 	}
 
 	if (theDrawing != nil) {
-		[self setDrawing:theDrawing];
+		// the drawing was made without reference to the document, and is only attached to it on the main thread
 
-		// having loaded the drawing and fully dearchived it, we need to remerge styles in the document with the style registry.
-		// what happens here will depend on the application design and possibly the user's personal choice. So this is factored out to
-		// allow an easy override. The default method blindly remerges the styles from the document back into the registry.
-
-		NSSet* stylesToMerge = [[self drawing] allRegisteredStyles]; // after a file load, this method returns a special set THIS ONCE ONLY
-
-		if (stylesToMerge != nil && [stylesToMerge count] > 0)
-			[self remergeStyles:stylesToMerge
-					readFromURL:nil];
+		if ([NSThread isMainThread])
+			[self attachReadDrawing:theDrawing];
+		else
+			[self performSelectorOnMainThread:@selector(attachReadDrawing:)
+								   withObject:theDrawing
+								waitUntilDone:YES];
 
 		return YES;
 	} else {
 		if (outError)
 			*outError = [NSError errorWithDomain:NSCocoaErrorDomain
-											code:NSFileReadUnsupportedSchemeError
+											code:cancelled ? NSUserCancelledError : NSFileReadUnsupportedSchemeError
 										userInfo:nil];
 		return NO;
 	}
 }
 
+/** @brief Stops reading the document, if it's being read
+
+ May be called from any thread, typically from a progress panel while the document is read in the background. The read then fails
+ with NSUserCancelledError, which NSDocumentController doesn't report.
+ @param sender the sender of the message
+ */
+- (IBAction)cancelReading:(id)sender
+{
+#pragma unused(sender)
+
+	@synchronized(self)
+	{
+		if ([mReadingHelper respondsToSelector:@selector(cancel)])
+			[mReadingHelper cancel];
+	}
+}
+
+- (void)attachReadDrawing:(DKDrawing*)drawing
+{
+	[self setDrawing:drawing];
+
+	// having loaded the drawing and fully dearchived it, we need to remerge styles in the document with the style registry.
+	// what happens here will depend on the application design and possibly the user's personal choice. So this is factored out to
+	// allow an easy override. The default method blindly remerges the styles from the document back into the registry.
+
+	NSSet* stylesToMerge = [[self drawing] allRegisteredStyles]; // after a file load, this method returns a special set THIS ONCE ONLY
+
+	if (stylesToMerge != nil && [stylesToMerge count] > 0)
+		[self remergeStyles:stylesToMerge
+				readFromURL:nil];
+}
+
+/** @brief Sets whether autosaves of the standard drawing type append changes to the file rather than rewriting it
+
+ The default is YES.
+ @param incremental YES for incremental autosaves
+ */
+- (void)setWritesIncrementalAutosaves:(BOOL)incremental
+{
+	mWritesIncrementalAutosaves = incremental;
+
+	if (!incremental) {
+		[mAutosaveWriter release];
+		mAutosaveWriter = nil;
+	}
+}
+
+- (BOOL)writesIncrementalAutosaves
+{
+	return mWritesIncrementalAutosaves;
+}
+
+/** @brief Writes the document, incrementally if it's an autosave of the standard drawing type
+
+ Other saves are written as usual, which also means that the next autosave will be a full one.
+ @param url where to write
+ @param typeName the type to write
+ @param saveOperation the kind of save
+ @param outError an error, if it wasn't successful
+ @return YES if the document was written
+ */
+- (BOOL)writeSafelyToURL:(NSURL*)url ofType:(NSString*)typeName forSaveOperation:(NSSaveOperationType)saveOperation error:(NSError**)outError
+{
+	BOOL autosave = (saveOperation == NSAutosaveElsewhereOperation || saveOperation == NSAutosaveInPlaceOperation);
+
+	if (autosave && [self writesIncrementalAutosaves] && [url isFileURL] && ([typeName isEqualToString:kDKDrawingDocumentType] || [typeName isEqualToString:kDKDrawingDocumentUTI]))
+		return [self writeIncrementalAutosaveToPath:[url path]
+											  error:outError];
+
+	[mAutosaveWriter release];
+	mAutosaveWriter = nil;
+
+	return [super writeSafelyToURL:url
+							ofType:typeName
+				  forSaveOperation:saveOperation
+							 error:outError];
+}
+
+- (BOOL)writeIncrementalAutosaveToPath:(NSString*)path error:(NSError**)outError
+{
+	NSUndoManager* um = [self undoManager];
+	NSUInteger changeCount = [um respondsToSelector:@selector(changeCount)] ? [(DKUndoManager*)um changeCount] : NSNotFound;
+	BOOL unchanged = [mAutosaveWriter canAppendChanges] && [path isEqualToString:mAutosavePath] && [self autosavedFileIsUnchangedAtPath:path];
+
+	// if nothing has been done since the last autosave, the file is already up to date
+
+	if (unchanged && changeCount != NSNotFound && changeCount == mAutosaveChangeCount)
+		return YES;
+
+	[[[self drawing] drawingInfo] setObject:[self displayName]
+									 forKey:kDKDrawingInfoTitle];
+
+	BOOL result = NO;
+
+	// the file can't be appended to while it's being compacted, since the compacted copy would then be out of date
+
+	if (unchanged && !mAutosaveCompacting) {
+		unsigned long long length = [mAutosaveWriter fileLength];
+		NSOutputStream* stream = [NSOutputStream outputStreamToFileAtPath:path
+																   append:YES];
+		[stream open];
+		result = [mAutosaveWriter appendChangesToDrawing:[self drawing]
+												toStream:stream];
+		[stream close];
+
+		// if the append failed part way, what was appended is cut off so that the file's last table of contents is intact
+
+		if (!result) {
+			NSFileHandle* fh = [NSFileHandle fileHandleForWritingAtPath:path];
+			[fh truncateFileAtOffset:length];
+			[fh closeFile];
+		}
+	}
+
+	if (!result) {
+		// a full write goes to a temporary file which then replaces the autosaved file
+
+		if (mAutosaveWriter == nil) {
+			mAutosaveWriter = [[DKChunkedDrawingWriter alloc] init];
+			[mAutosaveWriter setTracksChanges:YES];
+		}
+
+		NSFileManager* fm = [NSFileManager defaultManager];
+		NSString* tempPath = [path stringByAppendingFormat:@".%@", [DKUniqueID uniqueKey]];
+		NSOutputStream* stream = [NSOutputStream outputStreamToFileAtPath:tempPath
+																   append:NO];
+		NSError* error = nil;
+
+		[stream open];
+		result = [mAutosaveWriter writeDrawing:[self drawing]
+									  toStream:stream];
+		[stream close];
+
+		if (result) {
+			if ([fm fileExistsAtPath:path])
+				result = [fm replaceItemAtURL:[NSURL fileURLWithPath:path]
+								withItemAtURL:[NSURL fileURLWithPath:tempPath]
+							   backupItemName:nil
+									  options:0
+							 resultingItemURL:NULL
+										error:&error];
+			else
+				result = [fm moveItemAtPath:tempPath
+									 toPath:path
+									  error:&error];
+		}
+
+		if (!result) {
+			[fm removeItemAtPath:tempPath
+						   error:NULL];
+			[mAutosaveWriter release];
+			mAutosaveWriter = nil;
+
+			if (outError)
+				*outError = error ? error : [NSError errorWithDomain:NSCocoaErrorDomain
+																code:NSFileWriteUnknownError
+															userInfo:nil];
+			return NO;
+		}
+	}
+
+	mAutosaveChangeCount = changeCount;
+	[self recordAutosavedFileAtPath:path];
+	[self compactAutosavedFileIfNeeded];
+
+	return YES;
+}
+
+- (BOOL)autosavedFileIsUnchangedAtPath:(NSString*)path
+{
+	NSDictionary* attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path
+																				error:NULL];
+
+	return [attributes fileSize] == [mAutosaveWriter fileLength] && [[attributes fileModificationDate] isEqualToDate:mAutosaveFileDate];
+}
+
+- (void)recordAutosavedFileAtPath:(NSString*)path
+{
+	NSDictionary* attributes = [[NSFileManager defaultManager] attributesOfItemAtPath:path
+																				error:NULL];
+	[path retain];
+	[mAutosavePath release];
+	mAutosavePath = path;
+
+	[mAutosaveFileDate release];
+	mAutosaveFileDate = [[attributes fileModificationDate] retain];
+}
+
+- (void)compactAutosavedFileIfNeeded
+{
+	unsigned long long length = [mAutosaveWriter fileLength];
+
+	if (mAutosaveCompacting || length < kDKAutosaveCompactionMinimumLength || [mAutosaveWriter liveLength] * 2 > length)
+		return;
+
+	// only the file is read while compacting, so the drawing can go on being edited. The result is used only if the file hasn't been
+	// written again in the meantime
+
+	DKAutosaveCompaction* compaction = calloc(1, sizeof(DKAutosaveCompaction));
+
+	compaction->document = [self retain];
+	compaction->path = [mAutosavePath copy];
+	compaction->compactedPath = [[mAutosavePath stringByAppendingFormat:@".%@", [DKUniqueID uniqueKey]] retain];
+	compaction->length = length;
+
+	mAutosaveCompacting = YES;
+
+	dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), compaction, compactInBackground);
+}
+
+- (void)autosaveCompactionDidFinish:(DKAutosaveCompaction*)compaction
+{
+	NSFileManager* fm = [NSFileManager defaultManager];
+	BOOL current = compaction->succeeded && [compaction->path isEqualToString:mAutosavePath] && [mAutosaveWriter fileLength] == compaction->length && [self autosavedFileIsUnchangedAtPath:compaction->path];
+
+	mAutosaveCompacting = NO;
+
+	if (current)
+		current = [fm replaceItemAtURL:[NSURL fileURLWithPath:compaction->path]
+						 withItemAtURL:[NSURL fileURLWithPath:compaction->compactedPath]
+						backupItemName:nil
+							   options:0
+					  resultingItemURL:NULL
+								 error:NULL];
+	if (current) {
+		LogEvent_(kFileEvent, @"compacted autosaved file from %llu to %llu bytes", compaction->length, compaction->compactedLength);
+
+		[mAutosaveWriter fileWasCompactedWithChunkOffsets:compaction->offsets
+												   length:compaction->compactedLength];
+		[self recordAutosavedFileAtPath:compaction->path];
+
+		// when autosaving in place the file is the document's own, whose date the document checks before saving
+
+		if ([[[self fileURL] path] isEqualToString:compaction->path])
+			[self setFileModificationDate:mAutosaveFileDate];
+	} else
+		[fm removeItemAtPath:compaction->compactedPath
+					   error:NULL];
+}
+
 /** @brief Sets the printing info
 
  This forwards the printInfo to the main view so that it can display page breaks
@@ -718,6 +1057,8 @@ static NSMutableDictionary* sFileExportBindings = nil;
 {
 	self = [super init];
 	if (self != nil) {
+		mWritesIncrementalAutosaves = YES;
+
 #if USE_DK_UNDO_MANAGER
 		DKUndoManager* dkum = [[DKUndoManager alloc] init];
 		[dkum enableUndoTaskCoalescing:YES];
@@ -727,9 +1068,9 @@ static NSMutableDictionary* sFileExportBindings = nil;
 		// bind the standard drawing types to the usual methods
 
 		[[self class] bindFileExportType:kDKDrawingDocumentType
-							  toSelector:@selector(drawingData)];
+							  toSelector:@selector(chunkedDrawingData)];
 		[[self class] bindFileExportType:kDKDrawingDocumentUTI
-							  toSelector:@selector(drawingData)];
+							  toSelector:@selector(chunkedDrawingData)];
 		[[self class] bindFileExportType:kDKDrawingDocumentXMLType
 							  toSelector:@selector(drawingAsXMLDataAtRoot)];
 		[[self class] bindFileExportType:kDKDrawingDocumentXMLUTI
@@ -746,6 +1087,9 @@ static NSMutableDictionary* sFileExportBindings = nil;
 - (void)dealloc
 {
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[mAutosaveWriter release];
+	[mAutosavePath release];
+	[mAutosaveFileDate release];
 
 	// set drawing's undo manager to nil prior to document dealloc so that any other refs to the drawing don't cause
 	// a problem with a stale undo mgr ref when the drawing is dealloced
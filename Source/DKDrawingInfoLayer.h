@@ -6,6 +6,8 @@
 
 #import "DKLayer.h"
 
+@class DKQuartzCache;
+
 // placement of info panel:
 
 typedef enum {
@@ -32,6 +34,8 @@ modified form. It is provided as another example of how to implement layer subcl
 	NSSize m_size; // the size of the panel
 	NSString* m_editingKeyRef; // which info key is being edited
 	BOOL m_drawBorder; // YES if a border is drawn around the drawing
+	DKQuartzCache* mInfoImage; // the info drawn on screen, or nil
+	NSArray* mInfoImageKey; // the info, box rect and scale the image was drawn with
 }
 
 // general settings:
@@ -51,6 +55,12 @@ modified form. It is provided as another example of how to implement layer subcl
 // internal stuff:
 
 - (NSRect)infoBoxRect;
+
+/** @brief Draws the info, labels and subdivisions of the box
+
+ On screen this is drawn into an image, which is redrawn from while the info, the box and the view's scale stay the same.
+ @param br the bounds of the info box
+ */
 - (void)drawInfoInRect:(NSRect)br;
 - (NSDictionary*)attributesForDrawingInfoItem:(NSString*)key;
 - (void)drawString:(NSString*)str inRect:(NSRect)r withAttributes:(NSDictionary*)attr;
@@ -64,4 +74,6 @@ modified form. It is provided as another example of how to implement layer subcl
 
 @end
 
+#define kDKDrawingInfoLayerMaximumImageScale 8.0 // above this many pixels per point the info is drawn directly
+
 extern NSString* kDKDrawingInfoTextLabelAttributes;
@@ -9,10 +9,28 @@
 #import "DKDrawing.h"
 #import "DKDrawingView.h"
 #import "DKGridLayer.h"
+#import "DKQuartzCache.h"
 
 #pragma mark Contants(Non - localized)
 NSString* kDKDrawingInfoTextLabelAttributes = @"kDKDrawingInfoTextLabelAttributes";
 
+@interface DKDrawingInfoLayer (Private)
+
+/** @brief Draws the info from an image of it, drawing the image first if what it shows has changed
+ @param br the bounds of the info box
+ @return NO if the info must be drawn directly, because this isn't drawing to the screen or the scale is too large
+ */
+- (BOOL)drawInfoImageInRect:(NSRect)br;
+
+/** @brief Returns what the image of the info depends on, to be compared with what it was drawn with
+ @param br the bounds of the info box
+ @param scale the image's pixels per point
+ @return an array of values
+ */
+- (NSArray*)infoImageKeyForRect:(NSRect)br scale:(CGFloat)scale;
+
+@end
+
 #pragma mark -
 @implementation DKDrawingInfoLayer
 #pragma mark As a DKDrawingInfoLayer
@@ -314,6 +332,71 @@ NSString* kDKDrawingInfoTextLabelAttributes = @"kDKDrawingInfoTextLabelAttribute
 	return r;
 }
 
+#pragma mark -
+- (BOOL)drawInfoImageInRect:(NSRect)br
+{
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+
+	if (context == nil || ![context isDrawingToScreen] || NSIsEmptyRect(br))
+		return NO;
+
+	// the image is made at the scale rounded up to a power of two so that zooming a little doesn't remake it
+
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform([context graphicsPort]);
+	CGFloat scale = exp2(ceil(log2(MAX(sqrt(fabs(dt.a * dt.d - dt.b * dt.c)), 0.125))));
+
+	if (scale > kDKDrawingInfoLayerMaximumImageScale)
+		return NO;
+
+	NSArray* key = [self infoImageKeyForRect:br
+									   scale:scale];
+
+	if (mInfoImage == nil || ![key isEqualToArray:mInfoImageKey]) {
+		[mInfoImage release];
+		mInfoImage = [[DKQuartzCache alloc] initWithContext:context
+													forRect:NSMakeRect(0, 0, ceil(NSWidth(br) * scale), ceil(NSHeight(br) * scale))];
+		[mInfoImageKey release];
+		mInfoImageKey = [key retain];
+
+		[mInfoImage lockFocus];
+
+		NSAffineTransform* transform = [NSAffineTransform transform];
+		[transform scaleBy:scale];
+		[transform translateXBy:-NSMinX(br)
+							yBy:-NSMinY(br)];
+		[transform concat];
+
+		[self drawInfoInRect:br];
+		[mInfoImage unlockFocus];
+	}
+
+	[mInfoImage drawInRect:br];
+	return YES;
+}
+
+- (NSArray*)infoImageKeyForRect:(NSRect)br scale:(CGFloat)scale
+{
+	// the items drawn are copied, as the drawing info's strings can be edited in place
+
+	NSDictionary* di = [[self drawing] drawingInfo];
+	NSArray* keys = [NSArray arrayWithObjects:kDKDrawingInfoDrawingNumber, kDKDrawingInfoDrawingRevision, kDKDrawingInfoDraughter, kDKDrawingInfoCreationDate, nil];
+	NSMutableArray* values = [NSMutableArray arrayWithCapacity:[keys count] + 2];
+	NSEnumerator* iter = [keys objectEnumerator];
+	NSString* infoKey;
+	id value;
+
+	while ((infoKey = [iter nextObject])) {
+		value = [[di objectForKey:infoKey] copy];
+		[values addObject:(value != nil) ? value : [NSNull null]];
+		[value release];
+	}
+
+	[values addObject:[NSValue valueWithRect:br]];
+	[values addObject:[NSNumber numberWithDouble:scale]];
+
+	return values;
+}
+
 #pragma mark -
 - (NSString*)keyForEditableRegionUnderMouse:(NSPoint)p
 {
@@ -388,7 +471,8 @@ NSString* kDKDrawingInfoTextLabelAttributes = @"kDKDrawingInfoTextLabelAttribute
 
 		// divide up the box and label each one:
 
-		[self drawInfoInRect:diRect];
+		if (![self drawInfoImageInRect:diRect])
+			[self drawInfoInRect:diRect];
 	}
 
 	if ([self drawsBorder]) {
@@ -447,6 +531,13 @@ NSString* kDKDrawingInfoTextLabelAttributes = @"kDKDrawingInfoTextLabelAttribute
 
 #pragma mark -
 #pragma mark As an NSObject
+- (void)dealloc
+{
+	[mInfoImage release];
+	[mInfoImageKey release];
+	[super dealloc];
+}
+
 - (id)init
 {
 	self = [super init];
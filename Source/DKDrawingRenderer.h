@@ -0,0 +1,77 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawing, DKLayer;
+
+/** @brief Renders a drawing into a Core Graphics context without a view.
+
+ Renders a drawing into a Core Graphics context without a view. Nothing about the rendering depends on a window, the main thread or
+ any state shared with other renderers, so different drawings can be rendered at the same time on different threads. A given drawing
+ should only be rendered on one thread at a time, and drawings rendered concurrently should not share style objects, as each style
+ caches what it renders. Drawings read from files with +[DKDrawing drawingWithData:] have styles of their own.
+
+ While rendering, work that DrawKit would normally finish later on the main thread is done at once instead, for example laying out
+ long text and decoding images, so the output is always complete.
+*/
+@interface DKDrawingRenderer : NSObject {
+@private
+	DKDrawing* mDrawing;
+	BOOL mDrawsPaper;
+}
+
+/** @brief Whether the current thread is rendering with a headless renderer
+ @return YES while inside -renderRect:intoContext:destinationRect: on this thread
+ */
++ (BOOL)isRenderingOnCurrentThread;
+
+- (id)initWithDrawing:(DKDrawing*)drawing;
+- (DKDrawing*)drawing;
+
+/** @brief Sets whether the paper colour is painted behind the drawing
+
+ The default is YES.
+ @param paper YES to paint the paper colour
+ */
+- (void)setDrawsPaper:(BOOL)paper;
+- (BOOL)drawsPaper;
+
+/** @brief Renders part of the drawing into a context
+
+ <rect> is scaled to fill <dest>, which is in the context's current coordinates, with the top of the drawing at the top of <dest>.
+ The context's state is restored afterwards.
+ @param rect the area of the drawing to render
+ @param ctx the context to render into
+ @param dest the area of the context to render into
+ */
+- (void)renderRect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest;
+
+/** @brief Renders part of one of the drawing's layers into a context
+
+ As -renderRect:intoContext:destinationRect:, but draws only <layer>, without the paper. The layer is drawn even if it's hidden. Different
+ layers of the same drawing may be rendered at the same time on different threads, so long as none of their objects share a style.
+ @param layer a layer belonging to the drawing
+ @param rect the area of the drawing to render
+ @param ctx the context to render into
+ @param dest the area of the context to render into
+ */
+- (void)renderLayer:(DKLayer*)layer rect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest;
+
+/** @brief Renders part of the drawing into a new bitmap image
+ @param rect the area of the drawing to render
+ @param scale the number of pixels per drawing unit
+ @return the image, which the caller must release, or NULL if it couldn't be made
+ */
+- (CGImageRef)newImageOfRect:(NSRect)rect scale:(CGFloat)scale;
+
+@end
+
+/// sets up <ctx> so that <rect> of a drawing fills <dest>, with the top of the drawing at the top, makes it AppKit's current context on this
+/// thread and calls <function> to draw with <rect> and <info>. Everything is restored afterwards. While <function> runs,
+/// +[DKDrawingRenderer isRenderingOnCurrentThread] is YES. Exceptions raised while drawing are logged and ignored.
+
+void DKDrawingRenderHeadless(CGContextRef ctx, NSRect rect, CGRect dest, void (*function)(NSRect rect, void* info), void* info);
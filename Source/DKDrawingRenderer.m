@@ -0,0 +1,181 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawingRenderer.h"
+#import "DKDrawing.h"
+#import "LogEvent.h"
+
+static __thread NSUInteger sRenderingDepth = 0; // nesting of headless renders on this thread
+
+@interface DKDrawingRenderer (Private)
+
+- (void)renderLayer:(DKLayer*)layer orDrawingRect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest;
+- (void)drawLayer:(DKLayer*)layer orDrawingRect:(NSRect)rect;
+
+@end
+
+void DKDrawingRenderHeadless(CGContextRef ctx, NSRect rect, CGRect dest, void (*function)(NSRect rect, void* info), void* info)
+{
+	NSCAssert(ctx != NULL, @"cannot render into a NULL context");
+
+	if (NSIsEmptyRect(rect) || CGRectIsEmpty(dest))
+		return;
+
+	// the drawing's coordinates are flipped, so the top of <rect> maps to the top of <dest>
+
+	CGContextSaveGState(ctx);
+	CGContextTranslateCTM(ctx, dest.origin.x, dest.origin.y + dest.size.height);
+	CGContextScaleCTM(ctx, dest.size.width / NSWidth(rect), -dest.size.height / NSHeight(rect));
+	CGContextTranslateCTM(ctx, -NSMinX(rect), -NSMinY(rect));
+	CGContextClipToRect(ctx, CGRectMake(NSMinX(rect), NSMinY(rect), NSWidth(rect), NSHeight(rect)));
+
+	// AppKit's current context is per thread, so setting it here doesn't disturb drawing on any other thread
+
+	[NSGraphicsContext saveGraphicsState];
+	[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:ctx
+																					flipped:YES]];
+	++sRenderingDepth;
+
+	@try
+	{
+		function(rect, info);
+	}
+	@catch (id exc)
+	{
+		LogEvent_(kWheneverEvent, @"exception while rendering headless (%@ - ignored)", exc);
+	}
+	@finally
+	{
+		--sRenderingDepth;
+		[NSGraphicsContext restoreGraphicsState];
+		CGContextRestoreGState(ctx);
+	}
+}
+
+// context is an array of { the renderer, the layer or nil }
+
+static void drawLayerOrDrawing(NSRect rect, void* info)
+{
+	void** context = (void**)info;
+
+	[(DKDrawingRenderer*)context[0] drawLayer:(DKLayer*)context[1]
+								orDrawingRect:rect];
+}
+
+@implementation DKDrawingRenderer
+
++ (BOOL)isRenderingOnCurrentThread
+{
+	return sRenderingDepth > 0;
+}
+
+- (id)initWithDrawing:(DKDrawing*)drawing
+{
+	NSAssert(drawing != nil, @"cannot render a nil drawing");
+
+	self = [super init];
+	if (self) {
+		mDrawing = [drawing retain];
+		mDrawsPaper = YES;
+	}
+
+	return self;
+}
+
+- (DKDrawing*)drawing
+{
+	return mDrawing;
+}
+
+- (void)setDrawsPaper:(BOOL)paper
+{
+	mDrawsPaper = paper;
+}
+
+- (BOOL)drawsPaper
+{
+	return mDrawsPaper;
+}
+
+- (void)renderRect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest
+{
+	[self renderLayer:nil
+		orDrawingRect:rect
+		  intoContext:ctx
+	  destinationRect:dest];
+}
+
+- (void)renderLayer:(DKLayer*)layer rect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest
+{
+	NSAssert(layer != nil, @"cannot render a nil layer");
+	NSAssert([layer drawing] == mDrawing, @"the layer must belong to the renderer's drawing");
+
+	[self renderLayer:layer
+		orDrawingRect:rect
+		  intoContext:ctx
+	  destinationRect:dest];
+}
+
+- (void)renderLayer:(DKLayer*)layer orDrawingRect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest
+{
+	void* context[2] = { self, layer };
+
+	DKDrawingRenderHeadless(ctx, rect, dest, drawLayerOrDrawing, context);
+}
+
+- (void)drawLayer:(DKLayer*)layer orDrawingRect:(NSRect)rect
+{
+	if (layer == nil)
+		[mDrawing drawContentInRect:rect
+						 drawsPaper:[self drawsPaper]];
+	else {
+		if ([layer clipsDrawingToInterior])
+			[NSBezierPath clipRect:[mDrawing interior]];
+
+		[layer beginDrawing];
+		[layer drawRect:rect
+				 inView:nil];
+		[layer endDrawing];
+	}
+}
+
+- (CGImageRef)newImageOfRect:(NSRect)rect scale:(CGFloat)scale
+{
+	NSAssert(scale > 0, @"scale must be greater than zero");
+
+	size_t pw = (size_t)ceil(NSWidth(rect) * scale);
+	size_t ph = (size_t)ceil(NSHeight(rect) * scale);
+
+	if (pw == 0 || ph == 0)
+		return NULL;
+
+	CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	CGContextRef bm = CGBitmapContextCreate(NULL, pw, ph, 8, 0, space, kCGImageAlphaPremultipliedLast);
+	CGColorSpaceRelease(space);
+
+	if (bm == NULL)
+		return NULL;
+
+	[self renderRect:rect
+		 intoContext:bm
+	 destinationRect:CGRectMake(0, 0, pw, ph)];
+
+	CGImageRef image = CGBitmapContextCreateImage(bm);
+	CGContextRelease(bm);
+
+	return image;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mDrawing release];
+	[super dealloc];
+}
+
+@end
@@ -0,0 +1,118 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKDrawing.h"
+
+@class DKLayer;
+
+/** @brief One layer of a drawing snapshot.
+
+ One layer of a drawing snapshot. Records what the layer was and how it was shown, and for object layers holds copies of its objects as
+ they were when the snapshot was made.
+*/
+@interface DKLayerSnapshot : NSObject {
+@private
+	NSString* mLayerName;
+	NSString* mUniqueKey;
+	Class mLayerClass;
+	BOOL mVisible;
+	BOOL mClipsToInterior;
+	NSArray* mObjects;
+}
+
+- (NSString*)layerName;
+- (NSString*)uniqueKey;
+- (Class)layerClass;
+
+/** @brief Whether the layer was shown, taking into account the visibility of the groups it's in
+ @return YES if the layer was visible
+ */
+- (BOOL)visible;
+- (BOOL)clipsDrawingToInterior;
+
+/** @brief The layer's objects as they were when the snapshot was made
+ @return copies of the objects, in stacking order, or nil if the layer doesn't own objects
+ */
+- (NSArray*)objects;
+
+@end
+
+#pragma mark -
+
+/** @brief An unchanging view of a drawing as it was at one moment, which can be read and rendered on any thread.
+
+ An unchanging view of a drawing as it was at one moment, which can be read and rendered on any thread. A snapshot is made on the main
+ thread by -[DKDrawing snapshot], and records the drawing's size, interior, paper colour and info, and each of its layers from bottom to
+ top. The objects of object layers are copies, with copies of their styles, so editing the drawing afterwards doesn't affect the snapshot,
+ and the snapshot can be rendered without locking the drawing - for example by exporters, thumbnailers and search indexers working in
+ the background.
+
+ Snapshots are cheap to make again: each layer keeps the copies it made, and copies again only the objects that changed since. So
+ successive snapshots of a drawing share the copies of unchanged objects, and should be rendered on one thread at a time, as each object
+ and style caches what it draws. Only the objects of object layers are rendered; grids, guides and other layers are recorded but not drawn.
+*/
+@interface DKDrawingSnapshot : NSObject {
+@private
+	NSSize mDrawingSize;
+	NSRect mInterior;
+	NSColor* mPaperColour;
+	NSDictionary* mDrawingInfo;
+	NSArray* mLayers;
+	BOOL mDrawsPaper;
+}
+
+- (id)initWithDrawing:(DKDrawing*)drawing;
+
+- (NSSize)drawingSize;
+- (NSRect)interior;
+- (NSColor*)paperColour;
+- (NSDictionary*)drawingInfo;
+
+/** @brief The drawing's layers as they were when the snapshot was made
+ @return the layer snapshots, bottom first, without the groups that contained them
+ */
+- (NSArray*)layers;
+
+/** @brief Sets whether the paper colour is painted behind the drawing when the snapshot is rendered
+
+ The default is YES.
+ @param paper YES to paint the paper colour
+ */
+- (void)setDrawsPaper:(BOOL)paper;
+- (BOOL)drawsPaper;
+
+/** @brief Renders part of the snapshot into a context
+
+ <rect> is scaled to fill <dest>, which is in the context's current coordinates, with the top of the drawing at the top of <dest>.
+ The context's state is restored afterwards. May be called on any thread.
+ @param rect the area of the drawing to render
+ @param ctx the context to render into
+ @param dest the area of the context to render into
+ */
+- (void)renderRect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest;
+
+/** @brief Renders part of the snapshot into a new bitmap image
+ @param rect the area of the drawing to render
+ @param scale the number of pixels per drawing unit
+ @return the image, which the caller must release, or NULL if it couldn't be made
+ */
+- (CGImageRef)newImageOfRect:(NSRect)rect scale:(CGFloat)scale;
+
+@end
+
+#pragma mark -
+
+@interface DKDrawing (Snapshot)
+
+/** @brief Makes an unchanging view of the drawing as it is now, for reading and rendering on other threads
+
+ Must be called on the main thread.
+ @return a snapshot of the drawing
+ */
+- (DKDrawingSnapshot*)snapshot;
+
+@end
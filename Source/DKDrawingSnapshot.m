@@ -0,0 +1,281 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawingSnapshot.h"
+#import "DKDrawingRenderer.h"
+#import "DKLayerGroup.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawableObject.h"
+#import "DKStyle.h"
+#import "NSDictionary+DeepCopy.h"
+
+@interface DKLayerSnapshot (Private)
+
+- (id)initWithLayer:(DKLayer*)layer frozenStyles:(CFMutableDictionaryRef)styles;
+
+@end
+
+@interface DKDrawingSnapshot (Private)
+
+- (void)drawRect:(NSRect)rect;
+
+@end
+
+static void drawSnapshot(NSRect rect, void* info)
+{
+	[(DKDrawingSnapshot*)info drawRect:rect];
+}
+
+@implementation DKLayerSnapshot
+
+- (id)initWithLayer:(DKLayer*)layer frozenStyles:(CFMutableDictionaryRef)styles
+{
+	self = [super init];
+	if (self) {
+		mLayerName = [[layer layerName] copy];
+		mUniqueKey = [[layer uniqueKey] copy];
+		mLayerClass = [layer class];
+		mClipsToInterior = [layer clipsDrawingToInterior];
+
+		// a layer is only shown if every group it's in is too
+
+		DKLayerGroup* group = [layer layerGroup];
+
+		mVisible = [layer visible];
+
+		while (mVisible && group) {
+			mVisible = [group visible];
+			group = [group layerGroup];
+		}
+
+		if ([layer isKindOfClass:[DKObjectOwnerLayer class]])
+			mObjects = [[(DKObjectOwnerLayer*)layer frozenObjectsWithStyles:styles] retain];
+	}
+
+	return self;
+}
+
+- (NSString*)layerName
+{
+	return mLayerName;
+}
+
+- (NSString*)uniqueKey
+{
+	return mUniqueKey;
+}
+
+- (Class)layerClass
+{
+	return mLayerClass;
+}
+
+- (BOOL)visible
+{
+	return mVisible;
+}
+
+- (BOOL)clipsDrawingToInterior
+{
+	return mClipsToInterior;
+}
+
+- (NSArray*)objects
+{
+	return mObjects;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mLayerName release];
+	[mUniqueKey release];
+	[mObjects release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKDrawingSnapshot
+
+- (id)initWithDrawing:(DKDrawing*)drawing
+{
+	NSAssert([NSThread isMainThread], @"a snapshot of a drawing must be made on the main thread");
+
+	self = [super init];
+	if (self) {
+		mDrawingSize = [drawing drawingSize];
+		mInterior = [drawing interior];
+		mPaperColour = [[drawing paperColour] retain];
+		mDrawingInfo = [[drawing drawingInfo] deepCopy];
+		mDrawsPaper = YES;
+
+		// a style change waiting to be posted hasn't yet told its objects, so their copies wouldn't be made again
+
+		[DKStyle postPendingChangeNotifications];
+
+		// the live styles of shared objects map to the copies made for this snapshot, so objects sharing a style still share one here
+
+		CFMutableDictionaryRef styles = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+		NSEnumerator* iter = [[drawing flattenedLayersIncludingGroups:NO] reverseObjectEnumerator];
+		NSMutableArray* layers = [NSMutableArray array];
+		DKLayer* layer;
+		DKLayerSnapshot* ls;
+
+		while ((layer = [iter nextObject])) {
+			ls = [[DKLayerSnapshot alloc] initWithLayer:layer
+										   frozenStyles:styles];
+			[layers addObject:ls];
+			[ls release];
+		}
+
+		CFRelease(styles);
+		mLayers = [layers copy];
+	}
+
+	return self;
+}
+
+- (NSSize)drawingSize
+{
+	return mDrawingSize;
+}
+
+- (NSRect)interior
+{
+	return mInterior;
+}
+
+- (NSColor*)paperColour
+{
+	return mPaperColour;
+}
+
+- (NSDictionary*)drawingInfo
+{
+	return mDrawingInfo;
+}
+
+- (NSArray*)layers
+{
+	return mLayers;
+}
+
+- (void)setDrawsPaper:(BOOL)paper
+{
+	mDrawsPaper = paper;
+}
+
+- (BOOL)drawsPaper
+{
+	return mDrawsPaper;
+}
+
+#pragma mark -
+
+- (void)renderRect:(NSRect)rect intoContext:(CGContextRef)ctx destinationRect:(CGRect)dest
+{
+	DKDrawingRenderHeadless(ctx, rect, dest, drawSnapshot, self);
+}
+
+- (CGImageRef)newImageOfRect:(NSRect)rect scale:(CGFloat)scale
+{
+	NSAssert(scale > 0, @"scale must be greater than zero");
+
+	size_t pw = (size_t)ceil(NSWidth(rect) * scale);
+	size_t ph = (size_t)ceil(NSHeight(rect) * scale);
+
+	if (pw == 0 || ph == 0)
+		return NULL;
+
+	CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	CGContextRef bm = CGBitmapContextCreate(NULL, pw, ph, 8, 0, space, kCGImageAlphaPremultipliedLast);
+	CGColorSpaceRelease(space);
+
+	if (bm == NULL)
+		return NULL;
+
+	[self renderRect:rect
+		 intoContext:bm
+	 destinationRect:CGRectMake(0, 0, pw, ph)];
+
+	CGImageRef image = CGBitmapContextCreateImage(bm);
+	CGContextRelease(bm);
+
+	return image;
+}
+
+#pragma mark -
+
+- (void)drawRect:(NSRect)rect
+{
+	if (mDrawsPaper && mPaperColour) {
+		[mPaperColour set];
+		NSRectFillUsingOperation(rect, NSCompositeSourceOver);
+	}
+
+	NSEnumerator* iter = [mLayers objectEnumerator];
+	DKLayerSnapshot* layer;
+	NSEnumerator* objIter;
+	DKDrawableObject* obj;
+
+	[DKStyle beginRenderPass:[DKStyle renderPassForCurrentContext]
+				  lowQuality:NO];
+
+	@try
+	{
+		while ((layer = [iter nextObject])) {
+			if (![layer visible] || [layer objects] == nil)
+				continue;
+
+			[NSGraphicsContext saveGraphicsState];
+
+			if ([layer clipsDrawingToInterior])
+				[NSBezierPath clipRect:mInterior];
+
+			objIter = [[layer objects] objectEnumerator];
+
+			while ((obj = [objIter nextObject])) {
+				if ([obj visible] && NSIntersectsRect([obj bounds], rect))
+					[obj drawContentWithSelectedState:NO];
+			}
+
+			[NSGraphicsContext restoreGraphicsState];
+		}
+	}
+	@finally
+	{
+		[DKStyle endRenderPass];
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mPaperColour release];
+	[mDrawingInfo release];
+	[mLayers release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKDrawing (Snapshot)
+
+- (DKDrawingSnapshot*)snapshot
+{
+	return [[[DKDrawingSnapshot alloc] initWithDrawing:self] autorelease];
+}
+
+@end
@@ -0,0 +1,80 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawing;
+
+// the scale of the thumbnail relative to the drawing, and how long the drawing must be left alone before changes are rendered into it
+
+#define kDKDrawingThumbnailScale 0.5
+#define kDKDrawingThumbnailIdleInterval 2.0
+
+/** @brief Keeps a JPEG thumbnail of a drawing up to date, rendering only the parts of it that have changed.
+
+ Keeps a JPEG thumbnail of a drawing up to date, rendering only the parts of it that have changed. The drawing passes on every area it
+ marks as needing display, and once nothing has changed for kDKDrawingThumbnailIdleInterval, the pdf of the changed area is made and then
+ rendered into the thumbnail's pixels and encoded on a background queue. Asking for the data when there are changes that haven't been
+ rendered yet renders them at once, so that costs only as much as the changes.
+
+ The thumbnail is drawn as the drawing would be printed. The pdf is made with AppKit, so the thumbnail should only be used on the main thread.
+
+ The thumbnail is owned by the drawing, and is made the first time the drawing's -thumbnailData is asked for, or when the drawing is read
+ from a file that includes one.
+*/
+@interface DKDrawingThumbnail : NSObject {
+@private
+	DKDrawing* mDrawingRef;
+	dispatch_queue_t mQueue; // renders and encodes, one update at a time
+	CGContextRef mBitmap; // the thumbnail's pixels, only used on mQueue
+	NSData* mData; // the encoded thumbnail
+	NSRect mDirtyRect; // the area of the drawing not yet rendered
+	NSSize mPixelSize;
+	NSTimer* mIdleTimer;
+	BOOL mMakingPDF;
+}
+
+- (id)initWithDrawing:(DKDrawing*)drawing;
+
+/** @brief Sets the drawing
+
+ The drawing isn't retained. It sets this to nil when it is deallocated, which stops any pending update.
+ @param drawing the drawing
+ */
+- (void)setDrawing:(DKDrawing*)drawing;
+- (DKDrawing*)drawing;
+
+/** @brief Marks part of the drawing as changed
+ @param rect the area of the drawing
+ */
+- (void)invalidateRect:(NSRect)rect;
+- (void)invalidate;
+
+/** @brief Whether every change has been rendered
+ @return YES if the data is up to date without rendering anything
+ */
+- (BOOL)isUpToDate;
+
+/** @brief The JPEG data of the thumbnail, rendering any changes first
+ @return the data, or nil if there is no drawing
+ */
+- (NSData*)data;
+
+/** @brief Makes the thumbnail from previously encoded data, such as that read from a file
+
+ This lets a drawing that was just read be saved again without rendering the whole thumbnail. The data is only used if its size is right
+ for the drawing.
+ @param data JPEG data, as returned by -data
+ @return YES if the data was used
+ */
+- (BOOL)setData:(NSData*)data;
+
+/** @brief The approximate memory used by the thumbnail's pixels and its encoded data
+ @return the size in bytes
+ */
+- (NSUInteger)bytesUsed;
+
+@end
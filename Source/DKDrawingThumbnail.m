@@ -0,0 +1,377 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawingThumbnail.h"
+#import "DKDrawing.h"
+#import "DKSelectionPDFView.h"
+#import "DKViewController.h"
+#import "LogEvent.h"
+
+// an update is made on the main thread, where the pdf of the changed area is drawn, then applied on the thumbnail's queue
+
+typedef struct {
+	DKDrawingThumbnail* thumbnail; // retained until the update is applied
+	CFDataRef pdfData; // the changed area, or NULL
+	CGImageRef seed; // previously encoded thumbnail to start from, or NULL
+	CGRect pixelRect; // where the pdf goes in the bitmap
+	size_t width;
+	size_t height;
+	CGFloat paper[4];
+} DKThumbnailUpdate;
+
+@interface DKDrawingThumbnail (Private)
+
+- (DKThumbnailUpdate*)newUpdate;
+- (NSData*)pdfOfRect:(NSRect)rect;
+- (void)applyUpdate:(DKThumbnailUpdate*)update;
+- (void)idleTimerFired:(NSTimer*)timer;
+
+@end
+
+static void applyThumbnailUpdate(void* context)
+{
+	DKThumbnailUpdate* update = (DKThumbnailUpdate*)context;
+
+	[update->thumbnail applyUpdate:update];
+
+	if (update->pdfData)
+		CFRelease(update->pdfData);
+
+	CGImageRelease(update->seed);
+	[update->thumbnail release];
+	free(update);
+}
+
+static void waitForThumbnailUpdates(void* context)
+{
+#pragma unused(context)
+}
+
+@implementation DKDrawingThumbnail
+
+- (id)initWithDrawing:(DKDrawing*)drawing
+{
+	self = [super init];
+	if (self) {
+		mDrawingRef = drawing;
+		mQueue = dispatch_queue_create("com.drawkit.thumbnail", NULL);
+		mDirtyRect = NSMakeRect(0, 0, [drawing drawingSize].width, [drawing drawingSize].height);
+	}
+
+	return self;
+}
+
+- (void)setDrawing:(DKDrawing*)drawing
+{
+	if (drawing == nil) {
+		[mIdleTimer invalidate];
+		[mIdleTimer release];
+		mIdleTimer = nil;
+	}
+
+	mDrawingRef = drawing;
+}
+
+- (DKDrawing*)drawing
+{
+	return mDrawingRef;
+}
+
+- (void)invalidateRect:(NSRect)rect
+{
+	// drawing the pdf marks things as needing display as a side effect, which mustn't start another update
+
+	if (mDrawingRef == nil || mMakingPDF || NSIsEmptyRect(rect))
+		return;
+
+	mDirtyRect = NSUnionRect(mDirtyRect, rect);
+
+	// the timer is put back every time, so it only fires once the drawing has been left alone. It isn't added for event
+	// tracking, so nothing is rendered during a drag
+
+	if (mIdleTimer == nil)
+		mIdleTimer = [[NSTimer scheduledTimerWithTimeInterval:kDKDrawingThumbnailIdleInterval
+													   target:self
+													 selector:@selector(idleTimerFired:)
+													 userInfo:nil
+													  repeats:NO] retain];
+	else
+		[mIdleTimer setFireDate:[NSDate dateWithTimeIntervalSinceNow:kDKDrawingThumbnailIdleInterval]];
+}
+
+- (void)invalidate
+{
+	NSSize size = [mDrawingRef drawingSize];
+
+	[self invalidateRect:NSMakeRect(0, 0, size.width, size.height)];
+}
+
+- (BOOL)isUpToDate
+{
+	return NSIsEmptyRect(mDirtyRect);
+}
+
+- (NSData*)data
+{
+	[mIdleTimer invalidate];
+	[mIdleTimer release];
+	mIdleTimer = nil;
+
+	DKThumbnailUpdate* update = [self newUpdate];
+
+	// waiting on the queue also waits for any update started in the background
+
+	if (update)
+		dispatch_sync_f(mQueue, update, applyThumbnailUpdate);
+	else
+		dispatch_sync_f(mQueue, NULL, waitForThumbnailUpdates);
+
+	@synchronized(self)
+	{
+		return [[mData retain] autorelease];
+	}
+}
+
+- (BOOL)setData:(NSData*)data
+{
+	if (data == nil || mDrawingRef == nil)
+		return NO;
+
+	NSSize size = [mDrawingRef drawingSize];
+	NSSize pixels = NSMakeSize(ceil(size.width * kDKDrawingThumbnailScale), ceil(size.height * kDKDrawingThumbnailScale));
+
+	CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)data, NULL);
+	CGImageRef image = NULL;
+
+	if (source) {
+		image = CGImageSourceCreateImageAtIndex(source, 0, NULL);
+		CFRelease(source);
+	}
+
+	if (image == NULL || CGImageGetWidth(image) != (size_t)pixels.width || CGImageGetHeight(image) != (size_t)pixels.height) {
+		CGImageRelease(image);
+		return NO;
+	}
+
+	DKThumbnailUpdate* update = calloc(1, sizeof(DKThumbnailUpdate));
+
+	update->thumbnail = [self retain];
+	update->seed = image;
+	update->width = (size_t)pixels.width;
+	update->height = (size_t)pixels.height;
+
+	dispatch_sync_f(mQueue, update, applyThumbnailUpdate);
+
+	@synchronized(self)
+	{
+		[mData release];
+		mData = [data copy];
+	}
+
+	mPixelSize = pixels;
+	mDirtyRect = NSZeroRect;
+
+	return YES;
+}
+
+- (NSUInteger)bytesUsed
+{
+	// the pixels are kept once anything has been rendered or set, which is when there is data
+
+	@synchronized(self)
+	{
+		if (mData == nil)
+			return 0;
+
+		return [mData length] + (NSUInteger)(mPixelSize.width * mPixelSize.height) * 4;
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mIdleTimer invalidate];
+	[mIdleTimer release];
+	dispatch_release(mQueue);
+	CGContextRelease(mBitmap);
+	[mData release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKDrawingThumbnail (Private)
+
+- (DKThumbnailUpdate*)newUpdate
+{
+	if (mDrawingRef == nil)
+		return NULL;
+
+	CGFloat scale = kDKDrawingThumbnailScale;
+	NSSize size = [mDrawingRef drawingSize];
+	NSRect bounds = NSMakeRect(0, 0, size.width, size.height);
+	NSSize pixels = NSMakeSize(ceil(size.width * scale), ceil(size.height * scale));
+
+	// a change of size makes a new bitmap, so all of it must be rendered
+
+	if (!NSEqualSizes(pixels, mPixelSize)) {
+		mPixelSize = pixels;
+		mDirtyRect = bounds;
+	}
+
+	NSRect rect = NSIntersectionRect(mDirtyRect, bounds);
+	mDirtyRect = NSZeroRect;
+
+	if (NSIsEmptyRect(rect))
+		return NULL;
+
+	// the area rendered is rounded out to whole thumbnail pixels, so that the pdf fills them exactly
+
+	NSRect pixelRect = NSIntegralRect(NSMakeRect(NSMinX(rect) * scale, NSMinY(rect) * scale, NSWidth(rect) * scale, NSHeight(rect) * scale));
+	pixelRect = NSIntersectionRect(pixelRect, NSMakeRect(0, 0, pixels.width, pixels.height));
+	rect = NSMakeRect(NSMinX(pixelRect) / scale, NSMinY(pixelRect) / scale, NSWidth(pixelRect) / scale, NSHeight(pixelRect) / scale);
+
+	DKThumbnailUpdate* update = calloc(1, sizeof(DKThumbnailUpdate));
+
+	update->thumbnail = [self retain];
+	update->pdfData = (CFDataRef)[[self pdfOfRect:rect] retain];
+	update->width = (size_t)pixels.width;
+	update->height = (size_t)pixels.height;
+
+	// the bitmap's origin is at the bottom, so a flipped drawing's rects are turned over
+
+	update->pixelRect = CGRectMake(NSMinX(pixelRect), [mDrawingRef isFlipped] ? pixels.height - NSMaxY(pixelRect) : NSMinY(pixelRect), NSWidth(pixelRect), NSHeight(pixelRect));
+
+	[[[mDrawingRef paperColour] colorUsingColorSpaceName:NSCalibratedRGBColorSpace] getRed:&update->paper[0]
+																					 green:&update->paper[1]
+																					  blue:&update->paper[2]
+																					 alpha:&update->paper[3]];
+
+	LogEvent_(kInfoEvent, @"updating thumbnail of %@, area = %@", mDrawingRef, NSStringFromRect(rect));
+
+	return update;
+}
+
+- (NSData*)pdfOfRect:(NSRect)rect
+{
+	NSRect frame = NSZeroRect;
+	frame.size = [mDrawingRef drawingSize];
+
+	mMakingPDF = YES;
+
+	DKLayerPDFView* pdfView = [[DKLayerPDFView alloc] initWithFrame:frame
+														  withLayer:mDrawingRef];
+	DKViewController* vc = [pdfView makeViewController];
+
+	[mDrawingRef addController:vc];
+
+	NSData* pdfData = [pdfView dataWithPDFInsideRect:rect];
+	[pdfView release]; // removes the controller
+
+	mMakingPDF = NO;
+
+	return pdfData;
+}
+
+- (void)applyUpdate:(DKThumbnailUpdate*)update
+{
+	// called on the queue
+
+	if (mBitmap == NULL || CGBitmapContextGetWidth(mBitmap) != update->width || CGBitmapContextGetHeight(mBitmap) != update->height) {
+		CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+
+		CGContextRelease(mBitmap);
+		mBitmap = CGBitmapContextCreate(NULL, update->width, update->height, 8, 0, space, kCGImageAlphaNoneSkipLast);
+		CGColorSpaceRelease(space);
+
+		if (mBitmap == NULL)
+			return;
+
+		CGContextSetRGBFillColor(mBitmap, 1, 1, 1, 1);
+		CGContextFillRect(mBitmap, CGRectMake(0, 0, update->width, update->height));
+	}
+
+	if (update->seed)
+		CGContextDrawImage(mBitmap, CGRectMake(0, 0, update->width, update->height), update->seed);
+
+	if (update->pdfData == NULL)
+		return;
+
+	CGDataProviderRef provider = CGDataProviderCreateWithCFData(update->pdfData);
+	CGPDFDocumentRef doc = CGPDFDocumentCreateWithProvider(provider);
+	CGPDFPageRef page = CGPDFDocumentGetPage(doc, 1);
+	CGRect pr = update->pixelRect;
+
+	// the JPEG has no alpha, so the paper is painted over white
+
+	CGContextSaveGState(mBitmap);
+	CGContextClipToRect(mBitmap, pr);
+	CGContextSetRGBFillColor(mBitmap, 1, 1, 1, 1);
+	CGContextFillRect(mBitmap, pr);
+	CGContextSetRGBFillColor(mBitmap, update->paper[0], update->paper[1], update->paper[2], update->paper[3]);
+	CGContextFillRect(mBitmap, pr);
+
+	if (page) {
+		CGRect mediaBox = CGPDFPageGetBoxRect(page, kCGPDFMediaBox);
+
+		CGContextSetInterpolationQuality(mBitmap, kCGInterpolationHigh);
+		CGContextTranslateCTM(mBitmap, pr.origin.x, pr.origin.y);
+		CGContextScaleCTM(mBitmap, pr.size.width / mediaBox.size.width, pr.size.height / mediaBox.size.height);
+		CGContextTranslateCTM(mBitmap, -mediaBox.origin.x, -mediaBox.origin.y);
+		CGContextDrawPDFPage(mBitmap, page);
+	}
+
+	CGContextRestoreGState(mBitmap);
+	CGPDFDocumentRelease(doc);
+	CGDataProviderRelease(provider);
+
+	// encoded at the same quality as the thumbnails exported before they were cached
+
+	CGImageRef image = CGBitmapContextCreateImage(mBitmap);
+	CFMutableDataRef data = CFDataCreateMutable(kCFAllocatorDefault, 0);
+	CGImageDestinationRef destRef = CGImageDestinationCreateWithData(data, kUTTypeJPEG, 1, NULL);
+	NSDictionary* jfif = [NSDictionary dictionaryWithObject:[NSNumber numberWithBool:YES]
+													 forKey:(NSString*)kCGImagePropertyJFIFIsProgressive];
+	NSDictionary* options = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithDouble:0.5], (NSString*)kCGImageDestinationLossyCompressionQuality,
+																	   [NSNumber numberWithInteger:72], (NSString*)kCGImagePropertyDPIWidth,
+																	   [NSNumber numberWithInteger:72], (NSString*)kCGImagePropertyDPIHeight,
+																	   jfif, (NSString*)kCGImagePropertyJFIFDictionary,
+																	   nil];
+
+	CGImageDestinationAddImage(destRef, image, (CFDictionaryRef)options);
+
+	if (CGImageDestinationFinalize(destRef)) {
+		@synchronized(self)
+		{
+			[mData release];
+			mData = [(NSData*)data copy];
+		}
+	} else
+		LogEvent_(kWheneverEvent, @"unable to encode thumbnail %@", self);
+
+	CFRelease(destRef);
+	CFRelease(data);
+	CGImageRelease(image);
+}
+
+- (void)idleTimerFired:(NSTimer*)timer
+{
+#pragma unused(timer)
+
+	[mIdleTimer release];
+	mIdleTimer = nil;
+
+	DKThumbnailUpdate* update = [self newUpdate];
+
+	if (update)
+		dispatch_async_f(mQueue, update, applyThumbnailUpdate);
+}
+
+@end
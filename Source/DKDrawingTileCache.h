@@ -0,0 +1,98 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKCacheRegistry.h"
+
+@class DKDrawingView, DKLayer;
+
+/** @brief Caches the rendered content of a drawing as a grid of fixed-size tiles, for fast redrawing of a view.
+
+ Caches the rendered content of a drawing as a grid of fixed-size tiles, for fast redrawing of a view. Each tile is kDKDrawingTileSize points square
+ on screen, so the area of the drawing it covers depends on the view's scale; tiles are kept separately for each scale so that returning to a
+ previous zoom level doesn't require everything to be re-rendered. Scales are rounded to kDKDrawingTileScaleResolution, and kept apart by the
+ backing scale factor of the view's window and by whether the view draws outlines only, so that several views of one drawing at the same
+ scale share their tiles - a drawing keeps one cache for all of its views (see -[DKDrawing tileCache]). Tiles are stored as DKQuartzCache objects, which are device-compatible, so
+ drawing a cached tile is a simple blit.
+
+ The owning view invalidates tiles whenever the drawing marks an area as needing update, so only tiles touched by a change are re-rendered.
+ When the cache holds more tiles than its limit, tiles at other scales are discarded first, then the least recently used ones. Tiles rendered
+ while the drawing quality was lowered are rendered again once it is back to full.
+
+ A cache can also hold the content of a single layer rather than the whole drawing, as object layers use to cache themselves when inactive.
+*/
+@interface DKDrawingTileCache : NSObject <DKPurgeableCache> {
+@private
+	NSMutableDictionary* mLevels; // level key -> DKCachedTileLevel, of the tiles at one scale
+	DKLayer* mLayerRef; // the layer whose content is cached, or nil for the whole drawing
+	NSUInteger mTileCount;
+	NSUInteger mMaximumTileCount;
+	NSUInteger mUseCounter;
+	NSUInteger mHits;
+	NSUInteger mMisses;
+	NSRect mRenderingTileRect;
+	BOOL mRenderingTile;
+	DKDrawingView* mRenderingViewRef; // the view the tile being rendered is for
+}
+
+- (id)initWithMaximumTileCount:(NSUInteger)maxTiles;
+
+/** @brief Initialises a cache of the content of one layer
+
+ The layer's tiles are rendered by calling its -drawRect:inView: with a nil view, which must draw all of its content in the rect.
+ @param layer the layer, which isn't retained
+ @param maxTiles the most tiles to keep
+ @return the cache
+ */
+- (id)initWithLayer:(DKLayer*)layer maximumTileCount:(NSUInteger)maxTiles;
+- (DKLayer*)layer;
+
+/** @brief Draws the area <rect> of the view's drawing, using cached tiles where possible and rendering any that are missing
+ @param rect the area to draw, in drawing coordinates
+ @param aView the view being drawn
+ */
+- (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView;
+
+/** @brief Discards all tiles, at every scale, that intersect <rect>
+ @param rect an area of the drawing
+ */
+- (void)invalidateRect:(NSRect)rect;
+- (void)invalidateAll;
+
+/** @brief Whether a tile is being rendered, and if so, the area it covers
+
+ While a tile is being rendered, the view reports the tile's rect as the area needing drawing, so that all objects on the tile are drawn and
+ not just those in the view's current update region.
+ */
+- (BOOL)isRenderingTile;
+- (NSRect)renderingTileRect;
+
+/** @brief Whether a tile is being rendered for <aView>
+
+ Since the cache may be shared by several views, a view asks about itself.
+ @param aView a view
+ @return YES if a tile is being rendered for the view
+ */
+- (BOOL)isRenderingTileForView:(DKDrawingView*)aView;
+
+- (NSUInteger)maximumTileCount;
+- (void)setMaximumTileCount:(NSUInteger)maxTiles;
+- (NSUInteger)tileCount;
+
+/** @brief The approximate memory used by the tiles
+ @return the size of the tiles' layers, in bytes
+ */
+- (NSUInteger)bytesUsed;
+
+- (NSUInteger)hits;
+- (NSUInteger)misses;
+- (void)resetStatistics;
+
+@end
+
+#define kDKDrawingTileSize 256.0
+#define kDKDrawingTileScaleResolution 1.0e-4 // scales closer than this share their tiles
+#define kDKDrawingTileCacheDefaultMaximum 384
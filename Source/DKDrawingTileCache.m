@@ -0,0 +1,424 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawingTileCache.h"
+#import "DKDrawingView.h"
+#import "DKDrawing.h"
+#import "DKStyle.h"
+#import "DKQuartzCache.h"
+#import "DKRenderStatistics.h"
+#import "LogEvent.h"
+
+/// a single cached tile
+
+@interface DKCachedTile : NSObject {
+@public
+	DKQuartzCache* mCache;
+	NSUInteger mLastUse;
+	BOOL mDegraded; // rendered at less than full quality
+}
+
+@end
+
+@implementation DKCachedTile
+
+- (void)dealloc
+{
+	[mCache release];
+	[super dealloc];
+}
+
+@end
+
+/// the tiles at one scale
+
+@interface DKCachedTileLevel : NSObject {
+@public
+	NSMutableDictionary* mTiles; // "col:row" -> DKCachedTile
+	CGFloat mScale; // the scale the tiles were rendered at
+}
+
+@end
+
+@implementation DKCachedTileLevel
+
+- (void)dealloc
+{
+	[mTiles release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+static inline NSString* keyForTile(NSInteger col, NSInteger row)
+{
+	return [NSString stringWithFormat:@"%ld:%ld", (long)col, (long)row];
+}
+
+static inline BOOL isDrawingDegraded(DKDrawing* drawing)
+{
+	return [drawing lowRenderingQuality] || [DKStyle drawingQualityTier] != kDKDrawingQualityFull;
+}
+
+// views whose scales round to the same value, on screens of the same backing scale, draw the same tiles, unless one of them draws
+// outlines only
+
+static inline CGFloat bucketedScale(CGFloat scale)
+{
+	return round(scale / kDKDrawingTileScaleResolution) * kDKDrawingTileScaleResolution;
+}
+
+static NSString* levelKeyForView(DKDrawingView* aView, CGFloat scale)
+{
+	NSWindow* window = [aView window];
+	CGFloat backing = window ? [window backingScaleFactor] : 1.0;
+
+	return [NSString stringWithFormat:@"%g@%gx%@", scale, backing, [aView drawsOutlinesOnly] ? @"o" : @""];
+}
+
+@interface DKDrawingTileCache (Private)
+
+- (void)removeTilesFromLevel:(NSMutableDictionary*)tiles inRect:(NSRect)rect scale:(CGFloat)scale;
+- (void)evictTilesKeepingLevel:(NSString*)levelKey;
+
+@end
+
+#pragma mark -
+
+@implementation DKDrawingTileCache
+
+- (id)initWithMaximumTileCount:(NSUInteger)maxTiles
+{
+	self = [super init];
+	if (self) {
+		mLevels = [[NSMutableDictionary alloc] init];
+		mMaximumTileCount = MAX(maxTiles, 1U);
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeRenderedImages];
+	}
+
+	return self;
+}
+
+- (id)initWithLayer:(DKLayer*)layer maximumTileCount:(NSUInteger)maxTiles
+{
+	self = [self initWithMaximumTileCount:maxTiles];
+	if (self)
+		mLayerRef = layer;
+
+	return self;
+}
+
+- (DKLayer*)layer
+{
+	return mLayerRef;
+}
+
+- (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView
+{
+	CGFloat scale = bucketedScale([aView scale]);
+	CGFloat tileSize = kDKDrawingTileSize / scale;
+	NSString* levelKey = levelKeyForView(aView, scale);
+	DKCachedTileLevel* level = [mLevels objectForKey:levelKey];
+	NSRect bounds = [aView bounds];
+
+	if (level == nil) {
+		level = [[DKCachedTileLevel alloc] init];
+		level->mTiles = [[NSMutableDictionary alloc] init];
+		level->mScale = scale;
+		[mLevels setObject:level
+					forKey:levelKey];
+		[level release];
+	}
+
+	NSMutableDictionary* tiles = level->mTiles;
+
+	rect = NSIntersectionRect(rect, bounds);
+
+	if (NSIsEmptyRect(rect))
+		return;
+
+	NSInteger firstCol = (NSInteger)floor(NSMinX(rect) / tileSize);
+	NSInteger lastCol = (NSInteger)ceil(NSMaxX(rect) / tileSize);
+	NSInteger firstRow = (NSInteger)floor(NSMinY(rect) / tileSize);
+	NSInteger lastRow = (NSInteger)ceil(NSMaxY(rect) / tileSize);
+	NSInteger col, row;
+	DKDrawing* drawing = mLayerRef ? [mLayerRef drawing] : [aView drawing];
+	BOOL degraded = isDrawingDegraded(drawing);
+
+	for (row = firstRow; row < lastRow; ++row) {
+		for (col = firstCol; col < lastCol; ++col) {
+			NSRect tileRect = NSMakeRect(col * tileSize, row * tileSize, tileSize, tileSize);
+
+			if (![aView needsToDrawRect:tileRect])
+				continue;
+
+			NSString* key = keyForTile(col, row);
+			DKCachedTile* tile = [tiles objectForKey:key];
+
+			if (tile != nil && tile->mDegraded && !degraded) {
+				[tiles removeObjectForKey:key];
+				--mTileCount;
+				tile = nil;
+			}
+
+			if (tile == nil) {
+				// render the tile. The cache is created from the view's context so it's device-compatible, and the tile is drawn at the view's scale.
+
+				tile = [[DKCachedTile alloc] init];
+				tile->mCache = [[DKQuartzCache alloc] initWithContext:[NSGraphicsContext currentContext]
+															  forRect:NSMakeRect(0, 0, kDKDrawingTileSize, kDKDrawingTileSize)];
+				[tile->mCache lockFocus];
+
+				NSAffineTransform* transform = [NSAffineTransform transform];
+				[transform scaleBy:scale];
+				[transform translateXBy:-NSMinX(tileRect)
+									yBy:-NSMinY(tileRect)];
+				[transform concat];
+
+				mRenderingTileRect = tileRect;
+				mRenderingTile = YES;
+				mRenderingViewRef = aView;
+
+				if (mLayerRef) {
+					if ([mLayerRef clipsDrawingToInterior])
+						[NSBezierPath clipRect:[drawing interior]];
+
+					[mLayerRef beginDrawing];
+					[mLayerRef drawRect:tileRect
+								 inView:nil];
+					[mLayerRef endDrawing];
+				} else
+					[drawing drawRect:tileRect
+							   inView:aView];
+
+				mRenderingTile = NO;
+				mRenderingViewRef = nil;
+				[tile->mCache unlockFocus];
+
+				// the drawing may have lowered its quality as it drew
+
+				tile->mDegraded = isDrawingDegraded(drawing);
+
+				[tiles setObject:tile
+						  forKey:key];
+				[tile release];
+
+				++mTileCount;
+				++mMisses;
+				DKRenderRecordCacheLookup(self, NO);
+			} else {
+				++mHits;
+				DKRenderRecordCacheLookup(self, YES);
+			}
+
+			tile->mLastUse = ++mUseCounter;
+			[tile->mCache drawInRect:tileRect];
+		}
+	}
+
+	if (mTileCount > mMaximumTileCount)
+		[self evictTilesKeepingLevel:levelKey];
+}
+
+- (void)invalidateRect:(NSRect)rect
+{
+	// invalidates a slightly larger area to allow for antialiasing at the edges of the changed area
+
+	NSEnumerator* iter = [mLevels objectEnumerator];
+	DKCachedTileLevel* level;
+
+	while ((level = [iter nextObject])) {
+		CGFloat scale = level->mScale;
+
+		[self removeTilesFromLevel:level->mTiles
+							inRect:NSInsetRect(rect, -1.0 / scale, -1.0 / scale)
+							 scale:scale];
+	}
+}
+
+- (void)invalidateAll
+{
+	[mLevels removeAllObjects];
+	mTileCount = 0;
+}
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	// the layer draws directly until the tiles are rendered again
+
+	[self invalidateAll];
+	return 0;
+}
+
+- (BOOL)isRenderingTile
+{
+	return mRenderingTile;
+}
+
+- (NSRect)renderingTileRect
+{
+	return mRenderingTileRect;
+}
+
+- (BOOL)isRenderingTileForView:(DKDrawingView*)aView
+{
+	return mRenderingTile && mRenderingViewRef == aView;
+}
+
+- (NSUInteger)maximumTileCount
+{
+	return mMaximumTileCount;
+}
+
+- (void)setMaximumTileCount:(NSUInteger)maxTiles
+{
+	mMaximumTileCount = MAX(maxTiles, 1U);
+
+	if (mTileCount > mMaximumTileCount)
+		[self evictTilesKeepingLevel:nil];
+}
+
+- (NSUInteger)tileCount
+{
+	return mTileCount;
+}
+
+- (NSUInteger)bytesUsed
+{
+	NSEnumerator* iter = [mLevels objectEnumerator];
+	DKCachedTileLevel* level;
+	NSUInteger bytes = 0;
+
+	while ((level = [iter nextObject])) {
+		NSEnumerator* tileIter = [level->mTiles objectEnumerator];
+		DKCachedTile* tile;
+
+		while ((tile = [tileIter nextObject]))
+			bytes += [tile->mCache bytesUsed];
+	}
+
+	return bytes;
+}
+
+- (NSUInteger)hits
+{
+	return mHits;
+}
+
+- (NSUInteger)misses
+{
+	return mMisses;
+}
+
+- (void)resetStatistics
+{
+	mHits = mMisses = 0;
+}
+
+#pragma mark -
+
+- (void)removeTilesFromLevel:(NSMutableDictionary*)tiles inRect:(NSRect)rect scale:(CGFloat)scale
+{
+	CGFloat tileSize = kDKDrawingTileSize / scale;
+	NSInteger firstCol = (NSInteger)floor(NSMinX(rect) / tileSize);
+	NSInteger lastCol = (NSInteger)ceil(NSMaxX(rect) / tileSize);
+	NSInteger firstRow = (NSInteger)floor(NSMinY(rect) / tileSize);
+	NSInteger lastRow = (NSInteger)ceil(NSMaxY(rect) / tileSize);
+	NSInteger col, row;
+
+	if ((NSUInteger)((lastCol - firstCol) * (lastRow - firstRow)) > [tiles count]) {
+		// the area covers more tiles than are cached, so it's quicker to test each cached tile
+
+		NSEnumerator* iter = [[tiles allKeys] objectEnumerator];
+		NSString* key;
+
+		while ((key = [iter nextObject])) {
+			NSArray* parts = [key componentsSeparatedByString:@":"];
+			col = [[parts objectAtIndex:0] integerValue];
+			row = [[parts objectAtIndex:1] integerValue];
+
+			if (col >= firstCol && col < lastCol && row >= firstRow && row < lastRow) {
+				[tiles removeObjectForKey:key];
+				--mTileCount;
+			}
+		}
+	} else {
+		for (row = firstRow; row < lastRow; ++row) {
+			for (col = firstCol; col < lastCol; ++col) {
+				NSString* key = keyForTile(col, row);
+
+				if ([tiles objectForKey:key]) {
+					[tiles removeObjectForKey:key];
+					--mTileCount;
+				}
+			}
+		}
+	}
+}
+
+- (void)evictTilesKeepingLevel:(NSString*)levelKey
+{
+	// first discard the tiles for all other scales
+
+	NSEnumerator* iter = [[mLevels allKeys] objectEnumerator];
+	NSString* key;
+
+	while ((key = [iter nextObject]) && mTileCount > mMaximumTileCount) {
+		if (![key isEqualToString:levelKey]) {
+			mTileCount -= [((DKCachedTileLevel*)[mLevels objectForKey:key])->mTiles count];
+			[mLevels removeObjectForKey:key];
+		}
+	}
+
+	// then the least recently used tiles at the current scale
+
+	DKCachedTileLevel* level = levelKey ? [mLevels objectForKey:levelKey] : nil;
+	NSMutableDictionary* tiles = level ? level->mTiles : nil;
+
+	while (tiles && mTileCount > mMaximumTileCount) {
+		NSEnumerator* tileIter = [tiles keyEnumerator];
+		NSString* tileKey;
+		NSString* oldestKey = nil;
+		NSUInteger oldest = NSUIntegerMax;
+
+		while ((tileKey = [tileIter nextObject])) {
+			DKCachedTile* tile = [tiles objectForKey:tileKey];
+
+			if (tile->mLastUse < oldest) {
+				oldest = tile->mLastUse;
+				oldestKey = tileKey;
+			}
+		}
+
+		if (oldestKey == nil)
+			break;
+
+		[tiles removeObjectForKey:oldestKey];
+		--mTileCount;
+	}
+
+	LogEvent_(kInfoEvent, @"tile cache evicted down to %lu tiles", (unsigned long)mTileCount);
+}
+
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (id)init
+{
+	return [self initWithMaximumTileCount:kDKDrawingTileCacheDefaultMaximum];
+}
+
+- (void)dealloc
+{
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
+	[mLevels release];
+	[super dealloc];
+}
+
+@end
@@ -442,6 +442,11 @@ NSString* kDKDrawingToolUserDefaultsKey = @"DK_DrawingTool_Defaults";
 	mKeyboardEquivalent = str;
 
 	mKeyboardModifiers = flags;
+
+	// registries index the equivalents of their tools
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKDrawingToolKeyboardEquivalentDidChangeNotification
+														object:self];
 }
 
 /** @brief Return the keyboard equivalent character can be used to select this tool
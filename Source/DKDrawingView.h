@@ -5,8 +5,9 @@
 */
 
 #import "GCZoomView.h"
+#import "DKCommonTypes.h"
 
-@class DKDrawing, DKLayer, DKViewController;
+@class DKDrawing, DKLayer, DKViewController, DKDrawingTileCache, DKRetriggerableTimer, DKQuartzCache, DKDrawableObject;
 
 typedef enum {
 	DKCropMarksNone = 0,
@@ -43,15 +44,38 @@ typedef enum {
 	NSRect mEditorFrame; /**< tracks current frame of text editor */
 	NSTimeInterval mLastMouseDragTime; /**< time of last mouseDragged: event */
 	NSDictionary* mRulerMarkersDict; /**< tracks ruler markers */
+	BOOL mUsesTiledRendering; /**< YES if the view draws from the drawing's tile cache */
+	NSRect mTileRenderRect; /**< the tile being rendered, returned by -getRectsBeingDrawn:count: */
+	DKDrawingQualityTier mQualityTier; /**< the quality tier the view is currently drawing at */
+	NSTimeInterval mFrameTimeBudget; /**< the time an interactive update should take, or 0 for the default */
+	BOOL mFixedDrawingQuality; /**< YES if the view always draws at full quality */
+	DKRetriggerableTimer* mQualityTimer; /**< restores full quality once interactive updates stop */
+	BOOL mUsesStaticSnapshot; /**< YES while drawing from a snapshot of the static content */
+	BOOL mRenderingStaticSnapshot; /**< YES while the snapshot is being rendered */
+	DKDrawableObject* mStaticSnapshotObject; /**< the object left out of the snapshot and drawn live */
+	DKQuartzCache* mStaticSnapshot; /**< the static content, or nil if not yet captured */
+	NSRect mStaticSnapshotRect; /**< the area the snapshot covers */
+	CGFloat mStaticSnapshotScale; /**< the view's scale when the snapshot was captured */
+	BOOL mDrawsOutlinesOnly; /**< YES if objects are drawn as plain outlines */
+	NSMutableDictionary* mPendingRulerMarkers; /**< marker locations waiting for the next display refresh, by marker name */
+	NSPoint mPendingRulerMousePoint; /**< the mouse location the ruler lines are to be moved to at the next display refresh */
 }
 
 /** @brief Return the view currently drawing
 
  This is only valid during a drawRect: call - some internal parts of DK use this to obtain the
- view doing the drawing when they do not have a direct parameter to it.
+ view doing the drawing when they do not have a direct parameter to it. Each thread has its own current view.
  @return the current view that is drawing
  */
 + (DKDrawingView*)currentlyDrawingView;
+
+/** @brief Makes a view the current view on this thread, until the matching +pop
+
+ A view does this for itself while it draws. Code rendering for a view on another thread can do the same, so that objects drawn
+ there see the view's scale.
+ @param aView the view
+ */
++ (void)pushCurrentViewAndSet:(DKDrawingView*)aView;
 + (void)pop;
 
 /** @brief Set the colour used to draw the page breaks
@@ -266,7 +290,9 @@ typedef enum {
 
 /** @brief Set a ruler marker to a given position
 
- Generally called from the view's controller
+ Generally called from the view's controller. The marker is moved at the next display refresh, to the
+ last location given by then, so however often it's called the ruler redraws the marker at most once
+ per refresh.
  @param markerName the name of the marker to move
  @param loc a position value to move the ruler marker to
  */
@@ -290,11 +316,128 @@ typedef enum {
 
 /** @brief Set the ruler lines to the current mouse point
 
+ As for ruler markers, the lines are moved at the next display refresh.
  N.b. on 10.4 and earlier, there is a bug in NSRulerView that prevents both h and v ruler lines
  showing up correctly at the same time. No workaround is known. Fixed in 10.5+
  @param mouse the current mouse poin tin local coordinates */
 - (void)updateRulerMouseTracking:(NSPoint)mouse;
 
+// tiled rendering
+
+/** @brief Sets whether the view caches the rendered drawing as tiles
+
+ When enabled, the drawing's content is rendered into a grid of cached tiles at the current scale, and the view is redrawn by compositing
+ the tiles rather than re-rendering every visible object. Only tiles touched by an area the drawing marks as needing update are re-rendered,
+ so scrolling around a large, complex drawing is much cheaper. Anything the controller draws on top (e.g. tool feedback) and the page breaks
+ are drawn directly as normal. Tiles are not used while printing or during a live zoom. The tiles are kept by the drawing (see
+ -[DKDrawing tileCache]), so other views of it at the same scale draw from the same ones. Default is NO.
+ @param tiled YES to enable tiled rendering, NO to render directly
+ */
+- (void)setUsesTiledRendering:(BOOL)tiled;
+
+/** @brief Whether the view caches the rendered drawing as tiles
+ @return YES if tiled rendering is enabled
+ */
+- (BOOL)usesTiledRendering;
+
+/** @brief The tile cache used for tiled rendering
+ @return the drawing's tile cache, or nil if tiled rendering is not enabled
+ */
+- (DKDrawingTileCache*)tileCache;
+
+/** @brief Discards any cached tiles that intersect <rect>
+
+ The drawing does this itself when it marks an area as needing update. If you draw content in the drawing pass that changes without the
+ drawing being notified, call this to ensure it is re-rendered - since the tiles are shared, the other views of the drawing re-render
+ it too.
+ @param rect an area of the drawing
+ */
+- (void)invalidateCachedTilesInRect:(NSRect)rect;
+- (void)invalidateAllCachedTiles;
+
+/** @brief Whether the content now being drawn leaves out the layers' overlays, such as the selection
+
+ YES while a tile is rendered, since the view draws the overlays over the tiles (see -[DKLayer drawOverlayRect:inView:]). That way
+ selecting objects only redraws the selection rather than the content under it.
+ @return YES if layers should leave their overlays out of their content
+ */
+- (BOOL)drawsSelectionAsOverlay;
+
+// drawing outlines only
+
+/** @brief Sets whether the view draws every object as a plain outline, for finding one's way around very large drawings
+
+ Each object layer adds the outlines of the objects it draws to one path (see -[DKDrawableObject addOutlineToPath:]) and strokes it
+ once with a black hairline, so no style is rendered - text is shown by its bounds. The selection, the tools and layers other than
+ object layers are drawn as usual. Only drawing to the screen is affected, until this is turned off again. Default is NO.
+ @param outlines YES to draw outlines only, NO to draw the objects' styles
+ */
+- (void)setDrawsOutlinesOnly:(BOOL)outlines;
+- (BOOL)drawsOutlinesOnly;
+
+// interactive drawing quality
+
+/** @brief Sets whether the view lowers drawing quality to keep interactive updates fast
+
+ While the user is dragging or the view is zooming, each update is timed. If one takes longer than the frame time budget, the next
+ is drawn at a lower quality tier - first without shadows and with simplified hatching, patterns and text, then also without
+ anti-aliasing. Once interactive updates stop, full quality is restored and the view redrawn. Default is YES.
+ @param adapts YES to adapt the quality, NO to always draw at full quality
+ */
+- (void)setAdaptsDrawingQuality:(BOOL)adapts;
+
+/** @brief Whether the view lowers drawing quality to keep interactive updates fast
+ @return YES if the quality adapts
+ */
+- (BOOL)adaptsDrawingQuality;
+
+/** @brief Sets the time an interactive update should take
+
+ The default is kDKDrawingViewDefaultFrameTimeBudget, which is about one frame at 60 fps.
+ @param budget the time in seconds, or 0 to use the default
+ */
+- (void)setFrameTimeBudget:(NSTimeInterval)budget;
+
+/** @brief The time an interactive update should take
+ @return the time in seconds
+ */
+- (NSTimeInterval)frameTimeBudget;
+
+/** @brief The quality tier the view is currently drawing at
+
+ This is kDKDrawingQualityFull except while quality has been lowered during interactive updates.
+ @return the quality tier
+ */
+- (DKDrawingQualityTier)drawingQualityTier;
+
+// static content snapshot
+
+/** @brief Starts drawing the view from a snapshot of everything except one object
+
+ Used by DKToolController while a tool is tracking the mouse. The next time the view draws, all of its visible content other than
+ <anObject> is captured at the view's scale; from then on each update blits the snapshot and draws only <anObject> live on top, along
+ with anything the controller draws. The snapshot is recaptured if the view scrolls or zooms beyond it. Changes to other objects are not
+ seen until -endStaticContentSnapshot, and <anObject> is drawn above everything while the snapshot is in use. Only drawing to the
+ screen uses the snapshot.
+ @param anObject the object being edited, or nil to snapshot all of the content
+ */
+- (void)beginStaticContentSnapshotExcludingObject:(DKDrawableObject*)anObject;
+
+/** @brief Discards the snapshot and returns to drawing the content normally
+
+ The area of the object that was drawn live is redrawn so that it is restored to its place in the stacking order.
+ */
+- (void)endStaticContentSnapshot;
+- (BOOL)isUsingStaticContentSnapshot;
+
+/** @brief The object to leave out of the drawing
+
+ Layers consult this as they draw into the view, and skip the object it returns. It is only non-nil while the snapshot is being
+ captured.
+ @return the object being drawn live, or nil
+ */
+- (DKDrawableObject*)staticContentExcludedObject;
+
 // user actions
 
 /** @brief Show or hide the ruler.
@@ -340,3 +483,6 @@ extern NSString* kDKDrawingViewHorizontalRightMarkerName;
 extern NSString* kDKDrawingViewVerticalTopMarkerName;
 extern NSString* kDKDrawingViewVerticalCentreMarkerName;
 extern NSString* kDKDrawingViewVerticalBottomMarkerName;
+
+#define kDKDrawingViewDefaultFrameTimeBudget 0.016
+#define kDKDrawingViewQualityRestoreDelay 0.25
@@ -7,11 +7,19 @@
 #import "DKDrawingView.h"
 #import "DKToolController.h"
 #import "DKDrawing.h"
+#import "DKDrawingTileCache.h"
+#import "DKDrawKitMacros.h"
+#import "DKObjectDrawingLayer.h"
+#import "DKQuartzCache.h"
 #import "DKGridLayer.h"
+#import "DKRenderStatistics.h"
+#import "DKRetriggerableTimer.h"
+#import "DKStyle.h"
 #import "GCThreadQueue.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 #import "NSBezierPath+Shapes.h"
 #import "NSColor+DKAdditions.h"
+#import "DKFeedbackScheduler.h"
 #include <tgmath.h>
 
 #pragma mark Constants(Non - localized)
@@ -42,7 +50,7 @@ NSString* kDKDrawingViewVerticalBottomMarkerName = @"marker_v_bottom";
 
 #pragma mark Static Vars
 
-static NSMutableArray* sDrawingViewStack = nil; // stack of view refs
+static NSString* kDKDrawingViewStackThreadKey = @"DKDrawingViewStack"; // stack of view refs, kept per thread
 static NSColor* sPageBreakColour = nil;
 static NSPoint sLastContextMenuClick = { 0, 0 };
 
@@ -61,7 +69,6 @@ NSString* kDKTextEditorUndoesTypingPrefsKey = @"kDKTextEditorUndoesTyping";
  @param event the event associated with this
  */
 - (void)postMouseLocationInfo:(NSString*)operation event:(NSEvent*)event;
-+ (void)pushCurrentViewAndSet:(DKDrawingView*)aView;
 
 /** @brief Store the local rule marker info.
 
@@ -77,6 +84,29 @@ NSString* kDKTextEditorUndoesTypingPrefsKey = @"kDKTextEditorUndoesTyping";
  */
 - (NSDictionary*)rulerMarkerInfo;
 
+/** @brief Whether the view is being updated interactively, i.e. the user is dragging or the view is zooming
+ @return YES if updating interactively
+ */
+- (BOOL)isUpdatingInteractively;
+
+/** @brief Raises or lowers the quality tier following an update that took <frameTime> to draw
+ @param frameTime the time the update took
+ */
+- (void)adjustDrawingQualityForFrameTime:(NSTimeInterval)frameTime;
+- (void)qualityTimerDidIdle:(id)sender;
+
+/** @brief Draws <rect> from the static content snapshot, capturing it first if needed
+ @param rect the area being drawn
+ @return YES if the area was drawn, NO if it lies outside the view's visible area and must be drawn normally
+ */
+- (BOOL)drawStaticContentSnapshotInRect:(NSRect)rect;
+- (void)captureStaticContentSnapshot;
+
+/** @brief Moves the ruler markers and lines to where they were last set, once per display refresh
+ */
+- (void)updatePendingRulerMarkers;
+- (void)updatePendingRulerMouseTracking;
+
 @end
 
 #pragma mark -
@@ -91,25 +121,34 @@ NSString* kDKTextEditorUndoesTypingPrefsKey = @"kDKTextEditorUndoesTyping";
  */
 + (DKDrawingView*)currentlyDrawingView
 {
-	return [sDrawingViewStack lastObject];
+	// the stack is per thread, so that a drawing rendered on another thread never sees a view drawing on the main thread
+
+	return [[[[NSThread currentThread] threadDictionary] objectForKey:kDKDrawingViewStackThreadKey] lastObject];
 }
 
 + (void)pushCurrentViewAndSet:(DKDrawingView*)aView
 {
-	if (sDrawingViewStack == nil)
-		sDrawingViewStack = [[NSMutableArray alloc] init];
+	NSMutableDictionary* threadInfo = [[NSThread currentThread] threadDictionary];
+	NSMutableArray* stack = [threadInfo objectForKey:kDKDrawingViewStackThreadKey];
+
+	if (stack == nil) {
+		stack = [NSMutableArray array];
+		[threadInfo setObject:stack
+					   forKey:kDKDrawingViewStackThreadKey];
+	}
 
 	//NSLog(@"pushing %@; setting %@", [self currentlyDrawingView], aView);
 
-	[sDrawingViewStack addObject:aView];
+	[stack addObject:aView];
 }
 
 + (void)pop
 {
-	NSUInteger stackSize = [sDrawingViewStack count];
+	NSMutableArray* stack = [[[NSThread currentThread] threadDictionary] objectForKey:kDKDrawingViewStackThreadKey];
+	NSUInteger stackSize = [stack count];
 
 	if (stackSize > 0)
-		[sDrawingViewStack removeObjectAtIndex:stackSize - 1];
+		[stack removeObjectAtIndex:stackSize - 1];
 
 	//NSLog(@"popping %@", [self currentlyDrawingView]);
 }
@@ -266,7 +305,7 @@ static Class s_textEditorClass = Nil;
 {
 	NSSize viewSize = [self bounds].size;
 
-	LogEvent_(kReactiveEvent, @"View automatically instantiating a drawing (size = %@)", NSStringFromSize(viewSize));
+	DKTrace_(kDKTraceReactive, @"View automatically instantiating a drawing (size = %@)", NSStringFromSize(viewSize));
 
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKDrawingViewWillCreateAutoDrawing
 														object:self];
@@ -609,7 +648,7 @@ static Class s_textEditorClass = Nil;
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKDrawingViewDidBeginTextEditing
 														object:self];
 
-	LogEvent_(kReactiveEvent, @"View began text editing, text editor = %@", m_textEditViewRef);
+	DKTrace_(kDKTraceReactive, @"View began text editing, text editor = %@", m_textEditViewRef);
 
 	mTextEditViewInUse = YES;
 
@@ -702,14 +741,26 @@ static Class s_textEditorClass = Nil;
 
 /** @brief Set the ruler lines to the current mouse point
 
+ As for ruler markers, the lines are moved at the next display refresh.
  N.b. on 10.4 and earlier, there is a bug in NSRulerView that prevents both h and v ruler lines
  showing up correctly at the same time. No workaround is known. Fixed in 10.5+
  @param mouse the current mouse poin tin local coordinates */
 - (void)updateRulerMouseTracking:(NSPoint)mouse
 {
-	// updates the mouse tracking marks on the rulers, if they are visible. Note that the point parameter is the location in the view's window
+	// the lines are moved at the next display refresh, to the last point given by then
+
+	mPendingRulerMousePoint = mouse;
+
+	[[DKFeedbackScheduler sharedScheduler] scheduleUpdateForTarget:self
+														  selector:@selector(updatePendingRulerMouseTracking)];
+}
+
+- (void)updatePendingRulerMouseTracking
+{
+	// updates the mouse tracking marks on the rulers, if they are visible. Note that the point is the location in the view's window
 	// as obtained from an event - not the location in the drawing or view.
 
+	NSPoint mouse = mPendingRulerMousePoint;
 	static CGFloat ox = -1.0;
 	static CGFloat oy = -1.0;
 
@@ -742,7 +793,9 @@ static Class s_textEditorClass = Nil;
 
 /** @brief Set a ruler marker to a given position
 
- Generally called from the view's controller
+ Generally called from the view's controller. The marker is moved at the next display refresh, to the
+ last location given by then, so however often it's called the ruler redraws the marker at most once
+ per refresh.
  @param markerName the name of the marker to move
  @param loc a position value to move the ruler marker to
  */
@@ -750,15 +803,50 @@ static Class s_textEditorClass = Nil;
 {
 	NSScrollView* sv = [self enclosingScrollView];
 
-	if (sv && [sv rulersVisible]) {
+	if (sv && [sv rulersVisible] && markerName != nil) {
+		if (mPendingRulerMarkers == nil)
+			mPendingRulerMarkers = [[NSMutableDictionary alloc] init];
+
+		[mPendingRulerMarkers setObject:[NSNumber numberWithDouble:loc]
+								 forKey:markerName];
+
+		[[DKFeedbackScheduler sharedScheduler] scheduleUpdateForTarget:self
+															  selector:@selector(updatePendingRulerMarkers)];
+	}
+}
+
+- (void)updatePendingRulerMarkers
+{
+	// only the strip of the ruler under each moved marker is redrawn, where it was and where it is now
+
+	NSEnumerator* iter = [mPendingRulerMarkers keyEnumerator];
+	NSString* markerName;
+
+	while ((markerName = [iter nextObject])) {
 		NSRulerMarker* marker = [[self rulerMarkerInfo] objectForKey:markerName];
-		if (loc != [marker markerLocation]) {
+		CGFloat loc = [[mPendingRulerMarkers objectForKey:markerName] doubleValue];
+
+		if (marker != nil && loc != [marker markerLocation]) {
 			NSRulerView* rv = [marker ruler];
-			[rv setNeedsDisplayInRect:[marker imageRectInRuler]];
+			NSRect oldRect = [marker imageRectInRuler];
+
+			NSRect newRect;
+
 			[marker setMarkerLocation:loc];
-			[rv setNeedsDisplayInRect:[marker imageRectInRuler]];
+			newRect = [marker imageRectInRuler];
+
+			// a small move is one strip; a jump is two, rather than everything in between
+
+			if (NSIntersectsRect(oldRect, newRect))
+				[rv setNeedsDisplayInRect:NSUnionRect(oldRect, newRect)];
+			else {
+				[rv setNeedsDisplayInRect:oldRect];
+				[rv setNeedsDisplayInRect:newRect];
+			}
 		}
 	}
+
+	[mPendingRulerMarkers removeAllObjects];
 }
 
 /** @brief Set up the markers for the rulers.
@@ -959,9 +1047,302 @@ static Class s_textEditorClass = Nil;
 	else
 		[[self enclosingScrollView] setBackgroundColor:[NSColor veryLightGrey]];
 
+	[self invalidateAllCachedTiles];
 	[self setNeedsDisplay:YES];
 }
 
+#pragma mark -
+#pragma mark - tiled rendering
+
+/** @brief Sets whether the view caches the rendered drawing as tiles
+ @param tiled YES to enable tiled rendering, NO to render directly
+ */
+- (void)setUsesTiledRendering:(BOOL)tiled
+{
+	if (tiled != mUsesTiledRendering) {
+		mUsesTiledRendering = tiled;
+		[self setNeedsDisplay:YES];
+	}
+}
+
+/** @brief Whether the view caches the rendered drawing as tiles
+ @return YES if tiled rendering is enabled
+ */
+- (BOOL)usesTiledRendering
+{
+	return mUsesTiledRendering;
+}
+
+/** @brief The tile cache used for tiled rendering
+ @return the tile cache, or nil
+ */
+- (DKDrawingTileCache*)tileCache
+{
+	return mUsesTiledRendering ? [[self drawing] tileCache] : nil;
+}
+
+/** @brief Discards any cached tiles that intersect <rect>
+ @param rect an area of the drawing
+ */
+- (void)invalidateCachedTilesInRect:(NSRect)rect
+{
+	[[self tileCache] invalidateRect:rect];
+}
+
+/** @brief Discards all cached tiles
+ */
+- (void)invalidateAllCachedTiles
+{
+	[[self tileCache] invalidateAll];
+}
+
+- (BOOL)drawsSelectionAsOverlay
+{
+	return [[self tileCache] isRenderingTileForView:self];
+}
+
+#pragma mark -
+#pragma mark - drawing outlines only
+
+/** @brief Sets whether the view draws every object as a plain outline
+ @param outlines YES to draw outlines only, NO to draw the objects' styles
+ */
+- (void)setDrawsOutlinesOnly:(BOOL)outlines
+{
+	if (outlines != mDrawsOutlinesOnly) {
+		mDrawsOutlinesOnly = outlines;
+
+		// the tiles of outlines are kept apart from the others, but any snapshot holds the content as it was drawn before
+
+		[mStaticSnapshot release];
+		mStaticSnapshot = nil;
+		[self setNeedsDisplay:YES];
+	}
+}
+
+- (BOOL)drawsOutlinesOnly
+{
+	return mDrawsOutlinesOnly;
+}
+
+#pragma mark -
+#pragma mark - interactive drawing quality
+
+/** @brief Sets whether the view lowers drawing quality to keep interactive updates fast
+ @param adapts YES to adapt the quality, NO to always draw at full quality
+ */
+- (void)setAdaptsDrawingQuality:(BOOL)adapts
+{
+	mFixedDrawingQuality = !adapts;
+
+	if (!adapts && mQualityTier != kDKDrawingQualityFull)
+		[self qualityTimerDidIdle:self];
+}
+
+/** @brief Whether the view lowers drawing quality to keep interactive updates fast
+ @return YES if the quality adapts
+ */
+- (BOOL)adaptsDrawingQuality
+{
+	return !mFixedDrawingQuality;
+}
+
+/** @brief Sets the time an interactive update should take
+ @param budget the time in seconds, or 0 to use the default
+ */
+- (void)setFrameTimeBudget:(NSTimeInterval)budget
+{
+	mFrameTimeBudget = MAX(budget, 0.0);
+}
+
+/** @brief The time an interactive update should take
+ @return the time in seconds
+ */
+- (NSTimeInterval)frameTimeBudget
+{
+	return mFrameTimeBudget > 0 ? mFrameTimeBudget : kDKDrawingViewDefaultFrameTimeBudget;
+}
+
+/** @brief The quality tier the view is currently drawing at
+ @return the quality tier
+ */
+- (DKDrawingQualityTier)drawingQualityTier
+{
+	return mQualityTier;
+}
+
+- (BOOL)isUpdatingInteractively
+{
+	return [self isChangingScale] || ([NSEvent pressedMouseButtons] & 1) != 0;
+}
+
+- (void)adjustDrawingQualityForFrameTime:(NSTimeInterval)frameTime
+{
+	// quality is only lowered for interactive updates. Once lowered it can come back up a tier if updates become much quicker than
+	// the budget, but the gap between the two thresholds stops the tier flipping back and forth on every update.
+
+	if (![self isUpdatingInteractively])
+		return;
+
+	NSTimeInterval budget = [self frameTimeBudget];
+
+	if (frameTime > budget && mQualityTier < kDKDrawingQualityDraft) {
+		++mQualityTier;
+		DKTrace_(kDKTraceInfo, @"update took %.1fms, lowering drawing quality to tier %d", frameTime * 1000.0, mQualityTier);
+	} else if (frameTime < budget * 0.25 && mQualityTier > kDKDrawingQualityFull)
+		--mQualityTier;
+
+	if (mQualityTier != kDKDrawingQualityFull) {
+		if (mQualityTimer == nil)
+			mQualityTimer = [[DKRetriggerableTimer retriggerableTimerWithPeriod:kDKDrawingViewQualityRestoreDelay
+																		 target:self
+																	   selector:@selector(qualityTimerDidIdle:)] retain];
+		[mQualityTimer retrigger];
+	}
+}
+
+- (void)qualityTimerDidIdle:(id)sender
+{
+	// if the mouse is still held down the user may just be pausing mid-drag, so wait a little longer
+
+	if (sender == mQualityTimer && [self isUpdatingInteractively]) {
+		[mQualityTimer retrigger];
+		return;
+	}
+
+	if (mQualityTier != kDKDrawingQualityFull) {
+		mQualityTier = kDKDrawingQualityFull;
+
+		// any tiles rendered meanwhile are at the lower quality
+
+		[self invalidateAllCachedTiles];
+		[self setNeedsDisplay:YES];
+	}
+}
+
+#pragma mark -
+#pragma mark - static content snapshot
+
+/** @brief Starts drawing the view from a snapshot of everything except one object
+ @param anObject the object being edited, or nil to snapshot all of the content
+ */
+- (void)beginStaticContentSnapshotExcludingObject:(DKDrawableObject*)anObject
+{
+	[self endStaticContentSnapshot];
+
+	mStaticSnapshotObject = [anObject retain];
+	mUsesStaticSnapshot = YES;
+}
+
+/** @brief Discards the snapshot and returns to drawing the content normally
+ */
+- (void)endStaticContentSnapshot
+{
+	if (!mUsesStaticSnapshot)
+		return;
+
+	// the live object was drawn over everything else - put it back into its place among its neighbours
+
+	if (mStaticSnapshotObject != nil)
+		[self setNeedsDisplayInRect:[mStaticSnapshotObject bounds]];
+
+	mUsesStaticSnapshot = NO;
+	[mStaticSnapshot release];
+	mStaticSnapshot = nil;
+	[mStaticSnapshotObject release];
+	mStaticSnapshotObject = nil;
+}
+
+- (BOOL)isUsingStaticContentSnapshot
+{
+	return mUsesStaticSnapshot;
+}
+
+/** @brief The object to leave out of the drawing
+ @return the object being drawn live, or nil
+ */
+- (DKDrawableObject*)staticContentExcludedObject
+{
+	return mRenderingStaticSnapshot ? mStaticSnapshotObject : nil;
+}
+
+- (BOOL)drawStaticContentSnapshotInRect:(NSRect)rect
+{
+	if (mStaticSnapshot == nil || [self scale] != mStaticSnapshotScale || !NSContainsRect(mStaticSnapshotRect, rect)) {
+		[mStaticSnapshot release];
+		mStaticSnapshot = nil;
+
+		if (!NSContainsRect([self visibleRect], rect))
+			return NO;
+
+		[self captureStaticContentSnapshot];
+	}
+
+	SAVE_GRAPHICS_CONTEXT
+
+	[NSBezierPath clipRect:rect];
+	[mStaticSnapshot drawInRect:mStaticSnapshotRect];
+
+	DKDrawableObject* obj = mStaticSnapshotObject;
+
+	if (obj != nil && [obj visible] && [self needsToDrawRect:[obj bounds]]) {
+		// a pending object is drawn selected, as its layer would draw it
+
+		DKObjectOwnerLayer* layer = (DKObjectOwnerLayer*)[obj layer];
+		BOOL selected = [layer pendingObject] == obj;
+
+		if (!selected && [layer isKindOfClass:[DKObjectDrawingLayer class]])
+			selected = [(DKObjectDrawingLayer*)layer isSelectedObject:obj] && [(DKObjectDrawingLayer*)layer selectionVisible];
+
+		if ([layer clipsDrawingToInterior])
+			[NSBezierPath clipRect:[[self drawing] interior]];
+
+		[obj drawContentWithSelectedState:selected];
+	}
+
+	RESTORE_GRAPHICS_CONTEXT
+
+	return YES;
+}
+
+- (void)captureStaticContentSnapshot
+{
+	// the snapshot covers the whole visible area at the view's scale, and is always rendered at full quality as it is drawn from for the
+	// rest of the drag
+
+	NSRect visible = [self visibleRect];
+	CGFloat scale = [self scale];
+	DKDrawingQualityTier tier = [DKStyle drawingQualityTier];
+
+	mStaticSnapshot = [[DKQuartzCache alloc] initWithContext:[NSGraphicsContext currentContext]
+													 forRect:NSMakeRect(0, 0, ceil(NSWidth(visible) * scale), ceil(NSHeight(visible) * scale))];
+	mStaticSnapshotRect = visible;
+	mStaticSnapshotScale = scale;
+
+	[mStaticSnapshot lockFocus];
+
+	NSAffineTransform* transform = [NSAffineTransform transform];
+	[transform scaleBy:scale];
+	[transform translateXBy:-NSMinX(visible)
+						yBy:-NSMinY(visible)];
+	[transform concat];
+
+	[DKStyle setDrawingQualityTier:kDKDrawingQualityFull];
+	mRenderingStaticSnapshot = YES;
+
+	@try
+	{
+		[[self drawing] drawRect:visible
+						  inView:self];
+	}
+	@finally
+	{
+		mRenderingStaticSnapshot = NO;
+		[DKStyle setDrawingQualityTier:tier];
+		[mStaticSnapshot unlockFocus];
+	}
+}
+
 #pragma mark -
 
 - (void)set
@@ -972,6 +1353,16 @@ static Class s_textEditorClass = Nil;
 	[[self class] pushCurrentViewAndSet:self];
 }
 
+#pragma mark -
+#pragma mark As a GCZoomView
+
+- (NSColor*)zoomPreviewBackgroundColor
+{
+	NSColor* paper = [[self drawing] paperColour];
+
+	return paper ? paper : [super zoomPreviewBackgroundColor];
+}
+
 #pragma mark -
 #pragma mark As an NSView
 
@@ -984,11 +1375,34 @@ static Class s_textEditorClass = Nil;
  */
 - (void)drawRect:(NSRect)rect
 {
-	// draw the entire content of the drawing:
+	// draw the entire content of the drawing. Interactive updates are timed so that the quality can be lowered if they're too slow.
+
+	BOOL adaptive = [self adaptsDrawingQuality] && [NSGraphicsContext currentContextDrawingToScreen];
+	DKDrawingQualityTier savedTier = [DKStyle drawingQualityTier];
+	NSTimeInterval startTime = 0;
+	uint64_t statsStart = DKRenderIntervalBegin(kDKRenderEventViewDraw, self);
+
+	if (adaptive) {
+		[DKStyle setDrawingQualityTier:mQualityTier];
+		startTime = [NSDate timeIntervalSinceReferenceDate];
+	}
 
 	[self set];
-	[[self drawing] drawRect:rect
-					  inView:self];
+
+	BOOL screen = [NSGraphicsContext currentContextDrawingToScreen];
+
+	if ([self drawZoomPreviewInRect:rect]) {
+		// the scale is changing and the last frame has been drawn scaled to it
+	} else if (mUsesStaticSnapshot && screen && ![self isChangingScale] && [self drawStaticContentSnapshotInRect:rect]) {
+		// the snapshot and the object being edited have been drawn
+	} else if (mUsesTiledRendering && screen && ![self isChangingScale]) {
+		[[self tileCache] drawRect:rect
+							inView:self];
+		[[self drawing] drawOverlayRect:rect
+								 inView:self];
+	} else
+		[[self drawing] drawRect:rect
+						  inView:self];
 
 	// if our controller implements a drawRect: method, call it - the default controller doesn't but subclasses can.
 	// any drawing done by a controller will be "on top" of any drawing content. Typically this is used by tools
@@ -1008,6 +1422,55 @@ static Class s_textEditorClass = Nil;
 		[self drawCropMarks];
 
 	[[self class] pop];
+
+	if (adaptive) {
+		[DKStyle setDrawingQualityTier:savedTier];
+		[self adjustDrawingQualityForFrameTime:[NSDate timeIntervalSinceReferenceDate] - startTime];
+	}
+
+	DKRenderIntervalEnd(kDKRenderEventViewDraw, self, statsStart, 0, 0);
+}
+
+/** @brief Does the view need to draw the given rect
+
+ While a cached tile or the static content snapshot is being rendered, all of it needs drawing regardless of the view's current update region.
+ @param aRect a rect
+ @return YES if the rect needs drawing
+ */
+- (BOOL)needsToDrawRect:(NSRect)aRect
+{
+	if (mRenderingStaticSnapshot)
+		return NSIntersectsRect(aRect, mStaticSnapshotRect);
+
+	DKDrawingTileCache* tiles = [self tileCache];
+
+	if ([tiles isRenderingTileForView:self])
+		return NSIntersectsRect(aRect, [tiles renderingTileRect]);
+
+	return [super needsToDrawRect:aRect];
+}
+
+/** @brief The rects being drawn
+
+ While a cached tile or the static content snapshot is being rendered, this is its rect.
+ @param rects receives a pointer to the rects
+ @param count receives the number of rects
+ */
+- (void)getRectsBeingDrawn:(const NSRect**)rects count:(NSInteger*)count
+{
+	DKDrawingTileCache* tiles = [self tileCache];
+
+	if (mRenderingStaticSnapshot || [tiles isRenderingTileForView:self]) {
+		mTileRenderRect = mRenderingStaticSnapshot ? mStaticSnapshotRect : [tiles renderingTileRect];
+
+		if (rects)
+			*rects = &mTileRenderRect;
+
+		if (count)
+			*count = 1;
+	} else
+		[super getRectsBeingDrawn:rects
+							count:count];
 }
 
 /** @brief Is the view flipped.
@@ -1288,7 +1751,12 @@ static Class s_textEditorClass = Nil;
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	[mPrintInfo release];
 	[mRulerMarkersDict release];
+	[mPendingRulerMarkers release];
 	[m_textEditViewRef release];
+	[mStaticSnapshot release];
+	[mStaticSnapshotObject release];
+	[mQualityTimer setTarget:nil];
+	[mQualityTimer release];
 
 	// if the view automatically created its own "back-end", release all of that now - the drawing owns the controllers so
 	// they are also disposed of.
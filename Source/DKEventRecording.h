@@ -0,0 +1,74 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/** @brief A stream of mouse and key events made in a view, kept so that it can be replayed exactly.
+
+ A stream of mouse and key events made in a view, kept so that it can be replayed exactly. Events are recorded with -recordEvent:inView:,
+ which an application can call from its view's event methods or from an event monitor while someone works with a drawing. Mouse locations
+ are kept in the view's coordinates and times relative to the first event, so a recording stays valid if the window is moved or it is
+ replayed in another window, as long as the view shows the same drawing at the same scale. Events can also be added by hand, to script
+ an interaction.
+
+ A recording is stored as a property list: a dictionary holding the name of the drawing tool it was made with, if any, under "tool", and
+ an array of events under "events". Each event is a dictionary of its "type" (an NSEventType), "time", "x" and "y", "flags", "clicks",
+ and, for key events, "characters" and "keyCode". TestInteractionBenchmark replays recordings against its stress drawings.
+*/
+@interface DKEventRecording : NSObject {
+@private
+	NSMutableArray* mEvents; // dictionaries, as stored in the property list
+	NSString* mToolName;
+	NSTimeInterval mStartTime; // the timestamp of the first recorded event
+}
+
++ (DKEventRecording*)recordingWithContentsOfFile:(NSString*)path;
+
+/** @brief Initialises a recording from its property list
+ @param plist a dictionary, as returned by -propertyList
+ @return the recording, or nil if <plist> isn't a recording
+ */
+- (id)initWithPropertyList:(id)plist;
+- (id)propertyList;
+- (BOOL)writeToFile:(NSString*)path;
+
+/** @brief Sets the name of the drawing tool in use when the recording was made, so that it's set again before replaying it
+ @param name a registered tool name, or nil
+ */
+- (void)setToolName:(NSString*)name;
+- (NSString*)toolName;
+
+/** @brief Adds an event made in a view to the recording
+
+ Only left mouse button, mouse moved and key events are recorded - others are ignored.
+ @param event the event
+ @param view the view it was made in
+ */
+- (void)recordEvent:(NSEvent*)event inView:(NSView*)view;
+
+- (void)addMouseEventOfType:(NSEventType)type atPoint:(NSPoint)p time:(NSTimeInterval)t modifierFlags:(NSUInteger)flags clickCount:(NSInteger)clicks;
+- (void)addKeyEventOfType:(NSEventType)type characters:(NSString*)chars keyCode:(unsigned short)code time:(NSTimeInterval)t modifierFlags:(NSUInteger)flags;
+
+- (NSUInteger)countOfEvents;
+- (NSEventType)typeOfEventAtIndex:(NSUInteger)indx;
+
+/** @brief The time of an event, relative to the first
+ @param indx the event's index
+ @return the time in seconds
+ */
+- (NSTimeInterval)timeOfEventAtIndex:(NSUInteger)indx;
+
+/** @brief Makes an event of the recording for replaying it in a view
+
+ The event's location is converted from the view's coordinates to its window's, and its timestamp is the event's time after <start>.
+ @param indx the event's index
+ @param view the view to replay it in, which must be in a window
+ @param start the timestamp of the first event
+ @return the event
+ */
+- (NSEvent*)eventAtIndex:(NSUInteger)indx inView:(NSView*)view startTime:(NSTimeInterval)start;
+
+@end
@@ -0,0 +1,230 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKEventRecording.h"
+
+#define kDKEventRecordingToolKey @"tool"
+#define kDKEventRecordingEventsKey @"events"
+#define kDKEventTypeKey @"type"
+#define kDKEventTimeKey @"time"
+#define kDKEventXKey @"x"
+#define kDKEventYKey @"y"
+#define kDKEventFlagsKey @"flags"
+#define kDKEventClicksKey @"clicks"
+#define kDKEventCharactersKey @"characters"
+#define kDKEventKeyCodeKey @"keyCode"
+
+static inline BOOL isMouseEventType(NSEventType type)
+{
+	return type == NSLeftMouseDown || type == NSLeftMouseDragged || type == NSLeftMouseUp || type == NSMouseMoved;
+}
+
+static inline BOOL isKeyEventType(NSEventType type)
+{
+	return type == NSKeyDown || type == NSKeyUp;
+}
+
+@implementation DKEventRecording
+
++ (DKEventRecording*)recordingWithContentsOfFile:(NSString*)path
+{
+	NSDictionary* plist = [NSDictionary dictionaryWithContentsOfFile:path];
+
+	return [[[self alloc] initWithPropertyList:plist] autorelease];
+}
+
+- (id)initWithPropertyList:(id)plist
+{
+	self = [self init];
+	if (self) {
+		NSArray* events = [plist isKindOfClass:[NSDictionary class]] ? [plist objectForKey:kDKEventRecordingEventsKey] : nil;
+
+		if (![events isKindOfClass:[NSArray class]]) {
+			[self release];
+			return nil;
+		}
+
+		// only the events that can be replayed are kept
+
+		NSEnumerator* iter = [events objectEnumerator];
+		NSDictionary* event;
+
+		while ((event = [iter nextObject])) {
+			if (![event isKindOfClass:[NSDictionary class]])
+				continue;
+
+			NSEventType type = (NSEventType)[[event objectForKey:kDKEventTypeKey] integerValue];
+
+			if (isMouseEventType(type) || (isKeyEventType(type) && [[event objectForKey:kDKEventCharactersKey] isKindOfClass:[NSString class]]))
+				[mEvents addObject:event];
+		}
+
+		[self setToolName:[plist objectForKey:kDKEventRecordingToolKey]];
+	}
+
+	return self;
+}
+
+- (id)propertyList
+{
+	NSMutableDictionary* plist = [NSMutableDictionary dictionary];
+
+	[plist setObject:[[mEvents copy] autorelease]
+			  forKey:kDKEventRecordingEventsKey];
+
+	if (mToolName)
+		[plist setObject:mToolName
+				  forKey:kDKEventRecordingToolKey];
+
+	return plist;
+}
+
+- (BOOL)writeToFile:(NSString*)path
+{
+	return [[self propertyList] writeToFile:path
+								 atomically:YES];
+}
+
+- (void)setToolName:(NSString*)name
+{
+	if (![name isKindOfClass:[NSString class]])
+		name = nil;
+
+	[name retain];
+	[mToolName release];
+	mToolName = name;
+}
+
+- (NSString*)toolName
+{
+	return mToolName;
+}
+
+#pragma mark -
+
+- (void)recordEvent:(NSEvent*)event inView:(NSView*)view
+{
+	NSEventType type = [event type];
+
+	if ([mEvents count] == 0)
+		mStartTime = [event timestamp];
+
+	if (isMouseEventType(type)) {
+		[self addMouseEventOfType:type
+						  atPoint:[view convertPoint:[event locationInWindow]
+											fromView:nil]
+							 time:[event timestamp] - mStartTime
+					modifierFlags:[event modifierFlags]
+					   clickCount:(type == NSMouseMoved) ? 0 : [event clickCount]];
+	} else if (isKeyEventType(type)) {
+		[self addKeyEventOfType:type
+					 characters:[event characters]
+						keyCode:[event keyCode]
+						   time:[event timestamp] - mStartTime
+				  modifierFlags:[event modifierFlags]];
+	}
+}
+
+- (void)addMouseEventOfType:(NSEventType)type atPoint:(NSPoint)p time:(NSTimeInterval)t modifierFlags:(NSUInteger)flags clickCount:(NSInteger)clicks
+{
+	NSAssert(isMouseEventType(type), @"not a mouse event type");
+
+	NSDictionary* event = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInteger:type], kDKEventTypeKey,
+																	 [NSNumber numberWithDouble:t], kDKEventTimeKey,
+																	 [NSNumber numberWithDouble:p.x], kDKEventXKey,
+																	 [NSNumber numberWithDouble:p.y], kDKEventYKey,
+																	 [NSNumber numberWithUnsignedInteger:flags], kDKEventFlagsKey,
+																	 [NSNumber numberWithInteger:clicks], kDKEventClicksKey, nil];
+	[mEvents addObject:event];
+}
+
+- (void)addKeyEventOfType:(NSEventType)type characters:(NSString*)chars keyCode:(unsigned short)code time:(NSTimeInterval)t modifierFlags:(NSUInteger)flags
+{
+	NSAssert(isKeyEventType(type), @"not a key event type");
+	NSAssert(chars != nil, @"key event needs characters");
+
+	NSDictionary* event = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInteger:type], kDKEventTypeKey,
+																	 [NSNumber numberWithDouble:t], kDKEventTimeKey,
+																	 [NSNumber numberWithUnsignedInteger:flags], kDKEventFlagsKey,
+																	 chars, kDKEventCharactersKey,
+																	 [NSNumber numberWithUnsignedShort:code], kDKEventKeyCodeKey, nil];
+	[mEvents addObject:event];
+}
+
+- (NSUInteger)countOfEvents
+{
+	return [mEvents count];
+}
+
+- (NSEventType)typeOfEventAtIndex:(NSUInteger)indx
+{
+	return (NSEventType)[[[mEvents objectAtIndex:indx] objectForKey:kDKEventTypeKey] integerValue];
+}
+
+- (NSTimeInterval)timeOfEventAtIndex:(NSUInteger)indx
+{
+	return [[[mEvents objectAtIndex:indx] objectForKey:kDKEventTimeKey] doubleValue];
+}
+
+- (NSEvent*)eventAtIndex:(NSUInteger)indx inView:(NSView*)view startTime:(NSTimeInterval)start
+{
+	NSDictionary* event = [mEvents objectAtIndex:indx];
+	NSEventType type = (NSEventType)[[event objectForKey:kDKEventTypeKey] integerValue];
+	NSUInteger flags = [[event objectForKey:kDKEventFlagsKey] unsignedIntegerValue];
+	NSTimeInterval timestamp = start + [[event objectForKey:kDKEventTimeKey] doubleValue];
+	NSInteger windowNumber = [[view window] windowNumber];
+
+	NSAssert([view window] != nil, @"events can only be replayed in a view in a window");
+
+	if (isKeyEventType(type)) {
+		NSString* chars = [event objectForKey:kDKEventCharactersKey];
+
+		return [NSEvent keyEventWithType:type
+								location:NSZeroPoint
+						   modifierFlags:flags
+							   timestamp:timestamp
+							windowNumber:windowNumber
+								 context:nil
+							  characters:chars
+			 charactersIgnoringModifiers:chars
+							   isARepeat:NO
+								 keyCode:[[event objectForKey:kDKEventKeyCodeKey] unsignedShortValue]];
+	}
+
+	NSPoint p = NSMakePoint([[event objectForKey:kDKEventXKey] doubleValue], [[event objectForKey:kDKEventYKey] doubleValue]);
+
+	return [NSEvent mouseEventWithType:type
+							  location:[view convertPoint:p
+												   toView:nil]
+						 modifierFlags:flags
+							 timestamp:timestamp
+						  windowNumber:windowNumber
+							   context:nil
+						   eventNumber:(NSInteger)indx
+							clickCount:[[event objectForKey:kDKEventClicksKey] integerValue]
+							  pressure:(type == NSLeftMouseUp || type == NSMouseMoved) ? 0.0 : 1.0];
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	self = [super init];
+	if (self)
+		mEvents = [[NSMutableArray alloc] init];
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[mEvents release];
+	[mToolName release];
+	[super dealloc];
+}
+
+@end
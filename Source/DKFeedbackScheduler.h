@@ -0,0 +1,53 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import <QuartzCore/QuartzCore.h>
+
+/** @brief Coalesces interface feedback updates to at most one per display refresh.
+
+ Coalesces interface feedback updates to at most one per display refresh. Feedback such as the info window shown while dragging and
+ the ruler markers and mouse lines follows every mouse event, and on large displays redrawing it for each event can cost more than the
+ drag itself. Code giving such feedback records the latest state and schedules a target and selector here. However many times a pair is
+ scheduled before the next refresh, it is performed once, on the main thread, after the display link fires, so the feedback shows the
+ latest state at the display's rate.
+
+ The target is retained until its update is performed or cancelled. The display link runs only while updates are pending. Main thread
+ only.
+*/
+@interface DKFeedbackScheduler : NSObject {
+@private
+	NSMutableArray* mPending;
+	CVDisplayLinkRef mDisplayLink;
+	volatile int32_t mFramePending; // nonzero while a flush is queued for the main thread
+}
+
+/** @brief The scheduler used by the drawing views and layers
+ @return the shared scheduler
+ */
++ (DKFeedbackScheduler*)sharedScheduler;
+
+/** @brief Schedules a message to be sent at the next display refresh
+
+ Scheduling a pair that is already pending does nothing.
+ @param target the object to send the message to
+ @param selector a selector taking no parameters
+ */
+- (void)scheduleUpdateForTarget:(id)target selector:(SEL)selector;
+
+/** @brief Removes a pending update, e.g. because the feedback it would update has been hidden
+ @param target the object
+ @param selector the selector
+ */
+- (void)cancelUpdateForTarget:(id)target selector:(SEL)selector;
+
+/** @brief Performs all pending updates now
+ */
+- (void)flushUpdates;
+
+- (BOOL)hasPendingUpdates;
+
+@end
@@ -0,0 +1,198 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKFeedbackScheduler.h"
+#import <libkern/OSAtomic.h>
+
+// one pending update
+
+@interface DKFeedbackUpdate : NSObject {
+@public
+	id mTarget;
+	SEL mSelector;
+}
+
+@end
+
+@implementation DKFeedbackUpdate
+
+- (void)dealloc
+{
+	[mTarget release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKFeedbackScheduler (Private)
+
+- (void)displayDidRefresh;
+- (void)frameDidFinish;
+- (void)startDisplayLink;
+- (void)stopDisplayLink;
+
+@end
+
+static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp* now, const CVTimeStamp* outputTime, CVOptionFlags flagsIn, CVOptionFlags* flagsOut, void* context)
+{
+#pragma unused(displayLink, now, outputTime, flagsIn, flagsOut)
+
+	@autoreleasepool {
+		[(DKFeedbackScheduler*)context displayDidRefresh];
+	}
+
+	return kCVReturnSuccess;
+}
+
+static void flushFrame(void* context)
+{
+	DKFeedbackScheduler* scheduler = (DKFeedbackScheduler*)context;
+
+	[scheduler flushUpdates];
+	[scheduler frameDidFinish];
+}
+
+#pragma mark -
+@implementation DKFeedbackScheduler
+#pragma mark As a DKFeedbackScheduler
+
++ (DKFeedbackScheduler*)sharedScheduler
+{
+	static DKFeedbackScheduler* sSharedScheduler = nil;
+
+	if (sSharedScheduler == nil)
+		sSharedScheduler = [[self alloc] init];
+
+	return sSharedScheduler;
+}
+
+- (void)scheduleUpdateForTarget:(id)target selector:(SEL)selector
+{
+	NSAssert(target != nil, @"can't schedule an update for a nil target");
+
+	NSEnumerator* iter = [mPending objectEnumerator];
+	DKFeedbackUpdate* update;
+
+	while ((update = [iter nextObject])) {
+		if (update->mTarget == target && update->mSelector == selector)
+			return;
+	}
+
+	update = [[DKFeedbackUpdate alloc] init];
+	update->mTarget = [target retain];
+	update->mSelector = selector;
+	[mPending addObject:update];
+	[update release];
+
+	[self startDisplayLink];
+}
+
+- (void)cancelUpdateForTarget:(id)target selector:(SEL)selector
+{
+	NSUInteger i = [mPending count];
+
+	while (i-- > 0) {
+		DKFeedbackUpdate* update = [mPending objectAtIndex:i];
+
+		if (update->mTarget == target && update->mSelector == selector)
+			[mPending removeObjectAtIndex:i];
+	}
+}
+
+- (void)flushUpdates
+{
+	if ([mPending count] == 0) {
+		// nothing was scheduled since the last refresh, so the display link can rest until something is
+
+		[self stopDisplayLink];
+		return;
+	}
+
+	// updates may schedule others, which are left for the next refresh
+
+	NSArray* updates = [mPending copy];
+	NSEnumerator* iter = [updates objectEnumerator];
+	DKFeedbackUpdate* update;
+
+	[mPending removeAllObjects];
+
+	while ((update = [iter nextObject]))
+		[update->mTarget performSelector:update->mSelector];
+
+	[updates release];
+}
+
+- (BOOL)hasPendingUpdates
+{
+	return [mPending count] > 0;
+}
+
+#pragma mark -
+
+- (void)displayDidRefresh
+{
+	// called on the display link's thread. Only one flush is queued for the main thread at a time
+
+	if (OSAtomicCompareAndSwap32Barrier(0, 1, &mFramePending))
+		dispatch_async_f(dispatch_get_main_queue(), self, flushFrame);
+}
+
+- (void)frameDidFinish
+{
+	OSAtomicCompareAndSwap32Barrier(1, 0, &mFramePending);
+}
+
+- (void)startDisplayLink
+{
+	if (mDisplayLink == NULL) {
+		if (CVDisplayLinkCreateWithActiveCGDisplays(&mDisplayLink) != kCVReturnSuccess) {
+			// without a display link, updates are made straight away as they were before
+
+			mDisplayLink = NULL;
+			[self flushUpdates];
+			return;
+		}
+
+		CVDisplayLinkSetOutputCallback(mDisplayLink, displayLinkCallback, self);
+	}
+
+	if (!CVDisplayLinkIsRunning(mDisplayLink))
+		CVDisplayLinkStart(mDisplayLink);
+}
+
+- (void)stopDisplayLink
+{
+	if (mDisplayLink != NULL && CVDisplayLinkIsRunning(mDisplayLink))
+		CVDisplayLinkStop(mDisplayLink);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		mPending = [[NSMutableArray alloc] init];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[self stopDisplayLink];
+
+	if (mDisplayLink != NULL)
+		CVDisplayLinkRelease(mDisplayLink);
+
+	[mPending release];
+	[super dealloc];
+}
+
+@end
@@ -7,11 +7,47 @@
 #import "DKFill.h"
 #import "DKStyle.h"
 #import "NSShadow+Scaling.h"
+#import "NSColor+DKAdditions.h"
 #import "DKGradient.h"
 #import "NSObject+GraphicsAttributes.h"
 #import "DKDrawableObject.h"
 #import "DKDrawing.h"
 
+static NSString* kDKFillGradientShadingCacheKey = @"DKFill_shading";
+
+// the shading a gradient made for an object's path, kept in the object's rendering cache. It holds on to the gradient, whose colour table
+// the shading reads, and the gradient's checksum when it was made.
+
+@interface DKFillGradientShading : NSObject {
+@public
+	DKGradient* mGradient;
+	NSUInteger mChecksum;
+	CGShadingRef mShading;
+}
+
+@end
+
+@implementation DKFillGradientShading
+
+- (void)dealloc
+{
+	CGShadingRelease(mShading);
+	[mGradient release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKFill (Private)
+
+- (BOOL)canCacheGradientShading;
+- (void)fillPath:(NSBezierPath*)path withGradientForObject:(id<DKRenderable>)obj;
+
+@end
+
+#pragma mark -
 @implementation DKFill
 #pragma mark As a DKFill
 + (DKFill*)fillWithColour:(NSColor*)colour
@@ -117,6 +153,53 @@
 	return m_angleTracksObject;
 }
 
+#pragma mark -
+
+- (BOOL)canCacheGradientShading
+{
+	// a gradient subclass that fills in its own way can't be drawn from a shading made by DKGradient
+
+	DKGradient* gradient = [self gradient];
+	SEL fillSel = @selector(fillPath:startingAtPoint:startRadius:endingAtPoint:endRadius:);
+	SEL contextSel = @selector(fillContext:startingAtPoint:startRadius:endingAtPoint:endRadius:);
+
+	return [gradient methodForSelector:fillSel] == [DKGradient instanceMethodForSelector:fillSel] && [gradient methodForSelector:contextSel] == [DKGradient instanceMethodForSelector:contextSel];
+}
+
+- (void)fillPath:(NSBezierPath*)path withGradientForObject:(id<DKRenderable>)obj
+{
+	// the shading is only made again when the path, the object's geometry (which includes its angle) or the gradient changes
+
+	DKGradient* gradient = [self gradient];
+	NSUInteger checksum = [gradient shadingChecksum];
+	DKFillGradientShading* cached = [self cachedValueForObject:obj
+													sourcePath:path
+														   key:kDKFillGradientShadingCacheKey];
+
+	if (cached == nil || cached->mGradient != gradient || cached->mChecksum != checksum) {
+		CGShadingRef shader = [gradient newShaderForPath:path
+											centreOffset:NSZeroPoint];
+
+		if (shader == NULL) {
+			[gradient fillPath:path];
+			return;
+		}
+
+		cached = [[[DKFillGradientShading alloc] init] autorelease];
+		cached->mGradient = [gradient retain];
+		cached->mChecksum = checksum;
+		cached->mShading = shader;
+
+		[self setCachedValue:cached
+				   forObject:obj
+				  sourcePath:path
+						 key:kDKFillGradientShadingCacheKey];
+	}
+
+	[gradient fillPath:path
+			withShader:cached->mShading];
+}
+
 #pragma mark -
 #pragma mark As a DKRasterizer
 - (BOOL)isValid
@@ -203,19 +286,24 @@
 
 		// if low quality, don't bother with shadow - shadows really sap performance
 
-		BOOL lowQuality = [obj useLowQualityDrawing];
-
 		if ([self shadow] != nil && [DKStyle willDrawShadows]) {
-			if (!lowQuality)
-				[[self shadow] setAbsolute];
-			else
+			BOOL lowQuality = DKRenderUsesLowQualityDrawing(obj);
+
+			// an opaque fill casts the shadow of its path alone, which can be cached, whereas anything else is left to Quartz
+
+			BOOL opaque = [self colour] != nil && [[self colour] alphaComponent] >= 1.0;
+
+			if (!lowQuality) {
+				if (!opaque || ![[self shadow] drawCachedShadowForFilledPath:path])
+					[[self shadow] setAbsolute];
+			} else
 				[[self shadow] drawApproximateShadowWithPath:path
 												   operation:kDKShadowDrawFill
 												 strokeWidth:0];
 		}
 
 		if ([self colour])
-			[[self colour] setFill];
+			[[self colour] setRenderingFill];
 		else
 			[[NSColor clearColor] setFill];
 
@@ -232,7 +320,11 @@
 				[[self gradient] setAngleWithoutNotifying:ga + [obj angle]];
 			}
 
-			[[self gradient] fillPath:path];
+			if ([self canCacheGradientShading])
+				[self fillPath:path
+					withGradientForObject:obj];
+			else
+				[[self gradient] fillPath:path];
 
 			if ([self tracksObjectAngle])
 				[[self gradient] setAngleWithoutNotifying:ga];
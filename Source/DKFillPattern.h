@@ -12,6 +12,10 @@ This object represents a pattern consisting of a repeated motif spaced out at in
 
 This subclasses DKPathDecorator which carries out the bulk of the work - it stores the image and caches it, this
 just sets up the path clipping and calls the rendering method for each location of the repeating pattern.
+
+When nothing about the pattern is randomised and clipped elements aren't suppressed, every motif is placed the same way, so one repeat
+of the pattern (2 x 2 motifs, to allow for the alternate offsets) is drawn into an image at the device resolution and the whole fill is
+drawn by tiling that, in a single call.
 */
 @interface DKFillPattern : DKPathDecorator <NSCoding, NSCopying> {
 @private
@@ -24,7 +28,9 @@ just sets up the path clipping and calls the rendering method for each location
 	BOOL m_angleRelativeToObject;
 	BOOL m_motifAngleRelativeToPattern;
 	BOOL m_noClippedElements;
-	NSMutableArray* mMotifAngleRandCache;
+	NSColor* mLowDetailColour; // average colour of the motif, used when the pattern is too small to draw
+	CGImageRef mTileImage; // one repeat of the pattern, when it can be drawn by tiling
+	NSUInteger mTileChecksum; // the settings <mTileImage> was made with
 }
 
 /**  */
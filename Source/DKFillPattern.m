@@ -11,6 +11,19 @@
 #import "DKGeometryUtilities.h"
 #import "LogEvent.h"
 #import "DKRandom.h"
+#import "DKRasterizer.h"
+
+#define kDKFillPatternMaximumTileSize 2048 // tiles larger than this in pixels are drawn motif by motif instead
+
+@interface DKFillPattern (Private)
+
+- (BOOL)canDrawPatternAsTile;
+- (BOOL)drawTiledPatternWithInterval:(NSSize)interval centre:(NSPoint)cp angle:(CGFloat)angle motifAngle:(CGFloat)mangle;
+- (void)invalidateTile;
+
+@end
+
+#pragma mark -
 
 @implementation DKFillPattern
 #pragma mark As a DKFillPattern
@@ -108,6 +121,14 @@
 	if ([self motifAngleIsRelativeToPattern])
 		mangle += [self angle];
 
+	// patterns without randomness can be drawn by tiling one repeat of them
+
+	if ([self canDrawPatternAsTile] && [self drawTiledPatternWithInterval:NSMakeSize(dx, dy)
+																	centre:cp
+																	 angle:angle
+																motifAngle:mangle])
+		return;
+
 	// how many rows and columns of the motif will we need to fill the rect?
 	// n.b. div by 2 because we go from -cols to +cols etc
 
@@ -133,6 +154,7 @@
 		NSAffineTransform* tfm = RotationTransform(angle, cp);
 		NSPoint wobblePoint = NSZeroPoint;
 		CGFloat tempAngle = mangle;
+		uint64_t seed = DKRandomSeedForObject(self);
 
 		// ok, draw 'em...
 
@@ -149,29 +171,19 @@
 					mp.y = (y * dy) + cp.y;
 
 				if ([self wobblyness] > 0.0) {
-					// wobblyness is a randomising positioning factor from 0..1. Cached to avoid recalculation on every redraw.
-
-					if (mPlacementCount < [mWobbleCache count])
-						wobblePoint = [[mWobbleCache objectAtIndex:mPlacementCount] pointValue];
-					else {
-						wobblePoint.x = [DKRandom randomPositiveOrNegativeNumber] * dx * [self wobblyness];
-						wobblePoint.y = [DKRandom randomPositiveOrNegativeNumber] * dy * [self wobblyness];
-						[mWobbleCache addObject:[NSValue valueWithPoint:wobblePoint]];
-					}
+					// wobblyness is a randomising positioning factor from 0..1. The random amounts depend only on the pattern and the
+					// placement, so they are the same on every redraw.
+
+					wobblePoint.x = DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement) * dx * [self wobblyness];
+					wobblePoint.y = DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement + 1) * dy * [self wobblyness];
 
 					mp.x += wobblePoint.x;
 					mp.y += wobblePoint.y;
 				}
 
 				if ([self motifAngleRandomness] > 0.0) {
-					CGFloat ra = 0.0;
+					CGFloat ra = DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement + 3) * 2.0 * pi * [self motifAngleRandomness];
 
-					if (mPlacementCount < [mMotifAngleRandCache count])
-						ra = [[mMotifAngleRandCache objectAtIndex:mPlacementCount] doubleValue];
-					else {
-						ra = [DKRandom randomPositiveOrNegativeNumber] * 2.0 * pi * [self motifAngleRandomness];
-						[mMotifAngleRandCache addObject:[NSNumber numberWithDouble:ra]];
-					}
 					tempAngle = mangle;
 					tempAngle += ra;
 				}
@@ -288,14 +300,7 @@
 {
 	maRand = LIMIT(maRand, 0, 1);
 
-	if (maRand != mMotifAngleRandomness) {
-		mMotifAngleRandomness = maRand;
-
-		if (mMotifAngleRandCache == nil)
-			mMotifAngleRandCache = [[NSMutableArray alloc] init];
-
-		[mMotifAngleRandCache removeAllObjects];
-	}
+	mMotifAngleRandomness = maRand;
 }
 
 - (CGFloat)motifAngleRandomness
@@ -316,6 +321,154 @@
 	return m_noClippedElements;
 }
 
+#pragma mark -
+
+- (BOOL)canDrawPatternAsTile
+{
+	// every motif must be placed the same way relative to its position in the pattern, and all must be drawn. The tile is a bitmap, so
+	// printing and PDF output draw the motifs themselves to stay resolution independent
+
+	return [NSGraphicsContext currentContextDrawingToScreen] && !m_noClippedElements && [self motifAngleRandomness] == 0.0 && [self wobblyness] == 0.0 && [self scaleRandomness] == 0.0 && [self lateralOffset] == 0.0;
+}
+
+- (BOOL)drawTiledPatternWithInterval:(NSSize)interval centre:(NSPoint)cp angle:(CGFloat)angle motifAngle:(CGFloat)mangle
+{
+	// draws the pattern into the current clip by tiling an image of one repeat of it. The pattern's coordinates have their origin at <cp>
+	// and are rotated by <angle>, and motifs are placed as -placeObjectAtPoint:... would place them. Because odd rows and columns may be offset,
+	// one repeat is 2 x 2 motifs. The image is kept until anything that affects it changes. Returns NO if the pattern can't be tiled.
+
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+	CGContextRef ctx = [context graphicsPort];
+
+	if (ctx == NULL)
+		return NO;
+
+	NSSize mb = [[self image] size];
+	NSSize tileSize = NSMakeSize(interval.width * 2.0, interval.height * 2.0);
+
+	// the resolution of the tile is the device resolution rounded up to a power of two, so small changes of scale reuse it
+
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform(ctx);
+	CGFloat deviceScale = sqrt(fabs(dt.a * dt.d - dt.b * dt.c));
+
+	deviceScale = exp2(ceil(log2(MAX(deviceScale, 0.125))));
+
+	size_t pw = (size_t)ceil(tileSize.width * deviceScale);
+	size_t ph = (size_t)ceil(tileSize.height * deviceScale);
+
+	if (pw == 0 || ph == 0 || pw > kDKFillPatternMaximumTileSize || ph > kDKFillPatternMaximumTileSize)
+		return NO;
+
+	// a motif is drawn relative to the pattern's coordinates by this transform, which includes undoing the pattern's rotation when
+	// motifs aren't rotated with it
+
+	NSAffineTransform* motifTfm = [NSAffineTransform transform];
+
+	[motifTfm rotateByRadians:-angle];
+	[motifTfm scaleXBy:[self scale]
+				   yBy:[self scale] * -1.0];
+
+	if ([self normalToPath])
+		[motifTfm rotateByRadians:-mangle];
+
+	[motifTfm translateXBy:-(mb.width / 2)
+					   yBy:-(mb.height / 2)];
+
+	NSAffineTransformStruct ms = [motifTfm transformStruct];
+	NSUInteger checksum = (NSUInteger)[self image];
+
+	checksum = DKRasterizerChecksumCombine(checksum, tileSize.width);
+	checksum = DKRasterizerChecksumCombine(checksum, tileSize.height);
+	checksum = DKRasterizerChecksumCombine(checksum, deviceScale);
+	checksum = DKRasterizerChecksumCombine(checksum, m_altXOffset);
+	checksum = DKRasterizerChecksumCombine(checksum, m_altYOffset);
+	checksum = DKRasterizerChecksumCombine(checksum, ms.m11);
+	checksum = DKRasterizerChecksumCombine(checksum, ms.m12);
+	checksum = DKRasterizerChecksumCombine(checksum, ms.m21);
+	checksum = DKRasterizerChecksumCombine(checksum, ms.m22);
+	checksum = DKRasterizerChecksumCombine(checksum, [self motifDrawsAtop]);
+	checksum = DKRasterizerChecksumCombine(checksum, [context isFlipped]);
+
+	if (mTileImage == NULL || checksum != mTileChecksum) {
+		[self invalidateTile];
+
+		CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+		CGContextRef tileCtx = CGBitmapContextCreate(NULL, pw, ph, 8, 0, space, kCGImageAlphaPremultipliedLast);
+		CGColorSpaceRelease(space);
+
+		if (tileCtx == NULL)
+			return NO;
+
+		CGContextScaleCTM(tileCtx, pw / tileSize.width, ph / tileSize.height);
+
+		[NSGraphicsContext saveGraphicsState];
+		[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:tileCtx
+																						flipped:[context isFlipped]]];
+
+		// motifs that overlap the edges of the tile also have to be drawn from the neighbouring repeats, so that they wrap around
+
+		CGFloat reach = hypot(mb.width, mb.height) * [self scale] * 0.5;
+		NSInteger kx = (NSInteger)ceil(reach / tileSize.width);
+		NSInteger ky = (NSInteger)ceil(reach / tileSize.height);
+		NSInteger i, j, x, y;
+
+		for (j = -ky; j <= ky; ++j) {
+			for (y = 0; y < 2; ++y) {
+				for (i = -kx; i <= kx; ++i) {
+					for (x = 0; x < 2; ++x) {
+						NSPoint mp;
+
+						mp.x = interval.width * (x + ((y & 1) ? m_altXOffset : 0.0)) + i * tileSize.width;
+						mp.y = interval.height * (y + ((x & 1) ? m_altYOffset : 0.0)) + j * tileSize.height;
+
+						if (mp.x + reach < 0 || mp.x - reach > tileSize.width || mp.y + reach < 0 || mp.y - reach > tileSize.height)
+							continue;
+
+						NSAffineTransform* tfm = [NSAffineTransform transform];
+						[tfm translateXBy:mp.x
+									  yBy:mp.y];
+						[tfm prependTransform:motifTfm];
+
+						[NSGraphicsContext saveGraphicsState];
+						[tfm concat];
+						[self drawMotifUsingOperation:NSCompositeSourceOver];
+						[NSGraphicsContext restoreGraphicsState];
+					}
+				}
+			}
+		}
+
+		[NSGraphicsContext restoreGraphicsState];
+
+		mTileImage = CGBitmapContextCreateImage(tileCtx);
+		mTileChecksum = checksum;
+		CGContextRelease(tileCtx);
+
+		if (mTileImage == NULL)
+			return NO;
+	}
+
+	// a bitmap motif is drawn atop what's already there, so the tile is too
+
+	CGContextSaveGState(ctx);
+	CGContextTranslateCTM(ctx, cp.x, cp.y);
+	CGContextRotateCTM(ctx, angle);
+
+	if ([self motifDrawsAtop])
+		CGContextSetBlendMode(ctx, kCGBlendModeSourceAtop);
+
+	CGContextDrawTiledImage(ctx, CGRectMake(0, 0, tileSize.width, tileSize.height), mTileImage);
+	CGContextRestoreGState(ctx);
+
+	return YES;
+}
+
+- (void)invalidateTile
+{
+	CGImageRelease(mTileImage);
+	mTileImage = NULL;
+}
+
 #pragma mark -
 #pragma mark As a DKPathDecorator
 - (id)initWithImage:(NSImage*)image
@@ -332,6 +485,14 @@
 	return self;
 }
 
+- (void)setImage:(NSImage*)image
+{
+	[mLowDetailColour release];
+	mLowDetailColour = nil;
+
+	[super setImage:image];
+}
+
 #pragma mark -
 #pragma mark As a GCObservableObject
 + (NSArray*)observableKeyPaths
@@ -377,7 +538,8 @@
 
 - (void)dealloc
 {
-	[mMotifAngleRandCache release];
+	[self invalidateTile];
+	[mLowDetailColour release];
 	[super dealloc];
 }
 
@@ -406,6 +568,77 @@
 	}
 }
 
+- (CGFloat)minimumDetailSize
+{
+	// below this only a few motifs would be visible and each would be a pixel or two
+
+	return 16.0;
+}
+
+- (void)renderLowDetail:(id<DKRenderable>)obj
+{
+	// fills with the motif's average colour, thinned out by the proportion of each cell the motif covers
+
+	NSSize mb = [[self image] size];
+
+	if (mb.width <= 0.0 || mb.height <= 0.0)
+		return;
+
+	if (mLowDetailColour == nil) {
+		// downsampling the image into a tiny bitmap and averaging its pixels gives the overall colour
+
+		NSBitmapImageRep* rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
+																		pixelsWide:4
+																		pixelsHigh:4
+																	 bitsPerSample:8
+																   samplesPerPixel:4
+																		  hasAlpha:YES
+																		  isPlanar:NO
+																	colorSpaceName:NSCalibratedRGBColorSpace
+																	   bytesPerRow:0
+																	  bitsPerPixel:0];
+		NSGraphicsContext* context = [NSGraphicsContext graphicsContextWithBitmapImageRep:rep];
+		CGFloat r = 0, g = 0, b = 0, a = 0;
+		NSInteger x, y;
+
+		[NSGraphicsContext saveGraphicsState];
+		[NSGraphicsContext setCurrentContext:context];
+		[context setImageInterpolation:NSImageInterpolationHigh];
+		[[self image] drawInRect:NSMakeRect(0, 0, 4, 4)
+						fromRect:NSZeroRect
+					   operation:NSCompositeCopy
+						fraction:1.0];
+		[NSGraphicsContext restoreGraphicsState];
+
+		for (y = 0; y < 4; ++y) {
+			for (x = 0; x < 4; ++x) {
+				NSColor* c = [rep colorAtX:x
+										 y:y];
+				r += [c redComponent] * [c alphaComponent];
+				g += [c greenComponent] * [c alphaComponent];
+				b += [c blueComponent] * [c alphaComponent];
+				a += [c alphaComponent];
+			}
+		}
+
+		if (a > 0)
+			mLowDetailColour = [[NSColor colorWithCalibratedRed:r / a
+														  green:g / a
+														   blue:b / a
+														  alpha:a / 16.0] retain];
+		else
+			mLowDetailColour = [[NSColor clearColor] retain];
+
+		[rep release];
+	}
+
+	CGFloat cellArea = (mb.width + [self interval]) * (mb.height + [self interval]);
+	CGFloat coverage = (cellArea > 0 ? LIMIT((mb.width * mb.height) / cellArea, 0, 1) : 1.0);
+
+	[[mLowDetailColour colorWithAlphaComponent:[mLowDetailColour alphaComponent] * coverage] setFill];
+	[[self renderingPathForObject:obj] fill];
+}
+
 - (NSSize)extraSpaceNeeded
 {
 	return NSZeroSize; // none
@@ -0,0 +1,58 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKCacheRegistry.h"
+
+/** @brief A process-wide cache of glyph outlines, keyed by font and glyph.
+
+ Converting a glyph to a path asks the font to outline it, which is slow compared with copying and transforming an existing path. Drawings with
+ many labels in the same few fonts outline the same glyphs over and over, so text on paths and text converted to paths get their glyphs from this
+ cache instead, placing each one with a transform.
+
+ Outlines are stored with the glyph's origin at 0,0, unflipped. Fonts are compared as NSFont compares them, so the same font at the same size and
+ matrix shares its outlines. The cache discards outlines under memory pressure.
+*/
+@interface DKGlyphOutlineCache : NSObject <DKPurgeableCache, NSCacheDelegate> {
+@private
+	NSCache* mFonts; // font -> dictionary of glyph -> outline
+	NSUInteger mBytesUsed;
+	NSUInteger mHits;
+	NSUInteger mMisses;
+}
+
+/** @brief The shared cache
+ @return the cache used by every text-to-path conversion in the process
+ */
++ (DKGlyphOutlineCache*)sharedGlyphOutlineCache;
+
+/** @brief Returns the outline of a glyph, outlining it if it's not already cached
+
+ The path returned is shared, so must not be modified.
+ @param glyph the glyph
+ @param font the font
+ @return the outline, with the glyph's origin at 0,0
+ */
+- (NSBezierPath*)outlineOfGlyph:(NSGlyph)glyph inFont:(NSFont*)font;
+
+/** @brief Appends the outline of a glyph to a path, transformed
+ @param glyph the glyph
+ @param font the font
+ @param transform the transform to place the glyph with, applied to its outline at 0,0
+ @param path the path to append the glyph to
+ */
+- (void)appendOutlineOfGlyph:(NSGlyph)glyph inFont:(NSFont*)font transform:(NSAffineTransform*)transform toPath:(NSBezierPath*)path;
+
+- (void)removeAllOutlines;
+
+/** @brief The approximate memory used by the outlines, as -undoCost estimates the size of a path
+ */
+- (NSUInteger)bytesUsed;
+
+- (NSUInteger)hits;
+- (NSUInteger)misses;
+
+@end
@@ -0,0 +1,154 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKGlyphOutlineCache.h"
+#import "GCUndoManager.h"
+
+#define kDKGlyphOutlineCacheFontLimit 64 // fonts whose outlines are kept, beyond which the least used are discarded
+
+@implementation DKGlyphOutlineCache
+
++ (DKGlyphOutlineCache*)sharedGlyphOutlineCache
+{
+	static DKGlyphOutlineCache* sGlyphCache = nil;
+	static dispatch_once_t onceToken;
+
+	dispatch_once(&onceToken, ^{
+		sGlyphCache = [[self alloc] init];
+	});
+
+	return sGlyphCache;
+}
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		mFonts = [[NSCache alloc] init];
+		[mFonts setCountLimit:kDKGlyphOutlineCacheFontLimit];
+		[mFonts setDelegate:self];
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeLayout];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
+	[mFonts setDelegate:nil];
+	[mFonts release];
+	[super dealloc];
+}
+
+- (NSBezierPath*)outlineOfGlyph:(NSGlyph)glyph inFont:(NSFont*)font
+{
+	if (font == nil)
+		return nil;
+
+	// text can be converted to paths on more than one thread, e.g. when image export renders bands concurrently
+
+	@synchronized(self)
+	{
+		NSMutableDictionary* glyphs = [mFonts objectForKey:font];
+
+		if (glyphs == nil) {
+			glyphs = [[NSMutableDictionary alloc] init];
+			[mFonts setObject:glyphs
+					   forKey:font];
+			[glyphs release];
+		}
+
+		NSNumber* key = [NSNumber numberWithUnsignedInt:glyph];
+		NSBezierPath* outline = [glyphs objectForKey:key];
+
+		if (outline == nil) {
+			outline = [[NSBezierPath alloc] init];
+			[outline moveToPoint:NSZeroPoint];
+			[outline appendBezierPathWithGlyph:glyph
+										inFont:font];
+
+			[glyphs setObject:outline
+					   forKey:key];
+			[outline release];
+			mBytesUsed += [outline undoCost];
+			++mMisses;
+		} else
+			++mHits;
+
+		// retained and autoreleased in case the font's outlines are discarded before the caller is done with it
+
+		return [[outline retain] autorelease];
+	}
+}
+
+- (void)appendOutlineOfGlyph:(NSGlyph)glyph inFont:(NSFont*)font transform:(NSAffineTransform*)transform toPath:(NSBezierPath*)path
+{
+	NSBezierPath* outline = [self outlineOfGlyph:glyph
+										  inFont:font];
+
+	if (outline == nil)
+		return;
+
+	if (transform != nil) {
+		outline = [transform transformBezierPath:outline];
+	}
+
+	[path appendBezierPath:outline];
+}
+
+- (void)removeAllOutlines
+{
+	@synchronized(self)
+	{
+		[mFonts removeAllObjects];
+	}
+}
+
+- (NSUInteger)bytesUsed
+{
+	return mBytesUsed;
+}
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	NSUInteger bytes = mBytesUsed;
+
+	[self removeAllOutlines];
+	return bytes;
+}
+
+- (NSUInteger)hits
+{
+	return mHits;
+}
+
+- (NSUInteger)misses
+{
+	return mMisses;
+}
+
+#pragma mark -
+#pragma mark As an NSCache delegate
+
+- (void)cache:(NSCache*)cache willEvictObject:(id)obj
+{
+#pragma unused(cache)
+
+	// called for fonts discarded by the cache as well as those removed, so the outlines' bytes are only ever taken off here
+
+	@synchronized(self)
+	{
+		NSEnumerator* iter = [(NSDictionary*)obj objectEnumerator];
+		NSBezierPath* outline;
+
+		while ((outline = [iter nextObject]))
+			mBytesUsed -= MIN(mBytesUsed, [outline undoCost]);
+	}
+}
+
+@end
@@ -42,6 +42,9 @@ typedef enum {
 	DKGradientBlending m_blending; // method to blend colours
 	DKGradientInterpolation m_interp; // interpolation function
 	CGFunctionRef m_cbfunc; // callback function
+	CGFloat* mColorTable; // precomputed colour ramp sampled by the callback function
+	BOOL mColorTableValid; // NO if the colour table needs rebuilding
+	NSUInteger mColorTableGeneration; // counts the changes to the colour ramp, for -shadingChecksum
 }
 
 // simple gradient convenience methods
@@ -173,6 +176,30 @@ typedef enum {
 	  endingAtPoint:(NSPoint)ep
 		  endRadius:(CGFloat)er;
 
+/** @brief Makes the shading -fillPath:centreOffset: would draw for a path
+
+ The shading can be kept and drawn again with -fillPath:withShader: for as long as the path's bounds and -shadingChecksum are
+ unchanged, which saves making a new one for every fill. It uses the receiver's colour table, so it must not outlive the receiver.
+ Caller is responsible for releasing the returned ref.
+ @param path the path to be filled
+ @param co displacement from the centre for the start of a radial fill
+ @return the shading, or NULL if the gradient type has none
+ */
+- (CGShadingRef)newShaderForPath:(NSBezierPath*)path centreOffset:(NSPoint)co;
+
+/** @brief Fills the path with a shading made by -newShaderForPath:centreOffset:
+ @param path the bezier path to fill
+ @param shader the shading
+ */
+- (void)fillPath:(NSBezierPath*)path withShader:(CGShadingRef)shader;
+
+/** @brief A checksum of everything other than the path that affects the shading made for a path
+
+ Changes whenever the type, angle, radial settings or anything affecting the colour ramp changes.
+ @return a checksum
+ */
+- (NSUInteger)shadingChecksum;
+
 /** @brief Returns the computed Color for the gradient ramp expressed as a value from 0 to 1.0
 
  While intended for internal use, this function can be called at any time if you wish
@@ -243,6 +270,7 @@ typedef enum {
 @end
 
 #define DKGradientSwatchSize (NSMakeSize(20, 20))
+#define kDKGradientColorTableSize 1024
 
 #pragma mark -
 
@@ -28,12 +28,13 @@ NSString* kDKNotificationGradientDidChange = @"kDKNotificationGradientDidChange"
 
 #pragma mark Function Declarations
 static void shaderCallback(void* info, const CGFloat* in, CGFloat* out);
-static CGFunctionRef makeShaderFunction(DKGradient* object);
+static CGFunctionRef makeShaderFunction(const CGFloat* colorTable);
 static inline double powerMap(double x, double y);
 static inline double sineMap(double x, double y);
 static inline void transformHSV_RGB(CGFloat* components);
 static inline void transformRGB_HSV(CGFloat* components);
 static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
+static NSUInteger checksumCombine(NSUInteger checksum, CGFloat value);
 
 #pragma mark -
 @interface DKColorStop (Private)
@@ -43,6 +44,14 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 
 @end
 
+@interface DKGradient (Private)
+
+- (void)invalidateColorTable;
+- (void)buildColorTable;
+- (void)getShadingStartingPoint:(NSPoint*)sp startRadius:(CGFloat*)sr endingPoint:(NSPoint*)ep endRadius:(CGFloat*)er forPath:(NSBezierPath*)path centreOffset:(NSPoint)co;
+
+@end
+
 #pragma mark -
 @implementation DKGradient
 #pragma mark As a DKGradient
@@ -202,6 +211,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientWillRemoveColorStop
 														object:self];
 	[m_colorStops removeAllObjects];
+	[self invalidateColorTable];
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidRemoveColorStop
 														object:self];
 }
@@ -224,6 +234,7 @@ static inline void resolveHSV(CGFloat* color1, CGFloat* color2);
 
 	[m_colorStops makeObjectsPerformSelector:@selector(setOwner:)
 								  withObject:self];
+	[self invalidateColorTable];
 
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidAddColorStop
 														object:self];
@@ -264,6 +275,7 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 {
 	[m_colorStops sortUsingFunction:cmpColorStops
 							context:NULL];
+	[self invalidateColorTable];
 }
 
 /** @brief Reverses the order of all the Color stops so "inverting" the gradient
@@ -311,6 +323,8 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 
 - (void)insertObject:(DKColorStop*)stop inColorStopsAtIndex:(NSUInteger)ix
 {
+	[self invalidateColorTable];
+
 	if (ix >= [m_colorStops count])
 		[m_colorStops addObject:stop];
 	else
@@ -320,6 +334,8 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 
 - (void)removeObjectFromColorStopsAtIndex:(NSUInteger)ix
 {
+	[self invalidateColorTable];
+
 	[m_colorStops removeObjectAtIndex:ix];
 }
 
@@ -359,6 +375,29 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
  @param co displacement from the centre for the start of a radial fill
  */
 - (void)fillPath:(NSBezierPath*)path centreOffset:(NSPoint)co
+{
+	NSPoint sp, ep;
+	CGFloat sr, er;
+
+	[self getShadingStartingPoint:&sp
+					  startRadius:&sr
+					  endingPoint:&ep
+						endRadius:&er
+						  forPath:path
+					 centreOffset:co];
+
+	[self fillPath:path
+		startingAtPoint:sp
+			startRadius:sr
+		  endingAtPoint:ep
+			  endRadius:er];
+}
+
+/** @brief Works out where the shading for a path starts and ends, as -fillPath:centreOffset: fills it
+ @param path the path to be filled
+ @param co displacement from the centre for the start of a radial fill
+ */
+- (void)getShadingStartingPoint:(NSPoint*)spp startRadius:(CGFloat*)srp endingPoint:(NSPoint*)epp endRadius:(CGFloat*)erp forPath:(NSBezierPath*)path centreOffset:(NSPoint)co
 {
 	NSRect pb = [path bounds];
 
@@ -397,11 +436,10 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 		er = hypotf(pb.size.width, pb.size.height) / 3.0;
 	}
 
-	[self fillPath:path
-		startingAtPoint:sp
-			startRadius:sr
-		  endingAtPoint:ep
-			  endRadius:er];
+	*spp = sp;
+	*srp = sr;
+	*epp = ep;
+	*erp = er;
 }
 
 - (void)private_colorAtValue:(CGFloat)val components:(CGFloat*)components randomAccess:(BOOL)ra
@@ -560,6 +598,55 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 	}
 }
 
+/** @brief Marks the colour table as needing to be rebuilt
+
+ Called whenever anything that affects the colour ramp changes - the stops, their colours or positions, the blending or the interpolation.
+ */
+- (void)invalidateColorTable
+{
+	mColorTableValid = NO;
+	++mColorTableGeneration;
+}
+
+/** @brief Samples the colour ramp into the colour table used by the shading function
+
+ The ramp is sampled once here rather than for every value CoreGraphics asks the shading for, so all of the stop lookup, interpolation and
+ HSV conversion is paid kDKGradientColorTableSize times per change rather than per fill. Building is idempotent, so concurrent fills of the
+ same gradient (e.g. when exporting in bands) are harmless.
+ */
+- (void)buildColorTable
+{
+	NSInteger keys = [self countOfColorStops];
+	CGFloat components[4] = { 0, 0, 0, 0 };
+	CGFloat* entry = mColorTable;
+	NSUInteger i;
+
+	if (keys < 2) {
+		// as -colorAtValue:, a gradient that isn't set up yet is a solid grey, or the colour of its only stop
+
+		NSColor* solid = (keys == 0) ? [NSColor rgbGrey:0.5] : [[[self colorStops] objectAtIndex:0] color];
+
+		[[solid colorUsingColorSpaceName:NSCalibratedRGBColorSpace] getRed:&components[0]
+																	 green:&components[1]
+																	  blue:&components[2]
+																	 alpha:&components[3]];
+
+		for (i = 0; i < kDKGradientColorTableSize; ++i, entry += 4)
+			memcpy(entry, components, sizeof(components));
+	} else {
+		// alpha blending only sets the alpha component, so the colour carries over from one sample to the next as it always has
+
+		for (i = 0; i < kDKGradientColorTableSize; ++i, entry += 4) {
+			[self private_colorAtValue:(CGFloat)i / (kDKGradientColorTableSize - 1)
+							components:components
+						  randomAccess:YES];
+			memcpy(entry, components, sizeof(components));
+		}
+	}
+
+	mColorTableValid = YES;
+}
+
 #define qLogPerformanceMetrics 0
 
 /** @brief Fills the path using the gradient between two given points
@@ -637,6 +724,9 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
  @param ep the ending point of the fill */
 - (CGShadingRef)newLinearShaderForStartingPoint:(NSPoint)sp endPoint:(NSPoint)ep
 {
+	if (!mColorTableValid)
+		[self buildColorTable];
+
 	return CGShadingCreateAxial([DKGradient sharedGradientColorSpace], *(CGPoint*)&sp, *(CGPoint*)&ep, m_cbfunc, YES, YES);
 }
 
@@ -649,6 +739,9 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
  @param er the ending radius */
 - (CGShadingRef)newRadialShaderForStartingPoint:(NSPoint)sp startRadius:(CGFloat)sr endPoint:(NSPoint)ep endRadius:(CGFloat)er
 {
+	if (!mColorTableValid)
+		[self buildColorTable];
+
 	return CGShadingCreateRadial([DKGradient sharedGradientColorSpace], *(CGPoint*)&sp, sr, *(CGPoint*)&ep, er, m_cbfunc, YES, YES);
 }
 
@@ -682,6 +775,69 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 	}
 }
 
+- (CGShadingRef)newShaderForPath:(NSBezierPath*)path centreOffset:(NSPoint)co
+{
+	NSPoint sp, ep;
+	CGFloat sr, er;
+
+	[self getShadingStartingPoint:&sp
+					  startRadius:&sr
+					  endingPoint:&ep
+						endRadius:&er
+						  forPath:path
+					 centreOffset:co];
+
+	switch ([self gradientType]) {
+	case kDKGradientTypeLinear:
+		return [self newLinearShaderForStartingPoint:sp
+											endPoint:ep];
+
+	case kDKGradientTypeRadial:
+		return [self newRadialShaderForStartingPoint:sp
+										 startRadius:sr
+											endPoint:ep
+										   endRadius:er];
+
+	default:
+		return NULL;
+	}
+}
+
+- (void)fillPath:(NSBezierPath*)path withShader:(CGShadingRef)shader
+{
+	if (shader == NULL || [path isEmpty] || [path bounds].size.width <= 0.0 || [path bounds].size.height <= 0.0)
+		return;
+
+	// the shading samples the colour table when it's drawn, so the table must be up to date even though the shading isn't new
+
+	if (!mColorTableValid)
+		[self buildColorTable];
+
+	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
+		[path addClip];
+
+	CGContextDrawShading([[NSGraphicsContext currentContext] graphicsPort], shader);
+	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
+}
+
+- (NSUInteger)shadingChecksum
+{
+	NSUInteger cs = checksumCombine(mColorTableGeneration, [self gradientType]);
+
+	cs = checksumCombine(cs, [self angle]);
+
+	if ([self gradientType] == kDKGradientTypeRadial && m_extensionData != nil) {
+		cs = checksumCombine(cs, [self radialStartingPoint].x);
+		cs = checksumCombine(cs, [self radialStartingPoint].y);
+		cs = checksumCombine(cs, [self radialEndingPoint].x);
+		cs = checksumCombine(cs, [self radialEndingPoint].y);
+		cs = checksumCombine(cs, [self radialStartingRadius]);
+		cs = checksumCombine(cs, [self radialEndingRadius]);
+	}
+
+	return cs;
+}
+
 #pragma mark -
 
 /** @brief Returns the computed Color for the gradient ramp expressed as a value from 0 to 1.0
@@ -819,6 +975,7 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientWillChange
 															object:self];
 		m_blending = bt;
+		[self invalidateColorTable];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidChange
 															object:self];
 	}
@@ -843,6 +1000,7 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientWillChange
 															object:self];
 		m_interp = intrp;
+		[self invalidateColorTable];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKNotificationGradientDidChange
 															object:self];
 	}
@@ -902,6 +1060,8 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 {
 #pragma unused(stop)
 
+	[self invalidateColorTable];
+
 	//	LogEvent_(kStateEvent, @"stop changed color (%@)", stop);
 }
 
@@ -914,6 +1074,8 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 {
 #pragma unused(stop)
 
+	[self invalidateColorTable];
+
 	//	LogEvent_(kStateEvent, @"stop changed position (%@)", stop);
 }
 
@@ -1007,6 +1169,7 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 	[self removeAllColors];
 	[m_colorStops release];
 	CGFunctionRelease(m_cbfunc);
+	free(mColorTable);
 	[m_extensionData release];
 	[super dealloc];
 }
@@ -1018,9 +1181,10 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 		m_colorStops = [[NSMutableArray alloc] init];
 
 		// create the default shader stuff - the shader itself is made when
-		// the fill function is called
+		// the fill function is called. The colour table is filled in the first time it's needed.
 
-		m_cbfunc = makeShaderFunction(self);
+		mColorTable = calloc(kDKGradientColorTableSize * 4, sizeof(CGFloat));
+		m_cbfunc = makeShaderFunction(mColorTable);
 
 		if (m_colorStops == nil) {
 			[self autorelease];
@@ -1081,7 +1245,8 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 	if (self != nil) {
 		[self setColorStops:[coder decodeObjectForKey:@"gradientStops"]];
 		m_extensionData = [[coder decodeObjectForKey:@"extension_data"] mutableCopy];
-		m_cbfunc = makeShaderFunction(self);
+		mColorTable = calloc(kDKGradientColorTableSize * 4, sizeof(CGFloat));
+		m_cbfunc = makeShaderFunction(mColorTable);
 
 		m_gradAngle = [coder decodeDoubleForKey:@"gradientAngle"];
 		m_gradType = [coder decodeIntegerForKey:@"gradientType"];
@@ -1290,62 +1455,50 @@ static NSInteger cmpColorStops(DKColorStop* lh, DKColorStop* rh, void* context)
 
 #pragma mark -
 
-#define qUseDirectComponents 1 // this makes a big difference - almost 5x faster
-#define qUseImpCaching 1 // this makes a tiny difference - just 4% faster
-
 static void shaderCallback(void* info, const CGFloat* in, CGFloat* out)
 {
-	// callback function simply vectors the callback to the object, which handles the actual work.
+	// callback function interpolates between adjacent entries of the gradient's precomputed colour table. This is called for every
+	// sample CoreGraphics needs, so it's kept to plain C.
 
 	if (out == NULL || in == NULL)
 		return;
 
-#if qUseDirectComponents
+	const CGFloat* table = (const CGFloat*)info;
+	CGFloat v = LIMIT(*in, 0.0, 1.0) * (kDKGradientColorTableSize - 1);
+	NSUInteger indx = (NSUInteger)v;
 
-// here we use a number of optimisation tricks to extract maximum performance - caching the function pointer
-// and using raw rgb components and not NSColors
-#if qUseImpCaching
-	static void (*sfunc)(id, SEL, CGFloat, CGFloat*, BOOL) = nil;
-	static SEL ssel = nil;
-
-	if (sfunc == nil) {
-		ssel = @selector(private_colorAtValue:
-								   components:
-								 randomAccess:);
-		sfunc = (void (*)(id, SEL, CGFloat, CGFloat*, BOOL))[DKGradient instanceMethodForSelector : ssel];
+	if (indx >= kDKGradientColorTableSize - 1) {
+		memcpy(out, &table[(kDKGradientColorTableSize - 1) * 4], 4 * sizeof(CGFloat));
+		return;
 	}
 
-	sfunc(info, ssel, *in, out, NO);
-#else
-	[(DKGradient*)info private_colorAtValue:*in
-								 components:out
-							   randomAccess:NO];
-#endif
-#else
-	// ol' faithful - very slow but sure.
-
-	DKGradient* gradient = (DKGradient*)info;
+	const CGFloat* a = &table[indx * 4];
+	const CGFloat* b = a + 4;
+	CGFloat f = v - indx;
 
-	if (gradient != nil) {
-		CGFloat inValue = *in;
-
-		NSColor* Color = [gradient colorAtValue:inValue];
-
-		out[0] = [Color redComponent];
-		out[1] = [Color greenComponent];
-		out[2] = [Color blueComponent];
-		out[3] = [Color alphaComponent];
-	}
-#endif
+	out[0] = a[0] + (b[0] - a[0]) * f;
+	out[1] = a[1] + (b[1] - a[1]) * f;
+	out[2] = a[2] + (b[2] - a[2]) * f;
+	out[3] = a[3] + (b[3] - a[3]) * f;
 }
 
-static CGFunctionRef makeShaderFunction(DKGradient* object)
+static CGFunctionRef makeShaderFunction(const CGFloat* colorTable)
 {
 	static const CGFloat input_value_range[2] = { 0, 1 };
 	static const CGFloat output_value_ranges[8] = { 0, 1, 0, 1, 0, 1, 0, 1 };
 	static const CGFunctionCallbacks callbacks = { 0, shaderCallback, NULL };
 
-	return CGFunctionCreate((void*)object, 1, input_value_range, 4, output_value_ranges, &callbacks);
+	return CGFunctionCreate((void*)colorTable, 1, input_value_range, 4, output_value_ranges, &callbacks);
+}
+
+static NSUInteger checksumCombine(NSUInteger checksum, CGFloat value)
+{
+	double d = value;
+	unsigned long long bits;
+
+	memcpy(&bits, &d, sizeof(bits));
+
+	return (checksum * 31) ^ (NSUInteger)(bits ^ (bits >> 32));
 }
 
 static inline double powerMap(double x, double y)
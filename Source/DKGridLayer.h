@@ -64,6 +64,7 @@ Note: caching in a CGLayer is not recommended - the code is here but it doesn't
 	CGFloat mSpanSupressionScale; // scale below which span is not drawn at all (default = 0.1)
 	CGFloat mSpanCycleChangeThreshold; // scale below which span cycle is incremented
 	CGFloat mCachedViewScale; // view scale cache currently set up for
+	BOOL mDrawsWholeGrid; // YES to build the paths for the entire interior rather than just the update area
 @protected
 	CGFloat mSpanMultiplier; // the span is unit distance x this (usually 1.0)
 	NSUInteger m_divisionsPerSpan; // the number of divisions per span
@@ -128,6 +129,16 @@ Note: caching in a CGLayer is not recommended - the code is here but it doesn't
 - (NSUInteger)majors;
 - (CGFloat)spanMultiplier;
 
+/** @brief Sets whether the grid paths are built for the whole drawing or only the area being drawn
+
+ By default (NO), each update builds paths for the lines that cross the update area only, so the cost of drawing the grid depends on
+ the visible area rather than the size of the drawing. Passing YES builds paths for the whole interior once and keeps them until a grid
+ parameter changes, which was the original behaviour and may suit small drawings that are redrawn in full often.
+ @param wholeGrid YES to cache paths for the whole grid
+ */
+- (void)setDrawsWholeGrid:(BOOL)wholeGrid;
+- (BOOL)drawsWholeGrid;
+
 // hiding elements of the grid
 
 - (void)setDivisionsHidden:(BOOL)hide;
@@ -269,6 +280,14 @@ Note: caching in a CGLayer is not recommended - the code is here but it doesn't
 - (void)adjustSpanCycleForViewScale:(CGFloat)scale;
 - (void)invalidateCache;
 - (void)createGridCacheInRect:(NSRect)r;
+
+/** @brief Adds the grid lines that lie within an area to the cached paths
+
+ Lines are positioned relative to the grid rect, so the grid is the same whatever area is built.
+ @param r the rect in which the grid is defined (typically the drawing interior)
+ @param visibleRect the area to build lines for
+ */
+- (void)createGridCacheInRect:(NSRect)r visibleRect:(NSRect)visibleRect;
 - (void)drawBorderOutline:(DKDrawingView*)aView;
 
 // user actions
@@ -325,6 +325,19 @@ static NSColor* sMajorColour = nil;
 	return mSpanMultiplier;
 }
 
+- (void)setDrawsWholeGrid:(BOOL)wholeGrid
+{
+	if (wholeGrid != mDrawsWholeGrid) {
+		mDrawsWholeGrid = wholeGrid;
+		[self invalidateCache];
+	}
+}
+
+- (BOOL)drawsWholeGrid
+{
+	return mDrawsWholeGrid;
+}
+
 - (void)setDivisionsHidden:(BOOL)hide
 {
 	mDrawsDivisions = !hide;
@@ -769,102 +782,99 @@ static NSColor* sMajorColour = nil;
  */
 - (void)createGridCacheInRect:(NSRect)r
 {
-	CGFloat sp = NSMinX(r);
-	CGFloat lp = 0.0;
-	CGFloat divs;
-	NSUInteger i, m;
-	NSPoint a, b;
+	[self createGridCacheInRect:r
+					visibleRect:r];
+}
+
+static inline void addGridLine(NSBezierPath* path, NSPoint a, NSPoint b)
+{
+	[path moveToPoint:a];
+	[path lineToPoint:b];
+}
 
-	m = 0;
-	divs = [self divisionDistance];
-	a.y = NSMinY(r);
-	b.y = NSMaxY(r);
+/** @brief Adds the grid lines that lie within an area to the cached paths
 
+ Lines are positioned relative to the grid rect, so the grid is the same whatever area is built.
+ @param r the rect in which the grid is defined (typically the drawing interior)
+ @param visibleRect the area to build lines for
+ */
+- (void)createGridCacheInRect:(NSRect)r visibleRect:(NSRect)visibleRect
+{
 	if (mSpanCycle <= 0)
 		mSpanCycle = 1;
 
-	if (m_divsCache == nil) {
-		//float divsDash[2] = { divs * 0.5f, divs * 0.5f };
-
+	if (m_divsCache == nil)
 		m_divsCache = [[NSBezierPath bezierPath] retain];
-		//[m_divsCache setLineDash:divsDash count:2 phase:divs * 0.25f];
-	}
-
-	if (m_spanCache == nil) {
-		//float spanDash[2] = { divs * 2, m_spanDistance - ( divs * 2 )};
 
+	if (m_spanCache == nil)
 		m_spanCache = [[NSBezierPath bezierPath] retain];
-		//[m_spanCache setLineDash:spanDash count:2 phase:divs];
-	}
-
-	if (m_majorsCache == nil) {
-		//float majDash[2] = { divs * 4, m_spansPerMajor * m_spanDistance - (divs * 4)};
 
+	if (m_majorsCache == nil)
 		m_majorsCache = [[NSBezierPath bezierPath] retain];
-		//[m_majorsCache setLineDash:majDash count:2 phase:divs * 2];
-	}
-	// first all the vertical lines
+
+	NSRect vr = NSIntersectionRect(r, visibleRect);
+
+	if (NSIsEmptyRect(vr))
+		return;
+
+	// start at the first span cycle at or before the visible area, so that the major/span sequence is the same as for the whole grid
 
 	CGFloat span = [self spanDistance] * mSpanMultiplier;
+	CGFloat divs = [self divisionDistance];
+	NSUInteger divsPerCycle = m_divisionsPerSpan * mSpanCycle;
+	NSUInteger i, m, firstM, lastM;
+	CGFloat lp;
+	NSPoint a, b;
 
-	while (lp < NSMaxX(r)) {
-		lp = sp + (m * span);
-
-		if ((m % m_spansPerMajor) == 0) {
-			// drawing a major line
-			a.x = b.x = lp;
-			[m_majorsCache moveToPoint:a];
-			[m_majorsCache lineToPoint:b];
-		} else {
-			a.x = b.x = lp;
-			[m_spanCache moveToPoint:a];
-			[m_spanCache lineToPoint:b];
-		}
+	if (span <= 0.0)
+		return;
+
+	// first all the vertical lines
+
+	firstM = (NSUInteger)floor((NSMinX(vr) - NSMinX(r)) / span);
+	firstM -= firstM % mSpanCycle;
+	lastM = (NSUInteger)ceil((NSMaxX(vr) - NSMinX(r)) / span);
+	a.y = NSMinY(vr);
+	b.y = NSMaxY(vr);
+
+	for (m = firstM; m <= lastM; m += mSpanCycle) {
+		lp = NSMinX(r) + (m * span);
+		a.x = b.x = lp;
+
+		if (lp >= NSMinX(vr) && lp <= NSMaxX(vr))
+			addGridLine(((m % m_spansPerMajor) == 0) ? m_majorsCache : m_spanCache, a, b);
 
 		// subdivide each span into the number of divisions
 
-		for (i = 0; i < (m_divisionsPerSpan * mSpanCycle); ++i) {
-			if (lp <= NSMaxX(r)) {
+		for (i = 0; i < divsPerCycle && lp <= NSMaxX(vr); ++i, lp += divs) {
+			if (lp >= NSMinX(vr)) {
 				a.x = b.x = lp;
-				[m_divsCache moveToPoint:a];
-				[m_divsCache lineToPoint:b];
-			} else
-				break;
-			lp += divs;
+				addGridLine(m_divsCache, a, b);
+			}
 		}
-		m += mSpanCycle;
 	}
 
 	// horizontal lines:
 
-	sp = lp = NSMinY(r);
-	m = 0;
-	a.x = NSMinX(r);
-	b.x = NSMaxX(r);
-
-	while (lp <= NSMaxY(r)) {
-		lp = sp + (m * span);
-
-		if ((m % m_spansPerMajor) == 0) {
-			// drawing a major line
-			a.y = b.y = lp;
-			[m_majorsCache moveToPoint:a];
-			[m_majorsCache lineToPoint:b];
-		} else {
-			a.y = b.y = lp;
-			[m_spanCache moveToPoint:a];
-			[m_spanCache lineToPoint:b];
-		}
-		for (i = 0; i < (m_divisionsPerSpan * mSpanCycle); ++i) {
-			if (lp <= NSMaxY(r)) {
+	firstM = (NSUInteger)floor((NSMinY(vr) - NSMinY(r)) / span);
+	firstM -= firstM % mSpanCycle;
+	lastM = (NSUInteger)ceil((NSMaxY(vr) - NSMinY(r)) / span);
+	a.x = NSMinX(vr);
+	b.x = NSMaxX(vr);
+
+	for (m = firstM; m <= lastM; m += mSpanCycle) {
+		lp = NSMinY(r) + (m * span);
+		a.y = b.y = lp;
+
+		if (lp >= NSMinY(vr) && lp <= NSMaxY(vr))
+			addGridLine(((m % m_spansPerMajor) == 0) ? m_majorsCache : m_spanCache, a, b);
+
+		for (i = 0; i < divsPerCycle && lp <= NSMaxY(vr); ++i, lp += divs) {
+			if (lp >= NSMinY(vr)) {
 				a.y = b.y = lp;
-				[m_divsCache moveToPoint:a];
-				[m_divsCache lineToPoint:b];
-			} else
-				break;
-			lp += divs;
+				addGridLine(m_divsCache, a, b);
+			}
 		}
-		m += mSpanCycle;
 	}
 }
 
@@ -915,15 +925,21 @@ static NSColor* sMajorColour = nil;
  */
 - (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView
 {
-#pragma unused(rect)
-
 	// if the view scale has crossed the threshold for span cycle change, invalidate the cache
 
 	[self adjustSpanCycleForViewScale:[aView scale]];
 
 	NSRect mr = [[self drawing] interior];
 
-	if (m_divsCache == nil)
+	if (![self drawsWholeGrid]) {
+		// build just the lines that cross the update area. It's outset by the widest line so that lines just outside still contribute their edges
+
+		[m_divsCache removeAllPoints];
+		[m_spanCache removeAllPoints];
+		[m_majorsCache removeAllPoints];
+		[self createGridCacheInRect:mr
+						visibleRect:NSInsetRect(rect, -1.0, -1.0)];
+	} else if (m_divsCache == nil)
 		[self createGridCacheInRect:mr];
 
 	// be smart about colour: if the drawing has a dark background, switch the divs and majors colours to give better contrast
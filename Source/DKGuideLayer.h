@@ -31,6 +31,8 @@ the shift key down.
 	CGFloat m_snapTolerance; // the current snap tolerance value
 	NSRect mGuideDeletionZone; // guides dragged outside this rect are deleted
 	BOOL mDrawGuidesInClipView; // if YES, guides are extended to be drawn in the clip view of an enclosing scroller
+	NSMutableData* mVerticalIndex; // vertical guides sorted by position, for snapping (nil when out of date)
+	NSMutableData* mHorizontalIndex; // horizontal guides sorted by position, for snapping (nil when out of date)
 }
 
 // default snapping tolerance:
@@ -306,6 +308,7 @@ the shift key down.
 	CGFloat m_position;
 	BOOL m_isVertical;
 	NSColor* m_colour;
+	DKGuideLayer* m_layerRef; // the layer the guide belongs to (weak), which is told when the guide moves
 }
 
 /** @brief Sets the position of the guide
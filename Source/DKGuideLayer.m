@@ -26,8 +26,51 @@
 - (void)repositionGuide:(DKGuide*)guide atPoint:(NSPoint)p inView:(NSView*)aView;
 - (NSRect)guideRectOfGuide:(DKGuide*)guide forEnclosingClipViewOfView:(NSView*)aView;
 
+/** @brief Discards the sorted guide indexes so they are rebuilt when next needed
+
+ Called whenever a guide is added, removed or moved.
+ */
+- (void)invalidateGuideIndex;
+- (DKGuide*)nearestGuideInIndex:(NSMutableData*)index toPosition:(CGFloat)pos;
+
 @end
 
+@interface DKGuide (Private)
+
+- (void)setGuideLayer:(DKGuideLayer*)layer;
+
+@end
+
+// an entry in a sorted guide index
+
+typedef struct {
+	CGFloat position;
+	DKGuide* guide;
+} DKGuideIndexEntry;
+
+static int compareGuideIndexEntries(const void* a, const void* b)
+{
+	CGFloat pa = ((const DKGuideIndexEntry*)a)->position;
+	CGFloat pb = ((const DKGuideIndexEntry*)b)->position;
+
+	return (pa < pb) ? -1 : ((pa > pb) ? 1 : 0);
+}
+
+static NSMutableData* newGuideIndexForGuides(NSArray* guides)
+{
+	NSUInteger i, count = [guides count];
+	NSMutableData* index = [NSMutableData dataWithLength:count * sizeof(DKGuideIndexEntry)];
+	DKGuideIndexEntry* entries = [index mutableBytes];
+
+	for (i = 0; i < count; ++i) {
+		entries[i].guide = [guides objectAtIndex:i];
+		entries[i].position = [entries[i].guide guidePosition];
+	}
+
+	qsort(entries, count, sizeof(DKGuideIndexEntry), compareGuideIndexEntries);
+	return [index retain];
+}
+
 #pragma mark Static Vars
 static CGFloat sSnapTolerance = 6.0;
 
@@ -74,6 +117,8 @@ static BOOL sWasInside = NO;
 	else
 		[m_hGuides addObject:guide];
 
+	[guide setGuideLayer:self];
+	[self invalidateGuideIndex];
 	[guide setGuideColour:[self guideColour]];
 	[self refreshGuide:guide];
 
@@ -97,6 +142,9 @@ static BOOL sWasInside = NO;
 	else
 		[m_hGuides removeObject:guide];
 
+	[guide setGuideLayer:nil];
+	[self invalidateGuideIndex];
+
 	if (!([[self undoManager] isUndoing] || [[self undoManager] isRedoing]))
 		[[self undoManager] setActionName:NSLocalizedString(@"Delete Guide", @"undo action for Remove Guide")];
 }
@@ -108,8 +156,13 @@ static BOOL sWasInside = NO;
 	if (![self locked]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setGuides:[self guides]];
 
+		[m_vGuides makeObjectsPerformSelector:@selector(setGuideLayer:)
+								  withObject:nil];
+		[m_hGuides makeObjectsPerformSelector:@selector(setGuideLayer:)
+								  withObject:nil];
 		[m_vGuides removeAllObjects];
 		[m_hGuides removeAllObjects];
+		[self invalidateGuideIndex];
 		[self setNeedsDisplay:YES];
 	}
 }
@@ -117,49 +170,33 @@ static BOOL sWasInside = NO;
 #pragma mark -
 
 /** @brief Locates the nearest guide to the given position, if position is within the snap tolerance
+
+ The guides are searched using a sorted index, so the cost is O(log n) in the number of guides.
  @param pos a verical coordinate value, in points
  @return the nearest guide to the given point that lies within the snap tolerance, or nil
  */
 - (DKGuide*)nearestVerticalGuideToPosition:(CGFloat)pos
 {
-	NSEnumerator* iter = [[self verticalGuides] objectEnumerator];
-	DKGuide* guide;
-	DKGuide* nearestGuide = nil;
-	CGFloat nearestDistance = 10000, distance;
-
-	while ((guide = [iter nextObject])) {
-		distance = _CGFloatFabs(pos - [guide guidePosition]);
+	if (mVerticalIndex == nil)
+		mVerticalIndex = newGuideIndexForGuides([self verticalGuides]);
 
-		if (distance < [self snapTolerance] && distance < nearestDistance) {
-			nearestDistance = distance;
-			nearestGuide = guide;
-		}
-	}
-
-	return nearestGuide;
+	return [self nearestGuideInIndex:mVerticalIndex
+						  toPosition:pos];
 }
 
 /** @brief Locates the nearest guide to the given position, if position is within the snap tolerance
+
+ The guides are searched using a sorted index, so the cost is O(log n) in the number of guides.
  @param pos a horizontal coordinate value, in points
  @return the nearest guide to the given point that lies within the snap tolerance, or nil
  */
 - (DKGuide*)nearestHorizontalGuideToPosition:(CGFloat)pos
 {
-	NSEnumerator* iter = [[self horizontalGuides] objectEnumerator];
-	DKGuide* guide;
-	DKGuide* nearestGuide = nil;
-	CGFloat nearestDistance = 10000, distance;
+	if (mHorizontalIndex == nil)
+		mHorizontalIndex = newGuideIndexForGuides([self horizontalGuides]);
 
-	while ((guide = [iter nextObject])) {
-		distance = _CGFloatFabs(pos - [guide guidePosition]);
-
-		if (distance < [self snapTolerance] && distance < nearestDistance) {
-			nearestDistance = distance;
-			nearestGuide = guide;
-		}
-	}
-
-	return nearestGuide;
+	return [self nearestGuideInIndex:mHorizontalIndex
+						  toPosition:pos];
 }
 
 /** @brief Returns the list of vertical guides
@@ -596,6 +633,54 @@ static BOOL sWasInside = NO;
 
 #pragma mark -
 
+- (void)invalidateGuideIndex
+{
+	[mVerticalIndex release];
+	mVerticalIndex = nil;
+	[mHorizontalIndex release];
+	mHorizontalIndex = nil;
+}
+
+- (DKGuide*)nearestGuideInIndex:(NSMutableData*)index toPosition:(CGFloat)pos
+{
+	// binary search for the first guide at or beyond <pos> - the nearest guide is either that one or the one before it
+
+	const DKGuideIndexEntry* entries = [index bytes];
+	NSUInteger count = [index length] / sizeof(DKGuideIndexEntry);
+	NSUInteger lo = 0, hi = count, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+
+		if (entries[mid].position < pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	DKGuide* nearestGuide = nil;
+	CGFloat nearestDistance = [self snapTolerance];
+	CGFloat distance;
+
+	if (lo > 0) {
+		distance = pos - entries[lo - 1].position;
+
+		if (distance < nearestDistance) {
+			nearestDistance = distance;
+			nearestGuide = entries[lo - 1].guide;
+		}
+	}
+
+	if (lo < count) {
+		distance = entries[lo].position - pos;
+
+		if (distance < nearestDistance)
+			nearestGuide = entries[lo].guide;
+	}
+
+	return nearestGuide;
+}
+
 /** @brief Set whether the info window should be displayed when dragging a guide
 
  Default is YES, display the window
@@ -1059,8 +1144,14 @@ static BOOL sWasInside = NO;
  */
 - (void)dealloc
 {
+	[m_vGuides makeObjectsPerformSelector:@selector(setGuideLayer:)
+							  withObject:nil];
+	[m_hGuides makeObjectsPerformSelector:@selector(setGuideLayer:)
+							  withObject:nil];
 	[m_hGuides release];
 	[m_vGuides release];
+	[mVerticalIndex release];
+	[mHorizontalIndex release];
 
 	[super dealloc];
 }
@@ -1125,6 +1216,10 @@ static BOOL sWasInside = NO;
 	if (self != nil) {
 		m_hGuides = [[coder decodeObjectForKey:@"horizontalguides"] mutableCopy];
 		m_vGuides = [[coder decodeObjectForKey:@"verticalguides"] mutableCopy];
+		[m_vGuides makeObjectsPerformSelector:@selector(setGuideLayer:)
+								  withObject:self];
+		[m_hGuides makeObjectsPerformSelector:@selector(setGuideLayer:)
+								  withObject:self];
 
 		m_snapToGrid = [coder decodeBoolForKey:@"snapstogrid"];
 		m_showDragInfo = [coder decodeBoolForKey:@"showdraginfo"];
@@ -1170,7 +1265,10 @@ static BOOL sWasInside = NO;
  */
 - (void)setGuidePosition:(CGFloat)pos
 {
-	m_position = pos;
+	if (pos != m_position) {
+		m_position = pos;
+		[m_layerRef invalidateGuideIndex];
+	}
 }
 
 /** @brief Returns the position of the guide
@@ -1197,6 +1295,11 @@ static BOOL sWasInside = NO;
 	return m_isVertical;
 }
 
+- (void)setGuideLayer:(DKGuideLayer*)layer
+{
+	m_layerRef = layer;
+}
+
 - (void)setGuideColour:(NSColor*)colour
 {
 	[colour retain];
@@ -42,6 +42,15 @@ DKHandle is a base class for all handles, which are the knobs attached to shapes
 
 - (void)drawAtPoint:(NSPoint)point;
 - (void)drawAtPoint:(NSPoint)point angle:(CGFloat)radians;
+
+/** @brief Draws the handle at a series of points
+
+ Equivalent to calling -drawAtPoint:angle: for each point, but the graphics state is only set up once for the whole run.
+ @param points an array of <count> points
+ @param angles an array of <count> angles in radians, or NULL for no rotation
+ @param count the number of points
+ */
+- (void)drawAtPoints:(const NSPoint*)points angles:(const CGFloat*)angles count:(NSUInteger)count;
 - (BOOL)hitTestPoint:(NSPoint)point inHandleAtPoint:(NSPoint)hp;
 
 @end
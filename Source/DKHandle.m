@@ -196,6 +196,16 @@ static NSMutableDictionary* s_handleInstancesTable = nil;
 
 - (void)drawAtPoint:(NSPoint)point angle:(CGFloat)radians
 {
+	[self drawAtPoints:&point
+				angles:&radians
+				 count:1];
+}
+
+- (void)drawAtPoints:(const NSPoint*)points angles:(const CGFloat*)angles count:(NSUInteger)count
+{
+	if (count == 0)
+		return;
+
 	if (mCache == nil) {
 		mCache = [[DKQuartzCache cacheForCurrentContextWithSize:[self size]] retain];
 
@@ -231,20 +241,23 @@ static NSMutableDictionary* s_handleInstancesTable = nil;
 
 	CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
 	CGAffineTransform ctm = CGContextGetCTM(context);
-	CGAffineTransform newTfm = CGAffineTransformIdentity;
-
 	CGFloat compScale = 1.0 / ctm.a;
+	NSUInteger i;
 
-	newTfm = CGAffineTransformTranslate(newTfm, point.x, point.y);
+	for (i = 0; i < count; ++i) {
+		CGAffineTransform newTfm = CGAffineTransformMakeTranslation(points[i].x, points[i].y);
 
-	if (radians != 0)
-		newTfm = CGAffineTransformRotate(newTfm, radians);
+		if (angles && angles[i] != 0)
+			newTfm = CGAffineTransformRotate(newTfm, angles[i]);
 
-	newTfm = CGAffineTransformScale(newTfm, compScale, compScale);
-	newTfm = CGAffineTransformTranslate(newTfm, -[self size].width * 0.5, -[self size].height * 0.5);
-	CGContextConcatCTM(context, newTfm);
+		newTfm = CGAffineTransformScale(newTfm, compScale, compScale);
+		newTfm = CGAffineTransformTranslate(newTfm, -[self size].width * 0.5, -[self size].height * 0.5);
 
-	[mCache drawAtPoint:NSZeroPoint];
+		CGContextSaveGState(context);
+		CGContextConcatCTM(context, newTfm);
+		[mCache drawAtPoint:NSZeroPoint];
+		CGContextRestoreGState(context);
+	}
 
 	RESTORE_GRAPHICS_CONTEXT
 }
@@ -5,6 +5,7 @@
 */
 
 #import "DKRasterizer.h"
+#import "DKCacheRegistry.h"
 
 @class DKStrokeDash;
 
@@ -18,8 +19,17 @@ Can be set as a fill style in a DKStyle object.
 The hatch is cached in an NSBezierPath object based on the bounds of the path. If another path is hatched that is smaller
 than the cached size, it is not rebuilt. It is rebuilt if the angle or spacing changes or a bigger path is hatched. Linewidth also
 doesn't change the cache.
+
+When a hatch is rendered for an object and has no dash, roughness or line caps, the lines are instead clipped to the object's path
+by working out where they cross its edges, and the clipped lines are kept in the object's rendering cache. Many objects sharing one
+hatch then each draw only their own short lines, rather than the whole shared cache clipped to their path. The shared cache remains
+for the other cases and for -hatchPath:.
+
+A hatch can instead draw a dot screen: round dots of the line width on a square grid of the spacing, turned to the angle. On screen, the
+screen is drawn by tiling an image of one dot clipped to the path, rather than by stroking and capping a zero-length dash for every dot,
+so a large stippled area costs about the same as a flat fill at any scale. Printing, rough or wobbly screens draw each dot as a path.
 */
-@interface DKHatching : DKRasterizer <NSCoding, NSCopying> {
+@interface DKHatching : DKRasterizer <NSCoding, NSCopying, DKPurgeableCache> {
 @private
 	NSBezierPath* m_cache;
 	NSBezierPath* mRoughenedCache;
@@ -35,6 +45,9 @@ doesn't change the cache.
 	BOOL mRoughenStrokes;
 	CGFloat mRoughness;
 	CGFloat mWobblyness;
+	BOOL mDotScreen;
+	CGImageRef mDotTile; // one dot of the screen at device resolution, tiled to draw it
+	NSUInteger mDotTileChecksum; // the settings <mDotTile> was made with
 }
 
 /** @brief Return the default hatching
@@ -57,9 +70,9 @@ doesn't change the cache.
 
 /** @brief Return a hatching which implements a dot pattern
 
- The colour is set to black. The dot pattern is created using a dashed line at 45 degrees where
- the line and dash spacing is set to the dot pitch. The line width is the dot diameter and the
- rounded cap style is used. This is an efficient way to implement a dot pattern of a given density.
+ The colour is set to black. The hatching draws a dot screen at 45 degrees whose spacing is the dot
+ pitch and whose line width is the dot diameter. It also has a dash and rounded caps that draw the
+ same dots, so that it looks the same to code that reads those settings.
  @param pitch the spacing between the dots
  @param diameter the dot diameter
  @return a hatching instance having the given dot pattern
@@ -124,6 +137,15 @@ doesn't change the cache.
 - (DKStrokeDash*)dash;
 - (void)setAutoDash;
 
+/** @brief Sets whether the hatching draws a dot screen rather than lines
+
+ A dot screen places a round dot of diameter -width at every -spacing along lines -spacing apart, so the dots form a square grid
+ at -angle. The dash and line cap are ignored while it is set.
+ @param dots YES to draw dots
+ */
+- (void)setDrawsDotScreen:(BOOL)dots;
+- (BOOL)drawsDotScreen;
+
 - (void)setRoughness:(CGFloat)amount;
 - (CGFloat)roughness;
 - (void)setWobblyness:(CGFloat)wobble;
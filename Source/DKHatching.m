@@ -6,13 +6,185 @@
 
 #import "DKHatching.h"
 #import "DKDrawKitMacros.h"
+#import "DKStyle.h"
 #import "DKStrokeDash.h"
 #import "NSBezierPath+Geometry.h"
 #import "DKRandom.h"
 
+#define kDKHatchExactClipWidth 1.0 // hatch lines wider than this are still clipped to the path so that their ends follow it exactly
+#define kDKHatchMaximumDotTileSize 1024 // dot screens whose tile would be larger than this in pixels have their dots stroked instead
+
+// a point where a hatch line crosses an edge of the path being hatched. <t> is the position along the line and <dir> is +1 or -1
+// according to which way the edge crosses it.
+
+typedef struct {
+	NSInteger line;
+	CGFloat t;
+	NSInteger dir;
+} DKHatchCrossing;
+
+typedef struct {
+	DKHatchCrossing* crossings;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKHatchCrossingList;
+
+// the hatch lines in the hatch's own frame, where they run bottom to top. Line <i> goes from (ax[i], y0) to (bx[i], y1).
+
+typedef struct {
+	const CGFloat* ax;
+	const CGFloat* bx;
+	NSInteger count;
+	CGFloat y0;
+	CGFloat y1;
+	CGFloat firstX;
+	CGFloat spacing;
+	CGFloat maxWobble;
+} DKHatchLines;
+
+static void addCrossingsForEdge(DKHatchCrossingList* list, const DKHatchLines* lines, NSPoint p, NSPoint q)
+{
+	// finds the hatch lines that the edge <p>..<q> crosses. Only lines whose x range overlaps the edge's are tested. An end point that lies
+	// exactly on a line counts as being to the right of it, so an edge that ends on a line and the edge that starts there cross it once between them.
+
+	CGFloat minX = MIN(p.x, q.x) - lines->maxWobble;
+	CGFloat maxX = MAX(p.x, q.x) + lines->maxWobble;
+	NSInteger first = MAX(0, (NSInteger)floor((minX - lines->firstX) / lines->spacing));
+	NSInteger last = MIN(lines->count - 1, (NSInteger)ceil((maxX - lines->firstX) / lines->spacing));
+	CGFloat height = lines->y1 - lines->y0;
+	NSInteger i;
+
+	for (i = first; i <= last; ++i) {
+		CGFloat k = (lines->bx[i] - lines->ax[i]) / height;
+		CGFloat fp = p.x - (lines->ax[i] + k * (p.y - lines->y0));
+		CGFloat fq = q.x - (lines->ax[i] + k * (q.y - lines->y0));
+
+		if ((fp < 0) == (fq < 0))
+			continue;
+
+		if (list->count == list->capacity) {
+			list->capacity = MAX(64, list->capacity * 2);
+			list->crossings = realloc(list->crossings, list->capacity * sizeof(DKHatchCrossing));
+		}
+
+		DKHatchCrossing* c = &list->crossings[list->count++];
+
+		c->line = i;
+		c->t = p.y + (q.y - p.y) * (fp / (fp - fq));
+		c->dir = (fp < 0) ? 1 : -1;
+	}
+}
+
+static int compareCrossings(const void* a, const void* b)
+{
+	const DKHatchCrossing* ca = a;
+	const DKHatchCrossing* cb = b;
+
+	if (ca->line != cb->line)
+		return (ca->line < cb->line) ? -1 : 1;
+
+	if (ca->t != cb->t)
+		return (ca->t < cb->t) ? -1 : 1;
+
+	return 0;
+}
+
+static inline NSPoint pointOnHatchLine(const DKHatchLines* lines, NSInteger i, CGFloat t)
+{
+	return NSMakePoint(lines->ax[i] + (lines->bx[i] - lines->ax[i]) * (t - lines->y0) / (lines->y1 - lines->y0), t);
+}
+
+static NSBezierPath* clippedHatchLines(NSBezierPath* flatPath, NSAffineTransform* toHatch, const DKHatchLines* lines)
+{
+	// returns the parts of the hatch lines inside <flatPath>, in the hatch's frame. <toHatch> maps the path into that frame. Each line
+	// is walked from bottom to top through the edges it crosses, counting the winding number, and kept where the path's winding rule
+	// says it is inside.
+
+	DKHatchCrossingList list = { NULL, 0, 0 };
+	NSInteger i, ec = [flatPath elementCount];
+	NSPoint ap[3], start = NSZeroPoint, last = NSZeroPoint;
+	BOOL open = NO;
+
+	for (i = 0; i < ec; ++i) {
+		NSBezierPathElement element = [flatPath elementAtIndex:i
+											  associatedPoints:ap];
+
+		switch (element) {
+		case NSMoveToBezierPathElement:
+			if (open && !NSEqualPoints(last, start))
+				addCrossingsForEdge(&list, lines, last, start);
+
+			start = last = [toHatch transformPoint:ap[0]];
+			open = YES;
+			break;
+
+		case NSLineToBezierPathElement:
+		case NSCurveToBezierPathElement: {
+			NSPoint p = [toHatch transformPoint:(element == NSLineToBezierPathElement) ? ap[0] : ap[2]];
+
+			addCrossingsForEdge(&list, lines, last, p);
+			last = p;
+		} break;
+
+		case NSClosePathBezierPathElement:
+			if (!NSEqualPoints(last, start))
+				addCrossingsForEdge(&list, lines, last, start);
+
+			last = start;
+			open = NO;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// a path is filled as if its open subpaths were closed
+
+	if (open && !NSEqualPoints(last, start))
+		addCrossingsForEdge(&list, lines, last, start);
+
+	NSBezierPath* result = [NSBezierPath bezierPath];
+	BOOL evenOdd = ([flatPath windingRule] == NSEvenOddWindingRule);
+	NSUInteger n = 0;
+
+	qsort(list.crossings, list.count, sizeof(DKHatchCrossing), compareCrossings);
+
+	while (n < list.count) {
+		NSInteger line = list.crossings[n].line;
+		NSInteger winding = 0;
+		CGFloat entry = 0.0;
+
+		for (; n < list.count && list.crossings[n].line == line; ++n) {
+			BOOL wasInside = evenOdd ? (winding & 1) : (winding != 0);
+
+			winding += list.crossings[n].dir;
+
+			BOOL isInside = evenOdd ? (winding & 1) : (winding != 0);
+
+			if (isInside && !wasInside)
+				entry = list.crossings[n].t;
+			else if (wasInside && !isInside && list.crossings[n].t > entry) {
+				[result moveToPoint:pointOnHatchLine(lines, line, entry)];
+				[result lineToPoint:pointOnHatchLine(lines, line, list.crossings[n].t)];
+			}
+		}
+	}
+
+	free(list.crossings);
+
+	return result;
+}
+
+#pragma mark -
+
 @interface DKHatching (Private)
 
 - (void)invalidateRoughnessCache;
+- (BOOL)canClipHatchToObjects;
+- (NSBezierPath*)clippedHatchForObject:(id<DKRenderable>)obj;
+- (BOOL)drawDotScreenInPath:(NSBezierPath*)path objectAngle:(CGFloat)oa;
+- (void)invalidateDotTile;
 
 @end
 
@@ -56,9 +228,9 @@
 
 /** @brief Return a hatching which implements a dot pattern
 
- The colour is set to black. The dot pattern is created using a dashed line at 45 degrees where
- the line and dash spacing is set to the dot pitch. The line width is the dot diameter and the
- rounded cap style is used. This is an efficient way to implement a dot pattern of a given density.
+ The colour is set to black. The hatching draws a dot screen at 45 degrees whose spacing is the dot
+ pitch and whose line width is the dot diameter. It also has a dash and rounded caps that draw the
+ same dots, so that it looks the same to code that reads those settings.
  @param pitch the spacing between the dots
  @param diameter the dot diameter
  @return a hatching instance having the given dot pattern
@@ -79,6 +251,7 @@
 	[dash setScalesToLineWidth:NO];
 	[hatch setDash:dash];
 	[hatch setLineCapStyle:NSRoundLineCapStyle];
+	[hatch setDrawsDotScreen:YES];
 
 	return hatch;
 }
@@ -116,6 +289,14 @@
  */
 - (void)hatchPath:(NSBezierPath*)path objectAngle:(CGFloat)oa
 {
+	// a dot screen on screen is drawn by tiling one dot, which doesn't need the cache at all
+
+	if (mDotScreen && !mRoughenStrokes && mWobblyness == 0.0 && DKRenderIsDrawingToScreen()) {
+		if ([self drawDotScreenInPath:path
+						  objectAngle:oa])
+			return;
+	}
+
 	// if the bounds size of <path> is larger than the cached hatch, then we'll need to enlarge the cache, so invalidate
 	// it.
 
@@ -146,21 +327,32 @@
 
 		CGFloat actualLineWidth = [self width];
 
-		if (![NSGraphicsContext currentContextDrawingToScreen]) {
+		if (!DKRenderIsDrawingToScreen()) {
 			if (actualLineWidth <= 0.0)
 				actualLineWidth = 0.05; // hairline
 		}
 
 		[m_cache setLineWidth:actualLineWidth];
 
-		if ([self dash])
-			[[self dash] applyToPath:m_cache];
-		else
-			[m_cache setLineDash:nil
-						   count:0
+		if (mDotScreen) {
+			// each dot is a zero-length dash with round caps
+
+			CGFloat dotDash[2] = { 0.0, [self spacing] };
+
+			[m_cache setLineDash:dotDash
+						   count:2
 						   phase:0.0f];
+			[m_cache setLineCapStyle:NSRoundLineCapStyle];
+		} else {
+			if ([self dash])
+				[[self dash] applyToPath:m_cache];
+			else
+				[m_cache setLineDash:nil
+							   count:0
+							   phase:0.0f];
 
-		[m_cache setLineCapStyle:[self lineCapStyle]];
+			[m_cache setLineCapStyle:[self lineCapStyle]];
+		}
 		[m_cache setLineJoinStyle:[self lineJoinStyle]];
 
 		[[self colour] set];
@@ -186,8 +378,13 @@
 		if (mRoughenStrokes) {
 			NSBezierPath* roughHatch;
 
-			if (mRoughenedCache == nil)
-				mRoughenedCache = [[m_cache bezierPathWithRoughenedStrokeOutline:[self roughness] * [self width]] retain];
+			if (mRoughenedCache == nil) {
+				DKRandomState rs;
+
+				DKRandomSeed(&rs, ~DKRandomSeedForObject(self));
+				mRoughenedCache = [[m_cache bezierPathWithRoughenedStrokeOutline:[self roughness] * [self width]
+																	  randomState:&rs] retain];
+			}
 
 			if (oa != 0.0)
 				roughHatch = [xform transformBezierPath:mRoughenedCache];
@@ -296,6 +493,7 @@
 {
 	m_lineWidth = width;
 	[self invalidateRoughnessCache];
+	[self invalidateDotTile];
 }
 
 - (CGFloat)width
@@ -331,6 +529,7 @@
 	[colour retain];
 	[m_hatchColour release];
 	m_hatchColour = colour;
+	[self invalidateDotTile];
 }
 
 - (NSColor*)colour
@@ -390,12 +589,26 @@
 	return mWobblyness;
 }
 
+- (void)setDrawsDotScreen:(BOOL)dots
+{
+	if (dots != mDotScreen) {
+		mDotScreen = dots;
+		[self invalidateCache];
+	}
+}
+
+- (BOOL)drawsDotScreen
+{
+	return mDotScreen;
+}
+
 #pragma mark -
 - (void)invalidateCache
 {
 	[m_cache release];
 	m_cache = nil;
 	[self invalidateRoughnessCache];
+	[self invalidateDotTile];
 }
 
 - (void)calcHatchInRect:(NSRect)rect
@@ -407,11 +620,23 @@
 	if (m_cache == nil) {
 		m_cache = [[NSBezierPath bezierPath] retain];
 
+		// registering again is harmless, and covers hatches made by any initializer or copy
+
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeLayout];
+
 		NSRect cr;
 
 		cr.size.width = cr.size.height = (MAX(rect.size.width, rect.size.height) * 1.5f);
 		cr.origin.x = cr.origin.y = (cr.size.width * -0.5f);
 
+		// the dots of a dot screen fall on the grid of the spacing, as they do when the screen is tiled
+
+		if (mDotScreen) {
+			cr.origin.x = cr.origin.y = floor(cr.origin.x / [self spacing]) * [self spacing];
+			cr.size.width = cr.size.height = cr.size.width + [self spacing];
+		}
+
 		//LogEvent_(kReactiveEvent,  @"hatch origin rect = {%f, %f},{%f, %f}", cr.origin.x, cr.origin.y, cr.size.width, cr.size.height );
 
 		NSInteger i, m;
@@ -424,17 +649,25 @@
 
 		// wobblyness is a randomising factor 0..1 which displaces the end points of the hatch by a random amount
 		// relative to the spacing. It is used to give a more naturalistic type of hatch (esp. in conjunction with roughness).
+		// The random amounts are seeded from the hatch, so it wobbles the same way every time it's worked out.
 
 		CGFloat maxWobble = mWobblyness * [self spacing];
+		CGFloat* wobble = malloc(m * sizeof(CGFloat) * 2);
+		DKRandomState rs;
+
+		DKRandomSeed(&rs, DKRandomSeedForObject(self));
+		DKRandomFillSigned(&rs, wobble, m * 2);
 
 		for (i = 0; i < m; i++) {
-			a.x = cr.origin.x + m_leadIn + (i * [self spacing]) + ([DKRandom randomPositiveOrNegativeNumber] * maxWobble);
-			b.x = cr.origin.x + m_leadIn + (i * [self spacing]) + ([DKRandom randomPositiveOrNegativeNumber] * maxWobble);
+			a.x = cr.origin.x + m_leadIn + (i * [self spacing]) + (wobble[i] * maxWobble);
+			b.x = cr.origin.x + m_leadIn + (i * [self spacing]) + (wobble[m + i] * maxWobble);
 
 			[m_cache moveToPoint:a];
 			[m_cache lineToPoint:b];
 		}
 
+		free(wobble);
+
 		// now rotate the cache to the current angle
 
 		NSAffineTransform* rot = [NSAffineTransform transform];
@@ -449,6 +682,166 @@
 	mRoughenedCache = nil;
 }
 
+- (BOOL)canClipHatchToObjects
+{
+	// dashes would restart at the start of every clipped segment, roughening outlines the lines past their ends and caps other than
+	// butt extend beyond them, so those hatches are drawn by clipping the shared cache instead.
+
+	return m_hatchDash == nil && !mRoughenStrokes && m_cap == NSButtLineCapStyle && m_spacing > 0 && !mDotScreen;
+}
+
+- (NSBezierPath*)clippedHatchForObject:(id<DKRenderable>)obj
+{
+	// returns the hatch lines clipped to the object's path, worked out directly from where the lines cross the path's edges. The result
+	// is kept in the object's rendering cache, so an object is only hatched again when it or the hatch changes. The lines are laid out
+	// as -calcHatchInRect: would for the object's own bounds.
+
+	NSBezierPath* path = [obj renderingPath];
+	NSBezierPath* flatPath = [self flattenedRenderingPathForObject:obj];
+	NSBezierPath* hatch = [self cachedPathForObject:obj
+										 sourcePath:flatPath];
+
+	if (hatch != nil)
+		return hatch;
+
+	NSRect br = [path bounds];
+
+	if (NSIsEmptyRect(br))
+		return nil;
+
+	CGFloat size = MAX(br.size.width, br.size.height) * 1.5f;
+	CGFloat maxWobble = mWobblyness * m_spacing;
+	NSInteger i, m = _CGFloatLround(size / m_spacing) + 1;
+	CGFloat* ax = malloc(m * sizeof(CGFloat) * 2);
+	CGFloat* bx = ax + m;
+	DKHatchLines lines;
+
+	lines.ax = ax;
+	lines.bx = bx;
+	lines.count = m;
+	lines.y0 = size * -0.5f;
+	lines.y1 = size * 0.5f;
+	lines.firstX = lines.y0 + m_leadIn;
+	lines.spacing = m_spacing;
+	lines.maxWobble = maxWobble;
+
+	// the wobble is drawn in the same order as -calcHatchInRect: draws it, filling <ax> and then <bx>
+
+	DKRandomState rs;
+
+	DKRandomSeed(&rs, DKRandomSeedForObject(self));
+	DKRandomFillSigned(&rs, ax, m * 2);
+
+	for (i = 0; i < m; ++i) {
+		ax[i] = lines.firstX + (i * m_spacing) + (ax[i] * maxWobble);
+		bx[i] = lines.firstX + (i * m_spacing) + (bx[i] * maxWobble);
+	}
+
+	// the hatch's frame is centred on the object and rotated to the hatch angle
+
+	CGFloat angle = m_angle + (m_angleRelativeToObject ? [obj angle] : 0.0);
+	NSAffineTransform* fromHatch = [NSAffineTransform transform];
+
+	[fromHatch translateXBy:NSMidX(br)
+						yBy:NSMidY(br)];
+	[fromHatch rotateByRadians:angle];
+
+	NSAffineTransform* toHatch = [[fromHatch copy] autorelease];
+	[toHatch invert];
+
+	hatch = clippedHatchLines(flatPath, toHatch, &lines);
+	[hatch transformUsingAffineTransform:fromHatch];
+	free(ax);
+
+	[self setCachedPath:hatch
+			  forObject:obj
+			 sourcePath:flatPath];
+
+	return hatch;
+}
+
+- (BOOL)drawDotScreenInPath:(NSBezierPath*)path objectAngle:(CGFloat)oa
+{
+	// draws the dot screen clipped to <path> by tiling an image of one dot, centred in a square of the spacing. The dots fall where
+	// -calcHatchInRect: puts them, on a grid centred on the path's bounds and turned to the hatch's angle. The image is kept until the
+	// spacing, width, colour or device resolution changes. Returns NO if the screen can't be tiled, so its dots are stroked instead.
+
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+	CGContextRef ctx = [context graphicsPort];
+
+	if (ctx == NULL || m_spacing <= 0 || m_lineWidth <= 0)
+		return NO;
+
+	// the resolution of the tile is the device resolution rounded up to a power of two, so small changes of scale reuse it
+
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform(ctx);
+	CGFloat deviceScale = sqrt(fabs(dt.a * dt.d - dt.b * dt.c));
+
+	deviceScale = exp2(ceil(log2(MAX(deviceScale, 0.125))));
+
+	size_t pw = (size_t)ceil(m_spacing * deviceScale);
+
+	if (pw == 0 || pw > kDKHatchMaximumDotTileSize)
+		return NO;
+
+	NSUInteger checksum = DKRasterizerChecksumCombine(0, m_spacing);
+
+	checksum = DKRasterizerChecksumCombine(checksum, m_lineWidth);
+	checksum = DKRasterizerChecksumCombine(checksum, deviceScale);
+
+	if (mDotTile == NULL || checksum != mDotTileChecksum) {
+		[self invalidateDotTile];
+
+		CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+		CGContextRef tileCtx = CGBitmapContextCreate(NULL, pw, pw, 8, 0, space, kCGImageAlphaPremultipliedLast);
+		CGColorSpaceRelease(space);
+
+		if (tileCtx == NULL)
+			return NO;
+
+		CGContextScaleCTM(tileCtx, pw / m_spacing, pw / m_spacing);
+
+		[NSGraphicsContext saveGraphicsState];
+		[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:tileCtx
+																						flipped:NO]];
+
+		// the spacing is never less than the width, so the dot doesn't reach into the neighbouring repeats
+
+		NSRect dot = NSMakeRect((m_spacing - m_lineWidth) * 0.5, (m_spacing - m_lineWidth) * 0.5, m_lineWidth, m_lineWidth);
+
+		[[self colour] setFill];
+		[[NSBezierPath bezierPathWithOvalInRect:dot] fill];
+
+		[NSGraphicsContext restoreGraphicsState];
+
+		mDotTile = CGBitmapContextCreateImage(tileCtx);
+		mDotTileChecksum = checksum;
+		CGContextRelease(tileCtx);
+
+		if (mDotTile == NULL)
+			return NO;
+	}
+
+	NSRect br = [path bounds];
+
+	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
+		[path addClip];
+
+	CGContextTranslateCTM(ctx, NSMidX(br), NSMidY(br));
+	CGContextRotateCTM(ctx, [self angle] + oa);
+	CGContextDrawTiledImage(ctx, CGRectMake(m_leadIn - m_spacing * 0.5, -m_spacing * 0.5, m_spacing, m_spacing), mDotTile);
+
+	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
+
+	return YES;
+}
+
+- (void)invalidateDotTile
+{
+	CGImageRelease(mDotTile);
+	mDotTile = NULL;
+}
+
 #pragma mark -
 #pragma mark As a DKRasterizer
 - (BOOL)isValid
@@ -462,7 +855,7 @@
 {
 	return [[super observableKeyPaths] arrayByAddingObjectsFromArray:[NSArray arrayWithObjects:@"colour", @"angle", @"spacing",
 																							   @"width", @"dash", @"leadIn",
-																							   @"lineCapStyle", @"lineJoinStyle", @"angleIsRelativeToObject", @"roughness", @"wobblyness", nil]];
+																							   @"lineCapStyle", @"lineJoinStyle", @"angleIsRelativeToObject", @"roughness", @"wobblyness", @"drawsDotScreen", nil]];
 }
 
 - (void)registerActionNames
@@ -490,12 +883,24 @@
 			 forKeyPath:@"roughness"];
 	[self setActionName:@"#kind# Hatch Wobble"
 			 forKeyPath:@"wobblyness"];
+	[self setActionName:@"#kind# Hatch Dot Screen"
+			 forKeyPath:@"drawsDotScreen"];
+}
+
+#pragma mark -
+#pragma mark As a DKPurgeableCache
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	[self invalidateCache];
+	return 0;
 }
 
 #pragma mark -
 #pragma mark As an NSObject
 - (void)dealloc
 {
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
 	[m_hatchDash release];
 	[m_hatchColour release];
 	[self invalidateCache];
@@ -529,6 +934,36 @@
 
 	NSBezierPath* path = [obj renderingPath];
 
+	if ([self canClipHatchToObjects]) {
+		NSBezierPath* hatch = [self clippedHatchForObject:obj];
+
+		if (hatch != nil) {
+			CGFloat actualLineWidth = [self width];
+
+			if (!DKRenderIsDrawingToScreen() && actualLineWidth <= 0.0)
+				actualLineWidth = 0.05; // hairline
+
+			// the clipped lines end on the path, but the corners of wide ones can poke out past it, so those are still clipped
+
+			SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
+				if (actualLineWidth > kDKHatchExactClipWidth)
+					[path addClip];
+
+			[hatch setLineWidth:actualLineWidth];
+			[hatch setLineCapStyle:NSButtLineCapStyle];
+			[hatch setLineJoinStyle:[self lineJoinStyle]];
+			[hatch setLineDash:NULL
+						 count:0
+						 phase:0.0];
+
+			[[self colour] set];
+			[hatch stroke];
+
+			RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
+			return;
+		}
+	}
+
 	if (m_angleRelativeToObject)
 		[self hatchPath:path
 			objectAngle:[obj angle]];
@@ -537,6 +972,44 @@
 			objectAngle:0.0f];
 }
 
+- (NSUInteger)renderingCacheParameters
+{
+	NSUInteger cs = [super renderingCacheParameters];
+
+	cs = DKRasterizerChecksumCombine(cs, m_angle);
+	cs = DKRasterizerChecksumCombine(cs, m_spacing);
+	cs = DKRasterizerChecksumCombine(cs, m_leadIn);
+	cs = DKRasterizerChecksumCombine(cs, mWobblyness);
+	cs = DKRasterizerChecksumCombine(cs, m_angleRelativeToObject);
+	cs = DKRasterizerChecksumCombine(cs, mDotScreen);
+
+	return cs;
+}
+
+- (CGFloat)minimumDetailSize
+{
+	// below this, individual hatch lines can't be made out and computing them is wasted effort
+
+	return 16.0;
+}
+
+- (void)renderLowDetail:(id<DKRenderable>)obj
+{
+	// hatching that can't be resolved is drawn as a flat tint of about the same density
+
+	CGFloat coverage;
+
+	if (m_spacing <= 0)
+		coverage = 1.0;
+	else if (mDotScreen)
+		coverage = LIMIT((pi * 0.25 * m_lineWidth * m_lineWidth) / (m_spacing * m_spacing), 0.1, 1.0);
+	else
+		coverage = LIMIT(m_lineWidth / m_spacing, 0.1, 1.0);
+
+	[[m_hatchColour colorWithAlphaComponent:[m_hatchColour alphaComponent] * coverage] setFill];
+	[[obj renderingPath] fill];
+}
+
 #pragma mark -
 #pragma mark As part of GraphicAttributtes Protocol
 - (void)setValue:(id)val forNumericParameter:(NSInteger)pnum
@@ -600,6 +1073,8 @@
 				 forKey:@"DKHatching_roughness"];
 	[coder encodeDouble:mWobblyness
 				 forKey:@"DKHatching_wobble"];
+	[coder encodeBool:mDotScreen
+			   forKey:@"DKHatching_dotScreen"];
 }
 
 - (id)initWithCoder:(NSCoder*)coder
@@ -623,6 +1098,19 @@
 
 		[self setRoughness:[coder decodeDoubleForKey:@"DKHatching_roughness"]];
 		mWobblyness = [coder decodeDoubleForKey:@"DKHatching_wobble"];
+
+		// hatchings from before dot screens drew dots as a zero-length dash of the spacing with round caps, which is what a dot screen draws
+
+		if ([coder containsValueForKey:@"DKHatching_dotScreen"])
+			mDotScreen = [coder decodeBoolForKey:@"DKHatching_dotScreen"];
+		else if ([self dash] != nil && [[self dash] count] == 2 && [self lineCapStyle] == NSRoundLineCapStyle) {
+			CGFloat dp[2];
+			NSInteger count;
+
+			[[self dash] getDashPattern:dp
+								  count:&count];
+			mDotScreen = dp[0] == 0.0 && dp[1] == [self spacing] && ![[self dash] scalesToLineWidth];
+		}
 	}
 	return self;
 }
@@ -646,6 +1134,7 @@
 	[copy setAngleIsRelativeToObject:[self angleIsRelativeToObject]];
 	[copy setRoughness:[self roughness]];
 	[copy setWobblyness:[self wobblyness]];
+	[copy setDrawsDotScreen:[self drawsDotScreen]];
 
 	return copy;
 }
@@ -0,0 +1,45 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/** @brief Tests many objects against a selection rect or lasso at once, sharing the exact tests between the processor's cores.
+
+ Tests many objects against a selection rect or lasso at once, sharing the exact tests between the processor's cores. A marquee dragged
+ over a busy area finds thousands of candidates whose bounds it touches, each of which must then be tested against its path. The quick
+ cases - invisible objects, bounds the rect misses or wholly encloses - are settled on the calling thread. For the rest, each object's
+ hit-test path is taken from it there (see -[DKDrawableObject hitTestPathWithOutlineDistance:filled:]), so the workers only read paths
+ and never look at the objects themselves. Objects without a hit-test path, or whose classes hit-test in their own way, are tested
+ in the ordinary way on the calling thread.
+
+ Whatever order the tests finish in, the objects hit are returned in the order they were given, so candidates passed in stacking order
+ give the hits in stacking order too.
+*/
+@interface DKHitTestBatch : NSObject
+
+/** @brief Finds the objects that intersect a rect
+
+ The result is the same as testing each object with -intersectsRect:.
+ @param objects drawable objects
+ @param rect the rect, in drawing coordinates
+ @return the objects that intersect the rect, in the same order as <objects>
+ */
++ (NSArray*)objects:(NSArray*)objects intersectingRect:(NSRect)rect;
+
+/** @brief Finds the objects that touch the area inside a lasso
+
+ The lasso is filled according to its winding rule, with open subpaths closed as they are when filled. An object is hit if any part of
+ its hit-test path's fill, or its stroke, lies in that area. Objects that can't give a hit-test path are tested as if they filled their
+ bounds. Invisible objects are never hit.
+ @param objects drawable objects
+ @param lasso the lasso, in drawing coordinates
+ @return the objects that touch the lasso's area, in the same order as <objects>
+ */
++ (NSArray*)objects:(NSArray*)objects intersectingLasso:(NSBezierPath*)lasso;
+
+@end
+
+#define kDKMinimumObjectsForConcurrentHitTest 64 // fewer paths to test than this are tested on the calling thread
@@ -0,0 +1,437 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKHitTestBatch.h"
+#import "DKDrawableObject.h"
+#import "NSBezierPath+Geometry.h"
+#include <dispatch/dispatch.h>
+
+// one object's exact test. The path is taken from the object on the calling thread, so the workers only read paths
+
+typedef struct {
+	NSUInteger object; // the object's position in the array given
+	NSBezierPath* path;
+	NSRect bounds;
+	CGFloat distance;
+	BOOL filled;
+	BOOL hit;
+	BOOL failed; // an exception was raised testing a rect, so the object is tested again on the calling thread
+} DKHitTestJob;
+
+typedef struct {
+	DKHitTestJob* jobs;
+	NSRect rect;
+	NSPoint* edges; // the flattened lasso, as pairs of end points, including the edges that close its subpaths
+	NSUInteger edgeCount;
+	NSRect lassoBounds;
+	BOOL evenOdd;
+} DKHitTestWork;
+
+static BOOL hitTestsInTheDefaultWay(DKDrawableObject* obj)
+{
+	// an object whose class hit-tests in its own way can't be tested from its hit-test path alone
+
+	Class cl = [obj class];
+	Class base = [DKDrawableObject class];
+
+	return [cl instanceMethodForSelector:@selector(intersectsRect:)] == [base instanceMethodForSelector:@selector(intersectsRect:)]
+		&& [cl instanceMethodForSelector:@selector(rectHitsPath:)] == [base instanceMethodForSelector:@selector(rectHitsPath:)]
+		&& [cl instanceMethodForSelector:@selector(geometricHitTestRect:)] == [base instanceMethodForSelector:@selector(geometricHitTestRect:)];
+}
+
+static inline void addEdge(DKHitTestWork* work, NSPoint a, NSPoint b)
+{
+	work->edges[2 * work->edgeCount] = a;
+	work->edges[2 * work->edgeCount + 1] = b;
+	++work->edgeCount;
+}
+
+static inline BOOL rectsTouch(NSRect a, NSRect b)
+{
+	// unlike NSIntersectsRect, rects of no width or height, such as the bounds of a horizontal edge, can touch
+
+	return NSMinX(a) <= NSMaxX(b) && NSMinX(b) <= NSMaxX(a) && NSMinY(a) <= NSMaxY(b) && NSMinY(b) <= NSMaxY(a);
+}
+
+static inline CGFloat crossProduct(NSPoint o, NSPoint a, NSPoint b)
+{
+	return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+static CGFloat distanceFromPointToSegment(NSPoint p, NSPoint a, NSPoint b)
+{
+	CGFloat dx = b.x - a.x;
+	CGFloat dy = b.y - a.y;
+	CGFloat lenSq = dx * dx + dy * dy;
+	CGFloat t = 0;
+
+	if (lenSq > 0)
+		t = MAX(0, MIN(1, ((p.x - a.x) * dx + (p.y - a.y) * dy) / lenSq));
+
+	return hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
+
+static CGFloat distanceBetweenSegments(NSPoint a, NSPoint b, NSPoint c, NSPoint d)
+{
+	CGFloat d1 = crossProduct(c, d, a);
+	CGFloat d2 = crossProduct(c, d, b);
+	CGFloat d3 = crossProduct(a, b, c);
+	CGFloat d4 = crossProduct(a, b, d);
+
+	if (((d1 > 0 && d2 < 0) || (d1 < 0 && d2 > 0)) && ((d3 > 0 && d4 < 0) || (d3 < 0 && d4 > 0)))
+		return 0;
+
+	// segments that don't cross are nearest at one of their ends
+
+	return MIN(MIN(distanceFromPointToSegment(a, c, d), distanceFromPointToSegment(b, c, d)),
+		MIN(distanceFromPointToSegment(c, a, b), distanceFromPointToSegment(d, a, b)));
+}
+
+static BOOL pointIsInLasso(const DKHitTestWork* work, NSPoint p)
+{
+	NSInteger winding = 0;
+	NSUInteger e;
+
+	for (e = 0; e < work->edgeCount; ++e) {
+		NSPoint a = work->edges[2 * e];
+		NSPoint b = work->edges[2 * e + 1];
+
+		if (a.y <= p.y) {
+			if (b.y > p.y && crossProduct(a, b, p) > 0)
+				++winding;
+		} else if (b.y <= p.y && crossProduct(a, b, p) < 0)
+			--winding;
+	}
+
+	return work->evenOdd ? (winding & 1) != 0 : winding != 0;
+}
+
+static BOOL segmentIsNearLasso(const DKHitTestWork* work, const NSUInteger* near, NSUInteger nearCount, NSPoint a, NSPoint b, CGFloat distance)
+{
+	NSUInteger i;
+
+	for (i = 0; i < nearCount; ++i) {
+		if (distanceBetweenSegments(a, b, work->edges[2 * near[i]], work->edges[2 * near[i] + 1]) <= distance)
+			return YES;
+	}
+
+	return NO;
+}
+
+static BOOL pathTouchesLasso(const DKHitTestWork* work, const DKHitTestJob* job)
+{
+	NSBezierPath* flat = [job->path bezierPathByFlatteningPath];
+
+	if ([flat isEmpty])
+		return NO;
+
+	NSRect reach = NSInsetRect([flat bounds], -job->distance, -job->distance);
+
+	if (!rectsTouch(reach, work->lassoBounds))
+		return NO;
+
+	// only the lasso's edges that come near the path can touch it
+
+	NSUInteger* near = malloc(work->edgeCount * sizeof(NSUInteger));
+	NSUInteger e, nearCount = 0;
+
+	for (e = 0; e < work->edgeCount; ++e) {
+		NSPoint a = work->edges[2 * e];
+		NSPoint b = work->edges[2 * e + 1];
+
+		if (rectsTouch(NSMakeRect(MIN(a.x, b.x), MIN(a.y, b.y), ABS(b.x - a.x), ABS(b.y - a.y)), reach))
+			near[nearCount++] = e;
+	}
+
+	NSInteger k, count = [flat elementCount];
+	NSPoint p[3], start = NSZeroPoint, last = NSZeroPoint;
+	BOOL hit = NO, inSubpath = NO;
+
+	for (k = 0; k < count && !hit; ++k) {
+		switch ([flat elementAtIndex:k
+					associatedPoints:p]) {
+		case NSMoveToBezierPathElement:
+			// a filled subpath left open is closed by its fill. Unless a subpath comes near an edge of the lasso, all of it is on the
+			// same side of the lasso as its first point
+
+			if (inSubpath && job->filled)
+				hit = segmentIsNearLasso(work, near, nearCount, last, start, job->distance);
+
+			hit = hit || pointIsInLasso(work, p[0]);
+			start = last = p[0];
+			inSubpath = YES;
+			break;
+
+		case NSLineToBezierPathElement:
+			hit = segmentIsNearLasso(work, near, nearCount, last, p[0], job->distance);
+			last = p[0];
+			inSubpath = YES;
+			break;
+
+		case NSClosePathBezierPathElement:
+			hit = segmentIsNearLasso(work, near, nearCount, last, start, job->distance);
+			last = start;
+			inSubpath = NO;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (!hit && inSubpath && job->filled)
+		hit = segmentIsNearLasso(work, near, nearCount, last, start, job->distance);
+
+	free(near);
+
+	// a lasso drawn wholly inside a filled area meets none of its edges
+
+	if (!hit && job->filled)
+		hit = [job->path containsPoint:work->edges[0]];
+
+	return hit;
+}
+
+static void testRectJob(void* context, size_t i)
+{
+	DKHitTestWork* work = (DKHitTestWork*)context;
+	DKHitTestJob* job = &work->jobs[i];
+	NSRect ir = NSIntersectionRect(work->rect, job->bounds);
+
+	@autoreleasepool {
+		@try {
+			job->hit = (job->filled && [job->path filledAreaIntersectsRect:ir]) || (job->distance > 0 && [job->path outlineIntersectsRect:ir
+																												   withinDistance:job->distance]);
+		}
+		@catch (NSException* excp) {
+			// an exception mustn't escape a worker thread
+
+			job->failed = YES;
+		}
+	}
+}
+
+static void testLassoJob(void* context, size_t i)
+{
+	DKHitTestWork* work = (DKHitTestWork*)context;
+	DKHitTestJob* job = &work->jobs[i];
+
+	@autoreleasepool {
+		@try {
+			job->hit = pathTouchesLasso(work, job);
+		}
+		@catch (NSException* excp) {
+			job->failed = YES;
+		}
+	}
+}
+
+static void performJobs(DKHitTestWork* work, NSUInteger jobCount, void (*function)(void*, size_t))
+{
+	NSUInteger i;
+
+	if (jobCount >= kDKMinimumObjectsForConcurrentHitTest)
+		dispatch_apply_f(jobCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), work, function);
+	else {
+		for (i = 0; i < jobCount; ++i)
+			function(work, i);
+	}
+}
+
+static NSArray* objectsHit(NSArray* objects, const BOOL* hits)
+{
+	NSMutableArray* result = [NSMutableArray array];
+	NSUInteger i, count = [objects count];
+
+	for (i = 0; i < count; ++i) {
+		if (hits[i])
+			[result addObject:[objects objectAtIndex:i]];
+	}
+
+	return result;
+}
+
+#pragma mark -
+
+@implementation DKHitTestBatch
+
++ (NSArray*)objects:(NSArray*)objects intersectingRect:(NSRect)rect
+{
+	NSUInteger i, j, count = [objects count], jobCount = 0;
+	DKHitTestWork work;
+	BOOL* hits = calloc(count, sizeof(BOOL));
+
+	memset(&work, 0, sizeof(work));
+	work.rect = rect;
+	work.jobs = calloc(count, sizeof(DKHitTestJob));
+
+	// the quick cases are settled here, following -intersectsRect: and -rectHitsPath:, leaving only the paths to be tested
+
+	for (i = 0; i < count; ++i) {
+		DKDrawableObject* od = [objects objectAtIndex:i];
+
+		if (!hitTestsInTheDefaultWay(od)) {
+			hits[i] = [od intersectsRect:rect];
+			continue;
+		}
+
+		NSRect br = [od bounds];
+
+		if (![od visible] || !NSIntersectsRect(br, rect))
+			continue;
+
+		NSRect ir = NSIntersectionRect(rect, br);
+
+		if (NSEqualRects(ir, br)) {
+			hits[i] = YES;
+			continue;
+		}
+
+		if (ir.size.width <= 0 || ir.size.height <= 0)
+			continue;
+
+		DKHitTestJob* job = &work.jobs[jobCount];
+
+		job->path = [[od hitTestPathWithOutlineDistance:&job->distance
+												 filled:&job->filled] retain];
+
+		if (job->path == nil) {
+			hits[i] = [od rectHitsPath:rect];
+			continue;
+		}
+
+		job->object = i;
+		job->bounds = br;
+		++jobCount;
+	}
+
+	performJobs(&work, jobCount, testRectJob);
+
+	for (j = 0; j < jobCount; ++j) {
+		DKHitTestJob* job = &work.jobs[j];
+
+		if (job->failed)
+			hits[job->object] = [[objects objectAtIndex:job->object] intersectsRect:rect];
+		else
+			hits[job->object] = job->hit;
+
+		[job->path release];
+	}
+
+	NSArray* result = objectsHit(objects, hits);
+
+	free(work.jobs);
+	free(hits);
+
+	return result;
+}
+
++ (NSArray*)objects:(NSArray*)objects intersectingLasso:(NSBezierPath*)lasso
+{
+	NSBezierPath* flatLasso = [lasso bezierPathByFlatteningPath];
+	NSInteger k, elementCount = [flatLasso elementCount];
+
+	if (elementCount < 2)
+		return [NSArray array];
+
+	NSUInteger i, j, count = [objects count], jobCount = 0;
+	DKHitTestWork work;
+	NSPoint p[3], start = NSZeroPoint, last = NSZeroPoint;
+	BOOL inSubpath = NO;
+
+	memset(&work, 0, sizeof(work));
+	work.evenOdd = ([lasso windingRule] == NSEvenOddWindingRule);
+	work.lassoBounds = [flatLasso bounds];
+
+	// each element gives at most one edge, and each subpath at most one more to close it
+
+	work.edges = malloc(4 * elementCount * sizeof(NSPoint));
+
+	for (k = 0; k < elementCount; ++k) {
+		switch ([flatLasso elementAtIndex:k
+						 associatedPoints:p]) {
+		case NSMoveToBezierPathElement:
+			if (inSubpath && !NSEqualPoints(last, start)) {
+				addEdge(&work, last, start);
+			}
+
+			start = last = p[0];
+			inSubpath = YES;
+			break;
+
+		case NSLineToBezierPathElement:
+			addEdge(&work, last, p[0]);
+			last = p[0];
+			inSubpath = YES;
+			break;
+
+		case NSClosePathBezierPathElement:
+			if (!NSEqualPoints(last, start)) {
+				addEdge(&work, last, start);
+			}
+
+			last = start;
+			inSubpath = NO;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (inSubpath && !NSEqualPoints(last, start)) {
+		addEdge(&work, last, start);
+	}
+
+	if (work.edgeCount == 0) {
+		free(work.edges);
+		return [NSArray array];
+	}
+
+	BOOL* hits = calloc(count, sizeof(BOOL));
+
+	work.jobs = calloc(count, sizeof(DKHitTestJob));
+
+	for (i = 0; i < count; ++i) {
+		DKDrawableObject* od = [objects objectAtIndex:i];
+		NSRect br = [od bounds];
+
+		if (![od visible] || !rectsTouch(br, work.lassoBounds))
+			continue;
+
+		DKHitTestJob* job = &work.jobs[jobCount++];
+
+		if (hitTestsInTheDefaultWay(od))
+			job->path = [[od hitTestPathWithOutlineDistance:&job->distance
+													 filled:&job->filled] retain];
+
+		if (job->path == nil) {
+			job->path = [[NSBezierPath bezierPathWithRect:br] retain];
+			job->distance = 0;
+			job->filled = YES;
+		}
+
+		job->object = i;
+		job->bounds = br;
+	}
+
+	performJobs(&work, jobCount, testLassoJob);
+
+	for (j = 0; j < jobCount; ++j) {
+		hits[work.jobs[j].object] = work.jobs[j].hit;
+		[work.jobs[j].path release];
+	}
+
+	NSArray* result = objectsHit(objects, hits);
+
+	free(work.jobs);
+	free(work.edges);
+	free(hits);
+
+	return result;
+}
+
+@end
@@ -19,6 +19,12 @@ typedef enum {
 /** @brief This class allows any image to be part of the rendering tree.
 
 This class allows any image to be part of the rendering tree.
+
+When the image was set from the drawing's image manager with -setImageWithKey:forDrawing:, drawing to the screen uses the manager's
+decoded proxy of the image that best matches the number of device pixels it covers, rather than the full image. Proxies are made in the
+background, once for each key and size, and are shared by every object and adornment that draws the same image, so the same badge on
+thousands of objects is decoded once. Until the best proxy is ready the nearest one is drawn, and the style's clients are redrawn when
+it arrives.
 */
 @interface DKImageAdornment : DKRasterizer <NSCoding, NSCopying> {
 @private
@@ -31,6 +37,7 @@ This class allows any image to be part of the rendering tree.
 	NSCompositingOperation m_op;
 	DKImageFittingOption m_fittingOption;
 	NSString* m_imageIdentifier;
+	BOOL mAwaitingProxy; // YES while observing the image manager for a better proxy
 }
 
 + (DKImageAdornment*)imageAdornmentWithImage:(NSImage*)image;
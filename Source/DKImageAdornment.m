@@ -12,6 +12,26 @@
 
 #import "DKDrawing.h"
 #import "DKImageDataManager.h"
+#import "DKDrawingRenderer.h"
+#import "DKPDFResources.h"
+#import "DKStyle.h"
+
+@interface DKImageAdornment (Private)
+
+/** @brief Returns the image to draw into a rect of the current context for an object
+
+ When drawing to the screen an image set by key is drawn from the image manager's proxy that best matches the number of pixels the rect
+ covers, or nothing if none has been made yet. Otherwise, as when printing, it is the image itself.
+ @param rect the rect the image will be drawn in, in the current coordinates
+ @param object the object being rendered
+ @return the image to draw, or nil to draw nothing this time
+ */
+- (NSImage*)imageForDrawingInRect:(NSRect)rect object:(id<DKRenderable>)object;
+- (void)proxyImageCreated:(NSNotification*)note;
+
+@end
+
+#pragma mark -
 
 @implementation DKImageAdornment
 #pragma mark As a DKImageAdornment
@@ -67,6 +87,57 @@
 	return mImageKey;
 }
 
+- (NSImage*)imageForDrawingInRect:(NSRect)rect object:(id<DKRenderable>)object
+{
+	DKImageDataManager* imgMgr = [object isKindOfClass:[DKDrawableObject class]] ? [[(DKDrawableObject*)object container] imageManager] : nil;
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+
+	// headless renders are never redrawn, so they can't wait for a proxy to be made
+
+	if (imgMgr == nil || [self imageKey] == nil || ![context isDrawingToScreen] || [DKDrawingRenderer isRenderingOnCurrentThread] || [imgMgr pixelSizeForKey:[self imageKey]] <= 0)
+		return [self image];
+
+	// the number of device pixels the image covers is found from the context's transform, which includes the image's own transform,
+	// the view's scale and the backing scale factor
+
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform([context graphicsPort]);
+	CGFloat deviceScale = sqrt(fabs(dt.a * dt.d - dt.b * dt.c));
+	NSImage* proxy = [imgMgr proxyImageForKey:[self imageKey]
+									pixelSize:MAX(NSWidth(rect), NSHeight(rect)) * deviceScale];
+
+	// the adornment is shared by all the objects using its style, so when a better proxy is made they are all redrawn together
+
+	if (!mAwaitingProxy && [imgMgr isMakingProxyForKey:[self imageKey]]) {
+		mAwaitingProxy = YES;
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(proxyImageCreated:)
+													 name:kDKImageDataManagerDidCreateProxyNotification
+												   object:imgMgr];
+	}
+
+	return proxy;
+}
+
+- (void)proxyImageCreated:(NSNotification*)note
+{
+	if ([[[note userInfo] objectForKey:@"key"] isEqualToString:[self imageKey]]) {
+		mAwaitingProxy = NO;
+		[[NSNotificationCenter defaultCenter] removeObserver:self
+														name:kDKImageDataManagerDidCreateProxyNotification
+													  object:[note object]];
+
+		DKRastGroup* root = [self container];
+
+		while ([root container] != nil)
+			root = [root container];
+
+		if ([root isKindOfClass:[DKStyle class]]) {
+			[(DKStyle*)root notifyClientsBeforeChange];
+			[(DKStyle*)root notifyClientsAfterChange];
+		}
+	}
+}
+
 - (void)setImageIdentifier:(NSString*)imageID
 {
 	[imageID retain];
@@ -251,6 +322,9 @@
 #pragma mark As an NSObject
 - (void)dealloc
 {
+	if (mAwaitingProxy)
+		[[NSNotificationCenter defaultCenter] removeObserver:self];
+
 	[m_imageIdentifier release];
 	[m_image release];
 	[mImageKey release];
@@ -318,6 +392,29 @@
 		destRect.origin.x = [self origin].x - (destRect.size.width / 2.0);
 		destRect.origin.y = [self origin].y - (destRect.size.height / 2.0);
 
+		// an image set by key is drawn from a decoded proxy of about the size it covers
+
+		if (image == [self image]) {
+			image = [self imageForDrawingInRect:destRect
+										 object:object];
+
+			if (image == nil) {
+				[[NSGraphicsContext currentContext] restoreGraphicsState];
+				return;
+			}
+		}
+
+		// a PDF or print refers back to the one copy of the image it holds for every object using the adornment
+
+		if ([[DKPDFResources currentResources] drawImage:image
+												  forKey:[self imageKey]
+												  inRect:destRect
+											   operation:[self operation]
+												fraction:[self opacity]]) {
+			[[NSGraphicsContext currentContext] restoreGraphicsState];
+			return;
+		}
+
 		// draw the image
 		[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
 		[image setFlipped:YES];
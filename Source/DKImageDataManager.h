@@ -5,6 +5,7 @@
 */
 
 #import <Cocoa/Cocoa.h>
+#import "DKCacheRegistry.h"
 
 /**
 The purpose of this class is to allow images to be archived much more efficiently, by archiving the original data that the image was created from rather than any bitmaps or
@@ -14,14 +15,56 @@ The purpose of this class is to allow images to be archived much more efficientl
  This only comes into play when archiving, dearchiving or creating images - each object still maintains an NSImage derived from the data stored here.
  
  When images are cut/pasted within the framework, the image key can be used to effect that operation without having to move the actual image data.
+
+ Data is identified by a SHA-256 hash of its contents, so finding whether the manager already has some data takes one hash and one lookup, and
+ different data is never mistaken for the same. The hashes are archived along with the data so they needn't be recomputed when a drawing is opened.
+
+ Data at least as long as the mapping threshold is copied to a temporary file and memory-mapped, so that large images occupy file-backed pages which
+ the system can drop and reread as needed, rather than the heap. The file is deleted as soon as it's mapped, so nothing is left behind.
+
+ For drawing to the screen, the manager also makes proxies of each image: a chain of decoded bitmaps, each half the size of the one before, made
+ in the background with ImageIO when first asked for. An image shape draws the smallest one that has at least as many pixels as it covers on
+ screen, so a zoomed out page of photos never decodes or resamples them at full size, and even the full size is decoded off the main thread.
+ The proxies are kept in a cache which discards them under memory pressure.
+
+ Images in files can also be imported in the background, so that dropping many of them doesn't hold up the main thread: their keys are
+ handed out at once, and the data is stored and kDKImageDataManagerDidImportImageNotification posted for each as it is read.
 */
-@interface DKImageDataManager : NSObject <NSCoding> {
+@interface DKImageDataManager : NSObject <NSCoding, DKPurgeableCache, NSCacheDelegate> {
 @private
 	NSMutableDictionary* mRepository;
-	NSMutableDictionary* mHashList;
+	NSMutableDictionary* mHashList; // content hash -> key
 	NSMutableDictionary* mKeyUsage;
+	NSMutableDictionary* mKeyHashes; // key -> content hash
+	CFMutableDictionaryRef mDataKeys; // data object -> key, for finding stored data without hashing it
+	NSCache* mProxies; // "key/level" -> decoded proxy image
+	CFMutableDictionaryRef mProxyCosts; // proxy image -> its bytes, as given to the cache
+	NSUInteger mProxyBytes; // the total of <mProxyCosts>
+	NSMutableDictionary* mPixelSizes; // key -> the longest side of the full image, in pixels
+	NSMutableSet* mPendingProxies; // "key/level" of proxies being made
+	NSMutableSet* mPendingImports; // keys of images being imported
+	NSMutableArray* mFinishedImports; // imports read in the background and waiting to be stored, guarded by itself
+	BOOL mStoreImportsScheduled; // YES once the finished imports are due to be stored on the main thread
 }
 
+/** @brief Sets the length at or above which image data is kept in a memory-mapped file rather than on the heap
+
+ The default is kDKImageDataDefaultMappingThreshold. Pass 0 to keep all data on the heap.
+ @param length the threshold in bytes
+ */
++ (void)setMappingThreshold:(NSUInteger)length;
++ (NSUInteger)mappingThreshold;
+
+/** @brief Returns data with the given contents that is memory-mapped from a temporary file rather than held on the heap
+
+ The bytes are written straight to the file, so if they are themselves mapped (e.g. a part of a file being read) they never need to be
+ on the heap at all.
+ @param bytes the bytes
+ @param length the number of bytes
+ @return the mapped data, or nil if it couldn't be written or mapped
+ */
++ (NSData*)mappedDataWithBytes:(const void*)bytes length:(NSUInteger)length;
+
 - (NSData*)imageDataForKey:(NSString*)key;
 - (void)setImageData:(NSData*)imageData forKey:(NSString*)key;
 - (BOOL)hasImageDataForKey:(NSString*)key;
@@ -35,17 +78,86 @@ The purpose of this class is to allow images to be archived much more efficientl
 - (NSImage*)makeImageWithContentsOfURL:(NSURL*)url key:(NSString**)key;
 - (NSImage*)makeImageForKey:(NSString*)key;
 
+/** @brief Starts importing images from files in the background, and returns the keys they will be known by at once
+
+ Each file is read, hashed and measured on a background queue. As they finish - several at a time, so that the observers' redraws are
+ coalesced - the data is stored on the main thread and kDKImageDataManagerDidImportImageNotification is posted for each. The userInfo
+ key "key" is the key returned here, and "imageKey" is the key the data was stored under, which is a different key if the same data was
+ already stored, and missing if the file couldn't be read.
+ @param urls file URLs of images
+ @return the keys, in the same order
+ */
+- (NSArray*)importImagesWithContentsOfURLs:(NSArray*)urls;
+- (BOOL)isImportingKey:(NSString*)key;
+
+/** @brief Returns a decoded proxy of an image suitable for drawing it with a given number of pixels along its longest side
+
+ Returns the smallest level of the mip chain with at least <pixels> along its longest side, or the full size image decoded if none is
+ that small. If that level hasn't been made yet, it is made in the background and the nearest level already made is returned instead,
+ or nil if there is none. kDKImageDataManagerDidCreateProxyNotification is posted when it's ready.
+ @param key the image key
+ @param pixels the number of device pixels the image's longest side will cover
+ @return a proxy image, or nil
+ */
+- (NSImage*)proxyImageForKey:(NSString*)key pixelSize:(CGFloat)pixels;
+
+/** @brief Returns the level of the mip chain that -proxyImageForKey:pixelSize: would return when it has been made, making it now if needed
+
+ For renders that are never redrawn, such as printing, which can't wait for a proxy to be made in the background. On the main thread
+ the level made is kept, as if it had been made in the background, so pages that share an image don't each decode it.
+ @param key the image key
+ @param pixels the number of device pixels the image's longest side will cover
+ @return a proxy image, or nil if the data isn't an image ImageIO can read
+ */
+- (NSImage*)makeProxyImageForKey:(NSString*)key pixelSize:(CGFloat)pixels;
+- (BOOL)isMakingProxyForKey:(NSString*)key;
+
+/** @brief The length of the longest side of an image at full size, in pixels
+ @param key the image key
+ @return the length, or 0 if the data isn't an image ImageIO can read
+ */
+- (CGFloat)pixelSizeForKey:(NSString*)key;
+
 - (void)setKey:(NSString*)key isInUse:(BOOL)inUse;
 - (BOOL)keyIsInUse:(NSString*)key;
+
+/** @brief Removes all data whose keys are not in use
+
+ The data itself is released on a background queue, since freeing or unmapping many large images can take a while.
+ */
 - (void)removeUnusedData;
 
+/** @brief The memory used by the stored image data
+
+ There's no direct way to tell whether data is mapped, so data at least as long as the mapping threshold is taken to be, as it's mapped
+ when stored unless that fails.
+ @param resident receives the bytes of the data on the heap
+ @param mapped receives the bytes of the data in mapped files
+ */
+- (void)getResidentDataBytes:(NSUInteger*)resident mappedDataBytes:(NSUInteger*)mapped;
+
+/** @brief The memory used by the decoded proxies currently cached
+ @return the size of their bitmaps, in bytes
+ */
+- (NSUInteger)proxyBytes;
+
 @end
 
+#define kDKImageDataDefaultMappingThreshold (256 * 1024)
+#define kDKImageProxyMinimumPixelSize 32 // proxies are never made smaller than this along their longest side
+#define kDKImageProxyCacheCostLimit (128 * 1024 * 1024) // bytes of decoded proxies kept by each manager
+
 extern NSString* kDKImageDataManagerPasteboardType;
+extern NSString* kDKImageDataManagerDidCreateProxyNotification; /**< object is the manager, userInfo key "key" is the image key */
+extern NSString* kDKImageDataManagerDidImportImageNotification; /**< object is the manager, userInfo keys "key" and "imageKey" - see -importImagesWithContentsOfURLs: */
 
 @interface NSData (Checksum)
 
 - (NSUInteger)checksum;
 - (NSString*)checksumString;
 
+/** @brief A SHA-256 hash of the whole of the data, as a hex string
+ */
+- (NSString*)contentHashString;
+
 @end
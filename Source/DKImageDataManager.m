@@ -7,17 +7,223 @@
 #import "DKImageDataManager.h"
 #import "DKUniqueID.h"
 #import "DKKeyedUnarchiver.h"
+#import "LogEvent.h"
+#include <CommonCrypto/CommonDigest.h>
 
 NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrtype";
+NSString* kDKImageDataManagerDidCreateProxyNotification = @"kDKImageDataManagerDidCreateProxyNotification";
+NSString* kDKImageDataManagerDidImportImageNotification = @"kDKImageDataManagerDidImportImageNotification";
+
+static NSUInteger sMappingThreshold = kDKImageDataDefaultMappingThreshold;
+
+static void releaseDataInBackground(void* context)
+{
+	[(NSArray*)context release];
+}
 
 @interface DKImageDataManager (Private)
 
 - (void)buildHashList;
+- (NSData*)storableData:(NSData*)data;
+- (NSUInteger)proxyLevelCountForKey:(NSString*)key;
+- (NSUInteger)proxyLevelForKey:(NSString*)key pixelSize:(CGFloat)pixels;
+- (void)makeProxyForKey:(NSString*)key level:(NSUInteger)level;
+- (void)installProxy:(CGImageRef)image forKey:(NSString*)key level:(NSUInteger)level;
+- (void)storeImageData:(NSData*)imageData forKey:(NSString*)key hash:(NSString*)hash;
+- (void)queueFinishedImport:(void*)request;
+- (void)storeFinishedImports;
 
 @end
 
+static CGFloat pixelSizeOfImageData(NSData* data)
+{
+	// only the image's properties are read, which doesn't decode it
+
+	CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)data, NULL);
+	CGFloat pixels = 0;
+
+	if (source) {
+		NSDictionary* props = (NSDictionary*)CGImageSourceCopyPropertiesAtIndex(source, 0, NULL);
+
+		pixels = MAX([[props objectForKey:(id)kCGImagePropertyPixelWidth] doubleValue], [[props objectForKey:(id)kCGImagePropertyPixelHeight] doubleValue]);
+
+		[props release];
+		CFRelease(source);
+	}
+
+	return pixels;
+}
+
+/// a proxy image being made in the background, and where to install it when it's done
+
+typedef struct {
+	DKImageDataManager* manager;
+	NSString* key;
+	NSData* data;
+	NSUInteger level;
+	CGFloat pixelSize;
+	CGImageRef image;
+} DKImageProxyRequest;
+
+static void installProxy(void* context)
+{
+	DKImageProxyRequest* pr = (DKImageProxyRequest*)context;
+
+	// if the data was replaced while the proxy was being made, the proxy is of the old data so is discarded
+
+	if ([pr->manager imageDataForKey:pr->key] != pr->data) {
+		CGImageRelease(pr->image);
+		pr->image = NULL;
+	}
+
+	[pr->manager installProxy:pr->image
+					   forKey:pr->key
+						level:pr->level];
+
+	CGImageRelease(pr->image);
+	[pr->data release];
+	[pr->key release];
+	[pr->manager release];
+	free(pr);
+}
+
+static CGImageRef createProxyImage(NSData* data, CGFloat pixelSize)
+{
+	CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)data, NULL);
+	CGImageRef image = NULL;
+
+	if (source) {
+		// a thumbnail is always decoded, even at full size, so drawing it later needn't decode anything
+
+		NSDictionary* options = [NSDictionary dictionaryWithObjectsAndKeys:(id)kCFBooleanTrue, (id)kCGImageSourceCreateThumbnailFromImageAlways,
+																		   [NSNumber numberWithInteger:(NSInteger)ceil(pixelSize)], (id)kCGImageSourceThumbnailMaxPixelSize,
+																		   (id)kCFBooleanTrue, (id)kCGImageSourceShouldCache, nil];
+
+		image = CGImageSourceCreateThumbnailAtIndex(source, 0, (CFDictionaryRef)options);
+		CFRelease(source);
+	}
+
+	return image;
+}
+
+static void makeProxyInBackground(void* context)
+{
+	DKImageProxyRequest* pr = (DKImageProxyRequest*)context;
+
+	pr->image = createProxyImage(pr->data, pr->pixelSize);
+
+	dispatch_async_f(dispatch_get_main_queue(), pr, installProxy);
+}
+
+/// an image file being imported in the background, and the key it will be stored under
+
+typedef struct {
+	DKImageDataManager* manager;
+	NSString* key;
+	NSURL* url;
+	NSData* data;
+	NSString* hash;
+	CGFloat pixelSize;
+} DKImageImportRequest;
+
+typedef struct {
+	DKImageImportRequest** requests;
+	size_t count;
+} DKImageImportBatch;
+
+static void readImportedImage(void* context, size_t index)
+{
+	DKImageImportRequest* ir = ((DKImageImportBatch*)context)->requests[index];
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	NSData* data = [NSData dataWithContentsOfURL:ir->url
+										 options:0
+										   error:NULL];
+
+	if (data) {
+		// large data is moved to a mapped file here rather than when it's stored, so the main thread never copies it
+
+		NSUInteger threshold = [DKImageDataManager mappingThreshold];
+
+		if (threshold > 0 && [data length] >= threshold) {
+			NSData* mapped = [DKImageDataManager mappedDataWithBytes:[data bytes]
+															  length:[data length]];
+			if (mapped)
+				data = mapped;
+		}
+
+		ir->data = [data retain];
+		ir->hash = [[data contentHashString] retain];
+		ir->pixelSize = pixelSizeOfImageData(data);
+	}
+
+	[pool drain];
+	[ir->manager queueFinishedImport:ir];
+}
+
+static void readImportedImages(void* context)
+{
+	DKImageImportBatch* batch = (DKImageImportBatch*)context;
+
+	// dispatch_apply_f keeps to as many files at once as there are processors, rather than a thread for each
+
+	dispatch_apply_f(batch->count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), batch, readImportedImage);
+
+	free(batch->requests);
+	free(batch);
+}
+
+static void storeImportedImages(void* context)
+{
+	DKImageDataManager* manager = (DKImageDataManager*)context;
+
+	[manager storeFinishedImports];
+	[manager release];
+}
+
+static NSString* proxyCacheKey(NSString* key, NSUInteger level)
+{
+	return [NSString stringWithFormat:@"%@/%lu", key, (unsigned long)level];
+}
+
 @implementation DKImageDataManager
 
++ (void)setMappingThreshold:(NSUInteger)length
+{
+	sMappingThreshold = length;
+}
+
++ (NSUInteger)mappingThreshold
+{
+	return sMappingThreshold;
+}
+
++ (NSData*)mappedDataWithBytes:(const void*)bytes length:(NSUInteger)length
+{
+	NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"DKImageData-%@", [DKUniqueID uniqueKey]]];
+	NSData* source = [NSData dataWithBytesNoCopy:(void*)bytes
+										  length:length
+									freeWhenDone:NO];
+	NSData* mapped = nil;
+
+	if ([source writeToFile:path
+				 atomically:NO]) {
+		mapped = [NSData dataWithContentsOfFile:path
+										options:NSDataReadingMappedAlways
+										  error:NULL];
+
+		// the mapping keeps the file's contents until the data is released, so the file itself can go at once
+
+		[[NSFileManager defaultManager] removeItemAtPath:path
+												   error:NULL];
+	}
+
+	if (mapped == nil)
+		LogEvent_(kFileEvent, @"unable to map %lu bytes of image data", (unsigned long)length);
+
+	return mapped;
+}
+
+
 - (NSData*)imageDataForKey:(NSString*)key
 {
 	return [mRepository objectForKey:key];
@@ -29,10 +235,32 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 
 	//NSLog(@"%@ set data (%d bytes), key = %@", self, [imageData length], key);
 
+	NSString* hash = [imageData contentHashString];
+
+	// any data already stored under the key is replaced. The data or key passed in may be the ones stored, which removing them releases
+
+	[[imageData retain] autorelease];
+	[[key retain] autorelease];
+
+	if ([mRepository objectForKey:key])
+		[self removeKey:key];
+
+	[self storeImageData:[self storableData:imageData]
+				  forKey:key
+					hash:hash];
+}
+
+- (void)storeImageData:(NSData*)imageData forKey:(NSString*)key hash:(NSString*)hash
+{
+	[mPixelSizes removeObjectForKey:key];
+
 	[mRepository setObject:imageData
 					forKey:key];
 	[mHashList setObject:key
-				  forKey:[imageData checksumString]];
+				  forKey:hash];
+	[mKeyHashes setObject:hash
+				   forKey:key];
+	CFDictionarySetValue(mDataKeys, imageData, key);
 }
 
 - (BOOL)hasImageDataForKey:(NSString*)key
@@ -42,12 +270,18 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 
 - (NSString*)keyForImageData:(NSData*)imageData
 {
-	// if the imagedata is known to the repository, its key is returned, otherwise nil.
+	// if the imagedata is known to the repository, its key is returned, otherwise nil. Data that is one of the stored objects is found without
+	// needing to hash it
 
-	if (imageData)
-		return [mHashList objectForKey:[imageData checksumString]];
-	else
+	if (imageData == nil)
 		return nil;
+
+	NSString* key = (NSString*)CFDictionaryGetValue(mDataKeys, imageData);
+
+	if (key == nil)
+		key = [mHashList objectForKey:[imageData contentHashString]];
+
+	return key;
 }
 
 - (NSString*)generateKey
@@ -67,10 +301,21 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 	NSData* data = [self imageDataForKey:key];
 
 	if (data) {
-		NSString* cs = [data checksumString];
-		[mHashList removeObjectForKey:cs];
+		NSString* hash = [mKeyHashes objectForKey:key];
+
+		if (hash && [[mHashList objectForKey:hash] isEqualToString:key])
+			[mHashList removeObjectForKey:hash];
+
+		CFDictionaryRemoveValue(mDataKeys, data);
 	}
 
+	NSUInteger level, levels = [self proxyLevelCountForKey:key];
+
+	for (level = 0; level < levels; ++level)
+		[mProxies removeObjectForKey:proxyCacheKey(key, level)];
+
+	[mPixelSizes removeObjectForKey:key];
+	[mKeyHashes removeObjectForKey:key];
 	[mRepository removeObjectForKey:key];
 }
 
@@ -96,9 +341,9 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 	if (key != NULL)
 		*key = theKey;
 
-	// create and return the image
+	// create and return the image from the stored data, which may be mapped, so that the image doesn't keep the caller's copy
 
-	return [[[NSImage alloc] initWithData:imageData] autorelease];
+	return [[[NSImage alloc] initWithData:[self imageDataForKey:theKey]] autorelease];
 }
 
 - (NSImage*)makeImageWithPasteboard:(NSPasteboard*)pb key:(NSString**)key
@@ -166,6 +411,152 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 		return nil;
 }
 
+- (NSArray*)importImagesWithContentsOfURLs:(NSArray*)urls
+{
+	NSAssert(urls != nil, @"cannot import from nil URLs");
+
+	NSMutableArray* keys = [NSMutableArray arrayWithCapacity:[urls count]];
+
+	if ([urls count] == 0)
+		return keys;
+
+	DKImageImportBatch* batch = malloc(sizeof(DKImageImportBatch));
+
+	batch->count = [urls count];
+	batch->requests = malloc(sizeof(DKImageImportRequest*) * batch->count);
+
+	NSEnumerator* iter = [urls objectEnumerator];
+	NSURL* url;
+	size_t i = 0;
+
+	while ((url = [iter nextObject])) {
+		DKImageImportRequest* ir = calloc(1, sizeof(DKImageImportRequest));
+
+		ir->manager = [self retain];
+		ir->key = [[self generateKey] retain];
+		ir->url = [url copy];
+
+		[mPendingImports addObject:ir->key];
+		[keys addObject:ir->key];
+		batch->requests[i++] = ir;
+	}
+
+	LogEvent_(kFileEvent, @"image manager importing %lu images in the background", (unsigned long)[urls count]);
+
+	dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), batch, readImportedImages);
+
+	return keys;
+}
+
+- (BOOL)isImportingKey:(NSString*)key
+{
+	return [mPendingImports containsObject:key];
+}
+
+- (NSImage*)proxyImageForKey:(NSString*)key pixelSize:(CGFloat)pixels
+{
+	if ([self pixelSizeForKey:key] <= 0)
+		return nil;
+
+	NSUInteger levels = [self proxyLevelCountForKey:key];
+	NSUInteger wanted = [self proxyLevelForKey:key
+									 pixelSize:pixels];
+	NSImage* proxy = [mProxies objectForKey:proxyCacheKey(key, wanted)];
+
+	if (proxy)
+		return proxy;
+
+	[self makeProxyForKey:key
+					level:wanted];
+
+	// meanwhile, the nearest larger level is best, then the nearest smaller one
+
+	NSInteger level;
+
+	for (level = (NSInteger)wanted - 1; level >= 0; --level) {
+		proxy = [mProxies objectForKey:proxyCacheKey(key, level)];
+
+		if (proxy)
+			return proxy;
+	}
+
+	for (level = wanted + 1; level < (NSInteger)levels; ++level) {
+		proxy = [mProxies objectForKey:proxyCacheKey(key, level)];
+
+		if (proxy)
+			return proxy;
+	}
+
+	return nil;
+}
+
+- (NSImage*)makeProxyImageForKey:(NSString*)key pixelSize:(CGFloat)pixels
+{
+	CGFloat full = [self pixelSizeForKey:key];
+
+	if (full <= 0)
+		return nil;
+
+	NSUInteger level = [self proxyLevelForKey:key
+									pixelSize:pixels];
+	NSImage* proxy = [mProxies objectForKey:proxyCacheKey(key, level)];
+
+	if (proxy)
+		return proxy;
+
+	CGImageRef image = createProxyImage([self imageDataForKey:key], MAX(1.0, full / (CGFloat)(1 << level)));
+
+	if (image == NULL)
+		return nil;
+
+	if ([NSThread isMainThread]) {
+		[self installProxy:image
+					forKey:key
+					 level:level];
+		proxy = [mProxies objectForKey:proxyCacheKey(key, level)];
+	}
+
+	// the cache may have discarded it at once if it's too big to keep
+
+	if (proxy == nil) {
+		proxy = [[[NSImage alloc] initWithCGImage:image
+											 size:NSZeroSize] autorelease];
+		[proxy setCacheMode:NSImageCacheNever];
+	}
+
+	CGImageRelease(image);
+
+	return proxy;
+}
+
+- (BOOL)isMakingProxyForKey:(NSString*)key
+{
+	NSUInteger level, levels = [self proxyLevelCountForKey:key];
+
+	for (level = 0; level < levels; ++level) {
+		if ([mPendingProxies containsObject:proxyCacheKey(key, level)])
+			return YES;
+	}
+
+	return NO;
+}
+
+- (CGFloat)pixelSizeForKey:(NSString*)key
+{
+	NSNumber* size = [mPixelSizes objectForKey:key];
+
+	if (size == nil) {
+		NSData* data = [self imageDataForKey:key];
+		CGFloat pixels = data ? pixelSizeOfImageData(data) : 0;
+
+		size = [NSNumber numberWithDouble:pixels];
+		[mPixelSizes setObject:size
+						forKey:key];
+	}
+
+	return [size doubleValue];
+}
+
 - (void)setKey:(NSString*)key isInUse:(BOOL)inUse
 {
 	if ([self hasImageDataForKey:key]) {
@@ -196,23 +587,73 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 	// delete all data and associated keys for keys not in use
 
 	NSArray* keys = [[self allKeys] copy];
+	NSMutableArray* removed = [[NSMutableArray alloc] init];
 	NSEnumerator* iter = [keys objectEnumerator];
 	NSString* key;
 
 	while ((key = [iter nextObject])) {
-		if (![self keyIsInUse:key])
+		if (![self keyIsInUse:key]) {
+			[removed addObject:[self imageDataForKey:key]];
 			[self removeKey:key];
+		}
 	}
 
 	[keys release];
+
+	// the removed data is now only retained by <removed>, unless used elsewhere, so releasing it there frees or unmaps it off this thread
+
+	LogEvent_(kInfoEvent, @"image manager removed %lu unused images", (unsigned long)[removed count]);
+
+	dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_BACKGROUND, 0), removed, releaseDataInBackground);
+}
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	// only the decoded proxies can be made again - the image data is the drawing's content. Images being drawn meanwhile have their
+	// proxies made again in the background
+
+	NSUInteger bytes = [self proxyBytes];
+
+	[mProxies removeAllObjects];
+	return bytes;
+}
+
+- (void)getResidentDataBytes:(NSUInteger*)resident mappedDataBytes:(NSUInteger*)mapped
+{
+	NSUInteger threshold = [[self class] mappingThreshold];
+	NSEnumerator* iter = [mRepository objectEnumerator];
+	NSData* data;
+	NSUInteger heapBytes = 0, mappedBytes = 0;
+
+	while ((data = [iter nextObject])) {
+		if (threshold == 0 || [data length] < threshold)
+			heapBytes += [data length];
+		else
+			mappedBytes += [data length];
+	}
+
+	if (resident)
+		*resident = heapBytes;
+
+	if (mapped)
+		*mapped = mappedBytes;
+}
+
+- (NSUInteger)proxyBytes
+{
+	@synchronized(mProxies)
+	{
+		return mProxyBytes;
+	}
 }
 
 - (void)buildHashList
 {
-	// hash list maps hash (or checksum) -> key, so is inverse to repository. As it can be built from the repo, it is safer to do this following dearchiving
-	// rather than archive the hash list itself. Earlier versions did archive the hash list but that data can be ignored.
+	// hash list maps hash -> key, so is inverse to repository. Hashes archived with the repository are used if present, so that the data
+	// needn't be read just to hash it again. Earlier versions had a weaker checksum, which is ignored.
 
 	[mHashList removeAllObjects];
+	CFDictionaryRemoveAllValues(mDataKeys);
 
 	NSEnumerator* iter = [mRepository keyEnumerator];
 	NSString* key;
@@ -220,9 +661,188 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 
 	while ((key = [iter nextObject])) {
 		data = [mRepository objectForKey:key];
+
+		NSString* hash = [mKeyHashes objectForKey:key];
+
+		if (hash == nil) {
+			hash = [data contentHashString];
+			[mKeyHashes setObject:hash
+						   forKey:key];
+		}
+
 		[mHashList setObject:key
-					  forKey:[data checksumString]];
+					  forKey:hash];
+		CFDictionarySetValue(mDataKeys, data, key);
+	}
+}
+
+- (NSUInteger)proxyLevelCountForKey:(NSString*)key
+{
+	CGFloat full = [self pixelSizeForKey:key];
+	NSUInteger levels = 1;
+
+	while (full / (CGFloat)(1 << levels) >= kDKImageProxyMinimumPixelSize)
+		++levels;
+
+	return levels;
+}
+
+- (NSUInteger)proxyLevelForKey:(NSString*)key pixelSize:(CGFloat)pixels
+{
+	// level n is 1/2^n of the full size. The wanted level is the smallest that still has enough pixels
+
+	CGFloat full = [self pixelSizeForKey:key];
+	NSUInteger levels = [self proxyLevelCountForKey:key];
+	NSUInteger wanted = 0;
+
+	while (wanted + 1 < levels && full / (CGFloat)(1 << (wanted + 1)) >= pixels)
+		++wanted;
+
+	return wanted;
+}
+
+- (void)makeProxyForKey:(NSString*)key level:(NSUInteger)level
+{
+	NSString* cacheKey = proxyCacheKey(key, level);
+
+	if ([mPendingProxies containsObject:cacheKey])
+		return;
+
+	[mPendingProxies addObject:cacheKey];
+
+	DKImageProxyRequest* pr = malloc(sizeof(DKImageProxyRequest));
+
+	pr->manager = [self retain];
+	pr->key = [key copy];
+	pr->data = [[self imageDataForKey:key] retain];
+	pr->level = level;
+	pr->pixelSize = MAX(1.0, [self pixelSizeForKey:key] / (CGFloat)(1 << level));
+	pr->image = NULL;
+
+	dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), pr, makeProxyInBackground);
+}
+
+- (void)installProxy:(CGImageRef)image forKey:(NSString*)key level:(NSUInteger)level
+{
+	NSString* cacheKey = proxyCacheKey(key, level);
+
+	[mPendingProxies removeObject:cacheKey];
+
+	if (image == NULL)
+		return;
+
+	NSImage* proxy = [[NSImage alloc] initWithCGImage:image
+												 size:NSZeroSize];
+
+	NSUInteger cost = CGImageGetBytesPerRow(image) * CGImageGetHeight(image);
+
+	[proxy setCacheMode:NSImageCacheNever];
+
+	@synchronized(mProxies)
+	{
+		CFDictionarySetValue(mProxyCosts, proxy, (const void*)cost);
+		mProxyBytes += cost;
+	}
+
+	[mProxies setObject:proxy
+				 forKey:cacheKey
+				   cost:cost];
+	[proxy release];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKImageDataManagerDidCreateProxyNotification
+														object:self
+													  userInfo:[NSDictionary dictionaryWithObject:key
+																						   forKey:@"key"]];
+}
+
+- (void)queueFinishedImport:(void*)request
+{
+	// called on the background queue. The imports that finish before the main thread gets round to storing them are stored together
+
+	@synchronized(mFinishedImports)
+	{
+		[mFinishedImports addObject:[NSValue valueWithPointer:request]];
+
+		if (!mStoreImportsScheduled) {
+			mStoreImportsScheduled = YES;
+			dispatch_async_f(dispatch_get_main_queue(), [self retain], storeImportedImages);
+		}
+	}
+}
+
+- (void)storeFinishedImports
+{
+	NSArray* finished;
+
+	@synchronized(mFinishedImports)
+	{
+		finished = [mFinishedImports copy];
+		[mFinishedImports removeAllObjects];
+		mStoreImportsScheduled = NO;
+	}
+
+	NSEnumerator* iter = [finished objectEnumerator];
+	NSValue* value;
+
+	while ((value = [iter nextObject])) {
+		DKImageImportRequest* ir = (DKImageImportRequest*)[value pointerValue];
+		NSString* imageKey = nil;
+
+		if (ir->data) {
+			// data already stored is shared rather than stored again under the new key
+
+			imageKey = [mHashList objectForKey:ir->hash];
+
+			if (imageKey == nil) {
+				[self storeImageData:ir->data
+							  forKey:ir->key
+								hash:ir->hash];
+				[mPixelSizes setObject:[NSNumber numberWithDouble:ir->pixelSize]
+								forKey:ir->key];
+				imageKey = ir->key;
+			}
+		} else
+			LogEvent_(kFileEvent, @"image manager couldn't import image from %@", ir->url);
+
+		[mPendingImports removeObject:ir->key];
+
+		NSDictionary* userInfo;
+
+		if (imageKey)
+			userInfo = [NSDictionary dictionaryWithObjectsAndKeys:ir->key, @"key", imageKey, @"imageKey", nil];
+		else
+			userInfo = [NSDictionary dictionaryWithObject:ir->key
+												   forKey:@"key"];
+
+		[[NSNotificationCenter defaultCenter] postNotificationName:kDKImageDataManagerDidImportImageNotification
+															object:self
+														  userInfo:userInfo];
+
+		[ir->data release];
+		[ir->hash release];
+		[ir->url release];
+		[ir->key release];
+		[ir->manager release];
+		free(ir);
 	}
+
+	[finished release];
+}
+
+- (NSData*)storableData:(NSData*)data
+{
+	// large data is moved to a mapped file, unless it's already mapped. There's no direct way to tell, so data that was stored before is
+	// taken to be in its final form
+
+	NSUInteger threshold = [[self class] mappingThreshold];
+
+	if (threshold == 0 || [data length] < threshold || CFDictionaryContainsKey(mDataKeys, data))
+		return data;
+
+	NSData* mapped = [[self class] mappedDataWithBytes:[data bytes]
+												length:[data length]];
+
+	return mapped ? mapped : data;
 }
 
 #pragma mark -
@@ -234,6 +854,18 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 		mRepository = [[NSMutableDictionary alloc] init];
 		mHashList = [[NSMutableDictionary alloc] init];
 		mKeyUsage = [[NSMutableDictionary alloc] init];
+		mKeyHashes = [[NSMutableDictionary alloc] init];
+		mDataKeys = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+		mProxies = [[NSCache alloc] init];
+		[mProxies setTotalCostLimit:kDKImageProxyCacheCostLimit];
+		[mProxies setDelegate:self];
+		mProxyCosts = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+		mPixelSizes = [[NSMutableDictionary alloc] init];
+		mPendingProxies = [[NSMutableSet alloc] init];
+		mPendingImports = [[NSMutableSet alloc] init];
+		mFinishedImports = [[NSMutableArray alloc] init];
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeDecodedImages];
 	}
 
 	return self;
@@ -241,9 +873,19 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 
 - (void)dealloc
 {
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
 	[mRepository release];
 	[mHashList release];
 	[mKeyUsage release];
+	[mKeyHashes release];
+	CFRelease(mDataKeys);
+	[mProxies setDelegate:nil];
+	[mProxies release];
+	CFRelease(mProxyCosts);
+	[mPixelSizes release];
+	[mPendingProxies release];
+	[mPendingImports release];
+	[mFinishedImports release];
 	[super dealloc];
 }
 
@@ -251,14 +893,52 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 {
 	[coder encodeObject:mRepository
 				 forKey:@"DKImageDataManager_repo"];
+	[coder encodeObject:mKeyHashes
+				 forKey:@"DKImageDataManager_hashes"];
 }
 
 - (id)initWithCoder:(NSCoder*)coder
 {
-	mRepository = [[coder decodeObjectForKey:@"DKImageDataManager_repo"] retain];
+	mRepository = [[NSMutableDictionary alloc] init];
 	mHashList = [[NSMutableDictionary alloc] init];
+	mKeyHashes = [[NSMutableDictionary alloc] init];
+	mDataKeys = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+	mProxies = [[NSCache alloc] init];
+	[mProxies setTotalCostLimit:kDKImageProxyCacheCostLimit];
+	[mProxies setDelegate:self];
+	mProxyCosts = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+	mPixelSizes = [[NSMutableDictionary alloc] init];
+	mPendingProxies = [[NSMutableSet alloc] init];
+	mPendingImports = [[NSMutableSet alloc] init];
+	mFinishedImports = [[NSMutableArray alloc] init];
+	[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+												priority:kDKCachePurgeDecodedImages];
+
+	// large data decoded from a keyed archive is on the heap, so is moved to mapped files. Data from the chunked format is already mapped,
+	// and is kept as it is.
+
+	NSDictionary* repository = [coder decodeObjectForKey:@"DKImageDataManager_repo"];
+	NSDictionary* hashes = [coder decodeObjectForKey:@"DKImageDataManager_hashes"];
+	NSEnumerator* iter = [repository keyEnumerator];
+	NSString* key;
+
+	while ((key = [iter nextObject])) {
+		NSData* data = [repository objectForKey:key];
+
+		if (![coder respondsToSelector:@selector(sharedImageData)] || [[(DKKeyedUnarchiver*)coder sharedImageData] indexOfObjectIdenticalTo:data] == NSNotFound)
+			data = [self storableData:data];
+
+		[mRepository setObject:data
+						forKey:key];
 
-	// hash list is built from repository, so there is no need to archive it.
+		NSString* hash = [hashes objectForKey:key];
+
+		if (hash)
+			[mKeyHashes setObject:hash
+						   forKey:key];
+	}
+
+	// hash list is built from repository and the archived hashes, hashing any data that wasn't archived with one
 
 	[self buildHashList];
 
@@ -280,6 +960,22 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 	return [NSString stringWithFormat:@"%@, keys = %@", [super description], [self allKeys]];
 }
 
+#pragma mark -
+#pragma mark As an NSCache delegate
+
+- (void)cache:(NSCache*)cache willEvictObject:(id)obj
+{
+#pragma unused(cache)
+
+	// called for proxies the cache discards as well as those removed, on whichever thread that happens
+
+	@synchronized(mProxies)
+	{
+		mProxyBytes -= MIN(mProxyBytes, (NSUInteger)CFDictionaryGetValue(mProxyCosts, obj));
+		CFDictionaryRemoveValue(mProxyCosts, obj);
+	}
+}
+
 @end
 
 #pragma mark -
@@ -310,4 +1006,18 @@ NSString* kDKImageDataManagerPasteboardType = @"net.apptree.drawkit.imgdatamgrty
 	return [NSString stringWithFormat:@"%ld", (long)[self checksum]];
 }
 
+- (NSString*)contentHashString
+{
+	unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+	char hex[CC_SHA256_DIGEST_LENGTH * 2 + 1];
+	NSUInteger i;
+
+	CC_SHA256([self bytes], (CC_LONG)[self length], digest);
+
+	for (i = 0; i < CC_SHA256_DIGEST_LENGTH; ++i)
+		snprintf(hex + i * 2, 3, "%02x", digest[i]);
+
+	return [NSString stringWithUTF8String:hex];
+}
+
 @end
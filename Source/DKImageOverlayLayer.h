@@ -6,6 +6,8 @@
 
 #import "DKLayer.h"
 
+@class DKImageTilePyramid;
+
 // coverage method flags - can be combined to give different effects
 
 typedef enum {
@@ -22,11 +24,18 @@ typedef enum {
 
 This layer type implements a single image overlay, for example for tracing a photograph in another layer. The coverage method
 sets whether the image is scaled, tiled or drawn only once in a particular position.
+
+For very large images, such as scanned plans, the layer can draw from a DKImageTilePyramid instead of the image itself: the image's data
+is cut into tiles at several resolutions, cached on disk, and only the tiles within the update rect at a resolution suited to the view's
+scale are decoded and drawn. This needs the image's original data, so the image must be set from data or a file.
 */
 @interface DKImageOverlayLayer : DKLayer <NSCoding> {
 	NSImage* m_image;
 	CGFloat m_opacity;
 	DKImageCoverageFlags m_coverageMethod;
+	NSData* mImageData; // the data the image was made from, if known
+	DKImageTilePyramid* mTilePyramid; // made when first drawn in tiled mode
+	BOOL mUsesTilePyramid;
 }
 
 - (id)initWithImage:(NSImage*)image;
@@ -35,6 +44,21 @@ sets whether the image is scaled, tiled or drawn only once in a particular posit
 - (void)setImage:(NSImage*)image;
 - (NSImage*)image;
 
+/** @brief Sets the image from data, which is kept so that the image can be archived and tiled from it
+ @param data image data
+ */
+- (void)setImageData:(NSData*)data;
+- (NSData*)imageData;
+
+/** @brief Sets whether the image is drawn from tiles cut at several resolutions rather than from the image itself
+
+ Only takes effect if the image was set from data. Until the tiles are ready nothing is drawn on screen, though the coarsest tiles are cut first.
+ @param tiled YES to draw from tiles
+ */
+- (void)setUsesTilePyramid:(BOOL)tiled;
+- (BOOL)usesTilePyramid;
+- (DKImageTilePyramid*)tilePyramid;
+
 - (void)setOpacity:(CGFloat)op;
 - (CGFloat)opacity;
 
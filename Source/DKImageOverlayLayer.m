@@ -7,6 +7,16 @@
 #import "DKImageOverlayLayer.h"
 
 #import "DKDrawing.h"
+#import "DKImageTilePyramid.h"
+
+@interface DKImageOverlayLayer (Private)
+
+/** @brief Draws the whole image into <destRect>, or the part of it within <clip> when drawing from tiles
+ */
+- (void)drawImageInRect:(NSRect)destRect clipRect:(NSRect)clip;
+- (void)tilesLoaded:(NSNotification*)note;
+
+@end
 
 @implementation DKImageOverlayLayer
 #pragma mark As a DKImageOverlayLayer
@@ -31,8 +41,18 @@
 
 - (id)initWithContentsOfFile:(NSString*)imagefile
 {
-	NSImage* img = [[[NSImage alloc] initWithContentsOfFile:imagefile] autorelease];
-	return [self initWithImage:img];
+	// the data is kept, mapped if the file allows, so that the image can be drawn from tiles
+
+	NSData* data = [NSData dataWithContentsOfFile:imagefile
+										  options:NSDataReadingMappedIfSafe
+											error:NULL];
+	NSImage* img = data ? [[[NSImage alloc] initWithData:data] autorelease] : nil;
+
+	self = [self initWithImage:img];
+	if (self)
+		mImageData = [data retain];
+
+	return self;
 }
 
 #pragma mark -
@@ -42,6 +62,21 @@
 	[m_image release];
 	m_image = image;
 	[m_image setFlipped:YES];
+
+	// any data and tiles belonged to the previous image
+
+	[mImageData release];
+	mImageData = nil;
+
+	if (mTilePyramid) {
+		[[NSNotificationCenter defaultCenter] removeObserver:self
+														name:kDKImageTilePyramidDidLoadTilesNotification
+													  object:mTilePyramid];
+		[mTilePyramid release];
+		mTilePyramid = nil;
+	}
+
+	[self setNeedsDisplay:YES];
 }
 
 - (NSImage*)image
@@ -49,6 +84,52 @@
 	return m_image;
 }
 
+- (void)setImageData:(NSData*)data
+{
+	NSAssert(data != nil, @"cannot set nil image data");
+
+	NSImage* image = [[NSImage alloc] initWithData:data];
+
+	if (image) {
+		[self setImage:image];
+		mImageData = [data retain];
+		[image release];
+	}
+}
+
+- (NSData*)imageData
+{
+	return mImageData;
+}
+
+- (void)setUsesTilePyramid:(BOOL)tiled
+{
+	if (tiled != mUsesTilePyramid) {
+		mUsesTilePyramid = tiled;
+		[self setNeedsDisplay:YES];
+	}
+}
+
+- (BOOL)usesTilePyramid
+{
+	return mUsesTilePyramid;
+}
+
+- (DKImageTilePyramid*)tilePyramid
+{
+	if (mTilePyramid == nil && mUsesTilePyramid && mImageData) {
+		mTilePyramid = [[DKImageTilePyramid alloc] initWithData:mImageData];
+
+		if (mTilePyramid)
+			[[NSNotificationCenter defaultCenter] addObserver:self
+													 selector:@selector(tilesLoaded:)
+														 name:kDKImageTilePyramidDidLoadTilesNotification
+													   object:mTilePyramid];
+	}
+
+	return mUsesTilePyramid ? mTilePyramid : nil;
+}
+
 #pragma mark -
 - (void)setOpacity:(CGFloat)op
 {
@@ -104,6 +185,43 @@
 	return r;
 }
 
+#pragma mark -
+
+- (void)drawImageInRect:(NSRect)destRect clipRect:(NSRect)clip
+{
+	DKImageTilePyramid* pyramid = [self tilePyramid];
+
+	if (pyramid) {
+		// until the tiles are ready only printing falls back to the image, since on screen that would decode it in full
+
+		if ([pyramid drawInRect:destRect
+						  clipRect:clip
+						 operation:NSCompositeSourceAtop
+						  fraction:[self opacity]] ||
+			[[NSGraphicsContext currentContext] isDrawingToScreen])
+			return;
+	}
+
+	[[self image] drawInRect:destRect
+					fromRect:NSZeroRect
+				   operation:NSCompositeSourceAtop
+					fraction:[self opacity]];
+}
+
+- (void)tilesLoaded:(NSNotification*)note
+{
+	NSRect ur = [[[note userInfo] objectForKey:@"rect"] rectValue];
+	NSRect dr = [self imageDestinationRect];
+
+	// a repeating image shows the tiles in many places, so is simply redrawn
+
+	if ([self coverageMethod] & (kDKDrawingImageCoverageVerticallyTiled | kDKDrawingImageCoverageHorizontallyTiled))
+		[self setNeedsDisplay:YES];
+	else
+		[self setNeedsDisplayInRect:NSMakeRect(NSMinX(dr) + NSMinX(ur) * NSWidth(dr), NSMinY(dr) + NSMinY(ur) * NSHeight(dr),
+											   NSWidth(ur) * NSWidth(dr), NSHeight(ur) * NSHeight(dr))];
+}
+
 #pragma mark -
 #pragma mark As a DKLayer
 - (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView
@@ -145,10 +263,8 @@
 
 			for (y = 0; y < v; ++y) {
 				for (x = 0; x < h; ++x) {
-					[[self image] drawInRect:ri
-									fromRect:NSZeroRect
-								   operation:NSCompositeSourceAtop
-									fraction:[self opacity]];
+					[self drawImageInRect:ri
+								 clipRect:rect];
 					ri.origin.x += ri.size.width;
 				}
 				ri.origin.x = dr.origin.x;
@@ -157,10 +273,8 @@
 		} else {
 			// straightforward composition of the image
 
-			[[self image] drawInRect:dr
-							fromRect:NSZeroRect
-						   operation:NSCompositeSourceAtop
-							fraction:[self opacity]];
+			[self drawImageInRect:dr
+						 clipRect:rect];
 		}
 	}
 }
@@ -169,6 +283,9 @@
 #pragma mark As an NSObject
 - (void)dealloc
 {
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[mTilePyramid release];
+	[mImageData release];
 	[m_image release];
 
 	[super dealloc];
@@ -181,8 +298,17 @@
 	NSAssert(coder != nil, @"Expected valid coder");
 	[super encodeWithCoder:coder];
 
-	[coder encodeObject:[self image]
-				 forKey:@"image"];
+	// the original data is archived in preference to the image, as it's smaller and lets the image be tiled again
+
+	if (mImageData)
+		[coder encodeObject:mImageData
+					 forKey:@"DKImageOverlayLayer_imageData"];
+	else
+		[coder encodeObject:[self image]
+					 forKey:@"image"];
+
+	[coder encodeBool:[self usesTilePyramid]
+			   forKey:@"DKImageOverlayLayer_usesTilePyramid"];
 	[coder encodeDouble:[self opacity]
 				 forKey:@"opacity"];
 	[coder encodeInteger:[self coverageMethod]
@@ -194,7 +320,14 @@
 	NSAssert(coder != nil, @"Expected valid coder");
 	self = [super initWithCoder:coder];
 	if (self != nil) {
-		[self setImage:[coder decodeObjectForKey:@"image"]];
+		NSData* data = [coder decodeObjectForKey:@"DKImageOverlayLayer_imageData"];
+
+		if (data)
+			[self setImageData:data];
+		else
+			[self setImage:[coder decodeObjectForKey:@"image"]];
+
+		[self setUsesTilePyramid:[coder decodeBoolForKey:@"DKImageOverlayLayer_usesTilePyramid"]];
 		[self setOpacity:[coder decodeDoubleForKey:@"opacity"]];
 		[self setCoverageMethod:[coder decodeIntegerForKey:@"coveragemethod"]];
 
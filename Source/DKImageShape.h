@@ -45,6 +45,9 @@ A hotspot is added to allow the user to drag the image offset position around.
 	DKImageCroppingOptions mImageCropping; // whether the image is scaled or cropped to the bounds
 	NSInteger mImageOffsetPartcode; // the partcode of the image offset hotspot
 	NSData* mOriginalImageData; // original image data (shared with image manager)
+	BOOL mAwaitingProxy; // YES while waiting for the image manager to make a proxy to draw
+	NSString* mPendingImageKey; // key of an image the image manager is importing, which the placeholder is showing for
+	NSSize mPendingImageMaximumSize; // the largest size the shape takes on when the pending image arrives, or zero for any
 }
 
 + (DKStyle*)imageShapeDefaultStyle;
@@ -76,6 +79,22 @@ A hotspot is added to allow the user to drag the image offset position around.
  */
 - (id)initWithContentsOfFile:(NSString*)filepath;
 
+/** @brief Initializes the image shape as a placeholder for an image the image manager is importing
+
+ The shape shows a placeholder of kDKImageShapePlaceholderSize until the manager posts kDKImageDataManagerDidImportImageNotification for
+ <key>, and then shows the image, taking on its size - scaled down to fit <maxSize> if need be - unless the placeholder has been resized
+ meanwhile. The swap isn't undoable. If the image can't be read the placeholder remains.
+ @param key a key returned by -[DKImageDataManager importImagesWithContentsOfURLs:]
+ @param maxSize the largest size the image is shown at to begin with, or NSZeroSize for the image's own size
+ @return the object
+ */
+- (id)initWithPendingImageKey:(NSString*)key maximumSize:(NSSize)maxSize;
+
+/** @brief The key of the image the shape is a placeholder for
+ @return the key, or nil once the image has arrived
+ */
+- (NSString*)pendingImageKey;
+
 /** @brief Sets the object's image
 
  The shape's path, size, angle, etc. are not changed by this method
@@ -247,6 +266,19 @@ A hotspot is added to allow the user to drag the image offset position around.
  */
 - (DKImageCroppingOptions)imageCroppingOptions;
 
+/** @brief The rect the image is drawn into, in the coordinates given by -imageDrawingTransform
+
+ The image is drawn into this rect with the transform concatenated, clipped to the shape's transformed path. Exporters that write the
+ image themselves rather than drawing it use these to place it the same way.
+ @return a rect
+ */
+- (NSRect)imageDrawingRect;
+
+/** @brief The transform from the image's coordinates to the drawing's, taking in the shape's own and those of any groups it's in
+ @return a transform
+ */
+- (NSAffineTransform*)imageDrawingTransform;
+
 // user actions
 
 /** @brief Select whether the object displays using crop or scale modes
@@ -316,3 +348,5 @@ A hotspot is added to allow the user to drag the image offset position around.
 extern NSString* kDKOriginalFileMetadataKey;
 extern NSString* kDKOriginalImageDimensionsMetadataKey;
 extern NSString* kDKOriginalNameMetadataKey;
+
+#define kDKImageShapePlaceholderSize 128 // the width and height of a placeholder for an image being imported
@@ -14,6 +14,9 @@
 #import "DKDrawing.h"
 #import "DKImageDataManager.h"
 #import "DKKeyedUnarchiver.h"
+#import "DKDrawingRenderer.h"
+#import "DKPrintDrawingView.h"
+#import "DKPDFResources.h"
 
 #pragma mark Constants
 
@@ -38,8 +41,54 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
  */
 - (void)drawImage;
 
+/** @brief Replaces the original data with the image manager's copy of the same data
+
+ The image is rebuilt from the new data without registering an undo, since what is drawn is the same.
+ @param data the image manager's data
+ */
+- (void)adoptImageData:(NSData*)data;
+
+/** @brief Returns the image to draw into a rect of the current context
+
+ When drawing to the screen this is the image manager's proxy that best matches the number of pixels the rect covers, or nil if none
+ is ready yet. Otherwise, as when printing, it is the image itself.
+ @param rect the rect the image will be drawn in, in the current coordinates
+ @return the image to draw, or nil to draw nothing this time
+ */
+- (NSImage*)imageForDrawingInRect:(NSRect)rect;
+- (void)proxyImageCreated:(NSNotification*)note;
+
+/** @brief Replaces the placeholder with the imported image, if the notification is for the pending key
+ @param note kDKImageDataManagerDidImportImageNotification
+ */
+- (void)pendingImageImported:(NSNotification*)note;
+- (void)setPendingImageKey:(NSString*)key;
+
 @end
 
+static NSImage* placeholderImage(void)
+{
+	// one image is shared by all placeholders
+
+	static NSImage* sPlaceholder = nil;
+
+	if (sPlaceholder == nil) {
+		NSRect r = NSMakeRect(0, 0, kDKImageShapePlaceholderSize, kDKImageShapePlaceholderSize);
+
+		sPlaceholder = [[NSImage alloc] initWithSize:r.size];
+		[sPlaceholder lockFocus];
+		[[NSColor colorWithCalibratedWhite:0.9
+									 alpha:1.0] set];
+		NSRectFill(r);
+		[[NSColor colorWithCalibratedWhite:0.6
+									 alpha:1.0] set];
+		NSFrameRect(r);
+		[sPlaceholder unlockFocus];
+	}
+
+	return sPlaceholder;
+}
+
 @implementation DKImageShape
 #pragma mark As a DKImageShape
 
@@ -201,6 +250,24 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
 	return self;
 }
 
+- (id)initWithPendingImageKey:(NSString*)key maximumSize:(NSSize)maxSize
+{
+	NSAssert(key != nil, @"cannot wait for a nil key");
+
+	self = [self initWithImage:placeholderImage()];
+	if (self) {
+		[self setPendingImageKey:key];
+		mPendingImageMaximumSize = maxSize;
+	}
+
+	return self;
+}
+
+- (NSString*)pendingImageKey
+{
+	return mPendingImageKey;
+}
+
 #pragma mark -
 
 /** @brief Sets the object's image
@@ -356,9 +423,7 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
 			NSString* key = [newIM keyForImageData:imageData];
 
 			if (key) {
-				imageData = [[newIM imageDataForKey:key] retain];
-				[mOriginalImageData release];
-				mOriginalImageData = imageData;
+				[self adoptImageData:[newIM imageDataForKey:key]];
 				[self setImageKey:key];
 
 				//NSLog(@"image data was found in new IM, updated key: %@", key );
@@ -370,6 +435,7 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
 
 				[newIM setImageData:imageData
 							 forKey:key];
+				[self adoptImageData:[newIM imageDataForKey:key]];
 				[self setImageKey:key];
 
 				//NSLog(@"image data was added to new IM, key: %@", key );
@@ -401,6 +467,12 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
 		image = [imgMgr makeImageWithData:data
 									  key:&key];
 
+		// the manager may hold the data mapped rather than on the heap, so keep its copy and not the caller's
+
+		data = [[imgMgr imageDataForKey:key] retain];
+		[mOriginalImageData release];
+		mOriginalImageData = data;
+
 		[self setImage:image];
 		[self setImageKey:key];
 	} else {
@@ -672,47 +744,242 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
 	return mImageCropping;
 }
 
+- (NSRect)imageDrawingRect
+{
+	NSRect ir;
+
+	ir.size = [[self image] size];
+
+	if ([self imageCroppingOptions] == kDKImageScaleToPath) {
+		ir.origin.x = m_imageOffset.x - (ir.size.width / 2.0);
+		ir.origin.y = m_imageOffset.y - (ir.size.height / 2.0);
+	} else {
+		ir.origin.x = m_imageOffset.x;
+		ir.origin.y = m_imageOffset.y;
+	}
+
+	return ir;
+}
+
+- (NSAffineTransform*)imageDrawingTransform
+{
+	NSAffineTransform* tx = [self imageTransform];
+
+	[tx appendTransform:[self containerTransform]];
+	return tx;
+}
+
 #pragma mark -
 
+- (void)adoptImageData:(NSData*)data
+{
+	if (data == nil || data == mOriginalImageData)
+		return;
+
+	[data retain];
+	[mOriginalImageData release];
+	mOriginalImageData = data;
+
+	// the image may be holding the original data, so it's rebuilt from the new data for that to be freed
+
+	if (m_image) {
+		NSImage* image = [[NSImage alloc] initWithData:data];
+
+		if (image) {
+			[image setCacheMode:NSImageCacheNever];
+			[m_image release];
+			m_image = image;
+		}
+	}
+}
+
 - (void)drawImage
 {
 	// the image must be transformed to the object's scale, rotation and position. This is achieved by concatenating the transform
 	// to the current graphics context.
 
 	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
-		NSAffineTransform* xt = [self containerTransform];
 
 	[[self transformedPath] addClip];
+	[[self imageDrawingTransform] concat];
 
-	NSAffineTransform* tx = [self imageTransform];
-	[tx appendTransform:xt];
-	[tx concat];
+	NSRect ir = [self imageDrawingRect];
 
-	NSRect ir;
+	// render at high quality
 
-	ir.size = [[self image] size];
+	NSImage* image = [self imageForDrawingInRect:ir];
+	NSRect fromRect = NSZeroRect;
 
-	if ([self imageCroppingOptions] == kDKImageScaleToPath) {
-		ir.origin.x = m_imageOffset.x - (ir.size.width / 2.0);
-		ir.origin.y = m_imageOffset.y - (ir.size.height / 2.0);
-	} else {
-		ir.origin.x = m_imageOffset.x;
-		ir.origin.y = m_imageOffset.y;
+	[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
+	[image setFlipped:[[NSGraphicsContext currentContext] isFlipped]];
+
+	// a PDF or print draws the whole image from the one copy the document holds, clipped by the path, so that it isn't embedded again
+	// for each page or each shape showing it
+
+	if ([[DKPDFResources currentResources] drawImage:image
+											  forKey:[self imageKey]
+											  inRect:ir
+										   operation:[self compositingOperation]
+											fraction:[self imageOpacity]]) {
+		RESTORE_GRAPHICS_CONTEXT
+		return;
 	}
 
-	// render at high quality
+	// a printed page gets only the part of the image it shows. The clip is in the image's space here, so it maps straight to the image
 
-	[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
-	[[self image] setFlipped:[[NSGraphicsContext currentContext] isFlipped]];
+	if ([DKPrintDrawingView isPrinting] && image != nil) {
+		CGRect clip = CGContextGetClipBoundingBox([[NSGraphicsContext currentContext] graphicsPort]);
+		NSRect visible = NSIntersectionRect(ir, NSRectFromCGRect(clip));
 
-	[[self image] drawInRect:ir
-					fromRect:NSZeroRect
-				   operation:[self compositingOperation]
-					fraction:[self imageOpacity]];
+		if (NSIsEmptyRect(visible)) {
+			RESTORE_GRAPHICS_CONTEXT
+			return;
+		}
+
+		if (!NSEqualRects(visible, ir)) {
+			NSSize is = [image size];
+			CGFloat sx = is.width / NSWidth(ir);
+			CGFloat sy = is.height / NSHeight(ir);
+
+			fromRect = NSMakeRect((NSMinX(visible) - NSMinX(ir)) * sx, (NSMinY(visible) - NSMinY(ir)) * sy, NSWidth(visible) * sx, NSHeight(visible) * sy);
+			ir = visible;
+		}
+	}
+
+	[image drawInRect:ir
+			 fromRect:fromRect
+			operation:[self compositingOperation]
+			 fraction:[self imageOpacity]];
 
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 }
 
+- (NSImage*)imageForDrawingInRect:(NSRect)rect
+{
+	DKImageDataManager* imgMgr = [[self container] imageManager];
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+
+	// printed images are decoded at once at the printed resolution, from the level of the mip chain that has enough pixels for it
+
+	if (imgMgr != nil && [self imageKey] != nil && [DKPrintDrawingView isPrinting] && [DKPrintDrawingView printedImageResolution] > 0) {
+		CGAffineTransform ct = CGContextGetCTM([context graphicsPort]);
+		CGFloat pointScale = sqrt(fabs(ct.a * ct.d - ct.b * ct.c));
+		NSImage* proxy = [imgMgr makeProxyImageForKey:[self imageKey]
+											pixelSize:MAX(NSWidth(rect), NSHeight(rect)) * pointScale * [DKPrintDrawingView printedImageResolution] / 72.0];
+
+		return proxy ? proxy : [self image];
+	}
+
+	// headless renders are never redrawn, so they can't wait for a proxy to be made
+
+	if (imgMgr == nil || [self imageKey] == nil || ![context isDrawingToScreen] || [DKDrawingRenderer isRenderingOnCurrentThread] || [imgMgr pixelSizeForKey:[self imageKey]] <= 0)
+		return [self image];
+
+	// the number of device pixels the image covers is found from the context's transform, which includes the view's scale and the
+	// backing scale factor
+
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform([context graphicsPort]);
+	CGFloat deviceScale = sqrt(fabs(dt.a * dt.d - dt.b * dt.c));
+	NSImage* proxy = [imgMgr proxyImageForKey:[self imageKey]
+									pixelSize:MAX(NSWidth(rect), NSHeight(rect)) * deviceScale];
+
+	// unless the best proxy is ready, the shape is redrawn when another one is made
+
+	if (!mAwaitingProxy && [imgMgr isMakingProxyForKey:[self imageKey]]) {
+		mAwaitingProxy = YES;
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(proxyImageCreated:)
+													 name:kDKImageDataManagerDidCreateProxyNotification
+												   object:imgMgr];
+	}
+
+	return proxy;
+}
+
+- (void)proxyImageCreated:(NSNotification*)note
+{
+	if ([[[note userInfo] objectForKey:@"key"] isEqualToString:[self imageKey]]) {
+		mAwaitingProxy = NO;
+		[[NSNotificationCenter defaultCenter] removeObserver:self
+														name:kDKImageDataManagerDidCreateProxyNotification
+													  object:[note object]];
+		[self notifyVisualChange];
+	}
+}
+
+- (void)pendingImageImported:(NSNotification*)note
+{
+	if (![[[note userInfo] objectForKey:@"key"] isEqualToString:mPendingImageKey])
+		return;
+
+	[self setPendingImageKey:nil];
+
+	DKImageDataManager* imgMgr = [note object];
+	NSString* key = [[note userInfo] objectForKey:@"imageKey"];
+	NSImage* image = key ? [imgMgr makeImageForKey:key] : nil;
+
+	if (image == nil) {
+		LogEvent_(kReactiveEvent, @"image shape %@ keeps its placeholder, image wasn't imported", self);
+		return;
+	}
+
+	// the placeholder stood in for the image from the start, so the swap is not something to undo
+
+	NSUndoManager* um = [self undoManager];
+	BOOL resize = NSEqualSizes([self size], [placeholderImage() size]);
+
+	[um disableUndoRegistration];
+
+	@try {
+		[self setImage:image];
+		[self setImageKey:key];
+
+		NSData* data = [[imgMgr imageDataForKey:key] retain];
+		[mOriginalImageData release];
+		mOriginalImageData = data;
+
+		if (resize) {
+			NSSize size = [image size];
+
+			if (mPendingImageMaximumSize.width > 0 && mPendingImageMaximumSize.height > 0 && size.width > 0 && size.height > 0) {
+				CGFloat scale = MIN(1.0, MIN(mPendingImageMaximumSize.width / size.width, mPendingImageMaximumSize.height / size.height));
+
+				size.width *= scale;
+				size.height *= scale;
+			}
+
+			[self setSize:size];
+		}
+
+		// in case the shape has been moved to another drawing meanwhile
+
+		[self transferImageKeyToNewContainer:[self container]];
+	}
+	@finally {
+		[um enableUndoRegistration];
+	}
+}
+
+- (void)setPendingImageKey:(NSString*)key
+{
+	if (mPendingImageKey)
+		[[NSNotificationCenter defaultCenter] removeObserver:self
+														name:kDKImageDataManagerDidImportImageNotification
+													  object:nil];
+
+	[key retain];
+	[mPendingImageKey release];
+	mPendingImageKey = key;
+
+	// the shape may not be in a drawing yet, so it can't know which manager will post the notification
+
+	if (mPendingImageKey)
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(pendingImageImported:)
+													 name:kDKImageDataManagerDidImportImageNotification
+												   object:nil];
+}
+
 - (NSAffineTransform*)imageTransform
 {
 	NSAffineTransform* tfm = [NSAffineTransform transform];
@@ -944,6 +1211,8 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
  */
 - (void)dealloc
 {
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[mPendingImageKey release];
 	[m_image release];
 	[mImageKey release];
 	[mOriginalImageData release];
@@ -1139,6 +1408,11 @@ NSString* kDKOriginalNameMetadataKey = @"dk_original_name";
 	copy->mImageOffsetPartcode = mImageOffsetPartcode;
 	[[copy hotspotForPartCode:mImageOffsetPartcode] setDelegate:copy];
 
+	if (mPendingImageKey) {
+		[copy setPendingImageKey:mPendingImageKey];
+		copy->mPendingImageMaximumSize = mPendingImageMaximumSize;
+	}
+
 	return copy;
 }
 
@@ -0,0 +1,74 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/** @brief A very large image kept on disk as tiles at several resolutions, so that only the tiles being drawn are decoded and held in memory.
+
+ A very large image kept on disk as tiles at several resolutions, so that only the tiles being drawn are decoded and held in memory. Level 0
+ is the image at full size, and each level after it is half the size of the one before, down to one that fits in a single tile. Every level
+ is cut into tiles kDKImageTilePyramidTileSize pixels square, which are written as PNG files to a directory named by a hash of the image's
+ data, so each image is only ever cut once and its tiles are found again whenever it is opened.
+
+ The tiles are cut in the background when the pyramid is made, coarsest level first, so something can be drawn soon after. Cutting level 0
+ decodes the image at full size once; after that it is never decoded whole again. Drawing uses the smallest level that has at least as many
+ pixels as the area it covers on screen, and draws only that level's tiles within the clip. Tiles not in memory are decoded in the background,
+ one at a time, while the area they cover is drawn from the smallest level, and kDKImageTilePyramidDidLoadTilesNotification is posted as
+ each arrives. No more than -maximumTileCount tiles are kept in memory; those drawn least recently are discarded first.
+
+ Off the main thread, or when not drawing to the screen, the tiles that are needed are read from disk as they are drawn, since such renders
+ aren't redrawn.
+*/
+@interface DKImageTilePyramid : NSObject {
+@private
+	NSData* mData; // the image data, kept until all of its tiles have been cut
+	NSString* mDirectory; // where the tiles are, once known
+	NSSize mPixelSize; // the size of level 0
+	NSUInteger mLevelCount;
+	uint32_t mBuiltLevels; // bit n is set once level n's tiles are all on disk
+	NSMutableDictionary* mTiles; // "level/col/row" -> in-memory tile
+	NSMutableSet* mPendingTiles; // keys of tiles being decoded
+	NSUInteger mMaximumTileCount;
+	NSUInteger mUseCounter;
+	NSImage* mOverview; // the smallest level, kept once it's built
+	dispatch_queue_t mQueue; // decodes tiles one at a time
+}
+
+/** @brief Returns the directory under which the tiles of all images are cached
+ @return a path in the user's caches folder
+ */
++ (NSString*)cacheDirectoryRoot;
+
+/** @brief Initializes a pyramid for an image and starts cutting its tiles in the background, unless they are already on disk
+ @param data data of an image that ImageIO can read
+ @return the pyramid, or nil if the data isn't a readable image
+ */
+- (id)initWithData:(NSData*)data;
+
+- (NSSize)pixelSize;
+- (NSUInteger)levelCount;
+- (BOOL)isBuilt;
+- (NSString*)cacheDirectory;
+
+/** @brief Draws the part of the image within <clip> that would be drawn if the whole image were drawn into <dest>
+ @param dest the rect the whole image is drawn into
+ @param clip the area to draw, usually the update rect
+ @param op the compositing operation
+ @param opacity the opacity
+ @return NO if no level is ready to be drawn yet, otherwise YES
+ */
+- (BOOL)drawInRect:(NSRect)dest clipRect:(NSRect)clip operation:(NSCompositingOperation)op fraction:(CGFloat)opacity;
+
+- (void)setMaximumTileCount:(NSUInteger)maxTiles;
+- (NSUInteger)maximumTileCount;
+- (NSUInteger)tileCount;
+
+@end
+
+#define kDKImageTilePyramidTileSize 512
+#define kDKImageTilePyramidDefaultMaximumTiles 64 // tiles held in memory, each 1MB when decoded
+
+extern NSString* kDKImageTilePyramidDidLoadTilesNotification; /**< object is the pyramid, userInfo key "rect" is an NSValue of the area loaded as a fraction of the image, origin top left */
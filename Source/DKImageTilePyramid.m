@@ -0,0 +1,625 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKImageTilePyramid.h"
+#import "DKImageDataManager.h"
+#import "LogEvent.h"
+
+NSString* kDKImageTilePyramidDidLoadTilesNotification = @"kDKImageTilePyramidDidLoadTilesNotification";
+
+/// a decoded tile held in memory
+
+@interface DKPyramidTile : NSObject {
+@public
+	NSImage* mImage;
+	NSUInteger mLastUse;
+}
+
+@end
+
+@implementation DKPyramidTile
+
+- (void)dealloc
+{
+	[mImage release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKImageTilePyramid (Private)
+
+- (NSUInteger)levelForPixels:(CGFloat)pixels;
+- (NSImage*)tileAtLevel:(NSUInteger)level column:(NSInteger)col row:(NSInteger)row;
+- (NSImage*)overview;
+- (void)didBuildLevels:(uint32_t)levels inDirectory:(NSString*)dir;
+- (void)installTile:(CGImageRef)image forKey:(NSString*)key unitRect:(NSRect)unitRect;
+- (void)evictTiles;
+
+@end
+
+/// the cutting of a pyramid's tiles, and the levels reported back to the main thread as each is done
+
+typedef struct {
+	DKImageTilePyramid* pyramid;
+	NSData* data;
+	NSSize pixelSize;
+	NSUInteger levelCount;
+} DKPyramidBuild;
+
+typedef struct {
+	DKImageTilePyramid* pyramid;
+	NSString* directory;
+	uint32_t levels;
+} DKPyramidBuildReport;
+
+/// a tile being decoded in the background
+
+typedef struct {
+	DKImageTilePyramid* pyramid;
+	NSString* key;
+	NSString* path;
+	NSRect unitRect;
+	CGImageRef image;
+} DKPyramidTileRequest;
+
+static inline NSSize levelSize(NSSize pixelSize, NSUInteger level)
+{
+	CGFloat d = (CGFloat)(1 << level);
+	return NSMakeSize(ceil(pixelSize.width / d), ceil(pixelSize.height / d));
+}
+
+static inline NSInteger tileCount(CGFloat pixels)
+{
+	return (NSInteger)ceil(pixels / kDKImageTilePyramidTileSize);
+}
+
+static inline NSRect tilePixelRect(NSSize ls, NSInteger col, NSInteger row)
+{
+	// in the level's pixels, origin top left
+
+	NSRect r;
+
+	r.origin.x = col * kDKImageTilePyramidTileSize;
+	r.origin.y = row * kDKImageTilePyramidTileSize;
+	r.size.width = MIN(kDKImageTilePyramidTileSize, ls.width - r.origin.x);
+	r.size.height = MIN(kDKImageTilePyramidTileSize, ls.height - r.origin.y);
+
+	return r;
+}
+
+static inline NSString* tileFileName(NSUInteger level, NSInteger col, NSInteger row)
+{
+	return [NSString stringWithFormat:@"%lu_%ld_%ld.png", (unsigned long)level, (long)col, (long)row];
+}
+
+static CGImageRef createTileFromFile(NSString* path)
+{
+	// a thumbnail is always decoded, so drawing the tile later needn't decode anything
+
+	CGImageSourceRef source = CGImageSourceCreateWithURL((CFURLRef)[NSURL fileURLWithPath:path], NULL);
+	CGImageRef image = NULL;
+
+	if (source) {
+		NSDictionary* options = [NSDictionary dictionaryWithObjectsAndKeys:(id)kCFBooleanTrue, (id)kCGImageSourceCreateThumbnailFromImageAlways,
+																		   [NSNumber numberWithInteger:kDKImageTilePyramidTileSize], (id)kCGImageSourceThumbnailMaxPixelSize,
+																		   (id)kCFBooleanTrue, (id)kCGImageSourceShouldCache, nil];
+
+		image = CGImageSourceCreateThumbnailAtIndex(source, 0, (CFDictionaryRef)options);
+		CFRelease(source);
+	}
+
+	return image;
+}
+
+static void reportBuiltLevels(void* context)
+{
+	DKPyramidBuildReport* report = (DKPyramidBuildReport*)context;
+
+	[report->pyramid didBuildLevels:report->levels
+						inDirectory:report->directory];
+
+	[report->directory release];
+	[report->pyramid release];
+	free(report);
+}
+
+static void postBuiltLevels(DKImageTilePyramid* pyramid, NSString* dir, uint32_t levels)
+{
+	DKPyramidBuildReport* report = malloc(sizeof(DKPyramidBuildReport));
+
+	report->pyramid = [pyramid retain];
+	report->directory = [dir copy];
+	report->levels = levels;
+
+	dispatch_async_f(dispatch_get_main_queue(), report, reportBuiltLevels);
+}
+
+static BOOL writeLevelTiles(CGImageRef image, NSSize ls, NSUInteger level, NSString* dir)
+{
+	NSInteger col, row, cols = tileCount(ls.width), rows = tileCount(ls.height);
+
+	for (row = 0; row < rows; ++row) {
+		for (col = 0; col < cols; ++col) {
+			NSRect pr = tilePixelRect(ls, col, row);
+			CGImageRef tile = CGImageCreateWithImageInRect(image, NSRectToCGRect(pr));
+			NSURL* url = [NSURL fileURLWithPath:[dir stringByAppendingPathComponent:tileFileName(level, col, row)]];
+			CGImageDestinationRef dest = CGImageDestinationCreateWithURL((CFURLRef)url, kUTTypePNG, 1, NULL);
+			BOOL ok = (tile != NULL && dest != NULL);
+
+			if (ok) {
+				CGImageDestinationAddImage(dest, tile, NULL);
+				ok = CGImageDestinationFinalize(dest);
+			}
+
+			if (dest)
+				CFRelease(dest);
+			CGImageRelease(tile);
+
+			if (!ok)
+				return NO;
+		}
+	}
+
+	return YES;
+}
+
+static CGImageRef createLevelImage(CGImageSourceRef source, NSSize ls, NSUInteger level)
+{
+	// level 0 is decoded once and cached by the image while its tiles are cut. The others are made by ImageIO at their size, which for
+	// JPEG decodes at a reduced scale rather than decoding in full and scaling
+
+	if (level == 0) {
+		NSDictionary* options = [NSDictionary dictionaryWithObject:(id)kCFBooleanTrue
+															forKey:(id)kCGImageSourceShouldCache];
+		return CGImageSourceCreateImageAtIndex(source, 0, (CFDictionaryRef)options);
+	}
+
+	NSDictionary* options = [NSDictionary dictionaryWithObjectsAndKeys:(id)kCFBooleanTrue, (id)kCGImageSourceCreateThumbnailFromImageAlways,
+																	   [NSNumber numberWithInteger:(NSInteger)MAX(ls.width, ls.height)], (id)kCGImageSourceThumbnailMaxPixelSize,
+																	   (id)kCFBooleanTrue, (id)kCGImageSourceShouldCache, nil];
+
+	return CGImageSourceCreateThumbnailAtIndex(source, 0, (CFDictionaryRef)options);
+}
+
+static void buildPyramidInBackground(void* context)
+{
+	DKPyramidBuild* build = (DKPyramidBuild*)context;
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+	NSFileManager* fm = [NSFileManager defaultManager];
+	NSString* dir = [[DKImageTilePyramid cacheDirectoryRoot] stringByAppendingPathComponent:[build->data contentHashString]];
+	NSString* marker = [dir stringByAppendingPathComponent:@"complete"];
+	uint32_t allLevels = (uint32_t)((1 << build->levelCount) - 1);
+
+	if ([fm fileExistsAtPath:marker])
+		postBuiltLevels(build->pyramid, dir, allLevels);
+	else if ([fm createDirectoryAtPath:dir
+			   withIntermediateDirectories:YES
+								attributes:nil
+									 error:NULL]) {
+		CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)build->data, NULL);
+		NSInteger level;
+		BOOL ok = (source != NULL);
+
+		// coarsest first, so that the image can be drawn roughly long before level 0 is done
+
+		for (level = (NSInteger)build->levelCount - 1; level >= 0 && ok; --level) {
+			NSAutoreleasePool* levelPool = [[NSAutoreleasePool alloc] init];
+			NSSize ls = levelSize(build->pixelSize, level);
+			CGImageRef image = createLevelImage(source, ls, level);
+
+			ok = (image != NULL) && writeLevelTiles(image, ls, level, dir);
+			CGImageRelease(image);
+
+			if (ok)
+				postBuiltLevels(build->pyramid, dir, 1 << level);
+
+			[levelPool drain];
+		}
+
+		if (source)
+			CFRelease(source);
+
+		if (ok)
+			[[NSData data] writeToFile:marker
+							atomically:YES];
+		else
+			LogEvent_(kFileEvent, @"unable to cut tiles for image pyramid in '%@'", dir);
+	}
+
+	[pool drain];
+	[build->data release];
+	[build->pyramid release];
+	free(build);
+}
+
+static void installTile(void* context)
+{
+	DKPyramidTileRequest* tr = (DKPyramidTileRequest*)context;
+
+	[tr->pyramid installTile:tr->image
+					  forKey:tr->key
+					unitRect:tr->unitRect];
+
+	CGImageRelease(tr->image);
+	[tr->path release];
+	[tr->key release];
+	[tr->pyramid release];
+	free(tr);
+}
+
+static void decodeTileInBackground(void* context)
+{
+	DKPyramidTileRequest* tr = (DKPyramidTileRequest*)context;
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+	tr->image = createTileFromFile(tr->path);
+
+	[pool drain];
+	dispatch_async_f(dispatch_get_main_queue(), tr, installTile);
+}
+
+#pragma mark -
+
+@implementation DKImageTilePyramid
+
++ (NSString*)cacheDirectoryRoot
+{
+	NSArray* paths = NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES);
+	NSString* owner = [[NSBundle mainBundle] bundleIdentifier];
+
+	if (owner == nil)
+		owner = @"DrawKit";
+
+	return [[[paths objectAtIndex:0] stringByAppendingPathComponent:owner] stringByAppendingPathComponent:@"DKImageTilePyramid"];
+}
+
+- (id)initWithData:(NSData*)data
+{
+	NSAssert(data != nil, @"cannot make a pyramid of nil data");
+
+	self = [super init];
+	if (self) {
+		// only the image's properties are read here, which doesn't decode it
+
+		CGImageSourceRef source = CGImageSourceCreateWithData((CFDataRef)data, NULL);
+
+		if (source) {
+			NSDictionary* props = (NSDictionary*)CGImageSourceCopyPropertiesAtIndex(source, 0, NULL);
+
+			mPixelSize.width = [[props objectForKey:(id)kCGImagePropertyPixelWidth] doubleValue];
+			mPixelSize.height = [[props objectForKey:(id)kCGImagePropertyPixelHeight] doubleValue];
+
+			[props release];
+			CFRelease(source);
+		}
+
+		if (mPixelSize.width <= 0 || mPixelSize.height <= 0) {
+			[self autorelease];
+			return nil;
+		}
+
+		mLevelCount = 1;
+
+		while (MAX(mPixelSize.width, mPixelSize.height) / (CGFloat)(1 << (mLevelCount - 1)) > kDKImageTilePyramidTileSize && mLevelCount < 32)
+			++mLevelCount;
+
+		mData = [data retain];
+		mTiles = [[NSMutableDictionary alloc] init];
+		mPendingTiles = [[NSMutableSet alloc] init];
+		mMaximumTileCount = kDKImageTilePyramidDefaultMaximumTiles;
+		mQueue = dispatch_queue_create("com.drawkit.tilepyramid", NULL);
+
+		DKPyramidBuild* build = malloc(sizeof(DKPyramidBuild));
+
+		build->pyramid = [self retain];
+		build->data = [data retain];
+		build->pixelSize = mPixelSize;
+		build->levelCount = mLevelCount;
+
+		dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), build, buildPyramidInBackground);
+	}
+
+	return self;
+}
+
+- (NSSize)pixelSize
+{
+	return mPixelSize;
+}
+
+- (NSUInteger)levelCount
+{
+	return mLevelCount;
+}
+
+- (BOOL)isBuilt
+{
+	return mBuiltLevels == (uint32_t)((1 << mLevelCount) - 1);
+}
+
+- (NSString*)cacheDirectory
+{
+	return mDirectory;
+}
+
+- (BOOL)drawInRect:(NSRect)dest clipRect:(NSRect)clip operation:(NSCompositingOperation)op fraction:(CGFloat)opacity
+{
+	NSRect visible = NSIntersectionRect(dest, clip);
+
+	if (NSIsEmptyRect(visible))
+		return YES;
+
+	// the number of device pixels the image covers is found from the context's transform, which includes the view's scale and the
+	// backing scale factor
+
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+	BOOL flipped = [context isFlipped];
+	BOOL onScreen = [context isDrawingToScreen] && [NSThread isMainThread];
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform([context graphicsPort]);
+	CGFloat deviceScale = sqrt(fabs(dt.a * dt.d - dt.b * dt.c));
+	NSUInteger level = [self levelForPixels:MAX(NSWidth(dest), NSHeight(dest)) * deviceScale];
+
+	if (level == NSNotFound)
+		return NO;
+
+	NSSize ls = levelSize(mPixelSize, level);
+	CGFloat sx = NSWidth(dest) / ls.width;
+	CGFloat sy = NSHeight(dest) / ls.height;
+
+	// the visible area in the level's pixels, from the top left, gives the range of tiles to draw
+
+	CGFloat top = flipped ? NSMinY(visible) - NSMinY(dest) : NSMaxY(dest) - NSMaxY(visible);
+	NSInteger col, row;
+	NSInteger firstCol = MAX(0, (NSInteger)floor((NSMinX(visible) - NSMinX(dest)) / sx / kDKImageTilePyramidTileSize));
+	NSInteger lastCol = MIN(tileCount(ls.width) - 1, (NSInteger)floor((NSMaxX(visible) - NSMinX(dest)) / sx / kDKImageTilePyramidTileSize));
+	NSInteger firstRow = MAX(0, (NSInteger)floor(top / sy / kDKImageTilePyramidTileSize));
+	NSInteger lastRow = MIN(tileCount(ls.height) - 1, (NSInteger)floor((top + NSHeight(visible)) / sy / kDKImageTilePyramidTileSize));
+
+	for (row = firstRow; row <= lastRow; ++row) {
+		for (col = firstCol; col <= lastCol; ++col) {
+			NSRect pr = tilePixelRect(ls, col, row);
+			NSRect tr;
+
+			tr.origin.x = NSMinX(dest) + NSMinX(pr) * sx;
+			tr.origin.y = flipped ? NSMinY(dest) + NSMinY(pr) * sy : NSMaxY(dest) - NSMaxY(pr) * sy;
+			tr.size.width = NSWidth(pr) * sx;
+			tr.size.height = NSHeight(pr) * sy;
+
+			NSImage* tile;
+
+			if (onScreen)
+				tile = [self tileAtLevel:level
+								  column:col
+									 row:row];
+			else {
+				CGImageRef image = createTileFromFile([mDirectory stringByAppendingPathComponent:tileFileName(level, col, row)]);
+
+				tile = nil;
+
+				if (image) {
+					tile = [[[NSImage alloc] initWithCGImage:image
+														size:NSZeroSize] autorelease];
+					CGImageRelease(image);
+				}
+			}
+
+			if (tile) {
+				[tile drawInRect:tr
+						fromRect:NSZeroRect
+					   operation:op
+						fraction:opacity
+				  respectFlipped:YES
+						   hints:nil];
+			} else {
+				// until the tile arrives, its area is drawn from the smallest level. Image coordinates have their origin at bottom left
+
+				NSImage* overview = [self overview];
+				NSSize os = [overview size];
+				NSRect fr;
+
+				fr.origin.x = NSMinX(pr) / ls.width * os.width;
+				fr.origin.y = os.height - NSMaxY(pr) / ls.height * os.height;
+				fr.size.width = NSWidth(pr) / ls.width * os.width;
+				fr.size.height = NSHeight(pr) / ls.height * os.height;
+
+				[overview drawInRect:tr
+							fromRect:fr
+						   operation:op
+							fraction:opacity
+					  respectFlipped:YES
+							   hints:nil];
+			}
+		}
+	}
+
+	return YES;
+}
+
+- (void)setMaximumTileCount:(NSUInteger)maxTiles
+{
+	mMaximumTileCount = MAX(1U, maxTiles);
+	[self evictTiles];
+}
+
+- (NSUInteger)maximumTileCount
+{
+	return mMaximumTileCount;
+}
+
+- (NSUInteger)tileCount
+{
+	return [mTiles count];
+}
+
+#pragma mark -
+
+- (NSUInteger)levelForPixels:(CGFloat)pixels
+{
+	// the smallest level with enough pixels, or if it isn't built yet the nearest coarser one that is, or failing that the nearest finer one
+
+	CGFloat full = MAX(mPixelSize.width, mPixelSize.height);
+	NSUInteger wanted = 0;
+	NSInteger level;
+
+	while (wanted + 1 < mLevelCount && full / (CGFloat)(1 << (wanted + 1)) >= pixels)
+		++wanted;
+
+	for (level = wanted; level < (NSInteger)mLevelCount; ++level) {
+		if (mBuiltLevels & (1 << level))
+			return level;
+	}
+
+	for (level = wanted - 1; level >= 0; --level) {
+		if (mBuiltLevels & (1 << level))
+			return level;
+	}
+
+	return NSNotFound;
+}
+
+- (NSImage*)tileAtLevel:(NSUInteger)level column:(NSInteger)col row:(NSInteger)row
+{
+	NSString* key = [NSString stringWithFormat:@"%lu/%ld/%ld", (unsigned long)level, (long)col, (long)row];
+	DKPyramidTile* tile = [mTiles objectForKey:key];
+
+	if (tile) {
+		tile->mLastUse = ++mUseCounter;
+		return tile->mImage;
+	}
+
+	if (![mPendingTiles containsObject:key]) {
+		[mPendingTiles addObject:key];
+
+		NSSize ls = levelSize(mPixelSize, level);
+		NSRect pr = tilePixelRect(ls, col, row);
+		DKPyramidTileRequest* tr = malloc(sizeof(DKPyramidTileRequest));
+
+		tr->pyramid = [self retain];
+		tr->key = [key copy];
+		tr->path = [[mDirectory stringByAppendingPathComponent:tileFileName(level, col, row)] retain];
+		tr->unitRect = NSMakeRect(NSMinX(pr) / ls.width, NSMinY(pr) / ls.height, NSWidth(pr) / ls.width, NSHeight(pr) / ls.height);
+		tr->image = NULL;
+
+		dispatch_async_f(mQueue, tr, decodeTileInBackground);
+	}
+
+	return nil;
+}
+
+- (NSImage*)overview
+{
+	// the smallest level is a single tile, read when first needed
+
+	NSUInteger top = mLevelCount - 1;
+
+	if (mOverview == nil && (mBuiltLevels & (1 << top))) {
+		CGImageRef image = createTileFromFile([mDirectory stringByAppendingPathComponent:tileFileName(top, 0, 0)]);
+
+		if (image) {
+			mOverview = [[NSImage alloc] initWithCGImage:image
+													size:NSZeroSize];
+			CGImageRelease(image);
+		}
+	}
+
+	return mOverview;
+}
+
+- (void)didBuildLevels:(uint32_t)levels inDirectory:(NSString*)dir
+{
+	if (mDirectory == nil)
+		mDirectory = [dir copy];
+
+	mBuiltLevels |= levels;
+
+	// once every tile is on disk, the image's data isn't needed
+
+	if ([self isBuilt]) {
+		[mData release];
+		mData = nil;
+	}
+
+	LogEvent_(kInfoEvent, @"image pyramid built levels %x of %lu", mBuiltLevels, (unsigned long)mLevelCount);
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKImageTilePyramidDidLoadTilesNotification
+														object:self
+													  userInfo:[NSDictionary dictionaryWithObject:[NSValue valueWithRect:NSMakeRect(0, 0, 1, 1)]
+																						   forKey:@"rect"]];
+}
+
+- (void)installTile:(CGImageRef)image forKey:(NSString*)key unitRect:(NSRect)unitRect
+{
+	[mPendingTiles removeObject:key];
+
+	if (image == NULL)
+		return;
+
+	DKPyramidTile* tile = [[DKPyramidTile alloc] init];
+
+	tile->mImage = [[NSImage alloc] initWithCGImage:image
+											   size:NSZeroSize];
+	tile->mLastUse = ++mUseCounter;
+	[tile->mImage setCacheMode:NSImageCacheNever];
+
+	[mTiles setObject:tile
+			   forKey:key];
+	[tile release];
+
+	[self evictTiles];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKImageTilePyramidDidLoadTilesNotification
+														object:self
+													  userInfo:[NSDictionary dictionaryWithObject:[NSValue valueWithRect:unitRect]
+																						   forKey:@"rect"]];
+}
+
+- (void)evictTiles
+{
+	// the least recently drawn tiles are discarded first
+
+	while ([mTiles count] > mMaximumTileCount) {
+		NSEnumerator* iter = [mTiles keyEnumerator];
+		NSString* tileKey;
+		NSString* oldestKey = nil;
+		NSUInteger oldest = NSUIntegerMax;
+
+		while ((tileKey = [iter nextObject])) {
+			DKPyramidTile* tile = [mTiles objectForKey:tileKey];
+
+			if (tile->mLastUse < oldest) {
+				oldest = tile->mLastUse;
+				oldestKey = tileKey;
+			}
+		}
+
+		if (oldestKey == nil)
+			break;
+
+		[mTiles removeObjectForKey:oldestKey];
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mData release];
+	[mDirectory release];
+	[mTiles release];
+	[mPendingTiles release];
+	[mOverview release];
+
+	if (mQueue)
+		dispatch_release(mQueue);
+
+	[super dealloc];
+}
+
+@end
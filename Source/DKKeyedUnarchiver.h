@@ -6,7 +6,7 @@
 
 #import <Cocoa/Cocoa.h>
 
-@class DKImageDataManager;
+@class DKImageDataManager, DKStyleInternTable;
 
 /** @brief This class works identically to NSKeyedUnarchiver in every way, except that it can store a reference to the drawing's DKImageDataManager instance.
 
@@ -15,13 +15,26 @@ This class works identically to NSKeyedUnarchiver in every way, except that it c
  
  Note that the image manager is archived and dearchived normally, but DKDrawing sets the coder's reference having dearchived it, so subsequent unarchiving can
  find it.
+
+ The chunked file format also sets the shared objects - the styles and image data that its archives refer to by index.
+
+ If a style intern table is set, each unshared style decoded is replaced by an identical one already in the table.
 */
 @interface DKKeyedUnarchiver : NSKeyedUnarchiver {
 @private
 	DKImageDataManager* mImageManagerRef;
+	NSArray* mSharedObjectsRef;
+	NSArray* mSharedImageDataRef;
+	DKStyleInternTable* mStyleInternTableRef;
 }
 
 - (void)setImageManager:(DKImageDataManager*)imgMgr;
 - (DKImageDataManager*)imageManager;
+- (void)setSharedObjects:(NSArray*)objects;
+- (NSArray*)sharedObjects;
+- (void)setSharedImageData:(NSArray*)imageData;
+- (NSArray*)sharedImageData;
+- (void)setStyleInternTable:(DKStyleInternTable*)table;
+- (DKStyleInternTable*)styleInternTable;
 
 @end
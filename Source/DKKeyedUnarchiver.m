@@ -20,4 +20,36 @@
 	return mImageManagerRef;
 }
 
+- (void)setSharedObjects:(NSArray*)objects
+{
+	// not retained, for the same reason
+
+	mSharedObjectsRef = objects;
+}
+
+- (NSArray*)sharedObjects
+{
+	return mSharedObjectsRef;
+}
+
+- (void)setSharedImageData:(NSArray*)imageData
+{
+	mSharedImageDataRef = imageData;
+}
+
+- (NSArray*)sharedImageData
+{
+	return mSharedImageDataRef;
+}
+
+- (void)setStyleInternTable:(DKStyleInternTable*)table
+{
+	mStyleInternTableRef = table;
+}
+
+- (DKStyleInternTable*)styleInternTable
+{
+	return mStyleInternTableRef;
+}
+
 @end
@@ -16,6 +16,23 @@ typedef enum {
 
 @class DKHandle;
 
+// batching and handle lookup records, used internally
+
+typedef struct {
+	DKHandle* handle;
+	NSPoint point;
+	CGFloat angle;
+} DKKnobBatchEntry;
+
+typedef struct {
+	DKHandle* handle;
+	DKKnobType type;
+	NSColor* colour;
+	NSSize size;
+} DKKnobHandleMemo;
+
+#define kDKKnobHandleMemoSize 4
+
 /** @brief simple class used to provide the drawing of knobs for object selection.
 
 simple class used to provide the drawing of knobs for object selection. You can override this and replace it (attached to any layer)
@@ -42,6 +59,17 @@ might include the shape of a knob, its colours, whether stroked or filled or bot
 	NSColor* mControlBarColour; // colour of control bars
 	NSSize mControlKnobSize; // control knob size
 	CGFloat mControlBarWidth; // control bar width
+	NSUInteger mBatchNesting; // >0 while drawing is being batched
+	DKKnobBatchEntry* mBatchEntries; // handles waiting to be drawn
+	NSUInteger mBatchCount;
+	NSUInteger mBatchCapacity;
+	CGAffineTransform mBatchCTM; // the transform in effect when the batch began
+	BOOL mBatchActive; // the owner's active state, sampled when the batch began
+	NSSize mBatchHandleSize; // the actual handle size, sampled when the batch began
+	NSBezierPath* mBatchBarPath; // control bars waiting to be drawn
+	NSColor* mBatchBarColour;
+	DKKnobHandleMemo mHandleMemo[kDKKnobHandleMemoSize]; // recently used handles
+	NSUInteger mHandleMemoNext;
 }
 
 /**  */
@@ -62,6 +90,18 @@ might include the shape of a knob, its colours, whether stroked or filled or bot
 - (void)drawRotationBarWithKnobsFromCentre:(NSPoint)centre toPoint:(NSPoint)p;
 - (void)drawPartcode:(NSInteger)code atPoint:(NSPoint)p fontSize:(CGFloat)fontSize;
 
+/** @brief Starts collecting knobs and control bars instead of drawing them immediately
+
+ Between this and -endDrawingBatch, knobs are recorded and then drawn together, handle by handle, and all control bars are stroked
+ as one path beneath them. This is much faster when many objects are selected. Calls nest; only the outermost pair has any effect.
+ Knobs drawn with a different transform from the one in effect when the batch began are drawn immediately.
+ */
+- (void)beginDrawingBatch;
+
+/** @brief Draws everything collected since -beginDrawingBatch
+ */
+- (void)endDrawingBatch;
+
 - (BOOL)hitTestPoint:(NSPoint)p inKnobAtPoint:(NSPoint)kp ofType:(DKKnobType)knobType userInfo:(id)userInfo;
 
 - (void)setControlBarColour:(NSColor*)clr;
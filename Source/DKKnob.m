@@ -7,6 +7,7 @@
 #import "DKKnob.h"
 #import "DKGeometryUtilities.h"
 #import "NSBezierPath+Geometry.h"
+#import "NSColor+DKAdditions.h"
 #import "DKDrawingView.h"
 #import "DKHandle.h"
 
@@ -22,6 +23,15 @@ static NSColor* sBarColour = nil;
 static CGFloat sBarWidth = 0.0;
 static NSSize sKnobSize = { 6.0, 6.0 };
 
+@interface DKKnob (Private)
+
+- (BOOL)isBatchingDrawing;
+- (void)addHandleToBatch:(DKHandle*)handle atPoint:(NSPoint)p angle:(CGFloat)radians;
+- (void)flushControlBars;
+- (DKHandle*)handleForType:(DKKnobType)knobType colour:(NSColor*)colour size:(NSSize)size;
+
+@end
+
 @implementation DKKnob
 #pragma mark As a DKKnob
 
@@ -67,20 +77,32 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 // skip this fancy stuff
 
 #if USE_DK_HANDLES
-	if ([[self owner] respondsToSelector:@selector(knobsWantDrawingActiveState)]) {
+	BOOL batching = [self isBatchingDrawing];
+
+	if (batching) {
+		if (!mBatchActive)
+			knobType |= kDKKnobIsInactiveFlag;
+	} else if ([[self owner] respondsToSelector:@selector(knobsWantDrawingActiveState)]) {
 		BOOL active = [[self owner] knobsWantDrawingActiveState];
 
 		if (!active)
 			knobType |= kDKKnobIsInactiveFlag;
 	}
 
-	NSSize ahs = [self actualHandleSize];
+	NSSize ahs = batching ? mBatchHandleSize : [self actualHandleSize];
 
 	if (ahs.width >= 1.0 || ahs.height >= 1.0) {
 		DKHandle* handle = [self handleForType:knobType
-										colour:aColour];
-		[handle drawAtPoint:p
-					  angle:radians];
+										colour:aColour
+										  size:ahs];
+
+		if (batching)
+			[self addHandleToBatch:handle
+						   atPoint:p
+							 angle:radians];
+		else
+			[handle drawAtPoint:p
+						  angle:radians];
 	}
 	return;
 #endif
@@ -128,14 +150,14 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 			}
 
 			if (aColour && (knobType & kDKKnobIsDisabledFlag) == 0)
-				[aColour set];
+				[aColour setRendering];
 			else
-				[[self fillColourForKnobType:knobType] set];
+				[[self fillColourForKnobType:knobType] setRendering];
 
 			NSRectFill(fkr);
 
 			if ((knobType & kDKKnobTypeMask) == kDKBoundingRectKnobType) {
-				[[self strokeColourForKnobType:knobType] set];
+				[[self strokeColourForKnobType:knobType] setRendering];
 				NSFrameRectWithWidth(fkr, strokeWidth);
 
 				if (radians != 0.0)
@@ -167,19 +189,32 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 // skip this fancy stuff
 
 #if USE_DK_HANDLES
-	if ([[self owner] respondsToSelector:@selector(knobsWantDrawingActiveState)]) {
+	BOOL batching = [self isBatchingDrawing];
+
+	if (batching) {
+		if (!mBatchActive)
+			knobType |= kDKKnobIsInactiveFlag;
+	} else if ([[self owner] respondsToSelector:@selector(knobsWantDrawingActiveState)]) {
 		BOOL active = [[self owner] knobsWantDrawingActiveState];
 
 		if (!active)
 			knobType |= kDKKnobIsInactiveFlag;
 	}
 
-	NSSize ahs = [self actualHandleSize];
+	NSSize ahs = batching ? mBatchHandleSize : [self actualHandleSize];
 
 	if (ahs.width >= 1.0 || ahs.height >= 1.0) {
-		DKHandle* handle = [self handleForType:knobType];
-		[handle drawAtPoint:p
-					  angle:radians];
+		DKHandle* handle = [self handleForType:knobType
+										colour:nil
+										  size:ahs];
+
+		if (batching)
+			[self addHandleToBatch:handle
+						   atPoint:p
+							 angle:radians];
+		else
+			[handle drawAtPoint:p
+						  angle:radians];
 	}
 	return;
 #endif
@@ -226,11 +261,11 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 				[transform concat];
 			}
 
-			[[self fillColourForKnobType:knobType] set];
+			[[self fillColourForKnobType:knobType] setRendering];
 			NSRectFill(fkr);
 
 			if ((knobType & kDKKnobTypeMask) == kDKBoundingRectKnobType) {
-				[[self strokeColourForKnobType:knobType] set];
+				[[self strokeColourForKnobType:knobType] setRendering];
 				NSFrameRectWithWidth(fkr, strokeWidth);
 
 				if (radians != 0.0)
@@ -252,6 +287,24 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 
 - (void)drawControlBarFromPoint:(NSPoint)a toPoint:(NSPoint)b
 {
+	if ([self isBatchingDrawing]) {
+		// bars are collected into a single path per colour and stroked when the batch ends
+
+		NSColor* colour = mBatchActive ? [self controlBarColour] : [NSColor lightGrayColor];
+
+		if (colour != mBatchBarColour && ![colour isEqual:mBatchBarColour]) {
+			[self flushControlBars];
+			mBatchBarColour = [colour retain];
+		}
+
+		if (mBatchBarPath == nil)
+			mBatchBarPath = [[NSBezierPath alloc] init];
+
+		[mBatchBarPath moveToPoint:a];
+		[mBatchBarPath lineToPoint:b];
+		return;
+	}
+
 	BOOL active = YES;
 
 	if ([self owner])
@@ -351,6 +404,61 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 	[NSBezierPath strokeRect:b];
 }
 
+- (void)beginDrawingBatch
+{
+	if (mBatchNesting++ > 0)
+		return;
+
+	mBatchCount = 0;
+	mBatchCTM = CGContextGetCTM([[NSGraphicsContext currentContext] graphicsPort]);
+	mBatchActive = YES;
+
+	if ([[self owner] respondsToSelector:@selector(knobsWantDrawingActiveState)])
+		mBatchActive = [[self owner] knobsWantDrawingActiveState];
+
+	mBatchHandleSize = [self actualHandleSize];
+}
+
+- (void)endDrawingBatch
+{
+	if (mBatchNesting == 0 || --mBatchNesting > 0)
+		return;
+
+	[self flushControlBars];
+
+	if (mBatchCount == 0)
+		return;
+
+	// draw all the stamps for each handle together. Entries are marked as drawn by clearing their handle.
+
+	NSPoint* points = malloc(mBatchCount * sizeof(NSPoint));
+	CGFloat* angles = malloc(mBatchCount * sizeof(CGFloat));
+	NSUInteger i, j, n;
+
+	for (i = 0; i < mBatchCount; ++i) {
+		DKHandle* handle = mBatchEntries[i].handle;
+
+		if (handle == nil)
+			continue;
+
+		for (j = i, n = 0; j < mBatchCount; ++j) {
+			if (mBatchEntries[j].handle == handle) {
+				points[n] = mBatchEntries[j].point;
+				angles[n++] = mBatchEntries[j].angle;
+				mBatchEntries[j].handle = nil;
+			}
+		}
+
+		[handle drawAtPoints:points
+					  angles:angles
+					   count:n];
+	}
+
+	free(points);
+	free(angles);
+	mBatchCount = 0;
+}
+
 #pragma mark -
 
 - (BOOL)hitTestPoint:(NSPoint)p inKnobAtPoint:(NSPoint)kp ofType:(DKKnobType)knobType userInfo:(id)userInfo
@@ -438,9 +546,9 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 
 - (DKHandle*)handleForType:(DKKnobType)knobType colour:(NSColor*)colour
 {
-	return [DKHandle handleForType:knobType
-							  size:[self actualHandleSize]
-							colour:colour];
+	return [self handleForType:knobType
+						colour:colour
+						  size:[self actualHandleSize]];
 }
 
 - (NSSize)actualHandleSize
@@ -496,6 +604,15 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 	[mControlOnPathPointColour release];
 	[mControlOffPathPointColour release];
 	[mControlBarColour release];
+	[mBatchBarPath release];
+	[mBatchBarColour release];
+	free(mBatchEntries);
+
+	NSUInteger i;
+
+	for (i = 0; i < kDKKnobHandleMemoSize; ++i)
+		[mHandleMemo[i].colour release];
+
 	[super dealloc];
 }
 
@@ -559,6 +676,84 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 
 #pragma mark -
 
+@implementation DKKnob (Private)
+
+- (BOOL)isBatchingDrawing
+{
+	// knobs drawn under some other transform than the batch was started with can't be deferred
+
+	if (mBatchNesting == 0)
+		return NO;
+
+	return CGAffineTransformEqualToTransform(CGContextGetCTM([[NSGraphicsContext currentContext] graphicsPort]), mBatchCTM);
+}
+
+- (void)addHandleToBatch:(DKHandle*)handle atPoint:(NSPoint)p angle:(CGFloat)radians
+{
+	if (mBatchCount >= mBatchCapacity) {
+		mBatchCapacity = MAX(mBatchCapacity * 2, 64U);
+		mBatchEntries = realloc(mBatchEntries, mBatchCapacity * sizeof(DKKnobBatchEntry));
+	}
+
+	mBatchEntries[mBatchCount].handle = handle;
+	mBatchEntries[mBatchCount].point = p;
+	mBatchEntries[mBatchCount].angle = radians;
+	++mBatchCount;
+}
+
+- (void)flushControlBars
+{
+	if (mBatchBarPath && ![mBatchBarPath isEmpty]) {
+		[mBatchBarColour set];
+
+		if ([NSGraphicsContext currentContextDrawingToScreen])
+			[mBatchBarPath setLineWidth:[[self class] controlBarWidth]];
+		else
+			[mBatchBarPath setLineWidth:1.0];
+
+		[mBatchBarPath stroke];
+		[mBatchBarPath removeAllPoints];
+	}
+
+	[mBatchBarColour release];
+	mBatchBarColour = nil;
+}
+
+- (DKHandle*)handleForType:(DKKnobType)knobType colour:(NSColor*)colour size:(NSSize)size
+{
+	// looking up a handle in DKHandle's table builds a string key each time, so the last few handles used are remembered here
+
+	DKKnobHandleMemo* memo;
+	NSUInteger i;
+
+	for (i = 0; i < kDKKnobHandleMemoSize; ++i) {
+		memo = &mHandleMemo[i];
+
+		if (memo->handle && memo->type == knobType && NSEqualSizes(memo->size, size) && (memo->colour == colour || [colour isEqual:memo->colour]))
+			return memo->handle;
+	}
+
+	DKHandle* handle = [DKHandle handleForType:knobType
+										  size:size
+										colour:colour];
+
+	memo = &mHandleMemo[mHandleMemoNext];
+	mHandleMemoNext = (mHandleMemoNext + 1) % kDKKnobHandleMemoSize;
+
+	[colour retain];
+	[memo->colour release];
+	memo->colour = colour;
+	memo->handle = handle;
+	memo->type = knobType;
+	memo->size = size;
+
+	return handle;
+}
+
+@end
+
+#pragma mark -
+
 @implementation DKKnob (Deprecated)
 
 + (void)setControlKnobColour:(NSColor*)clr
@@ -891,13 +1086,13 @@ static NSSize sKnobSize = { 6.0, 6.0 };
 				colour = preferred;
 		}
 
-		[colour setFill];
+		[colour setRenderingFill];
 		[path fill];
 	}
 
 	if (flags & kDKKnobDrawsStroke) {
 		colour = [self strokeColourForKnobType:knobType];
-		[colour setStroke];
+		[colour setRenderingStroke];
 		[path setLineWidth:[self strokeWidthForKnobType:knobType]];
 		[path stroke];
 	}
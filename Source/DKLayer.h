@@ -7,7 +7,7 @@
 #import <Cocoa/Cocoa.h>
 #import "DKCommonTypes.h"
 
-@class DKDrawing, DKDrawingView, DKLayerGroup, DKDrawableObject, DKKnob, DKStyle, GCInfoFloater;
+@class DKDrawing, DKDrawingView, DKLayerGroup, DKDrawableObject, DKKnob, DKStyle, GCInfoFloater, DKMemoryFootprint;
 
 // generic layer class:
 
@@ -49,6 +49,9 @@ indicate likely handling of drag and drop operations by a layer instance.
 	NSUInteger mReserved[3]; // unused
 	NSString* mLayerUniqueKey; // unique ID for the layer
 	CGFloat mAlpha; // alpha value applied to layer as a whole
+	NSRect mCoalescedUpdateRect; // union of the areas flagged for redrawing while updates are coalesced
+	NSString* mPendingInfoString; // the info window's text, waiting for the next display refresh
+	NSPoint mPendingInfoScreenPoint; // where the info window is to be moved to at the next display refresh
 }
 
 /** @brief Allows a list of colours to be set for supplying the selection colours
@@ -155,6 +158,16 @@ indicate likely handling of drag and drop operations by a layer instance.
  */
 - (void)drawRect:(NSRect)rect inView:(DKDrawingView*)aView;
 
+/** @brief Draws anything the layer shows over its content that isn't part of the content, such as the selection
+
+ A view that draws the content from its tile cache calls this afterwards, directly, so that what is drawn here can change without the tiles
+ being rendered again - areas flagged with -[DKDrawing setNeedsOverlayDisplayInRect:] are redrawn without being discarded from the cache.
+ Layers that draw an overlay leave it out of their content when -[DKDrawingView drawsSelectionAsOverlay] is YES. By default does nothing.
+ @param rect the overall area being updated
+ @param aView the view doing the rendering
+ */
+- (void)drawOverlayRect:(NSRect)rect inView:(DKDrawingView*)aView;
+
 /** @brief Is the layer opaque or transparent?
 
  Can be overridden to optimise drawing in some cases. Layers below an opaque layer are skipped
@@ -180,6 +193,19 @@ indicate likely handling of drag and drop operations by a layer instance.
  */
 - (void)setNeedsDisplayInRect:(NSRect)rect;
 
+/** @brief Starts collecting the areas that layers flag for redrawing
+
+ Until the matching +endCoalescingDisplayUpdates, each layer unions the rects passed to
+ -setNeedsDisplayInRect: instead of passing each one to the drawing, so a change that affects many
+ objects at once costs one update per layer. Calls may be nested. Main thread only - updates from
+ other threads are passed on as usual.
+ */
++ (void)beginCoalescingDisplayUpdates;
+
+/** @brief Passes each layer's collected area to the drawing when the outermost coalescing ends
+ */
++ (void)endCoalescingDisplayUpdates;
+
 /** @brief Marks several areas for update at once
 
  Several update optimising methods return sets of rect values, this allows them to be processed
@@ -380,6 +406,22 @@ indicate likely handling of drag and drop operations by a layer instance.
  */
 - (NSString*)uniqueKey;
 
+// memory footprint:
+
+/** @brief Estimates the memory used by the layer, by what it's used for
+
+ See DKMemoryFootprint. The layer's objects are each visited once, so this is cheap enough to sample periodically.
+ @return a new report
+ */
+- (DKMemoryFootprint*)memoryFootprint;
+
+/** @brief Adds the memory used by the layer to a footprint report
+
+ The default adds the layer's user info. Subclasses add their objects and caches, calling super.
+ @param footprint the report
+ */
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint;
+
 // print this layer?
 
 /** @brief Set whether this layer should be included in printed output
@@ -581,7 +623,8 @@ indicate likely handling of drag and drop operations by a layer instance.
 
  The window is shown near the point rather than at it. Generally the info window should be used
  for small, dynamically changing and temporary information, like a coordinate value. The background
- colour is initially set to the layer's selection colour
+ colour is initially set to the layer's selection colour. Once the window is showing, changes to it
+ are made at most once per display refresh, with the latest string and position.
  @param str a pre-formatted string containg some information to display
  @param p a point in local drawing coordinates
  */
@@ -8,13 +8,17 @@
 #import "DKKnob.h"
 #import "DKDrawing.h"
 #import "DKDrawingView.h"
+#import "DKLayerCompositor.h"
 #import "DKSelectionPDFView.h"
 #import "DKGeometryUtilities.h"
 #import "GCInfoFloater.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 #import "DKLayer+Metadata.h"
 #import "DKUniqueID.h"
 #import "NSDictionary+DeepCopy.h"
+#import "DKMemoryFootprint.h"
+#import "GCUndoManager.h"
+#import "DKFeedbackScheduler.h"
 
 #pragma mark Constants(Non - localized)
 
@@ -25,6 +29,15 @@ NSString* kDKLayerSelectionHighlightColourDidChange = @"kDKLayerSelectionHighlig
 
 #pragma mark Static Vars
 static NSInteger sLayerIndexSeed = 4;
+static NSUInteger sDisplayCoalescingLevel = 0;
+static CFMutableSetRef sLayersWithCoalescedUpdates = NULL; // retained
+
+#pragma mark -
+@interface DKLayer (Private)
+
+- (void)updateInfoWindow;
+
+@end
 
 #pragma mark -
 @implementation DKLayer
@@ -241,6 +254,12 @@ static NSArray* s_selectionColours = nil;
 	NSLog(@"you should override [DKLayer drawRect:inView];");
 }
 
+- (void)drawOverlayRect:(NSRect)rect inView:(DKDrawingView*)aView
+{
+#pragma unused(rect)
+#pragma unused(aView)
+}
+
 /** @brief Is the layer opaque or transparent?
 
  Can be overridden to optimise drawing in some cases. Layers below an opaque layer are skipped
@@ -272,7 +291,75 @@ static NSArray* s_selectionColours = nil;
  */
 - (void)setNeedsDisplayInRect:(NSRect)rect
 {
-	[[self drawing] setNeedsDisplayInRect:rect];
+	if (sDisplayCoalescingLevel > 0 && [NSThread isMainThread]) {
+		if (NSIsEmptyRect(rect))
+			return;
+
+		if (NSIsEmptyRect(mCoalescedUpdateRect)) {
+			CFSetAddValue(sLayersWithCoalescedUpdates, self);
+			mCoalescedUpdateRect = rect;
+		} else
+			mCoalescedUpdateRect = NSUnionRect(mCoalescedUpdateRect, rect);
+
+		return;
+	}
+
+	// the drawing's bitmap of this layer, if it has one, is out of date there
+
+	DKDrawing* drawing = [self drawing];
+
+	[[drawing layerCompositor] invalidateLayer:self
+										  rect:rect];
+	[drawing setNeedsDisplayInRect:rect];
+}
+
+/** @brief Starts collecting the areas that layers flag for redrawing
+
+ Until the matching +endCoalescingDisplayUpdates, each layer unions the rects passed to
+ -setNeedsDisplayInRect: instead of passing each one to the drawing, so a change that affects many
+ objects at once costs one update per layer. Calls may be nested. Main thread only - updates from
+ other threads are passed on as usual.
+ */
++ (void)beginCoalescingDisplayUpdates
+{
+	NSAssert([NSThread isMainThread], @"display updates can only be coalesced on the main thread");
+
+	if (sLayersWithCoalescedUpdates == NULL) {
+		// retained, and compared by identity
+
+		CFSetCallBacks callbacks = kCFTypeSetCallBacks;
+		callbacks.equal = NULL;
+		callbacks.hash = NULL;
+		sLayersWithCoalescedUpdates = CFSetCreateMutable(kCFAllocatorDefault, 0, &callbacks);
+	}
+
+	++sDisplayCoalescingLevel;
+}
+
+/** @brief Passes each layer's collected area to the drawing when the outermost coalescing ends
+ */
++ (void)endCoalescingDisplayUpdates
+{
+	NSAssert(sDisplayCoalescingLevel > 0, @"unbalanced +endCoalescingDisplayUpdates");
+
+	if (sDisplayCoalescingLevel == 0 || --sDisplayCoalescingLevel > 0)
+		return;
+
+	// take the layers out of the set first, since passing on the updates could start another batch
+
+	NSArray* layers = [(NSSet*)sLayersWithCoalescedUpdates allObjects];
+	CFSetRemoveAllValues(sLayersWithCoalescedUpdates);
+
+	NSEnumerator* iter = [layers objectEnumerator];
+	DKLayer* layer;
+	NSRect rect;
+
+	while ((layer = [iter nextObject])) {
+		rect = layer->mCoalescedUpdateRect;
+		layer->mCoalescedUpdateRect = NSZeroRect;
+
+		[layer setNeedsDisplayInRect:rect];
+	}
 }
 
 /** @brief Marks several areas for update at once
@@ -283,7 +370,11 @@ static NSArray* s_selectionColours = nil;
  */
 - (void)setNeedsDisplayInRects:(NSSet*)setOfRects
 {
-	[[self drawing] setNeedsDisplayInRects:setOfRects];
+	NSEnumerator* iter = [setOfRects objectEnumerator];
+	NSValue* val;
+
+	while ((val = [iter nextObject]))
+		[self setNeedsDisplayInRect:[val rectValue]];
 }
 
 /** @brief Marks several areas for update at once
@@ -295,8 +386,11 @@ static NSArray* s_selectionColours = nil;
  */
 - (void)setNeedsDisplayInRects:(NSSet*)setOfRects withExtraPadding:(NSSize)padding
 {
-	[[self drawing] setNeedsDisplayInRects:setOfRects
-						  withExtraPadding:padding];
+	NSEnumerator* iter = [setOfRects objectEnumerator];
+	NSValue* val;
+
+	while ((val = [iter nextObject]))
+		[self setNeedsDisplayInRect:NSInsetRect([val rectValue], -padding.width, -padding.height)];
 }
 
 /** @brief Called before the layer starts drawing its content
@@ -329,7 +423,7 @@ static NSArray* s_selectionColours = nil;
 - (void)setSelectionColour:(NSColor*)colour
 {
 	if (![self locked] && ![colour isEqual:[self selectionColour]]) {
-		LogEvent_(kReactiveEvent, @"<%@ 0x%x> setting selection colour: %@", NSStringFromClass([self class]), self, colour);
+		DKTrace_(kDKTraceReactive, @"<%@ 0x%x> setting selection colour: %@", NSStringFromClass([self class]), self, colour);
 
 		[[[self undoManager] prepareWithInvocationTarget:self] setSelectionColour:[self selectionColour]];
 
@@ -380,7 +474,7 @@ static NSArray* s_selectionColours = nil;
 		size.height = drsize.height / 8.0;
 	}
 
-	//LogEvent_(kReactiveEvent,  @"creating layer thumbnail size: {%f, %f}", size.width, size.height );
+	//DKTrace_(kDKTraceReactive,  @"creating layer thumbnail size: {%f, %f}", size.width, size.height );
 
 	NSImage* thumb = [[NSImage alloc] initWithSize:size];
 	NSRect tr, dr, dest;
@@ -706,7 +800,7 @@ static NSArray* s_selectionColours = nil;
 		[m_name release];
 		m_name = nameCopy;
 
-		LogEvent_(kStateEvent, @"layer's name was set to '%@'", m_name);
+		DKTrace_(kDKTraceState, @"layer's name was set to '%@'", m_name);
 
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerNameDidChange
 															object:self];
@@ -794,6 +888,22 @@ static NSArray* s_selectionColours = nil;
 						forKey:key];
 }
 
+#pragma mark -
+
+- (DKMemoryFootprint*)memoryFootprint
+{
+	DKMemoryFootprint* footprint = [[DKMemoryFootprint alloc] init];
+
+	[self addFootprintToReport:footprint];
+	return [footprint autorelease];
+}
+
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	[footprint addBytes:[mUserInfo undoCost]
+			 toCategory:kDKFootprintMetadata];
+}
+
 #pragma mark -
 #pragma mark - print this layer ?
 
@@ -839,7 +949,7 @@ static NSArray* s_selectionColours = nil;
 {
 	// override to make use of this message
 
-	LogEvent_(kReactiveEvent, @"layer %@ became active", self);
+	DKTrace_(kDKTraceReactive, @"layer %@ became active", self);
 }
 
 /** @brief The layer is no longer the active layer
@@ -850,7 +960,7 @@ static NSArray* s_selectionColours = nil;
 {
 	// override to make use of this message
 
-	LogEvent_(kReactiveEvent, @"layer %@ resigned active", self);
+	DKTrace_(kDKTraceReactive, @"layer %@ resigned active", self);
 }
 
 /** @brief Return whether the layer can be deleted
@@ -1163,10 +1273,43 @@ static NSArray* s_selectionColours = nil;
 		[m_infoWindow setWindowOffset:NSMakeSize(6, 10)];
 	}
 
-	[m_infoWindow setStringValue:str];
-	[m_infoWindow positionNearPoint:p
-							 inView:[self currentView]];
-	[m_infoWindow show];
+	// the position is worked out now, while the view is current. A window that's already up is changed at the next display refresh, so
+	// however many mouse events arrive before then, it's resized and moved only once.
+
+	NSPoint sp = [m_infoWindow screenPointNearPoint:p
+											 inView:[self currentView]];
+
+	if (![m_infoWindow isVisible]) {
+		[[DKFeedbackScheduler sharedScheduler] cancelUpdateForTarget:self
+															selector:@selector(updateInfoWindow)];
+		[mPendingInfoString release];
+		mPendingInfoString = nil;
+
+		[m_infoWindow setStringValue:str];
+		[m_infoWindow positionAtScreenPoint:sp];
+		[m_infoWindow show];
+	} else {
+		NSString* pending = [str copy];
+
+		[mPendingInfoString release];
+		mPendingInfoString = pending;
+		mPendingInfoScreenPoint = sp;
+
+		[[DKFeedbackScheduler sharedScheduler] scheduleUpdateForTarget:self
+															  selector:@selector(updateInfoWindow)];
+	}
+}
+
+- (void)updateInfoWindow
+{
+	if (mPendingInfoString != nil) {
+		[m_infoWindow setStringValue:mPendingInfoString];
+		[m_infoWindow positionAtScreenPoint:mPendingInfoScreenPoint];
+		[m_infoWindow show];
+
+		[mPendingInfoString release];
+		mPendingInfoString = nil;
+	}
 }
 
 /** @brief Sets the background colour of the small floating info window
@@ -1189,6 +1332,11 @@ static NSArray* s_selectionColours = nil;
  */
 - (void)hideInfoWindow
 {
+	[[DKFeedbackScheduler sharedScheduler] cancelUpdateForTarget:self
+														selector:@selector(updateInfoWindow)];
+	[mPendingInfoString release];
+	mPendingInfoString = nil;
+
 	[m_infoWindow hide];
 }
 
@@ -1295,12 +1443,13 @@ static NSArray* s_selectionColours = nil;
 #pragma mark As an NSObject
 - (void)dealloc
 {
-	LogEvent_(kLifeEvent, @"deallocating DKLayer %p", self);
+	DKTrace_(kDKTraceLife, @"deallocating DKLayer %p", self);
 
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	[[self undoManager] removeAllActionsWithTarget:self];
 
 	[m_infoWindow release];
+	[mPendingInfoString release];
 	[m_knobs release];
 	[m_selectionColour release];
 	[m_name release];
@@ -1369,7 +1518,7 @@ static NSArray* s_selectionColours = nil;
 - (id)initWithCoder:(NSCoder*)coder
 {
 	NSAssert(coder != nil, @"Expected valid coder");
-	LogEvent_(kFileEvent, @"decoding layer %@", self);
+	DKTrace_(kDKTraceFile, @"decoding layer %@", self);
 
 	self = [self init];
 	if (self) {
@@ -0,0 +1,76 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKCacheRegistry.h"
+
+@class DKDrawing, DKLayer, DKDrawingView;
+
+/** @brief Renders a drawing's cached layers concurrently into bitmaps of their own, and composites them when the view draws.
+
+ Renders a drawing's cached layers concurrently into bitmaps of their own, and composites them when the view draws. Each of the drawing's
+ own layers that is suitable (see -[DKObjectOwnerLayer isSuitableForConcurrentCompositing]) - by default, an inactive object layer set to
+ cache using a CGLayer - is kept as a bitmap of the view's visible area at the view's scale. When the view draws, the parts of those
+ bitmaps that their layers have flagged for update since are re-rendered, several layers at once on worker threads, and the bitmaps are
+ then drawn in Z order on the main thread between the layers that are drawn directly. Editing one layer then costs a render of that
+ layer alone plus a composite of the others.
+
+ Layers are rendered with DKDrawingRenderer, so they take its headless paths. Layers whose objects share a style are rendered one after
+ another on the same thread, as each style caches what it renders. A bitmap is re-rendered completely when the view scrolls or
+ zooms, or when the drawing quality has improved since it was rendered.
+
+ The compositor is owned by the drawing, and is only created if the drawing's setCompositesLayersConcurrently: is set to YES. It works
+ best with a single view; a drawing shown in several views re-renders the bitmaps as each view draws.
+*/
+@interface DKLayerCompositor : NSObject <DKPurgeableCache> {
+@private
+	DKDrawing* mDrawingRef; // the drawing that owns the compositor
+	CFMutableDictionaryRef mEntries; // layer -> composited layer
+	BOOL mIsCompositing;
+	NSUInteger mLayersRendered;
+	NSUInteger mLayersComposited;
+}
+
+- (id)initWithDrawing:(DKDrawing*)drawing;
+- (DKDrawing*)drawing;
+
+/** @brief Brings the bitmaps of the suitable layers up to date before the view draws <rect>
+
+ Called by the drawing as it starts to draw in a view. Layers are only composited until the matching -endCompositing, and only if
+ <rect> lies within the view's visible area - otherwise, as while the view renders a tile for its cache, every layer is drawn directly.
+ @param rect the area being drawn
+ @param aView the view being drawn
+ */
+- (void)beginCompositingRect:(NSRect)rect inView:(DKDrawingView*)aView;
+- (void)endCompositing;
+
+/** @brief Draws a layer from its bitmap, if it has one for the current update
+ @param layer one of the drawing's layers
+ @return YES if the layer was drawn, NO if the caller should draw it directly
+ */
+- (BOOL)drawLayer:(DKLayer*)layer;
+
+/** @brief Notes that part of a layer needs re-rendering
+ @param layer the layer
+ @param rect the area that changed
+ */
+- (void)invalidateLayer:(DKLayer*)layer rect:(NSRect)rect;
+- (void)invalidateAll;
+
+/** @brief The number of layers rendered into bitmaps, and the number of times a bitmap was composited, since the statistics were reset
+ */
+- (NSUInteger)layersRendered;
+- (NSUInteger)layersComposited;
+- (void)resetStatistics;
+
+/** @brief The memory used by the layers' bitmaps
+ @return the size of the bitmaps, in bytes
+ */
+- (NSUInteger)bytesUsed;
+
+@end
+
+#define kDKLayerCompositorMaximumBitmapBytes (64 * 1024 * 1024) // layers whose bitmap would be larger are drawn directly
@@ -0,0 +1,500 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKLayerCompositor.h"
+#import "DKDrawing.h"
+#import "DKDrawingView.h"
+#import "DKDrawingRenderer.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKStyle.h"
+#import "DKRenderStatistics.h"
+#import "DKTrace.h"
+#import "LogEvent.h"
+
+/// the bitmap of a single layer
+
+@interface DKCompositedLayer : NSObject {
+@public
+	CGContextRef mBitmap;
+	NSRect mRect; // the area of the drawing the bitmap covers, a whole number of pixels in size
+	CGFloat mScale;
+	size_t mPixelsWide;
+	size_t mPixelsHigh;
+	DKDrawingView* mViewRef;
+	NSRect mInvalidRect; // the area flagged for update since it was last rendered
+	DKDrawingQualityTier mQualityTier; // the worst quality any part was rendered at
+	BOOL mLowQuality;
+}
+
+@end
+
+@implementation DKCompositedLayer
+
+- (void)dealloc
+{
+	CGContextRelease(mBitmap);
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+/// the layers to render in one pass. Each job is rendered on one thread, its layers one after another
+
+typedef struct {
+	DKDrawingRenderer* renderer;
+	DKDrawingView* view;
+	DKLayer** layers;
+	DKCompositedLayer** entries;
+	NSRect* rects;
+	NSUInteger* jobStarts; // job k renders items jobStarts[k] to jobStarts[k + 1] - 1
+} DKCompositingPass;
+
+static NSRect pixelAlignedRect(DKCompositedLayer* entry, NSRect rect)
+{
+	// the rect is expanded to whole pixels of the bitmap, so that clearing it doesn't leave partial pixels at its edges
+
+	CGFloat s = entry->mScale;
+	CGFloat x0 = MAX(floor((NSMinX(rect) - NSMinX(entry->mRect)) * s), 0);
+	CGFloat y0 = MAX(floor((NSMinY(rect) - NSMinY(entry->mRect)) * s), 0);
+	CGFloat x1 = MIN(ceil((NSMaxX(rect) - NSMinX(entry->mRect)) * s), (CGFloat)entry->mPixelsWide);
+	CGFloat y1 = MIN(ceil((NSMaxY(rect) - NSMinY(entry->mRect)) * s), (CGFloat)entry->mPixelsHigh);
+
+	return NSMakeRect(NSMinX(entry->mRect) + x0 / s, NSMinY(entry->mRect) + y0 / s, (x1 - x0) / s, (y1 - y0) / s);
+}
+
+static void renderLayerIntoEntry(DKDrawingRenderer* renderer, DKLayer* layer, DKCompositedLayer* entry, NSRect rect)
+{
+	// the drawing is flipped and the bitmap isn't, so the top of the drawing is at the top of the bitmap
+
+	CGFloat s = entry->mScale;
+	CGRect dest = CGRectMake((NSMinX(rect) - NSMinX(entry->mRect)) * s, (NSMaxY(entry->mRect) - NSMaxY(rect)) * s, NSWidth(rect) * s, NSHeight(rect) * s);
+	uint64_t statsStart = DKRenderIntervalBegin(kDKRenderEventLayerDraw, layer);
+
+	CGContextClearRect(entry->mBitmap, dest);
+
+	[renderer renderLayer:layer
+					 rect:rect
+			  intoContext:entry->mBitmap
+		  destinationRect:dest];
+
+	DKRenderIntervalEnd(kDKRenderEventLayerDraw, layer, statsStart, 0, 0);
+}
+
+static void renderJob(void* context, size_t job)
+{
+	DKCompositingPass* pass = (DKCompositingPass*)context;
+	NSUInteger i;
+
+	@autoreleasepool {
+		// objects ask the current view for the scale they're drawn at
+
+		[DKDrawingView pushCurrentViewAndSet:pass->view];
+
+		for (i = pass->jobStarts[job]; i < pass->jobStarts[job + 1]; ++i)
+			renderLayerIntoEntry(pass->renderer, pass->layers[i], pass->entries[i], pass->rects[i]);
+
+		[DKDrawingView pop];
+	}
+}
+
+static NSUInteger rootOfGroup(NSUInteger* parents, NSUInteger i)
+{
+	while (parents[i] != i)
+		i = parents[i] = parents[parents[i]];
+
+	return i;
+}
+
+static void invalidateEntry(const void* key, const void* value, void* context)
+{
+#pragma unused(key, context)
+
+	DKCompositedLayer* entry = (DKCompositedLayer*)value;
+	entry->mInvalidRect = entry->mRect;
+}
+
+static void addEntryBytes(const void* key, const void* value, void* context)
+{
+#pragma unused(key)
+
+	DKCompositedLayer* entry = (DKCompositedLayer*)value;
+	*(NSUInteger*)context += CGBitmapContextGetBytesPerRow(entry->mBitmap) * entry->mPixelsHigh;
+}
+
+#pragma mark -
+
+@interface DKLayerCompositor (Private)
+
+- (void)renderLayers:(DKLayer**)layers entries:(DKCompositedLayer**)entries rects:(NSRect*)rects count:(NSUInteger)count inView:(DKDrawingView*)aView;
+
+@end
+
+#pragma mark -
+
+@implementation DKLayerCompositor
+
+- (id)initWithDrawing:(DKDrawing*)drawing
+{
+	self = [super init];
+	if (self) {
+		// layers are retained, so that one can't be replaced by another at the same address between updates
+
+		mDrawingRef = drawing;
+		mEntries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeRenderedImages];
+	}
+
+	return self;
+}
+
+- (DKDrawing*)drawing
+{
+	return mDrawingRef;
+}
+
+- (void)beginCompositingRect:(NSRect)rect inView:(DKDrawingView*)aView
+{
+	mIsCompositing = NO;
+
+	// a view drawing outlines only has the layers stroke them directly, which is quicker than compositing them
+
+	if (aView == nil || ![NSGraphicsContext currentContextDrawingToScreen] || [aView drawsOutlinesOnly])
+		return;
+
+	NSRect visible = [aView visibleRect];
+	CGFloat scale = [aView scale];
+
+	if (scale <= 0 || NSIsEmptyRect(visible) || !NSContainsRect(visible, rect))
+		return;
+
+	size_t pw = (size_t)ceil(NSWidth(visible) * scale);
+	size_t ph = (size_t)ceil(NSHeight(visible) * scale);
+
+	if (pw * ph * 4 > kDKLayerCompositorMaximumBitmapBytes)
+		return;
+
+	NSRect cover = NSMakeRect(NSMinX(visible), NSMinY(visible), pw / scale, ph / scale);
+	DKDrawingQualityTier tier = [DKStyle drawingQualityTier];
+	BOOL lowQuality = [mDrawingRef lowRenderingQuality];
+
+	// only the layers the drawing will draw - those from the highest opaque one down - are composited
+
+	NSMutableArray* suitable = [NSMutableArray array];
+	NSInteger n;
+	DKLayer* layer;
+
+	for (n = [mDrawingRef indexOfHighestOpaqueLayer]; n >= 0; --n) {
+		layer = [mDrawingRef objectInLayersAtIndex:n];
+
+		if ([layer visible] && [layer isKindOfClass:[DKObjectOwnerLayer class]] && [(DKObjectOwnerLayer*)layer isSuitableForConcurrentCompositing])
+			[suitable addObject:layer];
+	}
+
+	NSUInteger i, count = [suitable count], k = 0;
+	DKLayer** layers = malloc(sizeof(DKLayer*) * MAX(count, 1U));
+	DKCompositedLayer** entries = malloc(sizeof(DKCompositedLayer*) * MAX(count, 1U));
+	NSRect* rects = malloc(sizeof(NSRect) * MAX(count, 1U));
+	DKCompositedLayer* entry;
+	NSRect r;
+
+	@synchronized(self)
+	{
+		// discard the bitmaps of layers that are no longer composited
+
+		CFIndex c, entryCount = CFDictionaryGetCount(mEntries);
+		const void** keys = malloc(sizeof(void*) * MAX(entryCount, 1));
+
+		CFDictionaryGetKeysAndValues(mEntries, keys, NULL);
+
+		for (c = 0; c < entryCount; ++c) {
+			if (![suitable containsObject:(id)keys[c]])
+				CFDictionaryRemoveValue(mEntries, keys[c]);
+		}
+
+		free(keys);
+
+		// find what needs rendering. A bitmap made for another view, scale or area starts again, as does one rendered at a lower
+		// quality than is now wanted
+
+		for (i = 0; i < count; ++i) {
+			layer = [suitable objectAtIndex:i];
+			entry = (DKCompositedLayer*)CFDictionaryGetValue(mEntries, layer);
+
+			if (entry == nil || entry->mViewRef != aView || entry->mScale != scale || entry->mPixelsWide != pw || entry->mPixelsHigh != ph || !NSEqualRects(entry->mRect, cover)) {
+				CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+				CGContextRef bm = CGBitmapContextCreate(NULL, pw, ph, 8, 0, space, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+				CGColorSpaceRelease(space);
+
+				if (bm == NULL) {
+					LogEvent_(kWheneverEvent, @"couldn't make a %lu x %lu bitmap to composite layer %@", (unsigned long)pw, (unsigned long)ph, layer);
+
+					CFDictionaryRemoveValue(mEntries, layer);
+					continue;
+				}
+
+				entry = [[DKCompositedLayer alloc] init];
+				entry->mBitmap = bm;
+				entry->mRect = cover;
+				entry->mScale = scale;
+				entry->mPixelsWide = pw;
+				entry->mPixelsHigh = ph;
+				entry->mViewRef = aView;
+				entry->mInvalidRect = cover;
+
+				CFDictionarySetValue(mEntries, layer, entry);
+				[entry release];
+			} else if (tier < entry->mQualityTier || (entry->mLowQuality && !lowQuality))
+				entry->mInvalidRect = cover;
+
+			r = NSIntersectionRect(entry->mInvalidRect, cover);
+
+			if (!NSIsEmptyRect(r)) {
+				layers[k] = layer;
+				entries[k] = entry;
+				rects[k] = pixelAlignedRect(entry, r);
+				++k;
+
+				if (NSEqualRects(r, cover)) {
+					entry->mQualityTier = tier;
+					entry->mLowQuality = lowQuality;
+				} else {
+					entry->mQualityTier = MAX(entry->mQualityTier, tier);
+					entry->mLowQuality = entry->mLowQuality || lowQuality;
+				}
+
+				entry->mInvalidRect = NSZeroRect;
+			}
+		}
+	}
+
+	if (k > 0)
+		[self renderLayers:layers
+				   entries:entries
+					 rects:rects
+					 count:k
+					inView:aView];
+
+	free(layers);
+	free(entries);
+	free(rects);
+
+	mIsCompositing = YES;
+}
+
+- (void)renderLayers:(DKLayer**)layers entries:(DKCompositedLayer**)entries rects:(NSRect*)rects count:(NSUInteger)count inView:(DKDrawingView*)aView
+{
+	// layers whose objects share a style are put in the same job, since styles cache what they render. Sharing is transitive, so the
+	// jobs are the connected groups
+
+	NSUInteger* parents = malloc(sizeof(NSUInteger) * count);
+	NSSet** styles = malloc(sizeof(NSSet*) * count);
+	NSUInteger i, j, ri, rj;
+
+	for (i = 0; i < count; ++i) {
+		parents[i] = i;
+		styles[i] = [layers[i] allStyles];
+
+		for (j = 0; j < i; ++j) {
+			if (styles[i] && styles[j] && [styles[i] intersectsSet:styles[j]]) {
+				ri = rootOfGroup(parents, i);
+				rj = rootOfGroup(parents, j);
+
+				if (ri != rj)
+					parents[ri] = rj;
+			}
+		}
+	}
+
+	// sort the items so that each job's are together, keeping the layers' order within a job
+
+	NSUInteger* jobOfRoot = malloc(sizeof(NSUInteger) * count);
+	NSUInteger* jobStarts = calloc(count + 1, sizeof(NSUInteger));
+	NSUInteger* order = malloc(sizeof(NSUInteger) * count);
+	NSUInteger jobCount = 0;
+
+	for (i = 0; i < count; ++i)
+		jobOfRoot[i] = NSNotFound;
+
+	for (i = 0; i < count; ++i) {
+		ri = rootOfGroup(parents, i);
+
+		if (jobOfRoot[ri] == NSNotFound)
+			jobOfRoot[ri] = jobCount++;
+
+		jobStarts[jobOfRoot[ri] + 1]++;
+	}
+
+	for (j = 0; j < jobCount; ++j)
+		jobStarts[j + 1] += jobStarts[j];
+
+	NSUInteger* fill = malloc(sizeof(NSUInteger) * MAX(jobCount, 1U));
+	memcpy(fill, jobStarts, sizeof(NSUInteger) * jobCount);
+
+	for (i = 0; i < count; ++i)
+		order[fill[jobOfRoot[rootOfGroup(parents, i)]]++] = i;
+
+	DKLayer** sortedLayers = malloc(sizeof(DKLayer*) * count);
+	DKCompositedLayer** sortedEntries = malloc(sizeof(DKCompositedLayer*) * count);
+	NSRect* sortedRects = malloc(sizeof(NSRect) * count);
+
+	for (i = 0; i < count; ++i) {
+		sortedLayers[i] = layers[order[i]];
+		sortedEntries[i] = entries[order[i]];
+		sortedRects[i] = rects[order[i]];
+	}
+
+	DKDrawingRenderer* renderer = [[DKDrawingRenderer alloc] initWithDrawing:mDrawingRef];
+	DKCompositingPass pass;
+
+	pass.renderer = renderer;
+	pass.view = aView;
+	pass.layers = sortedLayers;
+	pass.entries = sortedEntries;
+	pass.rects = sortedRects;
+	pass.jobStarts = jobStarts;
+
+	DKTrace_(kDKTraceInfo, @"compositor rendering %lu layers in %lu jobs", (unsigned long)count, (unsigned long)jobCount);
+
+	// the calling thread takes part, and doesn't return until every job is done
+
+	if (jobCount == 1)
+		renderJob(&pass, 0);
+	else
+		dispatch_apply_f(jobCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_HIGH, 0), &pass, renderJob);
+
+	mLayersRendered += count;
+
+	[renderer release];
+	free(sortedLayers);
+	free(sortedEntries);
+	free(sortedRects);
+	free(fill);
+	free(order);
+	free(jobStarts);
+	free(jobOfRoot);
+	free(styles);
+	free(parents);
+}
+
+- (void)endCompositing
+{
+	mIsCompositing = NO;
+}
+
+- (BOOL)drawLayer:(DKLayer*)layer
+{
+	if (!mIsCompositing)
+		return NO;
+
+	DKCompositedLayer* entry = (DKCompositedLayer*)CFDictionaryGetValue(mEntries, layer);
+
+	if (entry == nil)
+		return NO;
+
+	CGImageRef image = CGBitmapContextCreateImage(entry->mBitmap);
+
+	if (image == NULL)
+		return NO;
+
+	// the view is flipped and the bitmap isn't
+
+	CGContextRef ctx = [[NSGraphicsContext currentContext] graphicsPort];
+
+	CGContextSaveGState(ctx);
+	CGContextTranslateCTM(ctx, NSMinX(entry->mRect), NSMaxY(entry->mRect));
+	CGContextScaleCTM(ctx, 1, -1);
+	CGContextDrawImage(ctx, CGRectMake(0, 0, NSWidth(entry->mRect), NSHeight(entry->mRect)), image);
+	CGContextRestoreGState(ctx);
+	CGImageRelease(image);
+
+	++mLayersComposited;
+	return YES;
+}
+
+- (void)invalidateLayer:(DKLayer*)layer rect:(NSRect)rect
+{
+	if (NSIsEmptyRect(rect))
+		return;
+
+	@synchronized(self)
+	{
+		DKCompositedLayer* entry = (DKCompositedLayer*)CFDictionaryGetValue(mEntries, layer);
+
+		if (entry != nil)
+			entry->mInvalidRect = NSIsEmptyRect(entry->mInvalidRect) ? rect : NSUnionRect(entry->mInvalidRect, rect);
+	}
+}
+
+- (void)invalidateAll
+{
+	@synchronized(self)
+	{
+		CFDictionaryApplyFunction(mEntries, invalidateEntry, NULL);
+	}
+}
+
+- (NSUInteger)layersRendered
+{
+	return mLayersRendered;
+}
+
+- (NSUInteger)layersComposited
+{
+	return mLayersComposited;
+}
+
+- (void)resetStatistics
+{
+	mLayersRendered = mLayersComposited = 0;
+}
+
+- (NSUInteger)bytesUsed
+{
+	NSUInteger bytes = 0;
+
+	@synchronized(self)
+	{
+		CFDictionaryApplyFunction(mEntries, addEntryBytes, &bytes);
+	}
+
+	return bytes;
+}
+
+#pragma mark -
+#pragma mark As a DKPurgeableCache
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	NSUInteger bytes = 0;
+
+	@synchronized(self)
+	{
+		// the bitmaps are in use between -beginCompositingRect:inView: and -endCompositing
+
+		if (!mIsCompositing) {
+			CFDictionaryApplyFunction(mEntries, addEntryBytes, &bytes);
+			CFDictionaryRemoveAllValues(mEntries);
+		}
+	}
+
+	return bytes;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
+	CFRelease(mEntries);
+	[super dealloc];
+}
+
+@end
@@ -6,8 +6,11 @@
 
 #import "DKLayerGroup.h"
 #import "DKDrawing.h"
+#import "DKLayerCompositor.h"
 #import "DKDrawKitMacros.h"
+#import "DKRenderStatistics.h"
 #import "LogEvent.h"
+#import "DKMemoryFootprint.h"
 
 #pragma mark Constants(Non - localized)
 NSString* kDKLayerGroupDidAddLayer = @"kDKLayerGroupDidAddLayer";
@@ -846,6 +849,11 @@ NSString* kDKLayerGroupDidReorderLayers = @"kDKLayerGroupDidReorderLayers";
 		NSInteger n;
 		BOOL printing = ![NSGraphicsContext currentContextDrawingToScreen];
 		DKLayer* layer;
+		uint64_t statsStart;
+
+		// the drawing's own layers may have been rendered already, to be composited
+
+		DKLayerCompositor* compositor = ([self drawing] == self) ? [(DKDrawing*)self layerCompositor] : nil;
 
 		bottom = [self indexOfHighestOpaqueLayer];
 
@@ -860,10 +868,16 @@ NSString* kDKLayerGroupDidReorderLayers = @"kDKLayerGroupDidReorderLayers";
 					if ([layer clipsDrawingToInterior])
 						[NSBezierPath clipRect:[[self drawing] interior]];
 
-					[layer beginDrawing];
-					[layer drawRect:rect
-							 inView:aView];
-					[layer endDrawing];
+					statsStart = DKRenderIntervalBegin(kDKRenderEventLayerDraw, layer);
+
+					if (![compositor drawLayer:layer]) {
+						[layer beginDrawing];
+						[layer drawRect:rect
+								 inView:aView];
+						[layer endDrawing];
+					}
+
+					DKRenderIntervalEnd(kDKRenderEventLayerDraw, layer, statsStart, 0, 0);
 				}
 				@catch (id exc)
 				{
@@ -879,6 +893,31 @@ NSString* kDKLayerGroupDidReorderLayers = @"kDKLayerGroupDidReorderLayers";
 	}
 }
 
+/** @brief Draws the overlays of the visible layers in the group, bottom to top
+ @param rect the overall area being updated
+ @param aView the view doing the rendering
+ */
+- (void)drawOverlayRect:(NSRect)rect inView:(DKDrawingView*)aView
+{
+	NSInteger n;
+	DKLayer* layer;
+
+	for (n = (NSInteger)[self countOfLayers] - 1; n >= 0; --n) {
+		layer = [self objectInLayersAtIndex:n];
+
+		if ([layer visible]) {
+			[NSGraphicsContext saveGraphicsState];
+
+			if ([layer clipsDrawingToInterior])
+				[NSBezierPath clipRect:[[self drawing] interior]];
+
+			[layer drawOverlayRect:rect
+							inView:aView];
+			[NSGraphicsContext restoreGraphicsState];
+		}
+	}
+}
+
 /** @brief Returns whether the layer can become the active layer
 
  The default for groups is NO. Discrete layers should be activated, not groups.
@@ -947,6 +986,16 @@ NSString* kDKLayerGroupDidReorderLayers = @"kDKLayerGroupDidReorderLayers";
 		return [[self layerGroup] level] + 1;
 }
 
+/** @brief Adds the memory used by the group and all of its layers to a footprint report
+ @param footprint the report
+ */
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	[super addFootprintToReport:footprint];
+	[[self layers] makeObjectsPerformSelector:_cmd
+								   withObject:footprint];
+}
+
 #pragma mark -
 #pragma mark - style utilities
 
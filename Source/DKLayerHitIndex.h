@@ -0,0 +1,67 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKObjectOwnerLayer;
+
+/** @brief A coarse map of where an object layer has objects, so that hit-testing can skip layers with nothing under the point.
+
+ A coarse map of where an object layer has objects, so that hit-testing can skip layers with nothing under the point. The drawing is divided
+ into a grid of kDKLayerHitIndexGridSize cells each way, and a cell is marked if any visible object's bounds touch it. Finding a drawing's
+ topmost layer under the mouse then costs one bit test for each layer that has no objects there, instead of a storage query.
+
+ The map is kept conservative cheaply: every area the layer flags for redrawing is marked, which covers objects that have moved or been
+ added, and after kDKLayerHitIndexRebuildThreshold such marks - or when the whole layer is redrawn - it is rebuilt from the objects' bounds
+ to clear the cells they have left.
+
+ The index also keeps the objects that touch the last cell hit-tested. While the mouse moves within a cell, as it does when the cursor or a
+ rollover highlight is being tracked, the layer's storage isn't queried again; those candidates are checked against each new point instead
+ until something changes in the cell.
+*/
+@interface DKLayerHitIndex : NSObject {
+@private
+	DKObjectOwnerLayer* mLayerRef; // the layer, not retained
+	uint32_t mCells[32]; // bit n of row m is set if an object may touch cell (n, m)
+	NSSize mCanvasSize; // the drawing size the cells were laid out for
+	BOOL mValid;
+	NSUInteger mMarkCount; // areas marked since the last rebuild
+	NSInteger mCandidateCell; // the cell whose objects are kept, or -1
+	NSArray* mCandidates; // objects touching the candidate cell, bottom to top
+	NSUInteger mSkips; // hit tests answered by the cells alone
+	NSUInteger mReuses; // hit tests answered from the kept candidates
+}
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer;
+
+/** @brief Whether the layer may have an object whose bounds contain <p>
+
+ NO means certainly not. Points outside the drawing always return YES.
+ @param p a point in drawing coordinates
+ @return YES if there may be an object there
+ */
+- (BOOL)mayHaveObjectsAtPoint:(NSPoint)p;
+
+/** @brief Returns the layer's visible objects whose bounds contain <p>, as -[DKObjectStorage objectsContainingPoint:] does
+ @param p a point in drawing coordinates
+ @return the objects, bottom to top
+ */
+- (NSArray*)objectsContainingPoint:(NSPoint)p;
+
+/** @brief Notes that something in <rect> has changed, so objects may now be there, or may have left
+ @param rect an area of the drawing
+ */
+- (void)noteChangeInRect:(NSRect)rect;
+- (void)invalidate;
+
+- (NSUInteger)skips;
+- (NSUInteger)reuses;
+- (void)resetStatistics;
+
+@end
+
+#define kDKLayerHitIndexGridSize 32 // cells each way; one 32-bit word per row
+#define kDKLayerHitIndexRebuildThreshold 256 // marked areas after which the cells are rebuilt from the objects
@@ -0,0 +1,205 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKLayerHitIndex.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawing.h"
+#import "DKDrawableObject.h"
+#import "DKStorageTuner.h"
+#import "LogEvent.h"
+
+@interface DKLayerHitIndex (Private)
+
+- (void)rebuild;
+- (void)markRect:(NSRect)rect;
+- (NSInteger)cellForPoint:(NSPoint)p;
+- (NSRect)rectOfCell:(NSInteger)cell;
+
+@end
+
+static inline NSRect pointRect(NSPoint p)
+{
+	// the same tiny rect the storage classes use for point queries
+
+	return NSMakeRect(p.x - 0.0005, p.y - 0.0005, 0.001, 0.001);
+}
+
+@implementation DKLayerHitIndex
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer
+{
+	self = [super init];
+	if (self) {
+		mLayerRef = layer;
+		mCandidateCell = -1;
+	}
+
+	return self;
+}
+
+- (BOOL)mayHaveObjectsAtPoint:(NSPoint)p
+{
+	if (!mValid || !NSEqualSizes(mCanvasSize, [[mLayerRef drawing] drawingSize]) || mMarkCount > kDKLayerHitIndexRebuildThreshold)
+		[self rebuild];
+
+	NSInteger cell = [self cellForPoint:p];
+
+	if (cell < 0)
+		return YES;
+
+	if ((mCells[cell / kDKLayerHitIndexGridSize] & (1U << (cell % kDKLayerHitIndexGridSize))) != 0)
+		return YES;
+
+	++mSkips;
+	return NO;
+}
+
+- (NSArray*)objectsContainingPoint:(NSPoint)p
+{
+	if (![self mayHaveObjectsAtPoint:p])
+		return [NSArray array];
+
+	NSInteger cell = [self cellForPoint:p];
+
+	if (cell < 0) {
+		[[mLayerRef storageTuner] noteQueryOfRect:pointRect(p)];
+		return [[mLayerRef storage] objectsContainingPoint:p];
+	}
+
+	if (cell == mCandidateCell)
+		++mReuses;
+	else {
+		[mCandidates release];
+		mCandidates = [[[mLayerRef storage] objectsIntersectingRect:[self rectOfCell:cell]
+															 inView:nil
+															options:0] retain];
+		[[mLayerRef storageTuner] noteQueryOfRect:[self rectOfCell:cell]];
+		mCandidateCell = cell;
+	}
+
+	NSMutableArray* objects = [NSMutableArray array];
+	NSEnumerator* iter = [mCandidates objectEnumerator];
+	DKDrawableObject* obj;
+	NSRect pr = pointRect(p);
+
+	while ((obj = [iter nextObject])) {
+		if (NSIntersectsRect(pr, [obj bounds]))
+			[objects addObject:obj];
+	}
+
+	return objects;
+}
+
+- (void)noteChangeInRect:(NSRect)rect
+{
+	if (mCandidateCell >= 0 && NSIntersectsRect(rect, [self rectOfCell:mCandidateCell])) {
+		[mCandidates release];
+		mCandidates = nil;
+		mCandidateCell = -1;
+	}
+
+	if (mValid) {
+		[self markRect:rect];
+		++mMarkCount;
+	}
+}
+
+- (void)invalidate
+{
+	mValid = NO;
+	[mCandidates release];
+	mCandidates = nil;
+	mCandidateCell = -1;
+}
+
+- (NSUInteger)skips
+{
+	return mSkips;
+}
+
+- (NSUInteger)reuses
+{
+	return mReuses;
+}
+
+- (void)resetStatistics
+{
+	mSkips = mReuses = 0;
+}
+
+#pragma mark -
+
+- (void)rebuild
+{
+	memset(mCells, 0, sizeof(mCells));
+	mCanvasSize = [[mLayerRef drawing] drawingSize];
+	mMarkCount = 0;
+	mValid = YES;
+
+	NSEnumerator* iter = [[[mLayerRef storage] objects] objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject])) {
+		if ([obj visible])
+			[self markRect:[obj bounds]];
+	}
+
+	LogEvent_(kInfoEvent, @"rebuilt hit index for layer '%@'", [mLayerRef layerName]);
+}
+
+- (void)markRect:(NSRect)rect
+{
+	if (NSIsEmptyRect(rect) || mCanvasSize.width <= 0 || mCanvasSize.height <= 0)
+		return;
+
+	CGFloat cw = mCanvasSize.width / kDKLayerHitIndexGridSize;
+	CGFloat ch = mCanvasSize.height / kDKLayerHitIndexGridSize;
+	NSInteger firstCol = MAX(0, (NSInteger)floor(NSMinX(rect) / cw));
+	NSInteger lastCol = MIN(kDKLayerHitIndexGridSize - 1, (NSInteger)floor(NSMaxX(rect) / cw));
+	NSInteger firstRow = MAX(0, (NSInteger)floor(NSMinY(rect) / ch));
+	NSInteger lastRow = MIN(kDKLayerHitIndexGridSize - 1, (NSInteger)floor(NSMaxY(rect) / ch));
+	NSInteger row, col;
+	uint32_t bits = 0;
+
+	if (firstCol > lastCol || firstRow > lastRow)
+		return;
+
+	for (col = firstCol; col <= lastCol; ++col)
+		bits |= (1U << col);
+
+	for (row = firstRow; row <= lastRow; ++row)
+		mCells[row] |= bits;
+}
+
+- (NSInteger)cellForPoint:(NSPoint)p
+{
+	if (mCanvasSize.width <= 0 || mCanvasSize.height <= 0 || p.x < 0 || p.y < 0 || p.x >= mCanvasSize.width || p.y >= mCanvasSize.height)
+		return -1;
+
+	NSInteger col = (NSInteger)(p.x / (mCanvasSize.width / kDKLayerHitIndexGridSize));
+	NSInteger row = (NSInteger)(p.y / (mCanvasSize.height / kDKLayerHitIndexGridSize));
+
+	return MIN(row, kDKLayerHitIndexGridSize - 1) * kDKLayerHitIndexGridSize + MIN(col, kDKLayerHitIndexGridSize - 1);
+}
+
+- (NSRect)rectOfCell:(NSInteger)cell
+{
+	CGFloat cw = mCanvasSize.width / kDKLayerHitIndexGridSize;
+	CGFloat ch = mCanvasSize.height / kDKLayerHitIndexGridSize;
+
+	return NSMakeRect((cell % kDKLayerHitIndexGridSize) * cw, (cell / kDKLayerHitIndexGridSize) * ch, cw, ch);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mCandidates release];
+	[super dealloc];
+}
+
+@end
@@ -0,0 +1,66 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKObjectStorageProtocol.h"
+
+@class DKDrawableObject;
+
+/** @brief Collects a large number of new objects for a layer, and builds the layer's storage for them, away from the main thread.
+
+ Collects a large number of new objects for a layer, and builds the layer's storage for them, away from the main thread. Adding objects
+ to a layer one at a time registers undo, updates the storage, posts notifications and flags the objects for redrawing for each of them,
+ which for an import of a million features costs far more than reading them. Objects added to a builder are only collected, since they
+ don't belong to a layer yet, and -finish loads them all into a new storage in one pass, building its spatial index once.
+
+ A builder is made by -[DKObjectOwnerLayer objectBuilder] on the main thread, so that it uses the same kind of storage as the layer. It
+ can then be filled and finished on any one thread at a time - typically the queue that is parsing the data - and is handed back to the
+ main thread for -[DKObjectOwnerLayer setObjectsFromBuilder:], which swaps the new storage into the layer as one undoable change.
+
+ The objects must not belong to a layer, and their styles, which may be shared with objects already in the drawing, must not be changed
+ on another thread while the builder is working.
+*/
+@interface DKLayerObjectBuilder : NSObject {
+@private
+	id<DKObjectStorage> mStorage; // the storage being built, until the layer takes it
+	NSMutableArray* mObjects;
+	NSRect mBounds; // the union of the visible objects' bounds, once finished
+	BOOL mFinished;
+}
+
+/** @brief Makes a builder for a particular kind of storage
+ @param storageClass a class conforming to DKObjectStorage
+ @param size the size of the drawing, which spatial storage is divided up for
+ @return the builder
+ */
+- (id)initWithStorageClass:(Class)storageClass canvasSize:(NSSize)size;
+
+/** @brief Adds an object above those already added
+ @param obj a drawable that doesn't belong to a layer
+ */
+- (void)addObject:(DKDrawableObject*)obj;
+- (void)addObjectsFromArray:(NSArray*)objs;
+- (NSUInteger)countOfObjects;
+
+/** @brief Loads the objects into the storage and builds its index
+
+ Called by -[DKObjectOwnerLayer setObjectsFromBuilder:] if it hasn't been already, but calling it on the builder's own thread keeps the
+ work off the main thread. No more objects can be added afterwards. Does nothing if already finished.
+ */
+- (void)finish;
+- (BOOL)isFinished;
+
+/** @brief The union of the bounds of the visible objects
+ @return a rect, only valid once finished
+ */
+- (NSRect)bounds;
+
+/** @brief Gives up the finished storage, which the builder then no longer has
+ @return the storage, or nil if it has already been taken
+ */
+- (id<DKObjectStorage>)takeStorage;
+
+@end
@@ -0,0 +1,104 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKLayerObjectBuilder.h"
+#import "DKDrawableObject.h"
+#import "DKGeometryUtilities.h"
+
+@implementation DKLayerObjectBuilder
+#pragma mark As a DKLayerObjectBuilder
+
+- (id)initWithStorageClass:(Class)storageClass canvasSize:(NSSize)size
+{
+	NSAssert([storageClass conformsToProtocol:@protocol(DKObjectStorage)], @"builder's storage class must conform to DKObjectStorage");
+
+	self = [super init];
+	if (self) {
+		mStorage = [[storageClass alloc] init];
+		[mStorage setCanvasSize:size];
+		mObjects = [[NSMutableArray alloc] init];
+		mBounds = NSZeroRect;
+	}
+
+	return self;
+}
+
+- (void)addObject:(DKDrawableObject*)obj
+{
+	NSAssert(obj != nil, @"can't add a nil object to a builder");
+	NSAssert(!mFinished, @"can't add objects to a builder that has finished");
+	NSAssert([obj container] == nil, @"object added to a builder already belongs to a layer");
+
+	[mObjects addObject:obj];
+}
+
+- (void)addObjectsFromArray:(NSArray*)objs
+{
+	NSAssert(!mFinished, @"can't add objects to a builder that has finished");
+
+	[mObjects addObjectsFromArray:objs];
+}
+
+- (NSUInteger)countOfObjects
+{
+	return [mObjects count];
+}
+
+- (void)finish
+{
+	if (mFinished)
+		return;
+
+	// the union is worked out here as well, so the layer doesn't need to visit every object again to find it
+
+	NSEnumerator* iter = [mObjects objectEnumerator];
+	DKDrawableObject* obj;
+	NSRect u = NSZeroRect;
+
+	while ((obj = [iter nextObject])) {
+		if ([obj visible] && !NSIsEmptyRect([obj bounds]))
+			u = UnionOfTwoRects(u, [obj bounds]);
+	}
+
+	mBounds = u;
+
+	// the storage copies the list, so it can go now
+
+	[mStorage setObjects:mObjects];
+	[mObjects release];
+	mObjects = nil;
+	mFinished = YES;
+}
+
+- (BOOL)isFinished
+{
+	return mFinished;
+}
+
+- (NSRect)bounds
+{
+	return mBounds;
+}
+
+- (id<DKObjectStorage>)takeStorage
+{
+	id<DKObjectStorage> storage = mStorage;
+
+	mStorage = nil;
+	return [storage autorelease];
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mStorage release];
+	[mObjects release];
+	[super dealloc];
+}
+
+@end
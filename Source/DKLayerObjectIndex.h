@@ -0,0 +1,54 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKObjectOwnerLayer, DKDrawableObject, DKStyle;
+
+/** @brief The objects of a layer grouped by style and by class, so that finding those that share a style or class doesn't look at every object.
+
+ The objects of a layer grouped by style and by class, so that finding those that share a style or class doesn't look at every object. The
+ groups are made the first time they're asked for, and are then kept up to date as the layer adds and removes objects and as its objects
+ change style. Replacing all of the layer's objects, or its storage, discards them until they're next wanted.
+
+ Styles are grouped by unique key, as -[DKObjectOwnerLayer objectsWithStyle:] has always compared them. Only the layer's own objects are
+ indexed, not those inside groups. Objects are returned in stacking order, sorted from the storage's indexes, so a query costs in proportion
+ to what it finds.
+*/
+@interface DKLayerObjectIndex : NSObject {
+@private
+	DKObjectOwnerLayer* mLayerRef; // the layer, not retained
+	NSMutableDictionary* mObjectsByStyle; // style key -> set of objects, not retained
+	CFMutableDictionaryRef mObjectsByClass; // class -> set of objects, not retained
+	BOOL mValid;
+}
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer;
+
+/** @brief Returns the layer's objects that have <style>, compared by unique key
+ @param style a style
+ @return the objects, in stacking order
+ */
+- (NSArray*)objectsWithStyle:(DKStyle*)style;
+
+/** @brief Returns the layer's objects that are of <aClass> or a subclass of it
+ @param aClass a class
+ @return the objects, in stacking order
+ */
+- (NSArray*)objectsOfClass:(Class)aClass;
+
+- (void)objectWasAdded:(DKDrawableObject*)obj;
+- (void)objectWasRemoved:(DKDrawableObject*)obj;
+
+/** @brief Moves <obj> to the group of the style it's about to be given
+ @param obj one of the layer's objects
+ @param newStyle the style it will have, or nil
+ */
+- (void)object:(DKDrawableObject*)obj willChangeStyleTo:(DKStyle*)newStyle;
+
+- (void)invalidate;
+
+@end
@@ -0,0 +1,236 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKLayerObjectIndex.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawableObject.h"
+#import "DKStyle.h"
+
+@interface DKLayerObjectIndex (Private)
+
+- (void)rebuild;
+- (void)addObject:(DKDrawableObject*)obj withStyle:(DKStyle*)style;
+- (void)removeObject:(DKDrawableObject*)obj withStyle:(DKStyle*)style;
+- (NSMutableArray*)objectsInStackingOrder:(CFSetRef)objects;
+
+@end
+
+static NSInteger compareStackingOrder(id a, id b, void* context)
+{
+	id<DKObjectStorage> storage = (id<DKObjectStorage>)context;
+	NSUInteger ia = [storage indexOfObject:a];
+	NSUInteger ib = [storage indexOfObject:b];
+
+	if (ia < ib)
+		return NSOrderedAscending;
+	else if (ia > ib)
+		return NSOrderedDescending;
+	else
+		return NSOrderedSame;
+}
+
+static void addValueToSet(const void* value, void* context)
+{
+	CFSetAddValue((CFMutableSetRef)context, value);
+}
+
+static void addObjectsOfClass(const void* key, const void* value, void* context)
+{
+	// context is an array of { the class asked for, the set the objects are gathered into }
+
+	void** info = (void**)context;
+
+	if ([(Class)key isSubclassOfClass:(Class)info[0]])
+		CFSetApplyFunction((CFSetRef)value, addValueToSet, info[1]);
+}
+
+@implementation DKLayerObjectIndex
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer
+{
+	self = [super init];
+	if (self) {
+		mLayerRef = layer;
+	}
+
+	return self;
+}
+
+- (NSArray*)objectsWithStyle:(DKStyle*)style
+{
+	NSString* key = [style uniqueKey];
+
+	if (key == nil)
+		return [NSArray array];
+
+	if (!mValid)
+		[self rebuild];
+
+	CFSetRef objects = (CFSetRef)[mObjectsByStyle objectForKey:key];
+
+	if (objects == NULL)
+		return [NSArray array];
+
+	return [self objectsInStackingOrder:objects];
+}
+
+- (NSArray*)objectsOfClass:(Class)aClass
+{
+	if (!mValid)
+		[self rebuild];
+
+	// a layer holds objects of only a few classes, so those that are subclasses of the one asked for are simply looked at in turn
+
+	CFMutableSetRef found = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+	void* info[2] = { aClass, found };
+	NSMutableArray* result = nil;
+
+	CFDictionaryApplyFunction(mObjectsByClass, addObjectsOfClass, info);
+
+	@try {
+		result = [self objectsInStackingOrder:found];
+	}
+	@finally {
+		CFRelease(found);
+	}
+
+	return result;
+}
+
+- (void)objectWasAdded:(DKDrawableObject*)obj
+{
+	if (!mValid)
+		return;
+
+	[self addObject:obj
+		  withStyle:[obj style]];
+
+	CFMutableSetRef objects = (CFMutableSetRef)CFDictionaryGetValue(mObjectsByClass, [obj class]);
+
+	if (objects == NULL) {
+		objects = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+		CFDictionarySetValue(mObjectsByClass, [obj class], objects);
+		CFRelease(objects);
+	}
+
+	CFSetAddValue(objects, obj);
+}
+
+- (void)objectWasRemoved:(DKDrawableObject*)obj
+{
+	if (!mValid)
+		return;
+
+	[self removeObject:obj
+			 withStyle:[obj style]];
+
+	CFMutableSetRef objects = (CFMutableSetRef)CFDictionaryGetValue(mObjectsByClass, [obj class]);
+
+	if (objects) {
+		CFSetRemoveValue(objects, obj);
+
+		if (CFSetGetCount(objects) == 0)
+			CFDictionaryRemoveValue(mObjectsByClass, [obj class]);
+	}
+}
+
+- (void)object:(DKDrawableObject*)obj willChangeStyleTo:(DKStyle*)newStyle
+{
+	if (!mValid)
+		return;
+
+	[self removeObject:obj
+			 withStyle:[obj style]];
+	[self addObject:obj
+		  withStyle:newStyle];
+}
+
+- (void)invalidate
+{
+	[mObjectsByStyle release];
+	mObjectsByStyle = nil;
+
+	if (mObjectsByClass) {
+		CFRelease(mObjectsByClass);
+		mObjectsByClass = NULL;
+	}
+
+	mValid = NO;
+}
+
+#pragma mark -
+
+- (void)rebuild
+{
+	[self invalidate];
+
+	mObjectsByStyle = [[NSMutableDictionary alloc] init];
+	mObjectsByClass = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+	mValid = YES;
+
+	NSEnumerator* iter = [[mLayerRef objects] objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject]))
+		[self objectWasAdded:obj];
+}
+
+- (void)addObject:(DKDrawableObject*)obj withStyle:(DKStyle*)style
+{
+	NSString* key = [style uniqueKey];
+
+	if (key == nil)
+		return;
+
+	CFMutableSetRef objects = (CFMutableSetRef)[mObjectsByStyle objectForKey:key];
+
+	if (objects == NULL) {
+		objects = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+		[mObjectsByStyle setObject:(id)objects
+							forKey:key];
+		CFRelease(objects);
+	}
+
+	CFSetAddValue(objects, obj);
+}
+
+- (void)removeObject:(DKDrawableObject*)obj withStyle:(DKStyle*)style
+{
+	NSString* key = [style uniqueKey];
+
+	if (key == nil)
+		return;
+
+	CFMutableSetRef objects = (CFMutableSetRef)[mObjectsByStyle objectForKey:key];
+
+	if (objects) {
+		CFSetRemoveValue(objects, obj);
+
+		if (CFSetGetCount(objects) == 0)
+			[mObjectsByStyle removeObjectForKey:key];
+	}
+}
+
+- (NSMutableArray*)objectsInStackingOrder:(CFSetRef)objects
+{
+	NSMutableArray* result = [NSMutableArray arrayWithArray:[(NSSet*)objects allObjects]];
+
+	[result sortUsingFunction:compareStackingOrder
+					  context:[mLayerRef storage]];
+
+	return result;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[self invalidate];
+	[super dealloc];
+}
+
+@end
@@ -0,0 +1,55 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKObjectOwnerLayer, DKDrawableObject;
+
+/** @brief The objects of a layer that each of its views last showed, so that a view scrolling over the layer only queries what it newly shows.
+
+ The objects of a layer that each of its views last showed, so that a view scrolling over the layer only queries what it newly shows. For
+ each view, the set of objects whose bounds touch its visible rect is kept. When the view has scrolled, the storage is queried only for the
+ strips it has newly exposed, whose objects are added, and for those it has left, whose objects are dropped unless they still touch the
+ visible rect. So a view that redraws everything it shows as it scrolls costs, in storage queries, only what has scrolled into or out of
+ view. A view that has moved further than its own size starts a new set.
+
+ The sets are kept up to date as the layer adds and removes objects, and as its objects move, resize or are shown or hidden. Replacing
+ all of the layer's objects, or its storage, discards them. Views aren't retained; a set is kept for up to kDKLayerVisibleSetMaximumViews
+ views, the one used longest ago being dropped to make room for another.
+
+ Only the layer's own objects are kept, not those inside groups. The objects needing update are returned in stacking order.
+*/
+@interface DKLayerVisibleSet : NSObject {
+@private
+	DKObjectOwnerLayer* mLayerRef; // the layer, not retained
+	NSMutableArray* mEntries; // one for each view, most recently used last
+	NSUInteger mStripQueries; // storage queries of exposed or vacated strips
+	NSUInteger mFullQueries; // storage queries of a whole visible rect
+}
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer;
+
+/** @brief Returns the objects needing update in <aView>, from the view's set
+ @param aView the view being drawn; the update must lie within its visible rect
+ @return the objects, in stacking order
+ */
+- (NSArray*)objectsForUpdateInView:(NSView*)aView;
+
+- (void)objectWasAdded:(DKDrawableObject*)obj;
+- (void)objectWasRemoved:(DKDrawableObject*)obj;
+- (void)object:(DKDrawableObject*)obj didChangeBoundsFrom:(NSRect)oldBounds;
+- (void)objectDidChangeVisibility:(DKDrawableObject*)obj;
+
+- (void)invalidate;
+
+// statistics:
+
+- (NSUInteger)stripQueries;
+- (NSUInteger)fullQueries;
+
+@end
+
+#define kDKLayerVisibleSetMaximumViews 4
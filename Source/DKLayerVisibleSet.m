@@ -0,0 +1,266 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKLayerVisibleSet.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawableObject.h"
+#import "DKStorageTuner.h"
+#import "DKGeometryUtilities.h"
+
+/** @brief The objects shown by one view, and the visible rect they were gathered for. */
+@interface DKVisibleSetEntry : NSObject {
+@public
+	NSView* mViewRef; // the view, not retained
+	NSRect mRect;
+	CFMutableSetRef mObjects; // visible objects touching mRect, not retained
+}
+
+@end
+
+@implementation DKVisibleSetEntry
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		mObjects = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	CFRelease(mObjects);
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKLayerVisibleSet (Private)
+
+- (DKVisibleSetEntry*)entryForView:(NSView*)aView;
+- (void)updateEntry:(DKVisibleSetEntry*)entry toRect:(NSRect)rect;
+- (void)addObjectsInRect:(NSRect)rect toEntry:(DKVisibleSetEntry*)entry;
+- (void)removeObjectsInRect:(NSRect)rect fromEntry:(DKVisibleSetEntry*)entry;
+- (void)refreshObject:(DKDrawableObject*)obj;
+
+@end
+
+static NSInteger compareStackingOrder(id a, id b, void* context)
+{
+	id<DKObjectStorage> storage = (id<DKObjectStorage>)context;
+	NSUInteger ia = [storage indexOfObject:a];
+	NSUInteger ib = [storage indexOfObject:b];
+
+	if (ia < ib)
+		return NSOrderedAscending;
+	else if (ia > ib)
+		return NSOrderedDescending;
+	else
+		return NSOrderedSame;
+}
+
+@implementation DKLayerVisibleSet
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer
+{
+	self = [super init];
+	if (self) {
+		mLayerRef = layer;
+		mEntries = [[NSMutableArray alloc] init];
+	}
+
+	return self;
+}
+
+- (NSArray*)objectsForUpdateInView:(NSView*)aView
+{
+	DKVisibleSetEntry* entry = [self entryForView:aView];
+
+	[self updateEntry:entry
+			   toRect:[aView visibleRect]];
+
+	NSEnumerator* iter = [[(NSSet*)entry->mObjects allObjects] objectEnumerator];
+	NSMutableArray* objects = [NSMutableArray arrayWithCapacity:CFSetGetCount(entry->mObjects)];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject])) {
+		if ([aView needsToDrawRect:[obj bounds]])
+			[objects addObject:obj];
+	}
+
+	[objects sortUsingFunction:compareStackingOrder
+					   context:[mLayerRef storage]];
+
+	return objects;
+}
+
+- (void)objectWasAdded:(DKDrawableObject*)obj
+{
+	[self refreshObject:obj];
+}
+
+- (void)objectWasRemoved:(DKDrawableObject*)obj
+{
+	NSEnumerator* iter = [mEntries objectEnumerator];
+	DKVisibleSetEntry* entry;
+
+	while ((entry = [iter nextObject]))
+		CFSetRemoveValue(entry->mObjects, obj);
+}
+
+- (void)object:(DKDrawableObject*)obj didChangeBoundsFrom:(NSRect)oldBounds
+{
+#pragma unused(oldBounds)
+
+	[self refreshObject:obj];
+}
+
+- (void)objectDidChangeVisibility:(DKDrawableObject*)obj
+{
+	[self refreshObject:obj];
+}
+
+- (void)invalidate
+{
+	[mEntries removeAllObjects];
+}
+
+#pragma mark -
+
+- (NSUInteger)stripQueries
+{
+	return mStripQueries;
+}
+
+- (NSUInteger)fullQueries
+{
+	return mFullQueries;
+}
+
+#pragma mark -
+
+- (DKVisibleSetEntry*)entryForView:(NSView*)aView
+{
+	NSEnumerator* iter = [mEntries objectEnumerator];
+	DKVisibleSetEntry* entry;
+
+	while ((entry = [iter nextObject])) {
+		if (entry->mViewRef == aView)
+			break;
+	}
+
+	if (entry == nil) {
+		if ([mEntries count] >= kDKLayerVisibleSetMaximumViews)
+			[mEntries removeObjectAtIndex:0];
+
+		entry = [[[DKVisibleSetEntry alloc] init] autorelease];
+		entry->mViewRef = aView;
+		entry->mRect = NSZeroRect;
+	} else {
+		[[entry retain] autorelease];
+		[mEntries removeObjectIdenticalTo:entry];
+	}
+
+	[mEntries addObject:entry];
+	return entry;
+}
+
+- (void)updateEntry:(DKVisibleSetEntry*)entry toRect:(NSRect)rect
+{
+	if (NSEqualRects(entry->mRect, rect))
+		return;
+
+	NSRect oldRect = entry->mRect;
+	NSEnumerator* iter;
+	NSValue* strip;
+
+	entry->mRect = rect;
+
+	if (NSIntersectsRect(oldRect, rect)) {
+		// the strips newly exposed bring their objects in; those in the strips left behind go unless they still reach into view
+
+		iter = [SubtractTwoRects(rect, oldRect) objectEnumerator];
+
+		while ((strip = [iter nextObject])) {
+			[self addObjectsInRect:[strip rectValue]
+						   toEntry:entry];
+			mStripQueries++;
+		}
+
+		iter = [SubtractTwoRects(oldRect, rect) objectEnumerator];
+
+		while ((strip = [iter nextObject])) {
+			[self removeObjectsInRect:[strip rectValue]
+							fromEntry:entry];
+			mStripQueries++;
+		}
+	} else {
+		CFSetRemoveAllValues(entry->mObjects);
+		[self addObjectsInRect:rect
+					   toEntry:entry];
+		mFullQueries++;
+	}
+}
+
+- (void)addObjectsInRect:(NSRect)rect toEntry:(DKVisibleSetEntry*)entry
+{
+	NSEnumerator* iter = [[[mLayerRef storage] objectsIntersectingRect:rect
+																 inView:nil
+																options:kDKZOrderMayBeRelaxed] objectEnumerator];
+	DKDrawableObject* obj;
+
+	[[mLayerRef storageTuner] noteQueryOfRect:rect];
+
+	while ((obj = [iter nextObject]))
+		CFSetAddValue(entry->mObjects, obj);
+}
+
+- (void)removeObjectsInRect:(NSRect)rect fromEntry:(DKVisibleSetEntry*)entry
+{
+	NSEnumerator* iter = [[[mLayerRef storage] objectsIntersectingRect:rect
+																 inView:nil
+																options:kDKZOrderMayBeRelaxed] objectEnumerator];
+	DKDrawableObject* obj;
+
+	[[mLayerRef storageTuner] noteQueryOfRect:rect];
+
+	while ((obj = [iter nextObject])) {
+		if (!NSIntersectsRect([obj bounds], entry->mRect))
+			CFSetRemoveValue(entry->mObjects, obj);
+	}
+}
+
+- (void)refreshObject:(DKDrawableObject*)obj
+{
+	// an object belongs to each set whose rect its bounds touch, if it's visible
+
+	NSEnumerator* iter = [mEntries objectEnumerator];
+	DKVisibleSetEntry* entry;
+	NSRect br = [obj bounds];
+	BOOL visible = [obj visible];
+
+	while ((entry = [iter nextObject])) {
+		if (visible && NSIntersectsRect(br, entry->mRect))
+			CFSetAddValue(entry->mObjects, obj);
+		else
+			CFSetRemoveValue(entry->mObjects, obj);
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mEntries release];
+	[super dealloc];
+}
+
+@end
@@ -7,6 +7,19 @@
 #import <Cocoa/Cocoa.h>
 #import "DKObjectStorageProtocol.h"
 
+/// the bounds and visibility of the objects, kept side by side so that a query can cull several objects at once with vector compares.
+/// Slots beyond the last object hold empty bounds, so a vector never needs to stop short.
+
+typedef struct {
+	float* minX;
+	float* minY;
+	float* maxX;
+	float* maxY;
+	int32_t* visible; // -1 if the object is visible, 0 if not - the same as a vector compare's true
+	NSUInteger capacity; // a multiple of kDKLinearStorageVectorWidth
+	BOOL valid;
+} DKLinearBoundsCache;
+
 /** @brief Basic storage class stores objects in a standard array.
 
 Basic storage class stores objects in a standard array. For many uses this will be entirely adequate, but may be substituted for scalability or
@@ -16,10 +29,46 @@ Basic storage class stores objects in a standard array. For many uses this will
  a brief period (beta 5), the storage was archived. To support files written at that time, this class and its derivatives currently support NSCoding (for reading)
  so that the files can be correctly dearchived. Re-saving the files will update to the new approach. Archiving of the storage isn't curremtly done, and attempting to
  archive will throw an exception.
+
+ Each object records its index, so -indexOfObject: and -containsObject: don't search the array. Changes that shift objects only lower the
+ mark below which the recorded indexes are known to be right; the objects above it are renumbered when an index is next wanted, so a run
+ of changes followed by a run of lookups costs one renumbering. Subclasses that record something else in the objects' indexes must override
+ -indexOfObject: without calling super.
+
+ Rect queries cull the objects from a copy of their bounds, made at the first query and kept up to date as objects are added, removed, moved,
+ resized or hidden, so a query sends -bounds only to the objects it finds. Like the spatial storages, this relies on the storage being told of
+ every bounds change. Subclasses that answer queries themselves never make the copy.
+
+ Nearest-object queries measure every object. The spatial storages answer them from their trees instead.
 */
 @interface DKLinearObjectStorage : NSObject <DKObjectStorage, NSCoding> {
 @private
 	NSMutableArray* mObjects;
+	NSUInteger mFirstUnnumbered; // objects below this index have their index recorded
+	DKLinearBoundsCache mBoundsCache;
 }
 
 @end
+
+/// an object found by a nearest-object query, with its distance from the query point and its Z-order
+
+typedef struct {
+	id<DKStorableObject> object;
+	CGFloat distance;
+	NSUInteger index;
+} DKObjectDistance;
+
+/// the distance from a point to the nearest part of a rect, or 0 if the point is inside it
+
+CGFloat DKObjectStorageDistanceToRect(NSPoint aPoint, NSRect rect);
+
+/// the distance from a point to an object - to its geometry if <options> includes kDKExactDistance and the object can measure it, otherwise to
+/// its bounds
+
+CGFloat DKObjectStorageDistanceToObject(id<DKStorableObject> obj, NSPoint aPoint, DKObjectStorageOptions options);
+
+/// sorts the objects found by a nearest-object query nearest first, topmost first where distances are equal, and returns up to <limit> of them
+
+NSArray* DKObjectStorageNearestObjects(DKObjectDistance* found, NSUInteger count, NSUInteger limit);
+
+#define kDKLinearStorageVectorWidth 4 // objects culled by each vector compare
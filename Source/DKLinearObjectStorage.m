@@ -5,7 +5,177 @@
 */
 
 #import "DKLinearObjectStorage.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
+#import <libkern/OSAtomic.h>
+
+typedef float DKFloatVector __attribute__((ext_vector_type(kDKLinearStorageVectorWidth)));
+typedef int32_t DKIntVector __attribute__((ext_vector_type(kDKLinearStorageVectorWidth)));
+
+NSUInteger DKObjectStorageNextQueryStamp(void)
+{
+	static volatile int64_t sQueryStamp = 0;
+	NSUInteger stamp;
+
+	// skip the stamps that are 0 once truncated to an NSUInteger
+
+	do
+		stamp = (NSUInteger)OSAtomicIncrement64Barrier(&sQueryStamp);
+	while (stamp == 0);
+
+	return stamp;
+}
+
+CGFloat DKObjectStorageDistanceToRect(NSPoint aPoint, NSRect rect)
+{
+	CGFloat dx = MAX(MAX(NSMinX(rect) - aPoint.x, aPoint.x - NSMaxX(rect)), 0);
+	CGFloat dy = MAX(MAX(NSMinY(rect) - aPoint.y, aPoint.y - NSMaxY(rect)), 0);
+
+	return (dx == 0 || dy == 0) ? dx + dy : _CGFloatSqrt(dx * dx + dy * dy);
+}
+
+CGFloat DKObjectStorageDistanceToObject(id<DKStorableObject> obj, NSPoint aPoint, DKObjectStorageOptions options)
+{
+	if ((options & kDKExactDistance) && [obj respondsToSelector:@selector(distanceFromPoint:)])
+		return [obj distanceFromPoint:aPoint];
+
+	return DKObjectStorageDistanceToRect(aPoint, [obj bounds]);
+}
+
+static int compareObjectDistances(const void* a, const void* b)
+{
+	const DKObjectDistance* da = (const DKObjectDistance*)a;
+	const DKObjectDistance* db = (const DKObjectDistance*)b;
+
+	if (da->distance != db->distance)
+		return (da->distance < db->distance) ? -1 : 1;
+
+	// topmost first
+
+	return (da->index > db->index) ? -1 : ((da->index < db->index) ? 1 : 0);
+}
+
+NSArray* DKObjectStorageNearestObjects(DKObjectDistance* found, NSUInteger count, NSUInteger limit)
+{
+	NSUInteger i, n = MIN(count, limit);
+	NSMutableArray* results = [NSMutableArray arrayWithCapacity:n];
+
+	qsort(found, count, sizeof(DKObjectDistance), compareObjectDistances);
+
+	for (i = 0; i < n; ++i)
+		[results addObject:found[i].object];
+
+	return results;
+}
+
+@interface DKLinearObjectStorage (Private)
+
+- (void)invalidateIndexesFromIndex:(NSUInteger)indx;
+- (void)renumberObjects;
+- (void)loadBoundsCache;
+- (NSArray*)objectsNearPoint:(NSPoint)aPoint count:(NSUInteger)count withinDistance:(CGFloat)distance options:(DKObjectStorageOptions)options;
+
+@end
+
+static void renumberObjectsInRange(NSArray* objects, NSUInteger first, NSUInteger last)
+{
+	NSUInteger i;
+
+	for (i = first; i <= last; ++i)
+		[(id<DKStorableObject>)[objects objectAtIndex:i] setIndex:i];
+}
+
+#pragma mark -
+
+// the cached bounds are rounded outwards to floats, so the cull never misses an object that NSIntersectsRect would find
+
+static inline float floatBelow(CGFloat v)
+{
+	float f = (float)v;
+	return (f > v) ? nextafterf(f, -INFINITY) : f;
+}
+
+static inline float floatAbove(CGFloat v)
+{
+	float f = (float)v;
+	return (f < v) ? nextafterf(f, INFINITY) : f;
+}
+
+static void setCachedBounds(DKLinearBoundsCache* cache, NSUInteger i, id<DKStorableObject> obj)
+{
+	NSRect r = [obj bounds];
+
+	cache->minX[i] = floatBelow(NSMinX(r));
+	cache->minY[i] = floatBelow(NSMinY(r));
+	cache->maxX[i] = floatAbove(NSMaxX(r));
+	cache->maxY[i] = floatAbove(NSMaxY(r));
+	cache->visible[i] = [obj visible] ? -1 : 0;
+}
+
+static void clearCachedBounds(DKLinearBoundsCache* cache, NSUInteger first, NSUInteger end)
+{
+	NSUInteger i;
+
+	for (i = first; i < end; ++i) {
+		cache->minX[i] = cache->minY[i] = INFINITY;
+		cache->maxX[i] = cache->maxY[i] = -INFINITY;
+		cache->visible[i] = 0;
+	}
+}
+
+static void reserveCachedBounds(DKLinearBoundsCache* cache, NSUInteger count)
+{
+	if (count <= cache->capacity)
+		return;
+
+	NSUInteger old = cache->capacity;
+	NSUInteger capacity = MAX(count, old * 2);
+
+	capacity = (capacity + kDKLinearStorageVectorWidth - 1) & ~(NSUInteger)(kDKLinearStorageVectorWidth - 1);
+
+	// malloc's blocks are aligned for vectors, and each vector starts at a multiple of the width
+
+	cache->minX = realloc(cache->minX, capacity * sizeof(float));
+	cache->minY = realloc(cache->minY, capacity * sizeof(float));
+	cache->maxX = realloc(cache->maxX, capacity * sizeof(float));
+	cache->maxY = realloc(cache->maxY, capacity * sizeof(float));
+	cache->visible = realloc(cache->visible, capacity * sizeof(int32_t));
+	cache->capacity = capacity;
+
+	clearCachedBounds(cache, old, capacity);
+}
+
+static void moveCachedBounds(DKLinearBoundsCache* cache, NSUInteger from, NSUInteger to, NSUInteger count)
+{
+	memmove(&cache->minX[to], &cache->minX[from], count * sizeof(float));
+	memmove(&cache->minY[to], &cache->minY[from], count * sizeof(float));
+	memmove(&cache->maxX[to], &cache->maxX[from], count * sizeof(float));
+	memmove(&cache->maxY[to], &cache->maxY[from], count * sizeof(float));
+	memmove(&cache->visible[to], &cache->visible[from], count * sizeof(int32_t));
+}
+
+static void freeCachedBounds(DKLinearBoundsCache* cache)
+{
+	free(cache->minX);
+	free(cache->minY);
+	free(cache->maxX);
+	free(cache->maxY);
+	free(cache->visible);
+	memset(cache, 0, sizeof(DKLinearBoundsCache));
+}
+
+static inline BOOL anyLaneSet(DKIntVector v)
+{
+	NSUInteger lane;
+
+	for (lane = 0; lane < kDKLinearStorageVectorWidth; ++lane) {
+		if (v[lane])
+			return YES;
+	}
+
+	return NO;
+}
+
+#pragma mark -
 
 @implementation DKLinearObjectStorage
 
@@ -16,29 +186,86 @@
 	NSMutableArray* temp = [NSMutableArray array];
 	NSEnumerator* iter;
 	id<DKStorableObject> obj;
-	NSRect bounds;
+	NSRect cullRect = aRect;
+	BOOL cull = (options & kDKIgnoreUpdateRect) == 0;
+	BOOL askView = cull && aView != nil;
 
-	if (options & kDKReverseOrder)
-		iter = [[self objects] reverseObjectEnumerator];
-	else
-		iter = [[self objects] objectEnumerator];
+	// if a view was passed, objects are culled by the area it's drawing, then each is tested with -needsToDrawRect:
 
-	while ((obj = [iter nextObject])) {
-		if ((options & kDKIncludeInvisible) || [obj visible]) {
-			if (options & kDKIgnoreUpdateRect)
-				[temp addObject:obj];
-			else {
-				bounds = [obj bounds];
+	if (askView) {
+		const NSRect* rects;
+		NSInteger i, count = 0;
 
-				// if a view was passed, use -needsToDrawRect, otherwise intersection with <rect>
+		[aView getRectsBeingDrawn:&rects
+							count:&count];
 
-				if (aView) {
-					if ([aView needsToDrawRect:bounds])
-						[temp addObject:obj];
-				} else if (NSIntersectsRect(bounds, aRect))
+		if (count > 0) {
+			cullRect = rects[0];
+
+			for (i = 1; i < count; ++i)
+				cullRect = NSUnionRect(cullRect, rects[i]);
+		} else
+			cull = NO;
+	}
+
+	if (!cull) {
+		if (options & kDKReverseOrder)
+			iter = [[self objects] reverseObjectEnumerator];
+		else
+			iter = [[self objects] objectEnumerator];
+
+		while ((obj = [iter nextObject])) {
+			if ((options & kDKIncludeInvisible) || [obj visible]) {
+				if (!askView || [aView needsToDrawRect:[obj bounds]])
 					[temp addObject:obj];
 			}
 		}
+
+		return temp;
+	}
+
+	if (!mBoundsCache.valid)
+		[self loadBoundsCache];
+
+	// a vector of objects at a time is compared with the cull rect, and only those that pass are sent -bounds for the exact test
+
+	NSUInteger count = [mObjects count];
+	NSUInteger v, vectors = (count + kDKLinearStorageVectorWidth - 1) / kDKLinearStorageVectorWidth;
+	NSUInteger lane, base, indx;
+	BOOL reverse = (options & kDKReverseOrder) != 0;
+	DKFloatVector qMinX = floatBelow(NSMinX(cullRect));
+	DKFloatVector qMinY = floatBelow(NSMinY(cullRect));
+	DKFloatVector qMaxX = floatAbove(NSMaxX(cullRect));
+	DKFloatVector qMaxY = floatAbove(NSMaxY(cullRect));
+	NSRect bounds;
+
+	for (v = 0; v < vectors; ++v) {
+		base = (reverse ? vectors - 1 - v : v) * kDKLinearStorageVectorWidth;
+
+		DKIntVector hits = (*(DKFloatVector*)&mBoundsCache.minX[base] <= qMaxX) & (*(DKFloatVector*)&mBoundsCache.maxX[base] >= qMinX)
+			& (*(DKFloatVector*)&mBoundsCache.minY[base] <= qMaxY) & (*(DKFloatVector*)&mBoundsCache.maxY[base] >= qMinY);
+
+		if ((options & kDKIncludeInvisible) == 0)
+			hits &= *(DKIntVector*)&mBoundsCache.visible[base];
+
+		if (!anyLaneSet(hits))
+			continue;
+
+		for (lane = 0; lane < kDKLinearStorageVectorWidth; ++lane) {
+			indx = base + (reverse ? kDKLinearStorageVectorWidth - 1 - lane : lane);
+
+			if (indx >= count || !hits[indx - base])
+				continue;
+
+			obj = [mObjects objectAtIndex:indx];
+			bounds = [obj bounds];
+
+			if (askView) {
+				if ([aView needsToDrawRect:bounds])
+					[temp addObject:obj];
+			} else if (NSIntersectsRect(bounds, aRect))
+				[temp addObject:obj];
+		}
 	}
 
 	return temp;
@@ -54,12 +281,14 @@
 
 - (void)setObjects:(NSArray*)objects
 {
-	LogEvent_(kReactiveEvent, @"storage setting %d objects %@", [objects count], self);
+	DKTrace_(kDKTraceReactive, @"storage setting %d objects %@", [objects count], self);
 
 	[objects retain];
 	[mObjects release];
 	mObjects = [objects mutableCopy];
 	[objects release];
+	mFirstUnnumbered = 0;
+	mBoundsCache.valid = NO;
 
 	[mObjects makeObjectsPerformSelector:@selector(setStorage:)
 							  withObject:self];
@@ -91,10 +320,19 @@
 {
 	NSAssert(obj != nil, @"attempt to add a nil object to the storage");
 
-	if (![[self objects] containsObject:obj]) {
+	if (![self containsObject:obj]) {
 		[mObjects insertObject:obj
 					   atIndex:indx];
 		[obj setStorage:self];
+		[self invalidateIndexesFromIndex:indx];
+
+		if (mBoundsCache.valid) {
+			NSUInteger count = [mObjects count];
+
+			reserveCachedBounds(&mBoundsCache, count);
+			moveCachedBounds(&mBoundsCache, indx, indx + 1, count - 1 - indx);
+			setCachedBounds(&mBoundsCache, indx, obj);
+		}
 	}
 }
 
@@ -105,6 +343,14 @@
 	id<DKStorableObject> obj = [mObjects objectAtIndex:indx];
 	[obj setStorage:nil];
 	[mObjects removeObjectAtIndex:indx];
+	[self invalidateIndexesFromIndex:indx];
+
+	if (mBoundsCache.valid) {
+		NSUInteger count = [mObjects count];
+
+		moveCachedBounds(&mBoundsCache, indx + 1, indx, count - indx);
+		clearCachedBounds(&mBoundsCache, count, count + 1);
+	}
 }
 
 - (void)replaceObjectInObjectsAtIndex:(NSUInteger)indx withObject:(id<DKStorableObject>)obj
@@ -117,6 +363,12 @@
 	[mObjects replaceObjectAtIndex:indx
 						withObject:obj];
 	[obj setStorage:self];
+
+	if (indx < mFirstUnnumbered)
+		[obj setIndex:indx];
+
+	if (mBoundsCache.valid)
+		setCachedBounds(&mBoundsCache, indx, obj);
 }
 
 - (void)insertObjects:(NSArray*)objs atIndexes:(NSIndexSet*)set
@@ -130,6 +382,11 @@
 							  withObject:self];
 		[mObjects insertObjects:objs
 					  atIndexes:set];
+		[self invalidateIndexesFromIndex:[set firstIndex]];
+
+		// scattered insertions shift the rest many times over, so the bounds are copied again at the next query
+
+		mBoundsCache.valid = NO;
 	}
 }
 
@@ -144,17 +401,35 @@
 		[objs makeObjectsPerformSelector:@selector(setStorage:)
 							  withObject:nil];
 		[mObjects removeObjectsAtIndexes:set];
+		[self invalidateIndexesFromIndex:[set firstIndex]];
+		mBoundsCache.valid = NO;
 	}
 }
 
 - (BOOL)containsObject:(id<DKStorableObject>)object
 {
-	return [mObjects containsObject:object];
+	return [object storage] == self;
 }
 
 - (NSUInteger)indexOfObject:(id<DKStorableObject>)object
 {
-	return [[self objects] indexOfObjectIdenticalTo:object];
+	if ([object storage] != self)
+		return NSNotFound;
+
+	NSUInteger indx = [object index];
+
+	if (indx < mFirstUnnumbered && [mObjects objectAtIndex:indx] == object)
+		return indx;
+
+	[self renumberObjects];
+	indx = [object index];
+
+	// an object that claims this storage but isn't in it has an index left over from before
+
+	if (indx >= [mObjects count] || [mObjects objectAtIndex:indx] != object)
+		return NSNotFound;
+
+	return indx;
 }
 
 - (void)moveObject:(id<DKStorableObject>)obj toIndex:(NSUInteger)indx
@@ -168,26 +443,53 @@
 
 	if (old != indx) {
 		[obj retain];
-		[mObjects removeObject:obj];
+		[mObjects removeObjectAtIndex:old];
 		[mObjects insertObject:obj
 					   atIndex:indx];
 		[obj release];
+
+		// only the objects between the two positions have moved, so they're renumbered now if those above are still right - reordering
+		// a selection then never renumbers the whole array
+
+		if (MAX(old, indx) < mFirstUnnumbered)
+			renumberObjectsInRange(mObjects, MIN(old, indx), MAX(old, indx));
+		else
+			[self invalidateIndexesFromIndex:MIN(old, indx)];
+
+		if (mBoundsCache.valid) {
+			if (old < indx)
+				moveCachedBounds(&mBoundsCache, old + 1, old, indx - old);
+			else
+				moveCachedBounds(&mBoundsCache, indx, indx + 1, old - indx);
+
+			setCachedBounds(&mBoundsCache, indx, obj);
+		}
 	}
 }
 
 - (void)object:(id<DKStorableObject>)obj didChangeBoundsFrom:(NSRect)oldBounds
 {
-#pragma unused(obj, oldBounds)
+#pragma unused(oldBounds)
+
+	// other spatially-partitioned storage may override this to re-store the object when it is resized or moved. Linear storage
+	// only updates the bounds it culls queries with
 
-	// linear storage does't care about an object's bounds, but other spatially-partitioned storage may do. This method
-	// can be used to re-store the object when it is resized or moved
+	if (mBoundsCache.valid) {
+		NSUInteger indx = [self indexOfObject:obj];
 
-	//NSLog(@"bounds change from: %@, old = %@, new = %@", obj, NSStringFromRect( oldBounds ), NSStringFromRect([obj bounds]));
+		if (indx != NSNotFound)
+			setCachedBounds(&mBoundsCache, indx, obj);
+	}
 }
 
 - (void)objectDidChangeVisibility:(id<DKStorableObject>)obj
 {
-#pragma unused(obj)
+	if (mBoundsCache.valid) {
+		NSUInteger indx = [self indexOfObject:obj];
+
+		if (indx != NSNotFound)
+			setCachedBounds(&mBoundsCache, indx, obj);
+	}
 }
 
 - (void)setCanvasSize:(NSSize)size
@@ -195,6 +497,99 @@
 #pragma unused(size)
 }
 
+- (NSArray*)objectsNearestPoint:(NSPoint)aPoint count:(NSUInteger)count options:(DKObjectStorageOptions)options
+{
+	return [self objectsNearPoint:aPoint
+							count:count
+				   withinDistance:CGFLOAT_MAX
+						  options:options];
+}
+
+- (NSArray*)objectsWithinDistance:(CGFloat)distance ofPoint:(NSPoint)aPoint options:(DKObjectStorageOptions)options
+{
+	return [self objectsNearPoint:aPoint
+							count:NSUIntegerMax
+				   withinDistance:distance
+						  options:options];
+}
+
+#pragma mark -
+#pragma mark - private
+
+- (void)invalidateIndexesFromIndex:(NSUInteger)indx
+{
+	mFirstUnnumbered = MIN(mFirstUnnumbered, indx);
+}
+
+- (void)renumberObjects
+{
+	NSUInteger count = [mObjects count];
+
+	if (mFirstUnnumbered < count)
+		renumberObjectsInRange(mObjects, mFirstUnnumbered, count - 1);
+
+	mFirstUnnumbered = count;
+}
+
+- (void)loadBoundsCache
+{
+	NSUInteger i, count = [mObjects count];
+
+	reserveCachedBounds(&mBoundsCache, count);
+
+	for (i = 0; i < count; ++i)
+		setCachedBounds(&mBoundsCache, i, [mObjects objectAtIndex:i]);
+
+	clearCachedBounds(&mBoundsCache, count, mBoundsCache.capacity);
+	mBoundsCache.valid = YES;
+}
+
+- (NSArray*)objectsNearPoint:(NSPoint)aPoint count:(NSUInteger)count withinDistance:(CGFloat)distance options:(DKObjectStorageOptions)options
+{
+	// measures every object. The exact distance is never less than the distance to the bounds, so objects whose bounds are too far away
+	// aren't measured exactly
+
+	NSUInteger i, n = [mObjects count], found = 0;
+
+	if (count == 0 || n == 0)
+		return [NSArray array];
+
+	DKObjectDistance* candidates = malloc(sizeof(DKObjectDistance) * n);
+	id<DKStorableObject> obj;
+	CGFloat d;
+
+	@try {
+		for (i = 0; i < n; ++i) {
+			obj = [mObjects objectAtIndex:i];
+
+			if ((options & kDKIncludeInvisible) == 0 && ![obj visible])
+				continue;
+
+			d = DKObjectStorageDistanceToRect(aPoint, [obj bounds]);
+
+			if (d > distance)
+				continue;
+
+			if (options & kDKExactDistance) {
+				d = DKObjectStorageDistanceToObject(obj, aPoint, options);
+
+				if (d > distance)
+					continue;
+			}
+
+			candidates[found].object = obj;
+			candidates[found].distance = d;
+			candidates[found].index = i;
+			++found;
+		}
+
+		return DKObjectStorageNearestObjects(candidates, found, count);
+	}
+	@finally {
+		free(candidates);
+	}
+}
+
 #pragma mark -
 #pragma mark - as implementor of the NSCoding protocol
 
@@ -236,6 +631,7 @@
 	[[self objects] makeObjectsPerformSelector:@selector(setStorage:)
 									withObject:nil];
 	[mObjects release];
+	freeCachedBounds(&mBoundsCache);
 	[super dealloc];
 }
 
@@ -0,0 +1,73 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/// what the memory of a drawing is used for
+
+typedef enum {
+	kDKFootprintObjects = 0, // the drawable objects themselves - their instance variables, and the text of text objects
+	kDKFootprintPaths = 1, // path elements, including the flattened and simplified forms kept with them
+	kDKFootprintMetadata = 2, // the metadata and other user info of objects and layers, and the metadata index
+	kDKFootprintRenderCaches = 3, // rendered tiles, layer and group bitmaps, cached object images, shadows and the thumbnail
+	kDKFootprintSwatchCaches = 4, // style swatches
+	kDKFootprintTextCaches = 5, // laid out text and glyph outlines
+	kDKFootprintResidentImages = 6, // image data on the heap, and decoded image proxies
+	kDKFootprintMappedImages = 7, // image data in memory-mapped files, whose pages the system can drop and reread
+	kDKFootprintUndo = 8, // the undo and redo stacks
+	kDKFootprintCategoryCount = 9
+} DKFootprintCategory;
+
+/** @brief An estimate of the memory used by a drawing or a layer, by what it's used for.
+
+ An estimate of the memory used by a drawing or a layer, by what it's used for. A report is made by -[DKLayer memoryFootprint], which covers
+ the layer and, for an object owner layer, its objects; a layer group adds up its layers, and a drawing adds its own caches, images and undo
+ stacks. The caches shared by every drawing - swatches, shadows and glyph outlines - are included in each drawing's report.
+
+ The figures are approximate: objects count the size of their instance variables, paths allow for the points of a curve per element, and
+ collections for their contents, as -undoCost does. Objects sharing a path or an image are each charged for it. Making a report visits each
+ object once and allocates nothing per object, so it is cheap enough to sample from production telemetry; -dictionary gives the figures
+ keyed by name, for logging.
+*/
+@interface DKMemoryFootprint : NSObject {
+@private
+	NSUInteger mBytes[kDKFootprintCategoryCount];
+	NSUInteger mObjectCount;
+}
+
+/** @brief The name of a category, as used for the keys of -dictionary
+ @param category the category
+ @return the name, e.g. @"paths"
+ */
++ (NSString*)nameOfCategory:(DKFootprintCategory)category;
+
+- (void)addBytes:(NSUInteger)bytes toCategory:(DKFootprintCategory)category;
+- (NSUInteger)bytesInCategory:(DKFootprintCategory)category;
+- (NSUInteger)totalBytes;
+
+/** @brief Counts a drawable object, whose own bytes are added to kDKFootprintObjects separately
+ */
+- (void)addObject;
+- (NSUInteger)objectCount;
+
+/** @brief The mean size of an object, without its paths, metadata or caches
+ @return kDKFootprintObjects bytes per object, or 0 if there are no objects
+ */
+- (NSUInteger)averageObjectSize;
+
+/** @brief Adds the figures of another report to this one
+ @param footprint the other report
+ */
+- (void)addFootprint:(DKMemoryFootprint*)footprint;
+
+/** @brief The figures as a dictionary, for telemetry
+
+ Each category's bytes are keyed by its name, and there are also @"total", @"objectCount" and @"averageObjectSize".
+ @return a dictionary of NSNumbers
+ */
+- (NSDictionary*)dictionary;
+
+@end
@@ -0,0 +1,99 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKMemoryFootprint.h"
+
+static NSString* const sCategoryNames[kDKFootprintCategoryCount] = { @"objects", @"paths", @"metadata", @"renderCaches", @"swatchCaches", @"textCaches", @"residentImages", @"mappedImages", @"undo" };
+
+@implementation DKMemoryFootprint
+
++ (NSString*)nameOfCategory:(DKFootprintCategory)category
+{
+	NSAssert(category < kDKFootprintCategoryCount, @"invalid footprint category");
+
+	return sCategoryNames[category];
+}
+
+- (void)addBytes:(NSUInteger)bytes toCategory:(DKFootprintCategory)category
+{
+	NSAssert(category < kDKFootprintCategoryCount, @"invalid footprint category");
+
+	mBytes[category] += bytes;
+}
+
+- (NSUInteger)bytesInCategory:(DKFootprintCategory)category
+{
+	NSAssert(category < kDKFootprintCategoryCount, @"invalid footprint category");
+
+	return mBytes[category];
+}
+
+- (NSUInteger)totalBytes
+{
+	NSUInteger i, total = 0;
+
+	for (i = 0; i < kDKFootprintCategoryCount; ++i)
+		total += mBytes[i];
+
+	return total;
+}
+
+- (void)addObject
+{
+	++mObjectCount;
+}
+
+- (NSUInteger)objectCount
+{
+	return mObjectCount;
+}
+
+- (NSUInteger)averageObjectSize
+{
+	if (mObjectCount == 0)
+		return 0;
+
+	return mBytes[kDKFootprintObjects] / mObjectCount;
+}
+
+- (void)addFootprint:(DKMemoryFootprint*)footprint
+{
+	NSUInteger i;
+
+	for (i = 0; i < kDKFootprintCategoryCount; ++i)
+		mBytes[i] += footprint->mBytes[i];
+
+	mObjectCount += footprint->mObjectCount;
+}
+
+- (NSDictionary*)dictionary
+{
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:kDKFootprintCategoryCount + 3];
+	NSUInteger i;
+
+	for (i = 0; i < kDKFootprintCategoryCount; ++i)
+		[dict setObject:[NSNumber numberWithUnsignedInteger:mBytes[i]]
+				 forKey:sCategoryNames[i]];
+
+	[dict setObject:[NSNumber numberWithUnsignedInteger:[self totalBytes]]
+			 forKey:@"total"];
+	[dict setObject:[NSNumber numberWithUnsignedInteger:mObjectCount]
+			 forKey:@"objectCount"];
+	[dict setObject:[NSNumber numberWithUnsignedInteger:[self averageObjectSize]]
+			 forKey:@"averageObjectSize"];
+
+	return dict;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> %lu bytes, %lu objects: %@", NSStringFromClass([self class]), self, (unsigned long)[self totalBytes], (unsigned long)mObjectCount, [self dictionary]];
+}
+
+@end
@@ -0,0 +1,102 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawing, DKDrawableObject;
+
+/** @brief Indexes the objects of a drawing by the values of chosen metadata keys.
+
+ Indexes the objects of a drawing by the values of chosen metadata keys, so that finding the objects with a given value doesn't mean reading
+ the metadata of every object in the drawing. For each key there is a hash index from each value to the objects that have it, and for range
+ queries a sorted list of the values, made when first needed and discarded when a value is added or goes away. Numbers and strings can be
+ queried by range; any value that can be copied can be queried for equality.
+
+ Only the objects owned directly by the drawing's object owner layers are indexed, and only by the metadata they have themselves - values
+ that would be found by searching the containment hierarchy are not included. The index is kept up to date as objects are added to and
+ removed from layers and as their metadata changes; adding or removing layers, or replacing all of a layer's objects (which is how a
+ layer's objects are loaded), means it is rebuilt the next time it is used. The objects of layers that haven't been loaded yet are not indexed.
+
+ The index is owned by the drawing, and is only created if the drawing's setIndexedMetadataKeys: is given some keys.
+*/
+@interface DKMetadataIndex : NSObject {
+@private
+	DKDrawing* mDrawingRef;
+	NSArray* mKeys; // lowercase, as metadata keys are
+	NSMutableDictionary* mBuckets; // key -> (value -> set of objects)
+	NSMutableDictionary* mSortedNumbers; // key -> sorted number values, made on demand
+	NSMutableDictionary* mSortedStrings; // key -> sorted string values, made on demand
+	CFMutableDictionaryRef mEntries; // object -> (key -> the value it is indexed under)
+	BOOL mNeedsRebuild;
+}
+
+/** @brief Finds the objects in some layers whose metadata has a value or lies in a range, without an index
+
+ This is what the drawing does for keys that it doesn't index, and gives the same results as the index would.
+ @param layers the object owner layers to search
+ @param value the value to find, or nil to find by range
+ @param low the lowest value to find, inclusive, or nil for no lower limit
+ @param high the highest value to find, inclusive, or nil for no upper limit
+ @param key the metadata key
+ @return the objects found, in layer and stacking order
+ */
++ (NSArray*)objectsInLayers:(NSArray*)layers withValue:(id)value orValuesFrom:(id)low to:(id)high forKey:(NSString*)key;
+
+/** @brief The value an object is indexed under for a key
+ @param obj the object
+ @param key the metadata key
+ @return the value of the object's own metadata for the key, or nil
+ */
++ (id)indexedValueOfObject:(DKDrawableObject*)obj forKey:(NSString*)key;
+
+- (id)initWithDrawing:(DKDrawing*)drawing keys:(NSArray*)keys;
+
+- (DKDrawing*)drawing;
+- (void)setDrawing:(DKDrawing*)drawing;
+- (NSArray*)indexedKeys;
+- (BOOL)indexesKey:(NSString*)key;
+
+/** @brief Adds an object and its metadata to the index
+
+ Called when an object is added to a layer of the drawing.
+ @param obj the object
+ */
+- (void)addObject:(DKDrawableObject*)obj;
+- (void)removeObject:(DKDrawableObject*)obj;
+
+/** @brief Updates the index after an object's metadata has changed
+ @param obj the object
+ @param key the key that changed, or nil if any of them may have
+ */
+- (void)objectDidChangeMetadata:(DKDrawableObject*)obj forKey:(NSString*)key;
+
+/** @brief Discards the index so that it is rebuilt the next time it is used
+ */
+- (void)invalidate;
+
+/** @brief Returns the objects whose metadata has a value for an indexed key
+ @param value the value
+ @param key the key, which must be indexed
+ @return a set of the objects
+ */
+- (NSSet*)objectsWithValue:(id)value forKey:(NSString*)key;
+
+/** @brief Returns the objects whose metadata for an indexed key lies in an inclusive range
+
+ The bounds give the kind of value found: if they are numbers, only number values are found, and if they are strings, only strings.
+ Strings are ordered by compare:.
+ @param low the lowest value, or nil for no lower limit
+ @param high the highest value, or nil for no upper limit
+ @param key the key, which must be indexed
+ @return a set of the objects
+ */
+- (NSSet*)objectsWithValuesFrom:(id)low to:(id)high forKey:(NSString*)key;
+
+/** @brief The number of objects in the index, for testing and diagnostics
+ */
+- (NSUInteger)objectCount;
+
+@end
@@ -0,0 +1,467 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKMetadataIndex.h"
+#import "DKDrawing.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawableObject+Metadata.h"
+#import "DKMetadataStore.h"
+#import "LogEvent.h"
+
+@interface DKMetadataIndex (Private)
+
+- (void)rebuildIfNeeded;
+- (void)addEntriesForObject:(DKDrawableObject*)obj keys:(NSArray*)keys;
+- (void)removeEntriesForObject:(DKDrawableObject*)obj keys:(NSArray*)keys;
+- (NSArray*)sortedValuesForKey:(NSString*)key likeValue:(id)bound;
+- (void)layersDidChange:(NSNotification*)note;
+
+@end
+
+// values are only ordered against values of the same kind, as compare: raises for a number and a string
+
+static BOOL isRangeValue(id value)
+{
+	return [value isKindOfClass:[NSNumber class]] || [value isKindOfClass:[NSString class]];
+}
+
+static BOOL isSameKindOfValue(id value, id bound)
+{
+	if ([bound isKindOfClass:[NSNumber class]])
+		return [value isKindOfClass:[NSNumber class]];
+	else if ([bound isKindOfClass:[NSString class]])
+		return [value isKindOfClass:[NSString class]];
+	else
+		return NO;
+}
+
+static BOOL valueIsInRange(id value, id low, id high)
+{
+	if (low == nil && high == nil)
+		return isRangeValue(value);
+
+	if (low && (!isSameKindOfValue(value, low) || [value compare:low] == NSOrderedAscending))
+		return NO;
+
+	if (high && (!isSameKindOfValue(value, high) || [value compare:high] == NSOrderedDescending))
+		return NO;
+
+	return YES;
+}
+
+static NSInteger compareValues(id a, id b, void* context)
+{
+#pragma unused(context)
+	return [a compare:b];
+}
+
+// the index of the first value in the sorted array not less than <value> or, if <after> is YES, greater than it
+
+static NSUInteger boundIndex(NSArray* values, id value, BOOL after)
+{
+	NSUInteger lo = 0, hi = [values count];
+
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+		NSComparisonResult order = [[values objectAtIndex:mid] compare:value];
+
+		if (order == NSOrderedAscending || (after && order == NSOrderedSame))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+#pragma mark -
+
+@implementation DKMetadataIndex
+#pragma mark As a DKMetadataIndex
+
++ (NSArray*)objectsInLayers:(NSArray*)layers withValue:(id)value orValuesFrom:(id)low to:(id)high forKey:(NSString*)key
+{
+	NSMutableArray* found = [NSMutableArray array];
+	NSEnumerator* iter = [layers objectEnumerator];
+	DKObjectOwnerLayer* layer;
+
+	key = [key lowercaseString];
+
+	while ((layer = [iter nextObject])) {
+		if ([layer hasPendingObjects])
+			continue;
+
+		NSEnumerator* objIter = [[layer objects] objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [objIter nextObject])) {
+			id objValue = [self indexedValueOfObject:obj
+											  forKey:key];
+
+			if (objValue == nil)
+				continue;
+
+			if (value ? [objValue isEqual:value] : valueIsInRange(objValue, low, high))
+				[found addObject:obj];
+		}
+	}
+
+	return found;
+}
+
++ (id)indexedValueOfObject:(DKDrawableObject*)obj forKey:(NSString*)key
+{
+	// the store gives the value without making an item for values held inline
+
+	NSDictionary* metadata = [obj metadata];
+
+	if ([metadata isKindOfClass:[DKMetadataStore class]])
+		return [(DKMetadataStore*)metadata metadataValueForKey:key];
+
+	return [(DKMetadataItem*)[metadata objectForKey:key] value];
+}
+
+- (id)initWithDrawing:(DKDrawing*)drawing keys:(NSArray*)keys
+{
+	self = [super init];
+	if (self) {
+		NSMutableArray* lowercaseKeys = [NSMutableArray array];
+		NSEnumerator* iter = [keys objectEnumerator];
+		NSString* key;
+
+		while ((key = [iter nextObject])) {
+			key = [key lowercaseString];
+
+			if (![lowercaseKeys containsObject:key])
+				[lowercaseKeys addObject:key];
+		}
+
+		mKeys = [lowercaseKeys copy];
+		mBuckets = [[NSMutableDictionary alloc] init];
+		mSortedNumbers = [[NSMutableDictionary alloc] init];
+		mSortedStrings = [[NSMutableDictionary alloc] init];
+
+		// drawable objects are compared by identity, and are retained until they are removed
+
+		CFDictionaryKeyCallBacks callbacks = kCFTypeDictionaryKeyCallBacks;
+		callbacks.equal = NULL;
+		callbacks.hash = NULL;
+
+		mEntries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &callbacks, &kCFTypeDictionaryValueCallBacks);
+		mNeedsRebuild = YES;
+
+		[self setDrawing:drawing];
+	}
+
+	return self;
+}
+
+- (DKDrawing*)drawing
+{
+	return mDrawingRef;
+}
+
+- (void)setDrawing:(DKDrawing*)drawing
+{
+	if (drawing != mDrawingRef) {
+		[[NSNotificationCenter defaultCenter] removeObserver:self];
+
+		mDrawingRef = drawing;
+		[self invalidate];
+
+		// layers can be added and removed anywhere in the drawing's tree of groups, so the object is checked when notified
+
+		if (drawing)
+			[[NSNotificationCenter defaultCenter] addObserver:self
+													 selector:@selector(layersDidChange:)
+														 name:kDKLayerGroupNumberOfLayersDidChange
+													   object:nil];
+	}
+}
+
+- (NSArray*)indexedKeys
+{
+	return mKeys;
+}
+
+- (BOOL)indexesKey:(NSString*)key
+{
+	return key && [mKeys containsObject:[key lowercaseString]];
+}
+
+- (void)addObject:(DKDrawableObject*)obj
+{
+	if (mNeedsRebuild || obj == nil || CFDictionaryContainsKey(mEntries, obj))
+		return;
+
+	NSMutableDictionary* entry = [[NSMutableDictionary alloc] init];
+
+	CFDictionarySetValue(mEntries, obj, entry);
+	[entry release];
+
+	[self addEntriesForObject:obj
+						 keys:mKeys];
+}
+
+- (void)removeObject:(DKDrawableObject*)obj
+{
+	if (mNeedsRebuild || obj == nil || !CFDictionaryContainsKey(mEntries, obj))
+		return;
+
+	[self removeEntriesForObject:obj
+							keys:mKeys];
+	CFDictionaryRemoveValue(mEntries, obj);
+}
+
+- (void)objectDidChangeMetadata:(DKDrawableObject*)obj forKey:(NSString*)key
+{
+	// objects that aren't in the index, such as those in groups, are ignored
+
+	if (mNeedsRebuild || obj == nil || !CFDictionaryContainsKey(mEntries, obj))
+		return;
+
+	NSArray* keys = mKeys;
+
+	if (key) {
+		key = [key lowercaseString];
+
+		if (![mKeys containsObject:key])
+			return;
+
+		keys = [NSArray arrayWithObject:key];
+	}
+
+	// the old values come from the object's entry rather than the metadata, which has already changed
+
+	[self removeEntriesForObject:obj
+							keys:keys];
+	[self addEntriesForObject:obj
+						 keys:keys];
+}
+
+- (void)invalidate
+{
+	mNeedsRebuild = YES;
+
+	CFDictionaryRemoveAllValues(mEntries);
+	[mBuckets removeAllObjects];
+	[mSortedNumbers removeAllObjects];
+	[mSortedStrings removeAllObjects];
+}
+
+- (NSSet*)objectsWithValue:(id)value forKey:(NSString*)key
+{
+	NSAssert([self indexesKey:key], @"querying the metadata index for a key that isn't indexed");
+
+	[self rebuildIfNeeded];
+
+	NSSet* objects = nil;
+
+	if (value)
+		objects = [[mBuckets objectForKey:[key lowercaseString]] objectForKey:value];
+
+	return objects ? [[objects copy] autorelease] : [NSSet set];
+}
+
+- (NSSet*)objectsWithValuesFrom:(id)low to:(id)high forKey:(NSString*)key
+{
+	NSAssert([self indexesKey:key], @"querying the metadata index for a key that isn't indexed");
+
+	[self rebuildIfNeeded];
+
+	key = [key lowercaseString];
+
+	NSDictionary* buckets = [mBuckets objectForKey:key];
+	NSMutableSet* found = [NSMutableSet set];
+
+	if (buckets == nil)
+		return found;
+
+	if (low == nil && high == nil) {
+		NSEnumerator* iter = [buckets keyEnumerator];
+		id value;
+
+		while ((value = [iter nextObject])) {
+			if (isRangeValue(value))
+				[found unionSet:[buckets objectForKey:value]];
+		}
+
+		return found;
+	}
+
+	if (low && high && !isSameKindOfValue(high, low))
+		return found;
+
+	NSArray* values = [self sortedValuesForKey:key
+									 likeValue:low ? low : high];
+	NSUInteger first = low ? boundIndex(values, low, NO) : 0;
+	NSUInteger last = high ? boundIndex(values, high, YES) : [values count];
+	NSUInteger i;
+
+	for (i = first; i < last; ++i)
+		[found unionSet:[buckets objectForKey:[values objectAtIndex:i]]];
+
+	return found;
+}
+
+- (NSUInteger)objectCount
+{
+	[self rebuildIfNeeded];
+
+	return (NSUInteger)CFDictionaryGetCount(mEntries);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+
+	[mKeys release];
+	[mBuckets release];
+	[mSortedNumbers release];
+	[mSortedStrings release];
+
+	if (mEntries)
+		CFRelease(mEntries);
+
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKMetadataIndex (Private)
+
+- (void)rebuildIfNeeded
+{
+	if (!mNeedsRebuild || mDrawingRef == nil)
+		return;
+
+	mNeedsRebuild = NO;
+
+	NSEnumerator* iter = [[mDrawingRef flattenedLayersOfClass:[DKObjectOwnerLayer class]] objectEnumerator];
+	DKObjectOwnerLayer* layer;
+
+	while ((layer = [iter nextObject])) {
+		// asking for the objects of a layer that hasn't been loaded would load it. It is indexed when it is
+
+		if ([layer hasPendingObjects])
+			continue;
+
+		NSEnumerator* objIter = [[layer objects] objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [objIter nextObject]))
+			[self addObject:obj];
+	}
+
+	LogEvent_(kInfoEvent, @"metadata index rebuilt, %ld objects, keys = %@", (long)CFDictionaryGetCount(mEntries), mKeys);
+}
+
+- (void)addEntriesForObject:(DKDrawableObject*)obj keys:(NSArray*)keys
+{
+	NSMutableDictionary* entry = (NSMutableDictionary*)CFDictionaryGetValue(mEntries, obj);
+	NSEnumerator* iter = [keys objectEnumerator];
+	NSString* key;
+
+	while ((key = [iter nextObject])) {
+		id value = [[self class] indexedValueOfObject:obj
+											   forKey:key];
+
+		// values are the keys of the hash index, so must be copyable
+
+		if (value == nil || ![value conformsToProtocol:@protocol(NSCopying)])
+			continue;
+
+		NSMutableDictionary* buckets = [mBuckets objectForKey:key];
+
+		if (buckets == nil) {
+			buckets = [NSMutableDictionary dictionary];
+			[mBuckets setObject:buckets
+						 forKey:key];
+		}
+
+		NSMutableSet* objects = [buckets objectForKey:value];
+
+		if (objects == nil) {
+			objects = [NSMutableSet set];
+			[buckets setObject:objects
+						forKey:value];
+
+			[mSortedNumbers removeObjectForKey:key];
+			[mSortedStrings removeObjectForKey:key];
+		}
+
+		[objects addObject:obj];
+		[entry setObject:value
+				  forKey:key];
+	}
+}
+
+- (void)removeEntriesForObject:(DKDrawableObject*)obj keys:(NSArray*)keys
+{
+	NSMutableDictionary* entry = (NSMutableDictionary*)CFDictionaryGetValue(mEntries, obj);
+	NSEnumerator* iter = [keys objectEnumerator];
+	NSString* key;
+
+	while ((key = [iter nextObject])) {
+		id value = [entry objectForKey:key];
+
+		if (value == nil)
+			continue;
+
+		NSMutableDictionary* buckets = [mBuckets objectForKey:key];
+		NSMutableSet* objects = [buckets objectForKey:value];
+
+		[objects removeObject:obj];
+
+		if ([objects count] == 0) {
+			[buckets removeObjectForKey:value];
+
+			[mSortedNumbers removeObjectForKey:key];
+			[mSortedStrings removeObjectForKey:key];
+		}
+
+		[entry removeObjectForKey:key];
+	}
+}
+
+- (NSArray*)sortedValuesForKey:(NSString*)key likeValue:(id)bound
+{
+	NSMutableDictionary* sorted = [bound isKindOfClass:[NSString class]] ? mSortedStrings : mSortedNumbers;
+	NSArray* values = [sorted objectForKey:key];
+
+	if (values == nil) {
+		NSMutableArray* sameKind = [NSMutableArray array];
+		NSEnumerator* iter = [[mBuckets objectForKey:key] keyEnumerator];
+		id value;
+
+		while ((value = [iter nextObject])) {
+			if (isSameKindOfValue(value, bound))
+				[sameKind addObject:value];
+		}
+
+		[sameKind sortUsingFunction:compareValues
+							context:NULL];
+
+		values = sameKind;
+		[sorted setObject:values
+				   forKey:key];
+	}
+
+	return values;
+}
+
+- (void)layersDidChange:(NSNotification*)note
+{
+	if ([[note object] drawing] == mDrawingRef)
+		[self invalidate];
+}
+
+@end
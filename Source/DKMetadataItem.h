@@ -61,6 +61,7 @@ DKMetadataItems are used to store metadata (attribute) values in user info dicti
 @private
 	id mValue;
 	DKMetadataType mType;
+	BOOL mValueShared; // the value is shared with a copy, and is copied before it is handed out
 }
 
 + (Class)classForType:(DKMetadataType)type;
@@ -545,6 +545,16 @@ NSString* DKMultipleMetadataItemsPBoardType = @"com.apptree.dk.multimeta";
 
 - (id)value
 {
+	// a mutable value shared with a copy is copied the first time it's asked for, since whoever asks may change it
+
+	if (mValueShared) {
+		id valCopy = [mValue copy];
+
+		[mValue release];
+		mValue = valCopy;
+		mValueShared = NO;
+	}
+
 	return mValue;
 }
 
@@ -719,6 +729,7 @@ NSString* DKMultipleMetadataItemsPBoardType = @"com.apptree.dk.multimeta";
 	[aValue retain];
 	[mValue release];
 	mValue = aValue;
+	mValueShared = NO;
 }
 
 - (id)valueWithCurrentType:(id)inValue
@@ -986,9 +997,19 @@ NSString* DKMultipleMetadataItemsPBoardType = @"com.apptree.dk.multimeta";
 	// copy always returns a mutable, independent copy. See also -metadataItemWithType:
 
 	DKMetadataItem* copy = [[[self class] allocWithZone:zone] initWithType:[self type]];
-	id valCopy = [[self value] copy];
-	[copy assignValue:valCopy];
-	[valCopy release];
+
+	// values are replaced rather than changed, except for images, which are costly to copy. So an image is shared by both items until
+	// one of them hands it out, and is copied then
+
+	if ([mValue isKindOfClass:[NSImage class]]) {
+		[copy assignValue:mValue];
+		copy->mValueShared = YES;
+		mValueShared = YES;
+	} else {
+		id valCopy = [mValue copy];
+		[copy assignValue:valCopy];
+		[valCopy release];
+	}
 
 	return copy;
 }
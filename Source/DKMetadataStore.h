@@ -0,0 +1,58 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKMetadataItem.h"
+
+@class DKMetadataKeyTable;
+
+/// opaque type of the slots that hold the store's values
+
+typedef struct _DKMetadataSlot DKMetadataSlot;
+
+/** @brief A compact mutable dictionary of metadata items, used for the metadata of drawable objects.
+
+ A compact mutable dictionary of metadata items, used for the metadata of drawable objects. The keys are held in a key table that is shared by
+ every store with the same keys added in the same order, so objects with the same fields share one list of keys. The values are held in an
+ array of slots, one per key. Integer, real, boolean and unsigned items are kept in their slot as plain values, so they cost no objects at all;
+ any other item is kept as it is.
+
+ The store is a view over the slots: asking for the object for a key whose value is held inline makes a DKMetadataItem for it, which then takes
+ the slot's place so that changes made to it are kept. -metadataValueForKey: and -inlineNumberForKey: read values without doing so, and should
+ be used where only the value is needed.
+
+ Copies are stores too, and stores are archived as ordinary dictionaries of DKMetadataItems, so files are unchanged.
+*/
+@interface DKMetadataStore : NSMutableDictionary {
+@private
+	DKMetadataKeyTable* mKeyTable;
+	DKMetadataSlot* mSlots; // one per key in the key table
+	NSUInteger mCapacity;
+}
+
+/** @brief Returns the value of the item for a key, without making an item for it
+ @param key the key
+ @return the value, which is an NSNumber for values held inline, or nil if there is no item for the key
+ */
+- (id)metadataValueForKey:(NSString*)key;
+
+/** @brief Returns the value for a key if it is held inline
+ @param key the key
+ @return the number, or nil if there is no item for the key or its value is held in an item
+ */
+- (NSNumber*)inlineNumberForKey:(NSString*)key;
+
+/** @brief Whether there is an item for a key, without making one
+ @param key the key
+ @return YES if there is an item for the key
+ */
+- (BOOL)containsKey:(NSString*)key;
+
+/** @brief The number of keys held inline, for testing and diagnostics
+ */
+- (NSUInteger)inlineCount;
+
+@end
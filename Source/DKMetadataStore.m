@@ -0,0 +1,499 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKMetadataStore.h"
+#import "NSDictionary+DeepCopy.h"
+#import "GCUndoManager.h"
+#import <objc/runtime.h>
+
+// a key table stops recording the tables made from it by adding keys after this many, so that stores with keys that differ from
+// object to object don't keep tables alive for ever
+
+#define kDKMetadataKeyTableMaximumTransitions 64
+
+struct _DKMetadataSlot {
+	DKMetadataType type; // the type of an inline value, or DKMetadataTypeUnknown if the slot holds an object
+	BOOL borrowed; // the object is shared with a deep copy, and is itself deep copied before it is handed out
+	union {
+		double real;
+		NSInteger integer; // also booleans
+		NSUInteger unsignedInteger;
+		id object; // retained
+	} value;
+};
+
+/// an immutable list of keys, shared by every store with the same keys added in the same order
+
+@interface DKMetadataKeyTable : NSObject {
+@public
+	NSArray* mKeys;
+	CFMutableDictionaryRef mIndexes; // key -> index + 1
+	NSMutableDictionary* mTransitions; // key -> the table with that key added
+}
+
++ (DKMetadataKeyTable*)emptyTable;
+
+- (DKMetadataKeyTable*)tableByAddingKey:(NSString*)key;
+- (DKMetadataKeyTable*)tableByRemovingKeyAtIndex:(NSUInteger)indx;
+- (NSUInteger)indexOfKey:(NSString*)key;
+- (NSUInteger)count;
+
+@end
+
+@implementation DKMetadataKeyTable
+
+static DKMetadataKeyTable* sEmptyKeyTable = nil;
+
++ (DKMetadataKeyTable*)emptyTable
+{
+	@synchronized(self)
+	{
+		if (sEmptyKeyTable == nil)
+			sEmptyKeyTable = [[self alloc] initWithKeys:[NSArray array]];
+	}
+
+	return sEmptyKeyTable;
+}
+
+- (id)initWithKeys:(NSArray*)keys
+{
+	self = [super init];
+	if (self) {
+		mKeys = [keys copy];
+		mIndexes = CFDictionaryCreateMutable(kCFAllocatorDefault, [keys count], &kCFCopyStringDictionaryKeyCallBacks, NULL);
+		mTransitions = [[NSMutableDictionary alloc] init];
+
+		NSUInteger i;
+
+		for (i = 0; i < [mKeys count]; ++i)
+			CFDictionarySetValue(mIndexes, [mKeys objectAtIndex:i], (const void*)(i + 1));
+	}
+
+	return self;
+}
+
+- (DKMetadataKeyTable*)tableByAddingKey:(NSString*)key
+{
+	// tables are shared between threads, but only the transitions ever change
+
+	@synchronized([DKMetadataKeyTable class])
+	{
+		DKMetadataKeyTable* table = [mTransitions objectForKey:key];
+
+		if (table == nil) {
+			table = [[DKMetadataKeyTable alloc] initWithKeys:[mKeys arrayByAddingObject:key]];
+
+			if ([mTransitions count] < kDKMetadataKeyTableMaximumTransitions)
+				[mTransitions setObject:table
+								 forKey:key];
+
+			[table autorelease];
+		}
+
+		return [[table retain] autorelease];
+	}
+}
+
+- (DKMetadataKeyTable*)tableByRemovingKeyAtIndex:(NSUInteger)indx
+{
+	// rebuilt from the empty table, so that the result is shared with stores that never had the key
+
+	DKMetadataKeyTable* table = [DKMetadataKeyTable emptyTable];
+	NSUInteger i;
+
+	for (i = 0; i < [mKeys count]; ++i) {
+		if (i != indx)
+			table = [table tableByAddingKey:[mKeys objectAtIndex:i]];
+	}
+
+	return table;
+}
+
+- (NSUInteger)indexOfKey:(NSString*)key
+{
+	const void* value;
+
+	if (key && CFDictionaryGetValueIfPresent(mIndexes, key, &value))
+		return (NSUInteger)value - 1;
+
+	return NSNotFound;
+}
+
+- (NSUInteger)count
+{
+	return [mKeys count];
+}
+
+- (void)dealloc
+{
+	[mKeys release];
+	CFRelease(mIndexes);
+	[mTransitions release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+static void clearSlot(DKMetadataSlot* slot)
+{
+	if (slot->type == DKMetadataTypeUnknown)
+		[slot->value.object release];
+
+	slot->type = DKMetadataTypeUnknown;
+	slot->borrowed = NO;
+	slot->value.object = nil;
+}
+
+static NSNumber* numberForSlot(const DKMetadataSlot* slot)
+{
+	switch (slot->type) {
+	case DKMetadataTypeInteger:
+		return [NSNumber numberWithInteger:slot->value.integer];
+
+	case DKMetadataTypeReal:
+		return [NSNumber numberWithDouble:slot->value.real];
+
+	case DKMetadataTypeBoolean:
+		return [NSNumber numberWithBool:(BOOL)slot->value.integer];
+
+	case DKMetadataTypeUnsignedInt:
+		return [NSNumber numberWithUnsignedInteger:slot->value.unsignedInteger];
+
+	default:
+		return nil;
+	}
+}
+
+static DKMetadataItem* newItemForSlot(const DKMetadataSlot* slot)
+{
+	switch (slot->type) {
+	case DKMetadataTypeInteger:
+		return [[DKMetadataItem alloc] initWithInteger:slot->value.integer];
+
+	case DKMetadataTypeReal:
+		return [[DKMetadataItem alloc] initWithReal:slot->value.real];
+
+	case DKMetadataTypeBoolean:
+		return [[DKMetadataItem alloc] initWithBoolean:(BOOL)slot->value.integer];
+
+	case DKMetadataTypeUnsignedInt:
+		return [[DKMetadataItem alloc] initWithUnsigned:slot->value.unsignedInteger];
+
+	default:
+		return [slot->value.object retain];
+	}
+}
+
+static void setSlotValue(DKMetadataSlot* slot, id object)
+{
+	// scalar items are held inline, but only if that gives back exactly the same value
+
+	[object retain];
+	clearSlot(slot);
+
+	if ([object class] == [DKMetadataItem class]) {
+		DKMetadataType type = [(DKMetadataItem*)object type];
+		id value = [(DKMetadataItem*)object value];
+
+		if ([value isKindOfClass:[NSNumber class]]) {
+			DKMetadataSlot inl;
+
+			inl.type = type;
+
+			if (type == DKMetadataTypeReal)
+				inl.value.real = [value doubleValue];
+			else if (type == DKMetadataTypeUnsignedInt)
+				inl.value.unsignedInteger = [value unsignedIntegerValue];
+			else
+				inl.value.integer = [value integerValue];
+
+			NSNumber* check = numberForSlot(&inl);
+
+			if (check != nil && [check isEqualToNumber:value]) {
+				inl.borrowed = NO;
+				*slot = inl;
+				[object release];
+				return;
+			}
+		}
+	}
+
+	slot->value.object = object;
+}
+
+#pragma mark -
+
+@implementation DKMetadataStore
+
+- (id)metadataValueForKey:(NSString*)key
+{
+	NSUInteger indx = [mKeyTable indexOfKey:key];
+
+	if (indx == NSNotFound)
+		return nil;
+
+	DKMetadataSlot* slot = &mSlots[indx];
+
+	if (slot->type != DKMetadataTypeUnknown)
+		return numberForSlot(slot);
+
+	if ([slot->value.object isKindOfClass:[DKMetadataItem class]])
+		return [(DKMetadataItem*)slot->value.object value];
+
+	return slot->value.object;
+}
+
+- (NSNumber*)inlineNumberForKey:(NSString*)key
+{
+	NSUInteger indx = [mKeyTable indexOfKey:key];
+
+	if (indx == NSNotFound)
+		return nil;
+
+	return numberForSlot(&mSlots[indx]);
+}
+
+- (BOOL)containsKey:(NSString*)key
+{
+	return [mKeyTable indexOfKey:key] != NSNotFound;
+}
+
+- (NSUInteger)inlineCount
+{
+	NSUInteger i, n = 0;
+
+	for (i = 0; i < [mKeyTable count]; ++i) {
+		if (mSlots[i].type != DKMetadataTypeUnknown)
+			++n;
+	}
+
+	return n;
+}
+
+#pragma mark -
+#pragma mark As an NSMutableDictionary
+
+- (NSUInteger)count
+{
+	return [mKeyTable count];
+}
+
+- (id)objectForKey:(id)key
+{
+	NSUInteger indx = [mKeyTable indexOfKey:key];
+
+	if (indx == NSNotFound)
+		return nil;
+
+	DKMetadataSlot* slot = &mSlots[indx];
+
+	if (slot->type != DKMetadataTypeUnknown) {
+		// the item made for an inline value replaces it, so that changes made to the item are kept
+
+		DKMetadataItem* item = newItemForSlot(slot);
+
+		slot->type = DKMetadataTypeUnknown;
+		slot->value.object = item;
+	} else if (slot->borrowed) {
+		// the caller may change what it's given, so an object shared with a deep copy becomes this store's own first
+
+		id obj = [slot->value.object deepCopy];
+
+		[slot->value.object release];
+		slot->value.object = obj;
+		slot->borrowed = NO;
+	}
+
+	return slot->value.object;
+}
+
+- (NSEnumerator*)keyEnumerator
+{
+	return [mKeyTable->mKeys objectEnumerator];
+}
+
+- (void)setObject:(id)object forKey:(id)key
+{
+	NSAssert(object != nil, @"cannot set a nil object in a metadata store");
+	NSAssert(key != nil, @"cannot use a nil key in a metadata store");
+
+	NSUInteger indx = [mKeyTable indexOfKey:key];
+
+	if (indx == NSNotFound) {
+		DKMetadataKeyTable* table = [mKeyTable tableByAddingKey:key];
+
+		indx = [mKeyTable count];
+
+		if (indx >= mCapacity) {
+			mCapacity = MAX(mCapacity * 2, 4U);
+			mSlots = realloc(mSlots, mCapacity * sizeof(DKMetadataSlot));
+		}
+
+		mSlots[indx].type = DKMetadataTypeUnknown;
+		mSlots[indx].borrowed = NO;
+		mSlots[indx].value.object = nil;
+
+		[table retain];
+		[mKeyTable release];
+		mKeyTable = table;
+	}
+
+	setSlotValue(&mSlots[indx], object);
+}
+
+- (void)removeObjectForKey:(id)key
+{
+	NSUInteger indx = [mKeyTable indexOfKey:key];
+
+	if (indx == NSNotFound)
+		return;
+
+	NSUInteger count = [mKeyTable count];
+
+	clearSlot(&mSlots[indx]);
+	memmove(&mSlots[indx], &mSlots[indx + 1], (count - indx - 1) * sizeof(DKMetadataSlot));
+
+	DKMetadataKeyTable* table = [[mKeyTable tableByRemovingKeyAtIndex:indx] retain];
+	[mKeyTable release];
+	mKeyTable = table;
+}
+
+- (void)removeAllObjects
+{
+	NSUInteger i;
+
+	for (i = 0; i < [mKeyTable count]; ++i)
+		clearSlot(&mSlots[i]);
+
+	[mKeyTable release];
+	mKeyTable = [[DKMetadataKeyTable emptyTable] retain];
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	return [self initWithCapacity:0];
+}
+
+- (id)initWithCapacity:(NSUInteger)numItems
+{
+	self = [super init];
+	if (self) {
+		mKeyTable = [[DKMetadataKeyTable emptyTable] retain];
+		mCapacity = MAX(numItems, 1U);
+		mSlots = malloc(mCapacity * sizeof(DKMetadataSlot));
+	}
+
+	return self;
+}
+
+- (id)initWithObjects:(const id[])objects forKeys:(const id<NSCopying>[])keys count:(NSUInteger)cnt
+{
+	self = [self initWithCapacity:cnt];
+	if (self) {
+		NSUInteger i;
+
+		for (i = 0; i < cnt; ++i)
+			[self setObject:objects[i]
+					 forKey:(id)keys[i]];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	NSUInteger i;
+
+	for (i = 0; i < [mKeyTable count]; ++i)
+		clearSlot(&mSlots[i]);
+
+	free(mSlots);
+	[mKeyTable release];
+	[super dealloc];
+}
+
+- (id)copyWithZone:(NSZone*)zone
+{
+	return [self mutableCopyWithZone:zone];
+}
+
+- (id)mutableCopyWithZone:(NSZone*)zone
+{
+	// the copy shares the key table, and like any dictionary copy, the objects
+
+	NSUInteger i, count = [mKeyTable count];
+	DKMetadataStore* copy = [[DKMetadataStore allocWithZone:zone] initWithCapacity:count];
+
+	[copy->mKeyTable release];
+	copy->mKeyTable = [mKeyTable retain];
+	memcpy(copy->mSlots, mSlots, count * sizeof(DKMetadataSlot));
+
+	for (i = 0; i < count; ++i) {
+		if (mSlots[i].type == DKMetadataTypeUnknown)
+			[mSlots[i].value.object retain];
+	}
+
+	return copy;
+}
+
+- (NSDictionary*)deepCopy
+{
+	// copy on write: the items are shared, and each store deep copies an item only when it hands it out, which is when it might be
+	// changed. Until then a duplicate costs one slot per key, and items that are never asked for are never copied
+
+	DKMetadataStore* copy = [self mutableCopy];
+	NSUInteger i;
+
+	for (i = 0; i < [mKeyTable count]; ++i) {
+		if (mSlots[i].type == DKMetadataTypeUnknown) {
+			mSlots[i].borrowed = YES;
+			copy->mSlots[i].borrowed = YES;
+		}
+	}
+
+	return copy;
+}
+
+- (NSUInteger)undoCost
+{
+	// NSDictionary's estimate would make an item for every inline value
+
+	NSUInteger i, cost = class_getInstanceSize([self class]) + mCapacity * sizeof(DKMetadataSlot);
+
+	for (i = 0; i < [mKeyTable count]; ++i) {
+		if (mSlots[i].type == DKMetadataTypeUnknown)
+			cost += [mSlots[i].value.object undoCost];
+	}
+
+	return cost;
+}
+
+- (id)replacementObjectForCoder:(NSCoder*)coder
+{
+#pragma unused(coder)
+
+	// archived as the dictionary of items it stands for, without making items in the store itself
+
+	NSUInteger i, count = [mKeyTable count];
+	NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:count];
+
+	for (i = 0; i < count; ++i) {
+		DKMetadataItem* item = newItemForSlot(&mSlots[i]);
+
+		[dict setObject:item
+				 forKey:[mKeyTable->mKeys objectAtIndex:i]];
+		[item release];
+	}
+
+	return dict;
+}
+
+@end
@@ -11,21 +11,54 @@
 #import "DKGridLayer.h"
 #import "LogEvent.h"
 
-#pragma mark Static Functions
-
-/** @brief Determines the relative vertical position order of a pair of objects
-
- Objects must respond to the -apparentBounds method
- @param a>, <b the objects to compare
- @return sort order constant */
-static NSInteger vertLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void* context);
+#import "DKLayer.h"
 
-/** @brief Determines the relative horizontal position order of a pair of objects
+#pragma mark Static Functions
 
- Objects must respond to the -apparentBounds method
- @param a>, <b the objects to compare
- @return sort order constant */
-static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void* context);
+// alignment and distribution read each object's geometry once into one of these, sort and compute on the C array, and move the
+// objects at the end, so that only one storage update and redraw is made for the whole operation
+
+typedef struct {
+	DKDrawableObject* object;
+	NSPoint location;
+	NSRect bounds; // logical bounds
+	NSPoint offset; // the total move to apply
+	NSUInteger index; // position in the original array, so that the sort is stable
+} DKAlignmentItem;
+
+/** @brief Reads the geometry of some objects into a new C array
+ @param objects the objects
+ @return the items, in the order of <objects>, which the caller must free */
+static DKAlignmentItem* alignmentItemsForObjects(NSArray* objects);
+
+/** @brief Sorts items by vertical location, keeping the original order of items at the same location
+ @param items the items
+ @param count the number of items */
+static void sortAlignmentItemsVertically(DKAlignmentItem* items, NSUInteger count);
+
+/** @brief Sorts items by horizontal location, keeping the original order of items at the same location
+ @param items the items
+ @param count the number of items */
+static void sortAlignmentItemsHorizontally(DKAlignmentItem* items, NSUInteger count);
+
+/** @brief Records a move of an item, updating its geometry to match
+ @param item the item
+ @param dx, dy the move */
+static void offsetAlignmentItem(DKAlignmentItem* item, CGFloat dx, CGFloat dy);
+
+/** @brief Moves the objects of some items by their offsets
+
+ The moves are made as one batch of bounds changes with the display updates coalesced, so the storage and the view are updated once.
+ @param layer the layer that owns the objects
+ @param items the items
+ @param count the number of items */
+static void applyAlignmentItems(DKObjectDrawingLayer* layer, DKAlignmentItem* items, NSUInteger count);
+
+/** @brief Returns the objects of some items, in the items' order
+ @param items the items
+ @param count the number of items
+ @return an array of the objects */
+static NSArray* objectsOfAlignmentItems(DKAlignmentItem* items, NSUInteger count);
 
 #pragma mark -
 @implementation DKObjectDrawingLayer (Alignment)
@@ -86,6 +119,8 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
  */
 - (void)alignObjects:(NSArray*)objects toMasterObject:(id)object withAlignment:(NSInteger)align
 {
+	[self beginBulkChangeToObjects:objects];
+
 	// if we are distributing the objects, use the distributor method first - master
 	// doesn't come into it
 
@@ -96,28 +131,27 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 	// apply other alignment flag if there is any
 
 	if ((align & ~kDKAlignmentDistributionMask) != 0) {
-		NSEnumerator* iter;
-		id mo;
-		NSRect mb, ob;
-		NSPoint alignOffset;
+		NSUInteger i, count = [objects count];
+		DKAlignmentItem* items;
+		NSRect mb;
 
 		NSAssert(object != nil, @"cannot align - master object is nil");
 
 		LogEvent_(kUserEvent, @"Aligning objects with alignment = %d", align);
 
 		mb = [object apparentBounds];
+		items = alignmentItemsForObjects(objects);
 
-		iter = [objects objectEnumerator];
-
-		while ((mo = [iter nextObject])) {
-			if (mo != object) {
-				ob = [mo apparentBounds];
-				alignOffset = calculateAlignmentOffset(mb, ob, align);
-				[mo offsetLocationByX:alignOffset.x
-								  byY:alignOffset.y];
-			}
+		for (i = 0; i < count; ++i) {
+			if (items[i].object != object)
+				items[i].offset = calculateAlignmentOffset(mb, [items[i].object apparentBounds], align);
 		}
+
+		applyAlignmentItems(self, items, count);
+		free(items);
 	}
+
+	[self endBulkChange];
 }
 
 /** @brief Aligns a set of objects to a given point
@@ -152,6 +186,7 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 	NSRect objRect;
 	NSSize offset;
 
+	[self beginBulkChangeToObjects:objects];
 	iter = [objects objectEnumerator];
 
 	while ((mo = [iter nextObject])) {
@@ -172,6 +207,8 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 			[mo setOffset:offset];
 		}
 	}
+
+	[self endBulkChange];
 }
 
 /** @brief Aligns a set of objects so their locations lie on a grid intersection
@@ -188,12 +225,15 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 	DKDrawableObject* mo;
 	NSPoint p;
 
+	[self beginBulkChangeToObjects:objects];
 	iter = [objects objectEnumerator];
 
 	while ((mo = [iter nextObject])) {
 		p = [grid nearestGridIntersectionToPoint:[mo location]];
 		[mo setLocation:p];
 	}
+
+	[self endBulkChange];
 }
 
 #pragma mark -
@@ -264,11 +304,14 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 {
 	LogEvent_(kReactiveEvent, @"sorting objects into vertical order");
 
-	NSMutableArray* na = [objects mutableCopy];
+	NSUInteger count = [objects count];
+	DKAlignmentItem* items = alignmentItemsForObjects(objects);
+
+	sortAlignmentItemsVertically(items, count);
 
-	[na sortUsingFunction:vertLocSortFunc
-				  context:nil];
-	return [na autorelease];
+	NSArray* sorted = objectsOfAlignmentItems(items, count);
+	free(items);
+	return sorted;
 }
 
 /** @brief Sorts a set of objects into order of their horizontal location
@@ -279,11 +322,14 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 {
 	LogEvent_(kReactiveEvent, @"sorting objects into horizontal order");
 
-	NSMutableArray* na = [objects mutableCopy];
+	NSUInteger count = [objects count];
+	DKAlignmentItem* items = alignmentItemsForObjects(objects);
+
+	sortAlignmentItemsHorizontally(items, count);
 
-	[na sortUsingFunction:horizLocSortFunc
-				  context:nil];
-	return [na autorelease];
+	NSArray* sorted = objectsOfAlignmentItems(items, count);
+	free(items);
+	return sorted;
 }
 
 #pragma mark -
@@ -301,10 +347,9 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 	// distribute the objects - this is usually called from the alignment method as needed - calling it directly will
 	// ignore any edge alignment set.
 
-	NSArray* sorted;
 	NSInteger numToAlign, i;
 	CGFloat spanDistance, spanIncrement, min, max;
-	DKDrawableObject* mo;
+	DKAlignmentItem* items;
 
 	numToAlign = [objects count];
 
@@ -313,134 +358,90 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 	if (numToAlign < 3)
 		return NO;
 
+	// each distribution sorts the items as moved by the ones before it, and the objects are moved once at the end
+
+	items = alignmentItemsForObjects(objects);
+
 	if (align & kDKAlignmentAlignVDistribution) {
-		sorted = [self objectsSortedByVerticalPosition:objects];
+		sortAlignmentItemsVertically(items, numToAlign);
 
 		// find the span distance - the difference between the first and last objects
 
-		min = [(DKDrawableObject*)[sorted objectAtIndex:0] location].y;
-		max = [(DKDrawableObject*)[sorted lastObject] location].y;
+		min = items[0].location.y;
+		max = items[numToAlign - 1].location.y;
 
-		spanDistance = max - min; //NSMidY( bottom ) - NSMidY( top );
+		spanDistance = max - min;
 		spanIncrement = spanDistance / (CGFloat)(numToAlign - 1);
 
-		//	LogEvent_(kReactiveEvent, @"vertically distributing %d objects, increment = %f, span = %f", numToAlign, spanIncrement, spanDistance );
-
-		NSPoint cp;
-
 		// iterate through the objects between the two, setting their vertical position accordingly
 
-		for (i = 1; i < (numToAlign - 1); i++) {
-			mo = [sorted objectAtIndex:i];
-
-			cp.x = [mo location].x;
-			cp.y = min + ((CGFloat)i * spanIncrement);
-
-			//	LogEvent_(kReactiveEvent,  @"positioning object %d, {%f, %f}", i, cp.x, cp.y );
-
-			[mo setLocation:cp];
-		}
+		for (i = 1; i < (numToAlign - 1); i++)
+			offsetAlignmentItem(&items[i], 0, min + ((CGFloat)i * spanIncrement) - items[i].location.y);
 	}
 
 	if (align & kDKAlignmentAlignHDistribution) {
-		sorted = [self objectsSortedByHorizontalPosition:objects];
-
-		// find the span distance - the difference between the first and last objects
+		sortAlignmentItemsHorizontally(items, numToAlign);
 
-		min = [(DKDrawableObject*)[sorted objectAtIndex:0] location].x;
-		max = [(DKDrawableObject*)[sorted lastObject] location].x;
+		min = items[0].location.x;
+		max = items[numToAlign - 1].location.x;
 
-		spanDistance = max - min; //NSMidX( bottom ) - NSMidX( top );
+		spanDistance = max - min;
 		spanIncrement = spanDistance / (CGFloat)(numToAlign - 1);
 
-		NSPoint cp;
-
-		// iterate through the objects between the two, setting their vertical position accordingly
-
-		for (i = 1; i < (numToAlign - 1); i++) {
-			mo = [sorted objectAtIndex:i];
-
-			cp.y = [mo location].y;
-			cp.x = min + ((CGFloat)i * spanIncrement);
-
-			[mo setLocation:cp];
-		}
+		for (i = 1; i < (numToAlign - 1); i++)
+			offsetAlignmentItem(&items[i], min + ((CGFloat)i * spanIncrement) - items[i].location.x, 0);
 	}
 
 	if (align & kDKAlignmentAlignVSpaceDistribution) {
 		// the space between the objects is shared out equally.
-		sorted = [self objectsSortedByVerticalPosition:objects];
-		CGFloat space = [self totalVerticalSpace:sorted];
-		CGFloat spaceEach = space / (CGFloat)(numToAlign - 1);
-		CGFloat nte;
-		NSRect mobr;
-		NSRect prevBounds = NSZeroRect;
-
-		// if the space is zero or negative, the objects overlap to a degree, and the space can't be distributed
-
-		if (space > 0.0) {
-			//	LogEvent_(kReactiveEvent, @"distributing space = %f among %d objects", space, numToAlign );
+		sortAlignmentItemsVertically(items, numToAlign);
 
-			NSPoint cp;
+		CGFloat space = NSMinY(items[numToAlign - 1].bounds) - NSMaxY(items[0].bounds);
 
-			for (i = 0; i < numToAlign - 1; i++) {
-				mo = [sorted objectAtIndex:i];
-				mobr = [mo logicalBounds];
+		for (i = 1; i < numToAlign - 1; i++)
+			space -= NSHeight(items[i].bounds);
 
-				if (i > 0) {
-					cp.x = [mo location].x;
+		// if the space is zero or negative, the objects overlap to a degree, and the space can't be distributed
 
-					// top edge of this object is bottom edge of last + spaceEach, but we are calculating the
-					// centre
+		if (space > 0.0) {
+			CGFloat spaceEach = space / (CGFloat)(numToAlign - 1);
+			CGFloat nte;
 
-					nte = NSMaxY(prevBounds) + spaceEach;
-					cp.y = NSMidY(mobr) - NSMinY(mobr) + nte;
+			for (i = 1; i < numToAlign - 1; i++) {
+				// top edge of this object is bottom edge of last + spaceEach, but we are calculating the
+				// centre
 
-					[mo setLocation:cp];
-					mobr = [mo logicalBounds];
-				}
-				prevBounds = mobr;
+				nte = NSMaxY(items[i - 1].bounds) + spaceEach;
+				offsetAlignmentItem(&items[i], 0, NSMidY(items[i].bounds) - NSMinY(items[i].bounds) + nte - items[i].location.y);
 			}
 		}
 	}
 
 	if (align & kDKAlignmentAlignHSpaceDistribution) {
 		// the space between the objects is shared out equally.
-		sorted = [self objectsSortedByHorizontalPosition:objects];
-		CGFloat space = [self totalHorizontalSpace:sorted];
-		CGFloat spaceEach = space / (CGFloat)(numToAlign - 1);
-		CGFloat nte;
-		NSRect mobr;
-		NSRect prevBounds = NSZeroRect;
+		sortAlignmentItemsHorizontally(items, numToAlign);
 
-		// if the space is zero or negative, the objects overlap to a degree, and the space can't be distributed
+		CGFloat space = NSMinX(items[numToAlign - 1].bounds) - NSMaxX(items[0].bounds);
 
-		if (space > 0.0) {
-			//	LogEvent_(kReactiveEvent, @"distributing space = %f among %d objects", space, numToAlign );
+		for (i = 1; i < numToAlign - 1; i++)
+			space -= NSWidth(items[i].bounds);
 
-			NSPoint cp;
-
-			for (i = 0; i < numToAlign - 1; i++) {
-				mo = [sorted objectAtIndex:i];
-				mobr = [mo logicalBounds];
-
-				if (i > 0) {
-					cp.y = [mo location].y;
-
-					// top edge of this object is bottom edge of last + spaceEach, but we are calculating the
-					// centre
-
-					nte = NSMaxX(prevBounds) + spaceEach;
-					cp.x = NSMidX(mobr) - NSMinX(mobr) + nte;
+		if (space > 0.0) {
+			CGFloat spaceEach = space / (CGFloat)(numToAlign - 1);
+			CGFloat nte;
 
-					[mo setLocation:cp];
-					mobr = [mo logicalBounds];
-				}
-				prevBounds = mobr;
+			for (i = 1; i < numToAlign - 1; i++) {
+				nte = NSMaxX(items[i - 1].bounds) + spaceEach;
+				offsetAlignmentItem(&items[i], NSMidX(items[i].bounds) - NSMinX(items[i].bounds) + nte - items[i].location.x, 0);
 			}
 		}
 	}
 
+	[self beginBulkChangeToObjects:objects];
+	applyAlignmentItems(self, items, numToAlign);
+	[self endBulkChange];
+	free(items);
+
 	return YES;
 }
 
@@ -653,38 +654,98 @@ static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void
 #pragma mark -
 #pragma mark Static Functions
 
-static NSInteger vertLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void* context)
+static DKAlignmentItem* alignmentItemsForObjects(NSArray* objects)
 {
-#pragma unused(context)
+	NSUInteger i, count = [objects count];
+	DKAlignmentItem* items = calloc(MAX(count, 1U), sizeof(DKAlignmentItem));
+	DKDrawableObject* obj;
 
-	CGFloat ya, yb;
+	for (i = 0; i < count; ++i) {
+		obj = [objects objectAtIndex:i];
 
-	ya = [a location].y;
-	yb = [b location].y;
+		items[i].object = obj;
+		items[i].location = [obj location];
+		items[i].bounds = [obj logicalBounds];
+		items[i].index = i;
+	}
 
-	if (ya < yb)
-		return NSOrderedAscending;
-	else if (ya > yb)
-		return NSOrderedDescending;
-	else
-		return NSOrderedSame;
+	return items;
 }
 
-static NSInteger horizLocSortFunc(DKDrawableObject* a, DKDrawableObject* b, void* context)
+static int compareItemsVertically(const void* a, const void* b)
 {
-#pragma unused(context)
+	const DKAlignmentItem* ia = a;
+	const DKAlignmentItem* ib = b;
 
-	CGFloat xa, xb;
+	if (ia->location.y < ib->location.y)
+		return -1;
+	else if (ia->location.y > ib->location.y)
+		return 1;
+	else
+		return (ia->index < ib->index) ? -1 : (ia->index > ib->index);
+}
 
-	xa = [a location].x;
-	xb = [b location].x;
+static int compareItemsHorizontally(const void* a, const void* b)
+{
+	const DKAlignmentItem* ia = a;
+	const DKAlignmentItem* ib = b;
 
-	if (xa < xb)
-		return NSOrderedAscending;
-	else if (xa > xb)
-		return NSOrderedDescending;
+	if (ia->location.x < ib->location.x)
+		return -1;
+	else if (ia->location.x > ib->location.x)
+		return 1;
 	else
-		return NSOrderedSame;
+		return (ia->index < ib->index) ? -1 : (ia->index > ib->index);
+}
+
+static void sortAlignmentItemsVertically(DKAlignmentItem* items, NSUInteger count)
+{
+	qsort(items, count, sizeof(DKAlignmentItem), compareItemsVertically);
+}
+
+static void sortAlignmentItemsHorizontally(DKAlignmentItem* items, NSUInteger count)
+{
+	qsort(items, count, sizeof(DKAlignmentItem), compareItemsHorizontally);
+}
+
+static void offsetAlignmentItem(DKAlignmentItem* item, CGFloat dx, CGFloat dy)
+{
+	item->location.x += dx;
+	item->location.y += dy;
+	item->bounds = NSOffsetRect(item->bounds, dx, dy);
+	item->offset.x += dx;
+	item->offset.y += dy;
+}
+
+static void applyAlignmentItems(DKObjectDrawingLayer* layer, DKAlignmentItem* items, NSUInteger count)
+{
+	NSUInteger i;
+
+	[layer beginBoundsUpdateBatch];
+	[DKLayer beginCoalescingDisplayUpdates];
+
+	@try {
+		for (i = 0; i < count; ++i) {
+			if (items[i].offset.x != 0.0 || items[i].offset.y != 0.0)
+				[items[i].object offsetLocationByX:items[i].offset.x
+											   byY:items[i].offset.y];
+		}
+	}
+	@finally {
+		[DKLayer endCoalescingDisplayUpdates];
+		[layer endBoundsUpdateBatch];
+	}
+}
+
+static NSArray* objectsOfAlignmentItems(DKAlignmentItem* items, NSUInteger count)
+{
+	NSMutableArray* objects = [NSMutableArray arrayWithCapacity:count];
+	NSUInteger i;
+
+	for (i = 0; i < count; ++i)
+		[objects addObject:items[i].object];
+
+	return objects;
 }
 
 #pragma mark -
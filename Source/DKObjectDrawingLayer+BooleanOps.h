@@ -0,0 +1,76 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKObjectDrawingLayer.h"
+#import "NSBezierPath+Combinatorial.h"
+
+/** @brief Commands that combine the selected objects into new ones using boolean operations on their paths.
+
+ The result of an operation takes its style from the bottom-most object taking part, and is placed at that object's position
+ in the stacking order. It is a path if that object is a path, otherwise a shape. Groups take part as the combined area of their contents.
+*/
+@interface DKObjectDrawingLayer (BooleanOps)
+
+// user actions:
+
+/** @brief Replaces the selected objects with a single object covering the area of all of them
+ @param sender the action's sender
+ */
+- (IBAction)unionSelectedObjects:(id)sender;
+
+/** @brief Replaces the selected objects with a single object covering the area that they all share
+ @param sender the action's sender
+ */
+- (IBAction)intersectionSelectedObjects:(id)sender;
+
+/** @brief Replaces the selected objects with the bottom-most one, less the area of the others
+ @param sender the action's sender
+ */
+- (IBAction)diffSelectedObjects:(id)sender;
+
+/** @brief Replaces the selected objects with a single object covering the area covered by an odd number of them
+ @param sender the action's sender
+ */
+- (IBAction)xorSelectedObjects:(id)sender;
+
+/** @brief Replaces two selected objects with objects for the area that each covers alone and the area they share
+ @param sender the action's sender
+ */
+- (IBAction)divideSelectedObjects:(id)sender;
+
+/** @brief Replaces the selected objects with a single object whose path contains all of their paths
+
+ Unlike the union, the paths are simply appended, as for a compound path. The result uses the even-odd winding rule, so
+ where the paths overlap the area is left unfilled.
+ @param sender the action's sender
+ */
+- (IBAction)combineSelectedObjects:(id)sender;
+
+/** @brief Performs a boolean operation on the selected objects
+
+ This is the method that the actions call. The selected objects are replaced by the result, and the change can be undone.
+ @param op the operation
+ @param actionName the name of the action, for undo
+ @return the new object, or nil if the operation left nothing
+ */
+- (DKDrawableObject*)performBooleanOp:(DKBooleanOperation)op onSelectionWithActionName:(NSString*)actionName;
+
+// helpers:
+
+/** @brief Returns the path that an object contributes to a boolean operation
+ @param obj a drawable object
+ @return a path, or nil if the object has none
+ */
+- (NSBezierPath*)booleanOperandPathForObject:(DKDrawableObject*)obj;
+
+/** @brief Returns a new object like a given one but having a different path
+ @param path the path of the new object
+ @param anObject the object whose style the new object should have
+ @return a new autoreleased path if <anObject> is a path, otherwise a shape
+ */
+- (DKDrawableObject*)objectWithPath:(NSBezierPath*)path likeObject:(DKDrawableObject*)anObject;
+
+@end
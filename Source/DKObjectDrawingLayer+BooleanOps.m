@@ -0,0 +1,226 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKObjectDrawingLayer+BooleanOps.h"
+
+#import "DKDrawablePath.h"
+#import "DKShapeGroup.h"
+#import "LogEvent.h"
+
+@implementation DKObjectDrawingLayer (BooleanOps)
+#pragma mark As a DKObjectDrawingLayer
+
+- (IBAction)unionSelectedObjects:(id)sender
+{
+#pragma unused(sender)
+
+	[self performBooleanOp:kDKBooleanOpUnion
+		onSelectionWithActionName:NSLocalizedString(@"Union", @"undo string for union")];
+}
+
+- (IBAction)intersectionSelectedObjects:(id)sender
+{
+#pragma unused(sender)
+
+	[self performBooleanOp:kDKBooleanOpIntersection
+		onSelectionWithActionName:NSLocalizedString(@"Intersection", @"undo string for intersection")];
+}
+
+- (IBAction)diffSelectedObjects:(id)sender
+{
+#pragma unused(sender)
+
+	[self performBooleanOp:kDKBooleanOpDifference
+		onSelectionWithActionName:NSLocalizedString(@"Difference", @"undo string for difference")];
+}
+
+- (IBAction)xorSelectedObjects:(id)sender
+{
+#pragma unused(sender)
+
+	[self performBooleanOp:kDKBooleanOpExclusiveOR
+		onSelectionWithActionName:NSLocalizedString(@"Exclusive Or", @"undo string for xor")];
+}
+
+- (IBAction)divideSelectedObjects:(id)sender
+{
+#pragma unused(sender)
+
+	if ([self lockedOrHidden])
+		return;
+
+	NSArray* objects = [self selectedAvailableObjects];
+
+	if ([objects count] != 2) {
+		NSBeep();
+		return;
+	}
+
+	DKDrawableObject* a = [objects objectAtIndex:0];
+	DKDrawableObject* b = [objects objectAtIndex:1];
+	NSBezierPath* pa = [self booleanOperandPathForObject:a];
+	NSBezierPath* pb = [self booleanOperandPathForObject:b];
+
+	if (pa == nil || pb == nil) {
+		NSBeep();
+		return;
+	}
+
+	// the parts of each object's path become new objects like that object
+
+	NSArray* parts = [pa dividePathWithPath:pb];
+	NSMutableArray* newObjects = [NSMutableArray array];
+	NSEnumerator* iter = [[parts objectAtIndex:0] objectEnumerator];
+	NSBezierPath* part;
+
+	while ((part = [iter nextObject]))
+		[newObjects addObject:[self objectWithPath:part
+										likeObject:a]];
+
+	iter = [[parts objectAtIndex:1] objectEnumerator];
+
+	while ((part = [iter nextObject]))
+		[newObjects addObject:[self objectWithPath:part
+										likeObject:b]];
+
+	if ([newObjects count] == 0) {
+		NSBeep();
+		return;
+	}
+
+	NSUInteger indx = [self indexOfObject:a];
+	NSUInteger i;
+
+	[self recordSelectionForUndo];
+	[self removeObjectsInArray:objects];
+
+	for (i = 0; i < [newObjects count]; ++i)
+		[self addObject:[newObjects objectAtIndex:i]
+				atIndex:indx + i];
+
+	[self exchangeSelectionWithObjectsFromArray:newObjects];
+	[self commitSelectionUndoWithActionName:NSLocalizedString(@"Divide", @"undo string for divide")];
+}
+
+- (IBAction)combineSelectedObjects:(id)sender
+{
+#pragma unused(sender)
+
+	if ([self lockedOrHidden])
+		return;
+
+	NSArray* objects = [self selectedAvailableObjects];
+
+	if ([objects count] < 2) {
+		NSBeep();
+		return;
+	}
+
+	NSBezierPath* combined = [NSBezierPath bezierPath];
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* obj;
+	NSBezierPath* path;
+
+	while ((obj = [iter nextObject])) {
+		path = [self booleanOperandPathForObject:obj];
+
+		if (path)
+			[combined appendBezierPath:path];
+	}
+
+	if ([combined isEmpty]) {
+		NSBeep();
+		return;
+	}
+
+	[combined setWindingRule:NSEvenOddWindingRule];
+
+	DKDrawableObject* bottom = [objects objectAtIndex:0];
+	DKDrawableObject* result = [self objectWithPath:combined
+										 likeObject:bottom];
+	NSUInteger indx = [self indexOfObject:bottom];
+
+	[self recordSelectionForUndo];
+	[self removeObjectsInArray:objects];
+	[self addObject:result
+			atIndex:indx];
+	[self replaceSelectionWithObject:result];
+	[self commitSelectionUndoWithActionName:NSLocalizedString(@"Combine", @"undo string for combine")];
+}
+
+- (DKDrawableObject*)performBooleanOp:(DKBooleanOperation)op onSelectionWithActionName:(NSString*)actionName
+{
+	if ([self lockedOrHidden])
+		return nil;
+
+	NSArray* objects = [self selectedAvailableObjects];
+
+	if ([objects count] < 2) {
+		NSBeep();
+		return nil;
+	}
+
+	// the objects are combined in a single operation, in stacking order so that for a difference the bottom object is the one
+	// the others are subtracted from. An object without a path still counts, so that it empties an intersection.
+
+	NSMutableArray* paths = [NSMutableArray arrayWithCapacity:[objects count]];
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* obj;
+	NSBezierPath* path;
+
+	while ((obj = [iter nextObject])) {
+		path = [self booleanOperandPathForObject:obj];
+		[paths addObject:path ? path : [NSBezierPath bezierPath]];
+	}
+
+	path = [NSBezierPath bezierPathByPerformingBooleanOp:op
+												 onPaths:paths];
+
+	LogEvent_(kInfoEvent, @"boolean op %d on %lu objects, result has %ld elements", op, (unsigned long)[objects count], (long)[path elementCount]);
+
+	if ([path isEmpty]) {
+		NSBeep();
+		return nil;
+	}
+
+	DKDrawableObject* bottom = [objects objectAtIndex:0];
+	DKDrawableObject* result = [self objectWithPath:path
+										 likeObject:bottom];
+	NSUInteger indx = [self indexOfObject:bottom];
+
+	[self recordSelectionForUndo];
+	[self removeObjectsInArray:objects];
+	[self addObject:result
+			atIndex:indx];
+	[self replaceSelectionWithObject:result];
+	[self commitSelectionUndoWithActionName:actionName];
+
+	return result;
+}
+
+#pragma mark -
+
+- (NSBezierPath*)booleanOperandPathForObject:(DKDrawableObject*)obj
+{
+	if ([obj isKindOfClass:[DKShapeGroup class]])
+		return [(DKShapeGroup*)obj combinedPathOfGroupedObjects];
+
+	return [obj renderingPath];
+}
+
+- (DKDrawableObject*)objectWithPath:(NSBezierPath*)path likeObject:(DKDrawableObject*)anObject
+{
+	// the base classes are used, as subclasses such as arcs or text shapes can't take on an arbitrary path
+
+	if ([anObject isKindOfClass:[DKDrawablePath class]])
+		return [DKDrawablePath drawablePathWithBezierPath:path
+												withStyle:[anObject style]];
+	else
+		return [DKDrawableShape drawableShapeWithBezierPath:path
+												  withStyle:[anObject style]];
+}
+
+@end
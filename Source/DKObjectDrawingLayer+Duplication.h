@@ -12,6 +12,15 @@ Some handy methods for implementing various kinds of object duplications.
 */
 @interface DKObjectDrawingLayer (Duplication)
 
+/** @brief Sets whether duplicates are made as symbol instances
+
+ When set, the copies of shapes and paths made by the methods here are DKSymbolInstances, all the copies of one object sharing a
+ single symbol, and so its path and style. Objects that can't be made into symbols are copied as usual. The default is NO.
+ @param asInstances YES to duplicate shapes and paths as symbol instances
+ */
++ (void)setDuplicatesAsSymbolInstances:(BOOL)asInstances;
++ (BOOL)duplicatesAsSymbolInstances;
+
 /** @brief Duplicates one or more objects radially around a common centre
 
  Objects in the result are obtained by copying the objects in the original list, and so will have the
@@ -70,4 +79,13 @@ Some handy methods for implementing various kinds of object duplications.
 				 numberOfCopies:(NSInteger)nCopies
 						insetBy:(CGFloat)inset;
 
+/** @brief Adds the objects made by one of the duplication methods to the layer as a single change
+
+ The copies are inserted above the existing objects in one step, so the storage is updated once, the area they cover is redrawn
+ once, and a single undo removes them all. They become the selection.
+ @param copies the copies to add, which must not belong to any layer
+ @param actionName the undo action name, or nil for "Duplicate"
+ */
+- (void)addDuplicates:(NSArray*)copies actionName:(NSString*)actionName;
+
 @end
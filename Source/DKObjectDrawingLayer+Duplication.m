@@ -7,11 +7,51 @@
 #import "DKObjectDrawingLayer+Duplication.h"
 
 #import "DKDrawableObject.h"
+#import "DKSymbolInstance.h"
 #import "LogEvent.h"
 
+static BOOL sDuplicatesAsSymbolInstances = NO;
+
+// returns the objects that the copies are made from - either the originals, or, when duplicating as symbol instances, an instance
+// for each original that can be one, which every copy of it then shares its symbol with
+
+static NSArray* duplicationMasters(NSArray* objects)
+{
+	if (!sDuplicatesAsSymbolInstances)
+		return objects;
+
+	NSMutableArray* masters = [NSMutableArray arrayWithCapacity:[objects count]];
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* o;
+	DKDrawableObject* master;
+
+	while ((o = [iter nextObject])) {
+		master = [DKSymbolInstance instanceWithObject:o];
+		[masters addObject:master ? master : o];
+	}
+
+	return masters;
+}
+
 @implementation DKObjectDrawingLayer (Duplication)
 #pragma mark As a DKObjectDrawingLayer
 
+/** @brief Sets whether duplicates are made as symbol instances
+
+ When set, the copies of shapes and paths made by the methods here are DKSymbolInstances, all the copies of one object sharing a
+ single symbol, and so its path and style. Objects that can't be made into symbols are copied as usual. The default is NO.
+ @param asInstances YES to duplicate shapes and paths as symbol instances
+ */
++ (void)setDuplicatesAsSymbolInstances:(BOOL)asInstances
+{
+	sDuplicatesAsSymbolInstances = asInstances;
+}
+
++ (BOOL)duplicatesAsSymbolInstances
+{
+	return sDuplicatesAsSymbolInstances;
+}
+
 /** @brief Duplicates one or more objects radially around a common centre
 
  Objects in the result are obtained by copying the objects in the original list, and so will have the
@@ -35,6 +75,8 @@
 	NSMutableArray* result = [[NSMutableArray alloc] init];
 	NSInteger i;
 
+	objectsToDuplicate = duplicationMasters(objectsToDuplicate);
+
 	for (i = 0; i < nCopies; ++i) {
 		// copy each object
 
@@ -87,6 +129,8 @@
 	NSMutableArray* result = [[NSMutableArray alloc] init];
 	NSInteger i;
 
+	objectsToDuplicate = duplicationMasters(objectsToDuplicate);
+
 	for (i = 0; i < nCopies; ++i) {
 		// copy each object
 
@@ -182,6 +226,8 @@
 	NSMutableArray* result = [NSMutableArray array];
 	NSInteger i;
 
+	objectsToDuplicate = duplicationMasters(objectsToDuplicate);
+
 	for (i = 0; i < nCopies; ++i) {
 		NSEnumerator* iter = [objectsToDuplicate objectEnumerator];
 		DKDrawableObject* o;
@@ -218,4 +264,34 @@
 	return result;
 }
 
+/** @brief Adds the objects made by one of the duplication methods to the layer as a single change
+
+ The copies are inserted above the existing objects in one step, so the storage is updated once, the area they cover is redrawn
+ once, and a single undo removes them all. They become the selection.
+ @param copies the copies to add, which must not belong to any layer
+ @param actionName the undo action name, or nil for "Duplicate"
+ */
+- (void)addDuplicates:(NSArray*)copies actionName:(NSString*)actionName
+{
+	if ([self lockedOrHidden] || [copies count] == 0)
+		return;
+
+	if (actionName == nil)
+		actionName = NSLocalizedString(@"Duplicate", @"undo string for Duplicate");
+
+	// the selection highlights of the objects deselected and selected are collected into the same update as the copies themselves
+
+	[DKLayer beginCoalescingDisplayUpdates];
+
+	@try {
+		[self recordSelectionForUndo];
+		[self addObjectsFromArray:copies];
+		[self exchangeSelectionWithObjectsFromArray:copies];
+		[self commitSelectionUndoWithActionName:actionName];
+	}
+	@finally {
+		[DKLayer endCoalescingDisplayUpdates];
+	}
+}
+
 @end
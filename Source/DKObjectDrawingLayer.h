@@ -41,6 +41,8 @@ selected state.
 	NSArray* m_objectsPendingDrag; // temporary list of objects being dragged from the layer
 	DKDrawableObject* mKeyAlignmentObject; // the master object to which others can be aligned
 	NSRect mSelBoundsCached; // cached value of the selection bounds
+	NSRect mSelLogicalBoundsCached; // cached value of the selection's logical bounds
+	NSMutableArray* mSelectionStackingOrder; // the selected objects in stacking order, made on demand
 }
 
 // default settings:
@@ -163,6 +165,14 @@ selected state.
  */
 - (void)refreshSelectedObjects;
 
+/** @brief Causes the selection highlights of the selected objects to be redrawn
+
+ When the highlights are drawn on top, they're redrawn as an overlay (see -[DKDrawing setNeedsOverlayDisplayInRect:]), so the objects
+ themselves aren't drawn again where the view caches them. Otherwise the objects are refreshed. Used whenever the selection, or whether
+ it's shown, changes.
+ */
+- (void)refreshSelectionHighlights;
+
 /** @brief Changes the location of all objects in the selection by dx and dy
  @param dx add this much to each object's x coordinate
  @param dy add this much to each object's y coordinate
@@ -253,6 +263,26 @@ selected state.
  */
 - (BOOL)exchangeSelectionWithObjectsFromArray:(NSArray*)sel;
 
+/** @brief Adds some objects to the selection and removes others, as a single change
+
+ This is for interactive selections that change a little at a time, such as a marquee drag, where the objects entering and
+ leaving the selection are known and the rest of it needn't be looked at. One selection change notification is posted for the
+ whole change, and it is posted when the run loop next goes idle, so that a series of changes made while handling events - one
+ for each mouse drag, say - is announced once, after the views have been drawn.
+ @param toSelect the objects to add to the selection
+ @param toDeselect the objects to remove from the selection
+ @return YES if the selection changed, NO if it did not
+ */
+- (BOOL)changeSelectionByAddingObjects:(NSArray*)toSelect removingObjects:(NSArray*)toDeselect;
+
+/** @brief Keeps the cached selection bounds up to date when a selected object changes its bounds
+
+ Called by selected objects when their geometry changes.
+ @param obj the selected object
+ @param oldBounds its bounds before the change
+ */
+- (void)selectedObject:(DKDrawableObject*)obj didChangeBoundsFrom:(NSRect)oldBounds;
+
 /** @brief Scrolls one or all views attached to the drawing so that the selection within this layer is visible
  @param aView if not nil, the view to scroll. If nil, scrolls all views
  */
@@ -673,6 +703,16 @@ selected state.
  */
 - (IBAction)joinPaths:(id)sender;
 
+/** @brief Joins as many of some paths in the layer together at their ends as possible, as one undoable change
+
+ See +[DKDrawablePath joinPaths:tolerance:makeColinear:absorbedPaths:]. The paths joined onto others are removed from the layer.
+ @param paths the paths, which must belong to the layer
+ @param tol a value used to determine if end points are placed sufficiently close to be joinable
+ @param colin if YES, and the joined segments are curves, this adjusts the control points of the curve
+ @return the paths that have others joined to them, empty if no joins were made
+ */
+- (NSArray*)joinPathsInArray:(NSArray*)paths tolerance:(CGFloat)tol makeColinear:(BOOL)colin;
+
 /** @brief Applies a style to the objects in the selection
 
  The sender -representedObject must be a DKStyle. This is designed to match the menu items managed
@@ -14,17 +14,22 @@
 #import "DKShapeCluster.h"
 #import "DKRuntimeHelper.h"
 #import "NSMutableArray+DKAdditions.h"
+#import "DKKnob.h"
 #import "DKImageShape.h"
 #import "DKTextShape.h"
 #import "DKGeometryUtilities.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 #import "DKPasteboardInfo.h"
+#include <dispatch/dispatch.h>
+
+#define kDKMinimumObjectsForConcurrentAction 8 // fewer objects than this are sent a forwarded action one by one
 
 #pragma mark Contants(Non - localized)
 
 NSString* kDKLayerDidReorderObjects = @"kDKLayerDidReorderObjects";
 NSString* kDKDrawableObjectPasteboardType = @"net.apptree.drawkit.drawable";
 NSString* kDKDrawableObjectInfoPasteboardType = @"kDKDrawableObjectInfoPasteboardType";
+NSString* kDKDrawableObjectSnapshotPasteboardType = @"net.apptree.drawkit.drawable-snapshot";
 NSString* kDKLayerSelectionDidChange = @"kDKLayerSelectionDidChange";
 NSString* kDKLayerKeyObjectDidChange = @"kDKLayerKeyObjectDidChange";
 
@@ -47,8 +52,55 @@ enum {
 - (BOOL)isBufferingSelectionChanges;
 - (void)bufferObject:(id)obj forSelectionOp:(NSInteger)op;
 
+- (void)selectionDidAddObject:(DKDrawableObject*)obj;
+- (void)selectionDidRemoveObject:(DKDrawableObject*)obj;
+- (void)invalidateSelectionCaches;
+- (NSArray*)selectionInStackingOrder;
+- (void)refreshSelectionHighlightsOfObjects:(id)container;
+- (void)refreshSelectionHighlightOfObject:(DKDrawableObject*)obj;
+- (void)drawSelectionHighlightsOfObjects:(NSArray*)objects;
+- (void)invokeAction:(NSInvocation*)invocation onObjects:(NSArray*)objects;
+
 @end
 
+// one object's part in an action whose geometry is worked out on several threads
+
+typedef struct {
+	Class objectClass;
+	id input;
+	id result;
+} DKConcurrentActionJob;
+
+typedef struct {
+	SEL action;
+	DKConcurrentActionJob* jobs;
+} DKConcurrentActionBatch;
+
+static void performConcurrentActionJob(void* context, size_t i)
+{
+	DKConcurrentActionBatch* batch = (DKConcurrentActionBatch*)context;
+	DKConcurrentActionJob* job = &batch->jobs[i];
+
+	@autoreleasepool {
+		@try {
+			job->result = [[job->objectClass resultOfConcurrentAction:batch->action
+														   withInput:job->input] retain];
+		}
+		@catch (NSException* excp) {
+			// an exception mustn't escape a worker thread - the object is just left as it was
+
+			job->result = nil;
+		}
+	}
+}
+
+// whether removing <r> from a union of rects may shrink the union <u> - only rects reaching one of its edges can
+
+static BOOL rectReachesEdgeOfRect(const NSRect r, const NSRect u)
+{
+	return NSMinX(r) <= NSMinX(u) || NSMinY(r) <= NSMinY(u) || NSMaxX(r) >= NSMaxX(u) || NSMaxY(r) >= NSMaxY(u);
+}
+
 #pragma mark -
 @implementation DKObjectDrawingLayer
 #pragma mark As a DKObjectDrawingLayer
@@ -107,11 +159,11 @@ enum {
 	NSMutableArray* ao = [[NSMutableArray alloc] init];
 
 	if (![self lockedOrHidden] && [self countOfSelection] > 0) {
-		NSEnumerator* iter = [[self availableObjectsInRect:[self selectionBounds]] objectEnumerator];
+		NSEnumerator* iter = [[self selectionInStackingOrder] objectEnumerator];
 		DKDrawableObject* od;
 
 		while ((od = [iter nextObject])) {
-			if ([self isSelectedObject:od])
+			if ([od visible] && ![od locked])
 				[ao addObject:od];
 		}
 	}
@@ -128,11 +180,11 @@ enum {
 	NSMutableArray* ao = [[NSMutableArray alloc] init];
 
 	if (![self lockedOrHidden] && [self countOfSelection] > 0) {
-		NSEnumerator* iter = [[self availableObjectsInRect:[self selectionBounds]] objectEnumerator];
+		NSEnumerator* iter = [[self selectionInStackingOrder] objectEnumerator];
 		DKDrawableObject* od;
 
 		while ((od = [iter nextObject])) {
-			if ([self isSelectedObject:od] && [od isKindOfClass:aClass])
+			if ([od visible] && ![od locked] && [od isKindOfClass:aClass])
 				[ao addObject:od];
 		}
 	}
@@ -149,11 +201,11 @@ enum {
 	NSMutableArray* ao = [[NSMutableArray alloc] init];
 
 	if ([self visible] && [self countOfSelection] > 0) {
-		NSEnumerator* iter = [[self visibleObjectsInRect:[self selectionBounds]] objectEnumerator];
+		NSEnumerator* iter = [[self selectionInStackingOrder] objectEnumerator];
 		DKDrawableObject* od;
 
 		while ((od = [iter nextObject])) {
-			if ([self isSelectedObject:od])
+			if ([od visible])
 				[ao addObject:od];
 		}
 	}
@@ -192,7 +244,7 @@ enum {
 		}
 	}
 
-	//LogEvent_( kInfoEvent, @"%d objects (of %d) returned '%d' to selector '%@'", [result count], [[self selection] count], answer, NSStringFromSelector( selector ));
+	//DKTrace_( kDKTraceInfo, @"%d objects (of %d) returned '%d' to selector '%@'", [result count], [[self selection] count], answer, NSStringFromSelector( selector ));
 
 	return result;
 }
@@ -215,7 +267,7 @@ enum {
 			[result addObject:o];
 	}
 
-	//LogEvent_( kInfoEvent, @"%d objects (of %d) respond to selector '%@'", [result count], [[self selection] count], NSStringFromSelector( selector ));
+	//DKTrace_( kDKTraceInfo, @"%d objects (of %d) respond to selector '%@'", [result count], [[self selection] count], NSStringFromSelector( selector ));
 
 	return result;
 }
@@ -253,19 +305,10 @@ enum {
  */
 - (NSArray*)selectedObjectsPreservingStackingOrder
 {
-	NSMutableArray* arr = [NSMutableArray array];
-
-	if ([self countOfSelection] > 0 && ![self lockedOrHidden]) {
-		NSEnumerator* iter = [[self objectsForUpdateRect:[self selectionBounds]
-												  inView:nil] objectEnumerator];
-		DKDrawableObject* obj;
-
-		while ((obj = [iter nextObject])) {
-			if ([self isSelectedObject:obj])
-				[arr addObject:obj];
-		}
-	}
-	return arr;
+	if ([self countOfSelection] > 0 && ![self lockedOrHidden])
+		return [NSMutableArray arrayWithArray:[self selectionInStackingOrder]];
+	else
+		return [NSMutableArray array];
 }
 
 /** @brief Returns the number of objects that are visible and not locked
@@ -385,6 +428,30 @@ enum {
 	[self refreshObjectsInContainer:[self selection]];
 }
 
+- (void)refreshSelectionHighlights
+{
+	[self refreshSelectionHighlightsOfObjects:m_selection];
+}
+
+- (void)refreshSelectionHighlightsOfObjects:(id)container
+{
+	NSEnumerator* iter = [container objectEnumerator];
+	DKDrawableObject* od;
+
+	while ((od = [iter nextObject]))
+		[self refreshSelectionHighlightOfObject:od];
+}
+
+- (void)refreshSelectionHighlightOfObject:(DKDrawableObject*)obj
+{
+	// highlights drawn on top aren't part of the content, so the object needn't be drawn again, nor its cached image discarded
+
+	if ([self drawsSelectionHighlightsOnTop])
+		[[self drawing] setNeedsOverlayDisplayInRect:[obj bounds]];
+	else
+		[obj notifyVisualChange];
+}
+
 /** @brief Changes the location of all objects in the selection by dx and dy
  @param dx add this much to each object's x coordinate
  @param dy add this much to each object's y coordinate
@@ -398,10 +465,14 @@ enum {
 		NSEnumerator* iter = [arr objectEnumerator];
 		DKDrawableObject* od;
 
+		[self beginBoundsUpdateBatch];
+
 		while ((od = [iter nextObject]))
 			[od offsetLocationByX:dx
 							  byY:dy];
 
+		[self endBoundsUpdateBatch];
+
 		return YES;
 	} else
 		return NO;
@@ -428,16 +499,16 @@ enum {
 			if ([self selectionChangesAreUndoable] || [[self undoManager] isUndoing] || [[self undoManager] isRedoing])
 				[[[self undoManager] prepareWithInvocationTarget:self] setSelection:[self selection]];
 
-			[self refreshSelectedObjects];
+			[self refreshSelectionHighlights];
 			[m_selection makeObjectsPerformSelector:@selector(objectIsNoLongerSelected)];
 
 			NSMutableSet* temp = [sel mutableCopy];
 			[m_selection release];
 			m_selection = temp;
-			mSelBoundsCached = NSZeroRect;
+			[self invalidateSelectionCaches];
 
 			[m_selection makeObjectsPerformSelector:@selector(objectDidBecomeSelected)];
-			[self refreshSelectedObjects];
+			[self refreshSelectionHighlights];
 			[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerSelectionDidChange
 																object:self];
 		}
@@ -490,11 +561,11 @@ enum {
 - (void)deselectAll
 {
 	if ([self isSelectionNotEmpty]) {
-		[self refreshSelectedObjects];
+		[self refreshSelectionHighlights];
 		[m_selection makeObjectsPerformSelector:@selector(objectIsNoLongerSelected)];
 		[m_selection removeAllObjects];
 		[self hideRulerMarkers];
-		mSelBoundsCached = NSZeroRect;
+		[self invalidateSelectionCaches];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerSelectionDidChange
 															object:self];
 	}
@@ -521,8 +592,8 @@ enum {
 	if (![m_selection containsObject:obj] && ![self lockedOrHidden] && [obj objectMayBecomeSelected]) {
 		[m_selection addObject:obj];
 		[obj objectDidBecomeSelected];
-		[obj notifyVisualChange];
-		mSelBoundsCached = NSZeroRect;
+		[self refreshSelectionHighlightOfObject:obj];
+		[self selectionDidAddObject:obj];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerSelectionDidChange
 															object:self];
 	}
@@ -576,13 +647,12 @@ enum {
 			[self bufferObject:obj
 				forSelectionOp:kObjectRemove];
 		else {
-			[obj notifyVisualChange];
+			[self refreshSelectionHighlightOfObject:obj];
 			[obj objectIsNoLongerSelected];
 			[m_selection removeObject:obj];
+			[self selectionDidRemoveObject:obj];
 
 			[self updateRulerMarkersForRect:[self selectionLogicalBounds]];
-
-			mSelBoundsCached = NSZeroRect;
 			[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerSelectionDidChange
 																object:self];
 		}
@@ -600,13 +670,12 @@ enum {
 
 	if (![self lockedOrHidden]) {
 		NSSet* removeSet = [NSSet setWithArray:objs];
-		[self refreshObjectsInContainer:objs];
+		[self refreshSelectionHighlightsOfObjects:objs];
 		[objs makeObjectsPerformSelector:@selector(objectIsNoLongerSelected)];
 		[m_selection minusSet:removeSet];
+		[self invalidateSelectionCaches];
 
 		[self updateRulerMarkersForRect:[self selectionLogicalBounds]];
-
-		mSelBoundsCached = NSZeroRect;
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerSelectionDidChange
 															object:self];
 	}
@@ -661,15 +730,15 @@ enum {
 					[newSel minusSet:m_selection]; // these are not present in the old selection, so will be selected
 
 					[oldSel makeObjectsPerformSelector:@selector(objectIsNoLongerSelected)];
-					[oldSel makeObjectsPerformSelector:@selector(notifyVisualChange)];
+					[self refreshSelectionHighlightsOfObjects:oldSel];
 
 					[m_selection setSet:[NSSet setWithArray:sel]];
 
 					[newSel makeObjectsPerformSelector:@selector(objectDidBecomeSelected)];
-					[newSel makeObjectsPerformSelector:@selector(notifyVisualChange)];
+					[self refreshSelectionHighlightsOfObjects:newSel];
 					[oldSel release];
 
-					mSelBoundsCached = NSZeroRect;
+					[self invalidateSelectionCaches];
 					[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerSelectionDidChange
 																		object:self];
 					didChange = YES;
@@ -683,6 +752,62 @@ enum {
 	return didChange;
 }
 
+/** @brief Adds some objects to the selection and removes others, as a single change
+
+ This is for interactive selections that change a little at a time, such as a marquee drag, where the objects entering and
+ leaving the selection are known and the rest of it needn't be looked at. One selection change notification is posted for the
+ whole change, and it is posted when the run loop next goes idle, so that a series of changes made while handling events - one
+ for each mouse drag, say - is announced once, after the views have been drawn.
+ @param toSelect the objects to add to the selection
+ @param toDeselect the objects to remove from the selection
+ @return YES if the selection changed, NO if it did not
+ */
+- (BOOL)changeSelectionByAddingObjects:(NSArray*)toSelect removingObjects:(NSArray*)toDeselect
+{
+	if ([self lockedOrHidden])
+		return NO;
+
+	BOOL didChange = NO;
+	NSEnumerator* iter = [toDeselect objectEnumerator];
+	DKDrawableObject* od;
+
+	while ((od = [iter nextObject])) {
+		if ([m_selection containsObject:od]) {
+			[od objectIsNoLongerSelected];
+			[self refreshSelectionHighlightOfObject:od];
+			[m_selection removeObject:od];
+			[self selectionDidRemoveObject:od];
+			didChange = YES;
+		}
+	}
+
+	iter = [toSelect objectEnumerator];
+
+	while ((od = [iter nextObject])) {
+		if (![m_selection containsObject:od] && [od objectMayBecomeSelected]) {
+			[m_selection addObject:od];
+			[self selectionDidAddObject:od];
+			[od objectDidBecomeSelected];
+			[self refreshSelectionHighlightOfObject:od];
+			didChange = YES;
+		}
+	}
+
+	if (didChange) {
+		[self updateRulerMarkersForRect:[self selectionLogicalBounds]];
+
+		NSNotification* note = [NSNotification notificationWithName:kDKLayerSelectionDidChange
+															 object:self];
+
+		[[NSNotificationQueue defaultQueue] enqueueNotification:note
+												   postingStyle:NSPostWhenIdle
+												   coalesceMask:NSNotificationCoalescingOnName | NSNotificationCoalescingOnSender
+													   forModes:nil];
+	}
+
+	return didChange;
+}
+
 /** @brief Scrolls one or all views attached to the drawing so that the selection within this layer is visible
  @param aView if not nil, the view to scroll. If nil, scrolls all views
  */
@@ -828,9 +953,13 @@ enum {
 	NSEnumerator* iter = [matches objectEnumerator];
 	DKDrawableObject* o;
 
+	[self beginBulkChangeToObjects:matches];
+
 	while ((o = [iter nextObject]))
 		[o setStyle:newStyle];
 
+	[self endBulkChange];
+
 	if (selectObjects)
 		return [self exchangeSelectionWithObjectsFromArray:matches];
 	else
@@ -854,7 +983,7 @@ enum {
  */
 - (BOOL)isSelectionNotEmpty
 {
-	return [[self selection] count] > 0;
+	return [self countOfSelection] > 0;
 }
 
 /** @brief Query whether there is exactly one object selected
@@ -862,7 +991,7 @@ enum {
  */
 - (BOOL)isSingleObjectSelected
 {
-	return [[self selection] count] == 1;
+	return [self countOfSelection] == 1;
 }
 
 /** @brief Query whether the selection contains any objects matching the given class
@@ -887,33 +1016,103 @@ enum {
  */
 - (NSRect)selectionBounds
 {
-	//if( !NSIsEmptyRect( mSelBoundsCached ))
-	//	return mSelBoundsCached;
-
-	mSelBoundsCached = NSZeroRect;
+	// the cached bounds are kept up to date as objects are selected and deselected and as selected objects change their
+	// geometry, and only worked out again from every selected object when an edge object goes away
 
-	if ([self isSelectionNotEmpty]) {
+	if (![self lockedOrHidden] && NSEqualRects(mSelBoundsCached, NSZeroRect)) {
 		DKDrawableObject* od;
-		NSEnumerator* iter = [[self selection] objectEnumerator];
+		NSEnumerator* iter = [m_selection objectEnumerator];
 
 		while ((od = [iter nextObject]))
 			mSelBoundsCached = UnionOfTwoRects(mSelBoundsCached, [od bounds]);
 	}
-	return mSelBoundsCached;
+	return [self lockedOrHidden] ? NSZeroRect : mSelBoundsCached;
 }
 
 - (NSRect)selectionLogicalBounds
 {
-	NSRect lbr = NSZeroRect;
-
-	if ([self isSelectionNotEmpty]) {
+	if (![self lockedOrHidden] && NSEqualRects(mSelLogicalBoundsCached, NSZeroRect)) {
 		DKDrawableObject* od;
-		NSEnumerator* iter = [[self selection] objectEnumerator];
+		NSEnumerator* iter = [m_selection objectEnumerator];
 
 		while ((od = [iter nextObject]))
-			lbr = UnionOfTwoRects(lbr, [od logicalBounds]);
+			mSelLogicalBoundsCached = UnionOfTwoRects(mSelLogicalBoundsCached, [od logicalBounds]);
+	}
+	return [self lockedOrHidden] ? NSZeroRect : mSelLogicalBoundsCached;
+}
+
+/** @brief Keeps the cached selection bounds up to date when a selected object changes its bounds
+
+ Called by selected objects when their geometry changes.
+ @param obj the selected object
+ @param oldBounds its bounds before the change
+ */
+- (void)selectedObject:(DKDrawableObject*)obj didChangeBoundsFrom:(NSRect)oldBounds
+{
+	if (rectReachesEdgeOfRect(oldBounds, mSelBoundsCached))
+		mSelBoundsCached = NSZeroRect;
+	else
+		mSelBoundsCached = UnionOfTwoRects(mSelBoundsCached, [obj bounds]);
+
+	// the old logical bounds aren't known, so these are always worked out again
+
+	mSelLogicalBoundsCached = NSZeroRect;
+}
+
+#pragma mark -
+
+// these private methods maintain the cached bounds and stacking order of the selection. The bounds grow as objects are selected, and are
+// only worked out again when an object that reaches their edge is deselected. The stacking order is made when first needed after the
+// selection or the stacking of the layer's objects changes; deselecting an object simply removes it.
+
+- (void)selectionDidAddObject:(DKDrawableObject*)obj
+{
+	if (!NSEqualRects(mSelBoundsCached, NSZeroRect))
+		mSelBoundsCached = UnionOfTwoRects(mSelBoundsCached, [obj bounds]);
+
+	if (!NSEqualRects(mSelLogicalBoundsCached, NSZeroRect))
+		mSelLogicalBoundsCached = UnionOfTwoRects(mSelLogicalBoundsCached, [obj logicalBounds]);
+
+	[mSelectionStackingOrder release];
+	mSelectionStackingOrder = nil;
+}
+
+- (void)selectionDidRemoveObject:(DKDrawableObject*)obj
+{
+	if (rectReachesEdgeOfRect([obj bounds], mSelBoundsCached))
+		mSelBoundsCached = NSZeroRect;
+
+	if (rectReachesEdgeOfRect([obj logicalBounds], mSelLogicalBoundsCached))
+		mSelLogicalBoundsCached = NSZeroRect;
+
+	[mSelectionStackingOrder removeObjectIdenticalTo:obj];
+}
+
+- (void)invalidateSelectionCaches
+{
+	mSelBoundsCached = NSZeroRect;
+	mSelLogicalBoundsCached = NSZeroRect;
+
+	[mSelectionStackingOrder release];
+	mSelectionStackingOrder = nil;
+}
+
+- (NSArray*)selectionInStackingOrder
+{
+	if (mSelectionStackingOrder == nil) {
+		mSelectionStackingOrder = [[NSMutableArray alloc] initWithCapacity:[m_selection count]];
+
+		NSEnumerator* iter = [[self objectsForUpdateRect:[self selectionBounds]
+												  inView:nil] objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [iter nextObject])) {
+			if ([m_selection containsObject:obj])
+				[mSelectionStackingOrder addObject:obj];
+		}
 	}
-	return lbr;
+
+	return mSelectionStackingOrder;
 }
 
 #pragma mark -
@@ -957,7 +1156,7 @@ enum {
 
 	m_selectionUndo = [[self selection] retain];
 
-	LogEvent_(kReactiveEvent, @"recorded selection for possible undo, count = %d", mUndoCount);
+	DKTrace_(kDKTraceReactive, @"recorded selection for possible undo, count = %d", mUndoCount);
 }
 
 /** @brief Sends the recorded selection state to the undo manager and tags it with the given action name
@@ -987,7 +1186,7 @@ enum {
 			// if selection hasn't changed, do nothing
 
 			if ([self selectionHasChangedFromRecorded]) {
-				LogEvent_(kStateEvent, @"selection changed - recording for undo");
+				DKTrace_(kDKTraceState, @"selection changed - recording for undo");
 
 				[[[self undoManager] prepareWithInvocationTarget:self] setSelection:m_selectionUndo];
 
@@ -1112,7 +1311,8 @@ enum {
 /** @brief Copies the selection to the given pasteboard in a variety of formats
 
  Data is recorded as native data, PDF and TIFF. Note that locked objects can't be copied as
- native types, but images are still copied.
+ native types, but images are still copied. The native data, and the images unless some of the
+ selection is locked, are provided by the selection's snapshot when they are asked for, not written here.
  @param pb the pasteboard to copy to
  */
 - (void)copySelectionToPasteboard:(NSPasteboard*)pb
@@ -1124,11 +1324,19 @@ enum {
 
 	// if the selection is empty, remove the native type from the list
 
-	if ([sel count] == 0)
+	if ([sel count] == 0) {
 		[dataTypes removeObject:kDKDrawableObjectPasteboardType];
+		[pb declareTypes:dataTypes
+				   owner:self];
+	} else {
+		// DK's native pasteboard type is an archived array of the selection, but archiving is deferred - a snapshot of the
+		// selection becomes the pasteboard's owner, serves pastes within this process directly, and only archives the objects
+		// if the native type is asked for.
 
-	[pb declareTypes:dataTypes
-			   owner:self];
+		DKPasteboardSnapshot* snapshot = [DKPasteboardSnapshot snapshotWithObjects:sel];
+		[snapshot declareTypes:dataTypes
+				  onPasteboard:pb];
+	}
 
 	// add an info object to the pasteboard - allows info about the objects to be read without dearchiving
 	// the objects themselves.
@@ -1137,13 +1345,6 @@ enum {
 	[pbInfo writeToPasteboard:pb];
 
 	if ([sel count] > 0) {
-		// convert selection to data by archiving it.
-		// DK's native pasteboard type is simply an archived array of the selection.
-
-		NSData* pbdata = [NSKeyedArchiver archivedDataWithRootObject:sel];
-		[pb setData:pbdata
-			forType:kDKDrawableObjectPasteboardType];
-
 		// if a single object is selected, it is offered the chance to add further data to the clipboard
 
 		if ([sel count] == 1) {
@@ -1152,16 +1353,21 @@ enum {
 		}
 	}
 
-	// add image of selection in PDF format:
-	NSData* pdf = [self pdfDataOfSelectedObjects];
-	[pb setData:pdf
-		forType:NSPDFPboardType];
+	// the snapshot renders the images when they're asked for, from its copies - unless there are locked objects in the selection,
+	// which it doesn't have but which still appear in the images
+
+	if ([sel count] == 0 || [sel count] != [self countOfSelection]) {
+		// add image of selection in PDF format:
+		NSData* pdf = [self pdfDataOfSelectedObjects];
+		[pb setData:pdf
+			forType:NSPDFPboardType];
 
-	// and TIFF format:
+		// and TIFF format:
 
-	NSImage* si = [self imageOfSelectedObjects];
-	[pb setData:[si TIFFRepresentation]
-		forType:NSTIFFPboardType];
+		NSImage* si = [self imageOfSelectedObjects];
+		[pb setData:[si TIFFRepresentation]
+			forType:NSTIFFPboardType];
+	}
 
 	[dataTypes release];
 }
@@ -1177,7 +1383,13 @@ enum {
  */
 - (void)setDrawsSelectionHighlightsOnTop:(BOOL)onTop
 {
-	m_drawSelectionOnTop = onTop;
+	if (onTop != m_drawSelectionOnTop) {
+		m_drawSelectionOnTop = onTop;
+
+		// highlights drawn in situ are part of the content, which has to be drawn again with or without them
+
+		[self refreshObjectsInContainer:m_selection];
+	}
 }
 
 /** @brief Draw selection highlights on top or in situ?
@@ -1222,7 +1434,7 @@ enum {
 {
 	if (vis != m_selectionVisible) {
 		m_selectionVisible = vis;
-		[self refreshSelectedObjects];
+		[self refreshSelectionHighlights];
 	}
 }
 
@@ -1461,7 +1673,7 @@ enum {
 	[self recordSelectionForUndo];
 
 	NSPasteboard* pb = [NSPasteboard generalPasteboard];
-	NSArray* objects = [DKDrawableObject nativeObjectsFromPasteboard:pb];
+	NSArray* objects = [self nativeObjectsFromPasteboard:pb];
 	BOOL isContextMenu = ([sender tag] == kDKPasteCommandContextualMenuTag);
 	NSPoint cp = NSZeroPoint;
 	NSView* view = (NSView*)[[NSApp keyWindow] firstResponder];
@@ -2037,10 +2249,6 @@ enum {
 {
 	if (![self lockedOrHidden]) {
 		NSArray* sp = [self selectedAvailableObjectsOfClass:[DKDrawablePath class]];
-		NSEnumerator* iter = [sp objectEnumerator];
-		DKDrawablePath* path;
-		DKDrawablePath* a = nil;
-		NSInteger joinsMade = 0;
 
 		if ([sp count] < 2)
 			return;
@@ -2056,28 +2264,52 @@ enum {
 
 		[self recordSelectionForUndo];
 
-		while ((path = [iter nextObject])) {
-			// first path is "master" and dictates style etc of result
-
-			if (a == nil)
-				a = path;
-			else {
-				if ([a join:path
-						   tolerance:tolerance
-						makeColinear:colin]) {
-					[self removeObject:path];
-					++joinsMade;
-				}
-			}
-		}
+		// the first path of each chain is its "master" and dictates style etc of the result
 
-		if (joinsMade > 0)
+		NSArray* joined = [self joinPathsInArray:sp
+									   tolerance:tolerance
+									makeColinear:colin];
+
+		if ([joined count] > 0)
 			[self commitSelectionUndoWithActionName:NSLocalizedString(@"Join Paths", @"undo string for join paths")];
 		else
 			NSBeep();
 	}
 }
 
+- (NSArray*)joinPathsInArray:(NSArray*)paths tolerance:(CGFloat)tol makeColinear:(BOOL)colin
+{
+	if ([self lockedOrHidden] || [paths count] < 2)
+		return [NSArray array];
+
+	// the new paths are set as one bulk change, and the paths they absorbed removed in one go, so that however many are joined it is
+	// undone as a whole
+
+	NSArray* absorbed = nil;
+	NSArray* joined = nil;
+
+	[DKLayer beginCoalescingDisplayUpdates];
+	[self beginBoundsUpdateBatch];
+	[self beginBulkChangeToObjects:paths];
+
+	@try {
+		joined = [DKDrawablePath joinPaths:paths
+								 tolerance:tol
+							  makeColinear:colin
+							 absorbedPaths:&absorbed];
+	}
+	@finally {
+		[self endBulkChange];
+		[self endBoundsUpdateBatch];
+		[DKLayer endCoalescingDisplayUpdates];
+	}
+
+	if ([absorbed count] > 0)
+		[self removeObjectsInArray:absorbed];
+
+	return joined;
+}
+
 /** @brief Applies a style to the objects in the selection
 
  The sender -representedObject must be a DKStyle. This is designed to match the menu items managed
@@ -2090,8 +2322,13 @@ enum {
 
 	if (sender && repObject && [self isSelectionNotEmpty]) {
 		if ([repObject isKindOfClass:[DKStyle class]]) {
-			[[self selectedAvailableObjects] makeObjectsPerformSelector:@selector(setStyle:)
-															 withObject:repObject];
+			NSArray* objects = [self selectedAvailableObjects];
+
+			[self beginBulkChangeToObjects:objects];
+			[objects makeObjectsPerformSelector:@selector(setStyle:)
+									 withObject:repObject];
+			[self endBulkChange];
+
 			[[self undoManager] setActionName:NSLocalizedString(@"Apply Style", @"undo action for Apply Style")];
 		}
 	}
@@ -2100,6 +2337,16 @@ enum {
 #pragma mark -
 #pragma mark As a DKObjectOwnerLayer
 
+/** @brief Whether the layer can be rendered on another thread and composited
+
+ Not while the selection is shown in inactive layers, since drawing it uses the drawing's knobs.
+ @return YES if the layer can be composited
+ */
+- (BOOL)isSuitableForConcurrentCompositing
+{
+	return ![[self class] selectionIsShownWhenInactive] && [super isSuitableForConcurrentCompositing];
+}
+
 /** @brief Performs a hit test but also returns the hit part code
 
  See notes for hitTest:
@@ -2182,6 +2429,34 @@ enum {
 	}
 }
 
+/** @brief Moves an object to a new stacking position
+
+ Moving a selected object changes the stacking order of the selection, which is made again when next needed
+ @param obj the object to move
+ @param indx the index it should be moved to
+ */
+- (void)moveObject:(DKDrawableObject*)obj toIndex:(NSUInteger)indx
+{
+	[super moveObject:obj
+			  toIndex:indx];
+
+	if ([self isSelectedObject:obj]) {
+		[mSelectionStackingOrder release];
+		mSelectionStackingOrder = nil;
+	}
+}
+
+/** @brief Replaces all of the layer's objects
+
+ The selection's cached bounds and stacking order are discarded, as the selected objects may have been restacked
+ @param objs the new objects
+ */
+- (void)setObjects:(NSArray*)objs
+{
+	[super setObjects:objs];
+	[self invalidateSelectionCaches];
+}
+
 /** @brief Removes objects from the indexes listed by the set
 
  If the indexes are present in the selection, they are removed
@@ -2240,13 +2515,19 @@ enum {
 			@autoreleasepool {
 
 				BOOL screen = [NSGraphicsContext currentContextDrawingToScreen];
-				BOOL drawSelected = [self selectionVisible] && screen && ([self isActive] || [[self class] selectionIsShownWhenInactive]) && ![self locked];
+				BOOL overlay = [self drawsSelectionHighlightsOnTop] && [aView isKindOfClass:[DKDrawingView class]] && [aView drawsSelectionAsOverlay];
+				BOOL drawSelected = [self selectionVisible] && screen && ([self isActive] || [[self class] selectionIsShownWhenInactive]) && ![self locked] && !overlay;
+				BOOL outlines = [self drawsOutlinesOnlyInView:aView];
 				NSArray* objectsToDraw = [self objectsForUpdateRect:rect
 															 inView:aView];
 
 				// draw the objects
 
-				if (!drawSelected || [self drawsSelectionHighlightsOnTop]) {
+				if (outlines) {
+					[self drawOutlinesOfObjects:objectsToDraw];
+				} else if ((!drawSelected || [self drawsSelectionHighlightsOnTop]) && [self drawsSimpleStylesInBatches]) {
+					[self drawObjectsInBatches:objectsToDraw];
+				} else if (!drawSelected || [self drawsSelectionHighlightsOnTop]) {
 					
 					[objectsToDraw enumerateObjectsUsingBlock:^(DKDrawableObject* obj,NSUInteger __unused inIndex,BOOL* __unused outShouldStop) {
 						[obj drawContentWithSelectedState:NO];
@@ -2260,16 +2541,10 @@ enum {
 
 				}
 
-				// draw the selection on top if set to do so
+				// draw the selection on top if set to do so - outlines have no content to draw it with, so it always goes on top of them
 
-				if ([self drawsSelectionHighlightsOnTop] && drawSelected) {
-					
-					[objectsToDraw enumerateObjectsUsingBlock:^(DKDrawableObject* obj,NSUInteger __unused inIndex,BOOL* __unused outShouldStop) {
-						if ([self isSelectedObject:obj])
-							[obj drawSelectedState];
-					}];
-					
-				}
+				if (([self drawsSelectionHighlightsOnTop] || outlines) && drawSelected)
+					[self drawSelectionHighlightsOfObjects:objectsToDraw];
 			}
 		}
 
@@ -2294,13 +2569,59 @@ enum {
 	RESTORE_GRAPHICS_CONTEXT
 }
 
+/** @brief Draws the selection highlights over content drawn from a view's tile cache
+
+ Only when the highlights are drawn on top - otherwise they're part of the content.
+ @param rect the area being updated
+ @param aView the view doing the rendering
+ */
+- (void)drawOverlayRect:(NSRect)rect inView:(DKDrawingView*)aView
+{
+#pragma unused(rect)
+
+	if (![self drawsSelectionHighlightsOnTop] || ![self selectionVisible] || [self locked] || [m_selection count] == 0)
+		return;
+
+	if (!([self isActive] || [[self class] selectionIsShownWhenInactive]))
+		return;
+
+	NSArray* sel = [self selectedObjectsPreservingStackingOrder];
+	NSMutableArray* objectsToDraw = [NSMutableArray arrayWithCapacity:[sel count]];
+	NSEnumerator* iter = [sel objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject])) {
+		if ([obj visible] && [aView needsToDrawRect:[obj bounds]])
+			[objectsToDraw addObject:obj];
+	}
+
+	[self drawSelectionHighlightsOfObjects:objectsToDraw];
+}
+
+- (void)drawSelectionHighlightsOfObjects:(NSArray*)objects
+{
+	// the knobs for all the selected objects are collected and drawn together
+
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* obj;
+
+	[[self knobs] beginDrawingBatch];
+
+	while ((obj = [iter nextObject])) {
+		if ([self isSelectedObject:obj])
+			[obj drawSelectedState];
+	}
+
+	[[self knobs] endDrawingBatch];
+}
+
 /**
  Refreshes the selection when the layer becomes active
  */
 - (void)layerDidBecomeActiveLayer
 {
 	[super layerDidBecomeActiveLayer];
-	[self refreshSelectedObjects];
+	[self refreshSelectionHighlights];
 }
 
 /**
@@ -2308,7 +2629,7 @@ enum {
  */
 - (void)layerDidResignActiveLayer
 {
-	[self refreshSelectedObjects];
+	[self refreshSelectionHighlights];
 	[super layerDidResignActiveLayer];
 }
 
@@ -2417,7 +2738,7 @@ enum {
 {
 	if (locked != [self locked]) {
 		[super setLocked:locked];
-		[self refreshSelectedObjects];
+		[self refreshSelectionHighlights];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerSelectionDidChange
 															object:self];
 	}
@@ -2487,7 +2808,7 @@ enum {
 		cp = [[self currentView] convertPoint:cp
 									 fromView:nil];
 
-		//	LogEvent_(kUserEvent, @"drag pt = %@", NSStringFromPoint( cp ));
+		//	DKTrace_(kDKTraceUser, @"drag pt = %@", NSStringFromPoint( cp ));
 
 		DKDrawableObject* target = [self hitTest:cp];
 
@@ -2527,7 +2848,7 @@ enum {
 
 		if (availableType != nil) {
 			// yes, so pass the drag info to the target and let it get on with it
-			//	LogEvent_(kReactiveEvent, @"passing drop to target = %@, availableType = %@", target, availableType );
+			//	DKTrace_(kDKTraceReactive, @"passing drop to target = %@, availableType = %@", target, availableType );
 
 			wasHandled = [(id<NSDraggingDestination>)target performDragOperation:sender];
 		}
@@ -2563,7 +2884,7 @@ enum {
 #pragma unused(aPoint)
 #pragma unused(operation)
 
-	//	LogEvent_(kReactiveEvent, @"drag ended - cleaning up pending list");
+	//	DKTrace_(kDKTraceReactive, @"drag ended - cleaning up pending list");
 
 	// if the pending drag list still exists, re-show all the objects in it
 
@@ -2583,16 +2904,91 @@ enum {
 #pragma mark As an NSObject
 - (void)dealloc
 {
-	//	LogEvent_(kReactiveEvent, @"dealloc - DKObjectDrawingLayer");
+	//	DKTrace_(kDKTraceReactive, @"dealloc - DKObjectDrawingLayer");
 
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 
 	[m_selectionUndo release];
 	[m_selection release];
+	[mSelectionStackingOrder release];
 
 	[super dealloc];
 }
 
+/** @brief Sends an action to several objects as one change
+
+ The objects are changed in one undo group and one batch of storage updates. If there are enough of them, each is first
+ asked to split the action (see -[DKDrawableObject inputForConcurrentAction:]); the geometry of those that can is then worked
+ out concurrently, and the results applied here. Objects that can't split the action are sent it in the ordinary way.
+ @param invocation the action
+ @param objects the objects to send it to
+ */
+- (void)invokeAction:(NSInvocation*)invocation onObjects:(NSArray*)objects
+{
+	SEL action = [invocation selector];
+	NSUInteger i, j, count = [objects count], jobCount = 0;
+	DKConcurrentActionBatch batch;
+	DKDrawableObject** jobObjects = calloc(count, sizeof(DKDrawableObject*));
+	DKDrawableObject* od;
+
+	batch.action = action;
+	batch.jobs = calloc(count, sizeof(DKConcurrentActionJob));
+
+	// the inputs are captured here, on the main thread, so the workers never look at the objects themselves
+
+	if (count >= kDKMinimumObjectsForConcurrentAction) {
+		for (i = 0; i < count; ++i) {
+			od = [objects objectAtIndex:i];
+
+			id input = [od inputForConcurrentAction:action];
+
+			if (input) {
+				batch.jobs[jobCount].objectClass = [od class];
+				batch.jobs[jobCount].input = [input retain];
+				jobObjects[jobCount++] = od;
+			}
+		}
+	}
+
+	NSUndoManager* um = [self undoManager];
+
+	[um beginUndoGrouping];
+	[self beginBoundsUpdateBatch];
+
+	@try {
+		if (jobCount > 0) {
+			DKTrace_(kDKTraceInfo, @"working out '%@' for %lu objects concurrently", NSStringFromSelector(action), (unsigned long)jobCount);
+
+			dispatch_apply_f(jobCount, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &batch, performConcurrentActionJob);
+		}
+
+		// jobs were made in the same order as the objects, so they can be matched up in one pass
+
+		for (i = j = 0; i < count; ++i) {
+			od = [objects objectAtIndex:i];
+
+			if (j < jobCount && jobObjects[j] == od) {
+				[od applyResult:batch.jobs[j].result
+					ofConcurrentAction:action];
+				++j;
+			} else
+				[invocation invokeWithTarget:od];
+		}
+	}
+	@finally {
+		[self endBoundsUpdateBatch];
+		[um endUndoGrouping];
+
+		for (j = 0; j < jobCount; ++j) {
+			[batch.jobs[j].input release];
+			[batch.jobs[j].result release];
+		}
+
+		free(batch.jobs);
+		free(jobObjects);
+	}
+}
+
 /** @brief Allows actions to be retargeted on single selected objects directly
 
  Commands can be implemented by a selected objects that wants to make use of them - this makes
@@ -2614,11 +3010,8 @@ enum {
 			// isolation.
 
 			[self beginBufferingSelectionChanges];
-			NSEnumerator* iter = [responders objectEnumerator];
-
-			while ((od = [iter nextObject]))
-				[invocation invokeWithTarget:od];
-
+			[self invokeAction:invocation
+					 onObjects:[responders allObjects]];
 			[self endBufferingSelectionChanges];
 		} else
 			[self doesNotRecognizeSelector:aSelector];
@@ -2699,7 +3092,7 @@ enum {
 - (id)initWithCoder:(NSCoder*)coder
 {
 	NSAssert(coder != nil, @"Expected valid coder");
-	//	LogEvent_(kFileEvent, @"decoding object drawing layer %@", self);
+	//	DKTrace_(kDKTraceFile, @"decoding object drawing layer %@", self);
 
 	self = [super initWithCoder:coder];
 	if (self != nil) {
@@ -8,7 +8,15 @@
 #import "DKObjectStorageProtocol.h"
 #import "DKDrawableContainerProtocol.h"
 
-@class DKDrawableObject, DKStyle;
+@class DKDrawableObject, DKStyle, DKObjectSnapshot, DKObjectOwnerLayer, DKLayerHitIndex, DKLayerObjectIndex, DKLayerVisibleSet, DKLayerObjectBuilder, DKStorageTuner;
+
+/** @brief Supplies the objects of a layer whose objects are loaded on first use.
+*/
+@protocol DKLayerObjectLoader <NSObject>
+
+- (NSArray*)objectsForLayer:(DKObjectOwnerLayer*)layer;
+
+@end
 
 // caching options
 
@@ -36,15 +44,12 @@ Layer caching:
 
 When a layer is NOT active, it may boost drawing performance to cache the layer's contents offscreen. This is especially beneficial
 if you are using many layers. By setting the cache option, you can control how caching is done. If set to "none", objects
-are never drawn using a cache, but simply drawn in the usual way. If "pdf", the cache is an NSPDFImageRep, which stores the image
-as a PDF and so draws it at full vector quality at all zoom scales. If "CGLayer", an offscreen CGLayer is used which gives the
-fastest rendering but will show pixellation at higher zooms. If both pdf and CGLayer are set, both caches will be created and
-the CGLayer one used when DKDrawing has its "low quality" hint set, and the PDF rep otherwise.
-
-The cache is only used for screen drawing.
- 
-NOTE: PDF caching has been shown to be actually slower when there are many objects, espcially with advanced storage in use. This is
-because it's an all-or-nothing rendering proposition which direct drawing of a layer's objects is not.
+are never drawn using a cache, but simply drawn in the usual way. If "pdf" or "CGLayer" - they are treated alike - the content
+is cached as tiles of bitmaps (see DKDrawingTileCache) rendered at the view's scale, kept separately for each scale so the layer
+stays sharp when zoomed. A change to an object only discards the tiles under it, and the tiles of inactive layers are discarded if
+memory runs short, to be rendered again as they're next drawn.
+
+The cache is only used for screen drawing, and not while the layer is being edited.
 */
 @interface DKObjectOwnerLayer : DKLayer <NSCoding, NSDraggingDestination, DKDrawableContainer> {
 @private
@@ -60,6 +65,21 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
 	BOOL m_recordPasteOffset; // set to YES following a paste, and NO following a drag. When YES, paste offset is recorded.
 	NSInteger mPasteboardLastChange; // last change count recorded during a paste
 	NSInteger mPasteCount; // number of repeated paste operations since last new paste
+	BOOL mDrawsInBatches; // YES to draw runs of objects sharing a simple style together
+	BOOL mUsesSnapshotUndo; // YES to undo bulk changes from a before and after snapshot of the objects
+	NSUInteger mBulkChangeLevel; // nesting level of -beginBulkChangeToObjects:
+	DKObjectSnapshot* mBulkChangeSnapshot; // the snapshot of the bulk change in progress, if any
+	CFMutableSetRef mChangedObjects; // objects changed since -resetObjectChanges, not retained
+	id<DKLayerObjectLoader> mPendingObjectLoader; // supplies the objects the first time the storage is needed, if they haven't been loaded yet
+	DKLayerHitIndex* mHitIndex; // where the objects are, to skip hit-testing the storage where there are none
+	DKLayerObjectIndex* mObjectIndex; // the objects by style and class, made when first asked for
+	NSRect mObjectBoundsUnion; // the union of the visible objects' bounds, if mObjectBoundsValid
+	BOOL mObjectBoundsValid;
+	DKLayerVisibleSet* mVisibleSet; // the objects each view last showed, if mCachesVisibleObjects
+	BOOL mCachesVisibleObjects;
+	CFMutableDictionaryRef mFrozenObjects; // copies of unchanged objects made for snapshots of the drawing, keyed by object not retained
+	DKStorageTuner* mStorageTuner; // moves the layer to the storage that suits its use, if it adapts its storage
+	NSUInteger mBoundsBatchLevel; // nesting level of -beginBoundsUpdateBatch
 @protected
 	BOOL mShowStorageDebugging; // if YES, draws the debugging path for the storage on top (debugging feature only)
 }
@@ -79,6 +99,68 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
  */
 - (id<DKObjectStorage>)storage;
 
+/** @brief Sets an object that will supply the layer's objects the first time they are needed
+
+ Used when opening a drawing so that layers that aren't shown don't need to be decoded until something asks for their objects, for
+ example by showing the layer. The objects are added with undo registration disabled, and the loader is then released.
+ @param loader the loader, or nil
+ */
+- (void)setPendingObjectLoader:(id<DKLayerObjectLoader>)loader;
+
+/** @brief Whether the layer's objects have yet to be loaded
+ @return YES if a loader is waiting to supply the objects
+ */
+- (BOOL)hasPendingObjects;
+
+/** @brief Loads the layer's objects now, if they haven't been loaded yet
+ */
+- (void)loadPendingObjects;
+
+/** @brief Starts a batch of bounds changes
+
+ While a batch is open, the storage may defer re-indexing objects whose bounds change until the batch ends, which is much
+ faster when many objects are moved at once (e.g. dragging a large selection). Batches may be nested; each call must be balanced
+ by a call to -endBoundsUpdateBatch. Has no effect if the storage doesn't support batching.
+ */
+- (void)beginBoundsUpdateBatch;
+
+/** @brief Ends a batch of bounds changes
+
+ When the outermost batch ends, the storage applies all deferred bounds changes in one pass.
+ */
+- (void)endBoundsUpdateBatch;
+
+/** @brief Sets whether new layers choose their own storage class
+
+ Applies to layers made or decoded after it is set. The default is NO.
+ @param adapts YES for new layers to adapt their storage
+ */
++ (void)setAdaptsStorageByDefault:(BOOL)adapts;
++ (BOOL)adaptsStorageByDefault;
+
+/** @brief Sets whether the layer moves itself to the storage class that suits how it's used
+
+ When YES, a DKStorageTuner watches the layer's queries and changes, and replaces the storage with one of a better class when that would
+ clearly pay for itself. See DKStorageTuner. Not archived.
+ @param adapts YES to adapt the storage, NO to keep the storage it has
+ */
+- (void)setAdaptsStorage:(BOOL)adapts;
+- (BOOL)adaptsStorage;
+
+/** @brief Returns the layer's storage tuner
+ @return the tuner, or nil if the layer doesn't adapt its storage
+ */
+- (DKStorageTuner*)storageTuner;
+
+/** @brief Moves the layer's objects into new storage of a class
+
+ The new storage is fully built before it replaces the old, in one step. The objects, their order and the selection are unchanged, and
+ nothing is recorded for undo. Refused while the objects are being loaded, changed in bulk, or moved in a bounds update batch.
+ @param aClass a class conforming to DKObjectStorage
+ @return YES if the storage was changed, NO if it couldn't be changed now
+ */
+- (BOOL)changeStorageToClass:(Class)aClass;
+
 // as a container for a DKDrawableObject:
 
 /** @brief Returns the layer of a drawable's container - since this is that layer, returns self
@@ -100,6 +182,22 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
  */
 - (NSArray*)objects; // KVC/KVO compliant
 
+/** @brief Returns a builder for a large number of new objects, using the same kind of storage as the layer
+
+ The builder can be filled and finished on another thread, then given to -setObjectsFromBuilder:. See DKLayerObjectBuilder.
+ @return a new builder
+ */
+- (DKLayerObjectBuilder*)objectBuilder;
+
+/** @brief Replaces the layer's objects with those collected by a builder, as one undoable change
+
+ The builder's storage, already loaded and indexed, becomes the layer's storage, and the whole layer is redrawn once. Undoing swaps the
+ previous storage back in, just as it was. The objects already in the layer are replaced - add them to the builder first to keep them.
+ The builder is finished first if it hasn't been, and can't be used again.
+ @param builder the builder
+ */
+- (void)setObjectsFromBuilder:(DKLayerObjectBuilder*)builder;
+
 /** @brief Returns objects that are available to the user, that is, not locked or invisible
 
  If the layer itself is locked, returns the empty list
@@ -148,6 +246,12 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
  */
 - (NSArray*)objectsWithStyle:(DKStyle*)style;
 
+/** @brief Called by one of the layer's objects just before its style changes, to keep the index of the objects by style up to date
+ @param obj the object
+ @param newStyle the style it's about to be given
+ */
+- (void)object:(DKDrawableObject*)obj willChangeStyleTo:(DKStyle*)newStyle;
+
 /** @brief Returns objects that respond to the selector with the value <answer>
  <selector> a selector taking no parameters
 
@@ -196,6 +300,23 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
  */
 - (NSIndexSet*)indexesOfObjectsInArray:(NSArray*)objs;
 
+/** @brief Returns the layer's objects whose metadata has a given value for a key
+
+ Uses the drawing's metadata index if the key is indexed, otherwise every object's metadata is looked at. Only the objects' own metadata
+ is considered.
+ @param value the value
+ @param key the metadata key
+ @return the objects found, in stacking order
+ */
+- (NSArray*)objectsWithMetadataValue:(id)value forKey:(NSString*)key;
+/** @brief Returns the layer's objects whose metadata for a key lies in an inclusive range
+ @param low the lowest value, or nil for no lower limit
+ @param high the highest value, or nil for no upper limit
+ @param key the metadata key
+ @return the objects found, in stacking order
+ */
+- (NSArray*)objectsWithMetadataValuesFrom:(id)low to:(id)high forKey:(NSString*)key;
+
 // adding and removing objects:
 // note that the 'objects' property is fully KVC/KVO compliant because where necessary all methods call some directly KVC/KVO compliant method internally.
 // those marked KVC/KVO compliant are *directly* compliant because they follow the standard KVC naming conventions. For observing a change via KVO, an
@@ -350,7 +471,78 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
 // updating & drawing objects:
 
 - (void)drawable:(DKDrawableObject*)obj needsDisplayInRect:(NSRect)rect;
+
+/** @brief Records that an object in the layer has changed
+
+ Called whenever an object asks to be redrawn or notifies a change of status. If the object is inside a group, the group that is directly
+ owned by the layer is recorded instead. Used by incremental saving to find the objects that need to be written again.
+ @param obj the object that changed
+ */
+- (void)noteChangeToObject:(DKDrawableObject*)obj;
+
+/** @brief Whether an object owned by the layer has changed since the change tracking was last reset
+ @param obj one of the layer's objects
+ @return YES if it has changed
+ */
+- (BOOL)objectHasChanged:(DKDrawableObject*)obj;
+
+/** @brief Forgets all the changes recorded so far by -noteChangeToObject:
+ */
+- (void)resetObjectChanges;
+
+/** @brief Returns copies of the layer's objects, for a snapshot of the drawing that later changes to the layer don't affect
+
+ The copies are kept, and only the objects that have changed since they were copied - as recorded by -noteChangeToObject: - are copied
+ again, so successive snapshots share the copies of unchanged objects. The copies have no container, and objects with a shared style are
+ given a copy of it, the same copy for all the objects of a snapshot that share it.
+ @param styles maps each shared style to its copy for the snapshot, keyed by the style not retained. Styles not yet in it are added
+ @return copies of the objects, in stacking order
+ */
+- (NSArray*)frozenObjectsWithStyles:(CFMutableDictionaryRef)styles;
 - (void)drawVisibleObjects;
+
+/** @brief Sets whether objects sharing a simple style are drawn in batches
+
+ When enabled, consecutive objects in the drawing order that share a style suitable for batching (see -[DKStyle isSuitableForBatchedDrawing])
+ are drawn with a single setting of the graphics state per style component, and their strokes are submitted as one path. A run only
+ includes objects that don't overlap one another, unless the style is such that overlaps make no difference, so the result is identical to
+ drawing each object individually. The default is NO.
+ @param batch YES to draw in batches, NO to draw each object individually
+ */
+- (void)setDrawsSimpleStylesInBatches:(BOOL)batch;
+- (BOOL)drawsSimpleStylesInBatches;
+
+/** @brief Sets whether the objects each view shows are kept, so that a scrolling view queries the storage only for what it newly shows
+
+ When enabled, a view drawing the layer on screen gets the objects to draw from the set of those in its visible rect. When the view has
+ scrolled, that set is brought up to date by querying the storage for only the strips that scrolled into and out of view, so views that
+ redraw everything they show as they scroll cost in proportion to the area exposed rather than the area shown. The default is NO, which
+ suits views that copy what they show as they scroll and redraw only what's exposed.
+ @param caches YES to keep the objects each view shows
+ */
+- (void)setCachesVisibleObjects:(BOOL)caches;
+- (BOOL)cachesVisibleObjects;
+
+/** @brief Draws the objects, batching runs of objects that share a simple style
+ @param objects the objects to draw, in drawing order
+ */
+- (void)drawObjectsInBatches:(NSArray*)objects;
+
+/** @brief Whether the layer draws its objects' outlines rather than their content into a view
+
+ YES when the view draws outlines only (see -[DKDrawingView setDrawsOutlinesOnly:]) and is drawing to the screen.
+ @param aView the view doing the rendering
+ @return YES if only outlines are drawn
+ */
+- (BOOL)drawsOutlinesOnlyInView:(NSView*)aView;
+
+/** @brief Draws the outlines of the objects as one path, stroked once with a hairline
+
+ Each object adds its outline with -[DKDrawableObject addOutlineToPath:], so no style is rendered.
+ @param objects the objects to draw
+ */
+- (void)drawOutlinesOfObjects:(NSArray*)objects;
+
 - (NSImage*)imageOfObjects;
 - (NSData*)pdfDataOfObjects;
 
@@ -402,11 +594,19 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
 /** @brief Return the union of all the visible objects in the layer. If there are no visible objects, returns
  NSZeroRect.
 
- Avoid using for refreshing objects. It is more efficient to use refreshAllObjects
+ Avoid using for refreshing objects. It is more efficient to use refreshAllObjects. The union is kept as objects are added, moved,
+ shown and hidden, and is only worked out again from the objects when one that lay on its edge shrinks, moves inwards or goes.
  @return a rect, the union of all visible object's bounds in the layer
  */
 - (NSRect)unionOfAllObjectBounds;
 
+/** @brief Called by the layer's objects when their bounds or visibility change, to keep the union of their bounds up to date
+ @param obj one of the layer's objects
+ @param oldBounds its bounds before the change
+ */
+- (void)object:(DKDrawableObject*)obj didChangeBoundsFrom:(NSRect)oldBounds;
+- (void)objectDidChangeVisibility:(DKDrawableObject*)obj;
+
 /** @brief Causes all objects in the passed array, set or other container to redraw themselves
  @param container a container of drawable objects. Any NSArray or NSSet is acceptable
  */
@@ -432,6 +632,39 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
  */
 - (void)applyTransformToObjects:(NSAffineTransform*)transform;
 
+// undoing bulk changes:
+
+/** @brief Sets whether bulk changes to objects are undone from a snapshot
+
+ When enabled, operations that change the geometry or style of many objects at once - applying a transform, aligning, distributing and
+ replacing styles - record the state of the objects before and after the change, and register a single undo task that puts back only the
+ objects that changed. This is much faster to capture and to undo than a task per object per property. It is used only if every object can
+ make a geometry snapshot, otherwise the ordinary undo tasks are registered. The default is NO.
+ @param snapshot YES to undo bulk changes from a snapshot
+ */
+- (void)setUsesSnapshotUndoForBulkChanges:(BOOL)snapshot;
+- (BOOL)usesSnapshotUndoForBulkChanges;
+
+/** @brief Starts a bulk change to some objects
+
+ If snapshot undo is enabled, the objects' state is recorded and undo registration is disabled until the matching -endBulkChange. Calls
+ may be nested, in which case only the outermost pair has any effect. Only geometry and style changes may be made in between, since
+ nothing else will be undoable.
+ @param objects the objects that are about to change
+ */
+- (void)beginBulkChangeToObjects:(NSArray*)objects;
+
+/** @brief Ends a bulk change started with -beginBulkChangeToObjects:, registering the undo task for it
+ */
+- (void)endBulkChange;
+
+/** @brief Puts the objects in a snapshot back into their other state
+
+ This is the undo (and redo) task registered by -endBulkChange.
+ @param snapshot the snapshot
+ */
+- (void)restoreObjectSnapshot:(DKObjectSnapshot*)snapshot;
+
 // stacking order:
 
 /** @brief Moves the object up in the stacking order
@@ -577,12 +810,20 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
 
  Test for inclusion by calling the object's intersectsRect method. Can be used to select objects in
  a given rect or for any other purpose. For selections, the results can be passed directly to
- exchangeSelection:
+ exchangeSelection:. Many candidates are tested concurrently (see DKHitTestBatch).
  @param rect a rectangle
- @return a list of objects touched by the rect
+ @return a list of objects touched by the rect, in stacking order
  */
 - (NSArray*)objectsInRect:(NSRect)rect;
 
+/** @brief Finds all objects touched by the area inside a lasso
+
+ Like -objectsInRect:, but for a freehand selection. See +[DKHitTestBatch objects:intersectingLasso:].
+ @param lasso a path, closed implicitly
+ @return a list of objects touched by the lasso's area, in stacking order
+ */
+- (NSArray*)objectsInLasso:(NSBezierPath*)lasso;
+
 /** @brief An object owned by the layer was double-clicked
 
  Override to use
@@ -591,13 +832,29 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
  */
 - (void)drawable:(DKDrawableObject*)obj wasDoubleClickedAtPoint:(NSPoint)mp;
 
+// finding where paths cross:
+
+/** @brief Finds every point where the rendering paths of two of the layer's objects cross
+
+ For finding crossing wires and the like. Only objects whose bounds touch have their paths compared, and the comparisons are shared
+ between the processor's cores; see DKPathIntersection. Crossings are grouped by pair of objects, from the bottom of the stacking order up.
+ @return a list of DKPathIntersections
+ */
+- (NSArray*)pathIntersections;
+
+/** @brief Finds every point where the rendering paths of two of the given objects cross
+ @param objects objects owned by the layer
+ @return a list of DKPathIntersections, grouped by pair of objects in the order of the array
+ */
+- (NSArray*)pathIntersectionsOfObjects:(NSArray*)objects;
+
 // snapping:
 
 /** @brief Snap a point to any existing object control point within tolerance
 
  If snap to object is not set for this layer, this simply returns the original point unmodified.
- currently uses hitPart to test for a hit, so tolerance is ignored and objects apply their internal
- hit testing tolerance.
+ currently uses hitPart to test for a hit, so objects apply their internal hit testing tolerance; the
+ tolerance only widens the area searched for candidate objects, which are found using the storage.
  @param p a point
  @param except don't snap to this object (intended to be the one being snapped)
  @param tol has to be within this distance to snap
@@ -655,6 +912,15 @@ because it's an all-or-nothing rendering proposition which direct drawing of a l
  */
 - (DKLayerCacheOption)layerCacheOption;
 
+/** @brief Whether the layer can be rendered on another thread and composited, when the drawing composites layers concurrently
+
+ See -[DKDrawing setCompositesLayersConcurrently:]. The default returns YES if the layer caches using a CGLayer and isn't active,
+ highlighted for a drag, creating an object or showing its storage. Subclasses whose drawing depends on other state, or which draw
+ anything that isn't safe to draw off the main thread, should override this to return NO in those cases.
+ @return YES if the layer can be composited
+ */
+- (BOOL)isSuitableForConcurrentCompositing;
+
 /** @brief Query whether the layer is currently highlighted for a drag (receive) operation
  @return YES if highlighted, NO otherwise
  */
@@ -732,3 +998,5 @@ extern NSString* kDKLayerWillRemoveObject;
 extern NSString* kDKLayerDidRemoveObject;
 
 #define DEFAULT_PASTE_OFFSET 20
+#define kDKMaximumDrawingBatchSize 256
+#define kDKObjectsDrawnPerAutoreleasePool 64 // objects drawn between drains of the temporaries their drawing makes
@@ -6,6 +6,7 @@
 
 #import "DKObjectOwnerLayer.h"
 #import "DKLayer+Metadata.h"
+#import "DKDrawableObject+Metadata.h"
 #import "DKDrawing.h"
 #import "DKStyle.h"
 #import "DKDrawingView.h"
@@ -16,10 +17,27 @@
 #import "DKTextShape.h"
 #import "DKSelectionPDFView.h"
 #import "DKUndoManager.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 #import "DKImageDataManager.h"
 #import "DKBSPObjectStorage.h"
 #import "DKPasteboardInfo.h"
+#import "DKKnob.h"
+#import "DKObjectSnapshot.h"
+#import "DKChunkedDrawingArchive.h"
+#import "DKMetadataIndex.h"
+#import "DKTextIndex.h"
+#import "DKRenderStatistics.h"
+#import "DKDrawingTileCache.h"
+#import "DKLayerHitIndex.h"
+#import "DKLayerObjectIndex.h"
+#import "DKLayerVisibleSet.h"
+#import "DKShapeGroup.h"
+#import "DKDrawingChangeFeed.h"
+#import "DKMemoryFootprint.h"
+#import "DKPathIntersection.h"
+#import "DKLayerObjectBuilder.h"
+#import "DKStorageTuner.h"
+#import "DKHitTestBatch.h"
 
 // constants
 
@@ -31,10 +49,61 @@ NSString* kDKLayerDidRemoveObject = @"kDKLayerDidRemoveObject";
 @interface DKObjectOwnerLayer (Private)
 - (void)updateCache;
 - (void)invalidateCache;
+- (DKDrawingTileCache*)contentCacheCreatingIfNeeded:(BOOL)create;
+- (BOOL)drawsFromContentCacheInView:(DKDrawingView*)aView;
+- (NSArray*)imageFileURLsFromPasteboard:(NSPasteboard*)pb;
+- (NSArray*)placeholdersForImportingImagesAtURLs:(NSArray*)urls;
+- (DKLayerHitIndex*)hitIndex;
+- (DKLayerObjectIndex*)objectIndex;
+- (DKLayerVisibleSet*)visibleSet;
+- (DKDrawingChangeFeed*)changeFeed;
+- (void)noteObjectAdded:(DKDrawableObject*)obj;
+- (void)noteObjectRemoved:(DKDrawableObject*)obj;
+- (void)widenObjectBoundsWithRect:(NSRect)bounds;
+- (void)narrowObjectBoundsWithoutRect:(NSRect)bounds;
+- (void)exchangeStorage:(id<DKObjectStorage>)storage;
 @end
 
+// a copy of an object has its own copy of an unshared style, but still has a shared one - which is swapped for the snapshot's copy of it
+
+static void freezeStylesOfObject(DKDrawableObject* obj, CFMutableDictionaryRef styles)
+{
+	DKStyle* style = [obj style];
+
+	if (style && [style isStyleSharable]) {
+		DKStyle* frozen = (DKStyle*)CFDictionaryGetValue(styles, style);
+
+		if (frozen == nil) {
+			frozen = [style mutableCopy];
+			CFDictionarySetValue(styles, style, frozen);
+			[frozen release];
+		}
+
+		[obj setStyle:frozen];
+	}
+
+	if ([obj isKindOfClass:[DKShapeGroup class]]) {
+		NSEnumerator* iter = [[(DKShapeGroup*)obj groupObjects] objectEnumerator];
+		DKDrawableObject* member;
+
+		while ((member = [iter nextObject]))
+			freezeStylesOfObject(member, styles);
+	}
+}
+
+static inline BOOL rectTouchesEdgeOfRect(NSRect r, NSRect u)
+{
+	return NSMinX(r) <= NSMinX(u) || NSMinY(r) <= NSMinY(u) || NSMaxX(r) >= NSMaxX(u) || NSMaxY(r) >= NSMaxY(u);
+}
+
+#define kDKLayerContentCacheOptions (kDKLayerCacheUsingPDF | kDKLayerCacheUsingCGLayer)
+#define kDKLayerContentCacheMaximumTiles 128
+#define kDKDroppedPlaceholderSpacing 16 // gap between the placeholders of dropped image files
+
 static Class sStorageClass = nil;
+static BOOL sAdaptsStorageByDefault = NO;
 static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
+static NSCache* sContentCaches = nil; // layer (not retained) -> its content cache. Discarded under memory pressure
 
 @implementation DKObjectOwnerLayer
 #pragma mark As a DKObjectOwnerLayer
@@ -74,11 +143,19 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 - (void)setStorage:(id<DKObjectStorage>)storage
 {
 	if ([storage conformsToProtocol:@protocol(DKObjectStorage)]) {
-		LogEvent_(kReactiveEvent, @"owner layer (%@) setting storage = %@", self, storage);
+		DKTrace_(kDKTraceReactive, @"owner layer (%@) setting storage = %@", self, storage);
 
 		[storage retain];
 		[mStorage release];
 		mStorage = storage;
+		[mHitIndex invalidate];
+		[mObjectIndex invalidate];
+		[mVisibleSet invalidate];
+
+		if (mFrozenObjects)
+			CFDictionaryRemoveAllValues(mFrozenObjects);
+
+		mObjectBoundsValid = NO;
 	}
 }
 
@@ -87,9 +164,138 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (id<DKObjectStorage>)storage
 {
+	if (mPendingObjectLoader)
+		[self loadPendingObjects];
+
 	return mStorage;
 }
 
+/** @brief Sets an object that will supply the layer's objects the first time they are needed
+
+ Used when opening a drawing so that layers that aren't shown don't need to be decoded until something asks for their objects, for
+ example by showing the layer. The objects are added with undo registration disabled, and the loader is then released.
+ @param loader the loader, or nil
+ */
+- (void)setPendingObjectLoader:(id<DKLayerObjectLoader>)loader
+{
+	[loader retain];
+	[mPendingObjectLoader release];
+	mPendingObjectLoader = loader;
+}
+
+/** @brief Whether the layer's objects have yet to be loaded
+ @return YES if a loader is waiting to supply the objects
+ */
+- (BOOL)hasPendingObjects
+{
+	return mPendingObjectLoader != nil;
+}
+
+/** @brief Loads the layer's objects now, if they haven't been loaded yet
+ */
+- (void)loadPendingObjects
+{
+	if (mPendingObjectLoader == nil)
+		return;
+
+	// the loader is cleared first because adding the objects uses the storage again
+
+	id<DKLayerObjectLoader> loader = [mPendingObjectLoader autorelease];
+	mPendingObjectLoader = nil;
+
+	DKTrace_(kDKTraceReactive, @"layer '%@' loading its objects on first use", [self layerName]);
+
+	NSArray* objects = [loader objectsForLayer:self];
+
+	if ([objects count] > 0) {
+		NSUndoManager* um = [self undoManager];
+
+		[um disableUndoRegistration];
+		[self setObjects:objects];
+		[um enableUndoRegistration];
+	}
+}
+
+- (void)beginBoundsUpdateBatch
+{
+	++mBoundsBatchLevel;
+
+	if ([mStorage respondsToSelector:@selector(beginBoundsUpdateBatch)])
+		[mStorage beginBoundsUpdateBatch];
+}
+
+- (void)endBoundsUpdateBatch
+{
+	if (mBoundsBatchLevel > 0)
+		--mBoundsBatchLevel;
+
+	if ([mStorage respondsToSelector:@selector(endBoundsUpdateBatch)])
+		[mStorage endBoundsUpdateBatch];
+}
+
++ (void)setAdaptsStorageByDefault:(BOOL)adapts
+{
+	sAdaptsStorageByDefault = adapts;
+}
+
++ (BOOL)adaptsStorageByDefault
+{
+	return sAdaptsStorageByDefault;
+}
+
+- (void)setAdaptsStorage:(BOOL)adapts
+{
+	if (adapts && mStorageTuner == nil)
+		mStorageTuner = [[DKStorageTuner alloc] initWithLayer:self];
+	else if (!adapts && mStorageTuner != nil) {
+		[mStorageTuner invalidate];
+		[mStorageTuner release];
+		mStorageTuner = nil;
+	}
+}
+
+- (BOOL)adaptsStorage
+{
+	return mStorageTuner != nil;
+}
+
+- (DKStorageTuner*)storageTuner
+{
+	return mStorageTuner;
+}
+
+- (BOOL)changeStorageToClass:(Class)aClass
+{
+	if (![aClass conformsToProtocol:@protocol(DKObjectStorage)])
+		return NO;
+
+	if (mPendingObjectLoader || mBulkChangeLevel > 0 || mBoundsBatchLevel > 0 || [self drawing] == nil)
+		return NO;
+
+	if ([mStorage class] == aClass)
+		return YES;
+
+	// the objects record the storage they're in, so the old storage is emptied before the new one takes them, and its release
+	// doesn't then detach them from the new one
+
+	NSArray* objs = [[mStorage objects] copy];
+	id<DKObjectStorage> oldStorage = [mStorage retain];
+	id<DKObjectStorage> newStorage = [[aClass alloc] init];
+
+	[oldStorage setObjects:[NSArray array]];
+	[newStorage setCanvasSize:[[self drawing] drawingSize]];
+	[newStorage setObjects:objs];
+	[self setStorage:newStorage];
+
+	DKTrace_(kDKTraceReactive, @"layer '%@' changed storage from %@ to %@", [self layerName], [oldStorage class], aClass);
+
+	[newStorage release];
+	[oldStorage release];
+	[objs release];
+
+	return YES;
+}
+
 #pragma mark - the list of objects
 
 /** @brief Sets the objects that this layer owns
@@ -100,6 +306,8 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	NSAssert(objs != nil, @"array of objects cannot be nil");
 
 	if (objs != [self objects]) {
+		[[self changeFeed] layer:self
+			willReplaceObjectsWith:objs];
 		[self setRulerMarkerUpdatesEnabled:NO];
 		[[self undoManager] registerUndoWithTarget:self
 										  selector:@selector(setObjects:)
@@ -111,7 +319,19 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerWillAddObject
 															object:self];
 
+		// the objects replaced aren't told they were removed, so the drawing's metadata index can't be updated one object at a time
+
+		[[[self drawing] metadataIndex] invalidate];
+		[[[self drawing] textIndex] invalidate];
 		[[self storage] setObjects:objs];
+		[mHitIndex invalidate];
+		[mObjectIndex invalidate];
+		[mVisibleSet invalidate];
+
+		if (mFrozenObjects)
+			CFDictionaryRemoveAllValues(mFrozenObjects);
+
+		mObjectBoundsValid = NO;
 
 		[[self objects] makeObjectsPerformSelector:@selector(setContainer:)
 										withObject:self];
@@ -133,6 +353,38 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	return [[[[self storage] objects] copy] autorelease];
 }
 
+/** @brief Returns a builder for a large number of new objects, using the same kind of storage as the layer
+ @return a new builder
+ */
+- (DKLayerObjectBuilder*)objectBuilder
+{
+	Class storageClass = mStorage ? [mStorage class] : [[self class] storageClass];
+
+	return [[[DKLayerObjectBuilder alloc] initWithStorageClass:storageClass
+												   canvasSize:[[self drawing] drawingSize]] autorelease];
+}
+
+/** @brief Replaces the layer's objects with those collected by a builder, as one undoable change
+ @param builder the builder
+ */
+- (void)setObjectsFromBuilder:(DKLayerObjectBuilder*)builder
+{
+	NSAssert(builder != nil, @"can't set objects from a nil builder");
+
+	[builder finish];
+
+	id<DKObjectStorage> storage = [builder takeStorage];
+
+	NSAssert(storage != nil, @"builder's objects have already been given to a layer");
+
+	[self exchangeStorage:storage];
+
+	// the builder found the union of the objects' bounds as it went
+
+	mObjectBoundsUnion = [builder bounds];
+	mObjectBoundsValid = YES;
+}
+
 /** @brief Returns objects that are available to the user, that is, not locked or invisible
 
  If the layer itself is locked, returns the empty list
@@ -180,11 +432,11 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	NSMutableArray* ao = [[NSMutableArray alloc] init];
 
 	if (![self lockedOrHidden]) {
-		NSEnumerator* iter = [[self objects] objectEnumerator];
+		NSEnumerator* iter = [[[self objectIndex] objectsOfClass:aClass] objectEnumerator];
 		DKDrawableObject* od;
 
 		while ((od = [iter nextObject])) {
-			if ([od visible] && ![od locked] && [od isKindOfClass:aClass])
+			if ([od visible] && ![od locked])
 				[ao addObject:od];
 		}
 	}
@@ -236,17 +488,15 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (NSArray*)objectsWithStyle:(DKStyle*)style
 {
-	NSMutableArray* ao = [[NSMutableArray alloc] init];
-	NSEnumerator* iter = [[self objects] objectEnumerator];
-	DKDrawableObject* od;
-	NSString* key = [style uniqueKey];
-
-	while ((od = [iter nextObject])) {
-		if ([[[od style] uniqueKey] isEqualToString:key])
-			[ao addObject:od];
-	}
+	return [[self objectIndex] objectsWithStyle:style];
+}
 
-	return [ao autorelease];
+- (void)object:(DKDrawableObject*)obj willChangeStyleTo:(DKStyle*)newStyle
+{
+	[mObjectIndex object:obj
+		willChangeStyleTo:newStyle];
+	[[self changeFeed] object:obj
+			willChangeStyleTo:newStyle];
 }
 
 /** @brief Returns objects that respond to the selector with the value <answer>
@@ -263,13 +513,29 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	id o;
 	NSInteger rval;
 
-	while ((o = [iter nextObject])) {
-		if ([o respondsToSelector:selector]) {
-			rval = 0;
+	// any object can be asked, so every object is looked at, but the invocation is made once for each class rather than for each object.
+	// A class that doesn't respond is recorded with the null object
+
+	CFMutableDictionaryRef invocations = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+
+	@try {
+		while ((o = [iter nextObject])) {
+			NSInvocation* inv = (NSInvocation*)CFDictionaryGetValue(invocations, [o class]);
+
+			if (inv == nil) {
+				if ([o respondsToSelector:selector]) {
+					inv = [NSInvocation invocationWithMethodSignature:[o methodSignatureForSelector:selector]];
+					[inv setSelector:selector];
+				} else
+					inv = (NSInvocation*)[NSNull null];
 
-			NSInvocation* inv = [NSInvocation invocationWithMethodSignature:[o methodSignatureForSelector:selector]];
+				CFDictionarySetValue(invocations, [o class], inv);
+			}
+
+			if (inv == (NSInvocation*)[NSNull null])
+				continue;
 
-			[inv setSelector:selector];
+			rval = 0;
 			[inv invokeWithTarget:o];
 
 			if ([[inv methodSignature] methodReturnLength] <= sizeof(NSInteger))
@@ -279,6 +545,9 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 				[result addObject:o];
 		}
 	}
+	@finally {
+		CFRelease(invocations);
+	}
 
 	return result;
 }
@@ -365,6 +634,54 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	return [mset autorelease];
 }
 
+/** @brief Returns the layer's objects whose metadata has a given value for a key
+
+ Uses the drawing's metadata index if the key is indexed, otherwise every object's metadata is looked at. Only the objects' own metadata
+ is considered.
+ @param value the value
+ @param key the metadata key
+ @return the objects found, in stacking order
+ */
+- (NSArray*)objectsWithMetadataValue:(id)value forKey:(NSString*)key
+{
+	if (value == nil)
+		return [NSArray array];
+
+	DKMetadataIndex* index = [[self drawing] metadataIndex];
+
+	if ([index indexesKey:key])
+		return [self objectsAtIndexes:[self indexesOfObjectsInArray:[[index objectsWithValue:value
+																					  forKey:key] allObjects]]];
+
+	return [DKMetadataIndex objectsInLayers:[NSArray arrayWithObject:self]
+								  withValue:value
+							   orValuesFrom:nil
+										 to:nil
+									 forKey:key];
+}
+
+/** @brief Returns the layer's objects whose metadata for a key lies in an inclusive range
+ @param low the lowest value, or nil for no lower limit
+ @param high the highest value, or nil for no upper limit
+ @param key the metadata key
+ @return the objects found, in stacking order
+ */
+- (NSArray*)objectsWithMetadataValuesFrom:(id)low to:(id)high forKey:(NSString*)key
+{
+	DKMetadataIndex* index = [[self drawing] metadataIndex];
+
+	if ([index indexesKey:key])
+		return [self objectsAtIndexes:[self indexesOfObjectsInArray:[[index objectsWithValuesFrom:low
+																							   to:high
+																						   forKey:key] allObjects]]];
+
+	return [DKMetadataIndex objectsInLayers:[NSArray arrayWithObject:self]
+								  withValue:nil
+							   orValuesFrom:low
+										 to:high
+									 forKey:key];
+}
+
 #pragma mark -
 #pragma mark - adding and removing objects(KVC / KVO compliant)
 
@@ -378,14 +695,23 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 {
 	NSAssert(obj != nil, @"attempt to add a nil object to the layer");
 
-	LogEvent_(kReactiveEvent, @"inserting %@ at: %d, count = %d", obj, indx, [self countOfObjects]);
+	DKTrace_(kDKTraceReactive, @"inserting %@ at: %d, count = %d", obj, indx, [self countOfObjects]);
 
 	if (![[self storage] containsObject:obj] && ![self lockedOrHidden]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] removeObject:obj];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerWillAddObject
 															object:self];
+
+		DKDrawingChangeFeed* feed = [self changeFeed];
+
+		if (feed)
+			[feed layer:self
+				willInsertObjects:[NSArray arrayWithObject:obj]
+						atIndexes:[NSIndexSet indexSetWithIndex:indx]];
+
 		[[self storage] insertObject:obj
 					inObjectsAtIndex:indx];
+		[self noteObjectAdded:obj];
 		[obj setContainer:self];
 		[obj notifyVisualChange];
 		[obj objectWasAddedToLayer:self];
@@ -405,7 +731,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 	if (![self lockedOrHidden]) {
 		DKDrawableObject* obj = [[self objectInObjectsAtIndex:indx] retain];
-		LogEvent_(kReactiveEvent, @"removing object %@, index = %d", obj, indx);
+		DKTrace_(kDKTraceReactive, @"removing object %@, index = %d", obj, indx);
 
 		[[[self undoManager] prepareWithInvocationTarget:self] insertObject:obj
 														   inObjectsAtIndex:indx];
@@ -413,7 +739,15 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 															object:self];
 
 		[obj notifyVisualChange];
+
+		DKDrawingChangeFeed* feed = [self changeFeed];
+
+		if (feed)
+			[feed layer:self
+				willRemoveObjectsAtIndexes:[NSIndexSet indexSetWithIndex:indx]];
+
 		[[self storage] removeObjectFromObjectsAtIndex:indx];
+		[self noteObjectRemoved:obj];
 		[obj objectWasRemovedFromLayer:self];
 		[obj setContainer:nil];
 		[obj release];
@@ -446,9 +780,14 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 		[old notifyVisualChange];
 		[old objectWasRemovedFromLayer:self];
 		[old setContainer:nil];
+		[self noteObjectRemoved:old];
+		[[self changeFeed] layer:self
+			willReplaceObjectAtIndex:indx
+						  withObject:obj];
 
 		[[self storage] replaceObjectInObjectsAtIndex:indx
 										   withObject:obj];
+		[self noteObjectAdded:obj];
 		[obj setContainer:self];
 		[obj notifyVisualChange];
 		[obj objectWasAddedToLayer:self];
@@ -476,12 +815,32 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerWillAddObject
 															object:self];
 
+		[[self changeFeed] layer:self
+			   willInsertObjects:objs
+					   atIndexes:set];
 		[[self storage] insertObjects:objs
 							atIndexes:set];
 
+		NSEnumerator* iter = [objs objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [iter nextObject]))
+			[self noteObjectAdded:obj];
+
 		[objs makeObjectsPerformSelector:@selector(setContainer:)
 							  withObject:self];
-		[objs makeObjectsPerformSelector:@selector(notifyVisualChange)];
+
+		// the objects are redrawn in one update rather than one each
+
+		[DKLayer beginCoalescingDisplayUpdates];
+
+		@try {
+			[objs makeObjectsPerformSelector:@selector(notifyVisualChange)];
+		}
+		@finally {
+			[DKLayer endCoalescingDisplayUpdates];
+		}
+
 		[objs makeObjectsPerformSelector:@selector(objectWasAddedToLayer:)
 							  withObject:self];
 
@@ -505,10 +864,28 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 																object:self];
 
 			NSArray* objs = [self objectsAtIndexes:set];
-			[objs makeObjectsPerformSelector:@selector(notifyVisualChange)];
+
+			[DKLayer beginCoalescingDisplayUpdates];
+
+			@try {
+				[objs makeObjectsPerformSelector:@selector(notifyVisualChange)];
+			}
+			@finally {
+				[DKLayer endCoalescingDisplayUpdates];
+			}
+
 			[[[self undoManager] prepareWithInvocationTarget:self] insertObjects:objs
 																	   atIndexes:set];
+			[[self changeFeed] layer:self
+				willRemoveObjectsAtIndexes:set];
 			[[self storage] removeObjectsAtIndexes:set];
+
+			NSEnumerator* iter = [objs objectEnumerator];
+			DKDrawableObject* obj;
+
+			while ((obj = [iter nextObject]))
+				[self noteObjectRemoved:obj];
+
 			[objs makeObjectsPerformSelector:@selector(objectWasRemovedFromLayer:)
 								  withObject:self];
 			[objs makeObjectsPerformSelector:@selector(setContainer:)
@@ -768,9 +1145,32 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (NSArray*)objectsForUpdateRect:(NSRect)rect inView:(NSView*)aView options:(DKObjectStorageOptions)options
 {
-	return [[self storage] objectsIntersectingRect:rect
-											inView:aView
-										   options:options];
+	NSArray* objects;
+
+	// the set of objects a view shows is only good for updates within what it shows on screen - not for printing, or drawing its
+	// whole bounds into an image
+
+	if (mCachesVisibleObjects && aView && (options & ~kDKZOrderMayBeRelaxed) == 0 && [NSThread isMainThread] &&
+		[NSGraphicsContext currentContextDrawingToScreen] && NSContainsRect([aView visibleRect], rect))
+		objects = [[self visibleSet] objectsForUpdateInView:aView];
+	else {
+		objects = [[self storage] objectsIntersectingRect:rect
+												   inView:aView
+												  options:options];
+		[mStorageTuner noteQueryOfRect:rect];
+	}
+
+	// while the view captures a snapshot of its static content, the object being edited is left out
+
+	DKDrawableObject* excluded = [aView isKindOfClass:[DKDrawingView class]] ? [(DKDrawingView*)aView staticContentExcludedObject] : nil;
+
+	if (excluded != nil && [objects containsObject:excluded]) {
+		NSMutableArray* remaining = [[objects mutableCopy] autorelease];
+		[remaining removeObject:excluded];
+		objects = remaining;
+	}
+
+	return objects;
 }
 
 #pragma mark -
@@ -784,13 +1184,87 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)drawable:(DKDrawableObject*)obj needsDisplayInRect:(NSRect)rect
 {
-#pragma unused(obj)
+	// if the layer is cached, this invalidates the cached tiles under <rect>, for example when an undo changes the appearance of
+	// an object while the layer is inactive
 
-	// if the layer is cached, invalidate it. This forces the cache to get rebuilt when a change occurs while inactive,
-	// for example an undo was performed on a contained object that changed its appearance
-
-	[self invalidateCache];
 	[self setNeedsDisplayInRect:rect];
+	[self noteChangeToObject:obj];
+}
+
+/** @brief Records that an object in the layer has changed
+
+ Called whenever an object asks to be redrawn or notifies a change of status. If the object is inside a group, the group that is directly
+ owned by the layer is recorded instead. Used by incremental saving to find the objects that need to be written again.
+ @param obj the object that changed
+ */
+- (void)noteChangeToObject:(DKDrawableObject*)obj
+{
+	// a redraw doesn't always mean a change that needs saving (e.g. a change of selection), but recording too many is only a little wasteful
+
+	while (obj && [obj container] != self) {
+		id container = [obj container];
+
+		if (![container isKindOfClass:[DKDrawableObject class]])
+			return;
+
+		obj = container;
+	}
+
+	if (obj) {
+		if (mChangedObjects == NULL)
+			mChangedObjects = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+
+		CFSetAddValue(mChangedObjects, obj);
+
+		if (mFrozenObjects)
+			CFDictionaryRemoveValue(mFrozenObjects, obj);
+	}
+}
+
+/** @brief Whether an object owned by the layer has changed since the change tracking was last reset
+ @param obj one of the layer's objects
+ @return YES if it has changed
+ */
+- (BOOL)objectHasChanged:(DKDrawableObject*)obj
+{
+	return mChangedObjects != NULL && CFSetContainsValue(mChangedObjects, obj);
+}
+
+/** @brief Forgets all the changes recorded so far by -noteChangeToObject:
+ */
+- (void)resetObjectChanges
+{
+	if (mChangedObjects)
+		CFSetRemoveAllValues(mChangedObjects);
+}
+
+- (NSArray*)frozenObjectsWithStyles:(CFMutableDictionaryRef)styles
+{
+	NSAssert([NSThread isMainThread], @"objects can only be frozen on the main thread");
+
+	if (mFrozenObjects == NULL)
+		mFrozenObjects = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+
+	NSArray* objects = [self objects];
+	NSMutableArray* frozen = [NSMutableArray arrayWithCapacity:[objects count]];
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* obj;
+	DKDrawableObject* copy;
+
+	while ((obj = [iter nextObject])) {
+		copy = (DKDrawableObject*)CFDictionaryGetValue(mFrozenObjects, obj);
+
+		if (copy == nil) {
+			copy = [obj copy];
+			freezeStylesOfObject(copy, styles);
+			CFDictionarySetValue(mFrozenObjects, obj, copy);
+			[copy release];
+		}
+
+		[frozen addObject:copy];
+	}
+
+	return frozen;
 }
 
 /** @brief Draws all of the visible objects
@@ -821,6 +1295,144 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	}
 }
 
+/** @brief Sets whether objects sharing a simple style are drawn in batches
+
+ When enabled, consecutive objects in the drawing order that share a style suitable for batching (see -[DKStyle isSuitableForBatchedDrawing])
+ are drawn with a single setting of the graphics state per style component, and their strokes are submitted as one path. A run only
+ includes objects that don't overlap one another, unless the style is such that overlaps make no difference, so the result is identical to
+ drawing each object individually. The default is NO.
+ @param batch YES to draw in batches, NO to draw each object individually
+ */
+- (void)setDrawsSimpleStylesInBatches:(BOOL)batch
+{
+	if (batch != mDrawsInBatches) {
+		mDrawsInBatches = batch;
+		[self setNeedsDisplay:YES];
+	}
+}
+
+- (BOOL)drawsSimpleStylesInBatches
+{
+	return mDrawsInBatches;
+}
+
+- (void)setCachesVisibleObjects:(BOOL)caches
+{
+	mCachesVisibleObjects = caches;
+
+	if (!caches) {
+		[mVisibleSet release];
+		mVisibleSet = nil;
+	}
+}
+
+- (BOOL)cachesVisibleObjects
+{
+	return mCachesVisibleObjects;
+}
+
+/** @brief Draws the objects, batching runs of objects that share a simple style
+ @param objects the objects to draw, in drawing order
+ */
+- (void)drawObjectsInBatches:(NSArray*)objects
+{
+	NSUInteger i = 0, count = [objects count];
+	NSMutableArray* run = [[NSMutableArray alloc] initWithCapacity:kDKMaximumDrawingBatchSize];
+	DKDrawableObject* obj;
+
+	// the temporaries made while drawing are released every few objects, rather than piling up until the whole update is done
+
+	while (i < count) {
+		@autoreleasepool {
+			NSUInteger end = MIN(count, i + kDKObjectsDrawnPerAutoreleasePool);
+
+			while (i < end) {
+				obj = [objects objectAtIndex:i++];
+
+				if (![obj isSuitableForBatchedDrawing]) {
+					[obj drawContentWithSelectedState:NO];
+					continue;
+				}
+
+				// extend the run over following objects with the same style. If drawing order matters for the style, the run stops at the
+				// first object that overlaps one already in it, since that object must be drawn after it in the normal way.
+
+				DKStyle* style = [obj style];
+				BOOL overlapAllowed = [style canBatchOverlappingObjects];
+
+				[run removeAllObjects];
+				[run addObject:obj];
+
+				while (i < count && [run count] < kDKMaximumDrawingBatchSize) {
+					DKDrawableObject* next = [objects objectAtIndex:i];
+
+					if ([next style] != style || ![next isSuitableForBatchedDrawing])
+						break;
+
+					if (!overlapAllowed) {
+						NSRect nb = [next bounds];
+						NSEnumerator* iter = [run objectEnumerator];
+						DKDrawableObject* member;
+
+						while ((member = [iter nextObject])) {
+							if (NSIntersectsRect(nb, [member bounds]))
+								break;
+						}
+
+						if (member)
+							break;
+					}
+
+					[run addObject:next];
+					++i;
+				}
+
+				if ([run count] > 1)
+					[style renderObjectsInBatch:run];
+				else
+					[obj drawContentWithSelectedState:NO];
+			}
+		}
+	}
+
+	[run release];
+}
+
+- (BOOL)drawsOutlinesOnlyInView:(NSView*)aView
+{
+	return [aView isKindOfClass:[DKDrawingView class]] && [(DKDrawingView*)aView drawsOutlinesOnly] && [NSGraphicsContext currentContextDrawingToScreen];
+}
+
+- (void)drawOutlinesOfObjects:(NSArray*)objects
+{
+	CGMutablePathRef path = CGPathCreateMutable();
+	NSUInteger i = 0, count = [objects count];
+
+	// objects that make their outline from a bezier path release it every few objects, rather than piling up until the whole update is done
+
+	while (i < count) {
+		@autoreleasepool {
+			NSUInteger end = MIN(count, i + kDKObjectsDrawnPerAutoreleasePool);
+
+			while (i < end)
+				[[objects objectAtIndex:i++] addOutlineToPath:path];
+		}
+	}
+
+	if (!CGPathIsEmpty(path)) {
+		CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+
+		CGContextSaveGState(context);
+		[[NSColor blackColor] setStroke];
+		CGContextSetLineWidth(context, 0);
+		CGContextAddPath(context, path);
+		CGContextStrokePath(context);
+		CGContextRestoreGState(context);
+	}
+
+	CGPathRelease(path);
+}
+
 /** @brief Get an image of the current objects in the layer
 
  If there are no visible objects, returns nil.
@@ -945,6 +1557,9 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 - (void)drawPendingObjectInView:(NSView*)aView
 {
 	if (mNewObjectPending != nil) {
+		if ([aView isKindOfClass:[DKDrawingView class]] && [(DKDrawingView*)aView staticContentExcludedObject] == mNewObjectPending)
+			return;
+
 		if ([aView needsToDrawRect:[mNewObjectPending bounds]])
 			[mNewObjectPending drawContentWithSelectedState:YES];
 	}
@@ -969,16 +1584,62 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (NSRect)unionOfAllObjectBounds
 {
-	NSEnumerator* iter = [[self visibleObjects] objectEnumerator];
+	NSEnumerator* iter;
 	DKDrawableObject* obj;
 	NSRect u = NSZeroRect;
 
+	if (![self visible])
+		return u;
+
+	if (!mObjectBoundsValid) {
+		iter = [[self objects] objectEnumerator];
+
+		while ((obj = [iter nextObject])) {
+			if ([obj visible] && !NSIsEmptyRect([obj bounds]))
+				u = UnionOfTwoRects(u, [obj bounds]);
+		}
+
+		mObjectBoundsUnion = u;
+		mObjectBoundsValid = YES;
+	}
+
+	// only objects within the interior are counted, which is all of them unless the union strays outside it
+
+	if (NSIsEmptyRect(mObjectBoundsUnion) || NSContainsRect([[self drawing] interior], mObjectBoundsUnion))
+		return mObjectBoundsUnion;
+
+	u = NSZeroRect;
+	iter = [[self visibleObjects] objectEnumerator];
+
 	while ((obj = [iter nextObject]))
 		u = UnionOfTwoRects(u, [obj bounds]);
 
 	return u;
 }
 
+- (void)object:(DKDrawableObject*)obj didChangeBoundsFrom:(NSRect)oldBounds
+{
+	[mStorageTuner noteBoundsChanges:1];
+	[mVisibleSet object:obj
+		didChangeBoundsFrom:oldBounds];
+	[[self changeFeed] objectDidChangeGeometry:obj];
+
+	if ([obj visible]) {
+		[self narrowObjectBoundsWithoutRect:oldBounds];
+		[self widenObjectBoundsWithRect:[obj bounds]];
+	}
+}
+
+- (void)objectDidChangeVisibility:(DKDrawableObject*)obj
+{
+	[mVisibleSet objectDidChangeVisibility:obj];
+
+	if ([obj visible])
+		[self widenObjectBoundsWithRect:[obj bounds]];
+	else
+		[self narrowObjectBoundsWithoutRect:[obj bounds]];
+}
+
 /** @brief Causes all objects in the passed array, set or other container to redraw themselves
  @param container a container of drawable objects. Any NSArray or NSSet is acceptable
  */
@@ -1013,8 +1674,97 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)applyTransformToObjects:(NSAffineTransform*)transform
 {
+	[self beginBulkChangeToObjects:[self objects]];
 	[[self objects] makeObjectsPerformSelector:@selector(applyTransform:)
 									withObject:transform];
+	[self endBulkChange];
+}
+
+#pragma mark -
+#pragma mark - undoing bulk changes
+
+/** @brief Sets whether bulk changes to objects are undone from a snapshot
+
+ When enabled, operations that change the geometry or style of many objects at once - applying a transform, aligning, distributing and
+ replacing styles - record the state of the objects before and after the change, and register a single undo task that puts back only the
+ objects that changed. This is much faster to capture and to undo than a task per object per property. It is used only if every object can
+ make a geometry snapshot, otherwise the ordinary undo tasks are registered. The default is NO.
+ @param snapshot YES to undo bulk changes from a snapshot
+ */
+- (void)setUsesSnapshotUndoForBulkChanges:(BOOL)snapshot
+{
+	mUsesSnapshotUndo = snapshot;
+}
+
+- (BOOL)usesSnapshotUndoForBulkChanges
+{
+	return mUsesSnapshotUndo;
+}
+
+/** @brief Starts a bulk change to some objects
+
+ If snapshot undo is enabled, the objects' state is recorded and undo registration is disabled until the matching -endBulkChange. Calls
+ may be nested, in which case only the outermost pair has any effect. Only geometry and style changes may be made in between, since
+ nothing else will be undoable.
+ @param objects the objects that are about to change
+ */
+- (void)beginBulkChangeToObjects:(NSArray*)objects
+{
+	if (mBulkChangeLevel++ > 0 || ![self usesSnapshotUndoForBulkChanges])
+		return;
+
+	NSUndoManager* um = [self undoManager];
+
+	if (um == nil || ![um isUndoRegistrationEnabled] || [objects count] == 0)
+		return;
+
+	mBulkChangeSnapshot = [[DKObjectSnapshot alloc] initWithObjects:objects];
+
+	if (mBulkChangeSnapshot)
+		[um disableUndoRegistration];
+}
+
+/** @brief Ends a bulk change started with -beginBulkChangeToObjects:, registering the undo task for it
+ */
+- (void)endBulkChange
+{
+	NSAssert(mBulkChangeLevel > 0, @"-endBulkChange called without -beginBulkChangeToObjects:");
+
+	if (mBulkChangeLevel == 0 || --mBulkChangeLevel > 0 || mBulkChangeSnapshot == nil)
+		return;
+
+	NSUndoManager* um = [self undoManager];
+
+	[um enableUndoRegistration];
+
+	if ([mBulkChangeSnapshot captureChanges]) {
+		DKTrace_(kDKTraceReactive, @"registering snapshot undo for %lu changed objects", (unsigned long)[mBulkChangeSnapshot count]);
+
+		[um registerUndoWithTarget:self
+						  selector:@selector(restoreObjectSnapshot:)
+							object:mBulkChangeSnapshot];
+	}
+
+	[mBulkChangeSnapshot release];
+	mBulkChangeSnapshot = nil;
+}
+
+/** @brief Puts the objects in a snapshot back into their other state
+
+ This is the undo (and redo) task registered by -endBulkChange.
+ @param snapshot the snapshot
+ */
+- (void)restoreObjectSnapshot:(DKObjectSnapshot*)snapshot
+{
+	NSUndoManager* um = [self undoManager];
+
+	[um disableUndoRegistration];
+	[snapshot restore];
+	[um enableUndoRegistration];
+
+	[um registerUndoWithTarget:self
+					  selector:@selector(restoreObjectSnapshot:)
+						object:snapshot];
 }
 
 #pragma mark -
@@ -1081,9 +1831,13 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 		if (old != indx) {
 			[[[self undoManager] prepareWithInvocationTarget:self] moveObject:obj
 																	  toIndex:old];
+			[[self changeFeed] layer:self
+				willMoveObjectAtIndex:old
+							  toIndex:indx];
 
 			[[self storage] moveObject:obj
 							   toIndex:indx];
+			[mStorageTuner noteStructuralChanges:1];
 			[obj notifyVisualChange];
 
 			[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerDidReorderObjects
@@ -1139,12 +1893,20 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 /** @brief Unarchive a list of objects from the pasteboard, if possible
 
  This factors the dearchiving of objects from the pasteboard. If the pasteboard does not contain
- any valid types, nil is returned
+ any valid types, nil is returned. Objects copied from a layer of this layer's drawing, in this process,
+ are cloned from the pasteboard's snapshot (see DKPasteboardSnapshot) rather than dearchived.
  @param pb the pasteboard to take objects from
  @return a list of objects
  */
 - (NSArray*)nativeObjectsFromPasteboard:(NSPasteboard*)pb
 {
+	DKPasteboardSnapshot* snapshot = [DKPasteboardSnapshot snapshotFromPasteboard:pb];
+
+	// the clones refer to images by keys in the originating drawing's image manager, so they can only be used within that drawing
+
+	if (snapshot && [[self drawing] layerWithUniqueKey:[snapshot keyOfOriginatingLayer]] != nil)
+		return [snapshot objectClones];
+
 	return [DKDrawableObject nativeObjectsFromPasteboard:pb];
 }
 
@@ -1378,9 +2140,16 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	NSEnumerator* iter;
 	DKDrawableObject* o;
 	NSInteger partcode;
-	NSArray* objects = [[self storage] objectsContainingPoint:point];
+	NSArray* objects;
 
-	LogEvent_(kUserEvent, @"hit-testing %d objects; layer = %@; objects = %@", [objects count], self, objects);
+	// off the main thread the index isn't safe to use, as it's kept up to date by the main thread
+
+	if ([NSThread isMainThread])
+		objects = [[self hitIndex] objectsContainingPoint:point];
+	else
+		objects = [[self storage] objectsContainingPoint:point];
+
+	DKTrace_(kDKTraceUser, @"hit-testing %d objects; layer = %@; objects = %@", [objects count], self, objects);
 
 	iter = [objects reverseObjectEnumerator];
 
@@ -1391,7 +2160,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 			if (part)
 				*part = partcode;
 
-			LogEvent_(kUserEvent, @"found hit = %@", o);
+			DKTrace_(kDKTraceUser, @"found hit = %@", o);
 
 			return o;
 		}
@@ -1400,7 +2169,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	if (part)
 		*part = kDKDrawingNoPart;
 
-	LogEvent_(kUserEvent, @"nothing hit");
+	DKTrace_(kDKTraceUser, @"nothing hit");
 
 	return nil;
 }
@@ -1409,25 +2178,29 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
  Test for inclusion by calling the object's intersectsRect method. Can be used to select objects in
  a given rect or for any other purpose. For selections, the results can be passed directly to
- exchangeSelection:
+ exchangeSelection:. The candidates' paths are tested concurrently when there are many of them.
  @param rect a rectangle
- @return a list of objects touched by the rect
+ @return a list of objects touched by the rect, in stacking order
  */
 - (NSArray*)objectsInRect:(NSRect)rect
 {
-	NSEnumerator* iter = [self objectEnumeratorForUpdateRect:rect
-													  inView:nil];
-	DKDrawableObject* o;
-	NSMutableArray* hits;
-
-	hits = [[NSMutableArray alloc] init];
+	return [DKHitTestBatch objects:[self objectsForUpdateRect:rect
+													   inView:nil]
+				  intersectingRect:rect];
+}
 
-	while ((o = [iter nextObject])) {
-		if ([o intersectsRect:rect])
-			[hits addObject:o];
-	}
+/** @brief Finds all objects touched by the area inside a lasso
+ @param lasso a path, closed implicitly
+ @return a list of objects touched by the lasso's area, in stacking order
+ */
+- (NSArray*)objectsInLasso:(NSBezierPath*)lasso
+{
+	if ([lasso isEmpty])
+		return [NSArray array];
 
-	return [hits autorelease];
+	return [DKHitTestBatch objects:[self objectsForUpdateRect:[lasso bounds]
+													   inView:nil]
+				 intersectingLasso:lasso];
 }
 
 /** @brief An object owned by the layer was double-clicked
@@ -1441,14 +2214,30 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 #pragma unused(obj, mp)
 }
 
+#pragma mark -
+#pragma mark - finding where paths cross
+
+- (NSArray*)pathIntersections
+{
+	return [self pathIntersectionsOfObjects:[self objects]];
+}
+
+- (NSArray*)pathIntersectionsOfObjects:(NSArray*)objects
+{
+	NSAssert(objects != nil, @"can't find crossings of nil objects");
+
+	return [DKPathIntersection intersectionsBetweenObjects:objects
+												 inStorage:[self storage]];
+}
+
 #pragma mark -
 #pragma mark - snapping
 
 /** @brief Snap a point to any existing object control point within tolerance
 
  If snap to object is not set for this layer, this simply returns the original point unmodified.
- currently uses hitPart to test for a hit, so tolerance is ignored and objects apply their internal
- hit testing tolerance.
+ currently uses hitPart to test for a hit, so objects apply their internal hit testing tolerance; the
+ tolerance only widens the area searched for candidate objects, which are found using the storage.
  @param p a point
  @param except don't snap to this object (intended to be the one being snapped)
  @param tol has to be within this distance to snap
@@ -1456,14 +2245,22 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (NSPoint)snapPoint:(NSPoint)p toAnyObjectExcept:(DKDrawableObject*)except snapTolerance:(CGFloat)tol
 {
-#pragma unused(tol)
-
 	if ([self allowsSnapToObjects]) {
 		NSInteger pc;
 		DKDrawableObject* ho;
 		NSEnumerator* iter;
 
-		iter = [[self objects] reverseObjectEnumerator];
+		// only objects close to the point can snap it, so the storage's spatial index supplies the candidates. Objects hit-test
+		// for snapping at up to twice the knob size, which can lie outside their bounds.
+
+		CGFloat radius = MAX(tol, [[self knobs] controlKnobSize].width * 2.0);
+		NSRect sr = NSInsetRect(NSMakeRect(p.x, p.y, 0, 0), -radius, -radius);
+
+		[mStorageTuner noteQueryOfRect:sr];
+
+		iter = [[[self storage] objectsIntersectingRect:sr
+												 inView:nil
+												options:0] reverseObjectEnumerator];
 
 		while ((ho = [iter nextObject])) {
 			if (ho != except) {
@@ -1472,7 +2269,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 				if (pc != kDKDrawingNoPart && pc != kDKDrawingEntireObjectPart) {
 					p = [ho pointForPartcode:pc];
-					//	LogEvent_(kInfoEvent, @"detectedsnap on %@, pc = %d", ho, pc );
+					//	DKTrace_(kDKTraceInfo, @"detectedsnap on %@, pc = %d", ho, pc );
 					break;
 				}
 			}
@@ -1583,7 +2380,10 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)setLayerCacheOption:(DKLayerCacheOption)option
 {
-	mLayerCachingOption = option;
+	if (option != mLayerCachingOption) {
+		[self invalidateCache];
+		mLayerCachingOption = option;
+	}
 }
 
 /** @brief Query whether the layer caches its content in an offscreen layer when not active
@@ -1598,6 +2398,11 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	return mLayerCachingOption;
 }
 
+- (BOOL)isSuitableForConcurrentCompositing
+{
+	return ([self layerCacheOption] & kDKLayerCacheUsingCGLayer) != 0 && ![self isActive] && ![self isHighlightedForDrag] && [self pendingObject] == nil && !mShowStorageDebugging;
+}
+
 /** @brief Query whether the layer is currently highlighted for a drag (receive) operation
  @return YES if highlighted, NO otherwise
  */
@@ -1661,7 +2466,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)updateCache
 {
-	// not implemented
+	// the tiles are rendered as they're first drawn, so there's nothing to build in advance
 }
 
 /** @brief Discard the offscreen cache(s) used for drawing the layer more quickly when it's inactive
@@ -1670,7 +2475,45 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)invalidateCache
 {
-	// not implemented
+	[sContentCaches removeObjectForKey:[NSValue valueWithNonretainedObject:self]];
+}
+
+/** @brief Returns the cache of the layer's content
+ @param create YES to make the cache if there isn't one
+ @return the cache, or nil
+ */
+- (DKDrawingTileCache*)contentCacheCreatingIfNeeded:(BOOL)create
+{
+	if ((mLayerCachingOption & kDKLayerContentCacheOptions) == 0)
+		return nil;
+
+	NSValue* key = [NSValue valueWithNonretainedObject:self];
+	DKDrawingTileCache* cache = [sContentCaches objectForKey:key];
+
+	if (cache == nil && create) {
+		if (sContentCaches == nil)
+			sContentCaches = [[NSCache alloc] init];
+
+		cache = [[DKDrawingTileCache alloc] initWithLayer:self
+										 maximumTileCount:kDKLayerContentCacheMaximumTiles];
+		[sContentCaches setObject:cache
+						   forKey:key];
+		[cache autorelease];
+	}
+
+	return cache;
+}
+
+/** @brief Whether the layer is drawn from its content cache
+
+ Only layers that aren't being edited are drawn from the cache - not the active layer, nor one creating an object or
+ highlighted for a drag - and only to the screen.
+ @param aView the view being drawn
+ @return YES to draw from the cache
+ */
+- (BOOL)drawsFromContentCacheInView:(DKDrawingView*)aView
+{
+	return (mLayerCachingOption & kDKLayerContentCacheOptions) != 0 && [aView isKindOfClass:[DKDrawingView class]] && ![aView isChangingScale] && [NSGraphicsContext currentContextDrawingToScreen] && ![self isActive] && [self pendingObject] == nil && ![self isHighlightedForDrag] && !mShowStorageDebugging;
 }
 
 #pragma mark -
@@ -1707,7 +2550,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (void)drawingDidChangeMargins:(NSValue*)oldInterior
 {
-	LogEvent_(kReactiveEvent, @"changed margins, old = %@", NSStringFromRect([oldInterior rectValue]));
+	DKTrace_(kDKTraceReactive, @"changed margins, old = %@", NSStringFromRect([oldInterior rectValue]));
 
 	NSRect old = [oldInterior rectValue];
 	NSRect new = [[self drawing] interior];
@@ -1729,20 +2572,78 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 {
 #pragma unused(rect)
 
-	if ([self countOfObjects] > 0) {
-		NSEnumerator* iter = [self objectEnumeratorForUpdateRect:rect
-														  inView:aView];
-		DKDrawableObject* obj;
+	// outlines don't need a style's render pass, and any cached content is of the styled objects
 
-		// draw the objects - this enumerator has already excluded any not needing to be drawn
+	if ([self drawsOutlinesOnlyInView:aView]) {
+		if ([self countOfObjects] > 0)
+			[self drawOutlinesOfObjects:[[self objectEnumeratorForUpdateRect:rect
+																	  inView:aView] allObjects]];
 
-		while ((obj = [iter nextObject]))
-			[obj drawContentWithSelectedState:NO];
+		[self drawPendingObjectInView:aView];
+
+		if ([self isHighlightedForDrag])
+			[self drawHighlightingForDrag];
+
+		return;
+	}
+
+	if ([self drawsFromContentCacheInView:aView]) {
+		// retained while drawing, as the cache may discard it at any time
+
+		DKDrawingTileCache* cache = [[self contentCacheCreatingIfNeeded:YES] retain];
+
+		[cache drawRect:rect
+				 inView:aView];
+		[cache release];
+		return;
 	}
 
-	// draw any pending object on top of the others
+	// every object is drawn in the same render mode, so it's worked out once for the update rather than for each object
+
+	[DKStyle beginRenderPass:[DKStyle renderPassForCurrentContext]
+				  lowQuality:[[self drawing] lowRenderingQuality]];
+
+	@try {
+		if ([self countOfObjects] > 0) {
+			uint64_t statsStart = DKRenderIntervalBegin(kDKRenderEventObjectEnumeration, self);
+			NSEnumerator* iter = [self objectEnumeratorForUpdateRect:rect
+															  inView:aView];
+			DKDrawableObject* obj;
+			NSUInteger drawn = 0;
+
+			// draw the objects - this enumerator has already excluded any not needing to be drawn
+
+			if ([self drawsSimpleStylesInBatches]) {
+				NSArray* visible = [iter allObjects];
+
+				drawn = [visible count];
+				[self drawObjectsInBatches:visible];
+			} else {
+				// the paths and transforms made while drawing are released every few objects, rather than piling up until the
+				// whole update is done
+
+				NSUInteger n;
+
+				do {
+					@autoreleasepool {
+						for (n = 0; n < kDKObjectsDrawnPerAutoreleasePool && (obj = [iter nextObject]); ++n) {
+							[obj drawContentWithSelectedState:NO];
+							++drawn;
+						}
+					}
+				} while (n == kDKObjectsDrawnPerAutoreleasePool);
+			}
+
+			DKRenderIntervalEnd(kDKRenderEventObjectEnumeration, self, statsStart, drawn, [self countOfObjects] - MIN(drawn, [self countOfObjects]));
+		}
+
+		// draw any pending object on top of the others
 
-	[self drawPendingObjectInView:aView];
+		[self drawPendingObjectInView:aView];
+	}
+	@finally {
+		[DKStyle endRenderPass];
+	}
 
 	if ([self isHighlightedForDrag])
 		[self drawHighlightingForDrag];
@@ -1762,6 +2663,11 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
  */
 - (BOOL)hitLayer:(NSPoint)p
 {
+	// when finding the layer under the mouse, most layers have nothing there, which the index can tell without hit-testing anything
+
+	if ([NSThread isMainThread] && ![[self hitIndex] mayHaveObjectsAtPoint:p])
+		return NO;
+
 	return ([self hitTest:p] != nil);
 }
 
@@ -1865,6 +2771,39 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	return types;
 }
 
+/** @brief Flags part of the layer as needing redrawing
+
+ Also discards the tiles of the content cache under <rect>, if the layer has one, and notes the area in the hit-testing index, since
+ objects may have moved into or out of it.
+ @param rect the area that needs to be redrawn
+ */
+- (void)setNeedsDisplayInRect:(NSRect)rect
+{
+	[[self contentCacheCreatingIfNeeded:NO] invalidateRect:rect];
+
+	if ([NSThread isMainThread])
+		[mHitIndex noteChangeInRect:rect];
+	else
+		[mHitIndex invalidate];
+
+	[super setNeedsDisplayInRect:rect];
+}
+
+/** @brief Flags the whole layer as needing redrawing
+
+ Also discards the content cache, if the layer has one, and the hit-testing index.
+ @param update YES to redraw the layer
+ */
+- (void)setNeedsDisplay:(BOOL)update
+{
+	if (update) {
+		[self invalidateCache];
+		[mHitIndex invalidate];
+	}
+
+	[super setNeedsDisplay:update];
+}
+
 /** @brief Invoked when the layer becomes the active layer
 
  Invalidates the layer cache - only inactive layers draw from their cache
@@ -1885,6 +2824,26 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 		[self setNeedsDisplay:YES];
 }
 
+/** @brief Adds the memory used by the layer, its objects and its content cache to a footprint report
+
+ Objects that haven't been loaded yet are not loaded for this, so aren't counted.
+ @param footprint the report
+ */
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	[super addFootprintToReport:footprint];
+
+	NSEnumerator* iter = [[mStorage objects] objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject]))
+		[obj addFootprintToReport:footprint];
+
+	[mNewObjectPending addFootprintToReport:footprint];
+	[footprint addBytes:[[self contentCacheCreatingIfNeeded:NO] bytesUsed]
+			 toCategory:kDKFootprintRenderCaches];
+}
+
 #pragma mark -
 #pragma mark As an NSObject
 - (void)dealloc
@@ -1892,9 +2851,26 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	// though we are about to release all the objects, set their container to nil - this ensures that
 	// if anything else is retaining them, when they are later released they won't have stale refs to the drawing, owner, et. al.
 
-	[[self objects] makeObjectsPerformSelector:@selector(setContainer:)
-									withObject:nil];
+	// the storage is used directly so that objects that were never loaded aren't loaded now
+
+	[[mStorage objects] makeObjectsPerformSelector:@selector(setContainer:)
+										withObject:nil];
+
+	[mPendingObjectLoader release];
+	[mBulkChangeSnapshot release];
+	[mHitIndex release];
+	[mObjectIndex release];
+	[mVisibleSet release];
+	[mStorageTuner invalidate];
+	[mStorageTuner release];
 
+	if (mChangedObjects)
+		CFRelease(mChangedObjects);
+
+	if (mFrozenObjects)
+		CFRelease(mFrozenObjects);
+
+	[self invalidateCache];
 	[mStorage release];
 	[super dealloc];
 }
@@ -1905,13 +2881,14 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	if (self != nil) {
 		mStorage = [[[[self class] storageClass] alloc] init];
 
-		LogEvent_(kInfoEvent, @"%@ allocated storage: %@", self, mStorage);
+		DKTrace_(kDKTraceInfo, @"%@ allocated storage: %@", self, mStorage);
 
 		[self setPasteOffsetX:DEFAULT_PASTE_OFFSET
 							y:DEFAULT_PASTE_OFFSET];
 		[self setAllowsSnapToObjects:YES];
 		[self setAllowsEditing:YES];
 		[self setLayerCacheOption:[[self class] defaultLayerCacheOption]];
+		[self setAdaptsStorage:[[self class] adaptsStorageByDefault]];
 		[self setLayerName:NSLocalizedString(@"Drawing Layer", @"default name for new drawing layers")];
 	}
 	return self;
@@ -1953,10 +2930,26 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 	[super encodeWithCoder:coder];
 
 	// only the objects are archived as a simple array, not the storage itself. This allows the
-	// storage to be selected for any file at runtime.
+	// storage to be selected for any file at runtime. The chunked file format archives the objects in chunks of their own.
+
+	if (![coder respondsToSelector:@selector(encodesLayerObjectsSeparately)] || ![(DKKeyedArchiver*)coder encodesLayerObjectsSeparately])
+		[coder encodeObject:[self objects]
+					 forKey:@"objects"];
+
+	// storage that can archive its spatial index does so, so that it needn't be rebuilt when the file is opened. It's only used if the
+	// file is opened with the same class of storage.
+
+	if ([mStorage respondsToSelector:@selector(archivedIndex)]) {
+		NSData* index = [mStorage archivedIndex];
+
+		if (index) {
+			[coder encodeObject:index
+						 forKey:@"DKObjectOwnerLayer_storageIndex"];
+			[coder encodeObject:NSStringFromClass([mStorage class])
+						 forKey:@"DKObjectOwnerLayer_storageIndexClass"];
+		}
+	}
 
-	[coder encodeObject:[self objects]
-				 forKey:@"objects"];
 	[coder encodeBool:[self allowsEditing]
 			   forKey:@"editable"];
 	[coder encodeBool:[self allowsSnapToObjects]
@@ -1968,7 +2961,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 - (id)initWithCoder:(NSCoder*)coder
 {
 	NSAssert(coder != nil, @"Expected valid coder");
-	LogEvent_(kFileEvent, @"decoding object owner layer %@", self);
+	DKTrace_(kDKTraceFile, @"decoding object owner layer %@", self);
 
 	self = [super initWithCoder:coder];
 	if (self != nil) {
@@ -1980,7 +2973,11 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 		mStorage = [[[[self class] storageClass] alloc] init];
 
-		LogEvent_(kInfoEvent, @"%@ '%@' allocated storage: %@", self, [self layerName], mStorage);
+		DKTrace_(kDKTraceInfo, @"%@ '%@' allocated storage: %@", self, [self layerName], mStorage);
+
+		if ([mStorage respondsToSelector:@selector(setArchivedIndex:)] &&
+			[NSStringFromClass([mStorage class]) isEqualToString:[coder decodeObjectForKey:@"DKObjectOwnerLayer_storageIndexClass"]])
+			[mStorage setArchivedIndex:[coder decodeObjectForKey:@"DKObjectOwnerLayer_storageIndex"]];
 
 		// attempt to dearchive storage from the file - most files encountered won't have this
 
@@ -1991,9 +2988,13 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 			[self setObjects:[tempStorage objects]];
 		} else {
-			// common case: storage wasn't archived but objects were
+			// common case: storage wasn't archived but objects were. Layers decoded from a chunked file have no objects here - they are
+			// set by the reader later
 
-			[self setObjects:[coder decodeObjectForKey:@"objects"]];
+			NSArray* objects = [coder decodeObjectForKey:@"objects"];
+
+			if (objects)
+				[self setObjects:objects];
 		}
 
 		[self setPasteOffsetX:20
@@ -2001,10 +3002,205 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 		[self setAllowsEditing:[coder decodeBoolForKey:@"editable"]];
 		[self setAllowsSnapToObjects:[coder decodeBoolForKey:@"snappable"]];
 		[self setLayerCacheOption:[[self class] defaultLayerCacheOption]];
+		[self setAdaptsStorage:[[self class] adaptsStorageByDefault]];
 	}
 	return self;
 }
 
+#pragma mark -
+
+- (NSArray*)imageFileURLsFromPasteboard:(NSPasteboard*)pb
+{
+	// image files named on the pasteboard, and those directly within any folders named there. Only names are looked at, so this is quick
+	// however many files there are
+
+	if ([pb availableTypeFromArray:[NSArray arrayWithObject:NSFilenamesPboardType]] == nil)
+		return nil;
+
+	NSArray* paths = [pb propertyListForType:NSFilenamesPboardType];
+	NSMutableSet* imageTypes = [NSMutableSet set];
+	NSMutableArray* urls = [NSMutableArray array];
+	NSFileManager* fm = [NSFileManager defaultManager];
+	NSEnumerator* iter = [[NSImage imageFileTypes] objectEnumerator];
+	NSString* path;
+	BOOL isDir;
+
+	while ((path = [iter nextObject]))
+		[imageTypes addObject:[path lowercaseString]];
+
+	iter = [paths objectEnumerator];
+
+	while ((path = [iter nextObject])) {
+		NSArray* files;
+
+		isDir = NO;
+
+		if ([fm fileExistsAtPath:path
+					 isDirectory:&isDir] &&
+			isDir) {
+			files = [[fm contentsOfDirectoryAtPath:path
+											 error:NULL] sortedArrayUsingSelector:@selector(localizedStandardCompare:)];
+		} else
+			files = [NSArray arrayWithObject:[path lastPathComponent]];
+
+		NSString* dir = isDir ? path : [path stringByDeletingLastPathComponent];
+		NSEnumerator* fileIter = [files objectEnumerator];
+		NSString* file;
+
+		while ((file = [fileIter nextObject])) {
+			if ([imageTypes containsObject:[[file pathExtension] lowercaseString]])
+				[urls addObject:[NSURL fileURLWithPath:[dir stringByAppendingPathComponent:file]]];
+		}
+	}
+
+	return urls;
+}
+
+- (NSArray*)placeholdersForImportingImagesAtURLs:(NSArray*)urls
+{
+	NSArray* keys = [[[self drawing] imageManager] importImagesWithContentsOfURLs:urls];
+	NSMutableArray* placeholders = [NSMutableArray arrayWithCapacity:[keys count]];
+	NSUInteger i, columns = (NSUInteger)ceil(sqrt((double)[keys count]));
+	CGFloat pitch = kDKImageShapePlaceholderSize + kDKDroppedPlaceholderSpacing;
+
+	// the placeholders are laid out in a square grid, in the order of the files. A single image arrives at its own size, as it
+	// would if it were read at once, but several are kept within their placeholders so that they don't overlap
+
+	NSSize maxSize = NSZeroSize;
+
+	if ([keys count] > 1)
+		maxSize = NSMakeSize(kDKImageShapePlaceholderSize, kDKImageShapePlaceholderSize);
+
+	for (i = 0; i < [keys count]; ++i) {
+		DKImageShape* placeholder = [[DKImageShape alloc] initWithPendingImageKey:[keys objectAtIndex:i]
+																	  maximumSize:maxSize];
+		NSString* path = [[urls objectAtIndex:i] path];
+
+		[placeholder setLocation:NSMakePoint((i % columns) * pitch, (i / columns) * pitch)];
+		[placeholder setString:path
+						forKey:kDKOriginalFileMetadataKey];
+		[placeholder setString:[[path lastPathComponent] stringByDeletingPathExtension]
+						forKey:kDKOriginalNameMetadataKey];
+
+		[placeholders addObject:placeholder];
+		[placeholder release];
+	}
+
+	return placeholders;
+}
+
+/** @brief Returns the index of where the layer's objects are, making it if needed
+ @return the index
+ */
+- (DKLayerHitIndex*)hitIndex
+{
+	if (mHitIndex == nil)
+		mHitIndex = [[DKLayerHitIndex alloc] initWithLayer:self];
+
+	return mHitIndex;
+}
+
+/** @brief Returns the index of the objects by style and class, making it if needed
+ @return the index
+ */
+- (DKLayerObjectIndex*)objectIndex
+{
+	if (mObjectIndex == nil)
+		mObjectIndex = [[DKLayerObjectIndex alloc] initWithLayer:self];
+
+	return mObjectIndex;
+}
+
+/** @brief Returns the objects each view last showed, making the set if needed
+ @return the visible set
+ */
+- (DKLayerVisibleSet*)visibleSet
+{
+	if (mVisibleSet == nil)
+		mVisibleSet = [[DKLayerVisibleSet alloc] initWithLayer:self];
+
+	return mVisibleSet;
+}
+
+/** @brief Returns the change feed of the layer's drawing
+ @return the feed, or nil if the drawing isn't recording changes
+ */
+- (DKDrawingChangeFeed*)changeFeed
+{
+	return [[self drawing] changeFeed];
+}
+
+- (void)noteObjectAdded:(DKDrawableObject*)obj
+{
+	[mStorageTuner noteStructuralChanges:1];
+	[mObjectIndex objectWasAdded:obj];
+	[mVisibleSet objectWasAdded:obj];
+
+	if ([obj visible])
+		[self widenObjectBoundsWithRect:[obj bounds]];
+}
+
+- (void)noteObjectRemoved:(DKDrawableObject*)obj
+{
+	[mStorageTuner noteStructuralChanges:1];
+	[mObjectIndex objectWasRemoved:obj];
+	[mVisibleSet objectWasRemoved:obj];
+
+	if (mFrozenObjects)
+		CFDictionaryRemoveValue(mFrozenObjects, obj);
+
+	if ([obj visible])
+		[self narrowObjectBoundsWithoutRect:[obj bounds]];
+}
+
+- (void)widenObjectBoundsWithRect:(NSRect)bounds
+{
+	if (mObjectBoundsValid && !NSIsEmptyRect(bounds))
+		mObjectBoundsUnion = UnionOfTwoRects(mObjectBoundsUnion, bounds);
+}
+
+- (void)exchangeStorage:(id<DKObjectStorage>)storage
+{
+	// swaps in a whole storage, index and all, so that neither doing nor undoing it needs the objects to be inserted or indexed again.
+	// Like -setObjects:, the objects replaced aren't told they were removed
+
+	id<DKObjectStorage> oldStorage = [[self storage] retain];
+	NSArray* objs = [storage objects];
+
+	[[self changeFeed] layer:self
+		willReplaceObjectsWith:objs];
+	[self setRulerMarkerUpdatesEnabled:NO];
+	[[[self undoManager] prepareWithInvocationTarget:self] exchangeStorage:oldStorage];
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerWillAddObject
+														object:self];
+	[[oldStorage objects] makeObjectsPerformSelector:@selector(setContainer:)
+										  withObject:nil];
+	[[[self drawing] metadataIndex] invalidate];
+	[[[self drawing] textIndex] invalidate];
+
+	[storage setCanvasSize:[[self drawing] drawingSize]];
+	[self setStorage:storage];
+
+	[objs makeObjectsPerformSelector:@selector(setContainer:)
+						  withObject:self];
+	[objs makeObjectsPerformSelector:@selector(objectWasAddedToLayer:)
+						  withObject:self];
+	[self setNeedsDisplay:YES];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKLayerDidAddObject
+														object:self];
+	[self setRulerMarkerUpdatesEnabled:YES];
+	[oldStorage release];
+}
+
+- (void)narrowObjectBoundsWithoutRect:(NSRect)bounds
+{
+	// an object away from the edges can leave without changing the union; one on an edge may have been all that held it there
+
+	if (mObjectBoundsValid && !NSIsEmptyRect(bounds) && rectTouchesEdgeOfRect(bounds, mObjectBoundsUnion))
+		mObjectBoundsValid = NO;
+}
+
 #pragma mark -
 #pragma mark As part of the NSDraggingDestination protocol
 
@@ -2020,6 +3216,7 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 				   fromView:nil];
 
 	NSString* dt = [pb availableTypeFromArray:[self pasteboardTypesForOperation:kDKReadableTypesForDrag]];
+	NSArray* imageURLs = [self imageFileURLsFromPasteboard:pb];
 
 	if ([dt isEqualToString:kDKDrawableObjectPasteboardType]) {
 		// drag contains native objects, which we can use directly.
@@ -2055,6 +3252,25 @@ static DKLayerCacheOption sDefaultCacheOption = kDKLayerCacheNone;
 
 			result = YES;
 		}
+	} else if ([imageURLs count] > 0) {
+		// image files (or folders of them) are imported in the background, so the drop returns at once with placeholders that
+		// show the images as they are read
+
+		dropObjects = [self placeholdersForImportingImagesAtURLs:imageURLs];
+
+		NSRect br = [DKDrawableObject unionOfBoundsOfDrawablesInArray:dropObjects];
+
+		cp = [view convertPoint:[sender draggingLocation]
+					   fromView:nil];
+		cp.x -= NSWidth(br) * 0.5f;
+		cp.y += NSHeight(br) * 0.5f;
+
+		[self addObjects:dropObjects
+			fromPasteboard:pb
+			atDropLocation:cp];
+		[[self undoManager] setActionName:NSLocalizedString(@"Drag and Drop Image", @"undo string for drag/drop image")];
+
+		result = YES;
 	} else if ([NSImage canInitWithPasteboard:pb]) {
 		// so that image can be efficiently cached and subsequently archived, we make the image via the image manager and
 		// initialise the object that way.
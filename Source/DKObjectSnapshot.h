@@ -0,0 +1,92 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawableObject, DKStyle;
+
+#define kDKGeometrySnapshotMaximumValues 8
+
+/** @brief The state of a drawable object's geometry at some moment, which the object can be put back into later.
+
+ The state of a drawable object's geometry at some moment, which the object can be put back into later. A snapshot holds a path, one other
+ object and a few numbers, whose meaning is up to the class that made it. Objects make snapshots with -geometrySnapshot and restore them with
+ -restoreGeometrySnapshot:.
+
+ Snapshots are immutable. A class whose path is changed in place must put a copy of it into the snapshot, and copy it again when restoring,
+ or put an immutable form of it such as a DKPathGeometry in as the other object instead.
+*/
+@interface DKGeometrySnapshot : NSObject {
+@private
+	NSBezierPath* mPath;
+	id mObject;
+	CGFloat mValues[kDKGeometrySnapshotMaximumValues];
+	NSUInteger mValueCount;
+}
+
++ (DKGeometrySnapshot*)snapshotWithPath:(NSBezierPath*)path object:(id)object values:(const CGFloat*)values count:(NSUInteger)count;
+
+- (id)initWithPath:(NSBezierPath*)path object:(id)object values:(const CGFloat*)values count:(NSUInteger)count;
+
+- (NSBezierPath*)path;
+- (id)object;
+- (CGFloat)valueAtIndex:(NSUInteger)indx;
+- (NSUInteger)valueCount;
+
+/** @brief Whether two snapshots describe the same geometry
+
+ Paths are compared point by point unless they are the same object, and the other objects must be equal.
+ @param snapshot another snapshot
+ @return YES if they are the same
+ */
+- (BOOL)isEqualToGeometrySnapshot:(DKGeometrySnapshot*)snapshot;
+
+@end
+
+#pragma mark -
+
+// one object's state before and after a change
+
+typedef struct {
+	DKDrawableObject* object;
+	DKGeometrySnapshot* geometry[2];
+	DKStyle* style[2];
+} DKObjectSnapshotRecord;
+
+/** @brief The geometry and style of a set of objects before and after a bulk change, used to undo the change in one step.
+
+ The geometry and style of a set of objects before and after a bulk change, used to undo the change in one step. The snapshot is made before
+ the change, the change is made with undo registration disabled, and then -captureChanges records the new state and drops the objects that
+ didn't change. Undoing the change is then a single task which puts every object back as it was, instead of one task per object per property.
+
+ Each time -restore is called the objects are put into the state other than the one they are in, so the same snapshot undoes and redoes.
+ Nothing but geometry and style is recorded, so this is only suitable for changes that affect nothing else.
+*/
+@interface DKObjectSnapshot : NSObject {
+@private
+	DKObjectSnapshotRecord* mRecords;
+	NSUInteger mCount;
+	NSUInteger mCurrent; // index of the state the objects are in
+}
+
+/** @brief Records the current geometry and style of the objects
+
+ @param objects the objects that are about to change
+ @return the snapshot, or nil if any object can't make a geometry snapshot
+ */
+- (id)initWithObjects:(NSArray*)objects;
+
+/** @brief Records the state of the objects after the change, discarding those that didn't change
+ @return YES if any object changed
+ */
+- (BOOL)captureChanges;
+
+/** @brief Puts the objects into the state they are not in
+ */
+- (void)restore;
+- (NSUInteger)count;
+
+@end
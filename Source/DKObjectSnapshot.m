@@ -0,0 +1,222 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKObjectSnapshot.h"
+#import "DKDrawableObject.h"
+#import "DKStyle.h"
+
+static BOOL pathsAreEqual(NSBezierPath* a, NSBezierPath* b)
+{
+	if (a == b)
+		return YES;
+
+	if (a == nil || b == nil)
+		return NO;
+
+	NSInteger i, count = [a elementCount];
+
+	if ([b elementCount] != count)
+		return NO;
+
+	NSPoint pa[3], pb[3];
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [a elementAtIndex:i
+									   associatedPoints:pa];
+
+		if ([b elementAtIndex:i
+				associatedPoints:pb] != element)
+			return NO;
+
+		if (element == NSCurveToBezierPathElement) {
+			if (!NSEqualPoints(pa[0], pb[0]) || !NSEqualPoints(pa[1], pb[1]) || !NSEqualPoints(pa[2], pb[2]))
+				return NO;
+		} else if (element != NSClosePathBezierPathElement && !NSEqualPoints(pa[0], pb[0]))
+			return NO;
+	}
+
+	return YES;
+}
+
+@implementation DKGeometrySnapshot
+
++ (DKGeometrySnapshot*)snapshotWithPath:(NSBezierPath*)path object:(id)object values:(const CGFloat*)values count:(NSUInteger)count
+{
+	return [[[self alloc] initWithPath:path
+								object:object
+								values:values
+								 count:count] autorelease];
+}
+
+- (id)initWithPath:(NSBezierPath*)path object:(id)object values:(const CGFloat*)values count:(NSUInteger)count
+{
+	NSAssert(count <= kDKGeometrySnapshotMaximumValues, @"too many values for a geometry snapshot");
+
+	self = [super init];
+	if (self) {
+		mPath = [path retain];
+		mObject = [object retain];
+		mValueCount = MIN(count, (NSUInteger)kDKGeometrySnapshotMaximumValues);
+
+		if (mValueCount > 0)
+			memcpy(mValues, values, mValueCount * sizeof(CGFloat));
+	}
+
+	return self;
+}
+
+- (NSBezierPath*)path
+{
+	return mPath;
+}
+
+- (id)object
+{
+	return mObject;
+}
+
+- (CGFloat)valueAtIndex:(NSUInteger)indx
+{
+	NSAssert(indx < mValueCount, @"geometry snapshot value index out of range");
+
+	return mValues[indx];
+}
+
+- (NSUInteger)valueCount
+{
+	return mValueCount;
+}
+
+- (BOOL)isEqualToGeometrySnapshot:(DKGeometrySnapshot*)snapshot
+{
+	if (snapshot == self)
+		return YES;
+
+	if (snapshot == nil || mValueCount != snapshot->mValueCount)
+		return NO;
+
+	if (mObject != snapshot->mObject && ![mObject isEqual:snapshot->mObject])
+		return NO;
+
+	if (mValueCount > 0 && memcmp(mValues, snapshot->mValues, mValueCount * sizeof(CGFloat)) != 0)
+		return NO;
+
+	return pathsAreEqual(mPath, snapshot->mPath);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mPath release];
+	[mObject release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKObjectSnapshot
+
+- (id)initWithObjects:(NSArray*)objects
+{
+	self = [super init];
+	if (self) {
+		mRecords = calloc(MAX(1U, [objects count]), sizeof(DKObjectSnapshotRecord));
+
+		NSEnumerator* iter = [objects objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [iter nextObject])) {
+			DKGeometrySnapshot* geometry = [obj geometrySnapshot];
+
+			if (geometry == nil) {
+				[self autorelease];
+				return nil;
+			}
+
+			DKObjectSnapshotRecord* record = &mRecords[mCount++];
+
+			record->object = [obj retain];
+			record->geometry[0] = [geometry retain];
+			record->style[0] = [[obj style] retain];
+		}
+	}
+
+	return self;
+}
+
+- (BOOL)captureChanges
+{
+	NSUInteger i, kept = 0;
+
+	for (i = 0; i < mCount; ++i) {
+		DKObjectSnapshotRecord* record = &mRecords[i];
+		DKGeometrySnapshot* geometry = [record->object geometrySnapshot];
+		DKStyle* style = [record->object style];
+
+		if ([geometry isEqualToGeometrySnapshot:record->geometry[0]] && style == record->style[0]) {
+			[record->object release];
+			[record->geometry[0] release];
+			[record->style[0] release];
+		} else {
+			record->geometry[1] = [geometry retain];
+			record->style[1] = [style retain];
+			mRecords[kept++] = *record;
+		}
+	}
+
+	mCount = kept;
+	mCurrent = 1;
+
+	return mCount > 0;
+}
+
+- (void)restore
+{
+	NSUInteger i, state = 1 - mCurrent;
+
+	for (i = 0; i < mCount; ++i) {
+		DKObjectSnapshotRecord* record = &mRecords[i];
+
+		if (record->style[state] != record->style[mCurrent])
+			[record->object setStyle:record->style[state]];
+
+		[record->object restoreGeometrySnapshot:record->geometry[state]];
+	}
+
+	mCurrent = state;
+}
+
+- (NSUInteger)count
+{
+	return mCount;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	NSUInteger i;
+
+	for (i = 0; i < mCount; ++i) {
+		DKObjectSnapshotRecord* record = &mRecords[i];
+
+		[record->object release];
+		[record->geometry[0] release];
+		[record->geometry[1] release];
+		[record->style[0] release];
+		[record->style[1] release];
+	}
+
+	free(mRecords);
+	[super dealloc];
+}
+
+@end
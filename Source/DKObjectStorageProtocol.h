@@ -12,7 +12,8 @@ typedef enum {
 	kDKReverseOrder = (1 << 0), // return objects in top to bottom order if set
 	kDKIncludeInvisible = (1 << 1), // includes invisible objects
 	kDKIgnoreUpdateRect = (1 << 2), // includes objects regardless of whether they are within the update region or not
-	kDKZOrderMayBeRelaxed = (1 << 3) // if set, the strict Z-ordering of objects may be relaxed if there is a performance benefit
+	kDKZOrderMayBeRelaxed = (1 << 3), // if set, the strict Z-ordering of objects may be relaxed if there is a performance benefit
+	kDKExactDistance = (1 << 4) // nearest-object queries measure to the objects' geometry where they can, rather than to their bounds
 } DKObjectStorageOptions;
 
 @protocol DKStorableObject <NSObject, NSCoding, NSCopying>
@@ -26,9 +27,22 @@ typedef enum {
 - (void)setMarked:(BOOL)markIt;
 - (BOOL)isMarked;
 
+// used by storage to skip objects already found by the current query (e.g. in several leaves or update rects). Each query uses a new stamp
+// from DKObjectStorageNextQueryStamp(), so unlike the mark flag it never needs clearing afterwards.
+
+- (NSUInteger)queryStamp;
+- (void)setQueryStamp:(NSUInteger)stamp;
+
 - (BOOL)visible;
 - (NSRect)bounds;
 
+@optional
+
+// the distance from the point to the object's actual geometry, used by nearest-object queries with kDKExactDistance. It must be 0 if the
+// point is inside the object, and never less than the distance to the object's bounds.
+
+- (CGFloat)distanceFromPoint:(NSPoint)aPoint;
+
 @end
 
 @protocol DKObjectStorage <NSObject>
@@ -69,8 +83,32 @@ typedef enum {
 @optional
 - (NSBezierPath*)debugStorageDivisions;
 
+// bounds changes reported between these calls may be deferred and applied in one pass when the outermost batch ends, e.g. when many objects
+// are dragged together. Calls may be nested. Queries and structural changes made during a batch apply any pending updates first.
+
+- (void)beginBoundsUpdateBatch;
+- (void)endBoundsUpdateBatch;
+
+// storage that maintains a spatial index may archive it with the objects, so that opening a document needn't rebuild it. -archivedIndex
+// returns the index as data, or nil. Data given to -setArchivedIndex: before the objects are set is used in place of building the index
+// for them, provided it still matches them - otherwise it's ignored and the index is built as usual.
+
+- (NSData*)archivedIndex;
+- (void)setArchivedIndex:(NSData*)data;
+
+// nearest-object queries. Objects are returned nearest first, measured to their bounds - or their geometry with kDKExactDistance - so that
+// objects the point is inside come first, at a distance of 0. Objects at the same distance are returned topmost first.
+
+- (NSArray*)objectsNearestPoint:(NSPoint)aPoint count:(NSUInteger)count options:(DKObjectStorageOptions)options;
+- (NSArray*)objectsWithinDistance:(CGFloat)distance ofPoint:(NSPoint)aPoint options:(DKObjectStorageOptions)options;
+
 @end
 
+/// returns a stamp value that has never been returned before, for de-duplicating the results of a single query. Stamps are never 0, so 0 can be
+/// used to mean "never found". Safe to call from any thread, so storages queried by renderers on different threads never share a stamp.
+
+NSUInteger DKObjectStorageNextQueryStamp(void);
+
 /*
 
 This protocol is used by DKObjectStorage classes to implement a common object storage schema. The purpose is to allow object storage to swapped for more efficient
@@ -0,0 +1,69 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/** @brief Draws each distinct image and symbol into a PDF once, and refers back to it for every later use.
+
+ Draws each distinct image and symbol into a PDF once, and refers back to it for every later use. An NSImage drawn into a PDF context
+ is embedded anew each time, so a document that shows the same logo on every page or stamps a motif along a path carries thousands of
+ copies of it. Quartz writes an image or layer only once per document if the same CGImage or CGLayer is drawn every time. While a
+ PDF or print operation draws, this registry keeps a CGImage for each image key (or each image that has no key) and a CGLayer for each
+ vector symbol, and draws those.
+
+ There is one registry for each operation, made the first time it's asked for and released with the operation. The registry is only
+ used when drawing straight into the operation's own context, not into a bitmap or layer made while printing. Main thread only.
+*/
+@interface DKPDFResources : NSObject {
+@private
+	CGContextRef mContext; // the operation's context, not retained
+	CFMutableDictionaryRef mImages; // key -> CGImageRef
+	CFMutableDictionaryRef mSymbols; // key -> CGLayerRef
+	NSUInteger mReuseCount;
+}
+
+/** @brief The registry for the PDF or print operation drawing into the current context
+ @return the registry, or nil when not drawing into a PDF or print operation's context
+ */
++ (DKPDFResources*)currentResources;
+
+/** @brief Returns the single image drawn for a key
+
+ The first image registered for a key is kept and returned for it afterwards. If a later one has more pixels, it is used instead from
+ then on, so the document holds each image at the largest size any use asked for.
+ @param image the image to draw
+ @param key the image's key in the image manager, or the image itself if it has none
+ @return the image to draw, or NULL if <image> has no bitmap
+ */
+- (CGImageRef)CGImageForImage:(NSImage*)image key:(id)key;
+
+/** @brief Draws a registered image upright into a rectangle, in the way -[NSImage drawInRect:fromRect:operation:fraction:] would
+
+ Only the source-over and source-atop operations can be drawn like this. For others, or if the image can't be registered, nothing is
+ drawn and the image should be drawn as usual.
+ @param image the image to draw
+ @param key the image's key, or the image itself
+ @param rect where to draw it
+ @param op the compositing operation
+ @param fraction the opacity
+ @return YES if the image was drawn
+ */
+- (BOOL)drawImage:(NSImage*)image forKey:(id)key inRect:(NSRect)rect operation:(NSCompositingOperation)op fraction:(CGFloat)fraction;
+
+/** @brief Draws a vector symbol, such as a PDF motif, with its bottom left corner at the origin
+
+ The symbol is recorded into a layer the first time, and the layer is drawn for every use.
+ @param rep the symbol's drawing
+ @param key an object identifying the symbol, e.g. the rep itself
+ */
+- (void)drawSymbol:(NSImageRep*)rep forKey:(id)key;
+
+/** @brief The number of times a registered image or symbol has been drawn again rather than embedded
+ @return the count
+ */
+- (NSUInteger)reuseCount;
+
+@end
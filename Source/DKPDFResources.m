@@ -0,0 +1,175 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKPDFResources.h"
+#import <objc/runtime.h>
+
+static char sResourcesKey; // the registry is associated with its operation under this
+
+@interface DKPDFResources (Private)
+
+- (id)initWithContext:(CGContextRef)context;
+
+@end
+
+#pragma mark -
+@implementation DKPDFResources
+#pragma mark As a DKPDFResources
+
++ (DKPDFResources*)currentResources
+{
+	NSPrintOperation* op = [NSPrintOperation currentOperation];
+
+	if (op == nil || [NSGraphicsContext currentContextDrawingToScreen])
+		return nil;
+
+	// bitmaps and layers made while printing draw as usual - only the operation's own context writes to the document
+
+	CGContextRef port = [[NSGraphicsContext currentContext] graphicsPort];
+
+	if (port == NULL || port != [[op context] graphicsPort])
+		return nil;
+
+	DKPDFResources* resources = objc_getAssociatedObject(op, &sResourcesKey);
+
+	if (resources == nil) {
+		resources = [[self alloc] initWithContext:port];
+		objc_setAssociatedObject(op, &sResourcesKey, resources, OBJC_ASSOCIATION_RETAIN_NONATOMIC);
+		[resources release];
+	}
+
+	return resources;
+}
+
+- (CGImageRef)CGImageForImage:(NSImage*)image key:(id)key
+{
+	if (image == nil)
+		return NULL;
+
+	if (key == nil)
+		key = image;
+
+	CGImageRef registered = (CGImageRef)CFDictionaryGetValue(mImages, key);
+	NSRect proposed = NSMakeRect(0, 0, [image size].width, [image size].height);
+	CGImageRef cgImage = [image CGImageForProposedRect:&proposed
+												context:nil
+												  hints:nil];
+
+	if (cgImage == NULL)
+		return registered;
+
+	// a bigger proxy of a keyed image replaces the smaller one for the rest of the document
+
+	if (registered != NULL && (registered == cgImage || CGImageGetWidth(registered) * CGImageGetHeight(registered) >= CGImageGetWidth(cgImage) * CGImageGetHeight(cgImage))) {
+		++mReuseCount;
+		return registered;
+	}
+
+	CFDictionarySetValue(mImages, key, cgImage);
+
+	return cgImage;
+}
+
+- (BOOL)drawImage:(NSImage*)image forKey:(id)key inRect:(NSRect)rect operation:(NSCompositingOperation)op fraction:(CGFloat)fraction
+{
+	CGBlendMode blendMode;
+
+	if (op == NSCompositeSourceOver)
+		blendMode = kCGBlendModeNormal;
+	else if (op == NSCompositeSourceAtop)
+		blendMode = kCGBlendModeSourceAtop;
+	else
+		return NO;
+
+	CGImageRef cgImage = [self CGImageForImage:image
+										   key:key];
+
+	if (cgImage == NULL)
+		return NO;
+
+	CGContextSaveGState(mContext);
+	CGContextSetBlendMode(mContext, blendMode);
+	CGContextSetAlpha(mContext, fraction);
+
+	// drawn upright as NSImage would, whichever way up the context is
+
+	if ([[NSGraphicsContext currentContext] isFlipped]) {
+		CGContextTranslateCTM(mContext, 0, NSMinY(rect) + NSMaxY(rect));
+		CGContextScaleCTM(mContext, 1, -1);
+	}
+
+	CGContextDrawImage(mContext, NSRectToCGRect(rect), cgImage);
+	CGContextRestoreGState(mContext);
+
+	return YES;
+}
+
+- (void)drawSymbol:(NSImageRep*)rep forKey:(id)key
+{
+	if (rep == nil)
+		return;
+
+	if (key == nil)
+		key = rep;
+
+	CGLayerRef layer = (CGLayerRef)CFDictionaryGetValue(mSymbols, key);
+
+	if (layer == NULL) {
+		NSSize size = [rep size];
+
+		layer = CGLayerCreateWithContext(mContext, NSSizeToCGSize(size), NULL);
+
+		if (layer == NULL) {
+			[rep draw];
+			return;
+		}
+
+		NSGraphicsContext* lc = [NSGraphicsContext graphicsContextWithGraphicsPort:CGLayerGetContext(layer)
+																		   flipped:NO];
+
+		[NSGraphicsContext saveGraphicsState];
+		[NSGraphicsContext setCurrentContext:lc];
+		[rep draw];
+		[NSGraphicsContext restoreGraphicsState];
+
+		CFDictionarySetValue(mSymbols, key, layer);
+		CGLayerRelease(layer);
+	} else
+		++mReuseCount;
+
+	CGContextDrawLayerAtPoint(mContext, CGPointZero, layer);
+}
+
+- (NSUInteger)reuseCount
+{
+	return mReuseCount;
+}
+
+#pragma mark -
+
+- (id)initWithContext:(CGContextRef)context
+{
+	self = [super init];
+	if (self) {
+		mContext = context;
+		mImages = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+		mSymbols = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+	}
+
+	return self;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	CFRelease(mImages);
+	CFRelease(mSymbols);
+	[super dealloc];
+}
+
+@end
@@ -38,4 +38,78 @@ This object is archived and added to the pasteboard when copying items within DK
 
 @end
 
+#pragma mark -
+
+/** @brief An in-memory copy of objects placed on a pasteboard, so that pasting them within the same process can skip archiving.
+
+ An in-memory copy of objects placed on a pasteboard, so that pasting them within the same process can skip archiving. The snapshot
+ holds its own copies of the objects as they were when copied - cheap, since the copies share their path geometry until either is
+ changed - and puts only a token on the pasteboard under kDKDrawableObjectSnapshotPasteboardType. A paste in this process looks the
+ token up and clones the objects again, so each paste gets objects of its own without the objects ever being archived.
+
+ The snapshot becomes the pasteboard's owner, and archives the objects for kDKDrawableObjectPasteboardType only when that type is
+ actually asked for - by another process, or by a paste the snapshot can't serve, such as into another drawing, whose image manager
+ won't know the keys of the objects' images. It is forgotten when the pasteboard changes owner.
+
+ In the same way, the PDF and TIFF images of the objects are only rendered, from the snapshot's copies, if another application asks for
+ them, so copying costs no more than making the snapshot.
+*/
+@interface DKPasteboardSnapshot : NSObject {
+	NSArray* mObjects;
+	NSString* mToken;
+	NSString* mOriginatingLayerKey;
+}
+
+/** @brief Returns a snapshot of <objects>, registered so that it can be found from a pasteboard
+ @param objects the objects being copied
+ @return a new snapshot
+ */
++ (DKPasteboardSnapshot*)snapshotWithObjects:(NSArray*)objects;
+
+/** @brief Returns the snapshot whose token is on the pasteboard, if it was made in this process and is still current
+ @param pb a pasteboard
+ @return the snapshot, or nil
+ */
++ (DKPasteboardSnapshot*)snapshotFromPasteboard:(NSPasteboard*)pb;
+
+- (id)initWithObjects:(NSArray*)objects;
+
+/** @brief Declares <types> on the pasteboard with the snapshot as owner, adding the snapshot's own type, and writes its token
+ @param pb the pasteboard
+ @param types the types the caller will write or that the snapshot will provide
+ @return YES if the token was written
+ */
+- (BOOL)declareTypes:(NSArray*)types onPasteboard:(NSPasteboard*)pb;
+
+/** @brief Returns new copies of the snapshot's objects, which the caller is free to add to a layer
+ @return an array of objects
+ */
+- (NSArray*)objectClones;
+- (NSUInteger)count;
+- (NSString*)token;
+- (NSString*)keyOfOriginatingLayer;
+
+/** @brief Returns the snapshot's objects archived in DK's native pasteboard format
+ @return the data
+ */
+- (NSData*)archivedObjects;
+
+/** @brief The area covered by the snapshot's objects
+ @return the union of the objects' bounds
+ */
+- (NSRect)bounds;
+
+/** @brief Renders the snapshot's objects as PDF, with a page the size of their bounds
+ @return the PDF data, or nil if there's nothing to render
+ */
+- (NSData*)pdfData;
+
+/** @brief Renders the snapshot's objects as a TIFF image of their bounds, at one pixel per point
+ @return the TIFF data, or nil if there's nothing to render
+ */
+- (NSData*)TIFFData;
+
+@end
+
 extern NSString* kDKDrawableObjectInfoPasteboardType;
+extern NSString* kDKDrawableObjectSnapshotPasteboardType;
@@ -7,8 +7,14 @@
 #import "DKPasteboardInfo.h"
 #import "DKGeometryUtilities.h"
 #import "DKLayer.h"
+#import "DKDrawableObject.h"
+#import "DKUniqueID.h"
+#import "DKDrawingRenderer.h"
+#import "DKStyle.h"
 #import "LogEvent.h"
 
+static NSMutableDictionary* sSnapshots = nil; // token -> snapshot, for those snapshots still owning a pasteboard
+
 @implementation DKPasteboardInfo
 
 + (DKPasteboardInfo*)pasteboardInfoForObjects:(NSArray*)objects
@@ -153,3 +159,287 @@
 }
 
 @end
+
+#pragma mark -
+
+@interface DKPasteboardSnapshot (Private)
+
++ (void)registerSnapshot:(DKPasteboardSnapshot*)snap;
++ (void)unregisterSnapshot:(DKPasteboardSnapshot*)snap;
+- (void)drawObjectsInRect:(NSRect)rect;
+
+@end
+
+static void drawSnapshotObjects(NSRect rect, void* info)
+{
+	[(DKPasteboardSnapshot*)info drawObjectsInRect:rect];
+}
+
+#pragma mark -
+
+@implementation DKPasteboardSnapshot
+
++ (DKPasteboardSnapshot*)snapshotWithObjects:(NSArray*)objects
+{
+	DKPasteboardSnapshot* snap = [[self alloc] initWithObjects:objects];
+	return [snap autorelease];
+}
+
++ (DKPasteboardSnapshot*)snapshotFromPasteboard:(NSPasteboard*)pb
+{
+	NSAssert(pb != nil, @"pasteboard was nil");
+
+	if ([pb availableTypeFromArray:[NSArray arrayWithObject:kDKDrawableObjectSnapshotPasteboardType]] == nil)
+		return nil;
+
+	NSString* token = [pb stringForType:kDKDrawableObjectSnapshotPasteboardType];
+	DKPasteboardSnapshot* snap = nil;
+
+	if (token) {
+		@synchronized(self)
+		{
+			snap = [[[sSnapshots objectForKey:token] retain] autorelease];
+		}
+	}
+
+	return snap;
+}
+
++ (void)registerSnapshot:(DKPasteboardSnapshot*)snap
+{
+	@synchronized(self)
+	{
+		if (sSnapshots == nil)
+			sSnapshots = [[NSMutableDictionary alloc] init];
+
+		[sSnapshots setObject:snap
+					   forKey:[snap token]];
+	}
+}
+
++ (void)unregisterSnapshot:(DKPasteboardSnapshot*)snap
+{
+	@synchronized(self)
+	{
+		// the registry may hold the last reference, so keep the snapshot alive until the caller returns
+
+		[[snap retain] autorelease];
+		[sSnapshots removeObjectForKey:[snap token]];
+	}
+}
+
+- (id)initWithObjects:(NSArray*)objects
+{
+	NSAssert(objects != nil, @"cannot snapshot nil objects");
+
+	self = [super init];
+	if (self) {
+		// copy the objects now, so that later edits to the originals don't show up in what is pasted. Paths and shapes share
+		// their geometry with the copies until one of them changes, so this costs little more than the objects themselves.
+
+		NSMutableArray* copies = [[NSMutableArray alloc] initWithCapacity:[objects count]];
+		NSEnumerator* iter = [objects objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [iter nextObject])) {
+			if (mOriginatingLayerKey == nil)
+				mOriginatingLayerKey = [[(DKLayer*)[obj layer] uniqueKey] retain];
+
+			DKDrawableObject* copy = [obj copy];
+			[copies addObject:copy];
+			[copy release];
+		}
+
+		mObjects = copies;
+		mToken = [[DKUniqueID uniqueKey] retain];
+	}
+
+	return self;
+}
+
+- (BOOL)declareTypes:(NSArray*)types onPasteboard:(NSPasteboard*)pb
+{
+	NSAssert(pb != nil, @"pasteboard was nil");
+
+	NSMutableArray* allTypes = [NSMutableArray arrayWithArray:types];
+	[allTypes addObject:kDKDrawableObjectSnapshotPasteboardType];
+
+	// register before declaring - declaring the types tells any previous owner it has lost the pasteboard, which may be another snapshot
+	// unregistering itself
+
+	[[self class] registerSnapshot:self];
+	[pb declareTypes:allTypes
+			   owner:self];
+
+	return [pb setString:[self token]
+				 forType:kDKDrawableObjectSnapshotPasteboardType];
+}
+
+- (NSArray*)objectClones
+{
+	NSMutableArray* clones = [NSMutableArray arrayWithCapacity:[mObjects count]];
+	NSEnumerator* iter = [mObjects objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject])) {
+		DKDrawableObject* clone = [obj copy];
+		[clones addObject:clone];
+		[clone release];
+	}
+
+	return clones;
+}
+
+- (NSUInteger)count
+{
+	return [mObjects count];
+}
+
+- (NSString*)token
+{
+	return mToken;
+}
+
+- (NSString*)keyOfOriginatingLayer
+{
+	return mOriginatingLayerKey;
+}
+
+- (NSData*)archivedObjects
+{
+	LogEvent_(kInfoEvent, @"archiving %lu snapshot objects for the pasteboard", (unsigned long)[mObjects count]);
+
+	return [NSKeyedArchiver archivedDataWithRootObject:mObjects];
+}
+
+- (NSRect)bounds
+{
+	NSRect br = NSZeroRect;
+	NSEnumerator* iter = [mObjects objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject]))
+		br = UnionOfTwoRects(br, [obj bounds]);
+
+	return br;
+}
+
+- (NSData*)pdfData
+{
+	NSRect br = [self bounds];
+
+	if (NSIsEmptyRect(br))
+		return nil;
+
+	LogEvent_(kInfoEvent, @"rendering %lu snapshot objects as PDF for the pasteboard", (unsigned long)[mObjects count]);
+
+	NSMutableData* data = [NSMutableData data];
+	CGDataConsumerRef consumer = CGDataConsumerCreateWithCFData((CFMutableDataRef)data);
+	CGRect box = CGRectMake(0, 0, NSWidth(br), NSHeight(br));
+	CGContextRef ctx = CGPDFContextCreate(consumer, &box, NULL);
+
+	CGDataConsumerRelease(consumer);
+
+	if (ctx == NULL)
+		return nil;
+
+	CGPDFContextBeginPage(ctx, NULL);
+	DKDrawingRenderHeadless(ctx, br, box, drawSnapshotObjects, self);
+	CGPDFContextEndPage(ctx);
+	CGPDFContextClose(ctx);
+	CGContextRelease(ctx);
+
+	return data;
+}
+
+- (NSData*)TIFFData
+{
+	NSRect br = [self bounds];
+	size_t pw = (size_t)ceil(NSWidth(br));
+	size_t ph = (size_t)ceil(NSHeight(br));
+
+	if (pw == 0 || ph == 0)
+		return nil;
+
+	LogEvent_(kInfoEvent, @"rendering %lu snapshot objects as TIFF for the pasteboard", (unsigned long)[mObjects count]);
+
+	CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	CGContextRef bm = CGBitmapContextCreate(NULL, pw, ph, 8, 0, space, kCGImageAlphaPremultipliedLast);
+	CGColorSpaceRelease(space);
+
+	if (bm == NULL)
+		return nil;
+
+	DKDrawingRenderHeadless(bm, br, CGRectMake(0, 0, pw, ph), drawSnapshotObjects, self);
+
+	CGImageRef image = CGBitmapContextCreateImage(bm);
+	CGContextRelease(bm);
+
+	if (image == NULL)
+		return nil;
+
+	NSBitmapImageRep* rep = [[NSBitmapImageRep alloc] initWithCGImage:image];
+	NSData* tiff = [rep TIFFRepresentation];
+
+	[rep release];
+	CGImageRelease(image);
+
+	return tiff;
+}
+
+- (void)drawObjectsInRect:(NSRect)rect
+{
+	NSEnumerator* iter = [mObjects objectEnumerator];
+	DKDrawableObject* obj;
+
+	[DKStyle beginRenderPass:[DKStyle renderPassForCurrentContext]
+				  lowQuality:NO];
+
+	@try
+	{
+		while ((obj = [iter nextObject])) {
+			if (NSIntersectsRect([obj bounds], rect))
+				[obj drawContentWithSelectedState:NO];
+		}
+	}
+	@finally
+	{
+		[DKStyle endRenderPass];
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSPasteboard owner
+
+- (void)pasteboard:(NSPasteboard*)sender provideDataForType:(NSString*)type
+{
+	if ([type isEqualToString:kDKDrawableObjectPasteboardType])
+		[sender setData:[self archivedObjects]
+				forType:kDKDrawableObjectPasteboardType];
+	else if ([type isEqualToString:NSPDFPboardType])
+		[sender setData:[self pdfData]
+				forType:NSPDFPboardType];
+	else if ([type isEqualToString:NSTIFFPboardType])
+		[sender setData:[self TIFFData]
+				forType:NSTIFFPboardType];
+}
+
+- (void)pasteboardChangedOwner:(NSPasteboard*)sender
+{
+#pragma unused(sender)
+
+	[[self class] unregisterSnapshot:self];
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mObjects release];
+	[mToken release];
+	[mOriginatingLayerKey release];
+	[super dealloc];
+}
+
+@end
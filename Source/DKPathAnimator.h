@@ -0,0 +1,72 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import <QuartzCore/QuartzCore.h>
+
+/** @brief Moves objects along paths in step with the display.
+
+ Moves objects along paths in step with the display. Each object moved by -moveObject:alongPath:atSpeed:loop:userInfo: (and so by
+ -[NSBezierPath moveObject:atSpeed:loop:userInfo:]) is advanced once per display refresh, driven by a CVDisplayLink rather than a timer
+ for each object. All the objects are moved together on the main thread, with the layers' display updates coalesced, so a map with
+ hundreds of moving markers costs one redraw per layer per frame rather than one per marker.
+
+ Positions are worked out from the time since each motion started and looked up in an arc length table made once for the path, so they
+ are correct whatever the frame rate. If the main thread hasn't finished the last frame when the display is ready for the next one, that
+ refresh is skipped rather than queued, so the motion drops frames under load instead of falling behind.
+
+ The objects must respond to the informal motion protocol, -moveObjectTo:position:slope:userInfo:. An object that returns NO from it is
+ stopped, as is one that reaches the end of its path when not looping. The animator retains the objects, paths and user info it moves
+ until they stop, and the display link runs only while something is moving. Main thread only.
+*/
+@interface DKPathAnimator : NSObject {
+@private
+	NSMutableArray* mMotions;
+	CVDisplayLinkRef mDisplayLink;
+	volatile int32_t mFramePending; // nonzero while a frame is queued for the main thread
+	volatile int64_t mDroppedFrames;
+}
+
+/** @brief The animator used by -[NSBezierPath moveObject:atSpeed:loop:userInfo:]
+ @return the shared animator
+ */
++ (DKPathAnimator*)sharedAnimator;
+
+/** @brief Starts moving an object along a path at a constant speed
+
+ The object is moved to the start of the path straight away. If it returns NO then, it isn't moved any further.
+ @param object the object to be moved
+ @param path the path to move it along; it is measured now, so later changes to it don't affect the motion
+ @param speed the speed in points per second
+ @param loop YES to go back to the start each time the end is reached, NO to stop there
+ @param userInfo user info passed to the object
+ */
+- (void)moveObject:(id)object alongPath:(NSBezierPath*)path atSpeed:(CGFloat)speed loop:(BOOL)loop userInfo:(id)userInfo;
+
+/** @brief Stops every motion of an object, leaving it where it is
+ @param object the object
+ */
+- (void)stopMovingObject:(id)object;
+- (void)stopAllMotions;
+
+/** @brief The number of objects being moved
+ @return the number of motions
+ */
+- (NSUInteger)countOfMotions;
+
+/** @brief Moves every object to where it should be at a given time
+
+ Called for each display refresh. Can also be called directly, e.g. to step an animation while recording it.
+ @param time the time, as from +[NSDate timeIntervalSinceReferenceDate]
+ */
+- (void)advanceToTime:(NSTimeInterval)time;
+
+/** @brief The number of display refreshes skipped because the main thread was still busy with the last frame
+ @return the count since the animator was made
+ */
+- (NSUInteger)droppedFrameCount;
+
+@end
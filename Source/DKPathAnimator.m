@@ -0,0 +1,280 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKPathAnimator.h"
+#import "DKArcLengthTable.h"
+#import "DKLayer.h"
+#import "NSBezierPath+Text.h"
+#import <libkern/OSAtomic.h>
+
+// one object being moved along a path
+
+@interface DKPathMotion : NSObject {
+@public
+	id mTarget;
+	id mUserInfo;
+	DKArcLengthTable* mLengthTable;
+	CGFloat mLength;
+	CGFloat mSpeed;
+	NSTimeInterval mStartTime;
+	BOOL mLoops;
+}
+
+@end
+
+@implementation DKPathMotion
+
+- (void)dealloc
+{
+	[mTarget release];
+	[mUserInfo release];
+	[mLengthTable release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKPathAnimator (Private)
+
+- (void)displayDidRefresh;
+- (void)frameDidFinish;
+- (void)startDisplayLink;
+- (void)stopDisplayLink;
+
+@end
+
+static CVReturn displayLinkCallback(CVDisplayLinkRef displayLink, const CVTimeStamp* now, const CVTimeStamp* outputTime, CVOptionFlags flagsIn, CVOptionFlags* flagsOut, void* context)
+{
+#pragma unused(displayLink, now, outputTime, flagsIn, flagsOut)
+
+	@autoreleasepool {
+		[(DKPathAnimator*)context displayDidRefresh];
+	}
+
+	return kCVReturnSuccess;
+}
+
+static void advanceFrame(void* context)
+{
+	DKPathAnimator* animator = (DKPathAnimator*)context;
+
+	[animator advanceToTime:[NSDate timeIntervalSinceReferenceDate]];
+	[animator frameDidFinish];
+}
+
+#pragma mark -
+@implementation DKPathAnimator
+#pragma mark As a DKPathAnimator
+
++ (DKPathAnimator*)sharedAnimator
+{
+	static DKPathAnimator* sSharedAnimator = nil;
+
+	if (sSharedAnimator == nil)
+		sSharedAnimator = [[self alloc] init];
+
+	return sSharedAnimator;
+}
+
+- (void)moveObject:(id)object alongPath:(NSBezierPath*)path atSpeed:(CGFloat)speed loop:(BOOL)loop userInfo:(id)userInfo
+{
+	NSAssert(object != nil, @"can't move a nil object");
+
+	if (![object respondsToSelector:@selector(moveObjectTo:
+												  position:
+													 slope:
+												  userInfo:)])
+		[NSException raise:NSInvalidArgumentException
+					format:@"Moved object %@ does not implement the required protocol", object];
+
+	if ([path elementCount] < 2 || speed <= 0)
+		return;
+
+	// set the object's position to the start of the path initially
+
+	DKArcLengthTable* lengthTable = [DKArcLengthTable arcLengthTableWithPath:path];
+	CGFloat slope;
+	NSPoint where = [lengthTable pointAtLength:0
+										 slope:&slope];
+
+	if (![object moveObjectTo:where
+					 position:0
+						slope:slope
+					 userInfo:userInfo])
+		return;
+
+	DKPathMotion* motion = [[DKPathMotion alloc] init];
+
+	motion->mTarget = [object retain];
+	motion->mUserInfo = [userInfo retain];
+	motion->mLengthTable = [lengthTable retain];
+	motion->mLength = [lengthTable length];
+	motion->mSpeed = speed;
+	motion->mStartTime = [NSDate timeIntervalSinceReferenceDate];
+	motion->mLoops = loop;
+
+	[mMotions addObject:motion];
+	[motion release];
+
+	[self startDisplayLink];
+}
+
+- (void)stopMovingObject:(id)object
+{
+	NSUInteger i = [mMotions count];
+
+	while (i-- > 0) {
+		DKPathMotion* motion = [mMotions objectAtIndex:i];
+
+		if (motion->mTarget == object)
+			[mMotions removeObjectAtIndex:i];
+	}
+
+	if ([mMotions count] == 0)
+		[self stopDisplayLink];
+}
+
+- (void)stopAllMotions
+{
+	[mMotions removeAllObjects];
+	[self stopDisplayLink];
+}
+
+- (NSUInteger)countOfMotions
+{
+	return [mMotions count];
+}
+
+- (void)advanceToTime:(NSTimeInterval)time
+{
+	if ([mMotions count] == 0)
+		return;
+
+	// the objects may stop or start motions in their callbacks, so a snapshot is moved and the finished ones removed afterwards
+
+	NSArray* motions = [mMotions copy];
+	NSMutableArray* finished = nil;
+	NSEnumerator* iter = [motions objectEnumerator];
+	DKPathMotion* motion;
+
+	[DKLayer beginCoalescingDisplayUpdates];
+
+	while ((motion = [iter nextObject])) {
+		CGFloat distance = motion->mSpeed * (time - motion->mStartTime);
+		BOOL shouldStop = NO;
+
+		if (!motion->mLoops && distance > motion->mLength) {
+			// reached the end of the path, so stop if not looping
+
+			distance = motion->mLength;
+			shouldStop = YES;
+		} else if (motion->mLoops && motion->mLength > 0)
+			distance = fmod(distance, motion->mLength);
+
+		NSPoint where;
+		CGFloat slope;
+
+		where = [motion->mLengthTable pointAtLength:distance
+											  slope:&slope];
+
+		// if the target returns NO, it is telling us to stop immediately, whether or not we are looping
+
+		shouldStop |= ![motion->mTarget moveObjectTo:where
+											 position:distance
+												slope:slope
+											 userInfo:motion->mUserInfo];
+
+		if (shouldStop) {
+			if (finished == nil)
+				finished = [NSMutableArray array];
+
+			[finished addObject:motion];
+		}
+	}
+
+	[DKLayer endCoalescingDisplayUpdates];
+
+	if (finished != nil) {
+		[mMotions removeObjectsInArray:finished];
+
+		if ([mMotions count] == 0)
+			[self stopDisplayLink];
+	}
+
+	[motions release];
+}
+
+- (NSUInteger)droppedFrameCount
+{
+	return (NSUInteger)mDroppedFrames;
+}
+
+#pragma mark -
+
+- (void)displayDidRefresh
+{
+	// called on the display link's thread. Only one frame is queued for the main thread at a time - if the last one is still waiting,
+	// this refresh is skipped, so a busy main thread sees fewer frames rather than a backlog of them
+
+	if (OSAtomicCompareAndSwap32Barrier(0, 1, &mFramePending))
+		dispatch_async_f(dispatch_get_main_queue(), self, advanceFrame);
+	else
+		OSAtomicIncrement64(&mDroppedFrames);
+}
+
+- (void)frameDidFinish
+{
+	OSAtomicCompareAndSwap32Barrier(1, 0, &mFramePending);
+}
+
+- (void)startDisplayLink
+{
+	if (mDisplayLink == NULL) {
+		if (CVDisplayLinkCreateWithActiveCGDisplays(&mDisplayLink) != kCVReturnSuccess) {
+			mDisplayLink = NULL;
+			return;
+		}
+
+		CVDisplayLinkSetOutputCallback(mDisplayLink, displayLinkCallback, self);
+	}
+
+	if (!CVDisplayLinkIsRunning(mDisplayLink))
+		CVDisplayLinkStart(mDisplayLink);
+}
+
+- (void)stopDisplayLink
+{
+	if (mDisplayLink != NULL && CVDisplayLinkIsRunning(mDisplayLink))
+		CVDisplayLinkStop(mDisplayLink);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		mMotions = [[NSMutableArray alloc] init];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[self stopDisplayLink];
+
+	if (mDisplayLink != NULL)
+		CVDisplayLinkRelease(mDisplayLink);
+
+	[mMotions release];
+	[super dealloc];
+}
+
+@end
@@ -14,6 +14,11 @@ This renderer draws the image along the path of another object spaced at <interv
 rotated to be normal to the path unless _normalToPath is NO.
 
 This prefers PDF image representations where the image contains one, preserving resolution as the drawing is scaled.
+
+Unless a subclass overrides -placeObjectAtPoint:onPath:position:slope:userInfo:, the placements are not made through that callback one at a
+time. Instead the points and slopes are found in batches in a single pass over the path's arc length table, the transform of each
+visible motif is worked out into a C array, and the batch is then stamped in one go, with a bitmap motif drawn straight from its CGImage.
+Each placement is the same as the callback would make it.
 */
 @interface DKPathDecorator : DKRasterizer <NSCoding, NSCopying> {
 @private
@@ -35,8 +40,8 @@ This prefers PDF image representations where the image contains one, preserving
 	BOOL m_lowQuality;
 @protected
 	NSUInteger mPlacementCount;
-	NSMutableArray* mWobbleCache;
-	NSMutableArray* mScaleRandCache;
+	NSBezierPath* mRenderingPathRef; // path being rendered, and its length, so each placement doesn't measure it again
+	CGFloat mRenderingPathLength;
 }
 
 + (DKPathDecorator*)pathDecoratorWithImage:(NSImage*)image;
@@ -83,6 +88,19 @@ This prefers PDF image representations where the image contains one, preserving
 - (void)setUsesChainMethod:(BOOL)chain;
 - (BOOL)usesChainMethod;
 
+/** @brief Draws the motif once, with its bottom, left corner at the origin of the current coordinates
+
+ Each placement calls this, passing NSCompositeSourceAtop, once it has transformed the coordinates to the motif's position, scale
+ and angle. Subclasses that draw the motif some other way can use it too.
+ @param op the compositing operation for a bitmap image; PDF and low quality cached motifs are always drawn over
+ */
+- (void)drawMotifUsingOperation:(NSCompositingOperation)op;
+
+/** @brief Whether -drawMotifUsingOperation: uses the operation passed to it
+ @return YES if the motif is drawn as a bitmap image
+ */
+- (BOOL)motifDrawsAtop;
+
 @end
 
 // clipping values:
@@ -92,3 +110,10 @@ enum {
 	kDKPathDecoratorClipOutsidePath = 1,
 	kDKPathDecoratorClipInsidePath = 2
 };
+
+// random values drawn for each placement - wobble x and y, scale and, for patterns, motif angle - so that each placement's values
+// are found by index, from a seed derived from the decorator
+
+#define kDKRandomValuesPerPlacement 4
+
+#define kDKPathDecoratorPlacementBatchSize 256 // the number of placements worked out before the motifs are drawn
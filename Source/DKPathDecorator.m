@@ -7,6 +7,7 @@
 #import "DKPathDecorator.h"
 
 #import "DKDrawing.h"
+#import "DKStyle.h"
 #import "DKDrawingView.h"
 #import "LogEvent.h"
 #import "NSBezierPath+Geometry.h"
@@ -16,8 +17,33 @@
 #import "DKDrawKitMacros.h"
 #import "DKRandom.h"
 #import "DKQuartzCache.h"
+#import "DKArcLengthTable.h"
+#import "DKPDFResources.h"
 #include <tgmath.h>
 
+@interface DKPathDecorator (Private)
+
+/** @brief Whether placements can be worked out in batches rather than by calling back for each one
+ @return YES unless a subclass places each motif itself
+ */
+- (BOOL)placesMotifsInBatches;
+
+/** @brief Places the motif along the path at the interval, as -placeObjectsOnPathAtInterval:factoryObject:userInfo: with the
+ decorator as the factory
+ @param path the path
+ */
+- (void)placeMotifsOnPath:(NSBezierPath*)path;
+
+/** @brief Draws the motif once for each transform, which maps the motif's coordinates to those of the path
+ @param transforms the transforms
+ @param count the number of transforms
+ */
+- (void)drawMotifWithTransforms:(const CGAffineTransform*)transforms count:(NSUInteger)count;
+
+@end
+
+#pragma mark -
+
 @implementation DKPathDecorator
 #pragma mark As a DKPathDecorator
 
@@ -54,6 +80,7 @@
 	// remove any CGLayer cache so that next time the rasterizer is used it
 	// will be recreated using the new image
 
+	[DKQuartzCache returnCacheToPool:mDKCache];
 	[mDKCache release];
 	mDKCache = nil;
 
@@ -93,9 +120,11 @@
 	NSAssert(m_image != nil, @"no image to create cache with");
 
 #if USE_DK_CACHE
-	if (mDKCache)
+	if (mDKCache) {
+		[DKQuartzCache returnCacheToPool:mDKCache];
 		[mDKCache release];
-	mDKCache = [[DKQuartzCache cacheForImage:[self image]] retain];
+	}
+	mDKCache = [[DKQuartzCache checkOutCacheForImage:[self image]] retain];
 #else
 	NSAssert(m_cache == nil, @"expected cache to be NULL");
 
@@ -171,14 +200,7 @@
 {
 	scRand = LIMIT(scRand, 0, 1.0);
 
-	if (scRand != mScaleRandomness) {
-		mScaleRandomness = scRand;
-
-		if (mScaleRandCache == nil)
-			mScaleRandCache = [[NSMutableArray alloc] init];
-
-		[mScaleRandCache removeAllObjects];
-	}
+	mScaleRandomness = scRand;
 }
 
 - (CGFloat)scaleRandomness
@@ -232,14 +254,7 @@
 {
 	wobble = LIMIT(wobble, 0, 1);
 
-	if (wobble != mWobblyness) {
-		mWobblyness = wobble;
-
-		if (mWobbleCache == nil)
-			mWobbleCache = [[NSMutableArray alloc] init];
-
-		[mWobbleCache removeAllObjects];
-	}
+	mWobblyness = wobble;
 }
 
 - (CGFloat)wobblyness
@@ -364,9 +379,8 @@
 {
 	[m_pdf release];
 	[m_image release];
+	[DKQuartzCache returnCacheToPool:mDKCache];
 	[mDKCache release];
-	[mWobbleCache release];
-	[mScaleRandCache release];
 	[super dealloc];
 }
 
@@ -393,7 +407,7 @@
 		CGFloat leadScale = 1.0;
 
 		if (path != nil) {
-			CGFloat loLen = [path length] - m_leadOutLength;
+			CGFloat loLen = ((path == mRenderingPathRef) ? mRenderingPathLength : [path length]) - m_leadOutLength;
 
 			if (m_leadInLength != 0 && pos <= m_leadInLength)
 				leadScale = [self rampFunction:pos / m_leadInLength];
@@ -417,18 +431,14 @@
 		CGFloat dx = mLateralOffset * cosf(slope + HALF_PI);
 		CGFloat dy = mLateralOffset * sinf(slope + HALF_PI);
 		NSPoint wobblePoint = NSZeroPoint;
+		uint64_t seed = DKRandomSeedForObject(self);
 
 		if ([self wobblyness] > 0.0) {
-			// wobblyness is a randomising positioning factor from 0..1 that is scaled by the spacing and offset by half. This is
-			// cached so that the wobble positions are not recalculated unless the wobble factor itself changes.
-
-			if (mPlacementCount < [mWobbleCache count])
-				wobblePoint = [[mWobbleCache objectAtIndex:mPlacementCount] pointValue];
-			else {
-				wobblePoint.x = [DKRandom randomPositiveOrNegativeNumber] * [self interval] * [self wobblyness];
-				wobblePoint.y = [DKRandom randomPositiveOrNegativeNumber] * [self interval] * [self wobblyness];
-				[mWobbleCache addObject:[NSValue valueWithPoint:wobblePoint]];
-			}
+			// wobblyness is a randomising positioning factor from 0..1 that is scaled by the spacing and offset by half. The random
+			// amounts depend only on the decorator and the placement, so the wobble positions are the same every time it's drawn.
+
+			wobblePoint.x = DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement) * [self interval] * [self wobblyness];
+			wobblePoint.y = DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement + 1) * [self interval] * [self wobblyness];
 		}
 
 		CGFloat randScale = 1.0;
@@ -437,12 +447,7 @@
 			// scale randomness is a randomising factor applied to the scale of the motif. Scale max is always
 			// set to the normal scale, the randomising factor makes the scale relatively smaller
 
-			if (mPlacementCount < [mScaleRandCache count])
-				randScale = [[mScaleRandCache objectAtIndex:mPlacementCount] doubleValue];
-			else {
-				randScale = 1.0 + ([DKRandom randomPositiveOrNegativeNumber] * [self scaleRandomness]);
-				[mScaleRandCache addObject:[NSNumber numberWithDouble:randScale]];
-			}
+			randScale = 1.0 + (DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement + 2) * [self scaleRandomness]);
 		}
 
 		[tfm translateXBy:p.x + dx + wobblePoint.x
@@ -477,17 +482,7 @@
 		if (cv == nil || [cv needsToDrawRect:drawnRect]) {
 			SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
 				[tfm concat];
-
-			if (mDKCache && m_lowQuality) {
-				[mDKCache drawAtPoint:NSZeroPoint];
-			} else if (m_pdf != nil)
-				[m_pdf draw];
-			else
-				[img drawAtPoint:NSZeroPoint
-						fromRect:NSZeroRect
-					   operation:NSCompositeSourceAtop
-						fraction:1.0];
-
+			[self drawMotifUsingOperation:NSCompositeSourceAtop];
 			RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 		}
 	}
@@ -499,6 +494,201 @@
 	return nil;
 }
 
+- (void)drawMotifUsingOperation:(NSCompositingOperation)op
+{
+	// draws the motif with its bottom, left corner at the origin. The low quality cache and PDF are always drawn over what's
+	// there already; <op> is used for a bitmap image. A PDF or print holds one copy of the motif and refers back to it for each placement.
+
+	DKPDFResources* pdfResources = [DKPDFResources currentResources];
+	CGImageRef pdfImage = NULL;
+
+	if (pdfResources != nil && m_pdf == nil && op == NSCompositeSourceAtop && !(mDKCache && m_lowQuality))
+		pdfImage = [pdfResources CGImageForImage:[self image]
+											 key:nil];
+
+	if (mDKCache && m_lowQuality) {
+		[mDKCache drawAtPoint:NSZeroPoint];
+	} else if (m_pdf != nil) {
+		if (pdfResources != nil)
+			[pdfResources drawSymbol:m_pdf
+							  forKey:m_pdf];
+		else
+			[m_pdf draw];
+	} else if (pdfImage != NULL) {
+		NSSize iSize = [[self image] size];
+		CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+
+		CGContextSaveGState(context);
+		CGContextSetBlendMode(context, kCGBlendModeSourceAtop);
+		CGContextDrawImage(context, CGRectMake(0, 0, iSize.width, iSize.height), pdfImage);
+		CGContextRestoreGState(context);
+	} else
+		[[self image] drawAtPoint:NSZeroPoint
+						 fromRect:NSZeroRect
+						operation:op
+						 fraction:1.0];
+}
+
+- (BOOL)motifDrawsAtop
+{
+	return !(mDKCache && m_lowQuality) && m_pdf == nil;
+}
+
+- (BOOL)placesMotifsInBatches
+{
+	SEL placement = @selector(placeObjectAtPoint:onPath:position:slope:userInfo:);
+
+	return [self methodForSelector:placement] == [DKPathDecorator instanceMethodForSelector:placement];
+}
+
+- (void)placeMotifsOnPath:(NSBezierPath*)path
+{
+	NSImage* img = [self image];
+
+	if (img == nil || [path elementCount] < 2)
+		return;
+
+	// everything that -placeObjectAtPoint:... looks up for each placement is the same for all of them, so it's fetched once here
+
+	DKArcLengthTable* table = [DKArcLengthTable arcLengthTableWithPath:path];
+	DKDrawingView* cv = [DKDrawingView currentlyDrawingView];
+	NSSize iSize = [img size];
+	CGFloat interval = [self interval];
+	CGFloat length = [table length];
+	CGFloat loLen = length - m_leadOutLength;
+	CGFloat scale = [self scale];
+	CGFloat wobble = [self wobblyness] * interval;
+	CGFloat scaleRandomness = [self scaleRandomness];
+	BOOL normal = [self normalToPath];
+	uint64_t seed = DKRandomSeedForObject(self);
+
+	NSPoint points[kDKPathDecoratorPlacementBatchSize];
+	CGFloat slopes[kDKPathDecoratorPlacementBatchSize];
+	CGAffineTransform transforms[kDKPathDecoratorPlacementBatchSize];
+	NSUInteger first = 0, n, i, visible;
+
+	while ((n = [table getPoints:points
+						  slopes:slopes
+					  fromLength:interval * first
+						interval:interval
+						   count:kDKPathDecoratorPlacementBatchSize]) > 0) {
+		visible = 0;
+
+		for (i = 0; i < n; ++i) {
+			CGFloat pos = interval * (first + i);
+			CGFloat slope = slopes[i];
+			NSPoint p = points[i];
+			CGFloat leadScale = 1.0;
+
+			if (m_leadInLength != 0 && pos <= m_leadInLength)
+				leadScale = [self rampFunction:pos / m_leadInLength];
+			else if (m_leadOutLength != 0 && pos >= loLen)
+				leadScale = [self rampFunction:1.0 - ((pos - loLen) / m_leadOutLength)];
+
+			// placements that have shrunk to nothing don't count, as with the callback
+
+			if (leadScale <= 0.0)
+				continue;
+
+			if ((mPlacementCount & 1) && mAlternateLateralOffsets)
+				slope += pi;
+
+			CGFloat dx = mLateralOffset * cos(slope + HALF_PI);
+			CGFloat dy = mLateralOffset * sin(slope + HALF_PI);
+			CGFloat wx = 0.0, wy = 0.0, randScale = 1.0;
+
+			if (wobble > 0.0) {
+				wx = DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement) * wobble;
+				wy = DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement + 1) * wobble;
+			}
+
+			if (scaleRandomness > 0.0)
+				randScale = 1.0 + (DKRandomSignedAtIndex(seed, mPlacementCount * kDKRandomValuesPerPlacement + 2) * scaleRandomness);
+
+			++mPlacementCount;
+
+			CGFloat s = scale * leadScale * randScale;
+			CGAffineTransform tfm = CGAffineTransformMakeTranslation(p.x + dx + wx, p.y + dy + wy);
+
+			tfm = CGAffineTransformScale(tfm, s, -s);
+
+			if (normal)
+				tfm = CGAffineTransformRotate(tfm, -slope);
+
+			tfm = CGAffineTransformTranslate(tfm, -(iSize.width / 2), -(iSize.height / 2));
+
+			// skip motifs outside the area being drawn, using the same generous square around the point as the callback
+
+			if (cv != nil) {
+				CGPoint a = CGPointApplyAffineTransform(CGPointZero, tfm);
+				CGPoint b = CGPointApplyAffineTransform(CGPointMake(iSize.width, iSize.height), tfm);
+				CGFloat maxw = MAX(ABS(b.x - a.x), ABS(b.y - a.y)) * 1.4;
+
+				if (![cv needsToDrawRect:NSMakeRect(p.x - maxw * 0.5, p.y - maxw * 0.5, maxw, maxw)])
+					continue;
+			}
+
+			transforms[visible++] = tfm;
+		}
+
+		[self drawMotifWithTransforms:transforms
+								count:visible];
+
+		first += n;
+
+		if (n < kDKPathDecoratorPlacementBatchSize)
+			break;
+	}
+}
+
+- (void)drawMotifWithTransforms:(const CGAffineTransform*)transforms count:(NSUInteger)count
+{
+	if (count == 0)
+		return;
+
+	NSGraphicsContext* nsContext = [NSGraphicsContext currentContext];
+	CGContextRef context = [nsContext graphicsPort];
+	CGImageRef image = NULL;
+	NSSize iSize = [[self image] size];
+	NSUInteger i;
+
+	// a bitmap motif is stamped straight from its CGImage, which is only looked up once for the whole batch
+
+	if ([self motifDrawsAtop]) {
+		DKPDFResources* pdfResources = [DKPDFResources currentResources];
+		NSRect proposed = NSMakeRect(0, 0, iSize.width, iSize.height);
+
+		// in a PDF or print, every batch draws the same CGImage so the document holds the motif once
+
+		if (pdfResources != nil)
+			image = [pdfResources CGImageForImage:[self image]
+											  key:nil];
+		else
+			image = [[self image] CGImageForProposedRect:&proposed
+												 context:nsContext
+												   hints:nil];
+	}
+
+	CGContextSaveGState(context);
+
+	if (image != NULL)
+		CGContextSetBlendMode(context, kCGBlendModeSourceAtop);
+
+	for (i = 0; i < count; ++i) {
+		CGContextSaveGState(context);
+		CGContextConcatCTM(context, transforms[i]);
+
+		if (image != NULL)
+			CGContextDrawImage(context, CGRectMake(0, 0, iSize.width, iSize.height), image);
+		else
+			[self drawMotifUsingOperation:NSCompositeSourceAtop];
+
+		CGContextRestoreGState(context);
+	}
+
+	CGContextRestoreGState(context);
+}
+
 - (id)placeLinkFromPoint:(NSPoint)pa toPoint:(NSPoint)pb onPath:(NSBezierPath*)path linkNumber:(NSInteger)lkn userInfo:(void*)userInfo
 {
 #pragma unused(path)
@@ -549,7 +739,7 @@
 		if (mDKCache == nil && [self image] != nil)
 			[self setUpCache];
 
-		m_lowQuality = [obj useLowQualityDrawing];
+		m_lowQuality = DKRenderUsesLowQualityDrawing(obj);
 
 		NSBezierPath* path = [self renderingPathForObject:obj];
 
@@ -589,6 +779,9 @@
 	if ([self interval] <= 0.0)
 		return;
 
+	mRenderingPathRef = path;
+	mRenderingPathLength = [path length];
+
 	if ([self usesChainMethod]) {
 		NSInteger pass = 0;
 
@@ -600,10 +793,14 @@
 		[path placeLinksOnPathWithLinkLength:[self interval]
 							   factoryObject:self
 									userInfo:&pass];
-	} else
+	} else if ([self placesMotifsInBatches])
+		[self placeMotifsOnPath:path];
+	else
 		[path placeObjectsOnPathAtInterval:[self interval]
 							 factoryObject:self
 								  userInfo:NULL];
+
+	mRenderingPathRef = nil;
 }
 
 #pragma mark -
@@ -0,0 +1,97 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/// opaque types used internally by the index
+
+typedef struct _DKElementIndexEntry DKElementIndexEntry;
+typedef struct _DKElementIndexNode DKElementIndexNode;
+
+/// called for each pair of elements found by -getElementPairsTouchingIndex:function:context:
+
+typedef void (*DKElementPairFunction)(NSInteger element, NSInteger otherElement, void* context);
+
+/** @brief A spatial index of the elements of a path, used to speed up hit-testing.
+
+ NSBezierPath's partcode and element hit-testing methods consider each element in turn, working out its bounding box as they go.
+ That is fine for a handful of elements, but on a traced path with many thousands of them it makes hovering or clicking noticeably slow.
+
+ This index records the bounds of every element once, then groups runs of consecutive elements into a balanced tree of bounding boxes.
+ A query walks down only the branches whose boxes are near the point, and returns candidates in ascending element order. Because the order
+ is kept, a hit-test using the index finds the same element or partcode as the linear scan would.
+
+ The index is a snapshot of the path and must be discarded when the path is edited. DKDrawablePath keeps one for its path and does this for you.
+*/
+@interface DKPathElementIndex : NSObject {
+@private
+	DKElementIndexEntry* mEntries;
+	NSInteger mElementCount;
+	DKElementIndexNode* mNodes;
+	NSInteger mLeafCount;
+	NSInteger mFirstLeaf;
+}
+
+/** @brief Returns a new index for the path
+ @param path the path
+ @return an autoreleased index
+ */
++ (DKPathElementIndex*)elementIndexWithPath:(NSBezierPath*)path;
+
+/** @brief Initializes the index by recording the bounds of each element of the path
+ @param path the path
+ @return the index
+ */
+- (id)initWithPath:(NSBezierPath*)path;
+
+/** @brief The number of elements in the path when the index was built
+ @return the element count
+ */
+- (NSInteger)elementCount;
+
+/** @brief Returns the first element at or after a given index whose bounds lie within a tolerance of a point
+
+ The bounds are those returned by -[NSBezierPath boundingBoxForElement:]. Move elements never match.
+ @param element the index of the first element to consider
+ @param p the point
+ @param tol the distance that the point may lie outside an element's bounds
+ @return the element index, or -1 if no other element is near the point
+ */
+- (NSInteger)elementFromIndex:(NSInteger)element nearPoint:(NSPoint)p tolerance:(CGFloat)tol;
+
+/** @brief Returns the first element at or after a given index that has a control point within a tolerance of a point
+
+ An element's control points for this purpose include the end point of the element before it, so that a partcode hit-test
+ can look at just the elements returned here.
+ @param element the index of the first element to consider
+ @param p the point
+ @param tol the distance that the point may lie outside the bounds of the control points
+ @return the element index, or -1 if no other element has control points near the point
+ */
+- (NSInteger)elementFromIndex:(NSInteger)element withControlPointsNearPoint:(NSPoint)p tolerance:(CGFloat)tol;
+
+/** @brief Returns the elements whose bounds touch a rect
+
+ Used to draw only the part of a long path that lies within the area being updated. Move elements are never included, and bounds of
+ no width or height, as of a horizontal or vertical line, count as touching if their edges do.
+ @param rect the rect
+ @return the indexes of the elements
+ */
+- (NSIndexSet*)elementsIntersectingRect:(NSRect)rect;
+
+/** @brief Finds the pairs of elements of this path and another whose bounds touch
+
+ Used to find where two paths cross without testing every element of one against every element of the other. The two trees are
+ walked together, and only where two nodes' bounds touch are their children looked at, so paths whose elements are mostly far apart
+ cost little more than their nodes near each other. Move elements are never included. The function may be called from any thread,
+ as the index is not changed; neither index may be discarded until this returns.
+ @param other the index of the other path
+ @param function called with each pair, the element of this path first
+ @param context passed to the function
+ */
+- (void)getElementPairsTouchingIndex:(DKPathElementIndex*)other function:(DKElementPairFunction)function context:(void*)context;
+
+@end
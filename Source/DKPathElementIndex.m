@@ -0,0 +1,386 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKPathElementIndex.h"
+#import "DKGeometryUtilities.h"
+
+#define kDKElementIndexLeafSize 8 // number of consecutive elements grouped in each leaf of the tree
+
+// the bounds of one element. <bounds> is the same as -boundingBoxForElement:, <controlBounds> encloses the points that a partcode
+// hit-test considers for the element, which includes the end point of the previous element.
+
+struct _DKElementIndexEntry {
+	NSRect bounds;
+	NSRect controlBounds;
+	BOOL isMove;
+};
+
+// a node of the tree, stored in an array with the children of node k at 2k and 2k + 1. <bounds> encloses both kinds of bounds
+// for all the elements below it.
+
+struct _DKElementIndexNode {
+	NSRect bounds;
+	BOOL isEmpty;
+};
+
+static inline BOOL pointNearRect(NSPoint p, NSRect r, CGFloat tol)
+{
+	// unlike NSPointInRect, the rect's edges are included, so that zero-width or zero-height rects can be hit
+
+	return (p.x >= NSMinX(r) - tol && p.x <= NSMaxX(r) + tol && p.y >= NSMinY(r) - tol && p.y <= NSMaxY(r) + tol);
+}
+
+static inline BOOL rectsTouch(NSRect a, NSRect b)
+{
+	// as NSIntersectsRect, but edges are included for the same reason
+
+	return (NSMinX(a) <= NSMaxX(b) && NSMinX(b) <= NSMaxX(a) && NSMinY(a) <= NSMaxY(b) && NSMinY(b) <= NSMaxY(a));
+}
+
+static inline NSRect unionOfRects(NSRect a, NSRect b)
+{
+	// zero-sized rects are valid bounds here (a degenerate element), so unlike UnionOfTwoRects() nothing is ignored
+
+	CGFloat minx = MIN(NSMinX(a), NSMinX(b));
+	CGFloat miny = MIN(NSMinY(a), NSMinY(b));
+
+	return NSMakeRect(minx, miny, MAX(NSMaxX(a), NSMaxX(b)) - minx, MAX(NSMaxY(a), NSMaxY(b)) - miny);
+}
+
+static inline NSRect rectEnclosingPoints(const NSPoint* pts, NSInteger count)
+{
+	CGFloat minx, miny, maxx, maxy;
+	NSInteger j;
+
+	minx = miny = HUGE_VAL;
+	maxx = maxy = -HUGE_VAL;
+
+	for (j = 0; j < count; ++j) {
+		minx = MIN(minx, pts[j].x);
+		miny = MIN(miny, pts[j].y);
+		maxx = MAX(maxx, pts[j].x);
+		maxy = MAX(maxy, pts[j].y);
+	}
+
+	return NSMakeRect(minx, miny, maxx - minx, maxy - miny);
+}
+
+@interface DKPathElementIndex (Private)
+
+- (void)buildNodes;
+- (NSInteger)searchNode:(NSInteger)node fromElement:(NSInteger)element nearPoint:(NSPoint)p tolerance:(CGFloat)tol controlPoints:(BOOL)controls;
+- (void)collectNode:(NSInteger)node intersectingRect:(NSRect)rect into:(NSMutableIndexSet*)elements;
+- (void)pairNode:(NSInteger)node withNode:(NSInteger)otherNode ofIndex:(DKPathElementIndex*)other function:(DKElementPairFunction)function context:(void*)context;
+
+@end
+
+#pragma mark -
+
+@implementation DKPathElementIndex
+
++ (DKPathElementIndex*)elementIndexWithPath:(NSBezierPath*)path
+{
+	return [[[self alloc] initWithPath:path] autorelease];
+}
+
+- (id)initWithPath:(NSBezierPath*)path
+{
+	self = [super init];
+	if (self) {
+		NSInteger i;
+		NSPoint ap[3], pts[4];
+		NSPoint lastPoint = NSZeroPoint, subpathStart = NSZeroPoint;
+
+		mElementCount = [path elementCount];
+		mEntries = calloc(MAX(mElementCount, 1), sizeof(DKElementIndexEntry));
+
+		for (i = 0; i < mElementCount; ++i) {
+			DKElementIndexEntry* entry = &mEntries[i];
+			NSBezierPathElement element = [path elementAtIndex:i
+											  associatedPoints:ap];
+
+			pts[0] = lastPoint;
+
+			switch (element) {
+			case NSMoveToBezierPathElement:
+				entry->isMove = YES;
+				entry->bounds = NSZeroRect;
+				pts[1] = ap[0];
+				entry->controlBounds = (i > 0) ? rectEnclosingPoints(pts, 2) : rectEnclosingPoints(ap, 1);
+				subpathStart = lastPoint = ap[0];
+				break;
+
+			case NSLineToBezierPathElement:
+				entry->bounds = NSRectFromTwoPoints(ap[0], lastPoint);
+				entry->controlBounds = entry->bounds;
+				lastPoint = ap[0];
+				break;
+
+			case NSCurveToBezierPathElement:
+				// curves are bounded by their control points, as for -boundingBoxForElement:
+
+				pts[1] = ap[0];
+				pts[2] = ap[1];
+				pts[3] = ap[2];
+				entry->bounds = rectEnclosingPoints(pts, 4);
+				entry->controlBounds = entry->bounds;
+				lastPoint = ap[2];
+				break;
+
+			case NSClosePathBezierPathElement:
+				entry->bounds = NSRectFromTwoPoints(subpathStart, lastPoint);
+				entry->controlBounds = entry->bounds;
+				lastPoint = subpathStart;
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		[self buildNodes];
+	}
+
+	return self;
+}
+
+- (NSInteger)elementCount
+{
+	return mElementCount;
+}
+
+- (NSInteger)elementFromIndex:(NSInteger)element nearPoint:(NSPoint)p tolerance:(CGFloat)tol
+{
+	if (element >= mElementCount)
+		return -1;
+
+	return [self searchNode:1
+				fromElement:MAX(element, 0)
+				  nearPoint:p
+				  tolerance:tol
+			  controlPoints:NO];
+}
+
+- (NSInteger)elementFromIndex:(NSInteger)element withControlPointsNearPoint:(NSPoint)p tolerance:(CGFloat)tol
+{
+	if (element >= mElementCount)
+		return -1;
+
+	return [self searchNode:1
+				fromElement:MAX(element, 0)
+				  nearPoint:p
+				  tolerance:tol
+			  controlPoints:YES];
+}
+
+- (NSIndexSet*)elementsIntersectingRect:(NSRect)rect
+{
+	NSMutableIndexSet* elements = [NSMutableIndexSet indexSet];
+
+	if (mElementCount > 0)
+		[self collectNode:1
+			intersectingRect:rect
+						into:elements];
+
+	return elements;
+}
+
+- (void)getElementPairsTouchingIndex:(DKPathElementIndex*)other function:(DKElementPairFunction)function context:(void*)context
+{
+	NSAssert(other != nil, @"can't pair elements with a nil index");
+	NSAssert(function != NULL, @"a function is needed to receive the pairs");
+
+	if (mElementCount > 0 && other->mElementCount > 0)
+		[self pairNode:1
+			   withNode:1
+				ofIndex:other
+			   function:function
+				context:context];
+}
+
+#pragma mark -
+
+- (void)buildNodes
+{
+	// the leaves are at the bottom level of a complete binary tree, so the tree is stored in an array twice the size of the next
+	// power of two above the leaf count. Node 0 is unused.
+
+	NSInteger i, k;
+
+	mLeafCount = (mElementCount + kDKElementIndexLeafSize - 1) / kDKElementIndexLeafSize;
+	mFirstLeaf = 1;
+
+	while (mFirstLeaf < mLeafCount)
+		mFirstLeaf <<= 1;
+
+	mNodes = calloc(mFirstLeaf * 2, sizeof(DKElementIndexNode));
+
+	for (k = 0; k < mFirstLeaf * 2; ++k)
+		mNodes[k].isEmpty = YES;
+
+	for (i = 0; i < mElementCount; ++i) {
+		DKElementIndexNode* leaf = &mNodes[mFirstLeaf + (i / kDKElementIndexLeafSize)];
+		NSRect r = mEntries[i].controlBounds;
+
+		if (!mEntries[i].isMove)
+			r = unionOfRects(r, mEntries[i].bounds);
+
+		leaf->bounds = leaf->isEmpty ? r : unionOfRects(leaf->bounds, r);
+		leaf->isEmpty = NO;
+	}
+
+	for (k = mFirstLeaf - 1; k > 0; --k) {
+		DKElementIndexNode* left = &mNodes[2 * k];
+		DKElementIndexNode* right = &mNodes[2 * k + 1];
+
+		if (left->isEmpty)
+			mNodes[k] = *right;
+		else if (right->isEmpty)
+			mNodes[k] = *left;
+		else {
+			mNodes[k].bounds = unionOfRects(left->bounds, right->bounds);
+			mNodes[k].isEmpty = NO;
+		}
+	}
+}
+
+- (NSInteger)searchNode:(NSInteger)node fromElement:(NSInteger)element nearPoint:(NSPoint)p tolerance:(CGFloat)tol controlPoints:(BOOL)controls
+{
+	if (mNodes[node].isEmpty || !pointNearRect(p, mNodes[node].bounds, tol))
+		return -1;
+
+	// work out the range of elements below this node, and skip it if it lies entirely before <element>
+
+	NSInteger span = 1, first = node;
+
+	while (first < mFirstLeaf) {
+		first <<= 1;
+		span <<= 1;
+	}
+
+	first = (first - mFirstLeaf) * kDKElementIndexLeafSize;
+
+	NSInteger last = MIN(first + span * kDKElementIndexLeafSize, mElementCount);
+
+	if (last <= element)
+		return -1;
+
+	if (node >= mFirstLeaf) {
+		NSInteger i;
+
+		for (i = MAX(first, element); i < last; ++i) {
+			const DKElementIndexEntry* entry = &mEntries[i];
+
+			if (controls) {
+				if (pointNearRect(p, entry->controlBounds, tol))
+					return i;
+			} else if (!entry->isMove && NSPointInRect(p, NSInsetRect(entry->bounds, -tol, -tol)))
+				return i;
+		}
+
+		return -1;
+	}
+
+	NSInteger result = [self searchNode:2 * node
+							fromElement:element
+							  nearPoint:p
+							  tolerance:tol
+						  controlPoints:controls];
+
+	if (result < 0)
+		result = [self searchNode:2 * node + 1
+					  fromElement:element
+						nearPoint:p
+						tolerance:tol
+					controlPoints:controls];
+
+	return result;
+}
+
+- (void)collectNode:(NSInteger)node intersectingRect:(NSRect)rect into:(NSMutableIndexSet*)elements
+{
+	if (mNodes[node].isEmpty || !rectsTouch(rect, mNodes[node].bounds))
+		return;
+
+	if (node >= mFirstLeaf) {
+		NSInteger i, first = (node - mFirstLeaf) * kDKElementIndexLeafSize;
+		NSInteger last = MIN(first + kDKElementIndexLeafSize, mElementCount);
+
+		for (i = first; i < last; ++i) {
+			if (!mEntries[i].isMove && rectsTouch(rect, mEntries[i].bounds))
+				[elements addIndex:i];
+		}
+	} else {
+		[self collectNode:2 * node
+			intersectingRect:rect
+						into:elements];
+		[self collectNode:2 * node + 1
+			intersectingRect:rect
+						into:elements];
+	}
+}
+
+- (void)pairNode:(NSInteger)node withNode:(NSInteger)otherNode ofIndex:(DKPathElementIndex*)other function:(DKElementPairFunction)function context:(void*)context
+{
+	if (mNodes[node].isEmpty || other->mNodes[otherNode].isEmpty || !rectsTouch(mNodes[node].bounds, other->mNodes[otherNode].bounds))
+		return;
+
+	BOOL isLeaf = (node >= mFirstLeaf);
+	BOOL otherIsLeaf = (otherNode >= other->mFirstLeaf);
+
+	if (isLeaf && otherIsLeaf) {
+		NSInteger i, j, first = (node - mFirstLeaf) * kDKElementIndexLeafSize;
+		NSInteger last = MIN(first + kDKElementIndexLeafSize, mElementCount);
+		NSInteger otherFirst = (otherNode - other->mFirstLeaf) * kDKElementIndexLeafSize;
+		NSInteger otherLast = MIN(otherFirst + kDKElementIndexLeafSize, other->mElementCount);
+
+		for (i = first; i < last; ++i) {
+			if (mEntries[i].isMove)
+				continue;
+
+			for (j = otherFirst; j < otherLast; ++j) {
+				if (!other->mEntries[j].isMove && rectsTouch(mEntries[i].bounds, other->mEntries[j].bounds))
+					function(i, j, context);
+			}
+		}
+	} else if (isLeaf || (!otherIsLeaf && other->mFirstLeaf > mFirstLeaf)) {
+		// the trees may be of different depths, so the deeper one is descended until both are at their leaves
+
+		[self pairNode:node
+			   withNode:2 * otherNode
+				ofIndex:other
+			   function:function
+				context:context];
+		[self pairNode:node
+			   withNode:2 * otherNode + 1
+				ofIndex:other
+			   function:function
+				context:context];
+	} else {
+		[self pairNode:2 * node
+			   withNode:otherNode
+				ofIndex:other
+			   function:function
+				context:context];
+		[self pairNode:2 * node + 1
+			   withNode:otherNode
+				ofIndex:other
+			   function:function
+				context:context];
+	}
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	free(mEntries);
+	free(mNodes);
+	[super dealloc];
+}
+
+@end
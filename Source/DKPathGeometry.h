@@ -0,0 +1,85 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+#define kDKPathGeometrySimplificationLevels 10 // the number of simplified forms of the path, each with twice the tolerance of the one before
+#define kDKPathGeometryFinestSimplification 0.25 // the tolerance of the finest simplified form
+#define kDKPathGeometryMinimumElementsToSimplify 1000 // paths with fewer elements are never simplified
+
+/** @brief An immutable path, with the values that are usually worked out from it kept alongside.
+
+ An immutable path, with the values that are usually worked out from it kept alongside. The path is held as a CGPath, together with its
+ bounds, checksum (the same value -[NSBezierPath checksum] gives), element count and winding rule, all computed once when the geometry
+ is made. A flattened form is made the first time it's asked for.
+
+ Because it never changes, one geometry can be shared by any number of objects, copies and snapshots. DKDrawablePath keeps one for its
+ path, which its copies and geometry snapshots share instead of copying the path; the NSBezierPath that is edited is only made again
+ from it when it's needed. Line width, dash and other stroking attributes are not part of the geometry.
+*/
+@interface DKPathGeometry : NSObject <NSCopying> {
+@private
+	CGPathRef mPath;
+	NSRect mBounds;
+	NSUInteger mChecksum;
+	NSInteger mElementCount;
+	NSWindingRule mWindingRule;
+	NSBezierPath* mFlattenedPath; // made lazily
+	id mSimplifiedPaths[kDKPathGeometrySimplificationLevels]; // NSBezierPath, or NSNull where simplifying saves too little
+	BOOL mSimplifying;
+}
+
++ (DKPathGeometry*)geometryWithBezierPath:(NSBezierPath*)path;
+
+- (id)initWithBezierPath:(NSBezierPath*)path;
+
+/** @brief A new mutable path with the same elements and winding rule
+ @return an autoreleased path, which the caller may change freely
+ */
+- (NSBezierPath*)bezierPath;
+
+/** @brief The path as a CGPath, owned by the geometry
+ @return the path, or NULL if the geometry is empty
+ */
+- (CGPathRef)quartzPath;
+
+- (NSRect)bounds;
+- (NSUInteger)checksum;
+- (NSInteger)elementCount;
+- (NSWindingRule)windingRule;
+- (BOOL)isEmpty;
+
+/** @brief The path with its curves flattened to lines, using the default flatness
+
+ Made the first time it's asked for and kept. Like the geometry itself, it must not be changed.
+ @return the flattened path
+ */
+- (NSBezierPath*)flattenedPath;
+
+/** @brief A simplified form of the path, for drawing it when zoomed out
+
+ The geometry keeps its path simplified with -bezierPathBySimplifyingLinesWithTolerance: at a series of tolerances, doubling from
+ kDKPathGeometryFinestSimplification, and returns the coarsest ready whose tolerance is no more than <maxError>. The forms are made on a
+ background thread the first time any is asked for, so until they're ready, and for paths with fewer than kDKPathGeometryMinimumElementsToSimplify
+ elements or whose lines simplify too little to be worth it, this returns nil and the path should be drawn in full. Like the geometry
+ itself, the result must not be changed.
+ @param maxError the furthest the simplified path may stray from the path, such as the size of a device pixel in the path's coordinates
+ @return the simplified path, or nil
+ */
+- (NSBezierPath*)simplifiedPathWithMaximumError:(CGFloat)maxError;
+
+/** @brief Whether two geometries have the same elements and points
+ @param geometry another geometry
+ @return YES if the paths are the same
+ */
+- (BOOL)isEqualToPathGeometry:(DKPathGeometry*)geometry;
+
+/** @brief The approximate memory used by the geometry, including the flattened and simplified forms made so far
+ @return the size in bytes
+ */
+- (NSUInteger)bytesUsed;
+
+@end
@@ -0,0 +1,313 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKPathGeometry.h"
+#import "GCUndoManager.h"
+#import "NSBezierPath+Editing.h"
+#import "NSBezierPath+Geometry.h"
+#include <dispatch/dispatch.h>
+#include <tgmath.h>
+
+// gathers the elements of two paths so they can be compared one by one
+
+typedef struct {
+	CGPathElementType type;
+	CGPoint points[3];
+} DKPathGeometryElement;
+
+typedef struct {
+	DKPathGeometryElement* elements;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKPathGeometryElementList;
+
+static void gatherElementsApplier(void* info, const CGPathElement* element)
+{
+	DKPathGeometryElementList* list = (DKPathGeometryElementList*)info;
+	NSUInteger n = 0;
+
+	if (list->count >= list->capacity)
+		return;
+
+	DKPathGeometryElement* e = &list->elements[list->count++];
+
+	// the whole element is cleared first so that the elements can be compared with memcmp, padding and all
+
+	memset(e, 0, sizeof(DKPathGeometryElement));
+	e->type = element->type;
+
+	switch (element->type) {
+	case kCGPathElementMoveToPoint:
+	case kCGPathElementAddLineToPoint:
+		n = 1;
+		break;
+
+	case kCGPathElementAddQuadCurveToPoint:
+		n = 2;
+		break;
+
+	case kCGPathElementAddCurveToPoint:
+		n = 3;
+		break;
+
+	default:
+		break;
+	}
+
+	if (n > 0)
+		memcpy(e->points, element->points, n * sizeof(CGPoint));
+}
+
+@interface DKPathGeometry (Private)
+
+- (void)makeSimplifiedPaths;
+
+@end
+
+static void makeSimplifiedPathsInBackground(void* context)
+{
+	DKPathGeometry* geometry = (DKPathGeometry*)context;
+
+	@autoreleasepool
+	{
+		[geometry makeSimplifiedPaths];
+	}
+
+	[geometry release];
+}
+
+#pragma mark -
+@implementation DKPathGeometry
+#pragma mark As a DKPathGeometry
+
++ (DKPathGeometry*)geometryWithBezierPath:(NSBezierPath*)path
+{
+	return [[[self alloc] initWithBezierPath:path] autorelease];
+}
+
+- (id)initWithBezierPath:(NSBezierPath*)path
+{
+	self = [super init];
+	if (self) {
+		if (path != nil && ![path isEmpty]) {
+			mPath = [path newQuartzPath];
+			mBounds = [path bounds];
+			mElementCount = [path elementCount];
+		}
+
+		mChecksum = [path checksum];
+		mWindingRule = path ? [path windingRule] : [NSBezierPath defaultWindingRule];
+	}
+
+	return self;
+}
+
+- (NSBezierPath*)bezierPath
+{
+	NSBezierPath* path = (mPath != NULL) ? [NSBezierPath bezierPathWithCGPath:mPath] : [NSBezierPath bezierPath];
+
+	[path setWindingRule:mWindingRule];
+	return path;
+}
+
+- (CGPathRef)quartzPath
+{
+	return mPath;
+}
+
+- (NSRect)bounds
+{
+	return mBounds;
+}
+
+- (NSUInteger)checksum
+{
+	return mChecksum;
+}
+
+- (NSInteger)elementCount
+{
+	return mElementCount;
+}
+
+- (NSWindingRule)windingRule
+{
+	return mWindingRule;
+}
+
+- (BOOL)isEmpty
+{
+	return (mPath == NULL);
+}
+
+- (NSBezierPath*)flattenedPath
+{
+	// the geometry can be shared by objects that are drawn on different threads, so the lazy path is made under a lock
+
+	@synchronized(self)
+	{
+		if (mFlattenedPath == nil)
+			mFlattenedPath = [[[self bezierPath] bezierPathByFlatteningPath] retain];
+	}
+
+	return mFlattenedPath;
+}
+
+- (NSBezierPath*)simplifiedPathWithMaximumError:(CGFloat)maxError
+{
+	if (mElementCount < kDKPathGeometryMinimumElementsToSimplify || maxError < kDKPathGeometryFinestSimplification)
+		return nil;
+
+	NSInteger i, level = MIN((NSInteger)floor(log2(maxError / kDKPathGeometryFinestSimplification)), kDKPathGeometrySimplificationLevels - 1);
+	id path = nil;
+
+	@synchronized(self)
+	{
+		// while the coarser forms are still being made, a finer one that's ready will do
+
+		for (i = level; i >= 0 && path == nil; --i)
+			path = mSimplifiedPaths[i];
+
+		if (mSimplifiedPaths[level] == nil && !mSimplifying) {
+			mSimplifying = YES;
+			[self retain];
+			dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0), self, makeSimplifiedPathsInBackground);
+		}
+
+		[[path retain] autorelease];
+	}
+
+	return [path isKindOfClass:[NSBezierPath class]] ? path : nil;
+}
+
+- (void)makeSimplifiedPaths
+{
+	// each form is simplified from the original, so that its error is no more than its own tolerance. Forms are published as they're
+	// made, finest first, so drawing can use them before the coarser ones are ready.
+
+	NSBezierPath* path = [self bezierPath];
+	CGFloat tolerance = kDKPathGeometryFinestSimplification;
+	NSInteger level;
+
+	for (level = 0; level < kDKPathGeometrySimplificationLevels; ++level) {
+		NSBezierPath* simplified = [path bezierPathBySimplifyingLinesWithTolerance:tolerance];
+		id result = simplified;
+
+		// a form that keeps most of the elements costs about as much to draw as the path
+
+		if ([simplified elementCount] * 4 > mElementCount * 3)
+			result = [NSNull null];
+
+		@synchronized(self)
+		{
+			mSimplifiedPaths[level] = [result retain];
+		}
+
+		tolerance *= 2.0;
+	}
+}
+
+- (BOOL)isEqualToPathGeometry:(DKPathGeometry*)geometry
+{
+	if (geometry == self)
+		return YES;
+
+	if (geometry == nil || mElementCount != geometry->mElementCount || mChecksum != geometry->mChecksum || mWindingRule != geometry->mWindingRule)
+		return NO;
+
+	if (mPath == NULL || geometry->mPath == NULL)
+		return (mPath == geometry->mPath);
+
+	// the checksum rounds the points, so paths that pass it are compared exactly
+
+	DKPathGeometryElementList a, b;
+	BOOL equal;
+
+	a.elements = malloc(mElementCount * sizeof(DKPathGeometryElement));
+	b.elements = malloc(mElementCount * sizeof(DKPathGeometryElement));
+	a.count = b.count = 0;
+	a.capacity = b.capacity = mElementCount;
+
+	CGPathApply(mPath, &a, gatherElementsApplier);
+	CGPathApply(geometry->mPath, &b, gatherElementsApplier);
+
+	equal = (a.count == b.count) && memcmp(a.elements, b.elements, a.count * sizeof(DKPathGeometryElement)) == 0;
+
+	free(a.elements);
+	free(b.elements);
+
+	return equal;
+}
+
+- (NSUInteger)bytesUsed
+{
+	NSUInteger i, bytes = [self undoCost];
+
+	@synchronized(self)
+	{
+		bytes += [mFlattenedPath undoCost];
+
+		for (i = 0; i < kDKPathGeometrySimplificationLevels; ++i) {
+			if ([mSimplifiedPaths[i] isKindOfClass:[NSBezierPath class]])
+				bytes += [mSimplifiedPaths[i] undoCost];
+		}
+	}
+
+	return bytes;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (BOOL)isEqual:(id)object
+{
+	return [object isKindOfClass:[DKPathGeometry class]] && [self isEqualToPathGeometry:object];
+}
+
+- (NSUInteger)hash
+{
+	return mChecksum;
+}
+
+- (NSUInteger)undoCost
+{
+	// allows for the three points of a curve per element, as for NSBezierPath
+
+	return [super undoCost] + mElementCount * (3 * sizeof(NSPoint) + sizeof(NSInteger));
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> %ld elements, bounds = %@", NSStringFromClass([self class]), self, (long)mElementCount, NSStringFromRect(mBounds)];
+}
+
+- (void)dealloc
+{
+	if (mPath != NULL)
+		CGPathRelease(mPath);
+
+	NSInteger level;
+
+	for (level = 0; level < kDKPathGeometrySimplificationLevels; ++level)
+		[mSimplifiedPaths[level] release];
+
+	[mFlattenedPath release];
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark As part of NSCopying Protocol
+
+- (id)copyWithZone:(NSZone*)zone
+{
+#pragma unused(zone)
+
+	// immutable, so copies can share the one instance
+
+	return [self retain];
+}
+
+@end
@@ -0,0 +1,73 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKObjectStorageProtocol.h"
+
+@class DKPathElementIndex;
+
+/** @brief A point where two paths cross, with where it lies on each of them.
+
+ A point where two paths cross, with where it lies on each of them. Each position is an element index, as for -[NSBezierPath elementAtIndex:],
+ and the curve parameter t in that element, from 0 at its start to 1 at its end. For crossings between the objects of a layer, the objects
+ whose paths cross are given too; -object is always the lower of the two in the stacking order.
+
+ Finding the crossings of two paths doesn't compare every element of one with every element of the other, as -allIntersectionsWithPath: does.
+ Each path's elements are indexed by a DKPathElementIndex, and the two trees of bounds are walked together so that only elements whose bounds
+ touch are intersected. For a layer, the storage is asked for the objects near each one, so only pairs of objects whose bounds touch have
+ their paths compared, and those pairs are shared between all the processor's cores. Finding every crossing wire in a layer then costs about
+ as much as its crossings, rather than the square of its objects times the square of their elements.
+
+ Crossings at a join between two elements are only given once, at the start of the later element. Path-level crossings work on every subpath,
+ so they can be used by any editing operation that needs to know where two paths cut each other.
+*/
+@interface DKPathIntersection : NSObject {
+@private
+	id mObject;
+	id mOtherObject;
+	NSPoint mPoint;
+	NSInteger mElement;
+	CGFloat mParameter;
+	NSInteger mOtherElement;
+	CGFloat mOtherParameter;
+}
+
+/** @brief Finds where two paths cross
+
+ Either index may be nil, in which case one is made for its path; passing indexes that are kept with paths, such as DKDrawablePath's, saves
+ making them each time.
+ @param path a path
+ @param index the element index of <path>, or nil
+ @param otherPath another path
+ @param otherIndex the element index of <otherPath>, or nil
+ @return the crossings, in order along <path>, with nil objects
+ */
++ (NSArray*)intersectionsBetweenPath:(NSBezierPath*)path elementIndex:(DKPathElementIndex*)index andPath:(NSBezierPath*)otherPath elementIndex:(DKPathElementIndex*)otherIndex;
+
+/** @brief Finds where the rendering paths of any two of a set of objects cross
+
+ The objects must all be in <storage>, which is used to find the pairs of them whose bounds touch. Their paths are compared concurrently,
+ but the result is the same as if it were done in order: crossings are grouped by pair of objects, in the order of the objects in the array,
+ and ordered along the first object's path within each pair. An object's crossings with its own path are not included.
+ @param objects the drawable objects
+ @param storage the storage holding the objects
+ @return the crossings
+ */
++ (NSArray*)intersectionsBetweenObjects:(NSArray*)objects inStorage:(id<DKObjectStorage>)storage;
+
+- (id)initWithPoint:(NSPoint)p element:(NSInteger)element parameter:(CGFloat)t otherElement:(NSInteger)otherElement parameter:(CGFloat)otherT;
+
+- (NSPoint)point;
+- (NSInteger)element;
+- (CGFloat)parameter;
+- (NSInteger)otherElement;
+- (CGFloat)otherParameter;
+
+- (void)setObject:(id)object otherObject:(id)otherObject;
+- (id)object;
+- (id)otherObject;
+
+@end
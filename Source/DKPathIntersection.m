@@ -0,0 +1,372 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKPathIntersection.h"
+#import "DKPathElementIndex.h"
+#import "DKDrawableObject.h"
+#import "NSBezierPath-OAExtensions.h"
+
+#define kDKIntersectionJoinEpsilon 1e-4 // how near the end of an element a crossing must be to be taken as the one at the start of the next
+
+// the crossings found between two paths
+
+typedef struct {
+	NSBezierPath* path;
+	NSBezierPath* otherPath;
+	NSInteger elementCount;
+	NSInteger otherElementCount;
+	OABezierPathIntersection* found;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKIntersectionList;
+
+// the work of finding the crossings between a set of objects. The paths are taken from the objects on the main thread, so the workers only
+// look at the paths and indexes.
+
+typedef struct {
+	NSBezierPath** paths; // one for each object, or nil if it has nothing to cross
+	DKPathElementIndex** indexes;
+	BOOL* needsIndex;
+	NSUInteger* pairs; // the positions of the two objects of each pair
+	DKIntersectionList* lists; // one for each pair
+} DKIntersectionBatch;
+
+static BOOL continuesAfterElement(NSBezierPath* path, NSInteger element, NSInteger count)
+{
+	// whether the next element starts where this one ends, so that a crossing at the end of this one is also found at the start of that.
+	// A closepath ends where its subpath started.
+
+	if ([path elementAtIndex:element] == NSClosePathBezierPathElement)
+		return YES;
+
+	return element + 1 < count && [path elementAtIndex:element + 1] != NSMoveToBezierPathElement;
+}
+
+static void collectElementPair(NSInteger element, NSInteger otherElement, void* context)
+{
+	DKIntersectionList* list = (DKIntersectionList*)context;
+	OABezierPathIntersection found[OA_MAX_INTERSECTIONS_PER_ELEMENT_PAIR];
+	NSUInteger i, count = [list->path getIntersections:found
+										betweenElement:element
+											andElement:otherElement
+												ofPath:list->otherPath];
+
+	for (i = 0; i < count; ++i) {
+		if (found[i].left.parameter >= 1.0 - kDKIntersectionJoinEpsilon && continuesAfterElement(list->path, element, list->elementCount))
+			continue;
+
+		if (found[i].right.parameter >= 1.0 - kDKIntersectionJoinEpsilon && continuesAfterElement(list->otherPath, otherElement, list->otherElementCount))
+			continue;
+
+		if (list->count == list->capacity) {
+			list->capacity = MAX(16, list->capacity * 2);
+			list->found = realloc(list->found, list->capacity * sizeof(OABezierPathIntersection));
+		}
+
+		list->found[list->count++] = found[i];
+	}
+}
+
+static int compareIntersections(const void* a, const void* b)
+{
+	const OABezierPathIntersection* ia = (const OABezierPathIntersection*)a;
+	const OABezierPathIntersection* ib = (const OABezierPathIntersection*)b;
+
+	if (ia->left.segment != ib->left.segment)
+		return (ia->left.segment < ib->left.segment) ? -1 : 1;
+
+	if (ia->left.parameter != ib->left.parameter)
+		return (ia->left.parameter < ib->left.parameter) ? -1 : 1;
+
+	return 0;
+}
+
+static int comparePairs(const void* a, const void* b)
+{
+	const NSUInteger* pa = (const NSUInteger*)a;
+	const NSUInteger* pb = (const NSUInteger*)b;
+
+	if (pa[0] != pb[0])
+		return (pa[0] < pb[0]) ? -1 : 1;
+
+	if (pa[1] != pb[1])
+		return (pa[1] < pb[1]) ? -1 : 1;
+
+	return 0;
+}
+
+static void findIntersections(DKIntersectionList* list, DKPathElementIndex* index, DKPathElementIndex* otherIndex)
+{
+	list->elementCount = [list->path elementCount];
+	list->otherElementCount = [list->otherPath elementCount];
+
+	[index getElementPairsTouchingIndex:otherIndex
+							   function:collectElementPair
+								context:list];
+
+	// the pairs come in the order of the trees, so they're put in order along the path
+
+	if (list->count > 1)
+		qsort(list->found, list->count, sizeof(OABezierPathIntersection), compareIntersections);
+}
+
+static void appendIntersections(NSMutableArray* array, const DKIntersectionList* list, id object, id otherObject)
+{
+	NSUInteger i;
+
+	for (i = 0; i < list->count; ++i) {
+		const OABezierPathIntersection* found = &list->found[i];
+		DKPathIntersection* pi = [[DKPathIntersection alloc] initWithPoint:found->location
+																   element:found->left.segment
+																 parameter:found->left.parameter
+															  otherElement:found->right.segment
+																 parameter:found->right.parameter];
+		[pi setObject:object
+			otherObject:otherObject];
+		[array addObject:pi];
+		[pi release];
+	}
+}
+
+static void indexPathJob(void* context, size_t i)
+{
+	DKIntersectionBatch* batch = (DKIntersectionBatch*)context;
+
+	if (!batch->needsIndex[i])
+		return;
+
+	@autoreleasepool {
+		@try {
+			batch->indexes[i] = [[DKPathElementIndex alloc] initWithPath:batch->paths[i]];
+		}
+		@catch (NSException* excp) {
+			// an exception mustn't escape a worker thread - the object's pairs are just left without crossings
+
+			batch->indexes[i] = nil;
+		}
+	}
+}
+
+static void intersectPairJob(void* context, size_t k)
+{
+	DKIntersectionBatch* batch = (DKIntersectionBatch*)context;
+	DKIntersectionList* list = &batch->lists[k];
+	DKPathElementIndex* index = batch->indexes[batch->pairs[2 * k]];
+	DKPathElementIndex* otherIndex = batch->indexes[batch->pairs[2 * k + 1]];
+
+	if (index == nil || otherIndex == nil)
+		return;
+
+	@autoreleasepool {
+		@try {
+			findIntersections(list, index, otherIndex);
+		}
+		@catch (NSException* excp) {
+			list->count = 0;
+		}
+	}
+}
+
+@implementation DKPathIntersection
+
++ (NSArray*)intersectionsBetweenPath:(NSBezierPath*)path elementIndex:(DKPathElementIndex*)index andPath:(NSBezierPath*)otherPath elementIndex:(DKPathElementIndex*)otherIndex
+{
+	NSAssert(path != nil && otherPath != nil, @"can't find the crossings of a nil path");
+
+	if (index == nil)
+		index = [DKPathElementIndex elementIndexWithPath:path];
+
+	if (otherIndex == nil)
+		otherIndex = [DKPathElementIndex elementIndexWithPath:otherPath];
+
+	DKIntersectionList list = { path, otherPath, 0, 0, NULL, 0, 0 };
+	NSMutableArray* result = [NSMutableArray array];
+
+	findIntersections(&list, index, otherIndex);
+	appendIntersections(result, &list, nil, nil);
+	free(list.found);
+
+	return result;
+}
+
++ (NSArray*)intersectionsBetweenObjects:(NSArray*)objects inStorage:(id<DKObjectStorage>)storage
+{
+	NSUInteger i, j, count = [objects count], pairCount = 0, pairCapacity = count;
+	NSMutableArray* result = [NSMutableArray array];
+	DKIntersectionBatch batch;
+
+	if (count < 2)
+		return result;
+
+	// the objects' positions in the array, so that each pair is only taken once, in order
+
+	CFMutableDictionaryRef positions = CFDictionaryCreateMutable(kCFAllocatorDefault, count, NULL, NULL);
+
+	batch.paths = calloc(count, sizeof(NSBezierPath*));
+	batch.indexes = calloc(count, sizeof(DKPathElementIndex*));
+	batch.needsIndex = calloc(count, sizeof(BOOL));
+	batch.pairs = malloc(2 * pairCapacity * sizeof(NSUInteger));
+
+	for (i = 0; i < count; ++i) {
+		DKDrawableObject* od = [objects objectAtIndex:i];
+		NSBezierPath* path = [od renderingPath];
+
+		if ([path elementCount] > 1)
+			batch.paths[i] = [path retain];
+
+		CFDictionarySetValue(positions, od, (const void*)i);
+	}
+
+	// the storage finds the objects near each one, so that only objects whose bounds touch have their paths compared
+
+	for (i = 0; i < count; ++i) {
+		if (batch.paths[i] == nil)
+			continue;
+
+		DKDrawableObject* od = [objects objectAtIndex:i];
+		NSEnumerator* iter = [[storage objectsIntersectingRect:[od bounds]
+														inView:nil
+													   options:kDKIncludeInvisible | kDKZOrderMayBeRelaxed] objectEnumerator];
+		id candidate;
+		const void* value;
+
+		while ((candidate = [iter nextObject])) {
+			if (!CFDictionaryGetValueIfPresent(positions, candidate, &value))
+				continue;
+
+			j = (NSUInteger)value;
+
+			if (j <= i || batch.paths[j] == nil)
+				continue;
+
+			if (pairCount == pairCapacity) {
+				pairCapacity *= 2;
+				batch.pairs = realloc(batch.pairs, 2 * pairCapacity * sizeof(NSUInteger));
+			}
+
+			batch.pairs[2 * pairCount] = i;
+			batch.pairs[2 * pairCount + 1] = j;
+			batch.needsIndex[i] = batch.needsIndex[j] = YES;
+			++pairCount;
+		}
+	}
+
+	CFRelease(positions);
+
+	if (pairCount > 0) {
+		// the storage may return the candidates in any order, so the pairs are sorted to make the result the same every time
+
+		qsort(batch.pairs, pairCount, 2 * sizeof(NSUInteger), comparePairs);
+
+		batch.lists = calloc(pairCount, sizeof(DKIntersectionList));
+
+		for (i = 0; i < pairCount; ++i) {
+			batch.lists[i].path = batch.paths[batch.pairs[2 * i]];
+			batch.lists[i].otherPath = batch.paths[batch.pairs[2 * i + 1]];
+		}
+
+		dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+
+		dispatch_apply_f(count, queue, &batch, indexPathJob);
+		dispatch_apply_f(pairCount, queue, &batch, intersectPairJob);
+
+		for (i = 0; i < pairCount; ++i) {
+			appendIntersections(result, &batch.lists[i], [objects objectAtIndex:batch.pairs[2 * i]], [objects objectAtIndex:batch.pairs[2 * i + 1]]);
+			free(batch.lists[i].found);
+		}
+
+		free(batch.lists);
+	}
+
+	for (i = 0; i < count; ++i) {
+		[batch.paths[i] release];
+		[batch.indexes[i] release];
+	}
+
+	free(batch.paths);
+	free(batch.indexes);
+	free(batch.needsIndex);
+	free(batch.pairs);
+
+	return result;
+}
+
+- (id)initWithPoint:(NSPoint)p element:(NSInteger)element parameter:(CGFloat)t otherElement:(NSInteger)otherElement parameter:(CGFloat)otherT
+{
+	self = [super init];
+	if (self) {
+		mPoint = p;
+		mElement = element;
+		mParameter = t;
+		mOtherElement = otherElement;
+		mOtherParameter = otherT;
+	}
+
+	return self;
+}
+
+- (NSPoint)point
+{
+	return mPoint;
+}
+
+- (NSInteger)element
+{
+	return mElement;
+}
+
+- (CGFloat)parameter
+{
+	return mParameter;
+}
+
+- (NSInteger)otherElement
+{
+	return mOtherElement;
+}
+
+- (CGFloat)otherParameter
+{
+	return mOtherParameter;
+}
+
+- (void)setObject:(id)object otherObject:(id)otherObject
+{
+	[object retain];
+	[mObject release];
+	mObject = object;
+
+	[otherObject retain];
+	[mOtherObject release];
+	mOtherObject = otherObject;
+}
+
+- (id)object
+{
+	return mObject;
+}
+
+- (id)otherObject
+{
+	return mOtherObject;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mObject release];
+	[mOtherObject release];
+	[super dealloc];
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p> %@ at element %ld t = %.4f, other element %ld t = %.4f", NSStringFromClass([self class]), self, NSStringFromPoint(mPoint), (long)mElement, mParameter, (long)mOtherElement, mOtherParameter];
+}
+
+@end
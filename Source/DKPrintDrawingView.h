@@ -6,11 +6,34 @@
 
 #import "DKDrawingView.h"
 
+/** @brief The view a drawing is printed through.
+
+ The view a drawing is printed through. Each page is drawn within its own autorelease pool, so what is made while drawing one page - such
+ as the decoded images - is freed before the next, rather than building up until the whole document has been spooled. Only the objects on
+ each page are drawn, as found from the layers' storage. Images are drawn from the level of the image manager's mip chain that suits the
+ resolution they're printed at, +printedImageResolution, and only the part of an image within the page is drawn, so a page of a poster made
+ from one big image spools only its own piece of it.
+*/
 @interface DKPrintDrawingView : DKDrawingView {
 	NSPrintInfo* m_printInfo;
 }
 
+/** @brief Sets the resolution images are printed at
+
+ Images with more pixels than needed for this are drawn from a smaller proxy. Default is kDKPrintDrawingViewDefaultImageResolution.
+ @param dpi dots per inch, or 0 to always print images at full size
+ */
++ (void)setPrintedImageResolution:(CGFloat)dpi;
++ (CGFloat)printedImageResolution;
+
+/** @brief Whether the current thread is drawing a page for a print operation, rather than to the screen or for a PDF or EPS copy
+ @return YES if printing
+ */
++ (BOOL)isPrinting;
+
 - (void)setPrintInfo:(NSPrintInfo*)ip;
 - (NSPrintInfo*)printInfo;
 
 @end
+
+#define kDKPrintDrawingViewDefaultImageResolution 300
@@ -9,8 +9,27 @@
 #import "DKDrawing.h"
 #import "LogEvent.h"
 
+static CGFloat sPrintedImageResolution = kDKPrintDrawingViewDefaultImageResolution;
+
 @implementation DKPrintDrawingView
 #pragma mark As a DKPrintDrawingView
++ (void)setPrintedImageResolution:(CGFloat)dpi
+{
+	sPrintedImageResolution = MAX(0, dpi);
+}
+
++ (CGFloat)printedImageResolution
+{
+	return sPrintedImageResolution;
+}
+
++ (BOOL)isPrinting
+{
+	NSPrintOperation* op = [NSPrintOperation currentOperation];
+
+	return op != nil && ![op isCopyingOperation] && ![NSGraphicsContext currentContextDrawingToScreen];
+}
+
 - (void)setPrintInfo:(NSPrintInfo*)ip
 {
 	[ip retain];
@@ -25,6 +44,19 @@
 
 #pragma mark -
 #pragma mark As an NSView
+
+- (void)drawRect:(NSRect)rect
+{
+	// the print operation draws every page within one pool, so without one here all that each page makes is held until the end
+
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+	[super drawRect:rect];
+	[pool drain];
+
+	LogEvent_(kInfoEvent, @"printed page %ld", (long)[[NSPrintOperation currentOperation] currentPage]);
+}
+
 /*
 - (BOOL)			knowsPageRange:(NSRangePointer) rng
 {
@@ -14,6 +14,7 @@ yielding a wide range of available effects.
 	CGBlendMode m_blendMode;
 	CGFloat m_alpha;
 	NSImage* m_maskImage;
+	CGImageRef mMask; // the mask made from m_maskImage, made when first needed
 }
 
 - (void)setBlendMode:(CGBlendMode)mode;
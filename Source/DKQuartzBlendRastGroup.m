@@ -37,6 +37,9 @@ static CGImageRef CreateMaskFromImage(NSImage* image);
 	[image retain];
 	[m_maskImage release];
 	m_maskImage = image;
+
+	CGImageRelease(mMask);
+	mMask = NULL;
 }
 
 - (NSImage*)maskImage
@@ -67,6 +70,7 @@ static CGImageRef CreateMaskFromImage(NSImage* image);
 - (void)dealloc
 {
 	[m_maskImage release];
+	CGImageRelease(mMask);
 
 	[super dealloc];
 }
@@ -98,7 +102,10 @@ static CGImageRef CreateMaskFromImage(NSImage* image);
 	// apply the mask image if there is one
 
 	if ([self maskImage]) {
-		CGImageRef mask = CreateMaskFromImage([self maskImage]);
+		// the mask is made once and reused, rather than drawn into a new bitmap for every object rendered
+
+		if (mMask == NULL)
+			mMask = CreateMaskFromImage([self maskImage]);
 
 		// TO DO: set up he image so it's aligned to the shape's path bounds and takes account of the
 		// rotation, etc. (As per DKImageAdornment). This is currently only OK for unrotated shapes.
@@ -107,11 +114,9 @@ static CGImageRef CreateMaskFromImage(NSImage* image);
 
 		clipr = [object bounds];
 
-		CGContextClipToMask(context, *(CGRect*)&clipr, mask);
-
-		//CGContextDrawImage( context, *(CGRect*)&clipr, mask );
+		CGContextClipToMask(context, *(CGRect*)&clipr, mMask);
 
-		CGImageRelease(mask);
+		//CGContextDrawImage( context, *(CGRect*)&clipr, mMask );
 	}
 	[super render:object];
 
@@ -9,6 +9,11 @@
 /** @brief Higher-level wrapper for CGLayer, used to cache graphics in numerous places in DK.
 
 Higher-level wrapper for CGLayer, used to cache graphics in numerous places in DK.
+
+ Caches that are only needed for a while can be checked out of a shared pool and returned to it afterwards, so that the CGLayers are
+ reused rather than made each time. Pooled layers are bucketed by the context they are made for and by size, rounded up to a power of
+ two, so a checked out cache may have a larger layer than was asked for; only the size asked for is drawn. The pool's idle caches are
+ limited to kDKQuartzCachePoolCostLimit bytes, and are discarded first when memory is short.
 */
 @interface DKQuartzCache : NSObject {
 @private
@@ -16,6 +21,8 @@ Higher-level wrapper for CGLayer, used to cache graphics in numerous places in D
 	BOOL mFocusLocked;
 	BOOL mFlipped;
 	NSPoint mOrigin;
+	NSSize mUsedSize; // the part of the layer in use, which is all of it unless pooled
+	NSString* mPoolKey; // the bucket in the pool, or nil if not from the pool
 }
 
 + (DKQuartzCache*)cacheForCurrentContextWithSize:(NSSize)size;
@@ -23,10 +30,34 @@ Higher-level wrapper for CGLayer, used to cache graphics in numerous places in D
 + (DKQuartzCache*)cacheForImage:(NSImage*)image;
 + (DKQuartzCache*)cacheForImageRep:(NSImageRep*)imageRep;
 
+/** @brief Checks out a cleared cache compatible with the current context from the pool
+
+ The cache should be given back with +returnCacheToPool: once it's no longer needed. One that isn't returned is simply released.
+ @param size the size needed
+ @return a cache whose -size is <size>
+ */
++ (DKQuartzCache*)checkOutCacheForCurrentContextWithSize:(NSSize)size;
++ (DKQuartzCache*)checkOutCacheForImage:(NSImage*)image;
+
+/** @brief Returns a cache checked out of the pool, so it can be reused
+
+ Caches that didn't come from the pool are ignored, so it's safe to pass any cache, or nil.
+ @param cache the cache, which the caller should release afterwards and not use again
+ */
++ (void)returnCacheToPool:(DKQuartzCache*)cache;
+
+/** @brief Discards all the idle caches in the pool
+ */
++ (void)trimCachePool;
+
 - (id)initWithContext:(NSGraphicsContext*)context forRect:(NSRect)rect;
 - (NSSize)size;
 - (CGContextRef)context;
 
+/** @brief The approximate memory used by the cache's layer, at four bytes per point of its size
+ */
+- (NSUInteger)bytesUsed;
+
 - (void)setFlipped:(BOOL)flipped;
 - (BOOL)flipped;
 
@@ -38,3 +69,6 @@ Higher-level wrapper for CGLayer, used to cache graphics in numerous places in D
 - (void)unlockFocus;
 
 @end
+
+#define kDKQuartzCachePoolCostLimit (64 * 1024 * 1024) // bytes of idle layers kept by the pool
+#define kDKQuartzCachePoolMinimumSize 64 // pooled layers are never smaller than this on either side
@@ -6,6 +6,28 @@
 
 #import "DKQuartzCache.h"
 
+static NSCache* sCachePool = nil; // bucket key -> idle caches
+
+static CGFloat poolBucketLength(CGFloat length)
+{
+	return exp2(ceil(log2(MAX(ceil(length), (CGFloat)kDKQuartzCachePoolMinimumSize))));
+}
+
+static NSUInteger layerCost(NSSize size)
+{
+	return (NSUInteger)(size.width * size.height) * 4;
+}
+
+@interface DKQuartzCache (Private)
+
+- (void)setPoolKey:(NSString*)key usedSize:(NSSize)size;
+- (NSString*)poolKey;
+- (void)clear;
+
+@end
+
+#pragma mark -
+
 @implementation DKQuartzCache
 
 + (DKQuartzCache*)cacheForCurrentContextWithSize:(NSSize)size
@@ -52,6 +74,99 @@
 	return [cache autorelease];
 }
 
++ (DKQuartzCache*)checkOutCacheForCurrentContextWithSize:(NSSize)size
+{
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+
+	NSAssert(context != nil, @"attempt to check out a cache with no current context");
+
+	NSSize bucket = NSMakeSize(poolBucketLength(size.width), poolBucketLength(size.height));
+	NSString* key = [NSString stringWithFormat:@"%p/%.0fx%.0f", [context graphicsPort], bucket.width, bucket.height];
+	DKQuartzCache* cache = nil;
+
+	// the pool is shared by every thread, though each cache in it belongs to a single context and so a single thread
+
+	@synchronized([DKQuartzCache class])
+	{
+		if (sCachePool == nil) {
+			sCachePool = [[NSCache alloc] init];
+			[sCachePool setTotalCostLimit:kDKQuartzCachePoolCostLimit];
+		}
+
+		NSMutableArray* idle = [sCachePool objectForKey:key];
+
+		if ([idle count] > 0) {
+			cache = [[idle lastObject] retain];
+			[idle removeLastObject];
+			[sCachePool setObject:idle
+						   forKey:key
+							 cost:layerCost(bucket) * [idle count]];
+		}
+	}
+
+	if (cache != nil) {
+		[cache clear];
+		[cache setFlipped:[context isFlipped]];
+	} else
+		cache = [[self alloc] initWithContext:context
+									  forRect:NSMakeRect(0, 0, bucket.width, bucket.height)];
+
+	[cache setPoolKey:key
+			 usedSize:size];
+
+	return [cache autorelease];
+}
+
++ (DKQuartzCache*)checkOutCacheForImage:(NSImage*)image
+{
+	NSAssert(image != nil, @"cannot create cache for nil image");
+
+	DKQuartzCache* cache = [self checkOutCacheForCurrentContextWithSize:[image size]];
+	[cache setFlipped:[image isFlipped]];
+	[cache lockFocus];
+	[image drawAtPoint:NSZeroPoint
+			  fromRect:NSZeroRect
+			 operation:NSCompositeCopy
+			  fraction:1.0];
+	[cache unlockFocus];
+
+	return cache;
+}
+
++ (void)returnCacheToPool:(DKQuartzCache*)cache
+{
+	NSString* key = [cache poolKey];
+
+	if (key == nil || sCachePool == nil)
+		return;
+
+	if (cache->mFocusLocked)
+		[cache unlockFocus];
+
+	CGSize cg_size = CGLayerGetSize(cache->mCGLayer);
+
+	@synchronized([DKQuartzCache class])
+	{
+		NSMutableArray* idle = [sCachePool objectForKey:key];
+
+		if (idle == nil)
+			idle = [NSMutableArray array];
+
+		[idle addObject:cache];
+		[sCachePool setObject:idle
+					   forKey:key
+						 cost:layerCost(NSMakeSize(cg_size.width, cg_size.height)) * [idle count]];
+	}
+}
+
++ (void)trimCachePool
+{
+	@synchronized([DKQuartzCache class])
+	{
+		[sCachePool removeAllObjects];
+	}
+}
+
 #pragma mark -
 
 - (id)initWithContext:(NSGraphicsContext*)context forRect:(NSRect)rect
@@ -65,6 +180,7 @@
 		CGSize cg_size = CGSizeMake(NSWidth(rect), NSHeight(rect));
 		mCGLayer = CGLayerCreateWithContext(port, cg_size, NULL);
 		mOrigin = rect.origin;
+		mUsedSize = rect.size;
 		[self setFlipped:[context isFlipped]];
 	}
 
@@ -72,9 +188,15 @@
 }
 
 - (NSSize)size
+{
+	return mUsedSize;
+}
+
+- (NSUInteger)bytesUsed
 {
 	CGSize cg_size = CGLayerGetSize(mCGLayer);
-	return NSMakeSize(cg_size.width, cg_size.height);
+
+	return layerCost(NSMakeSize(cg_size.width, cg_size.height));
 }
 
 - (CGContextRef)context
@@ -103,16 +225,42 @@
 {
 	CGPoint cg_point = CGPointMake(point.x, point.y);
 	CGContextRef port = [[NSGraphicsContext currentContext] graphicsPort];
+	CGSize cg_size = CGLayerGetSize(mCGLayer);
+	BOOL partial = cg_size.width != mUsedSize.width || cg_size.height != mUsedSize.height;
+
+	// a pooled layer may be larger than the part in use, so the rest of it is clipped away
+
+	if (partial) {
+		CGContextSaveGState(port);
+		CGContextClipToRect(port, CGRectMake(point.x, point.y, mUsedSize.width, mUsedSize.height));
+	}
+
 	CGContextSetAlpha(port, frac);
 	CGContextSetBlendMode(port, op);
 	CGContextDrawLayerAtPoint(port, cg_point, mCGLayer);
+
+	if (partial)
+		CGContextRestoreGState(port);
 }
 
 - (void)drawInRect:(NSRect)rect
 {
 	CGRect cg_rect = CGRectMake(rect.origin.x, rect.origin.y, rect.size.width, rect.size.height);
 	CGContextRef port = [[NSGraphicsContext currentContext] graphicsPort];
-	CGContextDrawLayerInRect(port, cg_rect, mCGLayer);
+	CGSize cg_size = CGLayerGetSize(mCGLayer);
+
+	if (cg_size.width == mUsedSize.width && cg_size.height == mUsedSize.height)
+		CGContextDrawLayerInRect(port, cg_rect, mCGLayer);
+	else if (mUsedSize.width > 0 && mUsedSize.height > 0) {
+		// the part in use is scaled to the rect, so the whole layer is drawn proportionally larger and clipped to it
+
+		CGRect whole = CGRectMake(rect.origin.x, rect.origin.y, cg_size.width * rect.size.width / mUsedSize.width, cg_size.height * rect.size.height / mUsedSize.height);
+
+		CGContextSaveGState(port);
+		CGContextClipToRect(port, cg_rect);
+		CGContextDrawLayerInRect(port, whole, mCGLayer);
+		CGContextRestoreGState(port);
+	}
 }
 
 - (void)lockFocus
@@ -121,6 +269,9 @@
 
 	NSAssert(mFocusLocked == NO, @"lockFocus called while already locked");
 
+	// the layer's own state is saved too, so that transforms set while focused don't outlast the focus when the cache is reused
+
+	CGContextSaveGState([self context]);
 	[NSGraphicsContext saveGraphicsState];
 	NSGraphicsContext* newContext = [NSGraphicsContext graphicsContextWithGraphicsPort:[self context]
 																			   flipped:[self flipped]];
@@ -139,9 +290,29 @@
 	NSAssert(mFocusLocked == YES, @"unlockFocus called without a matching lockFocus");
 
 	[NSGraphicsContext restoreGraphicsState];
+	CGContextRestoreGState([self context]);
 	mFocusLocked = NO;
 }
 
+- (void)setPoolKey:(NSString*)key usedSize:(NSSize)size
+{
+	[key retain];
+	[mPoolKey release];
+	mPoolKey = key;
+	mUsedSize = size;
+}
+
+- (NSString*)poolKey
+{
+	return mPoolKey;
+}
+
+- (void)clear
+{
+	CGSize cg_size = CGLayerGetSize(mCGLayer);
+	CGContextClearRect([self context], CGRectMake(0, 0, cg_size.width, cg_size.height));
+}
+
 #pragma mark -
 #pragma mark - as a NSObject
 
@@ -151,6 +322,7 @@
 		[self unlockFocus];
 
 	CGLayerRelease(mCGLayer);
+	[mPoolKey release];
 	[super dealloc];
 }
 
@@ -0,0 +1,57 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKLinearObjectStorage.h"
+
+/// opaque node type used internally by the tree
+
+typedef struct _DKRTreeNode DKRTreeNode;
+
+/** @brief Storage that maintains an R-tree in parallel with the linear array.
+
+ Storage that maintains an R-tree in parallel with the linear array. Unlike the BSP storage classes, the R-tree does not partition the canvas uniformly, but
+ groups objects by their actual bounds, so it stays balanced when objects are heavily clustered or vary wildly in size. A single huge object occupies exactly
+ one leaf entry rather than being referenced by every leaf it overlaps.
+
+ As with DKBSPDirectObjectStorage, each object stores its own Z-position (index) which is renumbered as the linear array changes. The tree refers to objects
+ directly (unretained - the linear array owns them) and query results are sorted on the stored index unless kDKZOrderMayBeRelaxed is passed.
+
+ The tree is bulk-loaded using Sort-Tile-Recursive packing when -setObjects: is called (e.g. on dearchiving), and maintained incrementally thereafter using
+ Guttman's quadratic split. Invisible objects are kept in the tree and filtered at query time, so visibility changes cost nothing.
+
+ To use this storage for all new layers, call +[DKObjectOwnerLayer setStorageClass:[DKRTreeObjectStorage class]].
+*/
+@interface DKRTreeObjectStorage : DKLinearObjectStorage {
+@private
+	DKRTreeNode* mRoot;
+	CFMutableDictionaryRef mLeafMap; // maps each stored object to the leaf node that contains it
+	NSMutableArray* mFoundObjects;
+	NSUInteger mBatchNesting;
+	NSMutableArray* mBatchObjects;
+}
+
+/** @brief Rebuilds the whole tree from the object array using STR bulk loading
+
+ Normally the tree is maintained incrementally so there's no need to call this, but after very large numbers of edits a repack can improve
+ query performance a little.
+ */
+- (void)rebuildTree;
+
+/** @brief The number of levels in the tree, including the leaf level
+ @return the tree height; 1 for an empty or small tree
+ */
+- (NSUInteger)treeHeight;
+
+/** @brief Returns a path consisting of the bounds of every node in the tree, for debugging
+ @return a path
+ */
+- (NSBezierPath*)debugStorageDivisions;
+
+@end
+
+#define kDKRTreeMaxEntries 16
+#define kDKRTreeMinEntries 6
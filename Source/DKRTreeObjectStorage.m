@@ -0,0 +1,1132 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKRTreeObjectStorage.h"
+#import "DKTrace.h"
+
+// the tree node. Leaf nodes store object pointers in <entries>, internal nodes store child node pointers. One extra slot is allocated so that
+// a node can temporarily overflow before it is split.
+
+struct _DKRTreeNode {
+	DKRTreeNode* parent;
+	NSUInteger count;
+	BOOL leaf;
+	NSRect rects[kDKRTreeMaxEntries + 1];
+	void* entries[kDKRTreeMaxEntries + 1];
+};
+
+// a rect/pointer pair used for bulk loading and reinsertion
+
+typedef struct {
+	NSRect rect;
+	void* ptr;
+} DKRTreeEntry;
+
+// if the number of objects inserted or removed in one go exceeds this fraction of the total, the tree is repacked rather than edited
+
+#define kDKRTreeRepackFraction 4
+
+#pragma mark Geometry utilities
+
+// n.b. NSUnionRect ignores empty rects, which is not what we want here - a zero-width line still needs to be covered by its node.
+
+static inline NSRect coverRect(NSRect a, NSRect b)
+{
+	CGFloat minX = MIN(NSMinX(a), NSMinX(b));
+	CGFloat minY = MIN(NSMinY(a), NSMinY(b));
+	CGFloat maxX = MAX(NSMaxX(a), NSMaxX(b));
+	CGFloat maxY = MAX(NSMaxY(a), NSMaxY(b));
+
+	return NSMakeRect(minX, minY, maxX - minX, maxY - minY);
+}
+
+static inline CGFloat rectArea(NSRect r)
+{
+	return NSWidth(r) * NSHeight(r);
+}
+
+static inline BOOL rectsOverlap(NSRect a, NSRect b)
+{
+	// closed-interval test, so that degenerate rects and points are found
+
+	return NSMinX(a) <= NSMaxX(b) && NSMinX(b) <= NSMaxX(a) && NSMinY(a) <= NSMaxY(b) && NSMinY(b) <= NSMaxY(a);
+}
+
+static inline BOOL rectContainsRect(NSRect outer, NSRect inner)
+{
+	return NSMinX(inner) >= NSMinX(outer) && NSMaxX(inner) <= NSMaxX(outer) && NSMinY(inner) >= NSMinY(outer) && NSMaxY(inner) <= NSMaxY(outer);
+}
+
+#pragma mark Node utilities
+
+static DKRTreeNode* newNode(BOOL leaf)
+{
+	DKRTreeNode* node = calloc(1, sizeof(DKRTreeNode));
+	node->leaf = leaf;
+	return node;
+}
+
+static void freeNodeRecursively(DKRTreeNode* node)
+{
+	if (node == NULL)
+		return;
+
+	if (!node->leaf) {
+		NSUInteger i;
+
+		for (i = 0; i < node->count; ++i)
+			freeNodeRecursively((DKRTreeNode*)node->entries[i]);
+	}
+
+	free(node);
+}
+
+static NSRect nodeCover(DKRTreeNode* node)
+{
+	if (node->count == 0)
+		return NSZeroRect;
+
+	NSRect r = node->rects[0];
+	NSUInteger i;
+
+	for (i = 1; i < node->count; ++i)
+		r = coverRect(r, node->rects[i]);
+
+	return r;
+}
+
+static NSUInteger indexOfEntry(DKRTreeNode* node, void* ptr)
+{
+	NSUInteger i;
+
+	for (i = 0; i < node->count; ++i) {
+		if (node->entries[i] == ptr)
+			return i;
+	}
+
+	return NSNotFound;
+}
+
+static void removeEntryAtIndex(DKRTreeNode* node, NSUInteger indx)
+{
+	// order within a node is irrelevant, so move the last entry into the hole
+
+	node->count--;
+	node->rects[indx] = node->rects[node->count];
+	node->entries[indx] = node->entries[node->count];
+}
+
+static void adoptEntry(DKRTreeNode* node, NSUInteger indx, CFMutableDictionaryRef leafMap)
+{
+	// makes the entry at <indx> point back to <node>, either via the child's parent pointer or the leaf map
+
+	if (node->leaf)
+		CFDictionarySetValue(leafMap, node->entries[indx], node);
+	else
+		((DKRTreeNode*)node->entries[indx])->parent = node;
+}
+
+static void refreshCoverUpwards(DKRTreeNode* node)
+{
+	DKRTreeNode* parent;
+
+	while ((parent = node->parent)) {
+		NSUInteger indx = indexOfEntry(parent, node);
+		NSRect cover = nodeCover(node);
+
+		if (NSEqualRects(cover, parent->rects[indx]))
+			break;
+
+		parent->rects[indx] = cover;
+		node = parent;
+	}
+}
+
+static NSUInteger treeHeight(DKRTreeNode* root)
+{
+	NSUInteger h = 1;
+
+	while (root && !root->leaf && root->count > 0) {
+		root = (DKRTreeNode*)root->entries[0];
+		++h;
+	}
+
+	return h;
+}
+
+#pragma mark Insertion
+
+static DKRTreeNode* chooseLeaf(DKRTreeNode* node, NSRect rect)
+{
+	// descend the tree choosing the child needing least enlargement, ties resolved by smallest area
+
+	while (!node->leaf) {
+		NSUInteger i, best = 0;
+		CGFloat bestEnlargement = CGFLOAT_MAX, bestArea = CGFLOAT_MAX;
+
+		for (i = 0; i < node->count; ++i) {
+			CGFloat area = rectArea(node->rects[i]);
+			CGFloat enlargement = rectArea(coverRect(node->rects[i], rect)) - area;
+
+			if (enlargement < bestEnlargement || (enlargement == bestEnlargement && area < bestArea)) {
+				best = i;
+				bestEnlargement = enlargement;
+				bestArea = area;
+			}
+		}
+
+		node = (DKRTreeNode*)node->entries[best];
+	}
+
+	return node;
+}
+
+static DKRTreeNode* splitNode(DKRTreeNode* node, CFMutableDictionaryRef leafMap)
+{
+	// quadratic split (Guttman). <node> contains kDKRTreeMaxEntries + 1 entries. On return <node> holds one group, and the returned sibling the other.
+
+	NSUInteger n = node->count;
+	NSRect rects[kDKRTreeMaxEntries + 1];
+	void* entries[kDKRTreeMaxEntries + 1];
+	BOOL assigned[kDKRTreeMaxEntries + 1];
+	NSUInteger i, j, seedA = 0, seedB = 1;
+	CGFloat worst = -CGFLOAT_MAX;
+
+	memcpy(rects, node->rects, sizeof(NSRect) * n);
+	memcpy(entries, node->entries, sizeof(void*) * n);
+	memset(assigned, 0, sizeof(assigned));
+
+	// pick the pair of seeds that would waste the most area if grouped together
+
+	for (i = 0; i < n - 1; ++i) {
+		for (j = i + 1; j < n; ++j) {
+			CGFloat d = rectArea(coverRect(rects[i], rects[j])) - rectArea(rects[i]) - rectArea(rects[j]);
+
+			if (d > worst) {
+				worst = d;
+				seedA = i;
+				seedB = j;
+			}
+		}
+	}
+
+	DKRTreeNode* sibling = newNode(node->leaf);
+	NSRect coverA = rects[seedA];
+	NSRect coverB = rects[seedB];
+
+	node->count = 0;
+	node->rects[0] = rects[seedA];
+	node->entries[0] = entries[seedA];
+	node->count = 1;
+	sibling->rects[0] = rects[seedB];
+	sibling->entries[0] = entries[seedB];
+	sibling->count = 1;
+	assigned[seedA] = assigned[seedB] = YES;
+
+	NSUInteger remaining = n - 2;
+
+	while (remaining > 0) {
+		DKRTreeNode* target;
+		NSUInteger pick = NSNotFound;
+
+		// if one group must take everything that's left to reach the minimum fill, give it to it
+
+		if (node->count + remaining <= kDKRTreeMinEntries)
+			target = node;
+		else if (sibling->count + remaining <= kDKRTreeMinEntries)
+			target = sibling;
+		else {
+			// pick the entry with the greatest preference for one group over the other
+
+			CGFloat maxDiff = -1;
+			CGFloat dA = 0, dB = 0;
+
+			for (i = 0; i < n; ++i) {
+				if (!assigned[i]) {
+					CGFloat ea = rectArea(coverRect(coverA, rects[i])) - rectArea(coverA);
+					CGFloat eb = rectArea(coverRect(coverB, rects[i])) - rectArea(coverB);
+
+					if (ABS(ea - eb) > maxDiff) {
+						maxDiff = ABS(ea - eb);
+						pick = i;
+						dA = ea;
+						dB = eb;
+					}
+				}
+			}
+
+			if (dA < dB)
+				target = node;
+			else if (dB < dA)
+				target = sibling;
+			else if (rectArea(coverA) != rectArea(coverB))
+				target = rectArea(coverA) < rectArea(coverB) ? node : sibling;
+			else
+				target = node->count <= sibling->count ? node : sibling;
+		}
+
+		if (pick == NSNotFound) {
+			// bulk-assign everything left to <target>
+
+			for (i = 0; i < n; ++i) {
+				if (!assigned[i]) {
+					target->rects[target->count] = rects[i];
+					target->entries[target->count++] = entries[i];
+					assigned[i] = YES;
+				}
+			}
+
+			remaining = 0;
+		} else {
+			target->rects[target->count] = rects[pick];
+			target->entries[target->count++] = entries[pick];
+			assigned[pick] = YES;
+			--remaining;
+		}
+
+		coverA = nodeCover(node);
+		coverB = nodeCover(sibling);
+	}
+
+	// fix up back references
+
+	for (i = 0; i < node->count; ++i)
+		adoptEntry(node, i, leafMap);
+
+	for (i = 0; i < sibling->count; ++i)
+		adoptEntry(sibling, i, leafMap);
+
+	return sibling;
+}
+
+static void insertEntry(DKRTreeNode** rootPtr, DKRTreeNode* leaf, NSRect rect, void* ptr, CFMutableDictionaryRef leafMap)
+{
+	// adds the entry to <leaf> (which may be any node at the correct level), splitting nodes upwards as required
+
+	DKRTreeNode* node = leaf;
+
+	node->rects[node->count] = rect;
+	node->entries[node->count] = ptr;
+	adoptEntry(node, node->count++, leafMap);
+
+	while (node->count > kDKRTreeMaxEntries) {
+		DKRTreeNode* sibling = splitNode(node, leafMap);
+		DKRTreeNode* parent = node->parent;
+
+		if (parent == NULL) {
+			// splitting the root grows the tree by one level
+
+			parent = newNode(NO);
+			parent->rects[0] = nodeCover(node);
+			parent->entries[0] = node;
+			parent->count = 1;
+			node->parent = parent;
+			*rootPtr = parent;
+		} else
+			parent->rects[indexOfEntry(parent, node)] = nodeCover(node);
+
+		parent->rects[parent->count] = nodeCover(sibling);
+		parent->entries[parent->count] = sibling;
+		sibling->parent = parent;
+		parent->count++;
+
+		node = parent;
+	}
+
+	refreshCoverUpwards(node);
+}
+
+#pragma mark Deletion
+
+static void collectEntries(DKRTreeNode* node, DKRTreeEntry** buffer, NSUInteger* count, NSUInteger* capacity)
+{
+	// gathers all leaf entries below <node> and frees the nodes as it goes
+
+	NSUInteger i;
+
+	for (i = 0; i < node->count; ++i) {
+		if (node->leaf) {
+			if (*count == *capacity) {
+				*capacity = MAX(*capacity * 2, (NSUInteger)kDKRTreeMaxEntries);
+				*buffer = realloc(*buffer, sizeof(DKRTreeEntry) * (*capacity));
+			}
+
+			(*buffer)[*count].rect = node->rects[i];
+			(*buffer)[*count].ptr = node->entries[i];
+			(*count)++;
+		} else
+			collectEntries((DKRTreeNode*)node->entries[i], buffer, count, capacity);
+	}
+
+	free(node);
+}
+
+static void removeObjectFromTree(DKRTreeNode** rootPtr, id<DKStorableObject> obj, CFMutableDictionaryRef leafMap)
+{
+	DKRTreeNode* leaf = (DKRTreeNode*)CFDictionaryGetValue(leafMap, obj);
+
+	if (leaf == NULL)
+		return;
+
+	NSUInteger indx = indexOfEntry(leaf, obj);
+
+	NSCAssert(indx != NSNotFound, @"R-tree leaf map is inconsistent with the tree");
+
+	removeEntryAtIndex(leaf, indx);
+	CFDictionaryRemoveValue(leafMap, obj);
+
+	// condense the tree: underfull nodes are removed and their objects reinserted
+
+	DKRTreeEntry* orphans = NULL;
+	NSUInteger orphanCount = 0, orphanCapacity = 0;
+	DKRTreeNode* node = leaf;
+
+	while (node->parent) {
+		DKRTreeNode* parent = node->parent;
+		NSUInteger ni = indexOfEntry(parent, node);
+
+		if (node->count < kDKRTreeMinEntries) {
+			removeEntryAtIndex(parent, ni);
+			collectEntries(node, &orphans, &orphanCount, &orphanCapacity);
+		} else
+			parent->rects[ni] = nodeCover(node);
+
+		node = parent;
+	}
+
+	// shorten the tree if the root has a single child
+
+	while (!(*rootPtr)->leaf && (*rootPtr)->count == 1) {
+		DKRTreeNode* oldRoot = *rootPtr;
+		*rootPtr = (DKRTreeNode*)oldRoot->entries[0];
+		(*rootPtr)->parent = NULL;
+		free(oldRoot);
+	}
+
+	if (!(*rootPtr)->leaf && (*rootPtr)->count == 0) {
+		free(*rootPtr);
+		*rootPtr = newNode(YES);
+	}
+
+	NSUInteger i;
+
+	for (i = 0; i < orphanCount; ++i)
+		insertEntry(rootPtr, chooseLeaf(*rootPtr, orphans[i].rect), orphans[i].rect, orphans[i].ptr, leafMap);
+
+	free(orphans);
+}
+
+#pragma mark Bulk loading
+
+static int compareEntryCentreX(const void* a, const void* b)
+{
+	CGFloat ca = NSMidX(((const DKRTreeEntry*)a)->rect);
+	CGFloat cb = NSMidX(((const DKRTreeEntry*)b)->rect);
+
+	return (ca < cb) ? -1 : ((ca > cb) ? 1 : 0);
+}
+
+static int compareEntryCentreY(const void* a, const void* b)
+{
+	CGFloat ca = NSMidY(((const DKRTreeEntry*)a)->rect);
+	CGFloat cb = NSMidY(((const DKRTreeEntry*)b)->rect);
+
+	return (ca < cb) ? -1 : ((ca > cb) ? 1 : 0);
+}
+
+static DKRTreeNode* bulkLoad(DKRTreeEntry* entries, NSUInteger count, BOOL leaf, CFMutableDictionaryRef leafMap)
+{
+	// Sort-Tile-Recursive packing. Builds one level of the tree from <entries>, then recurses on the resulting nodes until a single root remains.
+
+	NSUInteger i;
+
+	if (count <= kDKRTreeMaxEntries) {
+		DKRTreeNode* node = newNode(leaf);
+
+		for (i = 0; i < count; ++i) {
+			node->rects[i] = entries[i].rect;
+			node->entries[i] = entries[i].ptr;
+			adoptEntry(node, i, leafMap);
+		}
+
+		node->count = count;
+		return node;
+	}
+
+	NSUInteger nodeCount = (count + kDKRTreeMaxEntries - 1) / kDKRTreeMaxEntries;
+	NSUInteger sliceCount = (NSUInteger)ceil(sqrt((double)nodeCount));
+	NSUInteger sliceSize = sliceCount * kDKRTreeMaxEntries;
+	DKRTreeEntry* parents = malloc(sizeof(DKRTreeEntry) * nodeCount);
+	NSUInteger s, parentCount = 0;
+
+	qsort(entries, count, sizeof(DKRTreeEntry), compareEntryCentreX);
+
+	for (s = 0; s < count; s += sliceSize) {
+		NSUInteger sliceEnd = MIN(s + sliceSize, count);
+
+		qsort(entries + s, sliceEnd - s, sizeof(DKRTreeEntry), compareEntryCentreY);
+
+		for (i = s; i < sliceEnd; i += kDKRTreeMaxEntries) {
+			DKRTreeNode* node = newNode(leaf);
+			NSUInteger j, n = MIN((NSUInteger)kDKRTreeMaxEntries, sliceEnd - i);
+
+			for (j = 0; j < n; ++j) {
+				node->rects[j] = entries[i + j].rect;
+				node->entries[j] = entries[i + j].ptr;
+				adoptEntry(node, j, leafMap);
+			}
+
+			node->count = n;
+			parents[parentCount].rect = nodeCover(node);
+			parents[parentCount].ptr = node;
+			parentCount++;
+		}
+	}
+
+	DKRTreeNode* root = bulkLoad(parents, parentCount, NO, leafMap);
+	free(parents);
+
+	return root;
+}
+
+#pragma mark Searching
+
+static void searchTree(DKRTreeNode* root, NSRect rect, CFMutableArrayRef results)
+{
+	// non-recursive search using an explicit stack. The stack can never hold more than (height * (M - 1)) + 1 nodes.
+
+	NSUInteger stackSize = treeHeight(root) * kDKRTreeMaxEntries + 1;
+	DKRTreeNode* stack[stackSize];
+	NSUInteger i, sp = 0;
+
+	stack[sp++] = root;
+
+	while (sp > 0) {
+		DKRTreeNode* node = stack[--sp];
+
+		if (node->leaf) {
+			for (i = 0; i < node->count; ++i) {
+				if (rectsOverlap(node->rects[i], rect))
+					CFArrayAppendValue(results, node->entries[i]);
+			}
+		} else {
+			for (i = 0; i < node->count; ++i) {
+				if (rectsOverlap(node->rects[i], rect))
+					stack[sp++] = (DKRTreeNode*)node->entries[i];
+			}
+		}
+	}
+}
+
+static void appendNodeRects(DKRTreeNode* node, NSBezierPath* path)
+{
+	if (!node->leaf) {
+		NSUInteger i;
+
+		for (i = 0; i < node->count; ++i) {
+			[path appendBezierPathWithRect:node->rects[i]];
+			appendNodeRects((DKRTreeNode*)node->entries[i], path);
+		}
+	}
+}
+
+#pragma mark Nearest-object search
+
+// an entry in the best-first search queue - a node to open, an object measured so far only to its bounds, or an object whose exact
+// distance is known
+
+typedef enum {
+	kDKRTreeQueueNode,
+	kDKRTreeQueueObjectBounds,
+	kDKRTreeQueueObject
+} DKRTreeQueueKind;
+
+typedef struct {
+	void* ptr;
+	CGFloat distance;
+	DKRTreeQueueKind kind;
+} DKRTreeQueueItem;
+
+typedef struct {
+	DKRTreeQueueItem* items;
+	NSUInteger count;
+	NSUInteger capacity;
+} DKRTreeQueue;
+
+static void queuePush(DKRTreeQueue* queue, void* ptr, CGFloat distance, DKRTreeQueueKind kind)
+{
+	// a binary min-heap on distance
+
+	if (queue->count == queue->capacity) {
+		queue->capacity = MAX(queue->capacity * 2, (NSUInteger)64);
+		queue->items = realloc(queue->items, sizeof(DKRTreeQueueItem) * queue->capacity);
+	}
+
+	NSUInteger i = queue->count++;
+
+	while (i > 0 && queue->items[(i - 1) >> 1].distance > distance) {
+		queue->items[i] = queue->items[(i - 1) >> 1];
+		i = (i - 1) >> 1;
+	}
+
+	queue->items[i].ptr = ptr;
+	queue->items[i].distance = distance;
+	queue->items[i].kind = kind;
+}
+
+static DKRTreeQueueItem queuePop(DKRTreeQueue* queue)
+{
+	DKRTreeQueueItem top = queue->items[0];
+	DKRTreeQueueItem last = queue->items[--queue->count];
+	NSUInteger i = 0, child;
+
+	while ((child = (i << 1) + 1) < queue->count) {
+		if (child + 1 < queue->count && queue->items[child + 1].distance < queue->items[child].distance)
+			++child;
+
+		if (queue->items[child].distance >= last.distance)
+			break;
+
+		queue->items[i] = queue->items[child];
+		i = child;
+	}
+
+	if (queue->count > 0)
+		queue->items[i] = last;
+
+	return top;
+}
+
+static NSArray* searchNearest(DKRTreeNode* root, NSPoint pt, NSUInteger limit, CGFloat distance, DKObjectStorageOptions options)
+{
+	// best-first search: nodes and objects are taken from the queue nearest first, so objects come out in order of distance and the search
+	// stops as soon as enough have been found. An object's exact distance is never less than its bounds distance, so it's measured exactly
+	// only when it reaches the front of the queue, then queued again.
+
+	DKRTreeQueue queue = { NULL, 0, 0 };
+	DKObjectDistance* found = NULL;
+	NSUInteger i, foundCount = 0, foundCapacity = 0;
+	BOOL exact = (options & kDKExactDistance) != 0;
+	CGFloat d;
+
+	@try {
+		queuePush(&queue, root, 0, kDKRTreeQueueNode);
+
+		while (queue.count > 0 && foundCount < limit) {
+			DKRTreeQueueItem item = queuePop(&queue);
+
+			if (item.distance > distance)
+				break;
+
+			if (item.kind == kDKRTreeQueueNode) {
+				DKRTreeNode* node = (DKRTreeNode*)item.ptr;
+
+				for (i = 0; i < node->count; ++i) {
+					d = DKObjectStorageDistanceToRect(pt, node->rects[i]);
+
+					if (d > distance)
+						continue;
+
+					if (!node->leaf)
+						queuePush(&queue, node->entries[i], d, kDKRTreeQueueNode);
+					else if ((options & kDKIncludeInvisible) || [(id<DKStorableObject>)node->entries[i] visible])
+						queuePush(&queue, node->entries[i], d, exact ? kDKRTreeQueueObjectBounds : kDKRTreeQueueObject);
+				}
+			} else if (item.kind == kDKRTreeQueueObjectBounds)
+				queuePush(&queue, item.ptr, DKObjectStorageDistanceToObject((id<DKStorableObject>)item.ptr, pt, options), kDKRTreeQueueObject);
+			else {
+				if (foundCount == foundCapacity) {
+					foundCapacity = MAX(foundCapacity * 2, (NSUInteger)16);
+					found = realloc(found, sizeof(DKObjectDistance) * foundCapacity);
+				}
+
+				found[foundCount].object = (id<DKStorableObject>)item.ptr;
+				found[foundCount].distance = item.distance;
+				found[foundCount].index = [(id<DKStorableObject>)item.ptr index];
+				++foundCount;
+			}
+		}
+
+		return DKObjectStorageNearestObjects(found, foundCount, limit);
+	}
+	@finally {
+		free(queue.items);
+		free(found);
+	}
+}
+
+#pragma mark Z-ordering
+
+static NSComparisonResult zComparisonFunc(id<DKStorableObject> a, id<DKStorableObject> b, void* context)
+{
+#pragma unused(context)
+
+	NSUInteger ia = [a index];
+	NSUInteger ib = [b index];
+
+	if (ia < ib)
+		return NSOrderedAscending;
+	else if (ia > ib)
+		return NSOrderedDescending;
+	else
+		return NSOrderedSame;
+}
+
+static void renumberFunc(const void* value, void* context)
+{
+	id<DKStorableObject> obj = (id<DKStorableObject>)value;
+	[obj setIndex:*(NSUInteger*)context];
+	(*(NSUInteger*)context)++;
+}
+
+static void unmarkFunc(const void* value, void* context)
+{
+#pragma unused(context)
+	[(id<DKStorableObject>)value setMarked:NO];
+}
+
+#pragma mark -
+
+@interface DKRTreeObjectStorage (Private)
+
+- (void)renumberObjectsFromIndex:(NSUInteger)indx;
+- (void)insertObjectIntoTree:(id<DKStorableObject>)obj;
+- (void)removeObjectFromTree:(id<DKStorableObject>)obj;
+- (void)emptyTree;
+- (void)updateObjectInTree:(id<DKStorableObject>)obj;
+- (void)applyPendingBoundsUpdates;
+
+@end
+
+#pragma mark -
+
+@implementation DKRTreeObjectStorage
+
+- (void)rebuildTree
+{
+	[self emptyTree];
+
+	NSUInteger i, count = [self countOfObjects];
+
+	if (count > 0) {
+		DKRTreeEntry* entries = malloc(sizeof(DKRTreeEntry) * count);
+		NSArray* objects = [self objects];
+
+		for (i = 0; i < count; ++i) {
+			id<DKStorableObject> obj = [objects objectAtIndex:i];
+
+			entries[i].rect = [obj bounds];
+			entries[i].ptr = obj;
+		}
+
+		free(mRoot);
+		mRoot = bulkLoad(entries, count, YES, mLeafMap);
+		free(entries);
+	}
+
+	DKTrace_(kDKTraceInfo, @"%@ <%p> bulk loaded %lu objects, height = %lu", NSStringFromClass([self class]), self, (unsigned long)count, (unsigned long)[self treeHeight]);
+}
+
+- (NSUInteger)treeHeight
+{
+	return treeHeight(mRoot);
+}
+
+- (NSBezierPath*)debugStorageDivisions
+{
+	NSBezierPath* path = [NSBezierPath bezierPath];
+
+	if (mRoot->count > 0)
+		[path appendBezierPathWithRect:nodeCover(mRoot)];
+
+	appendNodeRects(mRoot, path);
+	return path;
+}
+
+#pragma mark -
+#pragma mark - as implementor of the DKObjectStorage protocol
+
+- (NSArray*)objectsIntersectingRect:(NSRect)aRect inView:(NSView*)aView options:(DKObjectStorageOptions)options
+{
+	// when the update rect is ignored there's no benefit from the tree, so let the linear storage deal with it
+
+	if (options & kDKIgnoreUpdateRect)
+		return [super objectsIntersectingRect:aRect
+									   inView:aView
+									  options:options];
+
+	[self applyPendingBoundsUpdates];
+
+	CFMutableArrayRef candidates = (CFMutableArrayRef)mFoundObjects;
+	NSMutableArray* results = [NSMutableArray array];
+	id<DKStorableObject> obj;
+	NSUInteger i, count, stamp = DKObjectStorageNextQueryStamp();
+
+	[mFoundObjects removeAllObjects];
+
+	if (aView) {
+		const NSRect* rects;
+		NSInteger rectCount, r;
+
+		[aView getRectsBeingDrawn:&rects
+							count:&rectCount];
+
+		for (r = 0; r < rectCount; ++r)
+			searchTree(mRoot, rects[r], candidates);
+	} else
+		searchTree(mRoot, aRect, candidates);
+
+	count = [mFoundObjects count];
+
+	for (i = 0; i < count; ++i) {
+		obj = [mFoundObjects objectAtIndex:i];
+
+		// an object can only be found more than once when there are several update rects
+
+		if ([obj queryStamp] == stamp)
+			continue;
+
+		if ((options & kDKIncludeInvisible) || [obj visible]) {
+			if (aView) {
+				if ([aView needsToDrawRect:[obj bounds]]) {
+					[obj setQueryStamp:stamp];
+					[results addObject:obj];
+				}
+			} else if (NSIntersectsRect([obj bounds], aRect))
+				[results addObject:obj];
+		}
+	}
+
+	[mFoundObjects removeAllObjects];
+
+	if ((options & kDKZOrderMayBeRelaxed) == 0)
+		CFArraySortValues((CFMutableArrayRef)results, CFRangeMake(0, [results count]), (CFComparatorFunction)zComparisonFunc, NULL);
+
+	if (options & kDKReverseOrder)
+		return [[results reverseObjectEnumerator] allObjects];
+
+	return results;
+}
+
+- (NSArray*)objectsContainingPoint:(NSPoint)aPoint
+{
+	NSMutableArray* results = [NSMutableArray array];
+	NSEnumerator* iter;
+	id<DKStorableObject> obj;
+
+	[self applyPendingBoundsUpdates];
+	[mFoundObjects removeAllObjects];
+	searchTree(mRoot, NSMakeRect(aPoint.x, aPoint.y, 0, 0), (CFMutableArrayRef)mFoundObjects);
+
+	iter = [mFoundObjects objectEnumerator];
+
+	while ((obj = [iter nextObject])) {
+		if ([obj visible] && NSPointInRect(aPoint, [obj bounds]))
+			[results addObject:obj];
+	}
+
+	[mFoundObjects removeAllObjects];
+	CFArraySortValues((CFMutableArrayRef)results, CFRangeMake(0, [results count]), (CFComparatorFunction)zComparisonFunc, NULL);
+
+	return results;
+}
+
+- (NSArray*)objectsNearestPoint:(NSPoint)aPoint count:(NSUInteger)count options:(DKObjectStorageOptions)options
+{
+	if (count == 0)
+		return [NSArray array];
+
+	[self applyPendingBoundsUpdates];
+
+	return searchNearest(mRoot, aPoint, count, CGFLOAT_MAX, options);
+}
+
+- (NSArray*)objectsWithinDistance:(CGFloat)distance ofPoint:(NSPoint)aPoint options:(DKObjectStorageOptions)options
+{
+	[self applyPendingBoundsUpdates];
+
+	return searchNearest(mRoot, aPoint, NSUIntegerMax, distance, options);
+}
+
+- (void)setObjects:(NSArray*)objects
+{
+	[self applyPendingBoundsUpdates];
+	[super setObjects:objects];
+	[self renumberObjectsFromIndex:0];
+	[self rebuildTree];
+}
+
+- (void)insertObject:(id<DKStorableObject>)obj inObjectsAtIndex:(NSUInteger)indx
+{
+	[self applyPendingBoundsUpdates];
+
+	NSUInteger oldCount = [self countOfObjects];
+
+	[super insertObject:obj
+		inObjectsAtIndex:indx];
+
+	if ([self countOfObjects] > oldCount) {
+		[self renumberObjectsFromIndex:indx];
+		[self insertObjectIntoTree:obj];
+	}
+}
+
+- (void)removeObjectFromObjectsAtIndex:(NSUInteger)indx
+{
+	[self applyPendingBoundsUpdates];
+
+	id<DKStorableObject> obj = [self objectInObjectsAtIndex:indx];
+
+	[self removeObjectFromTree:obj];
+	[super removeObjectFromObjectsAtIndex:indx];
+	[self renumberObjectsFromIndex:indx];
+}
+
+- (void)replaceObjectInObjectsAtIndex:(NSUInteger)indx withObject:(id<DKStorableObject>)obj
+{
+	[self applyPendingBoundsUpdates];
+
+	id<DKStorableObject> old = [self objectInObjectsAtIndex:indx];
+
+	if (old != obj) {
+		[self removeObjectFromTree:old];
+		[super replaceObjectInObjectsAtIndex:indx
+								  withObject:obj];
+		[obj setIndex:indx];
+		[self insertObjectIntoTree:obj];
+	}
+}
+
+- (void)insertObjects:(NSArray*)objs atIndexes:(NSIndexSet*)set
+{
+	[self applyPendingBoundsUpdates];
+
+	[super insertObjects:objs
+			   atIndexes:set];
+
+	if ([set count] > 0) {
+		[self renumberObjectsFromIndex:[set firstIndex]];
+
+		// for a large insertion, repacking the whole tree is faster and gives a better tree than inserting one by one
+
+		if ([set count] * kDKRTreeRepackFraction > [self countOfObjects])
+			[self rebuildTree];
+		else {
+			NSEnumerator* iter = [objs objectEnumerator];
+			id<DKStorableObject> obj;
+
+			while ((obj = [iter nextObject]))
+				[self insertObjectIntoTree:obj];
+		}
+	}
+}
+
+- (void)removeObjectsAtIndexes:(NSIndexSet*)set
+{
+	[self applyPendingBoundsUpdates];
+
+	if ([set count] > 0 && [set count] <= [self countOfObjects]) {
+		BOOL repack = ([set count] * kDKRTreeRepackFraction > [self countOfObjects]);
+
+		if (!repack) {
+			NSEnumerator* iter = [[self objectsAtIndexes:set] objectEnumerator];
+			id<DKStorableObject> obj;
+
+			while ((obj = [iter nextObject]))
+				[self removeObjectFromTree:obj];
+		}
+
+		[super removeObjectsAtIndexes:set];
+		[self renumberObjectsFromIndex:[set firstIndex]];
+
+		if (repack)
+			[self rebuildTree];
+	}
+}
+
+- (BOOL)containsObject:(id<DKStorableObject>)object
+{
+	return [object storage] == self;
+}
+
+- (void)moveObject:(id<DKStorableObject>)obj toIndex:(NSUInteger)indx
+{
+	// the tree doesn't care about Z-order, only the stored indexes need updating
+
+	NSUInteger oldIndex = [obj index];
+
+	[super moveObject:obj
+			  toIndex:indx];
+	[self renumberObjectsFromIndex:MIN(oldIndex, MIN(indx, [self countOfObjects] - 1))];
+}
+
+- (void)object:(id<DKStorableObject>)obj didChangeBoundsFrom:(NSRect)oldBounds
+{
+#pragma unused(oldBounds)
+
+	if (mBatchNesting > 0) {
+		// queries de-duplicate using query stamps rather than the mark flag, so it's free to record which objects are pending
+
+		if (![obj isMarked]) {
+			[obj setMarked:YES];
+			[mBatchObjects addObject:obj];
+		}
+	} else
+		[self updateObjectInTree:obj];
+}
+
+- (void)objectDidChangeVisibility:(id<DKStorableObject>)obj
+{
+#pragma unused(obj)
+
+	// invisible objects remain in the tree and are filtered at query time
+}
+
+- (void)setCanvasSize:(NSSize)size
+{
+#pragma unused(size)
+
+	// the R-tree is unbounded, so the canvas size is irrelevant
+}
+
+- (void)beginBoundsUpdateBatch
+{
+	++mBatchNesting;
+}
+
+- (void)endBoundsUpdateBatch
+{
+	NSAssert(mBatchNesting > 0, @"unbalanced call to endBoundsUpdateBatch");
+
+	if (mBatchNesting > 0 && --mBatchNesting == 0)
+		[self applyPendingBoundsUpdates];
+}
+
+#pragma mark -
+#pragma mark - private
+
+- (void)renumberObjectsFromIndex:(NSUInteger)indx
+{
+	if (indx >= [self countOfObjects])
+		return;
+
+	NSUInteger i = indx;
+	CFArrayApplyFunction((CFArrayRef)[self objects], CFRangeMake(indx, [self countOfObjects] - indx), renumberFunc, &i);
+}
+
+- (void)insertObjectIntoTree:(id<DKStorableObject>)obj
+{
+	NSRect br = [obj bounds];
+	insertEntry(&mRoot, chooseLeaf(mRoot, br), br, obj, mLeafMap);
+}
+
+- (void)removeObjectFromTree:(id<DKStorableObject>)obj
+{
+	removeObjectFromTree(&mRoot, obj, mLeafMap);
+}
+
+- (void)updateObjectInTree:(id<DKStorableObject>)obj
+{
+	DKRTreeNode* leaf = (DKRTreeNode*)CFDictionaryGetValue(mLeafMap, obj);
+
+	if (leaf == NULL)
+		return;
+
+	// if the new bounds still lie within the leaf's covering rect as recorded by its parent, the entry can be updated in place. This
+	// is very common when dragging objects by small amounts.
+
+	NSRect newBounds = [obj bounds];
+	DKRTreeNode* parent = leaf->parent;
+
+	if (parent == NULL || rectContainsRect(parent->rects[indexOfEntry(parent, leaf)], newBounds)) {
+		leaf->rects[indexOfEntry(leaf, obj)] = newBounds;
+		return;
+	}
+
+	[self removeObjectFromTree:obj];
+	[self insertObjectIntoTree:obj];
+}
+
+- (void)applyPendingBoundsUpdates
+{
+	NSUInteger count = [mBatchObjects count];
+
+	if (count == 0)
+		return;
+
+	CFArrayApplyFunction((CFArrayRef)mBatchObjects, CFRangeMake(0, count), unmarkFunc, NULL);
+
+	// if a large fraction of the objects moved, repacking is faster than updating each one and gives a better tree
+
+	if (count * kDKRTreeRepackFraction > [self countOfObjects])
+		[self rebuildTree];
+	else {
+		NSEnumerator* iter = [mBatchObjects objectEnumerator];
+		id<DKStorableObject> obj;
+
+		while ((obj = [iter nextObject]))
+			[self updateObjectInTree:obj];
+	}
+
+	[mBatchObjects removeAllObjects];
+}
+
+- (void)emptyTree
+{
+	freeNodeRecursively(mRoot);
+	mRoot = newNode(YES);
+	CFDictionaryRemoveAllValues(mLeafMap);
+}
+
+#pragma mark -
+#pragma mark - as implementor of the NSCoding protocol
+
+- (id)initWithCoder:(NSCoder*)aCoder
+{
+	// this method is here solely to support backward compatibility with b5; storage is no longer archived.
+
+	mRoot = newNode(YES);
+	mLeafMap = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+	mFoundObjects = [[NSMutableArray alloc] init];
+	mBatchObjects = [[NSMutableArray alloc] init];
+
+	return [super initWithCoder:aCoder];
+}
+
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		mRoot = newNode(YES);
+		mLeafMap = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+		mFoundObjects = [[NSMutableArray alloc] init];
+		mBatchObjects = [[NSMutableArray alloc] init];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	freeNodeRecursively(mRoot);
+
+	if (mLeafMap)
+		CFRelease(mLeafMap);
+
+	[mFoundObjects release];
+	[mBatchObjects release];
+	[super dealloc];
+}
+
+- (NSString*)description
+{
+	return [NSString stringWithFormat:@"<%@ %p>, %lu objects, height = %lu", NSStringFromClass([self class]), self, (unsigned long)[self countOfObjects], (unsigned long)[self treeHeight]];
+}
+
+@end
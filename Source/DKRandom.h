@@ -6,7 +6,21 @@
 
 #import <Cocoa/Cocoa.h>
 
-/** @brief returns a random number between 0 and 1 */
+/** @brief The state of a random number generator (xoshiro256**)
+
+ Each user of random numbers can keep its own, so that what it draws is repeatable and doesn't depend on which thread it runs on
+ or what else is drawing random numbers at the same time. Seed it with DKRandomSeed before use.
+ */
+typedef struct {
+	uint64_t s[4];
+} DKRandomState;
+
+/** @brief returns a random number between 0 and 1
+
+ The class methods draw from a generator kept for each thread, seeded from the time, so they are safe to call from any thread but
+ don't repeat from one run to the next. Rendering code that must draw the same way every time should use a DKRandomState seeded from
+ DKRandomSeedForObject, or DKRandomSignedAtIndex, instead.
+ */
 @interface DKRandom : NSObject {
 }
 
@@ -14,3 +28,55 @@
 + (CGFloat)randomPositiveOrNegativeNumber;
 
 @end
+
+/** @brief Seeds a generator
+ @param state the generator
+ @param seed any value; the same seed always gives the same sequence */
+void DKRandomSeed(DKRandomState* state, uint64_t seed);
+
+/** @brief The next 64 random bits from a generator
+ @param state the generator
+ @return the bits */
+uint64_t DKRandomNext(DKRandomState* state);
+
+/** @brief The next random number from a generator, from 0 up to but not including 1
+ @param state the generator
+ @return the number */
+CGFloat DKRandomUnit(DKRandomState* state);
+
+/** @brief The next random number from a generator, from -0.5 up to but not including 0.5
+ @param state the generator
+ @return the number */
+CGFloat DKRandomSigned(DKRandomState* state);
+
+/** @brief Fills an array with random numbers from 0 up to but not including 1
+ @param state the generator
+ @param values receives the numbers
+ @param count the number of values to fill */
+void DKRandomFillUnit(DKRandomState* state, CGFloat* values, NSUInteger count);
+
+/** @brief Fills an array with random numbers from -0.5 up to but not including 0.5
+ @param state the generator
+ @param values receives the numbers
+ @param count the number of values to fill */
+void DKRandomFillSigned(DKRandomState* state, CGFloat* values, NSUInteger count);
+
+/** @brief A seed derived from an object's identity
+
+ The same for as long as the object exists, so randomness seeded from it is the same every time the object is drawn.
+ @param object an object
+ @return the seed */
+uint64_t DKRandomSeedForObject(id object);
+
+/** @brief A random number from -0.5 up to but not including 0.5, chosen by a seed and an index
+
+ Needs no state, so it suits randomness that must be the same for a given position however it's reached - such as the wobble of
+ the nth motif along a path - without keeping the values.
+ @param seed the seed
+ @param index the index
+ @return the number */
+CGFloat DKRandomSignedAtIndex(uint64_t seed, NSUInteger index);
+
+/** @brief The generator the calling thread's DKRandom class methods draw from
+ @return the generator, which belongs to the thread */
+DKRandomState* DKRandomThreadState(void);
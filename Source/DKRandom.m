@@ -5,24 +5,21 @@
 */
 
 #import "DKRandom.h"
+#include <pthread.h>
+
+static pthread_key_t sThreadStateKey;
+
+static uint64_t splitMix64(uint64_t* x);
+static void makeThreadStateKey(void* context);
 
 @implementation DKRandom
 #pragma mark As a DKRandom
 
 + (CGFloat)randomNumber
 {
-// returns a random value between 0 and 1.
-
-	static unsigned long seed = 0;
-
-	if (seed == 0) {
-		srandom([[NSDate date] timeIntervalSince1970]);
-		seed = 1;
-	}
-	CGFloat randomNum = (CGFloat)random();
-	randomNum /= (randomNum < 0) ? -2147483647.0f : 2147483647.0f;
+	// returns a random value between 0 and 1.
 
-	return randomNum;
+	return DKRandomUnit(DKRandomThreadState());
 }
 
 + (CGFloat)randomPositiveOrNegativeNumber
@@ -31,3 +28,122 @@
 }
 
 @end
+
+#pragma mark -
+
+void DKRandomSeed(DKRandomState* state, uint64_t seed)
+{
+	// splitmix64 spreads the seed over the whole state, which must not be all zero
+
+	NSInteger i;
+
+	for (i = 0; i < 4; ++i)
+		state->s[i] = splitMix64(&seed);
+}
+
+static inline uint64_t rotl(uint64_t x, int k)
+{
+	return (x << k) | (x >> (64 - k));
+}
+
+uint64_t DKRandomNext(DKRandomState* state)
+{
+	uint64_t* s = state->s;
+	uint64_t result = rotl(s[1] * 5, 7) * 9;
+	uint64_t t = s[1] << 17;
+
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = rotl(s[3], 45);
+
+	return result;
+}
+
+CGFloat DKRandomUnit(DKRandomState* state)
+{
+	// the top 53 bits, as a double's mantissa holds
+
+	return (CGFloat)((DKRandomNext(state) >> 11) * (1.0 / 9007199254740992.0));
+}
+
+CGFloat DKRandomSigned(DKRandomState* state)
+{
+	return DKRandomUnit(state) - 0.5;
+}
+
+void DKRandomFillUnit(DKRandomState* state, CGFloat* values, NSUInteger count)
+{
+	// working on a local copy of the state lets the compiler keep it in registers over the loop
+
+	DKRandomState local = *state;
+	NSUInteger i;
+
+	for (i = 0; i < count; ++i)
+		values[i] = DKRandomUnit(&local);
+
+	*state = local;
+}
+
+void DKRandomFillSigned(DKRandomState* state, CGFloat* values, NSUInteger count)
+{
+	DKRandomState local = *state;
+	NSUInteger i;
+
+	for (i = 0; i < count; ++i)
+		values[i] = DKRandomUnit(&local) - 0.5;
+
+	*state = local;
+}
+
+uint64_t DKRandomSeedForObject(id object)
+{
+	uint64_t x = (uint64_t)(uintptr_t)object;
+
+	return splitMix64(&x);
+}
+
+CGFloat DKRandomSignedAtIndex(uint64_t seed, NSUInteger index)
+{
+	uint64_t x = seed ^ ((uint64_t)index * 0xD1B54A32D192ED03ULL);
+
+	return (CGFloat)((splitMix64(&x) >> 11) * (1.0 / 9007199254740992.0)) - 0.5;
+}
+
+DKRandomState* DKRandomThreadState(void)
+{
+	static dispatch_once_t once;
+	DKRandomState* state;
+
+	dispatch_once_f(&once, NULL, makeThreadStateKey);
+
+	state = pthread_getspecific(sThreadStateKey);
+
+	if (state == NULL) {
+		state = malloc(sizeof(DKRandomState));
+		DKRandomSeed(state, (uint64_t)([NSDate timeIntervalSinceReferenceDate] * 1.0e6) ^ (uint64_t)(uintptr_t)pthread_self());
+		pthread_setspecific(sThreadStateKey, state);
+	}
+
+	return state;
+}
+
+#pragma mark -
+
+static uint64_t splitMix64(uint64_t* x)
+{
+	uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+static void makeThreadStateKey(void* context)
+{
+#pragma unused(context)
+
+	pthread_key_create(&sThreadStateKey, free);
+}
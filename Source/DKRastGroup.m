@@ -9,7 +9,8 @@
 #import "DKFill.h"
 #import "DKStroke.h"
 #import "DKGradient.h"
-#import "LogEvent.h"
+#import "DKRenderStatistics.h"
+#import "DKTrace.h"
 
 @implementation DKRastGroup
 #pragma mark As a DKRenderGroup
@@ -501,8 +502,17 @@
 	if (![object conformsToProtocol:@protocol(DKRenderable)])
 		return;
 
+	NSEnumerator* iter = [[self renderList] objectEnumerator];
+	DKRasterizer* rend;
+	uint64_t statsStart;
+
 	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
-		[[self renderList] makeObjectsPerformSelector : _cmd withObject : object];
+
+	while ((rend = [iter nextObject])) {
+		statsStart = DKRenderIntervalBegin(kDKRenderEventRasterizerRender, rend);
+		[rend render:object];
+		DKRenderIntervalEnd(kDKRenderEventRasterizerRender, rend, statsStart, 0, 0);
+	}
 
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 }
@@ -550,7 +560,7 @@
  */
 - (void)setValue:(id)val forNumericParameter:(NSInteger)pnum
 {
-	LogEvent_(kReactiveEvent, @"anonymous parameter #%d, value = %@", pnum, val);
+	DKTrace_(kDKTraceReactive, @"anonymous parameter #%d, value = %@", pnum, val);
 
 	// if <val> conforms to the DKRasterizer protocol, we add it
 
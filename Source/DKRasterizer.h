@@ -67,15 +67,102 @@ Renderers can now have a delegate attached which is able to modify behaviours su
  This method is called internally by render: to obtain the path to be rendered. It is factored to
  allow a delegate to modify the path just before rendering, and to allow special subclasses to
  override it to modify the path for special effects. The normal behaviour is simply to ask the
- object for its rendering path.
+ object for its rendering path. When drawing to the screen, objects that implement -renderingPathWithMaximumError:
+ are asked for that instead, allowing an error of one device pixel, so that dense paths can be drawn simplified when zoomed out.
  @param object the object to render
  @return the rendering path */
 - (NSBezierPath*)renderingPathForObject:(id<DKRenderable>)object;
 
+/** @brief The flatness to use when flattening an object's path for rendering
+
+ Derived from the scale of the view the object is being drawn into, so that flattened paths stay smooth when zoomed in. The value is
+ rounded down to a power of two so that small changes of scale reuse the same cached flattening.
+ @param object the object being rendered
+ @return the flatness, in the object's coordinates
+ */
+- (CGFloat)flatnessForObject:(id<DKRenderable>)object;
+
+/** @brief Returns the object's rendering path flattened at -flatnessForObject:
+
+ The flattened path is kept in the object's rendering cache, if it has one, so every rasterizer in a style that needs it shares
+ a single flattening. The result must not be modified.
+ @param object the object being rendered
+ @return the flattened rendering path
+ */
+- (NSBezierPath*)flattenedRenderingPathForObject:(id<DKRenderable>)object;
+
+/** @brief The smallest on-screen size at which the rasterizer's full detail is worth drawing
+
+ When an object is drawn to the screen so small that its larger dimension, at the view's current scale, is less than this,
+ the style calls -renderLowDetail: instead of -render:. The default is 0, meaning the rasterizer always renders in full.
+ Subclasses whose output is intricate override this to return a suitable size.
+ @return the minimum size in screen points, or 0 to disable level-of-detail rendering
+ */
+- (CGFloat)minimumDetailSize;
+
+/** @brief Renders a cheap approximation of the rasterizer's output
+
+ Called in place of -render: when the object is smaller on screen than -minimumDetailSize. Subclasses should draw something that
+ approximates their full output at a glance, such as a flat colour. The default method draws nothing.
+ @param object the object to render
+ */
+- (void)renderLowDetail:(id<DKRenderable>)object;
+
+/** @brief Renders an object's path, given the object it came from
+
+ Called by -render: once it has the path and set up any clipping. The default method calls -renderPath:. Subclasses that keep
+ per-object information in the object's rendering cache override this rather than -renderPath:.
+ @param path the path to render
+ @param object the object being rendered
+ */
+- (void)renderPath:(NSBezierPath*)path forObject:(id<DKRenderable>)object;
+
+/** @brief A checksum of the settings that affect the paths this rasterizer generates
+
+ Paths that a rasterizer derives from an object's path are cached with this, the object's geometry checksum and the source path's
+ checksum, so that changing any of them regenerates the path. The default returns 0. Subclasses that cache paths combine their own
+ settings with super's.
+ @return a checksum
+ */
+- (NSUInteger)renderingCacheParameters;
+
+/** @brief Returns the path this rasterizer generated from a source path when last rendering the object, if it is still valid
+ @param object the object being rendered
+ @param path the path the generated path was derived from
+ @return the cached path, or nil if there is none or it is out of date
+ */
+- (NSBezierPath*)cachedPathForObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path;
+
+/** @brief Keeps a path generated from a source path in the object's rendering cache
+
+ Each rasterizer keeps one path per object. It is discarded with the rest of the rendering cache on -invalidateRenderingCache.
+ Cached paths are shared between renders, so must not be modified once cached.
+ @param generated the generated path
+ @param object the object being rendered
+ @param path the path the generated path was derived from
+ */
+- (void)setCachedPath:(NSBezierPath*)generated forObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path;
+
+/** @brief As -cachedPathForObject:sourcePath: and -setCachedPath:forObject:sourcePath:, for anything else a rasterizer works out from a path
+
+ Each key is a separate entry, so a class can cache something of its own without disturbing a path its subclasses cache. A nil key is
+ the entry the path methods use.
+ */
+- (id)cachedValueForObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path key:(NSString*)key;
+- (void)setCachedValue:(id)value forObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path key:(NSString*)key;
+
 - (BOOL)copyToPasteboard:(NSPasteboard*)pb;
 
 @end
 
+// combines a value into a checksum, for -renderingCacheParameters
+
+NSUInteger DKRasterizerChecksumCombine(NSUInteger checksum, CGFloat value);
+
+// the path -renderingPathForObject: returns by default, for code that already knows whether it is drawing to the screen
+
+NSBezierPath* DKRasterizerRenderingPath(id<DKRenderable> object, BOOL drawingToScreen);
+
 extern NSString* kDKRasterizerPasteboardType;
 
 extern NSString* kDKRasterizerPropertyWillChange;
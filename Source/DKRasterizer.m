@@ -8,6 +8,37 @@
 #import "DKStyle.h"
 #import "LogEvent.h"
 #import "NSBezierPath+Geometry.h"
+#import "NSBezierPath+Editing.h"
+
+#define kDKRasterizerDeviceFlatness 0.1 // how far a flattened path may stray from the curve, in screen points
+#define kDKRasterizerMinimumFlatness (1.0 / 256.0)
+#define kDKRasterizerMaximumFlatness 1.0
+
+NSUInteger DKRasterizerChecksumCombine(NSUInteger checksum, CGFloat value)
+{
+	double d = value;
+	unsigned long long bits;
+
+	memcpy(&bits, &d, sizeof(bits));
+
+	return (checksum * 31) ^ (NSUInteger)(bits ^ (bits >> 32));
+}
+
+NSBezierPath* DKRasterizerRenderingPath(id<DKRenderable> object, BOOL drawingToScreen)
+{
+	if (drawingToScreen && [object respondsToSelector:@selector(renderingPathWithMaximumError:)]) {
+		// a device pixel's size in the drawing's coordinates comes from how much the context scales areas
+
+		CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+		CGAffineTransform ctm = CGContextGetUserSpaceToDeviceSpaceTransform(context);
+		CGFloat det = fabs(ctm.a * ctm.d - ctm.b * ctm.c);
+
+		if (det > 0.0)
+			return [object renderingPathWithMaximumError:1.0 / sqrt(det)];
+	}
+
+	return [object renderingPath];
+}
 
 NSString* kDKRasterizerPasteboardType = @"kDKRendererPasteboardType";
 NSString* kDKRasterizerPropertyWillChange = @"kDKRasterizerPropertyWillChange";
@@ -171,12 +202,128 @@ NSString* kDKRasterizerChangedPropertyKey = @"kDKRasterizerChangedPropertyKey";
  This method is called internally by render: to obtain the path to be rendered. It is factored to
  allow a delegate to modify the path just before rendering, and to allow special subclasses to
  override it to modify the path for special effects. The normal behaviour is simply to ask the
- object for its rendering path.
+ object for its rendering path. When drawing to the screen, objects that implement -renderingPathWithMaximumError:
+ are asked for that instead, allowing an error of one device pixel, so that dense paths can be drawn simplified when zoomed out.
  @param object the object to render
  @return the rendering path */
 - (NSBezierPath*)renderingPathForObject:(id<DKRenderable>)object
 {
-	return [object renderingPath];
+	return DKRasterizerRenderingPath(object, DKRenderIsDrawingToScreen());
+}
+
+- (CGFloat)flatnessForObject:(id<DKRenderable>)object
+{
+	CGFloat scale = [object respondsToSelector:@selector(renderingScale)] ? [object renderingScale] : 1.0;
+
+	if (scale <= 0.0)
+		scale = 1.0;
+
+	CGFloat flatness = exp2(floor(log2(kDKRasterizerDeviceFlatness / scale)));
+
+	return MIN(MAX(flatness, kDKRasterizerMinimumFlatness), kDKRasterizerMaximumFlatness);
+}
+
+- (NSBezierPath*)flattenedRenderingPathForObject:(id<DKRenderable>)object
+{
+	NSMutableDictionary* cache = [object respondsToSelector:@selector(renderingCache)] ? [object renderingCache] : nil;
+
+	return [[object renderingPath] bezierPathByFlatteningPathWithFlatness:[self flatnessForObject:object]
+																	cache:cache];
+}
+
+/** @brief The smallest on-screen size at which the rasterizer's full detail is worth drawing
+
+ When an object is drawn to the screen so small that its larger dimension, at the view's current scale, is less than this,
+ the style calls -renderLowDetail: instead of -render:. The default is 0, meaning the rasterizer always renders in full.
+ Subclasses whose output is intricate override this to return a suitable size.
+ @return the minimum size in screen points, or 0 to disable level-of-detail rendering
+ */
+- (CGFloat)minimumDetailSize
+{
+	return 0.0;
+}
+
+/** @brief Renders a cheap approximation of the rasterizer's output
+
+ Called in place of -render: when the object is smaller on screen than -minimumDetailSize. Subclasses should draw something that
+ approximates their full output at a glance, such as a flat colour. The default method draws nothing.
+ @param object the object to render
+ */
+- (void)renderLowDetail:(id<DKRenderable>)object
+{
+#pragma unused(object)
+}
+
+- (void)renderPath:(NSBezierPath*)path forObject:(id<DKRenderable>)object
+{
+#pragma unused(object)
+
+	[self renderPath:path];
+}
+
+- (NSUInteger)renderingCacheParameters
+{
+	return 0;
+}
+
+- (NSUInteger)renderingCacheChecksumForObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path
+{
+	// the geometry checksum catches moves, resizes and rotations; the path checksum catches edits that leave them unchanged
+
+	return ([object geometryChecksum] * 31 + [path checksum]) * 31 + [self renderingCacheParameters];
+}
+
+- (NSBezierPath*)cachedPathForObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path
+{
+	return [self cachedValueForObject:object
+						   sourcePath:path
+								  key:nil];
+}
+
+- (void)setCachedPath:(NSBezierPath*)generated forObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path
+{
+	[self setCachedValue:generated
+			   forObject:object
+			  sourcePath:path
+					 key:nil];
+}
+
+- (id)renderingCacheKeyWithKey:(NSString*)key
+{
+	if (key == nil)
+		return [NSValue valueWithNonretainedObject:self];
+	else
+		return [NSString stringWithFormat:@"%@_%p", key, self];
+}
+
+- (id)cachedValueForObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path key:(NSString*)key
+{
+	if (![object respondsToSelector:@selector(renderingCache)])
+		return nil;
+
+	NSArray* entry = [[object renderingCache] objectForKey:[self renderingCacheKeyWithKey:key]];
+
+	if (entry != nil && [[entry objectAtIndex:0] unsignedIntegerValue] == [self renderingCacheChecksumForObject:object
+																									sourcePath:path])
+		return [entry objectAtIndex:1];
+
+	return nil;
+}
+
+- (void)setCachedValue:(id)value forObject:(id<DKRenderable>)object sourcePath:(NSBezierPath*)path key:(NSString*)key
+{
+	if (value == nil || ![object respondsToSelector:@selector(renderingCache)])
+		return;
+
+	// a nil cache would make every lookup miss without any sign of it
+
+	NSAssert([object renderingCache] != nil, @"an object offering a rendering cache must return one");
+
+	NSNumber* checksum = [NSNumber numberWithUnsignedInteger:[self renderingCacheChecksumForObject:object
+																						sourcePath:path]];
+
+	[[object renderingCache] setObject:[NSArray arrayWithObjects:checksum, value, nil]
+								forKey:[self renderingCacheKeyWithKey:key]];
 }
 
 - (BOOL)copyToPasteboard:(NSPasteboard*)pb
@@ -276,7 +423,8 @@ NSString* kDKRasterizerChangedPropertyKey = @"kDKRasterizerChangedPropertyKey";
 			break;
 		}
 
-		[self renderPath:path];
+		[self renderPath:path
+			   forObject:object];
 		RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 	}
 }
@@ -21,7 +21,10 @@
 - (NSUInteger)geometryChecksum; // return a checksum for the object's geometry (size, angle and position)
 
 @optional
-- (NSMutableDictionary*)renderingCache; // return a mutable dictionary that a renderer can store information into for caching purposes
+- (NSMutableDictionary*)renderingCache; // return a mutable dictionary that a renderer can store information into for caching purposes - never nil, as renderers store into it without checking
+- (CGFloat)renderingScale; // the scale of the view the object is being drawn into - used to decide the level of detail
+- (NSBezierPath*)renderingPathWithMaximumError:(CGFloat)maxError; // the rendering path, simplified where that keeps it within <maxError> of the original
+- (CGPathRef)cachedRenderingQuartzPath:(NSWindingRule*)windingRule; // the rendering path as a Quartz path kept by the object until its geometry changes, and its winding rule, or NULL if it has none kept
 
 @end
 
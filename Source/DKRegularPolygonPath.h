@@ -25,6 +25,7 @@ a star shape (not used if the inner radius is -ve).
 	CGFloat mValleySpread; // spread of star "valleys"
 	CGFloat mAngle; // overall rotation angle
 	BOOL mShowSpreadControls; // YES to display spread controls as knobs
+	BOOL mPathNeedsCalculating; // YES once the parameters have changed, until the path is next asked for
 }
 
 - (void)setNumberOfSides:(NSInteger)sides;
@@ -12,11 +12,24 @@
 #import "DKObjectDrawingLayer.h"
 #import "LogEvent.h"
 #import "DKDrawkitMacros.h"
+#import "DKObjectSnapshot.h"
 #include <tgmath.h>
 
 @interface DKRegularPolygonPath (Private)
 
+/** @brief Makes the path from the current polygon parameters
+
+ Called when the path is next asked for after the parameters have changed, so however many times they change while a knob is
+ dragged, the path is made once for each time the polygon is drawn.
+ @return a new path
+ */
 - (NSBezierPath*)calculatePath;
+
+/** @brief Discards the path and notifies the change, once the polygon parameters have been changed
+ @param oldBounds the bounds before the parameters changed
+ */
+- (void)polygonParametersDidChangeFromBounds:(NSRect)oldBounds;
+- (NSRect)pathBounds;
 - (void)movePart:(NSInteger)pc toPoint:(NSPoint)mp constrainAngle:(BOOL)constrain;
 
 /** @brief Returns the overall angle of the object
@@ -37,9 +50,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (sides != [self numberOfSides]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setNumberOfSides:[self numberOfSides]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mVertices = sides;
-		[self setPath:[self calculatePath]];
+		[self polygonParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Polygon Sides", @"undo string for change poly sides")];
 	}
 }
@@ -53,9 +67,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (rad != [self radius]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setRadius:[self radius]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mOuterRadius = rad;
-		[self setPath:[self calculatePath]];
+		[self polygonParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Polygon Radius", @"undo string for change poly radius")];
 	}
 }
@@ -69,9 +84,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (innerRad != [self innerRadius]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setInnerRadius:[self innerRadius]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mInnerRadius = innerRad;
-		[self setPath:[self calculatePath]];
+		[self polygonParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Polygon Inset", @"undo string for change poly inner radius")];
 	}
 }
@@ -85,9 +101,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (spread != [self tipSpread]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setTipSpread:[self tipSpread]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mTipSpread = spread;
-		[self setPath:[self calculatePath]];
+		[self polygonParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Polygon Outer Spread", @"undo string for change poly tip spread")];
 	}
 }
@@ -101,9 +118,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (spread != [self valleySpread]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setValleySpread:[self valleySpread]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mValleySpread = spread;
-		[self setPath:[self calculatePath]];
+		[self polygonParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Change Polygon Inner Spread", @"undo string for change poly valley spread")];
 	}
 }
@@ -207,6 +225,40 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 	return path;
 }
 
+- (void)polygonParametersDidChangeFromBounds:(NSRect)oldBounds
+{
+	mPathNeedsCalculating = YES;
+	[self setPathWithoutUndo:nil];
+
+	[self notifyVisualChange];
+	[self notifyGeometryChange:oldBounds];
+}
+
+- (NSRect)pathBounds
+{
+	// the bounds of the vertices, found from the parameters. Curved segments stay within their control points, which are
+	// no further from a vertex than the larger spread, so that much is added to be sure of enclosing them
+
+	NSInteger i;
+	NSPoint p = [self pointForPartcode:kDKRegularPolyFirstVertexPart];
+	CGFloat minX, maxX, minY, maxY;
+
+	minX = maxX = p.x;
+	minY = maxY = p.y;
+
+	for (i = 1; i < [self numberOfSides]; ++i) {
+		p = [self pointForPartcode:i + kDKRegularPolyFirstVertexPart];
+		minX = MIN(minX, p.x);
+		maxX = MAX(maxX, p.x);
+		minY = MIN(minY, p.y);
+		maxY = MAX(maxY, p.y);
+	}
+
+	CGFloat spread = [self radius] * MAX(fabs([self tipSpread]), fabs([self valleySpread]));
+
+	return NSInsetRect(NSMakeRect(minX, minY, maxX - minX, maxY - minY), -spread, -spread);
+}
+
 - (void)movePart:(NSInteger)pc toPoint:(NSPoint)mp constrainAngle:(BOOL)constrain
 {
 	CGFloat rad = hypotf(mp.x - mCentre.x, mp.y - mCentre.y);
@@ -353,6 +405,28 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 #pragma mark -
 #pragma mark - as a DKDrawablePath
 
+- (void)setPath:(NSBezierPath*)path
+{
+	mPathNeedsCalculating = NO;
+	[super setPath:path];
+}
+
+- (NSBezierPath*)path
+{
+	if (mPathNeedsCalculating) {
+		mPathNeedsCalculating = NO;
+		[self setPathWithoutUndo:[self calculatePath]];
+	}
+
+	return [super path];
+}
+
+- (DKPathGeometry*)pathGeometry
+{
+	[self path];
+	return [super pathGeometry];
+}
+
 /** @brief Draws the selection knobs as required
  @param path not used
  @param knobs the knobs object to use for drawing
@@ -624,9 +698,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (!NSEqualPoints(p, [self location]) && ![self locked] && ![self locationLocked]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setLocation:[self location]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mCentre = p;
-		[self setPath:[self calculatePath]];
+		[self polygonParametersDidChangeFromBounds:oldBounds];
 	}
 }
 
@@ -637,7 +712,9 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
  */
 - (NSRect)bounds
 {
-	NSRect pb = [[self path] bounds];
+	// found from the parameters, so that the path needn't be made to find out where it is
+
+	NSRect pb = [self pathBounds];
 	NSRect kr;
 
 	CGFloat tol = [[[self layer] knobs] controlKnobSize].width * 0.71f;
@@ -656,9 +733,10 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 {
 	if (angle != [self angle]) {
 		[[[self undoManager] prepareWithInvocationTarget:self] setAngle:[self angle]];
+		NSRect oldBounds = [self bounds];
 		[self notifyVisualChange];
 		mAngle = angle;
-		[self setPath:[self calculatePath]];
+		[self polygonParametersDidChangeFromBounds:oldBounds];
 		[[self undoManager] setActionName:NSLocalizedString(@"Rotate Polygon", @"undo string for rotate regular poly")];
 	}
 }
@@ -757,6 +835,28 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 	mCentre = [transform transformPoint:mCentre];
 }
 
+- (DKGeometrySnapshot*)geometrySnapshot
+{
+	// the path is derived from the parameters, but its geometry is kept as well so that it needn't be recalculated on restoring
+
+	CGFloat values[5] = { mCentre.x, mCentre.y, mOuterRadius, mInnerRadius, mAngle };
+
+	return [DKGeometrySnapshot snapshotWithPath:nil
+										 object:[self pathGeometry]
+										 values:values
+										  count:5];
+}
+
+- (void)restoreGeometrySnapshot:(DKGeometrySnapshot*)snapshot
+{
+	mPathNeedsCalculating = NO;
+	mCentre = NSMakePoint([snapshot valueAtIndex:0], [snapshot valueAtIndex:1]);
+	mOuterRadius = [snapshot valueAtIndex:2];
+	mInnerRadius = [snapshot valueAtIndex:3];
+	mAngle = [snapshot valueAtIndex:4];
+	[super restoreGeometrySnapshot:snapshot];
+}
+
 #pragma mark -
 #pragma mark - as a NSObject
 
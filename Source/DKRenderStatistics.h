@@ -0,0 +1,114 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+typedef enum {
+	kDKRenderEventViewDraw = 0, // a DKDrawingView's drawRect:
+	kDKRenderEventLayerDraw = 1, // a layer's drawRect:inView:, as called by its group
+	kDKRenderEventObjectEnumeration = 2, // an object owner layer drawing its objects; count is drawn, skipped is culled
+	kDKRenderEventRasterizerRender = 3, // a rasterizer's render:, as called by its group or style
+	kDKRenderEventCacheLookup = 4, // a rendering cache lookup; count is 1 for a hit, skipped is 1 for a miss. Not timed
+	kDKRenderEventKindCount = 5
+} DKRenderEventKind;
+
+/** @brief One recorded event
+ */
+typedef struct {
+	uint64_t sequence; // 1 for the first event recorded, and so on
+	DKRenderEventKind kind;
+	Class subjectClass; // the class of the view, layer, rasterizer or cache
+	uintptr_t subject; // its address, to tell instances apart. It may have been deallocated since
+	uint64_t startTime; // mach_absolute_time() at the start
+	uint64_t duration; // in nanoseconds
+	NSUInteger count;
+	NSUInteger skipped;
+} DKRenderEvent;
+
+/** @brief Records where the time goes while drawings are drawn.
+
+ Records where the time goes while drawings are drawn. When enabled, each view update, each layer drawn, each layer's drawing of its objects,
+ each rasterizer's rendering of an object and each lookup in the tile, rendered image and group caches is recorded as an event. Events go
+ into a fixed ring buffer holding the most recent kDKRenderStatisticsBufferSize of them, which any thread may record into without a lock,
+ and running totals are kept for each kind of event. A reader - such as telemetry sampling a slow document - can collect the events
+ recorded since it last looked with -eventsSinceSequence:count:, or get the totals and a per-class summary of the buffered events.
+
+ Where the system supports it, the timed events can also be emitted as os_signpost intervals, so they show up in Instruments.
+
+ Recording is off by default, and costs a single test of a flag at each site when off.
+*/
+@interface DKRenderStatistics : NSObject
+
+/** @brief Sets whether render events are recorded
+ @param enable YES to record events
+ */
++ (void)setEnabled:(BOOL)enable;
++ (BOOL)isEnabled;
+
+/** @brief Sets whether timed events are also emitted as os_signpost intervals, when they are recorded
+
+ Has no effect where os_signpost isn't available.
+ @param emit YES to emit signposts
+ */
++ (void)setEmitsSignposts:(BOOL)emit;
++ (BOOL)emitsSignposts;
+
+/** @brief The sequence number of the latest event recorded, or 0 if none has been
+ */
++ (uint64_t)latestSequence;
+
+/** @brief Copies the buffered events recorded after a given one, oldest first
+
+ Events that have already been overwritten in the buffer are skipped, as are any being written at the moment.
+ @param sequence the sequence number of the last event already seen, or 0
+ @param events receives the events
+ @param maxCount the size of <events>
+ @return the number of events copied
+ */
++ (NSUInteger)eventsSinceSequence:(uint64_t)sequence into:(DKRenderEvent*)events maxCount:(NSUInteger)maxCount;
+
+/** @brief The running totals for each kind of event since recording began or was reset
+
+ Keyed by the kind's name (e.g. @"layerDraw"), each value is a dictionary with the number of events (@"calls"), their total time in
+ seconds (@"time"), and the sums of their counts (@"count") and skipped counts (@"skipped").
+ @return the totals
+ */
++ (NSDictionary*)totals;
+
+/** @brief Summarises the buffered events by kind and class
+
+ Keyed by the kind's name, each value is a dictionary keyed by class name, holding dictionaries as for -totals.
+ @return the summary
+ */
++ (NSDictionary*)summaryOfBufferedEvents;
+
+/** @brief Discards the buffered events and the totals
+ */
++ (void)reset;
+
+@end
+
+/** @brief Notes the start of a timed event
+ @param kind the kind of event
+ @param subject the object doing the work
+ @return a token to pass to DKRenderIntervalEnd, or 0 if recording is off */
+uint64_t DKRenderIntervalBegin(DKRenderEventKind kind, id subject);
+
+/** @brief Records a timed event started by DKRenderIntervalBegin
+
+ Does nothing if <start> is 0, so calls need not test whether recording is on.
+ @param kind the kind of event
+ @param subject the object doing the work
+ @param start the token returned by DKRenderIntervalBegin
+ @param count, skipped counts for the event, as described for its kind */
+void DKRenderIntervalEnd(DKRenderEventKind kind, id subject, uint64_t start, NSUInteger count, NSUInteger skipped);
+
+/** @brief Records a lookup in a rendering cache
+ @param cache the cache
+ @param hit YES if the lookup found what it wanted */
+void DKRenderRecordCacheLookup(id cache, BOOL hit);
+
+#define kDKRenderStatisticsBufferSize 4096 // must be a power of two
@@ -0,0 +1,343 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKRenderStatistics.h"
+#import <libkern/OSAtomic.h>
+#import <mach/mach_time.h>
+#import <objc/runtime.h>
+
+#if defined(__has_include)
+#if __has_include(<os/signpost.h>)
+#import <os/signpost.h>
+#define DK_RENDER_SIGNPOSTS 1
+#endif
+#endif
+
+typedef struct {
+	volatile int64_t calls;
+	volatile int64_t time; // in nanoseconds
+	volatile int64_t count;
+	volatile int64_t skipped;
+} DKRenderTotals;
+
+static volatile BOOL sEnabled = NO;
+static volatile BOOL sEmitsSignposts = NO;
+static DKRenderEvent sEvents[kDKRenderStatisticsBufferSize];
+static volatile int64_t sLatestSequence = 0;
+static DKRenderTotals sTotals[kDKRenderEventKindCount];
+static mach_timebase_info_data_t sTimebase;
+
+static NSString* const sKindNames[kDKRenderEventKindCount] = { @"viewDraw", @"layerDraw", @"objectEnumeration", @"rasterizerRender", @"cacheLookup" };
+
+static void recordEvent(DKRenderEventKind kind, id subject, uint64_t start, uint64_t duration, NSUInteger count, NSUInteger skipped);
+static uint64_t nanosecondsFromAbsolute(uint64_t t);
+static void emitSignpost(DKRenderEventKind kind, id subject, BOOL begin);
+static NSMutableDictionary* totalsDictionary(int64_t calls, int64_t time, int64_t count, int64_t skipped);
+
+#pragma mark -
+
+@implementation DKRenderStatistics
+
++ (void)setEnabled:(BOOL)enable
+{
+	if (sTimebase.denom == 0)
+		mach_timebase_info(&sTimebase);
+
+	sEnabled = enable;
+}
+
++ (BOOL)isEnabled
+{
+	return sEnabled;
+}
+
++ (void)setEmitsSignposts:(BOOL)emit
+{
+	sEmitsSignposts = emit;
+}
+
++ (BOOL)emitsSignposts
+{
+	return sEmitsSignposts;
+}
+
++ (uint64_t)latestSequence
+{
+	OSMemoryBarrier();
+	return (uint64_t)sLatestSequence;
+}
+
++ (NSUInteger)eventsSinceSequence:(uint64_t)sequence into:(DKRenderEvent*)events maxCount:(NSUInteger)maxCount
+{
+	uint64_t latest = [self latestSequence];
+	uint64_t seq = sequence + 1;
+	NSUInteger copied = 0;
+	DKRenderEvent* slot;
+
+	// only the last buffer-full are still there
+
+	if (latest >= kDKRenderStatisticsBufferSize && seq <= latest - kDKRenderStatisticsBufferSize)
+		seq = latest - kDKRenderStatisticsBufferSize + 1;
+
+	for (; seq <= latest && copied < maxCount; ++seq) {
+		slot = &sEvents[(seq - 1) & (kDKRenderStatisticsBufferSize - 1)];
+
+		// the writer clears the sequence before it writes the slot and sets it after, so a copy made between two reads of the
+		// expected sequence is whole
+
+		if (slot->sequence != seq)
+			continue;
+
+		OSMemoryBarrier();
+		events[copied] = *slot;
+		OSMemoryBarrier();
+
+		if (slot->sequence == seq && events[copied].sequence == seq)
+			++copied;
+	}
+
+	return copied;
+}
+
++ (NSDictionary*)totals
+{
+	NSMutableDictionary* totals = [NSMutableDictionary dictionary];
+	NSInteger k;
+
+	for (k = 0; k < kDKRenderEventKindCount; ++k) {
+		[totals setObject:totalsDictionary(sTotals[k].calls, sTotals[k].time, sTotals[k].count, sTotals[k].skipped)
+				   forKey:sKindNames[k]];
+	}
+
+	return totals;
+}
+
++ (NSDictionary*)summaryOfBufferedEvents
+{
+	DKRenderEvent* events = malloc(sizeof(DKRenderEvent) * kDKRenderStatisticsBufferSize);
+	NSUInteger i, n = [self eventsSinceSequence:0
+										   into:events
+									   maxCount:kDKRenderStatisticsBufferSize];
+	DKRenderTotals* perKind[kDKRenderEventKindCount];
+	CFMutableDictionaryRef classes[kDKRenderEventKindCount]; // class -> index into perKind
+	NSUInteger used[kDKRenderEventKindCount];
+	NSInteger k, index;
+
+	for (k = 0; k < kDKRenderEventKindCount; ++k) {
+		perKind[k] = calloc(MAX(n, 1U), sizeof(DKRenderTotals));
+		classes[k] = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, NULL);
+		used[k] = 0;
+	}
+
+	for (i = 0; i < n; ++i) {
+		k = events[i].kind;
+
+		if (k < 0 || k >= kDKRenderEventKindCount)
+			continue;
+
+		if (CFDictionaryGetValueIfPresent(classes[k], events[i].subjectClass, (const void**)&index))
+			--index; // stored 1-based, so that 0 isn't confused with a missing entry
+		else {
+			index = used[k]++;
+			CFDictionarySetValue(classes[k], events[i].subjectClass, (const void*)(index + 1));
+		}
+
+		perKind[k][index].calls++;
+		perKind[k][index].time += events[i].duration;
+		perKind[k][index].count += events[i].count;
+		perKind[k][index].skipped += events[i].skipped;
+	}
+
+	NSMutableDictionary* summary = [NSMutableDictionary dictionary];
+	NSMutableDictionary* byClass;
+	CFIndex c, count;
+	const void** keys;
+	const void** values;
+
+	for (k = 0; k < kDKRenderEventKindCount; ++k) {
+		byClass = [NSMutableDictionary dictionary];
+		count = CFDictionaryGetCount(classes[k]);
+		keys = malloc(sizeof(void*) * MAX(count, 1));
+		values = malloc(sizeof(void*) * MAX(count, 1));
+
+		CFDictionaryGetKeysAndValues(classes[k], keys, values);
+
+		for (c = 0; c < count; ++c) {
+			DKRenderTotals* t = &perKind[k][(NSInteger)values[c] - 1];
+			NSString* name = keys[c] ? NSStringFromClass((Class)keys[c]) : @"(none)";
+
+			[byClass setObject:totalsDictionary(t->calls, t->time, t->count, t->skipped)
+						forKey:name];
+		}
+
+		[summary setObject:byClass
+					forKey:sKindNames[k]];
+
+		free(keys);
+		free(values);
+		free(perKind[k]);
+		CFRelease(classes[k]);
+	}
+
+	free(events);
+	return summary;
+}
+
++ (void)reset
+{
+	// events being recorded at the same moment may survive the reset, which doesn't matter for statistics
+
+	memset(sTotals, 0, sizeof(sTotals));
+	memset(sEvents, 0, sizeof(sEvents));
+	OSMemoryBarrier();
+}
+
+@end
+
+#pragma mark -
+#pragma mark - recording
+
+uint64_t DKRenderIntervalBegin(DKRenderEventKind kind, id subject)
+{
+	if (!sEnabled)
+		return 0;
+
+	if (sEmitsSignposts)
+		emitSignpost(kind, subject, YES);
+
+	uint64_t t = mach_absolute_time();
+
+	return (t == 0) ? 1 : t;
+}
+
+void DKRenderIntervalEnd(DKRenderEventKind kind, id subject, uint64_t start, NSUInteger count, NSUInteger skipped)
+{
+	if (start == 0)
+		return;
+
+	uint64_t end = mach_absolute_time();
+
+	if (sEmitsSignposts)
+		emitSignpost(kind, subject, NO);
+
+	recordEvent(kind, subject, start, nanosecondsFromAbsolute(end - start), count, skipped);
+}
+
+void DKRenderRecordCacheLookup(id cache, BOOL hit)
+{
+	if (sEnabled)
+		recordEvent(kDKRenderEventCacheLookup, cache, mach_absolute_time(), 0, hit ? 1 : 0, hit ? 0 : 1);
+}
+
+static void recordEvent(DKRenderEventKind kind, id subject, uint64_t start, uint64_t duration, NSUInteger count, NSUInteger skipped)
+{
+	// claiming the next sequence number claims the slot, so writers never share one unless the buffer laps during a write, which at
+	// worst makes a reader skip the event
+
+	uint64_t seq = (uint64_t)OSAtomicIncrement64Barrier(&sLatestSequence);
+	DKRenderEvent* slot = &sEvents[(seq - 1) & (kDKRenderStatisticsBufferSize - 1)];
+
+	slot->sequence = 0;
+	OSMemoryBarrier();
+
+	slot->kind = kind;
+	slot->subjectClass = subject ? object_getClass(subject) : Nil;
+	slot->subject = (uintptr_t)subject;
+	slot->startTime = start;
+	slot->duration = duration;
+	slot->count = count;
+	slot->skipped = skipped;
+
+	OSMemoryBarrier();
+	slot->sequence = seq;
+
+	OSAtomicIncrement64(&sTotals[kind].calls);
+	OSAtomicAdd64((int64_t)duration, &sTotals[kind].time);
+	OSAtomicAdd64((int64_t)count, &sTotals[kind].count);
+	OSAtomicAdd64((int64_t)skipped, &sTotals[kind].skipped);
+}
+
+static uint64_t nanosecondsFromAbsolute(uint64_t t)
+{
+	if (sTimebase.denom == 0)
+		mach_timebase_info(&sTimebase);
+
+	return t * sTimebase.numer / sTimebase.denom;
+}
+
+static NSMutableDictionary* totalsDictionary(int64_t calls, int64_t time, int64_t count, int64_t skipped)
+{
+	return [NSMutableDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithLongLong:calls], @"calls",
+									[NSNumber numberWithDouble:(double)time / 1.0e9], @"time",
+									[NSNumber numberWithLongLong:count], @"count",
+									[NSNumber numberWithLongLong:skipped], @"skipped", nil];
+}
+
+#ifdef DK_RENDER_SIGNPOSTS
+
+static os_log_t sSignpostLog = NULL;
+
+static void makeSignpostLog(void* context)
+{
+#pragma unused(context)
+
+	sSignpostLog = os_log_create("com.drawkit.render", "Rendering");
+}
+
+static void emitSignpost(DKRenderEventKind kind, id subject, BOOL begin)
+{
+	// signpost names must be literals, hence the switch
+
+	if (@available(macOS 10.14, *)) {
+		static dispatch_once_t once;
+		dispatch_once_f(&once, NULL, makeSignpostLog);
+
+		os_signpost_id_t sid = os_signpost_id_make_with_pointer(sSignpostLog, subject);
+		const char* className = subject ? class_getName(object_getClass(subject)) : "";
+
+		switch (kind) {
+		case kDKRenderEventViewDraw:
+			if (begin)
+				os_signpost_interval_begin(sSignpostLog, sid, "ViewDraw", "%{public}s", className);
+			else
+				os_signpost_interval_end(sSignpostLog, sid, "ViewDraw");
+			break;
+
+		case kDKRenderEventLayerDraw:
+			if (begin)
+				os_signpost_interval_begin(sSignpostLog, sid, "LayerDraw", "%{public}s", className);
+			else
+				os_signpost_interval_end(sSignpostLog, sid, "LayerDraw");
+			break;
+
+		case kDKRenderEventObjectEnumeration:
+			if (begin)
+				os_signpost_interval_begin(sSignpostLog, sid, "ObjectEnumeration", "%{public}s", className);
+			else
+				os_signpost_interval_end(sSignpostLog, sid, "ObjectEnumeration");
+			break;
+
+		case kDKRenderEventRasterizerRender:
+			if (begin)
+				os_signpost_interval_begin(sSignpostLog, sid, "RasterizerRender", "%{public}s", className);
+			else
+				os_signpost_interval_end(sSignpostLog, sid, "RasterizerRender");
+			break;
+
+		default:
+			break;
+		}
+	}
+}
+
+#else
+
+static void emitSignpost(DKRenderEventKind kind, id subject, BOOL begin)
+{
+#pragma unused(kind, subject, begin)
+}
+
+#endif
@@ -0,0 +1,67 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKCacheRegistry.h"
+
+@class DKDrawableObject;
+
+/** @brief Caches rasterized images of individual drawable objects at the current view scale, within a drawing-wide memory budget.
+
+ Caches rasterized images of individual drawable objects at the current view scale, within a drawing-wide memory budget. Objects whose styles are
+ expensive to render (hatching, fill patterns, roughened strokes and so on) can be drawn by blitting the cached image instead of running the full
+ style rendering on every redraw.
+
+ Each cached image records the object's geometry checksum, bounds, the modification timestamp of its style and the scale it was rendered at. If
+ any of these differ when the object is next drawn, the image is re-rendered. Objects also remove their image whenever their rendering cache is
+ invalidated. When the total size of the cached images exceeds the byte budget, the least recently drawn images are discarded.
+
+ The cache is owned by the drawing, and is only created if the drawing's setCachesRenderedObjectImages: is set to YES.
+*/
+@interface DKRenderedImageCache : NSObject <DKPurgeableCache> {
+@private
+	CFMutableDictionaryRef mEntries; // object (unretained) -> cache entry
+	NSUInteger mByteBudget;
+	NSUInteger mBytesUsed;
+	NSUInteger mUseCounter;
+	NSUInteger mHits;
+	NSUInteger mMisses;
+}
+
+- (id)initWithByteBudget:(NSUInteger)budget;
+
+/** @brief Draws the object using its cached image, rendering and caching the image first if necessary
+
+ The image covers the object's bounds and is rendered at <scale>, so it is pixel-for-pixel the same as drawing the object directly into a view at
+ that scale. Objects whose image would take up more than a quarter of the budget are not cached.
+ @param obj the object to draw
+ @param scale the scale of the view being drawn
+ @return YES if the object was drawn, NO if it can't be cached, in which case the caller should draw it directly
+ */
+- (BOOL)drawObject:(DKDrawableObject*)obj atScale:(CGFloat)scale;
+
+/** @brief Discards the cached image of an object, if there is one
+ @param obj the object
+ */
+- (void)removeImageForObject:(DKDrawableObject*)obj;
+- (void)removeAllImages;
+
+/** @brief The maximum total size of the cached images, in bytes
+
+ Setting a smaller budget discards images immediately until the cache fits.
+ */
+- (NSUInteger)byteBudget;
+- (void)setByteBudget:(NSUInteger)budget;
+- (NSUInteger)bytesUsed;
+- (NSUInteger)imageCount;
+
+- (NSUInteger)hits;
+- (NSUInteger)misses;
+- (void)resetStatistics;
+
+@end
+
+#define kDKRenderedImageCacheDefaultBudget (32 * 1024 * 1024)
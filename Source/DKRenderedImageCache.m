@@ -0,0 +1,258 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKRenderedImageCache.h"
+#import "DKDrawableObject.h"
+#import "DKStyle.h"
+#import "DKQuartzCache.h"
+#import "DKRenderStatistics.h"
+#import "LogEvent.h"
+
+/// a single cached object image
+
+@interface DKRenderedImage : NSObject {
+@public
+	DKQuartzCache* mCache;
+	const void* mObject; // unretained key
+	NSUInteger mChecksum;
+	NSTimeInterval mStyleTimestamp;
+	CGFloat mScale;
+	NSRect mBounds;
+	NSUInteger mBytes;
+	NSUInteger mLastUse;
+}
+
+@end
+
+@implementation DKRenderedImage
+
+- (void)dealloc
+{
+	[mCache release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+static NSInteger compareLastUse(id a, id b, void* context)
+{
+#pragma unused(context)
+	NSUInteger ua = ((DKRenderedImage*)a)->mLastUse;
+	NSUInteger ub = ((DKRenderedImage*)b)->mLastUse;
+
+	if (ua < ub)
+		return NSOrderedAscending;
+	else if (ua > ub)
+		return NSOrderedDescending;
+	else
+		return NSOrderedSame;
+}
+
+@interface DKRenderedImageCache (Private)
+
+- (void)removeEntryForKey:(const void*)key;
+- (void)evictToBudget:(NSUInteger)budget;
+
+@end
+
+#pragma mark -
+
+@implementation DKRenderedImageCache
+
+- (id)initWithByteBudget:(NSUInteger)budget
+{
+	self = [super init];
+	if (self) {
+		// keys are not retained - objects remove their own entries when they are invalidated or removed from the drawing
+
+		mEntries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+		mByteBudget = budget;
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeRenderedImages];
+	}
+
+	return self;
+}
+
+- (BOOL)drawObject:(DKDrawableObject*)obj atScale:(CGFloat)scale
+{
+	NSRect br = [obj bounds];
+
+	if (NSIsEmptyRect(br) || scale <= 0)
+		return NO;
+
+	NSUInteger pixelsWide = (NSUInteger)ceil(NSWidth(br) * scale);
+	NSUInteger pixelsHigh = (NSUInteger)ceil(NSHeight(br) * scale);
+	NSUInteger bytes = pixelsWide * pixelsHigh * 4;
+
+	if (bytes == 0 || bytes > mByteBudget / 4)
+		return NO;
+
+	NSUInteger checksum = [obj geometryChecksum];
+	NSTimeInterval timestamp = [[obj style] lastModificationTimestamp];
+	DKRenderedImage* entry = (DKRenderedImage*)CFDictionaryGetValue(mEntries, obj);
+
+	if (entry == nil || entry->mChecksum != checksum || entry->mStyleTimestamp != timestamp || entry->mScale != scale || !NSEqualRects(entry->mBounds, br)) {
+		[self removeEntryForKey:obj];
+
+		if (mBytesUsed + bytes > mByteBudget)
+			[self evictToBudget:mByteBudget - bytes];
+
+		entry = [[DKRenderedImage alloc] init];
+		entry->mCache = [[DKQuartzCache alloc] initWithContext:[NSGraphicsContext currentContext]
+													   forRect:NSMakeRect(0, 0, pixelsWide, pixelsHigh)];
+		entry->mObject = obj;
+		entry->mChecksum = checksum;
+		entry->mStyleTimestamp = timestamp;
+		entry->mScale = scale;
+		entry->mBounds = br;
+		entry->mBytes = bytes;
+
+		[entry->mCache lockFocus];
+
+		NSAffineTransform* transform = [NSAffineTransform transform];
+		[transform scaleBy:scale];
+		[transform translateXBy:-NSMinX(br)
+							yBy:-NSMinY(br)];
+		[transform concat];
+
+		[obj drawContent];
+		[entry->mCache unlockFocus];
+
+		CFDictionarySetValue(mEntries, obj, entry);
+		[entry release];
+
+		mBytesUsed += bytes;
+		++mMisses;
+		DKRenderRecordCacheLookup(self, NO);
+	} else {
+		++mHits;
+		DKRenderRecordCacheLookup(self, YES);
+	}
+
+	entry->mLastUse = ++mUseCounter;
+	[entry->mCache drawInRect:br];
+
+	return YES;
+}
+
+- (void)removeImageForObject:(DKDrawableObject*)obj
+{
+	[self removeEntryForKey:obj];
+}
+
+- (void)removeAllImages
+{
+	CFDictionaryRemoveAllValues(mEntries);
+	mBytesUsed = 0;
+}
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	NSUInteger bytes = mBytesUsed;
+
+	[self removeAllImages];
+	return bytes;
+}
+
+- (NSUInteger)byteBudget
+{
+	return mByteBudget;
+}
+
+- (void)setByteBudget:(NSUInteger)budget
+{
+	mByteBudget = budget;
+
+	if (mBytesUsed > mByteBudget)
+		[self evictToBudget:mByteBudget];
+}
+
+- (NSUInteger)bytesUsed
+{
+	return mBytesUsed;
+}
+
+- (NSUInteger)imageCount
+{
+	return (NSUInteger)CFDictionaryGetCount(mEntries);
+}
+
+- (NSUInteger)hits
+{
+	return mHits;
+}
+
+- (NSUInteger)misses
+{
+	return mMisses;
+}
+
+- (void)resetStatistics
+{
+	mHits = mMisses = 0;
+}
+
+#pragma mark -
+
+- (void)removeEntryForKey:(const void*)key
+{
+	DKRenderedImage* entry = (DKRenderedImage*)CFDictionaryGetValue(mEntries, key);
+
+	if (entry) {
+		mBytesUsed -= entry->mBytes;
+		CFDictionaryRemoveValue(mEntries, key);
+	}
+}
+
+- (void)evictToBudget:(NSUInteger)budget
+{
+	// sort the entries oldest first and discard them until the cache fits. Eviction is relatively rare, so sorting here is cheaper than
+	// maintaining an ordered list on every draw.
+
+	CFIndex count = CFDictionaryGetCount(mEntries);
+
+	if (count == 0)
+		return;
+
+	const void** values = malloc(count * sizeof(void*));
+
+	CFDictionaryGetKeysAndValues(mEntries, NULL, values);
+
+	NSMutableArray* entries = [NSMutableArray arrayWithObjects:(id*)values
+														 count:count];
+	free(values);
+
+	[entries sortUsingFunction:compareLastUse
+					   context:NULL];
+
+	NSEnumerator* iter = [entries objectEnumerator];
+	DKRenderedImage* entry;
+
+	while (mBytesUsed > budget && (entry = [iter nextObject]))
+		[self removeEntryForKey:entry->mObject];
+
+	LogEvent_(kInfoEvent, @"rendered image cache evicted down to %lu bytes", (unsigned long)mBytesUsed);
+}
+
+#pragma mark -
+#pragma mark - as a NSObject
+
+- (id)init
+{
+	return [self initWithByteBudget:kDKRenderedImageCacheDefaultBudget];
+}
+
+- (void)dealloc
+{
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
+	CFRelease(mEntries);
+	[super dealloc];
+}
+
+@end
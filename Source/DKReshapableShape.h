@@ -10,7 +10,9 @@
 
 This subclass of DKDrawableShape implements a protocol for obtaining shapes dynamically from a shape provider. When
 the user changes the shape's size, the shape provider is given the opportunity to supply a new path to fit the
-shape's new size. This path is then automatically inversely transformed and stored as the shape's path.
+shape's new size. This path is then automatically inversely transformed and stored as the shape's path. The provider is only
+asked again when something that defines the path changes - the shape's width or height, the provider, its selector or the optional
+parameter - so flipping the shape or setting an equal parameter leaves the path alone.
 
 The shape provider must return a bezier path to fit a rectangle that it is passed. This path is inversely transformed
 to the internal path.
@@ -33,6 +35,8 @@ be added to DKShapeFactory rather than having to make lots of individual subclas
 	SEL m_shapeSelector;
 	id m_shapeProvider;
 	id m_optionalParam;
+	NSSize mReshapedSize; // the size the current path was provided for
+	BOOL mPathIsProvided; // YES if the current path was obtained from the provider for mReshapedSize
 }
 
 - (void)setShapeProvider:(id)provider selector:(SEL)selector;
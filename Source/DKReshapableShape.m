@@ -17,6 +17,7 @@
 	[m_shapeProvider release];
 	m_shapeProvider = provider;
 	m_shapeSelector = selector;
+	mPathIsProvided = NO;
 
 	//LogEvent_(kReactiveEvent, @"selector = '%@'", [NSString stringWithCString:sel_getName( selector )]);
 }
@@ -39,13 +40,18 @@
 	// Typically it would be an NSNumber or a dictionary of multiple parameters.
 
 	if (objParam != m_optionalParam) {
+		BOOL changed = ![objParam isEqual:m_optionalParam];
+
 		[objParam retain];
 		[m_optionalParam release];
 		m_optionalParam = objParam;
 
 		// allow a change of param to force an update of the shape:
 
-		[self reshapePath];
+		if (changed) {
+			mPathIsProvided = NO;
+			[self reshapePath];
+		}
 	}
 }
 
@@ -103,6 +109,11 @@
 
 		r = NormalizedRect(r);
 
+		// the path only depends on the size, so if that hasn't changed since it was last provided there's nothing to do
+
+		if (mPathIsProvided && NSEqualSizes(r.size, mReshapedSize))
+			return;
+
 		// ask provider for the path.
 
 		NSBezierPath* p = [self providedShapeForRect:r];
@@ -128,6 +139,11 @@
 				[p transformUsingAffineTransform:tfm];
 
 				[self setPath:p];
+
+				mReshapedSize = [self size];
+				mReshapedSize.width = ABS(mReshapedSize.width);
+				mReshapedSize.height = ABS(mReshapedSize.height);
+				mPathIsProvided = YES;
 			}
 			[p release];
 		}
@@ -15,7 +15,8 @@ The nominal width, colour, etc are all inherited from DKStroke. <roughness> is t
 
 Because a roughened path is both fairly complicated to compute and has a lot of randomness that is different every time, this object caches the roughened
 paths it generates and re-uses them as much as it can. A path is cached based on its bounds, width and length, giving a key that is likely to be unique in practice.
-Paths are cached up to the maximum number set by the constant, after which least used cached paths are discarded.
+Paths are cached up to the maximum number set by the constant, after which least used cached paths are discarded. The path used for each object is also
+kept in that object's rendering cache, so it doesn't change from one render to the next until the object or the stroke does.
 */
 @interface DKRoughStroke : DKStroke <NSCoding, NSCopying> {
 @private
@@ -49,9 +49,14 @@
 	NSRect pb = [path bounds];
 
 	if (cp == nil) {
-		// not in the cache, so create it from scratch
+		// not in the cache, so create it from scratch. The roughening is seeded from the stroke and the path's key, so a path
+		// dropped from the cache is roughened the same way when it's made again
 
-		cp = [path bezierPathWithRoughenedStrokeOutline:[self roughness] * [self width]];
+		DKRandomState rs;
+
+		DKRandomSeed(&rs, DKRandomSeedForObject(self) ^ (uint64_t)[key hash]);
+		cp = [path bezierPathWithRoughenedStrokeOutline:[self roughness] * [self width]
+											randomState:&rs];
 
 		if (cp != nil) {
 			// set its origin to 0,0 based on the original path
@@ -124,6 +129,36 @@
 	[pc fill];
 }
 
+- (void)renderPath:(NSBezierPath*)path forObject:(id<DKRenderable>)object
+{
+	// the roughened path for this object is kept in its rendering cache so that it stays the same from one render to the next
+	// until the object is edited, without needing to work out its key in the shared cache each time.
+
+	NSBezierPath* pc = [self cachedPathForObject:object
+									  sourcePath:path];
+
+	if (pc == nil) {
+		// roughening uses the path's stroke attributes, so apply them to a copy rather than to the object's path
+
+		NSBezierPath* temp = [path copy];
+		[self applyAttributesToPath:temp];
+		pc = [self roughPathFromPath:temp];
+		[temp release];
+
+		[self setCachedPath:pc
+				  forObject:object
+				 sourcePath:path];
+	}
+
+	[[self colour] setFill];
+	[pc fill];
+}
+
+- (NSUInteger)renderingCacheParameters
+{
+	return DKRasterizerChecksumCombine([super renderingCacheParameters], [self roughness]);
+}
+
 - (NSSize)extraSpaceNeeded
 {
 	NSSize es = [super extraSpaceNeeded];
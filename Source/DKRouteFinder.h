@@ -8,7 +8,8 @@
 
 typedef enum {
 	kDKUseSimulatedAnnealing = 1,
-	kDKUseNearestNeighbour = 2
+	kDKUseNearestNeighbour = 2,
+	kDKUseImprovedNearestNeighbour = 4
 } DKRouteAlgorithmType;
 
 typedef enum {
@@ -22,12 +23,17 @@ typedef enum {
 /** @brief This object implements an heuristic solution to the travelling salesman problem.
 
 This object implements an heuristic solution to the travelling salesman problem. The algorithm is based on simulated annealing
-and is due to "Numerical Recipes in C", Chapter 10.
+and is due to "Numerical Recipes in C", Chapter 10. Several annealing chains are run at once, one per processor, each from a different
+starting order, and the shortest of their routes is kept. The progress delegate is called on the thread that asked for the route.
 
 To use, initialise with an array of NSValues containing NSPoints. Then request the shortestRoute. The order of points returned by -shortestRoute
 will be the shortest route as determined by the algorithm. The first point object in both input and output arrays is the same - in other words
 the zeroth element of the input array sets the starting point of the path.
 
+The improved nearest neighbour algorithm is much faster than annealing for large numbers of points, such as the points of a toolpath,
+and finds routes at least as short. It builds a route by nearest neighbour using a k-d tree, then improves it with 2-opt and Or-opt
+moves, considering for each point only its closest neighbours. Its route starts at the first point and needn't return to it.
+
 For uses with other object types, the -shortestRouteOrder might be more useful. This returns an array of integers which is the order of the
 objects. This can then be used to reorder arbitrary objects.
 
@@ -45,6 +51,7 @@ resolves to an NSPoint return value, and is given by <key>. The result is a new
 	CGFloat* mX; // for SA, list of input x coordinates
 	CGFloat* mY; // for SA, list of input y coordinates
 	NSInteger mAnnealingSteps; // for SA, the number of steps in the outer loop
+	volatile BOOL mCancelled; // for SA, set to stop the annealing early
 	CGFloat mPathLength; // the path length
 	// for NN
 	NSMutableArray* mVisited; // for NN, the list of visited points in visit order
@@ -62,11 +69,20 @@ resolves to an NSPoint return value, and is given by <key>. The result is a new
 - (CGFloat)pathLength;
 - (DKRouteAlgorithmType)algorithm;
 
+/** @brief Stops annealing early, keeping the shortest route found so far
+
+ May be called from any thread, including from the progress delegate. Has no effect on the other algorithms.
+ */
+- (void)cancel;
+- (BOOL)isCancelled;
+
 - (void)setProgressDelegate:(id)aDelegate;
 
 @end
 
 #define kDKDefaultAnnealingSteps 100
+#define kDKMaximumAnnealingStarts 16 // for SA, the most independent chains run, one per processor
+#define kDKRouteNeighbourCount 8 // for the improved NN algorithm, the number of closest neighbours of each point tried by its moves
 
 // informal protocol that an object can implement to be called back as the route finding progresses.
 // <value> is in the range 0..1
@@ -5,10 +5,32 @@
 */
 
 #import "DKRouteFinder.h"
-
-static CGFloat anneal(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NSInteger annealingSteps, const void* context);
-static void progressCallback(CGFloat iteration, CGFloat maxIterations, const void* context);
+#import "DKRandom.h"
+
+// one annealing chain. <iorder> and <jorder> are its own, 1-based; <x> and <y> are shared and only read
+
+typedef struct {
+	CGFloat* x;
+	CGFloat* y;
+	NSInteger* iorder;
+	NSInteger* jorder; // work space for trnspt
+	NSInteger ncity;
+	NSInteger annealingSteps;
+	DKRandomState random; // each chain has its own, so chains can run at the same time and give the same results on any thread
+	unsigned long iseed;
+	volatile BOOL* cancelled;
+	volatile CGFloat progress;
+	CGFloat path;
+} DKAnnealRun;
+
+#define kDKAnnealingProgressInterval (NSEC_PER_SEC / 20)
+
+static CGFloat anneal(DKAnnealRun* run);
+static void shuffleOrder(NSInteger iorder[], NSInteger ncity, DKRandomState* rs);
+static void annealInBackground(void* context);
+static void progressCallback(CGFloat iteration, CGFloat maxIterations, DKAnnealRun* run);
 static DKDirection directionOfAngle(const CGFloat angle);
+static void improvedNearestNeighbourRoute(const CGFloat x[], const CGFloat y[], NSInteger order[], NSInteger count, DKRouteFinder* rf);
 
 @interface DKRouteFinder (Private)
 
@@ -16,6 +38,8 @@ static DKDirection directionOfAngle(const CGFloat angle);
 - (void)notifyProgress:(CGFloat)value;
 - (NSUInteger)nearestNeighbourInArray:(NSArray*)arrayOfPoint toPoint:(NSPoint)cvp inDirection:(DKDirection)direction;
 - (NSArray*)sortArrayUsingNearestNeighbour:(NSArray*)points;
+- (void)sortUsingImprovedNearestNeighbour;
+- (void)sortUsingSimulatedAnnealing;
 - (CGFloat)pathLengthOfArray:(NSArray*)points;
 - (NSUInteger)indexOfTopLeftPointInArray:(NSArray*)points;
 - (void)performSortIfNeeded;
@@ -146,6 +170,19 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 	return mAlgorithm;
 }
 
+- (void)cancel
+{
+	// may be called from any thread, including from the progress delegate. Annealing stops soon after and keeps the best route
+	// found so far.
+
+	mCancelled = YES;
+}
+
+- (BOOL)isCancelled
+{
+	return mCancelled;
+}
+
 - (void)setProgressDelegate:(id)aDelegate
 {
 	// set a delegate that will be called with progress information as the route finder proceeds. Note that
@@ -192,7 +229,7 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 		NSInteger kludge = 1;
 		memset_pattern4(mOrder, &kludge, sizeof(NSInteger) * n);
 
-		if ((mAlgorithm & kDKUseSimulatedAnnealing) != 0) {
+		if ((mAlgorithm & (kDKUseSimulatedAnnealing | kDKUseImprovedNearestNeighbour)) != 0) {
 			mX = malloc(sizeof(CGFloat) * n);
 			mY = malloc(sizeof(CGFloat) * n);
 
@@ -370,6 +407,96 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 	return mVisited;
 }
 
+- (void)sortUsingImprovedNearestNeighbour
+{
+	// the C arrays are 1-based, as for SA, but the route code works from 0
+
+	NSInteger n = [mInput count];
+	NSInteger* order = malloc(sizeof(NSInteger) * n);
+	NSInteger k;
+
+	[self notifyProgress:0.0];
+
+	improvedNearestNeighbourRoute(mX + 1, mY + 1, order, n, self);
+
+	for (k = 0; k < n; ++k)
+		mOrder[k + 1] = order[k] + 1;
+
+	free(order);
+
+	[self notifyProgress:1.0];
+}
+
+- (void)sortUsingSimulatedAnnealing
+{
+	// runs independent annealing chains, one per processor, each from a different starting order and with its own random numbers, and
+	// keeps the shortest route. The first chain starts from the input order. The chains run in the background while this thread waits
+	// for them, reporting their combined progress so that the delegate is only ever called on the thread that asked for the route.
+
+	NSInteger n = [mInput count];
+	NSInteger starts = MAX(1, MIN((NSInteger)[[NSProcessInfo processInfo] activeProcessorCount], kDKMaximumAnnealingStarts));
+	DKAnnealRun* runs = calloc(starts, sizeof(DKAnnealRun));
+	dispatch_queue_t queue = dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0);
+	dispatch_group_t group = dispatch_group_create();
+	NSInteger i, best;
+	CGFloat progress, reported = 0.0;
+
+	[self notifyProgress:0.0];
+
+	for (i = 0; i < starts; ++i) {
+		runs[i].x = mX;
+		runs[i].y = mY;
+		runs[i].ncity = n;
+		runs[i].annealingSteps = mAnnealingSteps;
+		DKRandomSeed(&runs[i].random, 1 + i);
+		runs[i].iseed = 111 + 2 * i;
+		runs[i].cancelled = &mCancelled;
+		runs[i].iorder = malloc(sizeof(NSInteger) * (n + 1));
+		runs[i].jorder = malloc(sizeof(NSInteger) * (n + 1));
+
+		memcpy(runs[i].iorder, mOrder, sizeof(NSInteger) * (n + 1));
+
+		if (i > 0)
+			shuffleOrder(runs[i].iorder, n, &runs[i].random);
+
+		dispatch_group_async_f(group, queue, &runs[i], annealInBackground);
+	}
+
+	while (dispatch_group_wait(group, dispatch_time(DISPATCH_TIME_NOW, kDKAnnealingProgressInterval)) != 0) {
+		progress = 0.0;
+
+		for (i = 0; i < starts; ++i)
+			progress += runs[i].progress;
+
+		progress /= starts;
+
+		if (progress > reported) {
+			reported = progress;
+			[self notifyProgress:progress];
+		}
+	}
+
+	dispatch_release(group);
+
+	best = 0;
+
+	for (i = 1; i < starts; ++i) {
+		if (runs[i].path < runs[best].path)
+			best = i;
+	}
+
+	memcpy(mOrder, runs[best].iorder, sizeof(NSInteger) * (n + 1));
+
+	for (i = 0; i < starts; ++i) {
+		free(runs[i].iorder);
+		free(runs[i].jorder);
+	}
+
+	free(runs);
+
+	[self notifyProgress:1.0];
+}
+
 - (CGFloat)pathLengthOfArray:(NSArray*)points
 {
 	NSEnumerator* iter = [points objectEnumerator];
@@ -403,7 +530,7 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 		mCalculationDone = YES;
 
 		if ((mAlgorithm & kDKUseSimulatedAnnealing) != 0) {
-			anneal(mX, mY, mOrder, [mInput count], mAnnealingSteps, self);
+			[self sortUsingSimulatedAnnealing];
 			mPathLength = [self pathLengthOfArray:[self shortestRoute]];
 		}
 
@@ -411,17 +538,29 @@ static DKRouteAlgorithmType s_Algorithm = kDKUseNearestNeighbour; //kDKUseSimula
 			[self sortArrayUsingNearestNeighbour:mInput];
 			mPathLength = [self pathLengthOfArray:mVisited];
 		}
+
+		if ((mAlgorithm & kDKUseImprovedNearestNeighbour) != 0) {
+			[self sortUsingImprovedNearestNeighbour];
+			mPathLength = [self pathLengthOfArray:[self shortestRoute]];
+		}
 	}
 }
 
 @end
 
-void progressCallback(CGFloat iteration, CGFloat maxIterations, const void* context)
+void progressCallback(CGFloat iteration, CGFloat maxIterations, DKAnnealRun* run)
 {
-	DKRouteFinder* rf = (DKRouteFinder*)context;
+	// called on the chain's own thread, so only records the progress for the route finder to collect
 
-	if (rf != nil)
-		[rf notifyProgress:iteration / maxIterations];
+	run->progress = MIN(1.0, iteration / maxIterations);
+}
+
+void annealInBackground(void* context)
+{
+	DKAnnealRun* run = (DKAnnealRun*)context;
+
+	run->path = anneal(run);
+	run->progress = 1.0;
 }
 
 static DKDirection directionOfAngle(const CGFloat angle)
@@ -442,102 +581,509 @@ static DKDirection directionOfAngle(const CGFloat angle)
 }
 
 #pragma mark -
-#pragma mark - from Numerical Recipes in C(2nd ed.Ch 10. p448)
+#pragma mark - nearest neighbour using a k-d tree, improved by 2-opt and Or-opt
+
+// the k-d tree is implicit: the points are arranged in <perm> so that the middle element of each range splits it - on x at even
+// depths, on y at odd - and its halves are the subtrees. <alive> counts, for the node at each position, how many points in its
+// subtree are yet to be visited, so that a search can skip subtrees that have all been visited.
+
+typedef struct {
+	const CGFloat* x;
+	const CGFloat* y;
+	NSInteger count;
+	NSInteger* perm; // point indexes in tree order
+	NSInteger* position; // position of each point in perm
+	NSInteger* alive; // unvisited points in the subtree of the node at each position
+	BOOL* visited;
+} DKRouteTree;
+
+typedef struct {
+	const CGFloat* x;
+	const CGFloat* y;
+	NSInteger count;
+	NSInteger* tour; // the route, as point indexes. The first is the start and never moves
+	NSInteger* position; // position of each point in tour
+	NSInteger* neighbours; // kDKRouteNeighbourCount closest points of each point, nearest first
+	NSInteger maxMove; // longest stretch of the route a single move may rearrange
+	NSInteger* queue; // points whose moves are to be tried
+	BOOL* queued;
+	NSInteger queueHead;
+	NSInteger queueCount;
+} DKRouteOptimiser;
+
+#define kDKRouteMinimumGain 1.0e-7
+
+static inline CGFloat routeDistance(const CGFloat x[], const CGFloat y[], NSInteger a, NSInteger b)
+{
+	return hypot(x[a] - x[b], y[a] - y[b]);
+}
 
-static NSInteger* ivector(long nl, long nh);
-static void free_ivector(NSInteger* v, long nl, long nh);
-static CGFloat ran3(long* idum);
-static NSInteger irbit1(unsigned long* iseed);
-static NSInteger metrop(CGFloat de, CGFloat t);
-static CGFloat ran3(long* idum);
-static CGFloat revcst(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NSInteger n[]);
-static void reverse(NSInteger iorder[], NSInteger ncity, NSInteger n[]);
-static CGFloat trncst(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NSInteger n[]);
-static void trnspt(NSInteger iorder[], NSInteger ncity, NSInteger n[]);
+static void selectMedian(const CGFloat v[], NSInteger perm[], NSInteger lo, NSInteger hi, NSInteger k)
+{
+	// arranges perm[lo..hi) so that the point at k is the one that would be there if they were sorted by v, with none greater
+	// before it and none less after it
 
-#pragma mark -
-#define NR_END 1
-#define FREE_ARG char *
+	NSInteger i, j, tmp;
+	CGFloat pivot;
 
-/* allocate an int vector with subscript range v[nl..nh] */
+	--hi;
 
-NSInteger* ivector(long nl, long nh)
-{
-	NSInteger* v;
+	while (hi > lo) {
+		pivot = v[perm[(lo + hi) / 2]];
+		i = lo;
+		j = hi;
 
-	v = (NSInteger*)malloc((size_t)((nh - nl + 1 + NR_END) * sizeof(NSInteger)));
-	if (v != NULL)
-		return v - nl + NR_END;
-	else
-		return NULL;
+		while (i <= j) {
+			while (v[perm[i]] < pivot)
+				++i;
+			while (v[perm[j]] > pivot)
+				--j;
+
+			if (i <= j) {
+				tmp = perm[i];
+				perm[i++] = perm[j];
+				perm[j--] = tmp;
+			}
+		}
+
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
 }
 
-/* free an int vector allocated with ivector() */
+static void buildRouteTree(DKRouteTree* tree, NSInteger lo, NSInteger hi, NSInteger depth)
+{
+	if (hi <= lo)
+		return;
+
+	NSInteger mid = (lo + hi) / 2;
 
-void free_ivector(NSInteger* v, long nl, long nh)
+	selectMedian((depth & 1) ? tree->y : tree->x, tree->perm, lo, hi, mid);
+	tree->alive[mid] = hi - lo;
+
+	buildRouteTree(tree, lo, mid, depth + 1);
+	buildRouteTree(tree, mid + 1, hi, depth + 1);
+}
+
+static void nearestUnvisited(DKRouteTree* tree, NSInteger lo, NSInteger hi, NSInteger depth, NSInteger from, NSInteger* best, CGFloat* bestDistSq)
 {
-#pragma unused(nh)
+	if (hi <= lo)
+		return;
+
+	NSInteger mid = (lo + hi) / 2;
+
+	if (tree->alive[mid] == 0)
+		return;
+
+	NSInteger p = tree->perm[mid];
+	CGFloat dx = tree->x[from] - tree->x[p];
+	CGFloat dy = tree->y[from] - tree->y[p];
+
+	if (!tree->visited[p] && dx * dx + dy * dy < *bestDistSq) {
+		*bestDistSq = dx * dx + dy * dy;
+		*best = p;
+	}
+
+	CGFloat diff = (depth & 1) ? dy : dx;
+
+	if (diff < 0) {
+		nearestUnvisited(tree, lo, mid, depth + 1, from, best, bestDistSq);
+
+		if (diff * diff < *bestDistSq)
+			nearestUnvisited(tree, mid + 1, hi, depth + 1, from, best, bestDistSq);
+	} else {
+		nearestUnvisited(tree, mid + 1, hi, depth + 1, from, best, bestDistSq);
 
-	free((FREE_ARG)(v + nl - NR_END));
+		if (diff * diff < *bestDistSq)
+			nearestUnvisited(tree, lo, mid, depth + 1, from, best, bestDistSq);
+	}
 }
 
-#define MBIG 1000000000
-#define MSEED 161803398
-#define MZ 0
-#define FAC (1.0 / MBIG)
+static void markVisited(DKRouteTree* tree, NSInteger p)
+{
+	NSInteger lo = 0, hi = tree->count, mid;
+	NSInteger target = tree->position[p];
+
+	tree->visited[p] = YES;
 
-CGFloat ran3(long* idum)
+	do {
+		mid = (lo + hi) / 2;
+		--tree->alive[mid];
+
+		if (target < mid)
+			hi = mid;
+		else
+			lo = mid + 1;
+	} while (mid != target);
+}
+
+static void closestPoints(DKRouteTree* tree, NSInteger lo, NSInteger hi, NSInteger depth, NSInteger from, NSInteger found[], CGFloat foundDistSq[], NSInteger* foundCount)
 {
-	static NSInteger inext, inextp;
-	static long ma[56];
-	static NSInteger iff = 0;
-	long mj, mk;
-	NSInteger i, ii, k;
+	// finds the kDKRouteNeighbourCount points closest to <from>, whether visited or not, keeping them in order of distance
+
+	if (hi <= lo)
+		return;
 
-	if (*idum < 0 || iff == 0) {
-		iff = 1;
-		mj = MSEED - (*idum < 0 ? -*idum : *idum);
-		mj %= MBIG;
-		ma[55] = mj;
-		mk = 1;
+	NSInteger mid = (lo + hi) / 2;
+	NSInteger p = tree->perm[mid];
+	CGFloat dx = tree->x[from] - tree->x[p];
+	CGFloat dy = tree->y[from] - tree->y[p];
+	CGFloat d2 = dx * dx + dy * dy;
 
-		for (i = 1; i <= 54; i++) {
-			ii = (21 * i) % 55;
-			ma[ii] = mk;
-			mk = mj - mk;
-			if (mk < MZ)
-				mk += MBIG;
-			mj = ma[ii];
+	if (p != from && (*foundCount < kDKRouteNeighbourCount || d2 < foundDistSq[*foundCount - 1])) {
+		NSInteger k = (*foundCount < kDKRouteNeighbourCount) ? (*foundCount)++ : *foundCount - 1;
+
+		while (k > 0 && foundDistSq[k - 1] > d2) {
+			found[k] = found[k - 1];
+			foundDistSq[k] = foundDistSq[k - 1];
+			--k;
 		}
 
-		for (k = 1; k <= 4; k++) {
-			for (i = 1; i <= 55; i++) {
-				ma[i] -= ma[1 + (i + 30) % 55];
-				if (ma[i] < MZ)
-					ma[i] += MBIG;
+		found[k] = p;
+		foundDistSq[k] = d2;
+	}
+
+	CGFloat diff = (depth & 1) ? dy : dx;
+	NSInteger nearLo = (diff < 0) ? lo : mid + 1;
+	NSInteger nearHi = (diff < 0) ? mid : hi;
+	NSInteger farLo = (diff < 0) ? mid + 1 : lo;
+	NSInteger farHi = (diff < 0) ? hi : mid;
+
+	closestPoints(tree, nearLo, nearHi, depth + 1, from, found, foundDistSq, foundCount);
+
+	if (*foundCount < kDKRouteNeighbourCount || diff * diff < foundDistSq[*foundCount - 1])
+		closestPoints(tree, farLo, farHi, depth + 1, from, found, foundDistSq, foundCount);
+}
+
+static void queuePoint(DKRouteOptimiser* opt, NSInteger p)
+{
+	if (!opt->queued[p]) {
+		opt->queued[p] = YES;
+		opt->queue[(opt->queueHead + opt->queueCount++) % opt->count] = p;
+	}
+}
+
+static void reverseRoute(DKRouteOptimiser* opt, NSInteger from, NSInteger to)
+{
+	NSInteger tmp;
+
+	while (from < to) {
+		tmp = opt->tour[from];
+		opt->tour[from] = opt->tour[to];
+		opt->tour[to] = tmp;
+
+		opt->position[opt->tour[from]] = from;
+		opt->position[opt->tour[to]] = to;
+		++from;
+		--to;
+	}
+}
+
+static BOOL tryReversal(DKRouteOptimiser* opt, NSInteger from, NSInteger to)
+{
+	// reversing tour[from..to] replaces the edges into and out of it. The start is fixed, and the end is open, so reaching the end
+	// of the route removes only the edge into the stretch
+
+	if (from < 1 || to <= from || to - from > opt->maxMove)
+		return NO;
+
+	const NSInteger* t = opt->tour;
+	BOOL atEnd = (to == opt->count - 1);
+	CGFloat gain;
+
+	gain = routeDistance(opt->x, opt->y, t[from - 1], t[from]) - routeDistance(opt->x, opt->y, t[from - 1], t[to]);
+
+	if (!atEnd)
+		gain += routeDistance(opt->x, opt->y, t[to], t[to + 1]) - routeDistance(opt->x, opt->y, t[from], t[to + 1]);
+
+	if (gain <= kDKRouteMinimumGain)
+		return NO;
+
+	queuePoint(opt, t[from - 1]);
+	queuePoint(opt, t[from]);
+	queuePoint(opt, t[to]);
+
+	if (!atEnd)
+		queuePoint(opt, t[to + 1]);
+
+	reverseRoute(opt, from, to);
+	return YES;
+}
+
+static BOOL twoOptMove(DKRouteOptimiser* opt, NSInteger a)
+{
+	// tries joining <a> to each of its neighbours <c>, by reversing the stretch of the route that follows one of them up to the
+	// other, or the stretch that leads from one up to the city before the other
+
+	NSInteger i = opt->position[a], j, p, q, k;
+
+	for (k = 0; k < kDKRouteNeighbourCount; ++k) {
+		NSInteger c = opt->neighbours[a * kDKRouteNeighbourCount + k];
+
+		if (c < 0)
+			break;
+
+		j = opt->position[c];
+		p = MIN(i, j);
+		q = MAX(i, j);
+
+		if (tryReversal(opt, p + 1, q) || tryReversal(opt, p, q - 1))
+			return YES;
+	}
+
+	return NO;
+}
+
+static void moveSegment(DKRouteOptimiser* opt, NSInteger i, NSInteger len, NSInteger gap, BOOL reversed)
+{
+	// moves tour[i..i+len-1] into the gap following tour[gap]
+
+	NSInteger seg[3], k, first, last;
+	NSInteger* t = opt->tour;
+
+	for (k = 0; k < len; ++k)
+		seg[k] = t[reversed ? i + len - 1 - k : i + k];
+
+	if (gap > i) {
+		memmove(&t[i], &t[i + len], sizeof(NSInteger) * (gap - i - len + 1));
+		first = i;
+		last = gap;
+
+		for (k = 0; k < len; ++k)
+			t[gap - len + 1 + k] = seg[k];
+	} else {
+		memmove(&t[gap + 1 + len], &t[gap + 1], sizeof(NSInteger) * (i - gap - 1));
+		first = gap + 1;
+		last = i + len - 1;
+
+		for (k = 0; k < len; ++k)
+			t[gap + 1 + k] = seg[k];
+	}
+
+	for (k = first; k <= last; ++k)
+		opt->position[t[k]] = k;
+}
+
+static BOOL trySegmentMove(DKRouteOptimiser* opt, NSInteger i, NSInteger len)
+{
+	// tries moving tour[i..i+len-1], either way round, next to one of the neighbours of its ends
+
+	NSInteger n = opt->count;
+
+	if (i < 1 || i + len > n)
+		return NO;
+
+	const NSInteger* t = opt->tour;
+	const CGFloat* x = opt->x;
+	const CGFloat* y = opt->y;
+	NSInteger s0 = t[i], sl = t[i + len - 1], prev = t[i - 1];
+	BOOL hasNext = (i + len < n);
+	CGFloat removeGain = routeDistance(x, y, prev, s0);
+
+	if (hasNext)
+		removeGain += routeDistance(x, y, sl, t[i + len]) - routeDistance(x, y, prev, t[i + len]);
+
+	if (removeGain <= kDKRouteMinimumGain)
+		return NO;
+
+	NSInteger e, k, g, end;
+
+	for (e = 0; e < 2; ++e) {
+		end = e ? sl : s0;
+
+		for (k = 0; k < kDKRouteNeighbourCount; ++k) {
+			NSInteger c = opt->neighbours[end * kDKRouteNeighbourCount + k];
+
+			if (c < 0)
+				break;
+
+			NSInteger gaps[2] = { opt->position[c] - 1, opt->position[c] };
+
+			for (g = 0; g < 2; ++g) {
+				NSInteger gap = gaps[g];
+
+				if (gap < 0 || (gap >= i - 1 && gap <= i + len - 1) || labs(gap - i) > opt->maxMove)
+					continue;
+
+				NSInteger u = t[gap];
+				BOOL hasV = (gap + 1 < n);
+				CGFloat base = hasV ? routeDistance(x, y, u, t[gap + 1]) : 0;
+				CGFloat costF = routeDistance(x, y, u, s0) - base;
+				CGFloat costR = routeDistance(x, y, u, sl) - base;
+
+				if (hasV) {
+					costF += routeDistance(x, y, sl, t[gap + 1]);
+					costR += routeDistance(x, y, s0, t[gap + 1]);
+				}
+
+				BOOL reversed = (costR < costF);
+
+				if (removeGain - (reversed ? costR : costF) > kDKRouteMinimumGain) {
+					queuePoint(opt, prev);
+					queuePoint(opt, s0);
+					queuePoint(opt, sl);
+					queuePoint(opt, u);
+
+					if (hasNext)
+						queuePoint(opt, t[i + len]);
+
+					if (hasV)
+						queuePoint(opt, t[gap + 1]);
+
+					moveSegment(opt, i, len, gap, reversed);
+					return YES;
+				}
 			}
 		}
-		inext = 0;
-		inextp = 31;
-		*idum = 1;
 	}
 
-	if (++inext == 56)
-		inext = 1;
+	return NO;
+}
+
+static BOOL orOptMove(DKRouteOptimiser* opt, NSInteger a)
+{
+	// tries moving the stretches of one to three points that start or end at <a>
+
+	NSInteger i = opt->position[a], len;
+
+	for (len = 1; len <= 3; ++len) {
+		if (trySegmentMove(opt, i, len))
+			return YES;
+
+		if (len > 1 && trySegmentMove(opt, i - len + 1, len))
+			return YES;
+	}
+
+	return NO;
+}
+
+static void improvedNearestNeighbourRoute(const CGFloat x[], const CGFloat y[], NSInteger order[], NSInteger count, DKRouteFinder* rf)
+{
+	// builds a route from point 0 by repeatedly going to the nearest point not yet visited, then improves it with 2-opt and Or-opt
+	// moves until none of them shortens it. The route order is returned in <order>
+
+	DKRouteTree tree;
+	DKRouteOptimiser opt;
+	NSInteger k, p, found, nfound;
+	CGFloat bestDistSq;
+	CGFloat foundDistSq[kDKRouteNeighbourCount];
+
+	if (count < 1)
+		return;
+
+	tree.x = x;
+	tree.y = y;
+	tree.count = count;
+	tree.perm = malloc(sizeof(NSInteger) * count);
+	tree.position = malloc(sizeof(NSInteger) * count);
+	tree.alive = malloc(sizeof(NSInteger) * count);
+	tree.visited = calloc(count, sizeof(BOOL));
+
+	for (k = 0; k < count; ++k)
+		tree.perm[k] = k;
+
+	buildRouteTree(&tree, 0, count, 0);
+
+	for (k = 0; k < count; ++k)
+		tree.position[tree.perm[k]] = k;
+
+	// the neighbour lists are found before any point is visited, as the search for them ignores visiting
+
+	opt.x = x;
+	opt.y = y;
+	opt.count = count;
+	opt.tour = order;
+	opt.position = malloc(sizeof(NSInteger) * count);
+	opt.neighbours = malloc(sizeof(NSInteger) * count * kDKRouteNeighbourCount);
+	opt.queue = malloc(sizeof(NSInteger) * count);
+	opt.queued = calloc(count, sizeof(BOOL));
+	opt.queueHead = opt.queueCount = 0;
+
+	// bounding how much of the route one move may rearrange keeps large routes fast, at little cost to the result
+
+	opt.maxMove = MAX(1000, 25000000 / count);
+
+	for (p = 0; p < count; ++p) {
+		nfound = 0;
+		closestPoints(&tree, 0, count, 0, p, &opt.neighbours[p * kDKRouteNeighbourCount], foundDistSq, &nfound);
+
+		for (k = nfound; k < kDKRouteNeighbourCount; ++k)
+			opt.neighbours[p * kDKRouteNeighbourCount + k] = -1;
+	}
+
+	// nearest neighbour construction
+
+	p = 0;
+	markVisited(&tree, 0);
+	order[0] = 0;
+
+	for (k = 1; k < count; ++k) {
+		found = NSNotFound;
+		bestDistSq = HUGE_VAL;
+		nearestUnvisited(&tree, 0, count, 0, p, &found, &bestDistSq);
+
+		markVisited(&tree, found);
+		order[k] = p = found;
+
+		if ((k & 1023) == 0)
+			[rf notifyProgress:0.5 * (CGFloat)k / (CGFloat)count];
+	}
+
+	free(tree.perm);
+	free(tree.position);
+	free(tree.alive);
+	free(tree.visited);
 
-	if (++inextp == 56)
-		inextp = 1;
+	// improvement. A point is tried again whenever a move changes one of its edges, so this ends when no move helps any point
 
-	mj = ma[inext] - ma[inextp];
+	for (k = 0; k < count; ++k) {
+		opt.position[order[k]] = k;
+		queuePoint(&opt, order[k]);
+	}
+
+	NSUInteger tries = 0;
+	CGFloat progress = 0.5, remaining;
+
+	while (opt.queueCount > 0) {
+		p = opt.queue[opt.queueHead];
+		opt.queueHead = (opt.queueHead + 1) % count;
+		--opt.queueCount;
+		opt.queued[p] = NO;
+
+		if (!twoOptMove(&opt, p))
+			orOptMove(&opt, p);
 
-	if (mj < MZ)
-		mj += MBIG;
+		if ((++tries & 1023) == 0) {
+			remaining = 1.0 - (CGFloat)opt.queueCount / (CGFloat)count;
 
-	ma[inext] = mj;
+			if (0.5 + 0.5 * remaining > progress) {
+				progress = 0.5 + 0.5 * remaining;
+				[rf notifyProgress:progress];
+			}
+		}
+	}
 
-	return mj * FAC;
+	free(opt.position);
+	free(opt.neighbours);
+	free(opt.queue);
+	free(opt.queued);
 }
 
+#pragma mark -
+#pragma mark - from Numerical Recipes in C(2nd ed.Ch 10. p448)
+
+static NSInteger irbit1(unsigned long* iseed);
+static NSInteger metrop(CGFloat de, CGFloat t, DKRandomState* rs);
+static CGFloat revcst(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NSInteger n[]);
+static void reverse(NSInteger iorder[], NSInteger ncity, NSInteger n[]);
+static CGFloat trncst(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NSInteger n[]);
+static void trnspt(NSInteger iorder[], NSInteger ncity, NSInteger n[], NSInteger jorder[]);
+
+#pragma mark -
 #define IB1 1
 #define IB2 2
 #define IB5 16
@@ -556,6 +1102,24 @@ NSInteger irbit1(unsigned long* iseed)
 	return (NSInteger)newbit;
 }
 
+/* shuffles iorder[2..ncity], leaving the first city where it is, to give an annealing chain a different start */
+
+void shuffleOrder(NSInteger iorder[], NSInteger ncity, DKRandomState* rs)
+{
+	NSInteger j, k, itmp;
+
+	for (j = ncity; j > 2; --j) {
+		k = 2 + (NSInteger)((j - 1) * DKRandomUnit(rs));
+
+		if (k > j)
+			k = j;
+
+		itmp = iorder[j];
+		iorder[j] = iorder[k];
+		iorder[k] = itmp;
+	}
+}
+
 /*
 This algorithm ﬁnds the shortest round-trip path to ncity cities whose coordinates are in the 
 arrays x[1..ncity], y[1..ncity]. The array iorder[1..ncity] speciﬁes the order in 
@@ -569,14 +1133,18 @@ function result is the final path length
 #define TFACTR 0.9 // Annealing schedule: reduce t by this factor on each step.
 #define ALEN(a, b, c, d) _CGFloatSqrt(((b) - (a)) * ((b) - (a)) + ((d) - (c)) * ((d) - (c)))
 
-CGFloat anneal(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NSInteger annealingSteps, const void* context)
+CGFloat anneal(DKAnnealRun* run)
 {
 	NSInteger ans, nover, nlimit, i1, i2;
 	NSInteger i, j, k, nsucc, nn, idec;
 
-	static NSInteger n[7];
-	static long idum = -1;
-	static unsigned long iseed = 111;
+	CGFloat* x = run->x;
+	CGFloat* y = run->y;
+	NSInteger* iorder = run->iorder;
+	NSInteger ncity = run->ncity;
+	NSInteger annealingSteps = run->annealingSteps;
+	DKRandomState* rs = &run->random;
+	NSInteger n[7];
 	CGFloat path, de, t, previousPath;
 
 	nover = 100 * ncity; // Maximum number of paths tried at any temperature.
@@ -584,7 +1152,7 @@ CGFloat anneal(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NS
 	path = 0.0;
 	t = 0.5;
 
-	progressCallback(0, annealingSteps, context);
+	progressCallback(0, annealingSteps, run);
 
 	for (i = 1; i < ncity; ++i) {
 		// Calculate initial path length.
@@ -602,50 +1170,53 @@ CGFloat anneal(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NS
 	previousPath = path;
 
 	for (j = 1; j <= annealingSteps; ++j) {
-		progressCallback(j, annealingSteps, context);
+		progressCallback(j, annealingSteps, run);
 
 		// Try up to <annealingSteps> temperature steps.
 
 		nsucc = 0;
 		for (k = 1; k <= nover; ++k) {
+			if (*run->cancelled)
+				return path;
+
 			if (path != previousPath) {
 				// path changed, so make a progress report
 
 				previousPath = path;
 				CGFloat kprog = (CGFloat)k / (CGFloat)nover;
 
-				progressCallback((CGFloat)j + kprog, (CGFloat)annealingSteps, context); // for testing only - remove for production it slows this down too much
+				progressCallback((CGFloat)j + kprog, (CGFloat)annealingSteps, run);
 			}
 
 			do {
-				n[1] = 1 + (NSInteger)(ncity * ran3(&idum)); // Choose beginning of segment..
-				n[2] = 1 + (NSInteger)((ncity - 1) * ran3(&idum)); // ..and end of segment.
+				n[1] = 1 + (NSInteger)(ncity * DKRandomUnit(rs)); // Choose beginning of segment..
+				n[2] = 1 + (NSInteger)((ncity - 1) * DKRandomUnit(rs)); // ..and end of segment.
 				if (n[2] >= n[1])
 					++n[2];
 
 				nn = 1 + ((n[1] - n[2] + ncity - 1) % ncity); // nn is the number of cities not on the segment.
 			} while (nn < 3);
 
-			idec = irbit1(&iseed);
+			idec = irbit1(&run->iseed);
 
 			// Decide whether to do a segment reversal or transport.
 			if (idec == 0) {
 				// Do a transport.
-				n[3] = n[2] + (NSInteger)(labs(nn - 2) * ran3(&idum)) + 1;
+				n[3] = n[2] + (NSInteger)(labs(nn - 2) * DKRandomUnit(rs)) + 1;
 				n[3] = 1 + ((n[3] - 1) % ncity);
 
 				// Transport to a location not on the path.
 				de = trncst(x, y, iorder, ncity, n); // Calculate cost.
-				ans = metrop(de, t); // Consult the oracle.
+				ans = metrop(de, t, rs); // Consult the oracle.
 				if (ans) {
 					++nsucc;
 					path += de;
-					trnspt(iorder, ncity, n); // Carry out the transport.
+					trnspt(iorder, ncity, n, run->jorder); // Carry out the transport.
 				}
 			} else {
 				// Do a path reversal.
 				de = revcst(x, y, iorder, ncity, n); // Calculate cost.
-				ans = metrop(de, t); // Consult the oracle.
+				ans = metrop(de, t, rs); // Consult the oracle.
 
 				if (ans) {
 					++nsucc;
@@ -662,7 +1233,7 @@ CGFloat anneal(CGFloat x[], CGFloat y[], NSInteger iorder[], NSInteger ncity, NS
 
 		t *= TFACTR; // Annealing schedule.
 		if (nsucc == 0) {
-			progressCallback(annealingSteps, annealingSteps, context);
+			progressCallback(annealingSteps, annealingSteps, run);
 			return path; // If no success, we are done.
 		}
 	}
@@ -768,10 +1339,9 @@ n[4], n[5], and n[6] are calculated by function trncst. On output, iorder is mod
 reﬂect the movement of the path segment. 
 */
 
-void trnspt(NSInteger iorder[], NSInteger ncity, NSInteger n[])
+void trnspt(NSInteger iorder[], NSInteger ncity, NSInteger n[], NSInteger jorder[])
 {
-	NSInteger m1, m2, m3, nn, j, jj, *jorder;
-	jorder = ivector(1, ncity);
+	NSInteger m1, m2, m3, nn, j, jj;
 
 	m1 = 1 + ((n[2] - n[1] + ncity) % ncity); // Find number of cities from n[1] to n[2]
 	m2 = 1 + ((n[5] - n[4] + ncity) % ncity); // ...and the number from n[4] to n[5]
@@ -799,8 +1369,6 @@ void trnspt(NSInteger iorder[], NSInteger ncity, NSInteger n[])
 		// Copy jorder back into iorder.
 		iorder[j] = jorder[j];
 	}
-
-	free_ivector(jorder, 1, ncity);
 }
 
 /*
@@ -810,9 +1378,7 @@ metrop = 1(true), while if de > 0, metrop is only true with probability exp(-de/
 t is a temperature determined by the annealing schedule. 
 */
 
-NSInteger metrop(CGFloat de, CGFloat t)
+NSInteger metrop(CGFloat de, CGFloat t, DKRandomState* rs)
 {
-	static long gljdum = 1;
-
-	return de < 0.0 || ran3(&gljdum) < _CGFloatExp(-de / t);
+	return de < 0.0 || DKRandomUnit(rs) < _CGFloatExp(-de / t);
 }
@@ -6,11 +6,26 @@
 
 #import <Cocoa/Cocoa.h>
 
+/** @brief Finds the classes of a given kind registered in the runtime.
+
+ The runtime's class list is read once, the first time it's needed, and the classes of each kind asked for are found from that copy
+ and kept, so asking again costs a dictionary lookup. Classes in bundles loaded later are added to the copy and to each list they
+ belong to as the bundles load, so nothing scans the whole runtime again.
+*/
 @interface DKRuntimeHelper : NSObject
 
-/**  */
+/** @brief All the NSObject classes
+ @return the classes */
 + (NSArray*)allClasses;
+
+/** @brief The classes that are <aClass> or inherit from it
+ @param aClass a class
+ @return the classes */
 + (NSArray*)allClassesOfKind:(Class)aClass;
+
+/** @brief The classes whose superclass is <aClass>
+ @param aClass a class
+ @return the classes */
 + (NSArray*)allImmediateSubclassesOf:(Class)aClass;
 
 @end
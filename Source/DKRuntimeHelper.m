@@ -10,6 +10,24 @@
 
 #import <objc/objc-runtime.h>
 
+// the copy of the runtime's class list, and the lists found from it so far, keyed by class. All are only used under @synchronized
+
+static Class* sClasses = NULL;
+static NSUInteger sClassCount = 0;
+static NSUInteger sClassCapacity = 0;
+static CFMutableDictionaryRef sClassesOfKind = NULL;
+static CFMutableDictionaryRef sImmediateSubclasses = NULL;
+
+@interface DKRuntimeHelper (Private)
+
++ (void)readClassList;
++ (void)bundleDidLoad:(NSNotification*)note;
++ (NSArray*)classesOfKind:(Class)aClass immediate:(BOOL)immediate;
+
+@end
+
+#pragma mark -
+
 @implementation DKRuntimeHelper
 
 /**  */
@@ -20,113 +38,131 @@
 
 + (NSArray*)allClassesOfKind:(Class)aClass
 {
-	// returns a list of all Class objects that are of kind <aClass> or a subclass of it currently registered in the runtime. This caches the
-	// result so that the relatively expensive run-through is only performed the first time
-
-	static NSMutableDictionary* cache = nil;
-
-	if (cache == nil)
-		cache = [[NSMutableDictionary alloc] init];
-
-	// is the list already cached?
-
-	NSArray* cachedList = [cache objectForKey:NSStringFromClass(aClass)];
+	// returns a list of all Class objects that are of kind <aClass> or a subclass of it currently registered in the runtime
 
-	if (cachedList != nil)
-		return cachedList;
-
-	// if here, list wasn't in the cache, so build it the hard way
-
-	NSMutableArray* list = [NSMutableArray array];
+	return [self classesOfKind:aClass
+					 immediate:NO];
+}
 
-	Class* buffer = NULL;
-	Class cl;
++ (NSArray*)allImmediateSubclassesOf:(Class)aClass
+{
+	return [self classesOfKind:aClass
+					 immediate:YES];
+}
 
-	NSInteger i, numClasses = objc_getClassList(NULL, 0);
+@end
 
-	if (numClasses > 0) {
-		buffer = malloc(sizeof(Class) * numClasses);
+#pragma mark -
 
-		NSAssert(buffer != nil, @"couldn't allocate the buffer");
+@implementation DKRuntimeHelper (Private)
 
-		(void)objc_getClassList(buffer, numClasses);
++ (void)readClassList
+{
+	// called once, under the lock. From here on the copy is kept up to date from bundle load notifications
 
-		// go through the list and carefully check whether the class can respond to isSubclassOfClass: - if so, add it to the list.
+	NSInteger numClasses = objc_getClassList(NULL, 0);
 
-		for (i = 0; i < numClasses; ++i) {
-			cl = buffer[i];
+	sClassCapacity = MAX(numClasses, 0) + 256;
+	sClasses = malloc(sizeof(Class) * sClassCapacity);
 
-			if (classIsSubclassOfClass(cl, aClass))
-				[list addObject:cl];
-		}
+	NSAssert(sClasses != nil, @"couldn't allocate the buffer");
 
-		free(buffer);
-	}
+	// the list can grow between the two calls, so take only what was counted
 
-	// save in cache for next time
+	sClassCount = (NSUInteger)MAX(MIN(objc_getClassList(sClasses, (int)sClassCapacity), (int)sClassCapacity), 0);
 
-	[cache setObject:list
-			  forKey:NSStringFromClass(aClass)];
+	sClassesOfKind = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+	sImmediateSubclasses = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
 
-	//	LogEvent_(kReactiveEvent, @"classes: %@", list);
+	[[NSNotificationCenter defaultCenter] addObserver:self
+											 selector:@selector(bundleDidLoad:)
+												 name:NSBundleDidLoadNotification
+											   object:nil];
 
-	return list;
+	LogEvent_(kInfoEvent, @"runtime helper read %lu classes", (unsigned long)sClassCount);
 }
 
-+ (NSArray*)allImmediateSubclassesOf:(Class)aClass
++ (void)bundleDidLoad:(NSNotification*)note
 {
-	static NSMutableDictionary* cache = nil;
+	// adds the bundle's classes to the copy of the class list and to each list found so far that they belong to
 
-	if (cache == nil)
-		cache = [[NSMutableDictionary alloc] init];
+	NSArray* names = [[note userInfo] objectForKey:NSLoadedClasses];
+	NSEnumerator* iter = [names objectEnumerator];
+	NSString* name;
+	Class cl;
 
-	// is the list already cached?
+	@synchronized(self)
+	{
+		while ((name = [iter nextObject])) {
+			cl = NSClassFromString(name);
 
-	NSArray* cachedList = [cache objectForKey:NSStringFromClass(aClass)];
+			if (cl == Nil)
+				continue;
 
-	if (cachedList != nil)
-		return cachedList;
+			if (sClassCount == sClassCapacity) {
+				sClassCapacity *= 2;
+				sClasses = realloc(sClasses, sizeof(Class) * sClassCapacity);
+			}
 
-	// if here, list wasn't in the cache, so build it the hard way
+			sClasses[sClassCount++] = cl;
 
-	NSMutableArray* list = [NSMutableArray array];
+			// a class is only on the list for its own superclass, but on the kind lists of all its ancestors
 
-	Class* buffer = NULL;
-	Class cl;
+			NSMutableArray* list = nil;
+			Class ancestor = class_getSuperclass(cl);
 
-	NSInteger i, numClasses = objc_getClassList(NULL, 0);
+			if (ancestor != Nil)
+				list = (NSMutableArray*)CFDictionaryGetValue(sImmediateSubclasses, ancestor);
 
-	if (numClasses > 0) {
-		buffer = malloc(sizeof(Class) * numClasses);
+			[list addObject:cl];
 
-		NSAssert(buffer != nil, @"couldn't allocate the buffer");
+			for (ancestor = cl; ancestor != Nil; ancestor = class_getSuperclass(ancestor)) {
+				list = (NSMutableArray*)CFDictionaryGetValue(sClassesOfKind, ancestor);
+				[list addObject:cl];
+			}
+		}
+	}
+}
 
-		(void)objc_getClassList(buffer, numClasses);
++ (NSArray*)classesOfKind:(Class)aClass immediate:(BOOL)immediate
+{
+	if (aClass == Nil)
+		return [NSArray array];
 
-		// go through the list and carefully check whether the class can respond to isSubclassOfClass: - if so, add it to the list.
+	@synchronized(self)
+	{
+		if (sClasses == NULL)
+			[self readClassList];
 
-		for (i = 0; i < numClasses; ++i) {
-			cl = buffer[i];
+		CFMutableDictionaryRef lists = immediate ? sImmediateSubclasses : sClassesOfKind;
+		NSMutableArray* list = (NSMutableArray*)CFDictionaryGetValue(lists, aClass);
 
-			if (classIsImmediateSubclassOfClass(aClass, cl))
-				[list addObject:cl];
-		}
+		if (list == nil) {
+			NSUInteger i;
+			Class cl;
 
-		free(buffer);
-	}
+			list = [NSMutableArray array];
+
+			for (i = 0; i < sClassCount; ++i) {
+				cl = sClasses[i];
 
-	// save in cache for next time
+				if (immediate ? classIsImmediateSubclassOfClass(aClass, cl) : classIsSubclassOfClass(cl, aClass))
+					[list addObject:cl];
+			}
 
-	[cache setObject:list
-			  forKey:NSStringFromClass(aClass)];
+			CFDictionarySetValue(lists, aClass, list);
+		}
 
-	//	LogEvent_(kReactiveEvent, @"classes: %@", list);
+		// a copy, as bundles loading later may add to the list
 
-	return list;
+		return [[list copy] autorelease];
+	}
 }
 
 @end
 
+#pragma mark -
+
 BOOL classIsNSObject(const Class aClass)
 {
 	// returns YES if <aClass> is an NSObject derivative, otherwise NO. It does this without invoking any methods on the class being tested.
@@ -136,29 +172,19 @@ BOOL classIsNSObject(const Class aClass)
 
 BOOL classIsSubclassOfClass(const Class aClass, const Class subclass)
 {
-	Class temp = aClass;
-	NSInteger match = -1;
-	/*
-#if 1 //MAC_OS_X_VERSION_MAX_ALLOWED < MAC_OS_X_VERSION_10_5
-	while(( 0 != ( match = strncmp( temp->name, subclass->name, strlen( subclass->name )))) && ( NULL != temp->super_class ))
-		temp = temp->super_class;
-#else
-*/
-	while ((0 != (match = strncmp(class_getName(temp), class_getName(subclass), strlen(class_getName(subclass))))) && (NULL != class_getSuperclass(temp)))
-		temp = class_getSuperclass(temp);
-	/*
-#endif
-*/
-	return (match == 0);
+	// walks the superclass chain comparing classes, so no methods are invoked on classes that might not be NSObjects
+
+	Class temp;
+
+	for (temp = aClass; temp != Nil; temp = class_getSuperclass(temp)) {
+		if (temp == subclass)
+			return YES;
+	}
+
+	return NO;
 }
 
 BOOL classIsImmediateSubclassOfClass(const Class aClass, const Class subclass)
 {
-	
-	Class	superClass = class_getSuperclass(subclass);
-	
-	if( superClass != Nil )
-		return [NSStringFromClass(aClass) isEqualToString:NSStringFromClass(superClass)];
-	else
-		return NO;
+	return subclass != Nil && aClass != Nil && class_getSuperclass(subclass) == aClass;
 }
@@ -0,0 +1,81 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawing;
+
+/** @brief Writes a drawing as SVG, streaming the document to an output stream as the objects are visited.
+
+ Writes a drawing as SVG, streaming the document to an output stream as the objects are visited, so that the whole of it is never held in
+ memory. Output is gathered in a buffer of kDKSVGFlushThreshold bytes, which is written out as it fills.
+
+ Each layer is written as a group of its objects, in stacking order. An object's path is written with its style's topmost fill and
+ stroke, which are all SVG can show of most styles; hatches, effects and other renderers are left out, and a gradient fill is written as
+ the colour at its middle. Each style is written only once, as a CSS class, before the first object using it, so objects sharing a style
+ cost just the class name. Text, whether a text shape's own or that of a style's text adornments, is written as the outlines of its
+ glyphs, so it is laid out exactly as drawn and looks the same without the fonts.
+
+ Path data is written in fixed point, to -decimalPlaces places, with each point after the first relative to the one before and no more
+ characters than are needed to separate the numbers. That makes the data after the first point the same for copies of a path that are only
+ moved, so a path of more than kDKSVGMinimumSharedPathLength bytes with the same style as an earlier one is written as a <use> of it. The
+ content of a shape group is written relative to the group's location as a <symbol>, once for all the groups with the same content, and
+ each group is a <use> of its symbol.
+
+ An image shape refers to its image by the image manager's key rather than embedding its data. If an image directory is set, each image is
+ written there once, as PNG unless it is JPEG or GIF already, and the reference is the file's name after the image reference prefix.
+ Without one, the references name the files that would have been written, for the caller to provide.
+
+ The drawing is read on the calling thread, which should be the main thread unless no other thread uses the drawing, as for a
+ DKBatchRenderer job. kDKDrawingExportProgressNotification is posted as the objects are written.
+*/
+@interface DKSVGExporter : NSObject {
+@private
+	DKDrawing* mDrawing;
+	NSArray* mLayers;
+	NSURL* mImageDirectoryURL;
+	NSString* mImageReferencePrefix;
+	NSUInteger mDecimalPlaces;
+}
+
+/** @brief Makes an exporter for some layers of a drawing
+ @param drawing the drawing
+ @param layers the layers to write, bottom first; only object owner layers are written
+ @return the exporter
+ */
+- (id)initWithDrawing:(DKDrawing*)drawing layers:(NSArray*)layers;
+
+- (DKDrawing*)drawing;
+
+/** @brief Sets how many decimal places coordinates are written to
+ @param places 0 to kDKSVGMaximumDecimalPlaces; the default is 2
+ */
+- (void)setDecimalPlaces:(NSUInteger)places;
+- (NSUInteger)decimalPlaces;
+
+/** @brief Sets the directory the images of image shapes are written to
+ @param url a file URL for a directory, made if needed, or nil not to write the images
+ */
+- (void)setImageDirectoryURL:(NSURL*)url;
+- (NSURL*)imageDirectoryURL;
+
+/** @brief Sets what comes before an image's file name in the references to it
+ @param prefix a URL string such as a relative path ending in a slash, or nil for none
+ */
+- (void)setImageReferencePrefix:(NSString*)prefix;
+- (NSString*)imageReferencePrefix;
+
+/** @brief Writes the SVG document
+ @param stream a stream, which is opened if it isn't already, and left open
+ @return YES if the whole document was written, NO if the stream failed
+ */
+- (BOOL)writeToStream:(NSOutputStream*)stream;
+
+@end
+
+#define kDKSVGFlushThreshold 65536 // bytes of output held before they're written to the stream
+#define kDKSVGMinimumSharedPathLength 48 // bytes of path data, below which a repeated path is cheaper to write again than to refer to
+#define kDKSVGMaximumDecimalPlaces 6
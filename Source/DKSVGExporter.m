@@ -0,0 +1,1276 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKSVGExporter.h"
+#import "DKDrawing.h"
+#import "DKDrawing+Export.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawableObject.h"
+#import "DKShapeGroup.h"
+#import "DKImageShape.h"
+#import "DKTextShape.h"
+#import "DKTextPath.h"
+#import "DKTextAdornment.h"
+#import "DKImageDataManager.h"
+#import "DKStyle.h"
+#import "DKFill.h"
+#import "DKGradient.h"
+#import "DKStroke.h"
+#import "DKStrokeDash.h"
+#import "DKDrawKitMacros.h"
+
+#define kDKSVGDefaultDecimalPlaces 2
+#define kDKSVGElementReserve 192 // bytes enough for any one path element, the longest being a curve's three points
+#define kDKSVGProgressInterval 4096 // objects written between progress notifications
+#define kDKSVGUnpainted NSUIntegerMax // the class of a style that paints nothing SVG can show
+
+typedef struct {
+	char* bytes;
+	size_t length;
+	size_t capacity;
+} DKSVGBuffer;
+
+typedef struct {
+	NSOutputStream* stream;
+	DKSVGBuffer root; // definitions and the top level of the document, written to the stream as it fills
+	DKSVGBuffer* out; // the root, or the content of the group being written
+	DKSVGBuffer scratch; // path data, until it's known whether the path is written or refers to an earlier one
+	long long unit; // 10 ^ decimal places
+	int places;
+	long long originX; // in units; what coordinates are written relative to
+	long long originY;
+	BOOL sharesPaths; // NO in a group, whose content must come out the same each time for the group to share its symbol
+	BOOL flipped;
+	BOOL failed;
+	CFMutableDictionaryRef styles; // style, not retained -> DKSVGStyleEntry
+	NSMutableDictionary* sharedPaths; // path data after the first point, and attributes -> DKSVGSharedPath
+	NSMutableDictionary* symbols; // group content -> identifier
+	NSMutableDictionary* clipPaths; // path data -> identifier
+	NSMutableDictionary* imageReferences; // image key -> href, or NSNull if the image couldn't be had
+	NSUInteger nextIdentifier;
+} DKSVGWriter;
+
+@interface DKSVGStyleEntry : NSObject {
+@public
+	NSUInteger mClass; // or kDKSVGUnpainted
+	NSArray* mTextAdornments;
+}
+@end
+
+@interface DKSVGSharedPath : NSObject {
+@public
+	NSUInteger mIdentifier;
+	long long mX; // the first point, as it was written
+	long long mY;
+}
+@end
+
+@implementation DKSVGStyleEntry
+
+- (void)dealloc
+{
+	[mTextAdornments release];
+	[super dealloc];
+}
+
+@end
+
+@implementation DKSVGSharedPath
+@end
+
+#pragma mark -
+
+static void reserveBuffer(DKSVGBuffer* b, size_t extra)
+{
+	if (b->length + extra <= b->capacity)
+		return;
+
+	size_t capacity = MAX(MAX(b->capacity * 2, b->length + extra), (size_t)4096);
+
+	b->bytes = realloc(b->bytes, capacity);
+	b->capacity = capacity;
+}
+
+static void appendBytes(DKSVGBuffer* b, const char* bytes, size_t length)
+{
+	reserveBuffer(b, length);
+	memcpy(b->bytes + b->length, bytes, length);
+	b->length += length;
+}
+
+static void appendCString(DKSVGBuffer* b, const char* s)
+{
+	appendBytes(b, s, strlen(s));
+}
+
+static void appendEscapedString(DKSVGBuffer* b, NSString* s)
+{
+	// escaped for an attribute value in double quotes
+
+	const char* c = [s UTF8String];
+
+	for (; c && *c; ++c) {
+		switch (*c) {
+		case '&':
+			appendCString(b, "&amp;");
+			break;
+
+		case '<':
+			appendCString(b, "&lt;");
+			break;
+
+		case '"':
+			appendCString(b, "&quot;");
+			break;
+
+		default:
+			appendBytes(b, c, 1);
+			break;
+		}
+	}
+}
+
+static char* appendInteger(char* p, unsigned long long n)
+{
+	char digits[24];
+	int count = 0;
+
+	do {
+		digits[count++] = '0' + (n % 10);
+		n /= 10;
+	} while (n);
+
+	while (count)
+		*p++ = digits[--count];
+
+	return p;
+}
+
+// writes <n> units of 10 ^ -<places>, with no zero before the point and none trailing after it, so 0.5 is ".5" and 2.50 is "2.5".
+// <fraction> is set if a point was written
+
+static char* appendFixed(char* p, long long n, int places, long long unit, BOOL* fraction)
+{
+	unsigned long long m = (unsigned long long)n;
+
+	if (n < 0) {
+		*p++ = '-';
+		m = -m;
+	}
+
+	unsigned long long whole = m / unit;
+	unsigned long long frac = m % unit;
+
+	if (whole != 0 || frac == 0)
+		p = appendInteger(p, whole);
+
+	if (fraction)
+		*fraction = (frac != 0);
+
+	if (frac != 0) {
+		char digits[kDKSVGMaximumDecimalPlaces];
+		int i, count = places;
+
+		for (i = places - 1; i >= 0; --i) {
+			digits[i] = '0' + (frac % 10);
+			frac /= 10;
+		}
+
+		while (digits[count - 1] == '0')
+			--count;
+
+		*p++ = '.';
+		memcpy(p, digits, count);
+		p += count;
+	}
+
+	return p;
+}
+
+static char* appendDouble(char* p, double v, int places)
+{
+	long long unit = 1;
+	int i;
+
+	for (i = 0; i < places; ++i)
+		unit *= 10;
+
+	return appendFixed(p, llround(v * unit), places, unit, NULL);
+}
+
+static char* appendIdentifier(char* p, char prefix, NSUInteger n)
+{
+	static const char digits[] = "0123456789abcdefghijklmnopqrstuvwxyz";
+	char reversed[16];
+	int count = 0;
+
+	do {
+		reversed[count++] = digits[n % 36];
+		n /= 36;
+	} while (n);
+
+	*p++ = prefix;
+
+	while (count)
+		*p++ = reversed[--count];
+
+	return p;
+}
+
+static void appendIdentifierToBuffer(DKSVGBuffer* b, char prefix, NSUInteger n)
+{
+	reserveBuffer(b, 16);
+	b->length = appendIdentifier(b->bytes + b->length, prefix, n) - b->bytes;
+}
+
+// writes an x and y in units as attributes, leaving them out if zero, as they are by default
+
+static void appendPosition(DKSVGWriter* w, DKSVGBuffer* b, long long x, long long y)
+{
+	reserveBuffer(b, 64);
+
+	char* p = b->bytes + b->length;
+
+	if (x != 0) {
+		p = stpcpy(p, " x=\"");
+		p = appendFixed(p, x, w->places, w->unit, NULL);
+		*p++ = '"';
+	}
+
+	if (y != 0) {
+		p = stpcpy(p, " y=\"");
+		p = appendFixed(p, y, w->places, w->unit, NULL);
+		*p++ = '"';
+	}
+
+	b->length = p - b->bytes;
+}
+
+static void appendMatrix(DKSVGWriter* w, DKSVGBuffer* b, NSAffineTransform* tfm)
+{
+	NSAffineTransformStruct ts = [tfm transformStruct];
+
+	reserveBuffer(b, 192);
+
+	char* p = stpcpy(b->bytes + b->length, " transform=\"matrix(");
+
+	p = appendDouble(p, ts.m11, kDKSVGMaximumDecimalPlaces);
+	*p++ = ' ';
+	p = appendDouble(p, ts.m12, kDKSVGMaximumDecimalPlaces);
+	*p++ = ' ';
+	p = appendDouble(p, ts.m21, kDKSVGMaximumDecimalPlaces);
+	*p++ = ' ';
+	p = appendDouble(p, ts.m22, kDKSVGMaximumDecimalPlaces);
+	*p++ = ' ';
+	p = appendFixed(p, llround(ts.tX * w->unit) - w->originX, w->places, w->unit, NULL);
+	*p++ = ' ';
+	p = appendFixed(p, llround(ts.tY * w->unit) - w->originY, w->places, w->unit, NULL);
+	p = stpcpy(p, ")\"");
+	b->length = p - b->bytes;
+}
+
+// writes a colour as #rgb or #rrggbb, returning NULL if it has no RGB equivalent, such as a pattern
+
+static char* appendColour(char* p, NSColor* colour, CGFloat* alpha)
+{
+	static const char hex[] = "0123456789abcdef";
+	NSColor* rgb = [colour colorUsingColorSpaceName:NSCalibratedRGBColorSpace];
+
+	if (rgb == nil)
+		return NULL;
+
+	CGFloat c[4];
+	unsigned v[3];
+	int i;
+
+	[rgb getRed:&c[0]
+		  green:&c[1]
+		   blue:&c[2]
+		  alpha:&c[3]];
+
+	for (i = 0; i < 3; ++i)
+		v[i] = (unsigned)LIMIT(lround(c[i] * 255.0), 0, 255);
+
+	*p++ = '#';
+
+	if ((v[0] >> 4) == (v[0] & 15) && (v[1] >> 4) == (v[1] & 15) && (v[2] >> 4) == (v[2] & 15)) {
+		for (i = 0; i < 3; ++i)
+			*p++ = hex[v[i] & 15];
+	} else {
+		for (i = 0; i < 3; ++i) {
+			*p++ = hex[v[i] >> 4];
+			*p++ = hex[v[i] & 15];
+		}
+	}
+
+	*alpha = c[3];
+	return p;
+}
+
+// the extension of image data browsers can show as it is, or nil
+
+static NSString* webImageExtension(NSData* data)
+{
+	const unsigned char* b = [data bytes];
+	NSUInteger length = [data length];
+
+	if (length >= 4 && memcmp(b, "\x89PNG", 4) == 0)
+		return @"png";
+
+	if (length >= 3 && b[0] == 0xFF && b[1] == 0xD8 && b[2] == 0xFF)
+		return @"jpg";
+
+	if (length >= 4 && memcmp(b, "GIF8", 4) == 0)
+		return @"gif";
+
+	return nil;
+}
+
+static void flushWriter(DKSVGWriter* w)
+{
+	const uint8_t* bytes = (const uint8_t*)w->root.bytes;
+	size_t remaining = w->root.length;
+
+	while (remaining > 0 && !w->failed) {
+		NSInteger written = [w->stream write:bytes
+								   maxLength:remaining];
+
+		if (written <= 0)
+			w->failed = YES;
+		else {
+			bytes += written;
+			remaining -= written;
+		}
+	}
+
+	w->root.length = 0;
+}
+
+static void postProgress(DKDrawing* drawing, double progress)
+{
+	NSDictionary* info = [NSDictionary dictionaryWithObject:[NSNumber numberWithDouble:MIN(progress, 1.0)]
+													 forKey:kDKDrawingExportProgressKey];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKDrawingExportProgressNotification
+														object:drawing
+													  userInfo:info];
+}
+
+#pragma mark -
+#pragma mark - path data
+
+typedef struct {
+	char* p;
+	long long unit;
+	int places;
+	BOOL separate; // a number written now needs something between it and the last
+	BOOL fraction; // the last number had a point, so one starting with a point needs nothing between them
+	char command; // the command a number written now belongs to without one of its own
+} DKSVGPathData;
+
+static void appendPathCommand(DKSVGPathData* d, char command)
+{
+	// a command that repeats the last can be left out, the numbers following on as another set of its arguments. A move's further
+	// arguments are lines though
+
+	if (command == d->command && command != 'M' && command != 'm' && command != 'z')
+		return;
+
+	*d->p++ = command;
+	d->separate = NO;
+	d->command = (command == 'm') ? 'l' : (command == 'M') ? 'L' : command;
+}
+
+static void appendPathNumber(DKSVGPathData* d, long long n)
+{
+	BOOL startsWithPoint = (n > 0 && n < d->unit);
+
+	if (d->separate && n >= 0 && !(d->fraction && startsWithPoint))
+		*d->p++ = ' ';
+
+	d->p = appendFixed(d->p, n, d->places, d->unit, &d->fraction);
+	d->separate = YES;
+}
+
+// writes a path's data to the scratch buffer, relative to the writer's origin, with every point after the first relative to the one
+// before. What follows the first point doesn't change when the path is moved, so the offset to it is returned, along with the first point
+
+static size_t writePathData(DKSVGWriter* w, NSBezierPath* path, long long* firstX, long long* firstY)
+{
+	DKSVGBuffer* b = &w->scratch;
+	DKSVGPathData d;
+	NSInteger i, count = [path elementCount];
+	NSPoint pts[3];
+	long long cx = 0, cy = 0, sx = 0, sy = 0;
+	long long x[3], y[3];
+	size_t rest = 0;
+	int j;
+
+	b->length = 0;
+	d.unit = w->unit;
+	d.places = w->places;
+	d.separate = NO;
+	d.fraction = NO;
+	d.command = 0;
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:pts];
+		int points = (element == NSCurveToBezierPathElement) ? 3 : (element == NSClosePathBezierPathElement) ? 0 : 1;
+
+		// points are rounded to units before taking the differences, so that rounding errors don't add up along the path
+
+		for (j = 0; j < points; ++j) {
+			x[j] = llround(pts[j].x * w->unit) - w->originX;
+			y[j] = llround(pts[j].y * w->unit) - w->originY;
+		}
+
+		reserveBuffer(b, kDKSVGElementReserve);
+		d.p = b->bytes + b->length;
+
+		switch (element) {
+		case NSMoveToBezierPathElement:
+			if (i == 0) {
+				appendPathCommand(&d, 'M');
+				appendPathNumber(&d, x[0]);
+				appendPathNumber(&d, y[0]);
+				*firstX = x[0];
+				*firstY = y[0];
+			} else {
+				appendPathCommand(&d, 'm');
+				appendPathNumber(&d, x[0] - cx);
+				appendPathNumber(&d, y[0] - cy);
+			}
+			cx = sx = x[0];
+			cy = sy = y[0];
+			break;
+
+		case NSLineToBezierPathElement:
+			if (y[0] == cy) {
+				appendPathCommand(&d, 'h');
+				appendPathNumber(&d, x[0] - cx);
+			} else if (x[0] == cx) {
+				appendPathCommand(&d, 'v');
+				appendPathNumber(&d, y[0] - cy);
+			} else {
+				appendPathCommand(&d, 'l');
+				appendPathNumber(&d, x[0] - cx);
+				appendPathNumber(&d, y[0] - cy);
+			}
+			cx = x[0];
+			cy = y[0];
+			break;
+
+		case NSCurveToBezierPathElement:
+			appendPathCommand(&d, 'c');
+
+			for (j = 0; j < 3; ++j) {
+				appendPathNumber(&d, x[j] - cx);
+				appendPathNumber(&d, y[j] - cy);
+			}
+			cx = x[2];
+			cy = y[2];
+			break;
+
+		case NSClosePathBezierPathElement:
+			appendPathCommand(&d, 'z');
+			cx = sx;
+			cy = sy;
+			break;
+
+		default:
+			break;
+		}
+
+		b->length = d.p - b->bytes;
+
+		if (i == 0)
+			rest = b->length;
+	}
+
+	return rest;
+}
+
+// writes a path element with some attributes, or a <use> of an earlier path with the same data and attributes
+
+static void writePath(DKSVGWriter* w, NSBezierPath* path, const char* attributes)
+{
+	if (path == nil || [path isEmpty])
+		return;
+
+	long long x = 0, y = 0;
+	size_t rest = writePathData(w, path, &x, &y);
+	DKSVGBuffer* b = &w->scratch;
+	DKSVGBuffer* out = w->out;
+	BOOL evenOdd = ([path windingRule] == NSEvenOddWindingRule);
+	size_t attributesLength = strlen(attributes);
+	size_t dataLength = b->length;
+	NSUInteger identifier = 0;
+
+	if (w->sharesPaths && dataLength - rest >= kDKSVGMinimumSharedPathLength) {
+		// the attributes are put after the data, so that they and the data after the first point are one run of bytes to look up
+
+		appendBytes(b, attributes, attributesLength);
+		appendBytes(b, evenOdd ? "e" : "n", 1);
+
+		NSData* key = [[NSData alloc] initWithBytesNoCopy:b->bytes + rest
+												   length:b->length - rest
+											 freeWhenDone:NO];
+		DKSVGSharedPath* shared = [w->sharedPaths objectForKey:key];
+
+		if (shared) {
+			[key release];
+			appendCString(out, "<use xlink:href=\"#");
+			appendIdentifierToBuffer(out, 'p', shared->mIdentifier);
+			appendCString(out, "\"");
+			appendPosition(w, out, x - shared->mX, y - shared->mY);
+			appendCString(out, "/>\n");
+			return;
+		}
+
+		NSData* copy = [[NSData alloc] initWithBytes:b->bytes + rest
+											  length:b->length - rest];
+		shared = [[DKSVGSharedPath alloc] init];
+		shared->mIdentifier = identifier = ++w->nextIdentifier;
+		shared->mX = x;
+		shared->mY = y;
+		[w->sharedPaths setObject:shared
+						   forKey:copy];
+		[shared release];
+		[copy release];
+		[key release];
+	}
+
+	appendCString(out, "<path");
+
+	if (identifier) {
+		appendCString(out, " id=\"");
+		appendIdentifierToBuffer(out, 'p', identifier);
+		appendCString(out, "\"");
+	}
+
+	appendBytes(out, attributes, attributesLength);
+
+	if (evenOdd)
+		appendCString(out, " fill-rule=\"evenodd\"");
+
+	appendCString(out, " d=\"");
+	appendBytes(out, b->bytes, dataLength);
+	appendCString(out, "\"/>\n");
+}
+
+// returns the identifier of a clip path, written with the definitions the first time it's used. Its data is relative to the current
+// origin, as is the content it clips, so the same clip for copies of a group is shared as well
+
+static NSUInteger clipPathIdentifier(DKSVGWriter* w, NSBezierPath* path)
+{
+	long long x, y;
+
+	writePathData(w, path, &x, &y);
+
+	NSData* key = [[NSData alloc] initWithBytesNoCopy:w->scratch.bytes
+											   length:w->scratch.length
+										 freeWhenDone:NO];
+	NSNumber* identifier = [w->clipPaths objectForKey:key];
+
+	if (identifier == nil) {
+		identifier = [NSNumber numberWithUnsignedInteger:++w->nextIdentifier];
+
+		NSData* copy = [[NSData alloc] initWithBytes:w->scratch.bytes
+											  length:w->scratch.length];
+		[w->clipPaths setObject:identifier
+						 forKey:copy];
+		[copy release];
+
+		appendCString(&w->root, "<clipPath id=\"");
+		appendIdentifierToBuffer(&w->root, 'c', [identifier unsignedIntegerValue]);
+		appendCString(&w->root, "\"><path");
+
+		if ([path windingRule] == NSEvenOddWindingRule)
+			appendCString(&w->root, " clip-rule=\"evenodd\"");
+
+		appendCString(&w->root, " d=\"");
+		appendBytes(&w->root, w->scratch.bytes, w->scratch.length);
+		appendCString(&w->root, "\"/></clipPath>\n");
+	}
+
+	[key release];
+	return [identifier unsignedIntegerValue];
+}
+
+static void appendClipGroup(DKSVGBuffer* b, NSUInteger clip)
+{
+	appendCString(b, "<g clip-path=\"url(#");
+	appendIdentifierToBuffer(b, 'c', clip);
+	appendCString(b, ")\">");
+}
+
+// finds the renderers of a style that can be written. The topmost fill and stroke are the ones that show, so are the last of each
+
+static void collectRenderers(DKRastGroup* group, NSColor** fillColour, DKStroke** stroke, NSMutableArray* adornments)
+{
+	NSEnumerator* iter = [[group renderList] objectEnumerator];
+	DKRasterizer* rast;
+
+	while ((rast = [iter nextObject])) {
+		if (![rast enabled])
+			continue;
+
+		if ([rast isKindOfClass:[DKRastGroup class]])
+			collectRenderers((DKRastGroup*)rast, fillColour, stroke, adornments);
+		else if ([rast isKindOfClass:[DKFill class]]) {
+			DKGradient* gradient = [(DKFill*)rast gradient];
+			NSColor* colour = gradient ? [gradient colorAtValue:0.5] : [(DKFill*)rast colour];
+
+			if (colour && [colour colorUsingColorSpaceName:NSCalibratedRGBColorSpace])
+				*fillColour = colour;
+		} else if ([rast isKindOfClass:[DKStroke class]]) {
+			if ([(DKStroke*)rast colour] && [(DKStroke*)rast width] > 0.0)
+				*stroke = (DKStroke*)rast;
+		} else if ([rast isKindOfClass:[DKTextAdornment class]])
+			[adornments addObject:rast];
+	}
+}
+
+#pragma mark -
+
+@interface DKSVGExporter (Private)
+
+- (DKSVGStyleEntry*)entryForStyle:(DKStyle*)style writer:(DKSVGWriter*)w;
+- (void)writeObject:(DKDrawableObject*)obj writer:(DKSVGWriter*)w;
+- (void)writeGroup:(DKShapeGroup*)group writer:(DKSVGWriter*)w;
+- (void)writeImageOfShape:(DKImageShape*)shape writer:(DKSVGWriter*)w;
+- (void)writeTextOfAdornment:(DKTextAdornment*)adornment object:(DKDrawableObject*)obj writer:(DKSVGWriter*)w;
+- (NSString*)referenceToImageWithKey:(NSString*)key writer:(DKSVGWriter*)w;
+- (NSString*)writeImageWithKey:(NSString*)key;
+
+@end
+
+#pragma mark -
+
+@implementation DKSVGExporter
+#pragma mark As a DKSVGExporter
+
+- (id)initWithDrawing:(DKDrawing*)drawing layers:(NSArray*)layers
+{
+	NSAssert(drawing != nil, @"can't export a nil drawing");
+
+	self = [super init];
+	if (self) {
+		mDrawing = [drawing retain];
+		mLayers = [layers copy];
+		mDecimalPlaces = kDKSVGDefaultDecimalPlaces;
+	}
+
+	return self;
+}
+
+- (DKDrawing*)drawing
+{
+	return mDrawing;
+}
+
+- (void)setDecimalPlaces:(NSUInteger)places
+{
+	mDecimalPlaces = MIN(places, (NSUInteger)kDKSVGMaximumDecimalPlaces);
+}
+
+- (NSUInteger)decimalPlaces
+{
+	return mDecimalPlaces;
+}
+
+- (void)setImageDirectoryURL:(NSURL*)url
+{
+	[url retain];
+	[mImageDirectoryURL release];
+	mImageDirectoryURL = url;
+}
+
+- (NSURL*)imageDirectoryURL
+{
+	return mImageDirectoryURL;
+}
+
+- (void)setImageReferencePrefix:(NSString*)prefix
+{
+	[prefix retain];
+	[mImageReferencePrefix release];
+	mImageReferencePrefix = prefix;
+}
+
+- (NSString*)imageReferencePrefix
+{
+	return mImageReferencePrefix;
+}
+
+- (BOOL)writeToStream:(NSOutputStream*)stream
+{
+	NSAssert(stream != nil, @"can't write SVG to a nil stream");
+
+	if ([stream streamStatus] == NSStreamStatusNotOpen)
+		[stream open];
+
+	DKSVGWriter w;
+	NSUInteger i;
+
+	memset(&w, 0, sizeof(w));
+	w.stream = stream;
+	w.out = &w.root;
+	w.places = (int)mDecimalPlaces;
+	w.unit = 1;
+	w.sharesPaths = YES;
+	w.flipped = [mDrawing isFlipped];
+	w.styles = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+	w.sharedPaths = [[NSMutableDictionary alloc] init];
+	w.symbols = [[NSMutableDictionary alloc] init];
+	w.clipPaths = [[NSMutableDictionary alloc] init];
+	w.imageReferences = [[NSMutableDictionary alloc] init];
+
+	for (i = 0; i < mDecimalPlaces; ++i)
+		w.unit *= 10;
+
+	NSSize size = [mDrawing drawingSize];
+	char* p;
+
+	reserveBuffer(&w.root, 512);
+	p = stpcpy(w.root.bytes, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n<svg xmlns=\"http://www.w3.org/2000/svg\" "
+							 "xmlns:xlink=\"http://www.w3.org/1999/xlink\" width=\"");
+	p = appendDouble(p, size.width, w.places);
+	p = stpcpy(p, "\" height=\"");
+	p = appendDouble(p, size.height, w.places);
+	p = stpcpy(p, "\" viewBox=\"0 0 ");
+	p = appendDouble(p, size.width, w.places);
+	*p++ = ' ';
+	p = appendDouble(p, size.height, w.places);
+	p = stpcpy(p, "\">\n");
+
+	CGFloat alpha = 0.0;
+
+	if ([mDrawing paperColourIsPrinted] && [mDrawing paperColour]) {
+		char* colourStart = stpcpy(p, "<rect width=\"100%\" height=\"100%\" fill=\"");
+		char* colourEnd = appendColour(colourStart, [mDrawing paperColour], &alpha);
+
+		if (colourEnd && alpha > 0.0) {
+			p = colourEnd;
+
+			if (alpha < 1.0) {
+				p = stpcpy(p, "\" fill-opacity=\"");
+				p = appendDouble(p, alpha, 3);
+			}
+
+			p = stpcpy(p, "\"/>\n");
+		}
+	}
+
+	// SVG's y axis goes down the page, as a flipped drawing's does, so an unflipped drawing is turned over as a whole
+
+	if (!w.flipped) {
+		p = stpcpy(p, "<g transform=\"matrix(1 0 0 -1 0 ");
+		p = appendDouble(p, size.height, w.places);
+		p = stpcpy(p, ")\">\n");
+	}
+
+	w.root.length = p - w.root.bytes;
+
+	NSEnumerator* iter = [mLayers objectEnumerator];
+	DKLayer* layer;
+	NSUInteger total = 0, done = 0;
+
+	while ((layer = [iter nextObject])) {
+		if ([layer isKindOfClass:[DKObjectOwnerLayer class]])
+			total += [(DKObjectOwnerLayer*)layer countOfObjects];
+	}
+
+	iter = [mLayers objectEnumerator];
+
+	while ((layer = [iter nextObject]) && !w.failed) {
+		if (![layer isKindOfClass:[DKObjectOwnerLayer class]])
+			continue;
+
+		appendCString(&w.root, "<g data-layer=\"");
+		appendEscapedString(&w.root, [layer layerName]);
+		appendCString(&w.root, "\">\n");
+
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		NSEnumerator* objIter = [[(DKObjectOwnerLayer*)layer objects] objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [objIter nextObject]) && !w.failed) {
+			[self writeObject:obj
+					   writer:&w];
+
+			if (w.root.length >= kDKSVGFlushThreshold)
+				flushWriter(&w);
+
+			if (++done % kDKSVGProgressInterval == 0) {
+				postProgress(mDrawing, (double)done / total);
+				[pool drain];
+				pool = [[NSAutoreleasePool alloc] init];
+			}
+		}
+
+		[pool drain];
+		appendCString(&w.root, "</g>\n");
+	}
+
+	if (!w.flipped)
+		appendCString(&w.root, "</g>\n");
+
+	appendCString(&w.root, "</svg>\n");
+	flushWriter(&w);
+
+	CFRelease(w.styles);
+	[w.sharedPaths release];
+	[w.symbols release];
+	[w.clipPaths release];
+	[w.imageReferences release];
+	free(w.root.bytes);
+	free(w.scratch.bytes);
+
+	postProgress(mDrawing, 1.0);
+
+	return !w.failed;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mDrawing release];
+	[mLayers release];
+	[mImageDirectoryURL release];
+	[mImageReferencePrefix release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKSVGExporter (Private)
+
+- (DKSVGStyleEntry*)entryForStyle:(DKStyle*)style writer:(DKSVGWriter*)w
+{
+	if (style == nil)
+		return nil;
+
+	DKSVGStyleEntry* entry = (DKSVGStyleEntry*)CFDictionaryGetValue(w->styles, style);
+
+	if (entry)
+		return entry;
+
+	NSColor* fillColour = nil;
+	DKStroke* stroke = nil;
+	NSMutableArray* adornments = [NSMutableArray array];
+	CGFloat fillAlpha = 0.0, strokeAlpha = 0.0;
+	char fill[8], strokeColour[8];
+	char* fillEnd = NULL;
+	char* strokeEnd = NULL;
+
+	collectRenderers(style, &fillColour, &stroke, adornments);
+
+	if (fillColour)
+		fillEnd = appendColour(fill, fillColour, &fillAlpha);
+
+	if (stroke)
+		strokeEnd = appendColour(strokeColour, [stroke colour], &strokeAlpha);
+
+	if (fillAlpha <= 0.0)
+		fillEnd = NULL;
+
+	if (strokeAlpha <= 0.0)
+		strokeEnd = NULL;
+
+	entry = [[DKSVGStyleEntry alloc] init];
+	entry->mTextAdornments = [adornments copy];
+	entry->mClass = kDKSVGUnpainted;
+
+	if (fillEnd || strokeEnd) {
+		// the rule goes with the definitions, since a class applies wherever the rule is in the document
+
+		DKSVGBuffer* b = &w->root;
+		CGFloat dashes[8];
+		NSInteger i, dashCount = 0;
+
+		if ([stroke dash]) {
+			[[stroke dash] getDashPattern:dashes
+									count:&dashCount];
+			dashCount = MIN(dashCount, (NSInteger)8);
+		}
+
+		entry->mClass = ++w->nextIdentifier;
+		reserveBuffer(b, 384 + dashCount * 24);
+
+		char* p = stpcpy(b->bytes + b->length, "<style>.");
+
+		p = appendIdentifier(p, 's', entry->mClass);
+		p = stpcpy(p, "{fill:");
+
+		if (fillEnd) {
+			memcpy(p, fill, fillEnd - fill);
+			p += fillEnd - fill;
+
+			if (fillAlpha < 1.0) {
+				p = stpcpy(p, ";fill-opacity:");
+				p = appendDouble(p, fillAlpha, 3);
+			}
+		} else
+			p = stpcpy(p, "none");
+
+		if (strokeEnd) {
+			CGFloat width = [stroke width];
+
+			p = stpcpy(p, ";stroke:");
+			memcpy(p, strokeColour, strokeEnd - strokeColour);
+			p += strokeEnd - strokeColour;
+
+			if (strokeAlpha < 1.0) {
+				p = stpcpy(p, ";stroke-opacity:");
+				p = appendDouble(p, strokeAlpha, 3);
+			}
+
+			if (width != 1.0) {
+				p = stpcpy(p, ";stroke-width:");
+				p = appendDouble(p, width, w->places);
+			}
+
+			if (dashCount > 0) {
+				CGFloat scale = [[stroke dash] scalesToLineWidth] ? width : 1.0;
+
+				p = stpcpy(p, ";stroke-dasharray:");
+
+				for (i = 0; i < dashCount; ++i) {
+					if (i > 0)
+						*p++ = ' ';
+					p = appendDouble(p, dashes[i] * scale, w->places);
+				}
+
+				if ([[stroke dash] phase] != 0.0) {
+					p = stpcpy(p, ";stroke-dashoffset:");
+					p = appendDouble(p, [[stroke dash] phase] * scale, w->places);
+				}
+			}
+
+			if ([stroke lineCapStyle] == NSRoundLineCapStyle)
+				p = stpcpy(p, ";stroke-linecap:round");
+			else if ([stroke lineCapStyle] == NSSquareLineCapStyle)
+				p = stpcpy(p, ";stroke-linecap:square");
+
+			if ([stroke lineJoinStyle] == NSRoundLineJoinStyle)
+				p = stpcpy(p, ";stroke-linejoin:round");
+			else if ([stroke lineJoinStyle] == NSBevelLineJoinStyle)
+				p = stpcpy(p, ";stroke-linejoin:bevel");
+			else if ([stroke miterLimit] != 4.0) {
+				p = stpcpy(p, ";stroke-miterlimit:");
+				p = appendDouble(p, MAX([stroke miterLimit], 1.0), 3);
+			}
+		}
+
+		p = stpcpy(p, "}</style>\n");
+		b->length = p - b->bytes;
+	}
+
+	CFDictionarySetValue(w->styles, style, entry);
+	[entry release];
+
+	return entry;
+}
+
+- (void)writeObject:(DKDrawableObject*)obj writer:(DKSVGWriter*)w
+{
+	if (![obj visible])
+		return;
+
+	if ([obj isKindOfClass:[DKShapeGroup class]]) {
+		[self writeGroup:(DKShapeGroup*)obj
+				  writer:w];
+		return;
+	}
+
+	DKSVGStyleEntry* entry = [self entryForStyle:[obj style]
+										  writer:w];
+	DKImageShape* imageShape = [obj isKindOfClass:[DKImageShape class]] ? (DKImageShape*)obj : nil;
+
+	if (imageShape && ![imageShape imageDrawsOnTop])
+		[self writeImageOfShape:imageShape
+						 writer:w];
+
+	if (entry && entry->mClass != kDKSVGUnpainted) {
+		char attributes[32];
+		char* p = stpcpy(attributes, " class=\"");
+
+		p = appendIdentifier(p, 's', entry->mClass);
+		*p++ = '"';
+		*p = 0;
+
+		writePath(w, [obj renderingPath], attributes);
+	}
+
+	if (imageShape && [imageShape imageDrawsOnTop])
+		[self writeImageOfShape:imageShape
+						 writer:w];
+
+	// text shapes and text paths have a text adornment of their own, drawn over their style
+
+	if ([obj isKindOfClass:[DKTextShape class]] || [obj isKindOfClass:[DKTextPath class]])
+		[self writeTextOfAdornment:[(DKTextShape*)obj textAdornment]
+							object:obj
+							writer:w];
+
+	NSEnumerator* iter = [(entry ? entry->mTextAdornments : nil) objectEnumerator];
+	DKTextAdornment* adornment;
+
+	while ((adornment = [iter nextObject]))
+		[self writeTextOfAdornment:adornment
+							object:obj
+							writer:w];
+}
+
+- (void)writeGroup:(DKShapeGroup*)group writer:(DKSVGWriter*)w
+{
+	DKSVGBuffer* parent = w->out;
+	DKSVGBuffer content = { NULL, 0, 0 };
+	long long originX = w->originX, originY = w->originY;
+	BOOL sharesPaths = w->sharesPaths;
+	BOOL visual = [group transformsVisually];
+	long long x = 0, y = 0;
+
+	// the content is written relative to the group's location, so that it comes out the same for copies of the group moved elsewhere.
+	// A group that transforms visually has its content in its own coordinates already, and its transform goes on the <use>
+
+	if (!visual) {
+		NSPoint loc = [group location];
+
+		x = llround(loc.x * w->unit);
+		y = llround(loc.y * w->unit);
+	}
+
+	w->out = &content;
+	w->originX = x;
+	w->originY = y;
+	w->sharesPaths = NO;
+
+	NSEnumerator* iter = [[group groupObjects] objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject]))
+		[self writeObject:obj
+				   writer:w];
+
+	w->out = parent;
+	w->originX = originX;
+	w->originY = originY;
+	w->sharesPaths = sharesPaths;
+
+	if (content.length == 0) {
+		free(content.bytes);
+		return;
+	}
+
+	NSData* key = [[NSData alloc] initWithBytesNoCopy:content.bytes
+											   length:content.length
+										 freeWhenDone:NO];
+	NSNumber* identifier = [w->symbols objectForKey:key];
+
+	if (identifier == nil) {
+		identifier = [NSNumber numberWithUnsignedInteger:++w->nextIdentifier];
+
+		NSData* copy = [[NSData alloc] initWithBytes:content.bytes
+											  length:content.length];
+		[w->symbols setObject:identifier
+					   forKey:copy];
+		[copy release];
+
+		// symbols go with the definitions rather than the content of an enclosing group, so that content is the same for every copy
+
+		appendCString(&w->root, "<symbol id=\"");
+		appendIdentifierToBuffer(&w->root, 'y', [identifier unsignedIntegerValue]);
+		appendCString(&w->root, "\" overflow=\"visible\">\n");
+		appendBytes(&w->root, content.bytes, content.length);
+		appendCString(&w->root, "</symbol>\n");
+	}
+
+	[key release];
+	free(content.bytes);
+
+	NSUInteger clip = [group clipContentToPath] ? clipPathIdentifier(w, [group renderingPath]) : 0;
+
+	if (clip)
+		appendClipGroup(parent, clip);
+
+	appendCString(parent, "<use xlink:href=\"#");
+	appendIdentifierToBuffer(parent, 'y', [identifier unsignedIntegerValue]);
+	appendCString(parent, "\"");
+
+	if (visual)
+		appendMatrix(w, parent, [group contentTransform]);
+	else
+		appendPosition(w, parent, x - originX, y - originY);
+
+	appendCString(parent, clip ? "/></g>\n" : "/>\n");
+}
+
+- (void)writeImageOfShape:(DKImageShape*)shape writer:(DKSVGWriter*)w
+{
+	NSString* key = [shape imageKey];
+
+	if (key == nil || [shape image] == nil)
+		return;
+
+	NSString* href = [self referenceToImageWithKey:key
+											writer:w];
+
+	if (href == nil)
+		return;
+
+	NSRect ir = [shape imageDrawingRect];
+	NSAffineTransform* tfm = [shape imageDrawingTransform];
+
+	// an image is drawn the right way up in its own coordinates, which in an unflipped drawing have been turned over with the rest
+
+	if (!w->flipped) {
+		NSAffineTransform* turn = [NSAffineTransform transform];
+
+		[turn translateXBy:0.0
+					   yBy:NSMinY(ir) + NSMaxY(ir)];
+		[turn scaleXBy:1.0
+				   yBy:-1.0];
+		[turn appendTransform:tfm];
+		tfm = turn;
+	}
+
+	DKSVGBuffer* out = w->out;
+	NSUInteger clip = clipPathIdentifier(w, [shape transformedPath]);
+	char* p;
+
+	appendClipGroup(out, clip);
+	appendCString(out, "<image preserveAspectRatio=\"none\"");
+
+	if ([shape imageOpacity] < 1.0) {
+		reserveBuffer(out, 32);
+		p = stpcpy(out->bytes + out->length, " opacity=\"");
+		p = appendDouble(p, [shape imageOpacity], 3);
+		*p++ = '"';
+		out->length = p - out->bytes;
+	}
+
+	reserveBuffer(out, 128);
+	p = stpcpy(out->bytes + out->length, " x=\"");
+	p = appendDouble(p, NSMinX(ir), w->places);
+	p = stpcpy(p, "\" y=\"");
+	p = appendDouble(p, NSMinY(ir), w->places);
+	p = stpcpy(p, "\" width=\"");
+	p = appendDouble(p, NSWidth(ir), w->places);
+	p = stpcpy(p, "\" height=\"");
+	p = appendDouble(p, NSHeight(ir), w->places);
+	*p++ = '"';
+	out->length = p - out->bytes;
+
+	appendMatrix(w, out, tfm);
+	appendCString(out, " xlink:href=\"");
+	appendEscapedString(out, href);
+	appendCString(out, "\"/></g>\n");
+}
+
+- (void)writeTextOfAdornment:(DKTextAdornment*)adornment object:(DKDrawableObject*)obj writer:(DKSVGWriter*)w
+{
+	if (adornment == nil || ![adornment enabled])
+		return;
+
+	NSBezierPath* path = [adornment textAsPathForObject:obj];
+
+	if (path == nil || [path isEmpty])
+		return;
+
+	NSColor* colour = [adornment colour] ? [adornment colour] : [NSColor blackColor];
+	char attributes[48];
+	CGFloat alpha = 0.0;
+	char* p = stpcpy(attributes, " fill=\"");
+
+	p = appendColour(p, colour, &alpha);
+
+	if (p == NULL || alpha <= 0.0)
+		return;
+
+	*p++ = '"';
+
+	if (alpha < 1.0) {
+		p = stpcpy(p, " fill-opacity=\"");
+		p = appendDouble(p, alpha, 3);
+		*p++ = '"';
+	}
+
+	*p = 0;
+
+	writePath(w, path, attributes);
+}
+
+- (NSString*)referenceToImageWithKey:(NSString*)key writer:(DKSVGWriter*)w
+{
+	id reference = [w->imageReferences objectForKey:key];
+
+	if (reference == nil) {
+		reference = [self writeImageWithKey:key];
+
+		if (reference == nil)
+			reference = [NSNull null];
+
+		[w->imageReferences setObject:reference
+							   forKey:key];
+	}
+
+	return (reference == [NSNull null]) ? nil : reference;
+}
+
+- (NSString*)writeImageWithKey:(NSString*)key
+{
+	NSData* data = [[mDrawing imageManager] imageDataForKey:key];
+
+	if (data == nil)
+		return nil;
+
+	NSString* extension = webImageExtension(data);
+	NSString* name = [key stringByAppendingPathExtension:extension ? extension : @"png"];
+
+	if (mImageDirectoryURL) {
+		// browsers can't show TIFF or PDF, so anything that isn't already in a format they can is written as PNG
+
+		if (extension == nil) {
+			NSBitmapImageRep* rep = [NSBitmapImageRep imageRepWithData:data];
+
+			if (rep == nil) {
+				NSImage* image = [[NSImage alloc] initWithData:data];
+
+				rep = [NSBitmapImageRep imageRepWithData:[image TIFFRepresentation]];
+				[image release];
+			}
+
+			data = [rep representationUsingType:NSPNGFileType
+									 properties:[NSDictionary dictionary]];
+
+			if (data == nil)
+				return nil;
+		}
+
+		if (![[NSFileManager defaultManager] createDirectoryAtURL:mImageDirectoryURL
+									  withIntermediateDirectories:YES
+													   attributes:nil
+															error:NULL])
+			return nil;
+
+		if (![data writeToURL:[mImageDirectoryURL URLByAppendingPathComponent:name]
+				   atomically:NO])
+			return nil;
+	}
+
+	NSString* reference = [name stringByAddingPercentEscapesUsingEncoding:NSUTF8StringEncoding];
+
+	return mImageReferencePrefix ? [mImageReferencePrefix stringByAppendingString:reference] : reference;
+}
+
+@end
@@ -0,0 +1,81 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+/// opaque type used internally by the table
+
+typedef struct _DKScanlineEdge DKScanlineEdge;
+
+/** @brief Finds where horizontal lines cross a path, for flowing text into it.
+
+ -[NSBezierPath intersectingPointsWithHorizontalLineAtY:] flattens the path and intersects every element with the line on each call, so
+ laying out a long text in a shape costs the number of lines times the number of elements, and the path is flattened once per line. An
+ edge table flattens the path once and keeps its edges sorted by their top. Lines are then found with an active edge list: moving down
+ to the next line adds the edges that start above it and drops those that end above it, so each line costs only the edges it crosses,
+ plus sorting their crossings. Lines may be asked for in any order, but laying them out top to bottom, as the text system does, is what
+ makes the walk incremental; moving back up starts it again from the top.
+
+ Each edge holds the points with y from its top up to but not including its bottom, so a line through a vertex where two edges meet
+ crosses only one of them. The table is a snapshot; it does not track later changes to the path.
+*/
+@interface DKScanlineEdgeTable : NSObject {
+@private
+	DKScanlineEdge* mEdges; // sorted by their top
+	NSUInteger mEdgeCount;
+	NSUInteger* mActive; // the edges crossing the last line asked for
+	NSUInteger mActiveCount;
+	NSUInteger mNextEdge; // the first edge not yet made active
+	CGFloat mLastY;
+	CGFloat* mCrossings;
+	NSUInteger mChecksum;
+}
+
+/** @brief Returns a new table for the path, flattened to kDKScanlineEdgeTableFlatness
+ @param path the path
+ @return an autoreleased edge table
+ */
++ (DKScanlineEdgeTable*)edgeTableWithPath:(NSBezierPath*)path;
+
+/** @brief Initializes the table from the path's edges
+
+ Subpaths are not closed implicitly, as -intersectingPointsWithHorizontalLineAtY: doesn't close them.
+ @param path the path
+ @param flatness the flatness its curves are flattened to
+ @return the table
+ */
+- (id)initWithPath:(NSBezierPath*)path flatness:(CGFloat)flatness;
+
+/** @brief The checksum of the path when the table was built
+ @return the path's checksum
+ */
+- (NSUInteger)checksum;
+
+/** @brief Finds where a horizontal line crosses the path
+ @param crossings receives the x positions of the crossings, sorted from left to right. Owned by the table, and only valid until it's
+ next asked for a line
+ @param y the position of the line
+ @return the number of crossings, which is always even
+ */
+- (NSUInteger)getCrossings:(const CGFloat**)crossings atY:(CGFloat)y;
+
+/** @brief As -[NSBezierPath intersectingPointsWithHorizontalLineAtY:]
+ @param y the position of the line
+ @return a list of NSValues containing NSPoints, or nil if the line doesn't cross the path
+ */
+- (NSArray*)intersectingPointsWithHorizontalLineAtY:(CGFloat)y;
+
+/** @brief As -[NSBezierPath lineFragmentRectForProposedRect:remainingRect:datumOffset:]
+ @param aRect the proposed rectangle
+ @param rem if not NULL, receives the rest of the proposed rect after the fragment
+ @param dOffset a value between +0.5 and -0.5 that represents the relative position within the line used
+ @return the available rectangle for the text given the proposed rect
+ */
+- (NSRect)lineFragmentRectForProposedRect:(NSRect)aRect remainingRect:(NSRect*)rem datumOffset:(CGFloat)dOffset;
+
+@end
+
+#define kDKScanlineEdgeTableFlatness 5.0 // as coarse as -intersectingPointsWithHorizontalLineAtY: flattens to, which is plenty for text layout
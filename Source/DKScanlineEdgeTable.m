@@ -0,0 +1,200 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKScanlineEdgeTable.h"
+#import "DKDrawKitMacros.h"
+#import "NSBezierPath+Editing.h"
+#import "NSBezierPath+Geometry.h"
+
+// a straight edge of the flattened path, holding the points with y from <top> up to but not including <bottom>
+
+struct _DKScanlineEdge {
+	CGFloat top;
+	CGFloat bottom;
+	CGFloat x; // at the top
+	CGFloat slope; // the change in x for each unit of y
+};
+
+static int CompareEdgeTops(const void* a, const void* b)
+{
+	CGFloat ta = ((const DKScanlineEdge*)a)->top;
+	CGFloat tb = ((const DKScanlineEdge*)b)->top;
+
+	return (ta < tb) ? -1 : ((ta > tb) ? 1 : 0);
+}
+
+static void SortCrossings(CGFloat* x, NSUInteger count)
+{
+	// an insertion sort, as the crossings of one line are few and come out of the active list nearly in order from the line before
+
+	NSUInteger i, j;
+
+	for (i = 1; i < count; ++i) {
+		CGFloat v = x[i];
+
+		for (j = i; j > 0 && x[j - 1] > v; --j)
+			x[j] = x[j - 1];
+
+		x[j] = v;
+	}
+}
+
+@implementation DKScanlineEdgeTable
+
++ (DKScanlineEdgeTable*)edgeTableWithPath:(NSBezierPath*)path
+{
+	return [[[self alloc] initWithPath:path
+							  flatness:kDKScanlineEdgeTableFlatness] autorelease];
+}
+
+- (id)initWithPath:(NSBezierPath*)path flatness:(CGFloat)flatness
+{
+	self = [super init];
+	if (self) {
+		NSBezierPath* flat = [path bezierPathByFlatteningPathWithFlatness:flatness];
+		NSInteger i, m = [flat elementCount];
+		NSPoint ap[3], fp = NSZeroPoint, lp = NSZeroPoint;
+
+		mChecksum = [path checksum];
+		mEdges = malloc(MAX(m, 1) * sizeof(DKScanlineEdge));
+
+		for (i = 0; i < m; ++i) {
+			NSBezierPathElement element = [flat elementAtIndex:i
+											  associatedPoints:ap];
+
+			if (element == NSMoveToBezierPathElement) {
+				fp = lp = ap[0];
+				continue;
+			}
+
+			if (element == NSClosePathBezierPathElement)
+				ap[0] = fp;
+
+			// horizontal edges are never crossed by a horizontal line, only touched at their ends by the edges either side
+
+			if (ap[0].y != lp.y) {
+				NSPoint a = (lp.y < ap[0].y) ? lp : ap[0];
+				NSPoint b = (lp.y < ap[0].y) ? ap[0] : lp;
+				DKScanlineEdge* edge = &mEdges[mEdgeCount++];
+
+				edge->top = a.y;
+				edge->bottom = b.y;
+				edge->x = a.x;
+				edge->slope = (b.x - a.x) / (b.y - a.y);
+			}
+
+			lp = ap[0];
+		}
+
+		qsort(mEdges, mEdgeCount, sizeof(DKScanlineEdge), CompareEdgeTops);
+
+		mActive = malloc(MAX(mEdgeCount, 1) * sizeof(NSUInteger));
+		mCrossings = malloc(MAX(mEdgeCount, 1) * sizeof(CGFloat));
+		mLastY = -HUGE_VAL;
+	}
+
+	return self;
+}
+
+- (NSUInteger)checksum
+{
+	return mChecksum;
+}
+
+- (NSUInteger)getCrossings:(const CGFloat**)crossings atY:(CGFloat)y
+{
+	NSUInteger i, kept = 0;
+
+	// going back up means the edges already dropped may be needed again
+
+	if (y < mLastY) {
+		mActiveCount = 0;
+		mNextEdge = 0;
+	}
+
+	mLastY = y;
+
+	while (mNextEdge < mEdgeCount && mEdges[mNextEdge].top <= y)
+		mActive[mActiveCount++] = mNextEdge++;
+
+	for (i = 0; i < mActiveCount; ++i) {
+		const DKScanlineEdge* edge = &mEdges[mActive[i]];
+
+		if (edge->bottom > y) {
+			mCrossings[kept] = edge->x + (y - edge->top) * edge->slope;
+			mActive[kept++] = mActive[i];
+		}
+	}
+
+	mActiveCount = kept;
+	SortCrossings(mCrossings, kept);
+
+	// an open subpath can leave one crossing without a partner - like -intersectingPointsWithHorizontalLineAtY:, the last is dropped
+
+	if (crossings)
+		*crossings = mCrossings;
+
+	return kept & ~(NSUInteger)1;
+}
+
+- (NSArray*)intersectingPointsWithHorizontalLineAtY:(CGFloat)y
+{
+	const CGFloat* x;
+	NSUInteger i, count = [self getCrossings:&x
+										 atY:y];
+
+	if (count == 0)
+		return nil;
+
+	NSMutableArray* result = [NSMutableArray arrayWithCapacity:count];
+
+	for (i = 0; i < count; ++i)
+		[result addObject:[NSValue valueWithPoint:NSMakePoint(x[i], y)]];
+
+	return result;
+}
+
+- (NSRect)lineFragmentRectForProposedRect:(NSRect)aRect remainingRect:(NSRect*)rem datumOffset:(CGFloat)dOffset
+{
+	CGFloat od = LIMIT(dOffset, -0.5, +0.5) + 0.5;
+	CGFloat y = NSMinY(aRect) + (od * NSHeight(aRect));
+	const CGFloat* x;
+	NSUInteger i, count = [self getCrossings:&x
+										 atY:y];
+
+	// the first span starting at or after the proposed rect's left edge is the fragment, and the rest of the rect is what remains
+
+	for (i = 0; i < count; i += 2) {
+		if (x[i] >= NSMinX(aRect)) {
+			NSRect result = NSMakeRect(x[i], NSMinY(aRect), x[i + 1] - x[i], NSHeight(aRect));
+
+			if (rem != nil) {
+				aRect.origin.x = x[i + 1];
+				*rem = aRect;
+			}
+
+			return result;
+		}
+	}
+
+	if (rem != nil)
+		*rem = NSZeroRect;
+
+	return NSZeroRect;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	free(mEdges);
+	free(mActive);
+	free(mCrossings);
+	[super dealloc];
+}
+
+@end
@@ -7,7 +7,7 @@
 #import "DKDrawingTool.h"
 #import "DKRasterizerProtocol.h"
 
-@class DKDrawingView, DKStyle, DKObjectDrawingLayer;
+@class DKDrawingView, DKStyle, DKObjectDrawingLayer, DKQuartzCache;
 
 // modes of operation determined by what was hit and what is in the selection
 
@@ -58,10 +58,14 @@ has a very low opacity should be used - the default style takes the system's hig
 	CGFloat mViewScale; // the view's current scale, valid for the renderingPath callback
 	NSUInteger mProxyDragThreshold; // number of objects in the selection where a proxy drag is used; 0 = never do a proxy drag
 	BOOL mInProxyDrag; // YES during a proxy drag
-	NSImage* mProxyDragImage; // the proxy image being dragged
+	DKQuartzCache* mProxyDragCache; // the proxy being dragged, rendered at device resolution
 	NSRect mProxyDragDestRect; // where it is drawn
+	CGFloat mProxyDeviceScale; // the device scale the proxy was rendered at
+	NSUInteger mProxyChecksum; // identifies the objects and content the proxy shows, so it can be reused for later drags
+	DKObjectDrawingLayer* mProxyLayerRef; // layer whose objects are being proxy dragged (weak)
 	NSArray* mDraggedObjects; // cache of objects being dragged
 	BOOL mWasInLockedObject; // YES if initial mouse down was in a locked object
+	NSMutableSet* mMarqueeObjects; // the objects touched by the marquee, while selecting
 }
 
 /** @brief Returns the default style to use for drawing the selection marquee
@@ -200,13 +204,28 @@ has a very low opacity should be used - the default style takes the system's hig
  The default method creates the image by asking the layer to make one using its standard imaging
  methods. You can override this for different approaches. Typically the drag image has the bounds of
  the selected objects - the caller will position the image based on that assumption. This is only
- invoked if the proxy drag threshold was exceeded and not zero.
+ invoked if the proxy drag threshold was exceeded and not zero, and only if a subclass overrides it - otherwise the
+ sharper -prepareDragProxy:inLayer:deviceScale: is used.
  @param objectsToDrag the list of objects that will be dragged
  @param layer the layer they are owned by
  @return an image, representing the dragged objects.
  */
 - (NSImage*)prepareDragImage:(NSArray*)objectsToDrag inLayer:(DKObjectDrawingLayer*)layer;
 
+/** @brief Render the proxy drag cache for the given objects
+
+ Called while the view is drawing, the first time the proxy is needed. The default method renders the objects into a CGLayer-backed
+ cache sized for the device resolution of the current context (including the view's scale and the screen's backing scale), so the proxy
+ is as sharp as the objects themselves. The cache covers the selection bounds. The proxy is kept after the drag and reused for the next
+ one, as long as the objects and their content haven't changed in the meantime. If a subclass overrides -prepareDragImage:inLayer:, its
+ image is used instead.
+ @param objectsToDrag the list of objects that will be dragged
+ @param layer the layer they are owned by
+ @param deviceScale the number of device pixels per drawing unit
+ @return a cache, representing the dragged objects
+ */
+- (DKQuartzCache*)prepareDragProxy:(NSArray*)objectsToDrag inLayer:(DKObjectDrawingLayer*)layer deviceScale:(CGFloat)deviceScale;
+
 // setting the undo action name
 
 - (void)setUndoAction:(NSString*)action;
@@ -11,9 +11,12 @@
 #import "DKDrawing.h"
 #import "DKDrawableObject.h"
 #import "DKDrawingView.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 #import "NSAffineTransform+DKAdditions.h"
 #import "DKUndoManager.h"
+#import "DKQuartzCache.h"
+#import "DKHitTestBatch.h"
+#include <tgmath.h>
 
 @interface DKSelectAndEditTool (Private)
 
@@ -21,9 +24,34 @@
 - (NSArray*)draggedObjects;
 - (void)proxyDragObjectsAsGroup:(NSArray*)objects inLayer:(DKObjectDrawingLayer*)layer toPoint:(NSPoint)p event:(NSEvent*)event dragPhase:(DKEditToolDragPhase)ph;
 - (BOOL)finishUsingToolInLayer:(DKObjectDrawingLayer*)odl delegate:(id)aDel event:(NSEvent*)event;
+- (void)drawProxyDrag;
+- (void)updateSelectionForMarqueeChangedFromRect:(NSRect)oldRect inLayer:(DKObjectDrawingLayer*)odl extending:(BOOL)extended;
 
 @end
 
+#define kDKProxyDragMaximumPixelSize 8192
+
+static NSUInteger proxyChecksumForObjects(NSArray* objects)
+{
+	// combines the identity, geometry and style state of the objects. The proxy is position-independent, but the checksum is taken
+	// after the proxy drag moves the objects, so a later drag of the same unchanged objects matches.
+
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* obj;
+	NSUInteger cs = [objects count];
+
+	while ((obj = [iter nextObject])) {
+		NSRect br = [obj bounds];
+
+		cs = cs * 31 + (NSUInteger)obj;
+		cs = cs * 31 + [obj geometryChecksum];
+		cs = cs * 31 + (NSUInteger)[obj style] + (NSUInteger)([[obj style] lastModificationTimestamp] * 1000.0);
+		cs = cs * 31 + (NSUInteger)(NSWidth(br) * 64.0) + ((NSUInteger)(NSHeight(br) * 64.0) << 16);
+	}
+
+	return cs;
+}
+
 #pragma mark constants
 
 // notification names
@@ -75,7 +103,7 @@ NSString* kDKSelectionToolTargetObject = @"kDKSelectionToolTargetObject";
 {
 	mOperationMode = op;
 
-	LogEvent_(kInfoEvent, @"select tool set op mode = %d", op);
+	DKTrace_(kDKTraceInfo, @"select tool set op mode = %d", op);
 }
 
 /** @brief Returns the tool's current operation mode
@@ -493,6 +521,12 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 							dragPhase:ph];
 	} else {
 
+		// moving many objects individually would otherwise cause the storage to re-index each one as it moves; batching
+		// defers that to a single pass at the end of this event
+
+		if (multipleObjects)
+			[layer beginBoundsUpdateBatch];
+
 #if USE_CF_APPLIER_FOR_DRAGGING
 		_dragInfo dragInfo;
 
@@ -563,6 +597,9 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 			}
 		}
 #endif
+
+		if (multipleObjects)
+			[layer endBoundsUpdateBatch];
 	}
 
 	// set the undo action to say what we just did for a drag:
@@ -626,7 +663,8 @@ static void dragFunction_mouseUp(const void* obj, void* context)
  The default method creates the image by asking the layer to make one using its standard imaging
  methods. You can override this for different approaches. Typically the drag image has the bounds of
  the selected objects - the caller will position the image based on that assumption. This is only
- invoked if the proxy drag threshold was exceeded and not zero.
+ invoked if the proxy drag threshold was exceeded and not zero, and only if a subclass overrides it - otherwise the
+ sharper -prepareDragProxy:inLayer:deviceScale: is used.
  @param objectsToDrag the list of objects that will be dragged
  @param layer the layer they are owned by
  @return an image, representing the dragged objects.
@@ -660,6 +698,56 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 	return img;
 }
 
+/** @brief Render the proxy drag cache for the given objects
+
+ Called while the view is drawing, the first time the proxy is needed. The default method renders the objects into a CGLayer-backed
+ cache sized for the device resolution of the current context (including the view's scale and the screen's backing scale), so the proxy
+ is as sharp as the objects themselves. The cache covers the selection bounds. The proxy is kept after the drag and reused for the next
+ one, as long as the objects and their content haven't changed in the meantime. If a subclass overrides -prepareDragImage:inLayer:, its
+ image is used instead.
+ @param objectsToDrag the list of objects that will be dragged
+ @param layer the layer they are owned by
+ @param deviceScale the number of device pixels per drawing unit
+ @return a cache, representing the dragged objects
+ */
+- (DKQuartzCache*)prepareDragProxy:(NSArray*)objectsToDrag inLayer:(DKObjectDrawingLayer*)layer deviceScale:(CGFloat)deviceScale
+{
+	if ([self methodForSelector:@selector(prepareDragImage:inLayer:)] != [DKSelectAndEditTool instanceMethodForSelector:@selector(prepareDragImage:inLayer:)]) {
+		NSImage* img = [self prepareDragImage:objectsToDrag
+									  inLayer:layer];
+		return img ? [DKQuartzCache checkOutCacheForImage:img] : nil;
+	}
+
+	NSRect sb = [layer selectionBounds];
+
+	if (NSIsEmptyRect(sb))
+		return nil;
+
+	NSRect pixelRect = NSMakeRect(0, 0, ceil(NSWidth(sb) * deviceScale), ceil(NSHeight(sb) * deviceScale));
+	DKQuartzCache* cache = [DKQuartzCache checkOutCacheForCurrentContextWithSize:pixelRect.size];
+
+	// the proxy is drawn at full quality whatever tier the view is currently drawing at, as it's reused for the whole drag
+
+	DKDrawingQualityTier savedTier = [DKStyle drawingQualityTier];
+	[DKStyle setDrawingQualityTier:kDKDrawingQualityFull];
+
+	[cache lockFocus];
+
+	NSAffineTransform* tfm = [NSAffineTransform transform];
+	[tfm scaleBy:deviceScale];
+	[tfm translateXBy:-sb.origin.x
+				  yBy:-sb.origin.y];
+	[tfm concat];
+
+	[layer drawSelectedObjects];
+
+	[cache unlockFocus];
+
+	[DKStyle setDrawingQualityTier:savedTier];
+
+	return cache;
+}
+
 /** @brief Perform the proxy drag image for the given objects
 
  Called internally when a proxy drag is detected. This will create the drag image on mouse down,
@@ -675,17 +763,24 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 
 	switch (ph) {
 	case kDKDragMouseDown: {
-		if (mProxyDragImage == nil) {
-			mProxyDragImage = [[self prepareDragImage:objects
-											  inLayer:layer] retain];
+		if (!mInProxyDrag) {
+			// a proxy left over from an earlier drag can be reused if it shows exactly these objects, unchanged. Otherwise it will be
+			// rendered when the view next draws.
+
+			if (mProxyDragCache && proxyChecksumForObjects(objects) != mProxyChecksum) {
+				[DKQuartzCache returnCacheToPool:mProxyDragCache];
+				[mProxyDragCache release];
+				mProxyDragCache = nil;
+			}
+
+			NSRect sb = [layer selectionBounds];
 
-			offset.width = p.x - NSMinX([layer selectionBounds]);
-			offset.height = p.y - NSMinY([layer selectionBounds]);
+			offset.width = p.x - NSMinX(sb);
+			offset.height = p.y - NSMinY(sb);
 			anchor = p;
 
-			mProxyDragDestRect.size = [mProxyDragImage size];
-			mProxyDragDestRect.origin.x = p.x - offset.width;
-			mProxyDragDestRect.origin.y = p.y - offset.height;
+			mProxyLayerRef = layer;
+			mProxyDragDestRect = sb;
 
 			[layer setNeedsDisplayInRect:mProxyDragDestRect];
 
@@ -710,7 +805,6 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 	case kDKDragMouseDragged: {
 		[layer setNeedsDisplayInRect:mProxyDragDestRect];
 
-		mProxyDragDestRect.size = [mProxyDragImage size];
 		mProxyDragDestRect.origin.x = p.x - offset.width;
 		mProxyDragDestRect.origin.y = p.y - offset.height;
 
@@ -718,8 +812,6 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 	} break;
 
 	case kDKDragMouseUp: {
-		[mProxyDragImage release];
-		mProxyDragImage = nil;
 		[layer setNeedsDisplayInRect:mProxyDragDestRect];
 
 		// move the objects by the total drag distance
@@ -740,6 +832,11 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 			[obj setVisible:YES];
 			[[layer undoManager] enableUndoRegistration];
 		}
+
+		// keep the proxy for the next drag, noting the state of the objects it shows
+
+		mProxyChecksum = proxyChecksumForObjects(objects);
+		mProxyLayerRef = nil;
 		mInProxyDrag = NO;
 	} break;
 
@@ -779,9 +876,14 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 		if (NSIsEmptyRect([self marqueeRect]) && mWasInLockedObject) {
 			obj = [odl hitTest:mLastPoint];
 			[odl replaceSelectionWithObject:obj];
-		} else
+		} else if (mMarqueeObjects)
+			sel = [mMarqueeObjects allObjects];
+		else
 			sel = [odl objectsInRect:[self marqueeRect]];
 
+		[mMarqueeObjects release];
+		mMarqueeObjects = nil;
+
 		NSString* undoStr = nil;
 
 		if ([sel count] == 0 && !extended && !mWasInLockedObject) {
@@ -852,6 +954,68 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 	return mPerformedUndoableTask;
 }
 
+/** @brief Updates the selection after the marquee has changed during a selection drag
+
+ Only the objects in the strips between the old and new marquee can have entered or left it, so only those strips are searched,
+ and only the objects that entered or left are selected or deselected. The first change of a drag searches the whole marquee.
+ @param oldRect the marquee before it changed
+ @param odl the layer being selected in
+ @param extended YES to only add objects to the selection, as when shift-dragging
+ */
+- (void)updateSelectionForMarqueeChangedFromRect:(NSRect)oldRect inLayer:(DKObjectDrawingLayer*)odl extending:(BOOL)extended
+{
+	NSRect mr = [self marqueeRect];
+
+	if (mMarqueeObjects == nil) {
+		NSArray* sel = [odl objectsInRect:mr];
+
+		mMarqueeObjects = [[NSMutableSet alloc] initWithArray:sel];
+
+		if (extended)
+			[odl addObjectsToSelectionFromArray:sel];
+		else
+			[odl exchangeSelectionWithObjectsFromArray:sel];
+
+		return;
+	}
+
+	NSMutableSet* candidates = [NSMutableSet set];
+	NSEnumerator* iter = [DifferenceOfTwoRects(oldRect, mr) objectEnumerator];
+	NSValue* strip;
+
+	while ((strip = [iter nextObject]))
+		[candidates addObjectsFromArray:[odl objectsInRect:[strip rectValue]]];
+
+	NSMutableArray* entered = [NSMutableArray array];
+	NSMutableArray* left = [NSMutableArray array];
+	NSSet* hits = [NSSet setWithArray:[DKHitTestBatch objects:[candidates allObjects]
+											 intersectingRect:mr]];
+	DKDrawableObject* o;
+	BOOL inside;
+
+	iter = [candidates objectEnumerator];
+
+	while ((o = [iter nextObject])) {
+		inside = [hits containsObject:o];
+
+		if (inside && ![mMarqueeObjects containsObject:o]) {
+			[mMarqueeObjects addObject:o];
+			[entered addObject:o];
+		} else if (!inside && [mMarqueeObjects containsObject:o]) {
+			[mMarqueeObjects removeObject:o];
+			[left addObject:o];
+		}
+	}
+
+	// an extended selection only grows during the drag, as objects the marquee passes over stay selected
+
+	if (extended)
+		[left removeAllObjects];
+
+	[odl changeSelectionByAddingObjects:entered
+						removingObjects:left];
+}
+
 #pragma mark -
 #pragma mark - As part of DKDrawingTool Protocol
 
@@ -908,7 +1072,10 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 	mWasInLockedObject = NO;
 	mLastPoint = p;
 
-	LogEvent_(kUserEvent, @"S/E tool mouse down, target = %@, layer = %@, pt = %@", obj, layer, NSStringFromPoint(p));
+	[mMarqueeObjects release];
+	mMarqueeObjects = nil;
+
+	DKTrace_(kDKTraceUser, @"S/E tool mouse down, target = %@, layer = %@, pt = %@", obj, layer, NSStringFromPoint(p));
 
 	NSDictionary* userInfoDict = [NSDictionary dictionaryWithObjectsAndKeys:layer, kDKSelectionToolTargetLayer, obj, kDKSelectionToolTargetObject, nil];
 
@@ -1064,18 +1231,15 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 			default:
 				break;
 
-			case kDKEditToolSelectionMode:
+			case kDKEditToolSelectionMode: {
+				NSRect omr = [self marqueeRect];
+
 				[self setMarqueeRect:NSRectFromTwoPoints(mAnchorPoint, p)
 							 inLayer:odl];
-
-				sel = [odl objectsInRect:[self marqueeRect]];
-
-				if (extended)
-					[odl addObjectsToSelectionFromArray:sel];
-				else
-					[odl exchangeSelectionWithObjectsFromArray:sel];
-
-				break;
+				[self updateSelectionForMarqueeChangedFromRect:omr
+													   inLayer:odl
+													 extending:extended];
+			} break;
 
 			case kDKEditToolMoveObjectsMode:
 				sel = [self draggedObjects];
@@ -1147,33 +1311,37 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 
 	if ([self operationMode] == kDKEditToolSelectionMode)
 		[self drawMarqueeInView:(DKDrawingView*)aView];
-	else if (mInProxyDrag && mProxyDragImage != nil) {
-		// need to flip the image if needed
-
-		SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
-			if ([aView isFlipped])
-		{
-			NSAffineTransform* unflipper = [NSAffineTransform transform];
-			[unflipper translateXBy:mProxyDragDestRect.origin.x
-								yBy:mProxyDragDestRect.origin.y + mProxyDragDestRect.size.height];
-			[unflipper scaleXBy:1.0
-							yBy:-1.0];
-			[unflipper concat];
-		}
-
-		// for slightly higher performance but less visual fidelity, comment this out:
-
-		[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationHigh];
+	else if (mInProxyDrag)
+		[self drawProxyDrag];
+}
 
-		// the drag image is drawn at 80% opacity to help with the "interleaving" issue. In practice this works pretty well.
+- (void)drawProxyDrag
+{
+	// the proxy is rendered once at the device resolution of the view, then just composited at its new position for each update
+
+	CGContextRef port = [[NSGraphicsContext currentContext] graphicsPort];
+	CGAffineTransform ctm = CGContextGetUserSpaceToDeviceSpaceTransform(port);
+	CGFloat deviceScale = sqrt(fabs(ctm.a * ctm.d - ctm.b * ctm.c));
+	CGFloat maxSide = MAX(NSWidth(mProxyDragDestRect), NSHeight(mProxyDragDestRect));
+
+	if (maxSide * deviceScale > kDKProxyDragMaximumPixelSize)
+		deviceScale = kDKProxyDragMaximumPixelSize / maxSide;
+
+	if (mProxyDragCache == nil || fabs(deviceScale - mProxyDeviceScale) > 0.001) {
+		[DKQuartzCache returnCacheToPool:mProxyDragCache];
+		[mProxyDragCache release];
+		mProxyDragCache = [[self prepareDragProxy:[self draggedObjects]
+										  inLayer:mProxyLayerRef
+									  deviceScale:deviceScale] retain];
+		mProxyDeviceScale = deviceScale;
+	}
 
-		[mProxyDragImage drawAtPoint:NSZeroPoint
-							fromRect:NSZeroRect
-						   operation:NSCompositeSourceAtop
-							fraction:PROXY_DRAG_IMAGE_OPACITY];
+	// the drag image is drawn at 80% opacity to help with the "interleaving" issue. In practice this works pretty well.
 
-		RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
-	}
+	CGContextSaveGState(port);
+	CGContextSetAlpha(port, PROXY_DRAG_IMAGE_OPACITY);
+	[mProxyDragCache drawInRect:mProxyDragDestRect];
+	CGContextRestoreGState(port);
 }
 
 /** @brief The state of the modifier keys changed
@@ -1333,8 +1501,10 @@ static void dragFunction_mouseUp(const void* obj, void* context)
 - (void)dealloc
 {
 	[mMarqueeStyle release];
-	[mProxyDragImage release];
+	[DKQuartzCache returnCacheToPool:mProxyDragCache];
+	[mProxyDragCache release];
 	[mDraggedObjects release];
+	[mMarqueeObjects release];
 	[super dealloc];
 }
 
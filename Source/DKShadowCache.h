@@ -0,0 +1,67 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKCacheRegistry.h"
+
+/** @brief Caches the blurred shadows of filled shapes for the whole application, within a memory budget.
+
+ Caches the blurred shadows of filled shapes for the whole application, within a memory budget. Quartz blurs a shadow afresh every time a
+ shadowed shape is drawn, which on a diagram of many shadowed cards is most of the cost of drawing it. This cache renders the shadow of a path
+ once, as an image of just the shadow in device pixels, and then composites that image beneath the shape on later draws.
+
+ Shadows are keyed on the shape of the path relative to its bounds, the winding rule, the scale, rotation and skew of the context, and the
+ shadow's blur radius and colour, so shapes that are alike share a shadow wherever they are, and zooming or changing the shadow simply makes
+ new ones. The offset isn't part of the key, as it only changes where the image is drawn. When the total size of the images exceeds the byte
+ budget, the least recently used are discarded.
+
+ The cache may be used from any thread.
+*/
+@interface DKShadowCache : NSObject <DKPurgeableCache> {
+@private
+	NSMutableDictionary* mShadows; // shadow key -> cached shadow
+	NSUInteger mByteBudget;
+	NSUInteger mBytesUsed;
+	NSUInteger mUseCounter;
+	NSUInteger mHits;
+	NSUInteger mMisses;
+}
+
+/** @brief The cache used by fills
+ @return the shared cache
+ */
++ (DKShadowCache*)sharedShadowCache;
+
+- (id)initWithByteBudget:(NSUInteger)budget;
+
+/** @brief Draws the shadow that filling a path with an opaque colour would cast, as -[NSShadow setAbsolute] sets it up
+
+ Only the shadow is drawn; the caller then fills the path with no shadow set. Nothing is drawn if the shadow's image would be too big
+ to keep, or the context can't be drawn into this way, in which case the caller should set the shadow and fill as usual.
+ @param shadow the shadow
+ @param path the path, in the current context's coordinates
+ @return YES if the shadow was drawn, otherwise NO
+ */
+- (BOOL)drawShadow:(NSShadow*)shadow forFilledPath:(NSBezierPath*)path;
+
+/** @brief The maximum total size of the shadows, in bytes
+
+ Setting a smaller budget discards shadows immediately until the cache fits.
+ */
+- (NSUInteger)byteBudget;
+- (void)setByteBudget:(NSUInteger)budget;
+- (NSUInteger)bytesUsed;
+- (NSUInteger)shadowCount;
+- (void)removeAllShadows;
+
+- (NSUInteger)hits;
+- (NSUInteger)misses;
+- (void)resetStatistics;
+
+@end
+
+#define kDKShadowCacheDefaultBudget (16 * 1024 * 1024)
+#define kDKShadowCacheMaximumImageSize 2048 // shadows wider or taller than this many device pixels are left to Quartz
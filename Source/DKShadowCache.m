@@ -0,0 +1,421 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKShadowCache.h"
+#import "NSShadow+Scaling.h"
+#import "NSColor+DKAdditions.h"
+#import "NSBezierPath+Geometry.h"
+#import "LogEvent.h"
+#include <tgmath.h>
+
+#define kDKShadowCacheShapeQuantum 16.0 // points are hashed to this fraction of a unit, so tiny differences don't matter
+
+/// the key of a cached shadow
+
+@interface DKShadowKey : NSObject <NSCopying> {
+@public
+	NSUInteger mShapeHash;
+	NSWindingRule mWindingRule;
+	CGFloat mTransform[4]; // the linear part of the CTM
+	CGFloat mBlur;
+	CGFloat mColour[4];
+	NSSize mShapeSize; // the path's bounds in its own coordinates
+}
+
+@end
+
+@implementation DKShadowKey
+
+- (NSUInteger)hash
+{
+	return mShapeHash ^ ((NSUInteger)(mBlur * 64.0) << 20) ^ ((NSUInteger)(mTransform[0] * 1024.0) << 8) ^ (NSUInteger)mWindingRule;
+}
+
+- (BOOL)isEqual:(id)object
+{
+	if (object == self)
+		return YES;
+
+	if (![object isKindOfClass:[DKShadowKey class]])
+		return NO;
+
+	DKShadowKey* key = (DKShadowKey*)object;
+
+	return key->mShapeHash == mShapeHash && key->mWindingRule == mWindingRule && key->mBlur == mBlur && NSEqualSizes(key->mShapeSize, mShapeSize)
+		&& memcmp(key->mTransform, mTransform, sizeof(mTransform)) == 0 && memcmp(key->mColour, mColour, sizeof(mColour)) == 0;
+}
+
+- (id)copyWithZone:(NSZone*)zone
+{
+#pragma unused(zone)
+
+	// keys are never changed once made
+
+	return [self retain];
+}
+
+@end
+
+/// a cached shadow. The image is placed with its origin <mOrigin> device pixels from the device position of the path's bounds origin.
+
+@interface DKCachedShadow : NSObject {
+@public
+	CGImageRef mImage;
+	DKShadowKey* mKey;
+	CGPoint mOrigin;
+	NSUInteger mBytes;
+	NSUInteger mLastUse;
+}
+
+@end
+
+@implementation DKCachedShadow
+
+- (void)dealloc
+{
+	CGImageRelease(mImage);
+	[mKey release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+static NSUInteger hashShapeOfPath(NSBezierPath* path, NSPoint origin)
+{
+	NSInteger i, j, count = [path elementCount];
+	NSPoint ap[3];
+	NSUInteger hash = 5381;
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:ap];
+		NSInteger n = (element == NSCurveToBezierPathElement) ? 3 : (element == NSClosePathBezierPathElement) ? 0 : 1;
+
+		hash = hash * 33 + (NSUInteger)element;
+
+		for (j = 0; j < n; ++j) {
+			hash = hash * 33 + (NSUInteger)(NSInteger)round((ap[j].x - origin.x) * kDKShadowCacheShapeQuantum);
+			hash = hash * 33 + (NSUInteger)(NSInteger)round((ap[j].y - origin.y) * kDKShadowCacheShapeQuantum);
+		}
+	}
+
+	return hash;
+}
+
+static CGFloat roundedComponent(CGFloat value)
+{
+	// the CTM's scale wobbles in the last few bits as views zoom, which mustn't make a different shadow
+
+	return round(value * 4096.0) / 4096.0;
+}
+
+static NSInteger compareLastUse(id a, id b, void* context)
+{
+#pragma unused(context)
+	NSUInteger ua = ((DKCachedShadow*)a)->mLastUse;
+	NSUInteger ub = ((DKCachedShadow*)b)->mLastUse;
+
+	if (ua < ub)
+		return NSOrderedAscending;
+	else if (ua > ub)
+		return NSOrderedDescending;
+	else
+		return NSOrderedSame;
+}
+
+@interface DKShadowCache (Private)
+
+- (DKCachedShadow*)newShadowForPath:(NSBezierPath*)path key:(DKShadowKey*)key deviceBounds:(CGRect)deviceBounds transform:(CGAffineTransform)ctm;
+- (void)evictToBudget:(NSUInteger)budget;
+
+@end
+
+#pragma mark -
+
+@implementation DKShadowCache
+
+static DKShadowCache* sSharedShadowCache = nil;
+
++ (DKShadowCache*)sharedShadowCache
+{
+	@synchronized(self)
+	{
+		if (sSharedShadowCache == nil)
+			sSharedShadowCache = [[self alloc] init];
+	}
+
+	return sSharedShadowCache;
+}
+
+- (id)initWithByteBudget:(NSUInteger)budget
+{
+	self = [super init];
+	if (self) {
+		mShadows = [[NSMutableDictionary alloc] init];
+		mByteBudget = budget;
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeRenderedImages];
+	}
+
+	return self;
+}
+
+- (BOOL)drawShadow:(NSShadow*)shadow forFilledPath:(NSBezierPath*)path
+{
+	CGContextRef cc = [[NSGraphicsContext currentContext] graphicsPort];
+
+	if (cc == NULL || shadow == nil || [path isEmpty])
+		return NO;
+
+	CGAffineTransform ctm = CGContextGetCTM(cc);
+	CGSize offset;
+	CGFloat blur;
+
+	[shadow getAbsoluteOffset:&offset
+				   blurRadius:&blur
+					  flipped:NO
+					inContext:cc];
+
+	NSRect bounds = [path controlPointBounds];
+	CGRect deviceBounds = CGRectApplyAffineTransform(NSRectToCGRect(bounds), ctm);
+
+	if (CGRectGetWidth(deviceBounds) + 2 * fabs(blur) > kDKShadowCacheMaximumImageSize || CGRectGetHeight(deviceBounds) + 2 * fabs(blur) > kDKShadowCacheMaximumImageSize)
+		return NO;
+
+	NSColor* colour = [[shadow shadowColor] colorUsingColorSpaceName:NSCalibratedRGBColorSpace];
+
+	if (colour == nil)
+		return NO;
+
+	DKShadowKey* key = [[[DKShadowKey alloc] init] autorelease];
+
+	key->mShapeHash = hashShapeOfPath(path, bounds.origin);
+	key->mWindingRule = [path windingRule];
+	key->mTransform[0] = roundedComponent(ctm.a);
+	key->mTransform[1] = roundedComponent(ctm.b);
+	key->mTransform[2] = roundedComponent(ctm.c);
+	key->mTransform[3] = roundedComponent(ctm.d);
+	key->mBlur = roundedComponent(blur);
+	key->mShapeSize = bounds.size;
+	[colour getRed:&key->mColour[0]
+			 green:&key->mColour[1]
+			  blue:&key->mColour[2]
+			 alpha:&key->mColour[3]];
+
+	DKCachedShadow* entry;
+
+	@synchronized(self)
+	{
+		entry = [[mShadows objectForKey:key] retain];
+
+		if (entry) {
+			entry->mLastUse = ++mUseCounter;
+			++mHits;
+		} else
+			++mMisses;
+	}
+
+	if (entry == nil) {
+		entry = [self newShadowForPath:path
+								   key:key
+						  deviceBounds:deviceBounds
+							 transform:ctm];
+
+		if (entry == nil)
+			return NO;
+
+		@synchronized(self)
+		{
+			if (entry->mBytes <= mByteBudget / 4) {
+				if ([mShadows objectForKey:key] == nil) {
+					if (mBytesUsed + entry->mBytes > mByteBudget)
+						[self evictToBudget:mByteBudget - entry->mBytes];
+
+					entry->mLastUse = ++mUseCounter;
+					[mShadows setObject:entry
+								 forKey:key];
+					mBytesUsed += entry->mBytes;
+				}
+			}
+		}
+	}
+
+	// the image is drawn in device space, offset as Quartz would offset the shadow
+
+	CGRect dest;
+
+	dest.origin.x = CGRectGetMinX(deviceBounds) + entry->mOrigin.x + offset.width;
+	dest.origin.y = CGRectGetMinY(deviceBounds) + entry->mOrigin.y + offset.height;
+	dest.size.width = CGImageGetWidth(entry->mImage);
+	dest.size.height = CGImageGetHeight(entry->mImage);
+
+	CGContextSaveGState(cc);
+	CGContextConcatCTM(cc, CGAffineTransformInvert(ctm));
+	CGContextDrawImage(cc, dest, entry->mImage);
+	CGContextRestoreGState(cc);
+
+	[entry release];
+
+	return YES;
+}
+
+- (NSUInteger)byteBudget
+{
+	return mByteBudget;
+}
+
+- (void)setByteBudget:(NSUInteger)budget
+{
+	@synchronized(self)
+	{
+		mByteBudget = budget;
+
+		if (mBytesUsed > mByteBudget)
+			[self evictToBudget:mByteBudget];
+	}
+}
+
+- (NSUInteger)bytesUsed
+{
+	return mBytesUsed;
+}
+
+- (NSUInteger)shadowCount
+{
+	@synchronized(self)
+	{
+		return [mShadows count];
+	}
+}
+
+- (void)removeAllShadows
+{
+	@synchronized(self)
+	{
+		[mShadows removeAllObjects];
+		mBytesUsed = 0;
+	}
+}
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	NSUInteger bytes;
+
+	@synchronized(self)
+	{
+		bytes = mBytesUsed;
+		[self removeAllShadows];
+	}
+
+	return bytes;
+}
+
+- (NSUInteger)hits
+{
+	return mHits;
+}
+
+- (NSUInteger)misses
+{
+	return mMisses;
+}
+
+- (void)resetStatistics
+{
+	mHits = mMisses = 0;
+}
+
+#pragma mark -
+
+- (DKCachedShadow*)newShadowForPath:(NSBezierPath*)path key:(DKShadowKey*)key deviceBounds:(CGRect)deviceBounds transform:(CGAffineTransform)ctm
+{
+	// the shape is drawn just off the left of the bitmap with the shadow offset to bring it back in, so that only its shadow lands
+	// in the bitmap. The shadow's offset is in the bitmap's pixels whatever its CTM.
+
+	CGFloat margin = ceil(fabs(key->mBlur)) + 2.0;
+	size_t width = (size_t)ceil(CGRectGetWidth(deviceBounds) + 2 * margin);
+	size_t height = (size_t)ceil(CGRectGetHeight(deviceBounds) + 2 * margin);
+	CGColorSpaceRef space = CGColorSpaceCreateDeviceRGB();
+	CGContextRef bm = CGBitmapContextCreate(NULL, width, height, 8, width * 4, space, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+
+	CGColorSpaceRelease(space);
+
+	if (bm == NULL)
+		return nil;
+
+	CGFloat shift = (CGFloat)width;
+	CGColorRef colour = CGColorCreateGenericRGB(key->mColour[0], key->mColour[1], key->mColour[2], key->mColour[3]);
+	CGPathRef qPath = [path newQuartzPath];
+
+	CGContextSetShadowWithColor(bm, CGSizeMake(shift, 0), key->mBlur, colour);
+	CGContextTranslateCTM(bm, margin - CGRectGetMinX(deviceBounds) - shift, margin - CGRectGetMinY(deviceBounds));
+	CGContextConcatCTM(bm, CGAffineTransformMake(ctm.a, ctm.b, ctm.c, ctm.d, ctm.tx, ctm.ty));
+	CGContextSetGrayFillColor(bm, 0.0, 1.0);
+	CGContextAddPath(bm, qPath);
+
+	if (key->mWindingRule == NSEvenOddWindingRule)
+		CGContextEOFillPath(bm);
+	else
+		CGContextFillPath(bm);
+
+	CGPathRelease(qPath);
+	CGColorRelease(colour);
+
+	DKCachedShadow* entry = [[DKCachedShadow alloc] init];
+
+	entry->mImage = CGBitmapContextCreateImage(bm);
+	entry->mKey = [key retain];
+	entry->mOrigin = CGPointMake(-margin, -margin);
+	entry->mBytes = width * height * 4;
+
+	CGContextRelease(bm);
+
+	if (entry->mImage == NULL) {
+		[entry release];
+		return nil;
+	}
+
+	return entry;
+}
+
+- (void)evictToBudget:(NSUInteger)budget
+{
+	// as for DKRenderedImageCache, sorting when evicting is cheaper than keeping the shadows in order on every use
+
+	NSMutableArray* entries = [[[mShadows allValues] mutableCopy] autorelease];
+
+	[entries sortUsingFunction:compareLastUse
+					   context:NULL];
+
+	NSEnumerator* iter = [entries objectEnumerator];
+	DKCachedShadow* entry;
+
+	while (mBytesUsed > budget && (entry = [iter nextObject])) {
+		mBytesUsed -= entry->mBytes;
+		[mShadows removeObjectForKey:entry->mKey];
+	}
+
+	LogEvent_(kInfoEvent, @"shadow cache evicted down to %lu bytes", (unsigned long)mBytesUsed);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	return [self initWithByteBudget:kDKShadowCacheDefaultBudget];
+}
+
+- (void)dealloc
+{
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
+	[mShadows release];
+	[super dealloc];
+}
+
+@end
@@ -12,8 +12,10 @@ This class provides a number of standard shareable paths that can be utilsed by
 bounded by the standard unit square 1.0 on each side and centered at the origin. The DKDrawableShape class
 provides rotation, scaling and offset for each shape that it draws.
 
-Note that for efficiency many of the path objects returned here are shared. That means that if you change a shape
-with the path editor you MUST copy it first.
+Paths that take some work to build - round rects, polygons, stars, rings, speech balloons and glyphs - are built once for each set of
+parameters and kept in a cache, so asking for the same shape again only costs a copy. Those with a rect are cached by its size and
+moved to its origin, so many shapes of the same size share one entry however they are placed. Every path returned is a new object
+that the caller may modify.
 
 The other job of this class is to provide shapes for reshapable shapes on demand. In that case, an instance of
 the shape factory is used (usually sharedShapeFactory) and the instance methods which conform to the reshapable informal
@@ -67,6 +69,10 @@ protocol are used as shape providers. See DKReshapableShape for more details.
 - (NSBezierPath*)roundEndedRect:(NSRect)rect objParam:(id)param;
 - (NSBezierPath*)speechBalloonInRect:(NSRect)rect objParam:(id)param;
 
+/** @brief Discards the cached paths
+ */
++ (void)flushPathCache;
+
 @end
 
 // params for speech balloon shapes:
@@ -88,3 +94,5 @@ enum {
 
 extern NSString* kDKSpeechBalloonType;
 extern NSString* kDKSpeechBalloonCornerRadius;
+
+#define kDKShapeFactoryMaximumCachedPaths 512 // the path cache is emptied when it grows beyond this
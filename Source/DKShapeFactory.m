@@ -12,6 +12,27 @@
 NSString* kDKSpeechBalloonType = @"kDKSpeechBalloonType";
 NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 
+static NSMutableDictionary* sPathCache = nil;
+
+@interface DKShapeFactory (Private)
+
+/** @brief Returns a copy of a cached path moved by <offset>, or nil if it hasn't been cached
+ @param key identifies the shape and every parameter that defines it
+ @param offset the origin of the rect the path is wanted in, or NSZeroPoint for a unit path
+ @return a new path, or nil
+ */
++ (NSBezierPath*)cachedPathForKey:(NSString*)key offset:(NSPoint)offset;
+
+/** @brief Keeps a copy of a path just built, moved back by <offset>, for later requests with the same key
+ @param path the path
+ @param key identifies the shape and every parameter that defines it
+ @param offset the origin of the rect the path was built in, or NSZeroPoint for a unit path
+ @return <path>
+ */
++ (NSBezierPath*)cachePath:(NSBezierPath*)path forKey:(NSString*)key offset:(NSPoint)offset;
+
+@end
+
 #pragma mark -
 @implementation DKShapeFactory
 #pragma mark As a DKShapeFactory
@@ -76,9 +97,16 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 	if (radius <= 0 || NSIsEmptyRect(rect))
 		return [NSBezierPath bezierPathWithRect:rect];
 
+	NSString* key = [NSString stringWithFormat:@"roundRect:%a,%a,%a", rect.size.width, rect.size.height, radius];
+	NSBezierPath* path = [self cachedPathForKey:key
+										 offset:rect.origin];
+
+	if (path != nil)
+		return path;
+
 	// Now draw our rectangle:
 	NSRect innerRect = NSInsetRect(rect, radius, radius); // Make rect with corners being centers of the corner circles.
-	NSBezierPath* path = [NSBezierPath bezierPath];
+	path = [NSBezierPath bezierPath];
 
 	[path moveToPoint:NSMakePoint(rect.origin.x, rect.origin.y + radius)];
 
@@ -107,17 +135,27 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 								   endAngle:180.0];
 	[path closePath]; // Implicitly creates left edge.
 
-	return path;
+	return [self cachePath:path
+					forKey:key
+					offset:rect.origin];
 }
 
 #pragma mark -
 + (NSBezierPath*)regularPolygon:(NSInteger)numberOfSides
 {
+	NSString* key = [NSString stringWithFormat:@"regularPolygon:%ld", (long)numberOfSides];
+	NSBezierPath* path = [self cachedPathForKey:key
+										 offset:NSZeroPoint];
+
+	if (path != nil)
+		return path;
+
 	CGFloat angle, radius = 0.5;
 	NSInteger i;
-	NSBezierPath* path = [NSBezierPath bezierPath];
 	NSPoint p;
 
+	path = [NSBezierPath bezierPath];
+
 	p.x = 0.5;
 	p.y = 0.0;
 
@@ -139,7 +177,9 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 
 	//[path appendBezierPathWithOvalInRect:[DKShapeFactory rectOfUnitSize]];
 
-	return path;
+	return [self cachePath:path
+					forKey:key
+					offset:NSZeroPoint];
 }
 
 #pragma mark -
@@ -195,12 +235,20 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 {
 	CGFloat angle, radius = 0.5;
 	NSInteger i;
-	NSBezierPath* path = [NSBezierPath bezierPath];
 	NSPoint p;
 
 	if (diam > 1.0)
 		diam = 1.0;
 
+	NSString* key = [NSString stringWithFormat:@"star:%ld,%a", (long)numberOfPoints, diam];
+	NSBezierPath* path = [self cachedPathForKey:key
+										 offset:NSZeroPoint];
+
+	if (path != nil)
+		return path;
+
+	path = [NSBezierPath bezierPath];
+
 	p.x = 0.5;
 	p.y = 0.0;
 
@@ -225,7 +273,9 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 	[path lineToPoint:p];
 	[path closePath];
 
-	return path;
+	return [self cachePath:path
+					forKey:key
+					offset:NSZeroPoint];
 }
 
 + (NSBezierPath*)regularStar:(NSInteger)numberOfPoints
@@ -261,18 +311,27 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 #pragma mark -
 + (NSBezierPath*)ring:(CGFloat)innerDiameter
 {
-	NSBezierPath* path = [NSBezierPath bezierPathWithOvalInRect:[self rectOfUnitSize]];
-
 	if (innerDiameter > 1.0)
 		innerDiameter = 1.0;
 
+	NSString* key = [NSString stringWithFormat:@"ring:%a", innerDiameter];
+	NSBezierPath* path = [self cachedPathForKey:key
+										 offset:NSZeroPoint];
+
+	if (path != nil)
+		return path;
+
+	path = [NSBezierPath bezierPathWithOvalInRect:[self rectOfUnitSize]];
+
 	CGFloat rad = innerDiameter * 0.5f;
 	NSRect r = NSMakeRect(-rad, -rad, innerDiameter, innerDiameter);
 
 	[path appendBezierPathWithOvalInRect:r];
 	[path setWindingRule:NSEvenOddWindingRule];
 
-	return path;
+	return [self cachePath:path
+					forKey:key
+					offset:NSZeroPoint];
 }
 
 + (NSBezierPath*)roundRectSpeechBalloon:(NSInteger)sbParams cornerRadius:(CGFloat)cr
@@ -311,9 +370,16 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 	if (cr >= (mainRect.size.width / 2))
 		cr = _CGFloatTrunc(mainRect.size.width / 2) - 1;
 
+	NSString* key = [NSString stringWithFormat:@"speechBalloon:%a,%a,%ld,%a", rect.size.width, rect.size.height, (long)sbParams, cr];
+	NSBezierPath* path = [self cachedPathForKey:key
+										 offset:rect.origin];
+
+	if (path != nil)
+		return path;
+
 	// Now draw our rectangle:
 	NSRect innerRect = NSInsetRect(mainRect, cr, cr); // Make rect with corners being centers of the corner circles.
-	NSBezierPath* path = [NSBezierPath bezierPath];
+	path = [NSBezierPath bezierPath];
 
 	[path moveToPoint:NSMakePoint(mainRect.origin.x, mainRect.origin.y + cr)];
 
@@ -400,7 +466,9 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 
 	[path closePath]; // Implicitly creates left edge.
 
-	return path;
+	return [self cachePath:path
+					forKey:key
+					offset:rect.origin];
 }
 
 + (NSBezierPath*)ovalSpeechBalloon:(NSInteger)sbParams
@@ -438,7 +506,14 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 
 	rakeFactor = LIMIT(rakeFactor, 0, 1) * 0.5f;
 
-	NSBezierPath* feather = [NSBezierPath bezierPath];
+	NSString* key = [NSString stringWithFormat:@"arrowTailFeather:%a", rakeFactor];
+	NSBezierPath* feather = [self cachedPathForKey:key
+											offset:NSZeroPoint];
+
+	if (feather != nil)
+		return feather;
+
+	feather = [NSBezierPath bezierPath];
 	NSPoint p = NSMakePoint(-0.5 + rakeFactor, 0);
 
 	[feather moveToPoint:p];
@@ -457,7 +532,9 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 	[feather lineToPoint:p];
 	[feather closePath];
 
-	return feather;
+	return [self cachePath:feather
+					forKey:key
+					offset:NSZeroPoint];
 }
 
 + (NSBezierPath*)inflectedArrowhead
@@ -482,13 +559,20 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 	if (rect.size.width == rect.size.height)
 		return [NSBezierPath bezierPathWithOvalInRect:rect];
 	else {
+		NSString* key = [NSString stringWithFormat:@"roundEndedRect:%a,%a", rect.size.width, rect.size.height];
+		NSBezierPath* path = [self cachedPathForKey:key
+											 offset:rect.origin];
+
+		if (path != nil)
+			return path;
+
 		NSSize rs = rect.size;
 		BOOL vertical = (rs.width < rs.height);
 		CGFloat radius = MIN(rs.width, rs.height);
 
 		radius /= 2.0;
 
-		NSBezierPath* path = [NSBezierPath bezierPath];
+		path = [NSBezierPath bezierPath];
 
 		if (!vertical) {
 			[path moveToPoint:NSMakePoint(NSMinX(rect) + radius, NSMinY(rect))];
@@ -514,7 +598,9 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 
 		[path closePath];
 
-		return path;
+		return [self cachePath:path
+						forKey:key
+						offset:rect.origin];
 	}
 }
 
@@ -524,16 +610,31 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 	// returns a path at the origin representing the glyph of the letter passed. This may need some adjustment to use in a shape.
 	// the character will be drawn "upside down" in a DKDrawingView unless the object that owns this path creates an appropriate transform.
 
+	NSString* key = [NSString stringWithFormat:@"glyph:%@,%@", glyph, fontName];
+	NSBezierPath* path = [self cachedPathForKey:key
+										 offset:NSZeroPoint];
+
+	if (path != nil)
+		return path;
+
 	NSFont* font = [NSFont fontWithName:fontName
 								   size:1];
-	NSBezierPath* path = [NSBezierPath bezierPath];
 	NSPoint p = NSMakePoint(-0.5, -0.5);
 
+	path = [NSBezierPath bezierPath];
+
 	[path moveToPoint:p];
 	[path appendBezierPathWithGlyph:[font glyphWithName:glyph]
 							 inFont:font];
 
-	return path;
+	// a missing font gives a different path from the real one, so it isn't kept
+
+	if (font == nil)
+		return path;
+
+	return [self cachePath:path
+					forKey:key
+					offset:NSZeroPoint];
 }
 
 #pragma mark -
@@ -572,6 +673,66 @@ NSString* kDKSpeechBalloonCornerRadius = @"kDKSpeechBalloonCornerRadius";
 										 cornerRadius:radius];
 }
 
+#pragma mark -
+
+/** @brief Discards the cached paths
+ */
++ (void)flushPathCache
+{
+	@synchronized([DKShapeFactory class])
+	{
+		[sPathCache removeAllObjects];
+	}
+}
+
++ (NSBezierPath*)cachedPathForKey:(NSString*)key offset:(NSPoint)offset
+{
+	NSBezierPath* path;
+
+	@synchronized([DKShapeFactory class])
+	{
+		path = [[sPathCache objectForKey:key] copy];
+	}
+
+	if (path != nil && !NSEqualPoints(offset, NSZeroPoint)) {
+		NSAffineTransform* tfm = [NSAffineTransform transform];
+		[tfm translateXBy:offset.x
+					  yBy:offset.y];
+		[path transformUsingAffineTransform:tfm];
+	}
+
+	return [path autorelease];
+}
+
++ (NSBezierPath*)cachePath:(NSBezierPath*)path forKey:(NSString*)key offset:(NSPoint)offset
+{
+	// the cached copy is kept at the origin so that it can be moved to wherever it's next wanted
+
+	NSBezierPath* cached = [path copy];
+
+	if (!NSEqualPoints(offset, NSZeroPoint)) {
+		NSAffineTransform* tfm = [NSAffineTransform transform];
+		[tfm translateXBy:-offset.x
+					  yBy:-offset.y];
+		[cached transformUsingAffineTransform:tfm];
+	}
+
+	@synchronized([DKShapeFactory class])
+	{
+		if (sPathCache == nil)
+			sPathCache = [[NSMutableDictionary alloc] init];
+		else if ([sPathCache count] >= kDKShapeFactoryMaximumCachedPaths)
+			[sPathCache removeAllObjects];
+
+		[sPathCache setObject:cached
+					   forKey:key];
+	}
+
+	[cached release];
+
+	return path;
+}
+
 #pragma mark -
 #pragma mark - As part of the NSCoding protocol
 
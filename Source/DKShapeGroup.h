@@ -7,7 +7,7 @@
 #import "DKDrawableShape.h"
 #import "DKDrawableContainerProtocol.h"
 
-@class DKObjectDrawingLayer;
+@class DKObjectDrawingLayer, DKRTreeObjectStorage;
 
 // caching options
 
@@ -43,6 +43,10 @@ For the normal case of grouping existing objects within a layer, this is not an
 	DKGroupCacheOption mCacheOption; // caching options
 	BOOL mIsWritingToCache; // YES when building cache - modifies transforms
 	BOOL mClipContentToPath; // YES to clip group content to the group's path
+	DKRTreeObjectStorage* mObjectIndex; // the objects' bounds in the group's coordinates, made when first needed for large groups
+	NSString* mContentCacheKey; // key of the shared content cache in use, or nil if the cache is the group's own
+	NSRect mContentCacheRect; // the area of the group's coordinates covered by the content cache
+	CGFloat mContentCacheScale; // the scale the content cache was rendered at
 }
 
 // creating new groups:
@@ -186,11 +190,35 @@ For the normal case of grouping existing objects within a layer, this is not an
 - (void)setTransformsVisually:(BOOL)tv;
 - (BOOL)transformsVisually;
 
+/** @brief Returns the area covered by the objects in the group as a single path
+
+ This is the union of the rendering paths of the visible objects, including those in nested groups. If the group clips
+ its content, the result is clipped to the group's path too.
+ @return a new path, in the same coordinates as the group's own rendering path
+ */
+- (NSBezierPath*)combinedPathOfGroupedObjects;
+
 // caching:
 
+/** @brief Sets how the group's content is cached
+
+ With kDKGroupCacheUsingCGLayer, the content is rendered once to a CGLayer, at a power of two scale at least that of the view, and then drawn
+ from the layer through the group's transform, so moving, rotating and resizing the group don't render the objects again. Groups whose
+ objects are all plain shapes, paths and groups share a layer with any other groups with the same content, so many instances of the same
+ symbol cost one rendering. The cache is only used when drawing to the screen, and is discarded when any of the objects changes.
+ @param cacheOption the caching options
+ */
 - (void)setCacheOptions:(DKGroupCacheOption)cacheOption;
 - (DKGroupCacheOption)cacheOptions;
 
+/** @brief An object in the group changed in some way that may affect how it looks
+
+ Objects call this on their container when they notify a visual change. It discards the group's spatial index and content cache, then
+ passes the change on to the group's own container.
+ @param obj the object that changed
+ */
+- (void)groupedObjectDidChange:(DKDrawableObject*)obj;
+
 // ungrouping:
 
 /** @brief Unpacks the group back into the nominated layer 
@@ -223,3 +251,13 @@ enum {
 	kDKCreateGroupWithShapes = 0,
 	kDKCreateGroupWithPaths = 1
 };
+
+// groups with at least this many objects use a spatial index to draw and hit-test only the objects that need it
+
+#define kDKShapeGroupIndexThreshold 32
+
+// limits of the scale a group's content cache is rendered at, and of the size of the cache in pixels
+
+#define kDKShapeGroupCacheMinScale 0.125
+#define kDKShapeGroupCacheMaxScale 16.0
+#define kDKShapeGroupCacheMaxSize 4096
@@ -11,17 +11,224 @@
 #import "DKStyle.h"
 #import "DKObjectDrawingLayer.h"
 #import "NSBezierPath+Geometry.h"
+#import "NSBezierPath+Combinatorial.h"
 #import "DKSelectionPDFView.h"
 #import "LogEvent.h"
 #import "DKDrawableObject+Metadata.h"
+#import "DKRTreeObjectStorage.h"
+#import "DKRenderStatistics.h"
+#import "DKMemoryFootprint.h"
 
 @interface DKShapeGroup (Private)
 - (void)invalidateCache;
 - (void)updateCache;
 - (void)drawUntransformedContent;
+- (DKRTreeObjectStorage*)objectIndex;
+- (void)invalidateObjectIndex;
+- (NSArray*)objectsToDraw;
+- (BOOL)drawContentFromCache;
+- (NSUInteger)sharableContentHash;
+- (NSArray*)sharableContent;
 
 @end
 
+// a content cache shared by groups with the same content
+
+@interface DKGroupContentCache : NSObject {
+@public
+	CGLayerRef mLayer;
+	NSArray* mContent; // what the layer shows (see -sharableContent), as hashes alone can be the same for different content
+	NSUInteger mUsers;
+}
+
+@end
+
+@implementation DKGroupContentCache
+
+- (void)dealloc
+{
+	CGLayerRelease(mLayer);
+	[mContent release];
+	[super dealloc];
+}
+
+@end
+
+static NSMutableDictionary* sSharedContentCaches = nil; // content hash and scale -> DKGroupContentCache, only used while locked by @synchronized on the DKGroupContentCache class
+
+static NSUInteger hashBytes(const void* bytes, size_t length, NSUInteger hash)
+{
+	const uint8_t* p = (const uint8_t*)bytes;
+	size_t i;
+
+	for (i = 0; i < length; ++i)
+		hash = (hash ^ p[i]) * 16777619U;
+
+	return hash;
+}
+
+// unlike -[NSBezierPath checksum], this uses the exact points, as paths that merely round to the same values don't look the same
+
+static NSUInteger hashPath(NSBezierPath* path, NSUInteger hash)
+{
+	NSInteger i, count = [path elementCount];
+	NSPoint p[3];
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:p];
+
+		hash = hashBytes(&element, sizeof(element), hash);
+		hash = hashBytes(p, sizeof(NSPoint) * (element == NSCurveToBezierPathElement ? 3 : (element == NSClosePathBezierPathElement ? 0 : 1)), hash);
+	}
+
+	return hash;
+}
+
+static BOOL pathsAreIdentical(NSBezierPath* a, NSBezierPath* b)
+{
+	NSInteger i, count = [a elementCount];
+	NSPoint pa[3], pb[3];
+
+	if (a == b)
+		return YES;
+
+	if (count != [b elementCount])
+		return NO;
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [a elementAtIndex:i
+									   associatedPoints:pa];
+
+		if ([b elementAtIndex:i
+				associatedPoints:pb] != element)
+			return NO;
+
+		if (memcmp(pa, pb, sizeof(NSPoint) * (element == NSCurveToBezierPathElement ? 3 : (element == NSClosePathBezierPathElement ? 0 : 1))) != 0)
+			return NO;
+	}
+
+	return YES;
+}
+
+// compares two results of -sharableContent: the bounds, then for each object its style or a group's content, its path and its flags
+
+static BOOL contentsAreIdentical(NSArray* a, NSArray* b)
+{
+	NSUInteger i, count = [a count];
+
+	if (count != [b count] || ![[a objectAtIndex:0] isEqual:[b objectAtIndex:0]])
+		return NO;
+
+	for (i = 1; i < count; ++i) {
+		NSArray* ea = [a objectAtIndex:i];
+		NSArray* eb = [b objectAtIndex:i];
+		id looksA = [ea objectAtIndex:0];
+		id looksB = [eb objectAtIndex:0];
+
+		if ([looksA isKindOfClass:[DKStyle class]]) {
+			if (![looksB isKindOfClass:[DKStyle class]] || (looksA != looksB && ![looksA hasSameContentAsStyle:looksB]))
+				return NO;
+		} else if ([looksB isKindOfClass:[DKStyle class]] || !contentsAreIdentical(looksA, looksB))
+			return NO;
+
+		if (!pathsAreIdentical([ea objectAtIndex:1], [eb objectAtIndex:1]) || ![[ea objectAtIndex:2] isEqual:[eb objectAtIndex:2]])
+			return NO;
+	}
+
+	return YES;
+}
+
+// an object of the group as it is held in the group's spatial index. The entry has the object's bounds in the group's coordinates, which
+// the object's own bounds are not when the group transforms its objects genuinely, and which don't change when the group is moved or resized
+
+@interface DKShapeGroupIndexEntry : NSObject <DKStorableObject> {
+@public
+	DKDrawableObject* mObjectRef;
+	NSRect mBounds;
+	id<DKObjectStorage> mStorageRef;
+	NSUInteger mIndex;
+	NSUInteger mQueryStamp;
+	BOOL mMarked;
+}
+
+@end
+
+@implementation DKShapeGroupIndexEntry
+
+- (id<DKObjectStorage>)storage
+{
+	return mStorageRef;
+}
+
+- (void)setStorage:(id<DKObjectStorage>)storage
+{
+	mStorageRef = storage;
+}
+
+- (NSUInteger)index
+{
+	return mIndex;
+}
+
+- (void)setIndex:(NSUInteger)indx
+{
+	mIndex = indx;
+}
+
+- (void)setMarked:(BOOL)markIt
+{
+	mMarked = markIt;
+}
+
+- (BOOL)isMarked
+{
+	return mMarked;
+}
+
+- (NSUInteger)queryStamp
+{
+	return mQueryStamp;
+}
+
+- (void)setQueryStamp:(NSUInteger)stamp
+{
+	mQueryStamp = stamp;
+}
+
+- (BOOL)visible
+{
+	return [mObjectRef visible];
+}
+
+- (NSRect)bounds
+{
+	return mBounds;
+}
+
+- (void)encodeWithCoder:(NSCoder*)coder
+{
+#pragma unused(coder)
+
+	// entries are made from the group's objects when needed, and never archived
+}
+
+- (id)initWithCoder:(NSCoder*)coder
+{
+#pragma unused(coder)
+	return [self init];
+}
+
+- (id)copyWithZone:(NSZone*)zone
+{
+#pragma unused(zone)
+	return [self retain];
+}
+
+@end
+
+#pragma mark -
+
 @implementation DKShapeGroup
 #pragma mark As a DKShapeGroup
 
@@ -194,6 +401,8 @@
 		[objects retain];
 		[m_objects release];
 		m_objects = objects;
+		[self invalidateObjectIndex];
+		[self invalidateCache];
 
 		[m_objects makeObjectsPerformSelector:@selector(groupWillAddObject:)
 								   withObject:self];
@@ -332,15 +541,19 @@
 
 - (void)drawGroupContent
 {
-	NSEnumerator* iter = [[self groupObjects] objectEnumerator];
 	DKDrawableShape* od;
+	BOOL concat = m_transformVisually && !mIsWritingToCache;
 
-	if (m_transformVisually) {
+	if (concat) {
 		[NSGraphicsContext saveGraphicsState];
 		NSAffineTransform* tfm = [self contentTransform];
 		[tfm concat];
 	}
 
+	// this is also how the group is hit-tested, the hit rect being drawn into a tiny bitmap, so culling to the clip serves both
+
+	NSEnumerator* iter = [[self objectsToDraw] objectEnumerator];
+
 	while ((od = [iter nextObject])) {
 		if ([od visible]) {
 			[od setBeingHitTested:[self isBeingHitTested]];
@@ -349,7 +562,7 @@
 		}
 	}
 
-	if (m_transformVisually)
+	if (concat)
 		[NSGraphicsContext restoreGraphicsState];
 }
 
@@ -404,6 +617,43 @@
 	return m_transformVisually;
 }
 
+- (NSBezierPath*)combinedPathOfGroupedObjects
+{
+	NSMutableArray* paths = [NSMutableArray array];
+	NSEnumerator* iter = [[self groupObjects] objectEnumerator];
+	DKDrawableObject* od;
+	NSBezierPath* path;
+
+	while ((od = [iter nextObject])) {
+		if (![od visible])
+			continue;
+
+		if ([od isKindOfClass:[DKShapeGroup class]])
+			path = [(DKShapeGroup*)od combinedPathOfGroupedObjects];
+		else
+			path = [od renderingPath];
+
+		if (path && ![path isEmpty])
+			[paths addObject:path];
+	}
+
+	// all the objects are combined in one pass, which is much quicker than adding them to the result one at a time
+
+	path = [NSBezierPath bezierPathByPerformingBooleanOp:kDKBooleanOpUnion
+												 onPaths:paths];
+
+	// when the group transforms visually its objects' paths are untransformed, as the transform is applied when drawing
+
+	if (m_transformVisually)
+		path = [[self contentTransform] transformBezierPath:path];
+
+	if (mClipContentToPath && ![path isEmpty])
+		path = [path performBooleanOp:kDKBooleanOpIntersection
+							 withPath:[self renderingPath]];
+
+	return path;
+}
+
 #pragma mark -
 #pragma mark - content caching
 
@@ -422,12 +672,255 @@
 
 - (void)updateCache
 {
-	// currently no-op
+	// the cache can only be made for a context to draw in, so it is made when the group is next drawn
 }
 
 - (void)invalidateCache
 {
-	// currently no-op
+	if (mContentCacheKey) {
+		@synchronized([DKGroupContentCache class])
+		{
+			DKGroupContentCache* shared = [sSharedContentCaches objectForKey:mContentCacheKey];
+
+			if (--shared->mUsers == 0)
+				[sSharedContentCaches removeObjectForKey:mContentCacheKey];
+		}
+
+		[mContentCacheKey release];
+		mContentCacheKey = nil;
+	}
+
+	if (mContentCache) {
+		CGLayerRelease(mContentCache);
+		mContentCache = NULL;
+	}
+}
+
+- (void)groupedObjectDidChange:(DKDrawableObject*)obj
+{
+#pragma unused(obj)
+
+	// objects can notify changes while the cache is being rendered, which doesn't make it out of date
+
+	if (mIsWritingToCache)
+		return;
+
+	[self invalidateObjectIndex];
+	[self invalidateCache];
+
+	if ([(id)[self container] respondsToSelector:_cmd])
+		[(id)[self container] groupedObjectDidChange:self];
+}
+
+/** @brief Draws the group's content from its cache, making the cache first if necessary
+ @return YES if the content was drawn, NO if it can't be cached now and should be drawn directly
+ */
+- (BOOL)drawContentFromCache
+{
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+
+	if ((mCacheOption & kDKGroupCacheUsingCGLayer) == 0 || mIsWritingToCache || [self isBeingHitTested] || ![context isDrawingToScreen])
+		return NO;
+
+	CGContextRef ctx = [context graphicsPort];
+
+	[NSGraphicsContext saveGraphicsState];
+
+	// the objects are transformed by the rendering transform, and by the content transform as well if the group transforms visually, so
+	// the cache is drawn in the coordinates they'd be drawn in
+
+	if (m_transformVisually)
+		[[self contentTransform] concat];
+
+	NSAffineTransform* tfm = [self renderingTransform];
+
+	if (tfm)
+		[tfm concat];
+
+	// the cache is rendered at the power of two at or above the current scale, so it's never magnified, and zooming doesn't always remake it
+
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform(ctx);
+	CGFloat scale = sqrt(fabs(dt.a * dt.d - dt.b * dt.c));
+
+	scale = LIMIT(pow(2.0, ceil(log2(MAX(scale, 1e-3)))), kDKShapeGroupCacheMinScale, kDKShapeGroupCacheMaxScale);
+
+	if (mContentCache && scale != mContentCacheScale)
+		[self invalidateCache];
+
+	DKRenderRecordCacheLookup(self, mContentCache != NULL);
+
+	if (mContentCache == NULL) {
+		NSSize extra = [self extraSpaceNeededByObjects:m_objects];
+		NSRect area = NSInsetRect(mBounds, -(extra.width + 1.0), -(extra.height + 1.0));
+		CGSize size = CGSizeMake(ceil(area.size.width * scale), ceil(area.size.height * scale));
+		NSUInteger hash = 0;
+		NSString* key = nil;
+		NSArray* content = nil;
+
+		// a layer drawn by two threads at once isn't safe, so only groups drawn on the main thread share them. The hash finds a cache that
+		// may be shared, and the content is then compared in full, as different content can have the same hash
+
+		if ([NSThread isMainThread])
+			hash = [self sharableContentHash];
+
+		if (hash != 0) {
+			key = [NSString stringWithFormat:@"%lx/%g", (unsigned long)hash, scale];
+			content = [self sharableContent];
+
+			@synchronized([DKGroupContentCache class])
+			{
+				DKGroupContentCache* shared = [sSharedContentCaches objectForKey:key];
+
+				if (shared && contentsAreIdentical(shared->mContent, content)) {
+					++shared->mUsers;
+					mContentCache = CGLayerRetain(shared->mLayer);
+					mContentCacheKey = [key retain];
+				} else if (shared)
+					key = nil; // the key is taken by other content, so this group keeps a cache of its own
+			}
+		}
+
+		if (mContentCache == NULL && size.width > 0 && size.height > 0 && size.width <= kDKShapeGroupCacheMaxSize && size.height <= kDKShapeGroupCacheMaxSize) {
+			mContentCache = CGLayerCreateWithContext(ctx, size, NULL);
+
+			CGContextRef lc = CGLayerGetContext(mContentCache);
+
+			CGContextScaleCTM(lc, scale, scale);
+			CGContextTranslateCTM(lc, -area.origin.x, -area.origin.y);
+
+			[NSGraphicsContext saveGraphicsState];
+			[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:lc
+																							flipped:[context isFlipped]]];
+			[self drawUntransformedContent];
+			[NSGraphicsContext restoreGraphicsState];
+
+			if (key) {
+				DKGroupContentCache* shared = [[DKGroupContentCache alloc] init];
+
+				shared->mLayer = CGLayerRetain(mContentCache);
+				shared->mContent = [content retain];
+				shared->mUsers = 1;
+
+				@synchronized([DKGroupContentCache class])
+				{
+					if (sSharedContentCaches == nil)
+						sSharedContentCaches = [[NSMutableDictionary alloc] init];
+
+					// another group may have shared the key meanwhile, in which case this one keeps its layer to itself
+
+					if ([sSharedContentCaches objectForKey:key] == nil) {
+						[sSharedContentCaches setObject:shared
+												 forKey:key];
+						mContentCacheKey = [key retain];
+					}
+				}
+
+				[shared release];
+			}
+
+			LogEvent_(kInfoEvent, @"group %p cached its content at scale %g (shared = %d)", self, scale, key != nil);
+		}
+
+		// groups that share a cache have the same bounds and styles, so the same area
+
+		mContentCacheRect = area;
+		mContentCacheScale = scale;
+	}
+
+	if (mContentCache)
+		CGContextDrawLayerInRect(ctx, NSRectToCGRect(mContentCacheRect), mContentCache);
+
+	[NSGraphicsContext restoreGraphicsState];
+
+	return mContentCache != NULL;
+}
+
+/** @brief A hash of the group's content, for sharing its cache with groups that look the same
+
+ Only plain shapes, paths and groups are included, since the appearance of other objects, such as text, isn't given by their path and style.
+ @return the hash, or 0 if the content includes other kinds of object
+ */
+- (NSUInteger)sharableContentHash
+{
+	NSUInteger hash = 2166136261U;
+	NSEnumerator* iter = [m_objects objectEnumerator];
+	DKDrawableObject* obj;
+	BOOL wasWritingToCache = mIsWritingToCache;
+
+	hash = hashBytes(&mBounds, sizeof(NSRect), hash);
+
+	// as for the spatial index, the objects' paths are in the group's coordinates while writing to the cache
+
+	mIsWritingToCache = YES;
+
+	while ((obj = [iter nextObject])) {
+		Class cl = [obj class];
+		NSUInteger objectHash;
+
+		if (cl == [DKShapeGroup class]) {
+			objectHash = [(DKShapeGroup*)obj sharableContentHash];
+
+			if (objectHash != 0 && [(DKShapeGroup*)obj clipContentToPath])
+				objectHash = ~objectHash;
+		} else if (cl == [DKDrawableShape class] || cl == [DKDrawablePath class])
+			objectHash = [[obj style] contentHash];
+		else
+			objectHash = 0;
+
+		if (objectHash == 0) {
+			hash = 0;
+			break;
+		}
+
+		hash = hashBytes(&objectHash, sizeof(NSUInteger), hash);
+		hash = hashPath([obj renderingPath], hash);
+		hash ^= [obj visible];
+	}
+
+	mIsWritingToCache = wasWritingToCache;
+
+	return hash;
+}
+
+/** @brief What the group's content looks like, for checking that groups with the same -sharableContentHash really do look the same
+
+ The first item is the group's bounds. Each object then has an array of its style (or for a group, its own sharable content), its path in
+ the group's coordinates and a number combining its visibility and, for a group, whether it clips its content.
+ @return the content, or nil if the content includes objects whose look isn't given by their path and style
+ */
+- (NSArray*)sharableContent
+{
+	NSMutableArray* content = [NSMutableArray arrayWithObject:[NSValue valueWithRect:mBounds]];
+	NSEnumerator* iter = [m_objects objectEnumerator];
+	DKDrawableObject* obj;
+	BOOL wasWritingToCache = mIsWritingToCache;
+
+	mIsWritingToCache = YES;
+
+	while ((obj = [iter nextObject])) {
+		Class cl = [obj class];
+		id looks = nil;
+		NSUInteger flags = [obj visible] ? 1 : 0;
+
+		if (cl == [DKShapeGroup class]) {
+			looks = [(DKShapeGroup*)obj sharableContent];
+
+			if ([(DKShapeGroup*)obj clipContentToPath])
+				flags |= 2;
+		} else if (cl == [DKDrawableShape class] || cl == [DKDrawablePath class])
+			looks = [obj style];
+
+		if (looks == nil) {
+			content = nil;
+			break;
+		}
+
+		[content addObject:[NSArray arrayWithObjects:looks, [[[obj renderingPath] copy] autorelease], [NSNumber numberWithUnsignedInteger:flags], nil]];
+	}
+
+	mIsWritingToCache = wasWritingToCache;
+
+	return content;
 }
 
 - (void)drawUntransformedContent
@@ -435,9 +928,110 @@
 	// draws the group content without applying any transforms - this is used to capture the original state of the
 	// contents into a cached context.
 
+	BOOL wasWritingToCache = mIsWritingToCache;
+
 	mIsWritingToCache = YES;
 	[self drawGroupContent];
-	mIsWritingToCache = NO;
+	mIsWritingToCache = wasWritingToCache;
+}
+
+#pragma mark -
+#pragma mark - spatial index
+
+/** @brief Returns the group's spatial index of its objects, making it if necessary
+ @return the index, or nil if the group has too few objects to need one
+ */
+- (DKRTreeObjectStorage*)objectIndex
+{
+	if (mObjectIndex == nil && [m_objects count] >= kDKShapeGroupIndexThreshold) {
+		NSMutableArray* entries = [[NSMutableArray alloc] init];
+		NSEnumerator* iter = [m_objects objectEnumerator];
+		DKDrawableObject* obj;
+		BOOL wasWritingToCache = mIsWritingToCache;
+
+		// while writing to the cache the group gives its objects no transform, so their logical bounds are in its coordinates. Those of
+		// nested groups are too, as their content lies within their path
+
+		mIsWritingToCache = YES;
+
+		while ((obj = [iter nextObject])) {
+			DKShapeGroupIndexEntry* entry = [[DKShapeGroupIndexEntry alloc] init];
+			NSSize extra = [obj extraSpaceNeeded];
+
+			entry->mObjectRef = obj;
+			entry->mBounds = NSInsetRect(NormalizedRect([obj logicalBounds]), -(extra.width + 1.0), -(extra.height + 1.0));
+
+			[entries addObject:entry];
+			[entry release];
+		}
+
+		mIsWritingToCache = wasWritingToCache;
+
+		mObjectIndex = [[DKRTreeObjectStorage alloc] init];
+		[mObjectIndex setObjects:entries];
+		[entries release];
+
+		LogEvent_(kInfoEvent, @"group %p indexed %lu objects", self, (unsigned long)[m_objects count]);
+	}
+
+	return mObjectIndex;
+}
+
+/** @brief Discards the spatial index, so that it is made again when next needed
+ */
+- (void)invalidateObjectIndex
+{
+	[mObjectIndex release];
+	mObjectIndex = nil;
+}
+
+/** @brief Returns the objects that can be seen through the current clip, in drawing order
+ @return the objects to draw
+ */
+- (NSArray*)objectsToDraw
+{
+	DKRTreeObjectStorage* index = [self objectIndex];
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+
+	if (index == nil || context == nil)
+		return [self groupObjects];
+
+	CGRect clip = CGContextGetClipBoundingBox([context graphicsPort]);
+
+	if (CGRectIsNull(clip))
+		return [NSArray array];
+
+	if (CGRectIsInfinite(clip))
+		return [self groupObjects];
+
+	// the objects' paths are transformed by the rendering transform and then drawn in the current coordinates, so taking the clip back
+	// through its inverse gives the part of the group that can be seen
+
+	NSAffineTransform* tfm = [self renderingTransform];
+	NSRect area = NSRectFromCGRect(clip);
+
+	if (tfm) {
+		NSAffineTransformStruct ts = [tfm transformStruct];
+
+		if (ts.m11 * ts.m22 - ts.m12 * ts.m21 == 0.0)
+			return [self groupObjects];
+
+		tfm = [[tfm copy] autorelease];
+		[tfm invert];
+		area = [[tfm transformBezierPath:[NSBezierPath bezierPathWithRect:area]] bounds];
+	}
+
+	NSArray* entries = [index objectsIntersectingRect:area
+											   inView:nil
+											  options:0];
+	NSMutableArray* objects = [NSMutableArray arrayWithCapacity:[entries count]];
+	NSEnumerator* iter = [entries objectEnumerator];
+	DKShapeGroupIndexEntry* entry;
+
+	while ((entry = [iter nextObject]))
+		[objects addObject:entry->mObjectRef];
+
+	return objects;
 }
 
 #pragma mark -
@@ -499,6 +1093,8 @@
 
 	[layer didUngroupObjects:m_objects];
 
+	[self invalidateObjectIndex];
+	[self invalidateCache];
 	[m_objects release];
 	m_objects = nil;
 }
@@ -566,6 +1162,53 @@
 	return [super bounds];
 }
 
+- (void)addOutlineToPath:(CGMutablePathRef)path
+{
+	// the outlines are those of the objects in the group, which already include its transform
+
+	NSEnumerator* iter = [[self groupObjects] objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject])) {
+		if ([obj visible])
+			[obj addOutlineToPath:path];
+	}
+}
+
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	[super addFootprintToReport:footprint];
+
+	NSEnumerator* iter = [[self groupObjects] objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject]))
+		[obj addFootprintToReport:footprint];
+
+	// a content cache shared by several groups is split between them
+
+	if (mContentCache != NULL) {
+		CGSize size = CGLayerGetSize(mContentCache);
+		NSUInteger bytes = (NSUInteger)(size.width * size.height) * 4;
+
+		if (mContentCacheKey) {
+			@synchronized([DKGroupContentCache class])
+			{
+				DKGroupContentCache* shared = [sSharedContentCaches objectForKey:mContentCacheKey];
+
+				if (shared->mUsers > 1)
+					bytes /= shared->mUsers;
+			}
+		}
+
+		[footprint addBytes:bytes
+				 toCategory:kDKFootprintRenderCaches];
+	}
+
+	[footprint addBytes:[[mPDFContentCache PDFRepresentation] length]
+			 toCategory:kDKFootprintRenderCaches];
+}
+
 - (NSSet*)allStyles
 {
 	// return the union of all the contained objects' styles
@@ -622,6 +1265,8 @@
 
 	[[self groupObjects] makeObjectsPerformSelector:@selector(replaceMatchingStylesFromSet:)
 										 withObject:aSet];
+	[self invalidateObjectIndex];
+	[self invalidateCache];
 }
 
 /** @brief Draws the objects within the group.
@@ -638,7 +1283,8 @@
 	if ([self clipContentToPath])
 		[[self renderingPath] addClip];
 
-	[self drawGroupContent];
+	if (![self drawContentFromCache])
+		[self drawGroupContent];
 
 	RESTORE_GRAPHICS_CONTEXT
 }
@@ -709,6 +1355,8 @@
 
 	[[self groupObjects] makeObjectsPerformSelector:@selector(setStyle:)
 										 withObject:style];
+	[self invalidateObjectIndex];
+	[self invalidateCache];
 	[self notifyVisualChange];
 }
 
@@ -849,6 +1497,7 @@
 - (void)dealloc
 {
 	[self invalidateCache];
+	[self invalidateObjectIndex];
 	[m_objects makeObjectsPerformSelector:@selector(setContainer:)
 							   withObject:nil];
 	[m_objects release];
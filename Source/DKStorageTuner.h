@@ -0,0 +1,121 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKObjectOwnerLayer;
+
+/// how a layer's storage has been used. Counts decay by half each time the tuner evaluates them, so they weight recent use the most.
+
+typedef struct {
+	double queries; // rect and point queries
+	double queryWidth; // the total width and height of the rects queried, for their mean size
+	double queryHeight;
+	double boundsChanges;
+	double structuralChanges; // insertions, removals and reorderings
+} DKStorageUsage;
+
+/// how a layer's objects are spread over the canvas, from a sample of them
+
+typedef struct {
+	NSUInteger count; // of all the objects, not the sample
+	double meanWidth; // of the sampled objects' bounds
+	double meanHeight;
+	double clustering; // 0 if the sampled objects' centres are spread as evenly as random ones, up to 1 if they're all in one place
+	NSSize canvasSize;
+} DKBoundsDistribution;
+
+/** @brief Watches how a layer's storage is used, and moves the layer to a better kind of storage when one would clearly do better.
+
+ Watches how a layer's storage is used, and moves the layer to a better kind of storage when one would clearly do better. Which storage
+ suits a layer depends on how many objects it has, how they are spread, and whether it is mostly drawn and hit-tested or mostly edited,
+ which a single +[DKObjectOwnerLayer setStorageClass:] for every layer can't allow for; a layer of a dozen labels is best in linear
+ storage, and a layer of a million features in a spatial one.
+
+ The layer tells its tuner of each query, bounds change and insertion, removal or reordering made on the main thread. After every
+ kDKStorageTunerEvaluationInterval of them the tuner samples the objects' bounds and estimates the cost of the recent use for each of
+ the candidate storage classes. The cost model counts, in units of the time a linear scan takes per object, the nodes visited, the
+ objects looked at and returned, and the work each class does to keep its index up to date. Its constants rank the classes as the
+ storage benchmark (TestStorageBenchmark) does for its distributions, and can be adjusted after running it on the target hardware.
+
+ A layer only moves when the best class would cost less than kDKStorageTunerWinningRatio of the current one, and would save more than
+ it costs to build the new storage within kDKStorageTunerPaybackEvaluations evaluations' worth of the same use. The move is made once
+ the layer has been left alone for kDKStorageTunerIdleDelay, and swaps in the new storage, fully built, in one step, so nothing ever
+ sees the layer part way between the two. Storage of a class the tuner doesn't know is never replaced.
+
+ A tuner belongs to its layer, which makes it when -[DKObjectOwnerLayer setAdaptsStorage:] is passed YES.
+*/
+@interface DKStorageTuner : NSObject {
+@private
+	DKObjectOwnerLayer* mLayerRef;
+	DKStorageUsage mUsage;
+	NSUInteger mOperationCount; // every operation noted, to tell whether the layer has been left alone
+	NSUInteger mNextEvaluation; // the operation count at which to evaluate next
+	NSUInteger mIdleCheckCount; // the operation count when the idle check was scheduled
+	Class mPendingClass; // the class to move to once the layer is idle, if any
+	NSUInteger mMigrationCount;
+}
+
+/** @brief Sets the storage classes a tuner chooses between
+ @param classes an array of classes known to the cost model; the default is all four of DrawKit's storage classes
+ */
++ (void)setCandidateStorageClasses:(NSArray*)classes;
++ (NSArray*)candidateStorageClasses;
+
+/** @brief Estimates the cost of some use of storage of a class
+ @param aClass one of DrawKit's storage classes
+ @param usage the use
+ @param dist the spread of the objects
+ @return the estimated cost, or HUGE_VAL if the class is unknown to the cost model
+ */
++ (double)costOfStorageClass:(Class)aClass usage:(DKStorageUsage)usage distribution:(DKBoundsDistribution)dist;
+
+/** @brief Estimates the cost of building storage of a class for some objects
+ @param aClass one of DrawKit's storage classes
+ @param count the number of objects
+ @return the estimated cost
+ */
++ (double)buildCostOfStorageClass:(Class)aClass count:(NSUInteger)count;
+
+/** @brief Samples the bounds of some objects
+ @param objects the objects
+ @param size the size of the canvas they're on
+ @return the spread of the objects
+ */
++ (DKBoundsDistribution)distributionOfObjects:(NSArray*)objects canvasSize:(NSSize)size;
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer;
+
+/** @brief Detaches the tuner from its layer, cancelling any move it has scheduled
+
+ Called by the layer when it stops adapting or is deallocated.
+ */
+- (void)invalidate;
+
+// noting the use of the storage. Only the main thread's use is counted
+
+- (void)noteQueryOfRect:(NSRect)rect;
+- (void)noteBoundsChanges:(NSUInteger)count;
+- (void)noteStructuralChanges:(NSUInteger)count;
+
+- (DKStorageUsage)usage;
+
+/** @brief Works out the class that would suit the layer best, from its recent use
+ @return the best of the candidate classes, or the class of the layer's storage if none clearly beats it
+ */
+- (Class)preferredStorageClass;
+
+/** @brief The number of times the tuner has moved its layer to a new kind of storage
+ */
+- (NSUInteger)migrationCount;
+
+@end
+
+#define kDKStorageTunerEvaluationInterval 1024 // operations noted between evaluations
+#define kDKStorageTunerWinningRatio 0.5 // the fraction of the current class's cost another must come under to be moved to
+#define kDKStorageTunerPaybackEvaluations 4.0
+#define kDKStorageTunerIdleDelay 1.0 // seconds without any use of the layer before it's moved
+#define kDKStorageTunerSampleSize 1024 // objects whose bounds are sampled at each evaluation
@@ -0,0 +1,349 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKStorageTuner.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawing.h"
+#import "DKDrawKitMacros.h"
+#import "DKLinearObjectStorage.h"
+#import "DKBSPObjectStorage.h"
+#import "DKBSPDirectObjectStorage.h"
+#import "DKRTreeObjectStorage.h"
+#import "LogEvent.h"
+
+// the cost model's constants, in units of the time a linear scan of the bounds cache takes per object
+
+#define kDKStorageCostScan 1.0 // per object, for a linear query
+#define kDKStorageCostResult 8.0 // per object returned by any query
+#define kDKStorageCostNode 24.0 // per level of a tree descended by a query
+#define kDKStorageCostLeafItem 3.0 // per entry looked at in the leaves a BSP query visits
+#define kDKStorageCostSort 4.0 // per object, for sorting query results by their sparse Z keys
+#define kDKStorageCostLeafUpdate 40.0 // per BSP leaf an object is added to or removed from
+#define kDKStorageCostRTreeUpdate 30.0 // per level of the R-tree, for re-inserting a changed object
+#define kDKStorageCostRenumber 0.1 // per object, for renumbering the objects above one inserted or removed
+#define kDKStorageCostBuild 6.0 // per object per level, for building a tree in one go
+#define kDKStorageBSPLeafCapacity 16.0 // the objects in a BSP leaf when the tree's depth suits the object count
+#define kDKStorageCrowdingPenalty 4.0 // how many times fuller a BSP's leaves get where all the objects are bunched together
+#define kDKStorageTunerGridSize 16 // cells along each side of the grid clustering is measured over
+
+static NSArray* sCandidateClasses = nil;
+
+@interface DKStorageTuner (Private)
+
+- (void)evaluate;
+- (void)scheduleIdleCheck;
+- (void)idleCheck;
+
+@end
+
+#pragma mark -
+
+@implementation DKStorageTuner
+#pragma mark As a DKStorageTuner
+
++ (void)setCandidateStorageClasses:(NSArray*)classes
+{
+	[classes retain];
+	[sCandidateClasses release];
+	sCandidateClasses = classes;
+}
+
++ (NSArray*)candidateStorageClasses
+{
+	if (sCandidateClasses == nil)
+		sCandidateClasses = [[NSArray alloc] initWithObjects:[DKLinearObjectStorage class], [DKBSPObjectStorage class], [DKBSPDirectObjectStorage class], [DKRTreeObjectStorage class], nil];
+
+	return sCandidateClasses;
+}
+
++ (double)costOfStorageClass:(Class)aClass usage:(DKStorageUsage)usage distribution:(DKBoundsDistribution)dist
+{
+	double n = dist.count;
+	double canvasArea = MAX(dist.canvasSize.width * dist.canvasSize.height, 1.0);
+	double queryWidth = (usage.queries > 0.0) ? usage.queryWidth / usage.queries : 0.0;
+	double queryHeight = (usage.queries > 0.0) ? usage.queryHeight / usage.queries : 0.0;
+
+	// queries are mostly made where the objects are, so the objects a query finds are those of the part of the canvas they're spread over
+	// whose bounds could touch the query's rect
+
+	double occupied = canvasArea * MAX(1.0 - dist.clustering, 1.0 / (kDKStorageTunerGridSize * kDKStorageTunerGridSize));
+	double found = n * MIN(1.0, (dist.meanWidth + queryWidth) * (dist.meanHeight + queryHeight) / occupied);
+	double levels = log2(n + 1.0);
+
+	// an object is in every BSP leaf its bounds touch, and where objects are bunched together the leaves there hold more than their share
+
+	double leaves = MAX(1.0, n / kDKStorageBSPLeafCapacity);
+	double leafWidth = MAX(dist.canvasSize.width / sqrt(leaves), 1.0);
+	double leafHeight = MAX(dist.canvasSize.height / sqrt(leaves), 1.0);
+	double span = (1.0 + dist.meanWidth / leafWidth) * (1.0 + dist.meanHeight / leafHeight);
+	double crowding = 1.0 + dist.clustering * kDKStorageCrowdingPenalty;
+
+	double query, boundsChange, structuralChange;
+
+	if (aClass == [DKLinearObjectStorage class]) {
+		query = kDKStorageCostScan * n + kDKStorageCostResult * found;
+		boundsChange = 1.0;
+		structuralChange = 1.0;
+	} else if (aClass == [DKBSPObjectStorage class]) {
+		query = kDKStorageCostNode * levels + (kDKStorageCostResult + kDKStorageCostLeafItem * span * crowding) * found;
+		boundsChange = kDKStorageCostLeafUpdate * span;
+		structuralChange = kDKStorageCostLeafUpdate * span + kDKStorageCostRenumber * n * 0.5;
+	} else if (aClass == [DKBSPDirectObjectStorage class]) {
+		query = kDKStorageCostNode * levels + (kDKStorageCostResult + kDKStorageCostSort + kDKStorageCostLeafItem * span * crowding * 0.5) * found;
+		boundsChange = kDKStorageCostLeafUpdate * span;
+		structuralChange = kDKStorageCostLeafUpdate * span;
+	} else if (aClass == [DKRTreeObjectStorage class]) {
+		query = kDKStorageCostNode * 2.0 * levels + (kDKStorageCostResult + kDKStorageCostLeafItem) * found;
+		boundsChange = kDKStorageCostRTreeUpdate * levels;
+		structuralChange = kDKStorageCostRTreeUpdate * levels + kDKStorageCostRenumber * n * 0.5;
+	} else
+		return HUGE_VAL;
+
+	return usage.queries * query + usage.boundsChanges * boundsChange + usage.structuralChanges * structuralChange;
+}
+
++ (double)buildCostOfStorageClass:(Class)aClass count:(NSUInteger)count
+{
+	if (aClass == [DKLinearObjectStorage class])
+		return count;
+
+	return kDKStorageCostBuild * count * log2(count + 1.0);
+}
+
++ (DKBoundsDistribution)distributionOfObjects:(NSArray*)objects canvasSize:(NSSize)size
+{
+	DKBoundsDistribution dist;
+	NSUInteger i, count = [objects count];
+	NSUInteger stride = MAX((NSUInteger)1, count / kDKStorageTunerSampleSize);
+	NSUInteger sampled = 0, occupiedCells = 0;
+	BOOL cells[kDKStorageTunerGridSize * kDKStorageTunerGridSize];
+	double width = 0.0, height = 0.0;
+
+	memset(cells, 0, sizeof(cells));
+	dist.count = count;
+	dist.canvasSize = size;
+
+	// the objects are sampled evenly through the stacking order, and their centres marked on a grid over the canvas
+
+	for (i = 0; i < count; i += stride) {
+		NSRect r = [(id<DKStorableObject>)[objects objectAtIndex:i] bounds];
+
+		if (NSIsEmptyRect(r))
+			continue;
+
+		NSInteger cx = (NSInteger)floor(NSMidX(r) / MAX(size.width, 1.0) * kDKStorageTunerGridSize);
+		NSInteger cy = (NSInteger)floor(NSMidY(r) / MAX(size.height, 1.0) * kDKStorageTunerGridSize);
+		NSInteger cell = LIMIT(cy, 0, kDKStorageTunerGridSize - 1) * kDKStorageTunerGridSize + LIMIT(cx, 0, kDKStorageTunerGridSize - 1);
+
+		if (!cells[cell]) {
+			cells[cell] = YES;
+			++occupiedCells;
+		}
+
+		width += NSWidth(r);
+		height += NSHeight(r);
+		++sampled;
+	}
+
+	dist.meanWidth = sampled ? width / sampled : 0.0;
+	dist.meanHeight = sampled ? height / sampled : 0.0;
+
+	// clustering compares the empty cells with the number a random spread of as many centres would be expected to leave empty
+
+	double total = kDKStorageTunerGridSize * kDKStorageTunerGridSize;
+	double expectedEmpty = pow(1.0 - 1.0 / total, (double)sampled);
+	double empty = (total - occupiedCells) / total;
+
+	dist.clustering = (sampled > 0 && expectedEmpty < 1.0) ? LIMIT((empty - expectedEmpty) / (1.0 - expectedEmpty), 0.0, 1.0) : 0.0;
+
+	return dist;
+}
+
+- (id)initWithLayer:(DKObjectOwnerLayer*)layer
+{
+	self = [super init];
+	if (self) {
+		mLayerRef = layer;
+		mNextEvaluation = kDKStorageTunerEvaluationInterval;
+	}
+
+	return self;
+}
+
+- (void)invalidate
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self
+											 selector:@selector(idleCheck)
+											   object:nil];
+	mPendingClass = Nil;
+	mLayerRef = nil;
+}
+
+- (void)noteQueryOfRect:(NSRect)rect
+{
+	if (![NSThread isMainThread])
+		return;
+
+	mUsage.queries += 1.0;
+	mUsage.queryWidth += NSWidth(rect);
+	mUsage.queryHeight += NSHeight(rect);
+
+	if (++mOperationCount >= mNextEvaluation)
+		[self evaluate];
+}
+
+- (void)noteBoundsChanges:(NSUInteger)count
+{
+	if (![NSThread isMainThread])
+		return;
+
+	mUsage.boundsChanges += count;
+	mOperationCount += count;
+
+	if (mOperationCount >= mNextEvaluation)
+		[self evaluate];
+}
+
+- (void)noteStructuralChanges:(NSUInteger)count
+{
+	if (![NSThread isMainThread])
+		return;
+
+	mUsage.structuralChanges += count;
+	mOperationCount += count;
+
+	if (mOperationCount >= mNextEvaluation)
+		[self evaluate];
+}
+
+- (DKStorageUsage)usage
+{
+	return mUsage;
+}
+
+- (Class)preferredStorageClass
+{
+	Class current = [[mLayerRef storage] class];
+
+	if (mLayerRef == nil || [mLayerRef drawing] == nil)
+		return current;
+
+	NSArray* objects = [[mLayerRef storage] objects];
+	DKBoundsDistribution dist = [[self class] distributionOfObjects:objects
+														 canvasSize:[[mLayerRef drawing] drawingSize]];
+	double currentCost = [[self class] costOfStorageClass:current
+													usage:mUsage
+											 distribution:dist];
+
+	if (currentCost == HUGE_VAL)
+		return current;
+
+	NSEnumerator* iter = [[[self class] candidateStorageClasses] objectEnumerator];
+	Class candidate, best = current;
+	double bestCost = currentCost;
+
+	while ((candidate = [iter nextObject])) {
+		double cost = [[self class] costOfStorageClass:candidate
+												 usage:mUsage
+										  distribution:dist];
+
+		if (cost < bestCost) {
+			best = candidate;
+			bestCost = cost;
+		}
+	}
+
+	// the best class must win clearly, and soon make up for the cost of moving to it
+
+	if (best == current || bestCost > currentCost * kDKStorageTunerWinningRatio)
+		return current;
+
+	if ((currentCost - bestCost) * kDKStorageTunerPaybackEvaluations < [[self class] buildCostOfStorageClass:best
+																										count:[objects count]])
+		return current;
+
+	return best;
+}
+
+- (NSUInteger)migrationCount
+{
+	return mMigrationCount;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[self invalidate];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKStorageTuner (Private)
+
+- (void)evaluate
+{
+	mNextEvaluation = mOperationCount + kDKStorageTunerEvaluationInterval;
+
+	if (mLayerRef == nil || [mLayerRef hasPendingObjects])
+		return;
+
+	Class preferred = [self preferredStorageClass];
+
+	mPendingClass = (preferred != [[mLayerRef storage] class]) ? preferred : Nil;
+
+	if (mPendingClass)
+		[self scheduleIdleCheck];
+
+	// older use counts for less, so a layer that changes how it's used is soon judged on its new use
+
+	mUsage.queries *= 0.5;
+	mUsage.queryWidth *= 0.5;
+	mUsage.queryHeight *= 0.5;
+	mUsage.boundsChanges *= 0.5;
+	mUsage.structuralChanges *= 0.5;
+}
+
+- (void)scheduleIdleCheck
+{
+	[NSObject cancelPreviousPerformRequestsWithTarget:self
+											 selector:@selector(idleCheck)
+											   object:nil];
+
+	mIdleCheckCount = mOperationCount;
+	[self performSelector:@selector(idleCheck)
+			   withObject:nil
+			   afterDelay:kDKStorageTunerIdleDelay];
+}
+
+- (void)idleCheck
+{
+	if (mPendingClass == Nil || mLayerRef == nil)
+		return;
+
+	// anything done to the layer since the check was scheduled puts the move off again
+
+	if (mOperationCount != mIdleCheckCount) {
+		[self scheduleIdleCheck];
+		return;
+	}
+
+	Class target = mPendingClass;
+
+	mPendingClass = Nil;
+
+	if ([mLayerRef changeStorageToClass:target]) {
+		++mMigrationCount;
+		LogEvent_(kReactiveEvent, @"layer '%@' moved to %@ storage", [mLayerRef layerName], NSStringFromClass(target));
+	} else
+		[self scheduleIdleCheck];
+}
+
+@end
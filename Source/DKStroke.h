@@ -71,3 +71,12 @@ DKStyle can contains a list of strokes without limit.
 - (NSSize)extraSpaceNeededIgnoringMitreLimit;
 
 @end
+
+/*
+ A stroke of a path with many elements is culled to the area being drawn. The path, after trimming and lateral offsetting, is kept in the
+ object's rendering cache with a DKPathElementIndex of it, and only the elements whose bounds, grown by the stroke's allowance, reach into
+ the current clip are stroked. As anything an element draws lies within that distance of it, the result is the same as stroking the whole path.
+ A dashed path is stroked in sections, each with its phase advanced by its distance along its subpath, so the dashes don't shift.
+*/
+
+#define kDKStrokeMinimumElementsToCull 500 // paths with fewer elements are always stroked whole
@@ -9,9 +9,55 @@
 #import "DKStrokeDash.h"
 #import "NSBezierPath+Geometry.h"
 #import "NSShadow+Scaling.h"
+#import "NSColor+DKAdditions.h"
 #import "DKDrawableObject.h"
 #import "DKDrawing.h"
+#import "DKDashedPath.h"
+#import "DKPathElementIndex.h"
+#import "DKArcLengthTable.h"
 
+static NSString* kDKStrokeDashedPathCacheKey = @"DKStroke_dashes";
+static NSString* kDKStrokeCulledPathCacheKey = @"DKStroke_culling";
+
+#define kDKStrokeOffsetFlatness 0.05 // how finely a laterally offset stroke flattens any curves left in the path it's given
+
+// a long path as stroked, indexed so that the part of it in the area being drawn can be found quickly
+
+@interface DKStrokeCulledPath : NSObject {
+@public
+	NSBezierPath* mPath;
+	NSRect mBounds;
+	DKPathElementIndex* mIndex;
+	NSInteger* mSubpathStarts; // the index of the move starting the subpath of each element
+	DKArcLengthTable* mLengths; // made when a dashed section is first stroked
+}
+
+@end
+
+@implementation DKStrokeCulledPath
+
+- (void)dealloc
+{
+	[mPath release];
+	[mIndex release];
+	[mLengths release];
+	free(mSubpathStarts);
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKStroke (Private)
+
+- (NSBezierPath*)strokePathForPath:(NSBezierPath*)path;
+- (BOOL)strokesAsDKStroke;
+- (BOOL)renderCulledPath:(NSBezierPath*)path forObject:(id<DKRenderable>)object;
+
+@end
+
+#pragma mark -
 @implementation DKStroke
 #pragma mark As a DKStroke
 + (DKStroke*)defaultStroke
@@ -255,6 +301,34 @@
 
 #pragma mark -
 #pragma mark As a DKRasterizer
+- (NSUInteger)renderingCacheParameters
+{
+	NSUInteger cs = [super renderingCacheParameters];
+
+	cs = DKRasterizerChecksumCombine(cs, [self width]);
+	cs = DKRasterizerChecksumCombine(cs, [self lateralOffset]);
+	cs = DKRasterizerChecksumCombine(cs, [self trimLength]);
+	cs = DKRasterizerChecksumCombine(cs, [self lineCapStyle]);
+	cs = DKRasterizerChecksumCombine(cs, [self lineJoinStyle]);
+	cs = DKRasterizerChecksumCombine(cs, [self miterLimit]);
+
+	// precomputed dashes follow the dash's settings, not just which dash it is
+
+	DKStrokeDash* dash = [self dash];
+
+	if (dash != nil) {
+		NSUInteger i;
+
+		for (i = 0; i < (NSUInteger)[dash count]; ++i)
+			cs = DKRasterizerChecksumCombine(cs, [dash lengthAtIndex:i]);
+
+		cs = DKRasterizerChecksumCombine(cs, [dash phase]);
+		cs = DKRasterizerChecksumCombine(cs, [dash scalesToLineWidth]);
+	}
+
+	return cs * 31 + (NSUInteger)dash;
+}
+
 - (BOOL)isValid
 {
 	return ([self colour] != nil);
@@ -319,12 +393,10 @@
 	if (![obj conformsToProtocol:@protocol(DKRenderable)] || ![self enabled])
 		return;
 
-	BOOL lowQuality = [obj useLowQualityDrawing];
-
 	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
 		if ([self shadow] != nil && [DKStyle willDrawShadows])
 	{
-		if (!lowQuality)
+		if (!DKRenderUsesLowQualityDrawing(obj))
 			[[self shadow] setAbsolute];
 		else
 			[[self shadow] drawApproximateShadowWithPath:[obj renderingPath]
@@ -336,7 +408,72 @@
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 }
 
+- (NSBezierPath*)renderingPathForObject:(id<DKRenderable>)object
+{
+	// an offset stroke has to flatten the path, so it starts from the object's shared flattening. Other strokes offsetting the same path
+	// then reuse it, and flattening it again in -renderPath: is trivial.
+
+	if (mLateralOffset != 0.0)
+		return [self flattenedRenderingPathForObject:object];
+	else
+		return [super renderingPathForObject:object];
+}
+
+- (void)renderPath:(NSBezierPath*)path forObject:(id<DKRenderable>)object
+{
+	// precomputed dashes stand in for what -renderPath: would stroke, so they're only used by classes that stroke the way this one does.
+	// Each run of dashes would cast a shadow of its own, so shadowed strokes are left to Quartz as well.
+
+	BOOL canCache = [object respondsToSelector:@selector(renderingCache)] && [self strokesAsDKStroke];
+	BOOL precompute = canCache && [[self dash] precomputesDashes] && [self shadow] == nil;
+
+	id dashes = nil;
+
+	if (precompute) {
+		dashes = [self cachedValueForObject:object
+								 sourcePath:path
+										key:kDKStrokeDashedPathCacheKey];
+
+		if (dashes == nil) {
+			NSBezierPath* pc = [self strokePathForPath:path];
+
+			[self applyAttributesToPath:pc];
+			dashes = [DKDashedPath dashedPathWithPath:pc];
+
+			// a path with too many dashes to keep is remembered as such, so it isn't measured again on every draw
+
+			if (dashes == nil)
+				dashes = [NSNull null];
+
+			[self setCachedValue:dashes
+					   forObject:object
+					  sourcePath:path
+							 key:kDKStrokeDashedPathCacheKey];
+		}
+	}
+
+	if ([dashes isKindOfClass:[DKDashedPath class]]) {
+		[[self colour] setRenderingStroke];
+		[(DKDashedPath*)dashes strokeInClip];
+	} else if (!canCache || [path elementCount] < kDKStrokeMinimumElementsToCull || ![self renderCulledPath:path
+																								   forObject:object])
+		[super renderPath:path
+				forObject:object];
+}
+
 - (void)renderPath:(NSBezierPath*)path
+{
+	NSBezierPath* pc = [self strokePathForPath:path];
+
+	[[self colour] setRenderingStroke];
+	[self applyAttributesToPath:pc];
+
+	[pc stroke];
+}
+
+#pragma mark -
+
+- (NSBezierPath*)strokePathForPath:(NSBezierPath*)path
 {
 	// copy path as we are about to change many of its properties
 
@@ -348,18 +485,185 @@
 		pc = [[path copy] autorelease];
 
 	if (mLateralOffset != 0.0) {
-		// make a parallel copy of the path
-		CGFloat savedFlatness = [NSBezierPath defaultFlatness];
-		[NSBezierPath setDefaultFlatness:0.05];
+		// make a parallel copy of the path. The rendering path is already flattened at the object's scale (see -renderingPathForObject:), so
+		// the flatness here only applies to curves in paths passed in by subclasses.
 		[pc setLineJoinStyle:[self lineJoinStyle]];
-		pc = [pc paralleloidPathWithOffset22:[self lateralOffset]];
-		[NSBezierPath setDefaultFlatness:savedFlatness];
+		pc = [pc paralleloidPathWithOffset22:[self lateralOffset]
+									flatness:kDKStrokeOffsetFlatness];
 	}
 
-	[[self colour] setStroke];
-	[self applyAttributesToPath:pc];
+	return pc;
+}
 
-	[pc stroke];
+- (BOOL)strokesAsDKStroke
+{
+	return [self methodForSelector:@selector(renderPath:)] == [DKStroke instanceMethodForSelector:@selector(renderPath:)];
+}
+
+- (BOOL)renderCulledPath:(NSBezierPath*)path forObject:(id<DKRenderable>)object
+{
+	CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+
+	if (context == NULL)
+		return NO;
+
+	DKStrokeCulledPath* culled = [self cachedValueForObject:object
+												 sourcePath:path
+														key:kDKStrokeCulledPathCacheKey];
+
+	if (culled == nil) {
+		NSBezierPath* pc = [self strokePathForPath:path];
+		NSInteger i, count = [pc elementCount], move = 0;
+
+		culled = [[[DKStrokeCulledPath alloc] init] autorelease];
+		culled->mPath = [pc retain];
+		culled->mBounds = [pc controlPointBounds];
+		culled->mIndex = [[DKPathElementIndex alloc] initWithPath:pc];
+		culled->mSubpathStarts = malloc(MAX(count, 1) * sizeof(NSInteger));
+
+		for (i = 0; i < count; ++i) {
+			if ([pc elementAtIndex:i] == NSMoveToBezierPathElement)
+				move = i;
+
+			culled->mSubpathStarts[i] = move;
+		}
+
+		[self setCachedValue:culled
+				   forObject:object
+				  sourcePath:path
+						 key:kDKStrokeCulledPathCacheKey];
+	}
+
+	CGFloat outset = [self allowance] + 1.0;
+	NSRect area = NSInsetRect(NSRectFromCGRect(CGContextGetClipBoundingBox(context)), -outset, -outset);
+
+	// when all of it is in view, it's quicker to stroke it whole
+
+	if (NSContainsRect(area, culled->mBounds))
+		return NO;
+
+	NSIndexSet* visible = [culled->mIndex elementsIntersectingRect:area];
+
+	if ([visible count] == 0)
+		return YES;
+
+	NSBezierPath* pc = culled->mPath;
+	NSBezierPath* sections = [NSBezierPath bezierPath];
+	NSInteger dashCount = 0;
+	CGFloat* pattern = NULL;
+	CGFloat phase = 0.0;
+
+	[self applyAttributesToPath:sections];
+	[sections getLineDash:NULL
+					count:&dashCount
+					phase:NULL];
+
+	if (dashCount > 0) {
+		pattern = malloc(dashCount * sizeof(CGFloat));
+		[sections getLineDash:pattern
+						count:&dashCount
+						phase:&phase];
+
+		if (culled->mLengths == nil)
+			culled->mLengths = [[DKArcLengthTable alloc] initWithPath:pc
+													   maximumError:0.1];
+	}
+
+	[[self colour] setRenderingStroke];
+
+	NSUInteger first = [visible firstIndex];
+	NSPoint ap[3];
+
+	while (first != NSNotFound) {
+		// each run of consecutive visible elements is a section, which starts where the element before it ends
+
+		NSUInteger last = first, i;
+
+		while ([visible containsIndex:last + 1])
+			++last;
+
+		NSInteger move = culled->mSubpathStarts[first];
+		NSPoint subpathStart, start;
+
+		[pc elementAtIndex:move
+		  associatedPoints:ap];
+		subpathStart = ap[0];
+
+		switch ([pc elementAtIndex:first - 1
+				  associatedPoints:ap]) {
+		case NSCurveToBezierPathElement:
+			start = ap[2];
+			break;
+
+		case NSClosePathBezierPathElement:
+			start = subpathStart;
+			break;
+
+		default:
+			start = ap[0];
+			break;
+		}
+
+		NSBezierPath* section = (pattern != NULL) ? [sections copy] : [sections retain];
+
+		[section moveToPoint:start];
+
+		for (i = first; i <= last; ++i) {
+			switch ([pc elementAtIndex:i
+					  associatedPoints:ap]) {
+			case NSLineToBezierPathElement:
+				[section lineToPoint:ap[0]];
+				break;
+
+			case NSCurveToBezierPathElement:
+				[section curveToPoint:ap[2]
+						controlPoint1:ap[0]
+						controlPoint2:ap[1]];
+				break;
+
+			case NSClosePathBezierPathElement:
+				// only a section that covers the whole subpath has the join where it closes
+
+				if (first == (NSUInteger)move + 1)
+					[section closePath];
+				else
+					[section lineToPoint:subpathStart];
+				break;
+
+			default:
+				break;
+			}
+		}
+
+		// a dashed section carries on the pattern from where its subpath has got to
+
+		if (pattern != NULL) {
+			CGFloat along = [culled->mLengths lengthAtElement:first
+															t:0.0];
+			CGFloat subpathAlong = [culled->mLengths lengthAtElement:move + 1
+																   t:0.0];
+
+			if (along >= 0.0 && subpathAlong >= 0.0)
+				along -= subpathAlong;
+			else
+				along = 0.0;
+
+			[section setLineDash:pattern
+						   count:dashCount
+						   phase:phase + along];
+			[section stroke];
+		}
+
+		[section release];
+		first = [visible indexGreaterThanIndex:last];
+	}
+
+	if (pattern == NULL)
+		[sections stroke];
+
+	free(pattern);
+
+	return YES;
 }
 
 #pragma mark -
@@ -13,6 +13,7 @@
 	NSUInteger m_count;
 	BOOL m_scaleToLineWidth;
 	BOOL mEditing;
+	BOOL mPrecomputesDashes;
 }
 
 /**  */
@@ -40,6 +41,17 @@
 - (void)setIsBeingEdited:(BOOL)edit;
 - (BOOL)isBeingEdited;
 
+/** @brief Whether strokes using the dash work out its dashes once per object, rather than leaving Quartz to dash the whole path on every draw
+
+ When set, a DKStroke with this dash cuts the dashes out of each object's path with a DKDashedPath, keeps them in the object's rendering
+ cache, and strokes only those that reach into the area being drawn. This makes long, detailed paths with short dashes, such as contours
+ and boundaries, draw in time proportional to how much of them is visible. It costs memory for the dashes, and a recalculation whenever
+ the path, stroke or dash changes, so it isn't worth it for short paths, or for dashes whose phase is animated. The default is NO.
+ @param precompute YES to precompute the dashes
+ */
+- (void)setPrecomputesDashes:(BOOL)precompute;
+- (BOOL)precomputesDashes;
+
 - (void)applyToPath:(NSBezierPath*)path;
 - (void)applyToPath:(NSBezierPath*)path withPhase:(CGFloat)phase;
 
@@ -222,6 +222,16 @@ static NSUInteger euclid_hcf(NSUInteger a, NSUInteger b)
 	return mEditing;
 }
 
+- (void)setPrecomputesDashes:(BOOL)precompute
+{
+	mPrecomputesDashes = precompute;
+}
+
+- (BOOL)precomputesDashes
+{
+	return mPrecomputesDashes;
+}
+
 #pragma mark -
 - (void)applyToPath:(NSBezierPath*)path
 {
@@ -388,6 +398,8 @@ static NSUInteger euclid_hcf(NSUInteger a, NSUInteger b)
 				  forKey:@"count"];
 	[coder encodeBool:[self scalesToLineWidth]
 			   forKey:@"scale_to_width"];
+	[coder encodeBool:[self precomputesDashes]
+			   forKey:@"DKStrokeDash_precomputesDashes"];
 }
 
 - (id)initWithCoder:(NSCoder*)coder
@@ -404,6 +416,7 @@ static NSUInteger euclid_hcf(NSUInteger a, NSUInteger b)
 							   count:m_count
 								  at:m_pattern];
 		[self setScalesToLineWidth:[coder decodeBoolForKey:@"scale_to_width"]];
+		[self setPrecomputesDashes:[coder decodeBoolForKey:@"DKStrokeDash_precomputesDashes"]];
 		[self setPhase:[coder decodeDoubleForKey:@"phase"]];
 	}
 	return self;
@@ -418,6 +431,7 @@ static NSUInteger euclid_hcf(NSUInteger a, NSUInteger b)
 	[copy setDashPattern:m_pattern
 				   count:m_count];
 	[copy setScalesToLineWidth:[self scalesToLineWidth]];
+	[copy setPrecomputesDashes:[self precomputesDashes]];
 	[copy setPhase:[self phase]];
 
 	return copy;
@@ -5,6 +5,7 @@
 */
 
 #import "DKRastGroup.h"
+#import "DKCommonTypes.h"
 
 @class DKDrawableObject, DKUndoManager;
 
@@ -26,6 +27,30 @@ typedef enum {
 
 #define STYLE_SWATCH_SIZE NSMakeSize(128.0, 128.0)
 
+/// opaque type of the flattened render list used internally when drawing
+
+typedef struct _DKRenderPlan DKRenderPlan;
+
+/// the kinds of drawing pass, each of which draws its objects in a different way
+
+typedef enum {
+	kDKRenderPassFull = 0, // drawing to the screen at full quality
+	kDKRenderPassInteractive = 1, // drawing to the screen at a reduced quality tier
+	kDKRenderPassPrint = 2, // printing or exporting, at full detail whatever the quality tier
+	kDKRenderPassHitTest = 3 // drawing an object into the hit-testing bitmap
+} DKRenderPass;
+
+/// the drawing state that is the same for every object a pass draws, so that it's worked out once, not by every rasterizer for every object
+
+typedef struct {
+	DKRenderPass pass;
+	BOOL drawingToScreen;
+	BOOL lowQuality; // the drawing's low quality hint, as returned by -useLowQualityDrawing
+	BOOL drawsShadows; // as +willDrawShadows
+	BOOL antialias; // as +shouldAntialias
+	BOOL usesLevelOfDetail; // small objects draw their rasterizers' low detail fallbacks
+} DKRenderMode;
+
 // n.b. for style registry API, see DKStyleRegistry.h
 
 @interface DKStyle : DKRastGroup <NSCoding, NSCopying, NSMutableCopying> {
@@ -39,7 +64,13 @@ typedef enum {
 	BOOL m_mergeFlag; // set to YES when a style is read in from a file and was saved in a registered state.
 	NSTimeInterval m_lastModTime; // timestamp to determine when styles have been updated
 	NSUInteger m_clientCount; // keeps count of the clients using the style
-	NSMutableDictionary* mSwatchCache; // cache of swatches at various sizes previously requested
+	DKRenderPlan* mRenderPlan; // flattened render list, compiled on demand and discarded after any change
+	BOOL mChangeIsPending; // YES while a coalesced change notification is waiting to be posted
+	BOOL mContentHashIsValid; // YES if mContentHash is up to date
+	NSUInteger mContentHash; // cached hash of the rasterizer tree and text attributes
+	NSUInteger mCoalescingCount; // nesting of begin/endCoalescingPropertyChanges
+	NSMutableArray* mCoalescedChanges; // the first previous value of each property changed while coalescing
+	NSMutableSet* mCoalescedKeys; // identifies the object and key path of each entry in <mCoalescedChanges>
 }
 
 // basic standard styles:
@@ -142,14 +173,90 @@ typedef enum {
  */
 + (BOOL)shouldSubstitutePlaceholderStyle;
 
+/** @brief Set whether small objects are drawn with cheap approximations of intricate rasterizers
+
+ Default is YES. When a rasterizer declares a minimum detail size and an object is drawn to the screen smaller than that, the
+ rasterizer's low detail fallback is drawn instead. Printing and exporting always render full detail.
+ @param lod YES to use level-of-detail rendering, NO to always render full detail
+ */
++ (void)setUsesLevelOfDetail:(BOOL)lod;
+
+/** @brief Whether small objects are drawn with cheap approximations of intricate rasterizers
+
+ Default is YES. When a rasterizer declares a minimum detail size and an object is drawn to the screen smaller than that, the
+ rasterizer's low detail fallback is drawn instead. Printing and exporting always render full detail.
+ @return YES if level-of-detail rendering is used
+ */
++ (BOOL)usesLevelOfDetail;
+
+/** @brief Set the quality tier that drawing is currently done at
+
+ DKDrawingView sets this for the duration of its drawing when it lowers quality to keep interactive updates fast. Lower tiers
+ suppress shadows, draw low detail fallbacks regardless of size and, at the draft tier, turn off anti-aliasing. Unlike the
+ other performance settings, this is temporary and is not saved in the defaults. It only affects drawing to the screen, and only
+ on the thread that sets it.
+ @param tier the quality tier
+ */
++ (void)setDrawingQualityTier:(DKDrawingQualityTier)tier;
+
+/** @brief The quality tier that drawing is currently done at
+ @return the quality tier
+ */
++ (DKDrawingQualityTier)drawingQualityTier;
+
+/** @brief The kind of pass that drawing into the current context would be
+ @return the full or interactive pass when drawing to the screen, according to the quality tier, otherwise the print pass
+ */
++ (DKRenderPass)renderPassForCurrentContext;
+
+/** @brief The render mode used for a pass, given the current performance settings
+ @param pass the kind of pass
+ @param lowQuality the drawing's low quality hint
+ @return the render mode
+ */
++ (DKRenderMode)renderModeForPass:(DKRenderPass)pass lowQuality:(BOOL)lowQuality;
+
+/** @brief Starts a pass of drawing in which every object is drawn in the same render mode
+
+ The mode is fixed for the pass, so the style renders each object by the path specialized for that kind of pass, and rasterizers
+ take the mode from DKCurrentRenderMode() rather than asking the object, the context and the performance settings again for every
+ object. Object layers start a pass for each update. Passes may be nested, and only affect drawing on the thread that starts them.
+ Outside a pass, everything is worked out for each object as it is drawn.
+ @param pass the kind of pass
+ @param lowQuality the drawing's low quality hint
+ */
++ (void)beginRenderPass:(DKRenderPass)pass lowQuality:(BOOL)lowQuality;
++ (void)endRenderPass;
+
 // updating & notifying clients:
 
-/** @brief Informs clients that a property of the style is about to change */
+/** @brief Sets whether changes to a style made on the main thread are collapsed into one notification
+
+ When YES, which is the default, the first change to a style in a turn of the main run loop posts
+ kDKStyleWillChangeNotification as usual, but kDKStyleDidChangeNotification is posted just once,
+ before the run loop waits again (and so before the views are redrawn), however many times the
+ style changed in between. The clients' redraws are coalesced into one update per layer.
+ @param coalesce YES to coalesce change notifications, NO to post them as each change is made
+ */
++ (void)setCoalescesChangeNotifications:(BOOL)coalesce;
++ (BOOL)coalescesChangeNotifications;
+
+/** @brief Posts any change notifications that are waiting for the end of the run loop turn
+
+ Call this if something needs the clients of changed styles to be up to date before the run loop
+ next waits - drawing does so before it starts.
+ */
++ (void)postPendingChangeNotifications;
+
+/** @brief Informs clients that a property of the style is about to change
+
+ If a coalesced change of this style is already pending, the clients have already been told. */
 - (void)notifyClientsBeforeChange;
 
 /** @brief Informs clients that a property of the style has just changed
 
- This method is called in response to any observed change to any renderer the style contains */
+ This method is called in response to any observed change to any renderer the style contains. The
+ notification may be deferred and coalesced - see +setCoalescesChangeNotifications: */
 - (void)notifyClientsAfterChange;
 
 /** @brief Called when a style is attached to an object
@@ -284,6 +391,29 @@ typedef enum {
 - (void)clearRemergeFlag;
 - (NSTimeInterval)lastModificationTimestamp;
 
+/** @brief Return an archive of what the style draws and its text attributes
+
+ The name, key, timestamp and flags are left out, so two styles that look the same have the same
+ content data, whether or not they are the same style. Computing this also caches -contentHash.
+ @return the data
+ */
+- (NSData*)contentData;
+
+/** @brief Return a hash of what the style draws and its text attributes
+
+ The hash is of -contentData, so it's stable across launches. It's cached until the style changes.
+ @return the hash
+ */
+- (NSUInteger)contentHash;
+
+/** @brief Whether another style draws the same and has the same text attributes as this one
+
+ Unlike -isEqualToStyle:, which compares the key and timestamp, this compares the contents.
+ @param aStyle another style
+ @return YES if the styles' content data are the same
+ */
+- (BOOL)hasSameContentAsStyle:(DKStyle*)aStyle;
+
 /** @brief Is this style the same as <aStyle>?
 
  Styles are considered equal if they have the same unique ID and the same timestamp.
@@ -312,6 +442,23 @@ typedef enum {
  */
 - (void)changeKeyPath:(NSString*)keypath ofObject:(id)object toValue:(id)value;
 
+/** @brief Starts collecting changes to the style's components into a single undoable action
+
+ Normally each change to a property of a rasterizer in the style is recorded for undo as it's made. Between this and a matching
+ -endCoalescingPropertyChanges, only the first previous value of each property changed is kept, and the whole burst is recorded as
+ one action when the outermost end is reached. Calls can be nested.
+ */
+- (void)beginCoalescingPropertyChanges;
+
+/** @brief Ends collecting changes started by -beginCoalescingPropertyChanges, recording them for undo if this ends the outermost
+ */
+- (void)endCoalescingPropertyChanges;
+
+/** @brief Restores properties of the style's components, as recorded by -endCoalescingPropertyChanges
+ @param changes dictionaries giving the object, key path and value of each property to restore
+ */
+- (void)restoreComponentValues:(NSArray*)changes;
+
 // stroke utilities:
 
 /** @brief Adjusts all contained stroke widths by the given scale value
@@ -411,6 +558,48 @@ typedef enum {
  */
 - (BOOL)hasTextAdornment;
 
+/** @brief Queries whether the style contains renderers that are relatively slow to draw
+
+ Hatches, fill patterns and roughened strokes all generate a lot of drawing for each object, so objects using them benefit from having
+ their rendered image cached.
+ @return YES if the style has one or more expensive renderers, NO otherwise
+ */
+- (BOOL)isExpensiveToRender;
+
+/** @brief Discards the style's compiled render plan
+
+ When a style first renders, it flattens its tree of rasterizers into a plan - a simple list of the enabled rasterizers in drawing
+ order, together with the graphics state saves and restores that plain groups require and the space the style needs. The plan is used
+ for all subsequent renders until the style changes, so shared styles avoid walking the tree for every object they draw. This is called
+ automatically whenever the style notifies its clients of a change; you should only need to call it if a component is changed by some
+ means that bypasses the style's observation of its components.
+ */
+- (void)invalidateRenderPlan;
+
+/** @brief Whether objects using this style can be drawn in batches
+
+ A style can be batched if it consists only of plain fills (no gradient or shadow) and plain strokes (no dash, shadow, trim or offset).
+ Objects sharing such a style can be drawn together using one setting of the graphics state per component.
+ @return YES if the style is suitable for batched drawing
+ */
+- (BOOL)isSuitableForBatchedDrawing;
+
+/** @brief Whether batched objects using this style may overlap one another
+
+ Batching changes the order in which the components of different objects are drawn - all of the fills are drawn before all of the strokes.
+ Where objects overlap this is visible unless the style has a single fill or a single opaque stroke.
+ @return YES if overlapping objects can be batched together, NO if only disjoint objects can be
+ */
+- (BOOL)canBatchOverlappingObjects;
+
+/** @brief Draws a number of objects using this style in a single batch
+
+ The style must be suitable for batched drawing. Each fill sets its colour once and fills every object's path, and each stroke sets up
+ its attributes once and strokes a single path made up of all of the objects' paths.
+ @param objects the objects to draw, in drawing order
+ */
+- (void)renderObjectsInBatch:(NSArray*)objects;
+
 /** @brief Queries whether the style has any components at all
  @return YES if there are no components and no text attributes, NO if there is at least 1 or has text 
  */
@@ -425,6 +614,29 @@ typedef enum {
  */
 - (NSImage*)styleSwatchWithSize:(NSSize)size type:(DKStyleSwatchType)type;
 
+/** @brief Returns a thumbnail image of the style from the shared swatch cache, rendering it if necessary
+
+ Swatches are cached by content, size, type and backing scale, so changing the style simply means that new swatches are
+ made, and styles with the same content share them. If <wait> is NO and the swatch isn't cached, it is rendered on a
+ background queue and nil is returned; kDKStyleSwatchDidRenderNotification is posted when it is ready.
+ @param size the desired size of the thumbnail
+ @param type the type of thumbnail - currently rect and path types are supported, or selected automatically
+ @param wait YES to render the swatch now if necessary, NO to render it in the background
+ @return the swatch, or nil if it is being rendered in the background
+ */
+- (NSImage*)styleSwatchWithSize:(NSSize)size type:(DKStyleSwatchType)type waitUntilRendered:(BOOL)wait;
+
+/** @brief Renders a thumbnail image of the style into a new bitmap
+
+ This draws only into its own bitmap context, so it may be called on any thread, provided the style isn't changed
+ meanwhile - the shared swatch cache renders a copy of the style for this reason.
+ @param size the size of the thumbnail
+ @param type the type of thumbnail
+ @param scale the backing scale, i.e. pixels per point
+ @return the image, which the caller releases, or NULL
+ */
+- (CGImageRef)newSwatchImageWithSize:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale;
+
 /** @brief Creates a thumbnail image of the style
 
  The swatch returned will have the curve path style if it has no fill, otherwise the rect style.
@@ -437,8 +649,9 @@ typedef enum {
 /** @brief Return a key for the swatch cache for the given size and type of swatch
 
  The key is a simple concatenation of the size and the type, but don't rely on this anywhere - just
- ask for the swatch you want and if it's cached it will be returned.
- @return a string that is used as the key to the swatches in the cache
+ ask for the swatch you want and if it's cached it will be returned. Swatches are now kept by
+ DKStyleSwatchCache, which doesn't use this key.
+ @return a string identifying swatches of the given size and type
  */
 - (NSString*)swatchCacheKeyForSize:(NSSize)size type:(DKStyleSwatchType)type;
 
@@ -500,3 +713,15 @@ extern NSString* kDKStyleNameChangedNotification;
 extern NSString* kDKStyleDisplayPerformance_no_anti_aliasing;
 extern NSString* kDKStyleDisplayPerformance_no_shadows;
 extern NSString* kDKStyleDisplayPerformance_substitute_styles;
+extern NSString* kDKStyleDisplayPerformance_no_level_of_detail;
+
+// the render mode of the current pass, or NULL if drawing is not part of one:
+
+extern const DKRenderMode* DKCurrentRenderMode(void);
+
+// the current pass's answers if there is one, otherwise the context's and the object's:
+
+extern BOOL DKRenderIsDrawingToScreen(void);
+extern BOOL DKRenderUsesLowQualityDrawing(id<DKRenderable> object);
+
+#define kDKStyleMaximumRenderPassDepth 8 // passes nested deeper than this share the mode of the innermost one kept
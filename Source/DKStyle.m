@@ -12,7 +12,7 @@
 #import "DKRoughStroke.h"
 #import "DKTextAdornment.h"
 #import "DKGradient.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 #import "NSColor+DKAdditions.h"
 #import "NSDictionary+DeepCopy.h"
 #import "DKUndoManager.h"
@@ -21,7 +21,13 @@
 #import "DKDrawablePath.h"
 #import "DKDrawableShape.h"
 #import "DKGeometryUtilities.h"
+#import "NSBezierPath+Geometry.h"
 #import "NSImage+DKAdditions.h"
+#import "DKDrawKitMacros.h"
+#import "DKLayer.h"
+#import "DKKeyedUnarchiver.h"
+#import "DKStyleInternTable.h"
+#import "DKStyleSwatchCache.h"
 
 #pragma mark Contants(Non - localized)
 
@@ -40,6 +46,7 @@ NSString* kDKStyleTextAttributesDidChangeNotification = @"kDKStyleTextAttributes
 NSString* kDKStyleDisplayPerformance_no_anti_aliasing = @"kDKStyleDisplayPerformance_no_anti_aliasing";
 NSString* kDKStyleDisplayPerformance_no_shadows = @"kDKStyleDisplayPerformance_no_shadows";
 NSString* kDKStyleDisplayPerformance_substitute_styles = @"kDKStyleDisplayPerformance_substitute_styles";
+NSString* kDKStyleDisplayPerformance_no_level_of_detail = @"kDKStyleDisplayPerformance_no_level_of_detail";
 
 // the fixed default styles need to have a predetermined (but still unique) key. We define them here.
 // Do not change or interpret these values.
@@ -54,10 +61,391 @@ static NSMutableDictionary* sPasteboardRegistry = nil;
 static BOOL sShouldDrawShadows = YES;
 static BOOL sAntialias = YES;
 static BOOL sSubstitute = NO;
+static BOOL sUsesLevelOfDetail = YES;
+static __thread DKDrawingQualityTier sQualityTier = kDKDrawingQualityFull; // per thread, so rendering elsewhere is unaffected by the views
+static BOOL sCoalescesChanges = YES;
+static CFMutableSetRef sStylesWithPendingChanges = NULL; // retained, main thread only
+static CFRunLoopObserverRef sPendingChangesObserver = NULL;
+
+// the swatch cache type used for swatches scaled to fit a size by -imageToFitSize:
+
+static const DKStyleSwatchType kDKStyleSwatchFittedImage = (DKStyleSwatchType)-2;
+
+static CGFloat swatchBackingScale(void)
+{
+	CGFloat scale = [[NSScreen mainScreen] backingScaleFactor];
+
+	return (scale > 0) ? scale : 1.0;
+}
+
+#pragma mark -
+
+/// the render plan is a flat list of operations compiled from the style's rasterizer tree.
+
+typedef enum {
+	kDKRenderOpRender = 0, // send render: to the rasterizer
+	kDKRenderOpSaveState, // save graphics state on entering a plain group
+	kDKRenderOpRestoreState // restore graphics state on leaving a plain group
+} DKRenderOpType;
+
+typedef struct {
+	DKRenderOpType type;
+	DKRasterizer* rasterizer; // retained by the plan
+	IMP renderIMP; // resolved implementation of -render:
+	CGFloat minimumDetailSize; // below this on-screen size the rasterizer renders its low detail fallback
+	BOOL simple; // a plain fill or stroke, which a render pass draws directly
+	BOOL isFill;
+} DKRenderOp;
+
+struct _DKRenderPlan {
+	NSUInteger refCount; // plans may be discarded while being executed, so are reference counted
+	NSUInteger count;
+	NSUInteger capacity;
+	NSSize extraSpace;
+	NSSize extraSpaceIgnoringMitreLimit;
+	CGFloat maxStrokeWidth;
+	CGFloat maxStrokeWidthDifference;
+	BOOL batchable; // YES if the plan consists only of simple fills and strokes
+	BOOL batchIgnoresOverlap; // YES if batched objects may overlap without changing the result
+	CGFloat largestDetailSize; // the largest minimum detail size of any operation, or 0 if none uses level of detail
+	DKRenderOp* ops;
+};
+
+static BOOL isSimpleRasterizer(DKRasterizer* rast);
+
+static void appendRenderOp(DKRenderPlan* plan, DKRenderOpType type, DKRasterizer* rast)
+{
+	if (plan->count == plan->capacity) {
+		plan->capacity = MAX(plan->capacity * 2, 8U);
+		plan->ops = realloc(plan->ops, plan->capacity * sizeof(DKRenderOp));
+	}
+
+	DKRenderOp* op = &plan->ops[plan->count++];
+
+	op->type = type;
+	op->rasterizer = [rast retain];
+	op->renderIMP = (rast ? [rast methodForSelector:@selector(render:)] : NULL);
+	op->minimumDetailSize = [rast minimumDetailSize];
+	op->simple = (rast != nil && isSimpleRasterizer(rast));
+	op->isFill = ([rast class] == [DKFill class]);
+	plan->largestDetailSize = MAX(plan->largestDetailSize, op->minimumDetailSize);
+}
+
+static void compileRenderList(DKRenderPlan* plan, NSArray* renderList)
+{
+	// groups that don't override -render: do nothing but save the state and render their contents, so they are flattened into the
+	// plan. Disabled rasterizers are left out entirely. Anything else is a single operation that renders itself in its own way.
+
+	static IMP sGroupRenderIMP = NULL;
+
+	if (sGroupRenderIMP == NULL)
+		sGroupRenderIMP = [DKRastGroup instanceMethodForSelector:@selector(render:)];
+
+	NSEnumerator* iter = [renderList objectEnumerator];
+	DKRasterizer* rast;
+
+	while ((rast = [iter nextObject])) {
+		if (![rast enabled])
+			continue;
+
+		if ([rast isKindOfClass:[DKRastGroup class]] && [rast methodForSelector:@selector(render:)] == sGroupRenderIMP) {
+			appendRenderOp(plan, kDKRenderOpSaveState, nil);
+			compileRenderList(plan, [(DKRastGroup*)rast renderList]);
+			appendRenderOp(plan, kDKRenderOpRestoreState, nil);
+		} else
+			appendRenderOp(plan, kDKRenderOpRender, rast);
+	}
+}
+
+static void releaseRenderPlan(DKRenderPlan* plan)
+{
+	if (plan && --plan->refCount == 0) {
+		NSUInteger i;
+
+		for (i = 0; i < plan->count; ++i)
+			[plan->ops[i].rasterizer release];
+
+		free(plan->ops);
+		free(plan);
+	}
+}
+
+static CGFloat screenSizeOfObject(id<DKRenderable> object)
+{
+	NSSize size = [object bounds].size;
+	CGFloat scale = [object respondsToSelector:@selector(renderingScale)] ? [object renderingScale] : 1.0;
+
+	return MAX(size.width, size.height) * scale;
+}
+
+static void renderSimpleOp(DKRenderOp* op, id<DKRenderable> object, BOOL drawingToScreen)
+{
+	// draws as DKFill or DKStroke's -render: would for a rasterizer with no shadow, gradient or clipping, which in a render pass have
+	// nothing else to check for each object
+
+	NSBezierPath* path = DKRasterizerRenderingPath(object, drawingToScreen);
+
+	if (path == nil || [path isEmpty])
+		return;
+
+	if (op->isFill) {
+		NSColor* colour = [(DKFill*)op->rasterizer colour];
+		NSSize size = [path bounds].size;
+
+		// with no colour the fill would be clear, so it draws nothing
+
+		if (colour == nil || size.width <= 0.0 || size.height <= 0.0)
+			return;
+
+		[colour setRenderingFill];
+		[path fill];
+	} else {
+		// the stroke only changes what a save of the Quartz state restores, which costs much less than saving the NSGraphicsContext
+
+		CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+
+		CGContextSaveGState(context);
+		[op->rasterizer renderPath:path
+						 forObject:object];
+		CGContextRestoreGState(context);
+	}
+}
+
+static inline void executeRenderOps(DKRenderPlan* plan, id<DKRenderable> object, CGFloat screenSize, const BOOL inPass, const BOOL drawingToScreen) __attribute__((always_inline));
+
+static inline void executeRenderOps(DKRenderPlan* plan, id<DKRenderable> object, CGFloat screenSize, const BOOL inPass, const BOOL drawingToScreen)
+{
+	// always inlined, so each caller gets a copy with its flags folded away
+
+	NSUInteger i, depth = 0;
+	DKRenderOp* op;
+	SEL renderSel = @selector(render:);
+
+	@try
+	{
+		for (i = 0; i < plan->count; ++i) {
+			op = &plan->ops[i];
+
+			switch (op->type) {
+			default:
+			case kDKRenderOpRender:
+				if (screenSize < op->minimumDetailSize)
+					[op->rasterizer renderLowDetail:object];
+				else if (inPass && op->simple)
+					renderSimpleOp(op, object, drawingToScreen);
+				else
+					op->renderIMP(op->rasterizer, renderSel, object);
+				break;
+
+			case kDKRenderOpSaveState:
+				[NSGraphicsContext saveGraphicsState];
+				++depth;
+				break;
+
+			case kDKRenderOpRestoreState:
+				[NSGraphicsContext restoreGraphicsState];
+				--depth;
+				break;
+			}
+		}
+	}
+	@finally
+	{
+		// if a rasterizer threw, unwind the states saved by any groups it was within, as the groups themselves would have done
+
+		while (depth-- > 0)
+			[NSGraphicsContext restoreGraphicsState];
+	}
+}
+
+static void executeRenderPlan(DKRenderPlan* plan, id<DKRenderable> object)
+{
+	CGFloat screenSize = CGFLOAT_MAX;
+
+	// the object's size on screen is only needed if some rasterizer in the plan could drop its detail
+
+	if (plan->largestDetailSize > 0 && [NSGraphicsContext currentContextDrawingToScreen]) {
+		if (sQualityTier >= kDKDrawingQualityReduced)
+			screenSize = 0;
+		else if (sUsesLevelOfDetail)
+			screenSize = screenSizeOfObject(object);
+	}
+
+	executeRenderOps(plan, object, screenSize, NO, NO);
+}
+
+// the specialized executors for each kind of render pass. The pass has settled everything but the object's size
+
+static void executeFullPassPlan(DKRenderPlan* plan, id<DKRenderable> object, const DKRenderMode* mode)
+{
+	CGFloat screenSize = CGFLOAT_MAX;
+
+	if (plan->largestDetailSize > 0 && mode->usesLevelOfDetail)
+		screenSize = screenSizeOfObject(object);
+
+	executeRenderOps(plan, object, screenSize, YES, YES);
+}
+
+static void executeInteractivePassPlan(DKRenderPlan* plan, id<DKRenderable> object, const DKRenderMode* mode)
+{
+#pragma unused(mode)
+
+	// reduced quality tiers draw every low detail fallback, whatever the size
+
+	executeRenderOps(plan, object, 0, YES, YES);
+}
+
+static void executeOffScreenPassPlan(DKRenderPlan* plan, id<DKRenderable> object, const DKRenderMode* mode)
+{
+#pragma unused(mode)
+
+	executeRenderOps(plan, object, CGFLOAT_MAX, YES, NO);
+}
+
+typedef void (*DKRenderPassExecutor)(DKRenderPlan* plan, id<DKRenderable> object, const DKRenderMode* mode);
+
+typedef struct {
+	DKRenderMode mode;
+	DKRenderPassExecutor execute; // chosen once for the pass
+} DKRenderPassState;
+
+static __thread DKRenderPassState sRenderPasses[kDKStyleMaximumRenderPassDepth];
+static __thread NSUInteger sRenderPassDepth = 0;
+
+static inline DKRenderPassState* currentRenderPass(void)
+{
+	return (sRenderPassDepth > 0) ? &sRenderPasses[MIN(sRenderPassDepth, kDKStyleMaximumRenderPassDepth) - 1] : NULL;
+}
+
+const DKRenderMode* DKCurrentRenderMode(void)
+{
+	DKRenderPassState* pass = currentRenderPass();
+
+	return pass ? &pass->mode : NULL;
+}
+
+BOOL DKRenderIsDrawingToScreen(void)
+{
+	DKRenderPassState* pass = currentRenderPass();
+
+	return pass ? pass->mode.drawingToScreen : [NSGraphicsContext currentContextDrawingToScreen];
+}
+
+BOOL DKRenderUsesLowQualityDrawing(id<DKRenderable> object)
+{
+	DKRenderPassState* pass = currentRenderPass();
+
+	return pass ? pass->mode.lowQuality : [object useLowQualityDrawing];
+}
+
+static BOOL isSimpleRasterizer(DKRasterizer* rast)
+{
+	// simple rasterizers are plain fills and strokes whose output depends only on the path, so many objects can be drawn with one
+	// setting of the graphics state
+
+	if ([rast clipping] != kDKClippingNone)
+		return NO;
+
+	if ([rast class] == [DKFill class]) {
+		DKFill* fill = (DKFill*)rast;
+		return [fill shadow] == nil && [fill gradient] == nil;
+	} else if ([rast class] == [DKStroke class]) {
+		DKStroke* stroke = (DKStroke*)rast;
+		return [stroke shadow] == nil && [stroke dash] == nil && [stroke trimLength] == 0.0 && [stroke lateralOffset] == 0.0;
+	} else
+		return NO;
+}
+
+static void classifyRenderPlan(DKRenderPlan* plan)
+{
+	NSUInteger i;
+
+	plan->batchable = (plan->count > 0);
+
+	for (i = 0; i < plan->count && plan->batchable; ++i)
+		plan->batchable = plan->ops[i].simple;
+
+	// with only one fill, or one opaque stroke, the order in which overlapping objects are drawn makes no difference
+
+	if (plan->batchable && plan->count == 1) {
+		DKRasterizer* rast = plan->ops[0].rasterizer;
+
+		if ([rast class] == [DKFill class])
+			plan->batchIgnoresOverlap = YES;
+		else
+			plan->batchIgnoresOverlap = ([[(DKStroke*)rast colour] alphaComponent] >= 1.0);
+	}
+}
+
+// strokes <path> as the stroke would an NSBezierPath - the attributes it gives one are read back from an empty path and set in <context>
+
+static void strokeQuartzPath(CGContextRef context, CGPathRef path, DKStroke* stroke)
+{
+	NSBezierPath* attributes = [NSBezierPath bezierPath];
+	CGFloat dashes[8];
+	NSInteger dashCount = 0;
+	CGFloat phase = 0.0;
+
+	[stroke applyAttributesToPath:attributes];
+	[attributes getLineDash:NULL
+					  count:&dashCount
+					  phase:NULL];
+
+	if (dashCount > 0 && dashCount <= 8)
+		[attributes getLineDash:dashes
+						  count:&dashCount
+						  phase:&phase];
+	else
+		dashCount = 0;
+
+	CGContextSetLineWidth(context, [attributes lineWidth]);
+	CGContextSetLineCap(context, (CGLineCap)[attributes lineCapStyle]);
+	CGContextSetLineJoin(context, (CGLineJoin)[attributes lineJoinStyle]);
+	CGContextSetMiterLimit(context, [attributes miterLimit]);
+	CGContextSetLineDash(context, phase, dashCount > 0 ? dashes : NULL, dashCount);
+	CGContextAddPath(context, path);
+	CGContextStrokePath(context);
+}
+
+static NSDictionary* newSharedTextAttributes(NSDictionary* attrs)
+{
+	// the attributes are held in an immutable dictionary that DK only ever replaces, so a copy of the style can share it. Shadows and
+	// mutable paragraph styles are the only values that can be changed in place, so only they are copied, and only if there are any
+
+	NSEnumerator* iter = [attrs keyEnumerator];
+	NSMutableDictionary* copy = nil;
+	id key, value;
+
+	if (attrs == nil || [attrs isKindOfClass:[NSMutableDictionary class]])
+		return [attrs deepCopy];
+
+	while ((key = [iter nextObject])) {
+		value = [attrs objectForKey:key];
+
+		if ([value isKindOfClass:[NSShadow class]] || [value isKindOfClass:[NSMutableParagraphStyle class]]) {
+			if (copy == nil)
+				copy = [attrs mutableCopy];
+
+			value = [value copy];
+			[copy setObject:value
+					 forKey:key];
+			[value release];
+		}
+	}
+
+	return copy ? copy : [attrs retain];
+}
+
+#pragma mark -
 
 @interface DKStyle (Private)
 
 - (NSSize)extraSpaceNeededIgnoringMitreLimit;
+- (NSSize)computeExtraSpaceNeededIgnoringMitreLimit;
+- (void)computeStrokeWidthsOfPlan:(DKRenderPlan*)plan;
+- (DKRenderPlan*)renderPlan;
+- (DKStyleSwatchType)resolvedSwatchType:(DKStyleSwatchType)type;
+- (void)noteChangeOfKeyPath:(NSString*)keypath ofObject:(id)object oldValue:(id)old kind:(NSKeyValueChange)kind;
 
 @end
 
@@ -239,7 +627,7 @@ static BOOL sSubstitute = NO;
 {
 	// put the style into the pasteboard registry
 
-	LogEvent_(kStateEvent, @"saving key for paste: %@ '%@'", pbname, [style name]);
+	DKTrace_(kDKTraceState, @"saving key for paste: %@ '%@'", pbname, [style name]);
 
 	if (sPasteboardRegistry == nil)
 		sPasteboardRegistry = [[NSMutableDictionary alloc] init];
@@ -318,7 +706,12 @@ static BOOL sSubstitute = NO;
  */
 + (BOOL)willDrawShadows
 {
-	return sShouldDrawShadows;
+	DKRenderPassState* pass = currentRenderPass();
+
+	if (pass)
+		return pass->mode.drawsShadows;
+
+	return sShouldDrawShadows && (sQualityTier == kDKDrawingQualityFull || ![NSGraphicsContext currentContextDrawingToScreen]);
 }
 
 #pragma mark -
@@ -343,7 +736,12 @@ static BOOL sSubstitute = NO;
  */
 + (BOOL)shouldAntialias
 {
-	return sAntialias;
+	DKRenderPassState* pass = currentRenderPass();
+
+	if (pass)
+		return pass->mode.antialias;
+
+	return sAntialias && (sQualityTier < kDKDrawingQualityDraft || ![NSGraphicsContext currentContextDrawingToScreen]);
 }
 
 /** @brief Set whether the style should substitute a simple placeholder when a style is complex and slow to
@@ -372,31 +770,281 @@ static BOOL sSubstitute = NO;
 	return sSubstitute;
 }
 
+/** @brief Set whether small objects are drawn with cheap approximations of intricate rasterizers
+
+ Default is YES. When a rasterizer declares a minimum detail size and an object is drawn to the screen smaller than that, the
+ rasterizer's low detail fallback is drawn instead. Printing and exporting always render full detail.
+ @param lod YES to use level-of-detail rendering, NO to always render full detail
+ */
++ (void)setUsesLevelOfDetail:(BOOL)lod
+{
+	sUsesLevelOfDetail = lod;
+	[[NSUserDefaults standardUserDefaults] setBool:!lod
+											forKey:kDKStyleDisplayPerformance_no_level_of_detail];
+}
+
+/** @brief Whether small objects are drawn with cheap approximations of intricate rasterizers
+
+ Default is YES. When a rasterizer declares a minimum detail size and an object is drawn to the screen smaller than that, the
+ rasterizer's low detail fallback is drawn instead. Printing and exporting always render full detail.
+ @return YES if level-of-detail rendering is used
+ */
++ (BOOL)usesLevelOfDetail
+{
+	return sUsesLevelOfDetail;
+}
+
+/** @brief Set the quality tier that drawing is currently done at
+
+ DKDrawingView sets this for the duration of its drawing when it lowers quality to keep interactive updates fast. Lower tiers
+ suppress shadows, draw low detail fallbacks regardless of size and, at the draft tier, turn off anti-aliasing. Unlike the
+ other performance settings, this is temporary and is not saved in the defaults. It only affects drawing to the screen, and only
+ on the thread that sets it.
+ @param tier the quality tier
+ */
++ (void)setDrawingQualityTier:(DKDrawingQualityTier)tier
+{
+	sQualityTier = tier;
+}
+
+/** @brief The quality tier that drawing is currently done at
+ @return the quality tier
+ */
++ (DKDrawingQualityTier)drawingQualityTier
+{
+	return sQualityTier;
+}
+
+#pragma mark -
+#pragma mark - render passes
+
++ (DKRenderPass)renderPassForCurrentContext
+{
+	if (![NSGraphicsContext currentContextDrawingToScreen])
+		return kDKRenderPassPrint;
+
+	return (sQualityTier == kDKDrawingQualityFull) ? kDKRenderPassFull : kDKRenderPassInteractive;
+}
+
++ (DKRenderMode)renderModeForPass:(DKRenderPass)pass lowQuality:(BOOL)lowQuality
+{
+	DKRenderMode mode;
+
+	mode.pass = pass;
+	mode.lowQuality = lowQuality;
+
+	switch (pass) {
+	default:
+	case kDKRenderPassFull:
+		mode.drawingToScreen = YES;
+		mode.drawsShadows = sShouldDrawShadows;
+		mode.antialias = sAntialias;
+		mode.usesLevelOfDetail = sUsesLevelOfDetail;
+		break;
+
+	case kDKRenderPassInteractive:
+		mode.drawingToScreen = YES;
+		mode.drawsShadows = NO;
+		mode.antialias = sAntialias && sQualityTier < kDKDrawingQualityDraft;
+		mode.usesLevelOfDetail = YES;
+		break;
+
+	case kDKRenderPassPrint:
+		mode.drawingToScreen = NO;
+		mode.drawsShadows = sShouldDrawShadows;
+		mode.antialias = sAntialias;
+		mode.usesLevelOfDetail = NO;
+		break;
+
+	// hit-testing doesn't care about shadows, and the bitmap it draws into is never anti-aliased
+
+	case kDKRenderPassHitTest:
+		mode.drawingToScreen = NO;
+		mode.drawsShadows = NO;
+		mode.antialias = NO;
+		mode.usesLevelOfDetail = NO;
+		break;
+	}
+
+	return mode;
+}
+
++ (void)beginRenderPass:(DKRenderPass)pass lowQuality:(BOOL)lowQuality
+{
+	DKRenderMode mode = [self renderModeForPass:pass
+									 lowQuality:lowQuality];
+
+	if (sRenderPassDepth < kDKStyleMaximumRenderPassDepth) {
+		DKRenderPassState* state = &sRenderPasses[sRenderPassDepth];
+
+		state->mode = mode;
+
+		switch (pass) {
+		default:
+		case kDKRenderPassFull:
+			state->execute = executeFullPassPlan;
+			break;
+
+		case kDKRenderPassInteractive:
+			state->execute = executeInteractivePassPlan;
+			break;
+
+		case kDKRenderPassPrint:
+		case kDKRenderPassHitTest:
+			state->execute = executeOffScreenPassPlan;
+			break;
+		}
+	}
+
+	++sRenderPassDepth;
+
+	// anti-aliasing is turned off once for the pass, instead of by the style of every object drawn
+
+	if (!mode.antialias && mode.drawingToScreen) {
+		[[NSGraphicsContext currentContext] setShouldAntialias:NO];
+		[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationNone];
+	}
+}
+
++ (void)endRenderPass
+{
+	NSAssert(sRenderPassDepth > 0, @"render pass ended without being begun");
+
+	if (sRenderPassDepth > 0)
+		--sRenderPassDepth;
+}
+
 #pragma mark -
 #pragma mark - updating& notifying clients
 
-/** @brief Informs clients that a property of the style is about to change */
+static void pendingChangesObserverCallback(CFRunLoopObserverRef observer, CFRunLoopActivity activity, void* info)
+{
+#pragma unused(observer)
+#pragma unused(activity)
+#pragma unused(info)
+
+	[DKStyle postPendingChangeNotifications];
+}
+
+/** @brief Sets whether changes to a style made on the main thread are collapsed into one notification
+
+ When YES, which is the default, the first change to a style in a turn of the main run loop posts
+ kDKStyleWillChangeNotification as usual, but kDKStyleDidChangeNotification is posted just once,
+ before the run loop waits again (and so before the views are redrawn), however many times the
+ style changed in between. The clients' redraws are coalesced into one update per layer.
+ @param coalesce YES to coalesce change notifications, NO to post them as each change is made
+ */
++ (void)setCoalescesChangeNotifications:(BOOL)coalesce
+{
+	if (!coalesce)
+		[self postPendingChangeNotifications];
+
+	sCoalescesChanges = coalesce;
+}
+
++ (BOOL)coalescesChangeNotifications
+{
+	return sCoalescesChanges;
+}
+
+/** @brief Posts any change notifications that are waiting for the end of the run loop turn
+
+ Call this if something needs the clients of changed styles to be up to date before the run loop
+ next waits - drawing does so before it starts.
+ */
++ (void)postPendingChangeNotifications
+{
+	if (sStylesWithPendingChanges == NULL || CFSetGetCount(sStylesWithPendingChanges) == 0 || ![NSThread isMainThread])
+		return;
+
+	// take the styles out of the set first - a client might change a style in response, which is then posted next time
+
+	NSArray* styles = [(NSSet*)sStylesWithPendingChanges allObjects];
+	CFSetRemoveAllValues(sStylesWithPendingChanges);
+
+	NSEnumerator* iter = [styles objectEnumerator];
+	DKStyle* style;
+
+	[DKLayer beginCoalescingDisplayUpdates];
+
+	@try {
+		while ((style = [iter nextObject])) {
+			style->mChangeIsPending = NO;
+			[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleDidChangeNotification
+																object:style];
+		}
+	}
+	@finally {
+		[DKLayer endCoalescingDisplayUpdates];
+	}
+}
+
+/** @brief Informs clients that a property of the style is about to change
+
+ If a coalesced change of this style is already pending, the clients have already been told. */
 - (void)notifyClientsBeforeChange
 {
-	[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleWillChangeNotification
-														object:self];
+	if (mChangeIsPending)
+		return;
+
+	BOOL coalesce = [NSThread isMainThread];
+
+	if (coalesce)
+		[DKLayer beginCoalescingDisplayUpdates];
+
+	@try {
+		[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleWillChangeNotification
+															object:self];
+	}
+	@finally {
+		if (coalesce)
+			[DKLayer endCoalescingDisplayUpdates];
+	}
 }
 
 /** @brief Informs clients that a property of the style has just changed
 
- This method is called in response to any observed change to any renderer the style contains */
+ This method is called in response to any observed change to any renderer the style contains. The
+ notification may be deferred and coalesced - see +setCoalescesChangeNotifications: */
 - (void)notifyClientsAfterChange
 {
 	// update the timestamp so that style registry can determine which of a pair of similar styles is the more recent
 
 	m_lastModTime = [NSDate timeIntervalSinceReferenceDate];
 
-	// invalidate any swatch cache to ensure cache is forced to be rebuilt after a change
+	// swatches are cached by content hash, so new ones are made for the changed style
+
+	mContentHashIsValid = NO;
+
+	// the render plan must be recompiled to pick up any change to the rasterizer tree
+
+	[self invalidateRenderPlan];
+
+	if (!sCoalescesChanges || ![NSThread isMainThread]) {
+		[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleDidChangeNotification
+															object:self];
+		return;
+	}
+
+	if (mChangeIsPending)
+		return;
+
+	// post the notification once, before the run loop waits. The observer runs in the common modes so that changes made
+	// while tracking a control, such as a colour slider, are also posted before the views are redrawn
 
-	[mSwatchCache removeAllObjects];
+	if (sPendingChangesObserver == NULL) {
+		// retained, but compared by identity - styles with the same key are equal, but are different objects
 
-	[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleDidChangeNotification
-														object:self];
+		CFSetCallBacks callbacks = kCFTypeSetCallBacks;
+		callbacks.equal = NULL;
+		callbacks.hash = NULL;
+		sStylesWithPendingChanges = CFSetCreateMutable(kCFAllocatorDefault, 0, &callbacks);
+		sPendingChangesObserver = CFRunLoopObserverCreate(kCFAllocatorDefault, kCFRunLoopBeforeWaiting, true, 0, pendingChangesObserverCallback, NULL);
+		CFRunLoopAddObserver(CFRunLoopGetMain(), sPendingChangesObserver, kCFRunLoopCommonModes);
+	}
+
+	mChangeIsPending = YES;
+	CFSetAddValue(sStylesWithPendingChanges, self);
 }
 
 /** @brief Called when a style is attached to an object
@@ -410,7 +1058,7 @@ static BOOL sSubstitute = NO;
 	// DKDrawableObject calls these methods in its setStyle: method so that the style can get notified about who
 	// is using it. By default these do nothing but send notifications - you can override for other uses.
 
-	//LogEvent_(kReactiveEvent, @"style %@ attached to object %@", self, toObject );
+	//DKTrace_(kDKTraceReactive, @"style %@ attached to object %@", self, toObject );
 
 	NSDictionary* userInfo = [NSDictionary dictionaryWithObject:self
 														 forKey:@"style"];
@@ -432,7 +1080,7 @@ static BOOL sSubstitute = NO;
  */
 - (void)styleWillBeRemoved:(DKDrawableObject*)fromObject
 {
-	//LogEvent_(kReactiveEvent, @"style %@ removed from object %@", self, fromObject );
+	//DKTrace_(kDKTraceReactive, @"style %@ removed from object %@", self, fromObject );
 
 	NSDictionary* userInfo = [NSDictionary dictionaryWithObject:self
 														 forKey:@"style"];
@@ -610,7 +1258,7 @@ static BOOL sSubstitute = NO;
 
 	if (m_uniqueKey == nil) {
 		m_uniqueKey = [[DKUniqueID uniqueKey] retain];
-		//	LogEvent_(kStateEvent, @"assigned unique key: %@", m_uniqueKey);
+		//	DKTrace_(kDKTraceState, @"assigned unique key: %@", m_uniqueKey);
 	}
 }
 
@@ -631,6 +1279,51 @@ static BOOL sSubstitute = NO;
 	m_mergeFlag = NO;
 }
 
+- (NSData*)contentData
+{
+	// a plain keyed archive of the rasterizers and text attributes - the rasterizers archive only their own settings
+
+	NSArray* content = [NSArray arrayWithObjects:[self renderList] ? [self renderList] : [NSArray array], [self textAttributes] ? (id)[self textAttributes] : (id)[NSNull null], nil];
+	NSData* data = [NSKeyedArchiver archivedDataWithRootObject:content];
+
+	if (!mContentHashIsValid) {
+		// FNV-1a over all of the bytes - NSData's own hash only looks at the first few
+
+		const uint8_t* bytes = (const uint8_t*)[data bytes];
+		NSUInteger i, length = [data length];
+		uint64_t hash = 14695981039346656037ULL;
+
+		for (i = 0; i < length; ++i) {
+			hash ^= bytes[i];
+			hash *= 1099511628211ULL;
+		}
+
+		mContentHash = (NSUInteger)hash;
+		mContentHashIsValid = YES;
+	}
+
+	return data;
+}
+
+- (NSUInteger)contentHash
+{
+	if (!mContentHashIsValid)
+		[self contentData];
+
+	return mContentHash;
+}
+
+- (BOOL)hasSameContentAsStyle:(DKStyle*)aStyle
+{
+	if (aStyle == self)
+		return YES;
+
+	if (aStyle == nil || [aStyle contentHash] != [self contentHash])
+		return NO;
+
+	return [[self contentData] isEqualToData:[aStyle contentData]];
+}
+
 - (NSTimeInterval)lastModificationTimestamp
 {
 	return m_lastModTime;
@@ -686,6 +1379,93 @@ static BOOL sSubstitute = NO;
 		  forKeyPath:keypath];
 }
 
+- (void)beginCoalescingPropertyChanges
+{
+	if (mCoalescingCount++ == 0) {
+		mCoalescedChanges = [[NSMutableArray alloc] init];
+		mCoalescedKeys = [[NSMutableSet alloc] init];
+	}
+}
+
+- (void)endCoalescingPropertyChanges
+{
+	NSAssert(mCoalescingCount > 0, @"unbalanced endCoalescingPropertyChanges");
+
+	if (mCoalescingCount == 0 || --mCoalescingCount > 0)
+		return;
+
+	NSArray* changes = [mCoalescedChanges autorelease];
+	NSUndoManager* um = [self undoManager];
+
+	[mCoalescedKeys release];
+	mCoalescedChanges = nil;
+	mCoalescedKeys = nil;
+
+	if ([changes count] == 0)
+		return;
+
+	[[um prepareWithInvocationTarget:self] restoreComponentValues:changes];
+
+	if (!([um isUndoing] || [um isRedoing])) {
+		// a single change keeps its own action name; a burst of different ones is just a change to the style
+
+		if ([changes count] == 1) {
+			NSDictionary* change = [changes lastObject];
+			id object = [change objectForKey:@"object"];
+			NSString* keypath = [change objectForKey:@"keyPath"];
+			NSKeyValueChange kind = [[change objectForKey:@"kind"] integerValue];
+
+			if ([object respondsToSelector:@selector(actionNameForKeyPath:
+															   changeKind:)])
+				[um setActionName:[object actionNameForKeyPath:keypath
+													changeKind:kind]];
+			else
+				[um setActionName:[GCObservableObject actionNameForKeyPath:keypath
+																  objClass:[object class]]];
+		} else
+			[um setActionName:NSLocalizedString(@"Change Style", @"undo string for a change to several style properties")];
+	}
+
+	[self notifyClientsAfterChange];
+}
+
+- (void)noteChangeOfKeyPath:(NSString*)keypath ofObject:(id)object oldValue:(id)old kind:(NSKeyValueChange)kind
+{
+	// only called while coalescing. Only the first previous value of a property matters - restoring it undoes the whole burst
+
+	NSAssert(mCoalescingCount > 0, @"changes must be noted while coalescing");
+
+	NSString* key = [NSString stringWithFormat:@"%p.%@", object, keypath];
+
+	if ([mCoalescedKeys containsObject:key])
+		return;
+
+	[mCoalescedKeys addObject:key];
+	[mCoalescedChanges addObject:[NSDictionary dictionaryWithObjectsAndKeys:object, @"object", keypath, @"keyPath",
+												 old ? old : [NSNull null], @"value",
+												 [NSNumber numberWithInteger:kind], @"kind", nil]];
+}
+
+- (void)restoreComponentValues:(NSArray*)changes
+{
+	// the restore is itself coalesced, so its redo is one action too
+
+	NSEnumerator* iter = [changes reverseObjectEnumerator];
+	NSDictionary* change;
+
+	[self beginCoalescingPropertyChanges];
+
+	@try {
+		while ((change = [iter nextObject]))
+			[self changeKeyPath:[change objectForKey:@"keyPath"]
+					   ofObject:[change objectForKey:@"object"]
+						toValue:[change objectForKey:@"value"]];
+	}
+	@finally {
+		[self endCoalescingPropertyChanges];
+	}
+}
+
 #pragma mark -
 #pragma mark - stroke utilities
 
@@ -702,11 +1482,22 @@ static BOOL sSubstitute = NO;
 		NSEnumerator* iter = [[self renderersOfClass:[DKStroke class]] objectEnumerator];
 		DKStroke* stroke;
 
-		while ((stroke = [iter nextObject]))
-			[stroke scaleWidthBy:scale];
+		[self beginCoalescingPropertyChanges];
+
+		@try {
+			while ((stroke = [iter nextObject]))
+				[stroke scaleWidthBy:scale];
+		}
+		@finally {
+			[self endCoalescingPropertyChanges];
+		}
+
+		// the stroke widths and extra space are cached by the render plan
 
 		if (!quiet)
 			[self notifyClientsAfterChange];
+		else
+			[self invalidateRenderPlan];
 	}
 }
 
@@ -715,21 +1506,7 @@ static BOOL sSubstitute = NO;
  */
 - (CGFloat)maxStrokeWidth
 {
-	CGFloat maxWid = 0.0;
-
-	NSArray* strokes = [self renderersOfClass:[DKStroke class]];
-
-	if (strokes) {
-		NSEnumerator* iter = [strokes objectEnumerator];
-		DKStroke* stk;
-
-		while ((stk = [iter nextObject])) {
-			if ([stk width] > maxWid)
-				maxWid = [stk width];
-		}
-	}
-
-	return maxWid;
+	return [self renderPlan]->maxStrokeWidth;
 }
 
 /** @brief Returns the difference between the widest and narrowest strokes
@@ -737,27 +1514,7 @@ static BOOL sSubstitute = NO;
  */
 - (CGFloat)maxStrokeWidthDifference
 {
-	CGFloat maxWid = 0.0;
-	CGFloat minWid = 1000.0;
-
-	NSArray* strokes = [self renderersOfClass:[DKStroke class]];
-
-	if (strokes != nil && [strokes count] > 1) {
-		NSEnumerator* iter = [strokes objectEnumerator];
-		DKStroke* stk;
-
-		while ((stk = [iter nextObject])) {
-			if ([stk width] > maxWid)
-				maxWid = [stk width];
-
-			if ([stk width] < minWid)
-				minWid = [stk width];
-		}
-
-		return maxWid - minWid;
-	}
-
-	return 0.0;
+	return [self renderPlan]->maxStrokeWidthDifference;
 }
 
 /** @brief Applies the cap, join, mitre limit, dash and line width attributes of the rear-most stroke to the path
@@ -1015,6 +1772,186 @@ static BOOL sSubstitute = NO;
 	return [self containsRendererOfClass:[DKTextAdornment class]];
 }
 
+/** @brief Queries whether the style contains renderers that are relatively slow to draw
+
+ Hatches, fill patterns and roughened strokes all generate a lot of drawing for each object, so objects using them benefit from having
+ their rendered image cached.
+ @return YES if the style has one or more expensive renderers, NO otherwise
+ */
+- (BOOL)isExpensiveToRender
+{
+	return [self hasHatch] || [self containsRendererOfClass:[DKFillPattern class]] || [self containsRendererOfClass:[DKRoughStroke class]];
+}
+
+#pragma mark -
+#pragma mark - render plan
+
+/** @brief Discards the style's compiled render plan
+
+ When a style first renders, it flattens its tree of rasterizers into a plan - a simple list of the enabled rasterizers in drawing
+ order, together with the graphics state saves and restores that plain groups require and the space the style needs. The plan is used
+ for all subsequent renders until the style changes, so shared styles avoid walking the tree for every object they draw. This is called
+ automatically whenever the style notifies its clients of a change; you should only need to call it if a component is changed by some
+ means that bypasses the style's observation of its components.
+ */
+- (void)invalidateRenderPlan
+{
+	releaseRenderPlan(mRenderPlan);
+	mRenderPlan = NULL;
+}
+
+/** @brief Whether objects using this style can be drawn in batches
+
+ A style can be batched if it consists only of plain fills (no gradient or shadow) and plain strokes (no dash, shadow, trim or offset).
+ Objects sharing such a style can be drawn together using one setting of the graphics state per component.
+ @return YES if the style is suitable for batched drawing
+ */
+- (BOOL)isSuitableForBatchedDrawing
+{
+	return [self enabled] && [self renderPlan]->batchable;
+}
+
+/** @brief Whether batched objects using this style may overlap one another
+
+ Batching changes the order in which the components of different objects are drawn - all of the fills are drawn before all of the strokes.
+ Where objects overlap this is visible unless the style has a single fill or a single opaque stroke.
+ @return YES if overlapping objects can be batched together, NO if only disjoint objects can be
+ */
+- (BOOL)canBatchOverlappingObjects
+{
+	return [self renderPlan]->batchIgnoresOverlap;
+}
+
+/** @brief Draws a number of objects using this style in a single batch
+
+ The style must be suitable for batched drawing. Each fill sets its colour once and fills every object's path, and each stroke sets up
+ its attributes once and strokes a single path made up of all of the objects' paths.
+ @param objects the objects to draw, in drawing order
+ */
+- (void)renderObjectsInBatch:(NSArray*)objects
+{
+	NSAssert([self isSuitableForBatchedDrawing], @"style can't be drawn in batches");
+
+	if ([objects count] == 0)
+		return;
+
+	if (currentRenderPass() == NULL && ![[self class] shouldAntialias] && [NSGraphicsContext currentContextDrawingToScreen]) {
+		[[NSGraphicsContext currentContext] setShouldAntialias:NO];
+		[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationNone];
+	}
+
+	@autoreleasepool {
+		// objects that keep their path as a Quartz path until their geometry changes lend it to the batch, so that an object that hasn't
+		// changed isn't converted again every time it's drawn. Only the others have one made from their rendering path.
+
+		NSUInteger i, k = 0, count = [objects count];
+		CGPathRef* paths = malloc(sizeof(CGPathRef) * count);
+		NSWindingRule* rules = malloc(sizeof(NSWindingRule) * count);
+		NSEnumerator* iter = [objects objectEnumerator];
+		id<DKRenderable> obj;
+		NSBezierPath* path;
+
+		while ((obj = [iter nextObject])) {
+			CGPathRef qp = NULL;
+
+			if ([obj respondsToSelector:@selector(cachedRenderingQuartzPath:)])
+				qp = CGPathRetain([obj cachedRenderingQuartzPath:&rules[k]]);
+
+			if (qp == NULL) {
+				path = [obj renderingPath];
+
+				if (path == nil || [path isEmpty])
+					continue;
+
+				qp = [path newQuartzPath];
+				rules[k] = [path windingRule];
+			}
+
+			paths[k++] = qp;
+		}
+
+		if (k > 0) {
+			DKRenderPlan* plan = [self renderPlan];
+			CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+			CGMutablePathRef combined = NULL;
+
+			++plan->refCount;
+
+			SAVE_GRAPHICS_CONTEXT
+
+			CGContextSetFlatness(context, DKRenderUsesLowQualityDrawing([objects objectAtIndex:0]) ? 2.0 : 0.5);
+
+			for (i = 0; i < plan->count; ++i) {
+				DKRasterizer* rast = plan->ops[i].rasterizer;
+				NSUInteger j;
+
+				if ([rast class] == [DKFill class]) {
+					NSColor* colour = [(DKFill*)rast colour];
+
+					if (colour == nil)
+						continue;
+
+					[colour setRenderingFill];
+
+					// as DKFill, paths with no area are not filled
+
+					for (j = 0; j < k; ++j) {
+						CGRect pb = CGPathGetBoundingBox(paths[j]);
+
+						if (pb.size.width > 0.0 && pb.size.height > 0.0) {
+							CGContextAddPath(context, paths[j]);
+
+							if (rules[j] == NSEvenOddWindingRule)
+								CGContextEOFillPath(context);
+							else
+								CGContextFillPath(context);
+						}
+					}
+				} else {
+					if (combined == NULL) {
+						combined = CGPathCreateMutable();
+
+						for (j = 0; j < k; ++j)
+							CGPathAddPath(combined, NULL, paths[j]);
+					}
+
+					[[(DKStroke*)rast colour] setRenderingStroke];
+					strokeQuartzPath(context, combined, (DKStroke*)rast);
+				}
+			}
+
+			RESTORE_GRAPHICS_CONTEXT
+
+			CGPathRelease(combined);
+			releaseRenderPlan(plan);
+		}
+
+		for (i = 0; i < k; ++i)
+			CGPathRelease(paths[i]);
+
+		free(paths);
+		free(rules);
+	}
+}
+
+- (DKRenderPlan*)renderPlan
+{
+	if (mRenderPlan == NULL) {
+		mRenderPlan = calloc(1, sizeof(DKRenderPlan));
+		mRenderPlan->refCount = 1;
+		mRenderPlan->extraSpace = [super extraSpaceNeeded];
+		mRenderPlan->extraSpaceIgnoringMitreLimit = [self computeExtraSpaceNeededIgnoringMitreLimit];
+		[self computeStrokeWidthsOfPlan:mRenderPlan];
+
+		compileRenderList(mRenderPlan, [self renderList]);
+		classifyRenderPlan(mRenderPlan);
+
+		DKTrace_(kDKTraceInfo, @"style '%@' compiled render plan with %lu operations", [self name], (unsigned long)mRenderPlan->count);
+	}
+
+	return mRenderPlan;
+}
+
 /** @brief Queries whether the style has any components at all
  @return YES if there are no components and no text attributes, NO if there is at least 1 or has text 
  */
@@ -1033,20 +1970,90 @@ static BOOL sSubstitute = NO;
  */
 - (NSImage*)styleSwatchWithSize:(NSSize)size type:(DKStyleSwatchType)type
 {
-	// return the cached swatch if possible - i.e. size and type are the same and there is a cached swatch. Changes to the
-	// style attributes etc should discard the cached swatch
+	return [self styleSwatchWithSize:size
+							 type:type
+				waitUntilRendered:YES];
+}
+
+/** @brief Returns a thumbnail image of the style from the shared swatch cache, rendering it if necessary
+
+ Swatches are cached by content, size, type and backing scale, so changing the style simply means that new swatches are
+ made, and styles with the same content share them. If <wait> is NO and the swatch isn't cached, it is rendered on a
+ background queue and nil is returned; kDKStyleSwatchDidRenderNotification is posted when it is ready.
+ @param size the desired size of the thumbnail
+ @param type the type of thumbnail - currently rect and path types are supported, or selected automatically
+ @param wait YES to render the swatch now if necessary, NO to render it in the background
+ @return the swatch, or nil if it is being rendered in the background
+ */
+- (NSImage*)styleSwatchWithSize:(NSSize)size type:(DKStyleSwatchType)type waitUntilRendered:(BOOL)wait
+{
+	DKStyleSwatchCache* cache = [DKStyleSwatchCache sharedSwatchCache];
+	CGFloat scale = swatchBackingScale();
+
+	type = [self resolvedSwatchType:type];
+
+	NSImage* image = [cache swatchForStyle:self
+									  size:size
+									  type:type
+									 scale:scale];
+
+	if (image != nil)
+		return image;
+
+	if (!wait) {
+		[cache renderSwatchForStyle:self
+							   size:size
+							   type:type
+							  scale:scale];
+		return nil;
+	}
+
+	CGImageRef cgImage = [self newSwatchImageWithSize:size
+												 type:type
+												scale:scale];
 
-	NSString* cacheKey = [self swatchCacheKeyForSize:size
-												type:type];
+	if (cgImage == NULL)
+		return nil;
 
-	if ([mSwatchCache objectForKey:cacheKey] != nil)
-		return [mSwatchCache objectForKey:cacheKey];
+	image = [[NSImage alloc] initWithCGImage:cgImage
+										size:size];
+	CGImageRelease(cgImage);
 
-	//NSLog(@"building swatch (size: %@) for style '%@'", NSStringFromSize( size ), [self name]);
+	// generating the swatch from scratch is relatively expensive, so this speeds up building user interfaces a great deal
 
-	// construct the image
+	[cache setSwatch:image
+			forStyle:self
+				size:size
+				type:type
+			   scale:scale];
+
+	return [image autorelease];
+}
+
+/** @brief Renders a thumbnail image of the style into a new bitmap
+
+ This draws only into its own bitmap context, so it may be called on any thread, provided the style isn't changed
+ meanwhile - the shared swatch cache renders a copy of the style for this reason.
+ @param size the size of the thumbnail
+ @param type the type of thumbnail
+ @param scale the backing scale, i.e. pixels per point
+ @return the image, which the caller releases, or NULL
+ */
+- (CGImageRef)newSwatchImageWithSize:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale
+{
+	size_t pixelsWide = (size_t)ceil(size.width * scale);
+	size_t pixelsHigh = (size_t)ceil(size.height * scale);
+
+	if (pixelsWide == 0 || pixelsHigh == 0)
+		return NULL;
+
+	CGColorSpaceRef space = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+	CGContextRef bitmap = CGBitmapContextCreate(NULL, pixelsWide, pixelsHigh, 8, 0, space, kCGImageAlphaPremultipliedFirst | kCGBitmapByteOrder32Host);
+	CGColorSpaceRelease(space);
+
+	if (bitmap == NULL)
+		return NULL;
 
-	NSImage* image = [[NSImage alloc] initWithSize:size];
 	NSBezierPath* path;
 	NSRect r, br = NSMakeRect(0, 0, size.width, size.height);
 
@@ -1065,14 +2072,7 @@ static BOOL sSubstitute = NO;
 	if (r.size.height < 10)
 		r.size.height = 10;
 
-	[image setFlipped:YES];
-
-	if (type == kDKStyleSwatchAutomatic) {
-		if ([self hasFill] || [self hasTextAttributes] || [self hasHatch] || [self countOfRenderList] == 0)
-			type = kDKStyleSwatchRectanglePath;
-		else
-			type = kDKStyleSwatchCurvePath;
-	}
+	type = [self resolvedSwatchType:type];
 
 	if (type == kDKStyleSwatchCurvePath) {
 		// draw a small curved segment
@@ -1097,10 +2097,14 @@ static BOOL sSubstitute = NO;
 	DKDrawableShape* od = [DKDrawableShape drawableShapeWithBezierPath:path
 															 withStyle:self];
 
-	[image lockFocus];
+	// the swatch is drawn flipped, as it was when drawn into a flipped NSImage
+
+	CGContextScaleCTM(bitmap, scale, -scale);
+	CGContextTranslateCTM(bitmap, 0, -size.height);
 
-	//[[NSColor clearColor] set];
-	//NSRectFill( br );
+	[NSGraphicsContext saveGraphicsState];
+	[NSGraphicsContext setCurrentContext:[NSGraphicsContext graphicsContextWithGraphicsPort:bitmap
+																					flipped:YES]];
 
 	[od drawContent];
 
@@ -1116,22 +2120,14 @@ static BOOL sSubstitute = NO;
 		[ta drawInRect:r];
 
 		[example release];
-
-		//[example drawInRect:r withAttributes:[self textAttributes]];
 	}
 
-	[image unlockFocus];
+	[NSGraphicsContext restoreGraphicsState];
 
-	// cache the swatch - the image will only be rebuilt if the size or type requested changes,
-	// or if the style itself is modified. The cache remembers all previously requested sizes until invalidated. The
-	// use of this cache significantly speeds up building of user interfaces where swatches are used a lot, because
-	// generating the swatch from scratch is relatively expensive.
+	CGImageRef image = CGBitmapContextCreateImage(bitmap);
+	CGContextRelease(bitmap);
 
-	if (image)
-		[mSwatchCache setObject:image
-						 forKey:cacheKey];
-
-	return [image autorelease];
+	return image;
 }
 
 /** @brief Creates a thumbnail image of the style
@@ -1149,11 +2145,14 @@ static BOOL sSubstitute = NO;
 {
 	//NSLog(@"request for image, size = %@", NSStringFromSize( aSize ));
 
-	NSString* cacheKey = [self swatchCacheKeyForSize:aSize
-												type:kDKStyleSwatchAutomatic];
+	DKStyleSwatchCache* cache = [DKStyleSwatchCache sharedSwatchCache];
+	CGFloat scale = swatchBackingScale();
 	NSImage* swatch;
 
-	swatch = [mSwatchCache objectForKey:cacheKey];
+	swatch = [cache swatchForStyle:self
+							  size:aSize
+							  type:kDKStyleSwatchFittedImage
+							 scale:scale];
 
 	if (swatch != nil)
 		return swatch;
@@ -1167,8 +2166,11 @@ static BOOL sSubstitute = NO;
 
 		NSImage* iconImage = [NSImage imageFromImage:swatch
 											withSize:aSize];
-		[mSwatchCache setObject:iconImage
-						 forKey:cacheKey];
+		[cache setSwatch:iconImage
+				forStyle:self
+					size:aSize
+					type:kDKStyleSwatchFittedImage
+				   scale:scale];
 
 		return iconImage;
 	}
@@ -1184,20 +2186,37 @@ static BOOL sSubstitute = NO;
 /** @brief Return a key for the swatch cache for the given size and type of swatch
 
  The key is a simple concatenation of the size and the type, but don't rely on this anywhere - just
- ask for the swatch you want and if it's cached it will be returned.
- @return a string that is used as the key to the swatches in the cache
+ ask for the swatch you want and if it's cached it will be returned. Swatches are now kept by
+ DKStyleSwatchCache, which doesn't use this key.
+ @return a string identifying swatches of the given size and type
  */
 - (NSString*)swatchCacheKeyForSize:(NSSize)size type:(DKStyleSwatchType)type
 {
 	return [NSString stringWithFormat:@"%@_%ld", NSStringFromSize(size), (long)type];
 }
 
+- (DKStyleSwatchType)resolvedSwatchType:(DKStyleSwatchType)type
+{
+	if (type != kDKStyleSwatchAutomatic)
+		return type;
+
+	if ([self hasFill] || [self hasTextAttributes] || [self hasHatch] || [self countOfRenderList] == 0)
+		return kDKStyleSwatchRectanglePath;
+	else
+		return kDKStyleSwatchCurvePath;
+}
+
 /** @brief As -extraSpaceNeeded but any mitre limit applied by renderes are ignored
 
  Used when drawing swatches as path is known to have non-acute angles where the mitre limit matters
  @return the space needed for the style without mitre limit
  */
 - (NSSize)extraSpaceNeededIgnoringMitreLimit
+{
+	return [self renderPlan]->extraSpaceIgnoringMitreLimit;
+}
+
+- (NSSize)computeExtraSpaceNeededIgnoringMitreLimit
 {
 	NSSize rs, accSize = NSZeroSize;
 
@@ -1206,7 +2225,7 @@ static BOOL sSubstitute = NO;
 		DKRasterizer* rend;
 
 		while ((rend = [iter nextObject])) {
-			if ([rend respondsToSelector:_cmd])
+			if ([rend respondsToSelector:@selector(extraSpaceNeededIgnoringMitreLimit)])
 				rs = [(id)rend extraSpaceNeededIgnoringMitreLimit];
 			else
 				rs = [rend extraSpaceNeeded];
@@ -1222,6 +2241,28 @@ static BOOL sSubstitute = NO;
 	return accSize;
 }
 
+- (void)computeStrokeWidthsOfPlan:(DKRenderPlan*)plan
+{
+	// the widths of all the strokes, whether or not they're enabled, as these methods have always returned
+
+	NSArray* strokes = [self renderersOfClass:[DKStroke class]];
+	NSEnumerator* iter = [strokes objectEnumerator];
+	DKStroke* stk;
+	CGFloat maxWid = 0.0;
+	CGFloat minWid = 1000.0;
+
+	while ((stk = [iter nextObject])) {
+		if ([stk width] > maxWid)
+			maxWid = [stk width];
+
+		if ([stk width] < minWid)
+			minWid = [stk width];
+	}
+
+	plan->maxStrokeWidth = maxWid;
+	plan->maxStrokeWidthDifference = ([strokes count] > 1) ? maxWid - minWid : 0.0;
+}
+
 #pragma mark -
 #pragma mark - currently rendering client
 
@@ -1343,7 +2384,7 @@ static BOOL sSubstitute = NO;
 - (void)moveRendererAtIndex:(NSUInteger)src toIndex:(NSUInteger)dest
 {
 	if (![self locked] && (src != dest)) {
-		LogEvent_(kStateEvent, @"moving style component at %d to %d", src, dest);
+		DKTrace_(kDKTraceState, @"moving style component at %d to %d", src, dest);
 
 		[[[self undoManager] prepareWithInvocationTarget:self] moveRendererAtIndex:dest
 																		   toIndex:src];
@@ -1354,6 +2395,15 @@ static BOOL sSubstitute = NO;
 	}
 }
 
+/** @brief Sets the style's list of renderers, discarding the compiled render plan
+ @param list an array of renderers
+ */
+- (void)setRenderList:(NSArray*)list
+{
+	[super setRenderList:list];
+	[self invalidateRenderPlan];
+}
+
 /** @brief Returns the root of the group tree - which is always self
  @return self
  */
@@ -1367,10 +2417,11 @@ static BOOL sSubstitute = NO;
  */
 - (void)observableWasAdded:(GCObservableObject*)observable
 {
-	LogEvent_(kKVOEvent, @"observable %@ will start being observed by %@ ('%@')", [observable description], [self description], [self name]);
+	DKTrace_(kDKTraceKVO, @"observable %@ will start being observed by %@ ('%@')", [observable description], [self description], [self name]);
 
 	NSAssert(observable != nil, @"observable object was nil");
 	[observable setUpKVOForObserver:self];
+	[self invalidateRenderPlan];
 }
 
 /** @brief Informs the style that a  component is about to be removed from the tree and should stop being observed
@@ -1378,15 +2429,24 @@ static BOOL sSubstitute = NO;
  */
 - (void)observableWillBeRemoved:(GCObservableObject*)observable
 {
-	LogEvent_(kKVOEvent, @"observable %@ will stop being observed by %@ ('%@')", [observable description], [self description], [self name]);
+	DKTrace_(kDKTraceKVO, @"observable %@ will stop being observed by %@ ('%@')", [observable description], [self description], [self name]);
 
 	NSAssert(observable != nil, @"observable object was nil");
 	[observable tearDownKVOForObserver:self];
+	[self invalidateRenderPlan];
 }
 
 #pragma mark -
 #pragma mark As a DKRasterizer
 
+/** @brief Returns the extra space needed by the style's renderers, which is computed once when the render plan is compiled
+ @return the extra width and height needed over and above the object's (path) bounds
+ */
+- (NSSize)extraSpaceNeeded
+{
+	return [self renderPlan]->extraSpace;
+}
+
 /** @brief Renders the object using this style
 
  Sets the value of the client for the duration of rendering */
@@ -1397,17 +2457,30 @@ static BOOL sSubstitute = NO;
 
 	if ([self enabled]) {
 		@autoreleasepool {
+			// within a render pass, the pass has already set the context up and chosen how the plan is executed
+
+			DKRenderPassState* pass = currentRenderPass();
 
-			if (![[self class] shouldAntialias] && [NSGraphicsContext currentContextDrawingToScreen]) {
+			if (pass == NULL && ![[self class] shouldAntialias] && [NSGraphicsContext currentContextDrawingToScreen]) {
 				[[NSGraphicsContext currentContext] setShouldAntialias:NO];
 				[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationNone];
 			}
 
 			m_renderClientRef = object;
 
+			// render using the compiled plan. It's retained while executing in case a rasterizer changes the style as it renders
+
+			DKRenderPlan* plan = [self renderPlan];
+			++plan->refCount;
+
 			@try
 			{
-				[super render:object];
+				SAVE_GRAPHICS_CONTEXT
+					if (pass)
+						pass->execute(plan, object, &pass->mode);
+					else
+						executeRenderPlan(plan, object);
+				RESTORE_GRAPHICS_CONTEXT
 			}
 			@catch (NSException* exception)
 			{
@@ -1418,6 +2491,7 @@ static BOOL sSubstitute = NO;
 
 				NSLog(@"An exception occurred while rendering the style - PLEASE FIX - %@. Exception = %@", self, exception);
 			}
+			releaseRenderPlan(plan);
 			m_renderClientRef = nil;
 
 		}
@@ -1478,11 +2552,12 @@ static BOOL sSubstitute = NO;
 	sShouldDrawShadows = ![[NSUserDefaults standardUserDefaults] boolForKey:kDKStyleDisplayPerformance_no_shadows];
 	sAntialias = ![[NSUserDefaults standardUserDefaults] boolForKey:kDKStyleDisplayPerformance_no_anti_aliasing];
 	sSubstitute = [[NSUserDefaults standardUserDefaults] boolForKey:kDKStyleDisplayPerformance_substitute_styles];
+	sUsesLevelOfDetail = ![[NSUserDefaults standardUserDefaults] boolForKey:kDKStyleDisplayPerformance_no_level_of_detail];
 }
 
 - (void)dealloc
 {
-	LogEvent_(kKVOEvent, @"style %@ ('%@') is being deallocated, will stop observing all components", self, [self name]);
+	DKTrace_(kDKTraceKVO, @"style %@ ('%@') is being deallocated, will stop observing all components", self, [self name]);
 
 	// stop observing all of the component rasterizers - any group objects in the list will propagate this
 	// message down to their subordinate objects.
@@ -1490,9 +2565,11 @@ static BOOL sSubstitute = NO;
 	[[self renderList] makeObjectsPerformSelector:@selector(tearDownKVOForObserver:)
 									   withObject:self];
 
-	[mSwatchCache release];
+	[self invalidateRenderPlan];
 	[m_textAttributes release];
 	[m_uniqueKey release];
+	[mCoalescedChanges release];
+	[mCoalescedKeys release];
 
 	[super dealloc];
 }
@@ -1510,7 +2587,6 @@ static BOOL sSubstitute = NO;
 		m_mergeFlag = NO;
 		[self assignUniqueKey];
 		m_lastModTime = [NSDate timeIntervalSinceReferenceDate];
-		mSwatchCache = [[NSMutableDictionary alloc] init];
 		m_clientCount = 0;
 
 		if (m_uniqueKey == nil) {
@@ -1581,7 +2657,7 @@ static BOOL sSubstitute = NO;
 			m_lastModTime = [NSDate timeIntervalSinceReferenceDate];
 			m_mergeFlag = NO;
 		} else {
-			m_uniqueKey = [uk retain];
+			m_uniqueKey = [[DKUniqueID uniqueKeyWithString:uk] retain];
 
 			// do not re-register styles immediately. Instead, just flag them as needing a potential remerge with the
 			// registry. The user might have other ideas - the document is able to handle the remerge of a document's styles
@@ -1595,7 +2671,6 @@ static BOOL sSubstitute = NO;
 		NSAssert(m_undoManagerRef == nil, @"Expected init to zero");
 		[self setStyleSharable:[coder decodeBoolForKey:@"shared"]];
 		[self setLocked:[coder decodeBoolForKey:@"locked"]];
-		mSwatchCache = [[NSMutableDictionary alloc] init];
 		NSAssert(m_renderClientRef == nil, @"Expected init to zero");
 		m_clientCount = 0;
 
@@ -1609,6 +2684,23 @@ static BOOL sSubstitute = NO;
 	return self;
 }
 
+- (id)awakeAfterUsingCoder:(NSCoder*)coder
+{
+	// when the coder has an intern table, a style identical to one already decoded is replaced by it
+
+	if ([coder respondsToSelector:@selector(styleInternTable)]) {
+		DKStyle* interned = [[(DKKeyedUnarchiver*)coder styleInternTable] internStyle:self];
+
+		if (interned != nil && interned != self) {
+			[interned retain];
+			[self release];
+			return interned;
+		}
+	}
+
+	return self;
+}
+
 #pragma mark -
 #pragma mark As part of NSCopying Protocol
 
@@ -1635,40 +2727,82 @@ static BOOL sSubstitute = NO;
 	// and client object refresh when properties are altered directly, which of course they usually will be. This powerfully
 	// means that renderers themselves do not need to know anything about undo or how they fit into the overall scheme of things.
 
+	// components are observed in batches (see -prefersBatchedObservation), so normally this is told of every change to a component through
+	// the one key, and gets the properties that changed and their previous values from the component. The whole change is coalesced, so
+	// it registers one undo action at most
+
+	if ([keypath isEqualToString:kGCObservableChangesKey]) {
+		NSDictionary* changes = [object observedChanges];
+		NSEnumerator* iter = [changes keyEnumerator];
+		NSString* kp;
+		id old, new;
+		NSKeyValueChange kind;
+
+		[self beginCoalescingPropertyChanges];
+
+		@try {
+			while ((kp = [iter nextObject])) {
+				old = [changes objectForKey:kp];
+				new = [object valueForKey:kp];
+				kind = NSKeyValueChangeSetting;
+
+				if ([old isKindOfClass:[NSArray class]] && [new isKindOfClass:[NSArray class]])
+					kind = ([(NSArray*)new count] > [(NSArray*)old count]) ? NSKeyValueChangeInsertion : NSKeyValueChangeRemoval;
+
+				if (!(old == new || [old isEqual:new] || (old == [NSNull null] && new == nil)))
+					[self noteChangeOfKeyPath:kp
+									 ofObject:object
+									 oldValue:old
+										 kind:kind];
+			}
+		}
+		@finally {
+			[self endCoalescingPropertyChanges];
+		}
+		return;
+	}
+
 	NSKeyValueChange ch = [[change objectForKey:NSKeyValueChangeKindKey] integerValue];
 	BOOL wasChanged = NO;
 
-	if (ch == NSKeyValueChangeSetting) {
-		if (![[change objectForKey:NSKeyValueChangeOldKey] isEqual:[change objectForKey:NSKeyValueChangeNewKey]]) {
-			[[[self undoManager] prepareWithInvocationTarget:self] changeKeyPath:keypath
-																		ofObject:object
-																		 toValue:[change objectForKey:NSKeyValueChangeOldKey]];
+	[self beginCoalescingPropertyChanges];
+
+	@try {
+		if (ch == NSKeyValueChangeSetting) {
+			if (![[change objectForKey:NSKeyValueChangeOldKey] isEqual:[change objectForKey:NSKeyValueChangeNewKey]]) {
+				[self noteChangeOfKeyPath:keypath
+								 ofObject:object
+								 oldValue:[change objectForKey:NSKeyValueChangeOldKey]
+									 kind:ch];
+				wasChanged = YES;
+			}
+		} else if (ch == NSKeyValueChangeInsertion || ch == NSKeyValueChangeRemoval) {
+			// Cocoa has a bug where array insertion/deletion changes don't properly record the old array.
+			// GCObserveableObject gives us a workaround
+
+			[self noteChangeOfKeyPath:keypath
+							 ofObject:object
+							 oldValue:[object oldArrayValueForKeyPath:keypath]
+								 kind:ch];
 			wasChanged = YES;
 		}
-	} else if (ch == NSKeyValueChangeInsertion || ch == NSKeyValueChangeRemoval) {
-		// Cocoa has a bug where array insertion/deletion changes don't properly record the old array.
-		// GCObserveableObject gives us a workaround
-
-		NSArray* old = [object oldArrayValueForKeyPath:keypath];
-
-		[[[self undoManager] prepareWithInvocationTarget:self] changeKeyPath:keypath
-																	ofObject:object
-																	 toValue:old];
-
-		wasChanged = YES;
 	}
-
-	if (wasChanged && !([[self undoManager] isUndoing] || [[self undoManager] isRedoing])) {
-		if ([object respondsToSelector:@selector(actionNameForKeyPath:
-														   changeKind:)])
-			[[self undoManager] setActionName:[object actionNameForKeyPath:keypath
-																changeKind:ch]];
-		else
-			[[self undoManager] setActionName:[GCObservableObject actionNameForKeyPath:keypath
-																			  objClass:[object class]]];
+	@finally {
+		[self endCoalescingPropertyChanges];
 	}
 
-	[self notifyClientsAfterChange];
+	// ending the coalescing tells the clients of a change it records
+
+	if (!wasChanged)
+		[self notifyClientsAfterChange];
+}
+
+/** @brief Asks to observe each component with a single KVO registration rather than one for each of its properties
+ @return YES
+ */
+- (BOOL)prefersBatchedObservation
+{
+	return YES;
 }
 
 #pragma mark -
@@ -1683,7 +2817,7 @@ static BOOL sSubstitute = NO;
 	[copy setName:nil];
 	[copy setStyleSharable:[self isStyleSharable]];
 
-	NSDictionary* attribs = [[self textAttributes] deepCopy];
+	NSDictionary* attribs = newSharedTextAttributes([self textAttributes]);
 
 	[copy setTextAttributes:attribs];
 	[attribs release];
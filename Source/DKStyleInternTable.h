@@ -0,0 +1,46 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKStyle;
+
+/** @brief Collapses unshared styles that have the same content into one shared style.
+
+ Collapses unshared styles that have the same content into one shared style. Drawings imported from elsewhere, or put together by pasting,
+ often carry thousands of copies of a few styles, each a separate unshared object, which costs memory and means that changing the look of
+ the objects has to be done for each. -internStyle: looks the style up by its -contentHash, and if an earlier style has the same
+ -contentData, returns that instead. Otherwise the style is made sharable and becomes the one returned for others like it.
+
+ Only unshared styles are interned. Styles that are already sharable, and styles that require a remerge with the registry (because they
+ were registered when saved), are returned as they are, since their identity matters.
+
+ Note that interning changes what editing a style does - the objects that now share the interned style all change together.
+*/
+@interface DKStyleInternTable : NSObject {
+@private
+	NSMutableDictionary* mEntries; // content hash -> array of (style, content data) pairs
+	NSUInteger mCount;
+	NSUInteger mInternedCount;
+}
+
+/** @brief Returns the style to use in place of the given one
+ @param style a style
+ @return an identical style already in the table, or <style>
+ */
+- (DKStyle*)internStyle:(DKStyle*)style;
+
+/** @brief The number of distinct styles in the table
+ */
+- (NSUInteger)count;
+
+/** @brief The number of styles that were replaced by one already in the table
+ */
+- (NSUInteger)internedCount;
+
+- (void)removeAllStyles;
+
+@end
@@ -0,0 +1,86 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKStyleInternTable.h"
+#import "DKStyle.h"
+#import "LogEvent.h"
+
+@implementation DKStyleInternTable
+
+- (DKStyle*)internStyle:(DKStyle*)style
+{
+	if (style == nil || [style isStyleSharable] || [style requiresRemerge])
+		return style;
+
+	// the content data is made once for each style, and also sets the style's content hash
+
+	NSData* data = [style contentData];
+	NSNumber* hash = [NSNumber numberWithUnsignedInteger:[style contentHash]];
+	NSMutableArray* entries = [mEntries objectForKey:hash];
+	NSEnumerator* iter = [entries objectEnumerator];
+	NSArray* entry;
+
+	while ((entry = [iter nextObject])) {
+		if ([data isEqualToData:[entry objectAtIndex:1]]) {
+			++mInternedCount;
+			return [entry objectAtIndex:0];
+		}
+	}
+
+	if (entries == nil) {
+		entries = [NSMutableArray arrayWithCapacity:1];
+		[mEntries setObject:entries
+					 forKey:hash];
+	}
+
+	// this style stands for the others from now on, so must be shared by the objects that use it
+
+	[style setStyleSharable:YES];
+	[entries addObject:[NSArray arrayWithObjects:style, data, nil]];
+	++mCount;
+
+	LogEvent_(kInfoEvent, @"interned new style %@", style);
+
+	return style;
+}
+
+- (NSUInteger)count
+{
+	return mCount;
+}
+
+- (NSUInteger)internedCount
+{
+	return mInternedCount;
+}
+
+- (void)removeAllStyles
+{
+	[mEntries removeAllObjects];
+	mCount = 0;
+	mInternedCount = 0;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	self = [super init];
+	if (self) {
+		mEntries = [[NSMutableDictionary alloc] init];
+	}
+
+	return self;
+}
+
+- (void)dealloc
+{
+	[mEntries release];
+	[super dealloc];
+}
+
+@end
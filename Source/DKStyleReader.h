@@ -9,11 +9,20 @@
 
 @class DKParser;
 
+#define kDKStyleReaderParsedScriptLimit 1024
+
 @interface DKStyleReader : DKEvaluator {
 	DKParser* mParser;
+	NSMutableDictionary* mParsedScripts; // script text -> parsed expression
 }
 
 - (id)evaluateScript:(NSString*)script;
+
+// scripts are parsed once and the parsed expressions are kept, up to kDKStyleReaderParsedScriptLimit of them, so
+// evaluating the same script again only builds the objects
+
+- (id)expressionForScript:(NSString*)script;
+- (void)removeAllParsedScripts;
 - (id)readContentsOfFile:(NSString*)filenamet;
 - (void)loadBuiltinSymbols;
 
@@ -17,7 +17,36 @@
 /**  */
 - (id)evaluateScript:(NSString*)script
 {
-	return [self evaluateExpression:[mParser parseString:script]];
+	return [self evaluateExpression:[self expressionForScript:script]];
+}
+
+- (id)expressionForScript:(NSString*)script
+{
+	if (script == nil)
+		return nil;
+
+	id expr = [mParsedScripts objectForKey:script];
+
+	if (expr == nil) {
+		expr = [mParser parseString:script];
+
+		if (expr != nil) {
+			// when full, the cache is simply emptied - imports tend to use a small set of scripts over and over
+
+			if ([mParsedScripts count] >= kDKStyleReaderParsedScriptLimit)
+				[mParsedScripts removeAllObjects];
+
+			[mParsedScripts setObject:expr
+							   forKey:script];
+		}
+	}
+
+	return expr;
+}
+
+- (void)removeAllParsedScripts
+{
+	[mParsedScripts removeAllObjects];
 }
 
 - (id)readContentsOfFile:(NSString*)filename;
@@ -153,6 +182,7 @@
 - (void)dealloc
 {
 	[mParser release];
+	[mParsedScripts release];
 
 	[super dealloc];
 }
@@ -162,6 +192,7 @@
 	self = [super init];
 	if (self != nil) {
 		mParser = [[DKParser alloc] init];
+		mParsedScripts = [[NSMutableDictionary alloc] init];
 
 		if (mParser == nil) {
 			[self autorelease];
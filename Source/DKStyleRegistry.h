@@ -110,7 +110,14 @@ Registering a style. The style registry performs the following steps:
 
 Cut/Paste: cut and paste of styles works independently of the registry, including dealing with shared styles. See DKStyle for more info.
 */
-@interface DKStyleRegistry : DKCategoryManager
+@interface DKStyleRegistry : DKCategoryManager {
+@private
+	NSMutableSet* mBatchNames; // names of the registered styles while registering in bulk
+	NSUInteger mBatchLevel; // nesting of -beginRegisteringStyles
+	BOOL mBatchRegisteredStyles; // YES if a style was registered during the batch
+	BOOL mBatchNeedsUIUpdate; // YES if a UI update was requested during the batch
+	NSMutableDictionary* mArchivedNames; // lowercase key -> name, of styles read from a library and not yet unarchived
+}
 
 // retrieving the registry and styles
 
@@ -222,6 +229,22 @@ Cut/Paste: cut and paste of styles works independently of the registry, includin
  */
 + (NSSet*)mergeStyles:(NSSet*)styles inCategories:(NSArray*)styleCategories options:(DKStyleMergeOptions)options mergeDelegate:(id)aDel;
 
+/** @brief Merge a set of styles with the registry, comparing them with the registered styles in the same pass
+
+ As -mergeStyles:inCategories:options:mergeDelegate:, but also returns what -compareStylesInSet: would
+ have returned before the merge, without looking up each style a second time. The whole merge is
+ done as a batch - style change notifications are suspended while it runs, and the registry posts
+ one kDKStyleWasRegisteredNotification and one UI update at the end.
+ @param styles a set of one or more styles
+ @param styleCategories a list of categories to add the styles to if they are added (one or more NSStrings)
+ @param options control flags for changing the preferred direction of merging, etc.
+ @param aDel an optional delegate object that can make a merge decision for each individual style object
+ @param comparison if not NULL, receives a dictionary of the results of comparing each style with the registry
+ @return a set of styles that should replace those with the same key in whatever structure made the call.
+ can be nil if there is no need to do anything.
+ */
++ (NSSet*)mergeStyles:(NSSet*)styles inCategories:(NSArray*)styleCategories options:(DKStyleMergeOptions)options mergeDelegate:(id)aDel comparison:(NSDictionary**)comparison;
+
 /** @brief Preflight a set of styles against the registry for a possible future merge operation
 
  This is a way to test a set of styles against the registry prior to a merge operation (preflight).
@@ -247,16 +270,27 @@ Cut/Paste: cut and paste of styles works independently of the registry, includin
  */
 + (NSData*)registeredStylesData;
 
-/** @brief Saves the registry to the current user defaults
+/** @brief Saves the registry as a style library in the file at +libraryPath
  */
 + (void)saveDefaults;
 
-/** @brief Loads the registry from the current user defaults
+/** @brief Loads the registry from the style library saved by +saveDefaults, or from the current user defaults
+ if it was saved there by an earlier version
 
- If used, this should be called early in the application launch sequence
+ If used, this should be called early in the application launch sequence. The library file is mapped
+ rather than read, and only the keys, names and categories of its styles are loaded - each style is
+ unarchived the first time it is asked for, so a large library costs little at launch.
  */
 + (void)loadDefaults;
 
+/** @brief The file that +saveDefaults saves the registry to
+
+ A file named "Styles.stylelib" in a folder named for the main bundle's identifier, in the user's
+ Application Support folder.
+ @return the full path of the file
+ */
++ (NSString*)libraryPath;
+
 /** @brief Reset the registry back to a "first run" condition
 
  This removes ALL styles from the registry, thereby unregistering them. It then starts over with
@@ -340,9 +374,11 @@ Cut/Paste: cut and paste of styles works independently of the registry, includin
  */
 - (NSArray*)styleNamesInCategory:(NSString*)catName;
 
-/** @brief Write the registry to a file
+/** @brief Write the registry to a file, as a style library
+
+ The file is always replaced atomically, since styles not yet unarchived may be mapped from it.
  @param path the full path of the file to write
- @param atom YES to save safely, NO to overwrite in place
+ @param atom ignored
  @return YES if the file was saved sucessfully, NO otherwise
  */
 - (BOOL)writeToFile:(NSString*)path atomically:(BOOL)atom;
@@ -353,6 +389,9 @@ Cut/Paste: cut and paste of styles works independently of the registry, includin
  options, etc. The intention of this method is to load a file containing styles only - either to
  augment or replace the existing registry. It is not used when opening a drawing document.
  If the intention is to replace the reg, the caller should clear out the current one before calling this.
+ The file may be a style library or an archive of a registry. Styles in a library that are new to the
+ registry are added without being unarchived, unless their names collide with those already registered
+ or the options ask for unshared styles to be ignored.
  @param path the full path of the file to write
  @param options merging options
  @param aDel an optional delegate object that can make a merge decision for each individual style object 
@@ -362,6 +401,26 @@ Cut/Paste: cut and paste of styles works independently of the registry, includin
 
 - (DKStyle*)mergeFromStyle:(DKStyle*)aStyle mergeDelegate:(id)aDel;
 
+/** @brief Returns the registry in the indexed form of a style library
+
+ A style library lists the key, name and categories of every style ahead of the styles themselves,
+ each of which is a keyed archive of its own. It starts with the four bytes "DKSL", then the version
+ and the length of the index as big-endian 32-bit integers, then the index as a binary property list
+ and then the archives. Styles still archived are written out as they are, without being unarchived.
+ @return the library
+ */
+- (NSData*)libraryData;
+
+/** @brief Adds the styles of a style library to the registry, leaving them archived until they are first used
+
+ Only the index is read. The archives are unarchived from <data> as the styles are asked for, so it's
+ best mapped from its file. Styles whose keys are already registered are left as they are, but are
+ added to the library's categories.
+ @param data a style library, as made by -libraryData
+ @return YES if the library was read, NO if it was not a valid style library
+ */
+- (BOOL)appendContentsWithLibraryData:(NSData*)data;
+
 /** @brief Set the registry empty
 
  Removes all styles from the registry, clears the "recently added" and "recently used" lists, and
@@ -372,12 +431,29 @@ Cut/Paste: cut and paste of styles works independently of the registry, includin
 - (void)setNeedsUIUpdate;
 - (void)styleDidChange:(NSNotification*)note;
 
+/** @brief Starts registering styles in bulk
+
+ Until the matching -endRegisteringStyles, the names of the registered styles are kept in a set so that
+ resolving name collisions doesn't rebuild the list of names for every style, and the notifications
+ that each style was registered and the UI updates are held back. Calls may be nested.
+ */
+- (void)beginRegisteringStyles;
+
+/** @brief Ends registering styles in bulk
+
+ When the outermost batch ends, one kDKStyleWasRegisteredNotification and one UI update are posted if
+ they were held back.
+ */
+- (void)endRegisteringStyles;
+- (BOOL)isRegisteringStyles;
+
 /** @brief Creates a new fully managed menu that lists all the styles, organised into categories.
 
  The returned menu is fully managed, that is, the Style Registry keeps it in synch with all changes
  to the registry and to the styles themselves. The menu can be assigned to UI controls such as a
  represented object is the style, and the item shows a swatch and the style's name. The menus
- are ordered alphabetically.
+ are ordered alphabetically. Each category's submenu is filled in when it's first opened, and the
+ swatches are rendered a few at a time while it is shown.
  This is intended as a very high-level method to support the most common usage. If you need to pass
  different options or wish to handle each item differently, DKCategoryManager has more flexible
  methods that expose more detail.
@@ -403,6 +479,10 @@ extern NSString* kDKStyleWasRegisteredNotification;
 extern NSString* kDKStyleWasRemovedFromRegistryNotification;
 extern NSString* kDKStyleWasEditedWhileRegisteredNotification;
 
+// the current version of the style library format. Libraries with a later version are refused
+
+#define kDKStyleLibraryVersion 1
+
 // delegate informal protocol allows the delegate to decide which of a pair of styles should be used
 
 @interface NSObject (DKStyleRegistryDelegate)
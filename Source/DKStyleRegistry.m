@@ -24,6 +24,17 @@ NSString* kDKStyleWasRegisteredNotification = @"kDKDrawingStyleWasRegisteredNoti
 NSString* kDKStyleWasRemovedFromRegistryNotification = @"kDKDrawingStyleWasRemovedFromRegistryNotification";
 NSString* kDKStyleWasEditedWhileRegisteredNotification = @"kDKStyleWasEditedWhileRegisteredNotifcation";
 
+// the style library format
+
+#define kDKStyleLibraryMagic "DKSL"
+#define kDKStyleLibraryHeaderLength 12
+
+#define kDKStyleLibraryKeysKey @"keys"
+#define kDKStyleLibraryNamesKey @"names"
+#define kDKStyleLibraryExtentsKey @"extents"
+#define kDKStyleLibraryCategoriesKey @"categories"
+#define kDKStyleLibraryRecentlyAddedKey @"recent_add"
+
 #pragma mark -
 #pragma mark static functions
 
@@ -39,6 +50,20 @@ static NSInteger SortKeysByReferredName(id a, id b, void* contextInfo)
 	return [nameA localisedCaseInsensitiveNumericCompare:nameB];
 }
 
+static NSInteger CompareStyleWithRegisteredStyle(DKStyle* style, DKStyle* regStyle)
+{
+	// note that for timestamp comparison to work, it is essential that the styles being tested have not in any way been touched
+	// such that their timestamps have been bumped.
+
+	if (regStyle == nil)
+		return kDKStyleNotRegistered;
+
+	if ([style isEqualToStyle:regStyle])
+		return kDKStyleUnchanged;
+
+	return ([style lastModificationTimestamp] > [regStyle lastModificationTimestamp]) ? kDKStyleIsNewer : kDKStyleIsOlder;
+}
+
 #pragma mark -
 #pragma mark special private category on DKStyle gives the registry extra privileges.
 
@@ -58,12 +83,94 @@ static NSInteger SortKeysByReferredName(id a, id b, void* contextInfo)
 
 #pragma mark -
 
+@interface DKStyleRegistry (Private)
+
+- (void)noteArchivedStyleName:(NSString*)name forKey:(NSString*)key;
+
+@end
+
+#pragma mark -
+
+// the archive of one style in a style library, kept where it lies in the library's data, which is usually mapped from the file. It retains
+// the library, so the mapping lasts for as long as any of its styles is still archived
+
+@interface DKStyleLibraryArchive : NSData {
+@private
+	NSData* mLibrary;
+	NSRange mRange;
+}
+
+- (id)initWithLibrary:(NSData*)library range:(NSRange)range;
+
+@end
+
+@implementation DKStyleLibraryArchive
+
+- (id)initWithLibrary:(NSData*)library range:(NSRange)range
+{
+	self = [super init];
+	if (self) {
+		mLibrary = [library retain];
+		mRange = range;
+	}
+
+	return self;
+}
+
+- (const void*)bytes
+{
+	return (const uint8_t*)[mLibrary bytes] + mRange.location;
+}
+
+- (NSUInteger)length
+{
+	return mRange.length;
+}
+
+- (void)dealloc
+{
+	[mLibrary release];
+	[super dealloc];
+}
+
+@end
+
+static NSData* archiveStyle(DKStyle* style)
+{
+	NSMutableData* data = [NSMutableData data];
+	NSKeyedArchiver* arch = [[NSKeyedArchiver alloc] initForWritingWithMutableData:data];
+
+	[arch setOutputFormat:NSPropertyListBinaryFormat_v1_0];
+	[arch encodeObject:style
+				forKey:@"root"];
+	[arch finishEncoding];
+	[arch release];
+
+	return data;
+}
+
+// the offset within the archives and the length of the archive of the <i>th style in a library
+
+static void getExtent(NSData* extents, NSUInteger i, NSUInteger* offset, NSUInteger* length)
+{
+	uint32_t extent[2];
+
+	[extents getBytes:extent
+				range:NSMakeRange(i * sizeof(extent), sizeof(extent))];
+
+	*offset = NSSwapBigIntToHost(extent[0]);
+	*length = NSSwapBigIntToHost(extent[1]);
+}
+
+#pragma mark -
+
 @implementation DKStyleRegistry
 
 // warning: only access this using +sharedStyleRegistry
 
 static DKStyleRegistry* s_styleRegistry = nil;
 static BOOL s_NoDKDefaults = NO;
+static BOOL s_styleNotificationsEnabled = NO;
 
 #pragma mark As a DKStyleRegistry
 
@@ -196,10 +303,17 @@ static BOOL s_NoDKDefaults = NO;
 	// but this makes sure that has to be a very deliberate act).
 
 	[aStyle setLocked:YES];
-	[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleWasRegisteredNotification
-														object:[self sharedStyleRegistry]];
 
-	[self setNeedsUIUpdate];
+	if ([reg isRegisteringStyles]) {
+		[reg->mBatchNames addObject:name];
+		reg->mBatchRegisteredStyles = YES;
+		reg->mBatchNeedsUIUpdate = YES;
+	} else {
+		[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleWasRegisteredNotification
+															object:reg];
+
+		[self setNeedsUIUpdate];
+	}
 }
 
 /** @brief Register a list of styles with the registry
@@ -232,14 +346,17 @@ static BOOL s_NoDKDefaults = NO;
 
 	NSEnumerator* iter = [styles objectEnumerator];
 	DKStyle* style;
-	NSArray* stNames = nil;
+	NSSet* stNames = nil;
 
-	[[self sharedStyleRegistry] setRecentlyAddedListEnabled:NO];
+	DKStyleRegistry* reg = [self sharedStyleRegistry];
+
+	[reg setRecentlyAddedListEnabled:NO];
+	[reg beginRegisteringStyles];
 
 	while ((style = [iter nextObject])) {
 		if (ignoreDupes) {
 			if (stNames == nil)
-				stNames = [[self sharedStyleRegistry] styleNames];
+				stNames = [NSSet setWithArray:[reg styleNames]];
 
 			if ([stNames containsObject:[style name]])
 				continue;
@@ -249,7 +366,8 @@ static BOOL s_NoDKDefaults = NO;
 			   inCategories:styleCategories];
 	}
 
-	[[self sharedStyleRegistry] setRecentlyAddedListEnabled:YES];
+	[reg endRegisteringStyles];
+	[reg setRecentlyAddedListEnabled:YES];
 }
 
 /** @brief Remove the style from the registry
@@ -301,38 +419,101 @@ static BOOL s_NoDKDefaults = NO;
  can be nil if there is no need to do anything.
  */
 + (NSSet*)mergeStyles:(NSSet*)styles inCategories:(NSArray*)styleCategories options:(DKStyleMergeOptions)options mergeDelegate:(id)aDel
+{
+	return [self mergeStyles:styles
+				inCategories:styleCategories
+					 options:options
+			   mergeDelegate:aDel
+				  comparison:NULL];
+}
+
+/** @brief Merge a set of styles with the registry, comparing them with the registered styles in the same pass
+
+ As -mergeStyles:inCategories:options:mergeDelegate:, but also returns what -compareStylesInSet: would
+ have returned before the merge, without looking up each style a second time. The whole merge is
+ done as a batch - style change notifications are suspended while it runs, and the registry posts
+ one kDKStyleWasRegisteredNotification and one UI update at the end.
+ @param styles a set of one or more styles
+ @param styleCategories a list of categories to add the styles to if they are added (one or more NSStrings)
+ @param options control flags for changing the preferred direction of merging, etc.
+ @param aDel an optional delegate object that can make a merge decision for each individual style object
+ @param comparison if not NULL, receives a dictionary of the results of comparing each style with the registry
+ @return a set of styles that should replace those with the same key in whatever structure made the call.
+ can be nil if there is no need to do anything.
+ */
++ (NSSet*)mergeStyles:(NSSet*)styles inCategories:(NSArray*)styleCategories options:(DKStyleMergeOptions)options mergeDelegate:(id)aDel comparison:(NSDictionary**)comparison
 {
 	NSAssert(styles != nil, @"cannot merge a nil set of styles");
 
+	DKStyleRegistry* reg = [self sharedStyleRegistry];
 	NSEnumerator* iter = [styles objectEnumerator];
 	DKStyle* style;
 	DKStyle* regStyle;
 	NSMutableSet* changedStyles = nil;
+	NSMutableDictionary* info = nil;
+	NSMutableArray* mergedKeys = nil;
+	NSInteger result;
+	BOOL notify = s_styleNotificationsEnabled;
 
-	while ((style = [iter nextObject])) {
-		// this option relates to the old registry's behaviour, and is mostly inappropriate for this one. Whether a style is sharable or not
-		// generally has no connection to how it is registered in the current model.
+	if (comparison != NULL)
+		info = [NSMutableDictionary dictionaryWithCapacity:[styles count]];
 
-		if ((options & kDKIgnoreUnsharedStyles) != 0 && ![style isStyleSharable])
-			continue;
+	// the registry would otherwise update the managed menus once for every style whose contents are swapped, so style notifications are
+	// suspended and the menus brought up to date at the end
+
+	if (notify) {
+		[self setStyleNotificationsEnabled:NO];
+		mergedKeys = [NSMutableArray array];
+	}
 
-		// if the style is unknown to the registry, simply register it - in this case there's no need to do any complex merging or
-		// further analysis.
+	[reg beginRegisteringStyles];
 
-		regStyle = [self styleForKey:[style uniqueKey]];
+	@try {
+		while ((style = [iter nextObject])) {
+			// this option relates to the old registry's behaviour, and is mostly inappropriate for this one. Whether a style is sharable or not
+			// generally has no connection to how it is registered in the current model.
 
-		if (regStyle == nil)
-			[self registerStyle:style
-				   inCategories:styleCategories];
-		else {
-			if ((options & kDKReplaceExistingStyles) != 0) {
-				// style is known to us, so a merge is required, overwriting the registered style with the new one. Any clients of the
-				// modified style will be updated automatically.
+			regStyle = [reg styleForKey:[style uniqueKey]];
+			result = CompareStyleWithRegisteredStyle(style, regStyle);
+
+			[info setObject:[NSNumber numberWithInteger:result]
+					 forKey:[style uniqueKey]];
+
+			if ((options & kDKIgnoreUnsharedStyles) != 0 && ![style isStyleSharable])
+				continue;
+
+			// if the style is unknown to the registry, simply register it - in this case there's no need to do any complex merging or
+			// further analysis.
+
+			if (regStyle == nil)
+				[self registerStyle:style
+					   inCategories:styleCategories];
+			else {
+				if ((options & kDKReplaceExistingStyles) != 0) {
+					// style is known to us, so a merge is required, overwriting the registered style with the new one. Any clients of the
+					// modified style will be updated automatically.
+
+					regStyle = [reg mergeFromStyle:style
+									 mergeDelegate:aDel];
+
+					if (regStyle != nil) {
+						if (changedStyles == nil)
+							changedStyles = [NSMutableSet set];
+
+						[changedStyles addObject:regStyle];
 
-				regStyle = [[self sharedStyleRegistry] mergeFromStyle:style
-														mergeDelegate:aDel];
+						if (result != kDKStyleUnchanged)
+							[mergedKeys addObject:[regStyle uniqueKey]];
+
+						// add to the requested categories if needed
+
+						[reg addKey:[regStyle uniqueKey]
+								toCategories:styleCategories
+							createCategories:YES];
+					}
+				} else if ((options & kDKReturnExistingStyles) != 0) {
+					// here the options request that the registered styles have priority, so the existing style is added to the return set
 
-				if (regStyle != nil) {
 					if (changedStyles == nil)
 						changedStyles = [NSMutableSet set];
 
@@ -340,41 +521,43 @@ static BOOL s_NoDKDefaults = NO;
 
 					// add to the requested categories if needed
 
-					[[self sharedStyleRegistry] addKey:[regStyle uniqueKey]
-										  toCategories:styleCategories
-									  createCategories:YES];
-				}
-			} else if ((options & kDKReturnExistingStyles) != 0) {
-				// here the options request that the registered styles have priority, so the existing style is added to the return set
-
-				if (changedStyles == nil)
-					changedStyles = [NSMutableSet set];
+					[reg addKey:[regStyle uniqueKey]
+							toCategories:styleCategories
+						createCategories:YES];
+				} else if ((options & kDKAddStylesAsNewVersions) != 0) {
+					// here the options request that the document styles are to be re-registered as new styles. This leaves both document and
+					// existing registered styles unaffected but can massively multiply the registry with many duplicates. In general this
+					// options should be used sparingly, if at all.
 
-				[changedStyles addObject:regStyle];
+					// to make these look like new styles, the unique key must be reassigned. Normally this is disallowed, but the style registry
+					// has special privileges (and a special private method) to make it possible:
 
-				// add to the requested categories if needed
+					[style reassignUniqueKey];
+					[self registerStyle:style
+						   inCategories:styleCategories];
 
-				[[self sharedStyleRegistry] addKey:[regStyle uniqueKey]
-									  toCategories:styleCategories
-								  createCategories:YES];
-			} else if ((options & kDKAddStylesAsNewVersions) != 0) {
-				// here the options request that the document styles are to be re-registered as new styles. This leaves both document and
-				// existing registered styles unaffected but can massively multiply the registry with many duplicates. In general this
-				// options should be used sparingly, if at all.
-
-				// to make these look like new styles, the unique key must be reassigned. Normally this is disallowed, but the style registry
-				// has special privileges (and a special private method) to make it possible:
+					// there's nothing to return in this case
+				}
+			}
+		}
+	}
+	@finally {
+		if (notify) {
+			[self setStyleNotificationsEnabled:YES];
 
-				[style reassignUniqueKey];
-				[self registerStyle:style
-					   inCategories:styleCategories];
+			NSEnumerator* keyIter = [mergedKeys objectEnumerator];
+			NSString* key;
 
-				// there's nothing to return in this case
-			}
+			while ((key = [keyIter nextObject]))
+				[reg updateMenusForKey:key];
 		}
+
+		[reg setNeedsUIUpdate];
+		[reg endRegisteringStyles];
 	}
 
-	[self setNeedsUIUpdate];
+	if (comparison != NULL)
+		*comparison = info;
 
 	return changedStyles;
 }
@@ -394,7 +577,7 @@ static BOOL s_NoDKDefaults = NO;
 {
 	NSAssert(styles != nil, @"can't preflight a nil set");
 
-	NSMutableDictionary* info = [NSMutableDictionary dictionary];
+	NSMutableDictionary* info = [NSMutableDictionary dictionaryWithCapacity:[styles count]];
 	NSEnumerator* iter = [styles objectEnumerator];
 	DKStyle* style;
 	DKStyle* regStyle;
@@ -404,28 +587,7 @@ static BOOL s_NoDKDefaults = NO;
 	while ((style = [iter nextObject])) {
 		key = [style uniqueKey];
 		regStyle = [self styleForKey:key];
-
-		if (regStyle == nil) {
-			// unknown style
-
-			infoValue = [NSNumber numberWithInteger:kDKStyleNotRegistered];
-		} else {
-			// known - compare timestamps. Note that for timestamp comparison to work,
-			// it is essential that the styles being tested have not in any way been touched
-			// such that their timestamps have been bumped.
-
-			NSTimeInterval a, b;
-
-			a = [style lastModificationTimestamp];
-			b = [regStyle lastModificationTimestamp];
-
-			if (a > b)
-				infoValue = [NSNumber numberWithInteger:kDKStyleIsNewer];
-			else if (a < b)
-				infoValue = [NSNumber numberWithInteger:kDKStyleIsOlder];
-			else
-				infoValue = [NSNumber numberWithInteger:kDKStyleUnchanged];
-		}
+		infoValue = [NSNumber numberWithInteger:CompareStyleWithRegisteredStyle(style, regStyle)];
 
 		[info setObject:infoValue
 				 forKey:key];
@@ -450,26 +612,55 @@ static BOOL s_NoDKDefaults = NO;
 	return [[self sharedStyleRegistry] data];
 }
 
-/** @brief Saves the registry to the current user defaults
+/** @brief Saves the registry as a style library in the file at +libraryPath
  */
 + (void)saveDefaults
 {
-	[[NSUserDefaults standardUserDefaults] setObject:[self registeredStylesData]
-											  forKey:@"DKStyleRegistry_stylesLibrary"];
+	NSString* path = [self libraryPath];
+
+	[[NSFileManager defaultManager] createDirectoryAtPath:[path stringByDeletingLastPathComponent]
+							  withIntermediateDirectories:YES
+											   attributes:nil
+													error:NULL];
+
+	// once the library is saved, a copy left in the defaults by an earlier version is out of date
+
+	if ([[self sharedStyleRegistry] writeToFile:path
+									 atomically:YES])
+		[[NSUserDefaults standardUserDefaults] removeObjectForKey:@"DKStyleRegistry_stylesLibrary"];
 }
 
-/** @brief Loads the registry from the current user defaults
+/** @brief Loads the registry from the style library saved by +saveDefaults, or from the current user defaults
+ if it was saved there by an earlier version
 
  If used, this should be called early in the application launch sequence
  */
 + (void)loadDefaults
 {
-	NSData* lib = [[NSUserDefaults standardUserDefaults] objectForKey:@"DKStyleRegistry_stylesLibrary"];
+	NSData* lib = [NSData dataWithContentsOfFile:[self libraryPath]
+										 options:NSDataReadingMappedIfSafe
+										   error:NULL];
+
+	if (lib && [[self sharedStyleRegistry] appendContentsWithLibraryData:lib])
+		return;
+
+	lib = [[NSUserDefaults standardUserDefaults] objectForKey:@"DKStyleRegistry_stylesLibrary"];
 
 	if (lib)
 		[[self sharedStyleRegistry] appendContentsWithData:lib];
 }
 
++ (NSString*)libraryPath
+{
+	NSArray* paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory, NSUserDomainMask, YES);
+	NSString* owner = [[NSBundle mainBundle] bundleIdentifier];
+
+	if (owner == nil)
+		owner = @"DrawKit";
+
+	return [[[paths objectAtIndex:0] stringByAppendingPathComponent:owner] stringByAppendingPathComponent:@"Styles.stylelib"];
+}
+
 /** @brief Reset the registry back to a "first run" condition
 
  This removes ALL styles from the registry, thereby unregistering them. It then starts over with
@@ -624,6 +815,13 @@ static BOOL s_NoDKDefaults = NO;
  */
 - (NSString*)styleNameForKey:(NSString*)styleID
 {
+	// a style still archived has the name its library listed, so names can be listed without unarchiving the styles
+
+	NSString* name = [mArchivedNames objectForKey:[styleID lowercaseString]];
+
+	if (name && [self archivedObjectForKey:styleID])
+		return name;
+
 	return [[self styleForKey:styleID] name];
 }
 
@@ -662,18 +860,14 @@ static BOOL s_NoDKDefaults = NO;
 	// if <name> already exists among the registerd styles, append a number to it until it is not found.
 
 	NSInteger numeral = 0;
-	BOOL found = YES;
 	NSString* temp = name;
-	NSArray* keys = [self styleNames];
+	NSSet* names = mBatchNames;
 
-	while (found) {
-		NSInteger k = [keys indexOfObject:temp];
+	if (names == nil)
+		names = [NSSet setWithArray:[self styleNames]];
 
-		if (k == NSNotFound)
-			found = NO;
-		else
-			temp = [NSString stringWithFormat:@"%@ %ld", name, (long)++numeral];
-	}
+	while ([names containsObject:temp])
+		temp = [NSString stringWithFormat:@"%@ %ld", name, (long)++numeral];
 
 	return temp;
 }
@@ -683,12 +877,17 @@ static BOOL s_NoDKDefaults = NO;
  */
 - (NSArray*)styleNames
 {
-	NSEnumerator* iter = [[self allObjects] objectEnumerator];
-	DKStyle* style;
+	NSEnumerator* iter = [[self allKeysInCategory:kDKDefaultCategoryName] objectEnumerator];
 	NSMutableArray* names = [NSMutableArray array];
+	NSString* key;
+	NSString* name;
 
-	while ((style = [iter nextObject]))
-		[names addObject:[style name]];
+	while ((key = [iter nextObject])) {
+		name = [self styleNameForKey:key];
+
+		if (name)
+			[names addObject:name];
+	}
 
 	[names sortUsingSelector:@selector(caseInsensitiveCompare:)];
 
@@ -722,14 +921,18 @@ static BOOL s_NoDKDefaults = NO;
  */
 - (BOOL)writeToFile:(NSString*)path atomically:(BOOL)atom
 {
+#pragma unused(atom)
+
 	NSAssert(path != nil, @"path can't be nil");
 
 	BOOL result = NO;
 
-	NSData* data = [self data];
+	// styles still archived may be mapped from the file being replaced, which must not change under them
+
+	NSData* data = [self libraryData];
 	if (data != nil)
 		result = [data writeToFile:path
-						atomically:atom];
+						atomically:YES];
 
 	return result;
 }
@@ -750,32 +953,66 @@ static BOOL s_NoDKDefaults = NO;
 	NSAssert(path != nil, @"cannot read file - path is nil");
 
 	BOOL readOK = NO;
-	NSData* styleData = [NSData dataWithContentsOfFile:path];
+	NSData* styleData = [NSData dataWithContentsOfFile:path
+											   options:NSDataReadingMappedIfSafe
+												 error:NULL];
 
 	if (styleData != nil && [styleData length] > 0) {
 		// because we are merging the file, a temporary registry object is created and that is used to populate the "real" one.
 
-		DKStyleRegistry* regTemp = [[DKStyleRegistry alloc] initWithData:styleData];
+		DKStyleRegistry* regTemp = [[DKStyleRegistry alloc] init];
+
+		if (![regTemp appendContentsWithLibraryData:styleData]) {
+			[regTemp release];
+			regTemp = [[DKStyleRegistry alloc] initWithData:styleData];
+		}
 
 		if (regTemp != nil) {
-			NSEnumerator* iter = [[regTemp allObjects] objectEnumerator];
+			NSEnumerator* iter = [[regTemp allKeys] objectEnumerator];
+			NSString* key;
+			NSString* name;
+			NSData* archive;
 			DKStyle* style;
 			NSSet* styles;
 			NSArray* cats;
 
-			while ((style = [iter nextObject])) {
-				cats = [regTemp categoriesContainingKey:[style uniqueKey]];
-				styles = [NSSet setWithObject:style];
-
-				[[self class] mergeStyles:styles
-							 inCategories:cats
-								  options:options
-							mergeDelegate:aDel];
-
-				readOK = YES;
+			[self beginRegisteringStyles];
+
+			@try {
+				while ((key = [iter nextObject])) {
+					cats = [regTemp categoriesContainingKey:key];
+					archive = [regTemp archivedObjectForKey:key];
+					name = [regTemp styleNameForKey:key];
+
+					// a style new to the registry can stay archived, unless its name has to be changed or its sharing checked
+
+					if (archive && name && ![self containsKey:key] && ![mBatchNames containsObject:name] && (options & kDKIgnoreUnsharedStyles) == 0) {
+						[self addArchivedObject:archive
+										   forKey:key
+									 toCategories:cats
+								 createCategories:YES];
+						[self noteArchivedStyleName:name
+											 forKey:key];
+						[mBatchNames addObject:name];
+						mBatchRegisteredStyles = YES;
+						mBatchNeedsUIUpdate = YES;
+						readOK = YES;
+					} else if ((style = [regTemp styleForKey:key])) {
+						styles = [NSSet setWithObject:style];
+
+						[[self class] mergeStyles:styles
+									 inCategories:cats
+										  options:options
+									mergeDelegate:aDel];
+
+						readOK = YES;
+					}
+				}
+			}
+			@finally {
+				[self endRegisteringStyles];
+				[regTemp release];
 			}
-
-			[regTemp release];
 		}
 	}
 
@@ -857,6 +1094,186 @@ static BOOL s_NoDKDefaults = NO;
 	return existingStyle;
 }
 
+- (NSData*)libraryData
+{
+	[self fixUpCategories];
+
+	NSArray* keys = [self allKeys];
+	NSMutableArray* names = [NSMutableArray arrayWithCapacity:[keys count]];
+	NSMutableData* extents = [NSMutableData dataWithCapacity:[keys count] * 2 * sizeof(uint32_t)];
+	NSMutableData* archives = [NSMutableData data];
+	NSEnumerator* iter = [keys objectEnumerator];
+	NSString* key;
+	NSString* name;
+	NSData* archive;
+	uint32_t extent[2];
+
+	while ((key = [iter nextObject])) {
+		archive = [self archivedObjectForKey:key];
+
+		if (archive == nil)
+			archive = archiveStyle([self styleForKey:key]);
+
+		name = [self styleNameForKey:key];
+
+		if (name == nil)
+			name = @"";
+
+		extent[0] = NSSwapHostIntToBig((uint32_t)[archives length]);
+		extent[1] = NSSwapHostIntToBig((uint32_t)[archive length]);
+
+		[names addObject:name];
+		[extents appendBytes:extent
+					  length:sizeof(extent)];
+		[archives appendData:archive];
+	}
+
+	NSMutableDictionary* categories = [NSMutableDictionary dictionary];
+
+	iter = [[self allCategories] objectEnumerator];
+
+	while ((name = [iter nextObject]))
+		[categories setObject:[self allKeysInCategory:name]
+					   forKey:name];
+
+	NSDictionary* index = [NSDictionary dictionaryWithObjectsAndKeys:keys, kDKStyleLibraryKeysKey, names, kDKStyleLibraryNamesKey, extents, kDKStyleLibraryExtentsKey,
+																	 categories, kDKStyleLibraryCategoriesKey, [self recentlyAddedItems], kDKStyleLibraryRecentlyAddedKey, nil];
+	NSData* indexData = [NSPropertyListSerialization dataWithPropertyList:index
+																   format:NSPropertyListBinaryFormat_v1_0
+																  options:0
+																	error:NULL];
+	if (indexData == nil)
+		return nil;
+
+	uint32_t header[2] = { NSSwapHostIntToBig(kDKStyleLibraryVersion), NSSwapHostIntToBig((uint32_t)[indexData length]) };
+	NSMutableData* data = [NSMutableData dataWithCapacity:kDKStyleLibraryHeaderLength + [indexData length] + [archives length]];
+
+	[data appendBytes:kDKStyleLibraryMagic
+			   length:4];
+	[data appendBytes:header
+			   length:sizeof(header)];
+	[data appendData:indexData];
+	[data appendData:archives];
+
+	return data;
+}
+
+- (BOOL)appendContentsWithLibraryData:(NSData*)data
+{
+	NSAssert(data != nil, @"cannot append from nil data");
+
+	const uint8_t* bytes = [data bytes];
+	NSUInteger length = [data length];
+	uint32_t header[2];
+
+	if (length < kDKStyleLibraryHeaderLength || memcmp(bytes, kDKStyleLibraryMagic, 4) != 0)
+		return NO;
+
+	memcpy(header, bytes + 4, sizeof(header));
+
+	NSUInteger indexLength = NSSwapBigIntToHost(header[1]);
+
+	if (NSSwapBigIntToHost(header[0]) > kDKStyleLibraryVersion || indexLength > length - kDKStyleLibraryHeaderLength)
+		return NO;
+
+	NSDictionary* index = [NSPropertyListSerialization propertyListWithData:[NSData dataWithBytesNoCopy:(void*)(bytes + kDKStyleLibraryHeaderLength)
+																								  length:indexLength
+																							freeWhenDone:NO]
+																	options:NSPropertyListImmutable
+																	 format:NULL
+																	  error:NULL];
+	if (![index isKindOfClass:[NSDictionary class]])
+		return NO;
+
+	NSArray* keys = [index objectForKey:kDKStyleLibraryKeysKey];
+	NSArray* names = [index objectForKey:kDKStyleLibraryNamesKey];
+	NSData* extents = [index objectForKey:kDKStyleLibraryExtentsKey];
+	NSDictionary* categories = [index objectForKey:kDKStyleLibraryCategoriesKey];
+
+	if (![keys isKindOfClass:[NSArray class]] || ![names isKindOfClass:[NSArray class]] || ![extents isKindOfClass:[NSData class]] || ![categories isKindOfClass:[NSDictionary class]])
+		return NO;
+
+	NSUInteger i, count = [keys count];
+	NSUInteger base = kDKStyleLibraryHeaderLength + indexLength;
+
+	if ([names count] != count || [extents length] != count * 2 * sizeof(uint32_t))
+		return NO;
+
+	// every archive must lie within the data before anything is added
+
+	NSUInteger offset, archiveLength;
+
+	for (i = 0; i < count; ++i) {
+		getExtent(extents, i, &offset, &archiveLength);
+
+		if (offset > length - base || archiveLength > length - base - offset)
+			return NO;
+	}
+
+	// the categories are inverted so that each style can be added to all of its own at once
+
+	NSMutableDictionary* keyCategories = [NSMutableDictionary dictionaryWithCapacity:count];
+	NSEnumerator* iter = [categories keyEnumerator];
+	NSEnumerator* keyIter;
+	NSString* catName;
+	NSString* key;
+	NSMutableArray* cats;
+
+	while ((catName = [iter nextObject])) {
+		keyIter = [[categories objectForKey:catName] objectEnumerator];
+
+		while ((key = [keyIter nextObject])) {
+			cats = [keyCategories objectForKey:key];
+
+			if (cats == nil) {
+				cats = [NSMutableArray array];
+				[keyCategories setObject:cats
+								  forKey:key];
+			}
+
+			[cats addObject:catName];
+		}
+	}
+
+	DKStyleLibraryArchive* archive;
+	NSArray* recent = [index objectForKey:kDKStyleLibraryRecentlyAddedKey];
+
+	[self setRecentlyAddedListEnabled:NO];
+
+	for (i = 0; i < count; ++i) {
+		key = [keys objectAtIndex:i];
+		cats = [keyCategories objectForKey:key];
+
+		// a style already registered may already be in use, so it isn't replaced by another copy
+
+		if ([self containsKey:key]) {
+			[self addKey:key
+					toCategories:cats
+				createCategories:YES];
+			continue;
+		}
+
+		getExtent(extents, i, &offset, &archiveLength);
+
+		archive = [[DKStyleLibraryArchive alloc] initWithLibrary:data
+														   range:NSMakeRange(base + offset, archiveLength)];
+		[self addArchivedObject:archive
+						   forKey:key
+					 toCategories:cats
+				 createCategories:YES];
+		[self noteArchivedStyleName:[names objectAtIndex:i]
+							 forKey:key];
+		[archive release];
+	}
+
+	[self setRecentlyAddedListEnabled:YES];
+
+	if ([recent isKindOfClass:[NSArray class]])
+		[self setRecentlyAddedItems:recent];
+
+	return YES;
+}
+
 /** @brief Set the registry empty
 
  Removes all styles from the registry, clears the "recently added" and "recently used" lists, and
@@ -868,6 +1285,7 @@ static BOOL s_NoDKDefaults = NO;
 
 	[self removeAllCategories];
 	[self addDefaultCategories];
+	[mArchivedNames removeAllObjects];
 }
 
 - (void)setNeedsUIUpdate
@@ -875,15 +1293,57 @@ static BOOL s_NoDKDefaults = NO;
 	// UI clients can listen for this notification and update any UI that relies on the registry. Note that this is not required if you are using managed menus
 	// sincethey are automaticaly kept up to date as the registry changes. This notification is only needed for other UIs that display the registry.
 
+	if ([self isRegisteringStyles]) {
+		mBatchNeedsUIUpdate = YES;
+		return;
+	}
+
 	[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleRegistryDidFlagPossibleUIChange
 														object:self];
 }
 
+- (void)beginRegisteringStyles
+{
+	if (mBatchLevel++ == 0) {
+		mBatchNames = [[NSMutableSet alloc] initWithArray:[self styleNames]];
+		mBatchRegisteredStyles = NO;
+		mBatchNeedsUIUpdate = NO;
+	}
+}
+
+- (void)endRegisteringStyles
+{
+	NSAssert(mBatchLevel > 0, @"unbalanced -endRegisteringStyles");
+
+	if (mBatchLevel == 0 || --mBatchLevel > 0)
+		return;
+
+	[mBatchNames release];
+	mBatchNames = nil;
+
+	if (mBatchRegisteredStyles)
+		[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleWasRegisteredNotification
+															object:self];
+
+	if (mBatchNeedsUIUpdate)
+		[self setNeedsUIUpdate];
+}
+
+- (BOOL)isRegisteringStyles
+{
+	return mBatchLevel > 0;
+}
+
 + (void)setStyleNotificationsEnabled:(BOOL)enable
 {
 	// typically the style registry will need to observe style changes but in many cases this isn't needed and adds an overhead that you might
 	// prefer to do without. Thus this must be explicitly enabled as needed. Default is OFF, which differs from b5 and earlier.
 
+	if (enable == s_styleNotificationsEnabled)
+		return;
+
+	s_styleNotificationsEnabled = enable;
+
 	if (enable) {
 		[[NSNotificationCenter defaultCenter] addObserver:[self sharedStyleRegistry]
 												 selector:@selector(styleDidChange:)
@@ -923,7 +1383,8 @@ static BOOL s_NoDKDefaults = NO;
  The returned menu is fully managed, that is, the Style Registry keeps it in synch with all changes
  to the registry and to the styles themselves. The menu can be assigned to UI controls such as a
  represented object is the style, and the item shows a swatch and the style's name. The menus
- are ordered alphabetically.
+ are ordered alphabetically. Each category's submenu is filled in when it's first opened, and the
+ swatches are rendered a few at a time while it is shown.
  This is intended as a very high-level method to support the most common usage. If you need to pass
  different options or wish to handle each item differently, DKCategoryManager has more flexible
  methods that expose more detail.
@@ -933,7 +1394,9 @@ static BOOL s_NoDKDefaults = NO;
  */
 - (NSMenu*)managedStylesMenuWithItemTarget:(id)target itemAction:(SEL)selector
 {
-	DKCategoryMenuOptions options = kDKIncludeRecentlyAddedItems | kDKIncludeRecentlyUsedItems | kDKMenuIsPopUpMenu;
+	// the submenus are filled in when they're opened, so a large registry doesn't slow down building the UI
+
+	DKCategoryMenuOptions options = kDKIncludeRecentlyAddedItems | kDKIncludeRecentlyUsedItems | kDKMenuIsPopUpMenu | kDKLazilyPopulateMenus;
 
 	return [self createMenuWithItemDelegate:self
 								 itemTarget:target
@@ -941,6 +1404,15 @@ static BOOL s_NoDKDefaults = NO;
 									options:options];
 }
 
+- (void)noteArchivedStyleName:(NSString*)name forKey:(NSString*)key
+{
+	if (mArchivedNames == nil)
+		mArchivedNames = [[NSMutableDictionary alloc] init];
+
+	[mArchivedNames setObject:name
+					   forKey:[key lowercaseString]];
+}
+
 #pragma mark -
 #pragma mark As a DKCategoryManager
 
@@ -995,36 +1467,44 @@ static BOOL s_NoDKDefaults = NO;
 	if (object == self) {
 		[item setTitle:NSLocalizedString(@"Style", @"")];
 	} else {
-		// fetch swatch at a large size and scale down to menu icon size - this gives a better impression of most styles
-		// than trying to render the icon at 1:1 size using the style
+		// set the menu item to the object's name. The swatch is supplied by -menuItemImageForObject:
 
 		if (object != nil && [object isKindOfClass:[DKStyle class]]) {
-			NSImage* swatch = [[object styleSwatchWithSize:NSMakeSize(112, 112)
-													  type:kDKStyleSwatchAutomatic] copy];
-
-			if (swatch != nil) {
-				[swatch setSize:NSMakeSize(28, 28)];
-				[swatch lockFocus];
-				[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationLow];
-				[swatch unlockFocus];
-				[item setImage:swatch];
-				[swatch release];
-			}
-
-			// set the menu item to the object's name
-
 			if ([object name] != nil)
 				[item setTitle:[object name]];
 		}
 	}
 }
 
+- (NSImage*)menuItemImageForObject:(id)object
+{
+	// fetch swatch at a large size and scale down to menu icon size - this gives a better impression of most styles
+	// than trying to render the icon at 1:1 size using the style
+
+	if (object == nil || ![object isKindOfClass:[DKStyle class]])
+		return nil;
+
+	NSImage* swatch = [[object styleSwatchWithSize:NSMakeSize(112, 112)
+											  type:kDKStyleSwatchAutomatic] copy];
+
+	if (swatch != nil) {
+		[swatch setSize:NSMakeSize(28, 28)];
+		[swatch lockFocus];
+		[[NSGraphicsContext currentContext] setImageInterpolation:NSImageInterpolationLow];
+		[swatch unlockFocus];
+	}
+
+	return [swatch autorelease];
+}
+
 #pragma mark -
 #pragma mark As a NSObject
 
 - (void)dealloc
 {
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
+	[mBatchNames release];
+	[mArchivedNames release];
 	[super dealloc];
 }
 
@@ -0,0 +1,70 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+#import "DKStyle.h"
+#import "DKCacheRegistry.h"
+
+/** @brief Caches the swatch images of styles for the whole application, within a memory budget.
+
+ Caches the swatch images of styles for the whole application, within a memory budget. Swatches are keyed by the style's content hash, the size,
+ the swatch type and the backing scale they were rendered at, so styles with the same content share their swatches, and changing a style simply
+ means that new swatches are made. When the total size of the swatches exceeds the byte budget, the least recently used swatches are discarded.
+
+ Swatches can be rendered on a background queue, from a copy of the style, so that user interfaces showing many styles needn't wait for them.
+ When such a swatch is ready it is added to the cache on the main thread and kDKStyleSwatchDidRenderNotification is posted, with the style
+ as the object. The cache is otherwise only used from the main thread.
+*/
+@interface DKStyleSwatchCache : NSObject <DKPurgeableCache> {
+@private
+	NSMutableDictionary* mSwatches; // swatch key -> swatch
+	NSMutableSet* mPendingKeys; // keys of swatches being rendered in the background
+	dispatch_queue_t mQueue;
+	NSUInteger mByteBudget;
+	NSUInteger mBytesUsed;
+	NSUInteger mUseCounter;
+}
+
+/** @brief The cache used by all styles
+ @return the shared cache
+ */
++ (DKStyleSwatchCache*)sharedSwatchCache;
+
+- (id)initWithByteBudget:(NSUInteger)budget;
+
+/** @brief Returns the cached swatch of a style, if there is one
+ @param style the style
+ @param size the size of the swatch
+ @param type the type of swatch, which should not be kDKStyleSwatchAutomatic
+ @param scale the backing scale the swatch is rendered at
+ @return the swatch, or nil
+ */
+- (NSImage*)swatchForStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale;
+- (void)setSwatch:(NSImage*)swatch forStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale;
+
+/** @brief Starts rendering a swatch of a style on the background queue, unless it is cached or already being rendered
+ @param style the style, which is copied so that it can be changed while the swatch is rendered
+ @param size the size of the swatch
+ @param type the type of swatch, which should not be kDKStyleSwatchAutomatic
+ @param scale the backing scale to render the swatch at
+ */
+- (void)renderSwatchForStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale;
+
+/** @brief The maximum total size of the swatches, in bytes
+
+ Setting a smaller budget discards swatches immediately until the cache fits.
+ */
+- (NSUInteger)byteBudget;
+- (void)setByteBudget:(NSUInteger)budget;
+- (NSUInteger)bytesUsed;
+- (NSUInteger)swatchCount;
+- (void)removeAllSwatches;
+
+@end
+
+#define kDKStyleSwatchCacheDefaultBudget (16 * 1024 * 1024)
+
+extern NSString* kDKStyleSwatchDidRenderNotification;
@@ -0,0 +1,362 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKStyleSwatchCache.h"
+#import "LogEvent.h"
+
+NSString* kDKStyleSwatchDidRenderNotification = @"kDKStyleSwatchDidRenderNotification";
+
+/// the key of a cached swatch
+
+@interface DKStyleSwatchKey : NSObject <NSCopying> {
+@public
+	NSUInteger mContentHash;
+	NSSize mSize;
+	DKStyleSwatchType mType;
+	CGFloat mScale;
+}
+
+@end
+
+@implementation DKStyleSwatchKey
+
+- (NSUInteger)hash
+{
+	return mContentHash ^ ((NSUInteger)mSize.width << 16) ^ ((NSUInteger)mSize.height << 4) ^ ((NSUInteger)(mType + 1) << 28) ^ (NSUInteger)mScale;
+}
+
+- (BOOL)isEqual:(id)object
+{
+	if (object == self)
+		return YES;
+
+	if (![object isKindOfClass:[DKStyleSwatchKey class]])
+		return NO;
+
+	DKStyleSwatchKey* key = (DKStyleSwatchKey*)object;
+
+	return key->mContentHash == mContentHash && NSEqualSizes(key->mSize, mSize) && key->mType == mType && key->mScale == mScale;
+}
+
+- (id)copyWithZone:(NSZone*)zone
+{
+#pragma unused(zone)
+
+	// keys are never changed once made
+
+	return [self retain];
+}
+
+@end
+
+/// a cached swatch
+
+@interface DKStyleSwatch : NSObject {
+@public
+	NSImage* mImage;
+	DKStyleSwatchKey* mKey;
+	NSUInteger mBytes;
+	NSUInteger mLastUse;
+}
+
+@end
+
+@implementation DKStyleSwatch
+
+- (void)dealloc
+{
+	[mImage release];
+	[mKey release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+// a swatch to be rendered on the background queue. The copy of the style is made, and released, on the main thread
+
+typedef struct {
+	DKStyleSwatchCache* cache;
+	DKStyle* style; // the style the swatch is for
+	DKStyle* styleCopy; // what is rendered
+	DKStyleSwatchKey* key;
+	CGImageRef image;
+} DKStyleSwatchRequest;
+
+@interface DKStyleSwatchCache (Private)
+
+- (DKStyleSwatchKey*)keyForStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale;
+- (void)setSwatch:(NSImage*)swatch forKey:(DKStyleSwatchKey*)key;
+- (void)installRequest:(DKStyleSwatchRequest*)request;
+- (void)evictToBudget:(NSUInteger)budget;
+
+@end
+
+static void installSwatch(void* context)
+{
+	DKStyleSwatchRequest* request = (DKStyleSwatchRequest*)context;
+
+	[request->cache installRequest:request];
+
+	CGImageRelease(request->image);
+	[request->styleCopy release];
+	[request->style release];
+	[request->key release];
+	[request->cache release];
+	free(request);
+}
+
+static void renderSwatchInBackground(void* context)
+{
+	DKStyleSwatchRequest* request = (DKStyleSwatchRequest*)context;
+	NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+	request->image = [request->styleCopy newSwatchImageWithSize:request->key->mSize
+														   type:request->key->mType
+														  scale:request->key->mScale];
+	[pool drain];
+
+	dispatch_async_f(dispatch_get_main_queue(), request, installSwatch);
+}
+
+static NSInteger compareLastUse(id a, id b, void* context)
+{
+#pragma unused(context)
+	NSUInteger ua = ((DKStyleSwatch*)a)->mLastUse;
+	NSUInteger ub = ((DKStyleSwatch*)b)->mLastUse;
+
+	if (ua < ub)
+		return NSOrderedAscending;
+	else if (ua > ub)
+		return NSOrderedDescending;
+	else
+		return NSOrderedSame;
+}
+
+#pragma mark -
+
+@implementation DKStyleSwatchCache
+
+static DKStyleSwatchCache* sSharedSwatchCache = nil;
+
++ (DKStyleSwatchCache*)sharedSwatchCache
+{
+	if (sSharedSwatchCache == nil)
+		sSharedSwatchCache = [[self alloc] init];
+
+	return sSharedSwatchCache;
+}
+
+- (id)initWithByteBudget:(NSUInteger)budget
+{
+	self = [super init];
+	if (self) {
+		mSwatches = [[NSMutableDictionary alloc] init];
+		mPendingKeys = [[NSMutableSet alloc] init];
+		mQueue = dispatch_queue_create("com.drawkit.swatches", NULL);
+		mByteBudget = budget;
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeRenderedImages];
+	}
+
+	return self;
+}
+
+- (NSImage*)swatchForStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale
+{
+	DKStyleSwatch* swatch = [mSwatches objectForKey:[self keyForStyle:style
+																 size:size
+																 type:type
+																scale:scale]];
+
+	if (swatch == nil)
+		return nil;
+
+	swatch->mLastUse = ++mUseCounter;
+
+	return swatch->mImage;
+}
+
+- (void)setSwatch:(NSImage*)swatch forStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale
+{
+	[self setSwatch:swatch
+			 forKey:[self keyForStyle:style
+								 size:size
+								 type:type
+								scale:scale]];
+}
+
+- (void)renderSwatchForStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale
+{
+	DKStyleSwatchKey* key = [self keyForStyle:style
+										 size:size
+										 type:type
+										scale:scale];
+
+	if (style == nil || [mSwatches objectForKey:key] != nil || [mPendingKeys containsObject:key])
+		return;
+
+	[mPendingKeys addObject:key];
+
+	// -copy would return a sharable style itself, which could then be changed while the swatch is rendered
+
+	DKStyleSwatchRequest* request = calloc(1, sizeof(DKStyleSwatchRequest));
+
+	request->cache = [self retain];
+	request->style = [style retain];
+	request->styleCopy = [style mutableCopy];
+	request->key = [key retain];
+
+	dispatch_async_f(mQueue, request, renderSwatchInBackground);
+}
+
+- (NSUInteger)byteBudget
+{
+	return mByteBudget;
+}
+
+- (void)setByteBudget:(NSUInteger)budget
+{
+	mByteBudget = budget;
+
+	if (mBytesUsed > mByteBudget)
+		[self evictToBudget:mByteBudget];
+}
+
+- (NSUInteger)bytesUsed
+{
+	return mBytesUsed;
+}
+
+- (NSUInteger)swatchCount
+{
+	return [mSwatches count];
+}
+
+- (void)removeAllSwatches
+{
+	[mSwatches removeAllObjects];
+	mBytesUsed = 0;
+}
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	NSUInteger bytes = mBytesUsed;
+
+	[self removeAllSwatches];
+	return bytes;
+}
+
+#pragma mark -
+
+- (DKStyleSwatchKey*)keyForStyle:(DKStyle*)style size:(NSSize)size type:(DKStyleSwatchType)type scale:(CGFloat)scale
+{
+	DKStyleSwatchKey* key = [[DKStyleSwatchKey alloc] init];
+
+	key->mContentHash = [style contentHash];
+	key->mSize = size;
+	key->mType = type;
+	key->mScale = scale;
+
+	return [key autorelease];
+}
+
+- (void)setSwatch:(NSImage*)swatch forKey:(DKStyleSwatchKey*)key
+{
+	DKStyleSwatch* old = [mSwatches objectForKey:key];
+
+	if (old) {
+		mBytesUsed -= old->mBytes;
+		[mSwatches removeObjectForKey:key];
+	}
+
+	if (swatch == nil)
+		return;
+
+	NSUInteger bytes = (NSUInteger)(ceil(key->mSize.width * key->mScale) * ceil(key->mSize.height * key->mScale) * 4);
+
+	// a swatch bigger than the whole budget is returned to the caller but not kept
+
+	if (bytes > mByteBudget)
+		return;
+
+	if (mBytesUsed + bytes > mByteBudget)
+		[self evictToBudget:mByteBudget - bytes];
+
+	DKStyleSwatch* entry = [[DKStyleSwatch alloc] init];
+
+	entry->mImage = [swatch retain];
+	entry->mKey = [key retain];
+	entry->mBytes = bytes;
+	entry->mLastUse = ++mUseCounter;
+
+	[mSwatches setObject:entry
+				  forKey:key];
+	[entry release];
+
+	mBytesUsed += bytes;
+}
+
+- (void)installRequest:(DKStyleSwatchRequest*)request
+{
+	[mPendingKeys removeObject:request->key];
+
+	if (request->image == NULL)
+		return;
+
+	NSImage* image = [[NSImage alloc] initWithCGImage:request->image
+												 size:request->key->mSize];
+
+	[self setSwatch:image
+			 forKey:request->key];
+	[image release];
+
+	[[NSNotificationCenter defaultCenter] postNotificationName:kDKStyleSwatchDidRenderNotification
+														object:request->style];
+}
+
+- (void)evictToBudget:(NSUInteger)budget
+{
+	// as for DKRenderedImageCache, sorting when evicting is cheaper than keeping the swatches in order on every use
+
+	NSMutableArray* entries = [[[mSwatches allValues] mutableCopy] autorelease];
+
+	[entries sortUsingFunction:compareLastUse
+					   context:NULL];
+
+	NSEnumerator* iter = [entries objectEnumerator];
+	DKStyleSwatch* entry;
+
+	while (mBytesUsed > budget && (entry = [iter nextObject])) {
+		mBytesUsed -= entry->mBytes;
+		[mSwatches removeObjectForKey:entry->mKey];
+	}
+
+	LogEvent_(kInfoEvent, @"style swatch cache evicted down to %lu bytes", (unsigned long)mBytesUsed);
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (id)init
+{
+	return [self initWithByteBudget:kDKStyleSwatchCacheDefaultBudget];
+}
+
+- (void)dealloc
+{
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
+	[mSwatches release];
+	[mPendingKeys release];
+
+	if (mQueue)
+		dispatch_release(mQueue);
+
+	[super dealloc];
+}
+
+@end
@@ -7,7 +7,7 @@
 #import "DKGradient.h"
 
 typedef union {
-	unsigned long pixel;
+	uint32_t pixel;
 	struct
 		{
 		unsigned char a;
@@ -17,9 +17,16 @@ typedef union {
 	} c;
 } pix_int;
 
+/** @brief A gradient that sweeps its colours around a centre point.
+
+ A gradient that sweeps its colours around a centre point. Core Graphics has no angular shading, so the gradient is rendered into a bitmap
+ which is then drawn clipped to the path being filled. Bitmaps are rasterized row by row using vectorized maths from Accelerate, with the
+ rows spread across all available cores, and are cached by pixel size, centre and segment count so that repeated fills - such as a shared
+ style drawing many objects - don't rebuild them. The angle is applied when the image is drawn, so rotating doesn't invalidate the cache.
+*/
 @interface DKSweptAngleGradient : DKGradient {
-	CGImageRef m_sa_image;
-	CGContextRef m_sa_bitmap;
+	NSMutableDictionary* mImageCache; // key string -> CGImageRef
+	NSMutableArray* mImageCacheOrder; // keys, least recently used first
 	pix_int* m_sa_colours;
 	NSInteger m_sa_segments;
 	NSPoint m_sa_centre;
@@ -35,7 +42,19 @@ typedef union {
 - (NSInteger)numberOfAngularSegments;
 
 - (void)preloadColours;
-- (void)createGradientImageWithRect:(NSRect)rect;
+
+/** @brief Returns the gradient image for filling <rect> with the gradient centred at the current centre point
+
+ The image is taken from the cache if possible, otherwise it's rasterized and added to the cache.
+ @param rect the bounds of the path being filled
+ @return the image, owned by the cache
+ */
+- (CGImageRef)gradientImageWithRect:(NSRect)rect;
+
+/** @brief Discards all cached gradient images
+ */
 - (void)invalidateCache;
 
 @end
+
+#define kDKSweptAngleImageCacheLimit 8
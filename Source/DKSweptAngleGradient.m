@@ -7,13 +7,122 @@
 #import "DKSweptAngleGradient.h"
 
 #import "DKGeometryUtilities.h"
-#import "DKRandom.h"
 #import "LogEvent.h"
+#import <Accelerate/Accelerate.h>
 
 @interface DKGradient (Private)
 - (void)private_colorAtValue:(CGFloat)val components:(CGFloat*)components randomAccess:(BOOL)ra;
+- (void)invalidateColorTable;
 @end
 
+#define kDKSweptAngleRowsPerBand 16
+
+/// parameters shared by all the bands of a swept angle image as they are rasterized concurrently
+
+typedef struct {
+	uint32_t* pixels;
+	size_t width;
+	size_t height;
+	float centreY;
+	const float* dx; // x - centre.x for every column - the same for all rows
+	const pix_int* colours;
+	NSUInteger nColours;
+	BOOL dither;
+} DKSweptAngleRaster;
+
+static void rasterizeSweptAngleBand(void* context, size_t band)
+{
+	// each band computes the angle of every pixel in a row in one vectorized call, then maps the angles to colour indexes
+
+	DKSweptAngleRaster* r = (DKSweptAngleRaster*)context;
+	size_t y, x, firstRow = band * kDKSweptAngleRowsPerBand;
+	size_t lastRow = MIN(firstRow + kDKSweptAngleRowsPerBand, r->height);
+	int n = (int)r->width;
+	float* dy = malloc(r->width * sizeof(float));
+	float* angles = malloc(r->width * sizeof(float));
+	uint32_t* indexes = malloc(r->width * sizeof(uint32_t));
+
+	// maps atan2's -pi..pi onto 0..nColours
+
+	float scale = (float)r->nColours / (2.0f * (float)pi);
+	float offset = (float)pi * scale;
+
+	if (dy && angles && indexes) {
+		for (y = firstRow; y < lastRow; ++y) {
+			float rowDY = (float)y - r->centreY;
+			uint32_t* p = r->pixels + y * r->width;
+
+			vDSP_vfill(&rowDY, dy, 1, r->width);
+			vvatan2f(angles, dy, r->dx, &n);
+			vDSP_vsmsa(angles, 1, &scale, &offset, angles, 1, r->width);
+			vDSP_vfixu32(angles, 1, indexes, 1, r->width);
+
+			// a simple per-row generator supplies the dither, so each row dithers the same way whichever thread draws it
+
+			uint32_t seed = (uint32_t)(y * 2654435761U) | 1;
+
+			for (x = 0; x < r->width; ++x) {
+				NSInteger colour = MIN(indexes[x], r->nColours - 1);
+
+				if (r->dither) {
+					seed = seed * 1664525U + 1013904223U;
+					colour = (colour + (NSInteger)(seed >> 30) - 2 + (NSInteger)r->nColours) % (NSInteger)r->nColours;
+				}
+
+				p[x] = r->colours[colour].pixel;
+			}
+		}
+	}
+
+	free(dy);
+	free(angles);
+	free(indexes);
+}
+
+static CGImageRef createSweptAngleImage(size_t width, size_t height, NSPoint cp, const pix_int* colours, NSUInteger nColours, BOOL dither)
+{
+	// directly create a bitmap context of the desired size then convert it to an image - this is much easier than messing about with data
+	// providers, etc
+
+	CGImageRef image = NULL;
+	uint32_t* buffer = malloc(width * height * sizeof(uint32_t));
+	float* dx = malloc(width * sizeof(float));
+
+	if (buffer && dx && colours) {
+		DKSweptAngleRaster raster;
+		size_t x;
+
+		for (x = 0; x < width; ++x)
+			dx[x] = (float)x - (float)cp.x;
+
+		raster.pixels = buffer;
+		raster.width = width;
+		raster.height = height;
+		raster.centreY = (float)cp.y;
+		raster.dx = dx;
+		raster.colours = colours;
+		raster.nColours = nColours;
+		raster.dither = dither;
+
+		dispatch_apply_f((height + kDKSweptAngleRowsPerBand - 1) / kDKSweptAngleRowsPerBand, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &raster, rasterizeSweptAngleBand);
+
+		CGColorSpaceRef cSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
+		CGContextRef bitmap = CGBitmapContextCreate(buffer, width, height, 8, 4 * width, cSpace, kCGImageAlphaPremultipliedFirst);
+
+		if (bitmap) {
+			image = CGBitmapContextCreateImage(bitmap);
+			CGContextRelease(bitmap);
+		}
+
+		CGColorSpaceRelease(cSpace);
+	}
+
+	free(dx);
+	free(buffer);
+
+	return image;
+}
+
 #pragma mark -
 @implementation DKSweptAngleGradient
 #pragma mark As a DKSweptAngleGradient
@@ -82,89 +191,74 @@
 	}
 }
 
-- (void)createGradientImageWithRect:(NSRect)rect
+- (CGImageRef)gradientImageWithRect:(NSRect)rect
 {
-	CGColorSpaceRef cSpace = CGColorSpaceCreateWithName(kCGColorSpaceGenericRGB);
-	NSUInteger width, height;
-
-	// directly create a bitmap context of the desired size then convert it to an image - this is much easier than messing about with data
-	// providers, etc
-
-	width = MAX(1, (NSInteger)(rect.size.width * 1.5f));
-	height = MAX(1, (NSInteger)(rect.size.height * 1.5f));
-
-	NSUInteger bufferSize = 4 * width * (height + 1);
-	unsigned char* buffer;
-
-	buffer = (unsigned char*)malloc(bufferSize);
-
-	if (buffer) {
-		m_sa_bitmap = CGBitmapContextCreate(buffer, width, height, 8, 4 * width, cSpace, kCGImageAlphaPremultipliedFirst);
-
-		LogEvent_(kInfoEvent, @"bitmap = %@", m_sa_bitmap);
-
-		// scan through the buffer and set all the pixels
-
-		NSPoint cp = m_sa_centre;
-
-		cp.x -= rect.origin.x;
-		cp.y -= rect.origin.y;
-
-		pix_int* colours = m_sa_colours;
-		NSUInteger nColours = m_sa_segments;
-		CGFloat angle, twopi;
-		NSUInteger x, y, colour;
-
-		// offset cp to account for 50% extra size of the image
-
-		cp.x *= 1.5;
-		cp.y *= 1.5;
-		twopi = 2 * pi;
-
-		unsigned long* p = (unsigned long*)buffer;
-
-		for (y = 0; y < height; ++y) {
-			for (x = 0; x < width; ++x) {
-				// need to know angle of x,y relative to centre point which gives us an index into the colour table
+	// the image is 50% larger than the rect so that it still covers the path when rotated
+
+	size_t width = MAX(1, (NSInteger)(rect.size.width * 1.5f));
+	size_t height = MAX(1, (NSInteger)(rect.size.height * 1.5f));
+	NSPoint cp = NSMakePoint((m_sa_centre.x - rect.origin.x) * 1.5, (m_sa_centre.y - rect.origin.y) * 1.5);
+	NSString* key = [NSString stringWithFormat:@"%lu:%lu:%ld:%ld:%ld:%d", (unsigned long)width, (unsigned long)height, (long)lround(cp.x), (long)lround(cp.y), (long)m_sa_segments, m_ditherColours];
+	CGImageRef image = (CGImageRef)[mImageCache objectForKey:key];
+
+	if (image) {
+		[mImageCacheOrder removeObject:key];
+		[mImageCacheOrder addObject:key];
+		return image;
+	}
 
-				angle = atan2f((CGFloat)y - cp.y, (CGFloat)x - cp.x) + pi;
-				colour = (NSUInteger)((angle * (CGFloat)nColours) / twopi);
+	if (m_sa_colours == NULL)
+		[self preloadColours];
 
-				// add a bit of random dither to the colour
+	image = createSweptAngleImage(width, height, cp, m_sa_colours, m_sa_segments, m_ditherColours);
 
-				if (m_ditherColours)
-					colour = (NSInteger)(colour + [DKRandom randomPositiveOrNegativeNumber] * 2.0) % nColours;
+	if (image) {
+		// the caches are made here rather than in -init, as a gradient read from an archive is initialized by -[DKGradient initWithCoder:]
 
-				// write the colour to the image in one fell swoop
+		if (mImageCache == nil) {
+			mImageCache = [[NSMutableDictionary alloc] init];
+			mImageCacheOrder = [[NSMutableArray alloc] init];
+		}
 
-				*p++ = colours[colour].pixel;
-			}
+		if ([mImageCacheOrder count] >= kDKSweptAngleImageCacheLimit) {
+			[mImageCache removeObjectForKey:[mImageCacheOrder objectAtIndex:0]];
+			[mImageCacheOrder removeObjectAtIndex:0];
 		}
 
-		// convert to an image.
+		[mImageCache setObject:(id)image
+						forKey:key];
+		[mImageCacheOrder addObject:key];
 
-		m_sa_image = CGBitmapContextCreateImage(m_sa_bitmap);
+		// the cache now owns the image
+
+		CGImageRelease(image);
 	}
 
-	CGColorSpaceRelease(cSpace);
+	return image;
 }
 
 - (void)invalidateCache
 {
-	unsigned char* buffer;
-
-	if (m_sa_image) {
-		CGImageRelease(m_sa_image);
-		m_sa_image = NULL;
-		buffer = CGBitmapContextGetData(m_sa_bitmap);
-		free(buffer);
-		CGContextRelease(m_sa_bitmap);
-		m_sa_bitmap = NULL;
+	[mImageCache removeAllObjects];
+	[mImageCacheOrder removeAllObjects];
+
+	if (m_sa_colours) {
+		free(m_sa_colours);
+		m_sa_colours = NULL;
 	}
 }
 
 #pragma mark -
 #pragma mark As a DKGradient
+
+- (void)invalidateColorTable
+{
+	// any change to the colour ramp also invalidates the images
+
+	[super invalidateColorTable];
+	[self invalidateCache];
+}
+
 - (void)fillPath:(NSBezierPath*)path startingAtPoint:(NSPoint)p startRadius:(CGFloat)sr endingAtPoint:(NSPoint)ep endRadius:(CGFloat)er
 {
 #pragma unused(sr)
@@ -174,33 +268,28 @@
 	NSInteger segments = [self numberOfAngularSegments];
 	NSRect rect = [path bounds];
 	CGFloat sa = [self angle];
-	BOOL inval = NO;
 
 	if (segments == 0)
 		segments = 512;
 
+	segments = MAX(segments, 2);
+
 	if (segments != m_sa_segments) {
-		m_sa_segments = MAX(segments, 2);
-		inval = YES;
+		m_sa_segments = segments;
+		[self invalidateCache];
 	}
 
-	if (m_sa_image != NULL && (rect.size.width > CGImageGetWidth(m_sa_image) || rect.size.height > CGImageGetHeight(m_sa_image)))
-		inval = YES;
+	m_sa_centre = p;
 
-	if (m_sa_image == NULL)
-		inval = YES;
+	CGImageRef image = [self gradientImageWithRect:rect];
 
-	if (inval) {
-		m_sa_centre = p;
-		[self invalidateCache];
-		[self preloadColours];
-		[self createGradientImageWithRect:rect];
-	}
+	if (image == NULL)
+		return;
 
 	// centre the image rect on <rect>, rotated to <sa>
 
 	NSPoint rcp = NSMakePoint(NSMidX(rect), NSMidY(rect));
-	NSRect imgRect = NSMakeRect(0, 0, CGImageGetWidth(m_sa_image), CGImageGetHeight(m_sa_image));
+	NSRect imgRect = NSMakeRect(0, 0, CGImageGetWidth(image), CGImageGetHeight(image));
 
 	rect.origin.x = -rect.size.width / 2;
 	rect.origin.y = -rect.size.height / 2;
@@ -215,7 +304,7 @@
 	CGContextTranslateCTM(context, rcp.x, rcp.y);
 	CGContextRotateCTM(context, sa);
 
-	CGContextDrawImage(context, *(CGRect*)&ir, m_sa_image);
+	CGContextDrawImage(context, *(CGRect*)&ir, image);
 	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
 }
 
@@ -225,8 +314,6 @@
 {
 	self = [super init];
 	if (self != nil) {
-		NSAssert(m_sa_image == nil, @"Expected init to zero");
-		NSAssert(m_sa_bitmap == nil, @"Expected init to zero");
 		NSAssert(m_sa_colours == nil, @"Expected init to zero");
 		NSAssert(m_sa_segments == 0, @"Expected init to zero");
 		NSAssert(NSEqualPoints(m_sa_centre, NSZeroPoint), @"Expected init to zero");
@@ -242,6 +329,8 @@
 - (void)dealloc
 {
 	[self invalidateCache];
+	[mImageCache release];
+	[mImageCacheOrder release];
 	[super dealloc];
 }
 
@@ -0,0 +1,49 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKStyle, DKDrawableObject;
+
+/** @brief The master of a set of symbol instances, holding the path and style they all share.
+
+ The master of a set of symbol instances, holding the path and style they all share. The path is canonical, as the path of a shape is:
+ it is bounded by the unit rect centred at the origin. The style is always sharable, so that copying an instance never copies it; if a
+ symbol is made with a style that isn't sharable, it is given a sharable copy of it instead. Changing the symbol's style therefore changes
+ every instance that still uses it.
+
+ A symbol is not itself drawn - see DKSymbolInstance.
+*/
+@interface DKSymbol : NSObject <NSCoding> {
+@private
+	NSBezierPath* mPath; // canonical path shared by the instances
+	DKStyle* mStyle; // sharable style shared by the instances
+	NSRect mPathBounds; // cached bounds of the path
+}
+
+/** @brief Makes a symbol with the path and style of an object
+
+ Shapes and paths can be made into symbols: a shape's canonical path is used as it is, a path is scaled to fit the unit rect.
+ Shapes with a distortion transform, paths with no width or height, and objects of any other class give nil.
+ @param obj a DKDrawableShape or DKDrawablePath
+ @return a new autoreleased symbol, or nil
+ */
++ (DKSymbol*)symbolWithObject:(DKDrawableObject*)obj;
+
+/** @brief Initializes a symbol
+ @param path a canonical path, bounded by the unit rect centred at the origin
+ @param style the style of the instances
+ @return the symbol
+ */
+- (id)initWithCanonicalPath:(NSBezierPath*)path style:(DKStyle*)style;
+
+- (NSBezierPath*)path;
+- (NSRect)pathBounds;
+
+- (DKStyle*)style;
+- (void)setStyle:(DKStyle*)style;
+
+@end
@@ -0,0 +1,123 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKSymbol.h"
+#import "DKDrawableShape.h"
+#import "DKDrawablePath.h"
+#import "DKStyle.h"
+#import "NSBezierPath+Packing.h"
+
+@implementation DKSymbol
+#pragma mark As a DKSymbol
+
++ (DKSymbol*)symbolWithObject:(DKDrawableObject*)obj
+{
+	NSBezierPath* path = nil;
+
+	if ([obj isKindOfClass:[DKDrawableShape class]]) {
+		// a distorted shape's path is no longer canonical
+
+		if ([(DKDrawableShape*)obj distortionTransform] != nil)
+			return nil;
+
+		path = [(DKDrawableShape*)obj path];
+	} else if ([obj isKindOfClass:[DKDrawablePath class]]) {
+		NSBezierPath* opath = [(DKDrawablePath*)obj path];
+		NSRect br = [opath bounds];
+
+		if ([opath isEmpty] || br.size.width <= 0.0 || br.size.height <= 0.0)
+			return nil;
+
+		NSAffineTransform* xfm = [NSAffineTransform transform];
+
+		[xfm scaleXBy:1.0 / br.size.width
+				  yBy:1.0 / br.size.height];
+		[xfm translateXBy:-NSMidX(br)
+					  yBy:-NSMidY(br)];
+
+		path = [xfm transformBezierPath:opath];
+	} else
+		return nil;
+
+	return [[[self alloc] initWithCanonicalPath:path
+										  style:[obj style]] autorelease];
+}
+
+- (id)initWithCanonicalPath:(NSBezierPath*)path style:(DKStyle*)style
+{
+	NSAssert(path != nil, @"can't make a symbol with a nil path");
+
+	self = [super init];
+	if (self != nil) {
+		mPath = [path retain];
+		mPathBounds = [path bounds];
+		[self setStyle:style];
+	}
+
+	return self;
+}
+
+- (NSBezierPath*)path
+{
+	return mPath;
+}
+
+- (NSRect)pathBounds
+{
+	return mPathBounds;
+}
+
+- (DKStyle*)style
+{
+	return mStyle;
+}
+
+- (void)setStyle:(DKStyle*)style
+{
+	// the style must be sharable, or copying an instance would copy it
+
+	if (style != nil && ![style isStyleSharable]) {
+		style = [[style mutableCopy] autorelease];
+		[style setStyleSharable:YES];
+	}
+
+	[style retain];
+	[mStyle release];
+	mStyle = style;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mPath release];
+	[mStyle release];
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark As part of NSCoding Protocol
+
+- (void)encodeWithCoder:(NSCoder*)coder
+{
+	NSAssert(coder != nil, @"Expected valid coder");
+
+	[coder encodePath:mPath
+			   forKey:@"DKSymbol_path"];
+	[coder encodeObject:mStyle
+				 forKey:@"DKSymbol_style"];
+}
+
+- (id)initWithCoder:(NSCoder*)coder
+{
+	NSAssert(coder != nil, @"Expected valid coder");
+
+	return [self initWithCanonicalPath:[coder decodePathForKey:@"DKSymbol_path"]
+								 style:[coder decodeObjectForKey:@"DKSymbol_style"]];
+}
+
+@end
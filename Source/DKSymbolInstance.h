@@ -0,0 +1,45 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKDrawableShape.h"
+
+@class DKSymbol;
+
+/** @brief A shape that draws a symbol, sharing the symbol's path and style with every other instance of it.
+
+ A shape that draws a symbol, sharing the symbol's path and style with every other instance of it. An instance holds only its own
+ location, size, angle and metadata; copies share the symbol rather than duplicating its path and style, and when instances are
+ archived together the symbol, its path and its style are written only once.
+
+ Because the path is canonical, an instance can test points and, when it isn't rotated, compute its logical bounds without transforming
+ the path. Instances behave as shapes in every other respect, so one made from a DKDrawablePath is resized and rotated as a shape rather
+ than edited point by point. Giving an instance another path or style detaches it from that part of the symbol.
+*/
+@interface DKSymbolInstance : DKDrawableShape <NSCoding, NSCopying> {
+@private
+	DKSymbol* mSymbol;
+}
+
+/** @brief Makes an instance which draws an object as a symbol
+
+ The instance has the location, size and angle of the object, and a copy of its metadata. If the object is itself an instance, the
+ result shares its symbol; otherwise a new symbol is made from it.
+ @param obj a DKDrawableShape, a DKDrawablePath or a DKSymbolInstance
+ @return a new autoreleased instance, or nil if the object can't be made into a symbol
+ */
++ (DKSymbolInstance*)instanceWithObject:(DKDrawableObject*)obj;
+
+/** @brief Initializes an instance of a symbol
+
+ The instance has a size of 1 x 1 at the origin, and must be sized, moved and rotated as required.
+ @param symbol the symbol
+ @return the instance
+ */
+- (id)initWithSymbol:(DKSymbol*)symbol;
+
+- (DKSymbol*)symbol;
+
+@end
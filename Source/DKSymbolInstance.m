@@ -0,0 +1,182 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKSymbolInstance.h"
+#import "DKSymbol.h"
+#import "DKDrawablePath.h"
+#import "DKStyle.h"
+#import "NSDictionary+DeepCopy.h"
+#import "NSAffineTransform+DKAdditions.h"
+
+@implementation DKSymbolInstance
+#pragma mark As a DKSymbolInstance
+
++ (DKSymbolInstance*)instanceWithObject:(DKDrawableObject*)obj
+{
+	if ([obj isKindOfClass:[DKSymbolInstance class]])
+		return [[obj copy] autorelease];
+
+	DKSymbol* symbol = [DKSymbol symbolWithObject:obj];
+
+	if (symbol == nil)
+		return nil;
+
+	DKSymbolInstance* inst = [[self alloc] initWithSymbol:symbol];
+
+	if ([obj isKindOfClass:[DKDrawableShape class]]) {
+		DKDrawableShape* shape = (DKDrawableShape*)obj;
+
+		// as when copying a shape, the offset must be set before the location
+
+		[inst setAngle:[shape angle]];
+		[inst setSize:[shape size]];
+		[inst setOffset:[shape offset]];
+		[inst setLocation:[shape location]];
+	} else {
+		// the symbol of a path is its path scaled to the unit rect, so the instance just fills the path's bounds
+
+		NSRect br = [[(DKDrawablePath*)obj path] bounds];
+
+		[inst setSize:br.size];
+		[inst setLocation:NSMakePoint(NSMidX(br), NSMidY(br))];
+	}
+
+	[inst setGhosted:[obj isGhosted]];
+
+	if ([obj userInfo] != nil) {
+		NSDictionary* ucopy = [[obj userInfo] deepCopy];
+		[inst setUserInfo:ucopy];
+		[ucopy release];
+	}
+
+	return [inst autorelease];
+}
+
+- (id)initWithSymbol:(DKSymbol*)symbol
+{
+	NSAssert(symbol != nil, @"can't make an instance of a nil symbol");
+
+	self = [self initWithStyle:[symbol style]];
+	if (self != nil) {
+		mSymbol = [symbol retain];
+		[self setPath:[symbol path]];
+	}
+
+	return self;
+}
+
+- (DKSymbol*)symbol
+{
+	return mSymbol;
+}
+
+#pragma mark -
+#pragma mark As a DKDrawableShape
+
+/** @brief Tests a point against the symbol's path
+
+ The point is taken into the symbol's space rather than the path being transformed into the drawing's space.
+ @param pt the point to test
+ @return YES if the path contains the point
+ */
+- (BOOL)pathContainsPoint:(NSPoint)pt
+{
+	if ([self distortionTransform] != nil || [self size].width == 0.0 || [self size].height == 0.0)
+		return [super pathContainsPoint:pt];
+
+	CGAffineTransform t;
+
+	[self getTransformIncludingParent:&t];
+	pt = NSPointFromCGPoint(CGPointApplyAffineTransform(NSPointToCGPoint(pt), CGAffineTransformInvert(t)));
+
+	NSBezierPath* path = [self path];
+
+	if (path == [mSymbol path])
+		return NSPointInRect(pt, [mSymbol pathBounds]) && [path containsPoint:pt];
+	else
+		return [path containsPoint:pt];
+}
+
+/** @brief Returns the bounds of the instance, ignoring stylistic effects
+
+ While the instance isn't rotated, this is the symbol's path bounds transformed, which is exact for a canonical path
+ and spares transforming the path itself.
+ @return a rect, the pure path bounds
+ */
+- (NSRect)logicalBounds
+{
+	if ([self distortionTransform] != nil || [self path] != [mSymbol path])
+		return [super logicalBounds];
+
+	CGAffineTransform t;
+
+	[self getTransformIncludingParent:&t];
+
+	if (t.b != 0.0 || t.c != 0.0)
+		return [super logicalBounds];
+
+	NSRect pb = [mSymbol pathBounds];
+	NSPoint a, b;
+
+	a.x = pb.origin.x * t.a + t.tx;
+	a.y = pb.origin.y * t.d + t.ty;
+	b.x = NSMaxX(pb) * t.a + t.tx;
+	b.y = NSMaxY(pb) * t.d + t.ty;
+
+	return NSMakeRect(MIN(a.x, b.x), MIN(a.y, b.y), ABS(b.x - a.x), ABS(b.y - a.y));
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[mSymbol release];
+	[super dealloc];
+}
+
+#pragma mark -
+#pragma mark As part of NSCoding Protocol
+
+- (void)encodeWithCoder:(NSCoder*)coder
+{
+	NSAssert(coder != nil, @"Expected valid coder");
+	[super encodeWithCoder:coder];
+
+	// the path and style were written by super, and a keyed archiver writes an object only once however many refer to it,
+	// so instances of one symbol archived together share them again when they are read
+
+	[coder encodeObject:mSymbol
+				 forKey:@"DKSymbolInstance_symbol"];
+}
+
+- (id)initWithCoder:(NSCoder*)coder
+{
+	NSAssert(coder != nil, @"Expected valid coder");
+
+	self = [super initWithCoder:coder];
+	if (self != nil) {
+		mSymbol = [[coder decodeObjectForKey:@"DKSymbolInstance_symbol"] retain];
+	}
+
+	return self;
+}
+
+#pragma mark -
+#pragma mark As part of NSCopying Protocol
+
+- (id)copyWithZone:(NSZone*)zone
+{
+	// the style is sharable and super shares the path, so the copy refers to the same symbol data
+
+	DKSymbolInstance* copy = [super copyWithZone:zone];
+
+	copy->mSymbol = [mSymbol retain];
+
+	return copy;
+}
+
+@end
@@ -6,8 +6,9 @@
 
 #import "DKRasterizer.h"
 #import "DKCommonTypes.h"
+#import "DKCacheRegistry.h"
 
-@class DKStyle, DKTextSubstitutor;
+@class DKStyle, DKTextSubstitutor, DKAttributeRunSummary;
 
 /** @brief This renderer allows text to be an attribute of any object.
 
@@ -22,10 +23,17 @@ state of internal data, and in addition the same cache is passed to text-on-path
 similar lengthy recalculations. The caching is transparent to client objects but may need to be taken into account if subclassing or
 using alternative helper objects, etc.
 
+Text laid out in an object's bounds or flowed into its path is also kept for each object, with a layout manager of its own. The layout is
+reused until the text, the object's size or angle, or the flowed path changes, so moving or reordering objects redraws their text without laying
+it out again.
+
+Very long text is laid out again in the background when it changes, and the last layout is drawn until the new one is ready, so resizing a
+shape holding a whole document doesn't hold up drawing.
+
 The text content is stored and suplied by DKTextSubstitutor which is able to build strings by reading an object's metadata and combining it with
 other fixed content. See that class for details.
 */
-@interface DKTextAdornment : DKRasterizer <NSCoding, NSCopying> {
+@interface DKTextAdornment : DKRasterizer <NSCoding, NSCopying, DKPurgeableCache> {
 @private
 	DKTextSubstitutor* mSubstitutor; // stores master string & performs substitutions on specially formatted strings
 	NSString* mPlaceholder; // placeholder string
@@ -46,7 +54,11 @@ other fixed content. See that class for details.
 	NSColor* mTextKnockoutColour; // colour for text knockout, default = white
 	NSColor* mTextKnockoutStrokeColour; // colour for stroking the text knockout, default = black
 	NSMutableDictionary* mTACache; // private cache used for various text layout caching
+	NSCache* mLayoutCache; // text laid out for each object, independent of where the object is
+	NSMutableSet* mPendingLayouts; // objects whose text is being laid out in the background
+	NSUInteger mLayoutGeneration; // incremented when the layouts are invalidated, so stale background layouts are discarded
 	NSDictionary* mDefaultAttributes; // saves default attributes for when text is deleted altogether
+	DKAttributeRunSummary* mAttributeSummary; // the master string's attribute runs, made when first asked about
 }
 
 // convenience constructor:
@@ -60,6 +72,25 @@ other fixed content. See that class for details.
 + (CGFloat)defaultMaximumVerticalOffset;
 + (void)setDefaultMaximumVerticalOffset:(CGFloat)mvo;
 
+/** @brief Sets the on-screen point size below which text is automatically greeked
+
+ When drawing to the screen, text whose font is smaller than this at the current scale is drawn greeked, as if -greeking were
+ kDKGreekingByLineRectangle. Set 0 to always draw glyphs.
+ @param size the size in screen points; the default is 4
+ */
++ (void)setAutomaticGreekingPointSize:(CGFloat)size;
++ (CGFloat)automaticGreekingPointSize;
+
+/** @brief Sets the on-screen point size below which text is drawn from a cached image
+
+ When drawing to the screen, text laid out in an object's bounds or path whose font is smaller than this at the current scale is drawn
+ into an image once. The image is drawn instead of the glyphs until the text or its layout changes, or the scale moves to a different power
+ of two. Set 0 to always draw glyphs.
+ @param size the size in screen points; the default is 9
+ */
++ (void)setTextImagePointSize:(CGFloat)size;
++ (CGFloat)textImagePointSize;
+
 // the text:
 
 - (NSString*)string;
@@ -151,6 +182,11 @@ other fixed content. See that class for details.
 - (BOOL)attributeIsHomogeneous:(NSString*)attributeName;
 - (BOOL)isHomogeneous;
 
+/** @brief Returns the attribute runs of the text, which are found once and kept until the text changes
+ @return the summary, or nil if there is no text
+ */
+- (DKAttributeRunSummary*)attributeRunSummary;
+
 // paragraph styles:
 
 - (void)setParagraphStyle:(NSParagraphStyle*)style;
@@ -197,6 +233,12 @@ other fixed content. See that class for details.
 
 - (BOOL)allTextWasFitted;
 
+/** @brief The approximate memory used by the text laid out for an object, including the image of it if there is one
+ @param obj the object
+ @return the size in bytes, or 0 if no layout is kept for the object
+ */
+- (NSUInteger)layoutBytesForObject:(id<DKRenderable>)obj;
+
 - (void)invalidateCache;
 
 - (void)drawInRect:(NSRect)aRect;
@@ -23,6 +23,11 @@
 #import "DKStroke.h"
 #import "DKTextSubstitutor.h"
 #import "DKGreekingLayoutManager.h"
+#import "NSBezierPath+Editing.h"
+#import "DKQuartzCache.h"
+#import "DKDrawingRenderer.h"
+
+@class DKTextAdornmentLayout;
 
 @interface DKTextAdornment (Private)
 
@@ -37,6 +42,100 @@
 - (void)applyNonCocoaTextAttributes:(NSDictionary*)attrs;
 - (NSLayoutManager*)layoutManager;
 - (void)masterStringChanged:(NSNotification*)note;
+- (DKTextAdornmentLayout*)layoutForText:(NSTextStorage*)contents withObject:(id<DKRenderable>)obj withPath:(NSBezierPath*)path;
+- (NSUInteger)placementNeutralChecksumForObject:(id<DKRenderable>)obj;
+- (CGFloat)onScreenPointSize;
+- (void)installLayout:(DKTextAdornmentLayout*)layout forObject:(id<DKRenderable>)obj generation:(NSUInteger)generation;
+- (void)drawPlaceholderForText:(NSTextStorage*)contents withObject:(id<DKRenderable>)obj withPath:(NSBezierPath*)path;
+
+@end
+
+/// text laid out by a layout manager of its own, so that it can be drawn again without being laid out again
+
+@interface DKTextAdornmentLayout : NSObject {
+@public
+	NSTextStorage* mText;
+	NSLayoutManager* mLayoutManager;
+	NSSize mContainerSize;
+	NSUInteger mPathChecksum; // the flowed layout path, in the text's own coordinates, or 0
+	CGFloat mPadding;
+	NSRange mGlyphRange; // the glyphs to draw
+	NSSize mTextSize;
+	BOOL mFittedAllText;
+	DKQuartzCache* mImage; // the text drawn at small sizes, or nil
+	CGFloat mImageScale;
+	NSRect mImageRect;
+}
+
+- (id)initWithText:(NSAttributedString*)text containerSize:(NSSize)size path:(NSBezierPath*)path padding:(CGFloat)padding;
+- (void)layOutWrappingLines:(BOOL)wraps;
+
+@end
+
+@implementation DKTextAdornmentLayout
+
+- (id)initWithText:(NSAttributedString*)text containerSize:(NSSize)size path:(NSBezierPath*)path padding:(CGFloat)padding
+{
+	// sets up the text to be laid out in the same way as the shared drawing layout manager would, but doesn't lay it out
+
+	self = [super init];
+	if (self) {
+		DKBezierTextContainer* bc = [[DKBezierTextContainer alloc] initWithContainerSize:size];
+		[bc setWidthTracksTextView:NO];
+		[bc setHeightTracksTextView:NO];
+		[bc setLineFragmentPadding:padding];
+		[bc setBezierPath:path];
+
+		mLayoutManager = [[NSLayoutManager alloc] init];
+		[mLayoutManager setUsesScreenFonts:NO];
+		[mLayoutManager addTextContainer:bc];
+		[bc release];
+
+		mText = [[NSTextStorage alloc] initWithAttributedString:text];
+		[mText addLayoutManager:mLayoutManager];
+
+		mContainerSize = size;
+		mPathChecksum = [path checksum];
+		mPadding = padding;
+	}
+
+	return self;
+}
+
+- (void)layOutWrappingLines:(BOOL)wraps
+{
+	// this only uses the receiver's own text system objects, so can be called on any thread as long as only one thread at a time uses it
+
+	NSTextContainer* bc = [[mLayoutManager textContainers] lastObject];
+	NSRange glyphRange = [mLayoutManager glyphRangeForTextContainer:bc];
+	NSRange fullRange = [mLayoutManager glyphRangeForCharacterRange:NSMakeRange(0, [mText length])
+											   actualCharacterRange:NULL];
+	mFittedAllText = NSEqualRanges(fullRange, glyphRange);
+	mGlyphRange = glyphRange;
+
+	if (glyphRange.length > 0) {
+		mTextSize = [mLayoutManager usedRectForTextContainer:bc].size;
+
+		// if not wrapping lines, draw only the first line
+
+		if (!wraps) {
+			NSRange grange;
+			NSRect frag = [mLayoutManager lineFragmentUsedRectForGlyphAtIndex:0
+															   effectiveRange:&grange];
+			mTextSize.height = frag.size.height;
+			mGlyphRange = grange;
+		}
+	}
+}
+
+- (void)dealloc
+{
+	[mImage release];
+	[mText removeLayoutManager:mLayoutManager];
+	[mLayoutManager release];
+	[mText release];
+	[super dealloc];
+}
 
 @end
 
@@ -57,6 +156,55 @@ static NSString* kDKTextAdornmentMaskPathCacheKey = @"DKTextAdornmentMaskPath";
 static NSString* kDKTextAdornmentMaskObjectChecksumCacheKey = @"DKTextAdornmentMaskObjectChecksum";
 static NSString* kDKTextAdornmentMetadataChecksumCacheKey = @"DKTextAdornmentMetadataChecksum";
 
+// thread dictionary key for the greeking layout manager of threads other than the main one
+
+static NSString* kDKGreekingLayoutManagerThreadKey = @"DKGreekingLayoutManager";
+
+#define kDKTextAdornmentLayoutCacheLimit 4096 // objects whose text layout is kept
+#define kDKTextAdornmentBackgroundLayoutLength 8000 // text longer than this is laid out in the background when it changes
+#define kDKTextAdornmentMaximumImageScale 8.0 // text images are never made at more than this many pixels per point
+#define kDKTextAdornmentLayoutBytesPerCharacter 32 // roughly what a layout manager keeps for each glyph, and the text storage for its character
+
+static CGFloat s_automaticGreekingPointSize = 4.0;
+static CGFloat s_textImagePointSize = 9.0;
+
+/// a layout being done in the background, and where to install it when it's done
+
+typedef struct {
+	DKTextAdornment* adornment;
+	id object;
+	DKTextAdornmentLayout* layout;
+	NSUInteger generation;
+	BOOL wraps;
+} DKTextAdornmentBackgroundLayout;
+
+static void installBackgroundLayout(void* context)
+{
+	DKTextAdornmentBackgroundLayout* bl = (DKTextAdornmentBackgroundLayout*)context;
+
+	[bl->adornment installLayout:bl->layout
+					   forObject:bl->object
+					  generation:bl->generation];
+
+	[bl->layout release];
+	[bl->object release];
+	[bl->adornment release];
+	free(bl);
+}
+
+static void layOutInBackground(void* context)
+{
+	DKTextAdornmentBackgroundLayout* bl = (DKTextAdornmentBackgroundLayout*)context;
+
+	@autoreleasepool {
+		[bl->layout layOutWrappingLines:bl->wraps];
+	}
+
+	dispatch_async_f(dispatch_get_main_queue(), bl, installBackgroundLayout);
+}
+
+#pragma mark -
+
 @implementation DKTextAdornment
 
 static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
@@ -114,6 +262,26 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 	s_maximumVerticalOffset = mvo;
 }
 
++ (void)setAutomaticGreekingPointSize:(CGFloat)size
+{
+	s_automaticGreekingPointSize = MAX(0, size);
+}
+
++ (CGFloat)automaticGreekingPointSize
+{
+	return s_automaticGreekingPointSize;
+}
+
++ (void)setTextImagePointSize:(CGFloat)size
+{
+	s_textImagePointSize = MAX(0, size);
+}
+
++ (CGFloat)textImagePointSize
+{
+	return s_textImagePointSize;
+}
+
 - (NSString*)string
 {
 	return [[self textSubstitutor] string];
@@ -732,16 +900,25 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 
 - (BOOL)attributeIsHomogeneous:(NSString*)attributeName
 {
-	// asks whether a given attribute applies over the entire length of the string.
+	// asks whether a given attribute applies over the entire length of the string. Inspectors ask this for each attribute they show
+	// whenever the selection changes, so the string's runs are found once and kept until the string changes
 
-	return [[[self textSubstitutor] masterString] attributeIsHomogeneous:attributeName];
+	return [[self attributeRunSummary] attributeIsHomogeneous:attributeName];
 }
 
 - (BOOL)isHomogeneous
 {
 	// asks whether all attributes apply over the whole length of the string
 
-	return [[[self textSubstitutor] masterString] isHomogeneous];
+	return [[self attributeRunSummary] isHomogeneous];
+}
+
+- (DKAttributeRunSummary*)attributeRunSummary
+{
+	if (mAttributeSummary == nil)
+		mAttributeSummary = [[[[self textSubstitutor] masterString] attributeRunSummary] retain];
+
+	return mAttributeSummary;
 }
 
 - (void)applyNonCocoaTextAttributes:(NSDictionary*)attrs
@@ -972,11 +1149,25 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 	return mLastLayoutFittedAllText;
 }
 
+- (NSUInteger)layoutBytesForObject:(id<DKRenderable>)obj
+{
+	DKTextAdornmentLayout* layout = [mLayoutCache objectForKey:[NSValue valueWithNonretainedObject:obj]];
+
+	if (layout == nil)
+		return 0;
+
+	return [layout->mText length] * kDKTextAdornmentLayoutBytesPerCharacter + [layout->mImage bytesUsed];
+}
+
 - (void)invalidateCache
 {
 	// empties the cache, causing all information it contains to be recalculated as needed
 
 	[mTACache removeAllObjects];
+	[mLayoutCache removeAllObjects];
+	[mAttributeSummary release];
+	mAttributeSummary = nil;
+	++mLayoutGeneration;
 }
 
 - (void)masterStringChanged:(NSNotification*)note
@@ -1115,10 +1306,265 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 
 - (void)drawText:(NSTextStorage*)contents withObject:(id<DKRenderable>)obj withPath:(NSBezierPath*)path
 {
-	[self drawText:contents
-		   withObject:obj
-			 withPath:path
-		layoutManager:[self layoutManager]];
+	// the text's layout doesn't depend on where the object is, so it is kept for each object and drawn again as long as the text and the space
+	// it's laid out in are the same. Greeked text is cheap to lay out and is drawn by its own layout manager each time.
+
+	DKTextAdornmentLayout* layout = [self layoutForText:contents
+											 withObject:obj
+											   withPath:path];
+
+	if (layout == nil) {
+		// text being laid out in the background for the first time isn't laid out here as well, but shown as lines until it's ready
+
+		if (obj && [mPendingLayouts containsObject:[NSValue valueWithNonretainedObject:obj]])
+			[self drawPlaceholderForText:contents
+							  withObject:obj
+								withPath:path];
+		else
+			[self drawText:contents
+				   withObject:obj
+					 withPath:path
+				layoutManager:[self layoutManager]];
+		return;
+	}
+
+	mLastLayoutFittedAllText = layout->mFittedAllText;
+
+	if (layout->mGlyphRange.length > 0) {
+		NSSize osize = ([self layoutMode] == kDKTextLayoutFlowedInPath) ? layout->mContainerSize : [obj size];
+
+		if ([self layoutMode] != kDKTextLayoutFlowedInPath && [self allowsTextToExtendHorizontally])
+			osize.width = 50000;
+
+		NSPoint textOrigin = [self textOriginForSize:layout->mTextSize
+										  objectSize:osize];
+
+		if ([self layoutMode] == kDKTextLayoutFlowedInPath && [self flowedTextPathInset] != 0.0)
+			textOrigin.y += [self flowedTextPathInset] * 0.5;
+
+		// at small sizes on screen the text is drawn from an image of it, made at the scale rounded up to a power of two so that
+		// zooming a little doesn't remake it
+
+		CGFloat pointSize = [self onScreenPointSize];
+
+		if (pointSize < [[self class] textImagePointSize]) {
+			CGFloat scale = pointSize / [[self font] pointSize];
+
+			scale = MIN(kDKTextAdornmentMaximumImageScale, exp2(ceil(log2(MAX(scale, 0.125)))));
+
+			// glyphs can overhang the used rect a little, so pad it
+
+			NSRect ur = [layout->mLayoutManager usedRectForTextContainer:[[layout->mLayoutManager textContainers] lastObject]];
+			ur.size.height = layout->mTextSize.height;
+			ur = NSInsetRect(NSOffsetRect(ur, textOrigin.x, textOrigin.y), -(2.0 + [[self font] pointSize] * 0.25), -(2.0 + [[self font] pointSize] * 0.25));
+
+			if (layout->mImage == nil || layout->mImageScale != scale || !NSEqualRects(layout->mImageRect, ur)) {
+				[layout->mImage release];
+				layout->mImage = [[DKQuartzCache alloc] initWithContext:[NSGraphicsContext currentContext]
+																forRect:NSMakeRect(0, 0, ceil(NSWidth(ur) * scale), ceil(NSHeight(ur) * scale))];
+				layout->mImageScale = scale;
+				layout->mImageRect = ur;
+
+				[layout->mImage lockFocus];
+
+				NSAffineTransform* transform = [NSAffineTransform transform];
+				[transform scaleBy:scale];
+				[transform translateXBy:-NSMinX(ur)
+									yBy:-NSMinY(ur)];
+				[transform concat];
+
+				[layout->mLayoutManager drawBackgroundForGlyphRange:layout->mGlyphRange
+															atPoint:textOrigin];
+				[layout->mLayoutManager drawGlyphsForGlyphRange:layout->mGlyphRange
+														atPoint:textOrigin];
+				[layout->mImage unlockFocus];
+			}
+
+			[layout->mImage drawInRect:ur];
+			return;
+		}
+
+		[layout->mLayoutManager drawBackgroundForGlyphRange:layout->mGlyphRange
+													atPoint:textOrigin];
+		[layout->mLayoutManager drawGlyphsForGlyphRange:layout->mGlyphRange
+												atPoint:textOrigin];
+	}
+}
+
+- (void)drawPlaceholderForText:(NSTextStorage*)contents withObject:(id<DKRenderable>)obj withPath:(NSBezierPath*)path
+{
+	// draws the text's lines as rectangles, much as greeking by line rectangle would, but estimated from the font and the length of the
+	// text so that nothing is laid out. Like the text, this is drawn in the text's own coordinates
+
+	NSFont* font = [self font];
+	NSSize osize = [obj size];
+	NSBezierPath* textLayoutPath = nil;
+
+	if ([self layoutMode] == kDKTextLayoutFlowedInPath) {
+		NSAffineTransform* tfm = [self textTransformForObject:obj];
+		[tfm invert];
+
+		textLayoutPath = [tfm transformBezierPath:path];
+		osize = [textLayoutPath bounds].size;
+	}
+
+	NSRect tr = [self textRect];
+	NSSize space = NSEqualRects(NSZeroRect, tr) || textLayoutPath ? osize : NSMakeSize(NSWidth(tr) * osize.width, NSHeight(tr) * osize.height);
+	CGFloat lineHeight = [font ascender] - [font descender] + [font leading];
+	CGFloat textWidth = [contents length] * [font pointSize] * 0.5;
+
+	if (space.width <= 0 || lineHeight <= 0)
+		return;
+
+	NSUInteger lines = 1;
+
+	if (textLayoutPath == nil && [self allowsTextToExtendHorizontally]) {
+		space.width = textWidth;
+		osize.width = 50000;
+	} else if ([self wrapsLines])
+		lines = MAX(1, MIN((NSUInteger)ceil(textWidth / space.width), (NSUInteger)floor(space.height / lineHeight)));
+
+	NSSize textSize = NSMakeSize(MIN(space.width, textWidth), lines * lineHeight);
+	NSPoint textOrigin = [self textOriginForSize:textSize
+									  objectSize:osize];
+	NSUInteger i;
+
+	SAVE_GRAPHICS_CONTEXT
+
+	if (textLayoutPath)
+		[textLayoutPath addClip];
+
+	[[[self colour] colorWithAlphaComponent:0.25] set];
+
+	for (i = 0; i < lines; ++i) {
+		CGFloat lineWidth = (i == lines - 1 && lines > 1) ? MIN(textWidth - i * space.width, textSize.width) : textSize.width;
+
+		NSRectFill(NSMakeRect(textOrigin.x, textOrigin.y + i * lineHeight, MAX(lineWidth, 0), lineHeight * 0.75));
+	}
+
+	RESTORE_GRAPHICS_CONTEXT
+}
+
+- (CGFloat)onScreenPointSize
+{
+	// the size the text's font appears on screen, taking into account all the scaling of the current context, or CGFLOAT_MAX if not
+	// drawing to the screen
+
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+
+	if (context == nil || !DKRenderIsDrawingToScreen())
+		return CGFLOAT_MAX;
+
+	CGAffineTransform dt = CGContextGetUserSpaceToDeviceSpaceTransform([context graphicsPort]);
+
+	return [[self font] pointSize] * sqrt(fabs(dt.a * dt.d - dt.b * dt.c));
+}
+
+- (DKTextAdornmentLayout*)layoutForText:(NSTextStorage*)contents withObject:(id<DKRenderable>)obj withPath:(NSBezierPath*)path
+{
+	// returns the object's laid out text, laying it out if the text, the container size or the flowed path has changed. Returns nil if the
+	// layout can't be kept, in which case the text should be drawn with the usual shared layout manager.
+
+	if (obj == nil || [contents length] == 0 || [self greeking] != kDKGreekingNone)
+		return nil;
+
+	NSSize osize = [obj size];
+	NSBezierPath* textLayoutPath = nil;
+	NSUInteger pathChecksum = 0;
+	CGFloat padding = 0;
+
+	if ([self layoutMode] == kDKTextLayoutFlowedInPath) {
+		// the flowed path is compared in the text's own coordinates, so moving or rotating the object doesn't change it
+
+		NSAffineTransform* tfm = [self textTransformForObject:obj];
+		[tfm invert];
+
+		textLayoutPath = [tfm transformBezierPath:path];
+		pathChecksum = [textLayoutPath checksum];
+		osize = [textLayoutPath bounds].size;
+		padding = [self flowedTextPathInset];
+	} else if ([self allowsTextToExtendHorizontally])
+		osize.width = 50000;
+
+	NSValue* key = [NSValue valueWithNonretainedObject:obj];
+	DKTextAdornmentLayout* layout = [mLayoutCache objectForKey:key];
+
+	if (layout != nil && NSEqualSizes(layout->mContainerSize, osize) && layout->mPathChecksum == pathChecksum && layout->mPadding == padding && [layout->mText isEqualToAttributedString:contents])
+		return layout;
+
+	// long text is laid out in the background, and until that's done the last layout is drawn (or placeholder lines, the first time).
+	// When the new layout is ready the object is redrawn, and if it has changed again in the meantime that starts another. Headless
+	// renders aren't redrawn, so they lay out at once.
+
+	if ([contents length] > kDKTextAdornmentBackgroundLayoutLength && ![DKDrawingRenderer isRenderingOnCurrentThread]) {
+		if (![mPendingLayouts containsObject:key]) {
+			if (mPendingLayouts == nil)
+				mPendingLayouts = [[NSMutableSet alloc] init];
+
+			[mPendingLayouts addObject:key];
+
+			DKTextAdornmentBackgroundLayout* bl = malloc(sizeof(DKTextAdornmentBackgroundLayout));
+
+			bl->adornment = [self retain];
+			bl->object = [(id)obj retain];
+			bl->layout = [[DKTextAdornmentLayout alloc] initWithText:contents
+													   containerSize:osize
+																path:textLayoutPath
+															 padding:padding];
+			bl->generation = mLayoutGeneration;
+			bl->wraps = [self wrapsLines];
+
+			dispatch_async_f(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), bl, layOutInBackground);
+		}
+
+		return layout;
+	}
+
+	layout = [[DKTextAdornmentLayout alloc] initWithText:contents
+										   containerSize:osize
+													path:textLayoutPath
+												 padding:padding];
+	[layout layOutWrappingLines:[self wrapsLines]];
+
+	[mLayoutCache setObject:layout
+					 forKey:key];
+	[layout release];
+
+	return layout;
+}
+
+- (void)installLayout:(DKTextAdornmentLayout*)layout forObject:(id<DKRenderable>)obj generation:(NSUInteger)generation
+{
+	NSValue* key = [NSValue valueWithNonretainedObject:obj];
+
+	[mPendingLayouts removeObject:key];
+
+	// a layout started before the settings changed is out of date
+
+	if (generation != mLayoutGeneration)
+		return;
+
+	[mLayoutCache setObject:layout
+					 forKey:key];
+
+	if ([(id)obj respondsToSelector:@selector(notifyVisualChange)])
+		[(id)obj notifyVisualChange];
+}
+
+- (NSUInteger)placementNeutralChecksumForObject:(id<DKRenderable>)obj
+{
+	// a checksum of what the text's layout within an object depends on - everything but where the object is
+
+	NSUInteger cs = [(id)obj metadataChecksum];
+	NSSize size = [obj size];
+
+	cs = DKRasterizerChecksumCombine(cs, size.width);
+	cs = DKRasterizerChecksumCombine(cs, size.height);
+
+	if ([self appliesObjectAngle])
+		cs = DKRasterizerChecksumCombine(cs, [obj angle]);
+
+	return cs;
 }
 
 - (void)drawText:(NSTextStorage*)contents withObject:(id<DKRenderable>)obj withPath:(NSBezierPath*)path layoutManager:(NSLayoutManager*)lm
@@ -1370,8 +1816,11 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 		// the general case of a text change will have invalidated the entire cache. This checks for a layout change
 		// that is only in consideration of the text mask effect.
 
+		// text laid out in the object's bounds is the same wherever the object is, so its mask is kept in the text's own coordinates
+
+		BOOL local = ([self layoutMode] == kDKTextLayoutInBoundingRect);
 		NSUInteger cs = [[mTACache objectForKey:kDKTextAdornmentMaskObjectChecksumCacheKey] integerValue];
-		NSUInteger geoCheck = [(id)obj geometryChecksum] ^ [(id)obj metadataChecksum];
+		NSUInteger geoCheck = local ? [self placementNeutralChecksumForObject:obj] : [(id)obj geometryChecksum] ^ [(id)obj metadataChecksum];
 
 		if (geoCheck != cs) {
 			[mTACache removeObjectForKey:kDKTextAdornmentMaskPathCacheKey];
@@ -1390,6 +1839,12 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 
 			textPath = [self textAsPathForObject:obj];
 
+			if (local) {
+				NSAffineTransform* tfm = [self textTransformForObject:obj];
+				[tfm invert];
+				[textPath transformUsingAffineTransform:tfm];
+			}
+
 			// knockout distance is expressed in terms of percentage of font height. So convert that to absolute value.
 			// distance is doubled to give effective strokewidth for calculating the outline path
 
@@ -1405,6 +1860,9 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 						 forKey:kDKTextAdornmentMaskPathCacheKey];
 		}
 
+		if (local)
+			textPath = [[self textTransformForObject:obj] transformBezierPath:textPath];
+
 		if ([self textKnockoutColour]) {
 			[[self textKnockoutColour] set];
 			[textPath fill];
@@ -1431,20 +1889,35 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 	if ([self greeking] == kDKGreekingNone)
 		return sharedDrawingLayoutManager();
 	else {
-		// greeking is implemented using a greeking layout manager
+		// greeking is implemented using a greeking layout manager. Like the normal one it's shared, as greeking is used for drawing
+		// large numbers of tiny objects and making a new one each time would cost more than the glyphs it saves. A layout manager can't
+		// be used by two threads at once though, so other threads than the main one keep their own in their thread dictionaries
 
-		DKGreekingLayoutManager* glm = [[DKGreekingLayoutManager alloc] init];
-		[glm setGreeking:[self greeking]];
+		static DKGreekingLayoutManager* sMainThreadGreekingLM = nil;
+		NSMutableDictionary* threadInfo = [NSThread isMainThread] ? nil : [[NSThread currentThread] threadDictionary];
+		DKGreekingLayoutManager* sGreekingLM = threadInfo ? [threadInfo objectForKey:kDKGreekingLayoutManagerThreadKey] : sMainThreadGreekingLM;
 
-		DKBezierTextContainer* tc = [[DKBezierTextContainer alloc] initWithContainerSize:NSMakeSize(1.0e6, 1.0e6)];
-		[tc setWidthTracksTextView:NO];
-		[tc setHeightTracksTextView:NO];
-		[glm addTextContainer:tc];
-		[tc release];
+		if (sGreekingLM == nil) {
+			sGreekingLM = [[DKGreekingLayoutManager alloc] init];
 
-		[glm setUsesScreenFonts:NO];
+			DKBezierTextContainer* tc = [[DKBezierTextContainer alloc] initWithContainerSize:NSMakeSize(1.0e6, 1.0e6)];
+			[tc setWidthTracksTextView:NO];
+			[tc setHeightTracksTextView:NO];
+			[sGreekingLM addTextContainer:tc];
+			[tc release];
 
-		return [glm autorelease];
+			[sGreekingLM setUsesScreenFonts:NO];
+
+			if (threadInfo) {
+				[threadInfo setObject:sGreekingLM
+							   forKey:kDKGreekingLayoutManagerThreadKey];
+				[sGreekingLM release];
+			} else
+				sMainThreadGreekingLM = sGreekingLM;
+		}
+
+		[sGreekingLM setGreeking:[self greeking]];
+		return sGreekingLM;
 	}
 }
 
@@ -1510,11 +1983,20 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 		NSUInteger cs, ccs = [[mTACache objectForKey:kDKTextAdornmentMetadataChecksumCacheKey] integerValue];
 		cs = [(id)object metadataChecksum];
 		if (cs != ccs) {
-			[self invalidateCache];
-			[mTACache setObject:[NSNumber numberWithInteger:ccs]
+			// the text layouts are kept for each object and check their own text, so only the cache for the last client is emptied
+
+			[mTACache removeAllObjects];
+			[mTACache setObject:[NSNumber numberWithInteger:cs]
 						 forKey:kDKTextAdornmentMetadataChecksumCacheKey];
 		}
 
+		// text too small to read on screen is greeked, which lays out the same lines but fills their rectangles
+
+		if ([self greeking] == kDKGreekingNone && [self onScreenPointSize] < [[self class] automaticGreekingPointSize]) {
+			[self renderLowDetail:object];
+			return;
+		}
+
 		NSTextStorage* str = [self textToDraw:object];
 
 		// if no text, nothing to do
@@ -1569,7 +2051,8 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 				mLastLayoutFittedAllText = [path drawTextOnPath:str
 														yOffset:baseOffset
 												  layoutManager:lm
-														  cache:mTACache];
+														  cache:mTACache
+													   flatness:[self flatnessForObject:object]];
 			} else {
 				if ([self clipping] != kDKClippingNone)
 					[path addClip];
@@ -1602,6 +2085,30 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 	}
 }
 
+- (CGFloat)minimumDetailSize
+{
+	// text on an object this small is far below legible size
+
+	return 24.0;
+}
+
+- (void)renderLowDetail:(id<DKRenderable>)object
+{
+	// greeked text lays out the same lines but fills their rectangles instead of drawing glyphs
+
+	DKGreeking savedGreeking = mGreeking;
+
+	mGreeking = kDKGreekingByLineRectangle;
+	@try
+	{
+		[self render:object];
+	}
+	@finally
+	{
+		mGreeking = savedGreeking;
+	}
+}
+
 #pragma mark -
 #pragma mark As a GCObservableObject
 + (NSArray*)observableKeyPaths
@@ -1654,17 +2161,32 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 			 forKeyPath:@"placeholderString"];
 }
 
+#pragma mark -
+#pragma mark As a DKPurgeableCache
+
+- (NSUInteger)purgeForMemoryPressure
+{
+	// the layouts are made again when each object is next drawn
+
+	[self invalidateCache];
+	return 0;
+}
+
 #pragma mark -
 #pragma mark As an NSObject
 - (void)dealloc
 {
+	[[DKCacheRegistry sharedCacheRegistry] unregisterCache:self];
 	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	[mTACache release];
+	[mLayoutCache release];
+	[mPendingLayouts release];
 	[mSubstitutor release];
 	[mTextKnockoutColour release];
 	[mTextKnockoutStrokeColour release];
 	[mPlaceholder release];
 	[mDefaultAttributes release];
+	[mAttributeSummary release];
 	[super dealloc];
 }
 
@@ -1678,6 +2200,10 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 		[self setFlowedTextPathInset:3];
 
 		mTACache = [[NSMutableDictionary alloc] init];
+		mLayoutCache = [[NSCache alloc] init];
+		[mLayoutCache setCountLimit:kDKTextAdornmentLayoutCacheLimit];
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeLayout];
 	}
 
 	if (self != nil) {
@@ -1745,6 +2271,10 @@ static CGFloat s_maximumVerticalOffset = DEFAULT_BASELINE_OFFSET_MAX;
 	self = [super initWithCoder:coder];
 	if (self != nil) {
 		mTACache = [[NSMutableDictionary alloc] init];
+		mLayoutCache = [[NSCache alloc] init];
+		[mLayoutCache setCountLimit:kDKTextAdornmentLayoutCacheLimit];
+		[[DKCacheRegistry sharedCacheRegistry] registerCache:self
+													priority:kDKCachePurgeLayout];
 
 		// identifiers are deprecated in favour of substitution - to migrate older objects, we append the identifier
 		// to the end of the master string using appropriate delimiters. This gives identical results to the earlier
@@ -0,0 +1,106 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+@class DKDrawing, DKDrawableObject;
+
+// text search options
+
+typedef enum {
+	kDKTextSearchWholeWords = 0, // each word searched for must be a whole word of the object's text
+	kDKTextSearchPrefix = (1 << 0) // each word searched for need only begin a word of the object's text
+} DKTextSearchOptions;
+
+/** @brief Indexes the objects of a drawing by the words of their text.
+
+ Indexes the objects of a drawing by the words of their text, so that finding the objects with some text doesn't mean getting the text of
+ every object in the drawing. The text of an object is that of its own text adornment, if it is a text shape or text path, and of the text
+ adornments of its style, with any substitutions made from the object's metadata, along with the string values of its own metadata. It is
+ split into words, which are folded to ignore case and diacritics, and for each word the index keeps the set of objects having it. A sorted
+ list of the words, for finding those with a prefix, is made when first needed and discarded when a word is added or goes away.
+
+ As with DKMetadataIndex, only the objects owned directly by the drawing's object owner layers are indexed. The index is kept up to date as
+ objects are added to and removed from layers, as their metadata or style changes, and as the text of a text adornment they use is set,
+ including by undo. Changed objects are only noted at the time, and indexed again the next time the index is searched, so that typing into
+ a label costs nothing until a search is made. Text substituted from an object's properties rather than its metadata is indexed as it was
+ when last indexed. Adding or removing layers, or replacing all of a layer's objects, means the index is rebuilt the next time it is used.
+
+ The index is owned by the drawing, and is only created if the drawing's setIndexesText: is given YES.
+*/
+@interface DKTextIndex : NSObject {
+@private
+	DKDrawing* mDrawingRef;
+	NSMutableDictionary* mPostings; // word -> set of objects
+	NSArray* mSortedWords; // the words of mPostings in order, made on demand
+	CFMutableDictionaryRef mEntries; // object -> its words and the sources of its text
+	CFMutableDictionaryRef mSources; // style or text substitutor, not retained -> set of the objects whose text it gives
+	CFMutableDictionaryRef mStyleSubstitutors; // style, not retained -> the text substitutors it had when last indexed
+	CFMutableSetRef mStaleObjects; // objects whose text may have changed since they were indexed, not retained
+	NSUInteger mPostingCount;
+	BOOL mNeedsRebuild;
+}
+
+/** @brief Splits a string into the words an index is made of
+ @param string the string
+ @return an array of words, folded to ignore case and diacritics, in the order they appear
+ */
++ (NSArray*)wordsOfString:(NSString*)string;
+
+/** @brief The text of an object that is indexed
+ @param obj the object
+ @return an array of strings
+ */
++ (NSArray*)indexedTextOfObject:(DKDrawableObject*)obj;
+
+/** @brief Finds the objects in some layers having some text, without an index
+
+ This is what the drawing does when it doesn't index text, and gives the same results as the index would.
+ @param layers the object owner layers to search
+ @param text the text; every word of it must be found
+ @param options the search options
+ @return the objects found, in layer and stacking order
+ */
++ (NSArray*)objectsInLayers:(NSArray*)layers matchingText:(NSString*)text options:(DKTextSearchOptions)options;
+
+- (id)initWithDrawing:(DKDrawing*)drawing;
+
+- (DKDrawing*)drawing;
+- (void)setDrawing:(DKDrawing*)drawing;
+
+/** @brief Adds an object and its text to the index
+
+ Called when an object is added to a layer of the drawing.
+ @param obj the object
+ */
+- (void)addObject:(DKDrawableObject*)obj;
+- (void)removeObject:(DKDrawableObject*)obj;
+
+/** @brief Notes that an object's text may have changed, so that it is indexed again before the next search
+ @param obj the object
+ */
+- (void)objectDidChangeText:(DKDrawableObject*)obj;
+
+/** @brief Discards the index so that it is rebuilt the next time it is used
+ */
+- (void)invalidate;
+
+/** @brief Returns the objects having some text
+ @param text the text; every word of it must be found in an object's text, in any order
+ @param options the search options
+ @return a set of the objects
+ */
+- (NSSet*)objectsMatchingText:(NSString*)text options:(DKTextSearchOptions)options;
+
+/** @brief The number of objects in the index, for testing and diagnostics
+ */
+- (NSUInteger)objectCount;
+
+/** @brief The number of (word, object) pairs in the index as it stands, for estimating its size
+ */
+- (NSUInteger)postingCount;
+
+@end
@@ -0,0 +1,643 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKTextIndex.h"
+#import "DKDrawing.h"
+#import "DKObjectOwnerLayer.h"
+#import "DKDrawableObject+Metadata.h"
+#import "DKMetadataIndex.h"
+#import "DKStyle.h"
+#import "DKTextAdornment.h"
+#import "DKTextSubstitutor.h"
+#import "LogEvent.h"
+
+// what the index knows about one object
+
+@interface DKTextIndexEntry : NSObject {
+@public
+	NSSet* mWords;
+	NSArray* mSources; // the style and text substitutors, as nonretained values
+}
+
+@end
+
+@implementation DKTextIndexEntry
+
+- (void)dealloc
+{
+	[mWords release];
+	[mSources release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKTextIndex (Private)
+
+- (void)updateIfNeeded;
+- (void)addEntryForObject:(DKDrawableObject*)obj;
+- (void)removeEntryForObject:(DKDrawableObject*)obj;
+- (NSSet*)objectsWithWord:(NSString*)word prefix:(BOOL)prefix;
+- (NSArray*)sortedWords;
+- (void)markObjectsOfSourceStale:(id)source;
+- (void)layersDidChange:(NSNotification*)note;
+- (void)substitutorDidChange:(NSNotification*)note;
+- (void)styleDidChange:(NSNotification*)note;
+- (void)styleWasAttached:(NSNotification*)note;
+
+@end
+
+// the text substitutors of the text adornments in a style, as nonretained values so they can be compared with those it had before
+
+static NSArray* substitutorsOfStyle(DKStyle* style)
+{
+	NSArray* adornments = [style renderersOfClass:[DKTextAdornment class]];
+
+	if ([adornments count] == 0)
+		return [NSArray array];
+
+	NSMutableArray* substitutors = [NSMutableArray arrayWithCapacity:[adornments count]];
+	NSEnumerator* iter = [adornments objectEnumerator];
+	DKTextAdornment* adornment;
+
+	while ((adornment = [iter nextObject]))
+		[substitutors addObject:[NSValue valueWithNonretainedObject:[adornment textSubstitutor]]];
+
+	return substitutors;
+}
+
+// gets the strings making up an object's text and, if <sources> isn't NULL, the style and substitutors they came from
+
+static NSArray* textOfObject(DKDrawableObject* obj, NSArray** sources)
+{
+	NSMutableArray* strings = [NSMutableArray array];
+	NSMutableArray* adornments = [NSMutableArray array];
+	NSMutableArray* from = [NSMutableArray array];
+
+	if ([obj respondsToSelector:@selector(textAdornment)]) {
+		DKTextAdornment* own = [(id)obj textAdornment];
+
+		if (own)
+			[adornments addObject:own];
+	}
+
+	DKStyle* style = [obj style];
+
+	if (style) {
+		[from addObject:[NSValue valueWithNonretainedObject:style]];
+		[adornments addObjectsFromArray:[style renderersOfClass:[DKTextAdornment class]]];
+	}
+
+	NSEnumerator* iter = [adornments objectEnumerator];
+	DKTextAdornment* adornment;
+
+	while ((adornment = [iter nextObject])) {
+		DKTextSubstitutor* substitutor = [adornment textSubstitutor];
+		NSString* str = [[substitutor substitutedStringWithObject:obj] string];
+
+		if ([str length] > 0)
+			[strings addObject:str];
+
+		if (substitutor)
+			[from addObject:[NSValue valueWithNonretainedObject:substitutor]];
+	}
+
+	// only the object's own metadata, as for the metadata index
+
+	iter = [[obj metadata] keyEnumerator];
+	NSString* key;
+
+	while ((key = [iter nextObject])) {
+		id value = [DKMetadataIndex indexedValueOfObject:obj
+												  forKey:key];
+
+		if ([value isKindOfClass:[NSString class]] && [value length] > 0)
+			[strings addObject:value];
+	}
+
+	if (sources)
+		*sources = from;
+
+	return strings;
+}
+
+static NSSet* wordsOfObject(DKDrawableObject* obj, NSArray** sources)
+{
+	NSMutableSet* words = [NSMutableSet set];
+	NSEnumerator* iter = [textOfObject(obj, sources) objectEnumerator];
+	NSString* str;
+
+	while ((str = [iter nextObject]))
+		[words addObjectsFromArray:[DKTextIndex wordsOfString:str]];
+
+	return words;
+}
+
+static BOOL wordsContainWord(NSSet* words, NSString* word, BOOL prefix)
+{
+	if (!prefix)
+		return [words containsObject:word];
+
+	NSEnumerator* iter = [words objectEnumerator];
+	NSString* w;
+
+	while ((w = [iter nextObject])) {
+		if ([w hasPrefix:word])
+			return YES;
+	}
+
+	return NO;
+}
+
+// the index of the first word in the sorted array not less than <word>
+
+static NSUInteger lowerBound(NSArray* words, NSString* word)
+{
+	NSUInteger lo = 0, hi = [words count];
+
+	while (lo < hi) {
+		NSUInteger mid = lo + (hi - lo) / 2;
+
+		if ([[words objectAtIndex:mid] compare:word
+									   options:NSLiteralSearch]
+			== NSOrderedAscending)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+static NSInteger compareWords(id a, id b, void* context)
+{
+#pragma unused(context)
+	return [a compare:b
+			  options:NSLiteralSearch];
+}
+
+#pragma mark -
+
+@implementation DKTextIndex
+#pragma mark As a DKTextIndex
+
++ (NSArray*)wordsOfString:(NSString*)string
+{
+	static NSCharacterSet* sSeparators = nil;
+
+	if (sSeparators == nil)
+		sSeparators = [[[NSCharacterSet alphanumericCharacterSet] invertedSet] retain];
+
+	NSString* folded = [string stringByFoldingWithOptions:NSCaseInsensitiveSearch | NSDiacriticInsensitiveSearch
+												   locale:nil];
+	NSArray* parts = [folded componentsSeparatedByCharactersInSet:sSeparators];
+	NSMutableArray* words = [NSMutableArray arrayWithCapacity:[parts count]];
+	NSEnumerator* iter = [parts objectEnumerator];
+	NSString* part;
+
+	while ((part = [iter nextObject])) {
+		if ([part length] > 0)
+			[words addObject:part];
+	}
+
+	return words;
+}
+
++ (NSArray*)indexedTextOfObject:(DKDrawableObject*)obj
+{
+	return textOfObject(obj, NULL);
+}
+
++ (NSArray*)objectsInLayers:(NSArray*)layers matchingText:(NSString*)text options:(DKTextSearchOptions)options
+{
+	NSMutableArray* found = [NSMutableArray array];
+	NSArray* searchWords = [self wordsOfString:text];
+	BOOL prefix = (options & kDKTextSearchPrefix) != 0;
+
+	if ([searchWords count] == 0)
+		return found;
+
+	NSEnumerator* iter = [layers objectEnumerator];
+	DKObjectOwnerLayer* layer;
+
+	while ((layer = [iter nextObject])) {
+		if ([layer hasPendingObjects])
+			continue;
+
+		NSEnumerator* objIter = [[layer objects] objectEnumerator];
+		DKDrawableObject* obj;
+
+		while ((obj = [objIter nextObject])) {
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+			NSSet* words = wordsOfObject(obj, NULL);
+			NSEnumerator* wordIter = [searchWords objectEnumerator];
+			NSString* word;
+			BOOL matches = YES;
+
+			while (matches && (word = [wordIter nextObject]))
+				matches = wordsContainWord(words, word, prefix);
+
+			if (matches)
+				[found addObject:obj];
+
+			[pool drain];
+		}
+	}
+
+	return found;
+}
+
+- (id)initWithDrawing:(DKDrawing*)drawing
+{
+	self = [super init];
+	if (self) {
+		mPostings = [[NSMutableDictionary alloc] init];
+
+		// drawable objects are compared by identity, and are retained until they are removed
+
+		CFDictionaryKeyCallBacks callbacks = kCFTypeDictionaryKeyCallBacks;
+		callbacks.equal = NULL;
+		callbacks.hash = NULL;
+
+		mEntries = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &callbacks, &kCFTypeDictionaryValueCallBacks);
+		mSources = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+		mStyleSubstitutors = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+		mStaleObjects = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+		mNeedsRebuild = YES;
+
+		[self setDrawing:drawing];
+	}
+
+	return self;
+}
+
+- (DKDrawing*)drawing
+{
+	return mDrawingRef;
+}
+
+- (void)setDrawing:(DKDrawing*)drawing
+{
+	if (drawing != mDrawingRef) {
+		NSNotificationCenter* nc = [NSNotificationCenter defaultCenter];
+
+		[nc removeObserver:self];
+
+		mDrawingRef = drawing;
+		[self invalidate];
+
+		// the objects notifying are checked against the index, since any drawing's may be
+
+		if (drawing) {
+			[nc addObserver:self
+				   selector:@selector(layersDidChange:)
+					   name:kDKLayerGroupNumberOfLayersDidChange
+					 object:nil];
+			[nc addObserver:self
+				   selector:@selector(substitutorDidChange:)
+					   name:kDKTextSubstitutorNewStringNotification
+					 object:nil];
+			[nc addObserver:self
+				   selector:@selector(styleDidChange:)
+					   name:kDKStyleDidChangeNotification
+					 object:nil];
+			[nc addObserver:self
+				   selector:@selector(styleWasAttached:)
+					   name:kDKDrawableStyleWasAttachedNotification
+					 object:nil];
+		}
+	}
+}
+
+- (void)addObject:(DKDrawableObject*)obj
+{
+	if (mNeedsRebuild || obj == nil || CFDictionaryContainsKey(mEntries, obj))
+		return;
+
+	[self addEntryForObject:obj];
+}
+
+- (void)removeObject:(DKDrawableObject*)obj
+{
+	if (mNeedsRebuild || obj == nil || !CFDictionaryContainsKey(mEntries, obj))
+		return;
+
+	[self removeEntryForObject:obj];
+}
+
+- (void)objectDidChangeText:(DKDrawableObject*)obj
+{
+	// objects that aren't in the index, such as those in groups, are ignored
+
+	if (!mNeedsRebuild && obj && CFDictionaryContainsKey(mEntries, obj))
+		CFSetAddValue(mStaleObjects, obj);
+}
+
+- (void)invalidate
+{
+	mNeedsRebuild = YES;
+
+	CFSetRemoveAllValues(mStaleObjects);
+	CFDictionaryRemoveAllValues(mEntries);
+	CFDictionaryRemoveAllValues(mSources);
+	CFDictionaryRemoveAllValues(mStyleSubstitutors);
+	[mPostings removeAllObjects];
+	[mSortedWords release];
+	mSortedWords = nil;
+	mPostingCount = 0;
+}
+
+- (NSSet*)objectsMatchingText:(NSString*)text options:(DKTextSearchOptions)options
+{
+	[self updateIfNeeded];
+
+	// each word narrows the objects found for those before it, so the search stops as soon as none are left
+
+	NSArray* searchWords = [[self class] wordsOfString:text];
+	NSEnumerator* iter = [searchWords objectEnumerator];
+	NSString* word;
+	NSMutableSet* found = nil;
+
+	while ((word = [iter nextObject])) {
+		NSSet* matches = [self objectsWithWord:word
+										prefix:(options & kDKTextSearchPrefix) != 0];
+
+		if (found == nil)
+			found = [[matches mutableCopy] autorelease];
+		else
+			[found intersectSet:matches];
+
+		if ([found count] == 0)
+			break;
+	}
+
+	return found ? found : [NSSet set];
+}
+
+- (NSUInteger)objectCount
+{
+	[self updateIfNeeded];
+
+	return (NSUInteger)CFDictionaryGetCount(mEntries);
+}
+
+- (NSUInteger)postingCount
+{
+	return mPostingCount;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
+
+	[mPostings release];
+	[mSortedWords release];
+
+	if (mStaleObjects)
+		CFRelease(mStaleObjects);
+
+	if (mStyleSubstitutors)
+		CFRelease(mStyleSubstitutors);
+
+	if (mSources)
+		CFRelease(mSources);
+
+	if (mEntries)
+		CFRelease(mEntries);
+
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKTextIndex (Private)
+
+- (void)updateIfNeeded
+{
+	if (mDrawingRef == nil)
+		return;
+
+	if (mNeedsRebuild) {
+		mNeedsRebuild = NO;
+
+		NSEnumerator* iter = [[mDrawingRef flattenedLayersOfClass:[DKObjectOwnerLayer class]] objectEnumerator];
+		DKObjectOwnerLayer* layer;
+
+		while ((layer = [iter nextObject])) {
+			// asking for the objects of a layer that hasn't been loaded would load it. It is indexed when it is
+
+			if ([layer hasPendingObjects])
+				continue;
+
+			NSEnumerator* objIter = [[layer objects] objectEnumerator];
+			DKDrawableObject* obj;
+
+			while ((obj = [objIter nextObject])) {
+				NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+				[self addObject:obj];
+				[pool drain];
+			}
+		}
+
+		LogEvent_(kInfoEvent, @"text index rebuilt, %ld objects, %ld words", (long)CFDictionaryGetCount(mEntries), (long)[mPostings count]);
+	} else if (CFSetGetCount(mStaleObjects) > 0) {
+		// the objects are kept by their entries while they are taken out and put back
+
+		CFIndex i, count = CFSetGetCount(mStaleObjects);
+		const void** stale = malloc(count * sizeof(void*));
+
+		CFSetGetValues(mStaleObjects, stale);
+
+		for (i = 0; i < count; ++i) {
+			DKDrawableObject* obj = [(DKDrawableObject*)stale[i] retain];
+
+			[self removeEntryForObject:obj];
+			[self addEntryForObject:obj];
+			[obj release];
+		}
+
+		free(stale);
+		CFSetRemoveAllValues(mStaleObjects);
+	}
+}
+
+- (void)addEntryForObject:(DKDrawableObject*)obj
+{
+	NSArray* sources = nil;
+	NSSet* words = wordsOfObject(obj, &sources);
+	DKTextIndexEntry* entry = [[DKTextIndexEntry alloc] init];
+
+	entry->mWords = [words retain];
+	entry->mSources = [sources retain];
+	CFDictionarySetValue(mEntries, obj, entry);
+	[entry release];
+
+	NSEnumerator* iter = [words objectEnumerator];
+	NSString* word;
+
+	while ((word = [iter nextObject])) {
+		NSMutableSet* objects = [mPostings objectForKey:word];
+
+		if (objects == nil) {
+			objects = [NSMutableSet set];
+			[mPostings setObject:objects
+						  forKey:word];
+
+			[mSortedWords release];
+			mSortedWords = nil;
+		}
+
+		[objects addObject:obj];
+		++mPostingCount;
+	}
+
+	// the style and substitutors are noted so that changes to them can be traced to the objects whose text they give
+
+	iter = [sources objectEnumerator];
+	NSValue* source;
+
+	while ((source = [iter nextObject])) {
+		const void* key = [source nonretainedObjectValue];
+		NSMutableSet* objects = (NSMutableSet*)CFDictionaryGetValue(mSources, key);
+
+		if (objects == nil) {
+			objects = [[NSMutableSet alloc] init];
+			CFDictionarySetValue(mSources, key, objects);
+			[objects release];
+		}
+
+		[objects addObject:obj];
+	}
+
+	DKStyle* style = [obj style];
+
+	if (style && !CFDictionaryContainsKey(mStyleSubstitutors, style))
+		CFDictionarySetValue(mStyleSubstitutors, style, substitutorsOfStyle(style));
+}
+
+- (void)removeEntryForObject:(DKDrawableObject*)obj
+{
+	DKTextIndexEntry* entry = (DKTextIndexEntry*)CFDictionaryGetValue(mEntries, obj);
+	NSEnumerator* iter = [entry->mWords objectEnumerator];
+	NSString* word;
+
+	while ((word = [iter nextObject])) {
+		NSMutableSet* objects = [mPostings objectForKey:word];
+
+		[objects removeObject:obj];
+		--mPostingCount;
+
+		if ([objects count] == 0) {
+			[mPostings removeObjectForKey:word];
+
+			[mSortedWords release];
+			mSortedWords = nil;
+		}
+	}
+
+	iter = [entry->mSources objectEnumerator];
+	NSValue* source;
+
+	while ((source = [iter nextObject])) {
+		const void* key = [source nonretainedObjectValue];
+		NSMutableSet* objects = (NSMutableSet*)CFDictionaryGetValue(mSources, key);
+
+		[objects removeObject:obj];
+
+		if ([objects count] == 0) {
+			CFDictionaryRemoveValue(mSources, key);
+			CFDictionaryRemoveValue(mStyleSubstitutors, key);
+		}
+	}
+
+	CFSetRemoveValue(mStaleObjects, obj);
+	CFDictionaryRemoveValue(mEntries, obj);
+}
+
+- (NSSet*)objectsWithWord:(NSString*)word prefix:(BOOL)prefix
+{
+	if (!prefix) {
+		NSSet* objects = [mPostings objectForKey:word];
+		return objects ? objects : [NSSet set];
+	}
+
+	NSArray* words = [self sortedWords];
+	NSUInteger i, count = [words count];
+	NSMutableSet* found = [NSMutableSet set];
+
+	for (i = lowerBound(words, word); i < count; ++i) {
+		NSString* w = [words objectAtIndex:i];
+
+		if (![w hasPrefix:word])
+			break;
+
+		[found unionSet:[mPostings objectForKey:w]];
+	}
+
+	return found;
+}
+
+- (NSArray*)sortedWords
+{
+	if (mSortedWords == nil)
+		mSortedWords = [[[mPostings allKeys] sortedArrayUsingFunction:compareWords
+															 context:NULL] retain];
+
+	return mSortedWords;
+}
+
+- (void)markObjectsOfSourceStale:(id)source
+{
+	NSSet* objects = (NSSet*)CFDictionaryGetValue(mSources, source);
+	NSEnumerator* iter = [objects objectEnumerator];
+	DKDrawableObject* obj;
+
+	while ((obj = [iter nextObject]))
+		CFSetAddValue(mStaleObjects, obj);
+}
+
+- (void)layersDidChange:(NSNotification*)note
+{
+	if ([[note object] drawing] == mDrawingRef)
+		[self invalidate];
+}
+
+- (void)substitutorDidChange:(NSNotification*)note
+{
+	if (!mNeedsRebuild)
+		[self markObjectsOfSourceStale:[note object]];
+}
+
+- (void)styleDidChange:(NSNotification*)note
+{
+	// changes to the text of a style's adornments come from their substitutors, so only a change to which adornments it has matters here
+
+	DKStyle* style = [note object];
+
+	if (mNeedsRebuild || !CFDictionaryContainsKey(mStyleSubstitutors, style))
+		return;
+
+	NSArray* substitutors = substitutorsOfStyle(style);
+
+	if (![substitutors isEqualToArray:(NSArray*)CFDictionaryGetValue(mStyleSubstitutors, style)]) {
+		CFDictionarySetValue(mStyleSubstitutors, style, substitutors);
+		[self markObjectsOfSourceStale:style];
+	}
+}
+
+- (void)styleWasAttached:(NSNotification*)note
+{
+	[self objectDidChangeText:[note object]];
+}
+
+@end
@@ -17,6 +17,8 @@
 #import "DKDrawableObject+Metadata.h"
 #import "NSBezierPath+Geometry.h"
 #import "DKKnob.h"
+#import "DKMemoryFootprint.h"
+#import "GCUndoManager.h"
 
 #pragma mark Static Vars
 static NSString* sDefault_string = @"Double-click to edit this text";
@@ -785,6 +787,24 @@ static NSString* sDefault_string = @"Double-click to edit this text";
 #pragma mark -
 #pragma mark - as a DKDrawablePath
 
+- (void)addOutlineToPath:(CGMutablePathRef)path
+{
+	// the text isn't laid out - its extent stands in for it
+
+	CGPathAddRect(path, NULL, NSRectToCGRect([self bounds]));
+}
+
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	// the text is the object's own, but its layout is kept by the adornment
+
+	[super addFootprintToReport:footprint];
+	[footprint addBytes:[mTextAdornment undoCost] + [[mTextAdornment string] undoCost]
+			 toCategory:kDKFootprintObjects];
+	[footprint addBytes:[mTextAdornment layoutBytesForObject:self]
+			 toCategory:kDKFootprintTextCaches];
+}
+
 - (void)drawContent
 {
 	if (![[self style] isEmpty])
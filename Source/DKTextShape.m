@@ -22,6 +22,8 @@
 #import "NSAttributedString+DKAdditions.h"
 #import "DKKnob.h"
 #import "DKDrawableShape+Utilities.h"
+#import "DKMemoryFootprint.h"
+#import "GCUndoManager.h"
 
 NSString* kDKTextOverflowIndicatorDefaultsKey = @"DKTextOverflowIndicator";
 NSString* kDKTextAllowsInlineImagesDefaultsKey = @"DKTextAllowsInlineImages";
@@ -1480,6 +1482,17 @@ static NSString* sDefault_string = @"Double-click to edit this text";
 	[super styleDidChange:note];
 }
 
+- (void)addFootprintToReport:(DKMemoryFootprint*)footprint
+{
+	// the text is the object's own, but its layout is kept by the adornment
+
+	[super addFootprintToReport:footprint];
+	[footprint addBytes:[mTextAdornment undoCost] + [[mTextAdornment string] undoCost]
+			 toCategory:kDKFootprintObjects];
+	[footprint addBytes:[mTextAdornment layoutBytesForObject:self]
+			 toCategory:kDKFootprintTextCaches];
+}
+
 #pragma mark -
 #pragma mark As an NSObject
 - (void)dealloc
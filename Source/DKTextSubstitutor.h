@@ -16,11 +16,15 @@ This objects abstracts the text substitution task used by text adornments, et. a
  
  A non-property key can also have further flags, called subKeys. These are . delimited single character attributes which invoke specific behaviours. By default these
  are the digits 0-9 which extract the nth word from the original data, and the flags U, L and C which convert the data to upper, lower and capitalized strings respectively.
+
+ The keys found in a master string are shared by every substitutor with the same string, so copies of a style don't each parse it again. The substituted
+ string for each object is kept until the master string or one of the metadata values it refers to changes, so redrawing labels doesn't rebuild them.
 */
 @interface DKTextSubstitutor : NSObject <NSCoding> {
 	NSAttributedString* mMasterString;
 	NSMutableArray* mKeys;
 	BOOL mNeedsToEvaluate;
+	NSCache* mResults; // object (unretained) -> the metadata strings and the string substituted with them
 }
 
 + (NSString*)delimiterString;
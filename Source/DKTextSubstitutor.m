@@ -12,6 +12,30 @@
 NSString* kDKTextSubstitutorNewStringNotification = @"kDKTextSubstitutorNewStringNotification";
 
 #define TS_LAZY_EVALUATION 1
+#define kDKTextSubstitutorResultLimit 32768 // objects whose substituted strings are kept
+
+/// a substituted string, and the metadata strings that went into it
+
+@interface DKTextSubstitutionResult : NSObject {
+@public
+	NSArray* mValues;
+	NSAttributedString* mString;
+}
+
+@end
+
+@implementation DKTextSubstitutionResult
+
+- (void)dealloc
+{
+	[mValues release];
+	[mString release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
 
 @implementation DKTextSubstitutor
 
@@ -93,6 +117,7 @@ static NSString* sDelimiter = DEFAULT_DELIMITER_STRING;
 #endif
 
 		[oldString release];
+		[mResults removeAllObjects];
 		[[NSNotificationCenter defaultCenter] postNotificationName:kDKTextSubstitutorNewStringNotification
 															object:self];
 	}
@@ -149,7 +174,24 @@ static NSString* sDelimiter = DEFAULT_DELIMITER_STRING;
 - (void)processMasterString
 {
 	// extracts the keys for the master string and stores them in order with their ranges. This speeds up substitution because
-	// the find doesn't need to be repeated, only the replacement. This is redone whenever a new master string is set.
+	// the find doesn't need to be repeated, only the replacement. This is redone whenever a new master string is set. Keys don't change once
+	// made, so those for a given string are shared by all substitutors.
+
+	static NSCache* sCompiledStrings = nil;
+
+	if (sCompiledStrings == nil)
+		sCompiledStrings = [[NSCache alloc] init];
+
+	NSString* compiledKey = [[[self class] delimiterString] stringByAppendingString:[self string]];
+	NSArray* compiled = [sCompiledStrings objectForKey:compiledKey];
+
+	[mResults removeAllObjects];
+
+	if (compiled != nil) {
+		[mKeys setArray:compiled];
+		mNeedsToEvaluate = NO;
+		return;
+	}
 
 	NSScanner* scanner = [NSScanner scannerWithString:[self string]];
 	NSString* key;
@@ -233,6 +275,11 @@ static NSString* sDelimiter = DEFAULT_DELIMITER_STRING;
 
 	mNeedsToEvaluate = NO;
 
+	compiled = [mKeys copy];
+	[sCompiledStrings setObject:compiled
+						 forKey:compiledKey];
+	[compiled release];
+
 	LogEvent_(kReactiveEvent, @"completed processing of string '%@', result = %@", mMasterString, mKeys);
 }
 
@@ -258,27 +305,50 @@ static NSString* sDelimiter = DEFAULT_DELIMITER_STRING;
 	if ([mKeys count] == 0)
 		return [self masterString];
 
-	// apply keys:
-
-	NSMutableAttributedString* newString = [[self masterString] mutableCopy];
+	// look up the metadata. If it's the same as when the string was last made for this object, that string can be returned again
 
+	NSMutableArray* values = [NSMutableArray arrayWithCapacity:[mKeys count]];
 	NSEnumerator* iter = [mKeys objectEnumerator];
 	DKTextSubstitutionKey* key;
 	id metaObject;
 	NSString* subString;
-	NSInteger rangeAdjustment = 0;
-	NSRange range;
 
 	while ((key = [iter nextObject])) {
-		subString = @"";
+		subString = nil;
 
 		if ([anObject respondsToSelector:@selector(metadataObjectForKey:)]) {
 			metaObject = [anObject metadataObjectForKey:[key key]];
 
 			if (metaObject)
-				subString = [key stringByApplyingSubkeysToString:[self metadataStringFromObject:metaObject]];
+				subString = [self metadataStringFromObject:metaObject];
 		}
 
+		[values addObject:subString ? (id)[[subString copy] autorelease] : (id)[NSNull null]];
+	}
+
+	NSValue* objectKey = [NSValue valueWithNonretainedObject:anObject];
+	DKTextSubstitutionResult* result = [mResults objectForKey:objectKey];
+
+	if (result != nil && [result->mValues isEqualToArray:values])
+		return [[result->mString retain] autorelease];
+
+	// apply keys:
+
+	NSMutableAttributedString* newString = [[self masterString] mutableCopy];
+	NSUInteger i = 0;
+	NSInteger rangeAdjustment = 0;
+	NSRange range;
+
+	iter = [mKeys objectEnumerator];
+
+	while ((key = [iter nextObject])) {
+		subString = [values objectAtIndex:i++];
+
+		if (subString == (id)[NSNull null])
+			subString = @"";
+		else
+			subString = [key stringByApplyingSubkeysToString:subString];
+
 		range = [key range];
 
 		// compensate for string length changes:
@@ -292,7 +362,24 @@ static NSString* sDelimiter = DEFAULT_DELIMITER_STRING;
 		rangeAdjustment += [subString length] - range.length;
 	}
 
-	return [newString autorelease];
+	if (mResults == nil) {
+		mResults = [[NSCache alloc] init];
+		[mResults setCountLimit:kDKTextSubstitutorResultLimit];
+	}
+
+	result = [[DKTextSubstitutionResult alloc] init];
+	result->mValues = [values copy];
+	result->mString = [newString copy];
+	[mResults setObject:result
+				 forKey:objectKey];
+	[newString release];
+
+	// the cache may discard the result at any time, so it's returned autoreleased
+
+	NSAttributedString* substituted = [result->mString retain];
+	[result release];
+
+	return [substituted autorelease];
 }
 
 - (NSString*)metadataStringFromObject:(id)object
@@ -331,6 +418,7 @@ static NSString* sDelimiter = DEFAULT_DELIMITER_STRING;
 {
 	[mMasterString release];
 	[mKeys release];
+	[mResults release];
 	[super dealloc];
 }
 
@@ -59,6 +59,7 @@ tool's name and target first responder with this action.
 	NSInteger mPartcode; // partcode to pass back during mouse ops
 	BOOL mOpenedUndoGroup; // YES if an undo group was requested by the tool at some point
 	BOOL mAbortiveMouseDown; // YES flagged after exception during mouse down - rejects drag and up events
+	BOOL mUsesStaticSnapshot; // YES to draw from a snapshot of the static content while a tool tracks the mouse
 }
 
 /** @brief Set the operating scope for tools for this application
@@ -145,6 +146,21 @@ tool's name and target first responder with this action.
  */
 - (BOOL)automaticallyRevertsToSelectionTool;
 
+/** @brief Set whether the view is drawn from a snapshot of its static content while a tool tracks the mouse
+
+ When YES, once a tool other than a selection tool has handled mouse down, the view snapshots everything except the object being
+ edited - the object being created, or else the tool's target object - and until mouse up only that object is drawn live over the
+ snapshot, together with the tool's own graphics. Creating or editing an object over a dense drawing then costs about the same as over
+ an empty one. Other objects are not updated during the drag, and the edited object is temporarily drawn above them. Default is NO.
+ @param snapshot YES to use a snapshot while tracking, NO to redraw the content normally
+ */
+- (void)setUsesStaticContentSnapshot:(BOOL)snapshot;
+
+/** @brief Whether the view is drawn from a snapshot of its static content while a tool tracks the mouse
+ @return YES if a snapshot is used while tracking
+ */
+- (BOOL)usesStaticContentSnapshot;
+
 /** @brief Select the tool using its registered name based on the title of a UI control, etc.
 
  This is a convenience for hooking up a UI for picking a tool. You can set the title of a button to
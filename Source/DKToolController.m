@@ -66,6 +66,16 @@ NSString* kDKDrawingToolAutoActivatesLayerDefaultsKey = @"DKDrawingToolAutoActiv
  */
 - (DKLayer*)findEligibleLayerForTool:(DKDrawingTool*)tool;
 
+/** @brief Starts drawing the view from a snapshot of its static content, if set to do so
+
+ Called once the tool has handled mouse down. The object left out of the snapshot is the one pending creation in the active layer,
+ otherwise <target>.
+ @param tool the tool tracking the mouse
+ @param target the object under the mouse down, if any
+ */
+- (void)beginStaticContentSnapshotForTool:(DKDrawingTool*)tool target:(DKDrawableObject*)target;
+- (void)endStaticContentSnapshot;
+
 @end
 
 #pragma mark -
@@ -310,6 +320,25 @@ static DKDrawingTool* sGlobalTool = nil;
 	return mAutoRevert;
 }
 
+/** @brief Set whether the view is drawn from a snapshot of its static content while a tool tracks the mouse
+ @param snapshot YES to use a snapshot while tracking, NO to redraw the content normally
+ */
+- (void)setUsesStaticContentSnapshot:(BOOL)snapshot
+{
+	mUsesStaticSnapshot = snapshot;
+
+	if (!snapshot)
+		[self endStaticContentSnapshot];
+}
+
+/** @brief Whether the view is drawn from a snapshot of its static content while a tool tracks the mouse
+ @return YES if a snapshot is used while tracking
+ */
+- (BOOL)usesStaticContentSnapshot
+{
+	return mUsesStaticSnapshot;
+}
+
 /** @brief Draw any tool graphic content into the view
  @param rect the update rect in the view
  */
@@ -447,6 +476,29 @@ static DKDrawingTool* sGlobalTool = nil;
 	return nil;
 }
 
+- (void)beginStaticContentSnapshotForTool:(DKDrawingTool*)tool target:(DKDrawableObject*)target
+{
+	// selection tools can change any number of objects as they drag, so the content is never static for them
+
+	if (![self usesStaticContentSnapshot] || [tool isSelectionTool] || ![[self view] isKindOfClass:[DKDrawingView class]])
+		return;
+
+	DKDrawableObject* edited = target;
+
+	if ([[self activeLayer] isKindOfClass:[DKObjectOwnerLayer class]] && [(DKObjectOwnerLayer*)[self activeLayer] pendingObject] != nil)
+		edited = [(DKObjectOwnerLayer*)[self activeLayer] pendingObject];
+
+	LogEvent_(kInfoEvent, @"tool controller drawing from static snapshot, live object = %@", edited);
+
+	[(DKDrawingView*)[self view] beginStaticContentSnapshotExcludingObject:edited];
+}
+
+- (void)endStaticContentSnapshot
+{
+	if ([[self view] isKindOfClass:[DKDrawingView class]])
+		[(DKDrawingView*)[self view] endStaticContentSnapshot];
+}
+
 #pragma mark -
 #pragma mark - As a DKViewController
 
@@ -551,11 +603,15 @@ static DKDrawingTool* sGlobalTool = nil;
 									   layer:[self activeLayer]
 									   event:event
 									delegate:self];
+
+			[self beginStaticContentSnapshotForTool:ct
+											 target:target];
 		}
 		@catch (NSException* excp)
 		{
 			NSLog(@"caught exception on mouse down with tool - ignored (tool = %@, exception = %@)", ct, excp);
 
+			[self endStaticContentSnapshot];
 			[self closeUndoGroup];
 			[self stopAutoscrolling];
 
@@ -611,6 +667,7 @@ static DKDrawingTool* sGlobalTool = nil;
 		{
 			NSLog(@"caught exception when dragging with tool - ignored (tool = %@, exception = %@)", ct, excp);
 
+			[self endStaticContentSnapshot];
 			[self closeUndoGroup];
 			[self stopAutoscrolling];
 		}
@@ -653,6 +710,10 @@ static DKDrawingTool* sGlobalTool = nil;
 			undo = NO;
 		}
 
+		// the tool has finished with the object, so the content is drawn normally again
+
+		[self endStaticContentSnapshot];
+
 		BOOL isObjectLayer = [[self activeLayer] isKindOfClass:[DKObjectDrawingLayer class]];
 
 		if (isObjectLayer && undo) {
@@ -831,7 +892,7 @@ static DKDrawingTool* sGlobalTool = nil;
 	}
 
 	if ([item action] == @selector(selectDrawingToolByName:)) {
-		return [[DKToolRegistry sharedToolRegistry] drawingToolWithName:[item title]] != nil;
+		return [[DKToolRegistry sharedToolRegistry] containsToolWithName:[item title]];
 	}
 
 	if ([item action] == @selector(selectDrawingToolByRepresentedObject:))
@@ -8,13 +8,20 @@
 
 @class DKDrawingTool;
 
+// makes a new tool of the given class for a tool registered by -registerDrawingToolOfClass:withName:keyboardEquivalent:modifierFlags:factory:.
+// The caller releases the tool
+
+typedef DKDrawingTool* (*DKDrawingToolFactory)(Class toolClass);
+
 /** @brief DKToolRegistry takes over the tool collection functionality formerly part of DKDrawingTool itself.
 
 DKToolRegistry takes over the tool collection functionality formerly part of DKDrawingTool itself. The old methods in DKDrawingTool now map to this class for backward
  compatibility but are deprecated.
 */
 @interface DKToolRegistry : NSObject {
-	NSMutableDictionary* mToolsReg;
+	NSMutableDictionary* mToolsReg; // name -> tool, for the tools made so far
+	NSMutableDictionary* mToolDescriptors; // name -> how to make a tool that hasn't been asked for yet
+	NSMutableDictionary* mKeyboardEquivalents; // modifier flags and key -> the name of the tool they select
 }
 
 /** @brief Return the shared tool registry
@@ -37,6 +44,31 @@ DKToolRegistry takes over the tool collection functionality formerly part of DKD
  */
 - (void)registerDrawingTool:(DKDrawingTool*)tool withName:(NSString*)name;
 
+/** @brief Add a tool to the registry, to be made the first time it is asked for
+
+ Registering a tool this way costs almost nothing. It is made when -drawingToolWithName:,
+ -drawingToolWithKeyboardEquivalent: or -tools first needs it, and is given the keyboard equivalent
+ then. kDKDrawingToolWasRegisteredNotification is posted when it is made.
+ @param toolClass the class of the tool
+ @param name the name of the tool
+ @param key the keyboard equivalent, or nil for none
+ @param flags the modifier flags of the keyboard equivalent
+ @param factory a function that makes the tool, or NULL to make it with -init
+ */
+- (void)registerDrawingToolOfClass:(Class)toolClass withName:(NSString*)name keyboardEquivalent:(NSString*)key modifierFlags:(NSUInteger)flags factory:(DKDrawingToolFactory)factory;
+
+/** @brief Whether a tool is registered with the name, without making it if it hasn't been made
+ @param name the name of the tool of interest
+ @return YES if there's a tool with the name
+ */
+- (BOOL)containsToolWithName:(NSString*)name;
+
+/** @brief The class of a named tool, without making it if it hasn't been made
+ @param name the name of the tool of interest
+ @return the class, or Nil if there's no tool with the name
+ */
+- (Class)classOfToolWithName:(NSString*)name;
+
 /** @brief Find the tool having a key equivalent matching the key event
  @param keyEvent the key event to match
  @return the tool if found, or nil
@@ -53,6 +85,7 @@ DKToolRegistry takes over the tool collection functionality formerly part of DKD
 // notifications
 
 extern NSString* kDKDrawingToolWasRegisteredNotification;
+extern NSString* kDKDrawingToolKeyboardEquivalentDidChangeNotification;
 
 // standard tool name constants
 
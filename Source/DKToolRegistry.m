@@ -22,6 +22,7 @@
 // notifications
 
 NSString* kDKDrawingToolWasRegisteredNotification = @"kDKDrawingToolWasRegisteredNotification";
+NSString* kDKDrawingToolKeyboardEquivalentDidChangeNotification = @"kDKDrawingToolKeyboardEquivalentDidChangeNotification";
 
 // standard tool names
 
@@ -46,6 +47,199 @@ NSString* kDKStandardDeletePathPointToolName = @"Delete Path Point";
 NSString* kDKStandardDeletePathSegmentToolName = @"Delete Path Segment";
 NSString* kDKStandardZoomToolName = @"Zoom";
 
+// how to make a tool that hasn't been asked for yet
+
+@interface DKToolDescriptor : NSObject {
+@public
+	Class mToolClass;
+	NSString* mKeyboardEquivalent;
+	NSUInteger mModifierFlags;
+	DKDrawingToolFactory mFactory;
+}
+
+@end
+
+@implementation DKToolDescriptor
+
+- (void)dealloc
+{
+	[mKeyboardEquivalent release];
+	[super dealloc];
+}
+
+@end
+
+#pragma mark -
+
+@interface DKToolRegistry (Private)
+
+- (DKDrawingTool*)makeToolWithName:(NSString*)name;
+- (void)indexKeyboardEquivalent:(NSString*)key modifierFlags:(NSUInteger)flags forToolWithName:(NSString*)name;
+- (void)toolDidChangeKeyboardEquivalent:(NSNotification*)note;
+
+@end
+
+// the key of a keyboard equivalent in the index
+
+static NSString* equivalentKey(NSString* key, NSUInteger flags)
+{
+	return [NSString stringWithFormat:@"%lu %@", (unsigned long)flags, key];
+}
+
+#pragma mark -
+
+// the standard tools are made by these the first time they're asked for. Each returns a new tool, which the caller releases
+
+static DKDrawingTool* newCreationTool(Class toolClass, id prototype)
+{
+	DKDrawingTool* tool = [[toolClass alloc] initWithPrototypeObject:prototype];
+	[prototype release];
+
+	return tool;
+}
+
+static DKDrawingTool* newShapeTool(Class toolClass, NSBezierPath* path)
+{
+	DKDrawableShape* shape = [[[DKDrawableObject classForConversionRequestFor:[DKDrawableShape class]] alloc] init];
+	[shape setPath:path];
+
+	return newCreationTool(toolClass, shape);
+}
+
+static DKDrawingTool* newRectangleTool(Class toolClass)
+{
+	return newShapeTool(toolClass, [DKShapeFactory rect]);
+}
+
+static DKDrawingTool* newOvalTool(Class toolClass)
+{
+	return newShapeTool(toolClass, [DKShapeFactory oval]);
+}
+
+static DKDrawingTool* newRingTool(Class toolClass)
+{
+	return newShapeTool(toolClass, [DKShapeFactory ring:0.67]);
+}
+
+static DKDrawingTool* newReshapableShapeTool(Class toolClass, SEL selector, id param)
+{
+	DKReshapableShape* rss = [[[DKDrawableObject classForConversionRequestFor:[DKReshapableShape class]] alloc] init];
+	[rss setShapeProvider:[DKShapeFactory sharedShapeFactory]
+				 selector:selector];
+
+	if (param)
+		[rss setOptionalParameter:param];
+
+	return newCreationTool(toolClass, rss);
+}
+
+static DKDrawingTool* newRoundRectangleTool(Class toolClass)
+{
+	return newReshapableShapeTool(toolClass, @selector(roundRectInRect:objParam:), [NSNumber numberWithDouble:16.0]);
+}
+
+static DKDrawingTool* newRoundEndedRectangleTool(Class toolClass)
+{
+	return newReshapableShapeTool(toolClass, @selector(roundEndedRect:objParam:), nil);
+}
+
+static DKDrawingTool* newSpeechBalloonTool(Class toolClass)
+{
+	return newReshapableShapeTool(toolClass, @selector(speechBalloonInRect:objParam:), nil);
+}
+
+static DKDrawingTool* newTextBoxTool(Class toolClass)
+{
+	return newCreationTool(toolClass, [[[DKDrawableObject classForConversionRequestFor:[DKTextShape class]] alloc] init]);
+}
+
+static DKDrawingTool* newTextPathTool(Class toolClass)
+{
+	DKTextPath* tPath = [[[DKDrawableObject classForConversionRequestFor:[DKTextPath class]] alloc] init];
+	[tPath setPathCreationMode:kDKPathCreateModeBezierCreate];
+
+	return newCreationTool(toolClass, tPath);
+}
+
+static DKDrawingTool* newPathTool(Class toolClass, DKDrawablePathCreationMode mode)
+{
+	DKDrawablePath* path = [[[DKDrawableObject classForConversionRequestFor:[DKDrawablePath class]] alloc] init];
+	[path setPathCreationMode:mode];
+
+	return newCreationTool(toolClass, path);
+}
+
+static DKDrawingTool* newBezierPathTool(Class toolClass)
+{
+	return newPathTool(toolClass, kDKPathCreateModeBezierCreate);
+}
+
+static DKDrawingTool* newLineTool(Class toolClass)
+{
+	return newPathTool(toolClass, kDKPathCreateModeLineCreate);
+}
+
+static DKDrawingTool* newPolygonTool(Class toolClass)
+{
+	return newPathTool(toolClass, kDKPathCreateModePolygonCreate);
+}
+
+static DKDrawingTool* newFreehandTool(Class toolClass)
+{
+	return newPathTool(toolClass, kDKPathCreateModeFreehandCreate);
+}
+
+static DKDrawingTool* newRegularPolygonTool(Class toolClass)
+{
+	DKRegularPolygonPath* path = [[[DKDrawableObject classForConversionRequestFor:[DKRegularPolygonPath class]] alloc] init];
+	[path setPathCreationMode:kDKRegularPolyCreationMode];
+	[path setShowsSpreadControls:YES];
+
+	return newCreationTool(toolClass, path);
+}
+
+static DKDrawingTool* newArcTool(Class toolClass)
+{
+	DKArcPath* arc = [[[DKDrawableObject classForConversionRequestFor:[DKArcPath class]] alloc] init];
+	[arc setArcType:kDKArcPathOpenArc];
+	[arc setStyle:[DKStyle defaultTrackStyle]];
+	[arc setPathCreationMode:kDKPathCreateModeArcSegment];
+
+	return newCreationTool(toolClass, arc);
+}
+
+static DKDrawingTool* newWedgeTool(Class toolClass)
+{
+	DKArcPath* arc = [[[DKDrawableObject classForConversionRequestFor:[DKArcPath class]] alloc] init];
+	[arc setArcType:kDKArcPathWedge];
+	[arc setPathCreationMode:kDKArcSimpleCreationMode];
+
+	return newCreationTool(toolClass, arc);
+}
+
+static DKDrawingTool* newPathDeletionTool(Class toolClass)
+{
+#pragma unused(toolClass)
+
+	return [[DKPathInsertDeleteTool pathDeletionTool] retain];
+}
+
+static DKDrawingTool* newPathInsertionTool(Class toolClass)
+{
+#pragma unused(toolClass)
+
+	return [[DKPathInsertDeleteTool pathInsertionTool] retain];
+}
+
+static DKDrawingTool* newPathElementDeletionTool(Class toolClass)
+{
+#pragma unused(toolClass)
+
+	return [[DKPathInsertDeleteTool pathElementDeletionTool] retain];
+}
+
+#pragma mark -
+
 @implementation DKToolRegistry
 
 static DKToolRegistry* s_toolRegistry = nil;
@@ -74,7 +268,12 @@ static DKToolRegistry* s_toolRegistry = nil;
 {
 	NSAssert(name != nil, @"cannot find a tool with a nil name");
 
-	return [mToolsReg objectForKey:name];
+	DKDrawingTool* tool = [mToolsReg objectForKey:name];
+
+	if (tool == nil)
+		tool = [self makeToolWithName:name];
+
+	return tool;
 }
 
 /** @brief Add a tool to the registry
@@ -87,8 +286,12 @@ static DKToolRegistry* s_toolRegistry = nil;
 	NSAssert(name != nil, @"cannot register a tool with a nil name");
 	NSAssert([name length] > 0, @"cannot register a tool with an empty name");
 
+	[mToolDescriptors removeObjectForKey:name];
 	[mToolsReg setObject:tool
 				  forKey:name];
+	[self indexKeyboardEquivalent:[tool keyboardEquivalent]
+					modifierFlags:[tool keyboardModifierFlags]
+				  forToolWithName:name];
 
 	// for compatibility, notification object is the tool, not the registry
 
@@ -96,6 +299,44 @@ static DKToolRegistry* s_toolRegistry = nil;
 														object:tool];
 }
 
+- (void)registerDrawingToolOfClass:(Class)toolClass withName:(NSString*)name keyboardEquivalent:(NSString*)key modifierFlags:(NSUInteger)flags factory:(DKDrawingToolFactory)factory
+{
+	NSAssert(toolClass != Nil, @"cannot register a tool without a class");
+	NSAssert(name != nil, @"cannot register a tool with a nil name");
+	NSAssert([name length] > 0, @"cannot register a tool with an empty name");
+
+	DKToolDescriptor* desc = [[DKToolDescriptor alloc] init];
+
+	desc->mToolClass = toolClass;
+	desc->mKeyboardEquivalent = [key copy];
+	desc->mModifierFlags = flags;
+	desc->mFactory = factory;
+
+	[mToolsReg removeObjectForKey:name];
+	[mToolDescriptors setObject:desc
+						 forKey:name];
+	[desc release];
+
+	[self indexKeyboardEquivalent:key
+					modifierFlags:flags
+				  forToolWithName:name];
+}
+
+- (BOOL)containsToolWithName:(NSString*)name
+{
+	return [mToolsReg objectForKey:name] != nil || [mToolDescriptors objectForKey:name] != nil;
+}
+
+- (Class)classOfToolWithName:(NSString*)name
+{
+	DKToolDescriptor* desc = [mToolDescriptors objectForKey:name];
+
+	if (desc)
+		return desc->mToolClass;
+
+	return [[mToolsReg objectForKey:name] class];
+}
+
 /** @brief Find the tool having a key equivalent matching the key event
  @param keyEvent the key event to match
  @return the tool if found, or nil
@@ -105,281 +346,210 @@ static DKToolRegistry* s_toolRegistry = nil;
 	NSAssert(keyEvent != nil, @"event was nil");
 
 	if ([keyEvent type] == NSKeyDown) {
-		NSEnumerator* iter = [[mToolsReg allKeys] objectEnumerator];
-		NSString* name;
-		NSString* keyEquivalent;
-		DKDrawingTool* tool;
-		NSUInteger flags;
+		NSString* key = equivalentKey([keyEvent charactersIgnoringModifiers], NSDeviceIndependentModifierFlagsMask & [keyEvent modifierFlags]);
+		NSString* name = [mKeyboardEquivalents objectForKey:key];
 
-		//NSLog(@"looking for tool with keyboard equivalent, string = '%@', modifers = %d", [keyEvent charactersIgnoringModifiers], [keyEvent modifierFlags]);
-
-		while ((name = [iter nextObject])) {
-			tool = [mToolsReg objectForKey:name];
-
-			keyEquivalent = [tool keyboardEquivalent];
-			flags = [tool keyboardModifierFlags];
-
-			if ([keyEquivalent isEqualToString:[keyEvent charactersIgnoringModifiers]]) {
-				if ((NSDeviceIndependentModifierFlagsMask & [keyEvent modifierFlags]) == flags)
-					return tool;
-			}
-		}
+		if (name)
+			return [self drawingToolWithName:name];
 	}
 	return nil;
 }
 
 - (void)registerStandardTools
 {
-	// ------ rect ------
-
-	Class trueClass;
-
-	trueClass = [DKDrawableObject classForConversionRequestFor:[DKDrawableShape class]];
-
-	DKDrawableShape* shape = [[trueClass alloc] init];
-	[shape setPath:[DKShapeFactory rect]];
-	DKDrawingTool* dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:shape];
-	[shape release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardRectangleToolName];
-	[dt setKeyboardEquivalent:@"r"
-				modifierFlags:0];
-	[dt release];
-
-	// -------- oval -------
-
-	shape = [[trueClass alloc] init];
-	[shape setPath:[DKShapeFactory oval]];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:shape];
-	[shape release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardOvalToolName];
-	[dt setKeyboardEquivalent:@"o"
-				modifierFlags:0];
-	[dt release];
-
-	// -------- ring -------
-
-	shape = [[trueClass alloc] init];
-	[shape setPath:[DKShapeFactory ring:0.67]];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:shape];
-	[shape release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardRingToolName];
-	[dt release];
-
-	// ----- roundrect -----
-
-	trueClass = [DKDrawableObject classForConversionRequestFor:[DKReshapableShape class]];
+	// the tools are only made when they're first asked for, so this is cheap enough to do on the launch path
+
+	Class creationTool = [DKObjectCreationTool class];
+
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardRectangleToolName
+				  keyboardEquivalent:@"r"
+					   modifierFlags:0
+							 factory:newRectangleTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardOvalToolName
+				  keyboardEquivalent:@"o"
+					   modifierFlags:0
+							 factory:newOvalTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardRingToolName
+				  keyboardEquivalent:nil
+					   modifierFlags:0
+							 factory:newRingTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardRoundRectangleToolName
+				  keyboardEquivalent:nil
+					   modifierFlags:0
+							 factory:newRoundRectangleTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardRoundEndedRectangleToolName
+				  keyboardEquivalent:nil
+					   modifierFlags:0
+							 factory:newRoundEndedRectangleTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardSpeechBalloonToolName
+				  keyboardEquivalent:nil
+					   modifierFlags:0
+							 factory:newSpeechBalloonTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardTextBoxToolName
+				  keyboardEquivalent:@"t"
+					   modifierFlags:0
+							 factory:newTextBoxTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardTextPathToolName
+				  keyboardEquivalent:@"e"
+					   modifierFlags:0
+							 factory:newTextPathTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardBezierPathToolName
+				  keyboardEquivalent:@"b"
+					   modifierFlags:0
+							 factory:newBezierPathTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardStraightLinePathToolName
+				  keyboardEquivalent:@"l"
+					   modifierFlags:0
+							 factory:newLineTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardIrregularPolygonPathToolName
+				  keyboardEquivalent:@"p"
+					   modifierFlags:0
+							 factory:newPolygonTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardFreehandPathToolName
+				  keyboardEquivalent:@"f"
+					   modifierFlags:0
+							 factory:newFreehandTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardRegularPolygonPathToolName
+				  keyboardEquivalent:@"g"
+					   modifierFlags:0
+							 factory:newRegularPolygonTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardArcToolName
+				  keyboardEquivalent:@"a"
+					   modifierFlags:0
+							 factory:newArcTool];
+	[self registerDrawingToolOfClass:creationTool
+							withName:kDKStandardWedgeToolName
+				  keyboardEquivalent:@"w"
+					   modifierFlags:0
+							 factory:newWedgeTool];
 
-	DKReshapableShape* rss = [[trueClass alloc] init];
-	[rss setShapeProvider:[DKShapeFactory sharedShapeFactory]
-				 selector:@selector(roundRectInRect:
-										   objParam:)];
-	[rss setOptionalParameter:[NSNumber numberWithDouble:16.0]];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:rss];
-	[rss release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardRoundRectangleToolName];
-	[dt release];
-
-	// ----- roundendrect -----
-
-	rss = [[trueClass alloc] init];
-	[rss setShapeProvider:[DKShapeFactory sharedShapeFactory]
-				 selector:@selector(roundEndedRect:
-										  objParam:)];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:rss];
-	[rss release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardRoundEndedRectangleToolName];
-	[dt release];
-
-	// ----- speech balloon ----
-
-	rss = [[trueClass alloc] init];
-	[rss setShapeProvider:[DKShapeFactory sharedShapeFactory]
-				 selector:@selector(speechBalloonInRect:
-											   objParam:)];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:rss];
-	[rss release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardSpeechBalloonToolName];
-	[dt release];
-
-	// ------ text shape ------
-
-	trueClass = [DKDrawableObject classForConversionRequestFor:[DKTextShape class]];
+	// ----- path add/delete tools ----
 
-	DKTextShape* tshape = [[trueClass alloc] init];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:tshape];
-	[tshape release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardTextBoxToolName];
-	[dt setKeyboardEquivalent:@"t"
-				modifierFlags:0];
-	[dt release];
+	[self registerDrawingToolOfClass:[DKPathInsertDeleteTool class]
+							withName:kDKStandardDeletePathPointToolName
+				  keyboardEquivalent:nil
+					   modifierFlags:0
+							 factory:newPathDeletionTool];
+	[self registerDrawingToolOfClass:[DKPathInsertDeleteTool class]
+							withName:kDKStandardAddPathPointToolName
+				  keyboardEquivalent:nil
+					   modifierFlags:0
+							 factory:newPathInsertionTool];
+	[self registerDrawingToolOfClass:[DKPathInsertDeleteTool class]
+							withName:kDKStandardDeletePathSegmentToolName
+				  keyboardEquivalent:@"x"
+					   modifierFlags:0
+							 factory:newPathElementDeletionTool];
+
+	// ----- zoom and select and edit tools -----
+
+	[self registerDrawingToolOfClass:[DKZoomTool class]
+							withName:kDKStandardZoomToolName
+				  keyboardEquivalent:@"z"
+					   modifierFlags:0
+							 factory:NULL];
+	[self registerDrawingToolOfClass:[DKSelectAndEditTool class]
+							withName:kDKStandardSelectionToolName
+				  keyboardEquivalent:@" "
+					   modifierFlags:0
+							 factory:NULL];
+}
 
-	// ------ text path -----
+- (NSArray*)toolNames
+{
+	NSMutableArray* tn = [[mToolsReg allKeys] mutableCopy];
+	[tn addObjectsFromArray:[mToolDescriptors allKeys]];
+	[tn sortUsingSelector:@selector(compare:)];
 
-	trueClass = [DKDrawableObject classForConversionRequestFor:[DKTextPath class]];
+	return [tn autorelease];
+}
 
-	DKTextPath* tPath = [[trueClass alloc] init];
-	[tPath setPathCreationMode:kDKPathCreateModeBezierCreate];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:tPath];
-	[tPath release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardTextPathToolName];
-	[dt setKeyboardEquivalent:@"e"
-				modifierFlags:0];
-	[dt release];
-
-	// -------- bezier path -------
-
-	trueClass = [DKDrawableObject classForConversionRequestFor:[DKDrawablePath class]];
-
-	DKDrawablePath* path = [[trueClass alloc] init];
-	[path setPathCreationMode:kDKPathCreateModeBezierCreate];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:path];
-	[path release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardBezierPathToolName];
-	[dt setKeyboardEquivalent:@"b"
-				modifierFlags:0];
-	[dt release];
-
-	//-------- line ---------
-
-	path = [[trueClass alloc] init];
-	[path setPathCreationMode:kDKPathCreateModeLineCreate];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:path];
-	[path release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardStraightLinePathToolName];
-	[dt setKeyboardEquivalent:@"l"
-				modifierFlags:0];
-	[dt release];
-
-	//-------- polygon ---------
-
-	path = [[trueClass alloc] init];
-	[path setPathCreationMode:kDKPathCreateModePolygonCreate];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:path];
-	[path release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardIrregularPolygonPathToolName];
-	[dt setKeyboardEquivalent:@"p"
-				modifierFlags:0];
-	[dt release];
-
-	//-------- freehand -------
-
-	path = [[trueClass alloc] init];
-	[path setPathCreationMode:kDKPathCreateModeFreehandCreate];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:path];
-	[path release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardFreehandPathToolName];
-	[dt setKeyboardEquivalent:@"f"
-				modifierFlags:0];
-	[dt release];
-
-	//-------- regular polygon ---------
-
-	trueClass = [DKDrawableObject classForConversionRequestFor:[DKRegularPolygonPath class]];
-
-	path = [[trueClass alloc] init];
-	[path setPathCreationMode:kDKRegularPolyCreationMode];
-	[(DKRegularPolygonPath*)path setShowsSpreadControls:YES];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:path];
-	[path release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardRegularPolygonPathToolName];
-	[dt setKeyboardEquivalent:@"g"
-				modifierFlags:0];
-	[dt release];
+- (NSArray*)allKeysForTool:(DKDrawingTool*)tool
+{
+	NSAssert(tool != nil, @"cannot find keys for a nil tool");
+	return [mToolsReg allKeysForObject:tool];
+}
 
-	//-------- arc ---------
+- (NSArray*)tools
+{
+	NSEnumerator* iter = [[mToolDescriptors allKeys] objectEnumerator];
+	NSString* name;
 
-	trueClass = [DKDrawableObject classForConversionRequestFor:[DKArcPath class]];
+	while ((name = [iter nextObject]))
+		[self makeToolWithName:name];
 
-	DKArcPath* arc = [[trueClass alloc] init];
-	[arc setArcType:kDKArcPathOpenArc];
-	[arc setStyle:[DKStyle defaultTrackStyle]];
-	[arc setPathCreationMode:kDKPathCreateModeArcSegment];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:arc];
-	[arc release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardArcToolName];
-	[dt setKeyboardEquivalent:@"a"
-				modifierFlags:0];
-	[dt release];
+	return [mToolsReg allValues];
+}
 
-	//-------- wedge ---------
+#pragma mark -
 
-	arc = [[trueClass alloc] init];
-	[arc setArcType:kDKArcPathWedge];
-	[arc setPathCreationMode:kDKArcSimpleCreationMode];
-	dt = [[DKObjectCreationTool alloc] initWithPrototypeObject:arc];
-	[arc release];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardWedgeToolName];
-	[dt setKeyboardEquivalent:@"w"
-				modifierFlags:0];
-	[dt release];
+- (DKDrawingTool*)makeToolWithName:(NSString*)name
+{
+	DKToolDescriptor* desc = [mToolDescriptors objectForKey:name];
 
-	// ----- path add/delete tools ----
+	if (desc == nil)
+		return nil;
 
-	dt = [DKPathInsertDeleteTool pathDeletionTool];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardDeletePathPointToolName];
+	DKDrawingTool* tool;
 
-	dt = [DKPathInsertDeleteTool pathInsertionTool];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardAddPathPointToolName];
+	if (desc->mFactory)
+		tool = desc->mFactory(desc->mToolClass);
+	else
+		tool = [[desc->mToolClass alloc] init];
 
-	dt = [DKPathInsertDeleteTool pathElementDeletionTool];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardDeletePathSegmentToolName];
-	[dt setKeyboardEquivalent:@"x"
-				modifierFlags:0];
+	if (tool == nil) {
+		NSLog(@"%@ ! the tool '%@' could not be made", self, name);
+		return nil;
+	}
 
-	// ----- zoom tool -----
+	if ([desc->mKeyboardEquivalent length] > 0)
+		[tool setKeyboardEquivalent:desc->mKeyboardEquivalent
+					  modifierFlags:desc->mModifierFlags];
 
-	dt = [[DKZoomTool alloc] init];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardZoomToolName];
-	[dt setKeyboardEquivalent:@"z"
-				modifierFlags:0];
-	[dt release];
+	// registering the tool replaces the descriptor
 
-	// ----- select and edit tool -----
+	[self registerDrawingTool:tool
+					 withName:name];
+	[tool release];
 
-	dt = [[DKSelectAndEditTool alloc] init];
-	[self registerDrawingTool:dt
-					 withName:kDKStandardSelectionToolName];
-	[dt setKeyboardEquivalent:@" "
-				modifierFlags:0];
-	[dt release];
+	return tool;
 }
 
-- (NSArray*)toolNames
+- (void)indexKeyboardEquivalent:(NSString*)key modifierFlags:(NSUInteger)flags forToolWithName:(NSString*)name
 {
-	NSMutableArray* tn = [[mToolsReg allKeys] mutableCopy];
-	[tn sortUsingSelector:@selector(compare:)];
+	// a tool has one equivalent at most, and only its first character counts
 
-	return [tn autorelease];
-}
+	[mKeyboardEquivalents removeObjectsForKeys:[mKeyboardEquivalents allKeysForObject:name]];
 
-- (NSArray*)allKeysForTool:(DKDrawingTool*)tool
-{
-	NSAssert(tool != nil, @"cannot find keys for a nil tool");
-	return [mToolsReg allKeysForObject:tool];
+	if ([key length] > 0)
+		[mKeyboardEquivalents setObject:name
+								 forKey:equivalentKey([key substringToIndex:1], flags)];
 }
 
-- (NSArray*)tools
+- (void)toolDidChangeKeyboardEquivalent:(NSNotification*)note
 {
-	return [mToolsReg allValues];
+	DKDrawingTool* tool = [note object];
+	NSEnumerator* iter = [[mToolsReg allKeysForObject:tool] objectEnumerator];
+	NSString* name;
+
+	while ((name = [iter nextObject]))
+		[self indexKeyboardEquivalent:[tool keyboardEquivalent]
+						modifierFlags:[tool keyboardModifierFlags]
+					  forToolWithName:name];
 }
 
 #pragma mark -
@@ -390,6 +560,15 @@ static DKToolRegistry* s_toolRegistry = nil;
 	self = [super init];
 	if (self) {
 		mToolsReg = [[NSMutableDictionary alloc] init];
+		mToolDescriptors = [[NSMutableDictionary alloc] init];
+		mKeyboardEquivalents = [[NSMutableDictionary alloc] init];
+
+		// the index of keyboard equivalents is kept up to date as the tools' equivalents are changed
+
+		[[NSNotificationCenter defaultCenter] addObserver:self
+												 selector:@selector(toolDidChangeKeyboardEquivalent:)
+													 name:kDKDrawingToolKeyboardEquivalentDidChangeNotification
+												   object:nil];
 	}
 
 	return self;
@@ -397,7 +576,10 @@ static DKToolRegistry* s_toolRegistry = nil;
 
 - (void)dealloc
 {
+	[[NSNotificationCenter defaultCenter] removeObserver:self];
 	[mToolsReg release];
+	[mToolDescriptors release];
+	[mKeyboardEquivalents release];
 	[super dealloc];
 }
 
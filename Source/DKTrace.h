@@ -0,0 +1,76 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Foundation/Foundation.h>
+
+/** @brief Tracing for DrawKit's hot paths.
+
+ DKTrace_ is used in place of LogEvent_ where a call may be made many times per event - in storage, drawing and undo - since LogEvent
+ formats its arguments and consults the logging controller before it knows whether anything is to be logged. DKTrace_ tests a single
+ global mask first, and evaluates its arguments only if the category is on, so a disabled trace costs one load and a branch. Defining
+ DK_TRACE_ENABLED as 0 removes the traces altogether.
+
+ The categories correspond to LogEvent's event types. Traces are written to the unified log (os_log) where it is available, under the
+ subsystem "com.drawkit" with a log category per trace category, so they can be filtered in Console and Instruments; otherwise they are
+ written with NSLog. The categories traced are set with DKSetTraceCategories(), or initially from the user default DKTraceCategories.
+*/
+
+typedef enum {
+	kDKTraceWhenever = (1 << 0),
+	kDKTraceUser = (1 << 1),
+	kDKTraceScript = (1 << 2),
+	kDKTraceReactive = (1 << 3),
+	kDKTraceUI = (1 << 4),
+	kDKTraceFile = (1 << 5),
+	kDKTraceLife = (1 << 6),
+	kDKTraceState = (1 << 7),
+	kDKTraceInfo = (1 << 8),
+	kDKTraceKVO = (1 << 9),
+	kDKTraceUndo = (1 << 10),
+	kDKTraceAll = 0x7FF
+} DKTraceCategory;
+
+#ifndef DK_TRACE_ENABLED
+#define DK_TRACE_ENABLED 1
+#endif
+
+#if DK_TRACE_ENABLED
+
+extern volatile uint32_t gDKTraceCategories;
+
+#define DKTrace_(category, ...)                                                  \
+	do {                                                                         \
+		if (__builtin_expect((gDKTraceCategories & (uint32_t)(category)) != 0, 0)) \
+			DKTrace((category), __VA_ARGS__);                                    \
+	} while (0)
+
+#else
+
+#define DKTrace_(category, ...) \
+	do {                        \
+	} while (0)
+
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** @brief Sets the categories that are traced
+ @param categories a mask of DKTraceCategory values, or 0 to trace nothing */
+void DKSetTraceCategories(uint32_t categories);
+uint32_t DKTraceCategories(void);
+
+/** @brief Writes a trace message, whether or not its category is on
+
+ Use DKTrace_ rather than calling this directly.
+ @param category the category of the message
+ @param format a format string, followed by its arguments */
+void DKTrace(DKTraceCategory category, NSString* format, ...);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,86 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "DKTrace.h"
+
+#if defined(__has_include)
+#if __has_include(<os/log.h>)
+#import <os/log.h>
+#define DK_TRACE_OS_LOG 1
+#endif
+#endif
+
+#define kDKTraceCategoryCount 11
+
+volatile uint32_t gDKTraceCategories = 0;
+
+static NSString* const sCategoryNames[kDKTraceCategoryCount] = { @"Whenever", @"User", @"Script", @"Reactive", @"UI", @"File", @"Life", @"State", @"Info", @"KVO", @"Undo" };
+
+#pragma mark -
+
+// the initial categories come from the defaults, read when the library is loaded so that no trace has to check whether it's been done
+
+__attribute__((constructor)) static void loadTraceCategories(void)
+{
+	@autoreleasepool {
+		NSNumber* categories = [[NSUserDefaults standardUserDefaults] objectForKey:@"DKTraceCategories"];
+
+		if ([categories respondsToSelector:@selector(unsignedIntValue)])
+			gDKTraceCategories = [categories unsignedIntValue] & kDKTraceAll;
+	}
+}
+
+void DKSetTraceCategories(uint32_t categories)
+{
+	gDKTraceCategories = categories & kDKTraceAll;
+}
+
+uint32_t DKTraceCategories(void)
+{
+	return gDKTraceCategories;
+}
+
+#ifdef DK_TRACE_OS_LOG
+
+static os_log_t sTraceLogs[kDKTraceCategoryCount];
+
+static void makeTraceLogs(void* context)
+{
+#pragma unused(context)
+
+	NSInteger k;
+
+	for (k = 0; k < kDKTraceCategoryCount; ++k)
+		sTraceLogs[k] = os_log_create("com.drawkit", [sCategoryNames[k] UTF8String]);
+}
+
+#endif
+
+void DKTrace(DKTraceCategory category, NSString* format, ...)
+{
+	NSInteger index = 0;
+	va_list args;
+
+	while (index < kDKTraceCategoryCount - 1 && (category & (1 << index)) == 0)
+		++index;
+
+	va_start(args, format);
+	NSString* message = [[NSString alloc] initWithFormat:format
+											   arguments:args];
+	va_end(args);
+
+#ifdef DK_TRACE_OS_LOG
+	if (@available(macOS 10.12, *)) {
+		static dispatch_once_t once;
+		dispatch_once_f(&once, NULL, makeTraceLogs);
+
+		os_log_debug(sTraceLogs[index], "%{public}@", message);
+	} else
+#endif
+		NSLog(@"[%@] %@", sCategoryNames[index], message);
+
+	[message release];
+}
@@ -7,15 +7,37 @@
 #import <Cocoa/Cocoa.h>
 
 /** @brief this helper is used when unarchiving to translate class names from older files to their modern equivalents
+
+The helper also reports progress. The started and finished notifications are always sent, but continued notifications are coalesced so that
+no more than one is sent every kDKUnarchiverProgressInterval seconds, and the clock is only read every kDKUnarchiverProgressCheckCount objects.
+Notifications are delivered on the main thread; when dearchiving
+on another thread they are queued rather than waited for, and don't include the object just decoded, since it isn't finished yet.
+
+Each class name is translated once per dearchiving. Translations that aren't to DKNullObject are given to the unarchiver, which then no
+longer asks for them; the rest are looked up in the helper's table. -reset clears it.
+
+Dearchiving can be cancelled from any thread with -cancel, which makes the helper raise kDKUnarchiverCancelledException from within the
+unarchiver the next time an object is decoded.
 */
 @interface DKUnarchivingHelper : NSObject {
 	NSUInteger mCount;
+	NSUInteger mNextProgressCheck; // the count at which the time is next looked at
 	NSString* mLastClassnameSubstituted;
+	NSMutableDictionary* mSubstitutions; // class name -> Class substituted, or NSNull where none was found, since the last reset
+	NSTimeInterval mLastProgressTime;
+	volatile BOOL mCancelled;
 }
 
 - (void)reset;
 - (NSUInteger)numberOfObjectsDecoded;
 
+/** @brief Asks for the dearchiving in progress to stop
+
+ May be called from any thread. Cleared by -reset.
+ */
+- (void)cancel;
+- (BOOL)isCancelled;
+
 - (NSString*)lastClassnameSubstituted;
 
 @end
@@ -36,3 +58,12 @@ if a substitution would return NSObject, return this insead, which provides a st
 extern NSString* kDKUnarchiverProgressStartedNotification;
 extern NSString* kDKUnarchiverProgressContinuedNotification;
 extern NSString* kDKUnarchiverProgressFinishedNotification;
+extern NSString* kDKUnarchiverCancelledException;
+
+// the shortest time between progress continued notifications
+
+#define kDKUnarchiverProgressInterval 0.1
+
+// the number of objects decoded between looks at the time, to see whether a progress notification is due
+
+#define kDKUnarchiverProgressCheckCount 256
@@ -10,12 +10,47 @@
 NSString* kDKUnarchiverProgressStartedNotification = @"kDKUnarchiverProgressStartedNotification";
 NSString* kDKUnarchiverProgressContinuedNotification = @"kDKUnarchiverProgressContinuedNotification";
 NSString* kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgressFinishedNotification";
+NSString* kDKUnarchiverCancelledException = @"kDKUnarchiverCancelledException";
+
+@interface DKUnarchivingHelper (Private)
+
+- (void)postProgressNotification:(NSNotification*)note;
+- (Class)substituteClassForClassName:(NSString*)name originalClasses:(NSArray*)classNames;
+
+@end
+
+static NSDictionary* sRenamedClasses = nil;
+
+static void makeRenamedClasses(void* context)
+{
+#pragma unused(context)
+
+	// class names changed other than from 'GC' to 'DK'
+
+	sRenamedClasses = [[NSDictionary alloc] initWithObjectsAndKeys:@"DKLayer", @"DKDrawingLayer",
+														 @"DKStyle", @"DKDrawingStyle",
+														 @"DKGridLayer", @"DKGridDrawingLayer",
+														 @"DKRasterizer", @"DKRenderer",
+														 @"DKReshapableShape", @"DKDrawableShapeWithReshape",
+														 @"DKRastGroup", @"DKRendererGroup",
+														 @"DKCIFilterRastGroup", @"DKEffectRenderGroup",
+														 @"DKQuartzBlendRastGroup", @"DKBlendRenderGroup",
+														 @"DKImageAdornment", @"DKImageRenderer",
+														 @"DKTextAdornment", @"DKTextLabelRenderer",
+														 @"DKObjectDrawingLayer", @"DKObjectDrawingToolLayer", // obsolete class - just convert to plain drawing layer
+														 @"DKStrokeDash", @"DKLineDash",
+														 nil];
+}
 
 @implementation DKUnarchivingHelper
 
 - (void)reset
 {
 	mCount = 0;
+	mNextProgressCheck = 0;
+	mLastProgressTime = 0;
+	mCancelled = NO;
+	[mSubstitutions removeAllObjects];
 }
 
 - (NSUInteger)numberOfObjectsDecoded
@@ -23,28 +58,62 @@ NSString* kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgressFin
 	return mCount;
 }
 
+- (void)cancel
+{
+	mCancelled = YES;
+}
+
+- (BOOL)isCancelled
+{
+	return mCancelled;
+}
+
+- (void)postProgressNotification:(NSNotification*)note
+{
+	// on the main thread the notification is posted at once. From any other thread it's queued so that dearchiving isn't held up waiting
+	// for the main thread
+
+	if ([NSThread isMainThread])
+		[[NSNotificationCenter defaultCenter] postNotification:note];
+	else
+		[[NSNotificationCenter defaultCenter] performSelectorOnMainThread:@selector(postNotification:)
+															   withObject:note
+															waitUntilDone:NO];
+}
+
 - (id)unarchiver:(NSKeyedUnarchiver*)unarchiver didDecodeObject:(id)object
 {
 #pragma unused(unarchiver)
 
 	// this method tracks the number of objects decoded and also sends notifications about the dearchiving progress, allowing a dearchiving
-	// to drive a progress bar, etc. The notification is delivered on the main thread in case this is being invoked by a thread.
+	// to drive a progress bar, etc. Continued notifications are coalesced so that decoding many small objects isn't dominated by posting them.
 
-	NSDictionary* userInfo = [NSDictionary dictionaryWithObjectsAndKeys:[NSNumber numberWithInteger:mCount], @"count", object, @"decoded_object", nil];
-	NSNotification* note;
+	if (mCancelled)
+		[NSException raise:kDKUnarchiverCancelledException
+					format:@"dearchiving was cancelled after %lu objects", (unsigned long)mCount];
 
-	if (mCount == 0)
-		note = [NSNotification notificationWithName:kDKUnarchiverProgressStartedNotification
-											 object:self
-										   userInfo:userInfo];
-	else
-		note = [NSNotification notificationWithName:kDKUnarchiverProgressContinuedNotification
-											 object:self
-										   userInfo:userInfo];
+	if (mCount >= mNextProgressCheck) {
+		NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+
+		mNextProgressCheck = mCount + kDKUnarchiverProgressCheckCount;
+
+		if (mCount == 0 || now - mLastProgressTime >= kDKUnarchiverProgressInterval) {
+			// the decoded object is only passed on when dearchiving on the main thread, since elsewhere it would be shared while still being built
+
+			NSMutableDictionary* userInfo = [NSMutableDictionary dictionaryWithObject:[NSNumber numberWithInteger:mCount]
+																			   forKey:@"count"];
+			if ([NSThread isMainThread] && object)
+				[userInfo setObject:object
+							 forKey:@"decoded_object"];
 
-	[[NSNotificationCenter defaultCenter] performSelectorOnMainThread:@selector(postNotification:)
-														   withObject:note
-														waitUntilDone:[NSThread isMainThread]];
+			NSString* name = (mCount == 0) ? kDKUnarchiverProgressStartedNotification : kDKUnarchiverProgressContinuedNotification;
+
+			[self postProgressNotification:[NSNotification notificationWithName:name
+																		  object:self
+																		userInfo:userInfo]];
+			mLastProgressTime = now;
+		}
+	}
 
 	++mCount;
 
@@ -59,53 +128,63 @@ NSString* kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgressFin
 	NSNotification* note = [NSNotification notificationWithName:kDKUnarchiverProgressFinishedNotification
 														 object:self
 													   userInfo:userInfo];
-	[[NSNotificationCenter defaultCenter] performSelectorOnMainThread:@selector(postNotification:)
-														   withObject:note
-														waitUntilDone:[NSThread isMainThread]];
+	[self postProgressNotification:note];
 }
 
 - (Class)unarchiver:(NSKeyedUnarchiver*)unarchiver cannotDecodeObjectOfClassName:(NSString*)name originalClasses:(NSArray*)classNames
 {
-#pragma unused(unarchiver)
-#pragma unused(classNames)
+	id found = [mSubstitutions objectForKey:name];
+
+	if (found == nil) {
+		Class theClass = [self substituteClassForClassName:name
+										   originalClasses:classNames];
+
+		if (mSubstitutions == nil)
+			mSubstitutions = [[NSMutableDictionary alloc] init];
+
+		[mSubstitutions setObject:theClass ? (id)theClass : (id)[NSNull null]
+						   forKey:name];
+
+		// the unarchiver can use the class itself from now on, unless it's the null object, which needs to be told what it stands in for
+
+		if (theClass && theClass != [DKNullObject class])
+			[unarchiver setClass:theClass
+					forClassName:name];
+
+		return theClass;
+	}
+
+	if (found == [NSNull null])
+		return Nil;
+
+	if (found == [DKNullObject class]) {
+		[mLastClassnameSubstituted release];
+		mLastClassnameSubstituted = [name retain];
+	}
+
+	return (Class)found;
+}
+
+- (Class)substituteClassForClassName:(NSString*)name originalClasses:(NSArray*)classNames
+{
+	static dispatch_once_t once;
+
+	dispatch_once_f(&once, NULL, makeRenamedClasses);
 
 	// check the first two letters - if it's 'GC' try substituting this with 'DK' and see if that works - many classnames were changed
 	// in this way
 
-	NSString* newclass;
-	NSString* ss = [name substringWithRange:NSMakeRange(0, 2)];
+	NSString* newclass = name;
 
-	if ([ss isEqualToString:@"GC"])
-		newclass = [NSString stringWithFormat:@"DK%@", [name substringWithRange:NSMakeRange(2, [name length] - 2)]];
-	else
-		newclass = name;
-
-	// other class name changes - just check and substitute them individually
-
-	if ([newclass isEqualToString:@"DKDrawingLayer"])
-		newclass = @"DKLayer";
-	else if ([newclass isEqualToString:@"DKDrawingStyle"])
-		newclass = @"DKStyle";
-	else if ([newclass isEqualToString:@"DKGridDrawingLayer"])
-		newclass = @"DKGridLayer";
-	else if ([newclass isEqualToString:@"DKRenderer"])
-		newclass = @"DKRasterizer";
-	else if ([newclass isEqualToString:@"DKDrawableShapeWithReshape"])
-		newclass = @"DKReshapableShape";
-	else if ([newclass isEqualToString:@"DKRendererGroup"])
-		newclass = @"DKRastGroup";
-	else if ([newclass isEqualToString:@"DKEffectRenderGroup"])
-		newclass = @"DKCIFilterRastGroup";
-	else if ([newclass isEqualToString:@"DKBlendRenderGroup"])
-		newclass = @"DKQuartzBlendRastGroup";
-	else if ([newclass isEqualToString:@"DKImageRenderer"])
-		newclass = @"DKImageAdornment";
-	else if ([newclass isEqualToString:@"DKTextLabelRenderer"])
-		newclass = @"DKTextAdornment";
-	else if ([newclass isEqualToString:@"DKObjectDrawingToolLayer"]) // obsolete class - just convert to plain drawing layer
-		newclass = @"DKObjectDrawingLayer";
-	else if ([newclass isEqualToString:@"DKLineDash"])
-		newclass = @"DKStrokeDash";
+	if ([name hasPrefix:@"GC"])
+		newclass = [@"DK" stringByAppendingString:[name substringFromIndex:2]];
+
+	// other class name changes are looked up
+
+	NSString* renamed = [sRenamedClasses objectForKey:newclass];
+
+	if (renamed)
+		newclass = renamed;
 
 	Class theClass = NSClassFromString(newclass);
 	NSUInteger indx = 1;
@@ -146,6 +225,7 @@ NSString* kDKUnarchiverProgressFinishedNotification = @"kDKUnarchiverProgressFin
 - (void)dealloc
 {
 	[mLastClassnameSubstituted release];
+	[mSubstitutions release];
 	[super dealloc];
 }
 
@@ -5,7 +5,7 @@
 */
 
 #import "DKUndoManager.h"
-#import "LogEvent.h"
+#import "DKTrace.h"
 
 #if USE_GC_UNDO_MANAGER
 
@@ -20,7 +20,7 @@
 	else
 		[self disableUndoTaskCoalescing];
 
-	LogEvent_(kInfoEvent, @"undo coalescing is %@", enable ? @"ON" : @"OFF");
+	DKTrace_(kDKTraceInfo, @"undo coalescing is %@", enable ? @"ON" : @"OFF");
 
 	return old;
 }
@@ -36,7 +36,7 @@
 	BOOL oldState = [self isUndoTaskCoalescingEnabled];
 	mCoalescingEnabled = enable;
 
-	LogEvent_(kInfoEvent, @"undo coalescing is %@", mCoalescingEnabled ? @"ON" : @"OFF");
+	DKTrace_(kDKTraceInfo, @"undo coalescing is %@", mCoalescingEnabled ? @"ON" : @"OFF");
 
 	return oldState;
 }
@@ -77,7 +77,7 @@
 {
 	@try
 	{
-		LogEvent_(kInfoEvent, @"%@ %@ '%@' target = <%@ 0x%x>", [self isUndoing] ? @"undoing" : @"redoing", [self undoActionName], NSStringFromSelector([invocation selector]), NSStringFromClass([[invocation target] class]), [invocation target]);
+		DKTrace_(kDKTraceInfo, @"%@ %@ '%@' target = <%@ 0x%x>", [self isUndoing] ? @"undoing" : @"redoing", [self undoActionName], NSStringFromSelector([invocation selector]), NSStringFromClass([[invocation target] class]), [invocation target]);
 
 		[invocation invoke];
 	}
@@ -133,7 +133,7 @@
 
 	[super beginUndoGrouping];
 
-	LogEvent_(kInfoEvent, @"%@ opened undo group, level = %d", self, [self groupingLevel]);
+	DKTrace_(kDKTraceInfo, @"%@ opened undo group, level = %d", self, [self groupingLevel]);
 }
 
 - (void)endUndoGrouping
@@ -146,7 +146,7 @@
 
 	[super endUndoGrouping];
 
-	LogEvent_(kInfoEvent, @"%@ closed undo group, level = %d, tasks submitted = %d", self, [self groupingLevel], [self numberOfTasksInLastGroup]);
+	DKTrace_(kDKTraceInfo, @"%@ closed undo group, level = %d, tasks submitted = %d", self, [self groupingLevel], [self numberOfTasksInLastGroup]);
 }
 
 - (id)prepareWithInvocationTarget:(id)target
@@ -183,13 +183,13 @@
 				//if the target and selector are the same return
 
 				if (target == mSkipTargetRef && mLastSelector == sel) {
-					LogEvent_(kInfoEvent, @"undo '%@' (discarded) group %d", NSStringFromSelector(sel), [self groupingLevel]);
+					DKTrace_(kDKTraceInfo, @"undo '%@' (discarded) group %d", NSStringFromSelector(sel), [self groupingLevel]);
 
 					return;
 				}
 			}
 
-			LogEvent_(kInfoEvent, @"undo '%@' (accepted) group %d", NSStringFromSelector(sel), [self groupingLevel]);
+			DKTrace_(kDKTraceInfo, @"undo '%@' (accepted) group %d", NSStringFromSelector(sel), [self groupingLevel]);
 
 			mSkipTargetRef = target;
 			mSkipTask = YES;
@@ -253,13 +253,13 @@
 			//if the target and selector are the same discard the invocation and return
 
 			if ((mLastTargetRef == mSkipTargetRef) && (mLastSelector == [invocation selector])) {
-				LogEvent_(kInfoEvent, @"undo invocation: [%@ %@] (discarded) group %d", NSStringFromClass([mSkipTargetRef class]), NSStringFromSelector([invocation selector]), [self groupingLevel]);
+				DKTrace_(kDKTraceInfo, @"undo invocation: [%@ %@] (discarded) group %d", NSStringFromClass([mSkipTargetRef class]), NSStringFromSelector([invocation selector]), [self groupingLevel]);
 
 				return;
 			}
 		}
 
-		LogEvent_(kInfoEvent, @"undo invocation: [%@ %@] (accepted) group %d", NSStringFromClass([mSkipTargetRef class]), NSStringFromSelector([invocation selector]), [self groupingLevel]);
+		DKTrace_(kDKTraceInfo, @"undo invocation: [%@ %@] (accepted) group %d", NSStringFromClass([mSkipTargetRef class]), NSStringFromSelector([invocation selector]), [self groupingLevel]);
 		mLastTargetRef = mSkipTargetRef;
 		mLastSelector = [invocation selector];
 	}
@@ -6,15 +6,79 @@
 
 #import <Cocoa/Cocoa.h>
 
-/** @brief Utility class generates totally unique keys using CFUUID.
+/** @brief A compact unique ID
 
-Utility class generates totally unique keys using CFUUID. The keys are guaranteed unique across time, space and different machines.
+ The high half is a random prefix chosen once per process, and the low half a counter, so IDs are unique across processes
+ in practice and within a process by construction.
+ */
+typedef struct {
+	uint64_t high;
+	uint64_t low;
+} DKUniqueIDValue;
+
+/** @brief Utility class generates totally unique keys.
+
+Utility class generates totally unique keys. The keys are unique across time, space and different machines.
 
 One intended client for this is to assign unique registry keys to styles to solve the registry merge problem.
+
+Keys are strings, so they can be used, archived and compared anywhere a string can, but the strings returned by +uniqueKey hold
+only a compact DKUniqueIDValue. Their characters - in the same form as a CFUUID string - are derived on demand, their hash is
+worked out once and kept, and comparing two of them compares 16 bytes. The hash is the same as that of the equivalent ordinary
+string, so compact keys and the ordinary strings read back from archives find each other in any dictionary or set.
 */
 @interface DKUniqueID : NSObject
 
-/**  */
+/** @brief Returns a new unique key
+ @return a string holding a new compact ID
+ */
 + (NSString*)uniqueKey;
 
+/** @brief Returns a new unique ID value
+ @return the ID
+ */
++ (DKUniqueIDValue)uniqueIDValue;
+
+/** @brief Returns the key for an ID value
+ @param value the ID
+ @return a string holding the ID
+ */
++ (NSString*)uniqueKeyWithValue:(DKUniqueIDValue)value;
+
+/** @brief Returns the compact form of a key, such as one read from an archive
+
+ Strings that aren't in the form produced by +uniqueKey, such as a style registry's fixed keys, are returned as they are.
+ @param key a key
+ @return the equivalent compact key, or <key>
+ */
++ (NSString*)uniqueKeyWithString:(NSString*)key;
+
+/** @brief Gets the ID value a key holds
+ @param key a key, compact or not
+ @param value receives the value
+ @return YES if <key> is in the form produced by +uniqueKey
+ */
++ (BOOL)getValue:(DKUniqueIDValue*)value ofKey:(NSString*)key;
+
 @end
+
+/** @brief Compares two ID values
+ @return YES if they are the same
+ */
+static inline BOOL DKUniqueIDValueEqual(DKUniqueIDValue a, DKUniqueIDValue b)
+{
+	return a.high == b.high && a.low == b.low;
+}
+
+/** @brief A hash of an ID value, for tables keyed by values rather than strings
+ @return the hash
+ */
+static inline NSUInteger DKUniqueIDValueHash(DKUniqueIDValue value)
+{
+	// the counter half is what varies within a process, so mix it well and fold in the prefix
+
+	uint64_t h = value.low * 0x9E3779B97F4A7C15ULL;
+
+	h ^= value.high + (h << 6) + (h >> 2);
+	return (NSUInteger)(h ^ (h >> 32));
+}
@@ -5,17 +5,263 @@
 */
 
 #import "DKUniqueID.h"
+#import <libkern/OSAtomic.h>
+
+#define kDKUniqueKeyLength 36 // the length of a CFUUID string
+
+static DKUniqueIDValue sPrefix;
+static volatile int64_t sCounter = 0;
+static const unichar sHexDigits[16] = { '0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F' };
+
+static void choosePrefix(void* context);
+static BOOL isDashIndex(NSUInteger i);
+static unichar characterOfValue(DKUniqueIDValue value, NSUInteger i);
+
+/** @brief The string form of a DKUniqueIDValue
+
+ Holds only the value, and derives its characters as they are asked for. Encodes itself as an ordinary string, so archives are
+ unchanged.
+ */
+@interface DKCompactUniqueKey : NSString {
+@private
+	DKUniqueIDValue mValue;
+	NSUInteger mHash; // 0 until worked out
+}
+
+- (id)initWithValue:(DKUniqueIDValue)value;
+- (DKUniqueIDValue)value;
+
+@end
+
+#pragma mark -
 
 @implementation DKUniqueID
 
-/**  */
 + (NSString*)uniqueKey
 {
-	CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
-	CFStringRef str = CFUUIDCreateString(kCFAllocatorDefault, uuid);
-	CFRelease(uuid);
+	return [self uniqueKeyWithValue:[self uniqueIDValue]];
+}
+
++ (DKUniqueIDValue)uniqueIDValue
+{
+	static dispatch_once_t once;
+	DKUniqueIDValue value;
+
+	dispatch_once_f(&once, NULL, choosePrefix);
+
+	value.high = sPrefix.high;
+	value.low = sPrefix.low + (uint64_t)OSAtomicIncrement64Barrier(&sCounter);
+
+	return value;
+}
+
++ (NSString*)uniqueKeyWithValue:(DKUniqueIDValue)value
+{
+	return [[[DKCompactUniqueKey alloc] initWithValue:value] autorelease];
+}
+
++ (NSString*)uniqueKeyWithString:(NSString*)key
+{
+	DKUniqueIDValue value;
+
+	if ([key isKindOfClass:[DKCompactUniqueKey class]] || ![self getValue:&value
+																	ofKey:key])
+		return key;
 
-	return [(NSString*)str autorelease];
+	return [self uniqueKeyWithValue:value];
+}
+
++ (BOOL)getValue:(DKUniqueIDValue*)value ofKey:(NSString*)key
+{
+	if ([key isKindOfClass:[DKCompactUniqueKey class]]) {
+		*value = [(DKCompactUniqueKey*)key value];
+		return YES;
+	}
+
+	if (![key isKindOfClass:[NSString class]] || [key length] != kDKUniqueKeyLength)
+		return NO;
+
+	unichar chars[kDKUniqueKeyLength];
+	uint64_t halves[2] = { 0, 0 };
+	NSUInteger i, digit = 0;
+
+	[key getCharacters:chars
+				 range:NSMakeRange(0, kDKUniqueKeyLength)];
+
+	// only the exact form produced here is accepted - upper case, dashes in place - so that the compact key has the same characters
+
+	for (i = 0; i < kDKUniqueKeyLength; ++i) {
+		unichar c = chars[i];
+		uint64_t nibble;
+
+		if (isDashIndex(i)) {
+			if (c != '-')
+				return NO;
+			continue;
+		}
+
+		if (c >= '0' && c <= '9')
+			nibble = c - '0';
+		else if (c >= 'A' && c <= 'F')
+			nibble = c - 'A' + 10;
+		else
+			return NO;
+
+		halves[digit / 16] = (halves[digit / 16] << 4) | nibble;
+		++digit;
+	}
+
+	value->high = halves[0];
+	value->low = halves[1];
+
+	return YES;
 }
 
 @end
+
+#pragma mark -
+
+@implementation DKCompactUniqueKey
+
+- (id)initWithValue:(DKUniqueIDValue)value
+{
+	self = [super init];
+	if (self != nil)
+		mValue = value;
+
+	return self;
+}
+
+- (DKUniqueIDValue)value
+{
+	return mValue;
+}
+
+#pragma mark -
+#pragma mark As an NSString
+
+- (NSUInteger)length
+{
+	return kDKUniqueKeyLength;
+}
+
+- (unichar)characterAtIndex:(NSUInteger)index
+{
+	if (index >= kDKUniqueKeyLength)
+		[NSException raise:NSRangeException
+					format:@"index %lu beyond the end of a unique key", (unsigned long)index];
+
+	return characterOfValue(mValue, index);
+}
+
+- (void)getCharacters:(unichar*)buffer range:(NSRange)aRange
+{
+	if (NSMaxRange(aRange) > kDKUniqueKeyLength)
+		[NSException raise:NSRangeException
+					format:@"range %@ beyond the end of a unique key", NSStringFromRange(aRange)];
+
+	NSUInteger i;
+
+	for (i = 0; i < aRange.length; ++i)
+		buffer[i] = characterOfValue(mValue, aRange.location + i);
+}
+
+- (BOOL)isEqualToString:(NSString*)aString
+{
+	if (aString == self)
+		return YES;
+
+	if ([aString isKindOfClass:[DKCompactUniqueKey class]])
+		return DKUniqueIDValueEqual(mValue, [(DKCompactUniqueKey*)aString value]);
+
+	return [super isEqualToString:aString];
+}
+
+- (BOOL)isEqual:(id)anObject
+{
+	if (anObject == self)
+		return YES;
+
+	if ([anObject isKindOfClass:[DKCompactUniqueKey class]])
+		return DKUniqueIDValueEqual(mValue, [(DKCompactUniqueKey*)anObject value]);
+
+	return [super isEqual:anObject];
+}
+
+- (NSUInteger)hash
+{
+	// must agree with the hash of the equivalent ordinary string, so it's worked out from the characters, but only once. Racing
+	// threads both store the same value
+
+	if (mHash == 0)
+		mHash = [super hash];
+
+	return mHash;
+}
+
+- (id)copyWithZone:(NSZone*)zone
+{
+#pragma unused(zone)
+
+	return [self retain];
+}
+
+#pragma mark -
+#pragma mark As part of NSCoding Protocol
+
+- (Class)classForCoder
+{
+	return [NSString class];
+}
+
+- (Class)classForKeyedArchiver
+{
+	return [NSString class];
+}
+
+- (id)replacementObjectForCoder:(NSCoder*)coder
+{
+#pragma unused(coder)
+
+	unichar chars[kDKUniqueKeyLength];
+
+	[self getCharacters:chars
+				  range:NSMakeRange(0, kDKUniqueKeyLength)];
+
+	return [NSString stringWithCharacters:chars
+								   length:kDKUniqueKeyLength];
+}
+
+- (id)replacementObjectForKeyedArchiver:(NSKeyedArchiver*)archiver
+{
+	return [self replacementObjectForCoder:archiver];
+}
+
+@end
+
+#pragma mark -
+
+static void choosePrefix(void* context)
+{
+#pragma unused(context)
+
+	arc4random_buf(&sPrefix, sizeof(sPrefix));
+}
+
+static BOOL isDashIndex(NSUInteger i)
+{
+	return i == 8 || i == 13 || i == 18 || i == 23;
+}
+
+static unichar characterOfValue(DKUniqueIDValue value, NSUInteger i)
+{
+	if (isDashIndex(i))
+		return '-';
+
+	// the number of the hex digit, skipping the dashes before it
+
+	NSUInteger digit = i - (i > 8) - (i > 13) - (i > 18) - (i > 23);
+	uint64_t half = (digit < 16) ? value.high : value.low;
+
+	return sHexDigits[(half >> (60 - 4 * (digit % 16))) & 0xF];
+}
@@ -92,6 +92,22 @@ completed except for page breaks. Tool controllers for example can draw selectio
  */
 - (void)setViewNeedsDisplayInRect:(NSValue*)updateRectValue;
 
+/** @brief Mark several parts of the view for update
+
+ This is called by the drawing once per turn of the run loop with the areas collected since the last, already merged. By
+ default it passes each to -setViewNeedsDisplayInRect:
+ @param rects the areas to mark for update
+ @param count the number of rects
+ */
+- (void)setViewNeedsDisplayInRects:(const NSRect*)rects count:(NSUInteger)count;
+
+/** @brief Mark part of the view for update, keeping the view's cached tiles of the drawing there
+
+ This is called by the drawing for changes to what is drawn over the content, such as the selection
+ @param rect the area to mark for update
+ */
+- (void)setViewNeedsOverlayDisplayInRect:(NSRect)rect;
+
 /** @brief Notify that the drawing has had its size changed
 
  The view's bounds and frame are adjusted to enclose the full drawing size and the view is updated
@@ -67,6 +67,8 @@ static NSTimer* s_autoscrollTimer = nil;
  */
 - (void)setViewNeedsDisplay:(NSNumber*)updateBoolValue
 {
+	// the drawing has already invalidated the tiles its views share
+
 	[[self view] setNeedsDisplay:[updateBoolValue boolValue]];
 }
 
@@ -81,6 +83,19 @@ static NSTimer* s_autoscrollTimer = nil;
 	[[self view] setNeedsDisplayInRect:[updateRectValue rectValue]];
 }
 
+- (void)setViewNeedsDisplayInRects:(const NSRect*)rects count:(NSUInteger)count
+{
+	NSUInteger i;
+
+	for (i = 0; i < count; ++i)
+		[self setViewNeedsDisplayInRect:[NSValue valueWithRect:rects[i]]];
+}
+
+- (void)setViewNeedsOverlayDisplayInRect:(NSRect)rect
+{
+	[[self view] setNeedsDisplayInRect:rect];
+}
+
 /** @brief Notify that the drawing has had its size changed
 
  The view's bounds and frame are adjusted to enclose the full drawing size and the view is updated
@@ -97,6 +112,10 @@ static NSTimer* s_autoscrollTimer = nil;
 
 	[[self view] setFrameSize:fr];
 	[[self view] setBoundsSize:[drawingSizeValue sizeValue]];
+
+	if ([[self view] isKindOfClass:[DKDrawingView class]])
+		[(DKDrawingView*)[self view] invalidateAllCachedTiles];
+
 	[[self view] setNeedsDisplay:YES];
 }
 
@@ -93,9 +93,37 @@
 
 - (NSBezierPath*)renderingPathForObject:(id<DKRenderable>)object
 {
-	return [[super renderingPathForObject:object] bezierPathWithWavelength:[self wavelength]
-																 amplitude:[self amplitude]
-																	spread:[self spread]];
+	// the zig-zag is measured along the object's shared flattening of its path, which is much quicker to measure than its curves.
+	// It only changes when the object's geometry or the fill's settings do, so it's kept in the object's rendering cache
+
+	if ([self amplitude] <= 0)
+		return [super renderingPathForObject:object];
+
+	NSBezierPath* path = [self flattenedRenderingPathForObject:object];
+	NSBezierPath* zz = [self cachedPathForObject:object
+									  sourcePath:path];
+
+	if (zz == nil) {
+		zz = [path bezierPathWithWavelength:[self wavelength]
+								  amplitude:[self amplitude]
+									 spread:[self spread]];
+		[self setCachedPath:zz
+				  forObject:object
+				 sourcePath:path];
+	}
+
+	return zz;
+}
+
+- (NSUInteger)renderingCacheParameters
+{
+	NSUInteger cs = [super renderingCacheParameters];
+
+	cs = DKRasterizerChecksumCombine(cs, [self wavelength]);
+	cs = DKRasterizerChecksumCombine(cs, [self amplitude]);
+	cs = DKRasterizerChecksumCombine(cs, [self spread]);
+
+	return cs;
 }
 
 - (BOOL)isFill
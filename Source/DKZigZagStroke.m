@@ -92,6 +92,49 @@
 		return NSZeroSize;
 }
 
+- (NSBezierPath*)renderingPathForObject:(id<DKRenderable>)object
+{
+	// the zig-zag is measured along the object's shared flattening of its path, which is much quicker to measure than its curves
+
+	if ([self amplitude] > 0)
+		return [self flattenedRenderingPathForObject:object];
+	else
+		return [super renderingPathForObject:object];
+}
+
+- (NSUInteger)renderingCacheParameters
+{
+	NSUInteger cs = [super renderingCacheParameters];
+
+	cs = DKRasterizerChecksumCombine(cs, [self wavelength]);
+	cs = DKRasterizerChecksumCombine(cs, [self amplitude]);
+	cs = DKRasterizerChecksumCombine(cs, [self spread]);
+
+	return cs;
+}
+
+- (void)renderPath:(NSBezierPath*)path forObject:(id<DKRenderable>)object
+{
+	// the zig-zag only changes when the object's geometry or the stroke's settings do, so it's kept in the object's rendering cache
+
+	if ([self amplitude] > 0) {
+		NSBezierPath* rp = [self cachedPathForObject:object
+										 sourcePath:path];
+
+		if (rp == nil) {
+			rp = [path bezierPathWithWavelength:[self wavelength]
+									  amplitude:[self amplitude]
+										 spread:[self spread]];
+			[self setCachedPath:rp
+					  forObject:object
+					 sourcePath:path];
+		}
+
+		[super renderPath:rp];
+	} else
+		[super renderPath:path];
+}
+
 - (void)renderPath:(NSBezierPath*)path
 {
 	if ([self amplitude] > 0) {
@@ -29,6 +29,7 @@ user interaction.
 - (void)setFormat:(NSString*)fmt;
 - (void)setWindowOffset:(NSSize)offset;
 - (void)positionNearPoint:(NSPoint)p inView:(NSView*)v;
+- (NSPoint)screenPointNearPoint:(NSPoint)p inView:(NSView*)v;
 - (void)positionAtScreenPoint:(NSPoint)sp;
 
 - (void)show;
@@ -146,6 +146,15 @@
 {
 	// places the window just to the right and above the point p as expressed in the coordinate system of view v.
 
+	[self positionAtScreenPoint:[self screenPointNearPoint:p
+													inView:v]];
+}
+
+- (NSPoint)screenPointNearPoint:(NSPoint)p inView:(NSView*)v
+{
+	// the screen point -positionNearPoint:inView: would place the window at, so that it can be worked out while the view is current
+	// and the window moved later
+
 	p = [v convertPoint:p
 				 toView:nil];
 
@@ -153,7 +162,8 @@
 
 	gp.x += m_wOffset.width;
 	gp.y += m_wOffset.height;
-	[self positionAtScreenPoint:gp];
+
+	return gp;
 }
 
 - (void)positionAtScreenPoint:(NSPoint)sp
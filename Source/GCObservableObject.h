@@ -17,6 +17,11 @@ observer watching all the published properties.
 Subclasses can also override these methods to be more selective about which properties are observed, or to propagate the message to
 additional observable objects they own.
 
+An observer that watches many objects can instead ask to observe in batches, by returning YES from -prefersBatchedObservation. It then
+observes just one key, kGCObservableChangesKey, which changes whenever any published property does. While it is told of the change, it
+can get the mask of the properties that changed from -observableChanges and their previous values from -observedChanges. This costs
+one KVO registration per object rather than one per property.
+
 This class also works around a bug or oversight in the KVO implementation (in 10.4 at least). When an array is changed, the old
 value isn't sent to the observer. To allow this, we record the old value locally. An observer can then call us back to get this
 old array if it needs to (for example, when building an Undo invocation).
@@ -28,6 +33,10 @@ objects to the undo manager and vice versa, implementing undo for all keypaths d
 @interface GCObservableObject : NSObject {
 @private
 	NSMutableDictionary* m_oldArrayValues;
+	NSMutableDictionary* mObservedChanges; // keypath -> previous value, for the change being reported to batched observers
+	uint64_t mObservableChanges; // mask of the properties in <mObservedChanges>
+	NSUInteger mChangeDepth; // nesting of will/did change pairs
+	NSUInteger mBatchedObserverCount;
 }
 
 + (void)registerActionName:(NSString*)na forKeyPath:(NSString*)kp objClass:(Class)cl;
@@ -35,12 +44,34 @@ objects to the undo manager and vice versa, implementing undo for all keypaths d
 
 + (NSArray*)observableKeyPaths;
 
+/** @brief The bit in -observableChanges for a property
+ @param keypath one of the class's observable key paths
+ @return the bit, or 0 if <keypath> isn't observable. Key paths beyond the 63rd share the top bit
+ */
++ (uint64_t)changeMaskForKeyPath:(NSString*)keypath;
+
 - (BOOL)setUpKVOForObserver:(id)object;
 - (BOOL)tearDownKVOForObserver:(id)object;
 
 - (void)setUpObservables:(NSArray*)keypaths forObserver:(id)object;
 - (void)tearDownObservables:(NSArray*)keypaths forObserver:(id)object;
 
+/** @brief Makes an observer observe all of the published properties as one
+ @param object the observer
+ */
+- (void)setUpBatchedObservationForObserver:(id)object;
+- (void)tearDownBatchedObservationForObserver:(id)object;
+
+/** @brief The properties in the change being reported to batched observers
+ @return a mask of bits from +changeMaskForKeyPath:, or 0 when no change is being reported
+ */
+- (uint64_t)observableChanges;
+
+/** @brief The previous values of the properties in the change being reported to batched observers
+ @return a dictionary of previous values keyed by key path. nil values are given as NSNull
+ */
+- (NSDictionary*)observedChanges;
+
 - (void)registerActionNames;
 - (NSString*)actionNameForKeyPath:(NSString*)keypath;
 - (NSString*)actionNameForKeyPath:(NSString*)keypath changeKind:(NSKeyValueChange)kind;
@@ -54,6 +85,16 @@ objects to the undo manager and vice versa, implementing undo for all keypaths d
 
 #define kDKChangeKindStringMarkerTag #kind #
 
+/** @brief Observers that watch many observables can implement this to observe each in batches
+
+ GCObservableObject asks this of observers passed to -setUpKVOForObserver:.
+ */
+@interface NSObject (GCBatchedObservation)
+
+- (BOOL)prefersBatchedObservation;
+
+@end
+
 // the observer relay is a simple object that can liaise between any undo manager instance and any class
 // set up as an observer. It also implements the above protocol so that observees are easily able to hook up to it.
 
@@ -73,4 +114,5 @@ objects to the undo manager and vice versa, implementing undo for all keypaths d
 @end
 
 extern NSString* kDKObserverRelayDidReceiveChange;
+extern NSString* kGCObservableChangesKey;
 extern NSString* kDKObservableKeyPath;
@@ -10,9 +10,18 @@
 #pragma mark Contants(Non - localized)
 NSString* kDKObserverRelayDidReceiveChange = @"kDKObserverRelayDidReceiveChange";
 NSString* kDKObservableKeyPath = @"kDKObservableKeyPath";
+NSString* kGCObservableChangesKey = @"observableChanges";
 
 #pragma mark Static Vars
 static NSMutableDictionary* sActionNameRegistry = nil;
+static NSMutableDictionary* sChangeMasks = nil; // class name -> (keypath -> mask)
+
+@interface GCObservableObject (Private)
+
+- (void)willChangeObservableForKey:(NSString*)key ofArray:(BOOL)isArray;
+- (void)didChangeObservableForKey:(NSString*)key;
+
+@end
 
 #pragma mark -
 @implementation GCObservableObject
@@ -57,6 +66,41 @@ static NSMutableDictionary* sActionNameRegistry = nil;
 	return [NSArray array];
 }
 
++ (uint64_t)changeMaskForKeyPath:(NSString*)keypath
+{
+	// observableKeyPaths builds a new array each time, so each class's masks are worked out once
+
+	if (sChangeMasks == nil)
+		sChangeMasks = [[NSMutableDictionary alloc] init];
+
+	NSString* className = NSStringFromClass(self);
+	NSMutableDictionary* masks = [sChangeMasks objectForKey:className];
+
+	if (masks == nil) {
+		NSArray* keypaths = [self observableKeyPaths];
+		NSUInteger i;
+
+		masks = [NSMutableDictionary dictionaryWithCapacity:[keypaths count]];
+
+		for (i = 0; i < [keypaths count]; ++i)
+			[masks setObject:[NSNumber numberWithUnsignedLongLong:1ULL << MIN(i, 63U)]
+					  forKey:[keypaths objectAtIndex:i]];
+
+		[sChangeMasks setObject:masks
+						 forKey:className];
+	}
+
+	return [[masks objectForKey:keypath] unsignedLongLongValue];
+}
+
++ (NSSet*)keyPathsForValuesAffectingValueForKey:(NSString*)key
+{
+	if ([key isEqualToString:kGCObservableChangesKey])
+		return [NSSet setWithArray:[self observableKeyPaths]];
+
+	return [super keyPathsForValuesAffectingValueForKey:key];
+}
+
 #pragma mark -
 - (BOOL)setUpKVOForObserver:(id)object
 {
@@ -65,6 +109,11 @@ static NSMutableDictionary* sActionNameRegistry = nil;
 	if (object == nil)
 		return NO;
 
+	if ([object prefersBatchedObservation]) {
+		[self setUpBatchedObservationForObserver:object];
+		return YES;
+	}
+
 	// attempt to auto-register any keypaths returned by the "observables" list
 
 	NSArray* observables = [[self class] observableKeyPaths];
@@ -83,6 +132,11 @@ static NSMutableDictionary* sActionNameRegistry = nil;
 	if (object == nil)
 		return NO;
 
+	if ([object prefersBatchedObservation]) {
+		[self tearDownBatchedObservationForObserver:object];
+		return YES;
+	}
+
 	// attempt to auto-unregister any keypaths returned by the "observables" list
 
 	NSArray* observables = [[self class] observableKeyPaths];
@@ -128,6 +182,41 @@ static NSMutableDictionary* sActionNameRegistry = nil;
 				  forKeyPath:kp];
 }
 
+- (void)setUpBatchedObservationForObserver:(id)object
+{
+	// the observer watches the one key that all the published properties affect. Neither old nor new values are asked for, as
+	// the previous values of the properties themselves are what an observer needs, and are kept here
+
+	LogEvent_(kKVOEvent, @"%@ is adding the batched observer %@", [self description], [object description]);
+
+	++mBatchedObserverCount;
+	[self addObserver:object
+		   forKeyPath:kGCObservableChangesKey
+			  options:0
+			  context:NULL];
+}
+
+- (void)tearDownBatchedObservationForObserver:(id)object
+{
+	LogEvent_(kKVOEvent, @"%@ is removing the batched observer %@", [self description], [object description]);
+
+	[self removeObserver:object
+			  forKeyPath:kGCObservableChangesKey];
+
+	if (mBatchedObserverCount > 0)
+		--mBatchedObserverCount;
+}
+
+- (uint64_t)observableChanges
+{
+	return mObservableChanges;
+}
+
+- (NSDictionary*)observedChanges
+{
+	return mObservedChanges;
+}
+
 #pragma mark -
 - (void)registerActionNames
 {
@@ -238,6 +327,7 @@ static NSMutableDictionary* sActionNameRegistry = nil;
 - (void)dealloc
 {
 	[m_oldArrayValues release];
+	[mObservedChanges release];
 	[super dealloc];
 }
 
@@ -275,11 +365,94 @@ static NSMutableDictionary* sActionNameRegistry = nil;
 		}
 	}
 
+	if (mBatchedObserverCount > 0)
+		[self willChangeObservableForKey:key
+								 ofArray:YES];
+
 	[super willChange:change
 		valuesAtIndexes:indexes
 				 forKey:key];
 }
 
+- (void)didChange:(NSKeyValueChange)change valuesAtIndexes:(NSIndexSet*)indexes forKey:(NSString*)key
+{
+	[super didChange:change
+		valuesAtIndexes:indexes
+				 forKey:key];
+
+	if (mBatchedObserverCount > 0)
+		[self didChangeObservableForKey:key];
+}
+
+- (void)willChangeValueForKey:(NSString*)key
+{
+	// batched observers are told of changes through kGCObservableChangesKey, which depends on every published property. The
+	// previous value is recorded here, before KVO reports the change
+
+	if (mBatchedObserverCount > 0 && ![key isEqualToString:kGCObservableChangesKey])
+		[self willChangeObservableForKey:key
+								 ofArray:NO];
+
+	[super willChangeValueForKey:key];
+}
+
+- (void)didChangeValueForKey:(NSString*)key
+{
+	[super didChangeValueForKey:key];
+
+	if (mBatchedObserverCount > 0 && ![key isEqualToString:kGCObservableChangesKey])
+		[self didChangeObservableForKey:key];
+}
+
+@end
+
+#pragma mark -
+@implementation GCObservableObject (Private)
+
+- (void)willChangeObservableForKey:(NSString*)key ofArray:(BOOL)isArray
+{
+	// a change made while another is being made, such as by a setter that sets other properties, is reported with it. Only the
+	// first previous value of each key counts. For arrays, the copy made by -willChange:valuesAtIndexes:forKey: is the previous value
+
+	uint64_t mask = [[self class] changeMaskForKeyPath:key];
+
+	++mChangeDepth;
+
+	if (mask == 0 || [mObservedChanges objectForKey:key] != nil)
+		return;
+
+	id value = isArray ? [m_oldArrayValues objectForKey:key] : [self valueForKey:key];
+
+	if (mObservedChanges == nil)
+		mObservedChanges = [[NSMutableDictionary alloc] init];
+
+	[mObservedChanges setObject:value ? value : [NSNull null]
+						 forKey:key];
+	mObservableChanges |= mask;
+}
+
+- (void)didChangeObservableForKey:(NSString*)key
+{
+#pragma unused(key)
+
+	// the observers have been told by now, so the outermost change clears the record
+
+	if (mChangeDepth > 0 && --mChangeDepth == 0) {
+		[mObservedChanges removeAllObjects];
+		mObservableChanges = 0;
+	}
+}
+
+@end
+
+#pragma mark -
+@implementation NSObject (GCBatchedObservation)
+
+- (BOOL)prefersBatchedObservation
+{
+	return NO;
+}
+
 @end
 
 #pragma mark -
@@ -6,15 +6,53 @@
 
 #import <Cocoa/Cocoa.h>
 
+typedef struct {
+	volatile long sequence;
+	id object;
+} GCThreadQueueCell;
+
+/** @brief A bounded first-in, first-out queue that any number of threads may add objects to and take them from at once.
+
+ The queue is a ring of cells, each stamped with a sequence number that tells a thread whether the cell is ready to fill or to empty,
+ so threads claim cells with a compare-and-swap rather than taking a lock. Semaphores count the full and empty cells, so that the
+ blocking methods wait without spinning, and cost only an atomic decrement when they needn't wait.
+
+ Objects are retained while they are in the queue.
+*/
 @interface GCThreadQueue : NSObject {
 @private
-	NSMutableArray* mQueue;
-	NSConditionLock* mLock;
+	GCThreadQueueCell* mCells;
+	NSUInteger mMask; // capacity - 1
+	volatile long mEnqueuePos;
+	volatile long mDequeuePos;
+	dispatch_semaphore_t mFull; // counts the objects waiting to be taken
+	dispatch_semaphore_t mEmpty; // counts the cells free to be filled
 }
 
-/**  */
+/** @brief Initializes a queue that holds at most <capacity> objects
+ @param capacity the most objects the queue holds; rounded up to a power of two
+ @return the queue
+ */
+- (id)initWithCapacity:(NSUInteger)capacity;
+
+/** @brief The most objects the queue holds
+ */
+- (NSUInteger)capacity;
+
+/** @brief Adds an object, waiting for room if the queue is full
+ @param object the object, which must not be nil
+ */
 - (void)enqueue:(id)object;
+
+/** @brief Adds an object if there is room for it
+ @param object the object, which must not be nil
+ @return YES if it was added, NO if the queue was full
+ */
+- (BOOL)tryEnqueue:(id)object;
+
 - (id)dequeue; // Blocks until there is an object to return
-- (id)tryDequeue; // Returns NULL if the queue is empty
+- (id)tryDequeue; // Returns nil if the queue is empty
 
 @end
+
+#define kGCThreadQueueDefaultCapacity 1024
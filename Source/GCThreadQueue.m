@@ -5,57 +5,182 @@
 */
 
 #import "GCThreadQueue.h"
+#import <libkern/OSAtomic.h>
+
+@interface GCThreadQueue (Private)
+
+- (BOOL)putObject:(id)object;
+- (id)takeObject;
+
+@end
+
+#pragma mark -
 
 @implementation GCThreadQueue
 
-/**  */
+- (id)initWithCapacity:(NSUInteger)capacity
+{
+	self = [super init];
+	if (self != nil) {
+		NSUInteger size = 2, k;
+
+		while (size < capacity)
+			size <<= 1;
+
+		mCells = calloc(size, sizeof(GCThreadQueueCell));
+		mMask = size - 1;
+
+		// each cell starts ready to be filled by the enqueue that reaches its position
+
+		for (k = 0; k < size; ++k)
+			mCells[k].sequence = (long)k;
+
+		mFull = dispatch_semaphore_create(0);
+		mEmpty = dispatch_semaphore_create((long)size);
+	}
+	return self;
+}
+
+- (id)init
+{
+	return [self initWithCapacity:kGCThreadQueueDefaultCapacity];
+}
+
+- (void)dealloc
+{
+	id object;
+
+	while ((object = [self takeObject]))
+		[object release];
+
+	free(mCells);
+	dispatch_release(mFull);
+	dispatch_release(mEmpty);
+	[super dealloc];
+}
+
+- (NSUInteger)capacity
+{
+	return mMask + 1;
+}
+
+#pragma mark -
+
 - (void)enqueue:(id)object
 {
-	[mLock lock];
-	[mQueue addObject:object];
-	[mLock unlockWithCondition:1];
+	NSAssert(object != nil, @"can't enqueue nil");
+
+	dispatch_semaphore_wait(mEmpty, DISPATCH_TIME_FOREVER);
+
+	// a cell is reserved for us, but the dequeue that freed it may not have finished with it yet
+
+	while (![self putObject:object])
+		sched_yield();
+
+	dispatch_semaphore_signal(mFull);
+}
+
+- (BOOL)tryEnqueue:(id)object
+{
+	NSAssert(object != nil, @"can't enqueue nil");
+
+	if (dispatch_semaphore_wait(mEmpty, DISPATCH_TIME_NOW) != 0)
+		return NO;
+
+	while (![self putObject:object])
+		sched_yield();
+
+	dispatch_semaphore_signal(mFull);
+	return YES;
 }
 
 - (id)dequeue
 {
-	[mLock lockWhenCondition:1];
-	id element = [[[mQueue objectAtIndex:0] retain] autorelease];
-	[mQueue removeObjectAtIndex:0];
-	NSInteger count = [mQueue count];
-	[mLock unlockWithCondition:(count > 0) ? 1 : 0];
+	id element;
+
+	dispatch_semaphore_wait(mFull, DISPATCH_TIME_FOREVER);
 
-	return element;
+	while ((element = [self takeObject]) == nil)
+		sched_yield();
+
+	dispatch_semaphore_signal(mEmpty);
+	return [element autorelease];
 }
 
 - (id)tryDequeue
 {
-	id element = NULL;
-	if ([mLock tryLock]) {
-		if ([mLock condition] == 1) {
-			element = [[[mQueue objectAtIndex:0] retain] autorelease];
-			[mQueue removeObjectAtIndex:0];
-		}
-		NSInteger count = [mQueue count];
-		[mLock unlockWithCondition:(count > 0) ? 1 : 0];
-	}
-	return element;
+	id element;
+
+	if (dispatch_semaphore_wait(mFull, DISPATCH_TIME_NOW) != 0)
+		return nil;
+
+	while ((element = [self takeObject]) == nil)
+		sched_yield();
+
+	dispatch_semaphore_signal(mEmpty);
+	return [element autorelease];
 }
 
-- (id)init
+#pragma mark -
+#pragma mark - private methods
+
+- (BOOL)putObject:(id)object
 {
-	self = [super init];
-	if (self != nil) {
-		mQueue = [[NSMutableArray alloc] init];
-		mLock = [[NSConditionLock alloc] initWithCondition:0];
+	// claims the cell at the enqueue position by advancing the position past it. The cell is free if its sequence equals the position;
+	// if it is less, the cell still holds the object put there a lap ago
+
+	GCThreadQueueCell* cell;
+	long pos = mEnqueuePos, diff;
+
+	for (;;) {
+		cell = &mCells[pos & mMask];
+		OSMemoryBarrier();
+		diff = cell->sequence - pos;
+
+		if (diff == 0) {
+			if (OSAtomicCompareAndSwapLongBarrier(pos, pos + 1, &mEnqueuePos))
+				break;
+		} else if (diff < 0)
+			return NO;
+
+		pos = mEnqueuePos;
 	}
-	return self;
+
+	cell->object = [object retain];
+	OSMemoryBarrier();
+	cell->sequence = pos + 1;
+
+	return YES;
 }
 
-- (void)dealloc
+- (id)takeObject
 {
-	[mQueue release];
-	[mLock release];
-	[super dealloc];
+	// returns the object retained, the queue's retain passing to the caller. The cell is full if its sequence is one past the position
+
+	GCThreadQueueCell* cell;
+	long pos = mDequeuePos, diff;
+	id object;
+
+	for (;;) {
+		cell = &mCells[pos & mMask];
+		OSMemoryBarrier();
+		diff = cell->sequence - (pos + 1);
+
+		if (diff == 0) {
+			if (OSAtomicCompareAndSwapLongBarrier(pos, pos + 1, &mDequeuePos))
+				break;
+		} else if (diff < 0)
+			return nil;
+
+		pos = mDequeuePos;
+	}
+
+	object = cell->object;
+	cell->object = nil;
+	OSMemoryBarrier();
+	cell->sequence = pos + (long)mMask + 1;
+
+	return object;
 }
 
 @end
@@ -21,6 +21,8 @@ typedef enum {
 
 @class GCUndoGroup, GCUndoManagerProxy, GCConcreteUndoTask;
 
+struct _GCUndoRecord;
+
 // the undo manager is a public-API compatible replacement for NSUndoManager but features a simpler internal implementation, some bug fixes and less
 // fragility than NSUndoManager. It can be used with NSDocument's -setUndoManager: method (cast to id or NSUndoManager). However its compatibility with
 // Core Data is unknown and untested at this time. See further notes at the end of this file.
@@ -48,6 +50,23 @@ The point of this is to provide an undo manager whose source is openly readable,
  
  -undoNestedGroup only operates on top level groups in this implementation, and is thus functionally equivalent to -undo. In fact -undo simply
  calls -undoNestedGroup here.
+
+ Tasks registered with -registerUndoWithTarget:selector:object: or -registerUndoWithTarget:handler: are recorded as plain records in their
+ group rather than as task objects wrapping an NSInvocation, and coalescing is checked before anything is recorded, so repeatedly registering
+ the same change during a drag allocates nothing. New code should prefer these over -prepareWithInvocationTarget:, which remains for methods
+ whose arguments aren't objects.
+
+ The undo and redo stacks can also be limited by an approximate memory cost as well as by the number of levels, using -setUndoByteBudget:.
+ Each task reports the cost of the objects it holds through -undoCost, which is estimated for common classes and can be overridden by any
+ class whose instances are kept alive by undo. Targets aren't counted, since they are usually part of the document anyway. When the
+ stacks are over budget, the oldest groups are discarded. If -archivesEvictedGroups is set, they are first archived instead, replacing the
+ objects they hold with NSData, and only discarded if that isn't enough. An archived group is unarchived when it's performed, so its
+ arguments are then copies of the originals. Only groups whose arguments are all values (see -isArchivableUndoValue) are archived, since
+ undoing with a copy of a drawable or a style would act on an object the document doesn't contain.
+
+ The manager keeps an index of the top level groups holding tasks for each target, so -removeAllActionsWithTarget: only visits the groups
+ that refer to the target rather than the whole of both stacks - deleting many objects with a long history would otherwise be very slow.
+ Groups left empty by it are removed from the stacks at the next checkpoint, in one pass, instead of as each target is removed.
 */
 @interface GCUndoManager : NSObject {
 @private
@@ -68,6 +87,10 @@ The point of this is to provide an undo manager whose source is openly readable,
 	BOOL mAutoDeleteEmptyGroups; // YES if empty groups are automatically removed from the stack
 	BOOL mRetainsTargets; // YES if invocation targets are retained
 	BOOL mIsRemovingTargets; // YES during stack clean-up to prevent re-entrancy
+	BOOL mArchivesEvictedGroups; // YES if groups over the byte budget are archived before they are discarded
+	NSUInteger mUndoByteBudget; // approximate cost allowed for the undo and redo stacks together, 0 = unlimited
+	CFMutableDictionaryRef mTargetGroups; // target -> set of the top level groups holding tasks for it, neither retained
+	BOOL mHasEmptyGroups; // YES if removing targets has left empty groups on the stacks, which go at the next checkpoint
 }
 
 // NSUndoManager compatible API
@@ -94,6 +117,29 @@ The point of this is to provide an undo manager whose source is openly readable,
 - (NSUInteger)levelsOfUndo;
 - (void)setLevelsOfUndo:(NSUInteger)levels;
 
+// limiting the memory used by the undo and redo stacks
+
+/** @brief Sets the approximate memory cost allowed for the undo and redo stacks together
+
+ When a top level group is closed and the stacks cost more than this, the oldest undo groups are archived or discarded, and then the redo
+ groups furthest from the present. The most recent group on each stack is always kept, whatever its cost.
+ @param bytes the budget in bytes, or 0 for no limit (the default)
+ */
+- (void)setUndoByteBudget:(NSUInteger)bytes;
+- (NSUInteger)undoByteBudget;
+
+/** @brief Sets whether groups over the byte budget are archived before they are discarded
+
+ The default is NO. Groups containing handlers, or arguments that aren't values or don't conform to NSCoding, can't be archived and are
+ discarded.
+ @param archive YES to archive groups, NO to discard them
+ */
+- (void)setArchivesEvictedGroups:(BOOL)archive;
+- (BOOL)archivesEvictedGroups;
+
+- (NSUInteger)undoStackCost;
+- (NSUInteger)redoStackCost;
+
 // performing the undo or redo
 
 - (BOOL)canUndo;
@@ -122,6 +168,15 @@ The point of this is to provide an undo manager whose source is openly readable,
 - (void)forwardInvocation:(NSInvocation*)invocation;
 - (void)registerUndoWithTarget:(id)target selector:(SEL)selector object:(id)anObject;
 
+/** @brief Registers a block to be called with <target> when the action is undone
+
+ Like -registerUndoWithTarget:selector:object: the task is stored compactly in its group without building an invocation, and the target
+ is handled according to -retainsTargets. Handlers are never coalesced, since two blocks can't be compared.
+ @param target the target, which is passed to the handler and can be used to remove the task with -removeAllActionsWithTarget:
+ @param handler the block to call
+ */
+- (void)registerUndoWithTarget:(id)target handler:(void (^)(id target))handler;
+
 // removing actions
 
 - (void)removeAllActions;
@@ -173,6 +228,7 @@ The point of this is to provide an undo manager whose source is openly readable,
 - (void)pushGroupOntoRedoStack:(GCUndoGroup*)aGroup;
 
 - (BOOL)submitUndoTask:(GCConcreteUndoTask*)aTask;
+- (BOOL)shouldCoalesceTaskWithTarget:(id)target selector:(SEL)selector;
 
 - (void)popUndoAndPerformTasks;
 - (void)popRedoAndPerformTasks;
@@ -187,6 +243,7 @@ The point of this is to provide an undo manager whose source is openly readable,
 - (void)reset;
 
 - (void)conditionallyBeginUndoGrouping;
+- (void)trimStacksToByteBudget;
 
 // debugging utility:
 
@@ -208,27 +265,54 @@ The point of this is to provide an undo manager whose source is openly readable,
 - (void)setParentGroup:(GCUndoGroup*)parent;
 - (void)perform;
 
+/** @brief Replaces the objects held by the task with an archive of them, to save memory
+
+ The base class can't be archived and returns NO.
+ @return YES if the task no longer holds any objects other than its target
+ */
+- (BOOL)archiveArguments;
+
 @end
 
 #pragma mark -
 
 // undo groups can contain any number of other groups or concrete tasks. The top level actions in the undo/redo stacks always consist
 // of groups, even if they only contain a single concrete task. The group also provides the storage for the action name associated with
-// the action. Groups own their tasks.
+// the action. Groups own their tasks. Tasks registered by target, selector and object are kept as records in an array rather than as
+// objects, and are only turned into GCConcreteUndoTasks if they are asked for individually.
 
 @interface GCUndoGroup : GCUndoTask {
 @private
 	NSString* mActionName;
-	NSMutableArray* mTasks;
+	struct _GCUndoRecord* mRecords; // the tasks in the order they were added
+	NSUInteger mCount;
+	NSUInteger mCapacity;
+	NSUInteger* mIndex; // hash of the records by target and selector, for coalescing
+	NSUInteger mIndexSize;
+	NSUInteger mCost; // cost of the records, not counting subgroups
+	NSData* mArchivedObjects; // the arguments of the compact records, if archived
+	BOOL mHasSubgroups;
+	BOOL mArchived;
 }
 
 - (void)addTask:(GCUndoTask*)aTask;
+- (void)addTarget:(id)target selector:(SEL)selector object:(id)object retainingTarget:(BOOL)retainIt;
+- (void)addTarget:(id)target handler:(void (^)(id target))handler retainingTarget:(BOOL)retainIt;
+- (BOOL)hasTaskWithTarget:(id)target selector:(SEL)selector;
+- (BOOL)lastTaskHasTarget:(id)target selector:(SEL)selector;
+- (NSUInteger)taskCount;
 - (GCUndoTask*)taskAtIndex:(NSUInteger)indx;
 - (GCConcreteUndoTask*)lastTaskIfConcrete;
 - (NSArray*)tasks;
 - (NSArray*)tasksWithTarget:(id)target selector:(SEL)selector;
 - (BOOL)isEmpty;
+- (BOOL)isArchived;
+- (void)restoreArguments;
 
+/** @brief Adds the targets of the tasks in this group and its subgroups to a set
+ @param targets a set made with NULL callbacks, as the targets aren't retained
+ */
+- (void)addTargetsToSet:(CFMutableSetRef)targets;
 - (void)removeTasksWithTarget:(id)aTarget undoManager:(GCUndoManager*)um;
 - (void)setActionName:(NSString*)name;
 - (NSString*)actionName;
@@ -243,15 +327,45 @@ The point of this is to provide an undo manager whose source is openly readable,
 @interface GCConcreteUndoTask : GCUndoTask {
 @private
 	NSInvocation* mInvocation;
+	id mHandler; // block called instead of the invocation, if any
 	id mTarget;
+	NSData* mArchivedArguments; // the invocation's object arguments, if archived
+	NSUInteger mCost; // cached result of -undoCost, 0 = not yet worked out
 	BOOL mTargetRetained;
 }
 
 - (id)initWithInvocation:(NSInvocation*)inv;
 - (id)initWithTarget:(id)target selector:(SEL)selector object:(id)object;
+- (id)initWithTarget:(id)target handler:(void (^)(id target))handler;
 - (void)setTarget:(id)target retained:(BOOL)retainIt;
 - (id)target;
 - (SEL)selector;
+- (void)restoreArguments;
+
+@end
+
+#pragma mark -
+
+/** @brief The approximate memory cost of objects held by undo tasks
+
+ The default is the size of the object's instance variables. Collections, strings, data and paths add the cost of their contents.
+ Override this in classes whose instances hold significant memory elsewhere, calling super.
+ */
+@interface NSObject (GCUndoCost)
+
+- (NSUInteger)undoCost;
+
+@end
+
+/** @brief Whether an object held by an undo task may be replaced by an archived copy of itself
+
+ Archiving an undo group replaces the objects its tasks hold with copies made when the group is performed, so only objects whose identity
+ doesn't matter - values such as strings, numbers, colours and paths, and collections of them - can be archived. The default is NO, so
+ document objects such as drawables, layers and styles are always kept as themselves. Override this to return YES in value-like classes.
+ */
+@interface NSObject (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue;
 
 @end
 
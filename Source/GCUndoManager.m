@@ -5,6 +5,7 @@
 */
 
 #import "GCUndoManager.h"
+#import <objc/runtime.h>
 
 // this proxy object is returned by -prepareWithInvocationTarget: if GCUM_USE_PROXY is 1. This provides a similar behaviour to NSUndoManager
 // on 10.6 so that a wider range of methods can be submitted as undo tasks. Unlike 10.6 however, it does not bypass um's -forwardInvocation:
@@ -34,6 +35,52 @@
 
 #define CALCULATE_GROUPING_LEVEL 0
 
+@interface GCUndoManager (Private)
+
+- (NSUInteger)evictGroupsFromStack:(NSMutableArray*)stack totalCost:(NSUInteger)total;
+- (void)removeGroupAtIndex:(NSUInteger)indx fromStack:(NSMutableArray*)stack;
+- (void)removeEmptyGroups;
+- (GCUndoGroup*)openTopGroup;
+- (void)indexTarget:(id)target;
+- (void)indexGroup:(GCUndoGroup*)group;
+- (void)unindexGroup:(GCUndoGroup*)group;
+
+@end
+
+// the target index maps each target to the set of top level groups holding its tasks. These apply a group to each of the targets it holds
+
+typedef struct {
+	CFMutableDictionaryRef index;
+	GCUndoGroup* group;
+} GCTargetIndexContext;
+
+static void addGroupForTarget(const void* target, void* context)
+{
+	GCTargetIndexContext* ctx = (GCTargetIndexContext*)context;
+	CFMutableSetRef groups = (CFMutableSetRef)CFDictionaryGetValue(ctx->index, target);
+
+	if (groups == NULL) {
+		groups = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+		CFDictionarySetValue(ctx->index, target, groups);
+		CFRelease(groups);
+	}
+
+	CFSetAddValue(groups, ctx->group);
+}
+
+static void removeGroupForTarget(const void* target, void* context)
+{
+	GCTargetIndexContext* ctx = (GCTargetIndexContext*)context;
+	CFMutableSetRef groups = (CFMutableSetRef)CFDictionaryGetValue(ctx->index, target);
+
+	if (groups) {
+		CFSetRemoveValue(groups, ctx->group);
+
+		if (CFSetGetCount(groups) == 0)
+			CFDictionaryRemoveValue(ctx->index, target);
+	}
+}
+
 #pragma mark -
 
 @implementation GCUndoManager
@@ -122,10 +169,13 @@
 					mIsRemovingTargets = YES;
 
 					while ([self numberOfUndoActions] > [self levelsOfUndo])
-						[mUndoStack removeObjectAtIndex:0];
+						[self removeGroupAtIndex:0
+									   fromStack:mUndoStack];
 
 					mIsRemovingTargets = NO;
 				}
+
+				[self trimStacksToByteBudget];
 			}
 		} else {
 			// closing an inner nested group, so restore its containing group as the open one.
@@ -139,6 +189,7 @@
 
 - (BOOL)canUndo
 {
+	[self removeEmptyGroups];
 	return [self numberOfUndoActions] > 0 && [self undoManagerState] == kGCUndoCollectingTasks;
 }
 
@@ -248,15 +299,64 @@
 		mIsRemovingTargets = YES;
 
 		while ([self numberOfUndoActions] > levels)
-			[mUndoStack removeObjectAtIndex:0];
+			[self removeGroupAtIndex:0
+						   fromStack:mUndoStack];
 
 		while ([self numberOfRedoActions] > levels)
-			[mRedoStack removeObjectAtIndex:0];
+			[self removeGroupAtIndex:0
+						   fromStack:mRedoStack];
 
 		mIsRemovingTargets = NO;
 	}
 }
 
+- (void)setUndoByteBudget:(NSUInteger)bytes
+{
+	mUndoByteBudget = bytes;
+
+	if (mGroupLevel == 0)
+		[self trimStacksToByteBudget];
+}
+
+- (NSUInteger)undoByteBudget
+{
+	return mUndoByteBudget;
+}
+
+- (void)setArchivesEvictedGroups:(BOOL)archive
+{
+	mArchivesEvictedGroups = archive;
+}
+
+- (BOOL)archivesEvictedGroups
+{
+	return mArchivesEvictedGroups;
+}
+
+- (NSUInteger)undoStackCost
+{
+	NSEnumerator* iter = [mUndoStack objectEnumerator];
+	GCUndoGroup* group;
+	NSUInteger cost = 0;
+
+	while ((group = [iter nextObject]))
+		cost += [group undoCost];
+
+	return cost;
+}
+
+- (NSUInteger)redoStackCost
+{
+	NSEnumerator* iter = [mRedoStack objectEnumerator];
+	GCUndoGroup* group;
+	NSUInteger cost = 0;
+
+	while ((group = [iter nextObject]))
+		cost += [group undoCost];
+
+	return cost;
+}
+
 - (NSArray*)runLoopModes
 {
 	return mRunLoopModes;
@@ -352,6 +452,14 @@
 	if ([self isUndoRegistrationEnabled]) {
 		THROW_IF_FALSE(invocation != nil, @"-forwardInvocation: was passed an invalid nil invocation");
 
+		// checking for coalescing first saves making a task that would only be thrown away
+
+		if ([self shouldCoalesceTaskWithTarget:mNextTarget
+									  selector:[invocation selector]]) {
+			mNextTarget = nil;
+			return;
+		}
+
 		GCConcreteUndoTask* task = [[[GCConcreteUndoTask alloc] initWithInvocation:invocation] autorelease];
 		[task setTarget:mNextTarget
 			   retained:[self retainsTargets]];
@@ -366,15 +474,48 @@
 	// disabled, does nothing, If coalescing enabled and the previous target and selector was the same, also does nothing.
 	// Will open a top-level group automatically if necessary and -groupsByEvent is YES.
 
+	// The task is recorded directly in the group, without an invocation or task object.
+
 	if ([self isUndoRegistrationEnabled]) {
 		THROW_IF_FALSE(selector != NULL, @"invalid (NULL) selector passed to registerUndoWithTarget:selector:object:");
 
-		GCConcreteUndoTask* task = [[[GCConcreteUndoTask alloc] initWithTarget:target
-																	  selector:selector
-																		object:anObject] autorelease];
-		[task setTarget:target
-			   retained:[self retainsTargets]];
-		[self submitUndoTask:task];
+		if (![self shouldCoalesceTaskWithTarget:target
+									   selector:selector]) {
+			[self conditionallyBeginUndoGrouping];
+
+			THROW_IF_FALSE(mOpenGroupRef != nil, @"invalid attempt to add undo task with no open group");
+
+			++mChangeCount;
+			[[self currentGroup] addTarget:target
+								  selector:selector
+									object:anObject
+						   retainingTarget:[self retainsTargets]];
+			[self indexTarget:target];
+
+			if ([self undoManagerState] == kGCUndoCollectingTasks)
+				[self clearRedoStack];
+		}
+	}
+	mNextTarget = nil;
+}
+
+- (void)registerUndoWithTarget:(id)target handler:(void (^)(id target))handler
+{
+	if ([self isUndoRegistrationEnabled]) {
+		THROW_IF_FALSE(handler != nil, @"invalid (nil) handler passed to registerUndoWithTarget:handler:");
+
+		[self conditionallyBeginUndoGrouping];
+
+		THROW_IF_FALSE(mOpenGroupRef != nil, @"invalid attempt to add undo task with no open group");
+
+		++mChangeCount;
+		[[self currentGroup] addTarget:target
+							   handler:handler
+					   retainingTarget:[self retainsTargets]];
+		[self indexTarget:target];
+
+		if ([self undoManagerState] == kGCUndoCollectingTasks)
+			[self clearRedoStack];
 	}
 	mNextTarget = nil;
 }
@@ -388,6 +529,8 @@
 		// prevent re-entrancy, in case targets are retained and releasing them calls -removeAllActionsWithTarget:
 
 		mIsRemovingTargets = YES;
+		CFDictionaryRemoveAllValues(mTargetGroups);
+		mHasEmptyGroups = NO;
 		[mUndoStack removeAllObjects];
 		[mRedoStack removeAllObjects];
 		mIsRemovingTargets = NO;
@@ -397,46 +540,34 @@
 
 - (void)removeAllActionsWithTarget:(id)target
 {
-	// removes all tasks having the given target. Groups that become empty as a result are also removed.
+	// removes all tasks having the given target. Only the groups the index holds for the target are visited. Groups that become empty
+	// as a result are removed at the next checkpoint.
 
-	if (!mIsRemovingTargets) {
+	if (!mIsRemovingTargets && target != nil) {
 		// prevent re-entrancy, in case targets are retained and releasing them would call this again
 
 		mIsRemovingTargets = YES;
 
-		NSArray* temp = [[self undoStack] copy];
-		NSEnumerator* iter = [temp objectEnumerator];
-		GCUndoGroup* task;
-
-		while ((task = [iter nextObject])) {
-			[task removeTasksWithTarget:target
-							undoManager:self];
-
-			// delete groups that become empty unless it's the current group
-
-			if ([task isEmpty] && task != [self currentGroup]) {
-				[mUndoStack removeObject:task];
-			}
-		}
+		CFSetRef groups = CFDictionaryGetValue(mTargetGroups, target);
 
-		[temp release];
+		if (groups) {
+			NSArray* temp = [(NSSet*)groups allObjects];
+			NSEnumerator* iter = [temp objectEnumerator];
+			GCUndoGroup* task;
 
-		temp = [[self redoStack] copy];
-		iter = [temp objectEnumerator];
+			// none of the groups refers to the target once its tasks are gone, so its entry can go first
 
-		while ((task = [iter nextObject])) {
-			[task removeTasksWithTarget:target
-							undoManager:self];
+			CFDictionaryRemoveValue(mTargetGroups, target);
 
-			// delete groups that become empty unless it's the current group
+			while ((task = [iter nextObject])) {
+				[task removeTasksWithTarget:target
+								undoManager:self];
 
-			if ([task isEmpty] && task != [self currentGroup]) {
-				[mRedoStack removeObject:task];
+				if ([task isEmpty])
+					mHasEmptyGroups = YES;
 			}
 		}
 
-		[temp release];
-
 		mIsRemovingTargets = NO;
 	}
 	mNextTarget = nil;
@@ -557,6 +688,27 @@
 	}
 }
 
+- (void)trimStacksToByteBudget
+{
+	// brings the stacks within the byte budget, starting with the oldest undo groups. This is called when a top level group is closed
+
+	if (mUndoByteBudget == 0 || mIsRemovingTargets)
+		return;
+
+	mIsRemovingTargets = YES;
+
+	NSUInteger total = [self undoStackCost] + [self redoStackCost];
+
+	if (total > mUndoByteBudget) {
+		total = [self evictGroupsFromStack:mUndoStack
+								 totalCost:total];
+		[self evictGroupsFromStack:mRedoStack
+						 totalCost:total];
+	}
+
+	mIsRemovingTargets = NO;
+}
+
 - (GCUndoGroup*)peekUndo
 {
 	// return the current top undo task without popping it off the stack.
@@ -605,6 +757,7 @@
 	THROW_IF_FALSE(aGroup != nil, @"invalid attempt to push a nil group onto undo stack");
 
 	[mUndoStack addObject:aGroup];
+	[self indexGroup:aGroup];
 }
 
 - (void)pushGroupOntoRedoStack:(GCUndoGroup*)aGroup
@@ -612,6 +765,7 @@
 	THROW_IF_FALSE(aGroup != nil, @"invalid attempt to push a nil group onto redo stack");
 
 	[mRedoStack addObject:aGroup];
+	[self indexGroup:aGroup];
 }
 
 - (BOOL)submitUndoTask:(GCConcreteUndoTask*)aTask
@@ -622,26 +776,9 @@
 
 	THROW_IF_FALSE(aTask != nil, @"invalid task was nil in -submitUndoTask:");
 
-	// if coalescing, reject invocation that matches an already registered target and selector within the current group.
-	// Coalescing is never done while redoing or undoing. Because this matches any already-registered action, not just the
-	// last action registered, it will also coalesce actions made up of multiple property changes. The match only checks the
-	// current open group, not any subgroups, so opening & closing groups automatically isolates coalescing to the current
-	// group scope as it should.
-
-	if ([self isUndoTaskCoalescingEnabled] && ([self undoManagerState] == kGCUndoCollectingTasks) && ([self currentGroup] != nil)) {
-		if ([self coalescingKind] == kGCCoalesceLastTask) {
-			GCConcreteUndoTask* lastTask = [[self currentGroup] lastTaskIfConcrete];
-
-			if ([lastTask target] == [aTask target] && [lastTask selector] == [aTask selector])
-				return NO;
-		} else {
-			NSArray* matchingTasks = [[self currentGroup] tasksWithTarget:[aTask target]
-																 selector:[aTask selector]];
-
-			if ([matchingTasks count] > 0)
-				return NO;
-		}
-	}
+	if ([self shouldCoalesceTaskWithTarget:[aTask target]
+								  selector:[aTask selector]])
+		return NO;
 
 	// for just-in-time grouping, open a group now if not open already and groupsByEvent is YES
 
@@ -655,6 +792,7 @@
 	++mChangeCount;
 
 	[[self currentGroup] addTask:aTask];
+	[self indexTarget:[aTask target]];
 
 	//NSLog(@"new task submitted %@: %@", [self isUndoing]? @"to r-stack" : @"to u-stack", aTask );
 
@@ -666,6 +804,26 @@
 	return YES;
 }
 
+- (BOOL)shouldCoalesceTaskWithTarget:(id)target selector:(SEL)selector
+{
+	// if coalescing, reject a task that matches an already registered target and selector within the current group.
+	// Coalescing is never done while redoing or undoing. Because this matches any already-registered action, not just the
+	// last action registered, it will also coalesce actions made up of multiple property changes. The match only checks the
+	// current open group, not any subgroups, so opening & closing groups automatically isolates coalescing to the current
+	// group scope as it should.
+
+	if ([self isUndoTaskCoalescingEnabled] && ([self undoManagerState] == kGCUndoCollectingTasks) && ([self currentGroup] != nil)) {
+		if ([self coalescingKind] == kGCCoalesceLastTask)
+			return [[self currentGroup] lastTaskHasTarget:target
+												 selector:selector];
+		else
+			return [[self currentGroup] hasTaskWithTarget:target
+												 selector:selector];
+	}
+
+	return NO;
+}
+
 - (void)popUndoAndPerformTasks
 {
 	// pops the top undo group and invokes all of its tasks
@@ -752,12 +910,134 @@
 	}
 }
 
+- (NSUInteger)evictGroupsFromStack:(NSMutableArray*)stack totalCost:(NSUInteger)total
+{
+	// archives (if enabled) and then discards groups from the bottom of <stack> until <total> is within budget, returning the new total.
+	// The top group is always kept
+
+	NSUInteger i;
+
+	if ([self archivesEvictedGroups]) {
+		for (i = 0; total > mUndoByteBudget && i + 1 < [stack count]; ++i) {
+			GCUndoGroup* group = [stack objectAtIndex:i];
+
+			if (![group isArchived]) {
+				NSUInteger before = [group undoCost];
+
+				[group archiveArguments];
+				total = total - before + [group undoCost];
+			}
+		}
+	}
+
+	while (total > mUndoByteBudget && [stack count] > 1) {
+		total -= MIN(total, [[stack objectAtIndex:0] undoCost]);
+		[self removeGroupAtIndex:0
+					   fromStack:stack];
+	}
+
+	return total;
+}
+
+- (void)removeGroupAtIndex:(NSUInteger)indx fromStack:(NSMutableArray*)stack
+{
+	// all groups leave the stacks through here or the pop methods, so the index never holds a group that might have been deallocated
+
+	[self unindexGroup:[stack objectAtIndex:indx]];
+	[stack removeObjectAtIndex:indx];
+}
+
+- (void)removeEmptyGroups
+{
+	// removes the groups left empty by -removeAllActionsWithTarget:, apart from the open group, in one pass over the stacks
+
+	if (!mHasEmptyGroups || mIsRemovingTargets)
+		return;
+
+	mIsRemovingTargets = YES;
+
+	GCUndoGroup* openGroup = [self openTopGroup];
+	NSUInteger i;
+
+	for (i = [mUndoStack count]; i > 0; --i) {
+		GCUndoGroup* group = [mUndoStack objectAtIndex:i - 1];
+
+		if (group != openGroup && [group isEmpty])
+			[self removeGroupAtIndex:i - 1
+						   fromStack:mUndoStack];
+	}
+
+	for (i = [mRedoStack count]; i > 0; --i) {
+		GCUndoGroup* group = [mRedoStack objectAtIndex:i - 1];
+
+		if (group != openGroup && [group isEmpty])
+			[self removeGroupAtIndex:i - 1
+						   fromStack:mRedoStack];
+	}
+
+	mHasEmptyGroups = NO;
+	mIsRemovingTargets = NO;
+}
+
+- (GCUndoGroup*)openTopGroup
+{
+	// the top level group containing the open group, or nil if no group is open
+
+	GCUndoGroup* group = [self currentGroup];
+
+	while ([group parentGroup])
+		group = [group parentGroup];
+
+	return group;
+}
+
+- (void)indexTarget:(id)target
+{
+	// records that the open top level group now holds a task for <target>
+
+	GCUndoGroup* group = [self openTopGroup];
+
+	if (target && group) {
+		GCTargetIndexContext ctx = { mTargetGroups, group };
+		addGroupForTarget(target, &ctx);
+	}
+}
+
+- (void)indexGroup:(GCUndoGroup*)group
+{
+	// a group is usually empty when it's pushed, but -explodeTopUndoAction pushes groups that already hold tasks
+
+	if ([group taskCount] == 0)
+		return;
+
+	CFMutableSetRef targets = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+	GCTargetIndexContext ctx = { mTargetGroups, group };
+
+	[group addTargetsToSet:targets];
+	CFSetApplyFunction(targets, addGroupForTarget, &ctx);
+	CFRelease(targets);
+}
+
+- (void)unindexGroup:(GCUndoGroup*)group
+{
+	if ([group taskCount] == 0)
+		return;
+
+	CFMutableSetRef targets = CFSetCreateMutable(kCFAllocatorDefault, 0, NULL);
+	GCTargetIndexContext ctx = { mTargetGroups, group };
+
+	[group addTargetsToSet:targets];
+	CFSetApplyFunction(targets, removeGroupForTarget, &ctx);
+	CFRelease(targets);
+}
+
 - (GCUndoGroup*)popUndo
 {
 	// pops the top undo task and returns it, or nil if the stack is empty.
 
 	if ([mUndoStack count] > 0) {
 		GCUndoGroup* group = [[[self peekUndo] retain] autorelease];
+		[self unindexGroup:group];
 		[mUndoStack removeLastObject];
 
 		return group;
@@ -771,6 +1051,7 @@
 
 	if ([mRedoStack count] > 0) {
 		GCUndoGroup* group = [[[self peekRedo] retain] autorelease];
+		[self unindexGroup:group];
 		[mRedoStack removeLastObject];
 
 		return group;
@@ -784,6 +1065,13 @@
 
 	if (!mIsRemovingTargets) {
 		mIsRemovingTargets = YES;
+
+		NSEnumerator* iter = [mRedoStack objectEnumerator];
+		GCUndoGroup* group;
+
+		while ((group = [iter nextObject]))
+			[self unindexGroup:group];
+
 		[mRedoStack removeAllObjects];
 		mIsRemovingTargets = NO;
 	}
@@ -793,8 +1081,10 @@
 {
 	// sends the checkpoint notification. Frankly, this seems very vague and called at all sorts of random points, so it's unclear
 	// exactly what the notification is meant to do. The GNUStep implementation also sends it more than the current documentation
-	// for NSUndoManager indicates. This implementation follows the current documentation.
+	// for NSUndoManager indicates. This implementation follows the current documentation. It's also when groups left empty by removing
+	// targets are cleared away.
 
+	[self removeEmptyGroups];
 	[[NSNotificationCenter defaultCenter] postNotificationName:NSUndoManagerCheckpointNotification
 														object:self];
 }
@@ -867,6 +1157,7 @@
 	if (self) {
 		mUndoStack = [[NSMutableArray alloc] init];
 		mRedoStack = [[NSMutableArray alloc] init];
+		mTargetGroups = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
 
 		mGroupsByEvent = YES;
 		mRunLoopModes = [[NSArray arrayWithObject:NSDefaultRunLoopMode] retain];
@@ -887,6 +1178,7 @@
 
 	[mUndoStack release];
 	[mRedoStack release];
+	CFRelease(mTargetGroups);
 	[mRunLoopModes release];
 	[mProxy release];
 	[super dealloc];
@@ -940,6 +1232,58 @@
 	NSAssert(NO, @"-perform must be overridden");
 }
 
+- (BOOL)archiveArguments
+{
+	return NO;
+}
+
+@end
+
+#pragma mark -
+
+/// one task in a group - either a task object, or the target, selector and argument of a task registered directly
+
+typedef struct _GCUndoRecord {
+	GCUndoTask* task; // retained task object, or nil for a compact record
+	id target; // for fast matching this is also set for concrete task objects
+	SEL selector; // NULL for a handler or a group
+	id object; // retained argument, or the handler block
+	NSUInteger cost; // cost of the task or argument, 0 for a group
+	BOOL targetRetained;
+} GCUndoRecord;
+
+// the approximate cost of a block, which can't be known
+
+#define kGCUndoHandlerCost 64
+
+static NSUInteger recordHash(id target, SEL selector)
+{
+	NSUInteger h = ((NSUInteger)target >> 4) * 2654435761u;
+
+	return h ^ ((NSUInteger)selector >> 2);
+}
+
+static NSUInteger recordCost(GCUndoRecord* record)
+{
+	if ([record->task isKindOfClass:[GCUndoGroup class]])
+		return 0;
+	else if (record->task != nil)
+		return sizeof(GCUndoRecord) + [record->task undoCost];
+	else if (record->selector != NULL)
+		return sizeof(GCUndoRecord) + [record->object undoCost];
+	else
+		return sizeof(GCUndoRecord) + kGCUndoHandlerCost;
+}
+
+@interface GCUndoGroup (Private)
+
+- (GCUndoRecord*)appendRecord;
+- (void)indexRecordAtIndex:(NSUInteger)indx;
+- (void)rebuildIndex;
+- (GCUndoTask*)taskForRecordAtIndex:(NSUInteger)indx;
+- (void)releaseRecord:(GCUndoRecord*)record;
+- (void)addCostOfRecord:(GCUndoRecord*)record;
+
 @end
 
 #pragma mark -
@@ -950,20 +1294,101 @@
 {
 	THROW_IF_FALSE1(aTask != nil, @"invalid attempt to add a nil task to group %@", self);
 
-	[mTasks addObject:aTask];
+	GCUndoRecord* record = [self appendRecord];
+
+	record->task = [aTask retain];
+
+	if ([aTask isKindOfClass:[GCConcreteUndoTask class]]) {
+		record->target = [(GCConcreteUndoTask*)aTask target];
+		record->selector = [(GCConcreteUndoTask*)aTask selector];
+	} else if ([aTask isKindOfClass:[GCUndoGroup class]])
+		mHasSubgroups = YES;
+
+	[self addCostOfRecord:record];
 	[aTask setParentGroup:self];
+	[self indexRecordAtIndex:mCount - 1];
+}
+
+- (void)addTarget:(id)target selector:(SEL)selector object:(id)object retainingTarget:(BOOL)retainIt
+{
+	// records a task without making a task object for it. It is performed by sending <selector> to <target> with <object>
+
+	THROW_IF_FALSE1(selector != NULL, @"invalid attempt to add a task with a NULL selector to group %@", self);
+
+	GCUndoRecord* record = [self appendRecord];
+
+	record->target = retainIt ? [target retain] : target;
+	record->targetRetained = retainIt;
+	record->selector = selector;
+	record->object = [object retain];
+
+	[self addCostOfRecord:record];
+	[self indexRecordAtIndex:mCount - 1];
+}
+
+- (void)addTarget:(id)target handler:(void (^)(id target))handler retainingTarget:(BOOL)retainIt
+{
+	THROW_IF_FALSE1(handler != nil, @"invalid attempt to add a nil handler to group %@", self);
+
+	GCUndoRecord* record = [self appendRecord];
+
+	record->target = retainIt ? [target retain] : target;
+	record->targetRetained = retainIt;
+	record->object = [handler copy];
+
+	[self addCostOfRecord:record];
+}
+
+- (BOOL)hasTaskWithTarget:(id)target selector:(SEL)selector
+{
+	// searches this group (but not any subgroups) for a task matching the target and selector, without allocating anything
+
+	if (mIndexSize == 0 || selector == NULL)
+		return NO;
+
+	NSUInteger mask = mIndexSize - 1;
+	NSUInteger slot = recordHash(target, selector) & mask;
+
+	while (mIndex[slot] != 0) {
+		GCUndoRecord* record = &mRecords[mIndex[slot] - 1];
+
+		if (record->target == target && record->selector == selector)
+			return YES;
+
+		slot = (slot + 1) & mask;
+	}
+
+	return NO;
+}
+
+- (BOOL)lastTaskHasTarget:(id)target selector:(SEL)selector
+{
+	if (mCount == 0 || selector == NULL)
+		return NO;
+
+	GCUndoRecord* record = &mRecords[mCount - 1];
+
+	return record->target == target && record->selector == selector;
+}
+
+- (NSUInteger)taskCount
+{
+	return mCount;
 }
 
 - (GCUndoTask*)taskAtIndex:(NSUInteger)indx
 {
-	THROW_IF_FALSE2(indx < [[self tasks] count], @"invalid task index (%ld) in group %@", (long)indx, self);
+	THROW_IF_FALSE2(indx < mCount, @"invalid task index (%ld) in group %@", (long)indx, self);
 
-	return [[self tasks] objectAtIndex:indx];
+	return [self taskForRecordAtIndex:indx];
 }
 
 - (GCConcreteUndoTask*)lastTaskIfConcrete
 {
-	GCUndoTask* task = [[self tasks] lastObject];
+	if (mCount == 0)
+		return nil;
+
+	GCUndoTask* task = [self taskForRecordAtIndex:mCount - 1];
 
 	if ([task isKindOfClass:[GCConcreteUndoTask class]])
 		return (GCConcreteUndoTask*)task;
@@ -973,30 +1398,37 @@
 
 - (NSArray*)tasks
 {
-	return mTasks;
+	// compact records are turned into task objects here, so this is relatively costly and is intended for inspection and debugging
+
+	NSMutableArray* tasks = [NSMutableArray arrayWithCapacity:mCount];
+	NSUInteger i;
+
+	for (i = 0; i < mCount; ++i)
+		[tasks addObject:[self taskForRecordAtIndex:i]];
+
+	return tasks;
 }
 
 - (NSArray*)tasksWithTarget:(id)target selector:(SEL)selector
 {
 	// searches this group (but not any subgroups) for tasks matching the target & selector. Pass nil if you don't care about
-	// a match (so nil, nil returns all tasks). No matches returns the empty array. This is typically used as part of the coalescing
-	// done by the um, where the current open group is checked for a match in order to drop identical tasks.
+	// a match (so nil, nil returns all tasks). No matches returns the empty array. The undo manager's coalescing uses
+	// -hasTaskWithTarget:selector: instead, which doesn't need to build the array.
 
 	if (target == nil && selector == NULL)
 		return [self tasks];
 
-	NSEnumerator* iter = [[self tasks] objectEnumerator];
-	GCUndoTask* task;
 	NSMutableArray* tasks = [NSMutableArray array];
+	NSUInteger i;
 
-	while ((task = [iter nextObject])) {
-		if ([task isKindOfClass:[GCConcreteUndoTask class]]) {
-			id targ = [(GCConcreteUndoTask*)task target];
-			SEL sel = [(GCConcreteUndoTask*)task selector];
+	for (i = 0; i < mCount; ++i) {
+		GCUndoRecord* record = &mRecords[i];
 
-			if ((target == nil || target == targ) && (selector == NULL || selector == sel))
-				[tasks addObject:task];
-		}
+		if (record->task != nil && ![record->task isKindOfClass:[GCConcreteUndoTask class]])
+			continue;
+
+		if ((target == nil || target == record->target) && (selector == NULL || selector == record->selector))
+			[tasks addObject:[self taskForRecordAtIndex:i]];
 	}
 
 	return tasks;
@@ -1006,64 +1438,247 @@
 {
 	// return whether the group contains any actual tasks. If it only contains other empty groups, returns YES.
 
-	if ([[self tasks] count] == 0)
-		return YES;
-	else {
-		NSEnumerator* iter = [[self tasks] objectEnumerator];
-		GCUndoTask* task;
+	NSUInteger i;
 
-		while ((task = [iter nextObject])) {
-			if ([task isKindOfClass:[self class]]) {
-				// is a group - is that one empty?
+	for (i = 0; i < mCount; ++i) {
+		GCUndoTask* task = mRecords[i].task;
 
-				if (![(GCUndoGroup*)task isEmpty])
-					return NO;
-			} else
-				return NO;
-		}
+		if (task == nil || ![task isKindOfClass:[GCUndoGroup class]] || ![(GCUndoGroup*)task isEmpty])
+			return NO;
 	}
 
 	return YES;
 }
 
-- (void)removeTasksWithTarget:(id)aTarget undoManager:(GCUndoManager*)um
+- (BOOL)isArchived
 {
-	// Removes all tasks in this group and any subgroups having the given target.
-	// It also removes any subgroups that become empty as a result.
+	return mArchived;
+}
+
+- (void)restoreArguments
+{
+	// unarchives the arguments of the compact records. Task objects and subgroups restore their own when they are performed
 
-	NSArray* temp = [[self tasks] copy];
-	NSEnumerator* iter = [temp objectEnumerator];
-	GCUndoTask* task;
+	if (!mArchived)
+		return;
 
-	while ((task = [iter nextObject])) {
-		if ([task respondsToSelector:_cmd]) {
-			[(GCUndoGroup*)task removeTasksWithTarget:aTarget
-										  undoManager:um];
+	NSDictionary* objects = nil;
 
-			if ([(GCUndoGroup*)task isEmpty] && [um currentGroup] != task)
-				[mTasks removeObject:task];
-		} else if ([task respondsToSelector:@selector(target)]) {
-			if (aTarget == [(GCConcreteUndoTask*)task target])
-				[mTasks removeObject:task];
-		}
+	if (mArchivedObjects)
+		objects = [NSKeyedUnarchiver unarchiveObjectWithData:mArchivedObjects];
+
+	NSUInteger i;
+
+	mCost = 0;
+
+	for (i = 0; i < mCount; ++i) {
+		GCUndoRecord* record = &mRecords[i];
+
+		if (record->task == nil)
+			record->object = [[objects objectForKey:[NSNumber numberWithUnsignedInteger:i]] retain];
+
+		record->cost = 0;
+		[self addCostOfRecord:record];
 	}
 
-	[temp release];
+	[mArchivedObjects release];
+	mArchivedObjects = nil;
+	mArchived = NO;
 }
 
-- (void)setActionName:(NSString*)name
+- (void)addTargetsToSet:(CFMutableSetRef)targets
 {
-	// sets the group's action name. In general this is automatically handled by the owning undo manager
+	NSUInteger i;
 
-	[name retain];
-	[mActionName release];
-	mActionName = name;
+	for (i = 0; i < mCount; ++i) {
+		GCUndoRecord* record = &mRecords[i];
+
+		if ([record->task isKindOfClass:[GCUndoGroup class]])
+			[(GCUndoGroup*)record->task addTargetsToSet:targets];
+		else if (record->target)
+			CFSetAddValue(targets, record->target);
+	}
 }
 
-- (NSString*)actionName
+- (void)removeTasksWithTarget:(id)aTarget undoManager:(GCUndoManager*)um
 {
-	return mActionName;
-}
+	// Removes all tasks in this group and any subgroups having the given target.
+	// It also removes any subgroups that become empty as a result.
+
+	NSUInteger i, kept = 0;
+
+	// the archive is indexed by record, so it must be restored before any records are removed
+
+	[self restoreArguments];
+
+	for (i = 0; i < mCount; ++i) {
+		GCUndoRecord* record = &mRecords[i];
+		BOOL removeIt = NO;
+
+		if ([record->task isKindOfClass:[GCUndoGroup class]]) {
+			[(GCUndoGroup*)record->task removeTasksWithTarget:aTarget
+												  undoManager:um];
+
+			removeIt = [(GCUndoGroup*)record->task isEmpty] && [um currentGroup] != record->task;
+		} else
+			removeIt = (record->target == aTarget);
+
+		if (removeIt) {
+			mCost -= MIN(mCost, record->cost);
+			[self releaseRecord:record];
+		} else
+			mRecords[kept++] = *record;
+	}
+
+	if (kept != mCount) {
+		mCount = kept;
+		[self rebuildIndex];
+	}
+}
+
+- (void)setActionName:(NSString*)name
+{
+	// sets the group's action name. In general this is automatically handled by the owning undo manager
+
+	[name retain];
+	[mActionName release];
+	mActionName = name;
+}
+
+- (NSString*)actionName
+{
+	return mActionName;
+}
+
+#pragma mark -
+
+- (GCUndoRecord*)appendRecord
+{
+	// records are stored in one block that grows by doubling, so adding tasks doesn't allocate per task
+
+	if (mCount == mCapacity) {
+		NSUInteger newCapacity = MAX(8U, mCapacity * 2);
+		GCUndoRecord* newRecords = realloc(mRecords, newCapacity * sizeof(GCUndoRecord));
+
+		THROW_IF_FALSE(newRecords != NULL, @"unable to allocate undo task records");
+
+		mRecords = newRecords;
+		mCapacity = newCapacity;
+	}
+
+	GCUndoRecord* record = &mRecords[mCount++];
+	memset(record, 0, sizeof(GCUndoRecord));
+
+	return record;
+}
+
+- (void)indexRecordAtIndex:(NSUInteger)indx
+{
+	// the index is kept at most half full, so probes are short
+
+	if (mCount * 2 > mIndexSize) {
+		[self rebuildIndex];
+		return;
+	}
+
+	GCUndoRecord* record = &mRecords[indx];
+
+	if (record->selector == NULL)
+		return;
+
+	NSUInteger mask = mIndexSize - 1;
+	NSUInteger slot = recordHash(record->target, record->selector) & mask;
+
+	while (mIndex[slot] != 0)
+		slot = (slot + 1) & mask;
+
+	mIndex[slot] = indx + 1;
+}
+
+- (void)rebuildIndex
+{
+	NSUInteger size = 16;
+
+	while (size < mCount * 2)
+		size *= 2;
+
+	if (size != mIndexSize) {
+		free(mIndex);
+		mIndex = malloc(size * sizeof(NSUInteger));
+
+		THROW_IF_FALSE(mIndex != NULL, @"unable to allocate undo task index");
+
+		mIndexSize = size;
+	}
+
+	memset(mIndex, 0, mIndexSize * sizeof(NSUInteger));
+
+	NSUInteger i, mask = mIndexSize - 1;
+
+	for (i = 0; i < mCount; ++i) {
+		GCUndoRecord* record = &mRecords[i];
+
+		if (record->selector == NULL)
+			continue;
+
+		NSUInteger slot = recordHash(record->target, record->selector) & mask;
+
+		while (mIndex[slot] != 0)
+			slot = (slot + 1) & mask;
+
+		mIndex[slot] = i + 1;
+	}
+}
+
+- (GCUndoTask*)taskForRecordAtIndex:(NSUInteger)indx
+{
+	// returns the task object for a record, making one from a compact record and keeping it in its place if necessary
+
+	[self restoreArguments];
+
+	GCUndoRecord* record = &mRecords[indx];
+
+	if (record->task == nil) {
+		GCConcreteUndoTask* task;
+
+		if (record->selector != NULL)
+			task = [[GCConcreteUndoTask alloc] initWithTarget:record->target
+													 selector:record->selector
+													   object:record->object];
+		else
+			task = [[GCConcreteUndoTask alloc] initWithTarget:record->target
+													  handler:record->object];
+
+		[task setTarget:record->target
+			   retained:record->targetRetained];
+		[task setParentGroup:self];
+
+		if (record->targetRetained)
+			[record->target release];
+
+		[record->object release];
+		record->object = nil;
+		record->targetRetained = NO;
+		record->task = task;
+	}
+
+	return record->task;
+}
+
+- (void)releaseRecord:(GCUndoRecord*)record
+{
+	[record->task release];
+	[record->object release];
+
+	if (record->targetRetained)
+		[record->target release];
+}
+
+- (void)addCostOfRecord:(GCUndoRecord*)record
+{
+	record->cost = recordCost(record);
+	mCost += record->cost;
+}
 
 #pragma mark -
 #pragma mark - as a GCUndoTask
@@ -1072,37 +1687,138 @@
 {
 	// cause the tasks in the group to be executed IN REVERSE ORDER. Subgroups are recursively executed.
 
-	NSInteger i = [[self tasks] count];
+	[self restoreArguments];
+
+	NSInteger i = mCount;
 
-	while (i-- > 0)
-		[[self taskAtIndex:i] perform];
+	while (i-- > 0) {
+		GCUndoRecord* record = &mRecords[i];
+
+		if (record->task != nil)
+			[record->task perform];
+		else if (record->target != nil) {
+			if (record->selector != NULL)
+				[record->target performSelector:record->selector
+									 withObject:record->object];
+			else
+				((void (^)(id))record->object)(record->target);
+		}
+	}
 }
 
-#pragma mark -
-#pragma mark - as a NSObject
+- (BOOL)archiveArguments
+{
+	// archives the arguments of the compact records into one block of data, and asks the task objects and subgroups to archive theirs.
+	// Fails if any task can't be archived, though those that could will have been
 
-- (id)init
+	if (mArchived)
+		return YES;
+
+	NSMutableDictionary* objects = [NSMutableDictionary dictionary];
+	BOOL archivable = YES;
+	NSUInteger i;
+
+	for (i = 0; i < mCount; ++i) {
+		GCUndoRecord* record = &mRecords[i];
+
+		if (record->task != nil) {
+			NSUInteger before = record->cost;
+
+			archivable = [record->task archiveArguments] && archivable;
+
+			// a task's cost changes when it's archived, but a subgroup's isn't kept in its record
+
+			if (before != 0) {
+				mCost -= MIN(mCost, before);
+				[self addCostOfRecord:record];
+			}
+		} else if (record->selector == NULL)
+			archivable = NO;
+		else if (record->object != nil) {
+			// an object that's part of the document must stay the same object, or undoing would act on a copy the document doesn't contain
+
+			if ([record->object isArchivableUndoValue])
+				[objects setObject:record->object
+							forKey:[NSNumber numberWithUnsignedInteger:i]];
+			else
+				archivable = NO;
+		}
+	}
+
+	if (!archivable)
+		return NO;
+
+	NSData* data = nil;
+
+	if ([objects count] > 0) {
+		@try
+		{
+			data = [NSKeyedArchiver archivedDataWithRootObject:objects];
+		}
+		@catch (NSException* excp)
+		{
+			NSLog(@"undo group could not be archived: %@", excp);
+			return NO;
+		}
+	}
+
+	mArchivedObjects = [data retain];
+	mArchived = YES;
+	mCost = [data length];
+
+	for (i = 0; i < mCount; ++i) {
+		GCUndoRecord* record = &mRecords[i];
+
+		if (record->task == nil) {
+			[record->object release];
+			record->object = nil;
+		}
+
+		record->cost = 0;
+		[self addCostOfRecord:record];
+	}
+
+	return YES;
+}
+
+- (NSUInteger)undoCost
 {
-	self = [super init];
-	if (self) {
-		mTasks = [[NSMutableArray alloc] init];
+	NSUInteger cost = class_getInstanceSize([self class]) + mCapacity * sizeof(GCUndoRecord) + mIndexSize * sizeof(NSUInteger) + mCost;
+
+	if (mHasSubgroups) {
+		NSUInteger i;
+
+		for (i = 0; i < mCount; ++i) {
+			if ([mRecords[i].task isKindOfClass:[GCUndoGroup class]])
+				cost += [mRecords[i].task undoCost];
+		}
 	}
 
-	return self;
+	return cost;
 }
 
+#pragma mark -
+#pragma mark - as a NSObject
+
 - (void)dealloc
 {
 	//NSLog(@"deallocating undo group %@", self );
 
-	[mTasks release];
+	NSUInteger i;
+
+	for (i = 0; i < mCount; ++i)
+		[self releaseRecord:&mRecords[i]];
+
+	free(mRecords);
+	free(mIndex);
+	[mArchivedObjects release];
 	[mActionName release];
 	[super dealloc];
 }
 
 - (NSString*)description
 {
-	return [NSString stringWithFormat:@"%@ '%@' %lu tasks: %@", [super description], [self actionName], (unsigned long)[mTasks count], mTasks];
+	return [NSString stringWithFormat:@"%@ '%@' %lu tasks: %@", [super description], [self actionName], (unsigned long)mCount, [self tasks]];
 }
 
 @end
@@ -1162,6 +1878,24 @@
 	return self;
 }
 
+- (id)initWithTarget:(id)target handler:(void (^)(id target))handler
+{
+	// initialises a task that calls <handler> with its target when performed, instead of an invocation
+
+	self = [super init];
+	if (self) {
+		if (handler) {
+			mHandler = [handler copy];
+			mTarget = target;
+		} else {
+			[self autorelease];
+			self = nil;
+		}
+	}
+
+	return self;
+}
+
 - (void)setTarget:(id)target retained:(BOOL)retainIt
 {
 	// sets the invocation's target, optionally retaining it.
@@ -1186,6 +1920,27 @@
 	return [mInvocation selector];
 }
 
+- (void)restoreArguments
+{
+	if (mArchivedArguments == nil)
+		return;
+
+	NSDictionary* arguments = [NSKeyedUnarchiver unarchiveObjectWithData:mArchivedArguments];
+	NSEnumerator* iter = [arguments keyEnumerator];
+	NSNumber* indx;
+
+	while ((indx = [iter nextObject])) {
+		id object = [arguments objectForKey:indx];
+
+		[mInvocation setArgument:&object
+						 atIndex:[indx integerValue]];
+	}
+
+	[mArchivedArguments release];
+	mArchivedArguments = nil;
+	mCost = 0;
+}
+
 #pragma mark -
 #pragma mark - as a GCUndoTask
 
@@ -1195,8 +1950,109 @@
 
 	//NSLog(@"about to invoke task %@", self );
 
-	if (mTarget)
-		[mInvocation invokeWithTarget:mTarget];
+	if (mTarget) {
+		if (mHandler)
+			((void (^)(id))mHandler)(mTarget);
+		else {
+			[self restoreArguments];
+			[mInvocation invokeWithTarget:mTarget];
+		}
+	}
+}
+
+- (BOOL)archiveArguments
+{
+	// archives the invocation's object arguments and sets them to nil, which releases them. A handler can't be archived
+
+	if (mArchivedArguments)
+		return YES;
+
+	if (mHandler)
+		return NO;
+
+	NSMethodSignature* sig = [mInvocation methodSignature];
+	NSMutableDictionary* arguments = [NSMutableDictionary dictionary];
+	NSUInteger i;
+
+	for (i = 2; i < [sig numberOfArguments]; ++i) {
+		if (*[sig getArgumentTypeAtIndex:i] == _C_ID) {
+			id object = nil;
+
+			[mInvocation getArgument:&object
+							 atIndex:i];
+
+			if (object == nil)
+				continue;
+
+			if (![object isArchivableUndoValue])
+				return NO;
+
+			[arguments setObject:object
+						  forKey:[NSNumber numberWithUnsignedInteger:i]];
+		}
+	}
+
+	if ([arguments count] == 0)
+		return YES;
+
+	NSData* data;
+
+	@try
+	{
+		data = [NSKeyedArchiver archivedDataWithRootObject:arguments];
+	}
+	@catch (NSException* excp)
+	{
+		NSLog(@"undo task could not be archived: %@", excp);
+		return NO;
+	}
+
+	NSEnumerator* iter = [arguments keyEnumerator];
+	NSNumber* indx;
+	id nilObject = nil;
+
+	while ((indx = [iter nextObject]))
+		[mInvocation setArgument:&nilObject
+						 atIndex:[indx integerValue]];
+
+	mArchivedArguments = [data retain];
+	mCost = 0;
+
+	return YES;
+}
+
+- (NSUInteger)undoCost
+{
+	// the cost of the invocation's object arguments, or of their archive. The target isn't counted
+
+	if (mCost == 0) {
+		mCost = class_getInstanceSize([self class]);
+
+		if (mHandler)
+			mCost += kGCUndoHandlerCost;
+		else if (mInvocation) {
+			NSMethodSignature* sig = [mInvocation methodSignature];
+			NSUInteger i;
+
+			mCost += class_getInstanceSize([mInvocation class]) + [sig frameLength];
+
+			if (mArchivedArguments)
+				mCost += [mArchivedArguments length];
+			else {
+				for (i = 2; i < [sig numberOfArguments]; ++i) {
+					if (*[sig getArgumentTypeAtIndex:i] == _C_ID) {
+						id object = nil;
+
+						[mInvocation getArgument:&object
+										 atIndex:i];
+						mCost += [object undoCost];
+					}
+				}
+			}
+		}
+	}
+
+	return mCost;
 }
 
 #pragma mark -
@@ -1211,6 +2067,8 @@
 - (void)dealloc
 {
 	[mInvocation release];
+	[mHandler release];
+	[mArchivedArguments release];
 
 	if (mTargetRetained)
 		[mTarget release];
@@ -1265,3 +2123,225 @@
 
 @end
 ;
+
+#pragma mark -
+
+@implementation NSObject (GCUndoCost)
+
+- (NSUInteger)undoCost
+{
+	return class_getInstanceSize([self class]);
+}
+
+@end
+
+@implementation NSString (GCUndoCost)
+
+- (NSUInteger)undoCost
+{
+	return [super undoCost] + [self length] * sizeof(unichar);
+}
+
+@end
+
+@implementation NSData (GCUndoCost)
+
+- (NSUInteger)undoCost
+{
+	return [super undoCost] + [self length];
+}
+
+@end
+
+@implementation NSArray (GCUndoCost)
+
+- (NSUInteger)undoCost
+{
+	NSEnumerator* iter = [self objectEnumerator];
+	NSUInteger cost = [super undoCost] + [self count] * sizeof(id);
+	id object;
+
+	while ((object = [iter nextObject]))
+		cost += [object undoCost];
+
+	return cost;
+}
+
+@end
+
+@implementation NSSet (GCUndoCost)
+
+- (NSUInteger)undoCost
+{
+	NSEnumerator* iter = [self objectEnumerator];
+	NSUInteger cost = [super undoCost] + [self count] * sizeof(id);
+	id object;
+
+	while ((object = [iter nextObject]))
+		cost += [object undoCost];
+
+	return cost;
+}
+
+@end
+
+@implementation NSDictionary (GCUndoCost)
+
+- (NSUInteger)undoCost
+{
+	NSEnumerator* iter = [self keyEnumerator];
+	NSUInteger cost = [super undoCost] + [self count] * 2 * sizeof(id);
+	id key;
+
+	while ((key = [iter nextObject]))
+		cost += [key undoCost] + [[self objectForKey:key] undoCost];
+
+	return cost;
+}
+
+@end
+
+@implementation NSBezierPath (GCUndoCost)
+
+- (NSUInteger)undoCost
+{
+	// allows for the three points of a curve per element
+
+	return [super undoCost] + [self elementCount] * (3 * sizeof(NSPoint) + sizeof(NSInteger));
+}
+
+@end
+
+#pragma mark -
+
+@implementation NSObject (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return NO;
+}
+
+@end
+
+@implementation NSString (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSAttributedString (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSData (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSValue (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSDate (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSColor (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSBezierPath (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSAffineTransform (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	return YES;
+}
+
+@end
+
+@implementation NSArray (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	NSEnumerator* iter = [self objectEnumerator];
+	id object;
+
+	while ((object = [iter nextObject])) {
+		if (![object isArchivableUndoValue])
+			return NO;
+	}
+
+	return YES;
+}
+
+@end
+
+@implementation NSSet (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	NSEnumerator* iter = [self objectEnumerator];
+	id object;
+
+	while ((object = [iter nextObject])) {
+		if (![object isArchivableUndoValue])
+			return NO;
+	}
+
+	return YES;
+}
+
+@end
+
+@implementation NSDictionary (GCUndoArchiving)
+
+- (BOOL)isArchivableUndoValue
+{
+	NSEnumerator* iter = [self keyEnumerator];
+	id key;
+
+	while ((key = [iter nextObject])) {
+		if (![key isArchivableUndoValue] || ![[self objectForKey:key] isArchivableUndoValue])
+			return NO;
+	}
+
+	return YES;
+}
+
+@end
@@ -27,6 +27,9 @@ it will get initialized to 0.0 and NOTHING WILL BE DRAWN.
 	NSUInteger mScrollwheelModifierMask;
 	BOOL mIsChangingScale;
 	DKRetriggerableTimer* mRT;
+	BOOL mUsesZoomPreview; // YES to draw from a scaled copy of the last frame while the scale is changing
+	NSImage* mZoomPreview; // the frame drawn before the scale started changing
+	NSRect mZoomPreviewRect; // the area of the view it shows
 }
 
 /** @brief Set whether scroll-wheel zooming is enabled
@@ -163,6 +166,33 @@ it will get initialized to 0.0 and NOTHING WILL BE DRAWN.
  */
 - (BOOL)isChangingScale;
 
+/** @brief Sets whether the view is drawn from a copy of its last frame while the scale is changing
+
+ When YES, the pixels on screen are copied as a zoom starts, and until it settles - when the retriggerable timer runs out - that copy
+ is scaled to fit instead of the content being rendered at each intermediate scale, which keeps a scrollwheel or pinch zoom of a big
+ drawing at the display's refresh rate. Parts of the view the copy doesn't cover, as appear when zooming out, are filled with
+ -zoomPreviewBackgroundColor. The content is rendered at full quality once again when the zoom settles. Subclasses opt in to this by
+ calling -drawZoomPreviewInRect: from their -drawRect:. Default is NO.
+ @param preview YES to draw from a copy while zooming
+ */
+- (void)setUsesZoomPreview:(BOOL)preview;
+- (BOOL)usesZoomPreview;
+
+/** @brief Draws the copy of the last frame, scaled to the current zoom, if the scale is changing and there is one
+
+ Subclasses call this at the start of -drawRect:, and draw their content as usual if it returns NO.
+ @param rect the rect being drawn
+ @return YES if the preview was drawn, NO if the content should be drawn
+ */
+- (BOOL)drawZoomPreviewInRect:(NSRect)rect;
+
+/** @brief The colour drawn where the zoom preview doesn't cover the view
+
+ Subclasses can override this to match their content. The default is white.
+ @return a colour
+ */
+- (NSColor*)zoomPreviewBackgroundColor;
+
 /** @brief Sets the minimum permitted view scale (zoom)
  @param scmin the minimum scale
  */
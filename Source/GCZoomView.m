@@ -12,6 +12,7 @@
 
 - (void)stopScaleChange;
 - (void)startScaleChange;
+- (void)captureZoomPreview;
 
 @end
 
@@ -307,6 +308,11 @@ NSString* kDKDrawingScrollwheelSensePrefsKey = @"kDKDrawingcrollwheelSense"; //
 		sc = [self maximumScale];
 
 	if (sc != [self scale]) {
+		// the preview is copied from the screen before the first change of scale, while it still shows the content at full quality
+
+		if (mUsesZoomPreview && !mIsChangingScale)
+			[self captureZoomPreview];
+
 		[self startScaleChange]; // stop is called by retriggerable timer
 
 		NSSize newSize;
@@ -356,6 +362,51 @@ NSString* kDKDrawingScrollwheelSensePrefsKey = @"kDKDrawingcrollwheelSense"; //
 	return mIsChangingScale;
 }
 
+- (void)setUsesZoomPreview:(BOOL)preview
+{
+	mUsesZoomPreview = preview;
+
+	if (!preview) {
+		[mZoomPreview release];
+		mZoomPreview = nil;
+	}
+}
+
+- (BOOL)usesZoomPreview
+{
+	return mUsesZoomPreview;
+}
+
+- (BOOL)drawZoomPreviewInRect:(NSRect)rect
+{
+	if (!mIsChangingScale || mZoomPreview == nil || ![NSGraphicsContext currentContextDrawingToScreen])
+		return NO;
+
+	NSGraphicsContext* context = [NSGraphicsContext currentContext];
+	NSImageInterpolation interpolation = [context imageInterpolation];
+
+	if (!NSContainsRect(mZoomPreviewRect, rect)) {
+		[[self zoomPreviewBackgroundColor] set];
+		NSRectFill(rect);
+	}
+
+	// the copy is in the view's own coordinates, which don't change with the scale, so it lands where the content it shows now is
+
+	[context setImageInterpolation:NSImageInterpolationLow];
+	[mZoomPreview drawInRect:mZoomPreviewRect
+					fromRect:NSZeroRect
+				   operation:NSCompositeSourceOver
+					fraction:1.0];
+	[context setImageInterpolation:interpolation];
+
+	return YES;
+}
+
+- (NSColor*)zoomPreviewBackgroundColor
+{
+	return [NSColor whiteColor];
+}
+
 /** @brief Sets the minimum permitted view scale (zoom)
  @param scmin the minimum scale
  */
@@ -393,6 +444,8 @@ NSString* kDKDrawingScrollwheelSensePrefsKey = @"kDKDrawingcrollwheelSense"; //
 - (void)stopScaleChange
 {
 	mIsChangingScale = NO;
+	[mZoomPreview release];
+	mZoomPreview = nil;
 	[self setNeedsDisplay:YES]; // redraw in high quality?
 
 	LogEvent_(kReactiveEvent, @"view stopped changing scale (%f): %@", [self scale], self);
@@ -404,6 +457,41 @@ NSString* kDKDrawingScrollwheelSensePrefsKey = @"kDKDrawingcrollwheelSense"; //
 	[mRT retrigger];
 }
 
+- (void)captureZoomPreview
+{
+	[mZoomPreview release];
+	mZoomPreview = nil;
+
+	NSRect visible = [self visibleRect];
+
+	if (NSIsEmptyRect(visible) || [self window] == nil || ![self canDraw])
+		return;
+
+	// the pixels already on screen are read back rather than rendered again. A layer-backed view's backing store can't be read that way,
+	// so it is rendered once instead.
+
+	NSBitmapImageRep* rep;
+
+	if ([self wantsLayer]) {
+		rep = [[self bitmapImageRepForCachingDisplayInRect:visible] retain];
+		[self cacheDisplayInRect:visible
+				toBitmapImageRep:rep];
+	} else {
+		[self lockFocus];
+		rep = [[NSBitmapImageRep alloc] initWithFocusedViewRect:visible];
+		[self unlockFocus];
+	}
+
+	if (rep) {
+		mZoomPreview = [[NSImage alloc] initWithSize:visible.size];
+		[mZoomPreview addRepresentation:rep];
+		[rep release];
+		mZoomPreviewRect = visible;
+
+		LogEvent_(kReactiveEvent, @"captured zoom preview of %@", NSStringFromRect(visible));
+	}
+}
+
 #pragma mark -
 #pragma mark As an NSResponder
 
@@ -432,6 +520,19 @@ NSString* kDKDrawingScrollwheelSensePrefsKey = @"kDKDrawingcrollwheelSense"; //
 		[super scrollWheel:theEvent];
 }
 
+/** @brief Allows a trackpad pinch to change the zoom.
+
+ Overrides NSResponder. As for the scrollwheel, the visible centre point stays put.
+ @param theEvent - magnify event */
+- (void)magnifyWithEvent:(NSEvent*)theEvent
+{
+	CGFloat factor = 1.0 + [theEvent magnification];
+
+	if (factor > 0.0)
+		[self zoomViewByFactor:factor
+				andCentrePoint:[self centredPointInDocView]];
+}
+
 #pragma mark -
 #pragma mark As an NSView
 
@@ -470,6 +571,7 @@ NSString* kDKDrawingScrollwheelSensePrefsKey = @"kDKDrawingcrollwheelSense"; //
 
 - (void)dealloc
 {
+	[mZoomPreview release];
 	[mRT release];
 	[super dealloc];
 }
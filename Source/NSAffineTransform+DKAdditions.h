@@ -16,6 +16,10 @@
 - (NSAffineTransform*)scaleBounds:(NSRect)bounds toHeight:(CGFloat)height centeredAboveOrigin:(CGFloat)distance;
 - (NSAffineTransform*)flipVertical:(NSRect)bounds;
 
+/** @brief Conversions to and from the Quartz form, which can be passed around and combined without allocating anything */
++ (NSAffineTransform*)transformWithCGAffineTransform:(CGAffineTransform)t;
+- (CGAffineTransform)CGAffineTransform;
+
 @end
 
 // stolen from Apple sample code "speedy categories"
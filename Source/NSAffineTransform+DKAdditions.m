@@ -8,6 +8,22 @@
 
 @implementation NSAffineTransform (DKAdditions)
 
++ (NSAffineTransform*)transformWithCGAffineTransform:(CGAffineTransform)t
+{
+	NSAffineTransform* transform = [self transform];
+	NSAffineTransformStruct ts = { t.a, t.b, t.c, t.d, t.tx, t.ty };
+
+	[transform setTransformStruct:ts];
+	return transform;
+}
+
+- (CGAffineTransform)CGAffineTransform
+{
+	NSAffineTransformStruct ts = [self transformStruct];
+
+	return CGAffineTransformMake(ts.m11, ts.m12, ts.m21, ts.m22, ts.tX, ts.tY);
+}
+
 /**  */
 - (NSAffineTransform*)mapFrom:(NSRect)src to:(NSRect)dst
 {
@@ -7,6 +7,8 @@
 #import <Cocoa/Cocoa.h>
 #import "DKCommonTypes.h"
 
+@class DKAttributeRunSummary;
+
 /** @brief These category methods perform high-level text layout.
 
 These category methods perform high-level text layout.
@@ -58,6 +60,43 @@ The second method is similar except that text is flowed into the layoutPath.
 - (BOOL)attributeIsHomogeneous:(NSString*)attrName;
 - (BOOL)attributesAreHomogeneous:(NSDictionary*)attrs;
 
+/** @brief Returns a summary of the receiver's attribute runs, which answers questions about its attributes without rescanning it
+
+ The summary is made afresh each time - keep it for as long as the string is unchanged.
+ @return a new summary
+ */
+- (DKAttributeRunSummary*)attributeRunSummary;
+
+@end
+
+/** @brief The runs of an attributed string over which its attributes are the same, found by scanning it once.
+
+ The runs of an attributed string over which its attributes are the same, found by scanning it once. Whether the whole string, or
+ an attribute, is homogeneous is then found from the runs rather than the string, and each attribute's answer is kept. A summary is
+ a snapshot - it doesn't follow later edits to the string, so whoever keeps one must discard it when the string changes, as
+ DKTextAdornment does when its text is replaced.
+*/
+@interface DKAttributeRunSummary : NSObject {
+@private
+	NSUInteger mLength;
+	NSUInteger mRunCount;
+	NSRange* mRuns; // the longest ranges of equal attributes, in order
+	NSArray* mRunAttributes; // the attributes of each run
+	NSMutableDictionary* mHomogeneousAttributes; // attribute name -> NSNumber, once asked
+}
+
+- (id)initWithAttributedString:(NSAttributedString*)str;
+
+- (NSUInteger)length;
+- (NSUInteger)runCount;
+- (NSRange)rangeOfRunAtIndex:(NSUInteger)indx;
+- (NSDictionary*)attributesOfRunAtIndex:(NSUInteger)indx;
+
+/** @brief As -[NSAttributedString isHomogeneous] - YES if the string is empty or its attributes are the same throughout */
+- (BOOL)isHomogeneous;
+- (BOOL)attributeIsHomogeneous:(NSString*)attrName;
+- (BOOL)attributesAreHomogeneous:(NSDictionary*)attrs;
+
 @end
 
 @interface NSMutableAttributedString (DKAdditions)
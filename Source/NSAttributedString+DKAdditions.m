@@ -11,14 +11,41 @@
 #import "NSBezierPath+Geometry.h"
 #import "DKDrawKitMacros.h"
 
+// a layout manager can't be used by two threads at once, so the shared ones are per thread. The main thread's is kept in a static, and
+// other threads', such as those of headless renderers, in their thread dictionaries
+
+static NSLayoutManager* layoutManagerForCurrentThread(NSString* key, NSLayoutManager* mainThreadLM)
+{
+	if ([NSThread isMainThread])
+		return mainThreadLM;
+
+	return [[[NSThread currentThread] threadDictionary] objectForKey:key];
+}
+
+static void setLayoutManagerForCurrentThread(NSLayoutManager* lm, NSString* key, NSLayoutManager** mainThreadLM)
+{
+	// takes ownership of <lm>
+
+	if ([NSThread isMainThread])
+		*mainThreadLM = lm;
+	else {
+		[[[NSThread currentThread] threadDictionary] setObject:lm
+														forKey:key];
+		[lm release];
+	}
+}
+
 /** @brief Supply a layout manager common to all DKTextShape instances
+
+ Each thread has its own, as a layout manager can't be used by two threads at once.
  @return the shared layout manager instance */
 NSLayoutManager* sharedDrawingLayoutManager(void)
 {
 	// This method returns an NSLayoutManager that can be used to draw the contents of a DKTextShape.
 	// The same layout manager is used for all instances of the class
 
-	static NSLayoutManager* sharedLM = nil;
+	static NSLayoutManager* sMainThreadLM = nil;
+	NSLayoutManager* sharedLM = layoutManagerForCurrentThread(@"DKDrawingLayoutManager", sMainThreadLM);
 	NSTextContainer* tc = nil;
 
 	if (sharedLM == nil) {
@@ -36,6 +63,7 @@ NSLayoutManager* sharedDrawingLayoutManager(void)
 		[tc release];
 
 		[sharedLM setUsesScreenFonts:NO];
+		setLayoutManagerForCurrentThread(sharedLM, @"DKDrawingLayoutManager", &sMainThreadLM);
 	} else
 		tc = [[sharedLM textContainers] lastObject];
 
@@ -44,10 +72,13 @@ NSLayoutManager* sharedDrawingLayoutManager(void)
 }
 
 /** @brief Supply a layout manager that can be used to capture text layout into a bezier path
+
+ Each thread has its own, as a layout manager can't be used by two threads at once.
  @return the shared layout manager instance */
 NSLayoutManager* sharedCaptureLayoutManager(void)
 {
-	static DKBezierLayoutManager* sharedLM = nil;
+	static NSLayoutManager* sMainThreadLM = nil;
+	DKBezierLayoutManager* sharedLM = (DKBezierLayoutManager*)layoutManagerForCurrentThread(@"DKCaptureLayoutManager", sMainThreadLM);
 	NSTextContainer* tc = nil;
 
 	if (sharedLM == nil) {
@@ -65,6 +96,7 @@ NSLayoutManager* sharedCaptureLayoutManager(void)
 		[tc release];
 
 		[sharedLM setUsesScreenFonts:NO];
+		setLayoutManagerForCurrentThread(sharedLM, @"DKCaptureLayoutManager", &sMainThreadLM);
 	} else
 		tc = [[sharedLM textContainers] lastObject];
 
@@ -276,6 +308,131 @@ NSLayoutManager* sharedCaptureLayoutManager(void)
 	return YES;
 }
 
+- (DKAttributeRunSummary*)attributeRunSummary
+{
+	return [[[DKAttributeRunSummary alloc] initWithAttributedString:self] autorelease];
+}
+
+@end
+
+#pragma mark -
+
+@implementation DKAttributeRunSummary
+
+- (id)initWithAttributedString:(NSAttributedString*)str
+{
+	self = [super init];
+	if (self) {
+		NSMutableArray* attributes = [[NSMutableArray alloc] init];
+		NSRange eff, rangeLimit;
+		NSUInteger capacity = 8;
+
+		mLength = [str length];
+		mRuns = malloc(capacity * sizeof(NSRange));
+		rangeLimit = NSMakeRange(0, mLength);
+
+		while (rangeLimit.length > 0) {
+			NSDictionary* attrs = [str attributesAtIndex:rangeLimit.location
+								   longestEffectiveRange:&eff
+												 inRange:rangeLimit];
+			if (mRunCount == capacity) {
+				capacity *= 2;
+				mRuns = realloc(mRuns, capacity * sizeof(NSRange));
+			}
+
+			mRuns[mRunCount++] = eff;
+			[attributes addObject:attrs];
+
+			rangeLimit = NSMakeRange(NSMaxRange(eff), mLength - NSMaxRange(eff));
+		}
+
+		mRunAttributes = attributes;
+		mHomogeneousAttributes = [[NSMutableDictionary alloc] init];
+	}
+
+	return self;
+}
+
+- (NSUInteger)length
+{
+	return mLength;
+}
+
+- (NSUInteger)runCount
+{
+	return mRunCount;
+}
+
+- (NSRange)rangeOfRunAtIndex:(NSUInteger)indx
+{
+	NSAssert(indx < mRunCount, @"run index out of range");
+
+	return mRuns[indx];
+}
+
+- (NSDictionary*)attributesOfRunAtIndex:(NSUInteger)indx
+{
+	return [mRunAttributes objectAtIndex:indx];
+}
+
+- (BOOL)isHomogeneous
+{
+	return mRunCount <= 1;
+}
+
+- (BOOL)attributeIsHomogeneous:(NSString*)attrName
+{
+	if (mRunCount <= 1 || attrName == nil)
+		return YES;
+
+	NSNumber* answer = [mHomogeneousAttributes objectForKey:attrName];
+
+	if (answer == nil) {
+		// the attribute is homogeneous if every run has the value the first run has, including none at all
+
+		id value = [[mRunAttributes objectAtIndex:0] objectForKey:attrName];
+		NSUInteger i;
+		BOOL homogeneous = YES;
+
+		for (i = 1; i < mRunCount && homogeneous; ++i) {
+			id runValue = [[mRunAttributes objectAtIndex:i] objectForKey:attrName];
+
+			if (runValue != value && ![runValue isEqual:value])
+				homogeneous = NO;
+		}
+
+		answer = [NSNumber numberWithBool:homogeneous];
+		[mHomogeneousAttributes setObject:answer
+								   forKey:attrName];
+	}
+
+	return [answer boolValue];
+}
+
+- (BOOL)attributesAreHomogeneous:(NSDictionary*)attrs
+{
+	NSEnumerator* iter = [attrs keyEnumerator];
+	NSString* key;
+
+	while ((key = [iter nextObject])) {
+		if (![self attributeIsHomogeneous:key])
+			return NO;
+	}
+
+	return YES;
+}
+
+#pragma mark -
+#pragma mark As an NSObject
+
+- (void)dealloc
+{
+	free(mRuns);
+	[mRunAttributes release];
+	[mHomogeneousAttributes release];
+	[super dealloc];
+}
+
 @end
 
 #pragma mark -
@@ -14,28 +14,53 @@ typedef enum {
 } DKBooleanOperation;
 
 /**
-######## NOTE ######## NOT YET IMPLEMENTED - DO NOT USE - THESE FILES ARE A PLACEHOLDER ONLY
+implements union, intersection, diff and xor between paths.
 
-implements union, intersection, diff and xor between pairs of paths.
+this maintains paths in their original form as much as possible - curves come out as curves, and only the parts of them that are cut
+by another path are changed.
 
-this maintains paths in their original form as much as possible.
-
-restrictions: both operand paths must be closed.
+open subpaths are treated as closed, as they would be when filled. Each operand is filled according to its own winding rule. The result
+uses the non-zero winding rule, and needs no renormalizing.
 
 how it works:
 
-first, the points where the paths intersect are found by searching for intersections between flattened versions of the paths. This is the slowest part of the
-operation because every path segments needs to be tested against every path segment of the second path (after weeding out obvious non-intersecting points).
-
-then, the paths are split up into new path fragments at the intersecting points. Depending on which operation is being performed, some of these paths will be
-thrown away, and the rest joined up into the new path.
+the paths are flattened into straight edges, which are swept across from left to right so that each edge is only tested against those
+next to it. See DKBooleanSweep.h for the details. Any number of paths can be combined in a single sweep, which is much faster than combining
+them two at a time.
 */
 @interface NSBezierPath (Combinatorial)
 
+/** @brief Combines any number of paths in a single operation
+
+ For a difference, the first path is the one the others are subtracted from. For an exclusive-or, the result is the area covered by an
+ odd number of the paths.
+ @param op the operation to perform
+ @param paths a list of NSBezierPaths
+ @return a new path, which is empty if nothing is left
+ */
++ (NSBezierPath*)bezierPathByPerformingBooleanOp:(DKBooleanOperation)op onPaths:(NSArray*)paths;
+
 - (void)showIntersectionsWithPath:(NSBezierPath*)path;
+
+/** @brief Returns a path in which every subpath is clockwise
+ @return a path, which may be the receiver
+ */
 - (NSBezierPath*)renormalizePath;
+
+/** @brief Divides the receiver and another path into the areas that they share and don't share
+
+ The result is an array of two arrays. The first holds the receiver's parts - the area outside <path>, then the area it shares with
+ <path>. The second holds the part of <path> outside the receiver. Parts that would be empty are left out.
+ @param path the other path
+ @return an array of two arrays of paths
+ */
 - (NSArray*)dividePathWithPath:(NSBezierPath*)path;
 
+/** @brief Combines the receiver with another path
+ @param op the operation to perform
+ @param path the other path, which is subtracted from the receiver for a difference
+ @return a new path, which is empty if nothing is left
+ */
 - (NSBezierPath*)performBooleanOp:(DKBooleanOperation)op withPath:(NSBezierPath*)path;
 
 @end
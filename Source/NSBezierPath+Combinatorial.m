@@ -7,19 +7,216 @@
 #import "NSBezierPath+Combinatorial.h"
 #import "NSBezierPath-OAExtensions.h"
 #import "NSBezierPath+Geometry.h"
+#import "DKBooleanSweep.h"
+#include <tgmath.h>
+
+#define kDKBooleanFlatness 0.05 // the most that flattened curves may deviate from the originals
 
 @interface NSBezierPath (CombinatorialPrivate)
 
-/**  */
-- (void)appendSplitElementFromPath:(NSBezierPath*)path withIntersectionInfo:(OABezierPathIntersection*)info rightOrLeft:(BOOL)isRight trailingOrLeading:(BOOL)isLeading;
 - (void)appendElementsFromPath:(NSBezierPath*)path fromIndex:(NSInteger)firstIndex toIndex:(NSInteger)nextIndex;
 - (void)appendElementsFromPath:(NSBezierPath*)path inRange:(NSRange)range;
-- (NSArray*)breakApartWithIntersectionInfo:(PathIntersectionList)info rightOrLeft:(BOOL)isRight;
 
 @end
 
+static void appendPathEdges(NSBezierPath* path, DKBooleanCurveTable* curves, DKBooleanEdgeList* edges)
+{
+	// flattens the path into edges, closing any open subpaths as filling would
+
+	NSInteger i, ec = [path elementCount];
+	NSPoint ap[3], bez[4];
+	NSPoint lastPoint = NSZeroPoint, subpathStart = NSZeroPoint;
+	BOOL isOpen = NO;
+
+	for (i = 0; i < ec; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:ap];
+
+		switch (element) {
+		case NSMoveToBezierPathElement:
+			if (isOpen)
+				DKBooleanEdgeListAppend(edges, lastPoint, subpathStart, -1, 0.0, 1.0);
+
+			subpathStart = lastPoint = ap[0];
+			isOpen = NO;
+			break;
+
+		case NSLineToBezierPathElement:
+			DKBooleanEdgeListAppend(edges, lastPoint, ap[0], -1, 0.0, 1.0);
+			lastPoint = ap[0];
+			isOpen = YES;
+			break;
+
+		case NSCurveToBezierPathElement:
+			bez[0] = lastPoint;
+			bez[1] = ap[0];
+			bez[2] = ap[1];
+			bez[3] = ap[2];
+
+			DKBooleanFlattenCurve(curves, bez, kDKBooleanFlatness, edges);
+			lastPoint = ap[2];
+			isOpen = YES;
+			break;
+
+		case NSClosePathBezierPathElement:
+			DKBooleanEdgeListAppend(edges, lastPoint, subpathStart, -1, 0.0, 1.0);
+			lastPoint = subpathStart;
+			isOpen = NO;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (isOpen)
+		DKBooleanEdgeListAppend(edges, lastPoint, subpathStart, -1, 0.0, 1.0);
+}
+
+static BOOL edgesJoin(const DKBooleanEdge* a, const DKBooleanEdge* b)
+{
+	// YES if <b> carries straight on from <a> - either along the same curve in the same direction, or along the same line
+
+	if (a->curve >= 0)
+		return (a->curve == b->curve) && fabs(a->t1 - b->t0) < 1e-9 && ((a->t1 - a->t0) * (b->t1 - b->t0)) > 0.0;
+
+	if (b->curve >= 0)
+		return NO;
+
+	CGFloat dx = a->p1.x - a->p0.x;
+	CGFloat dy = a->p1.y - a->p0.y;
+	CGFloat ex = b->p1.x - b->p0.x;
+	CGFloat ey = b->p1.y - b->p0.y;
+
+	return fabs(dx * ey - dy * ex) <= 1e-6 * hypot(dx, dy) * hypot(ex, ey) && (dx * ex + dy * ey) > 0.0;
+}
+
+static void appendContour(NSBezierPath* path, const DKBooleanContour* contour, const DKBooleanCurveTable* curves)
+{
+	// turns runs of edges that came from the same curve back into that curve, and runs along the same line into a single line
+
+	const DKBooleanEdge* e = contour->edges.edges;
+	NSUInteger i, j, n = contour->edges.count, first = 0;
+
+	// start at an edge that doesn't carry on from the one before, so that no run is split across the start of the contour
+
+	for (i = 0; i < n; ++i) {
+		if (!edgesJoin(&e[(i + n - 1) % n], &e[i])) {
+			first = i;
+			break;
+		}
+	}
+
+	[path moveToPoint:e[first].p0];
+
+	for (i = 0; i < n; i = j) {
+		const DKBooleanEdge* start = &e[(first + i) % n];
+
+		for (j = i + 1; j < n && edgesJoin(&e[(first + j - 1) % n], &e[(first + j) % n]); ++j)
+			;
+
+		const DKBooleanEdge* end = &e[(first + j - 1) % n];
+
+		if (start->curve >= 0) {
+			NSPoint part[4];
+
+			DKBooleanSubcurve(curves->curves[start->curve].bez, start->t0, end->t1, part);
+			[path curveToPoint:end->p1
+				 controlPoint1:part[1]
+				 controlPoint2:part[2]];
+		} else if (j < n)
+			[path lineToPoint:end->p1];
+	}
+
+	[path closePath];
+}
+
 @implementation NSBezierPath (Combinatorial)
 
++ (NSBezierPath*)bezierPathByPerformingBooleanOp:(DKBooleanOperation)op onPaths:(NSArray*)paths
+{
+	NSBezierPath* result = [NSBezierPath bezierPath];
+	NSInteger operand = 0, operandCount = [paths count];
+	DKBooleanCurveTable curves = { 0 };
+	DKBooleanEdgeList edges = { 0 }, boundary = { 0 };
+	DKBooleanContourList contours = { 0 }, output = { 0 };
+	DKBooleanFillRule rule;
+	NSEnumerator* iter = [paths objectEnumerator];
+	NSBezierPath* path;
+	NSUInteger i;
+	BOOL isEmpty = NO;
+
+	[result setWindingRule:NSNonZeroWindingRule];
+
+	switch (op) {
+	default:
+	case kDKBooleanOpUnion:
+		rule = kDKBooleanFillNonZero;
+		break;
+
+	case kDKBooleanOpIntersection:
+		rule = kDKBooleanFillAll;
+		break;
+
+	case kDKBooleanOpDifference:
+		rule = kDKBooleanFillSubjectOnly;
+		break;
+
+	case kDKBooleanOpExclusiveOR:
+		rule = kDKBooleanFillEvenOdd;
+		break;
+	}
+
+	// first simplify each path on its own using its winding rule, so that the contours of each are separate and consistently directed
+
+	while ((path = [iter nextObject])) {
+		NSUInteger contoursBefore = contours.count;
+
+		edges.count = boundary.count = 0;
+		appendPathEdges(path, &curves, &edges);
+		DKBooleanSweepEdges(&edges, ([path windingRule] == NSEvenOddWindingRule) ? kDKBooleanFillEvenOdd : kDKBooleanFillNonZero, &boundary);
+		DKBooleanChainEdges(&boundary, operand, &contours);
+
+		// nothing intersects an empty path, and nothing can be left when the path being subtracted from is empty
+
+		if (contours.count == contoursBefore && (op == kDKBooleanOpIntersection || (op == kDKBooleanOpDifference && operand == 0))) {
+			isEmpty = YES;
+			break;
+		}
+
+		++operand;
+	}
+
+	if (!isEmpty && contours.count > 0) {
+		// a contour that doesn't touch any other is either kept or dropped whole. Those are typically the majority when combining many
+		// small separate paths, and leaving them out keeps the sweep short.
+
+		DKBooleanMarkIsolatedContours(&contours);
+
+		for (i = 0; i < contours.count; ++i) {
+			const DKBooleanContour* contour = &contours.contours[i];
+
+			if (contour->isolated && DKBooleanIsInside(rule, 1, (contour->operand == 0) ? 1 : 0, operandCount) && !DKBooleanIsInside(rule, 0, 0, operandCount))
+				appendContour(result, contour, &curves);
+		}
+
+		boundary.count = 0;
+		DKBooleanSweepContours(&contours, rule, operandCount, &boundary);
+		DKBooleanChainEdges(&boundary, 0, &output);
+
+		for (i = 0; i < output.count; ++i)
+			appendContour(result, &output.contours[i], &curves);
+	}
+
+	DKBooleanContourListFree(&output);
+	DKBooleanContourListFree(&contours);
+	DKBooleanEdgeListFree(&boundary);
+	DKBooleanEdgeListFree(&edges);
+	DKBooleanCurveTableFree(&curves);
+
+	return result;
+}
+
 - (void)showIntersectionsWithPath:(NSBezierPath*)path
 {
 	// test method, uses the Omni code to find the intersections, then draws a blob at the found points.
@@ -71,8 +268,8 @@
 
 - (NSBezierPath*)renormalizePath
 {
-	// this returns a path such that all of its subpaths are in a clockwise direction. It may return self if there is nothing to do. This is done first for each subpath
-	// contributing to a boolean operation so that the logic to perform the combinations is made more straightforward.
+	// this returns a path such that all of its subpaths are in a clockwise direction. It may return self if there is nothing to do. The boolean operations
+	// don't need this, as each operand is simplified by the sweep before it is combined.
 
 	// first see if there's nothing to do and , err, do it...
 
@@ -175,286 +372,41 @@
 							 inRange:NSMakeRange(0, nextIndex)];
 }
 
-- (void)appendSplitElementFromPath:(NSBezierPath*)path withIntersectionInfo:(OABezierPathIntersection*)info rightOrLeft:(BOOL)isRight trailingOrLeading:(BOOL)isLeading
-{
-	NSAssert(path != nil, @"can't append elements from nil path");
-
-	NSInteger segment;
-	CGFloat t;
-
-	if (isRight) {
-		segment = info->right.segment;
-		t = info->right.parameter;
-	} else {
-		segment = info->left.segment;
-		t = info->left.parameter;
-	}
-
-	// segment must be in range
-
-	if (segment >= [path elementCount] || segment < 0)
-		return;
-
-	NSPoint points[4];
-	NSBezierPathElement element = [path elementAtIndex:segment
-									  associatedPoints:&points[1]];
-	points[0] = [path currentpointForSegment:element];
-
-	if (element == NSCurveToBezierPathElement) {
-		NSPoint left[4], right[4];
-		splitBezierCurveTo(points, t, left, right);
-
-		if (isLeading)
-			[self curveToPoint:right[3]
-				 controlPoint1:right[1]
-				 controlPoint2:right[2]];
-		else
-			[self curveToPoint:left[3]
-				 controlPoint1:left[1]
-				 controlPoint2:left[2]];
-	} else {
-		if (isLeading)
-			[self lineToPoint:points[1]];
-		else
-			[self lineToPoint:info->location];
-	}
-}
-
-- (NSArray*)breakApartWithIntersectionInfo:(PathIntersectionList)info rightOrLeft:(BOOL)isRight
-{
-	// divides the receiver into as many parts as necessary at the intersection points. The intersection info is followed down the left or right avenues according to
-	// the flag. To assist with the subsequent recombination, the path starting points are relocated to the first intersection point.
-
-	NSUInteger i, m = info.count;
-	NSInteger startIndex, endIndex;
-	NSMutableArray* parts = [NSMutableArray array];
-	NSBezierPath* piece;
-
-	for (i = 0; i < 1; ++i) {
-		if (isRight) {
-			startIndex = info.intersections[i].right.segment;
-
-			if (i == (m - 1))
-				endIndex = info.intersections[0].right.segment - 1;
-			else
-				endIndex = info.intersections[i + 1].right.segment - 1;
-		} else {
-			startIndex = info.intersections[i].left.segment;
-			if (i == (m - 1))
-				endIndex = info.intersections[0].left.segment - 1;
-			else
-				endIndex = info.intersections[i + 1].left.segment - 1;
-		}
-
-		if (endIndex < 0)
-			endIndex = [self elementCount] - 1;
-
-		piece = [NSBezierPath bezierPath];
-
-		//[piece moveToPoint:info.intersections[i].location];
-		//[piece appendSplitElementFromPath:self withIntersectionInfo:&info.intersections[i] rightOrLeft:isRight trailingOrLeading:YES];
-		[piece appendElementsFromPath:self
-							fromIndex:startIndex + 1
-							  toIndex:endIndex];
-		//[piece appendSplitElementFromPath:self withIntersectionInfo:&info.intersections[i+1] rightOrLeft:isRight trailingOrLeading:NO];
-
-		//NSLog(@"original path = %@", self );
-		//[piece appendElementsFromPath:self fromIndex:4 toIndex:2];
-		//NSLog(@"new path = %@", piece );
-
-		[parts addObject:piece];
-	}
-
-	return parts;
-}
 
 - (NSBezierPath*)performBooleanOp:(DKBooleanOperation)op withPath:(NSBezierPath*)path
 {
-#pragma unused(op)
-
-	// first renormalize both contributing paths
-
-	NSBezierPath* leftPath, *rightPath;
-
-	leftPath = [self renormalizePath];
-	rightPath = [path renormalizePath];
-
-	// find the intersections
-
-	PathIntersectionList ptList = [leftPath allIntersectionsWithPath:rightPath];
-
-	// assemble the new path. We start at the first intersection point, which will begin the new path. This point is common to all operations, unlike the first point
-	// of either source path, which may not be included in an intersection.
-
-	NSBezierPath* newPath = [NSBezierPath bezierPath];
-
-	BOOL phase = NO; // phase tracks whether we are following the left or right path
-	NSBezierPath* srcPath; // srcPath is the one we are following at the moment.
-	NSUInteger sectIndex; // index to which intersection is currently being actioned
-	NSPoint previousPoint; // the last end point of a segment
-	NSInteger firstElement; // tracks the index of the very first element we use
-
-	// interSect is set to the current intersection we are using.
-
-	struct OABezierPathIntersectionHalf interSect;
-
-	sectIndex = 0;
-	srcPath = leftPath; // start with the left path
-	interSect = ptList.intersections[0].left;
-	firstElement = interSect.segment;
-
-	// new path starts here regardless
+	NSAssert(path != nil, @"cannot combine with a nil path");
 
-	previousPoint = ptList.intersections[0].location;
-	[newPath moveToPoint:previousPoint];
-
-	while (sectIndex < ptList.count) {
-		// the loop starts with the most recent intersection point, so by definition this is splitting a segment.
-
-		NSInteger lmIndex, nextIndex;
-		NSBezierPathElement element;
-		NSPoint points[4]; // up to four segment points (4 for curves, 2 for lines) 0 = previous end point or start of segment.
-
-		points[0] = previousPoint;
-		lmIndex = interSect.segment;
-		element = [srcPath elementAtIndex:lmIndex
-						 associatedPoints:&points[1]];
-
-		if (element == NSCurveToBezierPathElement) {
-			// split the curve segment
-
-			NSPoint leftPoints[4], rightPoints[4];
-
-			splitBezierCurveTo(points, interSect.parameter, leftPoints, rightPoints);
-			[newPath curveToPoint:rightPoints[3]
-					controlPoint1:rightPoints[1]
-					controlPoint2:rightPoints[2]];
-			previousPoint = rightPoints[3];
-		} else {
-			// line segment
-
-			[newPath lineToPoint:points[0]];
-			previousPoint = points[0];
-		}
-		++lmIndex;
-
-		// which element of the source path contains the next intersection?
-
-		++sectIndex;
-
-		if (sectIndex >= ptList.count) {
-			// no more intersections, so all that remains is to copy the remainder of the srcPath to the newPath,
-			// looping if needed so that the first part of the path is also copied, and append the final split.
-
-			[newPath appendElementsFromPath:srcPath
-								  fromIndex:lmIndex
-									toIndex:[srcPath elementCount]];
-
-			// and the first part:
-
-			if (firstElement > 0)
-				[newPath appendElementsFromPath:srcPath
-									  fromIndex:0
-										toIndex:firstElement - 1];
-
-			// and the final split:
-
-		} else {
-			if (phase)
-				nextIndex = ptList.intersections[sectIndex].right.segment - 1;
-			else
-				nextIndex = ptList.intersections[sectIndex].left.segment - 1;
-
-			// copy elements from src to new between the two indexes. Might need two calls if we wrap around the path start point.
-
-			if (nextIndex < lmIndex) {
-				// need to wrap around
-
-				[newPath appendElementsFromPath:srcPath
-									  fromIndex:lmIndex
-										toIndex:[srcPath elementCount]];
-				lmIndex = 0;
-			}
-
-			[newPath appendElementsFromPath:srcPath
-								  fromIndex:lmIndex
-									toIndex:nextIndex];
-			lmIndex = nextIndex + 1;
-
-			// ready to handle the next intersection, which is another split, still on the current path.
-
-			element = [srcPath elementAtIndex:lmIndex
-							 associatedPoints:&points[1]];
-
-			if (element == NSCurveToBezierPathElement) {
-				// split the curve segment
-
-				NSPoint leftPoints[4], rightPoints[4];
-
-				splitBezierCurveTo(points, interSect.parameter, leftPoints, rightPoints);
-				[newPath curveToPoint:leftPoints[3]
-						controlPoint1:leftPoints[1]
-						controlPoint2:leftPoints[2]];
-				previousPoint = leftPoints[3];
-			} else {
-				// line segment which ends at the intersection point
-
-				previousPoint = ptList.intersections[sectIndex].location;
-				[newPath lineToPoint:previousPoint];
-			}
-
-			// now we swap to the alternate path and set up for the next loop
-
-			phase = !phase;
-
-			if (phase) {
-				srcPath = rightPath; // src is right path
-				interSect = ptList.intersections[sectIndex].right;
-			} else {
-				srcPath = leftPath; // src is the left path
-				interSect = ptList.intersections[sectIndex].left;
-			}
-		}
-	}
-
-	free(ptList.intersections);
-	return newPath;
+	return [NSBezierPath bezierPathByPerformingBooleanOp:op
+												 onPaths:[NSArray arrayWithObjects:self, path, nil]];
 }
 
 - (NSArray*)dividePathWithPath:(NSBezierPath*)path
 {
-	// divides the receiver and <path> into parts split at the intersecting points between the two paths. The result is an array which in turn consists of two further
-	// arrays - the first containing the receiver's parts, the second the other path's. The other operations can be built by recombining the parts in various ways.
+	// the other operations can be built by recombining the parts in various ways
 
 	NSAssert(path != nil, @"cannot divide by a nil path");
 
-	NSMutableArray* allParts;
-	NSArray* leftParts;
-	//NSArray*		rightParts;
-
-	allParts = [NSMutableArray array];
-
-	// normalize
-
-	NSBezierPath* left, *right;
-
-	left = [self renormalizePath];
-	right = [path renormalizePath];
-
-	// find the intersections
-
-	PathIntersectionList ptList = [left allIntersectionsWithPath:right];
+	NSMutableArray* leftParts = [NSMutableArray array];
+	NSMutableArray* rightParts = [NSMutableArray array];
+	NSBezierPath* part;
 
-	leftParts = [left breakApartWithIntersectionInfo:ptList
-										 rightOrLeft:NO];
-	//rightParts = [right breakApartWithIntersectionInfo:ptList rightOrLeft:YES];
+	part = [self performBooleanOp:kDKBooleanOpDifference
+						 withPath:path];
+	if (![part isEmpty])
+		[leftParts addObject:part];
 
-	free(ptList.intersections);
+	part = [self performBooleanOp:kDKBooleanOpIntersection
+						 withPath:path];
+	if (![part isEmpty])
+		[leftParts addObject:part];
 
-	[allParts addObject:leftParts];
-	//[allParts addObject:rightParts];
+	part = [path performBooleanOp:kDKBooleanOpDifference
+						 withPath:self];
+	if (![part isEmpty])
+		[rightParts addObject:part];
 
-	return allParts;
+	return [NSArray arrayWithObjects:leftParts, rightParts, nil];
 }
 
 @end
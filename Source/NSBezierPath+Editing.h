@@ -6,6 +6,8 @@
 
 #import <Cocoa/Cocoa.h>
 
+@class DKPathElementIndex;
+
 /** @brief This category provides some basic methods for supporting interactive editing of a NSBezierPath object.
 
 This category provides some basic methods for supporting interactive editing of a NSBezierPath object. This can be more tricky
@@ -54,6 +56,13 @@ optionally maintains colinearity across curve joins, and knows how to maintain c
 - (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t prioritiseOnPathPoints:(BOOL)onpPriority;
 - (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t startingFromElement:(NSInteger)startElement;
 - (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t startingFromElement:(NSInteger)startElement prioritiseOnPathPoints:(BOOL)onpPriority;
+
+// variants of the hit-testing methods that use a prebuilt index of the path's elements. They return the same results as the methods without an index,
+// but only consider the elements near the point, which is much faster for paths with many elements. <index> must have been built from this path in its
+// current state; if it's nil, or doesn't match the path's element count, the path is scanned as usual.
+
+- (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t prioritiseOnPathPoints:(BOOL)onpPriority elementIndex:(DKPathElementIndex*)index;
+- (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t startingFromElement:(NSInteger)startElement prioritiseOnPathPoints:(BOOL)onpPriority elementIndex:(DKPathElementIndex*)index;
 - (NSInteger)partcodeForLastPoint;
 - (NSPoint)referencePointForConstrainedPartcode:(NSInteger)pc;
 
@@ -66,6 +75,7 @@ optionally maintains colinearity across curve joins, and knows how to maintain c
 - (NSBezierPath*)insertControlPointAtPoint:(NSPoint)p tolerance:(CGFloat)tol type:(NSInteger)controlPointType;
 
 - (NSPoint)nearestPointToPoint:(NSPoint)p tolerance:(CGFloat)tol;
+- (NSPoint)nearestPointToPoint:(NSPoint)p tolerance:(CGFloat)tol elementIndex:(DKPathElementIndex*)index;
 
 // geometry utilities:
 
@@ -75,6 +85,8 @@ optionally maintains colinearity across curve joins, and knows how to maintain c
 - (NSInteger)elementHitByPoint:(NSPoint)p tolerance:(CGFloat)tol tValue:(CGFloat*)t;
 - (NSInteger)elementHitByPoint:(NSPoint)p tolerance:(CGFloat)tol tValue:(CGFloat*)t nearestPoint:(NSPoint*)npp;
 - (NSInteger)elementBoundsContainsPoint:(NSPoint)p tolerance:(CGFloat)tol;
+- (NSInteger)elementHitByPoint:(NSPoint)p tolerance:(CGFloat)tol tValue:(CGFloat*)t nearestPoint:(NSPoint*)npp elementIndex:(DKPathElementIndex*)index;
+- (NSInteger)elementBoundsContainsPoint:(NSPoint)p tolerance:(CGFloat)tol elementIndex:(DKPathElementIndex*)index;
 
 // element bounding boxes - can reduce need to draw entire path when only a part is edited
 
@@ -9,6 +9,7 @@
 #import "LogEvent.h"
 #import "NSBezierPath+Geometry.h"
 #import "DKGeometryUtilities.h"
+#import "DKPathElementIndex.h"
 
 #define USE_OMNI_METHODS 0
 
@@ -24,6 +25,123 @@ static CGFloat sAngleConstraint = 0.261799387799; // 15°
 static inline NSInteger arrayIndexForPartcode(const NSInteger pc);
 static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 
+static NSInteger partcodeHitInElement(NSBezierPath* path, NSInteger i, NSInteger ec, NSPoint p, CGFloat t, BOOL onpPriority)
+{
+	// tests the control points of element <i> and the end point of the element before it, in the order described in
+	// -partcodeHitByPoint:tolerance:startingFromElement:prioritiseOnPathPoints:elementIndex:. Returns the partcode of the point hit, or 0 if none.
+
+	NSBezierPathElement et, pet;
+	NSPoint ap[3], lp[3];
+	NSInteger pc;
+
+	pet = [path elementAtIndex:i - 1
+			  associatedPoints:lp];
+	et = [path elementAtIndex:i
+			 associatedPoints:ap];
+
+	if (et == NSCurveToBezierPathElement) {
+		if (onpPriority) {
+			if (pet == NSCurveToBezierPathElement) {
+				pc = [NSBezierPath point:p
+						  inNSPointArray:&lp[2]
+								   count:1
+							   tolerance:t];
+				if (pc != NSNotFound)
+					pc = 2;
+			} else
+				pc = [NSBezierPath point:p
+						  inNSPointArray:lp
+								   count:1
+							   tolerance:t];
+
+			if (pc != NSNotFound)
+				return partcodeForElementControlPoint(i - 1, pc);
+
+			pc = [NSBezierPath point:p
+					  inNSPointArray:ap
+							   count:3
+						   tolerance:t
+							 reverse:YES];
+
+			if (pc != NSNotFound)
+				return partcodeForElementControlPoint(i, pc);
+		} else {
+			// test 2 control points, 3 for last segment
+
+			pc = [NSBezierPath point:p
+					  inNSPointArray:ap
+							   count:(i == (ec - 1)) ? 3 : 2
+						   tolerance:t];
+
+			if (pc != NSNotFound)
+				return partcodeForElementControlPoint(i, pc);
+		}
+
+		// next test on-path point of previous segment:
+
+		if (pet == NSCurveToBezierPathElement) {
+			pc = [NSBezierPath point:p
+					  inNSPointArray:&lp[2]
+							   count:1
+						   tolerance:t];
+			if (pc != NSNotFound)
+				pc = 2;
+		} else
+			pc = [NSBezierPath point:p
+					  inNSPointArray:lp
+							   count:1
+						   tolerance:t];
+
+		if (pc != NSNotFound)
+			return partcodeForElementControlPoint(i - 1, pc);
+
+		// also test last segment if necessary
+
+		if (i == ec - 1) {
+			pc = [NSBezierPath point:p
+					  inNSPointArray:ap
+							   count:3
+						   tolerance:t
+							 reverse:onpPriority];
+
+			if (pc != NSNotFound)
+				return partcodeForElementControlPoint(i, pc);
+		}
+	} else {
+		// one point to test, which is the end point of the previous segment
+
+		if (pet == NSCurveToBezierPathElement) {
+			pc = [NSBezierPath point:p
+					  inNSPointArray:&lp[2]
+							   count:1
+						   tolerance:t];
+			if (pc != NSNotFound)
+				pc = 2;
+		} else
+			pc = [NSBezierPath point:p
+					  inNSPointArray:lp
+							   count:1
+						   tolerance:t];
+
+		if (pc != NSNotFound)
+			return partcodeForElementControlPoint(i - 1, pc);
+
+		// also test last segment if necessary
+
+		if (i == ec - 1) {
+			pc = [NSBezierPath point:p
+					  inNSPointArray:ap
+							   count:1
+						   tolerance:t];
+
+			if (pc != NSNotFound)
+				return partcodeForElementControlPoint(i, pc);
+		}
+	}
+
+	return 0;
+}
+
 #pragma mark -
 @implementation NSBezierPath (DKEditing)
 #pragma mark As an NSBezierPath
@@ -559,6 +677,24 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 }
 
 - (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t startingFromElement:(NSInteger)startElement prioritiseOnPathPoints:(BOOL)onpPriority
+{
+	return [self partcodeHitByPoint:p
+						  tolerance:t
+				startingFromElement:startElement
+			 prioritiseOnPathPoints:onpPriority
+					   elementIndex:nil];
+}
+
+- (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t prioritiseOnPathPoints:(BOOL)onpPriority elementIndex:(DKPathElementIndex*)index
+{
+	return [self partcodeHitByPoint:p
+						  tolerance:t
+				startingFromElement:0
+			 prioritiseOnPathPoints:onpPriority
+					   elementIndex:index];
+}
+
+- (NSInteger)partcodeHitByPoint:(NSPoint)p tolerance:(CGFloat)t startingFromElement:(NSInteger)startElement prioritiseOnPathPoints:(BOOL)onpPriority elementIndex:(DKPathElementIndex*)index
 {
 	// given a point <p>, this detects whether any of the control points in the path were hit. A hit has to
 	// be within <t> of the point's position. Returns the partcode of the point hit, or 0 if not hit. If <onpPriority> is YES, on-path points
@@ -576,116 +712,34 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 	// in preference to on-path points so that if they lie at the same point, the cp is detected. This makes it
 	// possible for the user to drag a cp away from an underlying on-path point. This behaviour is inverted if <onpPriority> is YES
 
-	NSBezierPathElement et, pet;
-	NSPoint ap[3], lp[3];
-
 	NSInteger pc, i, ec = [self elementCount];
 
-	for (i = startElement + 1; i < ec; ++i) {
-		pet = [self elementAtIndex:i - 1
-				  associatedPoints:lp];
-		et = [self elementAtIndex:i
-				 associatedPoints:ap];
-
-		if (et == NSCurveToBezierPathElement) {
-			if (onpPriority) {
-				if (pet == NSCurveToBezierPathElement) {
-					pc = [NSBezierPath point:p
-							  inNSPointArray:&lp[2]
-									   count:1
-								   tolerance:t];
-					if (pc != NSNotFound)
-						pc = 2;
-				} else
-					pc = [NSBezierPath point:p
-							  inNSPointArray:lp
-									   count:1
-								   tolerance:t];
-
-				if (pc != NSNotFound)
-					return partcodeForElementControlPoint(i - 1, pc);
-
-				pc = [NSBezierPath point:p
-						  inNSPointArray:ap
-								   count:3
-							   tolerance:t
-								 reverse:YES];
+	if (index != nil && [index elementCount] == ec) {
+		// only the elements that have a control point near <p> need to be tested, and the index returns them in the same order as the scan below
 
-				if (pc != NSNotFound)
-					return partcodeForElementControlPoint(i, pc);
-			} else {
-				// test 2 control points, 3 for last segment
-
-				pc = [NSBezierPath point:p
-						  inNSPointArray:ap
-								   count:(i == (ec - 1)) ? 3 : 2
-							   tolerance:t];
+		i = [index elementFromIndex:startElement + 1
+			withControlPointsNearPoint:p
+							 tolerance:t];
 
-				if (pc != NSNotFound)
-					return partcodeForElementControlPoint(i, pc);
-			}
+		while (i > 0) {
+			pc = partcodeHitInElement(self, i, ec, p, t, onpPriority);
 
-			// next test on-path point of previous segment:
+			if (pc != 0)
+				return pc;
 
-			if (pet == NSCurveToBezierPathElement) {
-				pc = [NSBezierPath point:p
-						  inNSPointArray:&lp[2]
-								   count:1
-							   tolerance:t];
-				if (pc != NSNotFound)
-					pc = 2;
-			} else
-				pc = [NSBezierPath point:p
-						  inNSPointArray:lp
-								   count:1
-							   tolerance:t];
-
-			if (pc != NSNotFound)
-				return partcodeForElementControlPoint(i - 1, pc);
-
-			// also test last segment if necessary
-
-			if (i == ec - 1) {
-				pc = [NSBezierPath point:p
-						  inNSPointArray:ap
-								   count:3
-							   tolerance:t
-								 reverse:onpPriority];
-
-				if (pc != NSNotFound)
-					return partcodeForElementControlPoint(i, pc);
-			}
-		} else {
-			// one point to test, which is the end point of the previous segment
-
-			if (pet == NSCurveToBezierPathElement) {
-				pc = [NSBezierPath point:p
-						  inNSPointArray:&lp[2]
-								   count:1
-							   tolerance:t];
-				if (pc != NSNotFound)
-					pc = 2;
-			} else
-				pc = [NSBezierPath point:p
-						  inNSPointArray:lp
-								   count:1
-							   tolerance:t];
-
-			if (pc != NSNotFound)
-				return partcodeForElementControlPoint(i - 1, pc);
+			i = [index elementFromIndex:i + 1
+				withControlPointsNearPoint:p
+								 tolerance:t];
+		}
 
-			// also test last segment if necessary
+		return 0;
+	}
 
-			if (i == ec - 1) {
-				pc = [NSBezierPath point:p
-						  inNSPointArray:ap
-								   count:1
-							   tolerance:t];
+	for (i = startElement + 1; i < ec; ++i) {
+		pc = partcodeHitInElement(self, i, ec, p, t, onpPriority);
 
-				if (pc != NSNotFound)
-					return partcodeForElementControlPoint(i, pc);
-			}
-		}
+		if (pc != 0)
+			return pc;
 	}
 
 	return 0;
@@ -1201,6 +1255,13 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 }
 
 - (NSPoint)nearestPointToPoint:(NSPoint)p tolerance:(CGFloat)tol
+{
+	return [self nearestPointToPoint:p
+						   tolerance:tol
+						elementIndex:nil];
+}
+
+- (NSPoint)nearestPointToPoint:(NSPoint)p tolerance:(CGFloat)tol elementIndex:(DKPathElementIndex*)index
 {
 	// given a point, this determines whether it's within <tol> distance of the path. If so, the nearest point on the path is returned,
 	// otherwise the original point is returned.
@@ -1210,7 +1271,8 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 	NSInteger elem = [self elementHitByPoint:p
 								   tolerance:tol
 									  tValue:&t
-								nearestPoint:&np];
+								nearestPoint:&np
+								elementIndex:index];
 
 	if (elem < 1)
 		return p;
@@ -1284,14 +1346,24 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 }
 
 - (NSInteger)elementHitByPoint:(NSPoint)p tolerance:(CGFloat)tol tValue:(CGFloat*)t nearestPoint:(NSPoint*)npp
+{
+	return [self elementHitByPoint:p
+						 tolerance:tol
+							tValue:t
+					  nearestPoint:npp
+					  elementIndex:nil];
+}
+
+- (NSInteger)elementHitByPoint:(NSPoint)p tolerance:(CGFloat)tol tValue:(CGFloat*)t nearestPoint:(NSPoint*)npp elementIndex:(DKPathElementIndex*)index
 {
 // determines which element is hit by the point, and where. This first rejects any point outside the overall bounds of the
 // path, then tests which elements bounds enclose the point. Then it really gets down to business and calculates the
 // actually position along the path. For line segments, the t value returned is the linear proportion of the length from
 // 0..1, for curves it is the bezier t parameter value. <tol> is used to determine how accurate the computation needs to be
-// to count as a hit.
+// to count as a hit. If <index> is not nil, it's used to find the element whose bounds contain the point.
 
 #if (USE_OMNI_METHODS)
+#pragma unused(index)
 	CGFloat tee;
 	NSInteger elem = [self _segmentHitByPoint:p
 									 position:&tee
@@ -1320,7 +1392,8 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 
 	if (NSPointInRect(p, bb)) {
 		NSInteger elem = [self elementBoundsContainsPoint:p
-												tolerance:tol];
+												tolerance:tol
+											 elementIndex:index];
 
 		//NSLog(@"point %@ (tol = %f) in element bbox, elem = %d", NSStringFromPoint( p ), tol, elem );
 
@@ -1389,6 +1462,13 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 }
 
 - (NSInteger)elementBoundsContainsPoint:(NSPoint)p tolerance:(CGFloat)tol
+{
+	return [self elementBoundsContainsPoint:p
+								  tolerance:tol
+							   elementIndex:nil];
+}
+
+- (NSInteger)elementBoundsContainsPoint:(NSPoint)p tolerance:(CGFloat)tol elementIndex:(DKPathElementIndex*)index
 {
 	// for each element of a bezier path, this tests the point against the bounding box of the element, returning the
 	// element index of the one containing the point. If none do, it returns -1. This gives you a quick way to home in
@@ -1398,6 +1478,21 @@ static inline NSInteger elementIndexForPartcode(const NSInteger pc);
 	NSInteger i, m = [self elementCount];
 	NSRect bb;
 
+	if (index != nil && [index elementCount] == m) {
+		// the index holds the same bounds as -boundingBoxForElement:, so this makes the same two passes as below
+
+		i = [index elementFromIndex:1
+						  nearPoint:p
+						  tolerance:0];
+
+		if (i < 0)
+			i = [index elementFromIndex:1
+							  nearPoint:p
+							  tolerance:tol];
+
+		return i;
+	}
+
 	// initially ignore <tol>, this allows us to find the right element when the point is close to another segment
 
 	for (i = 1; i < m; ++i) {
@@ -5,6 +5,7 @@
 */
 
 #import <Cocoa/Cocoa.h>
+#import "DKRandom.h"
 
 @interface NSBezierPath (Geometry)
 
@@ -27,9 +28,16 @@
 
 - (NSBezierPath*)bezierPathByIteratingWithDelegate:(id)delegate contextInfo:(void*)contextInfo;
 
+// flattening at a given flatness, optionally sharing the result through a rendering cache:
+
+- (NSBezierPath*)bezierPathByFlatteningPathWithFlatness:(CGFloat)flatness;
+- (NSBezierPath*)bezierPathByFlatteningPathWithFlatness:(CGFloat)flatness cache:(NSMutableDictionary*)cache;
+
 - (NSBezierPath*)paralleloidPathWithOffset:(CGFloat)delta;
 - (NSBezierPath*)paralleloidPathWithOffset2:(CGFloat)delta;
+- (NSBezierPath*)paralleloidPathWithOffset2:(CGFloat)delta flatness:(CGFloat)flatness;
 - (NSBezierPath*)paralleloidPathWithOffset22:(CGFloat)delta;
+- (NSBezierPath*)paralleloidPathWithOffset22:(CGFloat)delta flatness:(CGFloat)flatness;
 - (NSBezierPath*)offsetPathWithStartingOffset:(CGFloat)delta1 endingOffset:(CGFloat)delta2;
 - (NSBezierPath*)offsetPathWithStartingOffset2:(CGFloat)delta1 endingOffset:(CGFloat)delta2;
 
@@ -37,6 +45,15 @@
 
 - (NSBezierPath*)bezierPathByInterpolatingPath:(CGFloat)amount;
 
+/** @brief Returns a copy of the path with runs of straight lines thinned using the Douglas-Peucker algorithm
+
+ Each run of consecutive line elements is reduced to the fewest of its points that keep it within <tolerance> of the original, which is a
+ fraction of them for dense polylines such as traced or imported survey data. Curves, closes, moves and the ends of each run are kept as they are.
+ @param tolerance the furthest the simplified lines may stray from the original points
+ @return a new path
+ */
+- (NSBezierPath*)bezierPathBySimplifyingLinesWithTolerance:(CGFloat)tolerance;
+
 // calculating a fillet
 
 - (NSBezierPath*)filletPathForVertex:(NSPoint[])vp filletSize:(CGFloat)fs;
@@ -44,7 +61,9 @@
 // roughening and randomising paths
 
 - (NSBezierPath*)bezierPathByRandomisingPoints:(CGFloat)maxAmount;
+- (NSBezierPath*)bezierPathByRandomisingPoints:(CGFloat)maxAmount randomState:(DKRandomState*)rs;
 - (NSBezierPath*)bezierPathWithRoughenedStrokeOutline:(CGFloat)amount;
+- (NSBezierPath*)bezierPathWithRoughenedStrokeOutline:(CGFloat)amount randomState:(DKRandomState*)rs;
 - (NSBezierPath*)bezierPathWithFragmentedLineSegments:(CGFloat)flatness;
 
 // zig-zags and waves
@@ -75,6 +94,7 @@
 // finding path lengths for points and points for lengths
 
 - (NSPoint)pointOnPathAtLength:(CGFloat)length slope:(CGFloat*)slope;
+- (NSPoint)pointOnPathAtLength:(CGFloat)length slope:(CGFloat*)slope maximumError:(CGFloat)maxError;
 - (CGFloat)slopeStartingPath;
 - (CGFloat)distanceFromStartOfPathAtPoint:(NSPoint)p tolerance:(CGFloat)tol;
 
@@ -84,6 +104,27 @@
 
 - (void)addInverseClip;
 
+// geometric hit-testing:
+
+/** @brief Whether any part of the path's outline passes within <distance> of a rect
+
+ The curves are subdivided as far as needed, but nothing is allocated, so it's cheap enough to call for every object under the mouse.
+ Subpaths that aren't explicitly closed are treated as open. Testing against half a stroke's width gives whether the stroke, as
+ drawn with round caps and joins, would touch the rect.
+ @param rect the rect to test
+ @param distance how far from the outline counts as touching it
+ @return YES if the outline passes within <distance> of the rect
+ */
+- (BOOL)outlineIntersectsRect:(NSRect)rect withinDistance:(CGFloat)distance;
+
+/** @brief Whether any part of the area that filling the path paints lies within a rect
+
+ Open subpaths are closed implicitly, as they are when filled, and the path's winding rule is respected.
+ @param rect the rect to test
+ @return YES if the filled area and the rect overlap
+ */
+- (BOOL)filledAreaIntersectsRect:(NSRect)rect;
+
 // path trimming
 
 - (CGFloat)length;
@@ -7,9 +7,9 @@
 #import "NSBezierPath+Geometry.h"
 #import "DKDrawKitMacros.h"
 #import "DKGeometryUtilities.h"
-#import "DKRandom.h"
 #import "LogEvent.h"
 #import "NSBezierPath+Editing.h"
+#import "DKArcLengthTable.h"
 
 // define this to use Omni methods for finding points on paths, etc. Note - I have discovered that these methods, though probably faster, are quite innaccurate
 // and the innaccuracy worsens with longer paths (accumulative rounding error). So if your paths are likely to exceed 1000 points in length, it's better to use
@@ -21,6 +21,12 @@
 #import "NSBezierPath-OAExtensions.h"
 #endif
 
+static NSString* kDKFlattenedPathCacheKey = @"DKFlattenedPaths";
+static NSString* kDKFlattenedPathChecksumKey = @"checksum";
+
+#define DEFAULT_TRIM_EPSILON 0.1
+#define kDKMaximumCurveSegments 1024 // the most line segments a single curve is flattened into, however fine the flatness
+
 #pragma mark Static Functions
 static void ConvertPathApplierFunction(void* info, const CGPathElement* element);
 static CGFloat lengthOfBezier(const NSPoint bez[4], CGFloat acceptableError);
@@ -30,6 +36,10 @@ static void InterpolatePoints(const NSPoint* pointsIn, NSPoint* cp1, NSPoint* cp
 static NSPoint CornerPoint(const NSPoint* pointsIn, CGFloat offset, CGFloat miterLimit);
 static BOOL CornerArc(const NSPoint* pointsIn, CGFloat offset, NSBezierPath* newPath);
 static BOOL CornerBevel(const NSPoint* pointsIn, CGFloat offset, NSBezierPath* newPath);
+static BOOL OutlineIsWithinDistanceOfRect(NSBezierPath* path, NSRect rect, CGFloat distance, BOOL closeSubpaths);
+static CGFloat DistanceFromPointToSegment(NSPoint p, NSPoint a, NSPoint b);
+static void AppendSimplifiedPolyline(const NSPoint* points, NSUInteger count, CGFloat tolerance, NSBezierPath* path);
+static void AppendFlattenedCurve(const NSPoint* c, CGFloat flatness, NSBezierPath* path);
 
 @interface NSBezierPath (Geometry_Private)
 - (NSBezierPath*)paralleloidPathWithOffset3:(CGFloat)delta lineJoinStyle:(NSLineJoinStyle)js;
@@ -559,16 +569,132 @@ static BOOL CornerBevel(const NSPoint* pointsIn, CGFloat offset, NSBezierPath* n
 	return YES;
 }
 
+static void AppendFlattenedCurve(const NSPoint* c, CGFloat flatness, NSBezierPath* path)
+{
+	// appends the curve c[0]..c[3] to <path> as straight lines that stray no further than <flatness> from it. The number of lines is found from the largest
+	// second difference of the control points (Wang's formula), so no subdivision tests are needed and the lines are evenly spaced in t.
+
+	CGFloat dx = MAX(fabs(c[0].x - 2.0 * c[1].x + c[2].x), fabs(c[1].x - 2.0 * c[2].x + c[3].x));
+	CGFloat dy = MAX(fabs(c[0].y - 2.0 * c[1].y + c[2].y), fabs(c[1].y - 2.0 * c[2].y + c[3].y));
+	NSInteger i, n = (NSInteger)ceil(sqrt(0.75 * hypot(dx, dy) / flatness));
+
+	n = MIN(MAX(n, 1), kDKMaximumCurveSegments);
+
+	for (i = 1; i < n; ++i) {
+		CGFloat t = (CGFloat)i / n;
+		CGFloat mt = 1.0 - t;
+		CGFloat a = mt * mt * mt, b = 3.0 * mt * mt * t, d = 3.0 * mt * t * t, e = t * t * t;
+
+		[path lineToPoint:NSMakePoint(a * c[0].x + b * c[1].x + d * c[2].x + e * c[3].x, a * c[0].y + b * c[1].y + d * c[2].y + e * c[3].y)];
+	}
+
+	[path lineToPoint:c[3]];
+}
+
+- (NSBezierPath*)bezierPathByFlatteningPathWithFlatness:(CGFloat)flatness
+{
+	// returns a flattened copy of the path at the given flatness. This does its own subdivision rather than setting the default flatness around
+	// -bezierPathByFlatteningPath, so the global state is never touched and it's safe to call from any thread.
+
+	if (flatness <= 0.0)
+		flatness = [NSBezierPath defaultFlatness];
+
+	NSBezierPath* flat = [NSBezierPath bezierPath];
+	NSInteger i, m = [self elementCount];
+	NSPoint ap[3], c[4];
+	NSPoint fp, pp;
+
+	fp = pp = NSZeroPoint;
+
+	for (i = 0; i < m; ++i) {
+		switch ([self elementAtIndex:i
+					associatedPoints:ap]) {
+		case NSMoveToBezierPathElement:
+			fp = pp = ap[0];
+			[flat moveToPoint:fp];
+			break;
+
+		case NSLineToBezierPathElement:
+			pp = ap[0];
+			[flat lineToPoint:pp];
+			break;
+
+		case NSCurveToBezierPathElement:
+			c[0] = pp;
+			c[1] = ap[0];
+			c[2] = ap[1];
+			c[3] = ap[2];
+			AppendFlattenedCurve(c, flatness, flat);
+			pp = ap[2];
+			break;
+
+		case NSClosePathBezierPathElement:
+			[flat closePath];
+			pp = fp;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	[flat setWindingRule:[self windingRule]];
+	[flat setLineCapStyle:[self lineCapStyle]];
+	[flat setLineJoinStyle:[self lineJoinStyle]];
+	[flat setLineWidth:[self lineWidth]];
+	[flat setMiterLimit:[self miterLimit]];
+	[flat setFlatness:[self flatness]];
+
+	return flat;
+}
+
+- (NSBezierPath*)bezierPathByFlatteningPathWithFlatness:(CGFloat)flatness cache:(NSMutableDictionary*)cache
+{
+	// as above, but the result is kept in <cache> (typically an object's rendering cache) along with the path's checksum, so that every
+	// rasterizer drawing the same path at the same flatness shares one flattening. When the path changes the old flattenings are dropped.
+	// The result is shared, so callers must not modify it.
+
+	if (cache == nil)
+		return [self bezierPathByFlatteningPathWithFlatness:flatness];
+
+	NSMutableDictionary* flattenings = [cache objectForKey:kDKFlattenedPathCacheKey];
+	NSNumber* checksum = [NSNumber numberWithUnsignedInteger:[self checksum]];
+
+	if (flattenings == nil || ![[flattenings objectForKey:kDKFlattenedPathChecksumKey] isEqualToNumber:checksum]) {
+		flattenings = [NSMutableDictionary dictionaryWithObject:checksum
+														 forKey:kDKFlattenedPathChecksumKey];
+		[cache setObject:flattenings
+				  forKey:kDKFlattenedPathCacheKey];
+	}
+
+	NSNumber* key = [NSNumber numberWithDouble:flatness];
+	NSBezierPath* flat = [flattenings objectForKey:key];
+
+	if (flat == nil) {
+		flat = [self bezierPathByFlatteningPathWithFlatness:flatness];
+		[flattenings setObject:flat
+						forKey:key];
+	}
+
+	return flat;
+}
+
 - (NSBezierPath*)paralleloidPathWithOffset2:(CGFloat)delta
 {
-	// returns a path offset by <delta>, using the paralleloidPathWithOffset method above on a flattened version of the path. If the caller sets the
-	// default flatness prior to calling this they can control the fineness of the offset path. The offset joins are set to match the current line join style.
+	return [self paralleloidPathWithOffset2:delta
+								   flatness:[NSBezierPath defaultFlatness]];
+}
+
+- (NSBezierPath*)paralleloidPathWithOffset2:(CGFloat)delta flatness:(CGFloat)flatness
+{
+	// returns a path offset by <delta>, using the paralleloidPathWithOffset method above on a version of the path flattened at <flatness>, which
+	// controls the fineness of the offset path. The offset joins are set to match the current line join style.
 
 	if (delta == 0.0)
 		return self;
 
 	NSBezierPath* temp;
-	temp = [self bezierPathByFlatteningPath];
+	temp = [self bezierPathByFlatteningPathWithFlatness:flatness];
 	temp = [temp paralleloidPathWithOffset:delta];
 
 	return temp;
@@ -576,14 +702,20 @@ static BOOL CornerBevel(const NSPoint* pointsIn, CGFloat offset, NSBezierPath* n
 
 - (NSBezierPath*)paralleloidPathWithOffset22:(CGFloat)delta
 {
-	// returns a path offset by <delta>, using the paralleloidPathWithOffset3 method below on a flattened version of the path. If the caller sets the
-	// default flatness prior to calling this they can control the fineness of the offset path. The offset joins are set to match the current line join style.
+	return [self paralleloidPathWithOffset22:delta
+									flatness:[NSBezierPath defaultFlatness]];
+}
+
+- (NSBezierPath*)paralleloidPathWithOffset22:(CGFloat)delta flatness:(CGFloat)flatness
+{
+	// returns a path offset by <delta>, using the paralleloidPathWithOffset3 method below on a version of the path flattened at <flatness>, which
+	// controls the fineness of the offset path. The offset joins are set to match the current line join style.
 
 	if (delta == 0.0)
 		return self;
 
 	NSBezierPath* temp;
-	temp = [self bezierPathByFlatteningPath];
+	temp = [self bezierPathByFlatteningPathWithFlatness:flatness];
 	temp = [temp paralleloidPathWithOffset3:delta
 							  lineJoinStyle:[self lineJoinStyle]];
 
@@ -830,6 +962,66 @@ static BOOL CornerBevel(const NSPoint* pointsIn, CGFloat offset, NSBezierPath* n
 	return temp;
 }
 
+- (NSBezierPath*)bezierPathBySimplifyingLinesWithTolerance:(CGFloat)tolerance
+{
+	NSBezierPath* newPath = [NSBezierPath bezierPath];
+	NSInteger i, count = [self elementCount];
+	NSUInteger runCount = 0, runCapacity = 256;
+	NSPoint* run = malloc(runCapacity * sizeof(NSPoint));
+	NSPoint ap[3], subpathStart = NSZeroPoint;
+
+	[newPath setWindingRule:[self windingRule]];
+
+	// <run> holds the current point followed by the ends of the lines that continue on from it
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [self elementAtIndex:i
+										  associatedPoints:ap];
+
+		if (element == NSLineToBezierPathElement) {
+			if (runCount >= runCapacity) {
+				runCapacity *= 2;
+				run = realloc(run, runCapacity * sizeof(NSPoint));
+			}
+
+			run[runCount++] = ap[0];
+			continue;
+		}
+
+		AppendSimplifiedPolyline(run, runCount, tolerance, newPath);
+
+		switch (element) {
+		case NSMoveToBezierPathElement:
+			[newPath moveToPoint:ap[0]];
+			run[0] = subpathStart = ap[0];
+			runCount = 1;
+			break;
+
+		case NSCurveToBezierPathElement:
+			[newPath curveToPoint:ap[2]
+					controlPoint1:ap[0]
+					controlPoint2:ap[1]];
+			run[0] = ap[2];
+			runCount = 1;
+			break;
+
+		case NSClosePathBezierPathElement:
+			[newPath closePath];
+			run[0] = subpathStart;
+			runCount = 1;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	AppendSimplifiedPolyline(run, runCount, tolerance, newPath);
+	free(run);
+
+	return newPath;
+}
+
 - (NSBezierPath*)bezierPathByInterpolatingPath:(CGFloat)amount
 {
 	// smooths a vector (line segment) path by interpolation into curve segments. This algorithm from http://antigrain.com/research/bezier_interpolation/index.html#PAGE_BEZIER_INTERPOLATION
@@ -1042,6 +1234,13 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 #pragma mark -
 - (NSBezierPath*)bezierPathByRandomisingPoints:(CGFloat)maxAmount
 {
+	return [self bezierPathByRandomisingPoints:maxAmount
+								   randomState:DKRandomThreadState()];
+}
+
+- (NSBezierPath*)bezierPathByRandomisingPoints:(CGFloat)maxAmount randomState:(DKRandomState*)rs
+{
+	// the random offsets are drawn from <rs>, so a generator seeded the same way randomises the same path the same way
 	NSBezierPath* newPath = [self copy];
 
 	if (![self isEmpty]) {
@@ -1059,8 +1258,8 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 			kind = [self elementAtIndex:i
 					   associatedPoints:ap];
 
-			dx = [DKRandom randomPositiveOrNegativeNumber] * maxAmount;
-			dy = [DKRandom randomPositiveOrNegativeNumber] * maxAmount;
+			dx = DKRandomSigned(rs) * maxAmount;
+			dy = DKRandomSigned(rs) * maxAmount;
 
 			//LogEvent_(kInfoEvent, @"random amount = {%f, %f}", dx, dy );
 
@@ -1078,12 +1277,12 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 			case NSCurveToBezierPathElement:
 				ap[0].x += dx;
 				ap[0].y += dy;
-				dx = [DKRandom randomPositiveOrNegativeNumber] * maxAmount;
-				dy = [DKRandom randomPositiveOrNegativeNumber] * maxAmount;
+				dx = DKRandomSigned(rs) * maxAmount;
+				dy = DKRandomSigned(rs) * maxAmount;
 				ap[1].x += dx;
 				ap[1].y += dy;
-				dx = [DKRandom randomPositiveOrNegativeNumber] * maxAmount;
-				dy = [DKRandom randomPositiveOrNegativeNumber] * maxAmount;
+				dx = DKRandomSigned(rs) * maxAmount;
+				dy = DKRandomSigned(rs) * maxAmount;
 				ap[2].x += dx;
 				ap[2].y += dy;
 				[newPath curveToPoint:ap[2]
@@ -1105,6 +1304,12 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 }
 
 - (NSBezierPath*)bezierPathWithRoughenedStrokeOutline:(CGFloat)amount
+{
+	return [self bezierPathWithRoughenedStrokeOutline:amount
+										  randomState:DKRandomThreadState()];
+}
+
+- (NSBezierPath*)bezierPathWithRoughenedStrokeOutline:(CGFloat)amount randomState:(DKRandomState*)rs
 {
 	// given the path, this returns the outline of the path stroke roughened by the given amount. Roughening works by first taking the stroke outline at the
 	// current stroke width, inserting a large number of redundant points and then randomly offsetting each one by a small amount. The result is a path that, when
@@ -1125,14 +1330,12 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 
 		// flatten the path - this breaks up curve segments into short straight segments
 
-		CGFloat savedFlatness = [[self class] defaultFlatness];
-		[[self class] setDefaultFlatness:flatness];
-		newPath = [newPath bezierPathByFlatteningPath];
-		[[self class] setDefaultFlatness:savedFlatness];
+		newPath = [newPath bezierPathByFlatteningPathWithFlatness:flatness];
 
 		// randomise the positions of the points
 
-		newPath = [newPath bezierPathByRandomisingPoints:amount];
+		newPath = [newPath bezierPathByRandomisingPoints:amount
+											 randomState:rs];
 	}
 
 	return newPath; //[newPath bezierPathByUnflatteningPath];
@@ -1221,8 +1424,9 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 	NSBezierPath* newPath;
 	BOOL side = 0; // are we zigging or zagging?
 	BOOL doneFirst = NO;
+	DKArcLengthTable* lengthTable = [DKArcLengthTable arcLengthTableWithPath:self];
 
-	len = [self length];
+	len = [lengthTable length];
 	newPath = [NSBezierPath bezierPath];
 	[newPath moveToPoint:[self firstPoint]];
 	[newPath setWindingRule:[self windingRule]];
@@ -1230,14 +1434,14 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 	while (t < len) {
 		if ((t + zig) > len) {
 			if ([self isPathClosed])
-				zp = [self pointOnPathAtLength:0.0
-										 slope:&slope];
+				zp = [lengthTable pointAtLength:0.0
+										  slope:&slope];
 			else
-				zp = [self pointOnPathAtLength:len
-										 slope:&slope];
+				zp = [lengthTable pointAtLength:len
+										  slope:&slope];
 		} else
-			zp = [self pointOnPathAtLength:t
-									 slope:&slope];
+			zp = [lengthTable pointAtLength:t
+									  slope:&slope];
 
 		// calculate position of corner offset from the path
 
@@ -1291,8 +1495,9 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 		NSBezierPath* newPath;
 		BOOL side = 0; // are we zigging or zagging?
 		BOOL doneFirst = NO;
+		DKArcLengthTable* lengthTable = [DKArcLengthTable arcLengthTableWithPath:self];
 
-		len = [self length];
+		len = [lengthTable length];
 		newPath = [NSBezierPath bezierPath];
 		[newPath moveToPoint:[self firstPoint]];
 		[newPath setWindingRule:[self windingRule]];
@@ -1310,18 +1515,18 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 
 					if (side == 1) {
 						t = (t + len) / 2.0;
-						zp = [self pointOnPathAtLength:t
-												 slope:&slope];
+						zp = [lengthTable pointAtLength:t
+												  slope:&slope];
 						lambda = MAX(1, len - t);
 					} else
-						zp = [self pointOnPathAtLength:0.0
-												 slope:&slope];
+						zp = [lengthTable pointAtLength:0.0
+												  slope:&slope];
 				} else
-					zp = [self pointOnPathAtLength:len
-											 slope:&slope];
+					zp = [lengthTable pointAtLength:len
+											  slope:&slope];
 			} else
-				zp = [self pointOnPathAtLength:t
-										 slope:&slope];
+				zp = [lengthTable pointAtLength:t
+										  slope:&slope];
 
 			// calculate position of peak offset from the path
 
@@ -1374,44 +1579,25 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 	// returns a path representing the stroked edge of the receiver, taking into account its current width and other
 	// stroke settings. This works by converting to a quartz path and using the similar system function there.
 
-	// this creates an offscreen graphics context to support the CG function used, but the context itself does not
-	// need to actually draw anything, therefore a simple 1x1 bitmap is used and reused for this context.
-
-	NSBezierPath* path = nil;
-	NSGraphicsContext* ctx = nil;
-	static NSBitmapImageRep* rep = nil;
-
-	if (rep == nil) {
-		rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
-													  pixelsWide:1
-													  pixelsHigh:1
-												   bitsPerSample:8
-												 samplesPerPixel:3
-														hasAlpha:NO
-														isPlanar:NO
-												  colorSpaceName:NSCalibratedRGBColorSpace
-													 bytesPerRow:4
-													bitsPerPixel:32];
-	}
-
-	ctx = [NSGraphicsContext graphicsContextWithBitmapImageRep:rep];
-
-	NSAssert(ctx != nil, @"no context for -strokedPath");
-
-	SAVE_GRAPHICS_CONTEXT //[NSGraphicsContext saveGraphicsState];
-		[NSGraphicsContext setCurrentContext : ctx];
+	// this creates an offscreen context to support the CG function used, but the context itself does not need to actually
+	// draw anything, therefore a simple 1x1 bitmap is used. It's made for each call and never made current, so that paths can
+	// be stroked on any thread - the bitmap costs very little compared with stroking the path.
 
-	CGContextRef context = [self setQuartzPath];
+	NSBezierPath* path = self;
+	uint8_t byte[8]; // includes some unused padding
+	CGContextRef context = CGBitmapContextCreate(byte, 1, 1, 8, 1, NULL, kCGImageAlphaOnly);
 
-	path = self;
+	NSAssert(context != NULL, @"no context for -strokedPath");
 
 	if (context) {
+		[self setQuartzPathInContext:context
+						   isNewPath:YES];
 		CGContextReplacePathWithStrokedPath(context);
 		path = [NSBezierPath bezierPathWithPathFromContext:context];
+		CGContextRelease(context);
 	}
 
-	RESTORE_GRAPHICS_CONTEXT //[NSGraphicsContext restoreGraphicsState];
-		return path;
+	return path;
 }
 
 - (NSBezierPath*)strokedPathWithStrokeWidth:(CGFloat)width
@@ -1631,10 +1817,18 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 
 #pragma mark -
 - (NSPoint)pointOnPathAtLength:(CGFloat)length slope:(CGFloat*)slope
+{
+	return [self pointOnPathAtLength:length
+							   slope:slope
+						maximumError:DEFAULT_TRIM_EPSILON];
+}
+
+- (NSPoint)pointOnPathAtLength:(CGFloat)length slope:(CGFloat*)slope maximumError:(CGFloat)maxError
 {
 	// Given a length in terms of the distance from the path start, this returns the point and slope
 	// of the path at that position. This works for any path made up of line or curve segments or combinations of them. This should be used with
-	// paths that have no subpaths. If the path has less than two elements, the result is NSZeroPoint.
+	// paths that have no subpaths. If the path has less than two elements, the result is NSZeroPoint. Curves are measured to within <maxError>,
+	// so callers drawing at a small scale can pass a coarser error and measure less.
 
 	NSPoint p = NSZeroPoint;
 	NSPoint ap[3], lp[3];
@@ -1654,7 +1848,8 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 		if (slope)
 			*slope = Slope(ap[0], lp[0]);
 	} else {
-		NSBezierPath* temp = [self bezierPathByTrimmingToLength:length];
+		NSBezierPath* temp = [self bezierPathByTrimmingToLength:length
+											   withMaximumError:maxError];
 
 		// given the trimmed path, the desired point is at the end of the path.
 
@@ -1734,40 +1929,11 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 
 	if (elem < 1)
 		return -1.0; // not close enough
-	else {
-		// get length up to the split element
-
-		CGFloat distance = [self lengthOfPathFromElement:0
-											   toElement:elem - 1];
 
-		// now split the final element and add its length
+	// the table measures the path once, rather than separately up to the element and within it
 
-		NSPoint ap[4];
-		NSBezierPathElement et = [self elementAtIndex:elem
-									 associatedPoints:&ap[1]];
-
-		NSPoint pp[3];
-		NSBezierPathElement pt = [self elementAtIndex:elem - 1
-									 associatedPoints:pp];
-
-		if (pt == NSCurveToBezierPathElement)
-			ap[0] = pp[2];
-		else
-			ap[0] = pp[0];
-
-		if (et == NSCurveToBezierPathElement) {
-			NSPoint left[4], right[4];
-			subdivideBezierAtT(ap, left, right, t);
-
-			CGFloat bd = lengthOfBezier(left, 0.1);
-			distance += bd;
-		} else if (et == NSLineToBezierPathElement) {
-			NSPoint ip = Interpolate(ap[0], ap[1], t);
-			distance += distanceBetween(ip, ap[0]);
-		}
-
-		return distance;
-	}
+	return [[DKArcLengthTable arcLengthTableWithPath:self] lengthAtElement:elem
+																		 t:t];
 #endif
 }
 
@@ -1806,6 +1972,243 @@ static void InterpolatePoints(const NSPoint* v, NSPoint* cp1, NSPoint* cp2, cons
 }
 
 #pragma mark -
+#pragma mark - geometric hit-testing
+- (BOOL)outlineIntersectsRect:(NSRect)rect withinDistance:(CGFloat)distance
+{
+	return OutlineIsWithinDistanceOfRect(self, rect, MAX(0, distance), NO);
+}
+
+- (BOOL)filledAreaIntersectsRect:(NSRect)rect
+{
+	if ([self isEmpty] || !NSIntersectsRect([self controlPointBounds], rect))
+		return NO;
+
+	// either the rect lies wholly inside the filled area, in which case its centre does too, or some part of the area's
+	// edge - including the implicit closing segments - passes through the rect.
+
+	if ([self containsPoint:NSMakePoint(NSMidX(rect), NSMidY(rect))])
+		return YES;
+
+	return OutlineIsWithinDistanceOfRect(self, rect, 0, YES);
+}
+
+#pragma mark -
+
+#define kDKHitTestCurveFlatness 0.1
+#define kDKHitTestMaximumCurveDepth 16
+
+static inline CGFloat DistanceFromPointToRect(NSPoint p, NSRect r)
+{
+	CGFloat dx = MAX(MAX(NSMinX(r) - p.x, p.x - NSMaxX(r)), 0);
+	CGFloat dy = MAX(MAX(NSMinY(r) - p.y, p.y - NSMaxY(r)), 0);
+
+	return hypot(dx, dy);
+}
+
+static inline CGFloat DistanceBetweenRects(NSRect a, NSRect b)
+{
+	CGFloat dx = MAX(MAX(NSMinX(a) - NSMaxX(b), NSMinX(b) - NSMaxX(a)), 0);
+	CGFloat dy = MAX(MAX(NSMinY(a) - NSMaxY(b), NSMinY(b) - NSMaxY(a)), 0);
+
+	return hypot(dx, dy);
+}
+
+static CGFloat DistanceFromPointToSegment(NSPoint p, NSPoint a, NSPoint b)
+{
+	CGFloat dx = b.x - a.x;
+	CGFloat dy = b.y - a.y;
+	CGFloat lenSq = dx * dx + dy * dy;
+	CGFloat t = 0;
+
+	if (lenSq > 0)
+		t = LIMIT(((p.x - a.x) * dx + (p.y - a.y) * dy) / lenSq, 0, 1);
+
+	return hypot(p.x - (a.x + t * dx), p.y - (a.y + t * dy));
+}
+
+static void AppendSimplifiedPolyline(const NSPoint* points, NSUInteger count, CGFloat tolerance, NSBezierPath* path)
+{
+	// <points>[0] is already the path's current point. Douglas-Peucker keeps the point of each span furthest from the chord joining its
+	// ends while that is further than <tolerance>, then works on the two halves. The spans are kept on a stack rather than recursing, as
+	// a run can have hundreds of thousands of points.
+
+	if (count < 2)
+		return;
+
+	BOOL* keep = calloc(count, sizeof(BOOL));
+	NSUInteger* stack = malloc(count * 2 * sizeof(NSUInteger));
+	NSUInteger sp = 0, i;
+
+	keep[0] = keep[count - 1] = YES;
+	stack[sp++] = 0;
+	stack[sp++] = count - 1;
+
+	while (sp > 0) {
+		NSUInteger last = stack[--sp];
+		NSUInteger first = stack[--sp];
+		NSUInteger furthest = first;
+		CGFloat maxDistance = tolerance;
+
+		for (i = first + 1; i < last; ++i) {
+			CGFloat d = DistanceFromPointToSegment(points[i], points[first], points[last]);
+
+			if (d > maxDistance) {
+				maxDistance = d;
+				furthest = i;
+			}
+		}
+
+		if (furthest != first) {
+			keep[furthest] = YES;
+			stack[sp++] = first;
+			stack[sp++] = furthest;
+			stack[sp++] = furthest;
+			stack[sp++] = last;
+		}
+	}
+
+	for (i = 1; i < count; ++i) {
+		if (keep[i])
+			[path lineToPoint:points[i]];
+	}
+
+	free(stack);
+	free(keep);
+}
+
+static BOOL SegmentIntersectsRect(NSPoint a, NSPoint b, NSRect r)
+{
+	// Liang-Barsky - clips the parameter range of the segment against each edge in turn
+
+	CGFloat dx = b.x - a.x;
+	CGFloat dy = b.y - a.y;
+	CGFloat p[4] = { -dx, dx, -dy, dy };
+	CGFloat q[4] = { a.x - NSMinX(r), NSMaxX(r) - a.x, a.y - NSMinY(r), NSMaxY(r) - a.y };
+	CGFloat t0 = 0, t1 = 1;
+	NSInteger i;
+
+	for (i = 0; i < 4; ++i) {
+		if (p[i] == 0) {
+			if (q[i] < 0)
+				return NO;
+		} else {
+			CGFloat t = q[i] / p[i];
+
+			if (p[i] < 0)
+				t0 = MAX(t0, t);
+			else
+				t1 = MIN(t1, t);
+
+			if (t0 > t1)
+				return NO;
+		}
+	}
+
+	return YES;
+}
+
+static CGFloat DistanceFromSegmentToRect(NSPoint a, NSPoint b, NSRect r)
+{
+	if (SegmentIntersectsRect(a, b, r))
+		return 0;
+
+	// the segment lies wholly outside, so the nearest points are an end of the segment or a corner of the rect
+
+	CGFloat d = MIN(DistanceFromPointToRect(a, r), DistanceFromPointToRect(b, r));
+
+	d = MIN(d, DistanceFromPointToSegment(NSMakePoint(NSMinX(r), NSMinY(r)), a, b));
+	d = MIN(d, DistanceFromPointToSegment(NSMakePoint(NSMaxX(r), NSMinY(r)), a, b));
+	d = MIN(d, DistanceFromPointToSegment(NSMakePoint(NSMaxX(r), NSMaxY(r)), a, b));
+	d = MIN(d, DistanceFromPointToSegment(NSMakePoint(NSMinX(r), NSMaxY(r)), a, b));
+
+	return d;
+}
+
+static BOOL CurveIsWithinDistanceOfRect(const NSPoint* c, NSRect r, CGFloat distance, NSInteger depth)
+{
+	// the curve lies inside the hull of its control points, so if that's too far away, so is the curve
+
+	NSRect hull;
+	hull.origin.x = MIN(MIN(c[0].x, c[1].x), MIN(c[2].x, c[3].x));
+	hull.origin.y = MIN(MIN(c[0].y, c[1].y), MIN(c[2].y, c[3].y));
+	hull.size.width = MAX(MAX(c[0].x, c[1].x), MAX(c[2].x, c[3].x)) - hull.origin.x;
+	hull.size.height = MAX(MAX(c[0].y, c[1].y), MAX(c[2].y, c[3].y)) - hull.origin.y;
+
+	if (DistanceBetweenRects(hull, r) > distance)
+		return NO;
+
+	CGFloat flatness = MAX(DistanceFromPointToSegment(c[1], c[0], c[3]), DistanceFromPointToSegment(c[2], c[0], c[3]));
+
+	if (flatness <= kDKHitTestCurveFlatness || depth >= kDKHitTestMaximumCurveDepth)
+		return DistanceFromSegmentToRect(c[0], c[3], r) <= distance + flatness;
+
+	NSPoint left[4], right[4];
+	splitBezierCurveTo(c, 0.5, left, right);
+
+	return CurveIsWithinDistanceOfRect(left, r, distance, depth + 1) || CurveIsWithinDistanceOfRect(right, r, distance, depth + 1);
+}
+
+static BOOL OutlineIsWithinDistanceOfRect(NSBezierPath* path, NSRect rect, CGFloat distance, BOOL closeSubpaths)
+{
+	if ([path isEmpty] || DistanceBetweenRects([path controlPointBounds], rect) > distance)
+		return NO;
+
+	NSInteger i, count = [path elementCount];
+	NSPoint ap[3];
+	NSPoint c[4];
+	NSPoint start = NSZeroPoint;
+	NSPoint current = NSZeroPoint;
+	BOOL open = NO;
+
+	for (i = 0; i < count; ++i) {
+		NSBezierPathElement element = [path elementAtIndex:i
+										  associatedPoints:ap];
+
+		switch (element) {
+		case NSMoveToBezierPathElement:
+			if (closeSubpaths && open && DistanceFromSegmentToRect(current, start, rect) <= distance)
+				return YES;
+
+			start = current = ap[0];
+			open = NO;
+			break;
+
+		case NSLineToBezierPathElement:
+			if (DistanceFromSegmentToRect(current, ap[0], rect) <= distance)
+				return YES;
+
+			current = ap[0];
+			open = YES;
+			break;
+
+		case NSCurveToBezierPathElement:
+			c[0] = current;
+			c[1] = ap[0];
+			c[2] = ap[1];
+			c[3] = ap[2];
+
+			if (CurveIsWithinDistanceOfRect(c, rect, distance, 0))
+				return YES;
+
+			current = ap[2];
+			open = YES;
+			break;
+
+		case NSClosePathBezierPathElement:
+			if (DistanceFromSegmentToRect(current, start, rect) <= distance)
+				return YES;
+
+			current = start;
+			open = NO;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return closeSubpaths && open && DistanceFromSegmentToRect(current, start, rect) <= distance;
+}
 
 static void ConvertPathApplierFunction(void* info, const CGPathElement* element)
 {
@@ -2051,8 +2454,6 @@ static CGFloat subdivideBezierAtLength(const NSPoint bez[4],
 
 #pragma mark -
 
-#define DEFAULT_TRIM_EPSILON 0.1
-
 // Convenience method
 
 - (NSBezierPath*)bezierPathByTrimmingToLength:(CGFloat)trimLength
@@ -0,0 +1,62 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+#define kDKDefaultOffsetTolerance 0.1 // how far an offset curve may stray from the true offset, in points
+
+/**
+offsets paths by a distance, and outlines their strokes, directly from their curves.
+
+each curve is offset by offsetting its control polygon (the Tiller-Hanson construction). The result is checked against the true offset at
+a few points along it, and if it strays by more than the tolerance the curve is split in two and each half offset in turn, so a curve
+usually needs no more than a handful of curves to offset it. Lines stay lines. Corners get the path's line join, limited by its mitre
+limit, on the outside and are simply connected on the inside; cusps are subdivided into until the tolerance is met. Nothing is flattened
+or refitted, and no graphics context is needed, so paths can be offset on any thread.
+
+stroke outlines are made from an offset either side of each subpath, with the path's line caps at the ends of open subpaths; a closed subpath
+gives an outer and an inner loop. Dashes are not applied - use -strokedPath for dashed strokes. The result is meant to be filled with the
+non-zero winding rule, and where a stroke overlaps itself the outline does too, as it does for -strokedPath.
+
+positive distances offset to the left of the direction of the path, as for -paralleloidPathWithOffset:.
+*/
+@interface NSBezierPath (Offset)
+
+/** @brief Returns the path offset by a distance
+
+ The receiver's line join style and mitre limit are used for corners.
+ @param distance the distance to offset the path by
+ @return a new path
+ */
+- (NSBezierPath*)offsetPathWithDistance:(CGFloat)distance;
+- (NSBezierPath*)offsetPathWithDistance:(CGFloat)distance tolerance:(CGFloat)tolerance;
+
+/** @brief Returns the outline of the path's stroke
+
+ The receiver's line width, caps, joins and mitre limit are used.
+ @return a new path, which is empty if the stroke has no width
+ */
+- (NSBezierPath*)strokeOutlinePath;
+- (NSBezierPath*)strokeOutlinePathWithTolerance:(CGFloat)tolerance;
+
+/** @brief Offsets many paths at once, concurrently
+
+ The paths must not be changed until this returns.
+ @param paths a list of NSBezierPaths
+ @param distance the distance to offset each path by
+ @return a list of the offset paths, in the same order
+ */
++ (NSArray*)offsetPathsOfPaths:(NSArray*)paths withDistance:(CGFloat)distance;
+
+/** @brief Outlines the strokes of many paths at once, concurrently
+
+ The paths must not be changed until this returns.
+ @param paths a list of NSBezierPaths
+ @return a list of the stroke outlines, in the same order
+ */
++ (NSArray*)strokeOutlinePathsOfPaths:(NSArray*)paths;
+
+@end
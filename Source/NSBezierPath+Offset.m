@@ -0,0 +1,577 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "NSBezierPath+Offset.h"
+#import "DKDrawKitMacros.h"
+#import "NSBezierPath-OAExtensions.h"
+#include <dispatch/dispatch.h>
+#include <tgmath.h>
+
+#define kDKOffsetMaximumDepth 10 // a curve is split at most this many times over
+#define kDKOffsetEpsilon 1e-9
+
+// a line or curve of a subpath, lines having their control points on their ends
+
+typedef struct {
+	NSPoint p[4];
+	BOOL isLine;
+} DKOffsetSegment;
+
+typedef struct {
+	DKOffsetSegment* segments;
+	NSUInteger count;
+	NSUInteger capacity;
+	BOOL closed;
+} DKOffsetSubpath;
+
+// what an offset or outline is made with
+
+typedef struct {
+	CGFloat tolerance;
+	NSLineJoinStyle join;
+	NSLineCapStyle cap;
+	CGFloat miterLimit;
+} DKOffsetStyle;
+
+#pragma mark Static Functions
+
+static inline NSPoint addPoints(NSPoint a, NSPoint b)
+{
+	return NSMakePoint(a.x + b.x, a.y + b.y);
+}
+
+static inline NSPoint subtractPoints(NSPoint a, NSPoint b)
+{
+	return NSMakePoint(a.x - b.x, a.y - b.y);
+}
+
+static inline NSPoint scalePoint(NSPoint a, CGFloat s)
+{
+	return NSMakePoint(a.x * s, a.y * s);
+}
+
+static inline CGFloat crossProduct(NSPoint a, NSPoint b)
+{
+	return a.x * b.y - a.y * b.x;
+}
+
+static inline CGFloat dotProduct(NSPoint a, NSPoint b)
+{
+	return a.x * b.x + a.y * b.y;
+}
+
+// the left normal of a unit direction
+
+static inline NSPoint leftNormal(NSPoint t)
+{
+	return NSMakePoint(-t.y, t.x);
+}
+
+// the unit direction from <a> to <b>, or NO if they're the same point
+
+static BOOL unitDirection(NSPoint a, NSPoint b, NSPoint* dir)
+{
+	CGFloat dx = b.x - a.x;
+	CGFloat dy = b.y - a.y;
+	CGFloat len = hypot(dx, dy);
+
+	if (len < kDKOffsetEpsilon)
+		return NO;
+
+	dir->x = dx / len;
+	dir->y = dy / len;
+	return YES;
+}
+
+static NSPoint startTangent(const DKOffsetSegment* seg)
+{
+	NSPoint t = NSMakePoint(1, 0);
+
+	if (!unitDirection(seg->p[0], seg->p[1], &t) && !unitDirection(seg->p[0], seg->p[2], &t))
+		unitDirection(seg->p[0], seg->p[3], &t);
+
+	return t;
+}
+
+static NSPoint endTangent(const DKOffsetSegment* seg)
+{
+	NSPoint t = NSMakePoint(1, 0);
+
+	if (!unitDirection(seg->p[2], seg->p[3], &t) && !unitDirection(seg->p[1], seg->p[3], &t))
+		unitDirection(seg->p[0], seg->p[3], &t);
+
+	return t;
+}
+
+static NSPoint pointOnCurve(const NSPoint* c, CGFloat t)
+{
+	CGFloat mt = 1.0 - t;
+	CGFloat a = mt * mt * mt, b = 3 * mt * mt * t, cc = 3 * mt * t * t, d = t * t * t;
+
+	return NSMakePoint(a * c[0].x + b * c[1].x + cc * c[2].x + d * c[3].x, a * c[0].y + b * c[1].y + cc * c[2].y + d * c[3].y);
+}
+
+static NSPoint derivativeOfCurve(const NSPoint* c, CGFloat t)
+{
+	CGFloat mt = 1.0 - t;
+	CGFloat a = 3 * mt * mt, b = 6 * mt * t, d = 3 * t * t;
+
+	return NSMakePoint(a * (c[1].x - c[0].x) + b * (c[2].x - c[1].x) + d * (c[3].x - c[2].x),
+		a * (c[1].y - c[0].y) + b * (c[2].y - c[1].y) + d * (c[3].y - c[2].y));
+}
+
+// where the line through <p> along <u> meets the line through <q> along <v>, or NO if they're parallel
+
+static BOOL intersectLines(NSPoint p, NSPoint u, NSPoint q, NSPoint v, NSPoint* result)
+{
+	CGFloat denom = crossProduct(u, v);
+
+	if (fabs(denom) < 1e-6)
+		return NO;
+
+	CGFloat s = crossProduct(subtractPoints(q, p), v) / denom;
+
+	*result = addPoints(p, scalePoint(u, s));
+	return YES;
+}
+
+static void addSegment(DKOffsetSubpath* sp, NSPoint p0, NSPoint p1, NSPoint p2, NSPoint p3, BOOL isLine)
+{
+	if (sp->count >= sp->capacity) {
+		sp->capacity = MAX(sp->capacity * 2, (NSUInteger)16);
+		sp->segments = realloc(sp->segments, sp->capacity * sizeof(DKOffsetSegment));
+	}
+
+	DKOffsetSegment* seg = &sp->segments[sp->count++];
+
+	seg->p[0] = p0;
+	seg->p[1] = p1;
+	seg->p[2] = p2;
+	seg->p[3] = p3;
+	seg->isLine = isLine;
+}
+
+// offsets the control polygon of a curve, giving a curve close to its offset
+
+static void offsetControlPolygon(const NSPoint* c, CGFloat d, NSPoint* q)
+{
+	NSPoint a, b, e;
+	NSPoint na, nb, ne;
+
+	if (!unitDirection(c[0], c[1], &a) && !unitDirection(c[0], c[2], &a))
+		unitDirection(c[0], c[3], &a);
+
+	if (!unitDirection(c[2], c[3], &e) && !unitDirection(c[1], c[3], &e))
+		unitDirection(c[0], c[3], &e);
+
+	if (!unitDirection(c[1], c[2], &b) && !unitDirection(c[0], c[3], &b))
+		b = a;
+
+	na = scalePoint(leftNormal(a), d);
+	nb = scalePoint(leftNormal(b), d);
+	ne = scalePoint(leftNormal(e), d);
+
+	q[0] = addPoints(c[0], na);
+	q[3] = addPoints(c[3], ne);
+
+	// the inner control points are where the offset legs of the polygon meet, unless a handle has no length, in which
+	// case it has none on the offset either
+
+	if (NSEqualPoints(c[0], c[1]))
+		q[1] = q[0];
+	else if (!intersectLines(q[0], a, addPoints(c[1], nb), b, &q[1]))
+		q[1] = addPoints(c[1], na);
+
+	if (NSEqualPoints(c[2], c[3]))
+		q[2] = q[3];
+	else if (!intersectLines(q[3], e, addPoints(c[2], nb), b, &q[2]))
+		q[2] = addPoints(c[2], ne);
+}
+
+// whether the offset curve <q> is within <tolerance> of the true offset of <c> part way along it
+
+static BOOL offsetIsWithinTolerance(const NSPoint* c, const NSPoint* q, CGFloat d, CGFloat tolerance)
+{
+	static const CGFloat samples[3] = { 0.25, 0.5, 0.75 };
+	NSUInteger i;
+
+	for (i = 0; i < 3; ++i) {
+		NSPoint deriv = derivativeOfCurve(c, samples[i]);
+		CGFloat len = hypot(deriv.x, deriv.y);
+
+		if (len < kDKOffsetEpsilon)
+			continue;
+
+		NSPoint p = pointOnCurve(c, samples[i]);
+		NSPoint trueOffset = addPoints(p, scalePoint(leftNormal(scalePoint(deriv, 1.0 / len)), d));
+		NSPoint approx = pointOnCurve(q, samples[i]);
+
+		if (hypot(approx.x - trueOffset.x, approx.y - trueOffset.y) > tolerance)
+			return NO;
+	}
+
+	return YES;
+}
+
+static void appendOffsetCurve(const NSPoint* c, CGFloat d, CGFloat tolerance, NSUInteger depth, NSBezierPath* path)
+{
+	NSPoint q[4];
+
+	offsetControlPolygon(c, d, q);
+
+	if (depth < kDKOffsetMaximumDepth && !offsetIsWithinTolerance(c, q, d, tolerance)) {
+		NSPoint left[4], right[4];
+
+		splitBezierCurveTo(c, 0.5, left, right);
+		appendOffsetCurve(left, d, tolerance, depth + 1, path);
+		appendOffsetCurve(right, d, tolerance, depth + 1, path);
+		return;
+	}
+
+	// the halves of a split curve meet with the same tangent, so their offsets join up without a gap
+
+	if (!NSEqualPoints([path currentPoint], q[0]))
+		[path lineToPoint:q[0]];
+
+	[path curveToPoint:q[3]
+		 controlPoint1:q[1]
+		 controlPoint2:q[2]];
+}
+
+// connects the offset of a segment ending with tangent <t0> to that of one starting with <t1>, both at <p>
+
+static void appendJoin(NSPoint p, NSPoint t0, NSPoint t1, CGFloat d, const DKOffsetStyle* style, NSBezierPath* path)
+{
+	CGFloat cross = crossProduct(t0, t1);
+	CGFloat dot = dotProduct(t0, t1);
+
+	if (fabs(cross) < kDKOffsetEpsilon && dot > 0)
+		return;
+
+	NSPoint n0 = leftNormal(t0);
+	NSPoint n1 = leftNormal(t1);
+	NSPoint end = addPoints(p, scalePoint(n1, d));
+
+	// on the inside of the turn the offsets cross, so they're just connected
+
+	if (cross * d > 0) {
+		[path lineToPoint:end];
+		return;
+	}
+
+	switch (style->join) {
+	case NSRoundLineJoinStyle: {
+		CGFloat a0 = atan2(n0.y * d, n0.x * d) * 180.0 / pi;
+		CGFloat a1 = atan2(n1.y * d, n1.x * d) * 180.0 / pi;
+
+		[path appendBezierPathWithArcWithCenter:p
+										 radius:fabs(d)
+									 startAngle:a0
+									   endAngle:a1
+									  clockwise:(cross < 0)];
+	} break;
+
+	case NSMiterLineJoinStyle:
+		// the mitre's length relative to the stroke's width is sqrt(2 / (1 + cos)) of the angle between the segments' directions
+
+		if (dot > -1.0 + kDKOffsetEpsilon && sqrt(2.0 / (1.0 + dot)) <= style->miterLimit) {
+			NSPoint miter = addPoints(p, scalePoint(addPoints(n0, n1), d / (1.0 + dot)));
+			[path lineToPoint:miter];
+		}
+		[path lineToPoint:end];
+		break;
+
+	default:
+		[path lineToPoint:end];
+		break;
+	}
+}
+
+// appends a cap at the end <p> of a subpath whose last tangent is <t>, from its left offset to its right
+
+static void appendCap(NSPoint p, NSPoint t, CGFloat h, const DKOffsetStyle* style, NSBezierPath* path)
+{
+	NSPoint n = scalePoint(leftNormal(t), h);
+	NSPoint right = subtractPoints(p, n);
+
+	switch (style->cap) {
+	case NSRoundLineCapStyle: {
+		CGFloat a = atan2(n.y, n.x) * 180.0 / pi;
+
+		[path appendBezierPathWithArcWithCenter:p
+										 radius:h
+									 startAngle:a
+									   endAngle:a - 180.0
+									  clockwise:YES];
+	} break;
+
+	case NSSquareLineCapStyle: {
+		NSPoint ext = scalePoint(t, h);
+
+		[path lineToPoint:addPoints(addPoints(p, n), ext)];
+		[path lineToPoint:addPoints(right, ext)];
+		[path lineToPoint:right];
+	} break;
+
+	default:
+		[path lineToPoint:right];
+		break;
+	}
+}
+
+// appends the offset of a subpath, starting it with a move if <move> is YES, otherwise a line from the current point
+
+static void appendOffsetSubpath(const DKOffsetSubpath* sp, CGFloat d, const DKOffsetStyle* style, BOOL move, NSBezierPath* path)
+{
+	NSUInteger i;
+	const DKOffsetSegment* seg = &sp->segments[0];
+	NSPoint start = addPoints(seg->p[0], scalePoint(leftNormal(startTangent(seg)), d));
+
+	if (move)
+		[path moveToPoint:start];
+	else
+		[path lineToPoint:start];
+
+	for (i = 0; i < sp->count; ++i) {
+		seg = &sp->segments[i];
+
+		if (seg->isLine) {
+			NSPoint n = scalePoint(leftNormal(startTangent(seg)), d);
+			[path lineToPoint:addPoints(seg->p[3], n)];
+		} else
+			appendOffsetCurve(seg->p, d, style->tolerance, 0, path);
+
+		if (i + 1 < sp->count)
+			appendJoin(seg->p[3], endTangent(seg), startTangent(&sp->segments[i + 1]), d, style, path);
+	}
+
+	if (sp->closed) {
+		appendJoin(sp->segments[0].p[0], endTangent(&sp->segments[sp->count - 1]), startTangent(&sp->segments[0]), d, style, path);
+		[path closePath];
+	}
+}
+
+static void reverseSubpath(const DKOffsetSubpath* sp, DKOffsetSubpath* reversed)
+{
+	NSUInteger i;
+
+	reversed->count = reversed->capacity = sp->count;
+	reversed->closed = sp->closed;
+	reversed->segments = malloc(MAX(sp->count, (NSUInteger)1) * sizeof(DKOffsetSegment));
+
+	for (i = 0; i < sp->count; ++i) {
+		const DKOffsetSegment* seg = &sp->segments[sp->count - 1 - i];
+		DKOffsetSegment* rev = &reversed->segments[i];
+
+		rev->p[0] = seg->p[3];
+		rev->p[1] = seg->p[2];
+		rev->p[2] = seg->p[1];
+		rev->p[3] = seg->p[0];
+		rev->isLine = seg->isLine;
+	}
+}
+
+static void appendStrokeOutlineOfSubpath(const DKOffsetSubpath* sp, CGFloat h, const DKOffsetStyle* style, NSBezierPath* path)
+{
+	// offsetting the reversed subpath to its left is the same as offsetting the subpath to its right, and comes out
+	// going the right way round to close the outline
+
+	DKOffsetSubpath reversed;
+	reverseSubpath(sp, &reversed);
+
+	if (sp->closed) {
+		appendOffsetSubpath(sp, h, style, YES, path);
+		appendOffsetSubpath(&reversed, h, style, YES, path);
+	} else {
+		appendOffsetSubpath(sp, h, style, YES, path);
+		appendCap(sp->segments[sp->count - 1].p[3], endTangent(&sp->segments[sp->count - 1]), h, style, path);
+		appendOffsetSubpath(&reversed, h, style, NO, path);
+		appendCap(reversed.segments[reversed.count - 1].p[3], endTangent(&reversed.segments[reversed.count - 1]), h, style, path);
+		[path closePath];
+	}
+
+	free(reversed.segments);
+}
+
+// breaks the path into subpaths of segments, and calls <function> with each one that has any length
+
+typedef void (*DKOffsetSubpathFunction)(const DKOffsetSubpath* sp, CGFloat d, const DKOffsetStyle* style, NSBezierPath* path);
+
+static void processSubpath(DKOffsetSubpath* sp, CGFloat d, const DKOffsetStyle* style, NSBezierPath* path, DKOffsetSubpathFunction function)
+{
+	if (sp->count > 0)
+		function(sp, d, style, path);
+
+	sp->count = 0;
+	sp->closed = NO;
+}
+
+static NSBezierPath* newPathBySubpaths(NSBezierPath* source, CGFloat d, const DKOffsetStyle* style, DKOffsetSubpathFunction function)
+{
+	NSBezierPath* result = [[NSBezierPath alloc] init];
+	NSInteger i, count = [source elementCount];
+	NSPoint ap[3];
+	NSPoint start = NSZeroPoint, current = NSZeroPoint;
+	DKOffsetSubpath sp;
+
+	sp.segments = NULL;
+	sp.count = sp.capacity = 0;
+	sp.closed = NO;
+
+	for (i = 0; i < count; ++i) {
+		switch ([source elementAtIndex:i
+					  associatedPoints:ap]) {
+		case NSMoveToBezierPathElement:
+			processSubpath(&sp, d, style, result, function);
+			start = current = ap[0];
+			break;
+
+		case NSLineToBezierPathElement:
+			if (!NSEqualPoints(current, ap[0]))
+				addSegment(&sp, current, current, ap[0], ap[0], YES);
+			current = ap[0];
+			break;
+
+		case NSCurveToBezierPathElement:
+			if (!NSEqualPoints(current, ap[0]) || !NSEqualPoints(current, ap[1]) || !NSEqualPoints(current, ap[2]))
+				addSegment(&sp, current, ap[0], ap[1], ap[2], NO);
+			current = ap[2];
+			break;
+
+		case NSClosePathBezierPathElement:
+			if (!NSEqualPoints(current, start))
+				addSegment(&sp, current, current, start, start, YES);
+
+			sp.closed = YES;
+			processSubpath(&sp, d, style, result, function);
+			current = start;
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	processSubpath(&sp, d, style, result, function);
+	free(sp.segments);
+
+	[result setWindingRule:NSNonZeroWindingRule];
+	return result;
+}
+
+static DKOffsetStyle offsetStyleForPath(NSBezierPath* path, CGFloat tolerance)
+{
+	DKOffsetStyle style;
+
+	style.tolerance = MAX(tolerance, 0.001);
+	style.join = [path lineJoinStyle];
+	style.cap = [path lineCapStyle];
+	style.miterLimit = [path miterLimit];
+
+	return style;
+}
+
+#pragma mark - batches
+
+typedef struct {
+	NSBezierPath** paths;
+	NSBezierPath** results;
+	CGFloat distance;
+	BOOL outline;
+} DKOffsetBatch;
+
+static void offsetPathInBatch(void* context, size_t i)
+{
+	DKOffsetBatch* batch = (DKOffsetBatch*)context;
+
+	@autoreleasepool {
+		if (batch->outline)
+			batch->results[i] = [[batch->paths[i] strokeOutlinePath] retain];
+		else
+			batch->results[i] = [[batch->paths[i] offsetPathWithDistance:batch->distance] retain];
+	}
+}
+
+static NSArray* offsetPathsInBatch(NSArray* paths, CGFloat distance, BOOL outline)
+{
+	NSUInteger i, count = [paths count];
+
+	if (count == 0)
+		return [NSArray array];
+
+	DKOffsetBatch batch;
+
+	batch.paths = malloc(count * sizeof(NSBezierPath*));
+	batch.results = calloc(count, sizeof(NSBezierPath*));
+	batch.distance = distance;
+	batch.outline = outline;
+
+	[paths getObjects:batch.paths];
+
+	dispatch_apply_f(count, dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), &batch, offsetPathInBatch);
+
+	NSMutableArray* results = [NSMutableArray arrayWithCapacity:count];
+
+	for (i = 0; i < count; ++i) {
+		[results addObject:batch.results[i] ? batch.results[i] : [NSBezierPath bezierPath]];
+		[batch.results[i] release];
+	}
+
+	free(batch.paths);
+	free(batch.results);
+
+	return results;
+}
+
+#pragma mark -
+@implementation NSBezierPath (Offset)
+
+- (NSBezierPath*)offsetPathWithDistance:(CGFloat)distance
+{
+	return [self offsetPathWithDistance:distance
+							  tolerance:kDKDefaultOffsetTolerance];
+}
+
+- (NSBezierPath*)offsetPathWithDistance:(CGFloat)distance tolerance:(CGFloat)tolerance
+{
+	if (distance == 0.0 || [self isEmpty])
+		return [[self copy] autorelease];
+
+	DKOffsetStyle style = offsetStyleForPath(self, tolerance);
+	NSBezierPath* result = newPathBySubpaths(self, distance, &style, appendOffsetSubpath);
+
+	[result setWindingRule:[self windingRule]];
+	return [result autorelease];
+}
+
+- (NSBezierPath*)strokeOutlinePath
+{
+	return [self strokeOutlinePathWithTolerance:kDKDefaultOffsetTolerance];
+}
+
+- (NSBezierPath*)strokeOutlinePathWithTolerance:(CGFloat)tolerance
+{
+	CGFloat h = [self lineWidth] * 0.5;
+
+	if (h <= 0.0 || [self isEmpty])
+		return [NSBezierPath bezierPath];
+
+	DKOffsetStyle style = offsetStyleForPath(self, tolerance);
+
+	return [newPathBySubpaths(self, h, &style, appendStrokeOutlineOfSubpath) autorelease];
+}
+
++ (NSArray*)offsetPathsOfPaths:(NSArray*)paths withDistance:(CGFloat)distance
+{
+	return offsetPathsInBatch(paths, distance, NO);
+}
+
++ (NSArray*)strokeOutlinePathsOfPaths:(NSArray*)paths
+{
+	return offsetPathsInBatch(paths, 0, YES);
+}
+
+@end
@@ -0,0 +1,55 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <Cocoa/Cocoa.h>
+
+// the current version of the packed form. Paths packed by a later version are refused
+
+#define kDKPackedPathVersion 1
+
+/**
+packs a path's geometry into a compact binary form for archiving, in place of the keyed archive of the path itself.
+
+the packed form is a version byte, a flags byte and the winding rule, followed by the number of elements, the element types two bits each,
+and then the points of all the elements in order. The coordinates are big-endian floats when every one of them survives the trip to a float
+unchanged, as they do for most paths, and doubles otherwise, so packing never loses precision. The line width, cap, join, miter limit and
+flatness follow only when they aren't the defaults. Dashes are not kept.
+
+objects encode their paths with -[NSCoder encodePath:forKey:], which stores the packed form under a key of its own, and decode them with
+-decodePathForKey:, which reads archives made before paths were packed as well.
+*/
+@interface NSBezierPath (Packing)
+
+/** @brief Makes a path from its packed form
+ @param data the packed form, as made by -packedData
+ @return the path, or nil if the data isn't a valid packed path
+ */
++ (NSBezierPath*)bezierPathWithPackedData:(NSData*)data;
+
+/** @brief Packs the path
+ @return the packed form
+ */
+- (NSData*)packedData;
+
+@end
+
+@interface NSCoder (DKPathPacking)
+
+/** @brief Encodes a path in its packed form
+
+ The packed form is stored under <key> with "_packed" appended, so that nothing stored under <key> by an earlier version is mistaken for it.
+ @param path the path, which may be nil
+ @param key the key
+ */
+- (void)encodePath:(NSBezierPath*)path forKey:(NSString*)key;
+
+/** @brief Decodes a path encoded by -encodePath:forKey:, or the archived path stored under <key> by an earlier version
+ @param key the key
+ @return the path, or nil
+ */
+- (NSBezierPath*)decodePathForKey:(NSString*)key;
+
+@end
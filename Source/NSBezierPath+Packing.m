@@ -0,0 +1,238 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "NSBezierPath+Packing.h"
+
+// flags
+
+#define kDKPackedPathDoubles 0x01 // coordinates are doubles rather than floats
+#define kDKPackedPathAttributes 0x02 // the line width and other stroking attributes follow the points
+
+#define kDKPackedPathHeaderLength 3
+
+static inline NSUInteger pointsForElement(NSBezierPathElement element)
+{
+	if (element == NSCurveToBezierPathElement)
+		return 3;
+	else if (element == NSClosePathBezierPathElement)
+		return 0;
+	else
+		return 1;
+}
+
+static void appendFloat(NSMutableData* data, CGFloat value, BOOL doubles)
+{
+	if (doubles) {
+		NSSwappedDouble swapped = NSSwapHostDoubleToBig(value);
+		[data appendBytes:&swapped
+				   length:sizeof(swapped)];
+	} else {
+		NSSwappedFloat swapped = NSSwapHostFloatToBig((float)value);
+		[data appendBytes:&swapped
+				   length:sizeof(swapped)];
+	}
+}
+
+// reads a value at <*pos>, advancing it, if there's room; returns NO otherwise
+
+static BOOL readFloat(const uint8_t* bytes, NSUInteger length, NSUInteger* pos, BOOL doubles, CGFloat* value)
+{
+	if (doubles) {
+		NSSwappedDouble swapped;
+
+		if (length - *pos < sizeof(swapped))
+			return NO;
+
+		memcpy(&swapped, bytes + *pos, sizeof(swapped));
+		*value = NSSwapBigDoubleToHost(swapped);
+		*pos += sizeof(swapped);
+	} else {
+		NSSwappedFloat swapped;
+
+		if (length - *pos < sizeof(swapped))
+			return NO;
+
+		memcpy(&swapped, bytes + *pos, sizeof(swapped));
+		*value = NSSwapBigFloatToHost(swapped);
+		*pos += sizeof(swapped);
+	}
+
+	return YES;
+}
+
+@implementation NSBezierPath (Packing)
+
++ (NSBezierPath*)bezierPathWithPackedData:(NSData*)data
+{
+	const uint8_t* bytes = [data bytes];
+	NSUInteger length = [data length];
+	NSUInteger pos = kDKPackedPathHeaderLength;
+
+	if (length < kDKPackedPathHeaderLength + 4 || bytes[0] > kDKPackedPathVersion)
+		return nil;
+
+	BOOL doubles = (bytes[1] & kDKPackedPathDoubles) != 0;
+	uint32_t count;
+
+	memcpy(&count, bytes + pos, sizeof(count));
+	count = NSSwapBigIntToHost(count);
+	pos += sizeof(count);
+
+	// the types are packed four to a byte, so a count too large for the data is refused before any elements are read
+
+	NSUInteger typeBytes = ((NSUInteger)count + 3) / 4;
+
+	if (typeBytes > length - pos)
+		return nil;
+
+	const uint8_t* types = bytes + pos;
+	NSBezierPath* path = [NSBezierPath bezierPath];
+	NSBezierPathElement element;
+	NSPoint points[3];
+	NSUInteger i, j;
+
+	pos += typeBytes;
+
+	for (i = 0; i < count; ++i) {
+		element = (NSBezierPathElement)((types[i / 4] >> ((i % 4) * 2)) & 0x03);
+
+		for (j = 0; j < pointsForElement(element); ++j) {
+			if (!readFloat(bytes, length, &pos, doubles, &points[j].x) || !readFloat(bytes, length, &pos, doubles, &points[j].y))
+				return nil;
+		}
+
+		switch (element) {
+		case NSMoveToBezierPathElement:
+			[path moveToPoint:points[0]];
+			break;
+
+		case NSLineToBezierPathElement:
+			[path lineToPoint:points[0]];
+			break;
+
+		case NSCurveToBezierPathElement:
+			[path curveToPoint:points[2]
+				 controlPoint1:points[0]
+				 controlPoint2:points[1]];
+			break;
+
+		default:
+			[path closePath];
+			break;
+		}
+	}
+
+	[path setWindingRule:(NSWindingRule)bytes[2]];
+
+	if (bytes[1] & kDKPackedPathAttributes) {
+		CGFloat width, miter, flatness;
+
+		if (!readFloat(bytes, length, &pos, YES, &width) || !readFloat(bytes, length, &pos, YES, &miter) || !readFloat(bytes, length, &pos, YES, &flatness) || length - pos < 2)
+			return nil;
+
+		[path setLineWidth:width];
+		[path setMiterLimit:miter];
+		[path setFlatness:flatness];
+		[path setLineCapStyle:(NSLineCapStyle)bytes[pos]];
+		[path setLineJoinStyle:(NSLineJoinStyle)bytes[pos + 1]];
+	}
+
+	return path;
+}
+
+- (NSData*)packedData
+{
+	NSInteger i, count = [self elementCount];
+	NSUInteger j, typeBytes = ((NSUInteger)count + 3) / 4;
+	NSBezierPathElement element;
+	NSPoint points[3];
+	BOOL doubles = NO;
+
+	BOOL attributes = [self lineWidth] != [NSBezierPath defaultLineWidth] || [self miterLimit] != [NSBezierPath defaultMiterLimit] || [self flatness] != [NSBezierPath defaultFlatness] || [self lineCapStyle] != [NSBezierPath defaultLineCapStyle] || [self lineJoinStyle] != [NSBezierPath defaultLineJoinStyle];
+
+	NSMutableData* data = [NSMutableData dataWithLength:kDKPackedPathHeaderLength + sizeof(uint32_t) + typeBytes];
+	uint8_t* bytes = [data mutableBytes];
+	uint32_t swappedCount = NSSwapHostIntToBig((uint32_t)count);
+
+	memcpy(bytes + kDKPackedPathHeaderLength, &swappedCount, sizeof(swappedCount));
+
+	// the first pass packs the element types, and finds whether floats will do - they're used unless a coordinate would change
+
+	uint8_t* types = bytes + kDKPackedPathHeaderLength + sizeof(swappedCount);
+
+	for (i = 0; i < count; ++i) {
+		element = [self elementAtIndex:i
+					  associatedPoints:points];
+		types[i / 4] |= (element & 0x03) << ((i % 4) * 2);
+
+		for (j = 0; j < pointsForElement(element) && !doubles; ++j)
+			doubles = (CGFloat)(float)points[j].x != points[j].x || (CGFloat)(float)points[j].y != points[j].y;
+	}
+
+	bytes[0] = kDKPackedPathVersion;
+	bytes[1] = (doubles ? kDKPackedPathDoubles : 0) | (attributes ? kDKPackedPathAttributes : 0);
+	bytes[2] = (uint8_t)[self windingRule];
+
+	for (i = 0; i < count; ++i) {
+		element = [self elementAtIndex:i
+					  associatedPoints:points];
+
+		for (j = 0; j < pointsForElement(element); ++j) {
+			appendFloat(data, points[j].x, doubles);
+			appendFloat(data, points[j].y, doubles);
+		}
+	}
+
+	if (attributes) {
+		uint8_t styles[2] = { (uint8_t)[self lineCapStyle], (uint8_t)[self lineJoinStyle] };
+
+		appendFloat(data, [self lineWidth], YES);
+		appendFloat(data, [self miterLimit], YES);
+		appendFloat(data, [self flatness], YES);
+		[data appendBytes:styles
+				   length:2];
+	}
+
+	return data;
+}
+
+@end
+
+#pragma mark -
+
+@implementation NSCoder (DKPathPacking)
+
+- (void)encodePath:(NSBezierPath*)path forKey:(NSString*)key
+{
+	if (path == nil)
+		return;
+
+	NSData* data = [path packedData];
+
+	[self encodeBytes:[data bytes]
+			   length:[data length]
+			   forKey:[key stringByAppendingString:@"_packed"]];
+}
+
+- (NSBezierPath*)decodePathForKey:(NSString*)key
+{
+	NSString* packedKey = [key stringByAppendingString:@"_packed"];
+
+	if ([self containsValueForKey:packedKey]) {
+		NSUInteger length = 0;
+		const uint8_t* bytes = [self decodeBytesForKey:packedKey
+										returnedLength:&length];
+		NSBezierPath* path = [NSBezierPath bezierPathWithPackedData:[NSData dataWithBytesNoCopy:(void*)bytes
+																						 length:length
+																				   freeWhenDone:NO]];
+		if (path)
+			return path;
+	}
+
+	return [self decodeObjectForKey:key];
+}
+
+@end
@@ -12,7 +12,8 @@
 
 /** @brief Returns a layout manager used for text on path layout.
 
- This shared layout manager is used by text on path drawing unless a specific manager is passed.
+ This shared layout manager is used by text on path drawing unless a specific manager is passed. Each thread has its own, as a layout
+ manager can't be used by two threads at once.
  @return a shared layout manager instance */
 + (NSLayoutManager*)textOnPathLayoutManager;
 
@@ -76,6 +77,19 @@
  would not all fit on the path). */
 - (BOOL)drawTextOnPath:(NSAttributedString*)str yOffset:(CGFloat)dy layoutManager:(NSLayoutManager*)lm cache:(NSMutableDictionary*)cache;
 
+/** @brief Renders a string on a path, measuring the path to a given tolerance.
+
+ As -drawTextOnPath:yOffset:layoutManager:cache:, which uses a flatness of 0.1, but the path is measured and the underlines offset from
+ it to within <flatness>. Text drawn small can then be laid out from a coarser measure of the path; a rasterizer would pass its
+ -flatnessForObject:. When the flatness differs from that the cache was made at, the cache is invalidated as if the path had changed.
+ @param str the attributed string to render
+ @param dy the offset between the path and the text's baseline when drawn.
+ @param lm the layout manager to use for layout
+ @param cache an optional cache dictionary (must be a valid mutable dictionary, or nil)
+ @param flatness the greatest error allowed in placing the glyphs and lines, in the path's coordinates
+ @return YES if the text was fully laid out, NO if some text could not be drawn */
+- (BOOL)drawTextOnPath:(NSAttributedString*)str yOffset:(CGFloat)dy layoutManager:(NSLayoutManager*)lm cache:(NSMutableDictionary*)cache flatness:(CGFloat)flatness;
+
 // obtaining the paths of the glyphs laid out on the path
 
 /** @brief Returns a list of paths each containing one glyph from the original text.
@@ -247,6 +261,21 @@
 					  descenderBreaks:(NSArray*)breaks
 						grotThreshold:(CGFloat)gt;
 
+/** @brief Converts all the information about an underline into a path that can be drawn, offsetting it from the path to within <flatness>
+
+ As the method above, which uses a flatness of 0.1.
+ @param flatness the greatest error allowed in offsetting the line from the path
+ @return A path. Stroking this path draws the underline.
+ */
+- (NSBezierPath*)textLinePathWithMask:(NSInteger)mask
+						startPosition:(CGFloat)sp
+							   length:(CGFloat)length
+							   offset:(CGFloat)offset
+						lineThickness:(CGFloat)lineThickness
+					  descenderBreaks:(NSArray*)breaks
+						grotThreshold:(CGFloat)gt
+							 flatness:(CGFloat)flatness;
+
 // getting text layout rects for running text within a shape
 
 /** @brief Find the points where a line drawn horizontally across the path will intersect it.
@@ -367,10 +396,10 @@
 
 /** @brief Moves an object along the path at a constant speed
 
- The object must respond to the informal motion protocol. This method starts a timer which runs
- until either the end of the path is reached when loop is NO, or until the object being moved
- itself returns NO. The timer runs at 30 fps and the distance moved is calculated accordingly - this
- gives accurate motion speed regardless of framerate, and will drop frames if necessary.
+ The object must respond to the informal motion protocol. The object is moved by the shared
+ DKPathAnimator once per display refresh until either the end of the path is reached when loop is NO,
+ or until the object being moved itself returns NO. The distance moved is calculated from the time
+ elapsed - this gives accurate motion speed regardless of framerate, and will drop frames if necessary.
  @param object the object to be moved (i.e. animated)
  @param speed the linear motion speed in points per second
  @param loop YES to repeatedly loop the movement when it gets to the end, NO for one-time motion.
@@ -7,27 +7,33 @@
 #import "NSBezierPath+Text.h"
 #import "NSBezierPath+Geometry.h"
 #import "NSBezierPath+Editing.h"
+#import "DKArcLengthTable.h"
+#import "DKScanlineEdgeTable.h"
 #import "DKGeometryUtilities.h"
 #import "NSShadow+Scaling.h"
 #import "DKBezierLayoutManager.h"
+#import "DKGlyphOutlineCache.h"
+#import "DKPathAnimator.h"
 #include <tgmath.h>
 
-@interface NSBezierPath (TextOnPathPrivate)
-
-/** @brief Timer callback used by -moveObject:atSpeed:loop:userInfo
-
- The object must respond to the informal motion protocol.
- @param timer the timer
- */
-- (void)motionCallback:(NSTimer*)timer;
-
-@end
-
 // keys used for data in private cache
 
 static NSString* kDKTextOnPathGlyphPositionCacheKey = @"DKTextOnPathGlyphPositions";
 static NSString* kDKTextOnPathChecksumCacheKey = @"DKTextOnPathChecksum";
 static NSString* kDKTextOnPathTextFittedCacheKey = @"DKTextOnPathTextFitted";
+static NSString* kDKTextOnPathFlatnessCacheKey = @"DKTextOnPathFlatness";
+static NSString* kDKTextOnPathLayoutManagerThreadKey = @"DKTextOnPathLayoutManager";
+
+#define kDKTextOnPathDefaultFlatness 0.1
+
+static CGFloat TextOnPathFlatness(NSDictionary* cache)
+{
+	// the flatness the text in <cache> is being laid out at, as set by -drawTextOnPath:yOffset:layoutManager:cache:flatness:
+
+	NSNumber* flatness = [cache objectForKey:kDKTextOnPathFlatnessCacheKey];
+
+	return flatness ? [flatness doubleValue] : kDKTextOnPathDefaultFlatness;
+}
 
 @implementation NSBezierPath (TextOnPath)
 
@@ -37,9 +43,12 @@ static NSString* kDKTextOnPathTextFittedCacheKey = @"DKTextOnPathTextFitted";
  @return a shared layout manager instance */
 + (NSLayoutManager*)textOnPathLayoutManager
 {
-	// returns a layout manager instance which is used for all text on path layout tasks. Reusing this shared instance saves a little time and memory
+	// returns a layout manager instance which is used for all text on path layout tasks. Reusing this shared instance saves a little time and memory.
+	// A layout manager can't be used by two threads at once, so other threads than the main one keep their own in their thread dictionaries
 
-	static NSLayoutManager* topLayoutMgr = nil;
+	static NSLayoutManager* sMainThreadLayoutMgr = nil;
+	NSMutableDictionary* threadInfo = [NSThread isMainThread] ? nil : [[NSThread currentThread] threadDictionary];
+	NSLayoutManager* topLayoutMgr = threadInfo ? [threadInfo objectForKey:kDKTextOnPathLayoutManagerThreadKey] : sMainThreadLayoutMgr;
 
 	if (topLayoutMgr == nil) {
 		topLayoutMgr = [[NSLayoutManager alloc] init];
@@ -48,6 +57,13 @@ static NSString* kDKTextOnPathTextFittedCacheKey = @"DKTextOnPathTextFitted";
 		[tc release];
 
 		[topLayoutMgr setUsesScreenFonts:NO];
+
+		if (threadInfo) {
+			[threadInfo setObject:topLayoutMgr
+						   forKey:kDKTextOnPathLayoutManagerThreadKey];
+			[topLayoutMgr release];
+		} else
+			sMainThreadLayoutMgr = topLayoutMgr;
 	}
 
 	return topLayoutMgr;
@@ -116,11 +132,37 @@ static NSDictionary* s_TOPTextAttributes = nil;
  would not all fit on the path). */
 - (BOOL)drawTextOnPath:(NSAttributedString*)str yOffset:(CGFloat)dy layoutManager:(NSLayoutManager*)lm cache:(NSMutableDictionary*)cache
 {
+	return [self drawTextOnPath:str
+						yOffset:dy
+				  layoutManager:lm
+						  cache:cache
+					   flatness:kDKTextOnPathDefaultFlatness];
+}
+
+/** @brief Renders a string on a path, measuring the path to a given tolerance.
+
+ As -drawTextOnPath:yOffset:layoutManager:cache:, but the path is measured and the underlines offset from it to within <flatness>, so that
+ text drawn small can be laid out from a coarser measure of the path. When the flatness differs from that the cache was made at, the cache
+ is invalidated as if the path had changed.
+ @param str the attributed string to render
+ @param dy the offset between the path and the text's baseline when drawn.
+ @param lm the layout manager to use for layout
+ @param cache an optional cache dictionary (must be a valid mutable dictionary, or nil)
+ @param flatness the greatest error allowed in placing the glyphs and lines, in the path's coordinates
+ @return YES if the text was fully laid out, NO if some text could not be drawn (for example because it
+ would not all fit on the path). */
+- (BOOL)drawTextOnPath:(NSAttributedString*)str yOffset:(CGFloat)dy layoutManager:(NSLayoutManager*)lm cache:(NSMutableDictionary*)cache flatness:(CGFloat)flatness
+{
+	// without a cache of its own the flatness still has to reach the layout, so a temporary one carries it
+
+	if (cache == nil && flatness != kDKTextOnPathDefaultFlatness)
+		cache = [NSMutableDictionary dictionary];
+
 	NSUInteger cachedCS = [[cache objectForKey:kDKTextOnPathChecksumCacheKey] integerValue];
 	NSUInteger CS = [self checksum];
 
-	if (cachedCS != CS) {
-		// path has changed so cache is unreliable.
+	if (cachedCS != CS || TextOnPathFlatness(cache) != flatness) {
+		// path or flatness has changed so cache is unreliable.
 		//NSLog(@"cs mismatch, invalidating cache (old = %@, new cs = %d)", cache, CS );
 
 		// don't remove if value is 0, as that implies cache was already cleared externally, and may contain other informaiton of importance or
@@ -132,6 +174,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 
 		[cache setObject:[NSNumber numberWithInteger:CS]
 				  forKey:kDKTextOnPathChecksumCacheKey];
+		[cache setObject:[NSNumber numberWithDouble:flatness]
+				  forKey:kDKTextOnPathFlatnessCacheKey];
 	}
 
 	BOOL usingStandardLM = NO;
@@ -344,7 +388,6 @@ static NSDictionary* s_TOPTextAttributes = nil;
 	}
 
 	NSTextContainer* tc = [[lm textContainers] lastObject];
-	NSBezierPath* temp;
 	NSUInteger glyphIndex;
 	NSRect gbr;
 	BOOL result = YES;
@@ -367,6 +410,12 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		DKPathGlyphInfo* posInfo;
 		CGFloat baseline;
 
+		// the path is measured once, rather than trimmed for every glyph
+
+		DKArcLengthTable* lengthTable = [[[DKArcLengthTable alloc] initWithPath:self
+																   maximumError:TextOnPathFlatness(cache)] autorelease];
+		CGFloat pathLength = [lengthTable length];
+
 		// lay down the glyphs along the path
 
 		for (glyphIndex = glyphRange.location; glyphIndex < NSMaxRange(glyphRange); ++glyphIndex) {
@@ -391,20 +440,20 @@ static NSDictionary* s_TOPTextAttributes = nil;
 				// Note that this prevents some kinds of accents from getting drawn - need to work out a fix for that.
 
 				if (half > 0) {
-					// get a shortened path that starts at the character location
+					// find the point on the path at the character location
 
-					temp = [self bezierPathByTrimmingFromLength:NSMinX(lineFragmentRect) + layoutLocation.x + half];
+					CGFloat distance = NSMinX(lineFragmentRect) + layoutLocation.x + half;
 
 					// if no more room on path, stop laying glyphs
 
-					if ([temp length] < half) {
+					if (pathLength - distance < half) {
 						result = NO;
 						break;
 					}
 
-					[temp elementAtIndex:0
-						associatedPoints:&viewLocation];
-					CGFloat angle = [temp slopeStartingPath];
+					CGFloat angle;
+					viewLocation = [lengthTable pointAtLength:distance
+														slope:&angle];
 
 					// view location needs to be offset vertically normal to the path to account for the baseline
 
@@ -733,7 +782,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 								  offset:dy + ulOffset
 						   lineThickness:ulThickness
 						 descenderBreaks:descenderBreaks
-						   grotThreshold:grot];
+						   grotThreshold:grot
+								flatness:TextOnPathFlatness(cache)];
 
 		if (ulp)
 			[cache setObject:ulp
@@ -825,7 +875,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 								  offset:base + dy + (xHeight * 0.5f)
 						   lineThickness:ulThickness
 						 descenderBreaks:nil
-						   grotThreshold:0];
+						   grotThreshold:0
+								flatness:TextOnPathFlatness(cache)];
 
 		if (ulp)
 			[cache setObject:ulp
@@ -966,6 +1017,25 @@ static NSDictionary* s_TOPTextAttributes = nil;
 						lineThickness:(CGFloat)lineThickness
 					  descenderBreaks:(NSArray*)breaks
 						grotThreshold:(CGFloat)gt
+{
+	return [self textLinePathWithMask:mask
+						startPosition:sp
+							   length:length
+							   offset:offset
+						lineThickness:lineThickness
+					  descenderBreaks:breaks
+						grotThreshold:gt
+							 flatness:kDKTextOnPathDefaultFlatness];
+}
+
+- (NSBezierPath*)textLinePathWithMask:(NSInteger)mask
+						startPosition:(CGFloat)sp
+							   length:(CGFloat)length
+							   offset:(CGFloat)offset
+						lineThickness:(CGFloat)lineThickness
+					  descenderBreaks:(NSArray*)breaks
+						grotThreshold:(CGFloat)gt
+							 flatness:(CGFloat)flatness
 {
 	// extract the path we are based on. Note: underline by word is not yet supported.
 
@@ -1021,22 +1091,18 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		trimmedPath = [self bezierPathByTrimmingFromLength:sp
 												  toLength:length];
 
-	[trimmedPath setFlatness:0.1];
-	CGFloat savedFlatness = [NSBezierPath defaultFlatness];
-	[NSBezierPath setDefaultFlatness:0.1];
-
 	// parallel offset has opposite sign to text offset
 
-	trimmedPath = [trimmedPath paralleloidPathWithOffset2:-offset];
+	trimmedPath = [trimmedPath paralleloidPathWithOffset2:-offset
+												 flatness:flatness];
 	[trimmedPath setLineWidth:lineThickness];
 
 	if (isDouble) {
-		NSBezierPath* bp = [trimmedPath paralleloidPathWithOffset2:2.0 * lineThickness];
+		NSBezierPath* bp = [trimmedPath paralleloidPathWithOffset2:2.0 * lineThickness
+														  flatness:flatness];
 		[trimmedPath appendBezierPath:bp];
 	}
 
-	[NSBezierPath setDefaultFlatness:savedFlatness];
-
 	if (mask & 0x0F00) {
 		// some dash pattern is indicated, so work it out and apply it
 
@@ -1106,17 +1172,18 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		return nil;
 
 	NSMutableArray* array = [[NSMutableArray alloc] init];
+	DKArcLengthTable* lengthTable = [DKArcLengthTable arcLengthTableWithPath:self];
 	NSPoint p;
 	CGFloat slope, distance, length;
 	id placedObject;
 
 	distance = 0;
 
-	length = [self length];
+	length = [lengthTable length];
 
 	while (distance <= length) {
-		p = [self pointOnPathAtLength:distance
-								slope:&slope];
+		p = [lengthTable pointAtLength:distance
+								 slope:&slope];
 
 		placedObject = [object placeObjectAtPoint:p
 										   onPath:self
@@ -1200,17 +1267,18 @@ static NSDictionary* s_TOPTextAttributes = nil;
 
 	NSBezierPath* newPath = [NSBezierPath bezierPath];
 	NSBezierPath* temp;
+	DKArcLengthTable* lengthTable = [DKArcLengthTable arcLengthTableWithPath:self];
 	NSPoint p;
 	CGFloat slope, distance, length;
 	NSUInteger count = 0;
 
 	distance = phase;
 
-	length = [self length];
+	length = [lengthTable length];
 
 	while (distance <= length) {
-		p = [self pointOnPathAtLength:distance
-								slope:&slope];
+		p = [lengthTable pointAtLength:distance
+								 slope:&slope];
 
 		if (alt && ((count & 1) == 1))
 			slope += pi;
@@ -1294,6 +1362,7 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		return nil;
 
 	NSMutableArray* array = [[NSMutableArray alloc] init];
+	DKArcLengthTable* lengthTable = [DKArcLengthTable arcLengthTableWithPath:self];
 	NSInteger linkCount = 0;
 	NSPoint prevLink;
 	NSPoint p = NSZeroPoint;
@@ -1301,7 +1370,7 @@ static NSDictionary* s_TOPTextAttributes = nil;
 	id placedObject;
 
 	distance = 0;
-	length = [self length];
+	length = [lengthTable length];
 	prevLink = [self firstPoint];
 
 	while (distance <= length) {
@@ -1315,8 +1384,8 @@ static NSDictionary* s_TOPTextAttributes = nil;
 		distance += radius;
 
 		if (distance <= length) {
-			p = [self pointOnPathAtLength:distance
-									slope:NULL];
+			p = [lengthTable pointAtLength:distance
+									 slope:NULL];
 
 			// point to use will be in this general direction but ensure link length is correct:
 
@@ -1344,117 +1413,21 @@ static NSDictionary* s_TOPTextAttributes = nil;
 
 /** @brief Moves an object along the path at a constant speed
 
- The object must respond to the informal motion protocol. This method starts a timer which runs
- until either the end of the path is reached when loop is NO, or until the object being moved
- itself returns NO. The timer runs at 30 fps and the distance moved is calculated accordingly - this
- gives accurate motion speed regardless of framerate, and will drop frames if necessary.
+ The object must respond to the informal motion protocol. The object is moved by the shared
+ DKPathAnimator once per display refresh until either the end of the path is reached when loop is NO,
+ or until the object being moved itself returns NO. The distance moved is calculated from the time
+ elapsed - this gives accurate motion speed regardless of framerate, and will drop frames if necessary.
  @param object the object to be moved (i.e. animated)
  @param speed the linear motion speed in points per second
  @param loop YES to repeatedly loop the movement when it gets to the end, NO for one-time motion.
  @param userInfo user info passed to the object */
 - (void)moveObject:(id)object atSpeed:(CGFloat)speed loop:(BOOL)loop userInfo:(id)userInfo
 {
-	NSAssert(object != nil, @"can't move a nil object");
-
-	if (![object respondsToSelector:@selector(moveObjectTo:
-												  position:
-													 slope:
-												  userInfo:)])
-		[NSException raise:NSInvalidArgumentException
-					format:@"Moved object %@ does not implement the required protocol", object];
-
-	if ([self elementCount] < 2 || speed <= 0)
-		return;
-
-	if (object) {
-		// set the object's position to the start of the path initially
-
-		NSPoint where;
-		CGFloat slope;
-
-		where = [self pointOnPathAtLength:0
-									slope:&slope];
-		if ([object moveObjectTo:where
-						position:0
-						   slope:slope
-						userInfo:userInfo]) {
-			// set up a dictionary of parameters we can pass using the timer (allows many concurrent motions since there are no state variables
-			// cached by the object)
-
-			NSMutableDictionary* parameters = [[NSMutableDictionary alloc] init];
-
-			[parameters setObject:self
-						   forKey:@"path"];
-			[parameters setObject:[NSNumber numberWithDouble:speed]
-						   forKey:@"speed"];
-
-			if (userInfo != nil)
-				[parameters setObject:userInfo
-							   forKey:@"userinfo"];
-
-			[parameters setObject:object
-						   forKey:@"target"];
-			[parameters setObject:[NSNumber numberWithDouble:[self length]]
-						   forKey:@"path_length"];
-			[parameters setObject:[NSNumber numberWithBool:loop]
-						   forKey:@"loop"];
-			[parameters setObject:[NSNumber numberWithDouble:[NSDate timeIntervalSinceReferenceDate]]
-						   forKey:@"start_time"];
-
-			NSTimer* t = [NSTimer timerWithTimeInterval:1.0 / 30.0
-												 target:self
-											   selector:@selector(motionCallback:)
-											   userInfo:parameters
-												repeats:YES];
-
-			[parameters release];
-			[[NSRunLoop currentRunLoop] addTimer:t
-										 forMode:NSEventTrackingRunLoopMode];
-			[[NSRunLoop currentRunLoop] addTimer:t
-										 forMode:NSDefaultRunLoopMode];
-		}
-	}
-}
-
-- (void)motionCallback:(NSTimer*)timer
-{
-	CGFloat distance, speed, elapsedTime, length;
-	BOOL loop, shouldStop = NO;
-	NSDictionary* params = [timer userInfo];
-
-	elapsedTime = [NSDate timeIntervalSinceReferenceDate] - [[params objectForKey:@"start_time"] doubleValue];
-	speed = [[params objectForKey:@"speed"] doubleValue];
-
-	distance = speed * elapsedTime;
-	length = [[params objectForKey:@"path_length"] doubleValue];
-	loop = [[params objectForKey:@"loop"] boolValue];
-
-	if (!loop && distance > length) {
-		distance = length;
-
-		// reached the end of the path, so kill the timer if not looping
-
-		shouldStop = YES;
-	} else if (loop)
-		distance = fmod(distance, length);
-
-	// move the target object to the calculated point
-
-	NSPoint where;
-	CGFloat slope;
-	id obj = [params objectForKey:@"target"];
-
-	where = [self pointOnPathAtLength:distance
-								slope:&slope];
-	shouldStop |= ![obj moveObjectTo:where
-							position:distance
-							   slope:slope
-							userInfo:[params objectForKey:@"userinfo"]];
-
-	// if the target returns NO, it is telling us to stop immediately, whether or not we are looping
-
-	if (shouldStop)
-		[timer invalidate];
+	[[DKPathAnimator sharedAnimator] moveObject:object
+									  alongPath:self
+										atSpeed:speed
+										   loop:loop
+									   userInfo:userInfo];
 }
 
 #pragma mark -
@@ -1515,10 +1488,7 @@ static NSInteger SortPointsHorizontally(NSValue* value1, NSValue* value2, void*
 
 	// we can use a relatively coarse flatness for more speed - exact precision isn't needed for text layout.
 
-	CGFloat savedFlatness = [self flatness];
-	[self setFlatness:5.0];
-	NSBezierPath* flatpath = [self bezierPathByFlatteningPath];
-	[self setFlatness:savedFlatness];
+	NSBezierPath* flatpath = [self bezierPathByFlatteningPathWithFlatness:5.0];
 
 	NSMutableArray* result = [NSMutableArray array];
 	NSInteger i, m = [flatpath elementCount];
@@ -1580,7 +1550,7 @@ static NSInteger SortPointsHorizontally(NSValue* value1, NSValue* value2, void*
  This works with a fixed lineheight, where every line is the same. Note that this method isn't really
  suitable for use with NSTextContainer or Cocoa's text system in general - for flowing text using
  NSLayoutManager use DKBezierTextContainer which calls the -lineFragmentRectForProposedRect:remainingRect:
- method below.
+ method below. The lines are found with a DKScanlineEdgeTable.
  @param lineHeight the lineheight for the lines of text
  @return a list of NSValues containing NSRects */
 - (NSArray*)lineFragmentRectsForFixedLineheight:(CGFloat)lineHeight
@@ -1597,6 +1567,9 @@ static NSInteger SortPointsHorizontally(NSValue* value1, NSValue* value2, void*
 
 	if (lineCount > 0) {
 		@autoreleasepool {
+			// the lines are found in order down the path, so the edges are walked once rather than intersected for every line
+
+			DKScanlineEdgeTable* edges = [DKScanlineEdgeTable edgeTableWithPath:self];
 			NSArray* previousLine = nil;
 			NSArray* currentLine;
 			NSInteger i;
@@ -1609,10 +1582,10 @@ static NSInteger SortPointsHorizontally(NSValue* value1, NSValue* value2, void*
 				lineRect.origin.y = linePosition;
 
 				if (i == 0)
-					previousLine = [self intersectingPointsWithHorizontalLineAtY:linePosition + 1];
+					previousLine = [edges intersectingPointsWithHorizontalLineAtY:linePosition + 1];
 				else {
 					linePosition = NSMinY(br) + (i * lineHeight);
-					currentLine = [self intersectingPointsWithHorizontalLineAtY:linePosition];
+					currentLine = [edges intersectingPointsWithHorizontalLineAtY:linePosition];
 
 					if (currentLine != nil) {
 						// go through the points of the previous line and this one, forming rects
@@ -1775,13 +1748,6 @@ static NSInteger SortPointsHorizontally(NSValue* value1, NSValue* value2, void*
 
 	CGFloat base = [lm locationForGlyphAtIndex:glyphIndex].y;
 
-	// get the path of the glyph
-
-	NSBezierPath* glyphTemp = [[NSBezierPath alloc] init];
-	[glyphTemp moveToPoint:NSMakePoint(0, dy - base)];
-	[glyphTemp appendBezierPathWithGlyph:glyph
-								  inFont:font];
-
 	// set up a transform to rotate the glyph to the path's local angle and flip it vertically
 
 	NSAffineTransform* transform = [NSAffineTransform transform];
@@ -1790,8 +1756,16 @@ static NSInteger SortPointsHorizontally(NSValue* value1, NSValue* value2, void*
 	[transform rotateByRadians:angle];
 	[transform scaleXBy:1
 					yBy:-1]; // assumes destination is flipped
+	[transform translateXBy:0
+						yBy:dy - base];
 
-	[glyphTemp transformUsingAffineTransform:transform];
+	// get the path of the glyph from the shared outline cache, placed by the transform
+
+	NSBezierPath* glyphTemp = [[NSBezierPath alloc] init];
+	[[DKGlyphOutlineCache sharedGlyphOutlineCache] appendOutlineOfGlyph:glyph
+																 inFont:font
+															  transform:transform
+																 toPath:glyphTemp];
 
 	// add the transformed glyph
 
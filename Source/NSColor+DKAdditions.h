@@ -192,4 +192,38 @@
  */
 - (CGColorRef)newQuartzColor;
 
+/** @brief Sets the colour space colours are rendered in on the current thread
+
+ DKDrawing sets this to its -colourSpace while it draws, so that renderers using -quartzColorInRenderingColourSpace convert their
+ colours to it. nil leaves colours in their own colour spaces. The space isn't retained.
+ @param space a colour space, or nil
+ */
++ (void)setRenderingColourSpace:(NSColorSpace*)space;
++ (NSColorSpace*)renderingColourSpace;
+
+/** @brief Returns a quartz CGColorRef of the receiver converted to <space>
+ @param space the colour space, or nil for the receiver's own colour space
+ @return a new CGColorRef the caller must release, or NULL if the receiver, such as a pattern colour, can't be converted
+ */
+- (CGColorRef)newQuartzColorInColorSpace:(NSColorSpace*)space;
+
+/** @brief Returns a quartz CGColorRef of the receiver in the rendering colour space, made once and then kept
+
+ Renderers set the same few colours over and over, so the converted colours are kept in a shared cache limited to
+ kDKQuartzColourCacheCountLimit colours, rather than remade each time they're drawn. Safe to use from any thread.
+ @return a CGColorRef valid until the current autorelease pool drains, or NULL if the receiver can't be converted
+ */
+- (CGColorRef)quartzColorInRenderingColourSpace;
+
+/** @brief Sets the receiver as the fill, stroke or both colour of the current context, converted to the rendering colour space
+
+ The equivalents of -setFill, -setStroke and -set, using -quartzColorInRenderingColourSpace. Colours that can't be converted, such as
+ pattern colours, are set as those methods would set them.
+ */
+- (void)setRenderingFill;
+- (void)setRenderingStroke;
+- (void)setRendering;
+
 @end
+
+#define kDKQuartzColourCacheCountLimit 1024
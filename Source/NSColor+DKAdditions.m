@@ -9,6 +9,46 @@
 #import "LogEvent.h"
 #include <tgmath.h>
 
+/// a colour converted for quartz, and the colour space it was converted to
+
+@interface DKQuartzColour : NSObject {
+@public
+	CGColorRef mColour; // NULL if the colour couldn't be converted
+	NSColorSpace* mSpace;
+}
+@end
+
+@implementation DKQuartzColour
+
+- (void)dealloc
+{
+	CGColorRelease(mColour);
+	[mSpace release];
+	[super dealloc];
+}
+
+@end
+
+static __thread NSColorSpace* sRenderingColourSpace = nil; // per thread, as each render is of its own drawing
+
+static NSCache* sQuartzColourCache = nil;
+
+static void makeQuartzColourCache(void* context)
+{
+#pragma unused(context)
+	sQuartzColourCache = [[NSCache alloc] init];
+	[sQuartzColourCache setCountLimit:kDKQuartzColourCacheCountLimit];
+}
+
+static NSCache* quartzColourCache(void)
+{
+	static dispatch_once_t once;
+
+	dispatch_once_f(&once, NULL, makeQuartzColourCache);
+
+	return sQuartzColourCache;
+}
+
 @implementation NSColor (DKAdditions)
 #pragma mark As an NSColor
 
@@ -508,4 +548,103 @@
 	return cgColor;
 }
 
+#pragma mark -
+
++ (void)setRenderingColourSpace:(NSColorSpace*)space
+{
+	sRenderingColourSpace = space;
+}
+
++ (NSColorSpace*)renderingColourSpace
+{
+	return sRenderingColourSpace;
+}
+
+- (CGColorRef)newQuartzColorInColorSpace:(NSColorSpace*)space
+{
+	NSColor* colour = nil;
+
+	// only colours with components in a colour space convert. Others, such as catalog colours, are brought into RGB first
+
+	@try
+	{
+		if (space)
+			colour = [self colorUsingColorSpace:space];
+		else if ([self colorSpace] != nil)
+			colour = self;
+	}
+	@catch (id exc)
+	{
+		colour = [self colorUsingColorSpaceName:NSCalibratedRGBColorSpace];
+
+		if (space)
+			colour = [colour colorUsingColorSpace:space];
+	}
+
+	if (colour == nil || [colour numberOfComponents] <= 0 || [[colour colorSpace] CGColorSpace] == NULL)
+		return NULL;
+
+	NSInteger count = [colour numberOfComponents];
+	CGFloat* components = malloc(count * sizeof(CGFloat));
+
+	[colour getComponents:components];
+	CGColorRef cgColor = CGColorCreate([[colour colorSpace] CGColorSpace], components);
+	free(components);
+
+	return cgColor;
+}
+
+- (CGColorRef)quartzColorInRenderingColourSpace
+{
+	NSColorSpace* space = sRenderingColourSpace;
+	NSCache* cache = quartzColourCache();
+	DKQuartzColour* qc = [cache objectForKey:self];
+
+	if (qc == nil || (qc->mSpace != space && ![qc->mSpace isEqual:space])) {
+		qc = [[DKQuartzColour alloc] init];
+		qc->mColour = [self newQuartzColorInColorSpace:space];
+		qc->mSpace = [space retain];
+		[cache setObject:qc
+				  forKey:self];
+		[qc autorelease];
+	}
+
+	// another thread may replace the entry at any time, so what is returned is kept until the pool drains
+
+	return (CGColorRef)[[(id)qc->mColour retain] autorelease];
+}
+
+- (void)setRenderingFill
+{
+	CGColorRef colour = [self quartzColorInRenderingColourSpace];
+
+	if (colour)
+		CGContextSetFillColorWithColor([[NSGraphicsContext currentContext] graphicsPort], colour);
+	else
+		[self setFill];
+}
+
+- (void)setRenderingStroke
+{
+	CGColorRef colour = [self quartzColorInRenderingColourSpace];
+
+	if (colour)
+		CGContextSetStrokeColorWithColor([[NSGraphicsContext currentContext] graphicsPort], colour);
+	else
+		[self setStroke];
+}
+
+- (void)setRendering
+{
+	CGColorRef colour = [self quartzColorInRenderingColourSpace];
+
+	if (colour) {
+		CGContextRef context = [[NSGraphicsContext currentContext] graphicsPort];
+
+		CGContextSetFillColorWithColor(context, colour);
+		CGContextSetStrokeColorWithColor(context, colour);
+	} else
+		[self set];
+}
+
 @end
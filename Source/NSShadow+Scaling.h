@@ -22,6 +22,18 @@ as you scale.
 - (void)setAbsolute;
 - (void)setAbsoluteFlipped:(BOOL)flipped;
 
+/** @brief The offset and blur radius that -setAbsoluteFlipped: gives Quartz in a context, in the context's device space
+ */
+- (void)getAbsoluteOffset:(CGSize*)offset blurRadius:(CGFloat*)blur flipped:(BOOL)flipped inContext:(CGContextRef)cc;
+
+/** @brief Draws the shadow of filling a path in an opaque colour from the shared DKShadowCache, instead of leaving Quartz to blur it
+
+ The caller then fills the path without setting the shadow.
+ @param path the path
+ @return YES if the shadow was drawn, NO if the caller should set the shadow with -setAbsolute as usual
+ */
+- (BOOL)drawCachedShadowForFilledPath:(NSBezierPath*)path;
+
 #ifdef DRAWKIT_DEPRECATED
 - (void)setShadowAngle:(CGFloat)radians distance:(CGFloat)dist;
 - (void)setShadowAngleInDegrees:(CGFloat)degrees distance:(CGFloat)dist;
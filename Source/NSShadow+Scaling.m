@@ -7,6 +7,7 @@
 #import "NSShadow+Scaling.h"
 #import "NSColor+DKAdditions.h"
 #import "DKDrawKitMacros.h"
+#import "DKShadowCache.h"
 #include <tgmath.h>
 
 @implementation NSShadow (DKAdditions)
@@ -22,6 +23,22 @@
 - (void)setAbsoluteFlipped:(BOOL)flipped
 {
 	CGContextRef cc = [[NSGraphicsContext currentContext] graphicsPort];
+	CGSize offset;
+	CGFloat blur;
+
+	[self getAbsoluteOffset:&offset
+				 blurRadius:&blur
+					flipped:flipped
+				  inContext:cc];
+
+	CGColorRef colour = [[self shadowColor] newQuartzColor];
+
+	CGContextSetShadowWithColor(cc, offset, blur, colour);
+	CGColorRelease(colour);
+}
+
+- (void)getAbsoluteOffset:(CGSize*)offset blurRadius:(CGFloat*)blur flipped:(BOOL)flipped inContext:(CGContextRef)cc
+{
 	CGAffineTransform ctm = CGContextGetCTM(cc);
 	CGSize unit = CGSizeApplyAffineTransform(CGSizeMake(1, 1), ctm);
 
@@ -30,12 +47,14 @@
 	if (flipped)
 		os.height = -os.height;
 
-	CGSize offset = CGSizeApplyAffineTransform(*(CGSize*)&os, ctm);
-	CGFloat blur = [self shadowBlurRadius] * unit.width;
-	CGColorRef colour = [[self shadowColor] newQuartzColor];
+	*offset = CGSizeApplyAffineTransform(*(CGSize*)&os, ctm);
+	*blur = [self shadowBlurRadius] * unit.width;
+}
 
-	CGContextSetShadowWithColor(cc, offset, blur, colour);
-	CGColorRelease(colour);
+- (BOOL)drawCachedShadowForFilledPath:(NSBezierPath*)path
+{
+	return [[DKShadowCache sharedShadowCache] drawShadow:self
+										   forFilledPath:path];
 }
 
 #pragma mark -
@@ -91,6 +91,11 @@ void				splitBezierCurveTo(const NSPoint *c, CGFloat t, NSPoint *l, NSPoint *r);
 // Returns a list of all the intersections between the receiver and the specified path. As a special case, if other==self, it does the useful thing and returns only the nontrivial self-intersections.
 - (struct OABezierPathIntersectionList)	allIntersectionsWithPath:(NSBezierPath*) other;
 
+// Finds the intersections between one element of the receiver and one element of another path, for callers that have already pruned the pairs of elements
+// that can't meet. Elements are numbered as for -elementAtIndex:; movetos never intersect. The buffer must have room for OA_MAX_INTERSECTIONS_PER_ELEMENT_PAIR.
+#define OA_MAX_INTERSECTIONS_PER_ELEMENT_PAIR 16
+- (NSUInteger)			getIntersections:(OABezierPathIntersection*) intersections betweenElement:(NSInteger) element andElement:(NSInteger) otherElement ofPath:(NSBezierPath*) other;
+
 - (void)			getWinding:(NSInteger *)clockwiseWindingCount andHit:(NSUInteger *)strokeHitCount forPoint:(NSPoint)point;
 
 - (NSInteger)				segmentHitByPoint:(NSPoint)point padding:(CGFloat)padding;
@@ -398,6 +398,59 @@ static BOOL subsequent(struct OABezierPathIntersectionHalf *one, struct OABezier
 }
 #endif
 
+// Finds the intersections between an element with the given coefficients and another element, whose points are laid out as for subpathWalkingState.
+static NSUInteger intersectionsBetweenElements(NSBezierPathElement what, const NSPoint *elementCoefficients, NSBezierPathElement otherWhat, const NSPoint *otherPoints, struct intersectionInfo *segmentIntersections)
+{
+    NSPoint otherElementCoefficients[4];
+    NSUInteger intersectionsFound, intersectionIndex;
+    
+    switch(what) {
+        case NSClosePathBezierPathElement:
+        case NSLineToBezierPathElement:
+            switch(otherWhat) {
+                case NSClosePathBezierPathElement:
+                case NSLineToBezierPathElement:
+                    _parameterizeLine(otherElementCoefficients, otherPoints[0], otherPoints[1]);
+                    intersectionsFound = intersectionsBetweenLineAndLine(elementCoefficients, otherElementCoefficients, segmentIntersections);
+                    break;
+                case NSCurveToBezierPathElement:
+                    _parameterizeCurve(otherElementCoefficients, otherPoints[0], otherPoints[3], otherPoints[1], otherPoints[2]);
+                    intersectionsFound = intersectionsBetweenCurveAndLine(otherElementCoefficients, elementCoefficients, segmentIntersections);
+                    for(intersectionIndex = 0; intersectionIndex < intersectionsFound; intersectionIndex++)
+                        reverseSenseOfIntersection(&(segmentIntersections[intersectionIndex]));
+                    break;
+                default:
+                    OBASSERT_NOT_REACHED("Unexpected Bezier path element");
+                    intersectionsFound = 0;
+                    break;
+            }
+            break;
+        case NSCurveToBezierPathElement:
+            switch(otherWhat) {
+                case NSClosePathBezierPathElement:
+                case NSLineToBezierPathElement:
+                    _parameterizeLine(otherElementCoefficients, otherPoints[0], otherPoints[1]);
+                    intersectionsFound = intersectionsBetweenCurveAndLine(elementCoefficients, otherElementCoefficients, segmentIntersections);
+                    break;
+                case NSCurveToBezierPathElement:
+                    _parameterizeCurve(otherElementCoefficients, otherPoints[0], otherPoints[3], otherPoints[1], otherPoints[2]);
+                    intersectionsFound = intersectionsBetweenCurveAndCurve(elementCoefficients, otherElementCoefficients, segmentIntersections);
+                    break;
+                default:
+                    OBASSERT_NOT_REACHED("Unexpected Bezier path element");
+                    intersectionsFound = 0;
+                    break;
+            }
+            break;
+        default:
+            OBASSERT_NOT_REACHED("Unexpected Bezier path element");
+            intersectionsFound = 0;
+            break;
+    }
+    
+    return intersectionsFound;
+}
+
 - (struct OABezierPathIntersectionList)allIntersectionsWithPath:(NSBezierPath *)other
 {
 	NSUInteger intersectionCount = 0;
@@ -420,7 +473,6 @@ static BOOL subsequent(struct OABezierPathIntersectionHalf *one, struct OABezier
         parameterizeSubpathElement(&selfIter, elementCoefficients);
 
         while(nextSubpathElement(&otherIter)) {
-            NSPoint otherElementCoefficients[4];
             NSUInteger intersectionsFound, intersectionIndex;
             struct intersectionInfo segmentIntersections[MAX_INTERSECTIONS_PER_ELT_PAIR];
 
@@ -435,48 +487,8 @@ static BOOL subsequent(struct OABezierPathIntersectionHalf *one, struct OABezier
                 } else {
                     intersectionsFound = 0;
                 }
-            } else switch(selfIter.what) {  // This is the usual case
-                case NSClosePathBezierPathElement:
-                case NSLineToBezierPathElement:
-                    switch(otherIter.what) {
-                        case NSClosePathBezierPathElement:
-                        case NSLineToBezierPathElement:
-                            _parameterizeLine(otherElementCoefficients, otherIter.points[0], otherIter.points[1]);
-                            intersectionsFound = intersectionsBetweenLineAndLine(elementCoefficients, otherElementCoefficients, segmentIntersections);
-                            break;
-                        case NSCurveToBezierPathElement:
-                            _parameterizeCurve(otherElementCoefficients, otherIter.points[0], otherIter.points[3], otherIter.points[1], otherIter.points[2]);
-                            intersectionsFound = intersectionsBetweenCurveAndLine(otherElementCoefficients, elementCoefficients, segmentIntersections);
-                            for(intersectionIndex = 0; intersectionIndex < intersectionsFound; intersectionIndex++)
-                                reverseSenseOfIntersection(&(segmentIntersections[intersectionIndex]));
-                            break;
-                        default:
-                            OBASSERT_NOT_REACHED("Unexpected Bezier path element");
-                            intersectionsFound = 0;
-                            break;
-                    }
-                    break;
-                case NSCurveToBezierPathElement:
-                    switch(otherIter.what) {
-                        case NSClosePathBezierPathElement:
-                        case NSLineToBezierPathElement:
-                            _parameterizeLine(otherElementCoefficients, otherIter.points[0], otherIter.points[1]);
-                            intersectionsFound = intersectionsBetweenCurveAndLine(elementCoefficients, otherElementCoefficients, segmentIntersections);
-                            break;
-                        case NSCurveToBezierPathElement:
-                            _parameterizeCurve(otherElementCoefficients, otherIter.points[0], otherIter.points[3], otherIter.points[1], otherIter.points[2]);
-                            intersectionsFound = intersectionsBetweenCurveAndCurve(elementCoefficients, otherElementCoefficients, segmentIntersections);
-                            break;
-                        default:
-                            OBASSERT_NOT_REACHED("Unexpected Bezier path element");
-                            intersectionsFound = 0;
-                            break;
-                    }
-                    break;
-                default:
-                    OBASSERT_NOT_REACHED("Unexpected Bezier path element");
-                    intersectionsFound = 0;
-                    break;
+            } else {  // This is the usual case
+                intersectionsFound = intersectionsBetweenElements(selfIter.what, elementCoefficients, otherIter.what, otherIter.points, segmentIntersections);
             }
                 
             if (self == other) {
@@ -540,6 +552,72 @@ static BOOL subsequent(struct OABezierPathIntersectionHalf *one, struct OABezier
     return (struct OABezierPathIntersectionList){ intersectionCount, intersections };
 }
 
+// Gets the type and points of element i of a path, laid out as for subpathWalkingState. Returns NO for movetos, which have no extent.
+static BOOL getElementSegment(NSBezierPath *p, NSInteger i, NSBezierPathElement *what, NSPoint points[4])
+{
+    NSPoint previous[3];
+    NSInteger j;
+    
+    *what = [p elementAtIndex:i associatedPoints:(points + 1)];
+    if (*what == NSMoveToBezierPathElement || i == 0)
+        return NO;
+    
+    // the currentpoint is the end of the previous element, unless that was a closepath, which ends at the start of its subpath
+    switch([p elementAtIndex:i-1 associatedPoints:previous]) {
+        case NSCurveToBezierPathElement:
+            points[0] = previous[2];
+            break;
+        case NSClosePathBezierPathElement:
+            for(j = i-1; j > 0 && [p elementAtIndex:j] != NSMoveToBezierPathElement; j--)
+                ;
+            [p elementAtIndex:j associatedPoints:points];
+            break;
+        default:
+            points[0] = previous[0];
+            break;
+    }
+    
+    if (*what == NSClosePathBezierPathElement) {
+        for(j = i-1; j > 0 && [p elementAtIndex:j] != NSMoveToBezierPathElement; j--)
+            ;
+        [p elementAtIndex:j associatedPoints:previous];
+        points[1] = previous[0];
+    }
+    
+    return YES;
+}
+
+- (NSUInteger)getIntersections:(OABezierPathIntersection *)intersections betweenElement:(NSInteger)element andElement:(NSInteger)otherElement ofPath:(NSBezierPath *)other
+{
+    NSBezierPathElement what, otherWhat;
+    NSPoint points[4], otherPoints[4], elementCoefficients[4];
+    struct intersectionInfo segmentIntersections[MAX_INTERSECTIONS_PER_ELT_PAIR];
+    NSUInteger intersectionsFound, intersectionIndex;
+    
+    if (!getElementSegment(self, element, &what, points) || !getElementSegment(other, otherElement, &otherWhat, otherPoints))
+        return 0;
+    
+    if (what == NSCurveToBezierPathElement) {
+        _parameterizeCurve(elementCoefficients, points[0], points[3], points[1], points[2]);
+    } else {
+        _parameterizeLine(elementCoefficients, points[0], points[1]);
+        elementCoefficients[2].x = elementCoefficients[2].y = 0;
+        elementCoefficients[3].x = elementCoefficients[3].y = 0;
+    }
+    
+    intersectionsFound = intersectionsBetweenElements(what, elementCoefficients, otherWhat, otherPoints, segmentIntersections);
+    
+    for(intersectionIndex = 0; intersectionIndex < intersectionsFound; intersectionIndex++) {
+        double t = segmentIntersections[intersectionIndex].leftParameter;
+        
+        copyIntersection(&(intersections[intersectionIndex]), &(segmentIntersections[intersectionIndex]), element, otherElement);
+        intersections[intersectionIndex].location.x = (( elementCoefficients[3].x * t + elementCoefficients[2].x ) * t + elementCoefficients[1].x ) * t + elementCoefficients[0].x;
+        intersections[intersectionIndex].location.y = (( elementCoefficients[3].y * t + elementCoefficients[2].y ) * t + elementCoefficients[1].y ) * t + elementCoefficients[0].y;
+    }
+    
+    return intersectionsFound;
+}
+
 // TODO: Write unit tests for this. In particular, make sure the winding count comes out right even if the test point is lined up with a vertex or cusp.
 - (void)getWinding:(NSInteger *)windingCountPtr andHit:(NSUInteger *)hitCountPtr forPoint:(NSPoint)point
 {
@@ -6,6 +6,7 @@
 
 #import <SenTestingKit/SenTestingKit.h>
 #import "DKBSPDirectObjectStorage.h"
+#import "DKRTreeObjectStorage.h"
 
 /** @brief Unit Test for the BSP storage sub-system.
 
@@ -19,6 +20,10 @@ Unit Test for the BSP storage sub-system. This works by populating a storage ins
 
 - (void)testBSPStorage;
 - (void)testIndexedBSPStorage;
+- (void)testRTreeStorage;
+- (void)testPackedIndexTree;
+- (void)testRebuildHysteresis;
+- (void)testArchivedIndex;
 
 - (void)populateStorage:(id<DKObjectStorage>)storage canvasSize:(NSSize)canvasSize;
 - (void)deletionTest:(id<DKObjectStorage>)storage;
@@ -29,11 +34,12 @@ Unit Test for the BSP storage sub-system. This works by populating a storage ins
 - (void)repositioningTest:(id<DKObjectStorage>)storage canvasSize:(NSSize)canvasSize;
 - (void)reorderingTest:(id<DKObjectStorage>)storage;
 
-- (void)verifyRenumbering:(DKBSPDirectObjectStorage*)storage;
+- (void)verifyRenumbering:(id<DKObjectStorage>)storage;
 - (void)verifyStorageIntegrity:(DKBSPDirectObjectStorage*)storage;
 - (void)verifyIndexSpotcheck:(DKBSPDirectObjectStorage*)storage;
 
 - (void)verifyIndexedStorageIntegrity:(DKBSPObjectStorage*)storage;
+- (void)verifyRTreeStorageIntegrity:(DKRTreeObjectStorage*)storage;
 
 @end
 
@@ -41,6 +47,7 @@ Unit Test for the BSP storage sub-system. This works by populating a storage ins
 	NSRect _bounds;
 	NSUInteger _index;
 	BOOL _marked;
+	NSUInteger _queryStamp;
 	id<DKObjectStorage> _storage;
 }
 
@@ -10,7 +10,8 @@
 @interface DKBSPDirectObjectStorage (Private)
 
 - (void)sortObjectsByZ:(NSMutableArray*)objects;
-- (void)renumberObjectsFromIndex:(NSUInteger)indx;
+- (void)assignZKeyToObjectAtIndex:(NSUInteger)indx;
+- (void)respaceZKeys;
 - (void)unmarkAll:(NSArray*)objects;
 - (BOOL)checkForTreeRebuild;
 - (void)loadBSPTree;
@@ -39,6 +40,22 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 	return minVal + ru;
 }
 
+static NSArray* copiesOfStorableObjects(NSArray* objects)
+{
+	NSMutableArray* copies = [NSMutableArray arrayWithCapacity:[objects count]];
+	NSEnumerator* iter = [objects objectEnumerator];
+	testStorableObject* obj;
+
+	while ((obj = [iter nextObject])) {
+		testStorableObject* copy = [[testStorableObject alloc] init];
+		[copy setBounds:[obj bounds]];
+		[copies addObject:copy];
+		[copy release];
+	}
+
+	return copies;
+}
+
 @implementation TestBSPStorage
 
 #define NUMBER_OF_OBJECTS 300
@@ -245,6 +262,234 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 	NSLog(@"testIndexedBSPStorage complete.");
 }
 
+- (void)testRTreeStorage
+{
+	NSLog(@"starting 'testRTreeStorage'...");
+
+	srandomdev();
+
+	NSSize canvasSize = NSMakeSize(2000, 2000);
+
+	DKRTreeObjectStorage* testStorage = [[DKRTreeObjectStorage alloc] init];
+
+	[testStorage setCanvasSize:canvasSize];
+
+	[self populateStorage:testStorage
+			   canvasSize:canvasSize];
+	[self verifyRenumbering:testStorage];
+	[self verifyRTreeStorageIntegrity:testStorage];
+
+	NSUInteger v, u = NUMBER_OF_MAIN_TESTS;
+
+	for (v = 0; v < u; ++v) {
+		NSLog(@" =========  beginning main test loop, #%lu =========", (unsigned long)v);
+
+		[self deletionTest:testStorage];
+		[self verifyRenumbering:testStorage];
+		[self verifyRTreeStorageIntegrity:testStorage];
+
+		[self insertionTest:testStorage
+				 canvasSize:canvasSize];
+		[self verifyRenumbering:testStorage];
+		[self verifyRTreeStorageIntegrity:testStorage];
+
+		[self retrievalTest:testStorage
+				 canvasSize:canvasSize];
+		[self verifyRTreeStorageIntegrity:testStorage];
+
+		[self replacementTest:testStorage
+				   canvasSize:canvasSize];
+		[self verifyRenumbering:testStorage];
+		[self verifyRTreeStorageIntegrity:testStorage];
+
+		[self reorderingTest:testStorage];
+		[self verifyRenumbering:testStorage];
+		[self verifyRTreeStorageIntegrity:testStorage];
+
+		[self pointRetrievalTest:testStorage
+					  canvasSize:canvasSize];
+		[self verifyRTreeStorageIntegrity:testStorage];
+
+		// alternate between an incrementally built and a bulk loaded tree
+
+		if (v & 1)
+			[testStorage rebuildTree];
+	}
+
+	[testStorage release];
+	NSLog(@"testRTreeStorage complete.");
+}
+
+- (void)testPackedIndexTree
+{
+	// the packed tree must give exactly the same results as the standard index tree for the same sequence of operations
+
+	NSLog(@"starting 'testPackedIndexTree'...");
+
+	srandomdev();
+
+	NSSize canvasSize = NSMakeSize(2000, 2000);
+	DKBSPIndexTree* reference = [[DKBSPIndexTree alloc] initWithCanvasSize:canvasSize
+																	 depth:kDKMinimumDepth];
+	DKBSPPackedIndexTree* packed = [[DKBSPPackedIndexTree alloc] initWithCanvasSize:canvasSize
+																			  depth:kDKMinimumDepth];
+	NSUInteger i, n = NUMBER_OF_OBJECTS;
+
+	STAssertEquals([packed countOfLeaves], [reference countOfLeaves], @"leaf counts differ");
+
+	for (i = 0; i < n; ++i) {
+		NSRect br = NSMakeRect(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height), randomFloat(1, MAX_OBJECT_SIZE), randomFloat(1, MAX_OBJECT_SIZE));
+
+		[reference insertItemIndex:i
+						  withRect:br];
+		[packed insertItemIndex:i
+					   withRect:br];
+	}
+
+	for (i = 0; i < NUMBER_OF_RETRIEVAL_TESTS * 4; ++i) {
+		NSRect rr = NSMakeRect(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height), randomFloat(0, canvasSize.width / 2), randomFloat(0, canvasSize.height / 2));
+		NSPoint pt = NSMakePoint(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height));
+
+		STAssertEqualObjects([[[packed itemsIntersectingRect:rr] copy] autorelease], [[[reference itemsIntersectingRect:rr] copy] autorelease], @"rect query results differ for %@", NSStringFromRect(rr));
+		STAssertEqualObjects([[[packed itemsIntersectingPoint:pt] copy] autorelease], [[[reference itemsIntersectingPoint:pt] copy] autorelease], @"point query results differ for %@", NSStringFromPoint(pt));
+
+		// mutate both trees the way the storage does when an object is removed or inserted
+
+		NSUInteger ix = randomUnsigned(0, n);
+
+		if (i & 1) {
+			[reference removeItemIndex:ix
+							  withRect:NSZeroRect];
+			[reference shiftIndexesStartingAtIndex:ix + 1
+												by:-1];
+			[packed removeItemIndex:ix
+						   withRect:NSZeroRect];
+			[packed shiftIndexesStartingAtIndex:ix + 1
+											 by:-1];
+		} else {
+			NSRect br = NSMakeRect(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height), randomFloat(1, MAX_OBJECT_SIZE), randomFloat(1, MAX_OBJECT_SIZE));
+
+			[reference shiftIndexesStartingAtIndex:ix
+												by:1];
+			[reference insertItemIndex:ix
+							  withRect:br];
+			[packed shiftIndexesStartingAtIndex:ix
+											 by:1];
+			[packed insertItemIndex:ix
+						   withRect:br];
+		}
+	}
+
+	[reference release];
+	[packed release];
+	NSLog(@"testPackedIndexTree complete.");
+}
+
+- (void)testRebuildHysteresis
+{
+	// adding and removing objects repeatedly around a depth boundary should rebuild the tree once on the way up, but not on the way back down
+
+	NSLog(@"starting 'testRebuildHysteresis'...");
+
+	srandomdev();
+
+	NSSize canvasSize = NSMakeSize(2000, 2000);
+	DKBSPObjectStorage* testStorage = [[DKBSPObjectStorage alloc] init];
+	NSUInteger i, cycle, boundary = 1200, excursion = kDKBSPSlack * 4;
+	testStorableObject* tso;
+
+	[testStorage setCanvasSize:canvasSize];
+
+	for (i = 0; i < boundary - excursion; ++i) {
+		tso = [[testStorableObject alloc] init];
+		[tso setBounds:NSMakeRect(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height), randomFloat(1, MAX_OBJECT_SIZE), randomFloat(1, MAX_OBJECT_SIZE))];
+		[testStorage insertObject:tso
+				 inObjectsAtIndex:i];
+		[tso release];
+	}
+
+	[testStorage resetRebuildStatistics];
+
+	for (cycle = 0; cycle < 10; ++cycle) {
+		for (i = 0; i < excursion * 2; ++i) {
+			tso = [[testStorableObject alloc] init];
+			[tso setBounds:NSMakeRect(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height), randomFloat(1, MAX_OBJECT_SIZE), randomFloat(1, MAX_OBJECT_SIZE))];
+			[testStorage insertObject:tso
+					 inObjectsAtIndex:[testStorage countOfObjects]];
+			[tso release];
+		}
+
+		for (i = 0; i < excursion * 2; ++i)
+			[testStorage removeObjectFromObjectsAtIndex:[testStorage countOfObjects] - 1];
+
+		[self verifyIndexedStorageIntegrity:testStorage];
+	}
+
+	STAssertTrue([testStorage rebuildStatistics].rebuildCount <= 1, @"tree was rebuilt %d times while oscillating around a depth boundary", [testStorage rebuildStatistics].rebuildCount);
+
+	if ([testStorage rebuildStatistics].rebuildCount == 1)
+		STAssertTrue([testStorage rebuildStatistics].suppressedCount > 0, @"shrinking the tree on the way down wasn't counted as suppressed");
+
+	[testStorage release];
+	NSLog(@"testRebuildHysteresis complete.");
+}
+
+- (void)testArchivedIndex
+{
+	// a tree restored from an archived index must match one built from the same objects, and an index that no longer matches them must be
+	// ignored in favour of a rebuild
+
+	NSLog(@"starting 'testArchivedIndex'...");
+
+	NSSize canvasSize = NSMakeSize(2000, 2000);
+	DKBSPObjectStorage* original = [[DKBSPObjectStorage alloc] init];
+	DKBSPObjectStorage* restored = [[DKBSPObjectStorage alloc] init];
+	NSUInteger i;
+
+	[original setCanvasSize:canvasSize];
+	[self populateStorage:original
+			   canvasSize:canvasSize];
+
+	NSData* index = [original archivedIndex];
+
+	STAssertNotNil(index, @"storage with a tree has no archived index");
+
+	// as when a document is opened - the objects are set before the canvas size
+
+	[restored setArchivedIndex:index];
+	[restored setObjects:copiesOfStorableObjects([original objects])];
+	[restored setCanvasSize:canvasSize];
+
+	STAssertEquals([restored rebuildStatistics].restoredCount, (NSUInteger)1, @"tree wasn't restored from the archived index");
+	[self verifyIndexedStorageIntegrity:restored];
+
+	for (i = 0; i < NUMBER_OF_RETRIEVAL_TESTS; ++i) {
+		NSRect rr = NSMakeRect(randomFloat(0, canvasSize.width), randomFloat(0, canvasSize.height), randomFloat(0, canvasSize.width / 2), randomFloat(0, canvasSize.height / 2));
+
+		STAssertEqualObjects([[[[restored tree] itemsIntersectingRect:rr] copy] autorelease], [[[[original tree] itemsIntersectingRect:rr] copy] autorelease], @"restored tree differs for %@", NSStringFromRect(rr));
+	}
+
+	[restored release];
+
+	// move an object, so the index no longer matches
+
+	NSArray* objects = copiesOfStorableObjects([original objects]);
+	testStorableObject* tso = [objects objectAtIndex:0];
+	[tso setBounds:NSOffsetRect([tso bounds], 10, 10)];
+
+	restored = [[DKBSPObjectStorage alloc] init];
+	[restored setArchivedIndex:index];
+	[restored setObjects:objects];
+	[restored setCanvasSize:canvasSize];
+
+	STAssertEquals([restored rebuildStatistics].restoredCount, (NSUInteger)0, @"a stale archived index was used");
+	[self verifyIndexedStorageIntegrity:restored];
+
+	[restored release];
+	[original release];
+	NSLog(@"testArchivedIndex complete.");
+}
+
 - (void)populateStorage:(id<DKObjectStorage>)storage canvasSize:(NSSize)canvasSize
 {
 	NSUInteger i, m = NUMBER_OF_OBJECTS;
@@ -270,7 +515,7 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 		STAssertEqualObjects([tso storage], storage, @"storage back pointer was not correctly assigned");
 
 		if ([storage isKindOfClass:[DKBSPDirectObjectStorage class]])
-			STAssertEquals([tso index], i, @"storage index was incorrectly assigned (should be %d, was %d)", i, [tso index]);
+			STAssertEquals([storage indexOfObject:tso], i, @"storage index was incorrectly assigned (should be %d, was %d)", i, [storage indexOfObject:tso]);
 	}
 
 	STAssertEquals([storage countOfObjects], m, @"total number of objects stored was mismatched (was %d, should be %d)", [storage countOfObjects], m);
@@ -380,7 +625,7 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 
 		if ([storage isKindOfClass:[DKBSPDirectObjectStorage class]]) {
 			STAssertEquals([orig index], [tso index], @"replacement object index mismatch, expected %d, got %d", [orig index], [tso index]);
-			STAssertEquals(ix, [tso index], @"replacement object index mismatch, expected %d, got %d", ix, [tso index]);
+			STAssertEquals(ix, [storage indexOfObject:tso], @"replacement object index mismatch, expected %d, got %d", ix, [storage indexOfObject:tso]);
 		}
 
 		STAssertEqualObjects([tso storage], storage, @"storage back-pointer incorrect after replacement (%@)", [tso storage]);
@@ -564,12 +809,12 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 			tso = [objects objectAtIndex:r];
 
 			if ([storage isKindOfClass:[DKBSPDirectObjectStorage class]])
-				STAssertEquals([tso index], r, @"before repositioning index was incorrect - expected %d, got %d (%@)", r, [tso index], tso);
+				STAssertEquals([storage indexOfObject:tso], r, @"before repositioning index was incorrect - expected %d, got %d (%@)", r, [storage indexOfObject:tso], tso);
 
 			[tso setBounds:newBounds];
 
 			if ([storage isKindOfClass:[DKBSPDirectObjectStorage class]])
-				STAssertEquals([tso index], r, @"after repositioning index was incorrect - expected %d, got %d", r, [tso index]);
+				STAssertEquals([storage indexOfObject:tso], r, @"after repositioning index was incorrect - expected %d, got %d", r, [storage indexOfObject:tso]);
 
 			STAssertEqualObjects([tso storage], storage, @"after repositioning storage was incorrect, got %@", [tso storage]);
 			STAssertTrue(NSEqualRects(newBounds, [tso bounds]), @"bounds mismatch, should be %@", NSStringFromRect(newBounds));
@@ -609,13 +854,13 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 		tso = [storage objectInObjectsAtIndex:ix];
 
 		if ([storage isKindOfClass:[DKBSPDirectObjectStorage class]])
-			STAssertEquals([tso index], ix, @"object index was incorrect before reordering - expected %d, was %d (%@)", ix, [tso index], tso);
+			STAssertEquals([storage indexOfObject:tso], ix, @"object index was incorrect before reordering - expected %d, was %d (%@)", ix, [storage indexOfObject:tso], tso);
 
 		[storage moveObject:tso
 					toIndex:dx];
 
 		if ([storage isKindOfClass:[DKBSPDirectObjectStorage class]])
-			STAssertEquals([tso index], dx, @"object index was incorrect after reordering - expected %d, was %d (original = %d, %@)", dx, [tso index], ix, tso);
+			STAssertEquals([storage indexOfObject:tso], dx, @"object index was incorrect after reordering - expected %d, was %d (original = %d, %@)", dx, [storage indexOfObject:tso], ix, tso);
 
 		ix = [srcIndexes indexGreaterThanIndex:ix];
 		dx = [destIndexes indexGreaterThanIndex:dx];
@@ -627,17 +872,28 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 
 #pragma mark -
 
-- (void)verifyRenumbering:(DKBSPDirectObjectStorage*)storage
+- (void)verifyRenumbering:(id<DKObjectStorage>)storage
 {
 	NSLog(@"checking renumbering...");
 
 	testStorableObject* tso;
 	NSUInteger i, m = [storage countOfObjects];
+	NSUInteger prevKey = 0;
+
+	// direct storage uses sparse Z keys, which need only increase strictly in array order
+
+	BOOL sparse = [(id)storage isKindOfClass:[DKBSPDirectObjectStorage class]];
 
 	for (i = 0; i < m; ++i) {
 		tso = [storage objectInObjectsAtIndex:i];
 
-		STAssertEquals([tso index], i, @"renumbering error - index = %d, stored index = %d", i, [tso index]);
+		if (sparse) {
+			if (i > 0)
+				STAssertTrue([tso index] > prevKey, @"renumbering error - key at index %d (%d) does not exceed previous key (%d)", i, [tso index], prevKey);
+
+			prevKey = [tso index];
+		} else
+			STAssertEquals([tso index], i, @"renumbering error - index = %d, stored index = %d", i, [tso index]);
 	}
 }
 
@@ -745,7 +1001,7 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 	for (i = 0; i < [objects count]; ++i) {
 		tso = [objects objectAtIndex:i];
 
-		STAssertEquals([tso index], ix, @"mismatch of object index in spotcheck, expected %d, got %d (%@)", ix, [tso index], tso);
+		STAssertEquals([storage indexOfObject:tso], ix, @"mismatch of object index in spotcheck, expected %d, got %d (%@)", ix, [storage indexOfObject:tso], tso);
 
 		ix = [remIndexSet indexGreaterThanIndex:ix];
 	}
@@ -789,6 +1045,21 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 	}
 }
 
+- (void)verifyRTreeStorageIntegrity:(DKRTreeObjectStorage*)storage
+{
+	// retrieving the whole canvas (and well beyond it) must return every object, once, in Z-order
+
+	NSLog(@"checking R-tree integrity...");
+
+	NSArray* all = [storage objectsIntersectingRect:NSMakeRect(-10000, -10000, 20000, 20000)
+											 inView:nil
+											options:0];
+
+	STAssertEquals([all count], [storage countOfObjects], @"number of objects in tree is not equal to number in linear storage, expected %lu, got %lu", (unsigned long)[storage countOfObjects], (unsigned long)[all count]);
+	STAssertEqualObjects(all, [storage objects], @"objects retrieved from the tree are not in Z-order");
+	STAssertTrue([storage treeHeight] >= 1, @"tree height is invalid");
+}
+
 @end
 
 #pragma mark -
@@ -825,6 +1096,16 @@ static NSUInteger randomUnsigned(NSUInteger minVal, NSUInteger maxVal)
 	return _marked;
 }
 
+- (NSUInteger)queryStamp
+{
+	return _queryStamp;
+}
+
+- (void)setQueryStamp:(NSUInteger)stamp
+{
+	_queryStamp = stamp;
+}
+
 - (BOOL)visible
 {
 	return YES;
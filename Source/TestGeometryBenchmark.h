@@ -0,0 +1,49 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+
+/// the geometry operations measured by the benchmark
+
+typedef enum {
+	kDKGeometryBenchmarkLength = 0, // -[NSBezierPath length]
+	kDKGeometryBenchmarkPointAtLength, // -pointOnPathAtLength:slope: at a random length
+	kDKGeometryBenchmarkOffsetPath, // -paralleloidPathWithOffset22:
+	kDKGeometryBenchmarkRoughenedOutline, // -bezierPathWithRoughenedStrokeOutline:randomState:
+	kDKGeometryBenchmarkPartcodeHit, // -partcodeHitByPoint:tolerance: at a point near the path
+	kDKGeometryBenchmarkNearestPoint, // -nearestPointToPoint:tolerance: at a point near the path
+	kDKGeometryBenchmarkBooleanOp, // -performBooleanOp:withPath: of two overlapping loops
+	kDKGeometryBenchmarkIntersections, // -allIntersectionsWithPath: of two overlapping loops
+	kDKGeometryBenchmarkCurveFit, // curveFitPath() of a freehand polyline
+	kDKGeometryBenchmarkDistortion, // -[DKDistortionTransform transformBezierPath:]
+	kDKGeometryBenchmarkOperationCount
+} DKGeometryBenchmarkOperation;
+
+/** @brief Benchmarks the path geometry code that the rest of the framework is built on.
+
+ Benchmarks the path geometry code that the rest of the framework is built on. Each operation is run over generated paths of 10 to 100,000
+ elements, rising by a factor of ten - closed loops of curves, and freehand polylines for curve fitting - for as many iterations as fit in a
+ short time budget. For every operation and size the time per operation, the throughput in operations and elements per second, and the heap
+ blocks and bytes each operation leaves allocated, both before and after its autorelease pool is drained, are emitted as one line of JSON to
+ stdout (prefixed with "DKBENCH ") and to DK_BENCHMARK_OUTPUT, as for TestRenderBenchmark. Given DK_BENCHMARK_BASELINE, an operation more
+ than DK_BENCHMARK_TOLERANCE percent (default 20) slower than the baseline fails. Intersections, which compare every element of one path with
+ every element of the other, are only measured up to 10,000 elements.
+
+ The benchmark only runs if the environment variable DK_RUN_GEOMETRY_BENCHMARKS is set. DK_GEOMETRY_BENCHMARK_MAX_ELEMENTS limits the
+ largest path (default 100000). The paths are generated from a fixed seed so runs are repeatable.
+*/
+@interface TestGeometryBenchmark : SenTestCase {
+@private
+	NSFileHandle* mOutput;
+	NSMutableDictionary* mBaseline; // key -> ms per operation
+	CGFloat mTolerance;
+}
+
+- (void)testGeometryBenchmarks;
+
+- (void)benchmarkOperation:(DKGeometryBenchmarkOperation)op elements:(NSUInteger)count;
+
+@end
@@ -0,0 +1,340 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestGeometryBenchmark.h"
+#import "NSBezierPath+Geometry.h"
+#import "NSBezierPath+Editing.h"
+#import "NSBezierPath+Combinatorial.h"
+#import "NSBezierPath-OAExtensions.h"
+#import "DKDistortionTransform.h"
+#import "DKRandom.h"
+#import "CurveFit.h"
+#include <malloc/malloc.h>
+#include <tgmath.h>
+
+#define kDKGeometryBenchmarkSeed 20160404
+#define kDKGeometryBenchmarkDefaultMaxElements 100000
+#define kDKGeometryBenchmarkDefaultTolerance 20.0 // percent
+#define kDKGeometryBenchmarkPairwiseMaxElements 10000 // intersections compare every element with every other, so larger paths take too long
+#define kDKGeometryBenchmarkTimeBudget 0.5 // seconds of timed operations per measurement
+#define kDKGeometryBenchmarkBatchTime 0.002 // a batch is doubled until it takes this long, so the clock isn't read around every short operation
+#define kDKGeometryBenchmarkMinIterations 3
+#define kDKGeometryBenchmarkMaxIterations 1000000
+#define kDKGeometryBenchmarkProbeCount 64 // the points and lengths the queries cycle through
+#define kDKGeometryBenchmarkRadius 1000.0
+#define kDKGeometryBenchmarkTolerance 4.0 // the hit tolerance for the queries
+
+static NSString* sOperationNames[kDKGeometryBenchmarkOperationCount] = { @"length", @"pointAtLength", @"offsetPath", @"roughenedOutline", @"partcodeHit", @"nearestPoint", @"booleanOp", @"intersections", @"curveFit", @"distortion" };
+
+// what an operation works on, made before it's timed
+
+typedef struct {
+	NSBezierPath* path;
+	NSBezierPath* otherPath; // overlaps <path>, for the operations between two paths
+	NSBezierPath* polyline; // a freehand stroke, for curve fitting
+	DKDistortionTransform* distortion;
+	DKRandomState random;
+	NSPoint probes[kDKGeometryBenchmarkProbeCount]; // points near the path
+	CGFloat lengths[kDKGeometryBenchmarkProbeCount]; // lengths along the path
+	NSUInteger next; // the next probe
+} DKGeometryBenchmarkInputs;
+
+static volatile CGFloat sSink; // results are summed into this so that the work can't be optimised away
+
+static CGFloat benchRandom(CGFloat minVal, CGFloat maxVal)
+{
+	return minVal + (maxVal - minVal) * ((CGFloat)random() / (CGFloat)0x7FFFFFFF);
+}
+
+static NSPoint loopPoint(NSPoint centre, CGFloat radius, CGFloat angle)
+{
+	return NSMakePoint(centre.x + radius * cos(angle), centre.y + radius * sin(angle));
+}
+
+static NSBezierPath* benchLoop(NSUInteger elements, NSPoint centre)
+{
+	// a closed loop of curves around <centre> with noisy radii. Every point is at a different angle, so the loop never crosses
+	// itself however many elements it has. A moveto and closepath make up the count with the curves.
+
+	NSBezierPath* path = [NSBezierPath bezierPath];
+	NSUInteger i, curves = MAX(elements, (NSUInteger)3) - 2;
+	CGFloat step = 2.0 * M_PI / (CGFloat)curves;
+	NSPoint start = loopPoint(centre, kDKGeometryBenchmarkRadius, 0);
+
+	[path moveToPoint:start];
+
+	for (i = 1; i <= curves; ++i) {
+		CGFloat a = (CGFloat)(i - 1) * step;
+		NSPoint end = (i == curves) ? start : loopPoint(centre, kDKGeometryBenchmarkRadius * benchRandom(0.8, 1.0), a + step);
+
+		[path curveToPoint:end
+			 controlPoint1:loopPoint(centre, kDKGeometryBenchmarkRadius * benchRandom(0.8, 1.0), a + step / 3.0)
+			 controlPoint2:loopPoint(centre, kDKGeometryBenchmarkRadius * benchRandom(0.8, 1.0), a + 2.0 * step / 3.0)];
+	}
+
+	[path closePath];
+	[path setLineWidth:4.0];
+
+	return path;
+}
+
+static NSBezierPath* benchPolyline(NSUInteger elements)
+{
+	// a wavering stroke of short straight steps, as the freehand tool records
+
+	NSBezierPath* path = [NSBezierPath bezierPath];
+	NSUInteger i;
+
+	[path moveToPoint:NSZeroPoint];
+
+	for (i = 1; i < MAX(elements, (NSUInteger)2); ++i)
+		[path lineToPoint:NSMakePoint(i * 2.0, 200.0 * sin(i * 0.02) + 40.0 * sin(i * 0.13) + benchRandom(-1, 1))];
+
+	return path;
+}
+
+static void heapStatistics(size_t* blocks, size_t* bytes)
+{
+	malloc_statistics_t stats;
+
+	malloc_zone_statistics(NULL, &stats);
+
+	*blocks = stats.blocks_in_use;
+	*bytes = stats.size_in_use;
+}
+
+static void runOperation(DKGeometryBenchmarkOperation op, DKGeometryBenchmarkInputs* in)
+{
+	NSUInteger probe = in->next++ % kDKGeometryBenchmarkProbeCount;
+	CGFloat slope;
+	NSPoint p;
+
+	switch (op) {
+	default:
+	case kDKGeometryBenchmarkLength:
+		sSink += [in->path length];
+		break;
+
+	case kDKGeometryBenchmarkPointAtLength:
+		p = [in->path pointOnPathAtLength:in->lengths[probe]
+									slope:&slope];
+		sSink += p.x + slope;
+		break;
+
+	case kDKGeometryBenchmarkOffsetPath:
+		sSink += [[in->path paralleloidPathWithOffset22:10.0] elementCount];
+		break;
+
+	case kDKGeometryBenchmarkRoughenedOutline:
+		sSink += [[in->path bezierPathWithRoughenedStrokeOutline:2.0
+													 randomState:&in->random] elementCount];
+		break;
+
+	case kDKGeometryBenchmarkPartcodeHit:
+		sSink += [in->path partcodeHitByPoint:in->probes[probe]
+									tolerance:kDKGeometryBenchmarkTolerance];
+		break;
+
+	case kDKGeometryBenchmarkNearestPoint:
+		p = [in->path nearestPointToPoint:in->probes[probe]
+								tolerance:kDKGeometryBenchmarkTolerance];
+		sSink += p.x;
+		break;
+
+	case kDKGeometryBenchmarkBooleanOp:
+		sSink += [[in->path performBooleanOp:kDKBooleanOpUnion
+									withPath:in->otherPath] elementCount];
+		break;
+
+	case kDKGeometryBenchmarkIntersections: {
+		PathIntersectionList list = [in->path allIntersectionsWithPath:in->otherPath];
+
+		sSink += list.count;
+		free(list.intersections);
+	} break;
+
+	case kDKGeometryBenchmarkCurveFit:
+		sSink += [curveFitPath(in->polyline, 2.0) elementCount];
+		break;
+
+	case kDKGeometryBenchmarkDistortion:
+		sSink += [[in->distortion transformBezierPath:in->path] elementCount];
+		break;
+	}
+}
+
+@implementation TestGeometryBenchmark
+
+- (void)testGeometryBenchmarks
+{
+	if (getenv("DK_RUN_GEOMETRY_BENCHMARKS") == NULL) {
+		NSLog(@"skipping geometry benchmarks - set DK_RUN_GEOMETRY_BENCHMARKS to run them");
+		return;
+	}
+
+	NSUInteger maxElements = kDKGeometryBenchmarkDefaultMaxElements;
+	const char* maxEnv = getenv("DK_GEOMETRY_BENCHMARK_MAX_ELEMENTS");
+	const char* outputPath = getenv("DK_BENCHMARK_OUTPUT");
+	const char* baselinePath = getenv("DK_BENCHMARK_BASELINE");
+	const char* toleranceEnv = getenv("DK_BENCHMARK_TOLERANCE");
+
+	if (maxEnv && strtoul(maxEnv, NULL, 10) > 0)
+		maxElements = strtoul(maxEnv, NULL, 10);
+
+	mTolerance = (toleranceEnv && strtod(toleranceEnv, NULL) > 0) ? strtod(toleranceEnv, NULL) : kDKGeometryBenchmarkDefaultTolerance;
+
+	if (outputPath) {
+		NSString* path = [NSString stringWithUTF8String:outputPath];
+
+		if (![[NSFileManager defaultManager] fileExistsAtPath:path])
+			[[NSFileManager defaultManager] createFileAtPath:path
+													contents:nil
+												  attributes:nil];
+
+		mOutput = [[NSFileHandle fileHandleForWritingAtPath:path] retain];
+		[mOutput seekToEndOfFile];
+	}
+
+	// the baseline is earlier output - lines of JSON, optionally prefixed - of which only the geometry results are used
+
+	if (baselinePath) {
+		NSString* text = [NSString stringWithContentsOfFile:[NSString stringWithUTF8String:baselinePath]
+												   encoding:NSUTF8StringEncoding
+													  error:NULL];
+		NSEnumerator* iter = [[text componentsSeparatedByString:@"\n"] objectEnumerator];
+		NSString* line;
+
+		mBaseline = [[NSMutableDictionary alloc] init];
+
+		while ((line = [iter nextObject])) {
+			NSRange brace = [line rangeOfString:@"{"];
+
+			if (brace.location == NSNotFound)
+				continue;
+
+			NSDictionary* result = [NSJSONSerialization JSONObjectWithData:[[line substringFromIndex:brace.location] dataUsingEncoding:NSUTF8StringEncoding]
+																   options:0
+																	 error:NULL];
+			NSString* key = [result objectForKey:@"key"];
+
+			if (key && [result objectForKey:@"msPerOp"])
+				[mBaseline setObject:[result objectForKey:@"msPerOp"]
+							  forKey:key];
+		}
+	}
+
+	NSUInteger op, count;
+
+	for (op = 0; op < kDKGeometryBenchmarkOperationCount; ++op) {
+		for (count = 10; count <= maxElements; count *= 10) {
+			if (op == kDKGeometryBenchmarkIntersections && count > kDKGeometryBenchmarkPairwiseMaxElements)
+				break;
+
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+			[self benchmarkOperation:(DKGeometryBenchmarkOperation)op
+							elements:count];
+			[pool drain];
+		}
+	}
+
+	[mOutput closeFile];
+	[mOutput release];
+	mOutput = nil;
+	[mBaseline release];
+	mBaseline = nil;
+}
+
+- (void)benchmarkOperation:(DKGeometryBenchmarkOperation)op elements:(NSUInteger)count
+{
+	srandom(kDKGeometryBenchmarkSeed + (unsigned)count);
+
+	DKGeometryBenchmarkInputs in;
+	NSUInteger i;
+
+	memset(&in, 0, sizeof(in));
+
+	in.path = benchLoop(count, NSZeroPoint);
+	in.otherPath = benchLoop(count, NSMakePoint(kDKGeometryBenchmarkRadius * 0.5, kDKGeometryBenchmarkRadius * 0.25));
+	in.polyline = benchPolyline(count);
+	in.distortion = [DKDistortionTransform transformWithInitialRect:[in.path bounds]];
+	[in.distortion shearHorizontallyBy:kDKGeometryBenchmarkRadius * 0.2];
+	[in.distortion differentialPerspectiveBy:kDKGeometryBenchmarkRadius * 0.1];
+	DKRandomSeed(&in.random, kDKGeometryBenchmarkSeed);
+
+	// the queries are made at points just off the path, near the ends of random elements
+
+	CGFloat length = [in.path length];
+
+	for (i = 0; i < kDKGeometryBenchmarkProbeCount; ++i) {
+		NSPoint points[3];
+		NSInteger index = 1 + (NSInteger)((NSUInteger)random() % (NSUInteger)MAX([in.path elementCount] - 2, (NSInteger)1));
+		NSBezierPathElement element = [in.path elementAtIndex:index
+											 associatedPoints:points];
+		NSPoint p = (element == NSCurveToBezierPathElement) ? points[2] : points[0];
+
+		in.probes[i] = NSMakePoint(p.x + benchRandom(-1, 1), p.y + benchRandom(-1, 1));
+		in.lengths[i] = benchRandom(0, length);
+	}
+
+	// one operation first, so that lazily made caches don't count against the measured ones
+
+	size_t blocksBefore, bytesBefore, blocksPooled, bytesPooled, blocksAfter, bytesAfter;
+	double pooledBlocks = 0, pooledBytes = 0, netBlocks = 0, netBytes = 0;
+	NSUInteger batch = 1, iterations = 0;
+	NSTimeInterval start, elapsed, total = 0;
+
+	NSAutoreleasePool* warmUpPool = [[NSAutoreleasePool alloc] init];
+	runOperation(op, &in);
+	[warmUpPool drain];
+
+	while (iterations < kDKGeometryBenchmarkMaxIterations && (total < kDKGeometryBenchmarkTimeBudget || iterations < kDKGeometryBenchmarkMinIterations)) {
+		heapStatistics(&blocksBefore, &bytesBefore);
+
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+		start = [NSDate timeIntervalSinceReferenceDate];
+
+		for (i = 0; i < batch; ++i)
+			runOperation(op, &in);
+
+		elapsed = [NSDate timeIntervalSinceReferenceDate] - start;
+
+		heapStatistics(&blocksPooled, &bytesPooled);
+		[pool drain];
+		heapStatistics(&blocksAfter, &bytesAfter);
+
+		pooledBlocks += (double)blocksPooled - (double)blocksBefore;
+		pooledBytes += (double)bytesPooled - (double)bytesBefore;
+		netBlocks += (double)blocksAfter - (double)blocksBefore;
+		netBytes += (double)bytesAfter - (double)bytesBefore;
+		total += elapsed;
+		iterations += batch;
+
+		if (elapsed < kDKGeometryBenchmarkBatchTime)
+			batch = MIN(batch * 2, kDKGeometryBenchmarkMaxIterations - iterations);
+	}
+
+	CGFloat msPerOp = total * 1000.0 / (CGFloat)iterations;
+	CGFloat opsPerSecond = (total > 0) ? (CGFloat)iterations / total : 0;
+	NSString* key = [NSString stringWithFormat:@"%@/%lu", sOperationNames[op], (unsigned long)count];
+	NSString* line = [NSString stringWithFormat:@"{\"key\":\"%@\",\"operation\":\"%@\",\"elements\":%lu,\"iterations\":%lu,\"msPerOp\":%.6f,\"opsPerSecond\":%.1f,\"elementsPerSecond\":%.1f,\"pooledAllocationsPerOp\":%.1f,\"pooledBytesPerOp\":%.1f,\"netAllocationsPerOp\":%.1f,\"netBytesPerOp\":%.1f}",
+												key, sOperationNames[op], (unsigned long)count, (unsigned long)iterations, msPerOp, opsPerSecond, opsPerSecond * count,
+												pooledBlocks / iterations, pooledBytes / iterations, netBlocks / iterations, netBytes / iterations];
+
+	printf("DKBENCH %s\n", [line UTF8String]);
+
+	[mOutput writeData:[[line stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
+
+	NSNumber* baseline = [mBaseline objectForKey:key];
+
+	if (baseline && [baseline doubleValue] > 0) {
+		STAssertTrue(msPerOp <= [baseline doubleValue] * (1.0 + mTolerance / 100.0),
+					 @"%@ took %.6f ms per operation, more than %.0f%% slower than the baseline %.6f ms", key, msPerOp, mTolerance, [baseline doubleValue]);
+	}
+}
+
+@end
@@ -0,0 +1,19 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+
+/** @brief Unit Test for appending changes to a chunked drawing file.
+
+Unit Test for appending changes to a chunked drawing file. A drawing is written in full, changed, and the changes appended as an incremental
+ autosave does, then the file is read back to check that the changes were written. Changes that don't redraw anything, such as metadata
+ edits, must still mark their objects for writing again.
+*/
+@interface TestIncrementalAutosave : SenTestCase
+
+- (void)testMetadataChangeIsAppended;
+
+@end
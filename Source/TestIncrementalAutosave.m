@@ -0,0 +1,64 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestIncrementalAutosave.h"
+#import "DKDrawing.h"
+#import "DKObjectDrawingLayer.h"
+#import "DKDrawableShape.h"
+#import "DKDrawableObject+Metadata.h"
+#import "DKChunkedDrawingArchive.h"
+#import "DKUniqueID.h"
+
+@implementation TestIncrementalAutosave
+
+- (void)testMetadataChangeIsAppended
+{
+	NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:[NSString stringWithFormat:@"TestIncrementalAutosave-%@.drawing", [DKUniqueID uniqueKey]]];
+	DKDrawing* drawing = [[[DKDrawing alloc] initWithSize:NSMakeSize(500, 500)] autorelease];
+	DKDrawableShape* shape = [DKDrawableShape drawableShapeWithRect:NSMakeRect(10, 10, 100, 100)];
+
+	[shape setString:@"before"
+			  forKey:@"note"];
+	[drawing addLayer:[DKObjectDrawingLayer layerWithObjectsInArray:[NSArray arrayWithObject:shape]]
+		andActivateIt:YES];
+
+	// the first save writes everything
+
+	DKChunkedDrawingWriter* writer = [[[DKChunkedDrawingWriter alloc] init] autorelease];
+	NSOutputStream* stream = [NSOutputStream outputStreamToFileAtPath:path
+															   append:NO];
+	[writer setTracksChanges:YES];
+	[stream open];
+	STAssertTrue([writer writeDrawing:drawing
+							 toStream:stream],
+				 @"the drawing could not be written");
+	[stream close];
+
+	// editing only the metadata redraws nothing, so the change must be noted by the metadata methods themselves
+
+	[shape setString:@"after"
+			  forKey:@"note"];
+
+	stream = [NSOutputStream outputStreamToFileAtPath:path
+											   append:YES];
+	[stream open];
+	STAssertTrue([writer appendChangesToDrawing:drawing
+									   toStream:stream],
+				 @"the changes could not be appended");
+	[stream close];
+
+	DKDrawing* reopened = [DKChunkedDrawingReader drawingWithData:[NSData dataWithContentsOfFile:path]];
+	NSArray* objects = [[[reopened flattenedLayersOfClass:[DKObjectDrawingLayer class]] lastObject] objects];
+
+	[[NSFileManager defaultManager] removeItemAtPath:path
+											   error:NULL];
+
+	STAssertNotNil(reopened, @"the autosaved file could not be read");
+	STAssertEquals([objects count], (NSUInteger)1, @"the reopened drawing should have one object");
+	STAssertEqualObjects([[objects lastObject] stringForKey:@"note"], @"after", @"the metadata change was not appended");
+}
+
+@end
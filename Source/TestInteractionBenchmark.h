@@ -0,0 +1,56 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@class DKDrawing, DKDrawingView, DKEventRecording;
+
+/// the scripted interactions replayed by the benchmark
+
+typedef enum {
+	kDKInteractionBenchmarkDrag = 0, // an unselected shape dragged across the drawing with the selection tool
+	kDKInteractionBenchmarkResize, // a selected shape resized by its bottom right knob
+	kDKInteractionBenchmarkMarquee, // a selection marquee dragged out over many objects
+	kDKInteractionBenchmarkPathEdit, // a point of a selected path dragged
+	kDKInteractionBenchmarkTyping, // a sentence typed into a text shape being edited
+	kDKInteractionBenchmarkScenarioCount
+} DKInteractionBenchmarkScenario;
+
+/** @brief Benchmarks the time from a mouse or key event to the pixels it changes, by replaying event streams against a view of a stress drawing.
+
+ Benchmarks the time from a mouse or key event to the pixels it changes, by replaying event streams against a view of a stress drawing. Each stream is a
+ DKEventRecording, replayed into a DKDrawingView with a DKToolController in an offscreen window the size of a typical one. Each event is sent to
+ the view, the drawing's pending updates are passed on, and the window is displayed and flushed; the time that takes is the event's cost.
+
+ Replay doesn't wait for the recorded times, so runs are repeatable and quick, but the latency reported is what a user would have felt: each event
+ is taken to start at its recorded time, or when the one before it finished if that was later, and its latency runs from its recorded time to when
+ its pixels were flushed. A frame is counted as missed for each whole 1/60 s beyond the first that an event's latency spans.
+
+ Five scripted interactions are replayed - a drag, a resize, a marquee selection, a path edit and typing - each over a drawing of
+ DK_INTERACTION_BENCHMARK_OBJECTS (default 20000) shapes generated from a fixed seed. If DK_INTERACTION_RECORDINGS names a folder, each property list in
+ it is also replayed as a recording made against the same drawing; setting DK_INTERACTION_DOCUMENT writes the drawing to that path, so that it can
+ be opened in an application and interactions recorded there. For every stream the p50, p95 and p99 latency, the worst latency, the mean cost and the
+ frames missed are emitted as one line of JSON to stdout (prefixed with "DKBENCH ") and to DK_BENCHMARK_OUTPUT, with the keys always in the same order,
+ so that the output of two builds can be diffed line by line. Given DK_BENCHMARK_BASELINE, a stream whose p95 latency is more than
+ DK_BENCHMARK_TOLERANCE percent (default 20) worse than the baseline fails, as for TestRenderBenchmark.
+
+ The benchmark only runs if the environment variable DK_RUN_INTERACTION_BENCHMARKS is set.
+*/
+@interface TestInteractionBenchmark : SenTestCase {
+@private
+	NSFileHandle* mOutput;
+	NSMutableDictionary* mBaseline; // key -> p95 latency in ms
+	CGFloat mTolerance;
+	NSUInteger mObjectCount;
+}
+
+- (void)testInteractionBenchmarks;
+
+- (DKDrawing*)stressDrawing;
+- (DKEventRecording*)recordingForScenario:(DKInteractionBenchmarkScenario)scenario drawing:(DKDrawing*)drawing;
+- (void)benchmarkRecording:(DKEventRecording*)recording named:(NSString*)name scenario:(DKInteractionBenchmarkScenario)scenario;
+
+@end
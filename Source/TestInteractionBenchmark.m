@@ -0,0 +1,483 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestInteractionBenchmark.h"
+#import "DKEventRecording.h"
+#import "DKDrawing.h"
+#import "DKDrawingView.h"
+#import "DKToolController.h"
+#import "DKToolRegistry.h"
+#import "DKObjectDrawingLayer.h"
+#import "DKDrawableShape.h"
+#import "DKDrawablePath.h"
+#import "DKTextShape.h"
+#import "DKStyle.h"
+#import "DKUndoManager.h"
+#import "DKDrawableObject+Dependencies.h"
+#include <tgmath.h>
+
+#define kDKInteractionBenchmarkSeed 20160303
+#define kDKInteractionBenchmarkDefaultObjects 20000
+#define kDKInteractionBenchmarkDefaultTolerance 20.0 // percent
+#define kDKInteractionBenchmarkCanvasSide 4000.0
+#define kDKInteractionBenchmarkViewportWidth 1024
+#define kDKInteractionBenchmarkViewportHeight 768
+#define kDKInteractionBenchmarkEventInterval (1.0 / 60.0) // the time between scripted events
+#define kDKInteractionBenchmarkFrameInterval (1.0 / 60.0) // the time a frame lasts, for counting missed frames
+#define kDKInteractionBenchmarkDragSteps 90
+#define kDKInteractionBenchmarkTypedText @"The quick brown fox jumps over the lazy dog."
+
+// the objects the scripted interactions are made with, which are added to the drawing above the generated ones, in this order
+
+typedef enum {
+	kDKInteractionTargetShape = 0,
+	kDKInteractionTargetResizedShape,
+	kDKInteractionTargetPath,
+	kDKInteractionTargetText,
+	kDKInteractionTargetCount
+} DKInteractionTarget;
+
+static NSString* sScenarioNames[kDKInteractionBenchmarkScenarioCount] = { @"drag", @"resize", @"marquee", @"pathEdit", @"typing" };
+
+// no objects are generated where the marquee starts, so that the mouse goes down on nothing
+
+static const NSRect sMarqueeStartArea = { { 0, 0 }, { 60, 60 } };
+static const NSPoint sMarqueeStart = { 20, 20 };
+static const NSPoint sPathPoints[] = { { 300, 250 }, { 400, 350 }, { 500, 250 }, { 600, 350 } };
+
+static CGFloat benchRandom(CGFloat minVal, CGFloat maxVal)
+{
+	return minVal + (maxVal - minVal) * ((CGFloat)random() / (CGFloat)0x7FFFFFFF);
+}
+
+static NSColor* benchColour(void)
+{
+	return [NSColor colorWithCalibratedRed:benchRandom(0, 1)
+									 green:benchRandom(0, 1)
+									  blue:benchRandom(0, 1)
+									 alpha:1.0];
+}
+
+static DKDrawableObject* targetOfDrawing(DKDrawing* drawing, DKInteractionTarget target)
+{
+	NSArray* objects = [[drawing activeLayerOfClass:[DKObjectDrawingLayer class]] objects];
+
+	return [objects objectAtIndex:[objects count] - kDKInteractionTargetCount + target];
+}
+
+// adds a press at <from>, drags in even steps to <to> and releases there, one event every kDKInteractionBenchmarkEventInterval
+
+static void addDrag(DKEventRecording* recording, NSPoint from, NSPoint to)
+{
+	NSTimeInterval t = 0;
+	NSUInteger i;
+
+	[recording addMouseEventOfType:NSLeftMouseDown
+						   atPoint:from
+							  time:t
+					 modifierFlags:0
+						clickCount:1];
+
+	for (i = 1; i <= kDKInteractionBenchmarkDragSteps; ++i) {
+		CGFloat f = (CGFloat)i / kDKInteractionBenchmarkDragSteps;
+
+		t += kDKInteractionBenchmarkEventInterval;
+		[recording addMouseEventOfType:NSLeftMouseDragged
+							   atPoint:NSMakePoint(from.x + (to.x - from.x) * f, from.y + (to.y - from.y) * f)
+								  time:t
+						 modifierFlags:0
+							clickCount:1];
+	}
+
+	[recording addMouseEventOfType:NSLeftMouseUp
+						   atPoint:to
+							  time:t + kDKInteractionBenchmarkEventInterval
+					 modifierFlags:0
+						clickCount:1];
+}
+
+static void dispatchEvent(NSEvent* event, DKDrawingView* view)
+{
+	NSResponder* keyTarget = [view isTextBeingEdited] ? (NSResponder*)[view textEditingView] : (NSResponder*)view;
+
+	switch ([event type]) {
+	case NSLeftMouseDown:
+		[view mouseDown:event];
+		break;
+
+	case NSLeftMouseDragged:
+		[view mouseDragged:event];
+		break;
+
+	case NSLeftMouseUp:
+		[view mouseUp:event];
+		break;
+
+	case NSMouseMoved:
+		[view mouseMoved:event];
+		break;
+
+	case NSKeyDown:
+		[keyTarget keyDown:event];
+		break;
+
+	case NSKeyUp:
+		[keyTarget keyUp:event];
+		break;
+
+	default:
+		break;
+	}
+}
+
+static double percentile(NSArray* sorted, double p)
+{
+	// nearest rank
+
+	NSUInteger count = [sorted count];
+
+	if (count == 0)
+		return 0;
+
+	NSUInteger rank = (NSUInteger)ceil(p / 100.0 * count);
+
+	return [[sorted objectAtIndex:MIN(MAX(rank, 1U), count) - 1] doubleValue];
+}
+
+@implementation TestInteractionBenchmark
+
+- (void)testInteractionBenchmarks
+{
+	if (getenv("DK_RUN_INTERACTION_BENCHMARKS") == NULL) {
+		NSLog(@"skipping interaction benchmarks - set DK_RUN_INTERACTION_BENCHMARKS to run them");
+		return;
+	}
+
+	const char* objectsEnv = getenv("DK_INTERACTION_BENCHMARK_OBJECTS");
+	const char* recordingsPath = getenv("DK_INTERACTION_RECORDINGS");
+	const char* documentPath = getenv("DK_INTERACTION_DOCUMENT");
+	const char* outputPath = getenv("DK_BENCHMARK_OUTPUT");
+	const char* baselinePath = getenv("DK_BENCHMARK_BASELINE");
+	const char* toleranceEnv = getenv("DK_BENCHMARK_TOLERANCE");
+
+	mObjectCount = (objectsEnv && strtoul(objectsEnv, NULL, 10) > 0) ? strtoul(objectsEnv, NULL, 10) : kDKInteractionBenchmarkDefaultObjects;
+	mTolerance = (toleranceEnv && strtod(toleranceEnv, NULL) > 0) ? strtod(toleranceEnv, NULL) : kDKInteractionBenchmarkDefaultTolerance;
+
+	if (outputPath) {
+		NSString* path = [NSString stringWithUTF8String:outputPath];
+
+		if (![[NSFileManager defaultManager] fileExistsAtPath:path])
+			[[NSFileManager defaultManager] createFileAtPath:path
+													contents:nil
+												  attributes:nil];
+
+		mOutput = [[NSFileHandle fileHandleForWritingAtPath:path] retain];
+		[mOutput seekToEndOfFile];
+	}
+
+	// the baseline is earlier output - lines of JSON, optionally prefixed - of which only the interaction results are used
+
+	if (baselinePath) {
+		NSString* text = [NSString stringWithContentsOfFile:[NSString stringWithUTF8String:baselinePath]
+												   encoding:NSUTF8StringEncoding
+													  error:NULL];
+		NSEnumerator* iter = [[text componentsSeparatedByString:@"\n"] objectEnumerator];
+		NSString* line;
+
+		mBaseline = [[NSMutableDictionary alloc] init];
+
+		while ((line = [iter nextObject])) {
+			NSRange brace = [line rangeOfString:@"{"];
+
+			if (brace.location == NSNotFound)
+				continue;
+
+			NSDictionary* result = [NSJSONSerialization JSONObjectWithData:[[line substringFromIndex:brace.location] dataUsingEncoding:NSUTF8StringEncoding]
+																   options:0
+																	 error:NULL];
+			NSString* key = [result objectForKey:@"key"];
+
+			if (key && [result objectForKey:@"p95Ms"])
+				[mBaseline setObject:[result objectForKey:@"p95Ms"]
+							  forKey:key];
+		}
+	}
+
+	if (documentPath)
+		[[[self stressDrawing] drawingData] writeToFile:[NSString stringWithUTF8String:documentPath]
+											 atomically:YES];
+
+	NSUInteger scenario;
+
+	for (scenario = 0; scenario < kDKInteractionBenchmarkScenarioCount; ++scenario) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+		[self benchmarkRecording:nil
+						   named:sScenarioNames[scenario]
+						scenario:(DKInteractionBenchmarkScenario)scenario];
+		[pool drain];
+	}
+
+	// recordings are replayed in the order of their names, so that the output is in the same order every time
+
+	if (recordingsPath) {
+		NSString* folder = [NSString stringWithUTF8String:recordingsPath];
+		NSArray* names = [[[NSFileManager defaultManager] contentsOfDirectoryAtPath:folder
+																			  error:NULL] sortedArrayUsingSelector:@selector(compare:)];
+		NSEnumerator* iter = [names objectEnumerator];
+		NSString* name;
+
+		while ((name = [iter nextObject])) {
+			if (![[name pathExtension] isEqualToString:@"plist"])
+				continue;
+
+			NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+			DKEventRecording* recording = [DKEventRecording recordingWithContentsOfFile:[folder stringByAppendingPathComponent:name]];
+
+			STAssertNotNil(recording, @"%@ is not an event recording", name);
+
+			if (recording)
+				[self benchmarkRecording:recording
+								   named:[@"recorded/" stringByAppendingString:[name stringByDeletingPathExtension]]
+								scenario:kDKInteractionBenchmarkScenarioCount];
+			[pool drain];
+		}
+	}
+
+	[mOutput closeFile];
+	[mOutput release];
+	mOutput = nil;
+	[mBaseline release];
+	mBaseline = nil;
+}
+
+- (DKDrawing*)stressDrawing
+{
+	srandom(kDKInteractionBenchmarkSeed);
+
+	NSMutableArray* objects = [NSMutableArray arrayWithCapacity:mObjectCount + kDKInteractionTargetCount];
+	NSMutableArray* styles = [NSMutableArray array];
+	DKDrawableShape* shape;
+	NSUInteger i;
+
+	for (i = 0; i < 16; ++i)
+		[styles addObject:[DKStyle styleWithFillColour:benchColour()
+										  strokeColour:benchColour()
+										   strokeWidth:1.0]];
+
+	for (i = 0; i < mObjectCount; ++i) {
+		NSRect r = NSMakeRect(benchRandom(0, kDKInteractionBenchmarkCanvasSide - 40), benchRandom(0, kDKInteractionBenchmarkCanvasSide - 40), benchRandom(4, 40), benchRandom(4, 40));
+
+		if (NSIntersectsRect(r, sMarqueeStartArea))
+			continue;
+
+		shape = (i & 1) ? [DKDrawableShape drawableShapeWithOvalInRect:r] : [DKDrawableShape drawableShapeWithRect:r];
+		[shape setStyle:[styles objectAtIndex:i % 16]];
+		[objects addObject:shape];
+	}
+
+	// the targets, in the order of DKInteractionTarget
+
+	DKStyle* targetStyle = [DKStyle styleWithFillColour:[NSColor orangeColor]
+										   strokeColour:[NSColor blackColor]
+											strokeWidth:2.0];
+
+	shape = [DKDrawableShape drawableShapeWithRect:NSMakeRect(100, 100, 100, 80)];
+	[shape setStyle:targetStyle];
+	[objects addObject:shape];
+
+	shape = [DKDrawableShape drawableShapeWithOvalInRect:NSMakeRect(250, 450, 120, 90)];
+	[shape setStyle:targetStyle];
+	[objects addObject:shape];
+
+	NSBezierPath* zigzag = [NSBezierPath bezierPath];
+
+	[zigzag moveToPoint:sPathPoints[0]];
+
+	for (i = 1; i < sizeof(sPathPoints) / sizeof(NSPoint); ++i)
+		[zigzag lineToPoint:sPathPoints[i]];
+
+	[objects addObject:[DKDrawablePath drawablePathWithBezierPath:zigzag
+														withStyle:[DKStyle styleWithFillColour:nil
+																				  strokeColour:[NSColor blueColor]
+																				   strokeWidth:3.0]]];
+
+	[objects addObject:[DKTextShape textShapeWithString:@""
+												 inRect:NSMakeRect(700, 100, 260, 160)]];
+
+	DKDrawing* drawing = [[DKDrawing alloc] initWithSize:NSMakeSize(kDKInteractionBenchmarkCanvasSide, kDKInteractionBenchmarkCanvasSide)];
+
+	[drawing addLayer:[DKObjectDrawingLayer layerWithObjectsInArray:objects]
+		andActivateIt:YES];
+
+	return [drawing autorelease];
+}
+
+- (DKEventRecording*)recordingForScenario:(DKInteractionBenchmarkScenario)scenario drawing:(DKDrawing*)drawing
+{
+	DKEventRecording* recording = [[DKEventRecording alloc] init];
+	NSUInteger i;
+
+	[recording setToolName:kDKStandardSelectionToolName];
+
+	switch (scenario) {
+	default:
+	case kDKInteractionBenchmarkDrag: {
+		NSRect r = [(DKDrawableShape*)targetOfDrawing(drawing, kDKInteractionTargetShape) logicalBounds];
+
+		addDrag(recording, NSMakePoint(NSMidX(r), NSMidY(r)), NSMakePoint(NSMidX(r) + 500, NSMidY(r) + 400));
+	} break;
+
+	case kDKInteractionBenchmarkResize: {
+		NSPoint knob = [(DKDrawableShape*)targetOfDrawing(drawing, kDKInteractionTargetResizedShape) knobPoint:kDKDrawableShapeBottomRightHandle];
+
+		addDrag(recording, knob, NSMakePoint(knob.x + 300, knob.y + 200));
+	} break;
+
+	case kDKInteractionBenchmarkMarquee:
+		addDrag(recording, sMarqueeStart, NSMakePoint(900, 700));
+		break;
+
+	case kDKInteractionBenchmarkPathEdit:
+		addDrag(recording, sPathPoints[1], NSMakePoint(sPathPoints[1].x + 150, sPathPoints[1].y + 250));
+		break;
+
+	case kDKInteractionBenchmarkTyping: {
+		NSString* text = kDKInteractionBenchmarkTypedText;
+
+		for (i = 0; i < [text length]; ++i) {
+			NSString* c = [text substringWithRange:NSMakeRange(i, 1)];
+			NSTimeInterval t = i * kDKInteractionBenchmarkEventInterval * 4;
+
+			[recording addKeyEventOfType:NSKeyDown
+							  characters:c
+								 keyCode:0
+									time:t
+						   modifierFlags:0];
+			[recording addKeyEventOfType:NSKeyUp
+							  characters:c
+								 keyCode:0
+									time:t + kDKInteractionBenchmarkEventInterval
+						   modifierFlags:0];
+		}
+	} break;
+	}
+
+	return [recording autorelease];
+}
+
+- (void)benchmarkRecording:(DKEventRecording*)recording named:(NSString*)name scenario:(DKInteractionBenchmarkScenario)scenario
+{
+	DKDrawing* drawing = [self stressDrawing];
+	DKUndoManager* undo = [[DKUndoManager alloc] init];
+	NSRect frame = NSMakeRect(0, 0, kDKInteractionBenchmarkViewportWidth, kDKInteractionBenchmarkViewportHeight);
+	NSWindow* window = [[NSWindow alloc] initWithContentRect:frame
+												   styleMask:NSBorderlessWindowMask
+													 backing:NSBackingStoreBuffered
+													   defer:NO];
+	NSScrollView* scroller = [[NSScrollView alloc] initWithFrame:frame];
+	DKDrawingView* view = [[DKDrawingView alloc] initWithFrame:NSMakeRect(0, 0, kDKInteractionBenchmarkCanvasSide, kDKInteractionBenchmarkCanvasSide)];
+
+	[window setReleasedWhenClosed:NO];
+	[scroller setDocumentView:view];
+	[window setContentView:scroller];
+	[scroller release];
+
+	[drawing setUndoManager:undo];
+	[drawing addController:[view makeViewController]];
+	[window makeFirstResponder:view];
+	[view scrollPoint:NSZeroPoint];
+
+	if (recording == nil)
+		recording = [self recordingForScenario:scenario
+									   drawing:drawing];
+
+	if ([recording toolName])
+		[(DKToolController*)[view controller] setDrawingToolWithName:[recording toolName]];
+
+	// the state each scripted interaction starts from
+
+	DKObjectDrawingLayer* layer = [drawing activeLayerOfClass:[DKObjectDrawingLayer class]];
+
+	if (scenario == kDKInteractionBenchmarkResize)
+		[layer exchangeSelectionWithObjectsFromArray:[NSArray arrayWithObject:targetOfDrawing(drawing, kDKInteractionTargetResizedShape)]];
+	else if (scenario == kDKInteractionBenchmarkPathEdit)
+		[layer exchangeSelectionWithObjectsFromArray:[NSArray arrayWithObject:targetOfDrawing(drawing, kDKInteractionTargetPath)]];
+	else if (scenario == kDKInteractionBenchmarkTyping)
+		[(DKTextShape*)targetOfDrawing(drawing, kDKInteractionTargetText) startEditingInView:view];
+
+	// the first frame is drawn untimed, so that caches and lazily made objects don't count against the events
+
+	[drawing flushPendingDisplayUpdates];
+	[window displayIfNeeded];
+
+	NSUInteger i, count = [recording countOfEvents];
+	NSMutableArray* latencies = [NSMutableArray arrayWithCapacity:count];
+	NSTimeInterval replayStart = [NSDate timeIntervalSinceReferenceDate];
+	NSTimeInterval finished = 0, totalCost = 0, worst = 0;
+	NSUInteger framesMissed = 0;
+
+	for (i = 0; i < count; ++i) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		NSTimeInterval due = [recording timeOfEventAtIndex:i];
+		NSEvent* event = [recording eventAtIndex:i
+										  inView:view
+									   startTime:replayStart + due];
+		NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+
+		dispatchEvent(event, view);
+
+		[DKStyle postPendingChangeNotifications];
+		[DKDrawableObject updatePendingDependents];
+		[drawing flushPendingDisplayUpdates];
+		[window displayIfNeeded];
+		[window flushWindow];
+
+		// the event is taken to have happened at its recorded time, and to have waited for the one before it to finish
+
+		NSTimeInterval cost = [NSDate timeIntervalSinceReferenceDate] - start;
+		NSTimeInterval latency;
+
+		finished = MAX(finished, due) + cost;
+		latency = finished - due;
+		totalCost += cost;
+		worst = MAX(worst, latency);
+
+		if (latency > kDKInteractionBenchmarkFrameInterval)
+			framesMissed += (NSUInteger)ceil(latency / kDKInteractionBenchmarkFrameInterval) - 1;
+
+		[latencies addObject:[NSNumber numberWithDouble:latency * 1000.0]];
+		[pool drain];
+	}
+
+	if ([view isTextBeingEdited])
+		[view endTextEditing];
+
+	[window close];
+	[window release];
+	[view release];
+	[undo release];
+
+	NSArray* sorted = [latencies sortedArrayUsingSelector:@selector(compare:)];
+	double p95 = percentile(sorted, 95);
+	NSString* key = [NSString stringWithFormat:@"interaction/%@/%lu", name, (unsigned long)mObjectCount];
+	NSString* line = [NSString stringWithFormat:@"{\"key\":\"%@\",\"interaction\":\"%@\",\"objects\":%lu,\"events\":%lu,\"p50Ms\":%.3f,\"p95Ms\":%.3f,\"p99Ms\":%.3f,\"worstMs\":%.3f,\"meanCostMs\":%.3f,\"framesMissed\":%lu}",
+												key, name, (unsigned long)mObjectCount, (unsigned long)count, percentile(sorted, 50), p95, percentile(sorted, 99),
+												worst * 1000.0, count ? totalCost * 1000.0 / count : 0.0, (unsigned long)framesMissed];
+
+	printf("DKBENCH %s\n", [line UTF8String]);
+
+	[mOutput writeData:[[line stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
+
+	NSNumber* baseline = [mBaseline objectForKey:key];
+
+	if (baseline && [baseline doubleValue] > 0) {
+		STAssertTrue(p95 <= [baseline doubleValue] * (1.0 + mTolerance / 100.0),
+					 @"%@ has a p95 latency of %.3f ms, more than %.0f%% worse than the baseline %.3f ms", key, p95, mTolerance, [baseline doubleValue]);
+	}
+}
+
+@end
@@ -0,0 +1,56 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+
+@class DKDrawing;
+
+/// the synthetic drawings rendered by the benchmark
+
+typedef enum {
+	kDKRenderBenchmarkSimpleShapes = 0, // many small shapes with a plain fill and stroke
+	kDKRenderBenchmarkNestedGroups, // groups nested several levels deep
+	kDKRenderBenchmarkTextLabels, // shapes labelled with text adornments
+	kDKRenderBenchmarkHatchingAndPatterns, // shapes filled with hatching and image patterns
+	kDKRenderBenchmarkGradients, // shapes filled with linear and radial gradients
+	kDKRenderBenchmarkImages, // image shapes
+	kDKRenderBenchmarkDocumentCount
+} DKRenderBenchmarkDocument;
+
+/// the update areas each frame draws
+
+typedef enum {
+	kDKRenderBenchmarkFullFrame = 0, // the whole viewport
+	kDKRenderBenchmarkScrollStrip, // a strip along the bottom of a viewport that scrolls a strip each frame
+	kDKRenderBenchmarkDirtyRect, // a small rect somewhere in the viewport, as when one object changes
+	kDKRenderBenchmarkUpdateCount
+} DKRenderBenchmarkUpdate;
+
+/** @brief Benchmarks rendering of drawings that stress different parts of the renderer.
+
+ Benchmarks rendering of drawings that stress different parts of the renderer. Each synthetic drawing is rendered offscreen into a bitmap the size of a
+ typical window, at a range of scales and for each update pattern, using the same path the export renderer uses. For every combination the time per
+ frame, the net growth in heap allocations per frame and the peak resident memory are emitted as one line of JSON to stdout (prefixed with "DKBENCH ")
+ and, if DK_BENCHMARK_OUTPUT names a file, appended to it, in the same way as TestStorageBenchmark.
+
+ The benchmark only runs if the environment variable DK_RUN_RENDER_BENCHMARKS is set. DK_RENDER_BENCHMARK_FRAMES sets the frames per combination
+ (default 30). If DK_BENCHMARK_BASELINE names a file of results from an earlier run, any combination whose time per frame is more than
+ DK_BENCHMARK_TOLERANCE percent (default 20) slower than the baseline fails the test, so the benchmark can serve as a regression gate.
+ The drawings are generated from a fixed seed so runs are repeatable.
+*/
+@interface TestRenderBenchmark : SenTestCase {
+@private
+	NSFileHandle* mOutput;
+	NSMutableDictionary* mBaseline; // key -> ms per frame
+	CGFloat mTolerance;
+}
+
+- (void)testRenderBenchmarks;
+
+- (DKDrawing*)drawingForDocument:(DKRenderBenchmarkDocument)doc;
+- (void)benchmarkDrawing:(DKDrawing*)drawing document:(DKRenderBenchmarkDocument)doc scale:(CGFloat)scale update:(DKRenderBenchmarkUpdate)update frames:(NSUInteger)frames;
+
+@end
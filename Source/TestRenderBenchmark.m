@@ -0,0 +1,438 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestRenderBenchmark.h"
+#import "DKDrawing.h"
+#import "DKObjectDrawingLayer.h"
+#import "DKDrawableShape.h"
+#import "DKImageShape.h"
+#import "DKShapeGroup.h"
+#import "DKStyle.h"
+#import "DKFill.h"
+#import "DKStroke.h"
+#import "DKGradient.h"
+#import "DKHatching.h"
+#import "DKFillPattern.h"
+#import "DKTextAdornment.h"
+#include <malloc/malloc.h>
+#include <sys/resource.h>
+#include <tgmath.h>
+
+#define kDKRenderBenchmarkSeed 20160202
+#define kDKRenderBenchmarkDefaultFrames 30
+#define kDKRenderBenchmarkDefaultTolerance 20.0 // percent
+#define kDKRenderBenchmarkCanvasSide 4000.0
+#define kDKRenderBenchmarkViewportWidth 1024
+#define kDKRenderBenchmarkViewportHeight 768
+#define kDKRenderBenchmarkStripHeight 48.0 // pixels scrolled per frame
+#define kDKRenderBenchmarkDirtySize 64.0 // pixels
+
+static NSString* sDocumentNames[kDKRenderBenchmarkDocumentCount] = { @"simpleShapes", @"nestedGroups", @"textLabels", @"hatchingAndPatterns", @"gradients", @"images" };
+static NSString* sUpdateNames[kDKRenderBenchmarkUpdateCount] = { @"fullFrame", @"scrollStrip", @"dirtyRect" };
+
+static CGFloat benchRandom(CGFloat minVal, CGFloat maxVal)
+{
+	return minVal + (maxVal - minVal) * ((CGFloat)random() / (CGFloat)0x7FFFFFFF);
+}
+
+static NSColor* benchColour(void)
+{
+	return [NSColor colorWithCalibratedRed:benchRandom(0, 1)
+									 green:benchRandom(0, 1)
+									  blue:benchRandom(0, 1)
+									 alpha:1.0];
+}
+
+static NSRect benchRect(CGFloat minSize, CGFloat maxSize)
+{
+	return NSMakeRect(benchRandom(0, kDKRenderBenchmarkCanvasSide - maxSize), benchRandom(0, kDKRenderBenchmarkCanvasSide - maxSize), benchRandom(minSize, maxSize), benchRandom(minSize, maxSize));
+}
+
+static NSImage* benchImage(void)
+{
+	// a gradient with some shapes over it, so the image isn't trivially compressible
+
+	NSImage* image = [[NSImage alloc] initWithSize:NSMakeSize(256, 256)];
+	NSUInteger i;
+
+	[image lockFocus];
+
+	NSGradient* grad = [[NSGradient alloc] initWithStartingColor:benchColour()
+													 endingColor:benchColour()];
+	[grad drawInRect:NSMakeRect(0, 0, 256, 256)
+			   angle:45];
+	[grad release];
+
+	for (i = 0; i < 20; ++i) {
+		[benchColour() set];
+		[[NSBezierPath bezierPathWithOvalInRect:NSMakeRect(benchRandom(0, 200), benchRandom(0, 200), benchRandom(10, 56), benchRandom(10, 56))] fill];
+	}
+
+	[image unlockFocus];
+
+	return [image autorelease];
+}
+
+static void heapStatistics(size_t* blocks, size_t* bytes)
+{
+	malloc_statistics_t stats;
+
+	malloc_zone_statistics(NULL, &stats);
+
+	*blocks = stats.blocks_in_use;
+	*bytes = stats.size_in_use;
+}
+
+static long long peakResidentBytes(void)
+{
+	struct rusage usage;
+
+	getrusage(RUSAGE_SELF, &usage);
+	return (long long)usage.ru_maxrss; // bytes on OS X
+}
+
+@implementation TestRenderBenchmark
+
+- (void)testRenderBenchmarks
+{
+	if (getenv("DK_RUN_RENDER_BENCHMARKS") == NULL) {
+		NSLog(@"skipping render benchmarks - set DK_RUN_RENDER_BENCHMARKS to run them");
+		return;
+	}
+
+	NSUInteger frames = kDKRenderBenchmarkDefaultFrames;
+	const char* framesEnv = getenv("DK_RENDER_BENCHMARK_FRAMES");
+	const char* outputPath = getenv("DK_BENCHMARK_OUTPUT");
+	const char* baselinePath = getenv("DK_BENCHMARK_BASELINE");
+	const char* toleranceEnv = getenv("DK_BENCHMARK_TOLERANCE");
+
+	if (framesEnv && strtoul(framesEnv, NULL, 10) > 0)
+		frames = strtoul(framesEnv, NULL, 10);
+
+	mTolerance = (toleranceEnv && strtod(toleranceEnv, NULL) > 0) ? strtod(toleranceEnv, NULL) : kDKRenderBenchmarkDefaultTolerance;
+
+	if (outputPath) {
+		NSString* path = [NSString stringWithUTF8String:outputPath];
+
+		if (![[NSFileManager defaultManager] fileExistsAtPath:path])
+			[[NSFileManager defaultManager] createFileAtPath:path
+													contents:nil
+												  attributes:nil];
+
+		mOutput = [[NSFileHandle fileHandleForWritingAtPath:path] retain];
+		[mOutput seekToEndOfFile];
+	}
+
+	// the baseline is earlier output - lines of JSON, optionally prefixed - of which only the render results are used
+
+	if (baselinePath) {
+		NSString* text = [NSString stringWithContentsOfFile:[NSString stringWithUTF8String:baselinePath]
+												   encoding:NSUTF8StringEncoding
+													  error:NULL];
+		NSEnumerator* iter = [[text componentsSeparatedByString:@"\n"] objectEnumerator];
+		NSString* line;
+
+		mBaseline = [[NSMutableDictionary alloc] init];
+
+		while ((line = [iter nextObject])) {
+			NSRange brace = [line rangeOfString:@"{"];
+
+			if (brace.location == NSNotFound)
+				continue;
+
+			NSDictionary* result = [NSJSONSerialization JSONObjectWithData:[[line substringFromIndex:brace.location] dataUsingEncoding:NSUTF8StringEncoding]
+																   options:0
+																	 error:NULL];
+			NSString* key = [result objectForKey:@"key"];
+
+			if (key && [result objectForKey:@"msPerFrame"])
+				[mBaseline setObject:[result objectForKey:@"msPerFrame"]
+							  forKey:key];
+		}
+	}
+
+	CGFloat scales[] = { 0.25, 1.0, 4.0 };
+	NSUInteger doc, s, update;
+
+	for (doc = 0; doc < kDKRenderBenchmarkDocumentCount; ++doc) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+		DKDrawing* drawing = [self drawingForDocument:(DKRenderBenchmarkDocument)doc];
+
+		for (s = 0; s < sizeof(scales) / sizeof(CGFloat); ++s) {
+			for (update = 0; update < kDKRenderBenchmarkUpdateCount; ++update) {
+				NSAutoreleasePool* innerPool = [[NSAutoreleasePool alloc] init];
+
+				[self benchmarkDrawing:drawing
+							  document:(DKRenderBenchmarkDocument)doc
+								 scale:scales[s]
+								update:(DKRenderBenchmarkUpdate)update
+								frames:frames];
+				[innerPool drain];
+			}
+		}
+
+		[pool drain];
+	}
+
+	[mOutput closeFile];
+	[mOutput release];
+	mOutput = nil;
+	[mBaseline release];
+	mBaseline = nil;
+}
+
+- (DKDrawing*)drawingForDocument:(DKRenderBenchmarkDocument)doc
+{
+	srandom(kDKRenderBenchmarkSeed + (unsigned)doc);
+
+	NSMutableArray* objects = [NSMutableArray array];
+	NSMutableArray* styles = [NSMutableArray array];
+	DKStyle* style;
+	DKDrawableShape* shape;
+	NSUInteger i, k;
+
+	switch (doc) {
+	default:
+	case kDKRenderBenchmarkSimpleShapes:
+		for (k = 0; k < 16; ++k)
+			[styles addObject:[DKStyle styleWithFillColour:benchColour()
+											  strokeColour:benchColour()
+											   strokeWidth:1.0]];
+
+		for (i = 0; i < 20000; ++i) {
+			shape = (i & 1) ? [DKDrawableShape drawableShapeWithOvalInRect:benchRect(4, 40)] : [DKDrawableShape drawableShapeWithRect:benchRect(4, 40)];
+			[shape setStyle:[styles objectAtIndex:i % 16]];
+			[objects addObject:shape];
+		}
+		break;
+
+	case kDKRenderBenchmarkNestedGroups:
+		for (k = 0; k < 8; ++k)
+			[styles addObject:[DKStyle styleWithFillColour:benchColour()
+											  strokeColour:[NSColor blackColor]]];
+
+		for (i = 0; i < 200; ++i) {
+			// each level groups the level below with a few more shapes around it
+
+			NSRect area = benchRect(100, 300);
+			DKDrawableObject* inner = nil;
+			NSUInteger depth;
+
+			for (depth = 0; depth < 6; ++depth) {
+				NSMutableArray* members = [NSMutableArray array];
+
+				if (inner)
+					[members addObject:inner];
+
+				for (k = 0; k < 4; ++k) {
+					shape = [DKDrawableShape drawableShapeWithOvalInRect:NSMakeRect(benchRandom(NSMinX(area), NSMaxX(area) - 20), benchRandom(NSMinY(area), NSMaxY(area) - 20), 20, 20)];
+					[shape setStyle:[styles objectAtIndex:(i + depth + k) % 8]];
+					[members addObject:shape];
+				}
+
+				inner = [DKShapeGroup groupWithObjects:members];
+			}
+
+			[objects addObject:inner];
+		}
+		break;
+
+	case kDKRenderBenchmarkTextLabels:
+		for (k = 0; k < 8; ++k) {
+			style = [DKStyle styleWithFillColour:benchColour()
+									strokeColour:[NSColor blackColor]];
+			DKTextAdornment* label = [DKTextAdornment textAdornmentWithText:[NSString stringWithFormat:@"Label %lu with some longer text that wraps over a few lines", (unsigned long)k]];
+			[label setFontSize:9 + k];
+			[style addRenderer:label];
+			[styles addObject:style];
+		}
+
+		for (i = 0; i < 2000; ++i) {
+			shape = [DKDrawableShape drawableShapeWithRect:benchRect(60, 160)];
+			[shape setStyle:[styles objectAtIndex:i % 8]];
+			[objects addObject:shape];
+		}
+		break;
+
+	case kDKRenderBenchmarkHatchingAndPatterns: {
+		NSImage* tile = benchImage();
+
+		for (k = 0; k < 8; ++k) {
+			style = [DKStyle styleWithFillColour:nil
+									strokeColour:[NSColor blackColor]];
+
+			if (k & 1) {
+				DKFillPattern* pattern = [DKFillPattern fillPatternWithImage:tile];
+				[pattern setScale:0.1 + 0.05 * k];
+				[style addRenderer:pattern];
+			} else
+				[style addRenderer:[DKHatching hatchingWithLineWidth:0.5 + 0.25 * k
+															 spacing:3 + k
+															   angle:k * 0.4]];
+			[styles addObject:style];
+		}
+
+		for (i = 0; i < 2000; ++i) {
+			shape = [DKDrawableShape drawableShapeWithOvalInRect:benchRect(40, 200)];
+			[shape setStyle:[styles objectAtIndex:i % 8]];
+			[objects addObject:shape];
+		}
+	} break;
+
+	case kDKRenderBenchmarkGradients:
+		for (k = 0; k < 8; ++k) {
+			style = [DKStyle styleWithFillColour:nil
+									strokeColour:[NSColor darkGrayColor]];
+			[style addRenderer:[DKFill fillWithGradient:[DKGradient gradientWithStartingColor:benchColour()
+																				  endingColor:benchColour()
+																						 type:(k & 1) ? kDKGradientTypeRadial : kDKGradientTypeLinear
+																						angle:k * 45]]];
+			[styles addObject:style];
+		}
+
+		for (i = 0; i < 3000; ++i) {
+			shape = [DKDrawableShape drawableShapeWithRect:benchRect(20, 120)];
+			[shape setStyle:[styles objectAtIndex:i % 8]];
+			[objects addObject:shape];
+		}
+		break;
+
+	case kDKRenderBenchmarkImages: {
+		NSMutableArray* images = [NSMutableArray array];
+
+		for (k = 0; k < 8; ++k)
+			[images addObject:benchImage()];
+
+		for (i = 0; i < 500; ++i) {
+			DKImageShape* is = [[DKImageShape alloc] initWithImage:[images objectAtIndex:i % 8]];
+			NSRect r = benchRect(40, 256);
+
+			[is setLocation:NSMakePoint(NSMidX(r), NSMidY(r))];
+			[is setSize:r.size];
+			[objects addObject:is];
+			[is release];
+		}
+	} break;
+	}
+
+	DKDrawing* drawing = [[DKDrawing alloc] initWithSize:NSMakeSize(kDKRenderBenchmarkCanvasSide, kDKRenderBenchmarkCanvasSide)];
+
+	[drawing addLayer:[DKObjectDrawingLayer layerWithObjectsInArray:objects]
+		andActivateIt:YES];
+
+	return [drawing autorelease];
+}
+
+- (void)benchmarkDrawing:(DKDrawing*)drawing document:(DKRenderBenchmarkDocument)doc scale:(CGFloat)scale update:(DKRenderBenchmarkUpdate)update frames:(NSUInteger)frames
+{
+	srandom(kDKRenderBenchmarkSeed);
+
+	NSBitmapImageRep* rep = [[NSBitmapImageRep alloc] initWithBitmapDataPlanes:NULL
+																	pixelsWide:kDKRenderBenchmarkViewportWidth
+																	pixelsHigh:kDKRenderBenchmarkViewportHeight
+																 bitsPerSample:8
+															   samplesPerPixel:4
+																	  hasAlpha:YES
+																	  isPlanar:NO
+																colorSpaceName:NSCalibratedRGBColorSpace
+																   bytesPerRow:0
+																  bitsPerPixel:0];
+	NSGraphicsContext* bitmapContext = [NSGraphicsContext graphicsContextWithBitmapImageRep:rep];
+	NSGraphicsContext* context = [NSGraphicsContext graphicsContextWithGraphicsPort:[bitmapContext graphicsPort]
+																			flipped:YES];
+	NSSize viewSize = NSMakeSize(kDKRenderBenchmarkViewportWidth / scale, kDKRenderBenchmarkViewportHeight / scale);
+	NSPoint origin = NSMakePoint((kDKRenderBenchmarkCanvasSide - viewSize.width) * 0.5, (kDKRenderBenchmarkCanvasSide - viewSize.height) * 0.5);
+	NSTimeInterval start, total = 0;
+	size_t blocksBefore, bytesBefore, blocksAfter, bytesAfter;
+	NSUInteger frame;
+	NSRect updateRect;
+	NSPoint viewOrigin;
+
+	[NSGraphicsContext saveGraphicsState];
+	[NSGraphicsContext setCurrentContext:context];
+
+	// one frame first, so that caches and lazily made objects don't count against the timed frames
+
+	heapStatistics(&blocksBefore, &bytesBefore);
+
+	for (frame = 0; frame <= frames; ++frame) {
+		NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+		viewOrigin = origin;
+
+		switch (update) {
+		default:
+		case kDKRenderBenchmarkFullFrame:
+			updateRect = NSMakeRect(origin.x, origin.y, viewSize.width, viewSize.height);
+			break;
+
+		case kDKRenderBenchmarkScrollStrip: {
+			// the viewport moves down a strip each frame, so only the strip newly scrolled in is drawn
+
+			CGFloat strip = kDKRenderBenchmarkStripHeight / scale;
+
+			viewOrigin.y = fmod(origin.y + frame * strip, MAX(kDKRenderBenchmarkCanvasSide - viewSize.height, strip));
+			updateRect = NSMakeRect(origin.x, viewOrigin.y + viewSize.height - strip, viewSize.width, strip);
+		} break;
+
+		case kDKRenderBenchmarkDirtyRect: {
+			CGFloat side = kDKRenderBenchmarkDirtySize / scale;
+
+			updateRect = NSMakeRect(origin.x + benchRandom(0, viewSize.width - side), origin.y + benchRandom(0, viewSize.height - side), side, side);
+		} break;
+		}
+
+		NSAffineTransform* transform = [NSAffineTransform transform];
+
+		[transform translateXBy:0
+							yBy:kDKRenderBenchmarkViewportHeight];
+		[transform scaleXBy:scale
+						yBy:-scale];
+		[transform translateXBy:-viewOrigin.x
+							yBy:-viewOrigin.y];
+
+		start = [NSDate timeIntervalSinceReferenceDate];
+
+		[NSGraphicsContext saveGraphicsState];
+		[transform concat];
+		NSRectClip(updateRect);
+		[drawing drawContentInRect:updateRect
+						drawsPaper:YES];
+		[NSGraphicsContext restoreGraphicsState];
+		[context flushGraphics];
+
+		if (frame > 0)
+			total += [NSDate timeIntervalSinceReferenceDate] - start;
+		else
+			heapStatistics(&blocksBefore, &bytesBefore);
+
+		[pool drain];
+	}
+
+	heapStatistics(&blocksAfter, &bytesAfter);
+
+	[NSGraphicsContext restoreGraphicsState];
+	[rep release];
+
+	CGFloat msPerFrame = total * 1000.0 / (CGFloat)frames;
+	NSString* key = [NSString stringWithFormat:@"%@/%g/%@", sDocumentNames[doc], scale, sUpdateNames[update]];
+	NSString* line = [NSString stringWithFormat:@"{\"key\":\"%@\",\"document\":\"%@\",\"scale\":%g,\"update\":\"%@\",\"frames\":%lu,\"msPerFrame\":%.3f,\"netAllocationsPerFrame\":%.1f,\"netBytesPerFrame\":%.1f,\"peakResidentBytes\":%lld}",
+												key, sDocumentNames[doc], scale, sUpdateNames[update], (unsigned long)frames, msPerFrame,
+												((double)blocksAfter - (double)blocksBefore) / frames, ((double)bytesAfter - (double)bytesBefore) / frames, peakResidentBytes()];
+
+	printf("DKBENCH %s\n", [line UTF8String]);
+
+	[mOutput writeData:[[line stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
+
+	NSNumber* baseline = [mBaseline objectForKey:key];
+
+	if (baseline && [baseline doubleValue] > 0) {
+		STAssertTrue(msPerFrame <= [baseline doubleValue] * (1.0 + mTolerance / 100.0),
+					 @"%@ took %.3f ms per frame, more than %.0f%% slower than the baseline %.3f ms", key, msPerFrame, mTolerance, [baseline doubleValue]);
+	}
+}
+
+@end
@@ -0,0 +1,39 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import <SenTestingKit/SenTestingKit.h>
+
+/// synthetic object distributions used by the benchmark
+
+typedef enum {
+	kDKBenchmarkUniform = 0, // small objects spread evenly over the canvas
+	kDKBenchmarkClustered, // small objects grouped into a few dense clusters
+	kDKBenchmarkHugeAndTiny, // mostly tiny objects with a sprinkling of objects covering much of the canvas
+	kDKBenchmarkThinLines, // long, thin horizontal and vertical objects, such as walls or dimension lines
+	kDKBenchmarkDistributionCount
+} DKBenchmarkDistribution;
+
+/** @brief Benchmarks the object storage classes against one another.
+
+ Benchmarks the object storage classes against one another. For each storage class, a synthetic drawing is generated for each distribution at a range of
+ sizes, and the throughput of insertion, bulk loading, rect and point queries, bounds changes and reordering is measured. Each result is emitted as one
+ line of JSON to stdout (prefixed with "DKBENCH ") and, if DK_BENCHMARK_OUTPUT names a file, appended to it, so results can be compared between runs.
+
+ Because a full run takes a long time, the benchmark only runs if the environment variable DK_RUN_STORAGE_BENCHMARKS is set. DK_BENCHMARK_MAX_OBJECTS
+ limits the largest drawing size (default 1000000). The random sequence is seeded with a fixed value so runs are repeatable.
+*/
+@interface TestStorageBenchmark : SenTestCase {
+@private
+	NSFileHandle* mOutput;
+}
+
+- (void)testStorageBenchmarks;
+
+- (NSArray*)objectsWithDistribution:(DKBenchmarkDistribution)dist count:(NSUInteger)count canvasSize:(NSSize)canvasSize;
+- (void)benchmarkStorageClass:(Class)storageClass distribution:(DKBenchmarkDistribution)dist count:(NSUInteger)count;
+- (void)reportStorageClass:(Class)storageClass distribution:(DKBenchmarkDistribution)dist count:(NSUInteger)count operation:(NSString*)op iterations:(NSUInteger)iterations time:(NSTimeInterval)t;
+
+@end
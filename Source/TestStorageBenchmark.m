@@ -0,0 +1,326 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+#import "TestStorageBenchmark.h"
+#import "TestBSPStorage.h"
+#import "DKLinearObjectStorage.h"
+#import "DKBSPObjectStorage.h"
+#import "DKBSPDirectObjectStorage.h"
+#import "DKRTreeObjectStorage.h"
+#include <tgmath.h>
+
+#define kDKBenchmarkSeed 20160101
+#define kDKBenchmarkDefaultMaxObjects 1000000
+#define kDKBenchmarkMaxIterations 1000
+#define kDKBenchmarkMinIterations 10
+#define kDKBenchmarkQueryBudget 10000000 // approximate number of objects a linear query scan may visit per measurement
+
+static NSString* sDistributionNames[kDKBenchmarkDistributionCount] = { @"uniform", @"clustered", @"hugeAndTiny", @"thinLines" };
+
+static CGFloat benchRandom(CGFloat minVal, CGFloat maxVal)
+{
+	return minVal + (maxVal - minVal) * ((CGFloat)random() / (CGFloat)0x7FFFFFFF);
+}
+
+static NSUInteger benchRandomIndex(NSUInteger count)
+{
+	return (count > 0 ? (NSUInteger)random() % count : 0);
+}
+
+static NSSize canvasSizeForCount(NSUInteger count)
+{
+	// scale the canvas with the object count so that the density of the uniform distribution stays roughly constant
+
+	CGFloat side = MAX(2000.0, sqrt((CGFloat)count) * 40.0);
+	return NSMakeSize(side, side);
+}
+
+@implementation TestStorageBenchmark
+
+- (void)testStorageBenchmarks
+{
+	if (getenv("DK_RUN_STORAGE_BENCHMARKS") == NULL) {
+		NSLog(@"skipping storage benchmarks - set DK_RUN_STORAGE_BENCHMARKS to run them");
+		return;
+	}
+
+	NSUInteger maxObjects = kDKBenchmarkDefaultMaxObjects;
+	const char* maxEnv = getenv("DK_BENCHMARK_MAX_OBJECTS");
+	const char* outputPath = getenv("DK_BENCHMARK_OUTPUT");
+
+	if (maxEnv && strtoul(maxEnv, NULL, 10) > 0)
+		maxObjects = strtoul(maxEnv, NULL, 10);
+
+	if (outputPath) {
+		NSString* path = [NSString stringWithUTF8String:outputPath];
+
+		if (![[NSFileManager defaultManager] fileExistsAtPath:path])
+			[[NSFileManager defaultManager] createFileAtPath:path
+													contents:nil
+												  attributes:nil];
+
+		mOutput = [[NSFileHandle fileHandleForWritingAtPath:path] retain];
+		[mOutput seekToEndOfFile];
+	}
+
+	NSArray* classes = [NSArray arrayWithObjects:[DKLinearObjectStorage class], [DKBSPObjectStorage class], [DKBSPDirectObjectStorage class], [DKRTreeObjectStorage class], nil];
+	NSEnumerator* iter = [classes objectEnumerator];
+	Class storageClass;
+
+	while ((storageClass = [iter nextObject])) {
+		NSUInteger count, dist;
+
+		for (count = 1000; count <= maxObjects; count *= 10) {
+			for (dist = 0; dist < kDKBenchmarkDistributionCount; ++dist) {
+				NSAutoreleasePool* pool = [[NSAutoreleasePool alloc] init];
+
+				[self benchmarkStorageClass:storageClass
+							   distribution:(DKBenchmarkDistribution)dist
+									  count:count];
+				[pool drain];
+			}
+		}
+	}
+
+	[mOutput closeFile];
+	[mOutput release];
+	mOutput = nil;
+}
+
+- (NSArray*)objectsWithDistribution:(DKBenchmarkDistribution)dist count:(NSUInteger)count canvasSize:(NSSize)canvasSize
+{
+	NSMutableArray* objects = [NSMutableArray arrayWithCapacity:count];
+	CGFloat side = canvasSize.width;
+	NSPoint clusters[8];
+	NSUInteger i;
+
+	for (i = 0; i < 8; ++i)
+		clusters[i] = NSMakePoint(benchRandom(side * 0.1, side * 0.9), benchRandom(side * 0.1, side * 0.9));
+
+	for (i = 0; i < count; ++i) {
+		NSRect br;
+
+		switch (dist) {
+		default:
+		case kDKBenchmarkUniform:
+			br = NSMakeRect(benchRandom(0, side), benchRandom(0, side), benchRandom(2, 40), benchRandom(2, 40));
+			break;
+
+		case kDKBenchmarkClustered: {
+			// summing several uniform values approximates a normal distribution around the cluster centre
+
+			NSPoint c = clusters[i % 8];
+			CGFloat spread = side / 16.0;
+			CGFloat dx = (benchRandom(-1, 1) + benchRandom(-1, 1) + benchRandom(-1, 1)) * spread;
+			CGFloat dy = (benchRandom(-1, 1) + benchRandom(-1, 1) + benchRandom(-1, 1)) * spread;
+
+			br = NSMakeRect(c.x + dx, c.y + dy, benchRandom(2, 40), benchRandom(2, 40));
+		} break;
+
+		case kDKBenchmarkHugeAndTiny:
+			if ((i % 200) == 0)
+				br = NSMakeRect(benchRandom(0, side * 0.5), benchRandom(0, side * 0.5), benchRandom(side * 0.25, side), benchRandom(side * 0.25, side));
+			else
+				br = NSMakeRect(benchRandom(0, side), benchRandom(0, side), benchRandom(1, 8), benchRandom(1, 8));
+			break;
+
+		case kDKBenchmarkThinLines:
+			if (i & 1)
+				br = NSMakeRect(benchRandom(0, side * 0.5), benchRandom(0, side), benchRandom(side * 0.1, side * 0.5), benchRandom(1, 3));
+			else
+				br = NSMakeRect(benchRandom(0, side), benchRandom(0, side * 0.5), benchRandom(1, 3), benchRandom(side * 0.1, side * 0.5));
+			break;
+		}
+
+		testStorableObject* tso = [[testStorableObject alloc] init];
+		[tso setBounds:br];
+		[objects addObject:tso];
+		[tso release];
+	}
+
+	return objects;
+}
+
+- (void)benchmarkStorageClass:(Class)storageClass distribution:(DKBenchmarkDistribution)dist count:(NSUInteger)count
+{
+	srandom(kDKBenchmarkSeed + (unsigned)dist);
+
+	NSSize canvasSize = canvasSizeForCount(count);
+	NSArray* objects = [self objectsWithDistribution:dist
+											   count:count
+										  canvasSize:canvasSize];
+	NSArray* extras = [self objectsWithDistribution:dist
+											  count:MIN(count, (NSUInteger)kDKBenchmarkMaxIterations)
+										 canvasSize:canvasSize];
+	id<DKObjectStorage> storage = [[storageClass alloc] init];
+	NSUInteger i, k = [extras count];
+	NSUInteger queries = MAX(MIN(kDKBenchmarkQueryBudget / count, (NSUInteger)kDKBenchmarkMaxIterations), (NSUInteger)kDKBenchmarkMinIterations);
+	NSTimeInterval start;
+
+	[storage setCanvasSize:canvasSize];
+
+	// bulk load
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+	[storage setObjects:objects];
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"setObjects"
+				  iterations:count
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	// insertion and removal of individual objects at random indexes
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	for (i = 0; i < k; ++i)
+		[storage insertObject:[extras objectAtIndex:i]
+			 inObjectsAtIndex:benchRandomIndex([storage countOfObjects] + 1)];
+
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"insert"
+				  iterations:k
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	for (i = 0; i < k; ++i)
+		[storage removeObjectFromObjectsAtIndex:benchRandomIndex([storage countOfObjects])];
+
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"remove"
+				  iterations:k
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	// rect queries, sized to be typical of a window's update region
+
+	NSUInteger found = 0;
+	CGFloat qSize = MAX(canvasSize.width / 20.0, 200.0);
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	for (i = 0; i < queries; ++i) {
+		NSRect qr = NSMakeRect(benchRandom(0, canvasSize.width - qSize), benchRandom(0, canvasSize.height - qSize), qSize, qSize);
+		found += [[storage objectsIntersectingRect:qr
+											inView:nil
+										   options:0] count];
+	}
+
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"rectQuery"
+				  iterations:queries
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	for (i = 0; i < queries; ++i)
+		found += [[storage objectsContainingPoint:NSMakePoint(benchRandom(0, canvasSize.width), benchRandom(0, canvasSize.height))] count];
+
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"pointQuery"
+				  iterations:queries
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	// nearest-object queries, as when snapping or picking a connector's target
+
+	if ([storage respondsToSelector:@selector(objectsNearestPoint:count:options:)]) {
+		start = [NSDate timeIntervalSinceReferenceDate];
+
+		for (i = 0; i < queries; ++i)
+			found += [[storage objectsNearestPoint:NSMakePoint(benchRandom(0, canvasSize.width), benchRandom(0, canvasSize.height))
+											 count:8
+										   options:0] count];
+
+		[self reportStorageClass:storageClass
+					distribution:dist
+						   count:count
+					   operation:@"nearestQuery"
+					  iterations:queries
+							time:[NSDate timeIntervalSinceReferenceDate] - start];
+	}
+
+	// bounds changes - objects are nudged by a small amount as when dragged
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	for (i = 0; i < k; ++i) {
+		testStorableObject* tso = (testStorableObject*)[storage objectInObjectsAtIndex:benchRandomIndex([storage countOfObjects])];
+		[tso setBounds:NSOffsetRect([tso bounds], benchRandom(-10, 10), benchRandom(-10, 10))];
+	}
+
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"boundsChange"
+				  iterations:k
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	// reordering
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	for (i = 0; i < k; ++i) {
+		id<DKStorableObject> obj = [storage objectInObjectsAtIndex:benchRandomIndex([storage countOfObjects])];
+		[storage moveObject:obj
+					toIndex:benchRandomIndex([storage countOfObjects])];
+	}
+
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"reorder"
+				  iterations:k
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	// index lookups, as when a selection is reordered or its indexes are gathered for undo
+
+	NSMutableArray* selection = [NSMutableArray arrayWithCapacity:k];
+
+	for (i = 0; i < k; ++i)
+		[selection addObject:[storage objectInObjectsAtIndex:benchRandomIndex([storage countOfObjects])]];
+
+	start = [NSDate timeIntervalSinceReferenceDate];
+
+	for (i = 0; i < k; ++i) {
+		id<DKStorableObject> obj = [selection objectAtIndex:i];
+
+		if ([storage containsObject:obj])
+			found += ([storage indexOfObject:obj] != NSNotFound);
+	}
+
+	[self reportStorageClass:storageClass
+				distribution:dist
+					   count:count
+				   operation:@"indexLookup"
+				  iterations:k
+						time:[NSDate timeIntervalSinceReferenceDate] - start];
+
+	STAssertEquals([storage countOfObjects], count, @"benchmark left storage with the wrong number of objects");
+	STAssertTrue(found > 0, @"benchmark queries found nothing");
+
+	[storage release];
+}
+
+- (void)reportStorageClass:(Class)storageClass distribution:(DKBenchmarkDistribution)dist count:(NSUInteger)count operation:(NSString*)op iterations:(NSUInteger)iterations time:(NSTimeInterval)t
+{
+	NSString* line = [NSString stringWithFormat:@"{\"storage\":\"%@\",\"distribution\":\"%@\",\"objects\":%lu,\"operation\":\"%@\",\"iterations\":%lu,\"seconds\":%.6f,\"opsPerSecond\":%.1f}",
+												NSStringFromClass(storageClass), sDistributionNames[dist], (unsigned long)count, op, (unsigned long)iterations, t, (t > 0 ? iterations / t : 0.0)];
+
+	printf("DKBENCH %s\n", [line UTF8String]);
+
+	[mOutput writeData:[[line stringByAppendingString:@"\n"] dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+@end
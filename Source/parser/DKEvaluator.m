@@ -21,7 +21,13 @@
 #pragma mark -
 - (id)evaluateSymbol:(NSString*)symbol
 {
-	id sym = [mSymbolTable valueForKeyPath:symbol];
+	// nearly all symbols are plain keys, so the key path is only parsed if there might be one
+
+	id sym = [mSymbolTable objectForKey:symbol];
+
+	if (sym == nil && [symbol rangeOfString:@"."].location != NSNotFound)
+		sym = [mSymbolTable valueForKeyPath:symbol];
+
 	return (sym ? sym : symbol);
 }
 
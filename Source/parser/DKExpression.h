@@ -10,6 +10,8 @@
 @interface DKExpression : NSObject {
 	NSString* mType;
 	NSMutableArray* mValues;
+	BOOL mLiteralValueIsKnown;
+	BOOL mIsLiteralValue;
 }
 
 - (void)setType:(NSString*)aType;
@@ -17,6 +19,9 @@
 - (BOOL)isSequence;
 - (BOOL)isMethodCall;
 
+// the result is remembered until the expression's values are changed, so changes to the values of a contained
+// expression must be made before this is first asked for - as they are by the parser
+
 - (BOOL)isLiteralValue;
 - (NSInteger)argCount;
 
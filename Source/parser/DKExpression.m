@@ -43,15 +43,25 @@
 #pragma mark -
 - (BOOL)isLiteralValue
 {
-	NSEnumerator* curs = [mValues objectEnumerator];
-	id item;
+	// the evaluator asks this of every expression at every level, so it is worked out only once
+
+	if (!mLiteralValueIsKnown) {
+		NSEnumerator* curs = [mValues objectEnumerator];
+		id item;
+
+		mIsLiteralValue = YES;
 
-	while ((item = [curs nextObject])) {
-		if (![item isLiteralValue])
-			return NO;
+		while ((item = [curs nextObject])) {
+			if (![item isLiteralValue]) {
+				mIsLiteralValue = NO;
+				break;
+			}
+		}
+
+		mLiteralValueIsKnown = YES;
 	}
 
-	return YES;
+	return mIsLiteralValue;
 }
 
 - (NSInteger)argCount
@@ -101,12 +111,14 @@
 {
 	[mValues replaceObjectAtIndex:ndx
 					   withObject:obj];
+	mLiteralValueIsKnown = NO;
 }
 
 #pragma mark -
 - (void)addObject:(id)aValue
 {
 	[mValues addObject:aValue];
+	mLiteralValueIsKnown = NO;
 }
 
 - (void)addObject:(id)aValue forKey:(NSString*)key
@@ -116,6 +128,7 @@
 
 	[mValues addObject:pair];
 	[pair release];
+	mLiteralValueIsKnown = NO;
 }
 
 #pragma mark -
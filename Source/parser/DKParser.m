@@ -26,6 +26,40 @@ NSInteger dk_lex(id* val, YYLTYPE* yloc, void* reader)
 }
 #include "reader_g.m"
 
+static NSNumber* numberFromToken(const char* data, NSInteger len, BOOL isReal)
+{
+	char buf[64];
+	char* end;
+	NSInteger i;
+
+	if (len <= 0 || len >= (NSInteger)sizeof(buf))
+		return nil;
+
+	for (i = 0; i < len; ++i) {
+		char c = data[i];
+
+		if (!((c >= '0' && c <= '9') || c == '.' || c == '-' || c == '+' || c == 'e' || c == 'E'))
+			return nil;
+	}
+
+	memcpy(buf, data, len);
+	buf[len] = 0;
+
+	if (isReal) {
+		double value = strtod(buf, &end);
+
+		if (*end == 0)
+			return [NSNumber numberWithDouble:value];
+	} else {
+		long long value = strtoll(buf, &end, 10);
+
+		if (*end == 0)
+			return [NSNumber numberWithLongLong:value];
+	}
+
+	return nil;
+}
+
 @implementation DKParser
 #pragma mark As a DKParser
 - (void)registerFactoryClass:fClass forKey:(NSString*)key;
@@ -142,6 +176,14 @@ NSInteger dk_lex(id* val, YYLTYPE* yloc, void* reader)
 		break;
 	case TK_Real:
 	case TK_Integer: {
+		// plain numbers are converted directly, as the number formatter is slow. Anything else, such as a number with
+		// grouping separators, is left to the formatter
+
+		token = numberFromToken(scanr.data, scanr.len, scanr.token == TK_Real);
+
+		if (token != nil)
+			break;
+
 		NSString* stringValue, *error;
 		stringValue = [NSString stringWithCString:scanr.data
 										   length:scanr.len];
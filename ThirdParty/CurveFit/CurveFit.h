@@ -20,8 +20,18 @@ extern "C"
 
 // curve fit vector paths using bezier curve fitting:
 
-NSBezierPath*		curveFitPath(NSBezierPath* inPath, float epsilon);
-NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cornerAngleThreshold );
+NSBezierPath*		curveFitPath(NSBezierPath* inPath, CGFloat epsilon);
+NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, CGFloat epsilon, CGFloat cornerAngleThreshold );
+
+// curve fit points as they arrive, e.g. while drawing freehand. Finished segments are kept, and only the trailing ones
+// are refitted as each point is added, so the path is always fitted and there's no big pass to make at the end.
+
+typedef struct _CurveFitStream CurveFitStream;
+
+CurveFitStream*		curveFitStreamCreate( NSPoint startPoint, CGFloat epsilon );
+void				curveFitStreamAddPoint( CurveFitStream* stream, NSPoint p );
+NSBezierPath*		curveFitStreamPath( CurveFitStream* stream );
+void				curveFitStreamFree( CurveFitStream* stream );
 
 #ifdef __cplusplus
 }
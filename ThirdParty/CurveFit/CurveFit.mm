@@ -16,14 +16,13 @@
 
 
 
-NSBezierPath*			curveFitPath(NSBezierPath* inPath, float epsilon)
+static NSBezierPath*	curveFitPathWithScratch( NSBezierPath* inPath, CGFloat epsilon, Geom::BezierFitScratch& scratch )
 {
-	// given an input path in vector form (flattened), this converts it to the C++ data structure list of points and processes it via the
+	// given an input path in vector form (flattened), this copies its points into the scratch buffers and processes them via the
 	// curve fit method in the bezier-utils lib. It then converts the result back to NSBezierPath form. Note - the caller is responsible for passing
-	// a flattened path.
+	// a flattened path. The scratch buffers only grow, so a caller fitting many paths can pass the same one each time and avoid allocating.
 	
-	Geom::Point*	pd;
-	int				ec, i;
+	NSInteger		ec, i;
 	NSPoint			p[3];
 	NSBezierPath*	result = [NSBezierPath bezierPath];
 	
@@ -35,36 +34,30 @@ NSBezierPath*			curveFitPath(NSBezierPath* inPath, float epsilon)
 		return result;
 	}
 	
-	pd = (Geom::Point*) malloc( sizeof( Geom::Point ) * ec );
+	scratch.reserve((unsigned) ec );
 	
 	for( i = 0; i < ec; ++i )
 	{
 		[inPath elementAtIndex:i associatedPoints:p];
-		pd[i] = Geom::Point((Geom::Coord)p[0].x, (Geom::Coord)p[0].y);
+		scratch.x[i] = p[0].x;
+		scratch.y[i] = p[0].y;
 	}
 	
-	// converted, now try the curve fit. Note that we don't know how much space we need to store the result, and the code doesn't give
-	// us a way to find out, so we just create a big buffer and hope for the best.
+	// converted, now try the curve fit. The points are uniqued in place, and there can't be more segments than there are points,
+	// so the scratch segment buffer is always big enough.
 	
-	int				segments, maxSegments;
-	Geom::Point*	segBuffer;
-	
-	maxSegments = 256;
-	segBuffer = (Geom::Point*) malloc( sizeof( Geom::Point ) * maxSegments * 4 );
-	
-	// do the fitting:
-	
-	segments = bezier_fit_cubic_r( segBuffer, pd, ec, epsilon, maxSegments );
+	int segments = Geom::bezier_fit_cubic_soa( scratch.segments, scratch.x, scratch.y, (int) ec, epsilon, (unsigned) ec, scratch );
 	
 	if ( segments > 0 )
 	{
 		//NSLog(@"curve fit generated %d segments", segments );
 		
-		// we got a result, so convert it back to an NSBezierPath. The result is returned as quads of points (presumably this means that
-		// there is a lot of duplication).
+		// we got a result, so convert it back to an NSBezierPath. The result is returned as quads of points, the first of each
+		// being the same as the last of the one before.
 		
-		NSPoint temp[3];
-		int		segElement;
+		Geom::Point*	segBuffer = scratch.segments;
+		NSPoint			temp[3];
+		int				segElement;
 		
 		temp[0].x = segBuffer[0][Geom::X];
 		temp[0].y = segBuffer[0][Geom::Y];
@@ -85,16 +78,19 @@ NSBezierPath*			curveFitPath(NSBezierPath* inPath, float epsilon)
 		}
 	}
 	
-	// clean up
-	
-	free( pd );
-	free( segBuffer );
-	
 	return result;
 }
 
 
-NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cornerAngleThreshold )
+NSBezierPath*			curveFitPath(NSBezierPath* inPath, CGFloat epsilon)
+{
+	Geom::BezierFitScratch	scratch;
+	
+	return curveFitPathWithScratch( inPath, epsilon, scratch );
+}
+
+
+NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, CGFloat epsilon, CGFloat cornerAngleThreshold )
 {
 	// this curve fits a flattened path, but is much smarter about which parts of the path to curve fit and which to leave alone. It
 	// also properly deals with separate subpaths within the original path (holes).
@@ -109,7 +105,8 @@ NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cor
 	NSPoint					firstPoint = NSZeroPoint;
 	NSBezierPath*			result;
 	NSBezierPath*			temp;
-	float					angle;
+	CGFloat					angle;
+	Geom::BezierFitScratch	scratch;	// shared by all the subsections, so that they don't each allocate
 	
 	result = [NSBezierPath bezierPath];
 	[result setWindingRule:[inPath windingRule]];
@@ -129,7 +126,7 @@ NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cor
 					
 					if ([temp elementCount] > 1 )
 					{
-						[result appendBezierPathRemovingInitialMoveToPoint:curveFitPath( temp, epsilon )];
+						[result appendBezierPathRemovingInitialMoveToPoint:curveFitPathWithScratch( temp, epsilon, scratch )];
 						[temp removeAllPoints];
 					}
 					[temp moveToPoint:ap[0]];
@@ -168,7 +165,7 @@ NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cor
 						
 						if ([temp elementCount] > 1 )
 						{
-							[result appendBezierPathRemovingInitialMoveToPoint:curveFitPath( temp, epsilon )];
+							[result appendBezierPathRemovingInitialMoveToPoint:curveFitPathWithScratch( temp, epsilon, scratch )];
 						
 							// will now start a new temp path
 						
@@ -181,7 +178,7 @@ NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cor
 				case NSCurveToBezierPathElement:
 					if ([temp elementCount] > 1 )
 					{
-						[result appendBezierPathRemovingInitialMoveToPoint:curveFitPath( temp, epsilon )];
+						[result appendBezierPathRemovingInitialMoveToPoint:curveFitPathWithScratch( temp, epsilon, scratch )];
 						[temp removeAllPoints];
 					}
 					[result curveToPoint:ap[2] controlPoint1:ap[0] controlPoint2:ap[1]];
@@ -192,7 +189,7 @@ NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cor
 					if ([temp elementCount] > 1 )
 					{
 						[temp lineToPoint:firstPoint];
-						[result appendBezierPathRemovingInitialMoveToPoint:curveFitPath( temp, epsilon )];
+						[result appendBezierPathRemovingInitialMoveToPoint:curveFitPathWithScratch( temp, epsilon, scratch )];
 						[temp removeAllPoints];
 					}
 					[result closePath];
@@ -208,6 +205,94 @@ NSBezierPath*		smartCurveFitPath( NSBezierPath* inPath, float epsilon, float cor
 }
 
 
+#pragma mark -
+
+struct _CurveFitStream
+{
+	Geom::BezierStreamFitter*	fitter;
+	NSBezierPath*				committed;		// the fitter's committed segments, added to as they're committed
+	unsigned					committedCount;	// how many of them are in <committed>
+	NSPoint						lastPoint;
+};
+
+
+static void		appendSegments( NSBezierPath* path, Geom::Point const* seg, unsigned count )
+{
+	for( unsigned i = 0; i < count; ++i, seg += 4 )
+	{
+		[path curveToPoint:NSMakePoint( seg[3][Geom::X], seg[3][Geom::Y] )
+			 controlPoint1:NSMakePoint( seg[1][Geom::X], seg[1][Geom::Y] )
+			 controlPoint2:NSMakePoint( seg[2][Geom::X], seg[2][Geom::Y] )];
+	}
+}
+
+
+CurveFitStream*		curveFitStreamCreate( NSPoint startPoint, CGFloat epsilon )
+{
+	CurveFitStream* stream = new CurveFitStream;
+	
+	stream->fitter = new Geom::BezierStreamFitter( Geom::Point( startPoint.x, startPoint.y ), epsilon );
+	stream->committed = [[NSBezierPath alloc] init];
+	[stream->committed moveToPoint:startPoint];
+	stream->committedCount = 0;
+	stream->lastPoint = startPoint;
+	
+	return stream;
+}
+
+
+void				curveFitStreamAddPoint( CurveFitStream* stream, NSPoint p )
+{
+	if( stream == NULL )
+		return;
+	
+	if( stream->fitter->add_point( Geom::Point( p.x, p.y )))
+	{
+		stream->lastPoint = p;
+		
+		// pick up any segments that were committed by adding the point. Those already appended never change.
+		
+		unsigned count = stream->fitter->committed_count();
+		
+		if( count > stream->committedCount )
+		{
+			appendSegments( stream->committed, stream->fitter->committed() + stream->committedCount * 4, count - stream->committedCount );
+			stream->committedCount = count;
+		}
+	}
+}
+
+
+NSBezierPath*		curveFitStreamPath( CurveFitStream* stream )
+{
+	// returns the committed segments followed by the current fit of the trailing points. If the trailing points couldn't be fitted yet,
+	// a straight line to the last point stands in for them.
+	
+	if( stream == NULL )
+		return nil;
+	
+	NSBezierPath* result = [[stream->committed copy] autorelease];
+	
+	if( stream->fitter->trailing_count() > 0 )
+		appendSegments( result, stream->fitter->trailing(), stream->fitter->trailing_count());
+	else if( !NSEqualPoints( [result currentPoint], stream->lastPoint ))
+		[result lineToPoint:stream->lastPoint];
+	
+	return result;
+}
+
+
+void				curveFitStreamFree( CurveFitStream* stream )
+{
+	if( stream == NULL )
+		return;
+	
+	[stream->committed release];
+	delete stream->fitter;
+	delete stream;
+}
+
+
 #endif /* defined(qUseCurveFit) */
 
 
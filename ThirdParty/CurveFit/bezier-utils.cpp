@@ -55,6 +55,7 @@
 
 #include "isnan.h"
 #include <assert.h>
+#include <string.h>
 
 namespace Geom{
 
@@ -995,6 +996,679 @@ compute_hook(Point const &a, Point const &b, double const u, BezierCurve const b
      */
 }
 
+
+/*
+ * Structure-of-arrays fitting.
+ *
+ * This is the same algorithm as bezier_fit_cubic_r(), but the data points are held as separate x
+ * and y arrays, and each step is written as simple loops over those arrays that the compiler can
+ * vectorize.  All the working storage comes from a BezierFitScratch, and the recursive calls work
+ * on sub-ranges of the same buffers, so nothing is allocated during the fit.
+ */
+
+/* A cubic in power form, x(t) = ((ax t + bx) t + cx) t + dx, which is cheaper to evaluate than the
+   Bernstein form. */
+struct SoaCubic {
+    double ax, bx, cx, dx;
+    double ay, by, cy, dy;
+};
+
+static inline void
+soa_cubic_from_bezier(SoaCubic &c, Point const b[4])
+{
+    c.dx = b[0][X];
+    c.cx = 3.0 * (b[1][X] - b[0][X]);
+    c.bx = 3.0 * (b[2][X] - 2.0 * b[1][X] + b[0][X]);
+    c.ax = b[3][X] - 3.0 * b[2][X] + 3.0 * b[1][X] - b[0][X];
+    c.dy = b[0][Y];
+    c.cy = 3.0 * (b[1][Y] - b[0][Y]);
+    c.by = 3.0 * (b[2][Y] - 2.0 * b[1][Y] + b[0][Y]);
+    c.ay = b[3][Y] - 3.0 * b[2][Y] + 3.0 * b[1][Y] - b[0][Y];
+}
+
+BezierFitScratch::BezierFitScratch()
+    : x(NULL), y(NULL), u(NULL), cx(NULL), cy(NULL), w(NULL), segments(NULL), capacity(0)
+{
+}
+
+BezierFitScratch::~BezierFitScratch()
+{
+    delete[] x;
+    delete[] y;
+    delete[] u;
+    delete[] cx;
+    delete[] cy;
+    delete[] w;
+    delete[] segments;
+}
+
+void
+BezierFitScratch::reserve(unsigned const len)
+{
+    if ( len <= capacity ) {
+        return;
+    }
+
+    unsigned newCapacity = ( capacity < 256 ? 256 : capacity );
+    while ( newCapacity < len ) {
+        newCapacity *= 2;
+    }
+
+    /* The data points are copied across, as a caller may be filling them in a bit at a time. */
+    double *nx = new double[newCapacity];
+    double *ny = new double[newCapacity];
+    if ( capacity > 0 ) {
+        memcpy(nx, x, capacity * sizeof(double));
+        memcpy(ny, y, capacity * sizeof(double));
+    }
+
+    delete[] x;
+    delete[] y;
+    delete[] u;
+    delete[] cx;
+    delete[] cy;
+    delete[] w;
+    delete[] segments;
+
+    x = nx;
+    y = ny;
+    u = new double[newCapacity];
+    cx = new double[newCapacity];
+    cy = new double[newCapacity];
+    w = new double[newCapacity];
+    segments = new Point[newCapacity * 4];
+    capacity = newCapacity;
+}
+
+/* Distance travelled along the data points, scaled to run from 0 to 1.  Returns the total length. */
+static double
+soa_chord_length_parameterize(double const x[], double const y[], double u[], unsigned const len)
+{
+    u[0] = 0.0;
+    Geom_VECTORIZE
+    for (unsigned i = 1; i < len; i++) {
+        double const dx = x[i] - x[i - 1];
+        double const dy = y[i] - y[i - 1];
+        u[i] = sqrt(dx * dx + dy * dy);
+    }
+
+    for (unsigned i = 1; i < len; i++) {
+        u[i] += u[i - 1];
+    }
+
+    double const tot_len = u[len - 1];
+    if ( tot_len == 0.0 ) {
+        return 0.0;
+    }
+
+    if (isFinite(tot_len)) {
+        double const scale = 1.0 / tot_len;
+        Geom_VECTORIZE
+        for (unsigned i = 1; i < len; ++i) {
+            u[i] *= scale;
+        }
+    } else {
+        for (unsigned i = 1; i < len; ++i) {
+            u[i] = i / (double) ( len - 1 );
+        }
+    }
+    u[len - 1] = 1.0;
+
+    return tot_len;
+}
+
+static Point
+soa_left_tangent(double const x[], double const y[], unsigned const len, double const tolerance_sq)
+{
+    for (unsigned i = 1;;) {
+        Point const t(x[i] - x[0], y[i] - y[0]);
+        double const distsq = dot(t, t);
+        if ( tolerance_sq < distsq ) {
+            return unit_vector(t);
+        }
+        ++i;
+        if (i == len) {
+            return ( distsq == 0
+                     ? unit_vector(Point(x[1] - x[0], y[1] - y[0]))
+                     : unit_vector(t) );
+        }
+    }
+}
+
+static Point
+soa_right_tangent(double const x[], double const y[], unsigned const len, double const tolerance_sq)
+{
+    unsigned const last = len - 1;
+    for (unsigned i = last - 1;; i--) {
+        Point const t(x[i] - x[last], y[i] - y[last]);
+        double const distsq = dot(t, t);
+        if ( tolerance_sq < distsq ) {
+            return unit_vector(t);
+        }
+        if (i == 0) {
+            return ( distsq == 0
+                     ? unit_vector(Point(x[last - 1] - x[last], y[last - 1] - y[last]))
+                     : unit_vector(t) );
+        }
+    }
+}
+
+static Point
+soa_center_tangent(double const x[], double const y[], unsigned const center)
+{
+    Point ret;
+    if ( x[center + 1] == x[center - 1] && y[center + 1] == y[center - 1] ) {
+        ret = rot90(Point(x[center] - x[center - 1], y[center] - y[center - 1]));
+    } else {
+        ret = Point(x[center - 1] - x[center + 1], y[center - 1] - y[center + 1]);
+    }
+    ret.normalize();
+    return ret;
+}
+
+/* As estimate_lengths().  The sums over the points are collected per basis function, and only
+   combined with the tangents at the end. */
+static void
+soa_estimate_lengths(Point bezier[], double const x[], double const y[], double const u[],
+                     unsigned const len, Point const &tHat1, Point const &tHat2)
+{
+    bezier[0] = Point(x[0], y[0]);
+    bezier[3] = Point(x[len - 1], y[len - 1]);
+
+    double const x0 = x[0], y0 = y[0], x3 = x[len - 1], y3 = y[len - 1];
+    double s11 = 0.0, s12 = 0.0, s22 = 0.0;
+    double s1x = 0.0, s1y = 0.0, s2x = 0.0, s2y = 0.0;
+
+    Geom_VECTORIZE
+    for (unsigned i = 0; i < len; i++) {
+        double const ui = u[i];
+        double const b0 = B0(ui);
+        double const b1 = B1(ui);
+        double const b2 = B2(ui);
+        double const b3 = B3(ui);
+        double const sx = x[i] - ( b0 + b1 ) * x0 - ( b2 + b3 ) * x3;
+        double const sy = y[i] - ( b0 + b1 ) * y0 - ( b2 + b3 ) * y3;
+
+        s11 += b1 * b1;
+        s12 += b1 * b2;
+        s22 += b2 * b2;
+        s1x += b1 * sx;
+        s1y += b1 * sy;
+        s2x += b2 * sx;
+        s2y += b2 * sy;
+    }
+
+    double C[2][2];
+    double X[2];
+
+    C[0][0] = s11 * dot(tHat1, tHat1);
+    C[0][1] = C[1][0] = s12 * dot(tHat1, tHat2);
+    C[1][1] = s22 * dot(tHat2, tHat2);
+    X[0] = tHat1[0] * s1x + tHat1[1] * s1y;
+    X[1] = tHat2[0] * s2x + tHat2[1] * s2y;
+
+    double alpha_l, alpha_r;
+    double const det_C0_C1 = C[0][0] * C[1][1] - C[1][0] * C[0][1];
+    if ( det_C0_C1 != 0 ) {
+        double const det_C0_X  = C[0][0] * X[1]    - C[0][1] * X[0];
+        double const det_X_C1  = X[0]    * C[1][1] - X[1]    * C[0][1];
+        alpha_l = det_X_C1 / det_C0_C1;
+        alpha_r = det_C0_X / det_C0_C1;
+    } else {
+        double const c0 = C[0][0] + C[0][1];
+        if (c0 != 0) {
+            alpha_l = alpha_r = X[0] / c0;
+        } else {
+            double const c1 = C[1][0] + C[1][1];
+            if (c1 != 0) {
+                alpha_l = alpha_r = X[1] / c1;
+            } else {
+                alpha_l = alpha_r = 0.;
+            }
+        }
+    }
+
+    if ( alpha_l < 1.0e-6 ||
+         alpha_r < 1.0e-6   )
+    {
+        alpha_l = alpha_r = ( L2( bezier[3] - bezier[0] ) / 3.0 );
+    }
+
+    bezier[1] = alpha_l * tHat1 + bezier[0];
+    bezier[2] = alpha_r * tHat2 + bezier[3];
+}
+
+/* As estimate_bi() for the first control point. */
+static void
+soa_estimate_b1(Point bezier[4], double const x[], double const y[], double const u[], unsigned const len)
+{
+    double const x0 = bezier[0][X], y0 = bezier[0][Y];
+    double const x2 = bezier[2][X], y2 = bezier[2][Y];
+    double const x3 = bezier[3][X], y3 = bezier[3][Y];
+    double numx = 0., numy = 0., den = 0.;
+
+    Geom_VECTORIZE
+    for (unsigned i = 0; i < len; ++i) {
+        double const ui = u[i];
+        double const b0 = B0(ui);
+        double const b1 = B1(ui);
+        double const b2 = B2(ui);
+        double const b3 = B3(ui);
+
+        numx += b1 * ( b0 * x0 + b2 * x2 + b3 * x3 - x[i] );
+        numy += b1 * ( b0 * y0 + b2 * y2 + b3 * y3 - y[i] );
+        den -= b1 * b1;
+    }
+
+    if (den != 0.) {
+        bezier[1] = Point(numx / den, numy / den);
+    } else {
+        bezier[1] = ( 2 * bezier[0] + bezier[3] ) / 3.;
+    }
+}
+
+static void
+soa_generate_bezier(Point bezier[], double const x[], double const y[], double const u[], unsigned const len,
+                    Point const &tHat1, Point const &tHat2, double const tolerance_sq)
+{
+    bool const est1 = is_zero(tHat1);
+    bool const est2 = is_zero(tHat2);
+    Point est_tHat1( est1
+                     ? soa_left_tangent(x, y, len, tolerance_sq)
+                     : tHat1 );
+    Point est_tHat2( est2
+                     ? soa_right_tangent(x, y, len, tolerance_sq)
+                     : tHat2 );
+    soa_estimate_lengths(bezier, x, y, u, len, est_tHat1, est_tHat2);
+    if (est1) {
+        soa_estimate_b1(bezier, x, y, u, len);
+        if (bezier[1] != bezier[0]) {
+            est_tHat1 = unit_vector(bezier[1] - bezier[0]);
+        }
+        soa_estimate_lengths(bezier, x, y, u, len, est_tHat1, est_tHat2);
+    }
+}
+
+/* As reparameterize().  The derivative curves are worked out once for the whole curve rather than
+   once per point.  A first pass takes one Newton-Raphson step for every point, and a second makes
+   sure that no point has been moved further from the curve, backing off where it has. */
+static void
+soa_reparameterize(double const x[], double const y[], double u[], double w[], unsigned const len,
+                   Point const bezier[4])
+{
+    SoaCubic c;
+    soa_cubic_from_bezier(c, bezier);
+
+    unsigned const last = len - 1;
+
+    Geom_VECTORIZE
+    for (unsigned i = 1; i < last; i++) {
+        double const t = u[i];
+        double const qx = ( ( c.ax * t + c.bx ) * t + c.cx ) * t + c.dx;
+        double const qy = ( ( c.ay * t + c.by ) * t + c.cy ) * t + c.dy;
+        double const q1x = ( 3.0 * c.ax * t + 2.0 * c.bx ) * t + c.cx;
+        double const q1y = ( 3.0 * c.ay * t + 2.0 * c.by ) * t + c.cy;
+        double const q2x = 6.0 * c.ax * t + 2.0 * c.bx;
+        double const q2y = 6.0 * c.ay * t + 2.0 * c.by;
+        double const dx = qx - x[i];
+        double const dy = qy - y[i];
+        double const numerator = dx * q1x + dy * q1y;
+        double const denominator = q1x * q1x + q1y * q1y + dx * q2x + dy * q2y;
+
+        double improved_u = ( denominator > 0. ? t - numerator / denominator
+                              : numerator > 0. ? t * .98 - .01
+                              : numerator < 0. ? .031 + t * .98
+                              : t );
+
+        improved_u = ( improved_u < 0.0 ? 0.0 : improved_u > 1.0 ? 1.0 : improved_u );
+        w[i] = ( improved_u == improved_u ? improved_u : t );
+    }
+
+    for (unsigned i = 1; i < last; i++) {
+        double const t = u[i];
+        double improved_u = w[i];
+        double const px = x[i], py = y[i];
+        double ex = ( ( c.ax * t + c.bx ) * t + c.cx ) * t + c.dx - px;
+        double ey = ( ( c.ay * t + c.by ) * t + c.cy ) * t + c.dy - py;
+        double const diff_lensq = ex * ex + ey * ey;
+
+        for (double proportion = .125; ; proportion += .125) {
+            ex = ( ( c.ax * improved_u + c.bx ) * improved_u + c.cx ) * improved_u + c.dx - px;
+            ey = ( ( c.ay * improved_u + c.by ) * improved_u + c.cy ) * improved_u + c.dy - py;
+            if ( ex * ex + ey * ey > diff_lensq ) {
+                if ( proportion > 1.0 ) {
+                    improved_u = t;
+                    break;
+                }
+                improved_u = ( ( 1 - proportion ) * improved_u  +
+                               proportion         * t            );
+            } else {
+                break;
+            }
+        }
+        u[i] = improved_u;
+    }
+}
+
+/* As compute_max_error_ratio(). */
+static double
+soa_compute_max_error_ratio(double const x[], double const y[], double const u[],
+                            double cx[], double cy[], double w[], unsigned const len,
+                            Point const bezier[4], double const tolerance, unsigned *const splitPoint)
+{
+    SoaCubic c;
+    soa_cubic_from_bezier(c, bezier);
+
+    unsigned const last = len - 1;
+
+    /* The points on the curve at each parameter value... */
+    cx[0] = bezier[0][X];
+    cy[0] = bezier[0][Y];
+    Geom_VECTORIZE
+    for (unsigned i = 1; i <= last; i++) {
+        double const t = u[i];
+        cx[i] = ( ( c.ax * t + c.bx ) * t + c.cx ) * t + c.dx;
+        cy[i] = ( ( c.ay * t + c.by ) * t + c.cy ) * t + c.dy;
+    }
+
+    /* ...their distances from the data points... */
+    double maxDistsq = 0.0;
+    for (unsigned i = 1; i <= last; i++) {
+        double const dx = cx[i] - x[i];
+        double const dy = cy[i] - y[i];
+        double const distsq = dx * dx + dy * dy;
+        if ( distsq > maxDistsq ) {
+            maxDistsq = distsq;
+            *splitPoint = i;
+        }
+    }
+
+    /* ...and the hook ratio between each pair, as compute_hook(). */
+    Geom_VECTORIZE
+    for (unsigned i = 1; i <= last; i++) {
+        double const t = .5 * ( u[i - 1] + u[i] );
+        double const px = ( ( c.ax * t + c.bx ) * t + c.cx ) * t + c.dx;
+        double const py = ( ( c.ay * t + c.by ) * t + c.cy ) * t + c.dy;
+        double const dx = .5 * ( cx[i - 1] + cx[i] ) - px;
+        double const dy = .5 * ( cy[i - 1] + cy[i] ) - py;
+        double const dist = sqrt(dx * dx + dy * dy);
+        double const ax = cx[i] - cx[i - 1];
+        double const ay = cy[i] - cy[i - 1];
+        double const allowed = sqrt(ax * ax + ay * ay) + tolerance;
+        w[i] = ( dist < tolerance ? 0.0 : dist / allowed );
+    }
+
+    double max_hook_ratio = 0.0;
+    unsigned snap_end = 0;
+    for (unsigned i = 1; i <= last; i++) {
+        if ( max_hook_ratio < w[i] ) {
+            max_hook_ratio = w[i];
+            snap_end = i;
+        }
+    }
+
+    double const dist_ratio = sqrt(maxDistsq) / tolerance;
+    if (max_hook_ratio <= dist_ratio) {
+        return dist_ratio;
+    }
+
+    *splitPoint = snap_end - 1;
+    return -max_hook_ratio;
+}
+
+/* As bezier_fit_cubic_full().  The arrays all start at the first point of the range being fitted,
+   which is point \a base of the whole.  If \a splits isn't NULL, it receives where each segment but
+   the last ends, as an index into the whole. */
+static int
+soa_fit_cubic_full(Point bezier[], BezierFitSplit splits[], unsigned const base,
+                   double const x[], double const y[], double u[],
+                   double cx[], double cy[], double w[], unsigned const len,
+                   Point const &tHat1, Point const &tHat2,
+                   double const error, unsigned const max_beziers)
+{
+    int const maxIterations = 12;
+
+    if ( len < 2 ) return 0;
+
+    if ( len == 2 ) {
+        bezier[0] = Point(x[0], y[0]);
+        bezier[3] = Point(x[1], y[1]);
+        double const dist = ( L2( bezier[3] - bezier[0] ) / 3.0 );
+        if (isNaN(dist)) {
+            bezier[1] = bezier[0];
+            bezier[2] = bezier[3];
+        } else {
+            bezier[1] = ( is_zero(tHat1)
+                          ? ( 2 * bezier[0] + bezier[3] ) / 3.
+                          : bezier[0] + dist * tHat1 );
+            bezier[2] = ( is_zero(tHat2)
+                          ? ( bezier[0] + 2 * bezier[3] ) / 3.
+                          : bezier[3] + dist * tHat2 );
+        }
+        return 1;
+    }
+
+    if ( soa_chord_length_parameterize(x, y, u, len) == 0.0 ) {
+        return 0;
+    }
+
+    unsigned splitPoint = 0;
+    double const tolerance = sqrt(error + 1e-9);
+
+    soa_generate_bezier(bezier, x, y, u, len, tHat1, tHat2, error);
+    soa_reparameterize(x, y, u, w, len, bezier);
+
+    double maxErrorRatio = soa_compute_max_error_ratio(x, y, u, cx, cy, w, len, bezier, tolerance, &splitPoint);
+
+    if ( fabs(maxErrorRatio) <= 1.0 ) {
+        return 1;
+    }
+
+    if ( 0.0 <= maxErrorRatio && maxErrorRatio <= 3.0 ) {
+        for (int i = 0; i < maxIterations; i++) {
+            soa_generate_bezier(bezier, x, y, u, len, tHat1, tHat2, error);
+            soa_reparameterize(x, y, u, w, len, bezier);
+            maxErrorRatio = soa_compute_max_error_ratio(x, y, u, cx, cy, w, len, bezier, tolerance, &splitPoint);
+            if ( fabs(maxErrorRatio) <= 1.0 ) {
+                return 1;
+            }
+        }
+    }
+
+    bool const is_corner = (maxErrorRatio < 0);
+
+    if (is_corner) {
+        if (splitPoint == 0) {
+            if (is_zero(tHat1)) {
+                ++splitPoint;
+            } else {
+                return soa_fit_cubic_full(bezier, splits, base, x, y, u, cx, cy, w, len, unconstrained_tangent, tHat2,
+                                          error, max_beziers);
+            }
+        } else if (splitPoint == len - 1) {
+            if (is_zero(tHat2)) {
+                --splitPoint;
+            } else {
+                return soa_fit_cubic_full(bezier, splits, base, x, y, u, cx, cy, w, len, tHat1, unconstrained_tangent,
+                                          error, max_beziers);
+            }
+        }
+    }
+
+    if ( max_beziers <= 1 ) {
+        return -1;
+    }
+
+    Point recTHat2, recTHat1;
+    if (is_corner) {
+        if(!(0 < splitPoint && splitPoint < len - 1))
+            return -1;
+        recTHat1 = recTHat2 = unconstrained_tangent;
+    } else {
+        recTHat2 = soa_center_tangent(x, y, splitPoint);
+        recTHat1 = -recTHat2;
+    }
+
+    /* The two halves share the split point, and the first is finished with before the second
+       overwrites its parameter value. */
+    int const nsegs1 = soa_fit_cubic_full(bezier, splits, base, x, y, u, cx, cy, w, splitPoint + 1,
+                                          tHat1, recTHat2, error, max_beziers - 1);
+    if ( nsegs1 < 0 ) {
+        return -1;
+    }
+
+    if ( splits != NULL ) {
+        splits[nsegs1 - 1].index = base + splitPoint;
+        splits[nsegs1 - 1].tangent = recTHat1;
+    }
+
+    int const nsegs2 = soa_fit_cubic_full(bezier + nsegs1 * 4, ( splits == NULL ? NULL : splits + nsegs1 ),
+                                          base + splitPoint, x + splitPoint, y + splitPoint, u + splitPoint,
+                                          cx + splitPoint, cy + splitPoint, w + splitPoint, len - splitPoint,
+                                          recTHat1, tHat2, error, max_beziers - nsegs1);
+    if ( nsegs2 < 0 ) {
+        return -1;
+    }
+
+    return nsegs1 + nsegs2;
+}
+
+/**
+ * Fit a multi-segment Bezier curve to a set of digitized points held as separate x and y arrays,
+ * with weedout of identical points and NaNs, using the working storage in \a scratch.
+ *
+ * \a xs and \a ys may be scratch.x and scratch.y, in which case the points are uniqued in place,
+ * and \a bezier may be scratch.segments once scratch.reserve(len) has been called.
+ *
+ * \param max_beziers Maximum number of generated segments
+ * \param bezier Result array, must be large enough for n. segments * 4 elements.
+ *
+ * \return Number of segments generated, or -1 on error.
+ */
+int
+bezier_fit_cubic_soa(Point bezier[], double const xs[], double const ys[], int const len,
+                     double const error, unsigned const max_beziers, BezierFitScratch &scratch)
+{
+    if(bezier == NULL ||
+       xs == NULL ||
+       ys == NULL ||
+       len <= 0 ||
+       max_beziers < 1 ||
+       max_beziers >= (1ul << (31 - 2 - 1 - 3)) ||
+       !(error >= 0.0))
+        return -1;
+
+    scratch.reserve(len);
+
+    /* Copy without NaNs or adjacent duplicates.  The destination never gets ahead of the source,
+       so this works in place. */
+    double *const x = scratch.x;
+    double *const y = scratch.y;
+    unsigned si = 0, di = 0;
+
+    while ( si < unsigned(len) && ( isNaN(xs[si]) || isNaN(ys[si]) ) ) {
+        ++si;
+    }
+    if ( si == unsigned(len) ) {
+        return 0;
+    }
+    x[0] = xs[si];
+    y[0] = ys[si];
+    for (++si; si < unsigned(len); ++si) {
+        double const px = xs[si];
+        double const py = ys[si];
+        if ( ( px != x[di] || py != y[di] ) && !isNaN(px) && !isNaN(py) ) {
+            ++di;
+            x[di] = px;
+            y[di] = py;
+        }
+    }
+
+    unsigned const uniqued_len = di + 1;
+    if ( uniqued_len < 2 ) {
+        return 0;
+    }
+
+    return soa_fit_cubic_full(bezier, NULL, 0, x, y, scratch.u, scratch.cx, scratch.cy, scratch.w, uniqued_len,
+                              unconstrained_tangent, unconstrained_tangent, error, max_beziers);
+}
+
+
+BezierStreamFitter::BezierStreamFitter(Point const &start, double const error, unsigned const max_window)
+    : _error(error), _max_window(max_window < 8 ? 8 : max_window), _tHat1(unconstrained_tangent),
+      _trailing_count(0)
+{
+    _x.push_back(start[X]);
+    _y.push_back(start[Y]);
+}
+
+bool
+BezierStreamFitter::add_point(Point const &p)
+{
+    if ( isNaN(p[X]) || isNaN(p[Y]) || ( p[X] == _x.back() && p[Y] == _y.back() ) ) {
+        return false;
+    }
+
+    _x.push_back(p[X]);
+    _y.push_back(p[Y]);
+    refit();
+    return true;
+}
+
+void
+BezierStreamFitter::refit()
+{
+    unsigned const len = unsigned(_x.size());
+
+    _scratch.reserve(len);
+    if ( _trailing.size() < len * 4 ) {
+        _trailing.resize(len * 4);
+        _splits.resize(len);
+    }
+
+    int const segs = soa_fit_cubic_full(&_trailing[0], &_splits[0], 0, &_x[0], &_y[0],
+                                        _scratch.u, _scratch.cx, _scratch.cy, _scratch.w, len,
+                                        _tHat1, unconstrained_tangent, _error, len);
+    if ( segs < 0 ) {
+        /* Keep the previous fit - it's only a preview until it's committed. */
+        return;
+    }
+
+    _trailing_count = unsigned(segs);
+
+    if ( _trailing_count > 1 ) {
+        commit(_trailing_count - 1);
+    } else if ( _trailing_count == 1 && len >= _max_window ) {
+        commit(1);
+    }
+}
+
+void
+BezierStreamFitter::commit(unsigned const segments)
+{
+    _committed.insert(_committed.end(), _trailing.begin(), _trailing.begin() + segments * 4);
+
+    /* The window now starts where the last committed segment ends. */
+    unsigned start;
+    if ( segments < _trailing_count ) {
+        start = _splits[segments - 1].index;
+        _tHat1 = _splits[segments - 1].tangent;
+    } else {
+        start = unsigned(_x.size()) - 1;
+        Point const *last = &_trailing[segments * 4 - 4];
+        _tHat1 = ( last[3] != last[2] ? unit_vector(last[3] - last[2]) : unconstrained_tangent );
+    }
+
+    _x.erase(_x.begin(), _x.begin() + start);
+    _y.erase(_y.begin(), _y.begin() + start);
+
+    _trailing_count -= segments;
+    if ( _trailing_count > 0 ) {
+        std::copy(_trailing.begin() + segments * 4, _trailing.begin() + ( segments + _trailing_count ) * 4,
+                  _trailing.begin());
+    }
+}
+
 }
 
 /*
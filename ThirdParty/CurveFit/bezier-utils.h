@@ -39,6 +39,7 @@
  */
 
 #include "point.h"
+#include <vector>
 
 namespace Geom{
 
@@ -54,6 +55,78 @@ int bezier_fit_cubic_full(Point bezier[], int split_points[], Point const data[]
                               Point const &tHat1, Point const &tHat2,
                               double error, unsigned max_beziers);
 
+/* Reusable working storage for bezier_fit_cubic_soa().  The points are held as separate x and y
+   arrays so that the per-point loops can be vectorized, and the buffers only ever grow, so that
+   fitting one stroke after another doesn't allocate. */
+class BezierFitScratch {
+public:
+    BezierFitScratch();
+    ~BezierFitScratch();
+
+    /* Makes room for len points, and for the most segments that len points can be fitted with. */
+    void reserve(unsigned len);
+
+    double *x;          /* data points */
+    double *y;
+    double *u;          /* parameter values of the data points */
+    double *cx;         /* points on the fitted curve at those parameter values */
+    double *cy;
+    double *w;          /* per-point work */
+    Point *segments;    /* result, 4 points per segment */
+    unsigned capacity;
+
+private:
+    BezierFitScratch(BezierFitScratch const &);
+    BezierFitScratch &operator=(BezierFitScratch const &);
+};
+
+int bezier_fit_cubic_soa(Point bezier[], double const xs[], double const ys[], int len,
+                         double error, unsigned max_beziers, BezierFitScratch &scratch);
+
+/* Where one fitted segment ends and the next begins: the index of the data point, and the unit
+   tangent that the next segment starts with, which is zero at a corner. */
+struct BezierFitSplit {
+    unsigned index;
+    Point tangent;
+};
+
+/* Fits a curve to points as they arrive, such as from a mouse drag.  Only a trailing window of points
+   is refitted each time one is added.  Once the fit of the window needs more than one segment, all but
+   the last are finished with and committed, and the window starts again from the last of them, keeping
+   its tangent so that the curve stays smooth across the join.  The window is also committed when it
+   reaches max_window points, so that a very smooth stroke doesn't make each refit slower than the last. */
+class BezierStreamFitter {
+public:
+    BezierStreamFitter(Point const &start, double error, unsigned max_window = 400);
+
+    /* Returns false if the point was ignored because it's the same as the last one, or NaN. */
+    bool add_point(Point const &p);
+
+    /* The committed segments, 4 points each.  These never change once committed. */
+    Point const *committed() const { return _committed.empty() ? NULL : &_committed[0]; }
+    unsigned committed_count() const { return unsigned(_committed.size() / 4); }
+
+    /* The segments fitted to the trailing window, which follow on from the committed ones and
+       may change as more points are added. */
+    Point const *trailing() const { return _trailing_count > 0 ? &_trailing[0] : NULL; }
+    unsigned trailing_count() const { return _trailing_count; }
+
+private:
+    void refit();
+    void commit(unsigned segments);
+
+    double _error;
+    unsigned _max_window;
+    std::vector<double> _x;       /* the trailing window */
+    std::vector<double> _y;
+    Point _tHat1;                 /* tangent that the window's curve must start with */
+    std::vector<Point> _committed;
+    std::vector<Point> _trailing;
+    unsigned _trailing_count;
+    std::vector<BezierFitSplit> _splits;
+    BezierFitScratch _scratch;
+};
+
 Point darray_left_tangent(Point const d[], unsigned const len);
 Point darray_left_tangent(Point const d[], unsigned const len, double const tolerance_sq);
 Point darray_right_tangent(Point const d[], unsigned const length, double const tolerance_sq);
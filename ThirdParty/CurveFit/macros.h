@@ -50,6 +50,21 @@
 
 #define Geom_DF_TEST_CLOSE(a,b,e) (fabs ((a) - (b)) <= (e))
 
+/* Asks the compiler to vectorize the loop that follows; the geometry kernels are written so that it can. */
+#if defined(__clang__)
+# define Geom_VECTORIZE _Pragma("clang loop vectorize(enable) interleave(enable)")
+#else
+# define Geom_VECTORIZE
+#endif
+
+/* Checks that a compound transform operator agrees with the general matrix product.  Only in debug builds: in
+   release builds it would double the cost of every compound. */
+#ifdef NDEBUG
+# define Geom_ASSERT_CLOSE(a,b) ((void)0)
+#else
+# define Geom_ASSERT_CLOSE(a,b) assert_close((a), (b))
+#endif
+
 // Todo: move these into matrix.h
 #define Geom_MATRIX_DF_TEST_TRANSFORM_CLOSE(a,b,e) (Geom_DF_TEST_CLOSE ((*(a))[0], (*(b))[0], e) && \
 				        Geom_DF_TEST_CLOSE ((*(a))[1], (*(b))[1], e) && \
@@ -32,6 +32,7 @@
  */
 
 #include <cmath>
+#include <cstring>
 
 const double Geom_EPSILON = 1e-18; // taken from libnr.  Probably sqrt(MIN_FLOAT).
 
@@ -42,10 +43,10 @@ const double Geom_EPSILON = 1e-18; // taken from libnr.  Probably sqrt(MIN_FLOAT
 template <class T> inline int sgn(const T& x) {return (x < 0 ? -1 : (x > 0 ? 1 : 0) );}
 
 /** Square function - sqr(x) is equivalent to x * x. */
-template <class T> inline int sqr(const T& x) {return x * x;}
+template <class T> inline T sqr(const T& x) {return x * x;}
 
 /** Cube function - cube(x) is equivalent to x * x * x. */
-template <class T> inline int cube(const T& x) {return x * x * x;}
+template <class T> inline T cube(const T& x) {return x * x * x;}
 
 /** Between function - returns true if a number x is within a range. The values delimiting the
  *  range, as well as the number must have the same type.
@@ -59,9 +60,10 @@ template <class T> inline const T& between (const T& min, const T& max, const T&
  */
 inline float invSqrt (float x){
    float xhalf = 0.5f*x;
-   int i = *(int*)&x;
+   int i;
+   std::memcpy(&i, &x, sizeof(i)); // rather than casting pointers, which breaks strict aliasing
    i = 0x5f3759df - (i>>1);
-   x = *(float*)&i;
+   std::memcpy(&x, &i, sizeof(x));
    x = x*(1.5f - xhalf*x*x);
    return x;
 }
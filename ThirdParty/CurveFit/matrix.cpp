@@ -13,6 +13,9 @@
  * This code is in public domain
  */
 
+#include <cstdio>
+#include <cstdlib>
+
 #include "matrix.h"
 #include "point.h"
 #include "transforms.h"
@@ -52,35 +52,27 @@ class Matrix {
     //TODO: I'd prefer it default to identity matrix - Botty
     explicit Matrix() { }
 
-    Matrix(Matrix const &m) {
-        for(int i = 0; i < 6; i++) {
-            _c[i] = m[i];
-        }
-    }
-
     Matrix(Coord c0, Coord c1, Coord c2, Coord c3, Coord c4, Coord c5) {
         _c[0] = c0; _c[1] = c1;
         _c[2] = c2; _c[3] = c3;
         _c[4] = c4; _c[5] = c5;
     }
 
-    Matrix &operator=(Matrix const &m) {
-        for(int i = 0; i < 6; i++)
-            _c[i] = m._c[i];
-        return *this;
-    }
-
     explicit Matrix(Scale const &sm) {
-        _c[0] = sm[X];
-        _c[3] = sm[Y];
+        _c[0] = sm[X]; _c[1] = 0;
+        _c[2] = 0;     _c[3] = sm[Y];
+        _c[4] = 0;     _c[5] = 0;
     }
 
     explicit Matrix(Rotate const &r) {
         set_x_axis(r.vec);
         set_y_axis(r.vec.cw());
+        _c[4] = _c[5] = 0;
     }
 
     explicit Matrix(Translate const &tm) {
+        _c[0] = 1; _c[1] = 0;
+        _c[2] = 0; _c[3] = 1;
         set_translation(tm.offset);
     }
 
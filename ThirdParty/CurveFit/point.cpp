@@ -142,11 +142,32 @@ Point abs(Point const &b)
 }
 
 Point operator*(Point const &v, Matrix const &m) {
-    Point ret;
-    for(int i = 0; i < 2; i++) {
-        ret[i] = v[X] * m[i] + v[Y] * m[i + 2] + m[i + 4];
+    return Point(v[X] * m[0] + v[Y] * m[2] + m[4],
+                 v[X] * m[1] + v[Y] * m[3] + m[5]);
+}
+
+void transform_points(Point const *src, Point *dst, unsigned count, Matrix const &m) {
+    // the matrix is copied to locals so the compiler knows that writing dst can't change it
+    Coord const m0 = m[0], m1 = m[1], m2 = m[2], m3 = m[3], m4 = m[4], m5 = m[5];
+
+    Geom_VECTORIZE
+    for (unsigned i = 0; i < count; ++i) {
+        Coord const x = src[i][X];
+        Coord const y = src[i][Y];
+        dst[i] = Point(x * m0 + y * m2 + m4, x * m1 + y * m3 + m5);
+    }
+}
+
+void transform_coords(Coord const *xs, Coord const *ys, Coord *outXs, Coord *outYs, unsigned count, Matrix const &m) {
+    Coord const m0 = m[0], m1 = m[1], m2 = m[2], m3 = m[3], m4 = m[4], m5 = m[5];
+
+    Geom_VECTORIZE
+    for (unsigned i = 0; i < count; ++i) {
+        Coord const x = xs[i];
+        Coord const y = ys[i];
+        outXs[i] = x * m0 + y * m2 + m4;
+        outYs[i] = x * m1 + y * m3 + m5;
     }
-    return ret;
 }
 
 Point operator/(Point const &p, Matrix const &m) { return p * m.inverse(); }
@@ -18,6 +18,8 @@ enum Dim2 { X=0, Y=1 };
 class Matrix;
 
 /// Cartesian point.
+/// Copying is left to the compiler so that Point stays trivially copyable: arrays of them can be moved with memcpy,
+/// and the componentwise operators below are straight-line code the vectorizer can pack into one 2-lane operation.
 class Point {
     Coord _pt[2];
 
@@ -30,19 +32,6 @@ class Point {
         _pt[Y] = y;
     }
 
-    inline Point(Point const &p) {
-        for (unsigned i = 0; i < 2; ++i) {
-            _pt[i] = p._pt[i];
-        }
-    }
-
-    inline Point &operator=(Point const &p) {
-        for (unsigned i = 0; i < 2; ++i) {
-            _pt[i] = p._pt[i];
-        }
-        return *this;
-    }
-
     inline Coord operator[](unsigned i) const {
         return _pt[i];
     }
@@ -88,30 +77,26 @@ class Point {
     void normalize();
 
     inline Point &operator+=(Point const &o) {
-        for ( unsigned i = 0 ; i < 2 ; ++i ) {
-            _pt[i] += o._pt[i];
-        }
+        _pt[X] += o._pt[X];
+        _pt[Y] += o._pt[Y];
         return *this;
     }
   
     inline Point &operator-=(Point const &o) {
-        for ( unsigned i = 0 ; i < 2 ; ++i ) {
-            _pt[i] -= o._pt[i];
-        }
+        _pt[X] -= o._pt[X];
+        _pt[Y] -= o._pt[Y];
         return *this;
     }
   
     inline Point &operator/=(double const s) {
-        for ( unsigned i = 0 ; i < 2 ; ++i ) {
-            _pt[i] /= s;
-        }
+        _pt[X] /= s;
+        _pt[Y] /= s;
         return *this;
     }
 
     inline Point &operator*=(double const s) {
-        for ( unsigned i = 0 ; i < 2 ; ++i ) {
-            _pt[i] *= s;
-        }
+        _pt[X] *= s;
+        _pt[Y] *= s;
         return *this;
     }
 
@@ -133,15 +118,11 @@ inline std::ostream &operator<< (std::ostream &out_file, const Geom::Point &in_p
 
 
 inline Point operator+(Point const &a, Point const &b) {
-    Point ret(a);
-    ret += b;
-    return ret;
+    return Point(a[X] + b[X], a[Y] + b[Y]);
 }
 
 inline Point operator-(Point const &a, Point const &b) {
-    Point ret(a);
-    ret -= b;
-    return ret;
+    return Point(a[X] - b[X], a[Y] - b[Y]);
 }
 
 /** This is a rotation (sort of). */
@@ -152,37 +133,23 @@ inline Point operator^(Point const &a, Point const &b) {
 }
 
 inline Point operator-(Point const &a) {
-    Point ret;
-    for(unsigned i = 0; i < 2; i++) {
-        ret[i] = -a[i];
-    }
-    return ret;
+    return Point(-a[X], -a[Y]);
 }
 
 inline Point operator*(double const s, Point const &p) {
-    Point ret(p);
-    ret *= s;
-    return ret;
+    return Point(s * p[X], s * p[Y]);
 }
 
 inline Point operator*(Point const &p, double const s) {
-    Point ret(p);
-    ret *= s;
-    return ret;
+    return Point(p[X] * s, p[Y] * s);
 }
 
 inline Point operator/(Point const &p, double const s) {
-    Point ret(p);
-    ret /= s;
-    return ret;
+    return Point(p[X] / s, p[Y] / s);
 }
 
 inline Point operator/(double const s, Point const &p) {
-    Point ret;
-    for(int i = 0; i < 2; i++) {
-        ret[i] = s / p[i];
-    }
-    return ret;
+    return Point(s / p[X], s / p[Y]);
 }
 
 inline bool operator==(Point const &a, Point const &b)
@@ -238,11 +205,7 @@ Point unit_vector(Point const &a);
 
 /** compute the dot product (inner product) between the vectors a and b. */
 inline Coord dot(Point const &a, Point const &b) {
-    Coord ret = 0;
-    for ( int i = 0 ; i < 2 ; i++ ) {
-        ret += a[i] * b[i];
-    }
-    return ret;
+    return a[X] * b[X] + a[Y] * b[Y];
 }
 
 /** compute the euclidean distance between points a and b.  XXX: hypot safer/faster? */
@@ -260,6 +223,13 @@ Point operator*(Point const &v, Matrix const &m);
 
 Point operator/(Point const &p, Matrix const &m);
 
+/** Transforms \a count points from \a src into \a dst, which may be the same array.  Cheaper than applying the
+ *  matrix to each point in turn: the matrix is read once, and the loop has no calls for the vectorizer to stop at. */
+void transform_points(Point const *src, Point *dst, unsigned count, Matrix const &m);
+
+/** As transform_points, for points held as separate x and y arrays, as the curve fitter holds them. */
+void transform_coords(Coord const *xs, Coord const *ys, Coord *outXs, Coord *outYs, unsigned count, Matrix const &m);
+
 } /* namespace Geom */
 
 #endif /* !SEEN_Geom_POINT_H */
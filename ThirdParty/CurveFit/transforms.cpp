@@ -12,7 +12,7 @@ Matrix operator*(Scale const &s, Translate const &t) {
     Matrix ret(s);
     ret.set_translation(t.offset);
 
-    assert_close( ret, Matrix(s) * t );
+    Geom_ASSERT_CLOSE( ret, Matrix(s) * t );
     return ret;
 }
 
@@ -26,7 +26,7 @@ Matrix operator*(Scale const &s, Matrix const &m) {
     ret[2] *= s[Y];
     ret[3] *= s[Y];
 
-    assert_close( ret, Matrix(s) * m );
+    Geom_ASSERT_CLOSE( ret, Matrix(s) * m );
     return ret;
 }
 
@@ -52,7 +52,7 @@ Matrix operator*(Translate const &t, Scale const &s) {
     ret[4] = t[X] * s[X];
     ret[5] = t[Y] * s[Y];
 
-    assert_close( ret, Matrix(t) * Matrix(s) );
+    Geom_ASSERT_CLOSE( ret, Matrix(t) * Matrix(s) );
     return ret;
 }
 
@@ -63,7 +63,7 @@ Matrix operator*(Translate const &t, Rotate const &r) {
     Matrix ret(r);
     ret.set_translation(t.offset * ret);
 
-    assert_close( ret, Matrix(t) * Matrix(r) );
+    Geom_ASSERT_CLOSE( ret, Matrix(t) * Matrix(r) );
     return ret;
 }
 
@@ -78,7 +78,7 @@ Matrix operator*(Matrix const &m, Scale const &s) {
     ret[2] *= s[X]; ret[3] *= s[Y];
     ret[4] *= s[X]; ret[5] *= s[Y];
 
-    assert_close( ret, m * Matrix(s) );
+    Geom_ASSERT_CLOSE( ret, m * Matrix(s) );
     return ret;
 }
 
@@ -89,7 +89,7 @@ Matrix operator/(Matrix const &m, Scale const &s) {
     ret[2] /= s[X]; ret[3] /= s[Y];
     ret[4] /= s[X]; ret[5] /= s[Y];
 
-    assert_close( ret, m * Matrix(s.inverse()) );
+    Geom_ASSERT_CLOSE( ret, m * Matrix(s.inverse()) );
     return ret;
 }
 
@@ -104,21 +104,18 @@ Matrix operator*(Matrix const &m, Translate const &t) {
     ret[4] += t[X];
     ret[5] += t[Y];
 
-    assert_close( ret, m * Matrix(t) );
+    Geom_ASSERT_CLOSE( ret, m * Matrix(t) );
     return ret;
 }
 
 /** Multiplies two matrices together, effectively combining their transformations.*/
 Matrix operator*(Matrix const &m0, Matrix const &m1) {
-    Matrix ret;
-    for(int a = 0; a < 5; a += 2) {
-        for(int b = 0; b < 2; b++) {
-            ret[a + b] = m0[a] * m1[b] + m0[a + 1] * m1[b + 2];
-        }
-    }
-    ret[4] += m1[4];
-    ret[5] += m1[5];
-    return ret;
+    return Matrix(m0[0] * m1[0] + m0[1] * m1[2],
+                  m0[0] * m1[1] + m0[1] * m1[3],
+                  m0[2] * m1[0] + m0[3] * m1[2],
+                  m0[2] * m1[1] + m0[3] * m1[3],
+                  m0[4] * m1[0] + m0[5] * m1[2] + m1[4],
+                  m0[4] * m1[1] + m0[5] * m1[3] + m1[5]);
 }
 
 Matrix operator/(Matrix const &a, Matrix const &b) { return a * b.inverse(); }
@@ -0,0 +1,266 @@
+/**
+ @author Contributions from the community; see CONTRIBUTORS.md
+ @date 2005-2016
+ @copyright MPL2; see LICENSE.txt
+*/
+
+// dkrender - converts saved drawings to PNG, JPEG, TIFF, PDF or SVG files without a window, using DKBatchRenderer.
+//
+// usage: dkrender [options] [document[=output] ...]
+//
+//	-f formats	comma separated extensions written for each document given without an output, default png
+//	-o dir		the directory those outputs are written to, default beside the document
+//	-l file		reads more "document[=output]" specs from a file, one per line, or from stdin if file is -
+//	-s scale	pixels per drawing unit for bitmap formats, default 1
+//	-j jobs		the most documents rendered at once by each process, default the number of processors
+//	-p procs	shares the documents between this many processes, default 1
+//	-t		leaves out the paper colour
+//
+// a line is printed for each document as it finishes, with tab separated fields:
+//
+//	ok|failed	load seconds	render seconds	write seconds	document	output	[reason]
+//
+// the exit status is 0 if every document was written, 1 if any failed and 2 for bad arguments.
+
+#import <Cocoa/Cocoa.h>
+#import <DKDrawKit/DKDrawKit.h>
+#include <unistd.h>
+
+@interface DKRenderReporter : NSObject
+@end
+
+@implementation DKRenderReporter
+
+- (void)batchRenderer:(DKBatchRenderer*)renderer didFinishJob:(DKBatchRenderJob*)job
+{
+#pragma unused(renderer)
+
+	// the renderer never calls this for two jobs at once, and each line is written whole, so the lines of several processes don't mix
+
+	NSString* line = [NSString stringWithFormat:@"%@\t%.3f\t%.3f\t%.3f\t%@\t%@%@%@\n",
+												[job succeeded] ? @"ok" : @"failed",
+												[job loadTime],
+												[job renderTime],
+												[job writeTime],
+												[[job documentURL] path],
+												[[job outputURL] path],
+												[job succeeded] ? @"" : @"\t",
+												[job succeeded] ? @"" : [job failureReason]];
+	NSData* data = [line dataUsingEncoding:NSUTF8StringEncoding];
+
+	write(STDOUT_FILENO, [data bytes], [data length]);
+}
+
+@end
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: dkrender [-f formats] [-o dir] [-l file] [-s scale] [-j jobs] [-p procs] [-t] [document[=output] ...]\n");
+	exit(2);
+}
+
+static NSURL* fileURL(NSString* path)
+{
+	return [NSURL fileURLWithPath:[path stringByStandardizingPath]];
+}
+
+// adds the jobs for one "document[=output]" spec
+
+static BOOL addJobsForSpec(NSString* spec, NSArray* formats, NSString* outputDir, CGFloat scale, BOOL paper, NSMutableArray* jobs)
+{
+	NSRange eq = [spec rangeOfString:@"="];
+	NSString* document = (eq.location == NSNotFound) ? spec : [spec substringToIndex:eq.location];
+	NSMutableArray* outputs = [NSMutableArray array];
+	DKBatchRenderFormat format;
+
+	if (eq.location != NSNotFound)
+		[outputs addObject:[spec substringFromIndex:NSMaxRange(eq)]];
+	else {
+		NSString* base = [[document lastPathComponent] stringByDeletingPathExtension];
+		NSString* dir = outputDir ? outputDir : [document stringByDeletingLastPathComponent];
+		NSEnumerator* iter = [formats objectEnumerator];
+		NSString* ext;
+
+		while ((ext = [iter nextObject]))
+			[outputs addObject:[[dir stringByAppendingPathComponent:base] stringByAppendingPathExtension:ext]];
+	}
+
+	NSEnumerator* iter = [outputs objectEnumerator];
+	NSString* output;
+
+	while ((output = [iter nextObject])) {
+		if (![DKBatchRenderJob getFormat:&format
+						forPathExtension:[output pathExtension]]) {
+			fprintf(stderr, "dkrender: can't tell what to write for %s\n", [output fileSystemRepresentation]);
+			return NO;
+		}
+
+		DKBatchRenderJob* job = [[DKBatchRenderJob alloc] initWithDocumentURL:fileURL(document)
+																	outputURL:fileURL(output)
+																	   format:format];
+		[job setScale:scale];
+		[job setDrawsPaper:paper];
+		[jobs addObject:job];
+		[job release];
+	}
+
+	return YES;
+}
+
+// runs a copy of this tool for each shard of the documents, and waits for them all. Returns the worst of their exit statuses
+
+static int runShards(NSUInteger processes, NSArray* arguments)
+{
+	NSString* tool = [[[NSProcessInfo processInfo] arguments] objectAtIndex:0];
+	NSMutableArray* tasks = [NSMutableArray array];
+	NSUInteger i;
+	int status = 0;
+
+	for (i = 0; i < processes; ++i) {
+		NSTask* task = [[NSTask alloc] init];
+
+		[task setLaunchPath:tool];
+		[task setArguments:[[NSArray arrayWithObjects:@"-S", [NSString stringWithFormat:@"%lu/%lu", (unsigned long)i, (unsigned long)processes], nil] arrayByAddingObjectsFromArray:arguments]];
+		[task launch];
+		[tasks addObject:task];
+		[task release];
+	}
+
+	NSEnumerator* iter = [tasks objectEnumerator];
+	NSTask* task;
+
+	while ((task = [iter nextObject])) {
+		[task waitUntilExit];
+		status = MAX(status, [task terminationStatus]);
+	}
+
+	return status;
+}
+
+int main(int argc, char* argv[])
+{
+	@autoreleasepool
+	{
+		NSArray* formats = [NSArray arrayWithObject:@"png"];
+		NSString* outputDir = nil;
+		NSMutableArray* specs = [NSMutableArray array];
+		NSMutableArray* forwarded = [NSMutableArray array];
+		CGFloat scale = 1.0;
+		BOOL paper = YES;
+		NSUInteger maxJobs = 0, processes = 1;
+		unsigned long shard = 0, shards = 1;
+		int ch;
+
+		while ((ch = getopt(argc, argv, "f:o:l:s:j:p:tS:")) != -1) {
+			NSString* arg = optarg ? [NSString stringWithUTF8String:optarg] : nil;
+
+			switch (ch) {
+			case 'f':
+				formats = [arg componentsSeparatedByString:@","];
+				break;
+
+			case 'o':
+				outputDir = arg;
+				break;
+
+			case 'l': {
+				NSFileHandle* fh = [arg isEqualToString:@"-"] ? [NSFileHandle fileHandleWithStandardInput] : [NSFileHandle fileHandleForReadingAtPath:arg];
+				NSString* list = fh ? [[[NSString alloc] initWithData:[fh readDataToEndOfFile]
+															 encoding:NSUTF8StringEncoding] autorelease]
+									: nil;
+
+				if (list == nil) {
+					fprintf(stderr, "dkrender: can't read the list %s\n", optarg);
+					return 2;
+				}
+
+				NSEnumerator* iter = [[list componentsSeparatedByCharactersInSet:[NSCharacterSet newlineCharacterSet]] objectEnumerator];
+				NSString* line;
+
+				while ((line = [iter nextObject])) {
+					line = [line stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+
+					if ([line length] > 0)
+						[specs addObject:line];
+				}
+
+				// shards read the specs from their arguments, as stdin can only be read once
+				continue;
+			}
+
+			case 's':
+				scale = [arg doubleValue];
+				if (scale <= 0)
+					usage();
+				break;
+
+			case 'j':
+				maxJobs = (NSUInteger)MAX(0, [arg integerValue]);
+				break;
+
+			case 'p':
+				processes = (NSUInteger)MAX(1, [arg integerValue]);
+				continue;
+
+			case 't':
+				paper = NO;
+				break;
+
+			case 'S':
+				if (sscanf(optarg, "%lu/%lu", &shard, &shards) != 2 || shards == 0 || shard >= shards)
+					usage();
+				continue;
+
+			default:
+				usage();
+			}
+
+			[forwarded addObject:[NSString stringWithFormat:@"-%c", ch]];
+
+			if (arg)
+				[forwarded addObject:arg];
+		}
+
+		for (ch = optind; ch < argc; ++ch)
+			[specs addObject:[NSString stringWithUTF8String:argv[ch]]];
+
+		if ([specs count] == 0)
+			usage();
+
+		if (processes > 1)
+			return runShards(processes, [forwarded arrayByAddingObjectsFromArray:specs]);
+
+		// this process's share of the documents is every <shards>th one, from the <shard>th
+
+		NSMutableArray* jobs = [NSMutableArray array];
+		NSUInteger i;
+
+		for (i = shard; i < [specs count]; i += shards) {
+			if (!addJobsForSpec([specs objectAtIndex:i], formats, outputDir, scale, paper, jobs))
+				return 2;
+		}
+
+		// styles read from the documents are kept to their own drawings, so the drawings can be rendered at the same time
+
+		[DKDrawing setInternsStylesWhenReading:NO];
+
+		DKBatchRenderer* renderer = [[DKBatchRenderer alloc] initWithJobs:jobs];
+		DKRenderReporter* reporter = [[DKRenderReporter alloc] init];
+		NSTimeInterval start = [NSDate timeIntervalSinceReferenceDate];
+
+		if (maxJobs > 0)
+			[renderer setMaximumConcurrentJobs:maxJobs];
+
+		[renderer setDelegate:reporter];
+
+		NSUInteger failed = [renderer run];
+
+		fprintf(stderr, "dkrender: %lu of %lu files written in %.3f seconds\n", (unsigned long)([jobs count] - failed), (unsigned long)[jobs count],
+				[NSDate timeIntervalSinceReferenceDate] - start);
+
+		[renderer release];
+		[reporter release];
+
+		return (failed > 0) ? 1 : 0;
+	}
+}